@@ -106,6 +106,10 @@ class MoveGroupCommander(object):
         """ Get the current configuration of the group as a list (these are values published on /joint_states) """
         return self._g.get_current_joint_values()
 
+    def get_current_joint_values_array(self):
+        """ Get the current configuration of the group as a NumPy array """
+        return self._g.get_current_joint_values_array()
+
     def get_current_pose(self, end_effector_link = ""):
         """ Get the current pose of the end-effector of the group. Throws an exception if there is not end-effector. """
         if len(end_effector_link) > 0 or self.has_end_effector_link():
@@ -158,6 +162,15 @@ class MoveGroupCommander(object):
     def get_joint_value_target(self):
         return self._g.get_joint_value_target()
 
+    def get_joint_value_target_array(self):
+        """ Get the joint value target of the group as a NumPy array """
+        return self._g.get_joint_value_target_array()
+
+    def get_jacobian_matrix(self, joint_values, reference_point = None):
+        """ Get the Jacobian of the last link of the group at the given joint values (list or NumPy array),
+        as a 6 x N NumPy array. The reference point is given in the frame of that link. """
+        return self._g.get_jacobian_matrix(joint_values, [0.0, 0.0, 0.0] if reference_point is None else reference_point)
+
     def set_joint_value_target(self, arg1, arg2 = None, arg3 = None):
         """
         Specify a target joint configuration for the group.
@@ -577,3 +590,8 @@ class MoveGroupCommander(object):
         traj_out = RobotTrajectory()
         traj_out.deserialize(ser_traj_out)
         return traj_out
+
+    def get_trajectory_arrays(self, traj):
+        """ Unpack the joint trajectory of a RobotTrajectory message into a dictionary of NumPy arrays with the keys
+        joint_names, time_from_start (N), positions, velocities, accelerations and effort (N x J, None if missing) """
+        return self._g.get_trajectory_arrays(conversions.msg_to_string(traj))
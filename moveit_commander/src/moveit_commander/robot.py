@@ -234,6 +234,20 @@ class RobotCommander(object):
         """
         return self._r.get_current_variable_values()
 
+    def get_current_variable_values_array(self):
+        """
+        Get a NumPy array of the current values of all variables of the robot model.
+        """
+        return self._r.get_current_variable_values_array()
+
+    def get_link_poses_array(self, group, links, joint_values):
+        """
+        Compute forward kinematics for many configurations at once.
+        @param joint_values: M x N NumPy array of values for the N variables of the group
+        @return: M x L x 7 NumPy array with the pose [x, y, z, qx, qy, qz, qw] of each of the L links
+        """
+        return self._r.get_link_poses_array(group, links, joint_values)
+
     def get_joint(self, name):
         """
         @param name str: Name of movegroup
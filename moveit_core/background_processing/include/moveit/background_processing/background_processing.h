@@ -39,6 +39,7 @@
 
 #include <deque>
 #include <string>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
@@ -53,9 +54,14 @@ namespace tools
 {
 /** \brief This class provides simple API for executing background
     jobs. A queue of jobs is created and the specified jobs are
-    executed in order, one at a time. */
+    executed in order, one at a time. Jobs of higher priority are
+    executed before jobs of lower priority. Optionally, several
+    worker threads execute jobs concurrently. */
 class BackgroundProcessing : private boost::noncopyable
 {
+private:
+  struct Job;
+
 public:
   /** \brief Events for jobs */
   enum JobEvent
@@ -72,11 +78,36 @@ public:
    * the job */
   typedef boost::function<void(JobEvent, const std::string&)> JobUpdateCallback;
 
+  /** \brief Priorities of jobs */
+  enum JobPriority
+  {
+    LOW,
+    NORMAL,
+    HIGH,
+    PRIORITY_COUNT
+  };
+
   /** \brief The signature for job callbacks */
   typedef boost::function<void()> JobCallback;
 
-  /** \brief Constructor. The background thread is activated automatically. */
-  BackgroundProcessing();
+  /** \brief Refers to a job added to the queue, so it can be cancelled */
+  class JobHandle
+  {
+  public:
+    /** \brief Check if the handle refers to a job */
+    bool valid() const
+    {
+      return job_ != nullptr;
+    }
+
+  private:
+    friend class BackgroundProcessing;
+    std::shared_ptr<Job> job_;
+  };
+
+  /** \brief Constructor. The background threads (at least one) are activated automatically. With more than one
+      thread, jobs are started in order but may run concurrently. */
+  BackgroundProcessing(unsigned int threads = 1);
 
   /** \brief Finishes currently executing job, clears the remaining queue. */
   ~BackgroundProcessing();
@@ -84,9 +115,23 @@ public:
   /** \brief Add a job to the queue of jobs to execute. A name is also specifies for the job */
   void addJob(const JobCallback& job, const std::string& name);
 
-  /** \brief Get the size of the queue of jobs (includes currently processed job). */
+  /** \brief Add a job with \e priority to the queue of jobs to execute. If \e coalesce is true and a job with the same
+      name is still waiting in the queue, it is replaced by this job. */
+  JobHandle addJob(const JobCallback& job, const std::string& name, JobPriority priority, bool coalesce = false);
+
+  /** \brief Remove the job referred to by \e handle from the queue. Returns false if the job already started or was
+      removed before. */
+  bool cancelJob(const JobHandle& handle);
+
+  /** \brief Get the size of the queue of jobs (includes currently processed jobs). */
   std::size_t getJobCount() const;
 
+  /** \brief Get the number of worker threads */
+  std::size_t getThreadCount() const
+  {
+    return processing_threads_.size();
+  }
+
   /** \brief Clear the queue of jobs */
   void clear();
 
@@ -97,17 +142,30 @@ public:
   void clearJobUpdateEvent();
 
 private:
-  std::unique_ptr<boost::thread> processing_thread_;
+  /** \brief A job waiting in the queue */
+  struct Job
+  {
+    JobCallback fn;
+    std::string name;
+    JobPriority priority;
+  };
+
+  std::vector<std::unique_ptr<boost::thread> > processing_threads_;
   bool run_processing_thread_;
 
   mutable boost::mutex action_lock_;
   boost::condition_variable new_action_condition_;
-  std::deque<JobCallback> actions_;
-  std::deque<std::string> action_names_;
+
+  /** \brief The queued jobs of each priority, in order */
+  std::deque<std::shared_ptr<Job> > actions_[PRIORITY_COUNT];
 
   JobUpdateCallback queue_change_event_;
 
-  bool processing_;
+  /** \brief The number of jobs being executed */
+  std::size_t processing_;
+
+  /** \brief Remove \e job from the queue; returns false if it is not queued */
+  bool removeJob(const std::shared_ptr<Job>& job);
 
   void processingThread();
 };
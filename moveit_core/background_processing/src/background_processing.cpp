@@ -36,95 +36,174 @@
 
 #include <moveit/background_processing/background_processing.h>
 #include <ros/console.h>
+#include <algorithm>
 
 namespace moveit
 {
 namespace tools
 {
-BackgroundProcessing::BackgroundProcessing()
+BackgroundProcessing::BackgroundProcessing(unsigned int threads)
 {
-  // spin a thread that will process user events
+  // spin the threads that will process user events
   run_processing_thread_ = true;
-  processing_ = false;
-  processing_thread_.reset(new boost::thread(boost::bind(&BackgroundProcessing::processingThread, this)));
+  processing_ = 0;
+  processing_threads_.resize(std::max(threads, 1u));
+  for (std::size_t i = 0; i < processing_threads_.size(); ++i)
+    processing_threads_[i].reset(new boost::thread(boost::bind(&BackgroundProcessing::processingThread, this)));
 }
 
 BackgroundProcessing::~BackgroundProcessing()
 {
-  run_processing_thread_ = false;
+  {
+    boost::mutex::scoped_lock _(action_lock_);
+    run_processing_thread_ = false;
+  }
   new_action_condition_.notify_all();
-  processing_thread_->join();
+  for (std::size_t i = 0; i < processing_threads_.size(); ++i)
+    processing_threads_[i]->join();
 }
 
 void BackgroundProcessing::processingThread()
 {
   boost::unique_lock<boost::mutex> ulock(action_lock_);
 
-  while (run_processing_thread_)
+  while (true)
   {
-    while (actions_.empty() && run_processing_thread_)
+    // the queue with the highest priority that has jobs
+    int queue = PRIORITY_COUNT - 1;
+    while (queue >= 0 && actions_[queue].empty())
+      --queue;
+    if (queue < 0)
+    {
+      if (!run_processing_thread_)
+        break;
       new_action_condition_.wait(ulock);
+      continue;
+    }
+
+    std::shared_ptr<Job> job = actions_[queue].front();
+    actions_[queue].pop_front();
+    JobCallback fn;
+    fn.swap(job->fn);
+    std::string action_name = job->name;
+    ++processing_;
 
-    while (!actions_.empty())
+    // make sure we are unlocked while we process the event
+    action_lock_.unlock();
+    try
+    {
+      ROS_DEBUG_NAMED("background_processing", "Begin executing '%s'", action_name.c_str());
+      fn();
+      ROS_DEBUG_NAMED("background_processing", "Done executing '%s'", action_name.c_str());
+    }
+    catch (std::exception& ex)
     {
-      JobCallback fn = actions_.front();
-      std::string action_name = action_names_.front();
-      actions_.pop_front();
-      action_names_.pop_front();
-      processing_ = true;
-
-      // make sure we are unlocked while we process the event
-      action_lock_.unlock();
-      try
-      {
-        ROS_DEBUG_NAMED("background_processing", "Begin executing '%s'", action_name.c_str());
-        fn();
-        ROS_DEBUG_NAMED("background_processing", "Done executing '%s'", action_name.c_str());
-      }
-      catch (std::exception& ex)
-      {
-        ROS_ERROR_NAMED("background_processing", "Exception caught while processing action '%s': %s",
-                        action_name.c_str(), ex.what());
-      }
-      processing_ = false;
-      if (queue_change_event_)
-        queue_change_event_(COMPLETE, action_name);
-      action_lock_.lock();
+      ROS_ERROR_NAMED("background_processing", "Exception caught while processing action '%s': %s",
+                      action_name.c_str(), ex.what());
     }
+    action_lock_.lock();
+    --processing_;
+    action_lock_.unlock();
+    if (queue_change_event_)
+      queue_change_event_(COMPLETE, action_name);
+    action_lock_.lock();
   }
 }
 
 void BackgroundProcessing::addJob(const boost::function<void()>& job, const std::string& name)
 {
+  addJob(job, name, NORMAL);
+}
+
+BackgroundProcessing::JobHandle BackgroundProcessing::addJob(const JobCallback& job, const std::string& name,
+                                                             JobPriority priority, bool coalesce)
+{
+  JobHandle handle;
+  handle.job_.reset(new Job());
+  handle.job_->fn = job;
+  handle.job_->name = name;
+  handle.job_->priority = priority;
+
+  bool replaced = false;
   {
     boost::mutex::scoped_lock _(action_lock_);
-    actions_.push_back(job);
-    action_names_.push_back(name);
-    new_action_condition_.notify_all();
+    bool queued = false;
+    if (coalesce)
+      for (int p = 0; p < PRIORITY_COUNT && !replaced; ++p)
+        for (std::size_t i = 0; i < actions_[p].size() && !replaced; ++i)
+          if (actions_[p][i]->name == name)
+          {
+            replaced = true;
+            // a waiting job of the same priority is replaced in place, so the new job does not lose its turn
+            if (p == priority)
+            {
+              actions_[p][i] = handle.job_;
+              queued = true;
+            }
+            else
+              actions_[p].erase(actions_[p].begin() + i);
+          }
+    if (!queued)
+      actions_[priority].push_back(handle.job_);
+    new_action_condition_.notify_one();
   }
   if (queue_change_event_)
+  {
+    if (replaced)
+      queue_change_event_(REMOVE, name);
     queue_change_event_(ADD, name);
+  }
+  return handle;
+}
+
+bool BackgroundProcessing::removeJob(const std::shared_ptr<Job>& job)
+{
+  std::deque<std::shared_ptr<Job> >& queue = actions_[job->priority];
+  std::deque<std::shared_ptr<Job> >::iterator it = std::find(queue.begin(), queue.end(), job);
+  if (it == queue.end())
+    return false;
+  queue.erase(it);
+  return true;
+}
+
+bool BackgroundProcessing::cancelJob(const JobHandle& handle)
+{
+  if (!handle.job_)
+    return false;
+  {
+    boost::mutex::scoped_lock _(action_lock_);
+    if (!removeJob(handle.job_))
+      return false;
+  }
+  if (queue_change_event_)
+    queue_change_event_(REMOVE, handle.job_->name);
+  return true;
 }
 
 void BackgroundProcessing::clear()
 {
-  bool update = false;
-  std::deque<std::string> removed;
+  std::vector<std::string> removed;
   {
     boost::mutex::scoped_lock _(action_lock_);
-    update = !actions_.empty();
-    actions_.clear();
-    action_names_.swap(removed);
+    for (int p = PRIORITY_COUNT - 1; p >= 0; --p)
+    {
+      for (std::size_t i = 0; i < actions_[p].size(); ++i)
+        removed.push_back(actions_[p][i]->name);
+      actions_[p].clear();
+    }
   }
-  if (update && queue_change_event_)
-    for (std::deque<std::string>::iterator it = removed.begin(); it != removed.end(); ++it)
-      queue_change_event_(REMOVE, *it);
+  if (queue_change_event_)
+    for (std::size_t i = 0; i < removed.size(); ++i)
+      queue_change_event_(REMOVE, removed[i]);
 }
 
 std::size_t BackgroundProcessing::getJobCount() const
 {
   boost::mutex::scoped_lock _(action_lock_);
-  return actions_.size() + (processing_ ? 1 : 0);
+  std::size_t count = processing_;
+  for (int p = 0; p < PRIORITY_COUNT; ++p)
+    count += actions_[p].size();
+  return count;
 }
 
 void BackgroundProcessing::setJobUpdateEvent(const JobUpdateCallback& event)
@@ -0,0 +1,344 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Microbenchmarks of the hot paths of moveit_core on the PR2 and Panda models of moveit_resources.
+   Use --benchmark_filter=<regex> to select benchmarks and --benchmark_out=<file>.json --benchmark_out_format=json
+   to store machine-readable results for comparisons between commits. */
+
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/collision_detection_fcl/collision_world_fcl.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit_resources/config.h>
+
+#include <geometric_shapes/shapes.h>
+#include <urdf_parser/urdf_parser.h>
+#include <octomap/octomap.h>
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+#include <random_numbers/random_numbers.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+#include "pr2_arm_kinematics_plugin.h"
+
+namespace
+{
+// number of precomputed random states the benchmarks cycle through
+const std::size_t STATE_COUNT = 256;
+
+struct TestModel
+{
+  std::string name_;
+  std::string group_;
+  std::string tip_;
+  robot_model::RobotModelPtr model_;
+  planning_scene::PlanningScenePtr scene_;
+  std::vector<std::vector<double> > states_;
+};
+
+bool readFile(const boost::filesystem::path& path, std::string& content)
+{
+  std::ifstream file(path.string().c_str());
+  if (!file.is_open())
+    return false;
+  content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool loadTestModel(const std::string& name, const std::string& urdf_file, const std::string& srdf_file,
+                   const std::string& group, const std::string& tip, TestModel& result)
+{
+  boost::filesystem::path res_path(MOVEIT_TEST_RESOURCES_DIR);
+  std::string urdf_string, srdf_string;
+  if (!readFile(res_path / urdf_file, urdf_string) || !readFile(res_path / srdf_file, srdf_string))
+    return false;
+
+  urdf::ModelInterfaceSharedPtr urdf_model = urdf::parseURDF(urdf_string);
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  if (!urdf_model || !srdf_model->initString(*urdf_model, srdf_string))
+    return false;
+
+  result.name_ = name;
+  result.group_ = group;
+  result.tip_ = tip;
+  result.model_.reset(new robot_model::RobotModel(urdf_model, srdf_model));
+  if (!result.model_->hasJointModelGroup(group) || !result.model_->hasLinkModel(tip))
+    return false;
+  result.scene_.reset(new planning_scene::PlanningScene(result.model_));
+
+  // the same sequence of states in every run of the benchmarks, so results are comparable between runs
+  random_numbers::RandomNumberGenerator rng(42);
+  robot_state::RobotState state(result.model_);
+  state.setToDefaultValues();
+  result.states_.resize(STATE_COUNT);
+  for (std::size_t i = 0; i < STATE_COUNT; ++i)
+  {
+    state.setToRandomPositions(result.model_->getJointModelGroup(group), rng);
+    result.states_[i].assign(state.getVariablePositions(), state.getVariablePositions() + state.getVariableCount());
+  }
+  return true;
+}
+
+void BM_UpdateLinkTransforms(benchmark::State& bstate, const TestModel* m)
+{
+  robot_state::RobotState state(m->model_);
+  std::size_t i = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setVariablePositions(m->states_[i++ % STATE_COUNT]);
+    state.updateLinkTransforms();
+  }
+}
+
+void BM_GetJacobian(benchmark::State& bstate, const TestModel* m)
+{
+  const robot_model::JointModelGroup* jmg = m->model_->getJointModelGroup(m->group_);
+  const robot_model::LinkModel* tip = m->model_->getLinkModel(m->tip_);
+  robot_state::RobotState state(m->model_);
+  Eigen::MatrixXd jacobian;
+  std::size_t i = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setVariablePositions(m->states_[i++ % STATE_COUNT]);
+    state.updateLinkTransforms();
+    state.getJacobian(jmg, tip, Eigen::Vector3d::Zero(), jacobian);
+    benchmark::DoNotOptimize(jacobian.data());
+  }
+}
+
+void BM_CheckSelfCollision(benchmark::State& bstate, const TestModel* m)
+{
+  collision_detection::CollisionRobotFCL crobot(m->model_);
+  const collision_detection::AllowedCollisionMatrix& acm = m->scene_->getAllowedCollisionMatrix();
+  collision_detection::CollisionRequest req;
+  robot_state::RobotState state(m->model_);
+  std::size_t i = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setVariablePositions(m->states_[i++ % STATE_COUNT]);
+    state.updateCollisionBodyTransforms();
+    collision_detection::CollisionResult res;
+    crobot.checkSelfCollision(req, res, state, acm);
+    benchmark::DoNotOptimize(res.collision);
+  }
+}
+
+// collision of the robot with an octomap of bstate.range(0) random occupied cells around the robot
+void BM_CheckOctomapCollision(benchmark::State& bstate, const TestModel* m)
+{
+  std::shared_ptr<octomap::OcTree> tree(new octomap::OcTree(0.02));
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> coord(-1.5, 1.5);
+  for (long i = 0; i < bstate.range(0); ++i)
+    tree->updateNode(octomap::point3d(coord(gen), coord(gen), coord(gen) + 1.5), true);
+  tree->updateInnerOccupancy();
+
+  collision_detection::WorldPtr world(new collision_detection::World());
+  world->addToObject("<octomap>", shapes::ShapeConstPtr(new shapes::OcTree(tree)), Eigen::Affine3d::Identity());
+  collision_detection::CollisionWorldFCL cworld(world);
+  collision_detection::CollisionRobotFCL crobot(m->model_);
+  const collision_detection::AllowedCollisionMatrix& acm = m->scene_->getAllowedCollisionMatrix();
+  collision_detection::CollisionRequest req;
+  robot_state::RobotState state(m->model_);
+  std::size_t i = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setVariablePositions(m->states_[i++ % STATE_COUNT]);
+    state.updateCollisionBodyTransforms();
+    collision_detection::CollisionResult res;
+    cworld.checkRobotCollision(req, res, crobot, state, acm);
+    benchmark::DoNotOptimize(res.collision);
+  }
+}
+
+// a pose constraint on the tip combined with joint constraints for all joints of the group
+void BM_KinematicConstraintSetDecide(benchmark::State& bstate, const TestModel* m)
+{
+  const robot_model::JointModelGroup* jmg = m->model_->getJointModelGroup(m->group_);
+  robot_state::RobotState state(m->model_);
+  state.setVariablePositions(m->states_[0]);
+  state.update();
+
+  geometry_msgs::PoseStamped pose;
+  pose.header.frame_id = m->model_->getModelFrame();
+  const Eigen::Affine3d& t = state.getGlobalLinkTransform(m->tip_);
+  Eigen::Quaterniond q(t.linear());
+  pose.pose.position.x = t.translation().x();
+  pose.pose.position.y = t.translation().y();
+  pose.pose.position.z = t.translation().z();
+  pose.pose.orientation.x = q.x();
+  pose.pose.orientation.y = q.y();
+  pose.pose.orientation.z = q.z();
+  pose.pose.orientation.w = q.w();
+  moveit_msgs::Constraints constraints = kinematic_constraints::mergeConstraints(
+      kinematic_constraints::constructGoalConstraints(m->tip_, pose, 0.01, 0.01),
+      kinematic_constraints::constructGoalConstraints(state, jmg, 0.1));
+
+  robot_state::Transforms tf(m->model_->getModelFrame());
+  kinematic_constraints::KinematicConstraintSet kset(m->model_);
+  kset.add(constraints, tf);
+  std::size_t i = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setVariablePositions(m->states_[i++ % STATE_COUNT]);
+    state.update();
+    benchmark::DoNotOptimize(kset.decide(state).satisfied);
+  }
+}
+
+// adding bstate.range(0) random points to an empty 2m x 2m x 2m field with 2cm resolution
+void BM_PropagationDistanceFieldAddPoints(benchmark::State& bstate)
+{
+  distance_field::PropagationDistanceField df(2.0, 2.0, 2.0, 0.02, -1.0, -1.0, -1.0, 0.3);
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> coord(-1.0, 1.0);
+  EigenSTL::vector_Vector3d points(bstate.range(0));
+  for (std::size_t i = 0; i < points.size(); ++i)
+    points[i] = Eigen::Vector3d(coord(gen), coord(gen), coord(gen));
+
+  while (bstate.KeepRunning())
+  {
+    bstate.PauseTiming();
+    df.reset();
+    bstate.ResumeTiming();
+    df.addPointsToField(points);
+  }
+  bstate.SetItemsProcessed(bstate.iterations() * points.size());
+}
+
+// time parameterization of a trajectory of bstate.range(0) random waypoints
+void BM_ComputeTimeStamps(benchmark::State& bstate, const TestModel* m)
+{
+  robot_trajectory::RobotTrajectory trajectory(m->model_, m->group_);
+  robot_state::RobotState state(m->model_);
+  for (long i = 0; i < bstate.range(0); ++i)
+  {
+    state.setVariablePositions(m->states_[i % STATE_COUNT]);
+    trajectory.addSuffixWayPoint(state, 0.0);
+  }
+
+  trajectory_processing::IterativeParabolicTimeParameterization time_param;
+  while (bstate.KeepRunning())
+  {
+    bstate.PauseTiming();
+    robot_trajectory::RobotTrajectory copy(trajectory);
+    bstate.ResumeTiming();
+    time_param.computeTimeStamps(copy);
+  }
+}
+
+// IK of the PR2 right arm through RobotState::setFromIK(), for poses reached by random states
+void BM_SetFromIK(benchmark::State& bstate, const TestModel* m, urdf::ModelInterfaceSharedPtr urdf_model)
+{
+  pr2_arm_kinematics::PR2ArmKinematicsPluginPtr solver(new pr2_arm_kinematics::PR2ArmKinematicsPlugin);
+  solver->setRobotModel(urdf_model);
+  solver->initialize("", m->group_, "torso_lift_link", m->tip_, .01);
+  const robot_model::JointModelGroup* jmg = m->model_->getJointModelGroup(m->group_);
+  std::map<std::string, robot_model::SolverAllocatorFn> allocators;
+  allocators[m->group_] = [solver](const robot_model::JointModelGroup*) { return solver; };
+  m->model_->setKinematicsAllocators(allocators);
+
+  robot_state::RobotState state(m->model_);
+  EigenSTL::vector_Affine3d poses(STATE_COUNT);
+  for (std::size_t i = 0; i < STATE_COUNT; ++i)
+  {
+    state.setVariablePositions(m->states_[i]);
+    poses[i] = state.getGlobalLinkTransform(m->tip_);
+  }
+
+  std::vector<double> seed;
+  state.setToDefaultValues();
+  state.copyJointGroupPositions(jmg, seed);
+  std::size_t i = 0, solved = 0;
+  while (bstate.KeepRunning())
+  {
+    state.setJointGroupPositions(jmg, seed);
+    if (state.setFromIK(jmg, poses[i++ % STATE_COUNT], m->tip_, 1, 0.1))
+      ++solved;
+  }
+  bstate.counters["success_rate"] = bstate.iterations() ? (double)solved / bstate.iterations() : 0.0;
+}
+
+void registerModelBenchmarks(const TestModel* m)
+{
+  benchmark::RegisterBenchmark(("UpdateLinkTransforms/" + m->name_).c_str(), BM_UpdateLinkTransforms, m);
+  benchmark::RegisterBenchmark(("GetJacobian/" + m->name_).c_str(), BM_GetJacobian, m);
+  benchmark::RegisterBenchmark(("CheckSelfCollision/" + m->name_).c_str(), BM_CheckSelfCollision, m);
+  benchmark::RegisterBenchmark(("CheckOctomapCollision/" + m->name_).c_str(), BM_CheckOctomapCollision, m)
+      ->Arg(1000)
+      ->Arg(10000);
+  benchmark::RegisterBenchmark(("KinematicConstraintSetDecide/" + m->name_).c_str(), BM_KinematicConstraintSetDecide,
+                               m);
+  benchmark::RegisterBenchmark(("ComputeTimeStamps/" + m->name_).c_str(), BM_ComputeTimeStamps, m)->Arg(10)->Arg(100);
+}
+}
+
+int main(int argc, char** argv)
+{
+  TestModel pr2, panda;
+  if (!loadTestModel("pr2", "pr2_description/urdf/robot.xml", "pr2_description/srdf/robot.xml", "right_arm",
+                     "r_wrist_roll_link", pr2))
+  {
+    std::cerr << "Unable to load the PR2 model from " << MOVEIT_TEST_RESOURCES_DIR << std::endl;
+    return 1;
+  }
+  registerModelBenchmarks(&pr2);
+
+  std::string pr2_urdf;
+  readFile(boost::filesystem::path(MOVEIT_TEST_RESOURCES_DIR) / "pr2_description/urdf/robot.xml", pr2_urdf);
+  benchmark::RegisterBenchmark("SetFromIK/pr2", BM_SetFromIK, &pr2, urdf::parseURDF(pr2_urdf));
+
+  // the Panda model is only part of recent versions of moveit_resources
+  if (loadTestModel("panda", "panda_description/urdf/panda.urdf", "panda_moveit_config/config/panda.srdf",
+                    "panda_arm", "panda_link8", panda))
+    registerModelBenchmarks(&panda);
+  else
+    std::cerr << "Panda model not found, running only the PR2 benchmarks" << std::endl;
+
+  benchmark::RegisterBenchmark("PropagationDistanceFieldAddPoints", BM_PropagationDistanceFieldAddPoints)
+      ->Arg(1000)
+      ->Arg(10000);
+
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -181,6 +181,7 @@ struct CollisionRequest
     , max_contacts_per_pair(1)
     , max_cost_sources(1)
     , min_cost_density(0.2)
+    , bounding_sphere_prefilter(true)
     , verbose(false)
   {
   }
@@ -216,10 +217,59 @@ struct CollisionRequest
   /** \brief Function call that decides whether collision detection should stop. */
   boost::function<bool(const CollisionResult&)> is_done;
 
+  /** \brief If true, pairs of bodies whose bounding spheres do not overlap are rejected before the exact (narrowphase)
+   * check. This only skips work that cannot find a collision; it is supported by the FCL plugin */
+  bool bounding_sphere_prefilter;
+
   /** \brief Flag indicating whether information about detected collisions should be reported */
   bool verbose;
 };
 
+/** \brief Representation of a collision checking request that only asks whether there is a collision, for callers
+ * that check many states (e.g., the state validity checkers of planners). Unlike CollisionRequest, it holds no
+ * strings or functions, and the group is given by pointer, so no lookup by name is needed */
+struct BooleanCollisionRequest
+{
+  BooleanCollisionRequest() : group(nullptr), bounding_sphere_prefilter(true)
+  {
+  }
+
+  /** \brief The group to check collisions for (optional; if NULL, the complete robot is checked) */
+  const robot_model::JointModelGroup* group;
+
+  /** \brief Same as CollisionRequest::bounding_sphere_prefilter */
+  bool bounding_sphere_prefilter;
+};
+
+/** \brief Representation of the result of a BooleanCollisionRequest. It only holds plain values, so filling it
+ * does not touch the heap. The first pair of bodies found in collision is identified by integer ids: for a robot link,
+ * the id is the index of the link (LinkModel::getLinkIndex()); for an attached body, it is the index of the link the
+ * body is attached to; world objects have no integer id and are reported as -1 */
+struct BooleanCollisionResult
+{
+  BooleanCollisionResult()
+  {
+    clear();
+  }
+
+  /** \brief Clear a previously stored result */
+  void clear()
+  {
+    collision = false;
+    body_ids[0] = body_ids[1] = -1;
+    body_types[0] = body_types[1] = BodyTypes::WORLD_OBJECT;
+  }
+
+  /** \brief True if collision was found, false otherwise */
+  bool collision;
+
+  /** \brief The ids of the first pair of bodies found in collision, if there is a collision */
+  int body_ids[2];
+
+  /** \brief The types of the first pair of bodies found in collision, if there is a collision */
+  BodyType body_types[2];
+};
+
 namespace DistanceRequestTypes
 {
 enum DistanceRequestType
@@ -41,10 +41,12 @@
 #include <moveit/macros/class_forward.h>
 #include <moveit_msgs/AllowedCollisionMatrix.h>
 #include <boost/function.hpp>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 
 namespace collision_detection
 {
@@ -73,6 +75,52 @@ enum Type
 typedef boost::function<bool(collision_detection::Contact&)> DecideContactFn;
 
 MOVEIT_CLASS_FORWARD(AllowedCollisionMatrix);
+MOVEIT_CLASS_FORWARD(CompiledAllowedCollisionMatrix);
+
+/** @class CompiledAllowedCollisionMatrix
+ *  @brief Dense form of an AllowedCollisionMatrix for the links of one robot model, indexed by link index.
+ *   It is obtained with AllowedCollisionMatrix::getCompiled() and used while checking collisions, so that pairs of
+ *   links are not looked up by name. Other elements, as well as the predicates of conditionally allowed collisions,
+ *   are still looked up by name in the AllowedCollisionMatrix. */
+class CompiledAllowedCollisionMatrix
+{
+public:
+  /** @brief Compile the entries of \e acm for all pairs of links of \e model */
+  CompiledAllowedCollisionMatrix(const AllowedCollisionMatrix& acm, const robot_model::RobotModelConstPtr& model);
+
+  /** @brief Check whether the matrix was compiled for \e model */
+  bool isCompiledFor(const robot_model::RobotModelConstPtr& model) const
+  {
+    return !model_.owner_before(model) && !model.owner_before(model_);
+  }
+
+  /** @brief Check whether \e link belongs to the model the matrix was compiled for */
+  bool hasLink(const robot_model::LinkModel* link) const
+  {
+    const std::size_t index = link->getLinkIndex();
+    return index < links_.size() && links_[index] == link;
+  }
+
+  /** @brief Same as AllowedCollisionMatrix::getAllowedCollision(), for two links for which hasLink() is true */
+  bool getAllowedCollision(const robot_model::LinkModel* link1, const robot_model::LinkModel* link2,
+                           AllowedCollision::Type& allowed_collision) const
+  {
+    const unsigned char entry = entries_[link1->getLinkIndex() * links_.size() + link2->getLinkIndex()];
+    if (entry == NO_ENTRY)
+      return false;
+    allowed_collision = static_cast<AllowedCollision::Type>(entry);
+    return true;
+  }
+
+private:
+  static const unsigned char NO_ENTRY = 255;
+
+  std::weak_ptr<const robot_model::RobotModel> model_;
+  std::vector<const robot_model::LinkModel*> links_;
+
+  /** @brief The AllowedCollision::Type of every pair of links, or NO_ENTRY; row-major, indexed by link index */
+  std::vector<unsigned char> entries_;
+};
 
 /** @class AllowedCollisionMatrix
  *  @brief Definition of a structure for the allowed collision matrix. All elements in the collision world are referred
@@ -270,12 +318,35 @@ public:
   /** @brief Print the allowed collision matrix */
   void print(std::ostream& out) const;
 
+  /** @brief Get the compiled form of this matrix for the links of \e model. It is built on first use and kept until
+   * the matrix is modified */
+  CompiledAllowedCollisionMatrixConstPtr getCompiled(const robot_model::RobotModelConstPtr& model) const;
+
+  /** @brief The version of the matrix, incremented by every modification. Copies start with the version of the
+   * matrix they were copied from */
+  std::uint64_t getVersion() const
+  {
+    return version_;
+  }
+
 private:
+  /** @brief Drop the compiled matrix and increment the version; called by all modifications */
+  void markModified()
+  {
+    compiled_.reset();
+    ++version_;
+  }
+
   std::map<std::string, std::map<std::string, AllowedCollision::Type> > entries_;
   std::map<std::string, std::map<std::string, DecideContactFn> > allowed_contacts_;
 
   std::map<std::string, AllowedCollision::Type> default_entries_;
   std::map<std::string, DecideContactFn> default_allowed_contacts_;
+
+  /** @brief Cached result of getCompiled(); reset by all modifications of the matrix */
+  mutable CompiledAllowedCollisionMatrixConstPtr compiled_;
+
+  std::uint64_t version_;
 };
 }
 
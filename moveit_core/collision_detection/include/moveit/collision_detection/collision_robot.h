@@ -106,6 +106,17 @@ public:
                                   const robot_state::RobotState& state1, const robot_state::RobotState& state2,
                                   const AllowedCollisionMatrix& acm) const = 0;
 
+  /** \brief Check only whether there is a self collision, like checkSelfCollision(). The default implementation
+   *   forwards to checkSelfCollision() and does not report the colliding pair; detectors override it with a
+   *   query that does not touch the heap.
+   *  @param req A BooleanCollisionRequest object that encapsulates the collision request
+   *  @param res A BooleanCollisionResult object that encapsulates the collision result
+   *  @param state The kinematic state for which checks are being made
+   *  @param acm The allowed collision matrix. */
+  virtual void checkSelfCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                         const robot_state::RobotState& state,
+                                         const AllowedCollisionMatrix& acm) const;
+
   /** \brief Check for collision with a different robot (possibly a different kinematic model as well).
    *  Any collision between any pair of links is checked for, NO collisions are ignored.
    *  @param req A CollisionRequest object that encapsulates the collision request
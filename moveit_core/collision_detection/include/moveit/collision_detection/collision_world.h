@@ -155,6 +155,33 @@ public:
                                    const robot_state::RobotState& state1, const robot_state::RobotState& state2,
                                    const AllowedCollisionMatrix& acm) const = 0;
 
+  /** \brief Check only whether the robot model is in collision with the world, like checkRobotCollision(). The
+   *  default implementation forwards to checkRobotCollision() and does not report the colliding pair; detectors
+   *  override it with a query that does not touch the heap.
+   *  @param req A BooleanCollisionRequest object that encapsulates the collision request
+   *  @param res A BooleanCollisionResult object that encapsulates the collision result
+   *  @robot robot The collision model for the robot
+   *  @param state The kinematic state for which checks are being made
+   *  @param acm The allowed collision matrix. */
+  virtual void checkRobotCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                          const CollisionRobot& robot, const robot_state::RobotState& state,
+                                          const AllowedCollisionMatrix& acm) const;
+
+  /** \brief Check a batch of independent robot states for collision with the world, like checkRobotCollision().
+   *  Allowed collisions are ignored. Self collisions are not checked. The default implementation checks the states
+   *  one at a time, on up to \e thread_count threads (0 means one per hardware thread); detectors that can check
+   *  many configurations at once override it.
+   *  @param req A CollisionRequest object that encapsulates the collision request
+   *  @param results Resized to the number of states; results[i] is filled with the result for states[i]
+   *  @robot robot The collision model for the robot
+   *  @param states The kinematic states for which checks are being made, with up to date collision body transforms
+   *  @param acm The allowed collision matrix.
+   *  @param thread_count The maximum number of threads to use */
+  virtual void checkRobotCollisionBatch(const CollisionRequest& req, std::vector<CollisionResult>& results,
+                                        const CollisionRobot& robot,
+                                        const std::vector<const robot_state::RobotState*>& states,
+                                        const AllowedCollisionMatrix& acm, unsigned int thread_count) const;
+
   /** \brief Check whether a given set of objects is in collision with objects from another world.
    *  Any contacts are considered.
    *  @param req A CollisionRequest object that encapsulates the collision request
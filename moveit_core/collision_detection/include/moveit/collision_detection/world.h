@@ -39,6 +39,7 @@
 
 #include <moveit/macros/class_forward.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -130,6 +131,14 @@ public:
   {
     return objects_.size();
   }
+
+  /** \brief The version of the objects, incremented with every change. A copy of the world starts with the version
+   *  of the original, so equal versions of a world and its copies mean equal objects until either is changed. */
+  std::uint64_t getVersion() const
+  {
+    return version_;
+  }
+
   /** find changes for a named object */
   const_iterator find(const std::string& id) const
   {
@@ -263,6 +272,9 @@ private:
   /** The objects maintained in the world */
   std::map<std::string, ObjectPtr> objects_;
 
+  /** Incremented by notify(), through which every change goes */
+  std::uint64_t version_;
+
   /* observers to call when something changes */
   class Observer
   {
@@ -0,0 +1,163 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_COLLISION_DETECTION_WORLD_INDEX_
+#define MOVEIT_COLLISION_DETECTION_WORLD_INDEX_
+
+#include <moveit/collision_detection/world.h>
+#include <moveit/robot_model/aabb.h>
+#include <moveit/macros/class_forward.h>
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+namespace collision_detection
+{
+MOVEIT_CLASS_FORWARD(WorldIndex);
+
+/** \brief Maintain a dynamic AABB tree over the bounds of the objects in a World, so that region and nearest object
+ * queries do not need to visit every object.
+ *
+ * The index follows the changes of the world through its observer mechanism. Every change increments a version,
+ * and the regions affected by recent changes can be retrieved by version. Like the world itself, the index is not
+ * thread safe: it must not be queried while the world is being changed. */
+class WorldIndex : private boost::noncopyable
+{
+public:
+  /** \brief Constructor */
+  WorldIndex();
+
+  /** \brief Constructor. Index all objects in \e world and follow its changes. */
+  WorldIndex(const WorldPtr& world);
+
+  ~WorldIndex();
+
+  /** \brief Set which world to index. Indexes all objects in \e world and discards the previous index. */
+  void setWorld(const WorldPtr& world);
+
+  /** \brief Stop following the world and discard the index */
+  void reset();
+
+  /** \brief The number of indexed objects. Objects without shapes are not indexed. */
+  std::size_t size() const
+  {
+    return leaves_.size();
+  }
+
+  /** \brief Get the bounds of an indexed object. The bounds contain all the shapes of the object as well as the
+   * origins of the shapes. Returns false if the object is not indexed. */
+  bool getObjectBounds(const std::string& id, moveit::core::AABB& bounds) const;
+
+  /** \brief Get the ids of the objects whose bounds intersect \e region */
+  void getObjectsInRegion(const Eigen::AlignedBox3d& region, std::vector<std::string>& ids) const;
+
+  /** \brief Get the ids of the objects whose bounds are entirely inside \e region */
+  void getObjectsContainedInRegion(const Eigen::AlignedBox3d& region, std::vector<std::string>& ids) const;
+
+  /** \brief Find the object whose bounds are closest to \e point. The distance is zero if \e point is inside the
+   * bounds. Returns false if no object is indexed. */
+  bool getNearestObject(const Eigen::Vector3d& point, std::string& id, double& distance) const;
+
+  /** \brief The version of the index, incremented with every change of the world */
+  std::uint64_t getVersion() const
+  {
+    return version_;
+  }
+
+  /** \brief Get the regions of the world affected by the changes after \e version: for every changed object, its
+   * bounds before and after the change. Only a limited number of changes is remembered; returns false if the
+   * changes after \e version are no longer known. */
+  bool getChangedRegions(std::uint64_t version, std::vector<moveit::core::AABB>& regions) const;
+
+  /** \brief Check the consistency of the tree (used for testing) */
+  bool isValid() const;
+
+private:
+  struct Node
+  {
+    moveit::core::AABB bounds_;
+    int parent_;
+    int left_;
+    int right_;
+
+    /** \brief 0 for leaves, -1 for unused nodes */
+    int height_;
+
+    /** \brief The object of a leaf */
+    std::string id_;
+  };
+
+  /** \brief Notification function */
+  void notify(const World::ObjectConstPtr& object, World::Action action);
+
+  void clear();
+  void recordChange(const moveit::core::AABB& bounds);
+
+  int allocateNode();
+  void freeNode(int node);
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+
+  /** \brief Recompute bounds and heights from \e node up to the root, rebalancing on the way */
+  void refit(int node);
+  int balance(int node);
+  void replaceChild(int parent, int old_child, int new_child);
+  int checkNode(int node, int parent) const;
+
+  std::vector<Node> nodes_;
+  int root_;
+  int free_list_;
+
+  /** \brief The leaf of every indexed object */
+  std::map<std::string, int> leaves_;
+
+  std::uint64_t version_;
+
+  /** \brief The bounds affected by recent changes, with the version of the change */
+  std::deque<std::pair<std::uint64_t, moveit::core::AABB> > changes_;
+
+  /** \brief Changes up to this version are no longer in changes_ */
+  std::uint64_t forgotten_version_;
+
+  /* observer handle for world callback */
+  World::ObserverHandle observer_handle_;
+
+  /* used to unregister the notifier */
+  std::weak_ptr<World> world_;
+};
+}
+
+#endif
@@ -40,18 +40,18 @@
 
 namespace collision_detection
 {
-AllowedCollisionMatrix::AllowedCollisionMatrix()
+AllowedCollisionMatrix::AllowedCollisionMatrix() : version_(0)
 {
 }
 
-AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed)
+AllowedCollisionMatrix::AllowedCollisionMatrix(const std::vector<std::string>& names, bool allowed) : version_(0)
 {
   for (std::size_t i = 0; i < names.size(); ++i)
     for (std::size_t j = i; j < names.size(); ++j)
       setEntry(names[i], names[j], allowed);
 }
 
-AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix& msg)
+AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisionMatrix& msg) : version_(0)
 {
   if (msg.entry_names.size() != msg.entry_values.size() ||
       msg.default_entry_names.size() != msg.default_entry_values.size())
@@ -73,12 +73,13 @@ AllowedCollisionMatrix::AllowedCollisionMatrix(const moveit_msgs::AllowedCollisi
   }
 }
 
-AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm)
+AllowedCollisionMatrix::AllowedCollisionMatrix(const AllowedCollisionMatrix& acm) : version_(acm.version_)
 {
   entries_ = acm.entries_;
   allowed_contacts_ = acm.allowed_contacts_;
   default_entries_ = acm.default_entries_;
   default_allowed_contacts_ = acm.default_allowed_contacts_;
+  compiled_ = std::atomic_load(&acm.compiled_);
 }
 
 bool AllowedCollisionMatrix::getEntry(const std::string& name1, const std::string& name2, DecideContactFn& fn) const
@@ -122,6 +123,7 @@ bool AllowedCollisionMatrix::hasEntry(const std::string& name1, const std::strin
 
 void AllowedCollisionMatrix::setEntry(const std::string& name1, const std::string& name2, bool allowed)
 {
+  markModified();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   entries_[name1][name2] = entries_[name2][name1] = v;
 
@@ -144,12 +146,14 @@ void AllowedCollisionMatrix::setEntry(const std::string& name1, const std::strin
 
 void AllowedCollisionMatrix::setEntry(const std::string& name1, const std::string& name2, const DecideContactFn& fn)
 {
+  markModified();
   entries_[name1][name2] = entries_[name2][name1] = AllowedCollision::CONDITIONAL;
   allowed_contacts_[name1][name2] = allowed_contacts_[name2][name1] = fn;
 }
 
 void AllowedCollisionMatrix::removeEntry(const std::string& name)
 {
+  markModified();
   entries_.erase(name);
   allowed_contacts_.erase(name);
   for (auto& entry : entries_)
@@ -160,6 +164,7 @@ void AllowedCollisionMatrix::removeEntry(const std::string& name)
 
 void AllowedCollisionMatrix::removeEntry(const std::string& name1, const std::string& name2)
 {
+  markModified();
   auto jt = entries_.find(name1);
   if (jt != entries_.end())
   {
@@ -219,6 +224,7 @@ void AllowedCollisionMatrix::setEntry(const std::string& name, bool allowed)
 
 void AllowedCollisionMatrix::setEntry(bool allowed)
 {
+  markModified();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   for (auto& entry : entries_)
     for (auto& it2 : entry.second)
@@ -227,6 +233,7 @@ void AllowedCollisionMatrix::setEntry(bool allowed)
 
 void AllowedCollisionMatrix::setDefaultEntry(const std::string& name, bool allowed)
 {
+  markModified();
   const AllowedCollision::Type v = allowed ? AllowedCollision::ALWAYS : AllowedCollision::NEVER;
   default_entries_[name] = v;
   default_allowed_contacts_.erase(name);
@@ -234,6 +241,7 @@ void AllowedCollisionMatrix::setDefaultEntry(const std::string& name, bool allow
 
 void AllowedCollisionMatrix::setDefaultEntry(const std::string& name, const DecideContactFn& fn)
 {
+  markModified();
   default_entries_[name] = AllowedCollision::CONDITIONAL;
   default_allowed_contacts_[name] = fn;
 }
@@ -316,6 +324,7 @@ bool AllowedCollisionMatrix::getAllowedCollision(const std::string& name1, const
 
 void AllowedCollisionMatrix::clear()
 {
+  markModified();
   entries_.clear();
   allowed_contacts_.clear();
   default_entries_.clear();
@@ -368,6 +377,36 @@ void AllowedCollisionMatrix::getMessage(moveit_msgs::AllowedCollisionMatrix& msg
   }
 }
 
+CompiledAllowedCollisionMatrixConstPtr
+AllowedCollisionMatrix::getCompiled(const robot_model::RobotModelConstPtr& model) const
+{
+  // concurrent collision checks may compile the matrix at the same time; each of them stores a complete result
+  CompiledAllowedCollisionMatrixConstPtr compiled = std::atomic_load(&compiled_);
+  if (!compiled || !compiled->isCompiledFor(model))
+  {
+    compiled = std::make_shared<const CompiledAllowedCollisionMatrix>(*this, model);
+    std::atomic_store(&compiled_, compiled);
+  }
+  return compiled;
+}
+
+const unsigned char CompiledAllowedCollisionMatrix::NO_ENTRY;
+
+CompiledAllowedCollisionMatrix::CompiledAllowedCollisionMatrix(const AllowedCollisionMatrix& acm,
+                                                               const robot_model::RobotModelConstPtr& model)
+  : model_(model), links_(model->getLinkModels())
+{
+  const std::size_t n = links_.size();
+  entries_.resize(n * n, NO_ENTRY);
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t j = i; j < n; ++j)
+    {
+      AllowedCollision::Type type;
+      if (acm.getAllowedCollision(links_[i]->getName(), links_[j]->getName(), type))
+        entries_[i * n + j] = entries_[j * n + i] = static_cast<unsigned char>(type);
+    }
+}
+
 void AllowedCollisionMatrix::print(std::ostream& out) const
 {
   std::vector<std::string> names;
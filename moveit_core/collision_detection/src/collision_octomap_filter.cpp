@@ -41,6 +41,9 @@
 #include <octomap/math/Utils.h>
 #include <octomap/octomap.h>
 #include <geometric_shapes/shapes.h>
+#include <array>
+#include <cmath>
+#include <map>
 #include <memory>
 
 // static const double ISO_VALUE  = 0.5; // TODO magic number! (though, probably a good one).
@@ -58,6 +61,35 @@ bool findSurface(const octomap::point3d_list& cloud, const double& spacing, cons
 bool sampleCloud(const octomap::point3d_list& cloud, const double& spacing, const double& r_multiple,
                  const octomath::Vector3& position, double& intensity, octomath::Vector3& gradient);
 
+namespace
+{
+// An occupied leaf of the octree, with the range of keys it covers
+struct OccupiedLeaf
+{
+  octomap::point3d center;
+  octomap::OcTreeKey index_key;
+  unsigned int key_span;
+};
+
+// A contact with the octree and the key range of the cells that make up its neighborhood
+struct ContactQuery
+{
+  collision_detection::Contact* contact;
+  octomap::OcTreeKey min_key;
+  octomap::OcTreeKey max_key;
+};
+
+// Check whether the leaf intersects the key range of the query, as the bbx iterators of octomap do. The neighborhood of
+// a contact is then the same as if it was gathered with its own traversal.
+bool intersects(const OccupiedLeaf& leaf, const ContactQuery& query)
+{
+  for (unsigned int i = 0; i < 3; ++i)
+    if (leaf.index_key[i] > query.max_key[i] || leaf.index_key[i] + leaf.key_span <= query.min_key[i])
+      return false;
+  return true;
+}
+}
+
 int collision_detection::refineContactNormals(const World::ObjectConstPtr& object, CollisionResult& res,
                                               double cell_bbx_search_distance, double allowed_angle_divergence,
                                               bool estimate_depth, double iso_value, double metaball_radius_multiple)
@@ -72,92 +104,102 @@ int collision_detection::refineContactNormals(const World::ObjectConstPtr& objec
     ROS_WARN_NAMED("collision_detection", "There do not appear to be any contacts, so there is nothing to refine!");
     return 0;
   }
+  if (object->shapes_.empty())
+    return 0;
+  std::shared_ptr<const shapes::OcTree> shape_octree =
+      std::dynamic_pointer_cast<const shapes::OcTree>(object->shapes_[0]);
+  if (!shape_octree)
+    return 0;
+  std::shared_ptr<const octomap::OcTree> octree = shape_octree->octree;
+  double cell_size = octree->getResolution();
+  double half_width = cell_size * cell_bbx_search_distance;
 
-  int modified = 0;
-
-  // iterate through contacts
+  // Collect the contacts with the octomap and group them by location. The neighborhoods of the contacts in one bucket
+  // are gathered together with a single traversal of the tree.
+  std::map<std::array<long, 3>, std::vector<ContactQuery> > buckets;
   for (auto& contact : res.contacts)
   {
-    std::string contact1 = contact.first.first;
-    std::string contact2 = contact.first.second;
-    std::string octomap_name = "";
-    std::vector<collision_detection::Contact>& contact_vector = contact.second;
+    const std::string& contact1 = contact.first.first;
+    const std::string& contact2 = contact.first.second;
+    if (contact1.find("octomap") == std::string::npos && contact2.find("octomap") == std::string::npos)
+      continue;
 
-    if (contact1.find("octomap") != std::string::npos)
-      octomap_name = contact1;
-    else if (contact2.find("octomap") != std::string::npos)
-      octomap_name = contact2;
-    else
+    for (auto& contact_info : contact.second)
     {
-      continue;
+      const Eigen::Vector3d& point = contact_info.pos;
+      octomath::Vector3 contact_point(point[0], point[1], point[2]);
+      octomath::Vector3 diagonal = octomath::Vector3(1, 1, 1);
+      ContactQuery query;
+      query.contact = &contact_info;
+      // contacts at the bounds of the tree have no neighborhood, so their normals can not be refined
+      if (!octree->coordToKeyChecked(contact_point - diagonal * half_width, query.min_key) ||
+          !octree->coordToKeyChecked(contact_point + diagonal * half_width, query.max_key))
+        continue;
+      std::array<long, 3> bucket;
+      for (unsigned int i = 0; i < 3; ++i)
+        bucket[i] = static_cast<long>(std::floor(point[i] / std::max(half_width, cell_size)));
+      buckets[bucket].push_back(query);
     }
+  }
 
-    double cell_size = 0;
-    if (!object->shapes_.empty())
-    {
-      const shapes::ShapeConstPtr& shape = object->shapes_[0];
-      std::shared_ptr<const shapes::OcTree> shape_octree = std::dynamic_pointer_cast<const shapes::OcTree>(shape);
-      if (shape_octree)
-      {
-        std::shared_ptr<const octomap::OcTree> octree = shape_octree->octree;
-        cell_size = octree->getResolution();
-        for (auto& contact_info : contact_vector)
-        {
-          const Eigen::Vector3d& point = contact_info.pos;
-          const Eigen::Vector3d& normal = contact_info.normal;
+  int modified = 0;
+  octomap::point3d_list node_centers;
+  std::vector<OccupiedLeaf> leaves;
+  for (auto& bucket : buckets)
+  {
+    const std::vector<ContactQuery>& queries = bucket.second;
 
-          octomath::Vector3 contact_point(point[0], point[1], point[2]);
-          octomath::Vector3 contact_normal(normal[0], normal[1], normal[2]);
-          octomath::Vector3 diagonal = octomath::Vector3(1, 1, 1);
-          octomath::Vector3 bbx_min = contact_point - diagonal * cell_size * cell_bbx_search_distance;
-          octomath::Vector3 bbx_max = contact_point + diagonal * cell_size * cell_bbx_search_distance;
-          octomap::point3d_list node_centers;
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator it =
-              octree->begin_leafs_bbx(bbx_min, bbx_max);
-          octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator leafs_end =
-              octree->end_leafs_bbx();
-          int count = 0;
-          for (; it != leafs_end; ++it)
-          {
-            octomap::point3d pt = it.getCoordinate();
-            // double prob = it->getOccupancy();
-            if (octree->isNodeOccupied(*it))  // magic number!
-            {
-              count++;
-              node_centers.push_back(pt);
-              // ROS_INFO_NAMED("collision_detection", "Adding point %d with prob %.3f at [%.3f, %.3f, %.3f]",
-              //                          count, prob, pt.x(), pt.y(), pt.z());
-            }
-          }
-          // ROS_INFO_NAMED("collision_detection", "Contact point at [%.3f, %.3f, %.3f], cell size %.3f, occupied cells
-          // %d",
-          //                          contact_point.x(), contact_point.y(), contact_point.z(), cell_size, count);
+    // gather the occupied leaves around all the contacts of this bucket
+    octomap::OcTreeKey min_key = queries[0].min_key, max_key = queries[0].max_key;
+    for (const ContactQuery& query : queries)
+      for (unsigned int i = 0; i < 3; ++i)
+      {
+        min_key[i] = std::min(min_key[i], query.min_key[i]);
+        max_key[i] = std::max(max_key[i], query.max_key[i]);
+      }
+    leaves.clear();
+    octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator it =
+        octree->begin_leafs_bbx(min_key, max_key);
+    octomap::OcTreeBaseImpl<octomap::OcTreeNode, octomap::AbstractOccupancyOcTree>::leaf_bbx_iterator leafs_end =
+        octree->end_leafs_bbx();
+    for (; it != leafs_end; ++it)
+      if (octree->isNodeOccupied(*it))
+      {
+        OccupiedLeaf leaf;
+        leaf.center = it.getCoordinate();
+        leaf.index_key = it.getIndexKey();
+        leaf.key_span = 1u << (octree->getTreeDepth() - it.getDepth());
+        leaves.push_back(leaf);
+      }
 
-          // octree->getOccupiedLeafsBBX(node_centers, bbx_min, bbx_max);
-          // ROS_ERROR_NAMED("collision_detection", "bad stuff in collision_octomap_filter.cpp; need to port octomap
-          // call for groovy");
+    for (const ContactQuery& query : queries)
+    {
+      node_centers.clear();
+      for (const OccupiedLeaf& leaf : leaves)
+        if (intersects(leaf, query))
+          node_centers.push_back(leaf.center);
 
-          octomath::Vector3 n;
-          double depth;
-          if (getMetaballSurfaceProperties(node_centers, cell_size, iso_value, metaball_radius_multiple, contact_point,
-                                           n, depth, estimate_depth))
-          {
-            // only modify normal if the refinement predicts a "very different" result.
-            double divergence = contact_normal.angleTo(n);
-            if (divergence > allowed_angle_divergence)
-            {
-              modified++;
-              // ROS_INFO_NAMED("collision_detection", "Normals differ by %.3f, changing: [%.3f, %.3f, %.3f] -> [%.3f,
-              // %.3f, %.3f]",
-              //                          divergence, contact_normal.x(), contact_normal.y(), contact_normal.z(),
-              //                          n.x(), n.y(), n.z());
-              contact_info.normal = Eigen::Vector3d(n.x(), n.y(), n.z());
-            }
+      collision_detection::Contact& contact_info = *query.contact;
+      const Eigen::Vector3d& point = contact_info.pos;
+      const Eigen::Vector3d& normal = contact_info.normal;
+      octomath::Vector3 contact_point(point[0], point[1], point[2]);
+      octomath::Vector3 contact_normal(normal[0], normal[1], normal[2]);
 
-            if (estimate_depth)
-              contact_info.depth = depth;
-          }
+      octomath::Vector3 n;
+      double depth;
+      if (getMetaballSurfaceProperties(node_centers, cell_size, iso_value, metaball_radius_multiple, contact_point, n,
+                                       depth, estimate_depth))
+      {
+        // only modify normal if the refinement predicts a "very different" result.
+        double divergence = contact_normal.angleTo(n);
+        if (divergence > allowed_angle_divergence)
+        {
+          modified++;
+          contact_info.normal = Eigen::Vector3d(n.x(), n.y(), n.z());
         }
+
+        if (estimate_depth)
+          contact_info.depth = depth;
       }
     }
   }
@@ -92,6 +92,19 @@ CollisionRobot::CollisionRobot(const CollisionRobot& other) : robot_model_(other
   link_scale_ = other.link_scale_;
 }
 
+void CollisionRobot::checkSelfCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                               const robot_state::RobotState& state,
+                                               const AllowedCollisionMatrix& acm) const
+{
+  CollisionRequest full_req;
+  if (req.group)
+    full_req.group_name = req.group->getName();
+  full_req.bounding_sphere_prefilter = req.bounding_sphere_prefilter;
+  CollisionResult full_res;
+  checkSelfCollision(full_req, full_res, state, acm);
+  res.collision = full_res.collision;
+}
+
 void CollisionRobot::setPadding(double padding)
 {
   if (!validatePadding(padding))
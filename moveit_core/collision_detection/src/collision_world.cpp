@@ -36,6 +36,9 @@
 
 #include <moveit/collision_detection/collision_world.h>
 #include <geometric_shapes/shape_operations.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
 
 namespace collision_detection
 {
@@ -84,6 +87,46 @@ void CollisionWorld::checkCollision(const CollisionRequest& req, CollisionResult
     checkRobotCollision(req, res, robot, state1, state2, acm);
 }
 
+void CollisionWorld::checkRobotCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                                const CollisionRobot& robot, const robot_state::RobotState& state,
+                                                const AllowedCollisionMatrix& acm) const
+{
+  CollisionRequest full_req;
+  if (req.group)
+    full_req.group_name = req.group->getName();
+  full_req.bounding_sphere_prefilter = req.bounding_sphere_prefilter;
+  CollisionResult full_res;
+  checkRobotCollision(full_req, full_res, robot, state, acm);
+  res.collision = full_res.collision;
+}
+
+void CollisionWorld::checkRobotCollisionBatch(const CollisionRequest& req, std::vector<CollisionResult>& results,
+                                              const CollisionRobot& robot,
+                                              const std::vector<const robot_state::RobotState*>& states,
+                                              const AllowedCollisionMatrix& acm, unsigned int thread_count) const
+{
+  results.resize(states.size());
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, states.size());
+
+  // the threads only need to claim the states they check
+  std::atomic<std::size_t> next(0);
+  auto worker = [this, &req, &results, &robot, &states, &acm, &next]() {
+    for (std::size_t i = next++; i < states.size(); i = next++)
+      checkRobotCollision(req, results[i], robot, *states[i], acm);
+  };
+  if (thread_count <= 1)
+  {
+    worker();
+    return;
+  }
+  boost::thread_group workers;
+  for (unsigned int t = 0; t < thread_count; ++t)
+    workers.create_thread(worker);
+  workers.join_all();
+}
+
 void CollisionWorld::setWorld(const WorldPtr& world)
 {
   world_ = world;
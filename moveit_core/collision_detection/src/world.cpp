@@ -39,11 +39,11 @@
 
 namespace collision_detection
 {
-World::World()
+World::World() : version_(0)
 {
 }
 
-World::World(const World& other)
+World::World(const World& other) : version_(other.version_)
 {
   objects_ = other.objects_;
 }
@@ -245,6 +245,7 @@ void World::notifyAll(Action action)
 
 void World::notify(const ObjectConstPtr& obj, Action action)
 {
+  ++version_;
   for (std::vector<Observer*>::const_iterator obs = observers_.begin(); obs != observers_.end(); ++obs)
     (*obs)->callback_(obj, action);
 }
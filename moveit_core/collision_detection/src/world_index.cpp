@@ -0,0 +1,476 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/collision_detection/world_index.h>
+#include <geometric_shapes/shape_operations.h>
+#include <octomap/octomap.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace collision_detection
+{
+namespace
+{
+static const int NULL_NODE = -1;
+
+// the number of changed bounds remembered for getChangedRegions()
+static const std::size_t MAX_CHANGES = 1024;
+
+// planes are infinite; they are indexed with bounds this large, which keeps all the costs below finite
+static const double PLANE_EXTENT = 1e12;
+
+double surfaceArea(const Eigen::AlignedBox3d& box)
+{
+  const Eigen::Vector3d d = box.sizes();
+  return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+double mergedSurfaceArea(const Eigen::AlignedBox3d& a, const Eigen::AlignedBox3d& b)
+{
+  return surfaceArea(a.merged(b));
+}
+
+bool computeObjectBounds(const World::Object& object, moveit::core::AABB& bounds)
+{
+  bounds.setEmpty();
+  for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+  {
+    const Eigen::Affine3d& pose = object.shape_poses_[i];
+    const shapes::Shape* shape = object.shapes_[i].get();
+    bounds.extend(pose.translation());
+    if (shape->type == shapes::MESH)
+    {
+      // computeShapeExtents() does not provide the offset of the mesh origin
+      const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+      for (unsigned int j = 0; j < mesh->vertex_count; ++j)
+        bounds.extend(pose * Eigen::Map<const Eigen::Vector3d>(&mesh->vertices[3 * j]));
+    }
+    else if (shape->type == shapes::OCTREE)
+    {
+      const shapes::OcTree* octree = static_cast<const shapes::OcTree*>(shape);
+      if (!octree->octree || octree->octree->size() == 0)
+        continue;
+      Eigen::Vector3d min, max;
+      octree->octree->getMetricMin(min.x(), min.y(), min.z());
+      octree->octree->getMetricMax(max.x(), max.y(), max.z());
+      Eigen::Affine3d box_pose = pose;
+      box_pose.translate(0.5 * (min + max));
+      bounds.extendWithTransformedBox(box_pose, max - min);
+    }
+    else if (shape->type == shapes::PLANE)
+      bounds.extend(Eigen::AlignedBox3d(Eigen::Vector3d::Constant(-PLANE_EXTENT),
+                                        Eigen::Vector3d::Constant(PLANE_EXTENT)));
+    else
+      bounds.extendWithTransformedBox(pose, shapes::computeShapeExtents(shape));
+  }
+  return !object.shapes_.empty();
+}
+}
+
+WorldIndex::WorldIndex() : root_(NULL_NODE), free_list_(NULL_NODE), version_(0), forgotten_version_(0)
+{
+}
+
+WorldIndex::WorldIndex(const WorldPtr& world)
+  : root_(NULL_NODE), free_list_(NULL_NODE), version_(0), forgotten_version_(0)
+{
+  setWorld(world);
+}
+
+WorldIndex::~WorldIndex()
+{
+  WorldPtr old_world = world_.lock();
+  if (old_world)
+    old_world->removeObserver(observer_handle_);
+}
+
+void WorldIndex::setWorld(const WorldPtr& world)
+{
+  reset();
+  world_ = world;
+  observer_handle_ = world->addObserver(boost::bind(&WorldIndex::notify, this, _1, _2));
+  world->notifyObserverAllObjects(observer_handle_, World::CREATE);
+}
+
+void WorldIndex::reset()
+{
+  WorldPtr old_world = world_.lock();
+  if (old_world)
+    old_world->removeObserver(observer_handle_);
+  world_.reset();
+  clear();
+}
+
+void WorldIndex::clear()
+{
+  // the regions of the discarded objects are not known to have changed, so the history restarts
+  nodes_.clear();
+  leaves_.clear();
+  changes_.clear();
+  root_ = NULL_NODE;
+  free_list_ = NULL_NODE;
+  forgotten_version_ = ++version_;
+}
+
+void WorldIndex::notify(const World::ObjectConstPtr& object, World::Action action)
+{
+  ++version_;
+
+  std::map<std::string, int>::iterator it = leaves_.find(object->id_);
+  if (it != leaves_.end())
+  {
+    recordChange(nodes_[it->second].bounds_);
+    removeLeaf(it->second);
+    freeNode(it->second);
+    leaves_.erase(it);
+  }
+
+  if (action & World::DESTROY)
+    return;
+
+  moveit::core::AABB bounds;
+  if (!computeObjectBounds(*object, bounds))
+    return;
+  recordChange(bounds);
+
+  const int leaf = allocateNode();
+  nodes_[leaf].bounds_ = bounds;
+  nodes_[leaf].id_ = object->id_;
+  insertLeaf(leaf);
+  leaves_[object->id_] = leaf;
+}
+
+void WorldIndex::recordChange(const moveit::core::AABB& bounds)
+{
+  changes_.push_back(std::make_pair(version_, bounds));
+  while (changes_.size() > MAX_CHANGES)
+  {
+    forgotten_version_ = changes_.front().first;
+    changes_.pop_front();
+  }
+}
+
+bool WorldIndex::getChangedRegions(std::uint64_t version, std::vector<moveit::core::AABB>& regions) const
+{
+  regions.clear();
+  // the bounds recorded for changes up to forgotten_version_ may be incomplete
+  if (version < forgotten_version_)
+    return false;
+  for (std::deque<std::pair<std::uint64_t, moveit::core::AABB> >::const_reverse_iterator it = changes_.rbegin();
+       it != changes_.rend() && it->first > version; ++it)
+    regions.push_back(it->second);
+  std::reverse(regions.begin(), regions.end());
+  return true;
+}
+
+bool WorldIndex::getObjectBounds(const std::string& id, moveit::core::AABB& bounds) const
+{
+  std::map<std::string, int>::const_iterator it = leaves_.find(id);
+  if (it == leaves_.end())
+    return false;
+  bounds = nodes_[it->second].bounds_;
+  return true;
+}
+
+void WorldIndex::getObjectsInRegion(const Eigen::AlignedBox3d& region, std::vector<std::string>& ids) const
+{
+  ids.clear();
+  if (root_ == NULL_NODE)
+    return;
+  std::vector<int> stack(1, root_);
+  while (!stack.empty())
+  {
+    const Node& node = nodes_[stack.back()];
+    stack.pop_back();
+    if (!node.bounds_.intersects(region))
+      continue;
+    if (node.height_ == 0)
+      ids.push_back(node.id_);
+    else
+    {
+      stack.push_back(node.left_);
+      stack.push_back(node.right_);
+    }
+  }
+}
+
+void WorldIndex::getObjectsContainedInRegion(const Eigen::AlignedBox3d& region, std::vector<std::string>& ids) const
+{
+  ids.clear();
+  if (root_ == NULL_NODE)
+    return;
+  std::vector<int> stack(1, root_);
+  while (!stack.empty())
+  {
+    const Node& node = nodes_[stack.back()];
+    stack.pop_back();
+    if (node.height_ == 0)
+    {
+      if (region.contains(node.bounds_))
+        ids.push_back(node.id_);
+    }
+    else if (node.bounds_.intersects(region))
+    {
+      stack.push_back(node.left_);
+      stack.push_back(node.right_);
+    }
+  }
+}
+
+bool WorldIndex::getNearestObject(const Eigen::Vector3d& point, std::string& id, double& distance) const
+{
+  if (root_ == NULL_NODE)
+    return false;
+
+  // best first search; the distance to the bounds of a node is a lower bound for all the objects below it
+  typedef std::pair<double, int> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+  queue.push(Entry(nodes_[root_].bounds_.squaredExteriorDistance(point), root_));
+  while (!queue.empty())
+  {
+    const Entry entry = queue.top();
+    queue.pop();
+    const Node& node = nodes_[entry.second];
+    if (node.height_ == 0)
+    {
+      id = node.id_;
+      distance = std::sqrt(entry.first);
+      return true;
+    }
+    queue.push(Entry(nodes_[node.left_].bounds_.squaredExteriorDistance(point), node.left_));
+    queue.push(Entry(nodes_[node.right_].bounds_.squaredExteriorDistance(point), node.right_));
+  }
+  return false;
+}
+
+int WorldIndex::allocateNode()
+{
+  int node;
+  if (free_list_ != NULL_NODE)
+  {
+    node = free_list_;
+    free_list_ = nodes_[node].parent_;
+  }
+  else
+  {
+    node = nodes_.size();
+    nodes_.push_back(Node());
+  }
+  Node& n = nodes_[node];
+  n.parent_ = n.left_ = n.right_ = NULL_NODE;
+  n.height_ = 0;
+  n.bounds_.setEmpty();
+  return node;
+}
+
+void WorldIndex::freeNode(int node)
+{
+  nodes_[node].id_.clear();
+  nodes_[node].height_ = -1;
+  nodes_[node].parent_ = free_list_;
+  free_list_ = node;
+}
+
+void WorldIndex::insertLeaf(int leaf)
+{
+  if (root_ == NULL_NODE)
+  {
+    root_ = leaf;
+    nodes_[leaf].parent_ = NULL_NODE;
+    return;
+  }
+
+  // descend to the sibling that minimizes the surface area heuristic
+  const moveit::core::AABB bounds = nodes_[leaf].bounds_;
+  int index = root_;
+  while (nodes_[index].height_ > 0)
+  {
+    const Node& node = nodes_[index];
+    const double area = surfaceArea(node.bounds_);
+    const double merged_area = mergedSurfaceArea(node.bounds_, bounds);
+
+    // cost of making a new parent for this node and the leaf, and the cost pushed down to the children otherwise
+    const double cost = 2.0 * merged_area;
+    const double inheritance = 2.0 * (merged_area - area);
+
+    double child_cost[2];
+    const int children[2] = { node.left_, node.right_ };
+    for (int i = 0; i < 2; ++i)
+    {
+      const Node& child = nodes_[children[i]];
+      child_cost[i] = mergedSurfaceArea(child.bounds_, bounds) + inheritance;
+      if (child.height_ > 0)
+        child_cost[i] -= surfaceArea(child.bounds_);
+    }
+
+    if (cost < child_cost[0] && cost < child_cost[1])
+      break;
+    index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+  }
+
+  const int sibling = index;
+  const int old_parent = nodes_[sibling].parent_;
+  const int new_parent = allocateNode();
+  Node& parent = nodes_[new_parent];
+  parent.parent_ = old_parent;
+  parent.left_ = sibling;
+  parent.right_ = leaf;
+  parent.height_ = nodes_[sibling].height_ + 1;
+  parent.bounds_ = nodes_[sibling].bounds_;
+  parent.bounds_.extend(bounds);
+  replaceChild(old_parent, sibling, new_parent);
+  nodes_[sibling].parent_ = new_parent;
+  nodes_[leaf].parent_ = new_parent;
+
+  refit(old_parent);
+}
+
+void WorldIndex::removeLeaf(int leaf)
+{
+  if (leaf == root_)
+  {
+    root_ = NULL_NODE;
+    return;
+  }
+
+  const int parent = nodes_[leaf].parent_;
+  const int grand_parent = nodes_[parent].parent_;
+  const int sibling = nodes_[parent].left_ == leaf ? nodes_[parent].right_ : nodes_[parent].left_;
+
+  replaceChild(grand_parent, parent, sibling);
+  nodes_[sibling].parent_ = grand_parent;
+  freeNode(parent);
+  refit(grand_parent);
+}
+
+void WorldIndex::refit(int node)
+{
+  while (node != NULL_NODE)
+  {
+    node = balance(node);
+    Node& n = nodes_[node];
+    n.height_ = 1 + std::max(nodes_[n.left_].height_, nodes_[n.right_].height_);
+    n.bounds_ = nodes_[n.left_].bounds_;
+    n.bounds_.extend(nodes_[n.right_].bounds_);
+    node = n.parent_;
+  }
+}
+
+int WorldIndex::balance(int a)
+{
+  if (nodes_[a].height_ < 2)
+    return a;
+
+  // rotate the taller child up when the heights of the children differ by more than one
+  int b = nodes_[a].left_;
+  int c = nodes_[a].right_;
+  const int difference = nodes_[c].height_ - nodes_[b].height_;
+  if (difference >= -1 && difference <= 1)
+    return a;
+  if (difference < 0)
+    std::swap(b, c);
+
+  // c takes the place of a and adopts a as a child, next to the taller child f of c; a adopts g instead of c
+  int f = nodes_[c].left_;
+  int g = nodes_[c].right_;
+  if (nodes_[f].height_ < nodes_[g].height_)
+    std::swap(f, g);
+
+  const int parent = nodes_[a].parent_;
+  replaceChild(parent, a, c);
+  nodes_[c].parent_ = parent;
+  nodes_[c].left_ = a;
+  nodes_[c].right_ = f;
+  nodes_[a].parent_ = c;
+  if (nodes_[a].left_ == c)
+    nodes_[a].left_ = g;
+  else
+    nodes_[a].right_ = g;
+  nodes_[g].parent_ = a;
+
+  nodes_[a].bounds_ = nodes_[b].bounds_;
+  nodes_[a].bounds_.extend(nodes_[g].bounds_);
+  nodes_[a].height_ = 1 + std::max(nodes_[b].height_, nodes_[g].height_);
+  nodes_[c].bounds_ = nodes_[a].bounds_;
+  nodes_[c].bounds_.extend(nodes_[f].bounds_);
+  nodes_[c].height_ = 1 + std::max(nodes_[a].height_, nodes_[f].height_);
+  return c;
+}
+
+void WorldIndex::replaceChild(int parent, int old_child, int new_child)
+{
+  if (parent == NULL_NODE)
+    root_ = new_child;
+  else if (nodes_[parent].left_ == old_child)
+    nodes_[parent].left_ = new_child;
+  else
+    nodes_[parent].right_ = new_child;
+}
+
+bool WorldIndex::isValid() const
+{
+  if (root_ == NULL_NODE)
+    return leaves_.empty();
+  if (checkNode(root_, NULL_NODE) < 0)
+    return false;
+  for (std::map<std::string, int>::const_iterator it = leaves_.begin(); it != leaves_.end(); ++it)
+    if (nodes_[it->second].height_ != 0 || nodes_[it->second].id_ != it->first)
+      return false;
+  return true;
+}
+
+int WorldIndex::checkNode(int node, int parent) const
+{
+  // returns the number of leaves below node, or -1 if the subtree is inconsistent
+  const Node& n = nodes_[node];
+  if (n.parent_ != parent || n.height_ < 0)
+    return -1;
+  if (n.height_ == 0)
+    return 1;
+  const int left = checkNode(n.left_, node);
+  const int right = checkNode(n.right_, node);
+  if (left < 0 || right < 0)
+    return -1;
+  const Node& l = nodes_[n.left_];
+  const Node& r = nodes_[n.right_];
+  if (n.height_ != 1 + std::max(l.height_, r.height_) || !n.bounds_.contains(l.bounds_) ||
+      !n.bounds_.contains(r.bounds_))
+    return -1;
+  if (node == root_ && left + right != static_cast<int>(leaves_.size()))
+    return -1;
+  return left + right;
+}
+}
@@ -0,0 +1,202 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/collision_detection/world_index.h>
+#include <geometric_shapes/shapes.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace
+{
+Eigen::Affine3d translation(double x, double y, double z)
+{
+  return Eigen::Affine3d(Eigen::Translation3d(x, y, z));
+}
+
+std::vector<std::string> sorted(std::vector<std::string> ids)
+{
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+double random(double min, double max)
+{
+  return min + (max - min) * rand() / RAND_MAX;
+}
+}
+
+TEST(WorldIndex, Bounds)
+{
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::WorldIndex index(world);
+
+  world->addToObject("box", shapes::ShapePtr(new shapes::Box(1, 2, 4)), translation(1, 0, 0));
+  world->addToObject("empty", std::vector<shapes::ShapeConstPtr>(), EigenSTL::vector_Affine3d());
+  EXPECT_EQ(1u, index.size());
+
+  moveit::core::AABB bounds;
+  ASSERT_TRUE(index.getObjectBounds("box", bounds));
+  EXPECT_NEAR(0.5, bounds.min().x(), 1e-9);
+  EXPECT_NEAR(-1.0, bounds.min().y(), 1e-9);
+  EXPECT_NEAR(2.0, bounds.max().z(), 1e-9);
+  EXPECT_FALSE(index.getObjectBounds("empty", bounds));
+
+  // the bounds follow the shapes and include their origins
+  world->moveShapeInObject("box", world->getObject("box")->shapes_[0], translation(0, 0, 10));
+  ASSERT_TRUE(index.getObjectBounds("box", bounds));
+  EXPECT_NEAR(12.0, bounds.max().z(), 1e-9);
+  world->addToObject("box", shapes::ShapePtr(new shapes::Sphere(0.5)), translation(-5, 0, 0));
+  ASSERT_TRUE(index.getObjectBounds("box", bounds));
+  EXPECT_NEAR(-5.5, bounds.min().x(), 1e-9);
+
+  world->removeObject("box");
+  EXPECT_EQ(0u, index.size());
+  EXPECT_TRUE(index.isValid());
+}
+
+TEST(WorldIndex, RegionAndNearestQueries)
+{
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::WorldIndex index(world);
+  shapes::ShapePtr box(new shapes::Box(0.1, 0.1, 0.1));
+
+  srand(42);
+  for (int i = 0; i < 500; ++i)
+  {
+    std::string id = "object" + std::to_string(i);
+    world->addToObject(id, box, translation(random(-5, 5), random(-5, 5), random(0, 2)));
+  }
+  // move and remove some objects, so the tree is also checked after removals
+  for (int i = 0; i < 500; i += 3)
+    world->moveShapeInObject("object" + std::to_string(i), box,
+                             translation(random(-5, 5), random(-5, 5), random(0, 2)));
+  for (int i = 0; i < 500; i += 7)
+    world->removeObject("object" + std::to_string(i));
+  ASSERT_TRUE(index.isValid());
+
+  for (int q = 0; q < 50; ++q)
+  {
+    Eigen::Vector3d corner(random(-5, 5), random(-5, 5), random(0, 2));
+    Eigen::AlignedBox3d region(corner, corner + Eigen::Vector3d(random(0, 3), random(0, 3), random(0, 1)));
+    Eigen::Vector3d point(random(-6, 6), random(-6, 6), random(-1, 3));
+
+    std::vector<std::string> expected_intersecting, expected_contained;
+    std::string expected_nearest;
+    double expected_distance = std::numeric_limits<double>::infinity();
+    for (collision_detection::World::const_iterator it = world->begin(); it != world->end(); ++it)
+    {
+      moveit::core::AABB bounds;
+      ASSERT_TRUE(index.getObjectBounds(it->first, bounds));
+      if (bounds.intersects(region))
+        expected_intersecting.push_back(it->first);
+      if (region.contains(bounds))
+        expected_contained.push_back(it->first);
+      double distance = std::sqrt(bounds.squaredExteriorDistance(point));
+      if (distance < expected_distance)
+      {
+        expected_distance = distance;
+        expected_nearest = it->first;
+      }
+    }
+
+    std::vector<std::string> ids;
+    index.getObjectsInRegion(region, ids);
+    EXPECT_EQ(sorted(expected_intersecting), sorted(ids));
+    index.getObjectsContainedInRegion(region, ids);
+    EXPECT_EQ(sorted(expected_contained), sorted(ids));
+
+    std::string nearest;
+    double distance;
+    ASSERT_TRUE(index.getNearestObject(point, nearest, distance));
+    EXPECT_NEAR(expected_distance, distance, 1e-9);
+  }
+}
+
+TEST(WorldIndex, ChangedRegions)
+{
+  collision_detection::WorldPtr world(new collision_detection::World());
+  collision_detection::WorldIndex index(world);
+  shapes::ShapePtr box(new shapes::Box(1, 1, 1));
+
+  world->addToObject("a", box, translation(0, 0, 0));
+  const std::uint64_t version = index.getVersion();
+
+  std::vector<moveit::core::AABB> regions;
+  EXPECT_TRUE(index.getChangedRegions(version, regions));
+  EXPECT_TRUE(regions.empty());
+
+  // a move reports where the object was and where it is now
+  world->moveShapeInObject("a", box, translation(10, 0, 0));
+  EXPECT_LT(version, index.getVersion());
+  ASSERT_TRUE(index.getChangedRegions(version, regions));
+  ASSERT_EQ(2u, regions.size());
+  EXPECT_TRUE(regions[0].contains(Eigen::Vector3d(0, 0, 0)));
+  EXPECT_TRUE(regions[1].contains(Eigen::Vector3d(10, 0, 0)));
+
+  world->removeObject("a");
+  ASSERT_TRUE(index.getChangedRegions(version, regions));
+  EXPECT_EQ(3u, regions.size());
+
+  // the history is limited
+  world->addToObject("b", box, translation(0, 0, 0));
+  for (int i = 0; i < 2000; ++i)
+    world->moveShapeInObject("b", box, translation(i, 0, 0));
+  EXPECT_FALSE(index.getChangedRegions(version, regions));
+  EXPECT_TRUE(index.getChangedRegions(index.getVersion() - 1, regions));
+}
+
+TEST(WorldIndex, Reset)
+{
+  collision_detection::WorldPtr world(new collision_detection::World());
+  world->addToObject("a", shapes::ShapePtr(new shapes::Sphere(1)), translation(0, 0, 0));
+
+  collision_detection::WorldIndex index;
+  EXPECT_EQ(0u, index.size());
+  index.setWorld(world);
+  EXPECT_EQ(1u, index.size());
+
+  index.reset();
+  EXPECT_EQ(0u, index.size());
+  world->addToObject("b", shapes::ShapePtr(new shapes::Sphere(1)), translation(0, 0, 0));
+  EXPECT_EQ(0u, index.size());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
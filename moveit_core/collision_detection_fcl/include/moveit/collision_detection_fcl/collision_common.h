@@ -43,6 +43,8 @@
 #include <fcl/broadphase/broadphase.h>
 #include <fcl/collision.h>
 #include <fcl/distance.h>
+#include <iostream>
+#include <map>
 #include <memory>
 #include <set>
 
@@ -128,7 +130,7 @@ struct CollisionData
   {
   }
 
-  /// Compute \e active_components_only_ based on \e req_
+  /// Compute \e active_components_only_ based on \e req_, and \e compiled_acm_ for the links of \e kmodel
   void enableGroup(const robot_model::RobotModelConstPtr& kmodel);
 
   /// The collision request passed by the user
@@ -145,13 +147,134 @@ struct CollisionData
   /// The user specified collision matrix (may be NULL)
   const AllowedCollisionMatrix* acm_;
 
+  /// The compiled form of \e acm_, used for pairs of robot links (may be NULL)
+  CompiledAllowedCollisionMatrixConstPtr compiled_acm_;
+
   /// Flag indicating whether collision checking is complete
   bool done_;
 };
 
+/** \brief Data structure which is passed to the collision callback function of boolean collision queries
+    (booleanCollisionCallback()); like the request and result it refers to, it holds nothing on the heap */
+struct BooleanCollisionData
+{
+  BooleanCollisionData(const BooleanCollisionRequest* req, BooleanCollisionResult* res,
+                       const AllowedCollisionMatrix* acm)
+    : req_(req), active_components_only_(NULL), res_(res), acm_(acm)
+  {
+  }
+
+  /// Compute \e active_components_only_ based on \e req_, and \e compiled_acm_ for the links of \e kmodel
+  void enableGroup(const robot_model::RobotModelConstPtr& kmodel);
+
+  /// The collision request passed by the user
+  const BooleanCollisionRequest* req_;
+
+  /// The links considered for collision, if the request includes a group; if NULL, all collisions are considered
+  const std::set<const robot_model::LinkModel*>* active_components_only_;
+
+  /// The user specified response location
+  BooleanCollisionResult* res_;
+
+  /// The user specified collision matrix (may be NULL)
+  const AllowedCollisionMatrix* acm_;
+
+  /// The compiled form of \e acm_, used for pairs of robot links (may be NULL)
+  CompiledAllowedCollisionMatrixConstPtr compiled_acm_;
+};
+
+MOVEIT_CLASS_FORWARD(DistanceQueryContext);
+
+/** \brief Information kept between consecutive distance queries, for callers that query distances at a high rate on
+    states that change little from one query to the next.
+
+    For every pair of geometries whose distance was computed, the distance and the poses of the two geometries are
+    remembered. In the next query, the distance of the pair is at least the remembered distance minus how far any
+    point of the two geometries can have moved since; pairs for which this bound cannot improve the result are not
+    computed again. Optionally, a query stops as soon as a pair closer than a safety distance is found.
+
+    A context must only be used for queries of the same kind (e.g., only distanceSelf() for one robot) and by one
+    thread at a time. */
+class DistanceQueryContext
+{
+public:
+  DistanceQueryContext();
+
+  /** \brief Stop a query as soon as a pair of objects closer than \e distance is found. The result then contains
+      that pair, but not necessarily the closest one. Set to -infinity (the default) to disable. */
+  void setSafetyDistance(double distance)
+  {
+    safety_distance_ = distance;
+  }
+
+  double getSafetyDistance() const
+  {
+    return safety_distance_;
+  }
+
+  /** \brief True if the last query stopped because a pair closer than the safety distance was found */
+  bool isBelowSafetyDistance() const
+  {
+    return below_safety_distance_;
+  }
+
+  /** \brief The number of pairs whose distance was computed in the last query */
+  std::size_t getComputedPairCount() const
+  {
+    return computed_pairs_;
+  }
+
+  /** \brief The number of pairs skipped in the last query because their distance could not improve the result */
+  std::size_t getPrunedPairCount() const
+  {
+    return pruned_pairs_;
+  }
+
+  /** \brief Forget everything remembered from previous queries */
+  void clear();
+
+  /** \brief Called at the start of a query */
+  void beginQuery();
+
+  /** \brief Return true if the distance between \e o1 and \e o2 need not be computed because it is certainly not
+      below \e bound. If \e global is true, pairs that cannot be the closest pair are skipped as well. */
+  bool prune(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2, double bound, bool global);
+
+  /** \brief Remember the distance \e distance computed between \e o1 and \e o2. \e exact is false if FCL only
+      reported that the distance is at least \e distance (because it exceeded the requested threshold). Returns true if
+      the query should stop because of the safety distance. */
+  bool update(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2, double distance, bool exact);
+
+private:
+  struct PairRecord
+  {
+    std::weak_ptr<fcl::CollisionGeometry> geometry[2];
+    fcl::Transform3f transform[2];
+    double distance;
+    bool exact;
+  };
+
+  using PairKey = std::pair<const fcl::CollisionGeometry*, const fcl::CollisionGeometry*>;
+
+  /** \brief The largest displacement of any point of the geometry of \e o since it was at \e previous */
+  static double maxMotion(const fcl::CollisionObject* o, const fcl::Transform3f& previous);
+
+  std::map<PairKey, PairRecord> pairs_;
+
+  /// An upper bound on the minimum distance in the current query, derived from remembered exact distances
+  double upper_bound_;
+
+  double safety_distance_;
+  bool below_safety_distance_;
+  std::size_t computed_pairs_;
+  std::size_t pruned_pairs_;
+  unsigned int query_count_;
+};
+
 struct DistanceData
 {
-  DistanceData(const DistanceRequest* req, DistanceResult* res) : req(req), res(res), done(false)
+  DistanceData(const DistanceRequest* req, DistanceResult* res, DistanceQueryContext* context = nullptr)
+    : req(req), res(res), context(context), done(false)
   {
   }
   ~DistanceData()
@@ -164,6 +287,9 @@ struct DistanceData
   /// Distance query results information
   DistanceResult* res;
 
+  /// Information kept from previous queries (may be NULL)
+  DistanceQueryContext* context;
+
   /// Indicates if distance query is finished.
   bool done;
 };
@@ -227,8 +353,103 @@ struct FCLManager
   std::shared_ptr<fcl::BroadPhaseCollisionManager> manager_;
 };
 
+/** \brief The FCL broadphase collision managers that can be used for the objects of a world or robot */
+namespace BroadphaseTypes
+{
+/** \brief The FCL broadphase collision managers that can be used for the objects of a world or robot */
+enum Type
+{
+  /** \brief fcl::DynamicAABBTreeCollisionManager; the default, and best suited for objects that move */
+  DYNAMIC_AABB_TREE,
+
+  /** \brief fcl::DynamicAABBTreeCollisionManager_Array */
+  DYNAMIC_AABB_TREE_ARRAY,
+
+  /** \brief fcl::SaPCollisionManager (sweep and prune) */
+  SAP,
+
+  /** \brief fcl::SSaPCollisionManager (simple sweep and prune) */
+  SSAP,
+
+  /** \brief fcl::IntervalTreeCollisionManager */
+  INTERVAL_TREE,
+
+  /** \brief fcl::NaiveCollisionManager (all pairs are checked) */
+  NAIVE,
+
+  /** \brief Select the manager that answers the queries fastest for the current objects (see
+      selectBroadphaseType()) */
+  AUTO
+};
+}
+
+/** \brief The FCL broadphase collision managers that can be used for the objects of a world or robot */
+typedef BroadphaseTypes::Type BroadphaseType;
+
+/** \brief Construct an empty broadphase manager of type \e type; BroadphaseTypes::AUTO constructs the default
+    fcl::DynamicAABBTreeCollisionManager */
+fcl::BroadPhaseCollisionManager* createBroadphaseManager(BroadphaseType type);
+
+/** \brief Get the name of \e type, as accepted by parseBroadphaseType() */
+std::string getBroadphaseTypeName(BroadphaseType type);
+
+/** \brief Get the type named \e name ("dynamic_aabb_tree", "dynamic_aabb_tree_array", "sap", "ssap", "interval_tree",
+    "naive" or "auto"). Return false if the name is not known. */
+bool parseBroadphaseType(const std::string& name, BroadphaseType& type);
+
+/** \brief Benchmark the broadphase managers on \e objects: each manager is built from \e objects and queried with
+    each of \e queries (or, if \e queries is empty, updated and queried for the pairs of its own objects, as done for
+    self-collision checks), and the type of the fastest one is returned. Only the broadphase is timed; the queries do
+    not run narrowphase checks. */
+BroadphaseType selectBroadphaseType(const std::vector<fcl::CollisionObject*>& objects,
+                                    const std::vector<fcl::CollisionObject*>& queries);
+
+/** \brief Set the broadphase type used by the FCL worlds and robots constructed from now on */
+void setDefaultBroadphaseType(BroadphaseType type);
+
+/** \brief Get the broadphase type used by the FCL worlds and robots constructed from now on
+    (BroadphaseTypes::DYNAMIC_AABB_TREE, unless changed with setDefaultBroadphaseType()) */
+BroadphaseType getDefaultBroadphaseType();
+
+/** \brief A collision object that moves from its transform to an end transform, for continuous collision checking.
+
+    Its AABB covers the geometry along the whole motion, so broadphase queries with it return all candidate pairs for
+    continuousCollisionCallback(). The motion is interpolated linearly in translation and rotation, as done by
+    fcl::continuousCollide() with fcl::CCDM_LINEAR. */
+class FCLSweptCollisionObject : public fcl::CollisionObject
+{
+public:
+  /** \brief Copy \e object (so that its local AABB is not computed again) and let it move from \e start to \e end */
+  FCLSweptCollisionObject(const fcl::CollisionObject& object, const fcl::Transform3f& start,
+                          const fcl::Transform3f& end);
+
+  /** \brief Construct an object for \e geometry that moves from \e start to \e end */
+  FCLSweptCollisionObject(const std::shared_ptr<fcl::CollisionGeometry>& geometry, const fcl::Transform3f& start,
+                          const fcl::Transform3f& end);
+
+  /** \brief The transform at the end of the motion */
+  const fcl::Transform3f& getEndTransform() const
+  {
+    return end_transform_;
+  }
+
+private:
+  void computeSweptAABB();
+
+  fcl::Transform3f end_transform_;
+};
+
 bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data);
 
+/** \brief Broadphase callback for boolean collision queries: stops at the first pair in collision and records it.
+    \e data is a pointer to BooleanCollisionData */
+bool booleanCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data);
+
+/** \brief Broadphase callback for continuous collision checking. Works like collisionCallback(), but checks
+    FCLSweptCollisionObject's along their motion; other objects are considered static. Contacts are computed at the
+    time of first contact. \e data is a pointer to CollisionData. */
+bool continuousCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data);
+
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist);
 
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape, const robot_model::LinkModel* link,
@@ -243,8 +464,100 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
                                             const robot_state::AttachedBody* ab, int shape_index);
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape, double scale, double padding,
                                             const World::Object* obj);
+
+/** \brief Remove the cached FCL geometry of shapes that no longer exist */
 void cleanCollisionGeometryCache();
 
+/** \brief Counters describing the use of the cache of FCL geometry built by createCollisionGeometry() */
+struct FCLGeometryCacheStats
+{
+  FCLGeometryCacheStats()
+    : hits(0), misses(0), evictions(0), entries(0), bvh_reuses(0), bvh_models(0), scaled_shapes(0)
+  {
+  }
+
+  /// Number of requests answered with previously built geometry
+  std::size_t hits;
+
+  /// Number of requests for which geometry had to be constructed
+  std::size_t misses;
+
+  /// Number of entries removed because their shape no longer exists
+  std::size_t evictions;
+
+  /// Number of entries currently in the cache
+  std::size_t entries;
+
+  /// Number of mesh BVH models copied from a model built earlier from identical mesh data, instead of being built
+  std::size_t bvh_reuses;
+
+  /// Number of built mesh BVH models currently kept for reuse
+  std::size_t bvh_models;
+
+  /// Number of scaled or padded copies of shapes currently kept, so that the geometry built for them is reused when
+  /// the same scale and padding are requested again
+  std::size_t scaled_shapes;
+};
+
+/** \brief Get the usage counters of the FCL geometry cache (accumulated since the start of the process) */
+FCLGeometryCacheStats getCollisionGeometryCacheStats();
+
+/** \brief Statistics about the narrowphase checks of one pair of objects, accumulated while narrowphase
+    instrumentation is enabled (see setNarrowPhaseInstrumentation()) */
+struct NarrowPhaseStatistics
+{
+  /// Number of bins of \e time_histogram: bin 0 counts checks faster than 1us, each next bin covers ten times longer
+  /// checks, and the last bin counts checks that took 1s or more
+  static const std::size_t HISTOGRAM_BINS = 8;
+
+  NarrowPhaseStatistics();
+
+  /// Number of narrowphase collision checks
+  std::size_t collision_calls;
+
+  /// Number of narrowphase collision checks that found contacts
+  std::size_t collision_contacts;
+
+  /// Total time spent in narrowphase collision checks (seconds)
+  double collision_time;
+
+  /// Number of narrowphase distance computations
+  std::size_t distance_calls;
+
+  /// Number of narrowphase distance computations that found the objects in contact
+  std::size_t distance_contacts;
+
+  /// Total time spent in narrowphase distance computations (seconds)
+  double distance_time;
+
+  /// Number of checks (collision and distance) by duration
+  std::size_t time_histogram[HISTOGRAM_BINS];
+};
+
+/** \brief Narrowphase statistics indexed by the (sorted) names of the pair of objects */
+typedef std::map<std::pair<std::string, std::string>, NarrowPhaseStatistics> NarrowPhaseStatisticsMap;
+
+/** \brief Enable or disable the accumulation of the time spent and contacts found in narrowphase checks, per pair of
+    objects. This is meant for tuning (e.g., finding the pairs worth disabling in the SRDF or the meshes worth
+    simplifying) and is disabled by default, as it slows collision checking down. */
+void setNarrowPhaseInstrumentation(bool enabled);
+
+/** \brief Check whether narrowphase instrumentation is enabled */
+bool isNarrowPhaseInstrumentationEnabled();
+
+/** \brief Get the statistics accumulated so far */
+void getNarrowPhaseStatistics(NarrowPhaseStatisticsMap& statistics);
+
+/** \brief Forget the statistics accumulated so far */
+void clearNarrowPhaseStatistics();
+
+/** \brief Print the statistics accumulated so far, the pairs that took the most time first */
+void printNarrowPhaseStatistics(std::ostream& out = std::cout);
+
+/** \brief Add the statistics accumulated so far to the events and averages of moveit::tools::Profiler, which must be
+    running */
+void reportNarrowPhaseStatistics();
+
 inline void transform2fcl(const Eigen::Affine3d& b, fcl::Transform3f& f)
 {
   Eigen::Quaterniond q(b.linear());
@@ -38,6 +38,7 @@
 #define MOVEIT_COLLISION_DETECTION_FCL_COLLISION_ROBOT_
 
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <boost/thread/mutex.hpp>
 
 namespace collision_detection
 {
@@ -60,6 +61,12 @@ public:
                                   const robot_state::RobotState& state1, const robot_state::RobotState& state2,
                                   const AllowedCollisionMatrix& acm) const;
 
+  /** \brief Check only whether there is a self collision. Uses the cached broadphase managers of the links, so no
+      memory is allocated, unless \e state has attached bodies or contacts are conditionally allowed by \e acm */
+  virtual void checkSelfCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                         const robot_state::RobotState& state,
+                                         const AllowedCollisionMatrix& acm) const override;
+
   virtual void checkOtherCollision(const CollisionRequest& req, CollisionResult& res,
                                    const robot_state::RobotState& state, const CollisionRobot& other_robot,
                                    const robot_state::RobotState& other_state) const;
@@ -83,10 +90,36 @@ public:
                              const CollisionRobot& other_robot,
                              const robot_state::RobotState& other_state) const override;
 
+  /** \brief Compute the distance to self-collision, reusing the information in \e context that was kept from the
+      previous queries (see DistanceQueryContext) */
+  void distanceSelf(const DistanceRequest& req, DistanceResult& res, const robot_state::RobotState& state,
+                    DistanceQueryContext& context) const;
+
+  /** \brief Set the broadphase manager used for the links of the robot. With BroadphaseTypes::AUTO, the manager is
+      selected right away with selectBroadphaseType(), benchmarking self-collision queries for the default state of
+      the robot. This must not be called concurrently with collision queries. The default is
+      getDefaultBroadphaseType(); copies of this robot keep the type of the robot they are copied from. */
+  void setBroadphaseType(BroadphaseType type);
+
+  /** \brief Get the broadphase manager used for the links of the robot; this is never BroadphaseTypes::AUTO */
+  BroadphaseType getBroadphaseType() const
+  {
+    return broadphase_type_;
+  }
+
 protected:
   virtual void updatedPaddingOrScaling(const std::vector<std::string>& links);
   void constructFCLObject(const robot_state::RobotState& state, FCLObject& fcl_obj) const;
+  void constructAttachedBodiesFCLObject(const robot_state::RobotState& state, FCLObject& fcl_obj) const;
+  /** \brief Construct FCLSweptCollisionObject's for the links and attached bodies of the robot as it moves from
+      \e state1 to \e state2 */
+  void constructSweptFCLObject(const robot_state::RobotState& state1, const robot_state::RobotState& state2,
+                               FCLObject& fcl_obj) const;
   void allocSelfCollisionBroadPhase(const robot_state::RobotState& state, FCLManager& manager) const;
+  /** \brief Call \e fn with the FCL objects of the links and attached bodies of the robot at \e state, until it
+      returns true. The objects of the links are taken from a cached broadphase manager, so they are not allocated */
+  void forEachFCLObject(const robot_state::RobotState& state, bool (*fn)(fcl::CollisionObject* object, void* data),
+                        void* data) const;
   void getAttachedBodyObjects(const robot_state::AttachedBody* ab, std::vector<FCLGeometryConstPtr>& geoms) const;
 
   void checkSelfCollisionHelper(const CollisionRequest& req, CollisionResult& res, const robot_state::RobotState& state,
@@ -94,9 +127,31 @@ protected:
   void checkOtherCollisionHelper(const CollisionRequest& req, CollisionResult& res,
                                  const robot_state::RobotState& state, const CollisionRobot& other_robot,
                                  const robot_state::RobotState& other_state, const AllowedCollisionMatrix* acm) const;
+  void checkSelfCollisionHelper(const CollisionRequest& req, CollisionResult& res,
+                                const robot_state::RobotState& state1, const robot_state::RobotState& state2,
+                                const AllowedCollisionMatrix* acm) const;
+  void checkOtherCollisionHelper(const CollisionRequest& req, CollisionResult& res,
+                                 const robot_state::RobotState& state1, const robot_state::RobotState& state2,
+                                 const CollisionRobot& other_robot, const robot_state::RobotState& other_state1,
+                                 const robot_state::RobotState& other_state2, const AllowedCollisionMatrix* acm) const;
 
   std::vector<FCLGeometryConstPtr> geoms_;
   std::vector<FCLCollisionObjectConstPtr> fcl_objs_;
+
+  /** \brief The type of the broadphase managers built for the links */
+  BroadphaseType broadphase_type_;
+
+  /** \brief A broadphase manager for the links of the robot that is kept across queries */
+  struct CachedBroadPhase;
+  /** \brief Takes a CachedBroadPhase from the pool, updates it to a state and returns it to the pool when destroyed */
+  class ScopedBroadPhase;
+
+  /** \brief Cached broadphase managers that are not in use; each concurrent query takes its own */
+  mutable std::vector<std::shared_ptr<CachedBroadPhase>> broadphase_pool_;
+  /** \brief Incremented whenever geoms_ or broadphase_type_ change, so that outdated managers are not returned to the
+      pool */
+  mutable unsigned int broadphase_generation_;
+  mutable boost::mutex broadphase_lock_;
 };
 }
 
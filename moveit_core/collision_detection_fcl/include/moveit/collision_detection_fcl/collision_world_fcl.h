@@ -40,6 +40,8 @@
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
 #include <fcl/broadphase/broadphase.h>
 #include <memory>
+#include <set>
+#include <unordered_set>
 
 namespace collision_detection
 {
@@ -60,6 +62,14 @@ public:
   virtual void checkRobotCollision(const CollisionRequest& req, CollisionResult& res, const CollisionRobot& robot,
                                    const robot_state::RobotState& state1, const robot_state::RobotState& state2,
                                    const AllowedCollisionMatrix& acm) const;
+
+  /** \brief Check only whether the robot is in collision with the world. The FCL objects of the links are taken from
+      the cached broadphase managers of \e robot, so no memory is allocated, unless \e state has attached bodies or
+      contacts are conditionally allowed by \e acm */
+  virtual void checkRobotCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                          const CollisionRobot& robot, const robot_state::RobotState& state,
+                                          const AllowedCollisionMatrix& acm) const override;
+
   virtual void checkWorldCollision(const CollisionRequest& req, CollisionResult& res,
                                    const CollisionWorld& other_world) const;
   virtual void checkWorldCollision(const CollisionRequest& req, CollisionResult& res, const CollisionWorld& other_world,
@@ -68,26 +78,99 @@ public:
   virtual void distanceRobot(const DistanceRequest& req, DistanceResult& res, const CollisionRobot& robot,
                              const robot_state::RobotState& state) const override;
 
+  /** \brief Compute the distance between a robot and the world, reusing the information in \e context that was kept
+      from the previous queries (see DistanceQueryContext) */
+  void distanceRobot(const DistanceRequest& req, DistanceResult& res, const CollisionRobot& robot,
+                     const robot_state::RobotState& state, DistanceQueryContext& context) const;
+
   virtual void distanceWorld(const DistanceRequest& req, DistanceResult& res,
                              const CollisionWorld& world) const override;
 
   virtual void setWorld(const WorldPtr& world);
 
+  /** \brief Set the broadphase manager used for the objects that did not change for a while (those in the shared
+      structure, see SharedObjects); the objects changed since are always kept in a dynamic AABB tree, which is the
+      fastest to update. With BroadphaseTypes::AUTO, the manager is selected with selectBroadphaseType() when the
+      structure is rebuilt; this is repeated only once the number of objects changed considerably. Worlds copied from
+      this one start with the same type. The default is getDefaultBroadphaseType(). */
+  void setBroadphaseType(BroadphaseType type);
+
+  /** \brief Get the broadphase type set with setBroadphaseType() */
+  BroadphaseType getBroadphaseType() const
+  {
+    return broadphase_type_;
+  }
+
+  /** \brief Get the type of the broadphase manager currently used for the shared objects; unlike
+      getBroadphaseType(), this is never BroadphaseTypes::AUTO */
+  BroadphaseType getActiveBroadphaseType() const;
+
 protected:
   void checkWorldCollisionHelper(const CollisionRequest& req, CollisionResult& res, const CollisionWorld& other_world,
                                  const AllowedCollisionMatrix* acm) const;
   void checkRobotCollisionHelper(const CollisionRequest& req, CollisionResult& res, const CollisionRobot& robot,
                                  const robot_state::RobotState& state, const AllowedCollisionMatrix* acm) const;
+  void checkRobotCollisionHelper(const CollisionRequest& req, CollisionResult& res, const CollisionRobot& robot,
+                                 const robot_state::RobotState& state1, const robot_state::RobotState& state2,
+                                 const AllowedCollisionMatrix* acm) const;
 
   void constructFCLObject(const World::Object* obj, FCLObject& fcl_obj) const;
   void updateFCLObject(const std::string& id);
 
+  /** \brief Update the transforms of the FCL objects of \e obj after its shapes moved, without looking up their
+      geometry. Returns false if the FCL objects are shared with another world or do not correspond one to one to the
+      shapes; they need to be rebuilt with updateFCLObject() then. */
+  bool moveFCLObject(const World::Object& obj);
+
+  /** \brief Report the pairs of \e object and the objects of this world to \e callback */
+  void collide(fcl::CollisionObject* object, void* data, fcl::CollisionCallBack callback) const;
+
+  /** \brief Report the pairs of the objects of this world and those of \e other to \e callback */
+  void collide(const CollisionWorldFCL& other, void* data, fcl::CollisionCallBack callback) const;
+
+  /** \brief Report the pairs of \e object and the objects of this world to the distance \e callback */
+  void distance(fcl::CollisionObject* object, void* data, fcl::DistanceCallBack callback) const;
+
+  /** \brief Report the pairs of the objects of this world and those of \e other to the distance \e callback */
+  void distance(const CollisionWorldFCL& other, void* data, fcl::DistanceCallBack callback) const;
+
+  /** \brief FCL objects registered to a broadphase structure that is not modified any more, so it can be shared between
+      a world and the worlds copied from it */
+  struct SharedObjects
+  {
+    std::unique_ptr<fcl::BroadPhaseCollisionManager> manager_;
+    std::map<std::string, FCLObject> objects_;
+
+    /// the type of \e manager_
+    BroadphaseType type_;
+
+    /// the number of collision objects for which \e type_ was selected with BroadphaseTypes::AUTO (0 otherwise)
+    std::size_t tuned_size_;
+  };
+
+  /// the broadphase type of the shared objects, as set with setBroadphaseType()
+  BroadphaseType broadphase_type_;
+
+  /// the objects created or changed since \e shared_objs_ was built
   std::unique_ptr<fcl::BroadPhaseCollisionManager> manager_;
   std::map<std::string, FCLObject> fcl_objs_;
 
+  /// the objects shared with the world this one was copied from; those in \e hidden_ids_ are ignored by queries
+  std::shared_ptr<const SharedObjects> shared_objs_;
+  std::set<std::string> hidden_ids_;
+  std::unordered_set<const fcl::CollisionObject*> hidden_objects_;
+
 private:
   void initialize();
   void notifyObjectChange(const ObjectConstPtr& obj, World::Action action);
+
+  /** \brief Exclude the shared FCL objects of \e id from the queries of this world */
+  void hideSharedObject(const std::string& id);
+
+  /** \brief Move all objects into a new shared broadphase structure once enough of them changed; with \e force, also
+      if only a few did */
+  void shareObjects(bool force = false);
+
   World::ObserverHandle observer_handle_;
 };
 }
@@ -35,29 +35,40 @@
 /* Author: Ioan Sucan, Jia Pan */
 
 #include <moveit/collision_detection_fcl/collision_common.h>
+#include <moveit/profiler/profiler.h>
 #include <geometric_shapes/shapes.h>
 #include <fcl/BVH/BVH_model.h>
 #include <fcl/shape/geometric_shapes.h>
 #include <fcl/octree.h>
+#include <fcl/continuous_collision.h>
 #include <boost/thread/mutex.hpp>
+#include <ros/time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <memory>
 
 namespace collision_detection
 {
-bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data)
+namespace
+{
+/** \brief Decide whether the geometries \e cd1 and \e cd2 need to be checked for collision at all, based on the
+    active components, the allowed collision matrix \e acm (and its compiled form, both may be NULL) and the touch
+    links of attached bodies. If contacts between the two are conditionally allowed, \e dcf is set to the function that
+    decides on them. */
+bool needsCollisionCheck(const std::set<const robot_model::LinkModel*>* active_components_only,
+                         const AllowedCollisionMatrix* acm, const CompiledAllowedCollisionMatrix* compiled_acm,
+                         bool verbose, const CollisionGeometryData* cd1, const CollisionGeometryData* cd2,
+                         DecideContactFn& dcf)
 {
-  CollisionData* cdata = reinterpret_cast<CollisionData*>(data);
-  if (cdata->done_)
-    return true;
-  const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
-  const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
-
   // do not collision check geoms part of the same object / link / attached body
   if (cd1->sameObject(*cd2))
     return false;
 
   // If active components are specified
-  if (cdata->active_components_only_)
+  if (active_components_only)
   {
     const robot_model::LinkModel* l1 =
         cd1->type == BodyTypes::ROBOT_LINK ?
@@ -69,25 +80,30 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
             (cd2->type == BodyTypes::ROBOT_ATTACHED ? cd2->ptr.ab->getAttachedLink() : nullptr);
 
     // If neither of the involved components is active
-    if ((!l1 || cdata->active_components_only_->find(l1) == cdata->active_components_only_->end()) &&
-        (!l2 || cdata->active_components_only_->find(l2) == cdata->active_components_only_->end()))
+    if ((!l1 || active_components_only->find(l1) == active_components_only->end()) &&
+        (!l2 || active_components_only->find(l2) == active_components_only->end()))
       return false;
   }
 
   // use the collision matrix (if any) to avoid certain collision checks
-  DecideContactFn dcf;
   bool always_allow_collision = false;
-  if (cdata->acm_)
+  if (acm)
   {
+    // pairs of robot links are looked up by index in the compiled matrix
     AllowedCollision::Type type;
-    bool found = cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), type);
+    bool found;
+    if (compiled_acm && cd1->type == BodyTypes::ROBOT_LINK && cd2->type == BodyTypes::ROBOT_LINK &&
+        compiled_acm->hasLink(cd1->ptr.link) && compiled_acm->hasLink(cd2->ptr.link))
+      found = compiled_acm->getAllowedCollision(cd1->ptr.link, cd2->ptr.link, type);
+    else
+      found = acm->getAllowedCollision(cd1->getID(), cd2->getID(), type);
     if (found)
     {
       // if we have an entry in the collision matrix, we read it
       if (type == AllowedCollision::ALWAYS)
       {
         always_allow_collision = true;
-        if (cdata->req_->verbose)
+        if (verbose)
           ROS_DEBUG_NAMED(
               "collision_detection.fcl", "Collision between '%s' (type '%s') and '%s' (type '%s') is always allowed. "
                                          "No contacts are computed.",
@@ -95,8 +111,8 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
       }
       else if (type == AllowedCollision::CONDITIONAL)
       {
-        cdata->acm_->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
-        if (cdata->req_->verbose)
+        acm->getAllowedCollision(cd1->getID(), cd2->getID(), dcf);
+        if (verbose)
           ROS_DEBUG_NAMED("collision_detection.fcl", "Collision between '%s' and '%s' is conditionally allowed",
                           cd1->getID().c_str(), cd2->getID().c_str());
       }
@@ -110,7 +126,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     if (tl.find(cd1->getID()) != tl.end())
     {
       always_allow_collision = true;
-      if (cdata->req_->verbose)
+      if (verbose)
         ROS_DEBUG_NAMED("collision_detection.fcl",
                         "Robot link '%s' is allowed to touch attached object '%s'. No contacts are computed.",
                         cd1->getID().c_str(), cd2->getID().c_str());
@@ -122,7 +138,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     if (tl.find(cd2->getID()) != tl.end())
     {
       always_allow_collision = true;
-      if (cdata->req_->verbose)
+      if (verbose)
         ROS_DEBUG_NAMED("collision_detection.fcl",
                         "Robot link '%s' is allowed to touch attached object '%s'. No contacts are computed.",
                         cd2->getID().c_str(), cd1->getID().c_str());
@@ -135,8 +151,134 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
       always_allow_collision = true;
   }
 
-  // if collisions are always allowed, we are done
-  if (always_allow_collision)
+  return !always_allow_collision;
+}
+
+/** \brief Decide whether the geometries \e cd1 and \e cd2 need to be checked for collision at all, based on the request
+    and the allowed collision matrix in \e cdata */
+bool needsCollisionCheck(const CollisionData* cdata, const CollisionGeometryData* cd1, const CollisionGeometryData* cd2,
+                         DecideContactFn& dcf)
+{
+  return needsCollisionCheck(cdata->active_components_only_, cdata->acm_, cdata->compiled_acm_.get(),
+                             cdata->req_->verbose, cd1, cd2, dcf);
+}
+
+/** \brief The broadphase reports overlapping AABBs; the bounding spheres of the (padded) geometries are a cheap way to
+    reject pairs that are far apart along the diagonals of their AABBs, before the exact check */
+bool boundingSpheresOverlap(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2)
+{
+  const fcl::CollisionGeometry* g1 = o1->collisionGeometry().get();
+  const fcl::CollisionGeometry* g2 = o2->collisionGeometry().get();
+  const double radius = g1->aabb_radius + g2->aabb_radius;
+  return (o1->getTransform().transform(g1->aabb_center) - o2->getTransform().transform(g2->aabb_center)).sqrLength() <=
+         radius * radius;
+}
+
+/** \brief The integer id of a body reported by BooleanCollisionResult */
+int getBodyIndex(const CollisionGeometryData* cd)
+{
+  switch (cd->type)
+  {
+    case BodyTypes::ROBOT_LINK:
+      return cd->ptr.link->getLinkIndex();
+    case BodyTypes::ROBOT_ATTACHED:
+      return cd->ptr.ab->getAttachedLink()->getLinkIndex();
+    default:
+      break;
+  }
+  return -1;
+}
+
+/** \brief The statistics gathered by narrowphase instrumentation */
+struct NarrowPhaseInstrumentation
+{
+  NarrowPhaseInstrumentation() : enabled_(false)
+  {
+  }
+
+  void record(const std::string& id1, const std::string& id2, bool distance, bool contact, double time)
+  {
+    std::size_t bin = 0;
+    for (double limit = 1e-6; bin + 1 < NarrowPhaseStatistics::HISTOGRAM_BINS && time >= limit; limit *= 10.0)
+      ++bin;
+
+    boost::mutex::scoped_lock slock(lock_);
+    NarrowPhaseStatistics& stats = statistics_[id1 < id2 ? std::make_pair(id1, id2) : std::make_pair(id2, id1)];
+    if (distance)
+    {
+      stats.distance_calls++;
+      stats.distance_time += time;
+      if (contact)
+        stats.distance_contacts++;
+    }
+    else
+    {
+      stats.collision_calls++;
+      stats.collision_time += time;
+      if (contact)
+        stats.collision_contacts++;
+    }
+    stats.time_histogram[bin]++;
+  }
+
+  std::atomic<bool> enabled_;
+  NarrowPhaseStatisticsMap statistics_;
+  boost::mutex lock_;
+};
+
+NarrowPhaseInstrumentation& GetNarrowPhaseInstrumentation()
+{
+  static NarrowPhaseInstrumentation instrumentation;
+  return instrumentation;
+}
+
+/** \brief Measures the time of a narrowphase check, from construction to destruction, if instrumentation is enabled */
+class ScopedNarrowPhaseTimer
+{
+public:
+  ScopedNarrowPhaseTimer(const CollisionGeometryData* cd1, const CollisionGeometryData* cd2, bool distance)
+    : cd1_(cd1), cd2_(cd2), distance_(distance), contact_(false), enabled_(GetNarrowPhaseInstrumentation().enabled_)
+  {
+    if (enabled_)
+      start_ = ros::WallTime::now();
+  }
+
+  ~ScopedNarrowPhaseTimer()
+  {
+    if (enabled_)
+      GetNarrowPhaseInstrumentation().record(cd1_->getID(), cd2_->getID(), distance_, contact_,
+                                             (ros::WallTime::now() - start_).toSec());
+  }
+
+  void setContact(bool contact)
+  {
+    contact_ = contact;
+  }
+
+private:
+  const CollisionGeometryData* cd1_;
+  const CollisionGeometryData* cd2_;
+  bool distance_;
+  bool contact_;
+  bool enabled_;
+  ros::WallTime start_;
+};
+}
+
+bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data)
+{
+  CollisionData* cdata = reinterpret_cast<CollisionData*>(data);
+  if (cdata->done_)
+    return true;
+  const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
+  const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
+
+  // check only the pairs that are not always allowed to collide
+  DecideContactFn dcf;
+  if (!needsCollisionCheck(cdata, cd1, cd2, dcf))
+    return false;
+
+  if (cdata->req_->bounding_sphere_prefilter && !boundingSpheresOverlap(o1, o2))
     return false;
 
   if (cdata->req_->verbose)
@@ -164,6 +306,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
             std::min(cdata->req_->max_contacts_per_pair - have, cdata->req_->max_contacts - cdata->res_->contact_count);
     }
 
+  ScopedNarrowPhaseTimer timer(cd1, cd2, false);
   if (dcf)
   {
     // if we have a decider for allowed contacts, we need to look at all the contacts
@@ -174,6 +317,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     int num_contacts = fcl::collide(o1, o2, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), enable_contact,
                                                                   num_max_cost_sources, enable_cost),
                                     col_result);
+    timer.setContact(num_contacts > 0);
     if (num_contacts > 0)
     {
       if (cdata->req_->verbose)
@@ -242,6 +386,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
       int num_contacts = fcl::collide(
           o1, o2, fcl::CollisionRequest(want_contact_count, enable_contact, num_max_cost_sources, enable_cost),
           col_result);
+      timer.setContact(num_contacts > 0);
       if (num_contacts > 0)
       {
         int num_contacts_initial = num_contacts;
@@ -297,6 +442,7 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
       fcl::CollisionResult col_result;
       int num_contacts =
           fcl::collide(o1, o2, fcl::CollisionRequest(1, enable_contact, num_max_cost_sources, enable_cost), col_result);
+      timer.setContact(num_contacts > 0);
       if (num_contacts > 0)
       {
         cdata->res_->collision = true;
@@ -348,45 +494,449 @@ bool collisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
   return cdata->done_;
 }
 
-struct FCLShapeCache
+bool booleanCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data)
 {
-  using ShapeKey = std::weak_ptr<const shapes::Shape>;
-  using ShapeMap = std::map<ShapeKey, FCLGeometryConstPtr, std::owner_less<ShapeKey>>;
+  BooleanCollisionData* cdata = reinterpret_cast<BooleanCollisionData*>(data);
+  if (cdata->res_->collision)
+    return true;
+  const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
+  const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
+
+  DecideContactFn dcf;
+  if (!needsCollisionCheck(cdata->active_components_only_, cdata->acm_, cdata->compiled_acm_.get(), false, cd1, cd2,
+                           dcf))
+    return false;
+  if (cdata->req_->bounding_sphere_prefilter && !boundingSpheresOverlap(o1, o2))
+    return false;
+
+  ScopedNarrowPhaseTimer timer(cd1, cd2, false);
+  bool collision = false;
+  if (dcf)
+  {
+    // conditionally allowed contacts can only be decided on the contacts themselves, so this case is not heap free
+    fcl::CollisionResult col_result;
+    int num_contacts =
+        fcl::collide(o1, o2, fcl::CollisionRequest(std::numeric_limits<size_t>::max(), true), col_result);
+    Contact c;
+    for (int i = 0; !collision && i < num_contacts; ++i)
+    {
+      fcl2contact(col_result.getContact(i), c);
+      collision = !dcf(c);
+    }
+  }
+  else
+  {
+    // FCL records the colliding primitives even without contacts; reusing the result keeps its storage around
+    static thread_local fcl::CollisionResult col_result;
+    col_result.clear();
+    collision = fcl::collide(o1, o2, fcl::CollisionRequest(1, false), col_result) > 0;
+  }
+  timer.setContact(collision);
+
+  if (collision)
+  {
+    cdata->res_->collision = true;
+    cdata->res_->body_ids[0] = getBodyIndex(cd1);
+    cdata->res_->body_ids[1] = getBodyIndex(cd2);
+    cdata->res_->body_types[0] = cd1->type;
+    cdata->res_->body_types[1] = cd2->type;
+  }
+  return collision;
+}
+
+FCLSweptCollisionObject::FCLSweptCollisionObject(const fcl::CollisionObject& object, const fcl::Transform3f& start,
+                                                 const fcl::Transform3f& end)
+  : fcl::CollisionObject(object), end_transform_(end)
+{
+  setTransform(start);
+  computeSweptAABB();
+}
+
+FCLSweptCollisionObject::FCLSweptCollisionObject(const std::shared_ptr<fcl::CollisionGeometry>& geometry,
+                                                 const fcl::Transform3f& start, const fcl::Transform3f& end)
+  : fcl::CollisionObject(geometry, start), end_transform_(end)
+{
+  computeSweptAABB();
+}
+
+void FCLSweptCollisionObject::computeSweptAABB()
+{
+  // the object-level user data marks the object as swept for continuousCollisionCallback()
+  setUserData(this);
+
+  const fcl::Transform3f start = getTransform();
+  setTransform(end_transform_);
+  computeAABB();
+  const fcl::AABB end_aabb = getAABB();
+  setTransform(start);
+  computeAABB();
+  aabb += end_aabb;
+
+  // between the two poses, points rotate by at most the relative rotation angle about the reference point of the
+  // motion, so they leave the segment connecting their start and end positions by at most the sagitta of that arc
+  double cos_half_angle = fabs(start.getQuatRotation().dot(end_transform_.getQuatRotation()));
+  if (cos_half_angle < 1.0)
+  {
+    const fcl::CollisionGeometry* geometry = collisionGeometry().get();
+    double radius = geometry->aabb_center.length() + geometry->aabb_radius;
+    double sagitta = radius * (1.0 - cos_half_angle);
+    aabb.expand(fcl::Vec3f(sagitta, sagitta, sagitta));
+  }
+}
+
+bool continuousCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data)
+{
+  CollisionData* cdata = reinterpret_cast<CollisionData*>(data);
+  if (cdata->done_)
+    return true;
+  const CollisionGeometryData* cd1 = static_cast<const CollisionGeometryData*>(o1->collisionGeometry()->getUserData());
+  const CollisionGeometryData* cd2 = static_cast<const CollisionGeometryData*>(o2->collisionGeometry()->getUserData());
 
-  FCLShapeCache() : clean_count_(0)
+  DecideContactFn dcf;
+  if (!needsCollisionCheck(cdata, cd1, cd2, dcf))
+    return false;
+
+  const FCLSweptCollisionObject* s1 = static_cast<const FCLSweptCollisionObject*>(o1->getUserData());
+  const FCLSweptCollisionObject* s2 = static_cast<const FCLSweptCollisionObject*>(o2->getUserData());
+  const fcl::Transform3f& end1 = s1 ? s1->getEndTransform() : o1->getTransform();
+  const fcl::Transform3f& end2 = s2 ? s2->getEndTransform() : o2->getTransform();
+
+  // conservative advancement supports all pairs of primitive shapes and meshes; octrees are only sampled
+  const bool octree = o1->collisionGeometry()->getNodeType() == fcl::GEOM_OCTREE ||
+                      o2->collisionGeometry()->getNodeType() == fcl::GEOM_OCTREE;
+  fcl::ContinuousCollisionRequest ccd_request(10, 1e-4, fcl::CCDM_LINEAR, fcl::GST_LIBCCD,
+                                              octree ? fcl::CCDC_NAIVE : fcl::CCDC_CONSERVATIVE_ADVANCEMENT);
+  fcl::ContinuousCollisionResult ccd_result;
+  if (fcl::continuousCollide(o1->collisionGeometry().get(), o1->getTransform(), end1, o2->collisionGeometry().get(),
+                             o2->getTransform(), end2, ccd_request, ccd_result) < 0.0)
   {
+    // the pair is not supported by conservative advancement
+    ccd_request.ccd_solver_type = fcl::CCDC_NAIVE;
+    ccd_result = fcl::ContinuousCollisionResult();
+    fcl::continuousCollide(o1->collisionGeometry().get(), o1->getTransform(), end1, o2->collisionGeometry().get(),
+                           o2->getTransform(), end2, ccd_request, ccd_result);
   }
+  if (!ccd_result.is_collide)
+    return false;
 
-  void bumpUseCount(bool force = false)
+  if (cdata->req_->verbose)
+    ROS_DEBUG_NAMED("collision_detection.fcl", "'%s' and '%s' come into contact at time %lf of the motion",
+                    cd1->getID().c_str(), cd2->getID().c_str(), ccd_result.time_of_contact);
+
+  // compute contacts (and apply the conditionally allowed contacts) at the time of contact
+  fcl::CollisionObject contact1(*o1), contact2(*o2);
+  contact1.setTransform(ccd_result.contact_tf1);
+  contact1.computeAABB();
+  contact2.setTransform(ccd_result.contact_tf2);
+  contact2.computeAABB();
+  collisionCallback(&contact1, &contact2, data);
+
+  // the geometries may only be touching at the time of contact, without a discrete contact
+  if (!cdata->res_->collision && !dcf)
   {
-    clean_count_++;
+    cdata->res_->collision = true;
+    if (!cdata->req_->contacts && !cdata->req_->cost)
+      cdata->done_ = true;
+    else if (cdata->req_->is_done)
+      cdata->done_ = cdata->req_->is_done(*cdata->res_);
+  }
+
+  return cdata->done_;
+}
 
-    // clean-up for cache (we don't want to keep infinitely large number of weak ptrs stored)
-    if (clean_count_ > MAX_CLEAN_COUNT || force)
+struct FCLShapeCache
+{
+  using ShapeKey = std::weak_ptr<const shapes::Shape>;
+  using ShapeMap = std::map<ShapeKey, FCLGeometryConstPtr, std::owner_less<ShapeKey>>;
+
+  /** \brief The cache is split in independently locked shards so that threads creating geometry for different shapes
+      do not contend on a single mutex */
+  struct Shard
+  {
+    Shard() : clean_count_(0)
     {
-      clean_count_ = 0;
-      for (auto it = map_.begin(); it != map_.end();)
+    }
+
+    /** \brief Count a use of the shard and, every MAX_CLEAN_COUNT uses (or if \e force is true), remove the entries of
+        shapes that no longer exist. Returns the number of removed entries. Must be called with lock_ held. */
+    std::size_t bumpUseCount(bool force = false)
+    {
+      clean_count_++;
+
+      // clean-up for cache (we don't want to keep infinitely large number of weak ptrs stored)
+      std::size_t removed = 0;
+      if (clean_count_ > MAX_CLEAN_COUNT || force)
       {
-        auto nit = it;
-        ++nit;
-        if (it->first.expired())
-          map_.erase(it);
-        it = nit;
+        clean_count_ = 0;
+        for (auto it = map_.begin(); it != map_.end();)
+        {
+          auto nit = it;
+          ++nit;
+          if (it->first.expired())
+          {
+            map_.erase(it);
+            removed++;
+          }
+          it = nit;
+        }
       }
-      //      ROS_DEBUG_NAMED("collision_detection.fcl", "Cleaning up cache for FCL objects that correspond to static
-      //      shapes. Cache size
-      //      reduced from %u
-      //      to %u", from, (unsigned int)map_.size());
+      return removed;
     }
+
+    ShapeMap map_;
+    unsigned int clean_count_;
+    boost::mutex lock_;
+  };
+
+  FCLShapeCache() : hits_(0), misses_(0), evictions_(0)
+  {
   }
 
-  static const unsigned int MAX_CLEAN_COUNT = 100;  // every this many uses of the cache, a cleaning operation is
+  Shard& getShard(const shapes::Shape* shape)
+  {
+    // shapes are heap allocated, so the lowest bits of their address carry no information
+    std::size_t h = reinterpret_cast<std::uintptr_t>(shape) >> 4;
+    h ^= h >> 7;
+    return shards_[h % NUM_SHARDS];
+  }
+
+  /** \brief Bump the use count of \e shard and account for the removed entries. Must be called with the shard locked */
+  void bumpUseCount(Shard& shard, bool force = false)
+  {
+    std::size_t removed = shard.bumpUseCount(force);
+    if (removed)
+      evictions_ += removed;
+  }
+
+  static const unsigned int MAX_CLEAN_COUNT = 100;  // every this many uses of a shard, a cleaning operation is
                                                     // executed (this is only removal of expired entries)
-  ShapeMap map_;
-  unsigned int clean_count_;
+  static const std::size_t NUM_SHARDS = 16;
+  Shard shards_[NUM_SHARDS];
+
+  std::atomic<std::size_t> hits_;
+  std::atomic<std::size_t> misses_;
+  std::atomic<std::size_t> evictions_;
+};
+
+/** \brief Already built BVH models, indexed by the hash of the mesh they were built from. Shapes are often created
+    several times from the same mesh data (links loaded from the same resource, objects that are removed and added
+    again to the world, padded copies of links recreated with the same padding), and copying a model is much cheaper
+    than splitting and fitting its hierarchy again. */
+template <typename BV>
+struct FCLMeshCache
+{
+  using BVHModelConstPtr = std::shared_ptr<const fcl::BVHModel<BV>>;
+
+  FCLMeshCache() : reuses_(0)
+  {
+  }
+
+  static std::size_t hashMesh(const shapes::Mesh* mesh)
+  {
+    // FNV-1a over the raw vertex and triangle data
+    std::uint64_t h = 14695981039346656037ULL;
+    const unsigned char* v = reinterpret_cast<const unsigned char*>(mesh->vertices);
+    for (std::size_t i = 0; i < sizeof(double) * 3 * mesh->vertex_count; ++i)
+      h = (h ^ v[i]) * 1099511628211ULL;
+    const unsigned char* t = reinterpret_cast<const unsigned char*>(mesh->triangles);
+    for (std::size_t i = 0; i < sizeof(unsigned int) * 3 * mesh->triangle_count; ++i)
+      h = (h ^ t[i]) * 1099511628211ULL;
+    return static_cast<std::size_t>(h);
+  }
+
+  /** \brief Check that \e model was built from exactly the data in \e mesh (guards against hash collisions) */
+  static bool sameMesh(const fcl::BVHModel<BV>& model, const shapes::Mesh* mesh)
+  {
+    if (model.num_vertices != static_cast<int>(mesh->vertex_count) ||
+        model.num_tris != static_cast<int>(mesh->triangle_count))
+      return false;
+    for (unsigned int i = 0; i < mesh->vertex_count; ++i)
+      for (int j = 0; j < 3; ++j)
+        if (model.vertices[i][j] != mesh->vertices[3 * i + j])
+          return false;
+    for (unsigned int i = 0; i < mesh->triangle_count; ++i)
+      for (int j = 0; j < 3; ++j)
+        if (model.tri_indices[i][j] != mesh->triangles[3 * i + j])
+          return false;
+    return true;
+  }
+
+  BVHModelConstPtr find(std::size_t hash, const shapes::Mesh* mesh)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    auto it = models_.find(hash);
+    if (it != models_.end() && sameMesh(*it->second, mesh))
+    {
+      reuses_++;
+      return it->second;
+    }
+    return BVHModelConstPtr();
+  }
+
+  void insert(std::size_t hash, const BVHModelConstPtr& model)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (!models_.insert(std::make_pair(hash, model)).second)
+      return;
+    order_.push_back(hash);
+    while (order_.size() > MAX_ENTRIES)
+    {
+      models_.erase(order_.front());
+      order_.pop_front();
+    }
+  }
+
+  static const std::size_t MAX_ENTRIES = 64;  // models are kept in the order they were built; the oldest is dropped
+  std::map<std::size_t, BVHModelConstPtr> models_;
+  std::deque<std::size_t> order_;
+  std::atomic<std::size_t> reuses_;
   boost::mutex lock_;
 };
 
+template <typename BV>
+FCLMeshCache<BV>& GetMeshCache()
+{
+  static FCLMeshCache<BV> cache;
+  return cache;
+}
+
+/** \brief Build the BVH model for \e mesh, or copy it from a model previously built from identical data */
+template <typename BV>
+fcl::BVHModel<BV>* createBVHModel(const shapes::Mesh* mesh)
+{
+  if (mesh->vertex_count == 0 || mesh->triangle_count == 0)
+    return new fcl::BVHModel<BV>();
+
+  FCLMeshCache<BV>& cache = GetMeshCache<BV>();
+  std::size_t hash = FCLMeshCache<BV>::hashMesh(mesh);
+  typename FCLMeshCache<BV>::BVHModelConstPtr model = cache.find(hash, mesh);
+  if (model)
+    return new fcl::BVHModel<BV>(*model);
+
+  auto g = new fcl::BVHModel<BV>();
+  std::vector<fcl::Triangle> tri_indices(mesh->triangle_count);
+  for (unsigned int i = 0; i < mesh->triangle_count; ++i)
+    tri_indices[i] = fcl::Triangle(mesh->triangles[3 * i], mesh->triangles[3 * i + 1], mesh->triangles[3 * i + 2]);
+
+  std::vector<fcl::Vec3f> points(mesh->vertex_count);
+  for (unsigned int i = 0; i < mesh->vertex_count; ++i)
+    points[i] = fcl::Vec3f(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
+
+  g->beginModel();
+  g->addSubModel(points, tri_indices);
+  g->endModel();
+
+  // keep a pristine copy; g itself will carry the user data of the geometry it is used for
+  cache.insert(hash, std::make_shared<const fcl::BVHModel<BV>>(*g));
+  return g;
+}
+
+DistanceQueryContext::DistanceQueryContext()
+  : upper_bound_(std::numeric_limits<double>::infinity())
+  , safety_distance_(-std::numeric_limits<double>::infinity())
+  , below_safety_distance_(false)
+  , computed_pairs_(0)
+  , pruned_pairs_(0)
+  , query_count_(0)
+{
+}
+
+void DistanceQueryContext::clear()
+{
+  pairs_.clear();
+  upper_bound_ = std::numeric_limits<double>::infinity();
+  below_safety_distance_ = false;
+  computed_pairs_ = 0;
+  pruned_pairs_ = 0;
+  query_count_ = 0;
+}
+
+void DistanceQueryContext::beginQuery()
+{
+  upper_bound_ = std::numeric_limits<double>::infinity();
+  below_safety_distance_ = false;
+  computed_pairs_ = 0;
+  pruned_pairs_ = 0;
+
+  // forget the pairs of geometries that no longer exist every once in a while
+  if (++query_count_ % 100 == 0)
+    for (auto it = pairs_.begin(); it != pairs_.end();)
+      if (it->second.geometry[0].expired() || it->second.geometry[1].expired())
+        it = pairs_.erase(it);
+      else
+        ++it;
+}
+
+double DistanceQueryContext::maxMotion(const fcl::CollisionObject* o, const fcl::Transform3f& previous)
+{
+  // every point of the geometry is within this distance of the origin of its frame
+  const fcl::CollisionGeometry* g = o->collisionGeometry().get();
+  double radius = g->aabb_center.length() + g->aabb_radius;
+
+  const fcl::Quaternion3f& q1 = previous.getQuatRotation();
+  const fcl::Quaternion3f& q2 = o->getQuatRotation();
+  double dot = fabs(q1.getW() * q2.getW() + q1.getX() * q2.getX() + q1.getY() * q2.getY() + q1.getZ() * q2.getZ());
+  double angle = 2.0 * acos(std::min(dot, 1.0));
+
+  return (o->getTranslation() - previous.getTranslation()).length() + angle * radius;
+}
+
+bool DistanceQueryContext::prune(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2, double bound,
+                                 bool global)
+{
+  const fcl::CollisionGeometry* g1 = o1->collisionGeometry().get();
+  const fcl::CollisionGeometry* g2 = o2->collisionGeometry().get();
+  if (g2 < g1)
+  {
+    std::swap(o1, o2);
+    std::swap(g1, g2);
+  }
+
+  auto it = pairs_.find(std::make_pair(g1, g2));
+  if (it == pairs_.end())
+    return false;
+
+  // the geometries are compared as well, in case the remembered ones were destroyed and their memory reused
+  const PairRecord& record = it->second;
+  if (record.geometry[0].lock().get() != g1 || record.geometry[1].lock().get() != g2)
+  {
+    pairs_.erase(it);
+    return false;
+  }
+
+  double motion = maxMotion(o1, record.transform[0]) + maxMotion(o2, record.transform[1]);
+  if (global && record.exact)
+    upper_bound_ = std::min(upper_bound_, std::max(record.distance, 0.0) + motion);
+
+  double lower_bound = record.distance - motion;
+  if (lower_bound >= bound || (global && lower_bound > upper_bound_))
+  {
+    pruned_pairs_++;
+    return true;
+  }
+  return false;
+}
+
+bool DistanceQueryContext::update(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2, double distance,
+                                  bool exact)
+{
+  computed_pairs_++;
+  if (o2->collisionGeometry().get() < o1->collisionGeometry().get())
+    std::swap(o1, o2);
+
+  PairRecord& record = pairs_[std::make_pair(o1->collisionGeometry().get(), o2->collisionGeometry().get())];
+  record.geometry[0] = o1->collisionGeometry();
+  record.geometry[1] = o2->collisionGeometry();
+  record.transform[0] = o1->getTransform();
+  record.transform[1] = o2->getTransform();
+  record.distance = distance;
+  record.exact = exact;
+
+  if (distance < safety_distance_)
+    below_safety_distance_ = true;
+  return below_safety_distance_;
+}
+
 bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist)
 {
   DistanceData* cdata = reinterpret_cast<DistanceData*>(data);
@@ -506,8 +1056,20 @@ bool distanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void*
     }
   }
 
+  if (cdata->context)
+  {
+    bool global = cdata->req->type == DistanceRequestType::GLOBAL;
+    double bound = global ? std::min(dist_threshold, cdata->res->minimum_distance.distance) : dist_threshold;
+    if (cdata->context->prune(o1, o2, bound, global))
+      return cdata->done;
+  }
+
+  ScopedNarrowPhaseTimer timer(cd1, cd2, true);
   fcl_result.min_distance = dist_threshold;
   double d = fcl::distance(o1, o2, fcl::DistanceRequest(cdata->req->enable_nearest_points), fcl_result);
+  timer.setContact(d <= 0);
+  if (cdata->context && cdata->context->update(o1, o2, d, d < dist_threshold))
+    cdata->done = true;
 
   // Check if either object is already in the map. If not add it or if present
   // check to see if the new distance is closer. If closer remove the existing
@@ -641,16 +1203,18 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
   FCLShapeCache& cache = GetShapeCache<BV, T>();
 
   std::weak_ptr<const shapes::Shape> wptr(shape);
+  FCLShapeCache::Shard& shard = cache.getShard(shape.get());
   {
-    boost::mutex::scoped_lock slock(cache.lock_);
-    ShapeMap::const_iterator cache_it = cache.map_.find(wptr);
-    if (cache_it != cache.map_.end())
+    boost::mutex::scoped_lock slock(shard.lock_);
+    ShapeMap::const_iterator cache_it = shard.map_.find(wptr);
+    if (cache_it != shard.map_.end())
     {
       if (cache_it->second->collision_geometry_data_->ptr.raw == data)
       {
         //        ROS_DEBUG_NAMED("collision_detection.fcl", "Collision data structures for object %s retrieved from
         //        cache.",
         //        cache_it->second->collision_geometry_data_->getID().c_str());
+        cache.hits_++;
         return cache_it->second;
       }
       else if (cache_it->second.unique())
@@ -660,6 +1224,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
         //          cache after updating
         //          the source
         //          object.", cache_it->second->collision_geometry_data_->getID().c_str());
+        cache.hits_++;
         return cache_it->second;
       }
     }
@@ -674,16 +1239,17 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
     FCLShapeCache& othercache = GetShapeCache<BV, World::Object>();
 
     // attached bodies could be just moved from the environment.
-    othercache.lock_.lock();  // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-    auto cache_it = othercache.map_.find(wptr);
-    if (cache_it != othercache.map_.end())
+    FCLShapeCache::Shard& othershard = othercache.getShard(shape.get());
+    othershard.lock_.lock();  // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
+    auto cache_it = othershard.map_.find(wptr);
+    if (cache_it != othershard.map_.end())
     {
       if (cache_it->second.unique())
       {
         // remove from old cache
         FCLGeometryConstPtr obj_cache = cache_it->second;
-        othercache.map_.erase(cache_it);
-        othercache.lock_.unlock();
+        othershard.map_.erase(cache_it);
+        othershard.lock_.unlock();
 
         // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
         const_cast<FCLGeometry*>(obj_cache.get())->updateCollisionGeometryData(data, shape_index, true);
@@ -694,13 +1260,14 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
         //        obj_cache->collision_geometry_data_->getID().c_str());
 
         // add to the new cache
-        boost::mutex::scoped_lock slock(cache.lock_);
-        cache.map_[wptr] = obj_cache;
-        cache.bumpUseCount();
+        boost::mutex::scoped_lock slock(shard.lock_);
+        shard.map_[wptr] = obj_cache;
+        cache.bumpUseCount(shard);
+        cache.hits_++;
         return obj_cache;
       }
     }
-    othercache.lock_.unlock();
+    othershard.lock_.unlock();
   }
   else
       // world objects could have previously been attached objects; we try to move them
@@ -712,16 +1279,17 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
     FCLShapeCache& othercache = GetShapeCache<BV, robot_state::AttachedBody>();
 
     // attached bodies could be just moved from the environment.
-    othercache.lock_.lock();  // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
-    auto cache_it = othercache.map_.find(wptr);
-    if (cache_it != othercache.map_.end())
+    FCLShapeCache::Shard& othershard = othercache.getShard(shape.get());
+    othershard.lock_.lock();  // lock manually to avoid having 2 simultaneous locks active (avoids possible deadlock)
+    auto cache_it = othershard.map_.find(wptr);
+    if (cache_it != othershard.map_.end())
     {
       if (cache_it->second.unique())
       {
         // remove from old cache
         FCLGeometryConstPtr obj_cache = cache_it->second;
-        othercache.map_.erase(cache_it);
-        othercache.lock_.unlock();
+        othershard.map_.erase(cache_it);
+        othershard.lock_.unlock();
 
         // update the CollisionGeometryData; nobody has a pointer to this, so we can safely modify it
         const_cast<FCLGeometry*>(obj_cache.get())->updateCollisionGeometryData(data, shape_index, true);
@@ -733,13 +1301,14 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
         //                   obj_cache->collision_geometry_data_->getID().c_str());
 
         // add to the new cache
-        boost::mutex::scoped_lock slock(cache.lock_);
-        cache.map_[wptr] = obj_cache;
-        cache.bumpUseCount();
+        boost::mutex::scoped_lock slock(shard.lock_);
+        shard.map_[wptr] = obj_cache;
+        cache.bumpUseCount(shard);
+        cache.hits_++;
         return obj_cache;
       }
     }
-    othercache.lock_.unlock();
+    othershard.lock_.unlock();
   }
 
   fcl::CollisionGeometry* cg_g = nullptr;
@@ -788,27 +1357,8 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
       }
       break;
       case shapes::MESH:
-      {
-        auto g = new fcl::BVHModel<BV>();
-        const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape.get());
-        if (mesh->vertex_count > 0 && mesh->triangle_count > 0)
-        {
-          std::vector<fcl::Triangle> tri_indices(mesh->triangle_count);
-          for (unsigned int i = 0; i < mesh->triangle_count; ++i)
-            tri_indices[i] =
-                fcl::Triangle(mesh->triangles[3 * i], mesh->triangles[3 * i + 1], mesh->triangles[3 * i + 2]);
-
-          std::vector<fcl::Vec3f> points(mesh->vertex_count);
-          for (unsigned int i = 0; i < mesh->vertex_count; ++i)
-            points[i] = fcl::Vec3f(mesh->vertices[3 * i], mesh->vertices[3 * i + 1], mesh->vertices[3 * i + 2]);
-
-          g->beginModel();
-          g->addSubModel(points, tri_indices);
-          g->endModel();
-        }
-        cg_g = g;
-      }
-      break;
+        cg_g = createBVHModel<BV>(static_cast<const shapes::Mesh*>(shape.get()));
+        break;
       case shapes::OCTREE:
       {
         const shapes::OcTree* g = static_cast<const shapes::OcTree*>(shape.get());
@@ -825,9 +1375,10 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
   {
     cg_g->computeLocalAABB();
     FCLGeometryConstPtr res(new FCLGeometry(cg_g, data, shape_index));
-    boost::mutex::scoped_lock slock(cache.lock_);
-    cache.map_[wptr] = res;
-    cache.bumpUseCount();
+    boost::mutex::scoped_lock slock(shard.lock_);
+    shard.map_[wptr] = res;
+    cache.bumpUseCount(shard);
+    cache.misses_++;
     return res;
   }
   return FCLGeometryConstPtr();
@@ -851,6 +1402,86 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
   return createCollisionGeometry<fcl::OBBRSS, World::Object>(shape, obj, 0);
 }
 
+/** \brief Scaled and padded copies of shapes, kept for as long as the original shapes exist. The FCL geometry cache is
+    keyed by shape, so a copy that is kept lets the geometry built for it be found again when the same scale and
+    padding are requested, by another planning scene or when the padding is switched back. */
+struct FCLScaledShapeCache
+{
+  using ShapeKey = std::weak_ptr<const shapes::Shape>;
+
+  struct Variant
+  {
+    double scale_;
+    double padding_;
+    shapes::ShapeConstPtr shape_;
+  };
+
+  /** \brief Get the copy of \e shape with \e scale and \e padding applied, making it if needed */
+  shapes::ShapeConstPtr get(const shapes::ShapeConstPtr& shape, double scale, double padding)
+  {
+    ShapeKey key(shape);
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      const shapes::ShapeConstPtr* found = find(key, scale, padding);
+      if (found)
+        return *found;
+    }
+
+    // copying a large mesh takes a while, so this is done without holding the lock
+    shapes::ShapePtr scaled_shape(shape->clone());
+    scaled_shape->scaleAndPadd(scale, padding);
+
+    boost::mutex::scoped_lock slock(lock_);
+    const shapes::ShapeConstPtr* found = find(key, scale, padding);
+    if (found)  // another thread made the same copy in the meantime
+      return *found;
+    std::vector<Variant>& variants = map_[key];
+    if (variants.size() >= MAX_VARIANTS)
+      variants.erase(variants.begin());
+    variants.push_back(Variant{ scale, padding, scaled_shape });
+
+    if (++clean_count_ > MAX_CLEAN_COUNT)
+      clean();
+    return scaled_shape;
+  }
+
+  /** \brief Remove the copies of shapes that no longer exist. Must be called with lock_ held. */
+  void clean()
+  {
+    clean_count_ = 0;
+    for (auto it = map_.begin(); it != map_.end();)
+      if (it->first.expired())
+        it = map_.erase(it);
+      else
+        ++it;
+  }
+
+  std::map<ShapeKey, std::vector<Variant>, std::owner_less<ShapeKey>> map_;
+  unsigned int clean_count_ = 0;
+  boost::mutex lock_;
+
+  static const unsigned int MAX_CLEAN_COUNT = 100;  // every this many new copies, the copies of deleted shapes are
+                                                    // removed
+  static const std::size_t MAX_VARIANTS = 8;  // copies kept per shape; the oldest one makes room for a new one
+
+private:
+  const shapes::ShapeConstPtr* find(const ShapeKey& key, double scale, double padding) const
+  {
+    auto it = map_.find(key);
+    if (it != map_.end())
+      for (const Variant& variant : it->second)
+        if (variant.scale_ == scale && variant.padding_ == padding)
+          return &variant.shape_;
+    return nullptr;
+  }
+};
+
+FCLScaledShapeCache& GetScaledShapeCache()
+{
+  static FCLScaledShapeCache cache;
+  return cache;
+}
+
 template <typename BV, typename T>
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape, double scale, double padding,
                                             const T* data, int shape_index)
@@ -859,11 +1490,7 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
       fabs(padding) <= std::numeric_limits<double>::epsilon())
     return createCollisionGeometry<BV, T>(shape, data, shape_index);
   else
-  {
-    shapes::ShapePtr scaled_shape(shape->clone());
-    scaled_shape->scaleAndPadd(scale, padding);
-    return createCollisionGeometry<BV, T>(scaled_shape, data, shape_index);
-  }
+    return createCollisionGeometry<BV, T>(GetScaledShapeCache().get(shape, scale, padding), data, shape_index);
 }
 
 FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape, double scale, double padding,
@@ -884,19 +1511,250 @@ FCLGeometryConstPtr createCollisionGeometry(const shapes::ShapeConstPtr& shape,
   return createCollisionGeometry<fcl::OBBRSS, World::Object>(shape, scale, padding, obj, 0);
 }
 
+namespace
+{
+void cleanShapeCache(FCLShapeCache& cache)
+{
+  for (FCLShapeCache::Shard& shard : cache.shards_)
+  {
+    boost::mutex::scoped_lock slock(shard.lock_);
+    cache.bumpUseCount(shard, true);
+  }
+}
+
+void addShapeCacheStats(FCLShapeCache& cache, FCLGeometryCacheStats& stats)
+{
+  stats.hits += cache.hits_;
+  stats.misses += cache.misses_;
+  stats.evictions += cache.evictions_;
+  for (FCLShapeCache::Shard& shard : cache.shards_)
+  {
+    boost::mutex::scoped_lock slock(shard.lock_);
+    stats.entries += shard.map_.size();
+  }
+}
+}
+
 void cleanCollisionGeometryCache()
 {
-  FCLShapeCache& cache1 = GetShapeCache<fcl::OBBRSS, World::Object>();
   {
-    boost::mutex::scoped_lock slock(cache1.lock_);
-    cache1.bumpUseCount(true);
+    FCLScaledShapeCache& scaled_cache = GetScaledShapeCache();
+    boost::mutex::scoped_lock slock(scaled_cache.lock_);
+    scaled_cache.clean();
+  }
+  cleanShapeCache(GetShapeCache<fcl::OBBRSS, World::Object>());
+  cleanShapeCache(GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>());
+}
+
+FCLGeometryCacheStats getCollisionGeometryCacheStats()
+{
+  FCLGeometryCacheStats stats;
+  addShapeCacheStats(GetShapeCache<fcl::OBBRSS, robot_model::LinkModel>(), stats);
+  addShapeCacheStats(GetShapeCache<fcl::OBBRSS, World::Object>(), stats);
+  addShapeCacheStats(GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>(), stats);
+  {
+    FCLScaledShapeCache& scaled_cache = GetScaledShapeCache();
+    boost::mutex::scoped_lock slock(scaled_cache.lock_);
+    for (const auto& shape : scaled_cache.map_)
+      stats.scaled_shapes += shape.second.size();
   }
-  FCLShapeCache& cache2 = GetShapeCache<fcl::OBBRSS, robot_state::AttachedBody>();
+  FCLMeshCache<fcl::OBBRSS>& mesh_cache = GetMeshCache<fcl::OBBRSS>();
+  stats.bvh_reuses = mesh_cache.reuses_;
+  boost::mutex::scoped_lock slock(mesh_cache.lock_);
+  stats.bvh_models = mesh_cache.models_.size();
+  return stats;
+}
+
+NarrowPhaseStatistics::NarrowPhaseStatistics()
+  : collision_calls(0)
+  , collision_contacts(0)
+  , collision_time(0.0)
+  , distance_calls(0)
+  , distance_contacts(0)
+  , distance_time(0.0)
+{
+  std::fill(time_histogram, time_histogram + HISTOGRAM_BINS, 0);
+}
+
+void setNarrowPhaseInstrumentation(bool enabled)
+{
+  GetNarrowPhaseInstrumentation().enabled_ = enabled;
+}
+
+bool isNarrowPhaseInstrumentationEnabled()
+{
+  return GetNarrowPhaseInstrumentation().enabled_;
+}
+
+void getNarrowPhaseStatistics(NarrowPhaseStatisticsMap& statistics)
+{
+  NarrowPhaseInstrumentation& instrumentation = GetNarrowPhaseInstrumentation();
+  boost::mutex::scoped_lock slock(instrumentation.lock_);
+  statistics = instrumentation.statistics_;
+}
+
+void clearNarrowPhaseStatistics()
+{
+  NarrowPhaseInstrumentation& instrumentation = GetNarrowPhaseInstrumentation();
+  boost::mutex::scoped_lock slock(instrumentation.lock_);
+  instrumentation.statistics_.clear();
+}
+
+void printNarrowPhaseStatistics(std::ostream& out)
+{
+  NarrowPhaseStatisticsMap statistics;
+  getNarrowPhaseStatistics(statistics);
+
+  std::vector<NarrowPhaseStatisticsMap::const_iterator> sorted;
+  for (auto it = statistics.begin(); it != statistics.end(); ++it)
+    sorted.push_back(it);
+  std::sort(sorted.begin(), sorted.end(), [](NarrowPhaseStatisticsMap::const_iterator a,
+                                             NarrowPhaseStatisticsMap::const_iterator b) {
+    return a->second.collision_time + a->second.distance_time > b->second.collision_time + b->second.distance_time;
+  });
+
+  out << "Narrowphase statistics for " << sorted.size() << " pairs of objects:" << std::endl;
+  for (NarrowPhaseStatisticsMap::const_iterator it : sorted)
   {
-    boost::mutex::scoped_lock slock(cache2.lock_);
-    cache2.bumpUseCount(true);
+    const NarrowPhaseStatistics& stats = it->second;
+    out << it->first.first << " - " << it->first.second << ": total " << (stats.collision_time + stats.distance_time)
+        << "s; collision: " << stats.collision_calls << " calls, " << stats.collision_contacts << " in contact, "
+        << stats.collision_time << "s; distance: " << stats.distance_calls << " calls, " << stats.distance_contacts
+        << " in contact, " << stats.distance_time << "s; durations (<1us, <10us, ..., >=1s):";
+    for (std::size_t i = 0; i < NarrowPhaseStatistics::HISTOGRAM_BINS; ++i)
+      out << " " << stats.time_histogram[i];
+    out << std::endl;
   }
 }
+
+void reportNarrowPhaseStatistics()
+{
+  NarrowPhaseStatisticsMap statistics;
+  getNarrowPhaseStatistics(statistics);
+  for (const auto& pair : statistics)
+  {
+    const std::string name = "FCL narrowphase " + pair.first.first + " - " + pair.first.second;
+    const NarrowPhaseStatistics& stats = pair.second;
+    if (stats.collision_calls > 0)
+    {
+      moveit::tools::Profiler::Event(name + ": collision calls", stats.collision_calls);
+      moveit::tools::Profiler::Event(name + ": collision contacts", stats.collision_contacts);
+      moveit::tools::Profiler::Average(name + ": collision time (us)",
+                                       1e6 * stats.collision_time / stats.collision_calls);
+    }
+    if (stats.distance_calls > 0)
+    {
+      moveit::tools::Profiler::Event(name + ": distance calls", stats.distance_calls);
+      moveit::tools::Profiler::Event(name + ": distance contacts", stats.distance_contacts);
+      moveit::tools::Profiler::Average(name + ": distance time (us)", 1e6 * stats.distance_time / stats.distance_calls);
+    }
+  }
+}
+
+namespace
+{
+const char* BROADPHASE_TYPE_NAMES[] = { "dynamic_aabb_tree", "dynamic_aabb_tree_array", "sap", "ssap", "interval_tree",
+                                        "naive", "auto" };
+
+std::atomic<BroadphaseType>& GetDefaultBroadphaseType()
+{
+  static std::atomic<BroadphaseType> type(BroadphaseTypes::DYNAMIC_AABB_TREE);
+  return type;
+}
+
+bool ignoreCollisionCallback(fcl::CollisionObject* /*o1*/, fcl::CollisionObject* /*o2*/, void* /*data*/)
+{
+  return false;
+}
+}
+
+fcl::BroadPhaseCollisionManager* createBroadphaseManager(BroadphaseType type)
+{
+  switch (type)
+  {
+    case BroadphaseTypes::DYNAMIC_AABB_TREE_ARRAY:
+      return new fcl::DynamicAABBTreeCollisionManager_Array();
+    case BroadphaseTypes::SAP:
+      return new fcl::SaPCollisionManager();
+    case BroadphaseTypes::SSAP:
+      return new fcl::SSaPCollisionManager();
+    case BroadphaseTypes::INTERVAL_TREE:
+      return new fcl::IntervalTreeCollisionManager();
+    case BroadphaseTypes::NAIVE:
+      return new fcl::NaiveCollisionManager();
+    default:
+      break;
+  }
+  return new fcl::DynamicAABBTreeCollisionManager();
+}
+
+std::string getBroadphaseTypeName(BroadphaseType type)
+{
+  return BROADPHASE_TYPE_NAMES[type];
+}
+
+bool parseBroadphaseType(const std::string& name, BroadphaseType& type)
+{
+  for (int i = BroadphaseTypes::DYNAMIC_AABB_TREE; i <= BroadphaseTypes::AUTO; ++i)
+    if (name == BROADPHASE_TYPE_NAMES[i])
+    {
+      type = static_cast<BroadphaseType>(i);
+      return true;
+    }
+  return false;
+}
+
+BroadphaseType selectBroadphaseType(const std::vector<fcl::CollisionObject*>& objects,
+                                    const std::vector<fcl::CollisionObject*>& queries)
+{
+  // the queries are repeated, and the fastest round is kept, to be less sensitive to other load on the machine
+  static const unsigned int ROUNDS = 3;
+
+  BroadphaseType best = BroadphaseTypes::DYNAMIC_AABB_TREE;
+  double best_time = std::numeric_limits<double>::infinity();
+  for (int i = BroadphaseTypes::DYNAMIC_AABB_TREE; i < BroadphaseTypes::AUTO; ++i)
+  {
+    BroadphaseType type = static_cast<BroadphaseType>(i);
+    std::unique_ptr<fcl::BroadPhaseCollisionManager> manager(createBroadphaseManager(type));
+    manager->registerObjects(objects);
+    manager->setup();
+
+    double time = std::numeric_limits<double>::infinity();
+    for (unsigned int round = 0; round < ROUNDS; ++round)
+    {
+      ros::WallTime start = ros::WallTime::now();
+      if (queries.empty())
+      {
+        manager->update();
+        manager->collide(nullptr, &ignoreCollisionCallback);
+      }
+      for (fcl::CollisionObject* query : queries)
+        manager->collide(query, nullptr, &ignoreCollisionCallback);
+      time = std::min(time, (ros::WallTime::now() - start).toSec());
+    }
+    ROS_DEBUG_NAMED("collision_detection.fcl", "Broadphase '%s' answers %u queries on %u objects in %lfs",
+                    BROADPHASE_TYPE_NAMES[i], (unsigned int)std::max<std::size_t>(1, queries.size()),
+                    (unsigned int)objects.size(), time);
+
+    // prefer the earlier types, starting with the default, unless a later one is clearly faster
+    if (time < 0.9 * best_time)
+    {
+      best = type;
+      best_time = time;
+    }
+  }
+  return best;
+}
+
+void setDefaultBroadphaseType(BroadphaseType type)
+{
+  GetDefaultBroadphaseType() = type;
+}
+
+BroadphaseType getDefaultBroadphaseType()
+{
+  return GetDefaultBroadphaseType();
+}
 }
 
 void collision_detection::CollisionData::enableGroup(const robot_model::RobotModelConstPtr& kmodel)
@@ -905,6 +1763,13 @@ void collision_detection::CollisionData::enableGroup(const robot_model::RobotMod
     active_components_only_ = &kmodel->getJointModelGroup(req_->group_name)->getUpdatedLinkModelsSet();
   else
     active_components_only_ = nullptr;
+  compiled_acm_ = acm_ ? acm_->getCompiled(kmodel) : CompiledAllowedCollisionMatrixConstPtr();
+}
+
+void collision_detection::BooleanCollisionData::enableGroup(const robot_model::RobotModelConstPtr& kmodel)
+{
+  active_components_only_ = req_->group ? &req_->group->getUpdatedLinkModelsSet() : nullptr;
+  compiled_acm_ = acm_ ? acm_->getCompiled(kmodel) : CompiledAllowedCollisionMatrixConstPtr();
 }
 
 void collision_detection::FCLObject::registerTo(fcl::BroadPhaseCollisionManager* manager)
@@ -35,11 +35,131 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/collision_detection_fcl/collision_robot_fcl.h>
+#include <moveit/profiler/metrics.h>
 
 namespace collision_detection
 {
+namespace
+{
+moveit::tools::MetricCounter& SELF_COLLISION_CHECKS = moveit::tools::MetricsRegistry::instance().counter(
+    "moveit_self_collision_checks_total", "Self-collision checks of robot states");
+}
+
+struct CollisionRobotFCL::CachedBroadPhase
+{
+  /** \brief The manager, holding copies of the link collision objects in manager_.object_ */
+  FCLManager manager_;
+
+  /** \brief For every object in manager_.object_, the corresponding index in geoms_ */
+  std::vector<std::size_t> geom_indices_;
+
+  /** \brief Whether the objects were registered with the manager yet */
+  bool registered_;
+
+  /** \brief The value of broadphase_generation_ when this manager was created */
+  unsigned int generation_;
+};
+
+class CollisionRobotFCL::ScopedBroadPhase
+{
+public:
+  /** \brief With \e refit false, only the poses of the objects are updated, for queries that do not use the
+      manager itself (see forEachFCLObject()) */
+  ScopedBroadPhase(const CollisionRobotFCL& robot, const robot_state::RobotState& state, bool refit = true)
+    : robot_(robot), attached_registered_(false)
+  {
+    {
+      boost::mutex::scoped_lock slock(robot_.broadphase_lock_);
+      if (!robot_.broadphase_pool_.empty())
+      {
+        cached_ = robot_.broadphase_pool_.back();
+        robot_.broadphase_pool_.pop_back();
+      }
+      else
+      {
+        cached_.reset(new CachedBroadPhase());
+        cached_->generation_ = robot_.broadphase_generation_;
+      }
+    }
+
+    if (!cached_->manager_.manager_)
+    {
+      cached_->manager_.manager_.reset(createBroadphaseManager(robot_.broadphase_type_));
+      cached_->registered_ = false;
+      for (std::size_t i = 0; i < robot_.geoms_.size(); ++i)
+        if (robot_.geoms_[i] && robot_.geoms_[i]->collision_geometry_)
+        {
+          cached_->manager_.object_.collision_objects_.push_back(
+              FCLCollisionObjectPtr(new fcl::CollisionObject(*robot_.fcl_objs_[i])));
+          cached_->geom_indices_.push_back(i);
+        }
+    }
+
+    // move the link objects to the poses of the state and refit the tree, instead of rebuilding it
+    fcl::Transform3f fcl_tf;
+    for (std::size_t k = 0; k < cached_->geom_indices_.size(); ++k)
+    {
+      const CollisionGeometryData& data = *robot_.geoms_[cached_->geom_indices_[k]]->collision_geometry_data_;
+      transform2fcl(state.getCollisionBodyTransform(data.ptr.link, data.shape_index), fcl_tf);
+      fcl::CollisionObject* obj = cached_->manager_.object_.collision_objects_[k].get();
+      obj->setTransform(fcl_tf);
+      obj->computeAABB();
+    }
+
+    // attached bodies change with the state, so they are only added for the duration of the query
+    robot_.constructAttachedBodiesFCLObject(state, attached_);
+    if (!refit)
+      return;
+
+    if (cached_->registered_)
+      cached_->manager_.manager_->update();
+    else
+    {
+      cached_->manager_.object_.registerTo(cached_->manager_.manager_.get());
+      cached_->registered_ = true;
+    }
+    for (std::size_t k = 0; k < attached_.collision_objects_.size(); ++k)
+      cached_->manager_.manager_->registerObject(attached_.collision_objects_[k].get());
+    attached_registered_ = true;
+  }
+
+  ~ScopedBroadPhase()
+  {
+    if (attached_registered_)
+      attached_.unregisterFrom(cached_->manager_.manager_.get());
+    boost::mutex::scoped_lock slock(robot_.broadphase_lock_);
+    if (cached_->generation_ == robot_.broadphase_generation_)
+      robot_.broadphase_pool_.push_back(cached_);
+  }
+
+  fcl::BroadPhaseCollisionManager* get() const
+  {
+    return cached_->manager_.manager_.get();
+  }
+
+  /** \brief The objects of the links, at the poses of the state */
+  const FCLObject& getLinkObjects() const
+  {
+    return cached_->manager_.object_;
+  }
+
+  /** \brief The objects of the attached bodies of the state */
+  const FCLObject& getAttachedObjects() const
+  {
+    return attached_;
+  }
+
+private:
+  const CollisionRobotFCL& robot_;
+  std::shared_ptr<CachedBroadPhase> cached_;
+  FCLObject attached_;
+  bool attached_registered_;
+};
+
 CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr& model, double padding, double scale)
   : CollisionRobot(model, padding, scale)
+  , broadphase_type_(BroadphaseTypes::DYNAMIC_AABB_TREE)
+  , broadphase_generation_(0)
 {
   const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
   std::size_t index;
@@ -66,9 +186,11 @@ CollisionRobotFCL::CollisionRobotFCL(const robot_model::RobotModelConstPtr& mode
         ROS_ERROR_NAMED("collision_detection.fcl", "Unable to construct collision geometry for link '%s'",
                         link->getName().c_str());
     }
+  setBroadphaseType(getDefaultBroadphaseType());
 }
 
-CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL& other) : CollisionRobot(other)
+CollisionRobotFCL::CollisionRobotFCL(const CollisionRobotFCL& other)
+  : CollisionRobot(other), broadphase_type_(other.broadphase_type_), broadphase_generation_(0)
 {
   geoms_ = other.geoms_;
   fcl_objs_ = other.fcl_objs_;
@@ -103,6 +225,14 @@ void CollisionRobotFCL::constructFCLObject(const robot_state::RobotState& state,
       fcl_obj.collision_objects_.push_back(FCLCollisionObjectPtr(collObj));
     }
 
+  constructAttachedBodiesFCLObject(state, fcl_obj);
+}
+
+void CollisionRobotFCL::constructAttachedBodiesFCLObject(const robot_state::RobotState& state,
+                                                         FCLObject& fcl_obj) const
+{
+  fcl::Transform3f fcl_tf;
+
   // TODO: Implement a method for caching fcl::CollisionObject's for robot_state::AttachedBody's
   std::vector<const robot_state::AttachedBody*> ab;
   state.getAttachedBodies(ab);
@@ -124,14 +254,73 @@ void CollisionRobotFCL::constructFCLObject(const robot_state::RobotState& state,
   }
 }
 
+void CollisionRobotFCL::constructSweptFCLObject(const robot_state::RobotState& state1,
+                                                const robot_state::RobotState& state2, FCLObject& fcl_obj) const
+{
+  fcl_obj.collision_objects_.reserve(geoms_.size());
+
+  for (std::size_t i = 0; i < geoms_.size(); ++i)
+    if (geoms_[i] && geoms_[i]->collision_geometry_)
+    {
+      const CollisionGeometryData& data = *geoms_[i]->collision_geometry_data_;
+      fcl_obj.collision_objects_.push_back(FCLCollisionObjectPtr(new FCLSweptCollisionObject(
+          *fcl_objs_[i], transform2fcl(state1.getCollisionBodyTransform(data.ptr.link, data.shape_index)),
+          transform2fcl(state2.getCollisionBodyTransform(data.ptr.link, data.shape_index)))));
+    }
+
+  // bodies that are not attached in state2 are considered to stay where they are in state1
+  std::vector<const robot_state::AttachedBody*> ab;
+  state1.getAttachedBodies(ab);
+  for (auto& body : ab)
+  {
+    const robot_state::AttachedBody* body2 = state2.getAttachedBody(body->getName());
+    std::vector<FCLGeometryConstPtr> objs;
+    getAttachedBodyObjects(body, objs);
+    const EigenSTL::vector_Affine3d& ab_t1 = body->getGlobalCollisionBodyTransforms();
+    const EigenSTL::vector_Affine3d& ab_t2 =
+        body2 && body2->getShapes().size() == body->getShapes().size() ? body2->getGlobalCollisionBodyTransforms() :
+                                                                         ab_t1;
+    for (std::size_t k = 0; k < objs.size(); ++k)
+      if (objs[k]->collision_geometry_)
+      {
+        const int shape_index = objs[k]->collision_geometry_data_->shape_index;
+        fcl_obj.collision_objects_.push_back(FCLCollisionObjectPtr(new FCLSweptCollisionObject(
+            objs[k]->collision_geometry_, transform2fcl(ab_t1[shape_index]), transform2fcl(ab_t2[shape_index]))));
+        fcl_obj.collision_geometry_.push_back(objs[k]);
+      }
+  }
+}
+
 void CollisionRobotFCL::allocSelfCollisionBroadPhase(const robot_state::RobotState& state, FCLManager& manager) const
 {
-  auto m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager.manager_.reset(m);
+  manager.manager_.reset(createBroadphaseManager(broadphase_type_));
   constructFCLObject(state, manager.object_);
   manager.object_.registerTo(manager.manager_.get());
-  // manager.manager_->update();
+}
+
+void CollisionRobotFCL::setBroadphaseType(BroadphaseType type)
+{
+  if (type == BroadphaseTypes::AUTO)
+  {
+    robot_state::RobotState state(robot_model_);
+    state.setToDefaultValues();
+    state.update();
+    FCLObject fcl_obj;
+    constructFCLObject(state, fcl_obj);
+    std::vector<fcl::CollisionObject*> objects;
+    for (const FCLCollisionObjectPtr& co : fcl_obj.collision_objects_)
+      objects.push_back(co.get());
+    type = selectBroadphaseType(objects, std::vector<fcl::CollisionObject*>());
+    ROS_DEBUG_NAMED("collision_detection.fcl", "Selected broadphase '%s' for the links of robot '%s'",
+                    getBroadphaseTypeName(type).c_str(), robot_model_->getName().c_str());
+  }
+  if (type == broadphase_type_)
+    return;
+
+  boost::mutex::scoped_lock slock(broadphase_lock_);
+  broadphase_type_ = type;
+  broadphase_pool_.clear();
+  ++broadphase_generation_;
 }
 
 void CollisionRobotFCL::checkSelfCollision(const CollisionRequest& req, CollisionResult& res,
@@ -151,25 +340,47 @@ void CollisionRobotFCL::checkSelfCollision(const CollisionRequest& req, Collisio
                                            const robot_state::RobotState& state1,
                                            const robot_state::RobotState& state2) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, nullptr);
 }
 
 void CollisionRobotFCL::checkSelfCollision(const CollisionRequest& req, CollisionResult& res,
                                            const robot_state::RobotState& state1, const robot_state::RobotState& state2,
                                            const AllowedCollisionMatrix& acm) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkSelfCollisionHelper(req, res, state1, state2, &acm);
+}
+
+void CollisionRobotFCL::checkSelfCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                                  const robot_state::RobotState& state,
+                                                  const AllowedCollisionMatrix& acm) const
+{
+  SELF_COLLISION_CHECKS.increment();
+  ScopedBroadPhase manager(*this, state);
+  BooleanCollisionData cd(&req, &res, &acm);
+  cd.enableGroup(getRobotModel());
+  manager.get()->collide(&cd, &booleanCollisionCallback);
+}
+
+void CollisionRobotFCL::forEachFCLObject(const robot_state::RobotState& state,
+                                         bool (*fn)(fcl::CollisionObject* object, void* data), void* data) const
+{
+  ScopedBroadPhase manager(*this, state, false);
+  const FCLObject* objects[2] = { &manager.getLinkObjects(), &manager.getAttachedObjects() };
+  for (const FCLObject* object : objects)
+    for (const FCLCollisionObjectPtr& co : object->collision_objects_)
+      if (fn(co.get(), data))
+        return;
 }
 
 void CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest& req, CollisionResult& res,
                                                  const robot_state::RobotState& state,
                                                  const AllowedCollisionMatrix* acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  SELF_COLLISION_CHECKS.increment();
+  ScopedBroadPhase manager(*this, state);
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
-  manager.manager_->collide(&cd, &collisionCallback);
+  manager.get()->collide(&cd, &collisionCallback);
   if (req.distance)
   {
     DistanceRequest dreq;
@@ -183,6 +394,22 @@ void CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest& req, Co
   }
 }
 
+void CollisionRobotFCL::checkSelfCollisionHelper(const CollisionRequest& req, CollisionResult& res,
+                                                 const robot_state::RobotState& state1,
+                                                 const robot_state::RobotState& state2,
+                                                 const AllowedCollisionMatrix* acm) const
+{
+  SELF_COLLISION_CHECKS.increment();
+  FCLManager manager;
+  manager.manager_.reset(createBroadphaseManager(broadphase_type_));
+  constructSweptFCLObject(state1, state2, manager.object_);
+  manager.object_.registerTo(manager.manager_.get());
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(getRobotModel());
+  manager.manager_->collide(&cd, &continuousCollisionCallback);
+}
+
 void CollisionRobotFCL::checkOtherCollision(const CollisionRequest& req, CollisionResult& res,
                                             const robot_state::RobotState& state, const CollisionRobot& other_robot,
                                             const robot_state::RobotState& other_state) const
@@ -204,7 +431,7 @@ void CollisionRobotFCL::checkOtherCollision(const CollisionRequest& req, Collisi
                                             const robot_state::RobotState& other_state1,
                                             const robot_state::RobotState& other_state2) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, nullptr);
 }
 
 void CollisionRobotFCL::checkOtherCollision(const CollisionRequest& req, CollisionResult& res,
@@ -214,7 +441,7 @@ void CollisionRobotFCL::checkOtherCollision(const CollisionRequest& req, Collisi
                                             const robot_state::RobotState& other_state2,
                                             const AllowedCollisionMatrix& acm) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkOtherCollisionHelper(req, res, state1, state2, other_robot, other_state1, other_state2, &acm);
 }
 
 void CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest& req, CollisionResult& res,
@@ -223,8 +450,7 @@ void CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest& req, C
                                                   const robot_state::RobotState& other_state,
                                                   const AllowedCollisionMatrix* acm) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  ScopedBroadPhase manager(*this, state);
 
   const CollisionRobotFCL& fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
   FCLObject other_fcl_obj;
@@ -233,7 +459,7 @@ void CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest& req, C
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(getRobotModel());
   for (std::size_t i = 0; !cd.done_ && i < other_fcl_obj.collision_objects_.size(); ++i)
-    manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+    manager.get()->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
 
   if (req.distance)
   {
@@ -248,8 +474,38 @@ void CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest& req, C
   }
 }
 
+void CollisionRobotFCL::checkOtherCollisionHelper(const CollisionRequest& req, CollisionResult& res,
+                                                  const robot_state::RobotState& state1,
+                                                  const robot_state::RobotState& state2,
+                                                  const CollisionRobot& other_robot,
+                                                  const robot_state::RobotState& other_state1,
+                                                  const robot_state::RobotState& other_state2,
+                                                  const AllowedCollisionMatrix* acm) const
+{
+  FCLManager manager;
+  manager.manager_.reset(createBroadphaseManager(broadphase_type_));
+  constructSweptFCLObject(state1, state2, manager.object_);
+  manager.object_.registerTo(manager.manager_.get());
+
+  const CollisionRobotFCL& fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
+  FCLObject other_fcl_obj;
+  fcl_rob.constructSweptFCLObject(other_state1, other_state2, other_fcl_obj);
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(getRobotModel());
+  for (std::size_t i = 0; !cd.done_ && i < other_fcl_obj.collision_objects_.size(); ++i)
+    manager.manager_->collide(other_fcl_obj.collision_objects_[i].get(), &cd, &continuousCollisionCallback);
+}
+
 void CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string>& links)
 {
+  {
+    // cached managers hold copies of the old collision objects
+    boost::mutex::scoped_lock slock(broadphase_lock_);
+    broadphase_pool_.clear();
+    ++broadphase_generation_;
+  }
+
   std::size_t index;
   for (const auto& link : links)
   {
@@ -260,9 +516,10 @@ void CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string>&
       {
         FCLGeometryConstPtr g = createCollisionGeometry(lmodel->getShapes()[j], getLinkScale(lmodel->getName()),
                                                         getLinkPadding(lmodel->getName()), lmodel, j);
-        if (g)
+        index = lmodel->getFirstCollisionBodyTransformIndex() + j;
+        // padded and scaled geometry is cached, so switching back to earlier values usually finds the same geometry
+        if (g && g != geoms_[index])
         {
-          index = lmodel->getFirstCollisionBodyTransformIndex() + j;
           geoms_[index] = g;
           fcl_objs_[index] = FCLCollisionObjectConstPtr(new fcl::CollisionObject(g->collision_geometry_));
         }
@@ -276,19 +533,27 @@ void CollisionRobotFCL::updatedPaddingOrScaling(const std::vector<std::string>&
 void CollisionRobotFCL::distanceSelf(const DistanceRequest& req, DistanceResult& res,
                                      const robot_state::RobotState& state) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  ScopedBroadPhase manager(*this, state);
   DistanceData drd(&req, &res);
 
-  manager.manager_->distance(&drd, &distanceCallback);
+  manager.get()->distance(&drd, &distanceCallback);
+}
+
+void CollisionRobotFCL::distanceSelf(const DistanceRequest& req, DistanceResult& res,
+                                     const robot_state::RobotState& state, DistanceQueryContext& context) const
+{
+  ScopedBroadPhase manager(*this, state);
+  context.beginQuery();
+  DistanceData drd(&req, &res, &context);
+
+  manager.get()->distance(&drd, &distanceCallback);
 }
 
 void CollisionRobotFCL::distanceOther(const DistanceRequest& req, DistanceResult& res,
                                       const robot_state::RobotState& state, const CollisionRobot& other_robot,
                                       const robot_state::RobotState& other_state) const
 {
-  FCLManager manager;
-  allocSelfCollisionBroadPhase(state, manager);
+  ScopedBroadPhase manager(*this, state);
 
   const CollisionRobotFCL& fcl_rob = dynamic_cast<const CollisionRobotFCL&>(other_robot);
   FCLObject other_fcl_obj;
@@ -296,7 +561,7 @@ void CollisionRobotFCL::distanceOther(const DistanceRequest& req, DistanceResult
 
   DistanceData drd(&req, &res);
   for (std::size_t i = 0; !drd.done && i < other_fcl_obj.collision_objects_.size(); ++i)
-    manager.manager_->distance(other_fcl_obj.collision_objects_[i].get(), &drd, &distanceCallback);
+    manager.get()->distance(other_fcl_obj.collision_objects_[i].get(), &drd, &distanceCallback);
 }
 
 }  // end of namespace collision_detection
\ No newline at end of file
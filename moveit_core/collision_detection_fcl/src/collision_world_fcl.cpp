@@ -40,40 +40,88 @@
 #include <fcl/traversal/traversal_node_bvhs.h>
 #include <fcl/traversal/traversal_node_setup.h>
 #include <fcl/collision_node.h>
+#include <moveit/profiler/metrics.h>
 #include <boost/bind.hpp>
+#include <algorithm>
 
 namespace collision_detection
 {
 const std::string CollisionDetectorAllocatorFCL::NAME_("FCL");
 
-CollisionWorldFCL::CollisionWorldFCL() : CollisionWorld()
+namespace
 {
-  auto m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
+moveit::tools::MetricCounter& ROBOT_COLLISION_CHECKS = moveit::tools::MetricsRegistry::instance().counter(
+    "moveit_robot_world_collision_checks_total", "Collision checks of robot states against the world");
 
+typedef std::unordered_set<const fcl::CollisionObject*> CollisionObjectSet;
+const CollisionObjectSet NO_OBJECTS;
+
+// a new shared broadphase structure is built once more objects than this (or than a 16th of the shared objects)
+// changed since the last one was built
+const std::size_t MIN_CHANGED_OBJECTS = 16;
+
+// with BroadphaseTypes::AUTO, about this many world objects are used as queries to benchmark the broadphase managers
+const std::size_t MAX_TUNING_QUERIES = 32;
+
+// passes the pairs that do not involve hidden objects on to the callback of the actual query
+struct FilteredQuery
+{
+  void* data;
+  fcl::CollisionCallBack collision_callback;
+  fcl::DistanceCallBack distance_callback;
+  const CollisionObjectSet* hidden1;
+  const CollisionObjectSet* hidden2;
+
+  bool isHidden(const fcl::CollisionObject* o1, const fcl::CollisionObject* o2) const
+  {
+    return hidden1->find(o1) != hidden1->end() || hidden2->find(o2) != hidden2->end();
+  }
+};
+
+bool filteredCollisionCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data)
+{
+  const FilteredQuery* query = static_cast<const FilteredQuery*>(data);
+  if (query->isHidden(o1, o2))
+    return false;
+  return query->collision_callback(o1, o2, query->data);
+}
+
+bool filteredDistanceCallback(fcl::CollisionObject* o1, fcl::CollisionObject* o2, void* data, double& min_dist)
+{
+  const FilteredQuery* query = static_cast<const FilteredQuery*>(data);
+  if (query->isHidden(o1, o2))
+    return false;
+  return query->distance_callback(o1, o2, query->data, min_dist);
+}
+}
+
+CollisionWorldFCL::CollisionWorldFCL()
+  : CollisionWorld(), broadphase_type_(getDefaultBroadphaseType()), manager_(new fcl::DynamicAABBTreeCollisionManager())
+{
   // request notifications about changes to new world
   observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
 }
 
-CollisionWorldFCL::CollisionWorldFCL(const WorldPtr& world) : CollisionWorld(world)
+CollisionWorldFCL::CollisionWorldFCL(const WorldPtr& world)
+  : CollisionWorld(world)
+  , broadphase_type_(getDefaultBroadphaseType())
+  , manager_(new fcl::DynamicAABBTreeCollisionManager())
 {
-  auto m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
-
   // request notifications about changes to new world
   observer_handle_ = getWorld()->addObserver(boost::bind(&CollisionWorldFCL::notifyObjectChange, this, _1, _2));
   getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
+  shareObjects(true);
 }
 
 CollisionWorldFCL::CollisionWorldFCL(const CollisionWorldFCL& other, const WorldPtr& world)
   : CollisionWorld(other, world)
+  , broadphase_type_(other.broadphase_type_)
+  , manager_(new fcl::DynamicAABBTreeCollisionManager())
+  , shared_objs_(other.shared_objs_)
+  , hidden_ids_(other.hidden_ids_)
+  , hidden_objects_(other.hidden_objects_)
 {
-  auto m = new fcl::DynamicAABBTreeCollisionManager();
-  // m->tree_init_level = 2;
-  manager_.reset(m);
-
+  // the shared broadphase structure is used as it is; only the objects changed since it was built are registered
   fcl_objs_ = other.fcl_objs_;
   for (auto& fcl_obj : fcl_objs_)
     fcl_obj.second.registerTo(manager_.get());
@@ -105,7 +153,7 @@ void CollisionWorldFCL::checkRobotCollision(const CollisionRequest& req, Collisi
                                             const CollisionRobot& robot, const robot_state::RobotState& state1,
                                             const robot_state::RobotState& state2) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, nullptr);
 }
 
 void CollisionWorldFCL::checkRobotCollision(const CollisionRequest& req, CollisionResult& res,
@@ -113,13 +161,30 @@ void CollisionWorldFCL::checkRobotCollision(const CollisionRequest& req, Collisi
                                             const robot_state::RobotState& state2,
                                             const AllowedCollisionMatrix& acm) const
 {
-  ROS_ERROR_NAMED("collision_detection.fcl", "FCL continuous collision checking not yet implemented");
+  checkRobotCollisionHelper(req, res, robot, state1, state2, &acm);
+}
+
+void CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest& req, CollisionResult& res,
+                                                  const CollisionRobot& robot, const robot_state::RobotState& state1,
+                                                  const robot_state::RobotState& state2,
+                                                  const AllowedCollisionMatrix* acm) const
+{
+  ROBOT_COLLISION_CHECKS.increment();
+  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  FCLObject fcl_obj;
+  robot_fcl.constructSweptFCLObject(state1, state2, fcl_obj);
+
+  CollisionData cd(&req, &res, acm);
+  cd.enableGroup(robot.getRobotModel());
+  for (std::size_t i = 0; !cd.done_ && i < fcl_obj.collision_objects_.size(); ++i)
+    collide(fcl_obj.collision_objects_[i].get(), &cd, &continuousCollisionCallback);
 }
 
 void CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest& req, CollisionResult& res,
                                                   const CollisionRobot& robot, const robot_state::RobotState& state,
                                                   const AllowedCollisionMatrix* acm) const
 {
+  ROBOT_COLLISION_CHECKS.increment();
   const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
   FCLObject fcl_obj;
   robot_fcl.constructFCLObject(state, fcl_obj);
@@ -127,7 +192,7 @@ void CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest& req, C
   CollisionData cd(&req, &res, acm);
   cd.enableGroup(robot.getRobotModel());
   for (std::size_t i = 0; !cd.done_ && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
+    collide(fcl_obj.collision_objects_[i].get(), &cd, &collisionCallback);
 
   if (req.distance)
   {
@@ -142,6 +207,27 @@ void CollisionWorldFCL::checkRobotCollisionHelper(const CollisionRequest& req, C
   }
 }
 
+void CollisionWorldFCL::checkRobotCollisionBoolean(const BooleanCollisionRequest& req, BooleanCollisionResult& res,
+                                                   const CollisionRobot& robot, const robot_state::RobotState& state,
+                                                   const AllowedCollisionMatrix& acm) const
+{
+  ROBOT_COLLISION_CHECKS.increment();
+  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  BooleanCollisionData cd(&req, &res, &acm);
+  cd.enableGroup(robot.getRobotModel());
+
+  // the objects of the robot come from its cached broadphase managers, instead of being constructed for the query
+  typedef std::pair<const CollisionWorldFCL*, BooleanCollisionData*> Query;
+  Query query(this, &cd);
+  robot_fcl.forEachFCLObject(state,
+                             [](fcl::CollisionObject* object, void* data) {
+                               Query* query = static_cast<Query*>(data);
+                               query->first->collide(object, query->second, &booleanCollisionCallback);
+                               return query->second->res_->collision;
+                             },
+                             &query);
+}
+
 void CollisionWorldFCL::checkWorldCollision(const CollisionRequest& req, CollisionResult& res,
                                             const CollisionWorld& other_world) const
 {
@@ -160,7 +246,7 @@ void CollisionWorldFCL::checkWorldCollisionHelper(const CollisionRequest& req, C
 {
   const CollisionWorldFCL& other_fcl_world = dynamic_cast<const CollisionWorldFCL&>(other_world);
   CollisionData cd(&req, &res, acm);
-  manager_->collide(other_fcl_world.manager_.get(), &cd, &collisionCallback);
+  collide(other_fcl_world, &cd, &collisionCallback);
 
   if (req.distance)
   {
@@ -190,37 +276,92 @@ void CollisionWorldFCL::constructFCLObject(const World::Object* obj, FCLObject&
 
 void CollisionWorldFCL::updateFCLObject(const std::string& id)
 {
-  // remove FCL objects that correspond to this object
   auto jt = fcl_objs_.find(id);
-  if (jt != fcl_objs_.end())
-  {
-    jt->second.unregisterFrom(manager_.get());
-    jt->second.clear();
-  }
+
+  // shared objects are never modified, the changed object is kept with the others of this world
+  hideSharedObject(id);
 
   // check to see if we have this object
   auto it = getWorld()->find(id);
-  if (it != getWorld()->end())
+  if (it == getWorld()->end())
   {
-    // construct FCL objects that correspond to this object
+    // remove FCL objects that correspond to this object
     if (jt != fcl_objs_.end())
     {
-      constructFCLObject(it->second.get(), jt->second);
-      jt->second.registerTo(manager_.get());
+      jt->second.unregisterFrom(manager_.get());
+      fcl_objs_.erase(jt);
+    }
+    return;
+  }
+  if (jt == fcl_objs_.end())
+    jt = fcl_objs_.insert(std::make_pair(id, FCLObject())).first;
+
+  // construct FCL objects that correspond to this object; objects of shapes whose geometry did not change are kept
+  // and only moved, so that e.g. replacing one shape (such as the octree of the octomap) does not take all other
+  // shapes out of the broadphase and insert them again. Objects shared with the world this one was copied from are
+  // not modified.
+  const World::Object* obj = it->second.get();
+  FCLObject& old_obj = jt->second;
+  FCLObject new_obj;
+  std::vector<bool> reused(old_obj.collision_objects_.size(), false);
+  for (std::size_t i = 0; i < obj->shapes_.size(); ++i)
+  {
+    FCLGeometryConstPtr g = createCollisionGeometry(obj->shapes_[i], obj);
+    if (!g)
+      continue;
+
+    FCLCollisionObjectPtr co;
+    for (std::size_t j = 0; j < old_obj.collision_geometry_.size(); ++j)
+      if (!reused[j] && old_obj.collision_geometry_[j] == g && old_obj.collision_objects_[j].unique())
+      {
+        reused[j] = true;
+        co = old_obj.collision_objects_[j];
+        break;
+      }
+
+    if (co)
+    {
+      co->setTransform(transform2fcl(obj->shape_poses_[i]));
+      co->computeAABB();
+      manager_->update(co.get());
     }
     else
     {
-      constructFCLObject(it->second.get(), fcl_objs_[id]);
-      fcl_objs_[id].registerTo(manager_.get());
+      co.reset(new fcl::CollisionObject(g->collision_geometry_, transform2fcl(obj->shape_poses_[i])));
+      manager_->registerObject(co.get());
     }
+    new_obj.collision_objects_.push_back(co);
+    new_obj.collision_geometry_.push_back(g);
   }
-  else
+
+  for (std::size_t j = 0; j < reused.size(); ++j)
+    if (!reused[j])
+      manager_->unregisterObject(old_obj.collision_objects_[j].get());
+  std::swap(old_obj, new_obj);
+}
+
+bool CollisionWorldFCL::moveFCLObject(const World::Object& obj)
+{
+  auto jt = fcl_objs_.find(obj.id_);
+  if (jt == fcl_objs_.end())
+    return false;
+
+  // shapes without geometry get no FCL object, so objects and shapes only match by index if all shapes have one
+  const FCLObject& fcl_obj = jt->second;
+  if (fcl_obj.collision_objects_.size() != obj.shapes_.size())
+    return false;
+  for (const FCLCollisionObjectPtr& co : fcl_obj.collision_objects_)
+    if (!co.unique())
+      return false;
+
+  for (std::size_t i = 0; i < obj.shapes_.size(); ++i)
   {
-    if (jt != fcl_objs_.end())
-      fcl_objs_.erase(jt);
+    fcl::CollisionObject* co = fcl_obj.collision_objects_[i].get();
+    co->setTransform(transform2fcl(obj.shape_poses_[i]));
+    co->computeAABB();
+    manager_->update(co);
   }
-
-  // manager_->update();
+  return true;
 }
 
 void CollisionWorldFCL::setWorld(const WorldPtr& world)
@@ -234,6 +375,9 @@ void CollisionWorldFCL::setWorld(const WorldPtr& world)
   // clear out objects from old world
   manager_->clear();
   fcl_objs_.clear();
+  shared_objs_.reset();
+  hidden_ids_.clear();
+  hidden_objects_.clear();
   cleanCollisionGeometryCache();
 
   CollisionWorld::setWorld(world);
@@ -243,6 +387,158 @@ void CollisionWorldFCL::setWorld(const WorldPtr& world)
 
   // get notifications any objects already in the new world
   getWorld()->notifyObserverAllObjects(observer_handle_, World::CREATE);
+  shareObjects(true);
+}
+
+void CollisionWorldFCL::hideSharedObject(const std::string& id)
+{
+  if (!shared_objs_ || hidden_ids_.find(id) != hidden_ids_.end())
+    return;
+  auto it = shared_objs_->objects_.find(id);
+  if (it == shared_objs_->objects_.end())
+    return;
+  hidden_ids_.insert(id);
+  for (const FCLCollisionObjectPtr& co : it->second.collision_objects_)
+    hidden_objects_.insert(co.get());
+}
+
+void CollisionWorldFCL::shareObjects(bool force)
+{
+  const std::size_t changed = fcl_objs_.size() + hidden_ids_.size();
+  const std::size_t shared = shared_objs_ ? shared_objs_->objects_.size() : 0;
+  if (changed + shared == 0 || (!force && changed <= std::max(MIN_CHANGED_OBJECTS, shared / 16)))
+    return;
+
+  std::shared_ptr<SharedObjects> objs(new SharedObjects());
+  if (shared_objs_)
+    for (const auto& obj : shared_objs_->objects_)
+      if (hidden_ids_.find(obj.first) == hidden_ids_.end())
+        objs->objects_.insert(obj);
+  objs->objects_.insert(fcl_objs_.begin(), fcl_objs_.end());
+
+  std::vector<fcl::CollisionObject*> collision_objects;
+  for (const auto& obj : objs->objects_)
+    for (const FCLCollisionObjectPtr& co : obj.second.collision_objects_)
+      collision_objects.push_back(co.get());
+  objs->type_ = broadphase_type_;
+  objs->tuned_size_ = 0;
+  if (broadphase_type_ == BroadphaseTypes::AUTO)
+  {
+    // benchmarking is only repeated once the number of objects changed considerably since it was last done
+    const std::size_t size = collision_objects.size();
+    if (shared_objs_ && shared_objs_->tuned_size_ > 0 && size <= 2 * shared_objs_->tuned_size_ &&
+        2 * size >= shared_objs_->tuned_size_)
+    {
+      objs->type_ = shared_objs_->type_;
+      objs->tuned_size_ = shared_objs_->tuned_size_;
+    }
+    else
+    {
+      // a sample of the objects themselves serves as queries, as they are spread like the robots checked against them
+      std::vector<fcl::CollisionObject*> queries;
+      const std::size_t step = std::max<std::size_t>(1, size / MAX_TUNING_QUERIES);
+      for (std::size_t i = 0; i < size; i += step)
+        queries.push_back(collision_objects[i]);
+      objs->type_ = selectBroadphaseType(collision_objects, queries);
+      objs->tuned_size_ = std::max<std::size_t>(1, size);
+      ROS_DEBUG_NAMED("collision_detection.fcl", "Selected broadphase '%s' for %u world collision objects",
+                      getBroadphaseTypeName(objs->type_).c_str(), (unsigned int)size);
+    }
+  }
+  objs->manager_.reset(createBroadphaseManager(objs->type_));
+  objs->manager_->registerObjects(collision_objects);
+  objs->manager_->setup();
+
+  manager_->clear();
+  fcl_objs_.clear();
+  hidden_ids_.clear();
+  hidden_objects_.clear();
+  shared_objs_ = objs;
+}
+
+void CollisionWorldFCL::setBroadphaseType(BroadphaseType type)
+{
+  if (type == broadphase_type_)
+    return;
+  broadphase_type_ = type;
+  shareObjects(true);
+}
+
+BroadphaseType CollisionWorldFCL::getActiveBroadphaseType() const
+{
+  if (shared_objs_)
+    return shared_objs_->type_;
+  return broadphase_type_ == BroadphaseTypes::AUTO ? BroadphaseTypes::DYNAMIC_AABB_TREE : broadphase_type_;
+}
+
+void CollisionWorldFCL::collide(fcl::CollisionObject* object, void* data, fcl::CollisionCallBack callback) const
+{
+  if (shared_objs_ && hidden_objects_.empty())
+    shared_objs_->manager_->collide(object, data, callback);
+  else if (shared_objs_)
+  {
+    // the query object is never hidden, so it does not matter which of the two it is passed as
+    FilteredQuery query = { data, callback, nullptr, &hidden_objects_, &hidden_objects_ };
+    shared_objs_->manager_->collide(object, &query, &filteredCollisionCallback);
+  }
+  manager_->collide(object, data, callback);
+}
+
+void CollisionWorldFCL::collide(const CollisionWorldFCL& other, void* data, fcl::CollisionCallBack callback) const
+{
+  fcl::BroadPhaseCollisionManager* managers[2] = { shared_objs_ ? shared_objs_->manager_.get() : nullptr,
+                                                   manager_.get() };
+  fcl::BroadPhaseCollisionManager* other_managers[2] = {
+    other.shared_objs_ ? other.shared_objs_->manager_.get() : nullptr, other.manager_.get()
+  };
+  const CollisionObjectSet* hidden[2] = { &hidden_objects_, &NO_OBJECTS };
+  const CollisionObjectSet* other_hidden[2] = { &other.hidden_objects_, &NO_OBJECTS };
+  for (int i = 0; i < 2; ++i)
+    for (int j = 0; j < 2; ++j)
+    {
+      if (!managers[i] || !other_managers[j])
+        continue;
+      // objects of this world are passed first, those of the other world second
+      FilteredQuery query = { data, callback, nullptr, hidden[i], other_hidden[j] };
+      if (hidden[i]->empty() && other_hidden[j]->empty())
+        managers[i]->collide(other_managers[j], data, callback);
+      else
+        managers[i]->collide(other_managers[j], &query, &filteredCollisionCallback);
+    }
+}
+
+void CollisionWorldFCL::distance(fcl::CollisionObject* object, void* data, fcl::DistanceCallBack callback) const
+{
+  if (shared_objs_ && hidden_objects_.empty())
+    shared_objs_->manager_->distance(object, data, callback);
+  else if (shared_objs_)
+  {
+    FilteredQuery query = { data, nullptr, callback, &hidden_objects_, &hidden_objects_ };
+    shared_objs_->manager_->distance(object, &query, &filteredDistanceCallback);
+  }
+  manager_->distance(object, data, callback);
+}
+
+void CollisionWorldFCL::distance(const CollisionWorldFCL& other, void* data, fcl::DistanceCallBack callback) const
+{
+  fcl::BroadPhaseCollisionManager* managers[2] = { shared_objs_ ? shared_objs_->manager_.get() : nullptr,
+                                                   manager_.get() };
+  fcl::BroadPhaseCollisionManager* other_managers[2] = {
+    other.shared_objs_ ? other.shared_objs_->manager_.get() : nullptr, other.manager_.get()
+  };
+  const CollisionObjectSet* hidden[2] = { &hidden_objects_, &NO_OBJECTS };
+  const CollisionObjectSet* other_hidden[2] = { &other.hidden_objects_, &NO_OBJECTS };
+  for (int i = 0; i < 2; ++i)
+    for (int j = 0; j < 2; ++j)
+    {
+      if (!managers[i] || !other_managers[j])
+        continue;
+      FilteredQuery query = { data, nullptr, callback, hidden[i], other_hidden[j] };
+      if (hidden[i]->empty() && other_hidden[j]->empty())
+        managers[i]->distance(other_managers[j], data, callback);
+      else
+        managers[i]->distance(other_managers[j], &query, &filteredDistanceCallback);
+    }
 }
 
 void CollisionWorldFCL::notifyObjectChange(const ObjectConstPtr& obj, World::Action action)
@@ -256,14 +552,18 @@ void CollisionWorldFCL::notifyObjectChange(const ObjectConstPtr& obj, World::Act
       it->second.clear();
       fcl_objs_.erase(it);
     }
+    hideSharedObject(obj->id_);
     cleanCollisionGeometryCache();
   }
   else
   {
-    updateFCLObject(obj->id_);
+    // pure pose updates, e.g. of tracked objects, only refit the existing FCL objects in the broadphase
+    if (action != World::MOVE_SHAPE || !moveFCLObject(*obj))
+      updateFCLObject(obj->id_);
     if (action & (World::DESTROY | World::REMOVE_SHAPE))
       cleanCollisionGeometryCache();
   }
+  shareObjects();
 }
 
 void CollisionWorldFCL::distanceRobot(const DistanceRequest& req, DistanceResult& res, const CollisionRobot& robot,
@@ -275,7 +575,20 @@ void CollisionWorldFCL::distanceRobot(const DistanceRequest& req, DistanceResult
 
   DistanceData drd(&req, &res);
   for (std::size_t i = 0; !drd.done && i < fcl_obj.collision_objects_.size(); ++i)
-    manager_->distance(fcl_obj.collision_objects_[i].get(), &drd, &distanceCallback);
+    distance(fcl_obj.collision_objects_[i].get(), &drd, &distanceCallback);
+}
+
+void CollisionWorldFCL::distanceRobot(const DistanceRequest& req, DistanceResult& res, const CollisionRobot& robot,
+                                      const robot_state::RobotState& state, DistanceQueryContext& context) const
+{
+  const CollisionRobotFCL& robot_fcl = dynamic_cast<const CollisionRobotFCL&>(robot);
+  FCLObject fcl_obj;
+  robot_fcl.constructFCLObject(state, fcl_obj);
+
+  context.beginQuery();
+  DistanceData drd(&req, &res, &context);
+  for (std::size_t i = 0; !drd.done && i < fcl_obj.collision_objects_.size(); ++i)
+    distance(fcl_obj.collision_objects_[i].get(), &drd, &distanceCallback);
 }
 
 void CollisionWorldFCL::distanceWorld(const DistanceRequest& req, DistanceResult& res,
@@ -283,7 +596,7 @@ void CollisionWorldFCL::distanceWorld(const DistanceRequest& req, DistanceResult
 {
   const CollisionWorldFCL& other_fcl_world = dynamic_cast<const CollisionWorldFCL&>(world);
   DistanceData drd(&req, &res);
-  manager_->distance(other_fcl_world.manager_.get(), &drd, &distanceCallback);
+  distance(other_fcl_world, &drd, &distanceCallback);
 }
 
 }  // end of namespace collision_detection
\ No newline at end of file
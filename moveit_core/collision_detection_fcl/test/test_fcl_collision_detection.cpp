@@ -526,6 +526,39 @@ TEST_F(FclCollisionDetectionTester, MoveMesh)
   }
 }
 
+TEST_F(FclCollisionDetectionTester, MoveObjectInPlace)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  shapes::ShapeConstPtr box(new shapes::Box(0.2, 0.2, 0.2));
+  const Eigen::Affine3d near_pose(Eigen::Translation3d(0.0, 0.0, 0.2));
+  const Eigen::Affine3d far_pose(Eigen::Translation3d(10.0, 0.0, 0.2));
+  cworld_->getWorld()->addToObject("box", box, far_pose);
+
+  collision_detection::CollisionRequest req;
+  for (int i = 0; i < 4; ++i)
+  {
+    cworld_->getWorld()->moveShapeInObject("box", box, i % 2 ? far_pose : near_pose);
+    collision_detection::CollisionResult res;
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+    EXPECT_EQ(i % 2 == 0, res.collision);
+  }
+
+  // the FCL objects of a copy are shared until it moves them, so moving them in one world leaves the other one as is
+  collision_detection::WorldPtr child_world(new collision_detection::World(*cworld_->getWorld()));
+  collision_detection::CollisionWorldFCL child(*dynamic_cast<collision_detection::CollisionWorldFCL*>(cworld_.get()),
+                                               child_world);
+  child_world->moveShapeInObject("box", box, near_pose);
+  collision_detection::CollisionResult res;
+  child.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+}
+
 TEST_F(FclCollisionDetectionTester, TestChangingShapeSize)
 {
   robot_state::RobotState kstate1(kmodel_);
@@ -576,6 +609,354 @@ TEST_F(FclCollisionDetectionTester, TestChangingShapeSize)
   }
 }
 
+TEST_F(FclCollisionDetectionTester, BoundingSpherePrefilter)
+{
+  robot_state::RobotState kstate(kmodel_);
+  collision_detection::AllowedCollisionMatrix acm(kmodel_->getLinkModelNames(), false);
+  for (int i = 0; i < 20; ++i)
+  {
+    kstate.setToRandomPositions();
+    kstate.update();
+
+    collision_detection::CollisionRequest req;
+    req.contacts = true;
+    req.max_contacts = 100;
+    collision_detection::CollisionResult res1, res2;
+    crobot_->checkSelfCollision(req, res1, kstate, acm);
+    req.bounding_sphere_prefilter = false;
+    crobot_->checkSelfCollision(req, res2, kstate, acm);
+    EXPECT_EQ(res1.collision, res2.collision);
+    EXPECT_EQ(res1.contact_count, res2.contact_count);
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, BooleanCollisionQueries)
+{
+  robot_state::RobotState kstate(kmodel_);
+  collision_detection::AllowedCollisionMatrix acm(kmodel_->getLinkModelNames(), false);
+  shapes::ShapeConstPtr shape(new shapes::Box(1.0, 1.0, 1.0));
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation().x() = 1.0;
+  cworld_->getWorld()->addToObject("box", shape, pose);
+
+  collision_detection::BooleanCollisionRequest bool_req;
+  collision_detection::BooleanCollisionResult bool_res;
+  for (int i = 0; i < 20; ++i)
+  {
+    kstate.setToRandomPositions();
+    kstate.update();
+
+    collision_detection::CollisionRequest req;
+    collision_detection::CollisionResult res;
+    crobot_->checkSelfCollision(req, res, kstate, acm);
+    bool_res.clear();
+    crobot_->checkSelfCollisionBoolean(bool_req, bool_res, kstate, acm);
+    EXPECT_EQ(res.collision, bool_res.collision);
+    if (bool_res.collision)
+    {
+      EXPECT_EQ(collision_detection::BodyTypes::ROBOT_LINK, bool_res.body_types[0]);
+      EXPECT_EQ(collision_detection::BodyTypes::ROBOT_LINK, bool_res.body_types[1]);
+      ASSERT_GE(bool_res.body_ids[0], 0);
+      ASSERT_GE(bool_res.body_ids[1], 0);
+      EXPECT_NE(bool_res.body_ids[0], bool_res.body_ids[1]);
+    }
+
+    res.clear();
+    cworld_->checkRobotCollision(req, res, *crobot_, kstate, acm);
+    bool_res.clear();
+    cworld_->checkRobotCollisionBoolean(bool_req, bool_res, *crobot_, kstate, acm);
+    EXPECT_EQ(res.collision, bool_res.collision);
+    if (bool_res.collision)
+    {
+      // one of the bodies is the box, which has no integer id
+      int world = bool_res.body_types[0] == collision_detection::BodyTypes::WORLD_OBJECT ? 0 : 1;
+      EXPECT_EQ(collision_detection::BodyTypes::WORLD_OBJECT, bool_res.body_types[world]);
+      EXPECT_EQ(-1, bool_res.body_ids[world]);
+      EXPECT_EQ(collision_detection::BodyTypes::ROBOT_LINK, bool_res.body_types[1 - world]);
+      EXPECT_GE(bool_res.body_ids[1 - world], 0);
+    }
+  }
+}
+
+TEST_F(FclCollisionDetectionTester, CompiledAllowedCollisionMatrix)
+{
+  acm_->setEntry("base_link", "base_bellow_link", false);
+  acm_->setDefaultEntry("r_gripper_palm_link", false);
+  collision_detection::CompiledAllowedCollisionMatrixConstPtr compiled = acm_->getCompiled(kmodel_);
+  EXPECT_EQ(compiled, acm_->getCompiled(kmodel_));
+
+  const std::vector<const robot_model::LinkModel*>& links = kmodel_->getLinkModels();
+  for (const robot_model::LinkModel* link1 : links)
+    for (const robot_model::LinkModel* link2 : links)
+    {
+      collision_detection::AllowedCollision::Type type1, type2;
+      bool found1 = acm_->getAllowedCollision(link1->getName(), link2->getName(), type1);
+      ASSERT_TRUE(compiled->hasLink(link1));
+      ASSERT_EQ(found1, compiled->getAllowedCollision(link1, link2, type2));
+      if (found1)
+        EXPECT_EQ(type1, type2);
+    }
+
+  // modifications invalidate the compiled matrix
+  acm_->setEntry("base_link", "base_bellow_link", true);
+  EXPECT_NE(compiled, acm_->getCompiled(kmodel_));
+}
+
+TEST_F(FclCollisionDetectionTester, ContinuousWorldCollision)
+{
+  robot_state::RobotState start(kmodel_);
+  start.setToDefaultValues();
+  start.update();
+
+  robot_state::RobotState end(start);
+  Eigen::Affine3d end_pose = Eigen::Affine3d::Identity();
+  end_pose.translation().x() = 4.0;
+  end.updateStateWithLinkAt("base_footprint", end_pose);
+  end.update();
+
+  // the box is in the way of the motion, but collision free at both ends of it
+  Eigen::Affine3d box_pose = Eigen::Affine3d::Identity();
+  box_pose.translation() = Eigen::Vector3d(2.0, 0.0, 0.5);
+  cworld_->getWorld()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(.2, .2, .2)), box_pose);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  cworld_->checkRobotCollision(req, res, *crobot_, start, *acm_);
+  ASSERT_FALSE(res.collision);
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, end, *acm_);
+  ASSERT_FALSE(res.collision);
+
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, start, end, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // out of the way of the motion
+  cworld_->getWorld()->moveShapeInObject("box", cworld_->getWorld()->getObject("box")->shapes_[0],
+                                         Eigen::Affine3d(Eigen::Translation3d(2.0, 3.0, 0.5)));
+  res = collision_detection::CollisionResult();
+  cworld_->checkRobotCollision(req, res, *crobot_, start, end, *acm_);
+  EXPECT_FALSE(res.collision);
+
+  // no self collision along the motion, since all links move together
+  collision_detection::AllowedCollisionMatrix acm(*acm_);
+  acm.setEntry("r_gripper_palm_link", "l_gripper_palm_link", false);
+  res = collision_detection::CollisionResult();
+  crobot_->checkSelfCollision(req, res, start, end, acm);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST_F(FclCollisionDetectionTester, GeometryCacheReusesMeshes)
+{
+  collision_detection::FCLGeometryCacheStats before = collision_detection::getCollisionGeometryCacheStats();
+
+  // two distinct shapes loaded from the same resource share their BVH
+  shapes::ShapePtr kinect1(shapes::createMeshFromResource(kinect_dae_resource_));
+  shapes::ShapePtr kinect2(shapes::createMeshFromResource(kinect_dae_resource_));
+  cworld_->getWorld()->addToObject("kinect1", kinect1, Eigen::Affine3d::Identity());
+  cworld_->getWorld()->addToObject("kinect2", kinect2, Eigen::Affine3d::Identity());
+
+  collision_detection::FCLGeometryCacheStats after = collision_detection::getCollisionGeometryCacheStats();
+  EXPECT_LE(before.misses + 2, after.misses);
+  EXPECT_LE(before.bvh_reuses + 1, after.bvh_reuses);
+  EXPECT_LT(0u, after.bvh_models);
+
+  // moving an object reuses the geometry built for its shape
+  cworld_->getWorld()->moveShapeInObject("kinect1", kinect1, Eigen::Affine3d(Eigen::Translation3d(0.1, 0.0, 0.0)));
+  collision_detection::FCLGeometryCacheStats moved = collision_detection::getCollisionGeometryCacheStats();
+  EXPECT_LT(after.hits, moved.hits);
+  EXPECT_EQ(after.misses, moved.misses);
+}
+
+TEST_F(FclCollisionDetectionTester, GeometryCacheKeepsPaddedShapes)
+{
+  // geometry for the same scale and padding is built once, also after switching to other values and back
+  shapes::ShapeConstPtr box(new shapes::Box(0.2, 0.2, 0.2));
+  const robot_model::LinkModel* link = kmodel_->getLinkModel("base_link");
+  collision_detection::FCLGeometryConstPtr padded =
+      collision_detection::createCollisionGeometry(box, 1.0, 0.05, link, 0);
+  collision_detection::FCLGeometryConstPtr other = collision_detection::createCollisionGeometry(box, 1.0, 0.1, link, 0);
+  EXPECT_NE(padded, other);
+  EXPECT_EQ(padded, collision_detection::createCollisionGeometry(box, 1.0, 0.05, link, 0));
+  EXPECT_LE(2u, collision_detection::getCollisionGeometryCacheStats().scaled_shapes);
+
+  // robots with the same padding share their geometry
+  crobot_->setPadding(0.02);
+  collision_detection::FCLGeometryCacheStats before = collision_detection::getCollisionGeometryCacheStats();
+  DefaultCRobotType robot(kmodel_);
+  robot.setPadding(0.02);
+  crobot_->setPadding(0.0);
+  crobot_->setPadding(0.02);
+  collision_detection::FCLGeometryCacheStats after = collision_detection::getCollisionGeometryCacheStats();
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_LT(before.hits, after.hits);
+}
+
+TEST_F(FclCollisionDetectionTester, DistanceQueryContext)
+{
+  robot_state::RobotState state(kmodel_);
+  state.setToDefaultValues();
+  state.update();
+
+  collision_detection::DistanceRequest req;
+  req.acm = &*acm_;
+  collision_detection::DistanceQueryContext context;
+
+  // small motions, as for a monitor running at a high rate; the result must not change because of the context
+  double pan = state.getVariablePosition("r_shoulder_pan_joint");
+  for (unsigned int i = 0; i < 5; ++i)
+  {
+    state.setVariablePosition("r_shoulder_pan_joint", pan + i * 0.001);
+    state.update();
+
+    collision_detection::DistanceResult res, res_context;
+    crobot_->distanceSelf(req, res, state);
+    crobot_->distanceSelf(req, res_context, state, context);
+    EXPECT_NEAR(res.minimum_distance.distance, res_context.minimum_distance.distance, 1e-6);
+    if (i > 0)
+      EXPECT_LT(0u, context.getPrunedPairCount());
+  }
+
+  // stop at the first pair closer than the safety distance
+  context.setSafetyDistance(std::numeric_limits<double>::max());
+  collision_detection::DistanceResult res;
+  crobot_->distanceSelf(req, res, state, context);
+  EXPECT_TRUE(context.isBelowSafetyDistance());
+  EXPECT_EQ(1u, context.getComputedPairCount());
+}
+
+TEST_F(FclCollisionDetectionTester, NarrowPhaseInstrumentation)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  collision_detection::clearNarrowPhaseStatistics();
+  collision_detection::setNarrowPhaseInstrumentation(true);
+  ASSERT_TRUE(collision_detection::isNarrowPhaseInstrumentationEnabled());
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+
+  collision_detection::NarrowPhaseStatisticsMap statistics;
+  collision_detection::getNarrowPhaseStatistics(statistics);
+  EXPECT_FALSE(statistics.empty());
+  for (const auto& pair : statistics)
+  {
+    EXPECT_LT(pair.first.first, pair.first.second);
+    EXPECT_LT(0u, pair.second.collision_calls);
+    EXPECT_EQ(0u, pair.second.distance_calls);
+  }
+
+  // nothing is recorded once disabled
+  collision_detection::setNarrowPhaseInstrumentation(false);
+  collision_detection::clearNarrowPhaseStatistics();
+  res = collision_detection::CollisionResult();
+  crobot_->checkSelfCollision(req, res, kstate, *acm_);
+  collision_detection::getNarrowPhaseStatistics(statistics);
+  EXPECT_TRUE(statistics.empty());
+}
+
+TEST_F(FclCollisionDetectionTester, CopiedWorldSharesObjects)
+{
+  robot_state::RobotState kstate(kmodel_);
+  kstate.setToDefaultValues();
+  kstate.update();
+
+  // many objects away from the robot, which end up in the shared broadphase structure, and one touching it
+  shapes::ShapeConstPtr box(new shapes::Box(0.2, 0.2, 0.2));
+  for (int i = 0; i < 100; ++i)
+    cworld_->getWorld()->addToObject("far" + std::to_string(i), box,
+                                     Eigen::Affine3d(Eigen::Translation3d(10.0 + i, 10.0, 0.0)));
+  cworld_->getWorld()->addToObject("near", box, Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 0.2)));
+
+  collision_detection::WorldPtr child_world(new collision_detection::World(*cworld_->getWorld()));
+  collision_detection::CollisionWorldFCL child(*dynamic_cast<collision_detection::CollisionWorldFCL*>(cworld_.get()),
+                                               child_world);
+
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  child.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // moving the object away in the child does not affect the parent
+  child_world->moveShapeInObject("near", box, Eigen::Affine3d(Eigen::Translation3d(10.0, 12.0, 0.0)));
+  res.clear();
+  child.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // a shared object moved close to the robot in the child
+  child_world->moveShapeInObject("far3", box, Eigen::Affine3d(Eigen::Translation3d(0.0, 0.0, 0.2)));
+  res.clear();
+  child.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_TRUE(res.collision);
+
+  // removing objects from one world does not remove them from the other one
+  cworld_->getWorld()->removeObject("near");
+  res.clear();
+  cworld_->checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  child_world->removeObject("far3");
+  res.clear();
+  child.checkRobotCollision(req, res, *crobot_, kstate, *acm_);
+  EXPECT_FALSE(res.collision);
+  EXPECT_TRUE(cworld_->getWorld()->hasObject("far3"));
+}
+
+TEST_F(FclCollisionDetectionTester, BroadphaseTypes)
+{
+  shapes::ShapeConstPtr box(new shapes::Box(0.2, 0.2, 0.2));
+  for (int i = 0; i < 50; ++i)
+    cworld_->getWorld()->addToObject("box" + std::to_string(i), box,
+                                     Eigen::Affine3d(Eigen::Translation3d(0.1 * (i % 10), 0.3 * (i / 10), 0.2)));
+  collision_detection::CollisionWorldFCL& world = dynamic_cast<collision_detection::CollisionWorldFCL&>(*cworld_);
+  collision_detection::CollisionRobotFCL& robot = dynamic_cast<collision_detection::CollisionRobotFCL&>(*crobot_);
+  collision_detection::AllowedCollisionMatrix acm(kmodel_->getLinkModelNames(), false);
+
+  robot_state::RobotState kstate(kmodel_);
+  std::vector<std::size_t> self_contacts, world_contacts;
+  for (int i = 0; i < 10; ++i)
+  {
+    kstate.setToRandomPositions();
+    kstate.update();
+
+    // all managers find the same contacts
+    for (int t = 0; t <= collision_detection::BroadphaseTypes::AUTO; ++t)
+    {
+      collision_detection::BroadphaseType type = static_cast<collision_detection::BroadphaseType>(t);
+      world.setBroadphaseType(type);
+      robot.setBroadphaseType(type);
+      EXPECT_EQ(type, world.getBroadphaseType());
+      EXPECT_NE(collision_detection::BroadphaseTypes::AUTO, world.getActiveBroadphaseType());
+      EXPECT_NE(collision_detection::BroadphaseTypes::AUTO, robot.getBroadphaseType());
+
+      collision_detection::CollisionRequest req;
+      req.contacts = true;
+      req.max_contacts = 1000;
+      collision_detection::CollisionResult self_res, world_res;
+      robot.checkSelfCollision(req, self_res, kstate, acm);
+      world.checkRobotCollision(req, world_res, robot, kstate, acm);
+      if (type == collision_detection::BroadphaseTypes::DYNAMIC_AABB_TREE)
+      {
+        self_contacts.push_back(self_res.contact_count);
+        world_contacts.push_back(world_res.contact_count);
+      }
+      EXPECT_EQ(self_contacts.back(), self_res.contact_count);
+      EXPECT_EQ(world_contacts.back(), world_res.contact_count);
+    }
+  }
+
+  collision_detection::BroadphaseType type;
+  EXPECT_TRUE(collision_detection::parseBroadphaseType("interval_tree", type));
+  EXPECT_EQ(collision_detection::BroadphaseTypes::INTERVAL_TREE, type);
+  EXPECT_EQ("interval_tree", collision_detection::getBroadphaseTypeName(type));
+  EXPECT_FALSE(collision_detection::parseBroadphaseType("octree", type));
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
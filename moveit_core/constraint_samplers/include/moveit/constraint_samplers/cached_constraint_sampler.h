@@ -0,0 +1,188 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CONSTRAINT_SAMPLERS_CACHED_CONSTRAINT_SAMPLER_
+#define MOVEIT_CONSTRAINT_SAMPLERS_CACHED_CONSTRAINT_SAMPLER_
+
+#include <moveit/constraint_samplers/constraint_sampler.h>
+#include <boost/thread/mutex.hpp>
+#include <list>
+#include <map>
+
+namespace constraint_samplers
+{
+MOVEIT_CLASS_FORWARD(ConstraintSamplePool);
+MOVEIT_CLASS_FORWARD(CachedConstraintSampler);
+
+/**
+ * \brief Keeps the group states that were sampled for the most recently used constraints.
+ *
+ * Samples are kept for at most a given number of constraint sets; when more
+ * constraint sets are added, the samples of the least recently used one are
+ * discarded. The pool can be shared between threads.
+ */
+class ConstraintSamplePool
+{
+public:
+  /**
+   * \brief Constructor
+   *
+   * @param max_constraint_sets The number of constraint sets samples are kept for
+   * @param max_samples_per_set The number of samples kept for each constraint set
+   */
+  ConstraintSamplePool(std::size_t max_constraint_sets, std::size_t max_samples_per_set);
+
+  /**
+   * \brief Gets the key samples for \e constr are kept under, for the group \e group_name
+   *
+   * Time stamps are ignored, so constraints that are issued again map to the same key.
+   */
+  static std::string getKey(const std::string& group_name, const moveit_msgs::Constraints& constr);
+
+  /**
+   * \brief Gets the samples kept under \e key, most recent first, and marks them as recently used
+   */
+  void getSamples(const std::string& key, std::vector<std::vector<double> >& samples);
+
+  /**
+   * \brief Keeps the group state \e values under \e key
+   */
+  void addSample(const std::string& key, const std::vector<double>& values);
+
+  /**
+   * \brief Discards all samples
+   */
+  void clear();
+
+  std::size_t getMaxConstraintSets() const
+  {
+    return max_constraint_sets_;
+  }
+
+  std::size_t getMaxSamplesPerSet() const
+  {
+    return max_samples_per_set_;
+  }
+
+private:
+  struct Entry
+  {
+    std::string key;
+    std::list<std::vector<double> > samples;
+  };
+
+  std::size_t max_constraint_sets_;
+  std::size_t max_samples_per_set_;
+  boost::mutex lock_;
+  std::list<Entry> entries_;                                      /**< \brief The entries, most recently used first */
+  std::map<std::string, std::list<Entry>::iterator> entry_index_; /**< \brief The entries by key */
+};
+
+/**
+ * \brief A sampler that first returns the samples kept in a \ref
+ * ConstraintSamplePool for its constraints, and then samples from another
+ * sampler, adding the samples it produces to the pool.
+ *
+ * Each kept sample is returned at most once by a sampler, and only if it
+ * still satisfies the constraints and the group state validity callback, so
+ * samples found in a different scene are checked against the current one
+ * before they are used.
+ */
+class CachedConstraintSampler : public ConstraintSampler
+{
+public:
+  /**
+   * \brief Constructor
+   *
+   * @param [in] sampler The configured sampler that is used once the kept samples are exhausted
+   * @param [in] pool The pool samples are taken from and added to
+   * @param [in] constr The constraints \e sampler was configured for
+   */
+  CachedConstraintSampler(const ConstraintSamplerPtr& sampler, const ConstraintSamplePoolPtr& pool,
+                          const moveit_msgs::Constraints& constr);
+
+  /**
+   * \brief Configures the wrapped sampler, and uses the samples kept for \e constr
+   */
+  virtual bool configure(const moveit_msgs::Constraints& constr);
+
+  virtual bool sample(robot_state::RobotState& state, const robot_state::RobotState& reference_state,
+                      unsigned int max_attempts);
+
+  virtual bool project(robot_state::RobotState& state, unsigned int max_attempts);
+
+  virtual void setVerbose(bool verbose);
+
+  /**
+   * \brief Gets the wrapped sampler
+   */
+  const ConstraintSamplerPtr& getSampler() const
+  {
+    return sampler_;
+  }
+
+  /**
+   * \brief Gets the number of kept samples that were not tried yet
+   */
+  std::size_t getCachedSampleCount() const
+  {
+    return cached_samples_.size();
+  }
+
+  virtual const std::string& getName() const
+  {
+    static const std::string SAMPLER_NAME = "CachedConstraintSampler";
+    return SAMPLER_NAME;
+  }
+
+protected:
+  /**
+   * \brief Sets the constraints the samples are kept for and checked against
+   */
+  void useConstraints(const moveit_msgs::Constraints& constr);
+
+  /**
+   * \brief Adds the group state of \e state to the pool if it satisfies the constraints
+   */
+  void keepSample(robot_state::RobotState& state);
+
+  ConstraintSamplerPtr sampler_;                                    /**< \brief The wrapped sampler */
+  ConstraintSamplePoolPtr pool_;                                    /**< \brief The pool of samples */
+  std::string key_;                                                 /**< \brief The key of the constraints */
+  kinematic_constraints::KinematicConstraintSetPtr constraint_set_; /**< \brief Checks the samples */
+  std::vector<std::vector<double> > cached_samples_;                /**< \brief The untried samples, last first */
+};
+}
+
+#endif
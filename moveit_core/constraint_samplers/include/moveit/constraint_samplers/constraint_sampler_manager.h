@@ -38,6 +38,7 @@
 #define MOVEIT_CONSTRAINT_SAMPLERS_CONSTRAINT_SAMPLER_MANAGER_
 
 #include <moveit/constraint_samplers/constraint_sampler_allocator.h>
+#include <moveit/constraint_samplers/cached_constraint_sampler.h>
 #include <moveit/macros/class_forward.h>
 
 namespace constraint_samplers
@@ -49,8 +50,8 @@ MOVEIT_CLASS_FORWARD(ConstraintSamplerManager);
  * particular group from a moveit_msgs::Constraints.
  *
  * It contains logic that will generate either a
- * JointConstraintSampler, an IKConstraintSampler, or a
- * UnionConstraintSampler depending on the contents of the Constraints
+ * JointConstraintSampler, an IKConstraintSampler, a
+ * ProjectionConstraintSampler or a UnionConstraintSampler depending on the contents of the Constraints
  * message and the group in question.
  *
  */
@@ -73,6 +74,30 @@ public:
   {
     sampler_alloc_.push_back(sa);
   }
+
+  /**
+   * \brief Sets the pool of samples that are kept for the constraints samplers are selected for
+   *
+   * When a pool is set, the samplers returned by selectSampler() first
+   * return the samples previously found for the same constraints and group,
+   * as long as these are still valid, and add the samples they find to the
+   * pool.
+   *
+   * @param pool The pool of samples, or an empty pointer to not keep samples
+   */
+  void setSamplePool(const ConstraintSamplePoolPtr& pool)
+  {
+    sample_pool_ = pool;
+  }
+
+  /**
+   * \brief Gets the pool of samples, which may be empty
+   */
+  const ConstraintSamplePoolPtr& getSamplePool() const
+  {
+    return sample_pool_;
+  }
+
   /**
    * \brief Selects among the potential sampler allocators.
    *
@@ -80,7 +105,8 @@ public:
    * allocators, trying to find one that can service the constraints.
    * The first one that can service the request will be called.  If no
    * allocators can service the Constraints, or there are no
-   * allocators, the selectDefaultSampler will be called.
+   * allocators, the selectDefaultSampler will be called. If a sample
+   * pool is set, the sampler is wrapped in a \ref CachedConstraintSampler.
    *
    * @param scene The planning scene that will be passed into the constraint sampler
    * @param group_name The group name for which to allocate the constraint sampler
@@ -128,6 +154,8 @@ public:
    *   - If any samplers are valid, it adds them to a vector of type \ref ConstraintSamplerPtr.
    *   - Once it has iterated through each sub-group, if any samplers are valid, they are returned in a
    *UnionConstraintSampler, along with a JointConstraintSampler if one exists.
+   * - If no IK-based sampler could be generated, and the group is a chain that moves the links of some position or
+   *orientation constraints, a ProjectionConstraintSampler is returned, which also enforces the joint constraints.
    * @param scene The planning scene that will be used to create the ConstraintSampler
    * @param group_name The group name for which to create a sampler
    * @param constr The set of constraints for which to create a sampler
@@ -142,6 +170,7 @@ public:
 private:
   std::vector<ConstraintSamplerAllocatorPtr>
       sampler_alloc_; /**< \brief Holds the constraint sampler allocators, which will be tested in order  */
+  ConstraintSamplePoolPtr sample_pool_; /**< \brief Keeps the samples found for recent constraints, if set */
 };
 }
 
@@ -304,7 +304,7 @@ public:
    *
    */
   IKConstraintSampler(const planning_scene::PlanningSceneConstPtr& scene, const std::string& group_name)
-    : ConstraintSampler(scene, group_name)
+    : ConstraintSampler(scene, group_name), batch_size_(1), reachability_base_(NULL)
   {
   }
 
@@ -381,6 +381,36 @@ public:
     ik_timeout_ = timeout;
   }
 
+  /**
+   * \brief Use a kinematics solver of its own instead of the solver instance of the joint model group
+   *
+   * Samplers that sample concurrently cannot share a solver. The solver is kept when the sampler is configured again.
+   *
+   * @param solver A solver allocated for the group of this sampler, or an empty pointer to use the solver instance of
+   * the group
+   */
+  void setKinematicsSolver(const kinematics::KinematicsBaseConstPtr& solver);
+
+  /**
+   * \brief Solves IK for up to \e batch_size sampled poses at once, each in a thread with a kinematics solver of its
+   * own
+   *
+   * The solutions that are not returned right away are kept, and returned by the next calls to sample() and
+   * project(). Batches are only used if the group can allocate additional solvers, and if the sampled poses do not
+   * depend on the reference state. The group state validity callback must be thread safe.
+   *
+   * @param batch_size The number of poses to solve IK for at once; 1 solves them one at a time
+   */
+  void setBatchSize(unsigned int batch_size);
+
+  /**
+   * \brief Gets the number of poses IK is solved for at once
+   */
+  unsigned int getBatchSize() const
+  {
+    return batch_size_;
+  }
+
   /**
    * \brief Gets the position constraint associated with this sampler.
    *
@@ -463,7 +493,9 @@ public:
    * specified, then an quaternion is produced by sampling a
    * difference value within the axis tolerances and applying the
    * difference rotation to the orientation constraint target.
-   * Otherwise, a random quaternion is produced.
+   * Otherwise, a random quaternion is produced.  If the group has a
+   * reachability map for the constrained link, poses outside of it
+   * are rejected and sampled again, up to max_attempts times.
    *
    * @param [out] pos The position component of the sample
    * @param [out] quat The orientation component of the sample
@@ -510,13 +542,45 @@ protected:
   bool callIK(const geometry_msgs::Pose& ik_query,
               const kinematics::KinematicsBase::IKCallbackFn& adapted_ik_validity_callback, double timeout,
               robot_state::RobotState& state, bool use_as_seed);
+  /**
+   * \brief Samples a pose and transforms it to the base and tip frames of the IK solver
+   */
+  bool sampleIKQuery(geometry_msgs::Pose& ik_query, const robot_state::RobotState& reference_state,
+                     unsigned int max_attempts);
+
+  /**
+   * \brief Solves IK for a batch of sampled poses and keeps the solutions; returns false if no poses can be sampled
+   */
+  bool solveBatch(const robot_state::RobotState& state, const robot_state::RobotState& reference_state,
+                  unsigned int max_attempts);
+
+  /**
+   * \brief Sets \e state to a kept batch solution that is still valid for it; returns false if there is none
+   */
+  bool useBatchSolution(robot_state::RobotState& state);
+
   bool sampleHelper(robot_state::RobotState& state, const robot_state::RobotState& reference_state,
                     unsigned int max_attempts, bool project);
+
+  /**
+   * \brief Samples a pose in the constraint regions, as samplePose() does, without looking at the reachability map
+   */
+  bool sampleCandidatePose(Eigen::Vector3d& pos, Eigen::Quaterniond& quat, const robot_state::RobotState& ks,
+                           unsigned int max_attempts);
+
+  /**
+   * \brief Checks a pose of the sampled link (in the planning frame) against the reachability map
+   */
+  bool isReachable(const Eigen::Vector3d& pos, const Eigen::Quaterniond& quat, const robot_state::RobotState& ks) const;
   bool validate(robot_state::RobotState& state) const;
 
   random_numbers::RandomNumberGenerator random_number_generator_; /**< \brief Random generator used by the sampler */
   IKSamplingPose sampling_pose_;                                  /**< \brief Holder for the pose used for sampling */
   kinematics::KinematicsBaseConstPtr kb_;                         /**< \brief Holds the kinematics solver */
+  kinematics::KinematicsBaseConstPtr own_kb_; /**< \brief The solver used instead of the one of the group, if any */
+  unsigned int batch_size_; /**< \brief The number of poses IK is solved for at once */
+  std::vector<kinematics::KinematicsBaseConstPtr> batch_solvers_; /**< \brief The solvers of the batch besides kb_ */
+  std::vector<std::vector<double> > batch_solutions_; /**< \brief Solutions of a batch that were not returned yet */
   double ik_timeout_;                                             /**< \brief Holds the timeout associated with IK */
   std::string ik_frame_;                                          /**< \brief Holds the base from of the IK solver */
   bool transform_ik_; /**< \brief True if the frame associated with the kinematic model is different than the base frame
@@ -524,6 +588,8 @@ protected:
   bool need_eef_to_ik_tip_transform_; /**< \brief True if the tip frame of the inverse kinematic is different than the
                                         frame of the end effector */
   Eigen::Affine3d eef_to_ik_tip_transform_; /**< \brief Holds the transformation from end effector to IK tip frame */
+  robot_model::ReachabilityMapConstPtr reachability_map_; /**< \brief The reachability map used to reject poses */
+  const robot_model::LinkModel* reachability_base_;       /**< \brief The base link of the reachability map */
 };
 }
 
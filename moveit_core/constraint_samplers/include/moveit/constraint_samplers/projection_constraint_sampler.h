@@ -0,0 +1,178 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CONSTRAINT_SAMPLERS_PROJECTION_CONSTRAINT_SAMPLER_
+#define MOVEIT_CONSTRAINT_SAMPLERS_PROJECTION_CONSTRAINT_SAMPLER_
+
+#include <moveit/constraint_samplers/constraint_sampler.h>
+#include <moveit/constraint_samplers/constraint_sampler_allocator.h>
+#include <moveit/macros/class_forward.h>
+#include <random_numbers/random_numbers.h>
+
+namespace constraint_samplers
+{
+MOVEIT_CLASS_FORWARD(ProjectionConstraintSampler);
+MOVEIT_CLASS_FORWARD(ProjectionConstraintSamplerAllocator);
+
+/**
+ * \brief A sampler that projects group states onto position and
+ * orientation constraints with damped Newton steps along the Jacobian
+ * of the constrained links.
+ *
+ * Unlike \ref IKConstraintSampler, no IK solver is needed and the
+ * sampled poses are not drawn first, so states are found even for tight
+ * orientation constraints, for which drawing and solving poses is rarely
+ * successful. The joints the constraints leave free keep their random
+ * values, which makes the sampler suited for path constraints. The group
+ * must be a chain. Joint constraints are enforced by sampling and
+ * clamping within their bounds; visibility constraints are ignored.
+ */
+class ProjectionConstraintSampler : public ConstraintSampler
+{
+public:
+  /** \brief The default number of Newton steps before a projection is given up */
+  static const unsigned int DEFAULT_MAX_ITERATIONS = 64;
+
+  /**
+   * \brief Constructor
+   *
+   * @param [in] scene The planning scene used to check the constraint
+   * @param [in] group_name The group name associated with the constraint
+   */
+  ProjectionConstraintSampler(const planning_scene::PlanningSceneConstPtr& scene, const std::string& group_name);
+
+  /**
+   * \brief Configures the sampler for the joint, position and orientation constraints of \e constr
+   *
+   * Position and orientation constraints on links the group does not
+   * move are ignored.
+   *
+   * @return True if the group is a chain and at least one position or orientation constraint applies to it
+   */
+  virtual bool configure(const moveit_msgs::Constraints& constr);
+
+  /**
+   * \brief Projects random group states until one satisfies the constraints
+   *
+   * The values of the joints outside the group are taken from \e state.
+   */
+  virtual bool sample(robot_state::RobotState& state, const robot_state::RobotState& reference_state,
+                      unsigned int max_attempts);
+
+  /**
+   * \brief Projects the group state of \e state, and then random group
+   * states for the remaining attempts
+   */
+  virtual bool project(robot_state::RobotState& state, unsigned int max_attempts);
+
+  /** \brief Sets the number of Newton steps before a projection is given up */
+  void setMaxIterations(unsigned int max_iterations)
+  {
+    max_iterations_ = max_iterations;
+  }
+
+  unsigned int getMaxIterations() const
+  {
+    return max_iterations_;
+  }
+
+  /** \brief Sets the largest change of the group state, in joint space, made by a single Newton step */
+  void setMaxStep(double max_step)
+  {
+    max_step_ = max_step;
+  }
+
+  double getMaxStep() const
+  {
+    return max_step_;
+  }
+
+  /** \brief Gets the number of position and orientation constraints states are projected onto */
+  std::size_t getProjectedConstraintCount() const
+  {
+    return position_constraints_.size() + orientation_constraints_.size();
+  }
+
+  virtual const std::string& getName() const
+  {
+    static const std::string SAMPLER_NAME = "ProjectionConstraintSampler";
+    return SAMPLER_NAME;
+  }
+
+protected:
+  /** \brief The bounds the joint constraints impose on a variable of the group */
+  struct JointBounds
+  {
+    std::size_t index_;
+    double min_bound_;
+    double max_bound_;
+  };
+
+  virtual void clear();
+
+  /** \brief Sets values_ to a random group state within the joint constraints */
+  void sampleGroupState();
+
+  /** \brief Moves the group state of \e state onto the constraints, starting from the values in values_ */
+  bool projectGroupState(robot_state::RobotState& state);
+
+  random_numbers::RandomNumberGenerator random_number_generator_; /**< \brief Random number generator used to sample */
+  std::vector<JointBounds> bounds_; /**< \brief The bounds of the joint constrained variables */
+  std::vector<kinematic_constraints::PositionConstraintPtr> position_constraints_;
+  std::vector<kinematic_constraints::OrientationConstraintPtr> orientation_constraints_;
+  unsigned int max_iterations_;
+  double max_step_;
+  std::vector<double> values_; /**< \brief The group state being projected */
+};
+
+/**
+ * \brief Allocates a \ref ProjectionConstraintSampler for the constraints it applies to.
+ *
+ * \ref ConstraintSamplerManager::selectDefaultSampler() falls back to
+ * projection only if no IK-based sampler is found. Registering this
+ * allocator with \ref ConstraintSamplerManager::registerSamplerAllocator()
+ * makes projection preferred for position and orientation constraints.
+ */
+class ProjectionConstraintSamplerAllocator : public ConstraintSamplerAllocator
+{
+public:
+  virtual ConstraintSamplerPtr alloc(const planning_scene::PlanningSceneConstPtr& scene, const std::string& group_name,
+                                     const moveit_msgs::Constraints& constr);
+
+  virtual bool canService(const planning_scene::PlanningSceneConstPtr& scene, const std::string& group_name,
+                          const moveit_msgs::Constraints& constr) const;
+};
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/constraint_samplers/cached_constraint_sampler.h>
+#include <ros/serialization.h>
+#include <algorithm>
+
+namespace constraint_samplers
+{
+ConstraintSamplePool::ConstraintSamplePool(std::size_t max_constraint_sets, std::size_t max_samples_per_set)
+  : max_constraint_sets_(max_constraint_sets), max_samples_per_set_(max_samples_per_set)
+{
+}
+
+std::string ConstraintSamplePool::getKey(const std::string& group_name, const moveit_msgs::Constraints& constr)
+{
+  moveit_msgs::Constraints c = constr;
+  for (std::size_t i = 0; i < c.position_constraints.size(); ++i)
+    c.position_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.orientation_constraints.size(); ++i)
+    c.orientation_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.visibility_constraints.size(); ++i)
+  {
+    c.visibility_constraints[i].target_pose.header.stamp = ros::Time();
+    c.visibility_constraints[i].sensor_pose.header.stamp = ros::Time();
+  }
+
+  // the group name is followed by the serialized constraints, so keys are equal only for equal requests
+  uint32_t length = ros::serialization::serializationLength(c);
+  std::vector<uint8_t> buffer(length);
+  if (length > 0)
+  {
+    ros::serialization::OStream stream(&buffer[0], length);
+    ros::serialization::serialize(stream, c);
+  }
+  std::string key = group_name;
+  key.push_back('\0');
+  key.append(buffer.begin(), buffer.end());
+  return key;
+}
+
+void ConstraintSamplePool::getSamples(const std::string& key, std::vector<std::vector<double> >& samples)
+{
+  samples.clear();
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<std::string, std::list<Entry>::iterator>::iterator it = entry_index_.find(key);
+  if (it == entry_index_.end())
+    return;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  samples.assign(it->second->samples.begin(), it->second->samples.end());
+}
+
+void ConstraintSamplePool::addSample(const std::string& key, const std::vector<double>& values)
+{
+  if (max_constraint_sets_ == 0 || max_samples_per_set_ == 0)
+    return;
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<std::string, std::list<Entry>::iterator>::iterator it = entry_index_.find(key);
+  if (it == entry_index_.end())
+  {
+    if (entries_.size() >= max_constraint_sets_)
+    {
+      entry_index_.erase(entries_.back().key);
+      entries_.pop_back();
+    }
+    entries_.push_front(Entry());
+    entries_.front().key = key;
+    it = entry_index_.insert(std::make_pair(key, entries_.begin())).first;
+  }
+  else
+    entries_.splice(entries_.begin(), entries_, it->second);
+
+  std::list<std::vector<double> >& samples = it->second->samples;
+  samples.push_front(values);
+  if (samples.size() > max_samples_per_set_)
+    samples.pop_back();
+}
+
+void ConstraintSamplePool::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  entries_.clear();
+  entry_index_.clear();
+}
+
+CachedConstraintSampler::CachedConstraintSampler(const ConstraintSamplerPtr& sampler,
+                                                 const ConstraintSamplePoolPtr& pool,
+                                                 const moveit_msgs::Constraints& constr)
+  : ConstraintSampler(sampler->getPlanningScene(), sampler->getGroupName()), sampler_(sampler), pool_(pool)
+{
+  verbose_ = sampler_->getVerbose();
+  useConstraints(constr);
+}
+
+bool CachedConstraintSampler::configure(const moveit_msgs::Constraints& constr)
+{
+  clear();
+  if (!sampler_->configure(constr))
+    return false;
+  useConstraints(constr);
+  return is_valid_;
+}
+
+void CachedConstraintSampler::useConstraints(const moveit_msgs::Constraints& constr)
+{
+  frame_depends_ = sampler_->getFrameDependency();
+  is_valid_ = sampler_->isValid();
+  key_ = ConstraintSamplePool::getKey(jmg_->getName(), constr);
+  constraint_set_.reset(new kinematic_constraints::KinematicConstraintSet(scene_->getRobotModel()));
+  constraint_set_->add(constr, scene_->getTransforms());
+
+  // the samples are reversed so that the most recent ones are taken first from the back
+  pool_->getSamples(key_, cached_samples_);
+  std::reverse(cached_samples_.begin(), cached_samples_.end());
+  if (verbose_ && !cached_samples_.empty())
+    ROS_INFO_NAMED("constraint_samplers", "Reusing %u samples kept for the constraints of group '%s'",
+                   (unsigned int)cached_samples_.size(), jmg_->getName().c_str());
+}
+
+void CachedConstraintSampler::setVerbose(bool verbose)
+{
+  ConstraintSampler::setVerbose(verbose);
+  sampler_->setVerbose(verbose);
+}
+
+bool CachedConstraintSampler::sample(robot_state::RobotState& state, const robot_state::RobotState& reference_state,
+                                     unsigned int max_attempts)
+{
+  if (!is_valid_)
+  {
+    ROS_WARN_NAMED("constraint_samplers", "CachedConstraintSampler not configured, won't sample");
+    return false;
+  }
+
+  while (!cached_samples_.empty())
+  {
+    std::vector<double> values;
+    values.swap(cached_samples_.back());
+    cached_samples_.pop_back();
+    state = reference_state;
+    state.setJointGroupPositions(jmg_, values);
+    if (group_state_validity_callback_ && !group_state_validity_callback_(&state, jmg_, &values[0]))
+      continue;
+    state.update();
+    if (constraint_set_->decide(state, verbose_).satisfied)
+      return true;
+  }
+
+  sampler_->setGroupStateValidityCallback(group_state_validity_callback_);
+  if (!sampler_->sample(state, reference_state, max_attempts))
+    return false;
+  keepSample(state);
+  return true;
+}
+
+bool CachedConstraintSampler::project(robot_state::RobotState& state, unsigned int max_attempts)
+{
+  sampler_->setGroupStateValidityCallback(group_state_validity_callback_);
+  if (!sampler_->project(state, max_attempts))
+    return false;
+  keepSample(state);
+  return true;
+}
+
+void CachedConstraintSampler::keepSample(robot_state::RobotState& state)
+{
+  // the joint sampler may leave some joints unconstrained, so only samples that satisfy all constraints are kept
+  state.update();
+  if (!constraint_set_->decide(state).satisfied)
+    return;
+  std::vector<double> values;
+  state.copyJointGroupPositions(jmg_, values);
+  pool_->addSample(key_, values);
+}
+
+}  // end of namespace constraint_samplers
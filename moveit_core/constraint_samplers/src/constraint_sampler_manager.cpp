@@ -36,6 +36,7 @@
 
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
+#include <moveit/constraint_samplers/projection_constraint_sampler.h>
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
 #include <sstream>
 
@@ -44,12 +45,22 @@ constraint_samplers::ConstraintSamplerManager::selectSampler(const planning_scen
                                                              const std::string& group_name,
                                                              const moveit_msgs::Constraints& constr) const
 {
-  for (std::size_t i = 0; i < sampler_alloc_.size(); ++i)
+  ConstraintSamplerPtr sampler;
+  bool allocated = false;
+  for (std::size_t i = 0; i < sampler_alloc_.size() && !allocated; ++i)
     if (sampler_alloc_[i]->canService(scene, group_name, constr))
-      return sampler_alloc_[i]->alloc(scene, group_name, constr);
+    {
+      sampler = sampler_alloc_[i]->alloc(scene, group_name, constr);
+      allocated = true;
+    }
 
   // if no default sampler was used, try a default one
-  return selectDefaultSampler(scene, group_name, constr);
+  if (!allocated)
+    sampler = selectDefaultSampler(scene, group_name, constr);
+
+  if (sampler && sample_pool_)
+    return ConstraintSamplerPtr(new CachedConstraintSampler(sampler, sample_pool_, constr));
+  return sampler;
 }
 
 constraint_samplers::ConstraintSamplerPtr
@@ -341,6 +352,19 @@ constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(const planni
     }
   }
 
+  // without IK, states can still be projected onto the position and orientation constraints
+  if (!constr.position_constraints.empty() || !constr.orientation_constraints.empty())
+  {
+    ProjectionConstraintSamplerPtr sampler(new ProjectionConstraintSampler(scene, jmg->getName()));
+    if (sampler->configure(constr))
+    {
+      ROS_DEBUG_NAMED("constraint_samplers", "Allocated a sampler projecting states onto the position and "
+                                             "orientation constraints for group '%s'",
+                      jmg->getName().c_str());
+      return sampler;
+    }
+  }
+
   // if we've gotten here, just return joint sampler
   if (joint_sampler)
   {
@@ -36,9 +36,11 @@
 
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <set>
+#include <algorithm>
 #include <cassert>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 namespace constraint_samplers
 {
@@ -230,10 +232,44 @@ void IKConstraintSampler::clear()
 {
   ConstraintSampler::clear();
   kb_.reset();
+  batch_solutions_.clear();
   ik_frame_ = "";
   transform_ik_ = false;
   eef_to_ik_tip_transform_ = Eigen::Affine3d::Identity();
   need_eef_to_ik_tip_transform_ = false;
+  reachability_map_.reset();
+  reachability_base_ = NULL;
+}
+
+void IKConstraintSampler::setKinematicsSolver(const kinematics::KinematicsBaseConstPtr& solver)
+{
+  own_kb_ = solver;
+  // the frames of the solver were loaded for the group, so they remain valid
+  if (kb_)
+    kb_ = own_kb_ ? own_kb_ : jmg_->getSolverInstance();
+}
+
+void IKConstraintSampler::setBatchSize(unsigned int batch_size)
+{
+  batch_size_ = std::max(1u, batch_size);
+  batch_solutions_.clear();
+  if (batch_solvers_.size() >= batch_size_)
+    batch_solvers_.resize(batch_size_ - 1);
+
+  // solvers that are shared with the group cannot be used concurrently
+  const robot_model::SolverAllocatorFn& allocator = jmg_->getGroupKinematics().first.allocator_;
+  while (allocator && batch_solvers_.size() + 1 < batch_size_)
+  {
+    kinematics::KinematicsBaseConstPtr solver = allocator(jmg_);
+    if (!solver || solver == jmg_->getSolverInstance() || solver == own_kb_ ||
+        std::find(batch_solvers_.begin(), batch_solvers_.end(), solver) != batch_solvers_.end())
+    {
+      ROS_DEBUG_NAMED("constraint_samplers", "Only %u kinematics solvers are available for batches of group '%s'",
+                      (unsigned int)batch_solvers_.size() + 1, jmg_->getName().c_str());
+      break;
+    }
+    batch_solvers_.push_back(solver);
+  }
 }
 
 bool IKConstraintSampler::configure(const IKSamplingPose& sp)
@@ -266,7 +302,7 @@ bool IKConstraintSampler::configure(const IKSamplingPose& sp)
     frame_depends_.push_back(sampling_pose_.position_constraint_->getReferenceFrame());
   if (sampling_pose_.orientation_constraint_ && sampling_pose_.orientation_constraint_->mobileReferenceFrame())
     frame_depends_.push_back(sampling_pose_.orientation_constraint_->getReferenceFrame());
-  kb_ = jmg_->getSolverInstance();
+  kb_ = own_kb_ ? own_kb_ : jmg_->getSolverInstance();
   if (!kb_)
   {
     ROS_WARN_NAMED("constraint_samplers", "No solver instance in setup");
@@ -274,6 +310,15 @@ bool IKConstraintSampler::configure(const IKSamplingPose& sp)
     return false;
   }
   is_valid_ = loadIKSolver();
+
+  // the reachability map of the group is used if it was computed for the sampled link
+  const robot_model::ReachabilityMapConstPtr& map = jmg_->getReachabilityMap();
+  if (is_valid_ && map && map->getTipLinkName() == getLinkName() &&
+      jmg_->getParentModel().hasLinkModel(map->getBaseLinkName()))
+  {
+    reachability_map_ = map;
+    reachability_base_ = jmg_->getParentModel().getLinkModel(map->getBaseLinkName());
+  }
   return is_valid_;
 }
 
@@ -423,6 +468,34 @@ bool IKConstraintSampler::samplePose(Eigen::Vector3d& pos, Eigen::Quaterniond& q
     return false;
   }
 
+  // with a reachability map, poses the group cannot reach are rejected before IK is called for them
+  for (unsigned int a = 0;; ++a)
+  {
+    if (!sampleCandidatePose(pos, quat, ks, max_attempts))
+      return false;
+    if (!reachability_map_ || isReachable(pos, quat, ks))
+      return true;
+    if (a + 1 >= max_attempts)
+    {
+      if (verbose_)
+        ROS_INFO_NAMED("constraint_samplers", "No sampled pose is in the reachability map of group '%s'",
+                       jmg_->getName().c_str());
+      return false;
+    }
+  }
+}
+
+bool IKConstraintSampler::isReachable(const Eigen::Vector3d& pos, const Eigen::Quaterniond& quat,
+                                      const robot_state::RobotState& ks) const
+{
+  Eigen::Affine3d pose(Eigen::Translation3d(pos) * quat);
+  return reachability_map_->isPoseReachable(ks.getGlobalLinkTransform(reachability_base_).inverse(Eigen::Isometry) *
+                                            pose);
+}
+
+bool IKConstraintSampler::sampleCandidatePose(Eigen::Vector3d& pos, Eigen::Quaterniond& quat,
+                                              const robot_state::RobotState& ks, unsigned int max_attempts)
+{
   if (sampling_pose_.position_constraint_)
   {
     const std::vector<bodies::BodyPtr>& b = sampling_pose_.position_constraint_->getConstraintRegions();
@@ -521,6 +594,72 @@ void samplingIkCallbackFnAdapter(robot_state::RobotState* state, const robot_mod
   else
     error_code.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
 }
+
+struct BatchQuery
+{
+  geometry_msgs::Pose pose;
+  std::vector<double> seed;
+  std::vector<double> solution;
+  bool solved;
+};
+
+void solveBatchQuery(const kinematics::KinematicsBaseConstPtr& solver, BatchQuery* query,
+                     const kinematics::KinematicsBase::IKCallbackFn& adapted_ik_validity_callback, double timeout)
+{
+  moveit_msgs::MoveItErrorCodes error;
+  query->solved =
+      adapted_ik_validity_callback ?
+          solver->searchPositionIK(query->pose, query->seed, timeout, query->solution, adapted_ik_validity_callback,
+                                   error) :
+          solver->searchPositionIK(query->pose, query->seed, timeout, query->solution, error);
+  if (!query->solved && error.val != moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION &&
+      error.val != moveit_msgs::MoveItErrorCodes::INVALID_ROBOT_STATE &&
+      error.val != moveit_msgs::MoveItErrorCodes::TIMED_OUT)
+    ROS_ERROR_NAMED("constraint_samplers", "IK solver failed with error %d", error.val);
+}
+}
+
+bool IKConstraintSampler::sampleIKQuery(geometry_msgs::Pose& ik_query, const robot_state::RobotState& reference_state,
+                                        unsigned int max_attempts)
+{
+  // sample a point in the constraint region
+  Eigen::Vector3d point;
+  Eigen::Quaterniond quat;
+  if (!samplePose(point, quat, reference_state, max_attempts))
+  {
+    if (verbose_)
+      ROS_INFO_NAMED("constraint_samplers", "IK constraint sampler was unable to produce a pose to run IK for");
+    return false;
+  }
+
+  // we now have the transform we wish to perform IK for, in the planning frame
+  if (transform_ik_)
+  {
+    // we need to convert this transform to the frame expected by the IK solver
+    // both the planning frame and the frame for the IK are assumed to be robot links
+    Eigen::Affine3d ikq(Eigen::Translation3d(point) * quat.toRotationMatrix());
+    ikq = reference_state.getFrameTransform(ik_frame_).inverse(Eigen::Isometry) * ikq;
+    point = ikq.translation();
+    quat = Eigen::Quaterniond(ikq.linear());
+  }
+
+  if (need_eef_to_ik_tip_transform_)
+  {
+    // After sampling the pose needs to be transformed to the ik chain tip
+    Eigen::Affine3d ikq(Eigen::Translation3d(point) * quat.toRotationMatrix());
+    ikq = ikq * eef_to_ik_tip_transform_;
+    point = ikq.translation();
+    quat = Eigen::Quaterniond(ikq.linear());
+  }
+
+  ik_query.position.x = point.x();
+  ik_query.position.y = point.y();
+  ik_query.position.z = point.z();
+  ik_query.orientation.x = quat.x();
+  ik_query.orientation.y = quat.y();
+  ik_query.orientation.z = quat.z();
+  ik_query.orientation.w = quat.w();
+  return true;
 }
 
 bool IKConstraintSampler::sample(robot_state::RobotState& state, const robot_state::RobotState& reference_state,
@@ -543,48 +682,94 @@ bool IKConstraintSampler::sampleHelper(robot_state::RobotState& state, const rob
     adapted_ik_validity_callback =
         boost::bind(&samplingIkCallbackFnAdapter, &state, jmg_, group_state_validity_callback_, _1, _2, _3);
 
+  // batches are solved from random seeds, for poses that do not depend on the reference state
+  bool use_batches = !batch_solvers_.empty() && frame_depends_.empty() && !transform_ik_;
+  if (use_batches && !project && useBatchSolution(state))
+    return true;
+
   for (unsigned int a = 0; a < max_attempts; ++a)
   {
-    // sample a point in the constraint region
-    Eigen::Vector3d point;
-    Eigen::Quaterniond quat;
-    if (!samplePose(point, quat, reference_state, max_attempts))
+    if (use_batches && !(project && a == 0))
     {
-      if (verbose_)
-        ROS_INFO_NAMED("constraint_samplers", "IK constraint sampler was unable to produce a pose to run IK for");
-      return false;
+      if (!solveBatch(state, reference_state, max_attempts))
+        return false;
+      if (useBatchSolution(state))
+        return true;
+      continue;
     }
 
-    // we now have the transform we wish to perform IK for, in the planning frame
-    if (transform_ik_)
-    {
-      // we need to convert this transform to the frame expected by the IK solver
-      // both the planning frame and the frame for the IK are assumed to be robot links
-      Eigen::Affine3d ikq(Eigen::Translation3d(point) * quat.toRotationMatrix());
-      ikq = reference_state.getFrameTransform(ik_frame_).inverse(Eigen::Isometry) * ikq;
-      point = ikq.translation();
-      quat = Eigen::Quaterniond(ikq.linear());
-    }
+    geometry_msgs::Pose ik_query;
+    if (!sampleIKQuery(ik_query, reference_state, max_attempts))
+      return false;
+
+    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, state, project && a == 0))
+      return true;
+  }
+  return false;
+}
+
+bool IKConstraintSampler::solveBatch(const robot_state::RobotState& state,
+                                     const robot_state::RobotState& reference_state, unsigned int max_attempts)
+{
+  // the poses and seeds are sampled here, as the random number generator is not thread safe
+  const std::vector<unsigned int>& ik_joint_bijection = jmg_->getKinematicsSolverJointBijection();
+  std::vector<BatchQuery> queries(batch_solvers_.size() + 1);
+  std::vector<double> vals;
+  for (std::size_t q = 0; q < queries.size(); ++q)
+  {
+    if (!sampleIKQuery(queries[q].pose, reference_state, max_attempts))
+      return false;
+    jmg_->getVariableRandomPositions(random_number_generator_, vals);
+    queries[q].seed.resize(ik_joint_bijection.size());
+    for (std::size_t i = 0; i < ik_joint_bijection.size(); ++i)
+      queries[q].seed[i] = vals[ik_joint_bijection[i]];
+  }
 
-    if (need_eef_to_ik_tip_transform_)
+  // each thread passes a state of its own to the group state validity callback
+  std::vector<robot_state::RobotState> work_states(queries.size(), state);
+  boost::thread_group threads;
+  for (std::size_t q = 0; q < queries.size(); ++q)
+  {
+    kinematics::KinematicsBase::IKCallbackFn adapted_ik_validity_callback;
+    if (group_state_validity_callback_)
+      adapted_ik_validity_callback = boost::bind(&samplingIkCallbackFnAdapter, &work_states[q], jmg_,
+                                                 group_state_validity_callback_, _1, _2, _3);
+    const kinematics::KinematicsBaseConstPtr& solver = q == 0 ? kb_ : batch_solvers_[q - 1];
+    if (q + 1 == queries.size())
+      solveBatchQuery(solver, &queries[q], adapted_ik_validity_callback, ik_timeout_);
+    else
+      threads.create_thread(
+          boost::bind(&solveBatchQuery, solver, &queries[q], adapted_ik_validity_callback, ik_timeout_));
+  }
+  threads.join_all();
+
+  for (std::size_t q = 0; q < queries.size(); ++q)
+    if (queries[q].solved)
     {
-      // After sampling the pose needs to be transformed to the ik chain tip
-      Eigen::Affine3d ikq(Eigen::Translation3d(point) * quat.toRotationMatrix());
-      ikq = ikq * eef_to_ik_tip_transform_;
-      point = ikq.translation();
-      quat = Eigen::Quaterniond(ikq.linear());
+      assert(queries[q].solution.size() == ik_joint_bijection.size());
+      std::vector<double> solution(ik_joint_bijection.size());
+      for (std::size_t i = 0; i < ik_joint_bijection.size(); ++i)
+        solution[ik_joint_bijection[i]] = queries[q].solution[i];
+      batch_solutions_.push_back(solution);
     }
+  if (verbose_)
+    ROS_INFO_NAMED("constraint_samplers", "IK found %u solutions for a batch of %u poses",
+                   (unsigned int)batch_solutions_.size(), (unsigned int)queries.size());
+  return true;
+}
 
-    geometry_msgs::Pose ik_query;
-    ik_query.position.x = point.x();
-    ik_query.position.y = point.y();
-    ik_query.position.z = point.z();
-    ik_query.orientation.x = quat.x();
-    ik_query.orientation.y = quat.y();
-    ik_query.orientation.z = quat.z();
-    ik_query.orientation.w = quat.w();
-
-    if (callIK(ik_query, adapted_ik_validity_callback, ik_timeout_, state, project && a == 0))
+bool IKConstraintSampler::useBatchSolution(robot_state::RobotState& state)
+{
+  while (!batch_solutions_.empty())
+  {
+    std::vector<double> solution;
+    solution.swap(batch_solutions_.back());
+    batch_solutions_.pop_back();
+    // the state of the other groups may have changed since the batch was solved
+    if (group_state_validity_callback_ && !group_state_validity_callback_(&state, jmg_, &solution[0]))
+      continue;
+    state.setJointGroupPositions(jmg_, solution);
+    if (validate(state))
       return true;
   }
   return false;
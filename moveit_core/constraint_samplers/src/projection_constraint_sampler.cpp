@@ -0,0 +1,309 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/constraint_samplers/projection_constraint_sampler.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+
+namespace constraint_samplers
+{
+namespace
+{
+// keeps the steps bounded close to singular configurations
+const double DAMPING = 1e-3;
+}
+
+const unsigned int ProjectionConstraintSampler::DEFAULT_MAX_ITERATIONS;
+
+ProjectionConstraintSampler::ProjectionConstraintSampler(const planning_scene::PlanningSceneConstPtr& scene,
+                                                         const std::string& group_name)
+  : ConstraintSampler(scene, group_name), max_iterations_(DEFAULT_MAX_ITERATIONS), max_step_(0.3)
+{
+}
+
+bool ProjectionConstraintSampler::configure(const moveit_msgs::Constraints& constr)
+{
+  clear();
+
+  if (!jmg_)
+  {
+    ROS_ERROR_NAMED("constraint_samplers", "NULL group specified for constraint sampler");
+    return false;
+  }
+  if (!jmg_->isChain())
+  {
+    ROS_DEBUG_NAMED("constraint_samplers", "Group '%s' is not a chain; states cannot be projected onto constraints",
+                    jmg_->getName().c_str());
+    return false;
+  }
+
+  // the joint constraints on the same variable are intersected
+  std::map<std::string, JointBounds> bound_data;
+  for (std::size_t i = 0; i < constr.joint_constraints.size(); ++i)
+  {
+    kinematic_constraints::JointConstraint jc(scene_->getRobotModel());
+    if (!jc.configure(constr.joint_constraints[i]) || !jmg_->hasJointModel(jc.getJointModel()->getName()))
+      continue;
+    const std::string& variable = jc.getJointVariableName();
+    std::map<std::string, JointBounds>::iterator it = bound_data.find(variable);
+    if (it == bound_data.end())
+    {
+      const robot_model::VariableBounds& joint_bounds = jc.getJointModel()->getVariableBounds(variable);
+      JointBounds b;
+      b.index_ = jmg_->getVariableGroupIndex(variable);
+      b.min_bound_ = joint_bounds.min_position_;
+      b.max_bound_ = joint_bounds.max_position_;
+      it = bound_data.insert(std::make_pair(variable, b)).first;
+    }
+    it->second.min_bound_ =
+        std::max(it->second.min_bound_, jc.getDesiredJointPosition() - jc.getJointToleranceBelow());
+    it->second.max_bound_ =
+        std::min(it->second.max_bound_, jc.getDesiredJointPosition() + jc.getJointToleranceAbove());
+    if (it->second.min_bound_ > it->second.max_bound_ + std::numeric_limits<double>::epsilon())
+    {
+      ROS_ERROR_NAMED("constraint_samplers", "The constraints for joint '%s' are such that there are no possible "
+                                             "values for the joint: min_bound: %g, max_bound: %g. Failing.",
+                      variable.c_str(), it->second.min_bound_, it->second.max_bound_);
+      clear();
+      return false;
+    }
+  }
+  for (std::map<std::string, JointBounds>::iterator it = bound_data.begin(); it != bound_data.end(); ++it)
+    bounds_.push_back(it->second);
+
+  // only the links moved by the group have a Jacobian
+  for (std::size_t i = 0; i < constr.position_constraints.size(); ++i)
+  {
+    kinematic_constraints::PositionConstraintPtr pc(
+        new kinematic_constraints::PositionConstraint(scene_->getRobotModel()));
+    if (!pc->configure(constr.position_constraints[i], scene_->getTransforms()) ||
+        !jmg_->isLinkUpdated(pc->getLinkModel()->getName()))
+      continue;
+    if (pc->mobileReferenceFrame())
+      frame_depends_.push_back(pc->getReferenceFrame());
+    position_constraints_.push_back(pc);
+  }
+  for (std::size_t i = 0; i < constr.orientation_constraints.size(); ++i)
+  {
+    kinematic_constraints::OrientationConstraintPtr oc(
+        new kinematic_constraints::OrientationConstraint(scene_->getRobotModel()));
+    if (!oc->configure(constr.orientation_constraints[i], scene_->getTransforms()) ||
+        !jmg_->isLinkUpdated(oc->getLinkModel()->getName()))
+      continue;
+    if (oc->mobileReferenceFrame())
+      frame_depends_.push_back(oc->getReferenceFrame());
+    orientation_constraints_.push_back(oc);
+  }
+
+  if (position_constraints_.empty() && orientation_constraints_.empty())
+  {
+    ROS_DEBUG_NAMED("constraint_samplers", "No position or orientation constraints on links of group '%s'",
+                    jmg_->getName().c_str());
+    clear();
+    return false;
+  }
+
+  values_.resize(jmg_->getVariableCount());
+  is_valid_ = true;
+  return true;
+}
+
+void ProjectionConstraintSampler::sampleGroupState()
+{
+  jmg_->getVariableRandomPositions(random_number_generator_, values_);
+  for (std::size_t i = 0; i < bounds_.size(); ++i)
+    values_[bounds_[i].index_] = random_number_generator_.uniformReal(bounds_[i].min_bound_, bounds_[i].max_bound_);
+}
+
+bool ProjectionConstraintSampler::projectGroupState(robot_state::RobotState& state)
+{
+  // the Jacobians are expressed in the frame of the link the group is attached to
+  const robot_model::LinkModel* root_link = jmg_->getJointModels()[0]->getParentLinkModel();
+  Eigen::MatrixXd jacobian(3 * getProjectedConstraintCount(), values_.size());
+  Eigen::VectorXd error(jacobian.rows());
+  Eigen::MatrixXd link_jacobian;
+
+  for (unsigned int iteration = 0;; ++iteration)
+  {
+    state.setJointGroupPositions(jmg_, values_);
+    state.enforceBounds(jmg_);
+    state.updateLinkTransforms();
+    Eigen::Matrix3d to_root = Eigen::Matrix3d::Identity();
+    if (root_link)
+      to_root = state.getGlobalLinkTransform(root_link).linear().transpose();
+
+    // only the violated constraints contribute rows, so the satisfied ones are free to move within their bounds
+    std::size_t rows = 0;
+    for (std::size_t i = 0; i < position_constraints_.size(); ++i)
+    {
+      const kinematic_constraints::PositionConstraint& pc = *position_constraints_[i];
+      if (pc.decide(state).satisfied)
+        continue;
+      Eigen::Vector3d point = state.getGlobalLinkTransform(pc.getLinkModel()) * pc.getLinkOffset();
+
+      // the point is moved towards the closest region; the projection stops as soon as it is inside
+      Eigen::Vector3d target = point;
+      double min_distance = std::numeric_limits<double>::infinity();
+      for (std::size_t j = 0; j < pc.getConstraintRegions().size(); ++j)
+      {
+        Eigen::Vector3d center = pc.getConstraintRegions()[j]->getPose().translation();
+        if (pc.mobileReferenceFrame())
+          center = state.getFrameTransform(pc.getReferenceFrame()) * center;
+        double distance = (center - point).squaredNorm();
+        if (distance < min_distance)
+        {
+          min_distance = distance;
+          target = center;
+        }
+      }
+      if (!state.getJacobian(jmg_, pc.getLinkModel(), pc.getLinkOffset(), link_jacobian))
+        return false;
+      jacobian.middleRows(rows, 3) = link_jacobian.topRows(3);
+      error.segment<3>(rows) = to_root * (target - point);
+      rows += 3;
+    }
+    for (std::size_t i = 0; i < orientation_constraints_.size(); ++i)
+    {
+      const kinematic_constraints::OrientationConstraint& oc = *orientation_constraints_[i];
+      if (oc.decide(state).satisfied)
+        continue;
+      Eigen::Matrix3d desired = oc.getDesiredRotationMatrix();
+      if (oc.mobileReferenceFrame())
+        desired = state.getFrameTransform(oc.getReferenceFrame()).linear() * desired;
+      Eigen::AngleAxisd rotation(desired * state.getGlobalLinkTransform(oc.getLinkModel()).linear().transpose());
+      if (!state.getJacobian(jmg_, oc.getLinkModel(), Eigen::Vector3d::Zero(), link_jacobian))
+        return false;
+      jacobian.middleRows(rows, 3) = link_jacobian.bottomRows(3);
+      error.segment<3>(rows) = to_root * (rotation.angle() * rotation.axis());
+      rows += 3;
+    }
+
+    state.copyJointGroupPositions(jmg_, values_);
+    if (rows == 0)
+      return !group_state_validity_callback_ || group_state_validity_callback_(&state, jmg_, &values_[0]);
+    if (iteration >= max_iterations_)
+      return false;
+
+    // damped least squares step, limited in length so that the linearization stays meaningful
+    Eigen::MatrixXd j = jacobian.topRows(rows);
+    Eigen::MatrixXd jjt = j * j.transpose();
+    jjt.diagonal().array() += DAMPING * DAMPING;
+    Eigen::VectorXd step = j.transpose() * jjt.ldlt().solve(error.head(rows));
+    double norm = step.norm();
+    if (norm > max_step_)
+      step *= max_step_ / norm;
+    for (std::size_t k = 0; k < values_.size(); ++k)
+      values_[k] += step(k);
+    for (std::size_t k = 0; k < bounds_.size(); ++k)
+      values_[bounds_[k].index_] =
+          std::min(std::max(values_[bounds_[k].index_], bounds_[k].min_bound_), bounds_[k].max_bound_);
+  }
+}
+
+bool ProjectionConstraintSampler::sample(robot_state::RobotState& state,
+                                         const robot_state::RobotState& /* reference_state */,
+                                         unsigned int max_attempts)
+{
+  if (!is_valid_)
+  {
+    ROS_WARN_NAMED("constraint_samplers", "ProjectionConstraintSampler not configured, won't sample");
+    return false;
+  }
+
+  for (unsigned int a = 0; a < max_attempts; ++a)
+  {
+    sampleGroupState();
+    if (projectGroupState(state))
+      return true;
+  }
+  if (verbose_)
+    ROS_INFO_NAMED("constraint_samplers", "No state of group '%s' was projected onto the constraints in %u attempts",
+                   jmg_->getName().c_str(), max_attempts);
+  return false;
+}
+
+bool ProjectionConstraintSampler::project(robot_state::RobotState& state, unsigned int max_attempts)
+{
+  if (!is_valid_)
+  {
+    ROS_WARN_NAMED("constraint_samplers", "ProjectionConstraintSampler not configured, won't project");
+    return false;
+  }
+
+  state.copyJointGroupPositions(jmg_, values_);
+  for (std::size_t k = 0; k < bounds_.size(); ++k)
+    values_[bounds_[k].index_] =
+        std::min(std::max(values_[bounds_[k].index_], bounds_[k].min_bound_), bounds_[k].max_bound_);
+  if (projectGroupState(state))
+    return true;
+  return max_attempts > 1 && sample(state, state, max_attempts - 1);
+}
+
+void ProjectionConstraintSampler::clear()
+{
+  ConstraintSampler::clear();
+  bounds_.clear();
+  position_constraints_.clear();
+  orientation_constraints_.clear();
+  values_.clear();
+}
+
+ConstraintSamplerPtr ProjectionConstraintSamplerAllocator::alloc(const planning_scene::PlanningSceneConstPtr& scene,
+                                                                 const std::string& group_name,
+                                                                 const moveit_msgs::Constraints& constr)
+{
+  ProjectionConstraintSamplerPtr sampler(new ProjectionConstraintSampler(scene, group_name));
+  if (sampler->configure(constr))
+    return sampler;
+  return ConstraintSamplerPtr();
+}
+
+bool ProjectionConstraintSamplerAllocator::canService(const planning_scene::PlanningSceneConstPtr& scene,
+                                                      const std::string& group_name,
+                                                      const moveit_msgs::Constraints& constr) const
+{
+  const robot_model::JointModelGroup* jmg = scene->getRobotModel()->getJointModelGroup(group_name);
+  if (!jmg || !jmg->isChain())
+    return false;
+  for (std::size_t i = 0; i < constr.position_constraints.size(); ++i)
+    if (jmg->isLinkUpdated(constr.position_constraints[i].link_name))
+      return true;
+  for (std::size_t i = 0; i < constr.orientation_constraints.size(); ++i)
+    if (jmg->isLinkUpdated(constr.orientation_constraints[i].link_name))
+      return true;
+  return false;
+}
+
+}  // end of namespace constraint_samplers
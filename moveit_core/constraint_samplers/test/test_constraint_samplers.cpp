@@ -38,6 +38,7 @@
 #include <moveit/kinematic_constraints/kinematic_constraint.h>
 #include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <moveit/constraint_samplers/projection_constraint_sampler.h>
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/constraint_samplers/constraint_sampler_tools.h>
 #include <moveit_msgs/DisplayTrajectory.h>
@@ -457,6 +458,18 @@ TEST_F(LoadPlanningModelsPr2, IKConstraintsSamplerValid)
     EXPECT_TRUE(iks3.sample(ks, ks_const, 100));
     EXPECT_TRUE(oc.decide(ks).satisfied);
   }
+
+  // the solver of the group is shared, so batches fall back to solving one pose at a time
+  constraint_samplers::IKConstraintSampler iks4(ps, "left_arm");
+  iks4.setBatchSize(4);
+  EXPECT_EQ(iks4.getBatchSize(), 4u);
+  EXPECT_TRUE(iks4.configure(constraint_samplers::IKSamplingPose(pc, oc)));
+  for (int t = 0; t < 100; ++t)
+  {
+    EXPECT_TRUE(iks4.sample(ks, ks_const, 100));
+    EXPECT_TRUE(pc.decide(ks).satisfied);
+    EXPECT_TRUE(oc.decide(ks).satisfied);
+  }
 }
 
 TEST_F(LoadPlanningModelsPr2, UnionConstraintSampler)
@@ -1133,6 +1146,265 @@ TEST_F(LoadPlanningModelsPr2, SubgroupPoseConstraintsSampler)
                  (double)succ / (double)NT);
 }
 
+TEST_F(LoadPlanningModelsPr2, ComputeIKBatch)
+{
+  const robot_model::JointModelGroup* jmg = kmodel->getJointModelGroup("right_arm");
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+
+  // poses reached by random states of the arm are reachable
+  static const int NT = 20;
+  EigenSTL::vector_Affine3d poses;
+  robot_state::RobotState sample(kmodel);
+  sample.setToDefaultValues();
+  for (int t = 0; t < NT; ++t)
+  {
+    sample.setToRandomPositions(jmg);
+    sample.update();
+    poses.push_back(sample.getGlobalLinkTransform("r_wrist_roll_link"));
+  }
+
+  std::vector<std::vector<double> > solutions;
+  std::size_t solved = ks.computeIKBatch(jmg, poses, "r_wrist_roll_link", solutions, 0.1);
+  ASSERT_EQ(poses.size(), solutions.size());
+  EXPECT_GT(solved, 0u);
+
+  std::size_t found = 0;
+  for (std::size_t i = 0; i < solutions.size(); ++i)
+  {
+    if (solutions[i].empty())
+      continue;
+    ++found;
+    sample.setJointGroupPositions(jmg, solutions[i]);
+    sample.update();
+    EXPECT_TRUE(sample.getGlobalLinkTransform("r_wrist_roll_link").isApprox(poses[i], 1e-3));
+  }
+  EXPECT_EQ(solved, found);
+}
+
+TEST_F(LoadPlanningModelsPr2, ComputeCartesianPathAdaptive)
+{
+  const robot_model::JointModelGroup* jmg = kmodel->getJointModelGroup("right_arm");
+  const robot_model::LinkModel* link = kmodel->getLinkModel("r_wrist_roll_link");
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  std::vector<double> seed = { -0.3, 0.2, 0.0, -1.2, 0.0, -0.8, 0.0 };
+  ks.setJointGroupPositions(jmg, seed);
+  ks.update();
+  Eigen::Affine3d target = ks.getGlobalLinkTransform(link);
+  target.translation().x() += 0.05;
+
+  robot_state::RobotState fixed_state(ks);
+  std::vector<robot_state::RobotStatePtr> fixed_traj;
+  double fixed_fraction = fixed_state.computeCartesianPath(jmg, fixed_traj, link, target, true,
+                                                           robot_state::MaxEEFStep(0.002), robot_state::JumpThreshold());
+  EXPECT_NEAR(1.0, fixed_fraction, 1e-6);
+
+  // the well-conditioned straight line is covered with the largest steps
+  robot_state::AdaptiveEEFStep step(robot_state::MaxEEFStep(0.02), robot_state::MaxEEFStep(0.002), 0.5);
+  robot_state::RobotState adaptive_state(ks);
+  std::vector<robot_state::RobotStatePtr> traj;
+  double fraction = adaptive_state.computeCartesianPath(jmg, traj, link, target, true, step);
+  EXPECT_NEAR(1.0, fraction, 1e-6);
+  EXPECT_LT(traj.size(), fixed_traj.size());
+  EXPECT_TRUE(traj.back()->getGlobalLinkTransform(link).isApprox(target, 1e-3));
+  for (std::size_t i = 1; i < traj.size(); ++i)
+    EXPECT_LE(traj[i]->distance(*traj[i - 1], jmg), 0.5);
+
+  // the path stops before the first segment that is not valid
+  const double limit = ks.getGlobalLinkTransform(link).translation().x() + 0.025;
+  robot_state::SegmentValidityCallbackFn segment_validity = [link, limit](const robot_state::RobotState& from,
+                                                                           const robot_state::RobotState& to) {
+    return to.getGlobalLinkTransform(link).translation().x() <= limit + 1e-6;
+  };
+  adaptive_state = ks;
+  fraction = adaptive_state.computeCartesianPath(jmg, traj, link, target, true, step,
+                                                 robot_state::GroupStateValidityCallbackFn(), segment_validity, 2);
+  EXPECT_GT(fraction, 0.0);
+  EXPECT_LE(fraction, 0.5 + 1e-6);
+  EXPECT_LE(adaptive_state.getGlobalLinkTransform(link).translation().x(), limit + 1e-6);
+}
+
+TEST(ConstraintSamplePool, LeastRecentlyUsed)
+{
+  constraint_samplers::ConstraintSamplePool pool(2, 2);
+  std::vector<std::vector<double> > samples;
+
+  moveit_msgs::Constraints con;
+  con.position_constraints.resize(1);
+  con.position_constraints[0].header.stamp = ros::Time(1.0);
+  std::string key = constraint_samplers::ConstraintSamplePool::getKey("left_arm", con);
+  // stamps are ignored, but groups are not
+  con.position_constraints[0].header.stamp = ros::Time(2.0);
+  EXPECT_EQ(key, constraint_samplers::ConstraintSamplePool::getKey("left_arm", con));
+  EXPECT_NE(key, constraint_samplers::ConstraintSamplePool::getKey("right_arm", con));
+
+  pool.addSample("a", std::vector<double>(1, 1.0));
+  pool.addSample("a", std::vector<double>(1, 2.0));
+  pool.addSample("a", std::vector<double>(1, 3.0));
+  pool.getSamples("a", samples);
+  ASSERT_EQ(samples.size(), 2u);
+  EXPECT_EQ(samples[0][0], 3.0);
+  EXPECT_EQ(samples[1][0], 2.0);
+
+  // "a" was used more recently than "b", so "b" is discarded for "c"
+  pool.addSample("b", std::vector<double>(1, 4.0));
+  pool.getSamples("a", samples);
+  pool.addSample("c", std::vector<double>(1, 5.0));
+  pool.getSamples("b", samples);
+  EXPECT_TRUE(samples.empty());
+  pool.getSamples("a", samples);
+  EXPECT_EQ(samples.size(), 2u);
+  pool.getSamples("c", samples);
+  EXPECT_EQ(samples.size(), 1u);
+
+  pool.clear();
+  pool.getSamples("a", samples);
+  EXPECT_TRUE(samples.empty());
+}
+
+TEST_F(LoadPlanningModelsPr2, CachedConstraintSamplerManager)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+
+  moveit_msgs::Constraints con;
+  con.joint_constraints.resize(1);
+  con.joint_constraints[0].joint_name = "l_shoulder_pan_joint";
+  con.joint_constraints[0].position = 0.54;
+  con.joint_constraints[0].tolerance_above = 0.01;
+  con.joint_constraints[0].tolerance_below = 0.01;
+  con.joint_constraints[0].weight = 1.0;
+
+  kinematic_constraints::KinematicConstraintSet kset(kmodel);
+  kset.add(con, ps->getTransforms());
+
+  constraint_samplers::ConstraintSamplerManager csm;
+  csm.setSamplePool(constraint_samplers::ConstraintSamplePoolPtr(new constraint_samplers::ConstraintSamplePool(4, 8)));
+
+  constraint_samplers::ConstraintSamplerPtr s = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(static_cast<bool>(s));
+  constraint_samplers::CachedConstraintSampler* ccs =
+      dynamic_cast<constraint_samplers::CachedConstraintSampler*>(s.get());
+  ASSERT_TRUE(ccs != nullptr);
+  EXPECT_TRUE(dynamic_cast<constraint_samplers::JointConstraintSampler*>(ccs->getSampler().get()) != nullptr);
+  EXPECT_EQ(ccs->getCachedSampleCount(), 0u);
+  for (int t = 0; t < 3; ++t)
+  {
+    EXPECT_TRUE(s->sample(ks, ks, 1));
+    EXPECT_TRUE(kset.decide(ks).satisfied);
+  }
+
+  // a new sampler for the same constraints reuses the samples, as long as they are valid
+  s = csm.selectSampler(ps, "left_arm", con);
+  ccs = dynamic_cast<constraint_samplers::CachedConstraintSampler*>(s.get());
+  ASSERT_TRUE(ccs != nullptr);
+  EXPECT_EQ(ccs->getCachedSampleCount(), 3u);
+  EXPECT_TRUE(s->sample(ks, ks, 1));
+  EXPECT_TRUE(kset.decide(ks).satisfied);
+  EXPECT_EQ(ccs->getCachedSampleCount(), 2u);
+
+  // kept samples that are no longer valid are skipped, and new ones are sampled
+  s->setGroupStateValidityCallback(
+      [](robot_state::RobotState*, const robot_model::JointModelGroup*, const double*) { return false; });
+  EXPECT_TRUE(s->sample(ks, ks, 1));
+  EXPECT_EQ(ccs->getCachedSampleCount(), 0u);
+
+  // other constraints have samples of their own
+  con.joint_constraints[0].position = 0.2;
+  s = csm.selectSampler(ps, "left_arm", con);
+  ccs = dynamic_cast<constraint_samplers::CachedConstraintSampler*>(s.get());
+  ASSERT_TRUE(ccs != nullptr);
+  EXPECT_EQ(ccs->getCachedSampleCount(), 0u);
+}
+
+TEST_F(LoadPlanningModelsPr2, ProjectionConstraintSampler)
+{
+  robot_state::RobotState ks(kmodel);
+  ks.setToDefaultValues();
+  ks.update();
+
+  moveit_msgs::Constraints con;
+  con.orientation_constraints.resize(1);
+  con.orientation_constraints[0].link_name = "l_wrist_roll_link";
+  con.orientation_constraints[0].header.frame_id = kmodel->getModelFrame();
+  con.orientation_constraints[0].orientation.w = 1.0;
+  con.orientation_constraints[0].absolute_x_axis_tolerance = 0.01;
+  con.orientation_constraints[0].absolute_y_axis_tolerance = 0.01;
+  con.orientation_constraints[0].absolute_z_axis_tolerance = 0.01;
+  con.orientation_constraints[0].weight = 1.0;
+  con.joint_constraints.resize(1);
+  con.joint_constraints[0].joint_name = "l_shoulder_pan_joint";
+  con.joint_constraints[0].position = 0.54;
+  con.joint_constraints[0].tolerance_above = 0.1;
+  con.joint_constraints[0].tolerance_below = 0.1;
+  con.joint_constraints[0].weight = 1.0;
+
+  kinematic_constraints::KinematicConstraintSet kset(kmodel);
+  kset.add(con, ps->getTransforms());
+
+  // the group needs to be a chain that moves the constrained link
+  constraint_samplers::ProjectionConstraintSampler bad_group(ps, "arms");
+  EXPECT_FALSE(bad_group.configure(con));
+  constraint_samplers::ProjectionConstraintSampler bad_link(ps, "right_arm");
+  EXPECT_FALSE(bad_link.configure(con));
+
+  constraint_samplers::ProjectionConstraintSampler pcs(ps, "left_arm");
+  ASSERT_TRUE(pcs.configure(con));
+  EXPECT_EQ(1u, pcs.getProjectedConstraintCount());
+  unsigned int succeeded = 0;
+  for (int t = 0; t < 20; ++t)
+    if (pcs.sample(ks, ks, 5))
+    {
+      EXPECT_TRUE(kset.decide(ks).satisfied);
+      ++succeeded;
+    }
+  EXPECT_GT(succeeded, 10u);
+
+  // projection starts from the given state, which already satisfies the constraints
+  ASSERT_TRUE(pcs.sample(ks, ks, 20));
+  std::vector<double> before;
+  ks.copyJointGroupPositions("left_arm", before);
+  EXPECT_TRUE(pcs.project(ks, 1));
+  std::vector<double> after;
+  ks.copyJointGroupPositions("left_arm", after);
+  for (std::size_t i = 0; i < before.size(); ++i)
+    EXPECT_NEAR(before[i], after[i], 1e-9);
+
+  // constraints on links other than the IK tip have no IK sampler, but can be projected onto
+  moveit_msgs::Constraints elbow;
+  elbow.position_constraints.resize(1);
+  elbow.position_constraints[0].link_name = "l_elbow_flex_link";
+  elbow.position_constraints[0].header.frame_id = kmodel->getModelFrame();
+  elbow.position_constraints[0].constraint_region.primitives.resize(1);
+  elbow.position_constraints[0].constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  elbow.position_constraints[0].constraint_region.primitives[0].dimensions.resize(1);
+  elbow.position_constraints[0].constraint_region.primitives[0].dimensions[0] = 0.05;
+  elbow.position_constraints[0].constraint_region.primitive_poses.resize(1);
+  elbow.position_constraints[0].constraint_region.primitive_poses[0].position.x = 0.3;
+  elbow.position_constraints[0].constraint_region.primitive_poses[0].position.y = 0.4;
+  elbow.position_constraints[0].constraint_region.primitive_poses[0].position.z = 0.9;
+  elbow.position_constraints[0].constraint_region.primitive_poses[0].orientation.w = 1.0;
+  elbow.position_constraints[0].weight = 1.0;
+
+  constraint_samplers::ConstraintSamplerPtr s =
+      constraint_samplers::ConstraintSamplerManager::selectDefaultSampler(ps, "left_arm", elbow);
+  ASSERT_TRUE(static_cast<bool>(s));
+  EXPECT_TRUE(dynamic_cast<constraint_samplers::ProjectionConstraintSampler*>(s.get()) != nullptr);
+
+  // registering the allocator prefers projection over IK
+  constraint_samplers::ConstraintSamplerManager csm;
+  csm.registerSamplerAllocator(constraint_samplers::ConstraintSamplerAllocatorPtr(
+      new constraint_samplers::ProjectionConstraintSamplerAllocator()));
+  s = csm.selectSampler(ps, "left_arm", con);
+  ASSERT_TRUE(static_cast<bool>(s));
+  EXPECT_TRUE(dynamic_cast<constraint_samplers::ProjectionConstraintSampler*>(s.get()) != nullptr);
+  s = csm.selectSampler(ps, "arms", con);
+  EXPECT_TRUE(dynamic_cast<constraint_samplers::ProjectionConstraintSampler*>(s.get()) == nullptr);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
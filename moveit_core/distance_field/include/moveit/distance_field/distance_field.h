@@ -179,12 +179,14 @@ public:
    *
    * This function uses the Body class in the geometric_shapes package
    * to determine the set of obstacle points, with the exception of
-   * OcTrees as mentioned.  A bounding sphere is computed given the
-   * shape; the bounding sphere is iterated through in 3D at the
+   * OcTrees as mentioned and meshes.  A bounding sphere is computed given
+   * the shape; the bounding sphere is iterated through in 3D at the
    * resolution of the distance_field, with each point tested for
-   * point inclusion.  For more information about the behavior of
-   * bodies and poses please see the documentation for
-   * geometric_shapes.
+   * point inclusion.  Meshes are filled column by column between the
+   * crossings with their triangles instead, see \ref findInternalPointsMesh.
+   * Large shapes are discretized on several threads.  For more
+   * information about the behavior of bodies and poses please see the
+   * documentation for geometric_shapes.
    *
    * @param [in] shape The shape to add to the distance field
    * @param [in] pose The pose of the shape
@@ -323,6 +325,26 @@ public:
    */
   double getDistanceGradient(double x, double y, double z, double& gradient_x, double& gradient_y, double& gradient_z,
                              bool& in_bounds) const;
+
+  /**
+   * \brief Gets the distances and gradients at many locations at once.
+   * Without interpolation, the results are those of \ref
+   * getDistanceGradient for each location.  With interpolation, the
+   * distance is interpolated trilinearly between the eight cells
+   * around the location and the gradient is the gradient of that
+   * interpolation, so both change continuously as the location
+   * moves; a location is then in bounds if all eight cells are.
+   *
+   * @param [in] points The locations to query
+   * @param [out] distances The distance for each location
+   * @param [out] gradients The gradient for each location, zero if it is out of bounds
+   * @param [out] in_bounds Whether each location is valid for gradient purposes
+   * @param [in] interpolate Whether to interpolate trilinearly
+   */
+  virtual void getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                                    EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds,
+                                    bool interpolate = false) const;
+
   /**
    * \brief Gets the distance to the closest obstacle at the given
    * integer cell location. The particulars of this function are
@@ -615,6 +637,16 @@ protected:
   void setPoint(int xCell, int yCell, int zCell, double dist, geometry_msgs::Point& point, std_msgs::ColorRGBA& color,
                 double max_distance) const;
 
+  /**
+   * \brief Implementation of \ref getDistanceGradients that reads the
+   * distance of the cell at integer indices with \e cell_distance, so
+   * that derived classes can look up cells without virtual calls.
+   */
+  template <typename CellDistance>
+  void getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                            EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds, bool interpolate,
+                            const CellDistance& cell_distance) const;
+
   double size_x_;            /**< \brief X size of the distance field */
   double size_y_;            /**< \brief Y size of the distance field */
   double size_z_;            /**< \brief Z size of the distance field */
@@ -622,9 +654,84 @@ protected:
   double origin_y_;          /**< \brief Y origin of the distance field */
   double origin_z_;          /**< \brief Z origin of the distance field */
   double resolution_;        /**< \brief Resolution of the distance field */
-  int inv_twice_resolution_; /**< \brief Computed value 1.0/(2.0*resolution_) */
+  double inv_twice_resolution_; /**< \brief Computed value 1.0/(2.0*resolution_) */
 };
 
+template <typename CellDistance>
+void DistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                                         EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds,
+                                         bool interpolate, const CellDistance& cell_distance) const
+{
+  distances.resize(points.size());
+  gradients.resize(points.size());
+  in_bounds.resize(points.size());
+  const int num_x = getXNumCells();
+  const int num_y = getYNumCells();
+  const int num_z = getZNumCells();
+  const double inv_resolution = 1.0 / resolution_;
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    if (!interpolate)
+    {
+      // the nearest cell, rounded like VoxelGrid::getCellFromLocation()
+      int gx = static_cast<int>(floor((points[i].x() - (origin_x_ - 0.5 * resolution_)) * inv_resolution));
+      int gy = static_cast<int>(floor((points[i].y() - (origin_y_ - 0.5 * resolution_)) * inv_resolution));
+      int gz = static_cast<int>(floor((points[i].z() - (origin_z_ - 0.5 * resolution_)) * inv_resolution));
+      in_bounds[i] = gx >= 1 && gy >= 1 && gz >= 1 && gx < num_x - 1 && gy < num_y - 1 && gz < num_z - 1;
+      if (!in_bounds[i])
+      {
+        gradients[i].setZero();
+        distances[i] = getUninitializedDistance();
+        continue;
+      }
+      gradients[i].x() = (cell_distance(gx + 1, gy, gz) - cell_distance(gx - 1, gy, gz)) * inv_twice_resolution_;
+      gradients[i].y() = (cell_distance(gx, gy + 1, gz) - cell_distance(gx, gy - 1, gz)) * inv_twice_resolution_;
+      gradients[i].z() = (cell_distance(gx, gy, gz + 1) - cell_distance(gx, gy, gz - 1)) * inv_twice_resolution_;
+      distances[i] = cell_distance(gx, gy, gz);
+      continue;
+    }
+
+    // the location in cells; cell centers are at integer values
+    double fx = (points[i].x() - origin_x_) * inv_resolution;
+    double fy = (points[i].y() - origin_y_) * inv_resolution;
+    double fz = (points[i].z() - origin_z_) * inv_resolution;
+    int gx = static_cast<int>(floor(fx));
+    int gy = static_cast<int>(floor(fy));
+    int gz = static_cast<int>(floor(fz));
+    in_bounds[i] = gx >= 0 && gy >= 0 && gz >= 0 && gx < num_x - 1 && gy < num_y - 1 && gz < num_z - 1;
+    if (!in_bounds[i])
+    {
+      gradients[i].setZero();
+      distances[i] = getUninitializedDistance();
+      continue;
+    }
+    double tx = fx - gx;
+    double ty = fy - gy;
+    double tz = fz - gz;
+
+    // interpolate along z, then y, then x, keeping the differences for the gradient
+    double d_z[2][2], d_dz[2][2];
+    for (int a = 0; a < 2; ++a)
+      for (int b = 0; b < 2; ++b)
+      {
+        double d0 = cell_distance(gx + a, gy + b, gz);
+        double d1 = cell_distance(gx + a, gy + b, gz + 1);
+        d_z[a][b] = d0 + tz * (d1 - d0);
+        d_dz[a][b] = d1 - d0;
+      }
+    double d_yz[2], d_dyz[2];
+    for (int a = 0; a < 2; ++a)
+    {
+      d_yz[a] = d_z[a][0] + ty * (d_z[a][1] - d_z[a][0]);
+      d_dyz[a] = d_dz[a][0] + ty * (d_dz[a][1] - d_dz[a][0]);
+    }
+    distances[i] = d_yz[0] + tx * (d_yz[1] - d_yz[0]);
+    gradients[i].x() = (d_yz[1] - d_yz[0]) * inv_resolution;
+    gradients[i].y() = ((1.0 - tx) * (d_z[0][1] - d_z[0][0]) + tx * (d_z[1][1] - d_z[1][0])) * inv_resolution;
+    gradients[i].z() = (d_dyz[0] + tx * (d_dyz[1] - d_dyz[0])) * inv_resolution;
+  }
+}
+
 }  // namespace distance_field
 
 #endif  // MOVEIT_DISTANCE_FIELD_DISTANCE_FIELD_H
@@ -0,0 +1,224 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef MOVEIT_DISTANCE_FIELD_EUCLIDEAN_DISTANCE_FIELD_H
+#define MOVEIT_DISTANCE_FIELD_EUCLIDEAN_DISTANCE_FIELD_H
+
+#include <moveit/distance_field/distance_field.h>
+#include <boost/function.hpp>
+
+namespace distance_field
+{
+MOVEIT_CLASS_FORWARD(EuclideanDistanceField);
+
+/**
+ * \brief A DistanceField implementation that recomputes the exact
+ * Euclidean distance transform of the whole grid whenever obstacle
+ * cells are added or removed.
+ *
+ * The transform is the separable algorithm of Felzenszwalb and
+ * Huttenlocher: a one dimensional lower envelope of parabolas is
+ * computed along every line of the grid, one axis after the other.
+ * This takes time linear in the number of cells regardless of the
+ * obstacles, and all lines along an axis are independent, so they are
+ * spread over several threads.  Unlike \ref PropagationDistanceField,
+ * the cost of an update does not depend on how many cells changed, so
+ * this field suits scenes that change entirely between updates, such
+ * as fields rebuilt from a new octomap every frame.
+ *
+ * Distances are exact, and are clamped to the maximum distance.  If
+ * signed distances are requested, obstacle cells hold the negative
+ * distance to the nearest unoccupied cell, as in \ref
+ * PropagationDistanceField.
+ */
+class EuclideanDistanceField : public DistanceField
+{
+public:
+  /**
+   * \brief Constructor that initializes entire distance field to
+   * empty - all cells will be assigned maximum distance values.
+   *
+   * @param [in] size_x The X dimension in meters of the volume to represent
+   * @param [in] size_y The Y dimension in meters of the volume to represent
+   * @param [in] size_z The Z dimension in meters of the volume to represent
+   * @param [in] resolution The resolution in meters of the volume
+   * @param [in] origin_x The minimum X point of the volume
+   * @param [in] origin_y The minimum Y point of the volume
+   * @param [in] origin_z The minimum Z point of the volume
+   *
+   * @param [in] max_distance The maximum distance reported by the
+   * field, and the distance returned for points outside the volume
+   *
+   * @param [in] signed_distances Whether to compute negative
+   * distances for obstacle cells.  If false, all obstacle cells will
+   * be assigned zero distance.
+   */
+  EuclideanDistanceField(double size_x, double size_y, double size_z, double resolution, double origin_x,
+                         double origin_y, double origin_z, double max_distance, bool signed_distances = false);
+
+  virtual ~EuclideanDistanceField()
+  {
+  }
+
+  /**
+   * \brief Marks the cells containing the points as obstacles and
+   * recomputes the distance transform.  Adding all points in one call
+   * is much cheaper than adding them one by one.
+   */
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+
+  /**
+   * \brief Clears the cells containing the points and recomputes the
+   * distance transform.
+   */
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+
+  /**
+   * \brief Clears the cells of the old points, marks the cells of the
+   * new points and recomputes the distance transform once.
+   */
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /**
+   * \brief Clears all obstacle cells.
+   */
+  virtual void reset();
+
+  virtual double getDistance(double x, double y, double z) const;
+  virtual double getDistance(int x, int y, int z) const;
+  virtual bool isCellValid(int x, int y, int z) const;
+  virtual int getXNumCells() const;
+  virtual int getYNumCells() const;
+  virtual int getZNumCells() const;
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the contents of the distance field to the supplied
+   * stream, in the format of \ref
+   * PropagationDistanceField::writeToStream.
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Reads a distance field written by this class or by \ref
+   * PropagationDistanceField, and recomputes the distances.
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+  /**
+   * \brief Gets the distances and gradients at many points at once,
+   * spread over the threads set with \ref setThreadCount.  Each entry
+   * is the result of \ref getDistanceGradient; points that are not
+   * valid for gradients get the uninitialized distance and a zero
+   * gradient.
+   *
+   * @param [in] points The points to query
+   * @param [out] distances The distance at each point
+   * @param [out] gradients The gradient at each point
+   */
+  void getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                            EigenSTL::vector_Vector3d& gradients) const;
+
+  /**
+   * \brief Whether obstacle cells hold negative distances
+   */
+  bool hasSignedDistances() const
+  {
+    return signed_distances_;
+  }
+
+  /**
+   * \brief Whether the cell at the given index is an obstacle cell.
+   * x,y,z MUST be valid.
+   */
+  bool isCellOccupied(int x, int y, int z) const
+  {
+    return occupancy_->getCell(x, y, z) != 0;
+  }
+
+  /**
+   * \brief Sets the number of threads used to compute the transform
+   * and to answer batched queries.
+   *
+   * @param [in] thread_count The number of threads; 0 uses one
+   * thread per core.  The default is 1.
+   */
+  void setThreadCount(unsigned int thread_count);
+
+private:
+  /**
+   * \brief Allocates the grids for the current size and resolution
+   */
+  void initialize();
+
+  /**
+   * \brief Sets the occupancy of the cells containing the points,
+   * ignoring points outside the volume
+   */
+  void setOccupancy(const EigenSTL::vector_Vector3d& points, char occupied);
+
+  /**
+   * \brief Recomputes all distances from the occupancy grid
+   */
+  void computeDistances();
+
+  /**
+   * \brief Computes the squared distance, in cells, of every cell to
+   * the nearest occupied cell, or to the nearest free cell
+   */
+  void computeTransform(bool to_occupied, VoxelGrid<float>& distance_sq);
+
+  /**
+   * \brief Calls the function with ranges [begin, end) that together
+   * cover [0, count), on up to thread_count_ threads
+   */
+  void parallelFor(std::size_t count, std::size_t min_per_thread,
+                   const boost::function<void(std::size_t, std::size_t)>& function) const;
+
+  bool signed_distances_;                      /**< \brief Whether negative distances are computed */
+  unsigned int thread_count_;                  /**< \brief Number of threads, 0 for one per core */
+  double max_distance_;                        /**< \brief Distance at which distances are clamped */
+  VoxelGrid<char>::Ptr occupancy_;             /**< \brief Non-zero for obstacle cells */
+  VoxelGrid<float>::Ptr distance_;             /**< \brief Clamped, possibly signed distance of each cell */
+  VoxelGrid<float>::Ptr negative_distance_sq_; /**< \brief Squared distances to free cells while computing */
+};
+}
+
+#endif
@@ -39,6 +39,7 @@
 
 #include <eigen_stl_containers/eigen_stl_containers.h>
 #include <geometric_shapes/bodies.h>
+#include <geometric_shapes/shapes.h>
 
 namespace distance_field
 {
@@ -53,6 +54,31 @@ namespace distance_field
  *                   vector.
  */
 void findInternalPointsConvex(const bodies::Body& body, double resolution, EigenSTL::vector_Vector3d& points);
+
+/**
+ * \brief Find all points on a regular grid that are internal to a mesh at
+ * the given pose.  Each column of the grid is filled between pairs of
+ * crossings with the mesh, so the interior of closed non-convex meshes is
+ * found exactly.  Columns where the crossings are ambiguous (open meshes, or
+ * a column through an edge or vertex) are tested against the convex hull of
+ * the mesh instead, as findInternalPointsConvex() does.
+ *
+ * @param [in] mesh The mesh to discretize
+ * @param [in] pose The pose of the mesh
+ * @param [in] resolution The resolution at which to test
+ * @param [out] points The points internal to the mesh are appended to this
+ *                   vector.
+ */
+void findInternalPointsMesh(const shapes::Mesh& mesh, const Eigen::Affine3d& pose, double resolution,
+                            EigenSTL::vector_Vector3d& points);
+
+/**
+ * \brief Find all points on a regular grid that are internal to a shape at
+ * the given pose, with findInternalPointsMesh() for meshes and
+ * findInternalPointsConvex() for all other shapes.  OcTrees have no points.
+ */
+void findInternalPoints(const shapes::Shape& shape, const Eigen::Affine3d& pose, double resolution,
+                        EigenSTL::vector_Vector3d& points);
 }
 
 #endif
@@ -0,0 +1,203 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef MOVEIT_DISTANCE_FIELD_MAPPED_DISTANCE_FIELD_H
+#define MOVEIT_DISTANCE_FIELD_MAPPED_DISTANCE_FIELD_H
+
+#include <moveit/distance_field/distance_field.h>
+#include <eigen_stl_containers/eigen_stl_vector_container.h>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <stdint.h>
+
+namespace distance_field
+{
+MOVEIT_CLASS_FORWARD(MappedDistanceField);
+
+/**
+ * \brief A read-only DistanceField whose distances are memory mapped
+ * from a cache file, with an optional overlay field for dynamic
+ * obstacles.
+ *
+ * Cache files hold the distance of every cell of a precomputed field
+ * uncompressed, so opening one only maps it: the pages are read when
+ * distances are queried.  Each file records a hash of the geometry it
+ * was computed from (see \ref computeGeometryHash) and a format
+ * version, and files that do not match are rejected.
+ *
+ * Points added to or removed from this field go to the overlay, which
+ * must cover the same grid.  The distance of a cell is the smaller of
+ * the cached distance and the overlay distance.  For signed fields
+ * this is exact outside of obstacles, while cells inside overlapping
+ * obstacles get the deeper of the two penetration depths.
+ */
+class MappedDistanceField : public DistanceField
+{
+public:
+  /** \brief The version of the cache file format written by \ref writeCache */
+  static const uint32_t CACHE_VERSION = 1;
+
+  MappedDistanceField();
+
+  virtual ~MappedDistanceField();
+
+  /**
+   * \brief Writes the distances of a field to a cache file.  The file
+   * is written to a temporary file first, and replaces an existing
+   * cache only once it was written completely.
+   *
+   * @param [in] filename The cache file to write
+   * @param [in] field The field to store
+   * @param [in] geometry_hash The hash of the geometry the field was computed from
+   *
+   * @return Whether the file was written
+   */
+  static bool writeCache(const std::string& filename, const DistanceField& field, uint64_t geometry_hash);
+
+  /**
+   * \brief Computes a hash of shapes, their poses and a resolution
+   * that is stable across runs, to identify cache files.
+   */
+  static uint64_t computeGeometryHash(const std::vector<shapes::ShapeConstPtr>& shapes,
+                                      const EigenSTL::vector_Affine3d& poses, double resolution);
+
+  /**
+   * \brief Gets a file name for the cache of the geometry with the
+   * given hash, in the given directory
+   */
+  static std::string getCacheFilename(const std::string& directory, uint64_t geometry_hash);
+
+  /**
+   * \brief Maps a cache file, dropping the overlay.
+   *
+   * @param [in] filename The cache file to map
+   *
+   * @param [in] geometry_hash The hash the cache must have been
+   * written with, or 0 to accept any cache
+   *
+   * @return Whether the file is a valid cache of the expected geometry
+   */
+  bool open(const std::string& filename, uint64_t geometry_hash = 0);
+
+  /**
+   * \brief Whether a cache file is mapped
+   */
+  bool isOpen() const
+  {
+    return distances_ != NULL;
+  }
+
+  /**
+   * \brief Gets the geometry hash of the mapped cache
+   */
+  uint64_t getGeometryHash() const
+  {
+    return geometry_hash_;
+  }
+
+  /**
+   * \brief Sets the field that holds dynamic obstacles on top of the
+   * cached distances.  It must have the same number of cells as the
+   * cache, and is reset before use.
+   *
+   * @return Whether the overlay matches the cache
+   */
+  bool setOverlay(const DistanceFieldPtr& overlay);
+
+  const DistanceFieldPtr& getOverlay() const
+  {
+    return overlay_;
+  }
+
+  /**
+   * \brief Adds obstacle points to the overlay.  Without an overlay
+   * the points are ignored.
+   */
+  virtual void addPointsToField(const EigenSTL::vector_Vector3d& points);
+
+  /**
+   * \brief Removes obstacle points from the overlay.  Cached
+   * obstacles cannot be removed.
+   */
+  virtual void removePointsFromField(const EigenSTL::vector_Vector3d& points);
+
+  virtual void updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                   const EigenSTL::vector_Vector3d& new_points);
+
+  /**
+   * \brief Resets the overlay, leaving only the cached distances
+   */
+  virtual void reset();
+
+  virtual double getDistance(double x, double y, double z) const;
+  virtual double getDistance(int x, int y, int z) const;
+  virtual bool isCellValid(int x, int y, int z) const;
+  virtual int getXNumCells() const;
+  virtual int getYNumCells() const;
+  virtual int getZNumCells() const;
+  virtual bool gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const;
+  virtual bool worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const;
+
+  /**
+   * \brief Writes the combined distances in the cache file format
+   */
+  virtual bool writeToStream(std::ostream& stream) const;
+
+  /**
+   * \brief Not supported, cache files are mapped with \ref open
+   *
+   * @return false
+   */
+  virtual bool readFromStream(std::istream& stream);
+
+  virtual double getUninitializedDistance() const
+  {
+    return max_distance_;
+  }
+
+private:
+  /** \brief Writes the cache file format of a field to a stream */
+  static bool writeCache(std::ostream& stream, const DistanceField& field, uint64_t geometry_hash);
+
+  /** \brief Unmaps the cache file */
+  void close();
+
+  boost::iostreams::mapped_file_source file_; /**< \brief The mapped cache file */
+  const float* distances_;                    /**< \brief The distances in the mapped file, NULL if not open */
+  uint64_t geometry_hash_;                    /**< \brief The geometry hash of the mapped file */
+  int num_cells_[3];                          /**< \brief The number of cells along each dimension */
+  double max_distance_;                       /**< \brief The distance returned outside of the grid */
+  DistanceFieldPtr overlay_;                  /**< \brief Field holding dynamic obstacles, may be NULL */
+};
+}
+
+#endif
@@ -163,10 +163,14 @@ public:
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
    *
+   * @param [in] sparse Whether to store the voxels sparsely, in
+   * blocks that are only allocated near obstacles.  This saves memory
+   * for large volumes with few obstacles.
+   *
    */
   PropagationDistanceField(double size_x, double size_y, double size_z, double resolution, double origin_x,
                            double origin_y, double origin_z, double max_distance,
-                           bool propagate_negative_distances = false);
+                           bool propagate_negative_distances = false, bool sparse = false);
 
   /**
    * \brief Constructor based on an OcTree and bounding box
@@ -189,10 +193,13 @@ public:
    * and all obstacle cells will be assigned zero distance.  See the
    * \ref PropagationDistanceField description for more information on
    * the implications of this.
+   *
+   * @param [in] sparse Whether to store the voxels sparsely, in
+   * blocks that are only allocated near obstacles.
    */
   PropagationDistanceField(const octomap::OcTree& octree, const octomap::point3d& bbx_min,
                            const octomap::point3d& bbx_max, double max_distance,
-                           bool propagate_negative_distances = false);
+                           bool propagate_negative_distances = false, bool sparse = false);
 
   /**
    * \brief Constructor that takes an istream and reads the contents
@@ -327,6 +334,15 @@ public:
    */
   virtual double getDistance(int x, int y, int z) const;
 
+  /**
+   * \brief Gets the distances and gradients at many locations at
+   * once, see \ref DistanceField::getDistanceGradients.  The cells are
+   * read from the voxel grid directly.
+   */
+  virtual void getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                                    EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds,
+                                    bool interpolate = false) const;
+
   virtual bool isCellValid(int x, int y, int z) const;
   virtual int getXNumCells() const;
   virtual int getYNumCells() const;
@@ -447,6 +463,35 @@ public:
     return max_distance_sq_;
   }
 
+  /**
+   * \brief Sets the number of threads used to propagate distances
+   * when points are added or removed.
+   *
+   * The grid is split into slabs along X, one per thread.  Each
+   * thread propagates within its slab, and updates that cross into
+   * another slab are handed over between rounds until no updates are
+   * left.  As the propagation order differs from the single threaded
+   * propagation, distances may differ slightly in rare cases.
+   *
+   * @param [in] thread_count The number of threads; 0 uses one
+   * thread per core.  The default is 1.
+   */
+  void setThreadCount(unsigned int thread_count);
+
+  /**
+   * \brief Whether the voxels are stored sparsely
+   */
+  bool isSparse() const
+  {
+    return sparse_;
+  }
+
+  /**
+   * \brief The number of bytes allocated for voxels.  For sparse
+   * fields this only counts the allocated blocks.
+   */
+  std::size_t getVoxelMemoryUsage() const;
+
 private:
   /** Typedef for set of integer indices */
   typedef std::set<Eigen::Vector3i, compareEigen_Vector3i, Eigen::aligned_allocator<Eigen::Vector3i>> VoxelSet;
@@ -488,6 +533,37 @@ private:
    */
   void propagateNegative();
 
+  /**
+   * \brief An update of a voxel in the slab of another thread,
+   * handed over during parallel propagation
+   */
+  struct SlabUpdate
+  {
+    Eigen::Vector3i location_;
+    Eigen::Vector3i closest_point_;
+    int distance_square_;
+    int update_direction_;
+  };
+
+  /**
+   * \brief Propagates the contents of \e bucket_queue on several
+   * threads, and clears it.  The members of PropDistanceFieldVoxel
+   * that are propagated are selected by the member pointers, so
+   * positive and negative propagation share this function.
+   *
+   * @param thread_count The number of slabs and threads, at least 2
+   */
+  void propagateParallel(std::vector<EigenSTL::vector_Vector3i>& bucket_queue, unsigned int thread_count,
+                         int PropDistanceFieldVoxel::*distance_square,
+                         Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                         int PropDistanceFieldVoxel::*update_direction);
+
+  /**
+   * \brief The number of threads to propagate with, given \ref
+   * thread_count_ and the size of the grid
+   */
+  unsigned int getPropagationThreadCount() const;
+
   /**
    * \brief Determines distance based on actual voxel data
    *
@@ -552,6 +628,10 @@ private:
 
   bool propagate_negative_; /**< \brief Whether or not to propagate negative distances */
 
+  bool sparse_; /**< \brief Whether the voxels are stored in blocks allocated when needed */
+
+  unsigned int thread_count_; /**< \brief Number of threads for propagation, 0 for one per core */
+
   VoxelGrid<PropDistanceFieldVoxel>::Ptr voxel_grid_; /**< \brief Actual container for distance data */
 
   /// \brief Structure used to hold propagation frontier
@@ -39,6 +39,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <vector>
 #include <Eigen/Core>
 #include <moveit/macros/declare_ptr.h>
 
@@ -57,6 +58,10 @@ enum Dimension
  * given resolution, where the data is supplied as a template
  * parameter.
  *
+ * Optionally the data can be stored sparsely, in blocks of
+ * 8x8x8 cells that are only allocated once a cell in them is
+ * accessed for writing.  Reading a cell of a block that was not
+ * allocated returns the value the grid was last reset to.
  */
 template <typename T>
 class VoxelGrid
@@ -88,9 +93,12 @@ public:
    *
    * @param [in] default_object An object that will be returned for any
    * future queries that are not valid
+   *
+   * @param [in] sparse Whether to allocate the cells in blocks when
+   * they are first written, instead of all at once
    */
   VoxelGrid(double size_x, double size_y, double size_z, double resolution, double origin_x, double origin_y,
-            double origin_z, T default_object);
+            double origin_z, T default_object, bool sparse = false);
   virtual ~VoxelGrid();
 
   /**
@@ -117,9 +125,12 @@ public:
    * @param [in] origin_x Minimum point along the X axis of the volume
    * @param [in] origin_y Minimum point along the Y axis of the volume
    * @param [in] origin_z Minimum point along the Z axis of the volume
+   *
+   * @param [in] sparse Whether to allocate the cells in blocks when
+   * they are first written, instead of all at once
    */
   void resize(double size_x, double size_y, double size_z, double resolution, double origin_x, double origin_y,
-              double origin_z, T default_object);
+              double origin_z, T default_object, bool sparse = false);
 
   /**
    * \brief Operator that gets the value of the given location (x, y,
@@ -152,7 +163,8 @@ public:
    * @param [in] z The Z index of the desired cell
    *
    * @return The data in the indicated cell.  If x,y,z is invalid then
-   * corruption and/or SEGFAULTS will occur.
+   * corruption and/or SEGFAULTS will occur.  For sparse grids, the
+   * non-const versions allocate the block of the cell if needed.
    */
   T& getCell(int x, int y, int z);
   T& getCell(const Eigen::Vector3i& pos);
@@ -181,12 +193,26 @@ public:
   void setCell(const Eigen::Vector3i& pos, const T& obj);
 
   /**
-   * \brief Sets every cell in the voxel grid to the supplied data
+   * \brief Sets every cell in the voxel grid to the supplied data.
+   * Sparse grids release all their blocks.
    *
    * @param [in] initial The template variable to which to set the data
    */
   void reset(const T& initial);
 
+  /**
+   * \brief Whether the cells are allocated in blocks when needed
+   */
+  bool isSparse() const;
+
+  /**
+   * \brief The number of blocks of a sparse grid that are allocated
+   */
+  std::size_t getNumAllocatedBlocks() const;
+
+  /** \brief log2 of the edge length of the blocks of sparse grids, in cells */
+  static const int BLOCK_SHIFT = 3;
+
   /**
    * \brief Gets the size in arbitrary units of the indicated dimension
    *
@@ -300,6 +326,30 @@ protected:
   int stride1_;            /**< \brief The step to take when stepping between consecutive X members in the 1D array */
   int stride2_; /**< \brief The step to take when stepping between consecutive Y members given an X in the 1D array */
 
+  bool sparse_;               /**< \brief Whether the data is stored in blocks_ instead of data_ */
+  std::vector<T*> blocks_;    /**< \brief The blocks of a sparse grid, NULL for blocks that were not allocated */
+  T initial_object_;          /**< \brief The value of all cells in blocks that were not allocated */
+  int block_stride1_;         /**< \brief The step between consecutive X blocks in blocks_ */
+  int block_stride2_;         /**< \brief The step between consecutive Y blocks given an X in blocks_ */
+  std::size_t num_allocated_; /**< \brief The number of allocated blocks */
+
+  /**
+   * \brief Gets the index of the block of a cell in blocks_, and the
+   * index of the cell within the block
+   */
+  int blockRef(int x, int y, int z) const;
+  int blockCellRef(int x, int y, int z) const;
+
+  /**
+   * \brief Allocates a block of cells set to initial_object_
+   */
+  T* allocateBlock();
+
+  /**
+   * \brief Releases all blocks of a sparse grid
+   */
+  void releaseBlocks();
+
   /**
    * \brief Gets the 1D index into the array, with no validity check.
    *
@@ -341,14 +391,14 @@ protected:
 
 template <typename T>
 VoxelGrid<T>::VoxelGrid(double size_x, double size_y, double size_z, double resolution, double origin_x,
-                        double origin_y, double origin_z, T default_object)
-  : data_(NULL)
+                        double origin_y, double origin_z, T default_object, bool sparse)
+  : data_(NULL), sparse_(false), num_allocated_(0)
 {
-  resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object);
+  resize(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z, default_object, sparse);
 }
 
 template <typename T>
-VoxelGrid<T>::VoxelGrid() : data_(NULL)
+VoxelGrid<T>::VoxelGrid() : data_(NULL), sparse_(false), block_stride1_(0), block_stride2_(0), num_allocated_(0)
 {
   for (int i = DIM_X; i <= DIM_Z; ++i)
   {
@@ -366,10 +416,12 @@ VoxelGrid<T>::VoxelGrid() : data_(NULL)
 
 template <typename T>
 void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double resolution, double origin_x,
-                          double origin_y, double origin_z, T default_object)
+                          double origin_y, double origin_z, T default_object, bool sparse)
 {
   delete[] data_;
   data_ = NULL;
+  releaseBlocks();
+  blocks_.clear();
 
   size_[DIM_X] = size_x;
   size_[DIM_Y] = size_y;
@@ -394,15 +446,75 @@ void VoxelGrid<T>::resize(double size_x, double size_y, double size_z, double re
   stride1_ = num_cells_[DIM_Y] * num_cells_[DIM_Z];
   stride2_ = num_cells_[DIM_Z];
 
+  sparse_ = sparse;
+  initial_object_ = default_object;
+  int num_blocks[3];
+  for (int i = DIM_X; i <= DIM_Z; ++i)
+    num_blocks[i] = (num_cells_[i] + (1 << BLOCK_SHIFT) - 1) >> BLOCK_SHIFT;
+  block_stride1_ = num_blocks[DIM_Y] * num_blocks[DIM_Z];
+  block_stride2_ = num_blocks[DIM_Z];
+
   // initialize the data:
   if (num_cells_total_ > 0)
-    data_ = new T[num_cells_total_];
+  {
+    if (sparse_)
+      blocks_.assign(num_blocks[DIM_X] * block_stride1_, NULL);
+    else
+      data_ = new T[num_cells_total_];
+  }
 }
 
 template <typename T>
 VoxelGrid<T>::~VoxelGrid()
 {
   delete[] data_;
+  releaseBlocks();
+}
+
+template <typename T>
+inline int VoxelGrid<T>::blockRef(int x, int y, int z) const
+{
+  return (x >> BLOCK_SHIFT) * block_stride1_ + (y >> BLOCK_SHIFT) * block_stride2_ + (z >> BLOCK_SHIFT);
+}
+
+template <typename T>
+inline int VoxelGrid<T>::blockCellRef(int x, int y, int z) const
+{
+  const int mask = (1 << BLOCK_SHIFT) - 1;
+  return (x & mask) << (2 * BLOCK_SHIFT) | (y & mask) << BLOCK_SHIFT | (z & mask);
+}
+
+template <typename T>
+T* VoxelGrid<T>::allocateBlock()
+{
+  const int block_size = 1 << (3 * BLOCK_SHIFT);
+  T* block = new T[block_size];
+  std::fill(block, block + block_size, initial_object_);
+  ++num_allocated_;
+  return block;
+}
+
+template <typename T>
+void VoxelGrid<T>::releaseBlocks()
+{
+  for (std::size_t i = 0; i < blocks_.size(); ++i)
+  {
+    delete[] blocks_[i];
+    blocks_[i] = NULL;
+  }
+  num_allocated_ = 0;
+}
+
+template <typename T>
+inline bool VoxelGrid<T>::isSparse() const
+{
+  return sparse_;
+}
+
+template <typename T>
+inline std::size_t VoxelGrid<T>::getNumAllocatedBlocks() const
+{
+  return num_allocated_;
 }
 
 template <typename T>
@@ -479,37 +591,46 @@ inline const T& VoxelGrid<T>::operator()(const Eigen::Vector3d& pos) const
 template <typename T>
 inline T& VoxelGrid<T>::getCell(int x, int y, int z)
 {
-  return data_[ref(x, y, z)];
+  if (!sparse_)
+    return data_[ref(x, y, z)];
+  // the block directory is a flat array, so finding a block costs no more than indexing a dense grid
+  T*& block = blocks_[blockRef(x, y, z)];
+  if (!block)
+    block = allocateBlock();
+  return block[blockCellRef(x, y, z)];
 }
 
 template <typename T>
 inline const T& VoxelGrid<T>::getCell(int x, int y, int z) const
 {
-  return data_[ref(x, y, z)];
+  if (!sparse_)
+    return data_[ref(x, y, z)];
+  const T* block = blocks_[blockRef(x, y, z)];
+  return block ? block[blockCellRef(x, y, z)] : initial_object_;
 }
 
 template <typename T>
 inline T& VoxelGrid<T>::getCell(const Eigen::Vector3i& pos)
 {
-  return data_[ref(pos.x(), pos.y(), pos.z())];
+  return getCell(pos.x(), pos.y(), pos.z());
 }
 
 template <typename T>
 inline const T& VoxelGrid<T>::getCell(const Eigen::Vector3i& pos) const
 {
-  return data_[ref(pos.x(), pos.y(), pos.z())];
+  return getCell(pos.x(), pos.y(), pos.z());
 }
 
 template <typename T>
 inline void VoxelGrid<T>::setCell(int x, int y, int z, const T& obj)
 {
-  data_[ref(x, y, z)] = obj;
+  getCell(x, y, z) = obj;
 }
 
 template <typename T>
 inline void VoxelGrid<T>::setCell(const Eigen::Vector3i& pos, const T& obj)
 {
-  data_[ref(pos.x(), pos.y(), pos.z())] = obj;
+  getCell(pos.x(), pos.y(), pos.z()) = obj;
 }
 
 template <typename T>
@@ -541,7 +662,13 @@ inline double VoxelGrid<T>::getLocationFromCell(Dimension dim, int cell) const
 template <typename T>
 inline void VoxelGrid<T>::reset(const T& initial)
 {
-  std::fill(data_, data_ + num_cells_total_, initial);
+  if (sparse_)
+  {
+    releaseBlocks();
+    initial_object_ = initial;
+  }
+  else
+    std::fill(data_, data_ + num_cells_total_, initial);
 }
 
 template <typename T>
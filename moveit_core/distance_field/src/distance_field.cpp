@@ -85,6 +85,14 @@ double DistanceField::getDistanceGradient(double x, double y, double z, double&
   return getDistance(gx, gy, gz);
 }
 
+void DistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points, std::vector<double>& distances,
+                                         EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds,
+                                         bool interpolate) const
+{
+  getDistanceGradients(points, distances, gradients, in_bounds, interpolate,
+                       [this](int x, int y, int z) { return getDistance(x, y, z); });
+}
+
 void DistanceField::getIsoSurfaceMarkers(double min_distance, double max_distance, const std::string& frame_id,
                                          const ros::Time stamp, visualization_msgs::Marker& inf_marker) const
 {
@@ -207,12 +215,7 @@ bool DistanceField::getShapePoints(const shapes::Shape* shape, const Eigen::Affi
     getOcTreePoints(oc->octree.get(), points);
   }
   else
-  {
-    bodies::Body* body = bodies::createBodyFromShape(shape);
-    body->setPose(pose);
-    findInternalPointsConvex(*body, resolution_, *points);
-    delete body;
-  }
+    findInternalPoints(*shape, pose, resolution_, *points);
   return true;
 }
 
@@ -292,14 +295,10 @@ void DistanceField::moveShapeInField(const shapes::Shape* shape, const Eigen::Af
     ROS_WARN_NAMED("distance_field", "Move shape not supported for Octree");
     return;
   }
-  bodies::Body* body = bodies::createBodyFromShape(shape);
-  body->setPose(old_pose);
   EigenSTL::vector_Vector3d old_point_vec;
-  findInternalPointsConvex(*body, resolution_, old_point_vec);
-  body->setPose(new_pose);
+  findInternalPoints(*shape, old_pose, resolution_, old_point_vec);
   EigenSTL::vector_Vector3d new_point_vec;
-  findInternalPointsConvex(*body, resolution_, new_point_vec);
-  delete body;
+  findInternalPoints(*shape, new_pose, resolution_, new_point_vec);
   updatePointsInField(old_point_vec, new_point_vec);
 }
 
@@ -315,11 +314,8 @@ void DistanceField::moveShapeInField(const shapes::Shape* shape, const geometry_
 
 void DistanceField::removeShapeFromField(const shapes::Shape* shape, const Eigen::Affine3d& pose)
 {
-  bodies::Body* body = bodies::createBodyFromShape(shape);
-  body->setPose(pose);
   EigenSTL::vector_Vector3d point_vec;
-  findInternalPointsConvex(*body, resolution_, point_vec);
-  delete body;
+  findInternalPoints(*shape, pose, resolution_, point_vec);
   removePointsFromField(point_vec);
 }
 
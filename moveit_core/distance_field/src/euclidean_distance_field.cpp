@@ -0,0 +1,356 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/distance_field/euclidean_distance_field.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+
+namespace distance_field
+{
+namespace
+{
+const float EDT_INFINITY = 1e20f;
+
+// Computes d[q] = min_v ((q - v)^2 + f[v]) as the lower envelope of
+// parabolas, see Felzenszwalb and Huttenlocher, "Distance Transforms of
+// Sampled Functions".  v needs n and z needs n + 1 entries.
+void transformLine(const float* f, int n, float* d, int* v, float* z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -EDT_INFINITY;
+  z[1] = EDT_INFINITY;
+  for (int q = 1; q < n; ++q)
+  {
+    float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    while (s <= z[k])
+    {
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = EDT_INFINITY;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q)
+  {
+    while (z[k + 1] < q)
+      ++k;
+    d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+}
+
+EuclideanDistanceField::EuclideanDistanceField(double size_x, double size_y, double size_z, double resolution,
+                                               double origin_x, double origin_y, double origin_z, double max_distance,
+                                               bool signed_distances)
+  : DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z)
+  , signed_distances_(signed_distances)
+  , thread_count_(1)
+  , max_distance_(max_distance)
+{
+  initialize();
+}
+
+void EuclideanDistanceField::initialize()
+{
+  occupancy_.reset(new VoxelGrid<char>(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, 0));
+  distance_.reset(
+      new VoxelGrid<float>(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, max_distance_));
+  if (signed_distances_)
+    negative_distance_sq_.reset(
+        new VoxelGrid<float>(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_, origin_z_, 0.0f));
+  else
+    negative_distance_sq_.reset();
+  reset();
+}
+
+void EuclideanDistanceField::setThreadCount(unsigned int thread_count)
+{
+  thread_count_ = thread_count;
+}
+
+void EuclideanDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  setOccupancy(points, 1);
+  computeDistances();
+}
+
+void EuclideanDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  setOccupancy(points, 0);
+  computeDistances();
+}
+
+void EuclideanDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                                 const EigenSTL::vector_Vector3d& new_points)
+{
+  setOccupancy(old_points, 0);
+  setOccupancy(new_points, 1);
+  computeDistances();
+}
+
+void EuclideanDistanceField::reset()
+{
+  occupancy_->reset(0);
+  distance_->reset(max_distance_);
+}
+
+void EuclideanDistanceField::setOccupancy(const EigenSTL::vector_Vector3d& points, char occupied)
+{
+  int x, y, z;
+  for (std::size_t i = 0; i < points.size(); ++i)
+    if (occupancy_->worldToGrid(points[i].x(), points[i].y(), points[i].z(), x, y, z))
+      occupancy_->getCell(x, y, z) = occupied;
+}
+
+void EuclideanDistanceField::computeDistances()
+{
+  computeTransform(true, *distance_);
+  if (signed_distances_)
+    computeTransform(false, *negative_distance_sq_);
+
+  // turn the squared cell distances into clamped metric distances
+  const int num_y = getYNumCells();
+  const int num_z = getZNumCells();
+  parallelFor(getXNumCells(), 1, [this, num_y, num_z](std::size_t begin, std::size_t end) {
+    for (int x = begin; x < static_cast<int>(end); ++x)
+      for (int y = 0; y < num_y; ++y)
+        for (int z = 0; z < num_z; ++z)
+        {
+          float& distance = distance_->getCell(x, y, z);
+          distance = std::min<double>(std::sqrt(distance) * resolution_, max_distance_);
+          if (signed_distances_)
+            distance -= std::min<double>(std::sqrt(negative_distance_sq_->getCell(x, y, z)) * resolution_,
+                                         max_distance_);
+        }
+  });
+}
+
+void EuclideanDistanceField::computeTransform(bool to_occupied, VoxelGrid<float>& distance_sq)
+{
+  const int num[3] = { getXNumCells(), getYNumCells(), getZNumCells() };
+  const int max_num = std::max(num[DIM_X], std::max(num[DIM_Y], num[DIM_Z]));
+
+  // transform along Z first, seeding the lines from the occupancy, then along Y and X
+  for (int dim = DIM_Z; dim >= DIM_X; --dim)
+  {
+    // the other two dimensions enumerate the lines along dim
+    const int a = dim == DIM_X ? DIM_Y : DIM_X;
+    const int b = dim == DIM_Z ? DIM_Y : DIM_Z;
+    parallelFor(num[a] * num[b], 16, [&](std::size_t begin, std::size_t end) {
+      std::vector<float> f(max_num), d(max_num), z(max_num + 1);
+      std::vector<int> v(max_num);
+      int cell[3];
+      for (std::size_t line = begin; line < end; ++line)
+      {
+        cell[a] = line / num[b];
+        cell[b] = line % num[b];
+        for (cell[dim] = 0; cell[dim] < num[dim]; ++cell[dim])
+        {
+          if (dim == DIM_Z)
+            f[cell[dim]] =
+                (occupancy_->getCell(cell[0], cell[1], cell[2]) != 0) == to_occupied ? 0.0f : EDT_INFINITY;
+          else
+            f[cell[dim]] = distance_sq.getCell(cell[0], cell[1], cell[2]);
+        }
+        transformLine(&f[0], num[dim], &d[0], &v[0], &z[0]);
+        for (cell[dim] = 0; cell[dim] < num[dim]; ++cell[dim])
+          distance_sq.getCell(cell[0], cell[1], cell[2]) = d[cell[dim]];
+      }
+    });
+  }
+}
+
+void EuclideanDistanceField::parallelFor(std::size_t count, std::size_t min_per_thread,
+                                         const boost::function<void(std::size_t, std::size_t)>& function) const
+{
+  std::size_t thread_count = thread_count_;
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, std::max<std::size_t>(1, count / std::max<std::size_t>(1, min_per_thread)));
+  if (thread_count <= 1)
+  {
+    function(0, count);
+    return;
+  }
+
+  // the calling thread takes the first range
+  boost::thread_group threads;
+  for (std::size_t t = 1; t < thread_count; ++t)
+  {
+    std::size_t begin = count * t / thread_count;
+    std::size_t end = count * (t + 1) / thread_count;
+    threads.create_thread([&function, begin, end]() { function(begin, end); });
+  }
+  function(0, count / thread_count);
+  threads.join_all();
+}
+
+void EuclideanDistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                  std::vector<double>& distances,
+                                                  EigenSTL::vector_Vector3d& gradients) const
+{
+  distances.resize(points.size());
+  gradients.resize(points.size());
+  parallelFor(points.size(), 1024, [&](std::size_t begin, std::size_t end) {
+    bool in_bounds;
+    for (std::size_t i = begin; i < end; ++i)
+      distances[i] = getDistanceGradient(points[i].x(), points[i].y(), points[i].z(), gradients[i].x(),
+                                         gradients[i].y(), gradients[i].z(), in_bounds);
+  });
+}
+
+double EuclideanDistanceField::getDistance(double x, double y, double z) const
+{
+  int gx, gy, gz;
+  if (!distance_->worldToGrid(x, y, z, gx, gy, gz))
+    return max_distance_;
+  return distance_->getCell(gx, gy, gz);
+}
+
+double EuclideanDistanceField::getDistance(int x, int y, int z) const
+{
+  return distance_->getCell(x, y, z);
+}
+
+bool EuclideanDistanceField::isCellValid(int x, int y, int z) const
+{
+  return distance_->isCellValid(x, y, z);
+}
+
+int EuclideanDistanceField::getXNumCells() const
+{
+  return distance_->getNumCells(DIM_X);
+}
+
+int EuclideanDistanceField::getYNumCells() const
+{
+  return distance_->getNumCells(DIM_Y);
+}
+
+int EuclideanDistanceField::getZNumCells() const
+{
+  return distance_->getNumCells(DIM_Z);
+}
+
+bool EuclideanDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  distance_->gridToWorld(x, y, z, world_x, world_y, world_z);
+  return true;
+}
+
+bool EuclideanDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  return distance_->worldToGrid(world_x, world_y, world_z, x, y, z);
+}
+
+bool EuclideanDistanceField::writeToStream(std::ostream& os) const
+{
+  os << "resolution: " << resolution_ << std::endl;
+  os << "size_x: " << size_x_ << std::endl;
+  os << "size_y: " << size_y_ << std::endl;
+  os << "size_z: " << size_z_ << std::endl;
+  os << "origin_x: " << origin_x_ << std::endl;
+  os << "origin_y: " << origin_y_ << std::endl;
+  os << "origin_z: " << origin_z_ << std::endl;
+
+  // the occupancy in bits, compressed
+  boost::iostreams::filtering_ostream out;
+  out.push(boost::iostreams::zlib_compressor());
+  out.push(os);
+  for (int x = 0; x < getXNumCells(); ++x)
+    for (int y = 0; y < getYNumCells(); ++y)
+      for (int z = 0; z < getZNumCells(); z += 8)
+      {
+        std::bitset<8> bs(0);
+        for (int zi = 0; zi < std::min(8, getZNumCells() - z); ++zi)
+          bs[zi] = isCellOccupied(x, y, z + zi);
+        char byte = static_cast<char>(bs.to_ulong());
+        out.write(&byte, sizeof(char));
+      }
+  out.flush();
+  return true;
+}
+
+bool EuclideanDistanceField::readFromStream(std::istream& is)
+{
+  if (!is.good())
+    return false;
+
+  static const char* const NAMES[] = { "resolution:", "size_x:",   "size_y:",  "size_z:",
+                                       "origin_x:",   "origin_y:", "origin_z:" };
+  double* const values[] = { &resolution_, &size_x_, &size_y_, &size_z_, &origin_x_, &origin_y_, &origin_z_ };
+  std::string temp;
+  for (int i = 0; i < 7; ++i)
+  {
+    is >> temp;
+    if (temp != NAMES[i])
+      return false;
+    is >> *values[i];
+  }
+  inv_twice_resolution_ = 1.0 / (2.0 * resolution_);
+
+  // previous values for signed_distances_ and max_distance_ will be used
+  initialize();
+
+  // this should be newline
+  char nl;
+  is.get(nl);
+
+  boost::iostreams::filtering_istream in;
+  in.push(boost::iostreams::zlib_decompressor());
+  in.push(is);
+  for (int x = 0; x < getXNumCells(); ++x)
+    for (int y = 0; y < getYNumCells(); ++y)
+      for (int z = 0; z < getZNumCells(); z += 8)
+      {
+        char inchar;
+        if (!in.good())
+          return false;
+        in.get(inchar);
+        std::bitset<8> inbit(static_cast<unsigned char>(inchar));
+        for (int zi = 0; zi < std::min(8, getZNumCells() - z); ++zi)
+          occupancy_->getCell(x, y, z + zi) = inbit[zi];
+      }
+  computeDistances();
+  return true;
+}
+}
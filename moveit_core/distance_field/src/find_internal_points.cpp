@@ -35,6 +35,57 @@
 /* Author: Acorn Pooley */
 
 #include <moveit/distance_field/find_internal_points.h>
+#include <geometric_shapes/body_operations.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace distance_field
+{
+namespace
+{
+// smaller grids are not worth starting threads for
+const std::size_t MIN_POINTS_PER_THREAD = 32768;
+
+// Call find_points(x_begin, x_end, points) on consecutive slabs of the x indices [0, x_count) of a grid with
+// points_per_x points per x index, on several threads for large grids, and append the points in slab order
+template <typename FindPoints>
+void findPointsInSlabs(std::size_t x_count, std::size_t points_per_x, const FindPoints& find_points,
+                       EigenSTL::vector_Vector3d& points)
+{
+  std::size_t thread_count = std::min<std::size_t>(std::max(1u, boost::thread::hardware_concurrency()),
+                                                   x_count * points_per_x / MIN_POINTS_PER_THREAD);
+  if (thread_count <= 1)
+  {
+    find_points(0, x_count, points);
+    return;
+  }
+
+  std::vector<EigenSTL::vector_Vector3d> slab_points(thread_count);
+  boost::thread_group threads;
+  for (std::size_t t = 0; t < thread_count; ++t)
+    threads.create_thread([&find_points, &slab_points, x_count, thread_count, t]() {
+      find_points(t * x_count / thread_count, (t + 1) * x_count / thread_count, slab_points[t]);
+    });
+  threads.join_all();
+  for (std::size_t t = 0; t < thread_count; ++t)
+    points.insert(points.end(), slab_points[t].begin(), slab_points[t].end());
+}
+
+// the number of grid points from start to end (inclusive) at the given resolution
+std::size_t gridCount(double start, double end, double resolution)
+{
+  return end < start ? 0 : static_cast<std::size_t>(std::floor((end - start) / resolution)) + 1;
+}
+
+// twice the signed area of the triangle (a, b, p) projected on the xy plane
+double edgeFunction(const Eigen::Vector3d& a, const Eigen::Vector3d& b, double px, double py)
+{
+  return (b.x() - a.x()) * (py - a.y()) - (b.y() - a.y()) * (px - a.x());
+}
+}
+}
 
 void distance_field::findInternalPointsConvex(const bodies::Body& body, double resolution,
                                               EigenSTL::vector_Vector3d& points)
@@ -47,18 +98,151 @@ void distance_field::findInternalPointsConvex(const bodies::Body& body, double r
   double xval_e = sphere.center.x() + sphere.radius + resolution;
   double yval_e = sphere.center.y() + sphere.radius + resolution;
   double zval_e = sphere.center.z() + sphere.radius + resolution;
+  std::size_t x_count = gridCount(xval_s, xval_e, resolution);
+  std::size_t y_count = gridCount(yval_s, yval_e, resolution);
+  std::size_t z_count = gridCount(zval_s, zval_e, resolution);
+
+  // bodies only read their data when testing points, so slabs of the grid can be tested concurrently
+  findPointsInSlabs(x_count, y_count * z_count,
+                    [&](std::size_t x_begin, std::size_t x_end, EigenSTL::vector_Vector3d& slab_points) {
+                      Eigen::Vector3d pt;
+                      for (std::size_t i = x_begin; i < x_end; ++i)
+                      {
+                        pt.x() = xval_s + i * resolution;
+                        for (std::size_t j = 0; j < y_count; ++j)
+                        {
+                          pt.y() = yval_s + j * resolution;
+                          for (std::size_t k = 0; k < z_count; ++k)
+                          {
+                            pt.z() = zval_s + k * resolution;
+                            if (body.containsPoint(pt))
+                              slab_points.push_back(pt);
+                          }
+                        }
+                      }
+                    },
+                    points);
+}
+
+void distance_field::findInternalPointsMesh(const shapes::Mesh& mesh, const Eigen::Affine3d& pose, double resolution,
+                                            EigenSTL::vector_Vector3d& points)
+{
+  if (mesh.vertex_count == 0 || mesh.triangle_count == 0)
+    return;
+
+  EigenSTL::vector_Vector3d vertices(mesh.vertex_count);
+  for (unsigned int i = 0; i < mesh.vertex_count; ++i)
+    vertices[i] = pose * Eigen::Vector3d(mesh.vertices[3 * i], mesh.vertices[3 * i + 1], mesh.vertices[3 * i + 2]);
+  Eigen::Vector3d min = vertices[0];
+  Eigen::Vector3d max = vertices[0];
+  for (unsigned int i = 1; i < mesh.vertex_count; ++i)
+  {
+    min = min.cwiseMin(vertices[i]);
+    max = max.cwiseMax(vertices[i]);
+  }
+  Eigen::Vector3d start(std::floor(min.x() / resolution) * resolution, std::floor(min.y() / resolution) * resolution,
+                        std::floor(min.z() / resolution) * resolution);
+  std::size_t x_count = gridCount(start.x(), max.x(), resolution);
+  std::size_t y_count = gridCount(start.y(), max.y(), resolution);
+  std::size_t z_count = gridCount(start.z(), max.z(), resolution);
+
+  // sort the triangles into the grid columns their projections on the xy plane may cover
+  std::vector<std::vector<unsigned int> > columns(x_count * y_count);
+  for (unsigned int t = 0; t < mesh.triangle_count; ++t)
+  {
+    const Eigen::Vector3d& a = vertices[mesh.triangles[3 * t]];
+    const Eigen::Vector3d& b = vertices[mesh.triangles[3 * t + 1]];
+    const Eigen::Vector3d& c = vertices[mesh.triangles[3 * t + 2]];
+    Eigen::Vector3d tmin = a.cwiseMin(b).cwiseMin(c) - start;
+    Eigen::Vector3d tmax = a.cwiseMax(b).cwiseMax(c) - start;
+    std::size_t i_end = std::min(x_count, static_cast<std::size_t>(std::floor(tmax.x() / resolution)) + 1);
+    std::size_t j_end = std::min(y_count, static_cast<std::size_t>(std::floor(tmax.y() / resolution)) + 1);
+    for (std::size_t i = static_cast<std::size_t>(std::max(0.0, std::ceil(tmin.x() / resolution))); i < i_end; ++i)
+      for (std::size_t j = static_cast<std::size_t>(std::max(0.0, std::ceil(tmin.y() / resolution))); j < j_end; ++j)
+        columns[i * y_count + j].push_back(t);
+  }
+
+  // fill every column between pairs of crossings; columns that cannot be decided are collected for the hull test
+  std::vector<std::size_t> ambiguous;
+  boost::mutex ambiguous_lock;
+  findPointsInSlabs(
+      x_count, y_count * z_count,
+      [&](std::size_t x_begin, std::size_t x_end, EigenSTL::vector_Vector3d& slab_points) {
+        std::vector<std::size_t> slab_ambiguous;
+        std::vector<double> crossings;
+        for (std::size_t i = x_begin; i < x_end; ++i)
+          for (std::size_t j = 0; j < y_count; ++j)
+          {
+            double x = start.x() + i * resolution;
+            double y = start.y() + j * resolution;
+            const std::vector<unsigned int>& column = columns[i * y_count + j];
+            bool decided = true;
+            crossings.clear();
+            for (std::size_t t = 0; decided && t < column.size(); ++t)
+            {
+              const Eigen::Vector3d& a = vertices[mesh.triangles[3 * column[t]]];
+              const Eigen::Vector3d& b = vertices[mesh.triangles[3 * column[t] + 1]];
+              const Eigen::Vector3d& c = vertices[mesh.triangles[3 * column[t] + 2]];
+              double wa = edgeFunction(b, c, x, y);
+              double wb = edgeFunction(c, a, x, y);
+              double wc = edgeFunction(a, b, x, y);
+              double area = wa + wb + wc;
+              if (area == 0.0)
+                continue;  // the triangle is parallel to the column
+              if ((wa > 0.0 && wb > 0.0 && wc > 0.0) || (wa < 0.0 && wb < 0.0 && wc < 0.0))
+                crossings.push_back((wa * a.z() + wb * b.z() + wc * c.z()) / area);
+              else if ((wa >= 0.0 && wb >= 0.0 && wc >= 0.0) || (wa <= 0.0 && wb <= 0.0 && wc <= 0.0))
+                decided = false;  // the column passes through an edge or a vertex
+            }
+            if (!decided || crossings.size() % 2 != 0)
+            {
+              slab_ambiguous.push_back(i * y_count + j);
+              continue;
+            }
+            std::sort(crossings.begin(), crossings.end());
+            for (std::size_t p = 0; p < crossings.size(); p += 2)
+            {
+              double k_begin = std::max(0.0, std::ceil((crossings[p] - start.z()) / resolution));
+              double k_end = std::floor((crossings[p + 1] - start.z()) / resolution);
+              for (double k = k_begin; k <= k_end; k += 1.0)
+                slab_points.push_back(Eigen::Vector3d(x, y, start.z() + k * resolution));
+            }
+          }
+        boost::mutex::scoped_lock lock(ambiguous_lock);
+        ambiguous.insert(ambiguous.end(), slab_ambiguous.begin(), slab_ambiguous.end());
+      },
+      points);
+
+  if (ambiguous.empty())
+    return;
+  std::unique_ptr<bodies::Body> hull(bodies::createBodyFromShape(&mesh));
+  hull->setPose(pose);
+  std::sort(ambiguous.begin(), ambiguous.end());
   Eigen::Vector3d pt;
-  for (pt.x() = xval_s; pt.x() <= xval_e; pt.x() += resolution)
+  for (std::size_t c = 0; c < ambiguous.size(); ++c)
   {
-    for (pt.y() = yval_s; pt.y() <= yval_e; pt.y() += resolution)
+    pt.x() = start.x() + (ambiguous[c] / y_count) * resolution;
+    pt.y() = start.y() + (ambiguous[c] % y_count) * resolution;
+    for (std::size_t k = 0; k < z_count; ++k)
     {
-      for (pt.z() = zval_s; pt.z() <= zval_e; pt.z() += resolution)
-      {
-        if (body.containsPoint(pt))
-        {
-          points.push_back(pt);
-        }
-      }
+      pt.z() = start.z() + k * resolution;
+      if (hull->containsPoint(pt))
+        points.push_back(pt);
     }
   }
 }
+
+void distance_field::findInternalPoints(const shapes::Shape& shape, const Eigen::Affine3d& pose, double resolution,
+                                        EigenSTL::vector_Vector3d& points)
+{
+  if (shape.type == shapes::MESH)
+    findInternalPointsMesh(static_cast<const shapes::Mesh&>(shape), pose, resolution, points);
+  else if (shape.type != shapes::OCTREE)
+  {
+    std::unique_ptr<bodies::Body> body(bodies::createBodyFromShape(&shape));
+    if (!body)
+      return;
+    body->setPose(pose);
+    findInternalPointsConvex(*body, resolution, points);
+  }
+}
@@ -0,0 +1,353 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/distance_field/mapped_distance_field.h>
+#include <geometric_shapes/shape_operations.h>
+#include <ros/console.h>
+#include <boost/static_assert.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace distance_field
+{
+namespace
+{
+const char CACHE_MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'D', 'F' };
+
+// the distances start at a fixed offset, so they are aligned in the mapped file
+const std::size_t CACHE_DATA_OFFSET = 128;
+
+struct CacheHeader
+{
+  char magic[8];
+  uint32_t version;
+  int32_t num_cells[3];
+  uint64_t geometry_hash;
+  double resolution;
+  double size[3];
+  double origin[3];
+  double max_distance;
+};
+BOOST_STATIC_ASSERT(sizeof(CacheHeader) <= CACHE_DATA_OFFSET);
+
+// 64 bit FNV-1a, which unlike std::hash gives the same value in every run and build
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+void hashBytes(uint64_t& hash, const void* data, std::size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+}
+}
+
+MappedDistanceField::MappedDistanceField()
+  : DistanceField(0, 0, 0, 0, 0, 0, 0), distances_(NULL), geometry_hash_(0), max_distance_(0)
+{
+  num_cells_[DIM_X] = num_cells_[DIM_Y] = num_cells_[DIM_Z] = 0;
+}
+
+MappedDistanceField::~MappedDistanceField()
+{
+  close();
+}
+
+uint64_t MappedDistanceField::computeGeometryHash(const std::vector<shapes::ShapeConstPtr>& shapes,
+                                                  const EigenSTL::vector_Affine3d& poses, double resolution)
+{
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hashBytes(hash, &resolution, sizeof(resolution));
+  for (std::size_t i = 0; i < shapes.size(); ++i)
+  {
+    std::stringstream ss;
+    shapes::saveAsText(shapes[i].get(), ss);
+    const std::string text = ss.str();
+    hashBytes(hash, text.data(), text.size());
+    if (i < poses.size())
+      hashBytes(hash, poses[i].matrix().data(), 16 * sizeof(double));
+  }
+  // 0 means no hash to open()
+  return hash == 0 ? 1 : hash;
+}
+
+std::string MappedDistanceField::getCacheFilename(const std::string& directory, uint64_t geometry_hash)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.mdf", static_cast<unsigned long long>(geometry_hash));
+  if (directory.empty())
+    return name;
+  return directory + (directory[directory.size() - 1] == '/' ? "" : "/") + name;
+}
+
+bool MappedDistanceField::writeCache(std::ostream& stream, const DistanceField& field, uint64_t geometry_hash)
+{
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.num_cells[DIM_X] = field.getXNumCells();
+  header.num_cells[DIM_Y] = field.getYNumCells();
+  header.num_cells[DIM_Z] = field.getZNumCells();
+  header.geometry_hash = geometry_hash;
+  header.resolution = field.getResolution();
+  header.size[DIM_X] = field.getSizeX();
+  header.size[DIM_Y] = field.getSizeY();
+  header.size[DIM_Z] = field.getSizeZ();
+  header.origin[DIM_X] = field.getOriginX();
+  header.origin[DIM_Y] = field.getOriginY();
+  header.origin[DIM_Z] = field.getOriginZ();
+  header.max_distance = field.getUninitializedDistance();
+
+  char padding[CACHE_DATA_OFFSET] = { 0 };
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  stream.write(padding, CACHE_DATA_OFFSET - sizeof(header));
+
+  // one line along Z at a time
+  std::vector<float> line(header.num_cells[DIM_Z]);
+  for (int x = 0; x < header.num_cells[DIM_X]; ++x)
+    for (int y = 0; y < header.num_cells[DIM_Y]; ++y)
+    {
+      for (int z = 0; z < header.num_cells[DIM_Z]; ++z)
+        line[z] = field.getDistance(x, y, z);
+      if (!line.empty())
+        stream.write(reinterpret_cast<const char*>(&line[0]), line.size() * sizeof(float));
+    }
+  return stream.good();
+}
+
+bool MappedDistanceField::writeCache(const std::string& filename, const DistanceField& field, uint64_t geometry_hash)
+{
+  // write to a temporary file first, so a cache that is mapped elsewhere is not modified
+  const std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream file(tmp_filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!writeCache(file, field, geometry_hash))
+    {
+      ROS_ERROR_NAMED("distance_field", "Unable to write distance field cache to '%s'", tmp_filename.c_str());
+      std::remove(tmp_filename.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    ROS_ERROR_NAMED("distance_field", "Unable to replace '%s' by the new distance field cache", filename.c_str());
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool MappedDistanceField::open(const std::string& filename, uint64_t geometry_hash)
+{
+  close();
+  try
+  {
+    file_.open(filename);
+  }
+  catch (std::exception& ex)
+  {
+    ROS_DEBUG_NAMED("distance_field", "Unable to map distance field cache '%s': %s", filename.c_str(), ex.what());
+    return false;
+  }
+
+  CacheHeader header;
+  if (file_.size() < CACHE_DATA_OFFSET)
+  {
+    ROS_ERROR_NAMED("distance_field", "'%s' is not a distance field cache", filename.c_str());
+    close();
+    return false;
+  }
+  memcpy(&header, file_.data(), sizeof(header));
+  if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION)
+  {
+    ROS_ERROR_NAMED("distance_field", "'%s' is not a distance field cache of version %u", filename.c_str(),
+                    CACHE_VERSION);
+    close();
+    return false;
+  }
+  if (geometry_hash != 0 && header.geometry_hash != geometry_hash)
+  {
+    ROS_DEBUG_NAMED("distance_field", "Distance field cache '%s' was computed for different geometry",
+                    filename.c_str());
+    close();
+    return false;
+  }
+  std::size_t num_cells = 1;
+  for (int i = DIM_X; i <= DIM_Z; ++i)
+    num_cells *= std::max(0, header.num_cells[i]);
+  if (file_.size() < CACHE_DATA_OFFSET + num_cells * sizeof(float))
+  {
+    ROS_ERROR_NAMED("distance_field", "Distance field cache '%s' is truncated", filename.c_str());
+    close();
+    return false;
+  }
+
+  for (int i = DIM_X; i <= DIM_Z; ++i)
+    num_cells_[i] = header.num_cells[i];
+  size_x_ = header.size[DIM_X];
+  size_y_ = header.size[DIM_Y];
+  size_z_ = header.size[DIM_Z];
+  origin_x_ = header.origin[DIM_X];
+  origin_y_ = header.origin[DIM_Y];
+  origin_z_ = header.origin[DIM_Z];
+  resolution_ = header.resolution;
+  inv_twice_resolution_ = 1.0 / (2.0 * resolution_);
+  max_distance_ = header.max_distance;
+  geometry_hash_ = header.geometry_hash;
+  distances_ = reinterpret_cast<const float*>(file_.data() + CACHE_DATA_OFFSET);
+  return true;
+}
+
+void MappedDistanceField::close()
+{
+  overlay_.reset();
+  distances_ = NULL;
+  if (file_.is_open())
+    file_.close();
+}
+
+bool MappedDistanceField::setOverlay(const DistanceFieldPtr& overlay)
+{
+  if (overlay && (overlay->getXNumCells() != num_cells_[DIM_X] || overlay->getYNumCells() != num_cells_[DIM_Y] ||
+                  overlay->getZNumCells() != num_cells_[DIM_Z]))
+  {
+    ROS_ERROR_NAMED("distance_field", "The overlay does not have the same number of cells as the distance field cache");
+    return false;
+  }
+  overlay_ = overlay;
+  if (overlay_)
+    overlay_->reset();
+  return true;
+}
+
+void MappedDistanceField::addPointsToField(const EigenSTL::vector_Vector3d& points)
+{
+  if (overlay_)
+    overlay_->addPointsToField(points);
+  else
+    ROS_WARN_NAMED("distance_field", "Ignoring points added to a mapped distance field without overlay");
+}
+
+void MappedDistanceField::removePointsFromField(const EigenSTL::vector_Vector3d& points)
+{
+  if (overlay_)
+    overlay_->removePointsFromField(points);
+}
+
+void MappedDistanceField::updatePointsInField(const EigenSTL::vector_Vector3d& old_points,
+                                              const EigenSTL::vector_Vector3d& new_points)
+{
+  if (overlay_)
+    overlay_->updatePointsInField(old_points, new_points);
+  else
+    ROS_WARN_NAMED("distance_field", "Ignoring points added to a mapped distance field without overlay");
+}
+
+void MappedDistanceField::reset()
+{
+  if (overlay_)
+    overlay_->reset();
+}
+
+double MappedDistanceField::getDistance(double x, double y, double z) const
+{
+  int gx, gy, gz;
+  if (!worldToGrid(x, y, z, gx, gy, gz))
+    return max_distance_;
+  return getDistance(gx, gy, gz);
+}
+
+double MappedDistanceField::getDistance(int x, int y, int z) const
+{
+  double distance = distances_[(static_cast<std::size_t>(x) * num_cells_[DIM_Y] + y) * num_cells_[DIM_Z] + z];
+  if (overlay_)
+    distance = std::min(distance, overlay_->getDistance(x, y, z));
+  return distance;
+}
+
+bool MappedDistanceField::isCellValid(int x, int y, int z) const
+{
+  return x >= 0 && x < num_cells_[DIM_X] && y >= 0 && y < num_cells_[DIM_Y] && z >= 0 && z < num_cells_[DIM_Z];
+}
+
+int MappedDistanceField::getXNumCells() const
+{
+  return num_cells_[DIM_X];
+}
+
+int MappedDistanceField::getYNumCells() const
+{
+  return num_cells_[DIM_Y];
+}
+
+int MappedDistanceField::getZNumCells() const
+{
+  return num_cells_[DIM_Z];
+}
+
+bool MappedDistanceField::gridToWorld(int x, int y, int z, double& world_x, double& world_y, double& world_z) const
+{
+  world_x = origin_x_ + resolution_ * x;
+  world_y = origin_y_ + resolution_ * y;
+  world_z = origin_z_ + resolution_ * z;
+  return true;
+}
+
+bool MappedDistanceField::worldToGrid(double world_x, double world_y, double world_z, int& x, int& y, int& z) const
+{
+  // the rounded quantized location, as in VoxelGrid
+  x = int(floor((world_x - origin_x_) / resolution_ + 0.5));
+  y = int(floor((world_y - origin_y_) / resolution_ + 0.5));
+  z = int(floor((world_z - origin_z_) / resolution_ + 0.5));
+  return isCellValid(x, y, z);
+}
+
+bool MappedDistanceField::writeToStream(std::ostream& stream) const
+{
+  return writeCache(stream, *this, geometry_hash_);
+}
+
+bool MappedDistanceField::readFromStream(std::istream& /*stream*/)
+{
+  ROS_ERROR_NAMED("distance_field", "Mapped distance fields can only be read from files");
+  return false;
+}
+}
@@ -40,14 +40,18 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 
 namespace distance_field
 {
 PropagationDistanceField::PropagationDistanceField(double size_x, double size_y, double size_z, double resolution,
                                                    double origin_x, double origin_y, double origin_z,
-                                                   double max_distance, bool propagate_negative)
+                                                   double max_distance, bool propagate_negative, bool sparse)
   : DistanceField(size_x, size_y, size_z, resolution, origin_x, origin_y, origin_z)
   , propagate_negative_(propagate_negative)
+  , sparse_(sparse)
+  , thread_count_(1)
   , max_distance_(max_distance)
 {
   initialize();
@@ -55,10 +59,12 @@ PropagationDistanceField::PropagationDistanceField(double size_x, double size_y,
 
 PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree, const octomap::point3d& bbx_min,
                                                    const octomap::point3d& bbx_max, double max_distance,
-                                                   bool propagate_negative_distances)
+                                                   bool propagate_negative_distances, bool sparse)
   : DistanceField(bbx_max.x() - bbx_min.x(), bbx_max.y() - bbx_min.y(), bbx_max.z() - bbx_min.z(),
                   octree.getResolution(), bbx_min.x(), bbx_min.y(), bbx_min.z())
   , propagate_negative_(propagate_negative_distances)
+  , sparse_(sparse)
+  , thread_count_(1)
   , max_distance_(max_distance)
   , max_distance_sq_(0)  // avoid gcc warning about uninitialized value
 {
@@ -68,7 +74,11 @@ PropagationDistanceField::PropagationDistanceField(const octomap::OcTree& octree
 
 PropagationDistanceField::PropagationDistanceField(std::istream& is, double max_distance,
                                                    bool propagate_negative_distances)
-  : DistanceField(0, 0, 0, 0, 0, 0, 0), propagate_negative_(propagate_negative_distances), max_distance_(max_distance)
+  : DistanceField(0, 0, 0, 0, 0, 0, 0)
+  , propagate_negative_(propagate_negative_distances)
+  , sparse_(false)
+  , thread_count_(1)
+  , max_distance_(max_distance)
 {
   readFromStream(is);
 }
@@ -77,7 +87,8 @@ void PropagationDistanceField::initialize()
 {
   max_distance_sq_ = ceil(max_distance_ / resolution_) * ceil(max_distance_ / resolution_);
   voxel_grid_.reset(new VoxelGrid<PropDistanceFieldVoxel>(size_x_, size_y_, size_z_, resolution_, origin_x_, origin_y_,
-                                                          origin_z_, PropDistanceFieldVoxel(max_distance_sq_, 0)));
+                                                          origin_z_, PropDistanceFieldVoxel(max_distance_sq_, 0),
+                                                          sparse_));
 
   initNeighborhoods();
 
@@ -233,7 +244,8 @@ void PropagationDistanceField::addNewObstacleVoxels(const EigenSTL::vector_Vecto
   EigenSTL::vector_Vector3i negative_stack;
   if (propagate_negative_)
   {
-    negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+    // the stacks only hold the voxels affected by the change, so they are not reserved for the whole grid
+    negative_stack.reserve(voxel_points.size());
     negative_bucket_queue_[0].reserve(voxel_points.size());
   }
 
@@ -315,11 +327,12 @@ void PropagationDistanceField::removeObstacleVoxels(const EigenSTL::vector_Vecto
   EigenSTL::vector_Vector3i negative_stack;
   int initial_update_direction = getDirectionNumber(0, 0, 0);
 
-  stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+  // the stacks only hold the voxels affected by the change, so they are not reserved for the whole grid
+  stack.reserve(voxel_points.size());
   bucket_queue_[0].reserve(voxel_points.size());
   if (propagate_negative_)
   {
-    negative_stack.reserve(getXNumCells() * getYNumCells() * getZNumCells());
+    negative_stack.reserve(voxel_points.size());
     negative_bucket_queue_[0].reserve(voxel_points.size());
   }
 
@@ -395,8 +408,31 @@ void PropagationDistanceField::removeObstacleVoxels(const EigenSTL::vector_Vecto
   }
 }
 
+void PropagationDistanceField::setThreadCount(unsigned int thread_count)
+{
+  thread_count_ = thread_count;
+}
+
+unsigned int PropagationDistanceField::getPropagationThreadCount() const
+{
+  // narrower slabs would hand over most of their updates
+  static const int MIN_SLAB_WIDTH = 16;
+  unsigned int thread_count = thread_count_;
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  return std::max(1, std::min<int>(thread_count, getXNumCells() / MIN_SLAB_WIDTH));
+}
+
 void PropagationDistanceField::propagatePositive()
 {
+  unsigned int thread_count = getPropagationThreadCount();
+  if (thread_count > 1)
+  {
+    propagateParallel(bucket_queue_, thread_count, &PropDistanceFieldVoxel::distance_square_,
+                      &PropDistanceFieldVoxel::closest_point_, &PropDistanceFieldVoxel::update_direction_);
+    return;
+  }
+
   // now process the queue:
   for (unsigned int i = 0; i < bucket_queue_.size(); ++i)
   {
@@ -455,6 +491,15 @@ void PropagationDistanceField::propagatePositive()
 
 void PropagationDistanceField::propagateNegative()
 {
+  unsigned int thread_count = getPropagationThreadCount();
+  if (thread_count > 1)
+  {
+    propagateParallel(negative_bucket_queue_, thread_count, &PropDistanceFieldVoxel::negative_distance_square_,
+                      &PropDistanceFieldVoxel::closest_negative_point_,
+                      &PropDistanceFieldVoxel::negative_update_direction_);
+    return;
+  }
+
   // now process the queue:
   for (unsigned int i = 0; i < negative_bucket_queue_.size(); ++i)
   {
@@ -515,9 +560,140 @@ void PropagationDistanceField::propagateNegative()
   }
 }
 
+void PropagationDistanceField::propagateParallel(std::vector<EigenSTL::vector_Vector3i>& bucket_queue,
+                                                 unsigned int thread_count,
+                                                 int PropDistanceFieldVoxel::*distance_square,
+                                                 Eigen::Vector3i PropDistanceFieldVoxel::*closest_point,
+                                                 int PropDistanceFieldVoxel::*update_direction)
+{
+  // slab s holds the cells with slab_begin[s] <= x < slab_begin[s + 1]
+  const int num_x = getXNumCells();
+  std::vector<int> slab_begin(thread_count + 1);
+  for (unsigned int s = 0; s <= thread_count; ++s)
+  {
+    slab_begin[s] = num_x * s / thread_count;
+    // keep the blocks of sparse grids within one slab, so that threads never allocate the same block
+    if (s > 0 && s < thread_count)
+      slab_begin[s] &= ~((1 << VoxelGrid<PropDistanceFieldVoxel>::BLOCK_SHIFT) - 1);
+  }
+  std::vector<unsigned int> slab_of_x(num_x);
+  for (unsigned int s = 0; s < thread_count; ++s)
+    std::fill(slab_of_x.begin() + slab_begin[s], slab_of_x.begin() + slab_begin[s + 1], s);
+
+  // every slab has its own bucket queue; distribute the initial contents
+  std::vector<std::vector<EigenSTL::vector_Vector3i>> slab_queues(
+      thread_count, std::vector<EigenSTL::vector_Vector3i>(bucket_queue.size()));
+  for (std::size_t i = 0; i < bucket_queue.size(); ++i)
+  {
+    for (std::size_t k = 0; k < bucket_queue[i].size(); ++k)
+      slab_queues[slab_of_x[bucket_queue[i][k].x()]][i].push_back(bucket_queue[i][k]);
+    bucket_queue[i].clear();
+  }
+
+  // updates[src][dst] holds the updates slab src hands over to slab dst; the updates of one round are applied
+  // in the next, so there are two sets
+  std::vector<std::vector<std::vector<SlabUpdate>>> updates[2];
+  for (int r = 0; r < 2; ++r)
+    updates[r].assign(thread_count, std::vector<std::vector<SlabUpdate>>(thread_count));
+
+  for (unsigned int round = 0;; ++round)
+  {
+    std::vector<std::vector<std::vector<SlabUpdate>>>& received = updates[round % 2];
+    std::vector<std::vector<std::vector<SlabUpdate>>>& sent = updates[(round + 1) % 2];
+
+    auto worker = [&, this](unsigned int s) {
+      std::vector<EigenSTL::vector_Vector3i>& queue = slab_queues[s];
+      for (unsigned int src = 0; src < thread_count; ++src)
+      {
+        for (std::size_t k = 0; k < received[src][s].size(); ++k)
+        {
+          const SlabUpdate& update = received[src][s][k];
+          PropDistanceFieldVoxel& voxel =
+              voxel_grid_->getCell(update.location_.x(), update.location_.y(), update.location_.z());
+          if (update.distance_square_ < voxel.*distance_square)
+          {
+            voxel.*distance_square = update.distance_square_;
+            voxel.*closest_point = update.closest_point_;
+            voxel.*update_direction = update.update_direction_;
+            queue[update.distance_square_].push_back(update.location_);
+          }
+        }
+        received[src][s].clear();
+      }
+
+      // the same propagation as propagatePositive(), but neighbors in other slabs are handed over instead
+      for (std::size_t i = 0; i < queue.size(); ++i)
+      {
+        const int D = i > 1 ? 1 : i;
+        for (std::size_t k = 0; k < queue[i].size(); ++k)
+        {
+          const Eigen::Vector3i loc = queue[i][k];
+          const PropDistanceFieldVoxel& voxel = voxel_grid_->getCell(loc.x(), loc.y(), loc.z());
+          if (voxel.*update_direction < 0 || voxel.*update_direction > 26)
+          {
+            ROS_ERROR_NAMED("distance_field", "PROGRAMMING ERROR: Invalid update direction detected: %d",
+                            voxel.*update_direction);
+            continue;
+          }
+
+          const EigenSTL::vector_Vector3i& neighborhood = neighborhoods_[D][voxel.*update_direction];
+          for (std::size_t n = 0; n < neighborhood.size(); ++n)
+          {
+            const Eigen::Vector3i& diff = neighborhood[n];
+            Eigen::Vector3i nloc(loc.x() + diff.x(), loc.y() + diff.y(), loc.z() + diff.z());
+            if (!isCellValid(nloc.x(), nloc.y(), nloc.z()))
+              continue;
+
+            int new_distance_sq = eucDistSq(voxel.*closest_point, nloc);
+            if (new_distance_sq > max_distance_sq_)
+              continue;
+
+            if (nloc.x() < slab_begin[s] || nloc.x() >= slab_begin[s + 1])
+            {
+              SlabUpdate update;
+              update.location_ = nloc;
+              update.closest_point_ = voxel.*closest_point;
+              update.distance_square_ = new_distance_sq;
+              update.update_direction_ = getDirectionNumber(diff.x(), diff.y(), diff.z());
+              sent[s][slab_of_x[nloc.x()]].push_back(update);
+              continue;
+            }
+
+            PropDistanceFieldVoxel& neighbor = voxel_grid_->getCell(nloc.x(), nloc.y(), nloc.z());
+            if (new_distance_sq < neighbor.*distance_square)
+            {
+              neighbor.*distance_square = new_distance_sq;
+              neighbor.*closest_point = voxel.*closest_point;
+              neighbor.*update_direction = getDirectionNumber(diff.x(), diff.y(), diff.z());
+              queue[new_distance_sq].push_back(nloc);
+            }
+          }
+        }
+        queue[i].clear();
+      }
+    };
+
+    boost::thread_group workers;
+    for (unsigned int s = 1; s < thread_count; ++s)
+      workers.create_thread([&worker, s]() { worker(s); });
+    worker(0);
+    workers.join_all();
+
+    bool handed_over = false;
+    for (unsigned int src = 0; src < thread_count && !handed_over; ++src)
+      for (unsigned int dst = 0; dst < thread_count && !handed_over; ++dst)
+        handed_over = !sent[src][dst].empty();
+    if (!handed_over)
+      break;
+  }
+}
+
 void PropagationDistanceField::reset()
 {
   voxel_grid_->reset(PropDistanceFieldVoxel(max_distance_sq_, 0));
+  // sparse grids leave closest_negative_point_ uninitialized, which is treated the same as the cell itself
+  if (sparse_)
+    return;
   for (int x = 0; x < getXNumCells(); x++)
   {
     for (int y = 0; y < getYNumCells(); y++)
@@ -535,6 +711,14 @@ void PropagationDistanceField::reset()
   // object_voxel_locations_.clear();
 }
 
+std::size_t PropagationDistanceField::getVoxelMemoryUsage() const
+{
+  if (sparse_)
+    return voxel_grid_->getNumAllocatedBlocks() * (1 << (3 * VoxelGrid<PropDistanceFieldVoxel>::BLOCK_SHIFT)) *
+           sizeof(PropDistanceFieldVoxel);
+  return static_cast<std::size_t>(getXNumCells()) * getYNumCells() * getZNumCells() * sizeof(PropDistanceFieldVoxel);
+}
+
 void PropagationDistanceField::initNeighborhoods()
 {
   // first initialize the direction number mapping:
@@ -613,6 +797,18 @@ double PropagationDistanceField::getDistance(int x, int y, int z) const
   return getDistance(voxel_grid_->getCell(x, y, z));
 }
 
+void PropagationDistanceField::getDistanceGradients(const EigenSTL::vector_Vector3d& points,
+                                                    std::vector<double>& distances,
+                                                    EigenSTL::vector_Vector3d& gradients, std::vector<bool>& in_bounds,
+                                                    bool interpolate) const
+{
+  const VoxelGrid<PropDistanceFieldVoxel>& grid = *voxel_grid_;
+  DistanceField::getDistanceGradients(points, distances, gradients, in_bounds, interpolate,
+                                      [this, &grid](int x, int y, int z) {
+                                        return PropagationDistanceField::getDistance(grid.getCell(x, y, z));
+                                      });
+}
+
 bool PropagationDistanceField::isCellValid(int x, int y, int z) const
 {
   return voxel_grid_->isCellValid(x, y, z);
@@ -38,13 +38,18 @@
 
 #include <moveit/distance_field/voxel_grid.h>
 #include <moveit/distance_field/propagation_distance_field.h>
+#include <moveit/distance_field/euclidean_distance_field.h>
+#include <moveit/distance_field/mapped_distance_field.h>
 #include <moveit/distance_field/find_internal_points.h>
 #include <geometric_shapes/body_operations.h>
+#include <geometric_shapes/mesh_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <octomap/octomap.h>
 #include <ros/console.h>
 
 #include <memory>
+#include <limits>
+#include <sstream>
 
 using namespace distance_field;
 
@@ -651,6 +656,93 @@ TEST(TestSignedPropagationDistanceField, TestShape)
   ASSERT_TRUE(areDistanceFieldsDistancesEqual(df, test_df));
 }
 
+TEST(TestSignedPropagationDistanceField, TestDistanceGradients)
+{
+  PropagationDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  shapes::Sphere sphere(.25);
+  df.addShapeToField(&sphere, Eigen::Affine3d(Eigen::Translation3d(0.5, 0.5, 0.5)));
+
+  EigenSTL::vector_Vector3d points;
+  for (double x = -0.05; x < width + 0.1; x += 0.037)
+    points.push_back(Eigen::Vector3d(x, 0.43, 0.61));
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::vector<bool> in_bounds;
+
+  // without interpolation the results are those of single queries
+  df.getDistanceGradients(points, distances, gradients, in_bounds);
+  ASSERT_EQ(distances.size(), points.size());
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    Eigen::Vector3d grad;
+    bool bounds;
+    double dist = df.getDistanceGradient(points[i].x(), points[i].y(), points[i].z(), grad.x(), grad.y(), grad.z(),
+                                         bounds);
+    EXPECT_EQ(bool(in_bounds[i]), bounds);
+    EXPECT_EQ(distances[i], dist);
+    EXPECT_TRUE(gradients[i].isApprox(grad) || (gradients[i].isZero() && grad.isZero()));
+  }
+
+  // with interpolation, cell centers have the distance of the cell, and the distance changes continuously
+  points.clear();
+  for (double x = 0.1; x < 0.9; x += 0.01)
+    points.push_back(Eigen::Vector3d(x, 0.4, 0.6));
+  df.getDistanceGradients(points, distances, gradients, in_bounds, true);
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    ASSERT_TRUE(in_bounds[i]);
+    if (i > 0)
+    {
+      EXPECT_LE(std::abs(distances[i] - distances[i - 1]), 0.01 * 3.0);
+      // the gradient along x predicts the change of the distance within the cell
+      EXPECT_NEAR(distances[i] - distances[i - 1], 0.01 * 0.5 * (gradients[i].x() + gradients[i - 1].x()),
+                  0.01 * 2.0);
+    }
+  }
+  EigenSTL::vector_Vector3d centers(1, Eigen::Vector3d(0.4, 0.4, 0.6));
+  df.getDistanceGradients(centers, distances, gradients, in_bounds, true);
+  EXPECT_NEAR(distances[0], df.getDistance(0.4, 0.4, 0.6), 1e-9);
+}
+
+TEST(TestFindInternalPoints, TestNonConvexMesh)
+{
+  // a mesh of two separate boxes; its convex hull would also cover the space in between
+  std::unique_ptr<shapes::Mesh> box(shapes::createMeshFromShape(shapes::Box(0.2, 0.2, 0.2)));
+  shapes::Mesh mesh(2 * box->vertex_count, 2 * box->triangle_count);
+  for (unsigned int b = 0; b < 2; ++b)
+  {
+    for (unsigned int i = 0; i < box->vertex_count; ++i)
+    {
+      mesh.vertices[3 * (b * box->vertex_count + i)] = box->vertices[3 * i] + (b == 0 ? -0.3 : 0.3);
+      mesh.vertices[3 * (b * box->vertex_count + i) + 1] = box->vertices[3 * i + 1];
+      mesh.vertices[3 * (b * box->vertex_count + i) + 2] = box->vertices[3 * i + 2];
+    }
+    for (unsigned int i = 0; i < 3 * box->triangle_count; ++i)
+      mesh.triangles[3 * b * box->triangle_count + i] = box->triangles[i] + b * box->vertex_count;
+  }
+
+  Eigen::Affine3d pose = Eigen::Translation3d(0.013, 0.021, 0.017) * Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitZ());
+  EigenSTL::vector_Vector3d points;
+  findInternalPointsMesh(mesh, pose, 0.02, points);
+
+  std::size_t left = 0, right = 0;
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    Eigen::Vector3d local = pose.inverse() * points[i];
+    EXPECT_GT(std::abs(local.x()), 0.19);
+    EXPECT_LT(std::abs(local.x()), 0.41);
+    if (local.x() < 0.0)
+      ++left;
+    else
+      ++right;
+  }
+  // about (0.2 / 0.02)^3 points each
+  EXPECT_GT(left, 800u);
+  EXPECT_LT(left, 1400u);
+  EXPECT_GT(right, 800u);
+  EXPECT_LT(right, 1400u);
+}
+
 static const double PERF_WIDTH = 3.0;
 static const double PERF_HEIGHT = 3.0;
 static const double PERF_DEPTH = 4.0;
@@ -932,6 +1024,186 @@ TEST(TestSignedPropagationDistanceField, TestReadWrite)
   EXPECT_FALSE(areDistanceFieldsDistancesEqual(df, df3));
 }
 
+TEST(TestSignedPropagationDistanceField, TestParallelPropagation)
+{
+  PropagationDistanceField serial(3.2, 1.0, 1.0, 0.05, 0.0, 0.0, 0.0, 0.3, true);
+  PropagationDistanceField parallel(3.2, 1.0, 1.0, 0.05, 0.0, 0.0, 0.0, 0.3, true);
+  parallel.setThreadCount(4);
+
+  // obstacles scattered over the whole grid, so propagation crosses the slab boundaries
+  EigenSTL::vector_Vector3d points, removed;
+  for (unsigned int i = 0; i < 400; ++i)
+  {
+    Eigen::Vector3d p(fmod(0.731 * i, 3.2), fmod(0.377 * i, 1.0), fmod(0.593 * i, 1.0));
+    points.push_back(p);
+    if (i % 3 == 0)
+      removed.push_back(p);
+  }
+  serial.addPointsToField(points);
+  parallel.addPointsToField(points);
+
+  // compare after adding all points, and after removing a third of them again
+  for (int step = 0; step < 2; ++step)
+  {
+    if (step == 1)
+    {
+      serial.removePointsFromField(removed);
+      parallel.removePointsFromField(removed);
+    }
+    for (int x = 0; x < serial.getXNumCells(); ++x)
+      for (int y = 0; y < serial.getYNumCells(); ++y)
+        for (int z = 0; z < serial.getZNumCells(); ++z)
+        {
+          ASSERT_EQ(serial.getCell(x, y, z).distance_square_ == 0, parallel.getCell(x, y, z).distance_square_ == 0);
+          ASSERT_NEAR(serial.getDistance(x, y, z), parallel.getDistance(x, y, z), 0.05);
+        }
+  }
+}
+
+TEST(TestSignedPropagationDistanceField, TestSparse)
+{
+  PropagationDistanceField dense(3.2, 3.2, 3.2, 0.05, 0.0, 0.0, 0.0, 0.2, true);
+  PropagationDistanceField sparse(3.2, 3.2, 3.2, 0.05, 0.0, 0.0, 0.0, 0.2, true, true);
+  PropagationDistanceField sparse_parallel(3.2, 3.2, 3.2, 0.05, 0.0, 0.0, 0.0, 0.2, true, true);
+  sparse_parallel.setThreadCount(4);
+  EXPECT_TRUE(sparse.isSparse());
+  EXPECT_FALSE(dense.isSparse());
+  EXPECT_EQ(sparse.getVoxelMemoryUsage(), 0u);
+
+  // a few small obstacles in a large volume
+  EigenSTL::vector_Vector3d points, removed;
+  for (unsigned int i = 0; i < 20; ++i)
+  {
+    Eigen::Vector3d p(0.1 + fmod(0.731 * i, 3.0), 0.4 + fmod(0.377 * i, 0.2), 0.8 + fmod(0.593 * i, 0.2));
+    points.push_back(p);
+    if (i % 4 == 0)
+      removed.push_back(p);
+  }
+  dense.addPointsToField(points);
+  sparse.addPointsToField(points);
+  sparse_parallel.addPointsToField(points);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(dense, sparse));
+  EXPECT_LT(sparse.getVoxelMemoryUsage(), dense.getVoxelMemoryUsage() / 4);
+
+  dense.removePointsFromField(removed);
+  sparse.removePointsFromField(removed);
+  sparse_parallel.removePointsFromField(removed);
+  EXPECT_TRUE(areDistanceFieldsDistancesEqual(dense, sparse));
+  for (int x = 0; x < dense.getXNumCells(); ++x)
+    for (int y = 0; y < dense.getYNumCells(); ++y)
+      for (int z = 0; z < dense.getZNumCells(); ++z)
+        ASSERT_NEAR(dense.getDistance(x, y, z), sparse_parallel.getDistance(x, y, z), 0.05);
+
+  sparse.reset();
+  EXPECT_EQ(sparse.getVoxelMemoryUsage(), 0u);
+}
+
+TEST(TestEuclideanDistanceField, TestExactDistances)
+{
+  EuclideanDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  EuclideanDistanceField parallel_df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  parallel_df.setThreadCount(4);
+
+  // a small box and two single points
+  EigenSTL::vector_Vector3d points;
+  for (double x = 0.4; x < 0.75; x += resolution)
+    for (double y = 0.4; y < 0.75; y += resolution)
+      for (double z = 0.2; z < 0.55; z += resolution)
+        points.push_back(Eigen::Vector3d(x, y, z));
+  points.push_back(point1);
+  points.push_back(point2);
+  df.addPointsToField(points);
+  parallel_df.addPointsToField(points);
+
+  // compare against a brute force search over all cells
+  int num_x = df.getXNumCells(), num_y = df.getYNumCells(), num_z = df.getZNumCells();
+  for (int x = 0; x < num_x; ++x)
+    for (int y = 0; y < num_y; ++y)
+      for (int z = 0; z < num_z; ++z)
+      {
+        bool occupied = df.isCellOccupied(x, y, z);
+        int best = std::numeric_limits<int>::max();
+        for (int ox = 0; ox < num_x; ++ox)
+          for (int oy = 0; oy < num_y; ++oy)
+            for (int oz = 0; oz < num_z; ++oz)
+              if (df.isCellOccupied(ox, oy, oz) != occupied)
+                best = std::min(best, (ox - x) * (ox - x) + (oy - y) * (oy - y) + (oz - z) * (oz - z));
+        double expected = std::min(sqrt(double(best)) * resolution, max_dist);
+        if (occupied)
+          expected = -expected;
+        ASSERT_NEAR(expected, df.getDistance(x, y, z), 1e-5) << x << " " << y << " " << z;
+        ASSERT_EQ(df.getDistance(x, y, z), parallel_df.getDistance(x, y, z));
+      }
+
+  // batched gradient queries match single queries
+  EigenSTL::vector_Vector3d queries;
+  for (double x = -0.05; x < 1.05; x += 0.07)
+    for (double y = 0.05; y < 0.95; y += 0.11)
+      queries.push_back(Eigen::Vector3d(x, y, 0.35));
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  parallel_df.getDistanceGradients(queries, distances, gradients);
+  ASSERT_EQ(queries.size(), distances.size());
+  for (std::size_t i = 0; i < queries.size(); ++i)
+  {
+    Eigen::Vector3d gradient;
+    bool in_bounds;
+    double distance = df.getDistanceGradient(queries[i].x(), queries[i].y(), queries[i].z(), gradient.x(),
+                                             gradient.y(), gradient.z(), in_bounds);
+    EXPECT_EQ(distance, distances[i]);
+    EXPECT_TRUE(gradient == gradients[i]);
+  }
+
+  // removing everything leaves the maximum distance, and a stream round trip restores the obstacles
+  std::stringstream stream;
+  df.writeToStream(stream);
+  df.removePointsFromField(points);
+  EXPECT_EQ(max_dist, df.getDistance(5, 5, 3));
+  ASSERT_TRUE(df.readFromStream(stream));
+  EXPECT_EQ(parallel_df.getDistance(5, 5, 3), df.getDistance(5, 5, 3));
+  EXPECT_TRUE(df.isCellOccupied(5, 5, 3));
+}
+
+TEST(TestMappedDistanceField, TestCache)
+{
+  std::vector<shapes::ShapeConstPtr> shapes(1, shapes::ShapeConstPtr(new shapes::Box(0.2, 0.2, 0.2)));
+  EigenSTL::vector_Affine3d poses(1, Eigen::Affine3d(Eigen::Translation3d(0.5, 0.5, 0.5)));
+  uint64_t hash = MappedDistanceField::computeGeometryHash(shapes, poses, resolution);
+  EXPECT_EQ(hash, MappedDistanceField::computeGeometryHash(shapes, poses, resolution));
+  EXPECT_NE(hash, MappedDistanceField::computeGeometryHash(shapes, poses, resolution / 2));
+
+  PropagationDistanceField df(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true);
+  df.addShapeToField(shapes[0].get(), poses[0]);
+  std::string filename = MappedDistanceField::getCacheFilename("", hash);
+  ASSERT_TRUE(MappedDistanceField::writeCache(filename, df, hash));
+
+  MappedDistanceField mapped;
+  EXPECT_FALSE(mapped.open(filename, hash + 1));
+  ASSERT_TRUE(mapped.open(filename, hash));
+  ASSERT_EQ(df.getXNumCells(), mapped.getXNumCells());
+  ASSERT_EQ(df.getYNumCells(), mapped.getYNumCells());
+  ASSERT_EQ(df.getZNumCells(), mapped.getZNumCells());
+  for (int x = 0; x < df.getXNumCells(); ++x)
+    for (int y = 0; y < df.getYNumCells(); ++y)
+      for (int z = 0; z < df.getZNumCells(); ++z)
+        ASSERT_FLOAT_EQ(df.getDistance(x, y, z), mapped.getDistance(x, y, z));
+  EXPECT_FLOAT_EQ(df.getDistance(0.52, 0.48, 0.5), mapped.getDistance(0.52, 0.48, 0.5));
+  EXPECT_EQ(max_dist, mapped.getDistance(-1.0, 0.5, 0.5));
+
+  // dynamic obstacles go to the overlay
+  DistanceFieldPtr overlay(
+      new PropagationDistanceField(width, height, depth, resolution, origin_x, origin_y, origin_z, max_dist, true));
+  ASSERT_TRUE(mapped.setOverlay(overlay));
+  EigenSTL::vector_Vector3d points(1, point1);
+  mapped.addPointsToField(points);
+  EXPECT_GT(0.0, mapped.getDistance(point1.x(), point1.y(), point1.z()));
+  EXPECT_FLOAT_EQ(df.getDistance(5, 5, 5), mapped.getDistance(5, 5, 5));
+  mapped.reset();
+  EXPECT_FLOAT_EQ(df.getDistance(point1.x(), point1.y(), point1.z()),
+                  mapped.getDistance(point1.x(), point1.y(), point1.z()));
+  std::remove(filename.c_str());
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
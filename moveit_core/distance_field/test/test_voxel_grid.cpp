@@ -95,6 +95,35 @@ TEST(TestVoxelGrid, TestReadWrite)
       }
 }
 
+TEST(TestVoxelGrid, TestSparse)
+{
+  VoxelGrid<int> vg(0.2, 0.2, 0.2, 0.01, 0, 0, 0, -100, true);
+  const VoxelGrid<int>& const_vg = vg;
+  EXPECT_TRUE(vg.isSparse());
+  EXPECT_EQ(vg.getNumCells(DIM_X), 20);
+
+  // reading without writing does not allocate
+  vg.reset(7);
+  EXPECT_EQ(const_vg.getCell(3, 4, 5), 7);
+  EXPECT_EQ(const_vg.getCell(19, 19, 19), 7);
+  EXPECT_EQ(vg.getNumAllocatedBlocks(), 0u);
+
+  // writing allocates the block of the cell only
+  vg.setCell(3, 4, 5, 1);
+  vg.getCell(19, 19, 19) = 2;
+  EXPECT_EQ(vg.getNumAllocatedBlocks(), 2u);
+  EXPECT_EQ(const_vg.getCell(3, 4, 5), 1);
+  EXPECT_EQ(const_vg.getCell(3, 4, 6), 7);
+  EXPECT_EQ(const_vg.getCell(19, 19, 19), 2);
+  EXPECT_EQ(const_vg.getCell(10, 10, 10), 7);
+  EXPECT_EQ(vg.getNumAllocatedBlocks(), 2u);
+
+  // resetting releases all blocks
+  vg.reset(0);
+  EXPECT_EQ(vg.getNumAllocatedBlocks(), 0u);
+  EXPECT_EQ(const_vg.getCell(3, 4, 5), 0);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -42,6 +42,7 @@
 #include <kdl/chainidsolver_recursive_newton_euler.hpp>
 
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
 #include <geometry_msgs/Vector3.h>
 #include <geometry_msgs/Wrench.h>
 
@@ -115,6 +116,31 @@ public:
   bool getPayloadTorques(const std::vector<double>& joint_angles, double payload,
                          std::vector<double>& joint_torques) const;
 
+  /**
+   * @brief Get the torques at every waypoint of a trajectory of this group, for the positions, velocities and
+   * accelerations of the waypoints and a payload attached to the origin of the last link of this group. Velocities and
+   * accelerations that a waypoint does not have are taken to be zero. The waypoints are split over up to
+   * \e thread_count threads (0 means one per hardware thread), each of which reuses one solver for its waypoints.
+   * @param trajectory The trajectory; its waypoints must have up to date transforms
+   * @param payload The payload for which to compute torques (in kg)
+   * @param torques The torques at each waypoint, in the order of the joints of this group
+   * @return False if the trajectory is not for this group or the torques could not be computed
+   */
+  bool getTorques(const robot_trajectory::RobotTrajectory& trajectory, double payload,
+                  std::vector<std::vector<double> >& torques, unsigned int thread_count = 0) const;
+
+  /**
+   * @brief Get the maximum payload (in kg) that this group can hold at every waypoint of a trajectory, as computed by
+   * getMaxPayload() for the positions of the waypoints. The waypoints are split over up to \e thread_count threads
+   * (0 means one per hardware thread).
+   * @param trajectory The trajectory; its waypoints must have up to date transforms
+   * @param payloads The maximum payload at each waypoint
+   * @param joints_saturated The first saturated joint at each waypoint
+   * @return False if the trajectory is not for this group or the payloads could not be computed
+   */
+  bool getMaxPayloads(const robot_trajectory::RobotTrajectory& trajectory, std::vector<double>& payloads,
+                      std::vector<unsigned int>& joints_saturated, unsigned int thread_count = 0) const;
+
   /**
    * @brief Get maximum torques for this group
    * @return Vector of max torques
@@ -136,6 +162,12 @@ public:
   }
 
 private:
+  /** @brief Call \e evaluate(workspace, state, index) for every waypoint of \e trajectory, sharing one workspace
+   * per thread */
+  template <typename Evaluate>
+  bool forEachWayPoint(const robot_trajectory::RobotTrajectory& trajectory, unsigned int thread_count,
+                       const Evaluate& evaluate) const;
+
   std::shared_ptr<KDL::ChainIdSolver_RNE> chain_id_solver_;  // KDL chain inverse dynamics
   KDL::Chain kdl_chain_;                                     // KDL chain
 
@@ -148,7 +180,8 @@ private:
   unsigned int num_joints_, num_segments_;  // number of joints in group, number of segments in group
   std::vector<double> max_torques_;         // vector of max torques
 
-  double gravity_;  // Norm of the gravity vector passed in initialize()
+  double gravity_;              // Norm of the gravity vector passed in initialize()
+  KDL::Vector gravity_vector_;  // Gravity vector passed in initialize()
 };
 }
 #endif
@@ -45,6 +45,9 @@
 #include <kdl/chainjnttojacsolver.hpp>
 #include <kdl/tree.hpp>
 
+#include <boost/thread.hpp>
+#include <atomic>
+
 namespace dynamics_solver
 {
 namespace
@@ -62,6 +65,38 @@ inline geometry_msgs::Vector3 transformVector(const Eigen::Affine3d& transform,
 
   return result;
 }
+
+// The solver and buffers for computing the dynamics of one state after another
+struct Workspace
+{
+  Workspace(const KDL::Chain& chain, const KDL::Vector& gravity)
+    : solver(chain, gravity)
+    , angles(chain.getNrOfJoints())
+    , velocities(chain.getNrOfJoints())
+    , accelerations(chain.getNrOfJoints())
+    , torques(chain.getNrOfJoints())
+    , wrenches(chain.getNrOfSegments())
+  {
+  }
+
+  KDL::ChainIdSolver_RNE solver;
+  KDL::JntArray angles, velocities, accelerations, torques;
+  KDL::Wrenches wrenches;
+  std::vector<double> values;
+};
+
+// Compute the torques for the joint values in the workspace, with the force (in the base frame) applied to the origin
+// of the tip link and no other external wrenches
+bool computeTorques(Workspace& workspace, const Eigen::Affine3d& base_frame, const Eigen::Affine3d& tip_frame,
+                    const Eigen::Vector3d& force)
+{
+  Eigen::Vector3d local_force = (tip_frame.inverse(Eigen::Isometry) * base_frame).linear() * force;
+  for (std::size_t i = 0; i < workspace.wrenches.size(); ++i)
+    workspace.wrenches[i] = KDL::Wrench::Zero();
+  workspace.wrenches.back().force = KDL::Vector(local_force.x(), local_force.y(), local_force.z());
+  return workspace.solver.CartToJnt(workspace.angles, workspace.velocities, workspace.accelerations,
+                                    workspace.wrenches, workspace.torques) >= 0;
+}
 }
 
 DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr& robot_model, const std::string& group_name,
@@ -136,6 +171,7 @@ DynamicsSolver::DynamicsSolver(const robot_model::RobotModelConstPtr& robot_mode
   KDL::Vector gravity(gravity_vector.x, gravity_vector.y,
                       gravity_vector.z);  // \todo Not sure if KDL expects the negative of this (Sachin)
   gravity_ = gravity.Norm();
+  gravity_vector_ = gravity;
   ROS_DEBUG_NAMED("dynamics_solver", "Gravity norm set to %f", gravity_);
 
   chain_id_solver_.reset(new KDL::ChainIdSolver_RNE(kdl_chain_, gravity));
@@ -312,6 +348,133 @@ bool DynamicsSolver::getPayloadTorques(const std::vector<double>& joint_angles,
   return getTorques(joint_angles, joint_velocities, joint_accelerations, wrenches, joint_torques);
 }
 
+template <typename Evaluate>
+bool DynamicsSolver::forEachWayPoint(const robot_trajectory::RobotTrajectory& trajectory, unsigned int thread_count,
+                                     const Evaluate& evaluate) const
+{
+  if (!joint_model_group_)
+  {
+    ROS_DEBUG_NAMED("dynamics_solver", "Did not construct DynamicsSolver object properly. "
+                                       "Check error logs.");
+    return false;
+  }
+  if (trajectory.getGroup() != joint_model_group_)
+  {
+    ROS_ERROR_NAMED("dynamics_solver", "Trajectory is not for group '%s'", joint_model_group_->getName().c_str());
+    return false;
+  }
+
+  // waypoints of compact trajectories are materialized on first access, so that is done before spreading them out
+  std::vector<const robot_state::RobotState*> states(trajectory.getWayPointCount());
+  for (std::size_t i = 0; i < states.size(); ++i)
+    states[i] = &trajectory.getWayPoint(i);
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, states.size());
+
+  // each worker repeatedly claims the next waypoint that was not evaluated yet
+  std::atomic<std::size_t> next(0);
+  std::atomic<bool> success(true);
+  auto work = [this, &states, &next, &success, &evaluate]() {
+    Workspace workspace(kdl_chain_, gravity_vector_);
+    for (std::size_t i = next++; i < states.size() && success; i = next++)
+    {
+      states[i]->copyJointGroupPositions(joint_model_group_, workspace.values);
+      for (unsigned int j = 0; j < num_joints_; ++j)
+        workspace.angles(j) = workspace.values[j];
+      workspace.velocities.data.setZero();
+      workspace.accelerations.data.setZero();
+      if (!evaluate(workspace, *states[i], i))
+        success = false;
+    }
+  };
+
+  if (thread_count < 2)
+    work();
+  else
+  {
+    boost::thread_group workers;
+    for (std::size_t t = 0; t < thread_count; ++t)
+      workers.create_thread(work);
+    workers.join_all();
+  }
+
+  if (!success)
+    ROS_ERROR_NAMED("dynamics_solver", "Something went wrong computing torques");
+  return success;
+}
+
+bool DynamicsSolver::getTorques(const robot_trajectory::RobotTrajectory& trajectory, double payload,
+                                std::vector<std::vector<double> >& torques, unsigned int thread_count) const
+{
+  torques.assign(trajectory.getWayPointCount(), std::vector<double>(num_joints_, 0.0));
+  const Eigen::Vector3d force(0.0, 0.0, payload * gravity_);
+  return forEachWayPoint(trajectory, thread_count, [this, &torques, &force](
+                                                        Workspace& workspace, const robot_state::RobotState& state,
+                                                        std::size_t index) {
+    if (state.hasVelocities())
+    {
+      state.copyJointGroupVelocities(joint_model_group_, workspace.values);
+      for (unsigned int j = 0; j < num_joints_; ++j)
+        workspace.velocities(j) = workspace.values[j];
+    }
+    if (state.hasAccelerations())
+    {
+      state.copyJointGroupAccelerations(joint_model_group_, workspace.values);
+      for (unsigned int j = 0; j < num_joints_; ++j)
+        workspace.accelerations(j) = workspace.values[j];
+    }
+    if (!computeTorques(workspace, state.getFrameTransform(base_name_), state.getFrameTransform(tip_name_), force))
+      return false;
+    for (unsigned int j = 0; j < num_joints_; ++j)
+      torques[index][j] = workspace.torques(j);
+    return true;
+  });
+}
+
+bool DynamicsSolver::getMaxPayloads(const robot_trajectory::RobotTrajectory& trajectory, std::vector<double>& payloads,
+                                    std::vector<unsigned int>& joints_saturated, unsigned int thread_count) const
+{
+  payloads.assign(trajectory.getWayPointCount(), 0.0);
+  joints_saturated.assign(trajectory.getWayPointCount(), 0);
+  return forEachWayPoint(trajectory, thread_count, [this, &payloads, &joints_saturated](
+                                                        Workspace& workspace, const robot_state::RobotState& state,
+                                                        std::size_t index) {
+    // torques without payload; a joint that these already saturate leaves no payload
+    const Eigen::Affine3d& base_frame = state.getFrameTransform(base_name_);
+    const Eigen::Affine3d& tip_frame = state.getFrameTransform(tip_name_);
+    if (!computeTorques(workspace, base_frame, tip_frame, Eigen::Vector3d::Zero()))
+      return false;
+    KDL::JntArray zero_torques = workspace.torques;
+    for (unsigned int i = 0; i < num_joints_; ++i)
+      if (fabs(zero_torques(i)) >= max_torques_[i])
+      {
+        payloads[index] = 0.0;
+        joints_saturated[index] = i;
+        return true;
+      }
+
+    // torques for a unit force; the payload scales them linearly
+    if (!computeTorques(workspace, base_frame, tip_frame, Eigen::Vector3d(0.0, 0.0, 1.0)))
+      return false;
+    double min_payload = std::numeric_limits<double>::max();
+    for (unsigned int i = 0; i < num_joints_; ++i)
+    {
+      double unit_torque = workspace.torques(i) - zero_torques(i);
+      double payload_joint = std::max<double>((max_torques_[i] - zero_torques(i)) / unit_torque,
+                                              (-max_torques_[i] - zero_torques(i)) / unit_torque);
+      if (payload_joint < min_payload)
+      {
+        min_payload = payload_joint;
+        joints_saturated[index] = i;
+      }
+    }
+    payloads[index] = min_payload / gravity_;
+    return true;
+  });
+}
+
 const std::vector<double>& DynamicsSolver::getMaxTorques() const
 {
   return max_torques_;
@@ -0,0 +1,112 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_KINEMATIC_CONSTRAINTS_CONSTRAINT_SET_CACHE_
+#define MOVEIT_KINEMATIC_CONSTRAINTS_CONSTRAINT_SET_CACHE_
+
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <boost/noncopyable.hpp>
+#include <list>
+#include <map>
+#include <string>
+
+namespace kinematic_constraints
+{
+MOVEIT_CLASS_FORWARD(KinematicConstraintSetCache);
+
+/** \brief A cache of configured KinematicConstraintSet's, for callers that configure the same constraints again and
+ * again (e.g., the goal and path constraints of planning requests that refer to named constraints).
+ *
+ * Configuring a set resolves frames through the transforms and constructs the bodies of position constraint
+ * regions. Sets are looked up by the constraints message (ignoring the header stamps), the robot model and the
+ * transforms that configuring the set reads: those of the fixed frames the constraints are expressed in. A set
+ * returned by the cache is shared by all callers that ask for the same constraints and must not be modified; sets
+ * are safe to evaluate from multiple threads. The least recently used sets are dropped once the cache is full. */
+class KinematicConstraintSetCache : private boost::noncopyable
+{
+public:
+  /** \brief Constructor. At most \e max_sets sets are kept; 0 disables caching */
+  KinematicConstraintSetCache(std::size_t max_sets = 256);
+
+  /** \brief The cache shared by the whole process */
+  static KinematicConstraintSetCache& instance();
+
+  /** \brief Get a set configured for the constraints \e constr of \e model, with the frames resolved by \e tf. If
+   *  \e ok is not NULL, it is set to the return value of KinematicConstraintSet::add() */
+  KinematicConstraintSetConstPtr getConstraintSet(const robot_model::RobotModelConstPtr& model,
+                                                  const moveit_msgs::Constraints& constr,
+                                                  const robot_state::Transforms& tf, bool* ok = NULL);
+
+  /** \brief Set the maximum number of sets kept; 0 disables caching */
+  void setMaxSize(std::size_t max_sets);
+
+  std::size_t getMaxSize() const
+  {
+    return max_sets_;
+  }
+
+  /** \brief The number of sets currently kept */
+  std::size_t size() const;
+
+  /** \brief The number of lookups that found a configured set */
+  std::size_t getHitCount() const;
+
+  /** \brief The number of lookups that had to configure a new set */
+  std::size_t getMissCount() const;
+
+  /** \brief Forget all sets */
+  void clear();
+
+  /** \brief Compute the key under which the sets for \e constr of \e model are kept, given the transforms \e tf */
+  static std::string getKey(const robot_model::RobotModel& model, const moveit_msgs::Constraints& constr,
+                            const robot_state::Transforms& tf);
+
+private:
+  struct Entry
+  {
+    std::string key;
+    KinematicConstraintSetConstPtr set;
+    bool ok;
+  };
+
+  std::size_t max_sets_;
+  std::size_t hits_;
+  std::size_t misses_;
+  std::list<Entry> entries_;  // most recently used first
+  std::map<std::string, std::list<Entry>::iterator> entry_index_;
+  mutable boost::mutex lock_;
+};
+}
+
+#endif
@@ -45,6 +45,7 @@
 
 #include <geometric_shapes/bodies.h>
 #include <moveit_msgs/Constraints.h>
+#include <boost/thread/mutex.hpp>
 
 #include <iostream>
 #include <vector>
@@ -832,8 +833,33 @@ protected:
    */
   bool decideContact(const collision_detection::Contact& contact) const;
 
+  /**
+   * \brief Build a trimesh of the cone from \e apex to the disc approximated by \e base_points around \e base_center
+   */
+  shapes::Mesh* createVisibilityCone(const Eigen::Vector3d& apex, const Eigen::Vector3d& base_center,
+                                     const EigenSTL::vector_Vector3d& base_points) const;
+
+  /**
+   * \brief A collision world that holds the cone, kept for evaluating the constraint in a later call.
+   *
+   * The cone mesh is expressed in the target frame and is only rebuilt if the sensor moved relative to the target;
+   * otherwise it is just moved to the current target pose.
+   */
+  struct ConeWorld
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    collision_detection::CollisionWorldPtr world_;
+    shapes::ShapeConstPtr cone_;
+    Eigen::Affine3d sensor_in_target_; /**< \brief The pose of the sensor in the target frame \e cone_ was built for */
+  };
+
   collision_detection::CollisionRobotPtr collision_robot_; /**< \brief A copy of the collision robot maintained for
                                                               collision checking the cone against robot links */
+  collision_detection::AllowedCollisionMatrix acm_; /**< \brief Allows the contacts accepted by decideContact() */
+  std::vector<const robot_model::LinkModel*> cone_links_; /**< \brief The links the cone can collide with */
+  mutable std::vector<std::shared_ptr<ConeWorld> > cone_worlds_; /**< \brief Worlds not in use by a decide() call */
+  mutable boost::mutex cone_worlds_lock_;                         /**< \brief Protects \e cone_worlds_ */
   bool mobile_sensor_frame_;    /**< \brief True if the sensor is a non-fixed frame relative to the transform frame */
   bool mobile_target_frame_;    /**< \brief True if the target is a non-fixed frame relative to the transform frame */
   std::string target_frame_id_; /**< \brief The target frame id */
@@ -963,6 +989,25 @@ public:
   ConstraintEvaluationResult decide(const robot_state::RobotState& state,
                                     std::vector<ConstraintEvaluationResult>& results, bool verbose = false) const;
 
+  /**
+   * \brief Determines which of a batch of states satisfy all constraints
+   *
+   * Each constraint is evaluated for all states before the next one,
+   * starting with the cheapest kind: joint constraints only read
+   * variable values, position and orientation constraints read link
+   * transforms, and visibility constraints may check the robot for
+   * collisions with the sensor cone. Constraints are not evaluated for
+   * states that already violate one, so no distances are computed.
+   *
+   * @param [in] states The states to test, with up to date link transforms
+   * @param [out] satisfied Whether each of the states satisfies all constraints
+   * @param [in] verbose Whether to print the results of each constraint check
+   *
+   * @return The number of states that satisfy all constraints
+   */
+  std::size_t decide(const std::vector<const robot_state::RobotState*>& states, std::vector<bool>& satisfied,
+                     bool verbose = false) const;
+
   /**
    * \brief Whether or not another KinematicConstraintSet is equal to
    * this one.
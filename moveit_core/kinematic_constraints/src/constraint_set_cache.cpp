@@ -0,0 +1,186 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/kinematic_constraints/constraint_set_cache.h>
+#include <ros/serialization.h>
+
+namespace kinematic_constraints
+{
+namespace
+{
+const std::size_t AFFINE_SIZE = 16 * sizeof(double);
+
+/** \brief Append to \e key what configuring a constraint expressed in \e frame reads from \e tf */
+void appendFrame(const robot_state::Transforms& tf, const std::string& frame, std::string& key)
+{
+  if (!tf.isFixedFrame(frame))
+  {
+    // the frames that are not fixed are looked up when the constraints are evaluated
+    key.push_back('\0');
+    return;
+  }
+  key.push_back('\1');
+  const Eigen::Affine3d& t = tf.getTransform(frame);
+  key.append(reinterpret_cast<const char*>(t.data()), AFFINE_SIZE);
+}
+}
+
+KinematicConstraintSetCache::KinematicConstraintSetCache(std::size_t max_sets)
+  : max_sets_(max_sets), hits_(0), misses_(0)
+{
+}
+
+KinematicConstraintSetCache& KinematicConstraintSetCache::instance()
+{
+  static KinematicConstraintSetCache cache;
+  return cache;
+}
+
+std::string KinematicConstraintSetCache::getKey(const robot_model::RobotModel& model,
+                                                const moveit_msgs::Constraints& constr,
+                                                const robot_state::Transforms& tf)
+{
+  moveit_msgs::Constraints c = constr;
+  for (std::size_t i = 0; i < c.position_constraints.size(); ++i)
+    c.position_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.orientation_constraints.size(); ++i)
+    c.orientation_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.visibility_constraints.size(); ++i)
+  {
+    c.visibility_constraints[i].target_pose.header.stamp = ros::Time();
+    c.visibility_constraints[i].sensor_pose.header.stamp = ros::Time();
+  }
+
+  // the model is followed by the serialized constraints and the transforms of the frames they refer to
+  const robot_model::RobotModel* model_ptr = &model;
+  std::string key(reinterpret_cast<const char*>(&model_ptr), sizeof(model_ptr));
+  uint32_t length = ros::serialization::serializationLength(c);
+  std::size_t offset = key.size();
+  key.resize(offset + length);
+  if (length > 0)
+  {
+    ros::serialization::OStream stream(reinterpret_cast<uint8_t*>(&key[offset]), length);
+    ros::serialization::serialize(stream, c);
+  }
+  key.append(tf.getTargetFrame());
+  key.push_back('\0');
+  for (std::size_t i = 0; i < c.position_constraints.size(); ++i)
+    appendFrame(tf, c.position_constraints[i].header.frame_id, key);
+  for (std::size_t i = 0; i < c.orientation_constraints.size(); ++i)
+    appendFrame(tf, c.orientation_constraints[i].header.frame_id, key);
+  for (std::size_t i = 0; i < c.visibility_constraints.size(); ++i)
+  {
+    appendFrame(tf, c.visibility_constraints[i].target_pose.header.frame_id, key);
+    appendFrame(tf, c.visibility_constraints[i].sensor_pose.header.frame_id, key);
+  }
+  return key;
+}
+
+KinematicConstraintSetConstPtr KinematicConstraintSetCache::getConstraintSet(
+    const robot_model::RobotModelConstPtr& model, const moveit_msgs::Constraints& constr,
+    const robot_state::Transforms& tf, bool* ok)
+{
+  std::string key = getKey(*model, constr, tf);
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    std::map<std::string, std::list<Entry>::iterator>::iterator it = entry_index_.find(key);
+    if (it != entry_index_.end())
+    {
+      ++hits_;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      if (ok)
+        *ok = it->second->ok;
+      return it->second->set;
+    }
+    ++misses_;
+  }
+
+  // configure the set without holding the lock; concurrent misses for the same key configure it more than once
+  KinematicConstraintSetPtr set(new KinematicConstraintSet(model));
+  bool added = set->add(constr, tf);
+  if (ok)
+    *ok = added;
+
+  boost::mutex::scoped_lock slock(lock_);
+  if (max_sets_ == 0 || entry_index_.find(key) != entry_index_.end())
+    return set;
+  if (entries_.size() >= max_sets_)
+  {
+    entry_index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+  entries_.push_front(Entry());
+  entries_.front().key = key;
+  entries_.front().set = set;
+  entries_.front().ok = added;
+  entry_index_.insert(std::make_pair(key, entries_.begin()));
+  return set;
+}
+
+void KinematicConstraintSetCache::setMaxSize(std::size_t max_sets)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  max_sets_ = max_sets;
+  while (entries_.size() > max_sets_)
+  {
+    entry_index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+}
+
+std::size_t KinematicConstraintSetCache::size() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return entries_.size();
+}
+
+std::size_t KinematicConstraintSetCache::getHitCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return hits_;
+}
+
+std::size_t KinematicConstraintSetCache::getMissCount() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return misses_;
+}
+
+void KinematicConstraintSetCache::clear()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  entries_.clear();
+  entry_index_.clear();
+}
+}
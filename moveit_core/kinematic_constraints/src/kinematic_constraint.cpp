@@ -43,6 +43,7 @@
 #include <boost/math/constants/constants.hpp>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/bind.hpp>
+#include <algorithm>
 #include <limits>
 #include <memory>
 
@@ -646,10 +647,16 @@ VisibilityConstraint::VisibilityConstraint(const robot_model::RobotModelConstPtr
   : KinematicConstraint(model), collision_robot_(new collision_detection::CollisionRobotFCL(model))
 {
   type_ = VISIBILITY_CONSTRAINT;
+  acm_.setDefaultEntry("cone", boost::bind(&VisibilityConstraint::decideContact, this, _1));
 }
 
 void VisibilityConstraint::clear()
 {
+  cone_links_.clear();
+  {
+    boost::mutex::scoped_lock slock(cone_worlds_lock_);
+    cone_worlds_.clear();
+  }
   mobile_sensor_frame_ = false;
   mobile_target_frame_ = false;
   target_frame_id_ = "";
@@ -737,6 +744,13 @@ bool VisibilityConstraint::configure(const moveit_msgs::VisibilityConstraint& vc
   max_range_angle_ = vc.max_range_angle;
   sensor_view_direction_ = vc.sensor_view_direction;
 
+  // contacts of the cone with the sensor and target links are allowed (see decideContact())
+  const std::vector<const robot_model::LinkModel*>& links = robot_model_->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 0; i < links.size(); ++i)
+    if (!robot_state::Transforms::sameFrame(links[i]->getName(), sensor_frame_id_) &&
+        !robot_state::Transforms::sameFrame(links[i]->getName(), target_frame_id_))
+      cone_links_.push_back(links[i]);
+
   return target_radius_ > std::numeric_limits<double>::epsilon();
 }
 
@@ -792,6 +806,15 @@ shapes::Mesh* VisibilityConstraint::getVisibilityCone(const robot_state::RobotSt
     points = tempPoints.get();
   }
 
+  return createVisibilityCone(sp.translation(), tp.translation(), *points);
+}
+
+shapes::Mesh* VisibilityConstraint::createVisibilityCone(const Eigen::Vector3d& apex,
+                                                         const Eigen::Vector3d& base_center,
+                                                         const EigenSTL::vector_Vector3d& base_points) const
+{
+  const EigenSTL::vector_Vector3d* points = &base_points;
+
   // allocate memory for a mesh to represent the visibility cone
   shapes::Mesh* m = new shapes::Mesh();
   m->vertex_count = cone_sides_ + 2;
@@ -801,14 +824,14 @@ shapes::Mesh* VisibilityConstraint::getVisibilityCone(const robot_state::RobotSt
   // we do NOT allocate normals because we do not compute them
 
   // the sensor origin
-  m->vertices[0] = sp.translation().x();
-  m->vertices[1] = sp.translation().y();
-  m->vertices[2] = sp.translation().z();
+  m->vertices[0] = apex.x();
+  m->vertices[1] = apex.y();
+  m->vertices[2] = apex.z();
 
   // the center of the base of the cone approximation
-  m->vertices[3] = tp.translation().x();
-  m->vertices[4] = tp.translation().y();
-  m->vertices[5] = tp.translation().z();
+  m->vertices[3] = base_center.x();
+  m->vertices[4] = base_center.y();
+  m->vertices[5] = base_center.z();
 
   // the points that approximate the base disc
   for (std::size_t i = 0; i < points->size(); ++i)
@@ -923,13 +946,13 @@ ConstraintEvaluationResult VisibilityConstraint::decide(const robot_state::Robot
   if (target_radius_ <= std::numeric_limits<double>::epsilon())
     return ConstraintEvaluationResult(true, 0.0);
 
+  const Eigen::Affine3d& sp =
+      mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
+  const Eigen::Affine3d& tp =
+      mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
+
   if (max_view_angle_ > 0.0 || max_range_angle_ > 0.0)
   {
-    const Eigen::Affine3d& sp =
-        mobile_sensor_frame_ ? state.getFrameTransform(sensor_frame_id_) * sensor_pose_ : sensor_pose_;
-    const Eigen::Affine3d& tp =
-        mobile_target_frame_ ? state.getFrameTransform(target_frame_id_) * target_pose_ : target_pose_;
-
     // necessary to do subtraction as SENSOR_Z is 0 and SENSOR_X is 2
     const Eigen::Vector3d& normal2 = sp.linear().col(2 - sensor_view_direction_);
 
@@ -978,32 +1001,80 @@ ConstraintEvaluationResult VisibilityConstraint::decide(const robot_state::Robot
     }
   }
 
-  shapes::Mesh* m = getVisibilityCone(state);
-  if (!m)
-    return ConstraintEvaluationResult(false, 0.0);
+  // every point of the cone is within the target radius of its axis, so links whose bounding spheres are farther
+  // from the axis than that can not touch the cone
+  const Eigen::Vector3d axis = tp.translation() - sp.translation();
+  const double axis_length_sq = axis.squaredNorm();
+  bool near_cone = false;
+  for (std::size_t i = 0; i < cone_links_.size() && !near_cone; ++i)
+  {
+    const robot_model::LinkModel* link = cone_links_[i];
+    const Eigen::Vector3d center = state.getGlobalLinkTransform(link) * link->getCenteredBoundingBoxOffset();
+    const double t = axis_length_sq > 0.0 ? (center - sp.translation()).dot(axis) / axis_length_sq : 0.0;
+    const double radius = link->getShapeExtentsAtOrigin().norm() / 2.0 + target_radius_;
+    near_cone = (sp.translation() + std::max(0.0, std::min(1.0, t)) * axis - center).squaredNorm() <= radius * radius;
+  }
+  if (!near_cone)
+  {
+    if (verbose)
+      ROS_INFO_NAMED("kinematic_constraints", "Visibility constraint satisfied. No link is close to the cone");
+    return ConstraintEvaluationResult(true, 0.0);
+  }
 
-  // add the visibility cone as an object
-  collision_detection::CollisionWorldFCL collision_world;
-  collision_world.getWorld()->addToObject("cone", shapes::ShapeConstPtr(m), Eigen::Affine3d::Identity());
+  std::shared_ptr<ConeWorld> cone_world;
+  {
+    boost::mutex::scoped_lock slock(cone_worlds_lock_);
+    if (!cone_worlds_.empty())
+    {
+      cone_world = cone_worlds_.back();
+      cone_worlds_.pop_back();
+    }
+  }
+  if (!cone_world)
+  {
+    cone_world.reset(new ConeWorld());
+    cone_world->world_.reset(new collision_detection::CollisionWorldFCL());
+  }
+
+  // the cone only needs to be rebuilt if the sensor moved relative to the target
+  const Eigen::Affine3d target_inverse = tp.inverse(Eigen::Isometry);
+  const Eigen::Affine3d sensor_in_target = target_inverse * sp;
+  const collision_detection::WorldPtr& world = cone_world->world_->getWorld();
+  if (!cone_world->cone_ || !cone_world->sensor_in_target_.isApprox(sensor_in_target, 1e-9))
+  {
+    EigenSTL::vector_Vector3d base_points(points_.size());
+    for (std::size_t i = 0; i < points_.size(); ++i)
+      base_points[i] = mobile_target_frame_ ? points_[i] : target_inverse * points_[i];
+    cone_world->cone_.reset(createVisibilityCone(sensor_in_target.translation(), Eigen::Vector3d::Zero(), base_points));
+    cone_world->sensor_in_target_ = sensor_in_target;
+    world->removeObject("cone");
+    world->addToObject("cone", cone_world->cone_, tp);
+  }
+  else
+    world->moveShapeInObject("cone", cone_world->cone_, tp);
 
   // check for collisions between the robot and the cone
   collision_detection::CollisionRequest req;
   collision_detection::CollisionResult res;
-  collision_detection::AllowedCollisionMatrix acm;
-  acm.setDefaultEntry("cone", boost::bind(&VisibilityConstraint::decideContact, this, _1));
   req.contacts = true;
   req.verbose = verbose;
   req.max_contacts = 1;
-  collision_world.checkRobotCollision(req, res, *collision_robot_, state, acm);
+  cone_world->world_->checkRobotCollision(req, res, *collision_robot_, state, acm_);
 
   if (verbose)
   {
     std::stringstream ss;
-    m->print(ss);
-    ROS_INFO_NAMED("kinematic_constraints", "Visibility constraint %ssatisfied. Visibility cone approximation:\n %s",
+    cone_world->cone_->print(ss);
+    ROS_INFO_NAMED("kinematic_constraints", "Visibility constraint %ssatisfied. Visibility cone approximation in the "
+                                            "target frame:\n %s",
                    res.collision ? "not " : "", ss.str().c_str());
   }
 
+  {
+    boost::mutex::scoped_lock slock(cone_worlds_lock_);
+    cone_worlds_.push_back(cone_world);
+  }
+
   return ConstraintEvaluationResult(!res.collision, res.collision ? res.contacts.begin()->second.front().depth : 0.0);
 }
 
@@ -1154,6 +1225,41 @@ ConstraintEvaluationResult KinematicConstraintSet::decide(const robot_state::Rob
   return result;
 }
 
+namespace
+{
+// the constraint types are listed from the cheapest to evaluate to the most expensive
+bool cheaperConstraint(const KinematicConstraint* a, const KinematicConstraint* b)
+{
+  return a->getType() < b->getType();
+}
+}
+
+std::size_t KinematicConstraintSet::decide(const std::vector<const robot_state::RobotState*>& states,
+                                           std::vector<bool>& satisfied, bool verbose) const
+{
+  std::vector<const KinematicConstraint*> constraints(kinematic_constraints_.size());
+  for (std::size_t i = 0; i < kinematic_constraints_.size(); ++i)
+    constraints[i] = kinematic_constraints_[i].get();
+  std::stable_sort(constraints.begin(), constraints.end(), &cheaperConstraint);
+
+  satisfied.assign(states.size(), true);
+  std::vector<std::size_t> remaining(states.size());
+  for (std::size_t k = 0; k < states.size(); ++k)
+    remaining[k] = k;
+
+  for (std::size_t i = 0; i < constraints.size() && !remaining.empty(); ++i)
+  {
+    std::size_t kept = 0;
+    for (std::size_t k = 0; k < remaining.size(); ++k)
+      if (constraints[i]->decide(*states[remaining[k]], verbose).satisfied)
+        remaining[kept++] = remaining[k];
+      else
+        satisfied[remaining[k]] = false;
+    remaining.resize(kept);
+  }
+  return remaining.size();
+}
+
 void KinematicConstraintSet::print(std::ostream& out) const
 {
   out << kinematic_constraints_.size() << " kinematic constraints" << std::endl;
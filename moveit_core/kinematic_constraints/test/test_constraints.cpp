@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan, E. Gil Jones */
 
 #include <moveit/kinematic_constraints/kinematic_constraint.h>
+#include <moveit/kinematic_constraints/constraint_set_cache.h>
 #include <gtest/gtest.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
@@ -771,6 +772,8 @@ TEST_F(LoadPlanningModelsPr2, VisibilityConstraintsPR2)
   ks.setVariablePositions(state_values);
   ks.update();
   EXPECT_FALSE(vc.decide(ks, true).satisfied);
+  // the cone kept from the previous call gives the same result
+  EXPECT_FALSE(vc.decide(ks, false).satisfied);
 
   // this moves far enough away that it's fine
   state_values["r_shoulder_pan_joint"] = .4;
@@ -871,6 +874,61 @@ TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSet)
   EXPECT_FALSE(kcs.decide(ks).satisfied);
 }
 
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetBatch)
+{
+  robot_state::Transforms tf(kmodel->getModelFrame());
+  kinematic_constraints::KinematicConstraintSet kcs(kmodel);
+
+  // the position constraint is listed first, but it is always satisfied
+  moveit_msgs::Constraints constr;
+  constr.position_constraints.resize(1);
+  moveit_msgs::PositionConstraint& pcm = constr.position_constraints[0];
+  pcm.link_name = "l_wrist_roll_link";
+  pcm.header.frame_id = kmodel->getModelFrame();
+  pcm.constraint_region.primitives.resize(1);
+  pcm.constraint_region.primitives[0].type = shape_msgs::SolidPrimitive::SPHERE;
+  pcm.constraint_region.primitives[0].dimensions.resize(1, 10.0);
+  pcm.constraint_region.primitive_poses.resize(1);
+  pcm.constraint_region.primitive_poses[0].orientation.w = 1.0;
+  pcm.weight = 1.0;
+
+  constr.joint_constraints.resize(2);
+  constr.joint_constraints[0].joint_name = "head_pan_joint";
+  constr.joint_constraints[0].position = 0.4;
+  constr.joint_constraints[0].tolerance_above = 0.1;
+  constr.joint_constraints[0].tolerance_below = 0.05;
+  constr.joint_constraints[0].weight = 1.0;
+  constr.joint_constraints[1] = constr.joint_constraints[0];
+  constr.joint_constraints[1].joint_name = "head_tilt_joint";
+  EXPECT_TRUE(kcs.add(constr, tf));
+
+  std::vector<robot_state::RobotStatePtr> states;
+  std::vector<const robot_state::RobotState*> state_ptrs;
+  const double pan[] = { 0.41, 0.0, 0.41, 0.51 };
+  const double tilt[] = { 0.41, 0.41, 0.0, 0.45 };
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    states.push_back(robot_state::RobotStatePtr(new robot_state::RobotState(kmodel)));
+    states.back()->setToDefaultValues();
+    states.back()->setVariablePosition("head_pan_joint", pan[i]);
+    states.back()->setVariablePosition("head_tilt_joint", tilt[i]);
+    states.back()->update();
+    state_ptrs.push_back(states.back().get());
+  }
+
+  // the batch agrees with the states checked one at a time
+  std::vector<bool> satisfied;
+  EXPECT_EQ(kcs.decide(state_ptrs, satisfied), 1u);
+  ASSERT_EQ(satisfied.size(), 4u);
+  for (std::size_t i = 0; i < 4; ++i)
+    EXPECT_EQ(satisfied[i], kcs.decide(*states[i]).satisfied);
+  EXPECT_TRUE(satisfied[0]);
+
+  state_ptrs.clear();
+  EXPECT_EQ(kcs.decide(state_ptrs, satisfied), 0u);
+  EXPECT_TRUE(satisfied.empty());
+}
+
 TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetEquality)
 {
   robot_state::RobotState ks(kmodel);
@@ -950,6 +1008,69 @@ TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetEquality)
   EXPECT_TRUE(kcs2.equal(kcs, .1));
 }
 
+TEST_F(LoadPlanningModelsPr2, TestKinematicConstraintSetCache)
+{
+  robot_state::Transforms tf(kmodel->getModelFrame());
+  tf.setTransform(Eigen::Affine3d::Identity(), "other_frame");
+  kinematic_constraints::KinematicConstraintSetCache cache(2);
+
+  moveit_msgs::Constraints constr;
+  constr.joint_constraints.resize(1);
+  constr.joint_constraints[0].joint_name = "head_pan_joint";
+  constr.joint_constraints[0].position = 0.4;
+  constr.joint_constraints[0].tolerance_above = 0.1;
+  constr.joint_constraints[0].tolerance_below = 0.05;
+  constr.joint_constraints[0].weight = 1.0;
+  constr.orientation_constraints.resize(1);
+  constr.orientation_constraints[0].header.frame_id = "other_frame";
+  constr.orientation_constraints[0].link_name = "r_wrist_roll_link";
+  constr.orientation_constraints[0].orientation.w = 1.0;
+  constr.orientation_constraints[0].absolute_x_axis_tolerance = 0.1;
+  constr.orientation_constraints[0].absolute_y_axis_tolerance = 0.1;
+  constr.orientation_constraints[0].absolute_z_axis_tolerance = 0.1;
+  constr.orientation_constraints[0].weight = 1.0;
+
+  bool ok = false;
+  kinematic_constraints::KinematicConstraintSetConstPtr set = cache.getConstraintSet(kmodel, constr, tf, &ok);
+  ASSERT_TRUE(set);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(1u, set->getJointConstraints().size());
+  EXPECT_EQ(1u, set->getOrientationConstraints().size());
+  EXPECT_EQ(1u, cache.getMissCount());
+
+  // the stamps do not matter
+  constr.orientation_constraints[0].header.stamp = ros::Time(10.0);
+  EXPECT_EQ(set, cache.getConstraintSet(kmodel, constr, tf));
+  EXPECT_EQ(1u, cache.getHitCount());
+
+  // the constraints and the transforms of the fixed frames they refer to do
+  Eigen::Affine3d moved = Eigen::Affine3d::Identity();
+  moved.translation().x() = 1.0;
+  tf.setTransform(moved, "other_frame");
+  kinematic_constraints::KinematicConstraintSetConstPtr moved_set = cache.getConstraintSet(kmodel, constr, tf);
+  EXPECT_NE(set, moved_set);
+  constr.joint_constraints[0].position = 0.5;
+  EXPECT_NE(moved_set, cache.getConstraintSet(kmodel, constr, tf));
+  EXPECT_EQ(3u, cache.getMissCount());
+
+  // only the two most recently used sets are kept
+  EXPECT_EQ(2u, cache.size());
+  tf.setTransform(Eigen::Affine3d::Identity(), "other_frame");
+  constr.joint_constraints[0].position = 0.4;
+  EXPECT_NE(set, cache.getConstraintSet(kmodel, constr, tf));
+
+  // invalid constraints are cached too, with the result of adding them
+  constr.joint_constraints[0].joint_name = "no_joint";
+  cache.getConstraintSet(kmodel, constr, tf, &ok);
+  EXPECT_FALSE(ok);
+  ok = true;
+  cache.getConstraintSet(kmodel, constr, tf, &ok);
+  EXPECT_FALSE(ok);
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
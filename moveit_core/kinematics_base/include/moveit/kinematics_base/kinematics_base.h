@@ -110,6 +110,7 @@ struct KinematicsQueryOptions
     : lock_redundant_joints(false)
     , return_approximate_solution(false)
     , discretization_method(DiscretizationMethods::NO_DISCRETIZATION)
+    , parallel_seeds(1)
   {
   }
 
@@ -117,6 +118,9 @@ struct KinematicsQueryOptions
   bool return_approximate_solution;           /**<  KinematicsQueryOptions#return_approximate_solution. */
   DiscretizationMethod discretization_method; /**< Enumeration value that indicates the method for discretizing the
                                                  redundant. joints KinematicsQueryOptions#discretization_method. */
+  unsigned int parallel_seeds; /**< The number of seeds a search races in concurrent threads, for solvers that support
+                                  it: the first solution accepted by the solution callback wins. The callback is not
+                                  called concurrently. */
 };
 
 /*
@@ -319,6 +323,25 @@ public:
     return false;
   }
 
+  /**
+   * @brief Search for the joint angles that reach each of many desired poses of the end-effector. The queries are
+   * independent of each other, so solvers that can run several searches at once override this to solve them
+   * concurrently; the default implementation calls searchPositionIK() for one pose after the other.
+   * @param ik_poses the desired pose of the link, one for each query
+   * @param ik_seed_states the initial guess of each query, or a single one used for all queries
+   * @param timeout The amount of time (in seconds) available to the solver for each query
+   * @param solutions the solution vector of each query; it is empty for the queries that have no solution
+   * @param error_codes the error code of each query, encoding the reason for failure or success
+   * @param options container for other IK options
+   * @return True if a valid solution was found for every query, false otherwise
+   */
+  virtual bool
+  searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                        const std::vector<std::vector<double> >& ik_seed_states, double timeout,
+                        std::vector<std::vector<double> >& solutions,
+                        std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                        const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
+
   /**
    * @brief Given a set of joint angles and a set of links, compute their pose
    * @param link_names A set of links for which FK needs to be computed
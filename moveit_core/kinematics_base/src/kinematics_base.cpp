@@ -171,4 +171,35 @@ bool KinematicsBase::getPositionIK(const std::vector<geometry_msgs::Pose>& ik_po
   return true;
 }
 
+bool KinematicsBase::searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                           const std::vector<std::vector<double> >& ik_seed_states, double timeout,
+                                           std::vector<std::vector<double> >& solutions,
+                                           std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                                           const KinematicsQueryOptions& options) const
+{
+  solutions.assign(ik_poses.size(), std::vector<double>());
+  error_codes.assign(ik_poses.size(), moveit_msgs::MoveItErrorCodes());
+  if (ik_poses.empty())
+    return true;
+
+  if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    ROS_ERROR_NAMED("kinematics_base", "Expected 1 or %zu seed states for a batch of IK queries instead of %zu",
+                    ik_poses.size(), ik_seed_states.size());
+    for (std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  bool all_solved = true;
+  for (std::size_t i = 0; i < ik_poses.size(); ++i)
+    if (!searchPositionIK(ik_poses[i], ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i], timeout,
+                          solutions[i], error_codes[i], options))
+    {
+      solutions[i].clear();
+      all_solved = false;
+    }
+  return all_solved;
+}
+
 }  // end of namespace kinematics
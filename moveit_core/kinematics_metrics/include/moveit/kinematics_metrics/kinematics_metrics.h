@@ -39,6 +39,7 @@
 
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
 
 /** @brief Namespace for kinematics metrics */
 namespace kinematics_metrics
@@ -126,6 +127,21 @@ public:
   bool getManipulability(const robot_state::RobotState& state, const robot_model::JointModelGroup* joint_model_group,
                          double& condition_number, bool translation = false) const;
 
+  /**
+   * @brief Get the manipulability index and the manipulability of a group at every waypoint of a trajectory. Both are
+   * computed from a single Jacobian and singular value decomposition per waypoint, and the waypoints are split over up
+   * to \e thread_count threads (0 means one per hardware thread).
+   * @param trajectory The trajectory; its waypoints must have up to date transforms
+   * @param joint_model_group A pointer to the desired joint model group
+   * @param manipulability_indices The manipulability = sqrt(det(JJ^T)) at each waypoint
+   * @param condition_numbers The manipulability = sigma_min/sigma_max at each waypoint
+   * @return False if the group is not a chain
+   */
+  bool getManipulability(const robot_trajectory::RobotTrajectory& trajectory,
+                         const robot_model::JointModelGroup* joint_model_group,
+                         std::vector<double>& manipulability_indices, std::vector<double>& condition_numbers,
+                         bool translation = false, unsigned int thread_count = 0) const;
+
   void setPenaltyMultiplier(double multiplier)
   {
     penalty_multiplier_ = fabs(multiplier);
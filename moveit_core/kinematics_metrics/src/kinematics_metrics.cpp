@@ -38,6 +38,8 @@
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
 #include <boost/math/constants/constants.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
 
 namespace kinematics_metrics
 {
@@ -234,4 +236,58 @@ bool KinematicsMetrics::getManipulability(const robot_state::RobotState& state,
   return true;
 }
 
+bool KinematicsMetrics::getManipulability(const robot_trajectory::RobotTrajectory& trajectory,
+                                          const robot_model::JointModelGroup* joint_model_group,
+                                          std::vector<double>& manipulability_indices,
+                                          std::vector<double>& condition_numbers, bool translation,
+                                          unsigned int thread_count) const
+{
+  // state.getJacobian() only works for chain groups.
+  if (!joint_model_group->isChain())
+  {
+    return false;
+  }
+
+  // waypoints of compact trajectories are materialized on first access, so that is done before spreading them out
+  std::vector<const robot_state::RobotState*> states(trajectory.getWayPointCount());
+  for (std::size_t i = 0; i < states.size(); ++i)
+    states[i] = &trajectory.getWayPoint(i);
+  manipulability_indices.resize(states.size());
+  condition_numbers.resize(states.size());
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, states.size());
+
+  // each worker repeatedly claims the next waypoint that was not evaluated yet, reusing its Jacobian buffer
+  const robot_model::LinkModel* tip = joint_model_group->getLinkModels().back();
+  std::atomic<std::size_t> next(0);
+  auto work = [&]() {
+    Eigen::MatrixXd jacobian;
+    for (std::size_t i = next++; i < states.size(); i = next++)
+    {
+      const robot_state::RobotState& state = *states[i];
+      state.getJacobian(joint_model_group, tip, Eigen::Vector3d::Zero(), jacobian);
+      const double penalty = getJointLimitsPenalty(state, joint_model_group);
+
+      // the product of the singular values equals sqrt(det(JJ^T)) if JJ^T has full rank
+      Eigen::JacobiSVD<Eigen::MatrixXd> svdsolver(translation ? jacobian.topRows(3) : jacobian);
+      const Eigen::VectorXd& singular_values = svdsolver.singularValues();
+      manipulability_indices[i] = penalty * singular_values.prod();
+      condition_numbers[i] = penalty * singular_values.minCoeff() / singular_values.maxCoeff();
+    }
+  };
+
+  if (thread_count < 2)
+    work();
+  else
+  {
+    boost::thread_group workers;
+    for (std::size_t t = 0; t < thread_count; ++t)
+      workers.create_thread(work);
+    workers.join_all();
+  }
+  return true;
+}
+
 }  // end of namespace kinematics_metrics
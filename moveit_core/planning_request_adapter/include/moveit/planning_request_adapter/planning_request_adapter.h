@@ -41,12 +41,57 @@
 #include <moveit/planning_interface/planning_interface.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <boost/function.hpp>
+#include <vector>
 
 /** \brief Generic interface to adapting motion planning requests */
 namespace planning_request_adapter
 {
 MOVEIT_CLASS_FORWARD(PlanningRequestAdapter);
 
+/** \brief Facts about the start state of a motion plan request, shared by the adapters of a chain so that each of
+    them is computed at most once per request. Values are kept per planning scene and start state message, so an
+    adapter that passes a modified start state on to the next one gets values for that state. */
+class AdaptationContext
+{
+public:
+  /// The start state of \e req, applied to the current state of \e planning_scene, with updated transforms
+  const robot_state::RobotState& getStartState(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                               const planning_interface::MotionPlanRequest& req);
+
+  /// Whether the start state of \e req is in collision, as checked for req.group_name
+  bool isStartStateColliding(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                             const planning_interface::MotionPlanRequest& req);
+
+  /// Whether the start state of \e req is valid with respect to collisions and feasibility
+  bool isStartStateValid(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                         const planning_interface::MotionPlanRequest& req);
+
+  /// Whether the start state of \e req satisfies req.path_constraints
+  bool isStartStateConstrained(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                               const planning_interface::MotionPlanRequest& req);
+
+  /// Record \e state as the start state of \e req, for an adapter that has just computed req.start_state from it
+  void setStartState(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                     const planning_interface::MotionPlanRequest& req, const robot_state::RobotState& state);
+
+private:
+  struct StartStateFacts
+  {
+    const planning_scene::PlanningScene* planning_scene_;
+    std::vector<uint8_t> start_state_msg_;
+    robot_state::RobotStatePtr start_state_;
+    // -1 if not computed yet, otherwise 0 or 1
+    int colliding_;
+    int feasible_;
+    int constrained_;
+  };
+
+  StartStateFacts& getFacts(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req);
+
+  std::vector<StartStateFacts> facts_;
+};
+
 class PlanningRequestAdapter
 {
 public:
@@ -88,6 +133,16 @@ public:
                             const planning_interface::MotionPlanRequest& req,
                             planning_interface::MotionPlanResponse& res,
                             std::vector<std::size_t>& added_path_index) const = 0;
+
+  /** \brief Same as above, for adapters run by a PlanningRequestAdapterChain: \e context carries the facts about the
+      start state that other adapters of the chain computed already. The default implementation ignores it. */
+  virtual bool adaptAndPlan(const PlannerFn& planner, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req,
+                            planning_interface::MotionPlanResponse& res, std::vector<std::size_t>& added_path_index,
+                            AdaptationContext& context) const
+  {
+    return adaptAndPlan(planner, planning_scene, req, res, added_path_index);
+  }
 };
 
 /// Apply a sequence of adapters to a motion plan
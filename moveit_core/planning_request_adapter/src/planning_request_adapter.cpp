@@ -35,6 +35,8 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <moveit/robot_state/conversions.h>
+#include <ros/serialization.h>
 #include <boost/bind.hpp>
 #include <algorithm>
 
@@ -42,6 +44,90 @@
 
 namespace planning_request_adapter
 {
+namespace
+{
+std::vector<uint8_t> serializeStartState(const moveit_msgs::RobotState& msg)
+{
+  std::vector<uint8_t> buffer(ros::serialization::serializationLength(msg));
+  ros::serialization::OStream stream(buffer.data(), buffer.size());
+  ros::serialization::serialize(stream, msg);
+  return buffer;
+}
+}
+
+AdaptationContext::StartStateFacts&
+AdaptationContext::getFacts(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req)
+{
+  std::vector<uint8_t> msg = serializeStartState(req.start_state);
+  for (std::size_t i = 0; i < facts_.size(); ++i)
+    if (facts_[i].planning_scene_ == planning_scene.get() && facts_[i].start_state_msg_ == msg)
+      return facts_[i];
+
+  StartStateFacts facts;
+  facts.planning_scene_ = planning_scene.get();
+  facts.start_state_msg_.swap(msg);
+  facts.start_state_.reset(new robot_state::RobotState(planning_scene->getCurrentState()));
+  robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, *facts.start_state_);
+  facts.start_state_->update();
+  facts.colliding_ = facts.feasible_ = facts.constrained_ = -1;
+  facts_.push_back(facts);
+  return facts_.back();
+}
+
+const robot_state::RobotState& AdaptationContext::getStartState(
+    const planning_scene::PlanningSceneConstPtr& planning_scene, const planning_interface::MotionPlanRequest& req)
+{
+  return *getFacts(planning_scene, req).start_state_;
+}
+
+bool AdaptationContext::isStartStateColliding(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                              const planning_interface::MotionPlanRequest& req)
+{
+  StartStateFacts& facts = getFacts(planning_scene, req);
+  if (facts.colliding_ < 0)
+    facts.colliding_ = planning_scene->isStateColliding(*facts.start_state_, req.group_name) ? 1 : 0;
+  return facts.colliding_ == 1;
+}
+
+bool AdaptationContext::isStartStateValid(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                          const planning_interface::MotionPlanRequest& req)
+{
+  if (isStartStateColliding(planning_scene, req))
+    return false;
+  StartStateFacts& facts = getFacts(planning_scene, req);
+  if (facts.feasible_ < 0)
+    facts.feasible_ = planning_scene->isStateFeasible(*facts.start_state_) ? 1 : 0;
+  return facts.feasible_ == 1;
+}
+
+bool AdaptationContext::isStartStateConstrained(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                const planning_interface::MotionPlanRequest& req)
+{
+  StartStateFacts& facts = getFacts(planning_scene, req);
+  if (facts.constrained_ < 0)
+    facts.constrained_ = planning_scene->isStateConstrained(*facts.start_state_, req.path_constraints) ? 1 : 0;
+  return facts.constrained_ == 1;
+}
+
+void AdaptationContext::setStartState(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                      const planning_interface::MotionPlanRequest& req,
+                                      const robot_state::RobotState& state)
+{
+  std::vector<uint8_t> msg = serializeStartState(req.start_state);
+  for (std::size_t i = 0; i < facts_.size(); ++i)
+    if (facts_[i].planning_scene_ == planning_scene.get() && facts_[i].start_state_msg_ == msg)
+      return;
+
+  StartStateFacts facts;
+  facts.planning_scene_ = planning_scene.get();
+  facts.start_state_msg_.swap(msg);
+  facts.start_state_.reset(new robot_state::RobotState(state));
+  facts.start_state_->update();
+  facts.colliding_ = facts.feasible_ = facts.constrained_ = -1;
+  facts_.push_back(facts);
+}
+
 namespace
 {
 bool callPlannerInterfaceSolve(const planning_interface::PlannerManager* planner,
@@ -83,11 +169,12 @@ namespace
 bool callAdapter1(const PlanningRequestAdapter* adapter, const planning_interface::PlannerManagerPtr& planner,
                   const planning_scene::PlanningSceneConstPtr& planning_scene,
                   const planning_interface::MotionPlanRequest& req, planning_interface::MotionPlanResponse& res,
-                  std::vector<std::size_t>& added_path_index)
+                  std::vector<std::size_t>& added_path_index, AdaptationContext* context)
 {
   try
   {
-    return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index);
+    return adapter->adaptAndPlan(boost::bind(&callPlannerInterfaceSolve, planner.get(), _1, _2, _3), planning_scene,
+                                 req, res, added_path_index, *context);
   }
   catch (std::exception& ex)
   {
@@ -101,11 +188,11 @@ bool callAdapter1(const PlanningRequestAdapter* adapter, const planning_interfac
 bool callAdapter2(const PlanningRequestAdapter* adapter, const PlanningRequestAdapter::PlannerFn& planner,
                   const planning_scene::PlanningSceneConstPtr& planning_scene,
                   const planning_interface::MotionPlanRequest& req, planning_interface::MotionPlanResponse& res,
-                  std::vector<std::size_t>& added_path_index)
+                  std::vector<std::size_t>& added_path_index, AdaptationContext* context)
 {
   try
   {
-    return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index);
+    return adapter->adaptAndPlan(planner, planning_scene, req, res, added_path_index, *context);
   }
   catch (std::exception& ex)
   {
@@ -143,12 +230,16 @@ bool PlanningRequestAdapterChain::adaptAndPlan(const planning_interface::Planner
     // the index values added by each adapter
     std::vector<std::vector<std::size_t> > added_path_index_each(adapters_.size());
 
+    // the facts about the start state, shared by all adapters
+    AdaptationContext context;
+
     // if there are adapters, construct a function pointer for each, in order,
     // so that in the end we have a nested sequence of function pointers that call the adapters in the correct order.
     PlanningRequestAdapter::PlannerFn fn = boost::bind(&callAdapter1, adapters_.back().get(), planner, _1, _2, _3,
-                                                       boost::ref(added_path_index_each.back()));
+                                                       boost::ref(added_path_index_each.back()), &context);
     for (int i = adapters_.size() - 2; i >= 0; --i)
-      fn = boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]));
+      fn = boost::bind(&callAdapter2, adapters_[i].get(), fn, _1, _2, _3, boost::ref(added_path_index_each[i]),
+                       &context);
     bool result = fn(planning_scene, req, res);
     added_path_index.clear();
 
@@ -55,6 +55,9 @@
 #include <boost/noncopyable.hpp>
 #include <boost/function.hpp>
 #include <boost/concept_check.hpp>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <cstdint>
 #include <memory>
 
 /** \brief This namespace includes the central class for representing planning contexts */
@@ -124,6 +127,11 @@ public:
    *  get*NonConst functions are called) in the child then a copy is made and
    *  subsequent changes to the corresponding member of the parent will no
    *  longer be visible in the child.
+   *
+   *  The collision worlds of the child are not allocated until they are first
+   *  used. If the child world is unchanged at that point, the collision
+   *  geometry of the parent is shared rather than rebuilt, so a diff that is
+   *  only used to modify the state, the ACM or the padding is cheap to create.
    */
   PlanningScenePtr diff() const;
 
@@ -131,6 +139,13 @@ public:
    * has the diffs specified by \e msg applied. */
   PlanningScenePtr diff(const moveit_msgs::PlanningScene& msg) const;
 
+  /** \brief Get the version of the scene; it increases whenever the state, the world, the allowed collision matrix,
+   *  the fixed transforms, the padding or the object colors and types of this scene or of its parents change. Caches
+   *  of results computed for a scene can compare versions to know whether they are still valid. Versions of different
+   *  scenes are not comparable. Changes made through the references returned by the get*NonConst() functions for
+   *  the transforms and the collision robot are assumed to happen when these functions are called. */
+  std::uint64_t getVersion() const;
+
   /** \brief Get the parent scene (whith respect to which the diffs are maintained). This may be empty */
   const PlanningSceneConstPtr& getParent() const
   {
@@ -293,7 +308,7 @@ public:
   const collision_detection::CollisionWorldConstPtr& getCollisionWorld() const
   {
     // we always have a world representation after configure is called.
-    return active_collision_->cworld_const_;
+    return getCollisionWorld(*active_collision_);
   }
 
   /** \brief Get the active collision detector for the robot */
@@ -421,6 +436,35 @@ public:
                       const robot_state::RobotState& kstate,
                       const collision_detection::AllowedCollisionMatrix& acm) const;
 
+  /** \brief Check only whether a specified state (\e kstate) is in collision, with the world (using the padded robot)
+      or with itself (using the unpadded robot); none of the contact, cost or distance information of the full query
+      is computed, which lets collision detectors answer without touching the heap. The collision transforms of
+      \e kstate are expected to be up to date. */
+  void checkCollision(const collision_detection::BooleanCollisionRequest& req,
+                      collision_detection::BooleanCollisionResult& res, const robot_state::RobotState& kstate) const
+  {
+    getCollisionWorld()->checkRobotCollisionBoolean(req, res, *getCollisionRobot(), kstate,
+                                                    getAllowedCollisionMatrix());
+    if (!res.collision)
+      getCollisionRobotUnpadded()->checkSelfCollisionBoolean(req, res, kstate, getAllowedCollisionMatrix());
+  }
+
+  /** \brief Check a batch of independent \e states for collision, like checkCollision(), splitting the work over up
+      to \e thread_count threads (0 means one per hardware thread). \e results[i] is filled with the result for
+      \e states[i]. The collision body transforms of the states need to be up to date. The states are checked
+      against the world with collision_detection::CollisionWorld::checkRobotCollisionBatch(). */
+  void checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                           const std::vector<const robot_state::RobotState*>& states,
+                           std::vector<collision_detection::CollisionResult>& results,
+                           unsigned int thread_count = 0) const;
+
+  /** \brief Check a batch of independent \e states for collision, like checkCollision(), splitting the work over up
+      to \e thread_count threads (0 means one per hardware thread). \e colliding[i] is true if \e states[i] is in
+      collision. The collision body transforms of the states need to be up to date. */
+  void checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                           const std::vector<const robot_state::RobotState*>& states, std::vector<bool>& colliding,
+                           unsigned int thread_count = 0) const;
+
   /** \brief Check whether the current state is in collision,
       but use a collision_detection::CollisionRobot instance that has no padding.
       Since the function is non-const, the current state transforms are also updated if needed. */
@@ -515,6 +559,14 @@ public:
     getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, acm);
   }
 
+  /** \brief Check only whether a specified state (\e kstate) is in self collision, like the boolean variant of
+      checkCollision(). The collision transforms of \e kstate are expected to be up to date. */
+  void checkSelfCollision(const collision_detection::BooleanCollisionRequest& req,
+                          collision_detection::BooleanCollisionResult& res, const robot_state::RobotState& kstate) const
+  {
+    getCollisionRobotUnpadded()->checkSelfCollisionBoolean(req, res, kstate, getAllowedCollisionMatrix());
+  }
+
   /** \brief Get the names of the links that are involved in collisions for the current state */
   void getCollidingLinks(std::vector<std::string>& links);
 
@@ -776,7 +828,10 @@ public:
 
   /** \brief If there is a parent specified for this scene, then the diffs with respect to that parent are applied to a
      specified planning scene, whatever
-      that scene may be. If there is no parent specified, this function is a no-op. */
+      that scene may be. If there is no parent specified, this function is a no-op.
+
+      If \e scene is an ancestor of this scene further up the chain of diffs, the diffs of all the scenes in between
+      are merged and applied in a single pass, with the most recent change to each component taking precedence. */
   void pushDiffs(const PlanningScenePtr& scene);
 
   /** \brief Make sure that all the data maintained in this
@@ -888,11 +943,16 @@ public:
 
   /** \brief Check if a given path is valid. Each state is checked for validity (collision avoidance, feasibility and
    * constraint satisfaction). It is also checked that the goal constraints are satisfied by the last state on the
-   * passed in trajectory. */
+   * passed in trajectory.
+   *
+   * The waypoints are checked in coarse-to-fine order, split over up to \e thread_count threads (0 means one per
+   * hardware thread). Unless \e invalid_index is given, checking stops at the first invalid waypoint found. When
+   * using more than one thread, the state feasibility predicate needs to be thread safe. */
   bool isPathValid(const robot_trajectory::RobotTrajectory& trajectory,
                    const moveit_msgs::Constraints& path_constraints,
                    const std::vector<moveit_msgs::Constraints>& goal_constraints, const std::string& group = "",
-                   bool verbose = false, std::vector<std::size_t>* invalid_index = NULL) const;
+                   bool verbose = false, std::vector<std::size_t>* invalid_index = NULL,
+                   unsigned int thread_count = 1) const;
 
   /** \brief Check if a given path is valid. Each state is checked for validity (collision avoidance, feasibility and
    * constraint satisfaction). It is also checked that the goal constraints are satisfied by the last state on the
@@ -966,14 +1026,21 @@ private:
   /* \brief A set of compatible collision detectors */
   struct CollisionDetector
   {
+    CollisionDetector() : cworld_ready_(false)
+    {
+    }
+
     collision_detection::CollisionDetectorAllocatorPtr alloc_;
     collision_detection::CollisionRobotPtr crobot_unpadded_;  // if NULL use parent's
     collision_detection::CollisionRobotConstPtr crobot_unpadded_const_;
     collision_detection::CollisionRobotPtr crobot_;  // if NULL use parent's
     collision_detection::CollisionRobotConstPtr crobot_const_;
 
-    collision_detection::CollisionWorldPtr cworld_;  // never NULL
-    collision_detection::CollisionWorldConstPtr cworld_const_;
+    // NULL in a diff scene until first used; see PlanningScene::getCollisionWorld(const CollisionDetector&)
+    mutable collision_detection::CollisionWorldPtr cworld_;
+    mutable collision_detection::CollisionWorldConstPtr cworld_const_;
+    mutable std::atomic<bool> cworld_ready_;
+    mutable boost::mutex cworld_lock_;
 
     CollisionDetectorConstPtr parent_;  // may be NULL
 
@@ -996,8 +1063,17 @@ private:
   void allocateCollisionDetectors();
   void allocateCollisionDetectors(CollisionDetector& detector);
 
+  /* Get the collision world of \e detector, allocating it first if this has not been done yet. */
+  const collision_detection::CollisionWorldConstPtr& getCollisionWorld(const CollisionDetector& detector) const;
+
+  /* Raise version_ so that getVersion() is above \e previous, after the state, world or ACM were replaced by objects
+   * with versions of their own. */
+  void keepVersionAbove(std::uint64_t previous);
+
   std::string name_;  // may be empty
 
+  std::uint64_t version_;  // changes made by the scene itself; getVersion() adds those of the parent and members
+
   PlanningSceneConstPtr parent_;  // Null unless this is a diff scene
 
   robot_model::RobotModelConstPtr kmodel_;  // Never null (may point to same model as parent)
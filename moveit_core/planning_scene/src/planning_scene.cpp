@@ -45,6 +45,11 @@
 #include <moveit/robot_state/attached_body.h>
 #include <octomap_msgs/conversions.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <set>
 
@@ -96,6 +101,96 @@ private:
   const PlanningScene* scene_;
 };
 
+namespace
+{
+/** \brief Meshes constructed from collision object messages, indexed by a hash of their vertices and triangles. Scenes
+    often hold many objects with the same mesh (e.g. one for every tote on a shelf); constructing it once lets all of
+    them share its memory, and the FCL geometry of each is copied from the BVH built for the first one. The table only
+    refers to the meshes, they are freed when the last object using them is removed. */
+class MeshMsgCache
+{
+public:
+  MeshMsgCache() : insert_count_(0)
+  {
+  }
+
+  shapes::ShapeConstPtr get(const shape_msgs::Mesh& msg)
+  {
+    std::size_t hash = hashMesh(msg);
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      auto range = meshes_.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it)
+      {
+        shapes::ShapeConstPtr shape = it->second.lock();
+        if (shape && sameMesh(static_cast<const shapes::Mesh&>(*shape), msg))
+          return shape;
+      }
+    }
+
+    // construct the mesh without holding the lock; if another thread interned the same one meanwhile, both are kept
+    shapes::ShapeConstPtr shape(shapes::constructShapeFromMsg(msg));
+    if (!shape)
+      return shape;
+    boost::mutex::scoped_lock slock(lock_);
+    // forget the meshes that no longer exist every once in a while
+    if (++insert_count_ % MAX_CLEAN_COUNT == 0)
+      for (auto it = meshes_.begin(); it != meshes_.end();)
+        if (it->second.expired())
+          it = meshes_.erase(it);
+        else
+          ++it;
+    meshes_.insert(std::make_pair(hash, std::weak_ptr<const shapes::Shape>(shape)));
+    return shape;
+  }
+
+private:
+  static std::size_t hashMesh(const shape_msgs::Mesh& msg)
+  {
+    // FNV-1a over the vertices and triangles
+    std::uint64_t h = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < msg.vertices.size(); ++i)
+    {
+      const double v[3] = { msg.vertices[i].x, msg.vertices[i].y, msg.vertices[i].z };
+      const unsigned char* b = reinterpret_cast<const unsigned char*>(v);
+      for (std::size_t j = 0; j < sizeof(v); ++j)
+        h = (h ^ b[j]) * 1099511628211ULL;
+    }
+    for (std::size_t i = 0; i < msg.triangles.size(); ++i)
+      for (int j = 0; j < 3; ++j)
+        h = (h ^ msg.triangles[i].vertex_indices[j]) * 1099511628211ULL;
+    return static_cast<std::size_t>(h);
+  }
+
+  /** \brief Check that \e mesh was constructed from exactly the data in \e msg (guards against hash collisions) */
+  static bool sameMesh(const shapes::Mesh& mesh, const shape_msgs::Mesh& msg)
+  {
+    if (mesh.vertex_count != msg.vertices.size() || mesh.triangle_count != msg.triangles.size())
+      return false;
+    for (std::size_t i = 0; i < msg.vertices.size(); ++i)
+      if (mesh.vertices[3 * i] != msg.vertices[i].x || mesh.vertices[3 * i + 1] != msg.vertices[i].y ||
+          mesh.vertices[3 * i + 2] != msg.vertices[i].z)
+        return false;
+    for (std::size_t i = 0; i < msg.triangles.size(); ++i)
+      for (int j = 0; j < 3; ++j)
+        if (mesh.triangles[3 * i + j] != msg.triangles[i].vertex_indices[j])
+          return false;
+    return true;
+  }
+
+  static const unsigned int MAX_CLEAN_COUNT = 100;
+  std::multimap<std::size_t, std::weak_ptr<const shapes::Shape> > meshes_;
+  unsigned int insert_count_;
+  boost::mutex lock_;
+};
+
+shapes::ShapeConstPtr constructMeshFromMsg(const shape_msgs::Mesh& msg)
+{
+  static MeshMsgCache cache;
+  return cache.get(msg);
+}
+}
+
 bool PlanningScene::isEmpty(const moveit_msgs::PlanningScene& msg)
 {
   return msg.name.empty() && msg.fixed_frame_transforms.empty() && msg.allowed_collision_matrix.entry_names.empty() &&
@@ -120,14 +215,14 @@ bool PlanningScene::isEmpty(const moveit_msgs::PlanningSceneWorld& msg)
 }
 
 PlanningScene::PlanningScene(const robot_model::RobotModelConstPtr& robot_model, collision_detection::WorldPtr world)
-  : kmodel_(robot_model), world_(world), world_const_(world)
+  : version_(0), kmodel_(robot_model), world_(world), world_const_(world)
 {
   initialize();
 }
 
 PlanningScene::PlanningScene(const urdf::ModelInterfaceSharedPtr& urdf_model,
                              const srdf::ModelConstSharedPtr& srdf_model, collision_detection::WorldPtr world)
-  : world_(world), world_const_(world)
+  : version_(0), world_(world), world_const_(world)
 {
   if (!urdf_model)
     throw moveit::ConstructException("The URDF model cannot be NULL");
@@ -181,7 +276,7 @@ robot_model::RobotModelPtr PlanningScene::createRobotModel(const urdf::ModelInte
   return robot_model;
 }
 
-PlanningScene::PlanningScene(const PlanningSceneConstPtr& parent) : parent_(parent)
+PlanningScene::PlanningScene(const PlanningSceneConstPtr& parent) : version_(0), parent_(parent)
 {
   if (!parent_)
     throw moveit::ConstructException("NULL parent pointer for planning scene");
@@ -208,8 +303,8 @@ PlanningScene::PlanningScene(const PlanningSceneConstPtr& parent) : parent_(pare
     detector->alloc_ = parent_detector->alloc_;
     detector->parent_ = parent_detector;
 
-    detector->cworld_ = detector->alloc_->allocateWorld(parent_detector->cworld_, world_);
-    detector->cworld_const_ = detector->cworld_;
+    // cworld_ is allocated on first use (see getCollisionWorld(const CollisionDetector&)) so that children
+    // which never check collisions with the world do not pay for copying the broadphase structures.
 
     // leave these empty and use parent collision_robot_ unless/until a non-const one
     // is requested (e.g. to modify link padding or scale)
@@ -229,6 +324,26 @@ PlanningScenePtr PlanningScene::clone(const PlanningSceneConstPtr& scene)
   return result;
 }
 
+std::uint64_t PlanningScene::getVersion() const
+{
+  // every term only increases, and keepVersionAbove() compensates for members that are replaced
+  std::uint64_t version = version_ + world_->getVersion();
+  if (kstate_)
+    version += kstate_->getVersion();
+  if (acm_)
+    version += acm_->getVersion();
+  if (parent_)
+    version += parent_->getVersion();
+  return version;
+}
+
+void PlanningScene::keepVersionAbove(std::uint64_t previous)
+{
+  std::uint64_t current = getVersion();
+  if (current <= previous)
+    version_ += previous + 1 - current;
+}
+
 PlanningScenePtr PlanningScene::diff() const
 {
   return PlanningScenePtr(new PlanningScene(shared_from_this()));
@@ -257,6 +372,7 @@ void PlanningScene::propogateRobotPadding()
 {
   if (!active_collision_->crobot_)
     return;
+  ++version_;
 
   for (CollisionDetectorIterator it = collision_.begin(); it != collision_.end(); ++it)
   {
@@ -265,6 +381,36 @@ void PlanningScene::propogateRobotPadding()
   }
 }
 
+namespace
+{
+// true if both worlds hold the very same (copy on write) objects, i.e. one is an unmodified copy of the other
+bool shareWorldObjects(const collision_detection::World& a, const collision_detection::World& b)
+{
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+}
+
+const collision_detection::CollisionWorldConstPtr&
+PlanningScene::getCollisionWorld(const CollisionDetector& detector) const
+{
+  if (detector.cworld_ready_.load(std::memory_order_acquire))
+    return detector.cworld_const_;
+
+  boost::mutex::scoped_lock slock(detector.cworld_lock_);
+  if (!detector.cworld_)
+  {
+    CollisionDetectorConstIterator it;
+    if (parent_ && (it = parent_->collision_.find(detector.alloc_->getName())) != parent_->collision_.end() &&
+        shareWorldObjects(*world_, *parent_->world_))
+      detector.cworld_ = detector.alloc_->allocateWorld(parent_->getCollisionWorld(*it->second), world_);
+    else
+      detector.cworld_ = detector.alloc_->allocateWorld(world_);
+    detector.cworld_const_ = detector.cworld_;
+  }
+  detector.cworld_ready_.store(true, std::memory_order_release);
+  return detector.cworld_const_;
+}
+
 void PlanningScene::CollisionDetector::findParent(const PlanningScene& scene)
 {
   if (parent_ || !scene.parent_)
@@ -294,6 +440,7 @@ void PlanningScene::addCollisionDetector(const collision_detection::CollisionDet
 
   detector->cworld_ = detector->alloc_->allocateWorld(world_);
   detector->cworld_const_ = detector->cworld_;
+  detector->cworld_ready_ = true;
 
   // Allocate CollisionRobot unless we can use the parent's crobot_.
   // If active_collision_->crobot_ is non-NULL there is local padding and we cannot use the parent's crobot_.
@@ -331,6 +478,7 @@ void PlanningScene::setActiveCollisionDetector(const collision_detection::Collis
     {
       collision_[allocator->getName()] = p;
       active_collision_ = p;
+      ++version_;
       return;
     }
   }
@@ -345,6 +493,7 @@ bool PlanningScene::setActiveCollisionDetector(const std::string& collision_dete
   if (it != collision_.end())
   {
     active_collision_ = it->second;
+    ++version_;
     return true;
   }
   else
@@ -374,10 +523,10 @@ PlanningScene::getCollisionWorld(const std::string& collision_detector_name) con
     ROS_ERROR_NAMED("planning_scene",
                     "Could not get CollisionWorld named '%s'.  Returning active CollisionWorld '%s' instead",
                     collision_detector_name.c_str(), active_collision_->alloc_->getName().c_str());
-    return active_collision_->cworld_const_;
+    return getCollisionWorld(*active_collision_);
   }
 
-  return it->second->cworld_const_;
+  return getCollisionWorld(*it->second);
 }
 
 const collision_detection::CollisionRobotConstPtr&
@@ -414,6 +563,7 @@ void PlanningScene::clearDiffs()
 {
   if (!parent_)
     return;
+  const std::uint64_t previous_version = getVersion();
 
   // clear everything, reset the world, record diffs
   world_.reset(new collision_detection::World(*parent_->world_));
@@ -435,8 +585,10 @@ void PlanningScene::clearDiffs()
       it->second->crobot_unpadded_.reset();
       it->second->crobot_unpadded_const_.reset();
 
-      it->second->cworld_ = it->second->alloc_->allocateWorld(it->second->parent_->cworld_, world_);
-      it->second->cworld_const_ = it->second->cworld_;
+      // reallocated from the parent on first use
+      it->second->cworld_.reset();
+      it->second->cworld_const_.reset();
+      it->second->cworld_ready_ = false;
     }
     else
     {
@@ -444,6 +596,7 @@ void PlanningScene::clearDiffs()
 
       it->second->cworld_ = it->second->alloc_->allocateWorld(world_);
       it->second->cworld_const_ = it->second->cworld_;
+      it->second->cworld_ready_ = true;
     }
   }
 
@@ -452,6 +605,7 @@ void PlanningScene::clearDiffs()
   acm_.reset();
   object_colors_.reset();
   object_types_.reset();
+  keepVersionAbove(previous_version);
 }
 
 void PlanningScene::pushDiffs(const PlanningScenePtr& scene)
@@ -459,15 +613,45 @@ void PlanningScene::pushDiffs(const PlanningScenePtr& scene)
   if (!parent_)
     return;
 
-  if (ftf_)
-    scene->getTransformsNonConst().setAllTransforms(ftf_->getAllTransforms());
-
-  if (kstate_)
-  {
-    scene->getCurrentStateNonConst() = *kstate_;
+  // The scenes whose diffs are pushed, most recent first. If scene is an ancestor, this is every scene up to (but
+  // excluding) it; otherwise only the diffs of this scene with respect to its parent are pushed.
+  std::vector<const PlanningScene*> chain;
+  for (const PlanningScene* s = this; s && s != scene.get(); s = s->parent_.get())
+    chain.push_back(s);
+  if (chain.empty() || chain.back()->parent_ != scene)
+    chain.assign(1, this);
+
+  // components that are replaced as a whole are taken from the most recent scene that modified them
+  const robot_state::Transforms* ftf = nullptr;
+  const robot_state::RobotState* kstate = nullptr;
+  const collision_detection::AllowedCollisionMatrix* acm = nullptr;
+  const collision_detection::CollisionRobot* crobot = nullptr;
+  std::set<std::string> changed_objects;
+  for (std::size_t i = 0; i < chain.size(); ++i)
+  {
+    const PlanningScene& s = *chain[i];
+    if (!ftf && s.ftf_)
+      ftf = s.ftf_.get();
+    if (!kstate && s.kstate_)
+      kstate = s.kstate_.get();
+    if (!acm && s.acm_)
+      acm = s.acm_.get();
+    if (!crobot && s.active_collision_->crobot_)
+      crobot = s.active_collision_->crobot_.get();
+    if (s.world_diff_)
+      for (collision_detection::WorldDiff::const_iterator it = s.world_diff_->begin(); it != s.world_diff_->end(); ++it)
+        changed_objects.insert(it->first);
+  }
+
+  if (ftf)
+    scene->getTransformsNonConst().setAllTransforms(ftf->getAllTransforms());
+
+  if (kstate)
+  {
+    scene->getCurrentStateNonConst() = *kstate;
     // push colors and types for attached objects
     std::vector<const moveit::core::AttachedBody*> attached_objs;
-    kstate_->getAttachedBodies(attached_objs);
+    kstate->getAttachedBodies(attached_objs);
     for (std::vector<const moveit::core::AttachedBody*>::const_iterator it = attached_objs.begin();
          it != attached_objs.end(); ++it)
     {
@@ -478,37 +662,35 @@ void PlanningScene::pushDiffs(const PlanningScenePtr& scene)
     }
   }
 
-  if (acm_)
-    scene->getAllowedCollisionMatrixNonConst() = *acm_;
+  if (acm)
+    scene->getAllowedCollisionMatrixNonConst() = *acm;
 
-  if (active_collision_->crobot_)
+  if (crobot)
   {
     collision_detection::CollisionRobotPtr active_crobot = scene->getCollisionRobotNonConst();
-    active_crobot->setLinkPadding(active_collision_->crobot_->getLinkPadding());
-    active_crobot->setLinkScale(active_collision_->crobot_->getLinkScale());
+    active_crobot->setLinkPadding(crobot->getLinkPadding());
+    active_crobot->setLinkScale(crobot->getLinkScale());
     scene->propogateRobotPadding();
   }
 
-  if (world_diff_)
+  // the world of this scene already reflects every change made along the chain
+  for (std::set<std::string>::const_iterator it = changed_objects.begin(); it != changed_objects.end(); ++it)
   {
-    for (collision_detection::WorldDiff::const_iterator it = world_diff_->begin(); it != world_diff_->end(); ++it)
+    collision_detection::World::ObjectConstPtr obj = world_->getObject(*it);
+    if (!obj)
     {
-      if (it->second == collision_detection::World::DESTROY)
-      {
-        scene->world_->removeObject(it->first);
-        scene->removeObjectColor(it->first);
-        scene->removeObjectType(it->first);
-      }
-      else
-      {
-        const collision_detection::World::Object& obj = *world_->getObject(it->first);
-        scene->world_->removeObject(obj.id_);
-        scene->world_->addToObject(obj.id_, obj.shapes_, obj.shape_poses_);
-        if (hasObjectColor(it->first))
-          scene->setObjectColor(it->first, getObjectColor(it->first));
-        if (hasObjectType(it->first))
-          scene->setObjectType(it->first, getObjectType(it->first));
-      }
+      scene->world_->removeObject(*it);
+      scene->removeObjectColor(*it);
+      scene->removeObjectType(*it);
+    }
+    else
+    {
+      scene->world_->removeObject(obj->id_);
+      scene->world_->addToObject(obj->id_, obj->shapes_, obj->shape_poses_);
+      if (hasObjectColor(*it))
+        scene->setObjectColor(*it, getObjectColor(*it));
+      if (hasObjectType(*it))
+        scene->setObjectType(*it, getObjectType(*it));
     }
   }
 }
@@ -557,6 +739,51 @@ void PlanningScene::checkCollision(const collision_detection::CollisionRequest&
     getCollisionRobotUnpadded()->checkSelfCollision(req, res, kstate, acm);
 }
 
+void PlanningScene::checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                                        const std::vector<const robot_state::RobotState*>& states,
+                                        std::vector<collision_detection::CollisionResult>& results,
+                                        unsigned int thread_count) const
+{
+  results.clear();
+  results.resize(states.size());
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, states.size());
+
+  // check the world first, as checkCollision() does; the collision detector may check all states at once
+  getCollisionWorld()->checkRobotCollisionBatch(req, results, *getCollisionRobot(), states, getAllowedCollisionMatrix(),
+                                                thread_count);
+
+  // the collision checks of the scene are const and every concurrent query uses separate FCL managers,
+  // so the threads only need to claim the states they check
+  std::atomic<std::size_t> next(0);
+  auto worker = [this, &req, &states, &results, &next]() {
+    for (std::size_t i = next++; i < states.size(); i = next++)
+      if (!results[i].collision || (req.contacts && results[i].contacts.size() < req.max_contacts))
+        getCollisionRobotUnpadded()->checkSelfCollision(req, results[i], *states[i], getAllowedCollisionMatrix());
+  };
+  if (thread_count <= 1)
+  {
+    worker();
+    return;
+  }
+  boost::thread_group workers;
+  for (unsigned int t = 0; t < thread_count; ++t)
+    workers.create_thread(worker);
+  workers.join_all();
+}
+
+void PlanningScene::checkCollisionBatch(const collision_detection::CollisionRequest& req,
+                                        const std::vector<const robot_state::RobotState*>& states,
+                                        std::vector<bool>& colliding, unsigned int thread_count) const
+{
+  std::vector<collision_detection::CollisionResult> results;
+  checkCollisionBatch(req, states, results, thread_count);
+  colliding.resize(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i)
+    colliding[i] = results[i].collision;
+}
+
 void PlanningScene::checkCollisionUnpadded(const collision_detection::CollisionRequest& req,
                                            collision_detection::CollisionResult& res)
 {
@@ -629,6 +856,8 @@ void PlanningScene::getCollidingLinks(std::vector<std::string>& links, const rob
 
 const collision_detection::CollisionRobotPtr& PlanningScene::getCollisionRobotNonConst()
 {
+  // the padding is about to be changed
+  ++version_;
   if (!active_collision_->crobot_)
   {
     active_collision_->crobot_ =
@@ -687,6 +916,8 @@ const robot_state::Transforms& PlanningScene::getTransforms()
 
 robot_state::Transforms& PlanningScene::getTransformsNonConst()
 {
+  // the fixed transforms are about to be changed
+  ++version_;
   getCurrentStateNonConst().update();
   if (!ftf_)
   {
@@ -1128,6 +1359,7 @@ void PlanningScene::setCurrentState(const robot_state::RobotState& state)
 
 void PlanningScene::decoupleParent()
 {
+  const std::uint64_t previous_version = getVersion();
   if (!parent_)
     return;
 
@@ -1148,6 +1380,8 @@ void PlanningScene::decoupleParent()
 
   for (CollisionDetectorIterator it = collision_.begin(); it != collision_.end(); ++it)
   {
+    // the collision world is allocated lazily from the parent, so make sure it exists before decoupling
+    getCollisionWorld(*it->second);
     if (!it->second->crobot_)
     {
       it->second->crobot_ = it->second->alloc_->allocateRobot(it->second->parent_->getCollisionRobot());
@@ -1194,11 +1428,13 @@ void PlanningScene::decoupleParent()
   }
 
   parent_.reset();
+  keepVersionAbove(previous_version);
 }
 
 bool PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::PlanningScene& scene_msg)
 {
   bool result = true;
+  const std::uint64_t previous_version = getVersion();
 
   ROS_DEBUG_NAMED("planning_scene", "Adding planning scene diff");
   if (!scene_msg.name.empty())
@@ -1252,12 +1488,15 @@ bool PlanningScene::setPlanningSceneDiffMsg(const moveit_msgs::PlanningScene& sc
   if (!scene_msg.world.octomap.octomap.data.empty())
     processOctomapMsg(scene_msg.world.octomap);
 
+  // the ACM may have been replaced, and the transforms and padding are not versioned themselves
+  keepVersionAbove(previous_version);
   return result;
 }
 
 bool PlanningScene::setPlanningSceneMsg(const moveit_msgs::PlanningScene& scene_msg)
 {
   ROS_DEBUG_NAMED("planning_scene", "Setting new planning scene: '%s'", scene_msg.name.c_str());
+  const std::uint64_t previous_version = getVersion();
   name_ = scene_msg.name;
 
   if (!scene_msg.robot_model_name.empty() && scene_msg.robot_model_name != getRobotModel()->getName())
@@ -1285,7 +1524,9 @@ bool PlanningScene::setPlanningSceneMsg(const moveit_msgs::PlanningScene& scene_
   for (std::size_t i = 0; i < scene_msg.object_colors.size(); ++i)
     setObjectColor(scene_msg.object_colors[i].id, scene_msg.object_colors[i].color);
   world_->clearObjects();
-  return processPlanningSceneWorldMsg(scene_msg.world);
+  bool result = processPlanningSceneWorldMsg(scene_msg.world);
+  keepVersionAbove(previous_version);
+  return result;
 }
 
 bool PlanningScene::processPlanningSceneWorldMsg(const moveit_msgs::PlanningSceneWorld& world)
@@ -1308,13 +1549,15 @@ bool PlanningScene::usePlanningSceneMsg(const moveit_msgs::PlanningScene& scene_
 void PlanningScene::processOctomapMsg(const octomap_msgs::Octomap& map)
 {
   // each octomap replaces any previous one
-  world_->removeObject(OCTOMAP_NS);
-
   if (map.data.empty())
+  {
+    world_->removeObject(OCTOMAP_NS);
     return;
+  }
 
   if (map.id != "OcTree")
   {
+    world_->removeObject(OCTOMAP_NS);
     ROS_ERROR_NAMED("planning_scene", "Received octomap is of type '%s' but type 'OcTree' is expected.",
                     map.id.c_str());
     return;
@@ -1322,14 +1565,9 @@ void PlanningScene::processOctomapMsg(const octomap_msgs::Octomap& map)
 
   std::shared_ptr<octomap::OcTree> om(static_cast<octomap::OcTree*>(octomap_msgs::msgToMap(map)));
   if (!map.header.frame_id.empty())
-  {
-    const Eigen::Affine3d& t = getTransforms().getTransform(map.header.frame_id);
-    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), t);
-  }
+    processOctomapPtr(om, getTransforms().getTransform(map.header.frame_id));
   else
-  {
-    world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), Eigen::Affine3d::Identity());
-  }
+    processOctomapPtr(om, Eigen::Affine3d::Identity());
 }
 
 void PlanningScene::removeAllCollisionObjects()
@@ -1347,13 +1585,15 @@ void PlanningScene::removeAllCollisionObjects()
 void PlanningScene::processOctomapMsg(const octomap_msgs::OctomapWithPose& map)
 {
   // each octomap replaces any previous one
-  world_->removeObject(OCTOMAP_NS);
-
   if (map.octomap.data.empty())
+  {
+    world_->removeObject(OCTOMAP_NS);
     return;
+  }
 
   if (map.octomap.id != "OcTree")
   {
+    world_->removeObject(OCTOMAP_NS);
     ROS_ERROR_NAMED("planning_scene", "Received octomap is of type '%s' but type 'OcTree' is expected.",
                     map.octomap.id.c_str());
     return;
@@ -1363,8 +1603,7 @@ void PlanningScene::processOctomapMsg(const octomap_msgs::OctomapWithPose& map)
   const Eigen::Affine3d& t = getTransforms().getTransform(map.header.frame_id);
   Eigen::Affine3d p;
   tf::poseMsgToEigen(map.origin, p);
-  p = t * p;
-  world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(om)), p);
+  processOctomapPtr(om, t * p);
 }
 
 void PlanningScene::processOctomapPtr(const std::shared_ptr<const octomap::OcTree>& octree, const Eigen::Affine3d& t)
@@ -1381,6 +1620,8 @@ void PlanningScene::processOctomapPtr(const std::shared_ptr<const octomap::OcTre
         // if the pose changed, we update it
         if (map->shape_poses_[0].isApprox(t, std::numeric_limits<double>::epsilon() * 100.0))
         {
+          // the octree was modified in place, which the world does not see
+          ++version_;
           if (world_diff_)
             world_diff_->set(OCTOMAP_NS, collision_detection::World::DESTROY | collision_detection::World::CREATE |
                                              collision_detection::World::ADD_SHAPE);
@@ -1393,9 +1634,18 @@ void PlanningScene::processOctomapPtr(const std::shared_ptr<const octomap::OcTre
         }
         return;
       }
+
+      // if the octree pointer changed, swap the shape of the existing object: the new octree is added before the old
+      // one is removed, so the object never disappears from the world and collision detectors only replace the
+      // geometry of the octree instead of destroying and creating the object
+      shapes::ShapeConstPtr old_shape = map->shapes_[0];
+      map.reset();
+      world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octree)), t);
+      world_->removeShapeFromObject(OCTOMAP_NS, old_shape);
+      return;
     }
   }
-  // if the octree pointer changed, update the structure
+  // otherwise create the structure from scratch
   world_->removeObject(OCTOMAP_NS);
   world_->addToObject(OCTOMAP_NS, shapes::ShapeConstPtr(new shapes::OcTree(octree)), t);
 }
@@ -1510,12 +1760,12 @@ bool PlanningScene::processAttachedCollisionObjectMsg(const moveit_msgs::Attache
         }
         for (std::size_t i = 0; i < object.object.meshes.size(); ++i)
         {
-          shapes::Shape* s = shapes::constructShapeFromMsg(object.object.meshes[i]);
+          shapes::ShapeConstPtr s = constructMeshFromMsg(object.object.meshes[i]);
           if (s)
           {
             Eigen::Affine3d p;
             tf::poseMsgToEigen(object.object.mesh_poses[i], p);
-            shapes.push_back(shapes::ShapeConstPtr(s));
+            shapes.push_back(s);
             poses.push_back(p);
           }
         }
@@ -1708,12 +1958,12 @@ bool PlanningScene::processCollisionObjectMsg(const moveit_msgs::CollisionObject
     }
     for (std::size_t i = 0; i < object.meshes.size(); ++i)
     {
-      shapes::Shape* s = shapes::constructShapeFromMsg(object.meshes[i]);
+      shapes::ShapeConstPtr s = constructMeshFromMsg(object.meshes[i]);
       if (s)
       {
         Eigen::Affine3d p;
         tf::poseMsgToEigen(object.mesh_poses[i], p);
-        world_->addToObject(object.id, shapes::ShapeConstPtr(s), t * p);
+        world_->addToObject(object.id, s, t * p);
       }
     }
     for (std::size_t i = 0; i < object.planes.size(); ++i)
@@ -1883,12 +2133,13 @@ void PlanningScene::setObjectType(const std::string& id, const object_recognitio
   if (!object_types_)
     object_types_.reset(new ObjectTypeMap());
   (*object_types_)[id] = type;
+  ++version_;
 }
 
 void PlanningScene::removeObjectType(const std::string& id)
 {
-  if (object_types_)
-    object_types_->erase(id);
+  if (object_types_ && object_types_->erase(id))
+    ++version_;
 }
 
 void PlanningScene::getKnownObjectTypes(ObjectTypeMap& kc) const
@@ -1945,12 +2196,13 @@ void PlanningScene::setObjectColor(const std::string& id, const std_msgs::ColorR
   if (!object_colors_)
     object_colors_.reset(new ObjectColorMap());
   (*object_colors_)[id] = color;
+  ++version_;
 }
 
 void PlanningScene::removeObjectColor(const std::string& id)
 {
-  if (object_colors_)
-    object_colors_->erase(id);
+  if (object_colors_ && object_colors_->erase(id))
+    ++version_;
 }
 
 bool PlanningScene::isStateColliding(const moveit_msgs::RobotState& state, const std::string& group, bool verbose) const
@@ -2115,7 +2367,7 @@ bool PlanningScene::isPathValid(const moveit_msgs::RobotState& start_state,
 bool PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory& trajectory,
                                 const moveit_msgs::Constraints& path_constraints,
                                 const std::vector<moveit_msgs::Constraints>& goal_constraints, const std::string& group,
-                                bool verbose, std::vector<std::size_t>* invalid_index) const
+                                bool verbose, std::vector<std::size_t>* invalid_index, unsigned int thread_count) const
 {
   bool result = true;
   if (invalid_index)
@@ -2123,24 +2375,74 @@ bool PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory& traject
   kinematic_constraints::KinematicConstraintSet ks_p(getRobotModel());
   ks_p.add(path_constraints, getTransforms());
   std::size_t n_wp = trajectory.getWayPointCount();
-  for (std::size_t i = 0; i < n_wp; ++i)
+
+  // Waypoints are checked coarse to fine, so an invalid segment is usually found after a few checks. Unless all
+  // invalid waypoints are requested, the first one found cancels the remaining checks in all threads.
+  const std::vector<std::size_t> order = trajectory_processing::coarseToFineOrder(n_wp);
+  std::vector<char> invalid(n_wp, 0);
+
+  // the path constraints are much cheaper to check than collisions, so they are checked for all waypoints at once,
+  // and waypoints that violate them are not checked for collisions
+  if (!ks_p.empty())
   {
-    const robot_state::RobotState& st = trajectory.getWayPoint(i);
+    std::vector<const robot_state::RobotState*> states(n_wp);
+    for (std::size_t i = 0; i < n_wp; ++i)
+      states[i] = &trajectory.getWayPoint(i);
+    std::vector<bool> satisfied;
+    if (ks_p.decide(states, satisfied, verbose) < n_wp)
+    {
+      if (!invalid_index)
+        return false;
+      for (std::size_t i = 0; i < n_wp; ++i)
+        invalid[i] = !satisfied[i];
+    }
+  }
 
-    bool this_state_valid = true;
-    if (isStateColliding(st, group, verbose))
-      this_state_valid = false;
-    if (!isStateFeasible(st, verbose))
-      this_state_valid = false;
-    if (!ks_p.empty() && !ks_p.decide(st, verbose).satisfied)
-      this_state_valid = false;
+  std::atomic<bool> cancelled(false);
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]() {
+    for (std::size_t k = next++; k < n_wp && !cancelled; k = next++)
+    {
+      if (invalid[order[k]])
+        continue;
+      const robot_state::RobotState& st = trajectory.getWayPoint(order[k]);
+
+      bool this_state_valid = true;
+      if (isStateColliding(st, group, verbose))
+        this_state_valid = false;
+      if (!isStateFeasible(st, verbose))
+        this_state_valid = false;
+
+      if (!this_state_valid)
+      {
+        invalid[order[k]] = 1;
+        if (!invalid_index)
+          cancelled = true;
+      }
+    }
+  };
 
-    if (!this_state_valid)
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, n_wp);
+  if (thread_count <= 1)
+    worker();
+  else
+  {
+    boost::thread_group workers;
+    for (unsigned int t = 0; t < thread_count; ++t)
+      workers.create_thread(worker);
+    workers.join_all();
+  }
+  if (cancelled)
+    return false;
+
+  for (std::size_t i = 0; i < n_wp; ++i)
+  {
+    if (invalid[i])
     {
       if (invalid_index)
         invalid_index->push_back(i);
-      else
-        return false;
       result = false;
     }
 
@@ -2150,7 +2452,7 @@ bool PlanningScene::isPathValid(const robot_trajectory::RobotTrajectory& traject
       bool found = false;
       for (std::size_t k = 0; k < goal_constraints.size(); ++k)
       {
-        if (isStateConstrained(st, goal_constraints[k]))
+        if (isStateConstrained(trajectory.getWayPoint(i), goal_constraints[k]))
         {
           found = true;
           break;
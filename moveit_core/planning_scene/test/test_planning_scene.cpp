@@ -36,6 +36,9 @@
 
 #include <gtest/gtest.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <geometric_shapes/shapes.h>
+#include <octomap/octomap.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
 #include <string>
@@ -167,6 +170,215 @@ TEST(PlanningScene, isStateValid)
   }
 }
 
+TEST(PlanningScene, checkCollisionBatch)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModels(urdf_model, srdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  std::vector<robot_state::RobotState> states(20, ps->getCurrentState());
+  std::vector<const robot_state::RobotState*> state_ptrs;
+  for (robot_state::RobotState& state : states)
+  {
+    state.setToRandomPositions();
+    state.update();
+    state_ptrs.push_back(&state);
+  }
+
+  collision_detection::CollisionRequest req;
+  std::vector<bool> colliding;
+  ps->checkCollisionBatch(req, state_ptrs, colliding, 4);
+  ASSERT_EQ(colliding.size(), states.size());
+  for (std::size_t i = 0; i < states.size(); ++i)
+  {
+    collision_detection::CollisionResult res;
+    ps->checkCollision(req, res, states[i]);
+    EXPECT_EQ(res.collision, colliding[i]);
+  }
+}
+
+TEST(PlanningScene, ReplaceOctomap)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModels(urdf_model, srdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  const robot_state::RobotState& state = ps->getCurrentState();
+
+  std::shared_ptr<octomap::OcTree> empty(new octomap::OcTree(0.05));
+  std::shared_ptr<octomap::OcTree> occupied(new octomap::OcTree(0.05));
+  occupied->updateNode(octomap::point3d(0.0, 0.0, 0.2), true);
+
+  collision_detection::CollisionRequest req;
+  ps->processOctomapPtr(empty, Eigen::Affine3d::Identity());
+  collision_detection::CollisionResult res;
+  ps->getCollisionWorld()->checkRobotCollision(req, res, *ps->getCollisionRobot(), state);
+  EXPECT_FALSE(res.collision);
+
+  // a new octree replaces the shape of the existing octomap object
+  ps->processOctomapPtr(occupied, Eigen::Affine3d::Identity());
+  collision_detection::CollisionWorld::ObjectConstPtr map =
+      ps->getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+  ASSERT_TRUE(map != nullptr);
+  ASSERT_EQ(1u, map->shapes_.size());
+  EXPECT_EQ(occupied, static_cast<const shapes::OcTree*>(map->shapes_[0].get())->octree);
+  res = collision_detection::CollisionResult();
+  ps->getCollisionWorld()->checkRobotCollision(req, res, *ps->getCollisionRobot(), state);
+  EXPECT_TRUE(res.collision);
+
+  ps->processOctomapPtr(empty, Eigen::Affine3d::Identity());
+  res = collision_detection::CollisionResult();
+  ps->getCollisionWorld()->checkRobotCollision(req, res, *ps->getCollisionRobot(), state);
+  EXPECT_FALSE(res.collision);
+}
+
+TEST(PlanningScene, ShareIdenticalMeshes)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModel(urdf_model);
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+
+  shape_msgs::Mesh mesh;
+  mesh.vertices.resize(4);
+  mesh.vertices[1].x = 1.0;
+  mesh.vertices[2].y = 1.0;
+  mesh.vertices[3].z = 1.0;
+  mesh.triangles.resize(4);
+  const unsigned int indices[4][3] = { { 0, 1, 2 }, { 0, 1, 3 }, { 0, 2, 3 }, { 1, 2, 3 } };
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 3; ++j)
+      mesh.triangles[i].vertex_indices[j] = indices[i][j];
+
+  moveit_msgs::CollisionObject object;
+  object.header.frame_id = ps->getPlanningFrame();
+  object.operation = moveit_msgs::CollisionObject::ADD;
+  object.meshes.push_back(mesh);
+  object.mesh_poses.resize(1);
+  object.mesh_poses[0].orientation.w = 1.0;
+  object.id = "tote1";
+  EXPECT_TRUE(ps->processCollisionObjectMsg(object));
+  object.id = "tote2";
+  EXPECT_TRUE(ps->processCollisionObjectMsg(object));
+  object.meshes[0].vertices[3].z = 2.0;
+  object.id = "tote3";
+  EXPECT_TRUE(ps->processCollisionObjectMsg(object));
+
+  // identical messages share one shape, a different mesh gets its own
+  shapes::ShapeConstPtr shape1 = ps->getWorld()->getObject("tote1")->shapes_[0];
+  EXPECT_EQ(shape1, ps->getWorld()->getObject("tote2")->shapes_[0]);
+  EXPECT_NE(shape1, ps->getWorld()->getObject("tote3")->shapes_[0]);
+  EXPECT_EQ(2.0, static_cast<const shapes::Mesh*>(ps->getWorld()->getObject("tote3")->shapes_[0].get())->vertices[11]);
+}
+
+TEST(PlanningScene, Versions)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModel(urdf_model);
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+
+  std::uint64_t version = ps->getVersion();
+  std::uint64_t state_version = ps->getCurrentState().getVersion();
+  ps->getCurrentStateNonConst().setVariablePosition(0, 0.1);
+  EXPECT_LT(state_version, ps->getCurrentState().getVersion());
+  EXPECT_LT(version, ps->getVersion());
+
+  version = ps->getVersion();
+  std::uint64_t world_version = ps->getWorld()->getVersion();
+  ps->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.4)), id);
+  EXPECT_LT(world_version, ps->getWorld()->getVersion());
+  EXPECT_LT(version, ps->getVersion());
+
+  version = ps->getVersion();
+  ps->getAllowedCollisionMatrixNonConst().setEntry("sphere", true);
+  EXPECT_LT(version, ps->getVersion());
+
+  // updating the transforms does not change the version, and copies start with the version of the original
+  version = ps->getVersion();
+  ps->getCurrentStateNonConst().update();
+  EXPECT_EQ(version, ps->getVersion());
+  robot_state::RobotState copy(ps->getCurrentState());
+  EXPECT_EQ(ps->getCurrentState().getVersion(), copy.getVersion());
+
+  // changes of the parent are seen by the diff, and clearing the diff does not decrease its version
+  planning_scene::PlanningScenePtr child = ps->diff();
+  version = child->getVersion();
+  ps->getCurrentStateNonConst().setVariablePosition(0, 0.2);
+  EXPECT_LT(version, child->getVersion());
+  version = child->getVersion();
+  child->getCurrentStateNonConst().setVariablePosition(0, 0.3);
+  child->getWorldNonConst()->removeObject("sphere");
+  EXPECT_LT(version, child->getVersion());
+  version = child->getVersion();
+  child->clearDiffs();
+  EXPECT_LT(version, child->getVersion());
+  version = child->getVersion();
+  child->decoupleParent();
+  EXPECT_LT(version, child->getVersion());
+}
+
+TEST(PlanningScene, PushChainedDiffs)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModels(urdf_model, srdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  Eigen::Affine3d id = Eigen::Affine3d::Identity();
+  ps->getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), id);
+
+  // collision worlds of children are allocated on first use and match the world of the child
+  planning_scene::PlanningScenePtr first = ps->diff();
+  first->getWorldNonConst()->removeObject("box");
+  first->getAllowedCollisionMatrixNonConst().setEntry("sphere", "r_wrist_roll_link", true);
+  planning_scene::PlanningScenePtr second = first->diff();
+  second->getWorldNonConst()->addToObject("sphere", shapes::ShapeConstPtr(new shapes::Sphere(0.1)), id);
+  EXPECT_EQ(second->getWorld(), second->getCollisionWorld()->getWorld());
+  EXPECT_EQ(first->getWorld(), first->getCollisionWorld()->getWorld());
+  collision_detection::CollisionRequest req;
+  collision_detection::CollisionResult res;
+  second->checkCollision(req, res);
+
+  // pushing to the root merges the diffs of both children
+  second->pushDiffs(ps);
+  EXPECT_FALSE(ps->getWorld()->hasObject("box"));
+  EXPECT_TRUE(ps->getWorld()->hasObject("sphere"));
+  collision_detection::AllowedCollision::Type type;
+  EXPECT_TRUE(ps->getAllowedCollisionMatrix().getEntry("sphere", "r_wrist_roll_link", type));
+  EXPECT_EQ(collision_detection::AllowedCollision::ALWAYS, type);
+}
+
+TEST(PlanningScene, isPathValidParallel)
+{
+  srdf::ModelSharedPtr srdf_model(new srdf::Model());
+  urdf::ModelInterfaceSharedPtr urdf_model;
+  loadRobotModels(urdf_model, srdf_model);
+
+  planning_scene::PlanningScenePtr ps(new planning_scene::PlanningScene(urdf_model, srdf_model));
+  robot_trajectory::RobotTrajectory trajectory(ps->getRobotModel(), "left_arm");
+  robot_state::RobotState state = ps->getCurrentState();
+  for (std::size_t i = 0; i < 30; ++i)
+  {
+    state.setToRandomPositions();
+    state.update();
+    trajectory.addSuffixWayPoint(state, 0.1);
+  }
+
+  // the coarse-to-fine, multi-threaded check reports the same invalid waypoints as a single thread
+  static const moveit_msgs::Constraints no_constraints;
+  static const std::vector<moveit_msgs::Constraints> no_goals;
+  std::vector<std::size_t> sequential, parallel;
+  bool valid = ps->isPathValid(trajectory, no_constraints, no_goals, "left_arm", false, &sequential, 1);
+  EXPECT_EQ(valid, ps->isPathValid(trajectory, no_constraints, no_goals, "left_arm", false, &parallel, 4));
+  EXPECT_EQ(sequential, parallel);
+  EXPECT_EQ(valid, ps->isPathValid(trajectory, no_constraints, no_goals, "left_arm", false, nullptr, 4));
+  EXPECT_EQ(valid, sequential.empty());
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
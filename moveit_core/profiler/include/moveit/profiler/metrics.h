@@ -0,0 +1,191 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PROFILER_METRICS_
+#define MOVEIT_PROFILER_METRICS_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace moveit
+{
+namespace tools
+{
+/** \brief A monotonically increasing count that many threads can increment at once. Increments go to one of several
+    slots, chosen per thread, so that threads do not contend for the same cache line. */
+class MetricCounter : private boost::noncopyable
+{
+public:
+  MetricCounter(const std::string& name, const std::string& help);
+
+  /** \brief Add \e n to the count */
+  void increment(std::uint64_t n = 1)
+  {
+    slots_[slotIndex()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /** \brief Get the current count */
+  std::uint64_t value() const;
+
+  const std::string& getName() const
+  {
+    return name_;
+  }
+
+  const std::string& getHelp() const
+  {
+    return help_;
+  }
+
+private:
+  static const unsigned int SLOTS = 16;
+
+  /** \brief Get the slot of the calling thread */
+  static unsigned int slotIndex();
+
+  /** \brief A count padded to a cache line of its own */
+  struct Slot
+  {
+    std::atomic<std::uint64_t> value;
+    char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  std::string name_;
+  std::string help_;
+  Slot slots_[SLOTS];
+};
+
+/** \brief Counts observed values (typically latencies in seconds) in buckets with fixed upper bounds */
+class MetricHistogram : private boost::noncopyable
+{
+public:
+  /** \brief \e bounds are the ascending upper bounds of the buckets. Values above the last bound are counted in an
+      additional bucket. */
+  MetricHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds);
+
+  /** \brief Count \e value in its bucket */
+  void observe(double value);
+
+  /** \brief Get the count of each bucket (one more than there are bounds), the number of values and their sum */
+  void getSnapshot(std::vector<std::uint64_t>& buckets, std::uint64_t& count, double& sum) const;
+
+  const std::vector<double>& getBounds() const
+  {
+    return bounds_;
+  }
+
+  const std::string& getName() const
+  {
+    return name_;
+  }
+
+  const std::string& getHelp() const
+  {
+    return help_;
+  }
+
+private:
+  std::string name_;
+  std::string help_;
+  std::vector<double> bounds_;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> buckets_;
+  std::atomic<double> sum_;
+};
+
+/** \brief Observes the time from construction to destruction in a histogram, in seconds */
+class ScopedMetricTimer : private boost::noncopyable
+{
+public:
+  ScopedMetricTimer(MetricHistogram& histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now())
+  {
+  }
+
+  ~ScopedMetricTimer()
+  {
+    histogram_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+  }
+
+private:
+  MetricHistogram& histogram_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/** \brief The process-wide set of counters and histograms. These are meant to be always on: instrumented code looks
+    up its metrics once (e.g., into a static reference) and then only pays for an atomic increment. */
+class MetricsRegistry : private boost::noncopyable
+{
+public:
+  /** \brief Return the process-wide registry */
+  static MetricsRegistry& instance();
+
+  /** \brief Return the counter named \e name, creating it on first use. The reference stays valid for the life of
+      the registry. */
+  MetricCounter& counter(const std::string& name, const std::string& help);
+
+  /** \brief Return the histogram named \e name, creating it with \e bounds on first use. The reference stays valid for
+      the life of the registry. */
+  MetricHistogram& histogram(const std::string& name, const std::string& help,
+                             const std::vector<double>& bounds = latencyBounds());
+
+  /** \brief Bucket bounds for latencies, from 10 microseconds to 10 seconds */
+  static const std::vector<double>& latencyBounds();
+
+  /** \brief Get all registered counters, ordered by name */
+  std::vector<const MetricCounter*> getCounters() const;
+
+  /** \brief Get all registered histograms, ordered by name */
+  std::vector<const MetricHistogram*> getHistograms() const;
+
+  /** \brief Write all metrics in the Prometheus text exposition format */
+  void writePrometheus(std::ostream& out) const;
+
+private:
+  MetricsRegistry();
+
+  mutable boost::mutex lock_;
+  std::map<std::string, std::unique_ptr<MetricCounter> > counters_;
+  std::map<std::string, std::unique_ptr<MetricHistogram> > histograms_;
+};
+}
+}
+
+#endif
@@ -56,8 +56,14 @@
 
 #include <map>
 #include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <unordered_map>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
@@ -69,7 +75,10 @@ namespace tools
     spent in various chunks of code. This is different from
     external profiling tools in that it allows the user to count
     time spent in various bits of code (sub-function granularity)
-    or count how many times certain pieces of code are executed.*/
+    or count how many times certain pieces of code are executed.
+    Every thread records into its own buffers, so threads do not
+    contend for a shared lock. Optionally, every block of time is
+    also kept as a trace event, for export with writeTrace().*/
 class Profiler : private boost::noncopyable
 {
 public:
@@ -122,7 +131,14 @@ public:
 
   /** \brief Constructor. It is allowed to separately instantiate this
       class (not only as a singleton) */
-  Profiler(bool printOnDestroy = false, bool autoStart = false) : running_(false), printOnDestroy_(printOnDestroy)
+  Profiler(bool printOnDestroy = false, bool autoStart = false)
+    : local_(&releaseThreadData)
+    , epoch_(Clock::now())
+    , enabled_(true)
+    , trace_(false)
+    , trace_capacity_(1000000)
+    , running_(false)
+    , printOnDestroy_(printOnDestroy)
   {
     if (autoStart)
       start();
@@ -131,7 +147,7 @@ public:
   /** \brief Destructor */
   ~Profiler(void)
   {
-    if (printOnDestroy_ && !data_.empty())
+    if (printOnDestroy_ && !threads_.empty())
       status();
   }
 
@@ -234,46 +250,96 @@ public:
     return Instance().running();
   }
 
+  /** \brief Enable or disable recording. While disabled, all calls return right away */
+  void setEnabled(bool enabled)
+  {
+    enabled_ = enabled;
+  }
+
+  /** \brief Enable or disable recording. While disabled, all calls return right away */
+  static void SetEnabled(bool enabled)
+  {
+    Instance().setEnabled(enabled);
+  }
+
+  /** \brief Check if the profiler records anything */
+  bool enabled(void) const
+  {
+    return enabled_;
+  }
+
+  /** \brief Keep every block of time and event as a trace event as well. At most \e capacity events are kept per
+      thread; later ones are dropped */
+  void enableTrace(bool trace, std::size_t capacity = 1000000);
+
+  /** \brief Keep every block of time and event as a trace event as well */
+  static void EnableTrace(bool trace, std::size_t capacity = 1000000)
+  {
+    Instance().enableTrace(trace, capacity);
+  }
+
+  /** \brief Set the name the calling thread is shown with in the trace */
+  void setThreadName(const std::string& name);
+
+  /** \brief Set the name the calling thread is shown with in the trace */
+  static void SetThreadName(const std::string& name)
+  {
+    Instance().setThreadName(name);
+  }
+
+  /** \brief Write the trace events of all threads in the Chrome trace event format, which can be loaded in
+      chrome://tracing or Perfetto. Each thread is shown as a track of the same timeline. */
+  void writeTrace(std::ostream& out);
+
+  /** \brief Write the trace events of all threads in the Chrome trace event format */
+  static void WriteTrace(std::ostream& out)
+  {
+    Instance().writeTrace(out);
+  }
+
 private:
+  typedef std::chrono::steady_clock Clock;
+
   /** \brief Information about time spent in a section of the code */
   struct TimeInfo
   {
     TimeInfo(void)
-      : total(0, 0, 0, 0), shortest(boost::posix_time::pos_infin), longest(boost::posix_time::neg_infin), parts(0)
+      : total(Clock::duration::zero()), shortest(Clock::duration::max()), longest(Clock::duration::min()), parts(0)
     {
     }
 
     /** \brief Total time counted. */
-    boost::posix_time::time_duration total;
+    Clock::duration total;
 
     /** \brief The shortest counted time interval */
-    boost::posix_time::time_duration shortest;
+    Clock::duration shortest;
 
     /** \brief The longest counted time interval */
-    boost::posix_time::time_duration longest;
+    Clock::duration longest;
 
     /** \brief Number of times a chunk of time was added to this structure */
     unsigned long int parts;
 
     /** \brief The point in time when counting time started */
-    boost::posix_time::ptime start;
+    Clock::time_point start;
 
     /** \brief Begin counting time */
     void set(void)
     {
-      start = boost::posix_time::microsec_clock::universal_time();
+      start = Clock::now();
     }
 
-    /** \brief Add the counted time to the total time */
-    void update(void)
+    /** \brief Add the counted time to the total time and return it */
+    Clock::duration update(void)
     {
-      const boost::posix_time::time_duration& dt = boost::posix_time::microsec_clock::universal_time() - start;
+      const Clock::duration dt = Clock::now() - start;
       if (dt > longest)
         longest = dt;
       if (dt < shortest)
         shortest = dt;
-      total = total + dt;
+      total += dt;
       ++parts;
+      return dt;
     }
   };
 
@@ -290,8 +356,59 @@ private:
     unsigned long int parts;
   };
 
+  /** \brief The data recorded under one name */
+  struct Entry
+  {
+    Entry(void) : events(0), avg(), has_events(false), has_time(false)
+    {
+    }
+
+    unsigned long int events;
+    AvgInfo avg;
+    TimeInfo time;
+    bool has_events;
+    bool has_time;
+  };
+
+  /** \brief A block of time (\e times is 0) or an event counted \e times times, kept for the trace */
+  struct TraceEvent
+  {
+    unsigned int name;
+    unsigned int times;
+    Clock::time_point start;
+    Clock::duration duration;
+  };
+
   /** \brief Information to be maintained for each thread */
   struct PerThread
+  {
+    PerThread(void) : dropped(0)
+    {
+    }
+
+    /** \brief Return the index of the entry for \e name, adding it if needed */
+    unsigned int intern(const std::string& name);
+
+    /** \brief Keep \e event in the trace, unless \e capacity events are kept already */
+    void record(const TraceEvent& event, std::size_t capacity);
+
+    /** \brief Protects the data below; only contended while the profiler is read or cleared */
+    boost::mutex lock;
+
+    boost::thread::id id;
+    std::string thread_name;
+
+    /** \brief The names of the entries and their indices */
+    std::vector<std::string> names;
+    std::unordered_map<std::string, unsigned int> ids;
+    std::vector<Entry> entries;
+
+    std::vector<TraceEvent> trace;
+    unsigned long int dropped;
+  };
+
+  /** \brief The data of a thread, or of several threads merged, keyed by name */
+  struct Summary
   {
     /** \brief The stored events */
     std::map<std::string, unsigned long int> events;
@@ -303,10 +420,30 @@ private:
     std::map<std::string, TimeInfo> time;
   };
 
-  void printThreadInfo(std::ostream& out, const PerThread& data);
+  /** \brief The data of the calling thread, which is registered on first use */
+  PerThread& threadData(void);
+
+  /** \brief The thread data is owned by \e threads_, so nothing is released when a thread exits */
+  static void releaseThreadData(PerThread*)
+  {
+  }
+
+  void summarize(const PerThread& data, Summary& summary) const;
+
+  void printThreadInfo(std::ostream& out, const Summary& data);
 
+  /** \brief Protects the list of threads and the total time */
   boost::mutex lock_;
-  std::map<boost::thread::id, PerThread> data_;
+  std::vector<std::unique_ptr<PerThread> > threads_;
+  boost::thread_specific_ptr<PerThread> local_;
+
+  /** \brief The start of the timeline of the trace */
+  Clock::time_point epoch_;
+
+  std::atomic<bool> enabled_;
+  std::atomic<bool> trace_;
+  std::atomic<std::size_t> trace_capacity_;
+
   TimeInfo tinfo_;
   bool running_;
   bool printOnDestroy_;
@@ -443,6 +580,43 @@ public:
   {
     return false;
   }
+
+  void setEnabled(bool)
+  {
+  }
+
+  static void SetEnabled(bool)
+  {
+  }
+
+  bool enabled(void) const
+  {
+    return false;
+  }
+
+  void enableTrace(bool, std::size_t = 0)
+  {
+  }
+
+  static void EnableTrace(bool, std::size_t = 0)
+  {
+  }
+
+  void setThreadName(const std::string&)
+  {
+  }
+
+  static void SetThreadName(const std::string&)
+  {
+  }
+
+  void writeTrace(std::ostream&)
+  {
+  }
+
+  static void WriteTrace(std::ostream&)
+  {
+  }
 };
 }
 }
@@ -0,0 +1,186 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/profiler/metrics.h>
+#include <algorithm>
+
+namespace moveit
+{
+namespace tools
+{
+MetricCounter::MetricCounter(const std::string& name, const std::string& help) : name_(name), help_(help)
+{
+  for (unsigned int i = 0; i < SLOTS; ++i)
+    slots_[i].value = 0;
+}
+
+unsigned int MetricCounter::slotIndex()
+{
+  static std::atomic<unsigned int> next_slot(0);
+  static thread_local unsigned int slot = next_slot++ % SLOTS;
+  return slot;
+}
+
+std::uint64_t MetricCounter::value() const
+{
+  std::uint64_t sum = 0;
+  for (unsigned int i = 0; i < SLOTS; ++i)
+    sum += slots_[i].value.load(std::memory_order_relaxed);
+  return sum;
+}
+
+MetricHistogram::MetricHistogram(const std::string& name, const std::string& help, const std::vector<double>& bounds)
+  : name_(name), help_(help), bounds_(bounds), buckets_(new std::atomic<std::uint64_t>[bounds.size() + 1]), sum_(0.0)
+{
+  std::sort(bounds_.begin(), bounds_.end());
+  for (std::size_t i = 0; i <= bounds_.size(); ++i)
+    buckets_[i] = 0;
+}
+
+void MetricHistogram::observe(double value)
+{
+  // there are few buckets, so a linear search is as fast as any
+  std::size_t i = 0;
+  while (i < bounds_.size() && value > bounds_[i])
+    ++i;
+  buckets_[i].fetch_add(1, std::memory_order_relaxed);
+
+  double sum = sum_.load(std::memory_order_relaxed);
+  while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed))
+    ;
+}
+
+void MetricHistogram::getSnapshot(std::vector<std::uint64_t>& buckets, std::uint64_t& count, double& sum) const
+{
+  buckets.resize(bounds_.size() + 1);
+  count = 0;
+  for (std::size_t i = 0; i < buckets.size(); ++i)
+  {
+    buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    count += buckets[i];
+  }
+  sum = sum_.load(std::memory_order_relaxed);
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+const std::vector<double>& MetricsRegistry::latencyBounds()
+{
+  static const std::vector<double> bounds = { 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1.0, 5.0, 10.0 };
+  return bounds;
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name, const std::string& help)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::unique_ptr<MetricCounter>& counter = counters_[name];
+  if (!counter)
+    counter.reset(new MetricCounter(name, help));
+  return *counter;
+}
+
+MetricHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                            const std::vector<double>& bounds)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::unique_ptr<MetricHistogram>& histogram = histograms_[name];
+  if (!histogram)
+    histogram.reset(new MetricHistogram(name, help, bounds));
+  return *histogram;
+}
+
+std::vector<const MetricCounter*> MetricsRegistry::getCounters() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::vector<const MetricCounter*> counters;
+  for (std::map<std::string, std::unique_ptr<MetricCounter> >::const_iterator it = counters_.begin();
+       it != counters_.end(); ++it)
+    counters.push_back(it->second.get());
+  return counters;
+}
+
+std::vector<const MetricHistogram*> MetricsRegistry::getHistograms() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::vector<const MetricHistogram*> histograms;
+  for (std::map<std::string, std::unique_ptr<MetricHistogram> >::const_iterator it = histograms_.begin();
+       it != histograms_.end(); ++it)
+    histograms.push_back(it->second.get());
+  return histograms;
+}
+
+void MetricsRegistry::writePrometheus(std::ostream& out) const
+{
+  std::vector<const MetricCounter*> counters = getCounters();
+  for (std::size_t i = 0; i < counters.size(); ++i)
+  {
+    out << "# HELP " << counters[i]->getName() << " " << counters[i]->getHelp() << "\n";
+    out << "# TYPE " << counters[i]->getName() << " counter\n";
+    out << counters[i]->getName() << " " << counters[i]->value() << "\n";
+  }
+
+  std::vector<const MetricHistogram*> histograms = getHistograms();
+  std::vector<std::uint64_t> buckets;
+  for (std::size_t i = 0; i < histograms.size(); ++i)
+  {
+    const std::string& name = histograms[i]->getName();
+    const std::vector<double>& bounds = histograms[i]->getBounds();
+    std::uint64_t count;
+    double sum;
+    histograms[i]->getSnapshot(buckets, count, sum);
+
+    out << "# HELP " << name << " " << histograms[i]->getHelp() << "\n";
+    out << "# TYPE " << name << " histogram\n";
+    // Prometheus buckets are cumulative
+    std::uint64_t cumulative = 0;
+    for (std::size_t j = 0; j < bounds.size(); ++j)
+    {
+      cumulative += buckets[j];
+      out << name << "_bucket{le=\"" << bounds[j] << "\"} " << cumulative << "\n";
+    }
+    out << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+    out << name << "_sum " << sum << "\n";
+    out << name << "_count " << count << "\n";
+  }
+}
+}  // end of namespace tools
+}  // end of namespace moveit
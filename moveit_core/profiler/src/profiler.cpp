@@ -77,52 +77,183 @@ void Profiler::stop()
 void Profiler::clear()
 {
   lock_.lock();
-  data_.clear();
+  for (std::size_t i = 0; i < threads_.size(); ++i)
+  {
+    PerThread& data = *threads_[i];
+    boost::mutex::scoped_lock slock(data.lock);
+    data.names.clear();
+    data.ids.clear();
+    data.entries.clear();
+    data.trace.clear();
+    data.dropped = 0;
+  }
+  epoch_ = Clock::now();
   tinfo_ = TimeInfo();
   if (running_)
     tinfo_.set();
   lock_.unlock();
 }
 
+void Profiler::enableTrace(bool trace, std::size_t capacity)
+{
+  trace_capacity_ = capacity;
+  trace_ = trace;
+}
+
+void Profiler::setThreadName(const std::string& name)
+{
+  PerThread& data = threadData();
+  boost::mutex::scoped_lock slock(data.lock);
+  data.thread_name = name;
+}
+
+Profiler::PerThread& Profiler::threadData()
+{
+  PerThread* data = local_.get();
+  if (!data)
+  {
+    data = new PerThread();
+    data->id = boost::this_thread::get_id();
+    local_.reset(data);
+    lock_.lock();
+    threads_.push_back(std::unique_ptr<PerThread>(data));
+    lock_.unlock();
+  }
+  return *data;
+}
+
+unsigned int Profiler::PerThread::intern(const std::string& name)
+{
+  std::unordered_map<std::string, unsigned int>::const_iterator it = ids.find(name);
+  if (it != ids.end())
+    return it->second;
+  unsigned int id = names.size();
+  ids[name] = id;
+  names.push_back(name);
+  entries.push_back(Entry());
+  return id;
+}
+
+void Profiler::PerThread::record(const TraceEvent& event, std::size_t capacity)
+{
+  if (trace.size() < capacity)
+    trace.push_back(event);
+  else
+    ++dropped;
+}
+
 void Profiler::event(const std::string& name, const unsigned int times)
 {
-  lock_.lock();
-  data_[boost::this_thread::get_id()].events[name] += times;
-  lock_.unlock();
+  if (!enabled_)
+    return;
+  PerThread& data = threadData();
+  boost::mutex::scoped_lock slock(data.lock);
+  unsigned int id = data.intern(name);
+  Entry& e = data.entries[id];
+  e.events += times;
+  e.has_events = true;
+  if (trace_)
+  {
+    TraceEvent event = { id, times, Clock::now(), Clock::duration::zero() };
+    data.record(event, trace_capacity_);
+  }
 }
 
 void Profiler::average(const std::string& name, const double value)
 {
-  lock_.lock();
-  AvgInfo& a = data_[boost::this_thread::get_id()].avg[name];
+  if (!enabled_)
+    return;
+  PerThread& data = threadData();
+  boost::mutex::scoped_lock slock(data.lock);
+  AvgInfo& a = data.entries[data.intern(name)].avg;
   a.total += value;
   a.totalSqr += value * value;
   a.parts++;
-  lock_.unlock();
 }
 
 void Profiler::begin(const std::string& name)
 {
-  lock_.lock();
-  data_[boost::this_thread::get_id()].time[name].set();
-  lock_.unlock();
+  if (!enabled_)
+    return;
+  PerThread& data = threadData();
+  boost::mutex::scoped_lock slock(data.lock);
+  Entry& e = data.entries[data.intern(name)];
+  e.has_time = true;
+  e.time.set();
 }
 
 void Profiler::end(const std::string& name)
 {
-  lock_.lock();
-  data_[boost::this_thread::get_id()].time[name].update();
-  lock_.unlock();
+  if (!enabled_)
+    return;
+  PerThread& data = threadData();
+  boost::mutex::scoped_lock slock(data.lock);
+  unsigned int id = data.intern(name);
+  Entry& e = data.entries[id];
+  e.has_time = true;
+  Clock::duration dt = e.time.update();
+  if (trace_)
+  {
+    TraceEvent event = { id, 0, e.time.start, dt };
+    data.record(event, trace_capacity_);
+  }
 }
 
 namespace
 {
-inline double to_seconds(const boost::posix_time::time_duration& d)
+inline double to_seconds(const std::chrono::steady_clock::duration& d)
+{
+  return std::chrono::duration<double>(d).count();
+}
+
+inline double to_microseconds(const std::chrono::steady_clock::duration& d)
 {
-  return (double)d.total_microseconds() / 1000000.0;
+  return std::chrono::duration<double, std::micro>(d).count();
+}
+
+/** \brief Write \e s as a JSON string */
+void writeJsonString(std::ostream& out, const std::string& s)
+{
+  out << '"';
+  for (std::size_t i = 0; i < s.size(); ++i)
+  {
+    if (s[i] == '"' || s[i] == '\\')
+      out << '\\' << s[i];
+    else if ((unsigned char)s[i] >= 0x20)
+      out << s[i];
+  }
+  out << '"';
 }
 }
 
+void Profiler::summarize(const PerThread& data, Summary& summary) const
+{
+  for (std::size_t i = 0; i < data.entries.size(); ++i)
+  {
+    const Entry& e = data.entries[i];
+    const std::string& name = data.names[i];
+    if (e.has_events)
+      summary.events[name] += e.events;
+    if (e.avg.parts > 0)
+    {
+      AvgInfo& a = summary.avg[name];
+      a.total += e.avg.total;
+      a.totalSqr += e.avg.totalSqr;
+      a.parts += e.avg.parts;
+    }
+    if (e.has_time)
+    {
+      TimeInfo& tc = summary.time[name];
+      tc.total += e.time.total;
+      tc.parts += e.time.parts;
+      if (tc.shortest > e.time.shortest)
+        tc.shortest = e.time.shortest;
+      if (tc.longest < e.time.longest)
+        tc.longest = e.time.longest;
+    }
+  }
+}
+
 void Profiler::status(std::ostream& out, bool merge)
 {
   stop();
@@ -134,42 +265,70 @@ void Profiler::status(std::ostream& out, bool merge)
 
   if (merge)
   {
-    PerThread combined;
-    for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin(); it != data_.end(); ++it)
+    Summary combined;
+    for (std::size_t i = 0; i < threads_.size(); ++i)
     {
-      for (std::map<std::string, unsigned long int>::const_iterator iev = it->second.events.begin();
-           iev != it->second.events.end(); ++iev)
-        combined.events[iev->first] += iev->second;
-      for (std::map<std::string, AvgInfo>::const_iterator iavg = it->second.avg.begin(); iavg != it->second.avg.end();
-           ++iavg)
-      {
-        combined.avg[iavg->first].total += iavg->second.total;
-        combined.avg[iavg->first].totalSqr += iavg->second.totalSqr;
-        combined.avg[iavg->first].parts += iavg->second.parts;
-      }
-      for (std::map<std::string, TimeInfo>::const_iterator itm = it->second.time.begin(); itm != it->second.time.end();
-           ++itm)
-      {
-        TimeInfo& tc = combined.time[itm->first];
-        tc.total = tc.total + itm->second.total;
-        tc.parts = tc.parts + itm->second.parts;
-        if (tc.shortest > itm->second.shortest)
-          tc.shortest = itm->second.shortest;
-        if (tc.longest < itm->second.longest)
-          tc.longest = itm->second.longest;
-      }
+      boost::mutex::scoped_lock slock(threads_[i]->lock);
+      summarize(*threads_[i], combined);
     }
     printThreadInfo(out, combined);
   }
   else
-    for (std::map<boost::thread::id, PerThread>::const_iterator it = data_.begin(); it != data_.end(); ++it)
+    for (std::size_t i = 0; i < threads_.size(); ++i)
     {
-      out << "Thread " << it->first << ":" << std::endl;
-      printThreadInfo(out, it->second);
+      Summary summary;
+      {
+        boost::mutex::scoped_lock slock(threads_[i]->lock);
+        summarize(*threads_[i], summary);
+      }
+      out << "Thread " << threads_[i]->id << ":" << std::endl;
+      printThreadInfo(out, summary);
     }
   lock_.unlock();
 }
 
+void Profiler::writeTrace(std::ostream& out)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  unsigned long int dropped = 0;
+  bool first = true;
+
+  out << "{\"traceEvents\": [" << std::endl;
+  for (std::size_t t = 0; t < threads_.size(); ++t)
+  {
+    const PerThread& data = *threads_[t];
+    boost::mutex::scoped_lock tlock(threads_[t]->lock);
+    dropped += data.dropped;
+
+    std::stringstream thread_name;
+    if (data.thread_name.empty())
+      thread_name << "thread " << data.id;
+    else
+      thread_name << data.thread_name;
+    out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << t
+        << ", \"args\": {\"name\": ";
+    writeJsonString(out, thread_name.str());
+    out << "}}";
+    first = false;
+
+    for (std::size_t i = 0; i < data.trace.size(); ++i)
+    {
+      const TraceEvent& event = data.trace[i];
+      out << ",\n{\"name\": ";
+      writeJsonString(out, data.names[event.name]);
+      out << ", \"pid\": 0, \"tid\": " << t << ", \"ts\": " << to_microseconds(event.start - epoch_);
+      if (event.times == 0)
+        out << ", \"ph\": \"X\", \"dur\": " << to_microseconds(event.duration) << "}";
+      else
+        out << ", \"ph\": \"i\", \"s\": \"t\", \"args\": {\"times\": " << event.times << "}}";
+    }
+  }
+  out << std::endl << "]}" << std::endl;
+
+  if (dropped > 0)
+    ROS_WARN_NAMED("profiler", "The trace is missing %lu events that exceeded the trace capacity", dropped);
+}
+
 void Profiler::console()
 {
   std::stringstream ss;
@@ -211,7 +370,7 @@ struct SortDoubleByValue
 }
 /// @endcond
 
-void Profiler::printThreadInfo(std::ostream& out, const PerThread& data)
+void Profiler::printThreadInfo(std::ostream& out, const Summary& data)
 {
   double total = to_seconds(tinfo_.total);
 
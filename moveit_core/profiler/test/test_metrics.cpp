@@ -0,0 +1,106 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/profiler/metrics.h>
+#include <boost/thread.hpp>
+#include <sstream>
+
+using namespace moveit::tools;
+
+TEST(Metrics, CounterIsSharedByName)
+{
+  MetricCounter& a = MetricsRegistry::instance().counter("test_shared_total", "A counter");
+  MetricCounter& b = MetricsRegistry::instance().counter("test_shared_total", "A counter");
+  EXPECT_EQ(&a, &b);
+  a.increment();
+  b.increment(2);
+  EXPECT_EQ(3u, a.value());
+}
+
+TEST(Metrics, CounterFromManyThreads)
+{
+  MetricCounter& counter = MetricsRegistry::instance().counter("test_threads_total", "A counter");
+  boost::thread_group threads;
+  for (int k = 0; k < 8; ++k)
+    threads.create_thread([&counter]() {
+      for (int i = 0; i < 10000; ++i)
+        counter.increment();
+    });
+  threads.join_all();
+  EXPECT_EQ(80000u, counter.value());
+}
+
+TEST(Metrics, HistogramBuckets)
+{
+  std::vector<double> bounds = { 1.0, 2.0, 4.0 };
+  MetricHistogram& histogram = MetricsRegistry::instance().histogram("test_histogram", "A histogram", bounds);
+  histogram.observe(0.5);
+  histogram.observe(1.0);
+  histogram.observe(3.0);
+  histogram.observe(8.0);
+
+  std::vector<std::uint64_t> buckets;
+  std::uint64_t count;
+  double sum;
+  histogram.getSnapshot(buckets, count, sum);
+  ASSERT_EQ(4u, buckets.size());
+  EXPECT_EQ(2u, buckets[0]);
+  EXPECT_EQ(0u, buckets[1]);
+  EXPECT_EQ(1u, buckets[2]);
+  EXPECT_EQ(1u, buckets[3]);
+  EXPECT_EQ(4u, count);
+  EXPECT_DOUBLE_EQ(12.5, sum);
+}
+
+TEST(Metrics, Prometheus)
+{
+  MetricsRegistry::instance().counter("test_prometheus_total", "Prometheus counter").increment(5);
+  std::vector<double> bounds = { 1.0 };
+  MetricsRegistry::instance().histogram("test_prometheus_seconds", "Prometheus histogram", bounds).observe(0.5);
+
+  std::stringstream ss;
+  MetricsRegistry::instance().writePrometheus(ss);
+  const std::string text = ss.str();
+  EXPECT_NE(std::string::npos, text.find("# TYPE test_prometheus_total counter\ntest_prometheus_total 5\n"));
+  EXPECT_NE(std::string::npos, text.find("test_prometheus_seconds_bucket{le=\"1\"} 1\n"));
+  EXPECT_NE(std::string::npos, text.find("test_prometheus_seconds_bucket{le=\"+Inf\"} 1\n"));
+  EXPECT_NE(std::string::npos, text.find("test_prometheus_seconds_count 1\n"));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
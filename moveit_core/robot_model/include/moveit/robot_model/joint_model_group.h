@@ -40,6 +40,7 @@
 
 #include <moveit/robot_model/joint_model.h>
 #include <moveit/robot_model/link_model.h>
+#include <moveit/robot_model/reachability_map.h>
 #include <moveit/kinematics_base/kinematics_base.h>
 #include <srdfdom/model.h>
 #include <boost/function.hpp>
@@ -563,6 +564,18 @@ public:
   /** \brief Set the default IK attempts */
   void setDefaultIKAttempts(unsigned int ik_attempts);
 
+  /** \brief Get the precomputed map of the poses this group can reach, if one was loaded */
+  const ReachabilityMapConstPtr& getReachabilityMap() const
+  {
+    return reachability_map_;
+  }
+
+  /** \brief Set the precomputed map of the poses this group can reach */
+  void setReachabilityMap(const ReachabilityMapConstPtr& map)
+  {
+    reachability_map_ = map;
+  }
+
   /** \brief Return the mapping between the order of the joints in this group and the order of the joints in the
      kinematics solver.
       An element bijection[i] at index \e i in this array, maps the variable at index bijection[i] in this group to
@@ -636,6 +649,23 @@ protected:
   /** \brief The bounds for all the active joint models */
   JointBoundsVector active_joint_models_bounds_;
 
+  /** \brief An active variable of a revolute or prismatic joint */
+  struct SingleVariable
+  {
+    /** \brief The index of the variable in the group state */
+    int index_;
+
+    /** \brief The bounds of the joint model; these may still change after the group is constructed */
+    const VariableBounds* bounds_;
+
+    /** \brief Whether the joint is a continuous revolute joint */
+    bool continuous_;
+  };
+
+  /** \brief If all active joints are revolute or prismatic, their variables; the default bounds are then checked,
+      enforced and sampled on these directly, instead of through the joint models. Empty otherwise. */
+  std::vector<SingleVariable> single_variables_;
+
   /** \brief The list of index values this group includes, with respect to a full robot state; this includes mimic
    * joints. */
   std::vector<int> variable_index_list_;
@@ -735,6 +765,8 @@ protected:
 
   std::pair<KinematicsSolver, KinematicsSolverMap> group_kinematics_;
 
+  ReachabilityMapConstPtr reachability_map_;
+
   srdf::Model::Group config_;
 
   /** \brief The set of default states specified for this group in the SRDF */
@@ -0,0 +1,187 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_REACHABILITY_MAP_
+#define MOVEIT_CORE_ROBOT_MODEL_REACHABILITY_MAP_
+
+#include <moveit/macros/class_forward.h>
+#include <boost/noncopyable.hpp>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+MOVEIT_CLASS_FORWARD(ReachabilityMap);
+
+/** \brief A voxelized map of the poses a link of a group can reach, expressed in the frame of a base link.
+
+    Every voxel stores the approach directions the tip link can have while its origin is inside the voxel. The
+    approach direction is the direction of a fixed axis of the tip link (e.g., the axis grasps approach along); the
+    rotation about that axis is not distinguished. Directions are binned on a 3x3 grid on each face of a cube, so both
+    the voxel and the direction bin of a pose are found in constant time.
+
+    Maps are computed offline (see moveit_generate_reachability_map), saved to a file and memory mapped when loaded.
+    Their accuracy is limited by the resolution they were computed with, so they are meant for rejecting targets
+    that are clearly out of reach before attempting IK. */
+class ReachabilityMap : private boost::noncopyable
+{
+public:
+  /** \brief The number of approach direction bins per voxel */
+  static const unsigned int DIRECTION_COUNT = 54;
+
+  /** \brief Construct a map in which nothing is reachable, for poses of \e tip_link of \e group in the frame of
+      \e base_link. The map covers the box from \e min to \e max with cubic voxels of size \e resolution. */
+  ReachabilityMap(const std::string& group, const std::string& base_link, const std::string& tip_link,
+                  const Eigen::Vector3d& min, const Eigen::Vector3d& max, double resolution,
+                  const Eigen::Vector3d& approach_axis = Eigen::Vector3d::UnitX());
+  ~ReachabilityMap();
+
+  /** \brief Memory map a file previously written by save(). Returns an empty pointer in case of failure. */
+  static ReachabilityMapPtr load(const std::string& filename);
+
+  /** \brief Write the map to \e filename */
+  bool save(const std::string& filename) const;
+
+  const std::string& getGroupName() const
+  {
+    return group_;
+  }
+
+  /** \brief The name of the link whose frame the poses in the map are expressed in */
+  const std::string& getBaseLinkName() const
+  {
+    return base_link_;
+  }
+
+  /** \brief The name of the link whose poses are recorded in the map */
+  const std::string& getTipLinkName() const
+  {
+    return tip_link_;
+  }
+
+  /** \brief The axis of the tip link (in its own frame) whose direction is recorded as the approach direction */
+  const Eigen::Vector3d& getApproachAxis() const
+  {
+    return approach_axis_;
+  }
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  /** \brief The corner of the map with the lowest coordinates */
+  const Eigen::Vector3d& getOrigin() const
+  {
+    return origin_;
+  }
+
+  std::size_t getVoxelCount() const
+  {
+    return size_x_ * size_y_ * size_z_;
+  }
+
+  /** \brief Check if the map was loaded from a file (in which case it cannot be modified) */
+  bool isMapped() const
+  {
+    return mapped_ != NULL;
+  }
+
+  /** \brief Get the index of the voxel that contains \e position. Returns false if \e position is outside the map. */
+  bool getVoxelIndex(const Eigen::Vector3d& position, std::size_t& index) const;
+
+  /** \brief Get the center of the voxel with index \e index */
+  Eigen::Vector3d getVoxelCenter(std::size_t index) const;
+
+  /** \brief Get the index of the bin \e direction falls in; \e direction does not need to be normalized */
+  static std::size_t getDirectionIndex(const Eigen::Vector3d& direction);
+
+  /** \brief Get the (unit) direction at the center of the bin with index \e index */
+  static Eigen::Vector3d getDirection(std::size_t index);
+
+  /** \brief Get the approach directions reachable in a voxel, as a mask in which bit \e i corresponds to bin \e i */
+  std::uint64_t getDirections(std::size_t voxel) const
+  {
+    return data_[voxel];
+  }
+
+  /** \brief Mark the approach directions in the mask \e directions as reachable in \e voxel */
+  void addDirections(std::size_t voxel, std::uint64_t directions);
+
+  /** \brief Mark \e pose of the tip link (in the base frame) as reachable. Returns false if it is outside the map. */
+  bool addPose(const Eigen::Affine3d& pose);
+
+  /** \brief Mark every approach direction that is reachable in a voxel as reachable in its neighbouring voxels too.
+      This makes the map conservative near the boundary of the reachable workspace. */
+  void dilate();
+
+  /** \brief Check if the tip link can be at \e position (in the base frame) with some approach direction */
+  bool isPositionReachable(const Eigen::Vector3d& position) const;
+
+  /** \brief Check if the tip link can be at \e pose (in the base frame) with the approach direction of \e pose */
+  bool isPoseReachable(const Eigen::Affine3d& pose) const;
+
+  /** \brief Get the fraction of approach directions that are reachable at \e position (0 outside of the map) */
+  double getReachabilityIndex(const Eigen::Vector3d& position) const;
+
+private:
+  ReachabilityMap();
+
+  std::string group_;
+  std::string base_link_;
+  std::string tip_link_;
+  Eigen::Vector3d origin_;
+  Eigen::Vector3d approach_axis_;
+  double resolution_;
+  std::size_t size_x_;
+  std::size_t size_y_;
+  std::size_t size_z_;
+
+  /** \brief The direction masks of the voxels, for maps that were not loaded from a file */
+  std::vector<std::uint64_t> directions_;
+
+  /** \brief The direction masks of the voxels; points into directions_ or into the mapped file */
+  std::uint64_t* data_;
+
+  void* mapped_;
+  std::size_t mapped_size_;
+};
+}
+}
+
+#endif
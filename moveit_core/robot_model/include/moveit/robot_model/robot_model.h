@@ -52,6 +52,7 @@
 #include <moveit/robot_model/prismatic_joint_model.h>
 
 #include <Eigen/Geometry>
+#include <boost/function.hpp>
 #include <iostream>
 
 /** \brief Main namespace for MoveIt! */
@@ -62,6 +63,59 @@ namespace core
 {
 MOVEIT_CLASS_FORWARD(RobotModel);
 
+/** \brief Function used while building a RobotModel to construct the mesh for a mesh \e resource with a given \e scale.
+    Returns NULL on failure. */
+typedef boost::function<shapes::Mesh*(const std::string& resource, const Eigen::Vector3d& scale)> MeshLoaderFn;
+
+/** \brief One step of the flattened forward kinematics program of a RobotModel.
+
+    The global transform of a link is computed as
+    parent link transform * joint origin transform * joint transform.
+    The step caches everything needed for this in a flat structure, so that the transform can be
+    computed without chasing pointers through the LinkModel and without a virtual call per joint. */
+struct ForwardKinematicsStep
+{
+  /** \brief The parent joint of the link */
+  const JointModel* joint;
+
+  JointModel::JointType joint_type;
+  int joint_index;
+  int first_variable_index;
+
+  /** \brief The index of the parent link, -1 for the root link */
+  int parent_link_index;
+
+  /** \brief The joint origin transform of the link, NULL if it is the identity */
+  const Eigen::Affine3d* origin;
+
+  /** \brief True if the parent joint is fixed and the link is not the root link, i.e.,
+      the link transform is a constant offset from the parent link transform */
+  bool fixed;
+
+  /** \brief Compute the transform of the joint from the full vector of variable \e values */
+  void computeJointTransform(const double* values, Eigen::Affine3d& transform) const
+  {
+    // qualified calls avoid the virtual dispatch for the common joint types
+    switch (joint_type)
+    {
+      case JointModel::REVOLUTE:
+        static_cast<const RevoluteJointModel*>(joint)->RevoluteJointModel::computeTransform(
+            values + first_variable_index, transform);
+        break;
+      case JointModel::PRISMATIC:
+        static_cast<const PrismaticJointModel*>(joint)->PrismaticJointModel::computeTransform(
+            values + first_variable_index, transform);
+        break;
+      case JointModel::FIXED:
+        transform.setIdentity();
+        break;
+      default:
+        joint->computeTransform(values + first_variable_index, transform);
+        break;
+    }
+  }
+};
+
 /** \brief Definition of a kinematic model. This class is not thread
     safe, however multiple instances can be created */
 class RobotModel
@@ -70,6 +124,12 @@ public:
   /** \brief Construct a kinematic model from a parsed description and a list of planning groups */
   RobotModel(const urdf::ModelInterfaceSharedPtr& urdf_model, const srdf::ModelConstSharedPtr& srdf_model);
 
+  /** \brief Construct a kinematic model from a parsed description and a list of planning groups, using \e mesh_loader
+      instead of shapes::createMeshFromResource() to construct the meshes of the links (e.g., to read them from a
+      cache). Meshes are loaded concurrently, so \e mesh_loader must be thread-safe */
+  RobotModel(const urdf::ModelInterfaceSharedPtr& urdf_model, const srdf::ModelConstSharedPtr& srdf_model,
+             const MeshLoaderFn& mesh_loader);
+
   /** \brief Destructor. Clear all memory. */
   ~RobotModel();
 
@@ -270,6 +330,12 @@ public:
   }
 
   /** \brief Get the link models that have some collision geometry associated to themselves */
+  /** \brief Get the forward kinematics program of the model: one step per link, indexed by link index */
+  const std::vector<ForwardKinematicsStep>& getForwardKinematicsProgram() const
+  {
+    return fk_program_;
+  }
+
   const std::vector<const LinkModel*>& getLinkModelsWithCollisionGeometry() const
   {
     return link_models_with_collision_geometry_vector_;
@@ -418,6 +484,12 @@ public:
   void getMissingVariableNames(const std::vector<std::string>& variables,
                                std::vector<std::string>& missing_variables) const;
 
+  /** \brief Check if a variable exists. Return true if it does. */
+  bool hasVariable(const std::string& variable) const
+  {
+    return joint_variables_index_map_.find(variable) != joint_variables_index_map_.end();
+  }
+
   /** \brief Get the index of a variable in the robot state */
   int getVariableIndex(const std::string& variable) const;
 
@@ -472,6 +544,15 @@ protected:
   /** \brief The vector of links that are updated when computeTransforms() is called, in the order they are updated */
   std::vector<const LinkModel*> link_model_vector_const_;
 
+  /** \brief The flattened forward kinematics steps, indexed by link index */
+  std::vector<ForwardKinematicsStep> fk_program_;
+
+  /** \brief The function used to construct meshes while the model is built */
+  MeshLoaderFn mesh_loader_;
+
+  /** \brief Meshes loaded by preloadMeshes() that were not yet claimed by constructShape() */
+  std::map<const urdf::Geometry*, shapes::Mesh*> preloaded_meshes_;
+
   /** \brief The vector of link names that corresponds to link_model_vector_ */
   std::vector<std::string> link_model_names_vector_;
 
@@ -595,6 +676,9 @@ protected:
   /** \brief For every pair of joints, pre-compute the common roots of the joints */
   void computeCommonRoots();
 
+  /** \brief Compile the forward kinematics program of the model (see getForwardKinematicsProgram()) */
+  void buildForwardKinematicsProgram();
+
   /** \brief (This function is mostly intended for internal use). Given a parent link, build up (recursively),
       the kinematic model by walking  down the tree*/
   JointModel* buildRecursive(LinkModel* parent, const urdf::Link* link, const srdf::Model& srdf_model);
@@ -607,6 +691,10 @@ protected:
   JointModel* constructJointModel(const urdf::Joint* urdf_joint_model, const urdf::Link* child_link,
                                   const srdf::Model& srdf_model);
 
+  /** \brief Load the meshes of all links in \e urdf_model concurrently, ahead of buildRecursive(). The loaded meshes
+      are picked up by constructShape() */
+  void preloadMeshes(const urdf::ModelInterface& urdf_model);
+
   /** \brief Given a urdf link, build the corresponding LinkModel object*/
   LinkModel* constructLinkModel(const urdf::Link* urdf_link);
 
@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_MODEL_VARIABLE_INDEX_MAPPING_
+#define MOVEIT_CORE_ROBOT_MODEL_VARIABLE_INDEX_MAPPING_
+
+#include <moveit/macros/class_forward.h>
+#include <string>
+#include <vector>
+
+namespace moveit
+{
+namespace core
+{
+class RobotModel;
+class JointModel;
+
+MOVEIT_CLASS_FORWARD(VariableIndexMapping);
+
+/** \brief The indices of an ordered list of variable names (e.g., the names of a sensor_msgs::JointState message),
+    resolved once for a RobotModel.
+
+    Messages that share the same name ordering can then be applied to a RobotState with an indexed copy, without
+    looking up every name again. (The name VariableIndexMap is already used for std::map<std::string, int>.) */
+class VariableIndexMapping
+{
+public:
+  /** \brief Resolve \e names with respect to \e model. Names that are not variables of the model are allowed; they
+      are mapped to index -1 */
+  VariableIndexMapping(const RobotModel& model, const std::vector<std::string>& names);
+
+  /** \brief Check whether this mapping was built for exactly \e names, in the same order */
+  bool matches(const std::vector<std::string>& names) const
+  {
+    return names == names_;
+  }
+
+  /** \brief The names this mapping was built for */
+  const std::vector<std::string>& getNames() const
+  {
+    return names_;
+  }
+
+  /** \brief The number of names in the mapping */
+  std::size_t size() const
+  {
+    return names_.size();
+  }
+
+  /** \brief For every name, the index of the corresponding variable in the RobotModel, or -1 if the name is unknown */
+  const std::vector<int>& getVariableIndices() const
+  {
+    return indices_;
+  }
+
+  /** \brief For every name, the joint the corresponding variable belongs to, or NULL if the name is unknown */
+  const std::vector<const JointModel*>& getJointModels() const
+  {
+    return joints_;
+  }
+
+  /** \brief The number of names that are variables of the RobotModel */
+  std::size_t getKnownCount() const
+  {
+    return known_count_;
+  }
+
+  /** \brief Check whether the names are exactly the variables of the RobotModel, in the order of the model. Values
+      can then be copied into a RobotState as a whole */
+  bool isIdentity() const
+  {
+    return identity_;
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<int> indices_;
+  std::vector<const JointModel*> joints_;
+  std::size_t known_count_;
+  bool identity_;
+};
+}
+}
+
+#endif
@@ -40,7 +40,9 @@
 #include <moveit/robot_model/revolute_joint_model.h>
 #include <moveit/exceptions/exceptions.h>
 #include <boost/lexical_cast.hpp>
+#include <boost/math/constants/constants.hpp>
 #include <algorithm>
+#include <cmath>
 #include "order_robot_model_items.inc"
 
 namespace moveit
@@ -158,6 +160,23 @@ JointModelGroup::JointModelGroup(const std::string& group_name, const srdf::Mode
       fixed_joints_.push_back(joint_model_vector_[i]);
   }
 
+  // groups of revolute and prismatic joints only are handled without calls to the joint models
+  for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
+  {
+    const JointModel* jm = active_joint_model_vector_[i];
+    if (jm->getType() != JointModel::REVOLUTE && jm->getType() != JointModel::PRISMATIC)
+    {
+      single_variables_.clear();
+      break;
+    }
+    SingleVariable variable;
+    variable.index_ = active_joint_model_start_index_[i];
+    variable.bounds_ = &jm->getVariableBounds()[0];
+    variable.continuous_ =
+        jm->getType() == JointModel::REVOLUTE && static_cast<const RevoluteJointModel*>(jm)->isContinuous();
+    single_variables_.push_back(variable);
+  }
+
   // now we need to find all the set of joints within this group
   // that root distinct subtrees
   for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
@@ -313,9 +332,14 @@ void JointModelGroup::getVariableRandomPositions(random_numbers::RandomNumberGen
                                                  const JointBoundsVector& active_joint_bounds) const
 {
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
-  for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
-    active_joint_model_vector_[i]->getVariableRandomPositions(rng, values + active_joint_model_start_index_[i],
-                                                              *active_joint_bounds[i]);
+  if (!single_variables_.empty() && &active_joint_bounds == &active_joint_models_bounds_)
+    for (std::size_t i = 0; i < single_variables_.size(); ++i)
+      values[single_variables_[i].index_] =
+          rng.uniformReal(single_variables_[i].bounds_->min_position_, single_variables_[i].bounds_->max_position_);
+  else
+    for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
+      active_joint_model_vector_[i]->getVariableRandomPositions(rng, values + active_joint_model_start_index_[i],
+                                                                *active_joint_bounds[i]);
 
   updateMimicJoints(values);
 }
@@ -375,6 +399,18 @@ bool JointModelGroup::satisfiesPositionBounds(const double* state, const JointBo
                                               double margin) const
 {
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
+  if (!single_variables_.empty() && &active_joint_bounds == &active_joint_models_bounds_)
+  {
+    for (std::size_t i = 0; i < single_variables_.size(); ++i)
+    {
+      const SingleVariable& variable = single_variables_[i];
+      double value = state[variable.index_];
+      if (!variable.continuous_ &&
+          (value < variable.bounds_->min_position_ - margin || value > variable.bounds_->max_position_ + margin))
+        return false;
+    }
+    return true;
+  }
   for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
     if (!active_joint_model_vector_[i]->satisfiesPositionBounds(state + active_joint_model_start_index_[i],
                                                                 *active_joint_bounds[i], margin))
@@ -386,10 +422,40 @@ bool JointModelGroup::enforcePositionBounds(double* state, const JointBoundsVect
 {
   assert(active_joint_bounds.size() == active_joint_model_vector_.size());
   bool change = false;
-  for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
-    if (active_joint_model_vector_[i]->enforcePositionBounds(state + active_joint_model_start_index_[i],
-                                                             *active_joint_bounds[i]))
-      change = true;
+  if (!single_variables_.empty() && &active_joint_bounds == &active_joint_models_bounds_)
+    for (std::size_t i = 0; i < single_variables_.size(); ++i)
+    {
+      const SingleVariable& variable = single_variables_[i];
+      double& value = state[variable.index_];
+      if (variable.continuous_)
+      {
+        // same as RevoluteJointModel::enforcePositionBounds()
+        if (value <= -boost::math::constants::pi<double>() || value > boost::math::constants::pi<double>())
+        {
+          value = fmod(value, 2.0 * boost::math::constants::pi<double>());
+          if (value <= -boost::math::constants::pi<double>())
+            value += 2.0 * boost::math::constants::pi<double>();
+          else if (value > boost::math::constants::pi<double>())
+            value -= 2.0 * boost::math::constants::pi<double>();
+          change = true;
+        }
+      }
+      else if (value < variable.bounds_->min_position_)
+      {
+        value = variable.bounds_->min_position_;
+        change = true;
+      }
+      else if (value > variable.bounds_->max_position_)
+      {
+        value = variable.bounds_->max_position_;
+        change = true;
+      }
+    }
+  else
+    for (std::size_t i = 0; i < active_joint_model_vector_.size(); ++i)
+      if (active_joint_model_vector_[i]->enforcePositionBounds(state + active_joint_model_start_index_[i],
+                                                               *active_joint_bounds[i]))
+        change = true;
   if (change)
     updateMimicJoints(state);
   return change;
@@ -0,0 +1,329 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/reachability_map.h>
+#include <ros/console.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace moveit
+{
+namespace core
+{
+namespace
+{
+const char FILE_MAGIC[8] = { 'M', 'O', 'V', 'E', 'R', 'M', 'A', 'P' };
+const std::uint64_t FILE_VERSION = 1;
+const std::size_t NAME_LENGTH = 128;
+
+// The layout of the beginning of a map file; the direction masks of all voxels follow
+struct FileHeader
+{
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t size[3];
+  double origin[3];
+  double resolution;
+  double approach_axis[3];
+  char group[NAME_LENGTH];
+  char base_link[NAME_LENGTH];
+  char tip_link[NAME_LENGTH];
+};
+
+bool copyName(char* dest, const std::string& name)
+{
+  if (name.size() >= NAME_LENGTH)
+    return false;
+  std::memset(dest, 0, NAME_LENGTH);
+  std::memcpy(dest, name.c_str(), name.size());
+  return true;
+}
+
+std::size_t countBits(std::uint64_t mask)
+{
+  std::size_t count = 0;
+  for (; mask; mask &= mask - 1)
+    ++count;
+  return count;
+}
+}
+
+const unsigned int ReachabilityMap::DIRECTION_COUNT;
+
+ReachabilityMap::ReachabilityMap()
+  : origin_(Eigen::Vector3d::Zero())
+  , approach_axis_(Eigen::Vector3d::UnitX())
+  , resolution_(0.0)
+  , size_x_(0)
+  , size_y_(0)
+  , size_z_(0)
+  , data_(NULL)
+  , mapped_(NULL)
+  , mapped_size_(0)
+{
+}
+
+ReachabilityMap::ReachabilityMap(const std::string& group, const std::string& base_link, const std::string& tip_link,
+                                 const Eigen::Vector3d& min, const Eigen::Vector3d& max, double resolution,
+                                 const Eigen::Vector3d& approach_axis)
+  : group_(group)
+  , base_link_(base_link)
+  , tip_link_(tip_link)
+  , origin_(min)
+  , approach_axis_(approach_axis.normalized())
+  , resolution_(resolution)
+  , mapped_(NULL)
+  , mapped_size_(0)
+{
+  Eigen::Vector3d extents = (max - min) / resolution;
+  size_x_ = std::max(1, (int)ceil(extents.x()));
+  size_y_ = std::max(1, (int)ceil(extents.y()));
+  size_z_ = std::max(1, (int)ceil(extents.z()));
+  directions_.resize(getVoxelCount(), 0);
+  data_ = &directions_[0];
+}
+
+ReachabilityMap::~ReachabilityMap()
+{
+  if (mapped_)
+    munmap(mapped_, mapped_size_);
+}
+
+ReachabilityMapPtr ReachabilityMap::load(const std::string& filename)
+{
+  ReachabilityMapPtr result;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    ROS_ERROR_NAMED("reachability_map", "Unable to open reachability map '%s'", filename.c_str());
+    return result;
+  }
+  struct stat st;
+  void* mapped = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (std::size_t)st.st_size >= sizeof(FileHeader))
+    mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    ROS_ERROR_NAMED("reachability_map", "Unable to map reachability map '%s'", filename.c_str());
+    return result;
+  }
+
+  result.reset(new ReachabilityMap());
+  result->mapped_ = mapped;
+  result->mapped_size_ = st.st_size;
+
+  const FileHeader* header = static_cast<const FileHeader*>(mapped);
+  if (std::memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header->version != FILE_VERSION)
+  {
+    ROS_ERROR_NAMED("reachability_map", "'%s' is not a reachability map of version %u", filename.c_str(),
+                    (unsigned int)FILE_VERSION);
+    result.reset();
+    return result;
+  }
+  result->size_x_ = header->size[0];
+  result->size_y_ = header->size[1];
+  result->size_z_ = header->size[2];
+  if (sizeof(FileHeader) + result->getVoxelCount() * sizeof(std::uint64_t) != result->mapped_size_)
+  {
+    ROS_ERROR_NAMED("reachability_map", "Reachability map '%s' is truncated", filename.c_str());
+    result.reset();
+    return result;
+  }
+  result->origin_ = Eigen::Vector3d(header->origin[0], header->origin[1], header->origin[2]);
+  result->approach_axis_ = Eigen::Vector3d(header->approach_axis[0], header->approach_axis[1], header->approach_axis[2]);
+  result->resolution_ = header->resolution;
+  result->group_.assign(header->group, strnlen(header->group, NAME_LENGTH));
+  result->base_link_.assign(header->base_link, strnlen(header->base_link, NAME_LENGTH));
+  result->tip_link_.assign(header->tip_link, strnlen(header->tip_link, NAME_LENGTH));
+  result->data_ = reinterpret_cast<std::uint64_t*>(static_cast<char*>(mapped) + sizeof(FileHeader));
+  return result;
+}
+
+bool ReachabilityMap::save(const std::string& filename) const
+{
+  FileHeader header;
+  std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+  header.version = FILE_VERSION;
+  header.size[0] = size_x_;
+  header.size[1] = size_y_;
+  header.size[2] = size_z_;
+  for (int i = 0; i < 3; ++i)
+  {
+    header.origin[i] = origin_[i];
+    header.approach_axis[i] = approach_axis_[i];
+  }
+  header.resolution = resolution_;
+  if (!copyName(header.group, group_) || !copyName(header.base_link, base_link_) ||
+      !copyName(header.tip_link, tip_link_))
+  {
+    ROS_ERROR_NAMED("reachability_map", "Names longer than %u characters cannot be saved in a reachability map",
+                    (unsigned int)NAME_LENGTH - 1);
+    return false;
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(data_), getVoxelCount() * sizeof(std::uint64_t));
+  if (!out.good())
+  {
+    ROS_ERROR_NAMED("reachability_map", "Unable to write reachability map '%s'", filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ReachabilityMap::getVoxelIndex(const Eigen::Vector3d& position, std::size_t& index) const
+{
+  Eigen::Vector3d cell = (position - origin_) / resolution_;
+  if (!(cell.x() >= 0.0 && cell.y() >= 0.0 && cell.z() >= 0.0))
+    return false;
+  std::size_t x = (std::size_t)cell.x();
+  std::size_t y = (std::size_t)cell.y();
+  std::size_t z = (std::size_t)cell.z();
+  if (x >= size_x_ || y >= size_y_ || z >= size_z_)
+    return false;
+  index = (x * size_y_ + y) * size_z_ + z;
+  return true;
+}
+
+Eigen::Vector3d ReachabilityMap::getVoxelCenter(std::size_t index) const
+{
+  std::size_t z = index % size_z_;
+  std::size_t y = (index / size_z_) % size_y_;
+  std::size_t x = index / (size_z_ * size_y_);
+  return origin_ + resolution_ * Eigen::Vector3d(x + 0.5, y + 0.5, z + 0.5);
+}
+
+std::size_t ReachabilityMap::getDirectionIndex(const Eigen::Vector3d& direction)
+{
+  // the face of the cube the direction points to
+  Eigen::Vector3d::Index axis;
+  double m = direction.cwiseAbs().maxCoeff(&axis);
+  if (m <= 0.0)
+    return 0;
+  std::size_t face = 2 * axis + (direction[axis] < 0.0 ? 1 : 0);
+
+  // the cell of the 3x3 grid on that face
+  double u = direction[(axis + 1) % 3] / m;
+  double v = direction[(axis + 2) % 3] / m;
+  std::size_t cu = std::min<std::size_t>(2, (std::size_t)((u + 1.0) * 1.5));
+  std::size_t cv = std::min<std::size_t>(2, (std::size_t)((v + 1.0) * 1.5));
+  return face * 9 + cu * 3 + cv;
+}
+
+Eigen::Vector3d ReachabilityMap::getDirection(std::size_t index)
+{
+  std::size_t face = index / 9;
+  std::size_t axis = face / 2;
+  Eigen::Vector3d direction;
+  direction[axis] = (face % 2) ? -1.0 : 1.0;
+  direction[(axis + 1) % 3] = ((index % 9) / 3 + 0.5) / 1.5 - 1.0;
+  direction[(axis + 2) % 3] = ((index % 3) + 0.5) / 1.5 - 1.0;
+  return direction.normalized();
+}
+
+void ReachabilityMap::addDirections(std::size_t voxel, std::uint64_t directions)
+{
+  if (mapped_)
+  {
+    ROS_ERROR_NAMED("reachability_map", "Reachability maps loaded from a file cannot be modified");
+    return;
+  }
+  data_[voxel] |= directions;
+}
+
+bool ReachabilityMap::addPose(const Eigen::Affine3d& pose)
+{
+  std::size_t voxel;
+  if (!getVoxelIndex(pose.translation(), voxel))
+    return false;
+  addDirections(voxel, (std::uint64_t)1 << getDirectionIndex(pose.linear() * approach_axis_));
+  return true;
+}
+
+void ReachabilityMap::dilate()
+{
+  if (mapped_)
+  {
+    ROS_ERROR_NAMED("reachability_map", "Reachability maps loaded from a file cannot be modified");
+    return;
+  }
+  std::vector<std::uint64_t> dilated(directions_.size(), 0);
+  for (std::size_t x = 0; x < size_x_; ++x)
+    for (std::size_t y = 0; y < size_y_; ++y)
+      for (std::size_t z = 0; z < size_z_; ++z)
+      {
+        std::uint64_t mask = data_[(x * size_y_ + y) * size_z_ + z];
+        if (!mask)
+          continue;
+        for (std::size_t nx = x > 0 ? x - 1 : 0; nx <= x + 1 && nx < size_x_; ++nx)
+          for (std::size_t ny = y > 0 ? y - 1 : 0; ny <= y + 1 && ny < size_y_; ++ny)
+            for (std::size_t nz = z > 0 ? z - 1 : 0; nz <= z + 1 && nz < size_z_; ++nz)
+              dilated[(nx * size_y_ + ny) * size_z_ + nz] |= mask;
+      }
+  directions_.swap(dilated);
+  data_ = &directions_[0];
+}
+
+bool ReachabilityMap::isPositionReachable(const Eigen::Vector3d& position) const
+{
+  std::size_t voxel;
+  return getVoxelIndex(position, voxel) && data_[voxel] != 0;
+}
+
+bool ReachabilityMap::isPoseReachable(const Eigen::Affine3d& pose) const
+{
+  std::size_t voxel;
+  if (!getVoxelIndex(pose.translation(), voxel))
+    return false;
+  return (data_[voxel] >> getDirectionIndex(pose.linear() * approach_axis_)) & 1;
+}
+
+double ReachabilityMap::getReachabilityIndex(const Eigen::Vector3d& position) const
+{
+  std::size_t voxel;
+  if (!getVoxelIndex(position, voxel))
+    return 0.0;
+  return (double)countBits(data_[voxel]) / (double)DIRECTION_COUNT;
+}
+}
+}
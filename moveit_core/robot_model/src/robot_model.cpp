@@ -38,8 +38,10 @@
 #include <moveit/robot_model/robot_model.h>
 #include <geometric_shapes/shape_operations.h>
 #include <boost/math/constants/constants.hpp>
+#include <boost/thread.hpp>
 #include <moveit/profiler/profiler.h>
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <queue>
 #include <cmath>
@@ -60,6 +62,18 @@ RobotModel::RobotModel(const urdf::ModelInterfaceSharedPtr& urdf_model, const sr
   buildModel(*urdf_model, *srdf_model);
 }
 
+RobotModel::RobotModel(const urdf::ModelInterfaceSharedPtr& urdf_model, const srdf::ModelConstSharedPtr& srdf_model,
+                       const MeshLoaderFn& mesh_loader)
+  : mesh_loader_(mesh_loader)
+{
+  root_joint_ = nullptr;
+  urdf_ = urdf_model;
+  srdf_ = srdf_model;
+  buildModel(*urdf_model, *srdf_model);
+  // the loader is only needed while building the model
+  mesh_loader_.clear();
+}
+
 RobotModel::~RobotModel()
 {
   for (JointModelGroupMap::iterator it = joint_model_group_map_.begin(); it != joint_model_group_map_.end(); ++it)
@@ -97,8 +111,17 @@ void RobotModel::buildModel(const urdf::ModelInterface& urdf_model, const srdf::
     const urdf::Link* root_link_ptr = urdf_model.getRoot().get();
     model_frame_ = '/' + root_link_ptr->name;
 
+    ROS_DEBUG_NAMED(LOGNAME, "... loading meshes");
+    preloadMeshes(urdf_model);
+
     ROS_DEBUG_NAMED(LOGNAME, "... building kinematic chain");
     root_joint_ = buildRecursive(nullptr, root_link_ptr, srdf_model);
+
+    // meshes of links that are not part of the tree, or that constructShape() did not ask for
+    for (std::map<const urdf::Geometry*, shapes::Mesh*>::iterator it = preloaded_meshes_.begin();
+         it != preloaded_meshes_.end(); ++it)
+      delete it->second;
+    preloaded_meshes_.clear();
     if (root_joint_)
       root_link_ = root_joint_->getChildLinkModel();
     ROS_DEBUG_NAMED(LOGNAME, "... building mimic joints");
@@ -318,6 +341,24 @@ void RobotModel::buildJointInfo()
 
   computeDescendants();
   computeCommonRoots();  // must be called _after_ list of descendants was computed
+  buildForwardKinematicsProgram();
+}
+
+void RobotModel::buildForwardKinematicsProgram()
+{
+  fk_program_.resize(link_model_vector_.size());
+  for (const LinkModel* link : link_model_vector_)
+  {
+    ForwardKinematicsStep& step = fk_program_[link->getLinkIndex()];
+    const LinkModel* parent = link->getParentLinkModel();
+    step.joint = link->getParentJointModel();
+    step.joint_type = step.joint->getType();
+    step.joint_index = step.joint->getJointIndex();
+    step.first_variable_index = step.joint->getFirstVariableIndex();
+    step.parent_link_index = parent ? parent->getLinkIndex() : -1;
+    step.origin = link->jointOriginTransformIsIdentity() ? nullptr : &link->getJointOriginTransform();
+    step.fixed = parent && link->parentJointIsFixed();
+  }
 }
 
 void RobotModel::buildGroupStates(const srdf::Model& srdf_model)
@@ -965,6 +1006,65 @@ static inline Eigen::Affine3d urdfPose2Affine3d(const urdf::Pose& pose)
 }
 }
 
+void RobotModel::preloadMeshes(const urdf::ModelInterface& urdf_model)
+{
+  moveit::tools::Profiler::ScopedBlock prof_block("RobotModel::preloadMeshes");
+
+  // collect the meshes constructLinkModel() is going to ask for: the collision geometry of a link
+  // and, for links without collision geometry, the visual geometry
+  std::vector<const urdf::Mesh*> meshes;
+  std::vector<urdf::LinkSharedPtr> urdf_links;
+  urdf_model.getLinks(urdf_links);
+  for (std::size_t i = 0; i < urdf_links.size(); ++i)
+  {
+    const urdf::Link* urdf_link = urdf_links[i].get();
+    const std::vector<urdf::CollisionSharedPtr>& col_array =
+        urdf_link->collision_array.empty() ? std::vector<urdf::CollisionSharedPtr>(1, urdf_link->collision) :
+                                             urdf_link->collision_array;
+    bool has_collision_geometry = false;
+    for (std::size_t j = 0; j < col_array.size(); ++j)
+      if (col_array[j] && col_array[j]->geometry)
+      {
+        has_collision_geometry = true;
+        if (col_array[j]->geometry->type == urdf::Geometry::MESH)
+          meshes.push_back(static_cast<const urdf::Mesh*>(col_array[j]->geometry.get()));
+      }
+    if (has_collision_geometry)
+      continue;
+    const std::vector<urdf::VisualSharedPtr>& vis_array = urdf_link->visual_array.empty() ?
+                                                              std::vector<urdf::VisualSharedPtr>(1, urdf_link->visual) :
+                                                              urdf_link->visual_array;
+    for (std::size_t j = 0; j < vis_array.size(); ++j)
+      if (vis_array[j] && vis_array[j]->geometry && vis_array[j]->geometry->type == urdf::Geometry::MESH)
+        meshes.push_back(static_cast<const urdf::Mesh*>(vis_array[j]->geometry.get()));
+  }
+
+  std::size_t thread_count = std::min<std::size_t>(boost::thread::hardware_concurrency(), meshes.size());
+  if (thread_count < 2)
+    return;
+
+  // each worker repeatedly claims the next mesh that was not loaded yet
+  std::vector<shapes::Mesh*> loaded(meshes.size(), nullptr);
+  std::atomic<std::size_t> next(0);
+  boost::thread_group workers;
+  for (std::size_t t = 0; t < thread_count; ++t)
+    workers.create_thread([this, &meshes, &loaded, &next]() {
+      for (std::size_t i = next++; i < meshes.size(); i = next++)
+      {
+        if (meshes[i]->filename.empty())
+          continue;
+        Eigen::Vector3d scale(meshes[i]->scale.x, meshes[i]->scale.y, meshes[i]->scale.z);
+        loaded[i] = mesh_loader_ ? mesh_loader_(meshes[i]->filename, scale) :
+                                   shapes::createMeshFromResource(meshes[i]->filename, scale);
+      }
+    });
+  workers.join_all();
+
+  for (std::size_t i = 0; i < meshes.size(); ++i)
+    if (loaded[i])
+      preloaded_meshes_[meshes[i]] = loaded[i];
+}
+
 LinkModel* RobotModel::constructLinkModel(const urdf::Link* urdf_link)
 {
   LinkModel* result = new LinkModel(urdf_link->name);
@@ -1056,10 +1156,17 @@ shapes::ShapePtr RobotModel::constructShape(const urdf::Geometry* geom)
     case urdf::Geometry::MESH:
     {
       const urdf::Mesh* mesh = static_cast<const urdf::Mesh*>(geom);
-      if (!mesh->filename.empty())
+      std::map<const urdf::Geometry*, shapes::Mesh*>::iterator preloaded = preloaded_meshes_.find(geom);
+      if (preloaded != preloaded_meshes_.end())
+      {
+        result = preloaded->second;
+        preloaded_meshes_.erase(preloaded);
+      }
+      else if (!mesh->filename.empty())
       {
         Eigen::Vector3d scale(mesh->scale.x, mesh->scale.y, mesh->scale.z);
-        shapes::Mesh* m = shapes::createMeshFromResource(mesh->filename, scale);
+        shapes::Mesh* m = mesh_loader_ ? mesh_loader_(mesh->filename, scale) :
+                                         shapes::createMeshFromResource(mesh->filename, scale);
         result = m;
       }
     }
@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/robot_model/robot_model.h>
+#include <random_numbers/random_numbers.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
 #include <gtest/gtest.h>
@@ -102,6 +103,30 @@ TEST_F(LoadPlanningModelsPr2, Model)
   moveit::tools::Profiler::Status();
 }
 
+TEST_F(LoadPlanningModelsPr2, GroupPositionBounds)
+{
+  // right_arm has revolute joints with and without limits; a copy of the bounds takes the path through the joint models
+  const moveit::core::JointModelGroup* group = robot_model->getJointModelGroup("right_arm");
+  ASSERT_TRUE(group != NULL);
+  moveit::core::JointBoundsVector bounds = group->getActiveJointModelsBounds();
+  random_numbers::RandomNumberGenerator rng(7);
+  std::vector<double> values(group->getVariableCount());
+  std::vector<double> expected(group->getVariableCount());
+  for (int i = 0; i < 100; ++i)
+  {
+    for (std::size_t j = 0; j < values.size(); ++j)
+      values[j] = expected[j] = rng.uniformReal(-10.0, 10.0);
+    EXPECT_EQ(group->satisfiesPositionBounds(&values[0], 0.1), group->satisfiesPositionBounds(&values[0], bounds, 0.1));
+    EXPECT_EQ(group->enforcePositionBounds(&values[0]), group->enforcePositionBounds(&expected[0], bounds));
+    for (std::size_t j = 0; j < values.size(); ++j)
+      EXPECT_EQ(values[j], expected[j]);
+    EXPECT_TRUE(group->satisfiesPositionBounds(&values[0]));
+
+    group->getVariableRandomPositions(rng, &values[0]);
+    EXPECT_TRUE(group->satisfiesPositionBounds(&values[0]));
+  }
+}
+
 TEST(SiblingAssociateLinks, SimpleYRobot)
 {
   /* base_link - a - b - c
@@ -0,0 +1,121 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model/reachability_map.h>
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <unistd.h>
+
+using moveit::core::ReachabilityMap;
+
+TEST(ReachabilityMap, DirectionBins)
+{
+  for (std::size_t i = 0; i < ReachabilityMap::DIRECTION_COUNT; ++i)
+    EXPECT_EQ(i, ReachabilityMap::getDirectionIndex(ReachabilityMap::getDirection(i)));
+  EXPECT_EQ(ReachabilityMap::getDirectionIndex(Eigen::Vector3d(2.0, 0.1, -0.1)),
+            ReachabilityMap::getDirectionIndex(Eigen::Vector3d::UnitX()));
+  EXPECT_NE(ReachabilityMap::getDirectionIndex(Eigen::Vector3d::UnitX()),
+            ReachabilityMap::getDirectionIndex(-Eigen::Vector3d::UnitX()));
+}
+
+TEST(ReachabilityMap, Voxels)
+{
+  ReachabilityMap map("arm", "base", "tip", Eigen::Vector3d(-1.0, -1.0, 0.0), Eigen::Vector3d(1.0, 1.0, 1.0), 0.1);
+  EXPECT_EQ(20u * 20u * 10u, map.getVoxelCount());
+
+  std::size_t index;
+  EXPECT_FALSE(map.getVoxelIndex(Eigen::Vector3d(0.0, 0.0, -0.05), index));
+  EXPECT_FALSE(map.getVoxelIndex(Eigen::Vector3d(1.05, 0.0, 0.5), index));
+  ASSERT_TRUE(map.getVoxelIndex(Eigen::Vector3d(0.42, -0.33, 0.71), index));
+  EXPECT_TRUE(map.getVoxelCenter(index).isApprox(Eigen::Vector3d(0.45, -0.35, 0.75)));
+
+  // a pose reaching down along the approach axis (x) of the tip
+  Eigen::Affine3d pose(Eigen::Translation3d(0.42, -0.33, 0.71) *
+                       Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitY()));
+  EXPECT_FALSE(map.isPositionReachable(pose.translation()));
+  EXPECT_TRUE(map.addPose(pose));
+  EXPECT_TRUE(map.isPositionReachable(pose.translation()));
+  EXPECT_TRUE(map.isPoseReachable(pose));
+  EXPECT_FALSE(map.isPoseReachable(Eigen::Affine3d(Eigen::Translation3d(pose.translation()))));
+  EXPECT_DOUBLE_EQ(1.0 / ReachabilityMap::DIRECTION_COUNT, map.getReachabilityIndex(pose.translation()));
+
+  // rotating about the approach axis does not change the direction bin
+  Eigen::Affine3d rolled = pose * Eigen::AngleAxisd(1.0, Eigen::Vector3d::UnitX());
+  EXPECT_TRUE(map.isPoseReachable(rolled));
+
+  EXPECT_FALSE(map.isPositionReachable(Eigen::Vector3d(0.52, -0.33, 0.71)));
+  map.dilate();
+  EXPECT_TRUE(map.isPoseReachable(Eigen::Affine3d(Eigen::Translation3d(0.1, 0.0, 0.0)) * pose));
+  EXPECT_FALSE(map.isPositionReachable(Eigen::Vector3d(0.62, -0.33, 0.71)));
+}
+
+TEST(ReachabilityMap, SaveAndLoad)
+{
+  ReachabilityMap map("arm", "base", "tip", Eigen::Vector3d(0.0, 0.0, 0.0), Eigen::Vector3d(1.0, 0.5, 0.5), 0.05,
+                      Eigen::Vector3d::UnitZ());
+  Eigen::Affine3d pose(Eigen::Translation3d(0.3, 0.2, 0.1));
+  EXPECT_TRUE(map.addPose(pose));
+
+  char filename[] = "/tmp/reachability_map_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(map.save(filename));
+
+  moveit::core::ReachabilityMapPtr loaded = ReachabilityMap::load(filename);
+  std::remove(filename);
+  ASSERT_TRUE(bool(loaded));
+  EXPECT_TRUE(loaded->isMapped());
+  EXPECT_EQ("arm", loaded->getGroupName());
+  EXPECT_EQ("base", loaded->getBaseLinkName());
+  EXPECT_EQ("tip", loaded->getTipLinkName());
+  EXPECT_EQ(map.getVoxelCount(), loaded->getVoxelCount());
+  EXPECT_DOUBLE_EQ(0.05, loaded->getResolution());
+  EXPECT_TRUE(loaded->getApproachAxis().isApprox(Eigen::Vector3d::UnitZ()));
+  EXPECT_TRUE(loaded->isPoseReachable(pose));
+  EXPECT_FALSE(loaded->isPoseReachable(Eigen::Affine3d(Eigen::Translation3d(0.3, 0.2, 0.1)) *
+                                       Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX())));
+  EXPECT_FALSE(loaded->isPositionReachable(Eigen::Vector3d(0.6, 0.2, 0.1)));
+}
+
+TEST(ReachabilityMap, LoadInvalid)
+{
+  EXPECT_FALSE(bool(ReachabilityMap::load("/nonexistent/map")));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -41,6 +41,7 @@
 #include <eigen_stl_containers/eigen_stl_containers.h>
 #include <boost/function.hpp>
 #include <trajectory_msgs/JointTrajectory.h>
+#include <memory>
 #include <set>
 
 namespace moveit
@@ -52,7 +53,10 @@ typedef boost::function<void(AttachedBody* body, bool attached)> AttachedBodyCal
 
 /** @brief Object defining bodies that can be attached to robot
  *  links. This is useful when handling objects picked up by
- *  the robot. */
+ *  the robot.
+ *
+ *  Copies of an attached body share its geometry (shapes, fixed transforms, touch links and detach posture), which is
+ *  only copied when a copy modifies it. Only the global transforms are owned by each copy. */
 class AttachedBody
 {
 public:
@@ -64,12 +68,15 @@ public:
                const EigenSTL::vector_Affine3d& attach_trans, const std::set<std::string>& touch_links,
                const trajectory_msgs::JointTrajectory& attach_posture);
 
+  /** \brief Copy an attached body. The copy shares the geometry of \e other */
+  AttachedBody(const AttachedBody& other);
+
   ~AttachedBody();
 
   /** \brief Get the name of the attached body */
   const std::string& getName() const
   {
-    return id_;
+    return geometry_->id_;
   }
 
   /** \brief Get the name of the link this body is attached to */
@@ -87,13 +94,13 @@ public:
   /** \brief Get the shapes that make up this attached body */
   const std::vector<shapes::ShapeConstPtr>& getShapes() const
   {
-    return shapes_;
+    return geometry_->shapes_;
   }
 
   /** \brief Get the links that the attached body is allowed to touch */
   const std::set<std::string>& getTouchLinks() const
   {
-    return touch_links_;
+    return geometry_->touch_links_;
   }
 
   /** \brief Return the posture that is necessary for the object to be released, (if any). This is useful for example
@@ -101,13 +108,13 @@ public:
       the configuration of a gripper holding an object */
   const trajectory_msgs::JointTrajectory& getDetachPosture() const
   {
-    return detach_posture_;
+    return geometry_->detach_posture_;
   }
 
   /** \brief Get the fixed transform (the transforms to the shapes associated with this body) */
   const EigenSTL::vector_Affine3d& getFixedTransforms() const
   {
-    return attach_trans_;
+    return geometry_->attach_trans_;
   }
 
   /** \brief Get the global transforms for the collision bodies */
@@ -126,28 +133,38 @@ public:
   void computeTransform(const Eigen::Affine3d& parent_link_global_transform)
   {
     for (std::size_t i = 0; i < global_collision_body_transforms_.size(); ++i)
-      global_collision_body_transforms_[i] = parent_link_global_transform * attach_trans_[i];
+      global_collision_body_transforms_[i] = parent_link_global_transform * geometry_->attach_trans_[i];
   }
 
 private:
-  /** \brief The link that owns this attached body */
-  const LinkModel* parent_link_model_;
+  /** \brief The part of an attached body that does not change with the state of the robot */
+  struct Geometry
+  {
+    /** \brief string id for reference */
+    std::string id_;
 
-  /** \brief string id for reference */
-  std::string id_;
+    /** \brief The geometries of the attached body */
+    std::vector<shapes::ShapeConstPtr> shapes_;
 
-  /** \brief The geometries of the attached body */
-  std::vector<shapes::ShapeConstPtr> shapes_;
+    /** \brief The constant transforms applied to the link (needs to be specified by user) */
+    EigenSTL::vector_Affine3d attach_trans_;
 
-  /** \brief The constant transforms applied to the link (needs to be specified by user) */
-  EigenSTL::vector_Affine3d attach_trans_;
+    /** \brief The set of links this body is allowed to touch */
+    std::set<std::string> touch_links_;
 
-  /** \brief The set of links this body is allowed to touch */
-  std::set<std::string> touch_links_;
+    /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
+        the configuration of a gripper holding an object */
+    trajectory_msgs::JointTrajectory detach_posture_;
+  };
 
-  /** \brief Posture of links for releasing the object (if any). This is useful for example when storing
-      the configuration of a gripper holding an object */
-  trajectory_msgs::JointTrajectory detach_posture_;
+  /** \brief Get the geometry for modification, after copying it if it is shared with other attached bodies */
+  Geometry& getGeometryNonConst();
+
+  /** \brief The link that owns this attached body */
+  const LinkModel* parent_link_model_;
+
+  /** \brief The geometry, shared by all copies of this attached body until one of them modifies it */
+  std::shared_ptr<Geometry> geometry_;
 
   /** \brief The global transforms for these attached bodies (computed by forward kinematics) */
   EigenSTL::vector_Affine3d global_collision_body_transforms_;
@@ -109,6 +109,15 @@ void robotStateToJointStateMsg(const RobotState& state, sensor_msgs::JointState&
 bool jointTrajPointToRobotState(const trajectory_msgs::JointTrajectory& trajectory, std::size_t point_id,
                                 RobotState& state);
 
+/**
+ * @brief Set the values of a joint trajectory point in a MoveIt! robot state, without resolving the joint names again
+ * @param mapping The mapping of the joint names of the trajectory
+ * @param point The input trajectory point
+ * @param state The resultant MoveIt! robot state
+ */
+void jointTrajPointToRobotState(const VariableIndexMapping& mapping, const trajectory_msgs::JointTrajectoryPoint& point,
+                                RobotState& state);
+
 /**
  * @brief Convert a MoveIt! robot state to common separated values (CSV) on a single line that is
  *        outputted to a stream e.g. for file saving
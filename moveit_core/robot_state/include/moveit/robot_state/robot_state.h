@@ -39,6 +39,7 @@
 #define MOVEIT_CORE_ROBOT_STATE_
 
 #include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_model/variable_index_mapping.h>
 #include <moveit/robot_state/attached_body.h>
 #include <moveit/macros/deprecation.h>
 #include <sensor_msgs/JointState.h>
@@ -46,6 +47,7 @@
 #include <std_msgs/ColorRGBA.h>
 #include <geometry_msgs/Twist.h>
 #include <cassert>
+#include <cstdint>
 
 #include <boost/assert.hpp>
 
@@ -63,6 +65,10 @@ typedef boost::function<bool(RobotState* robot_state, const JointModelGroup* joi
                              const double* joint_group_variable_values)>
     GroupStateValidityCallbackFn;
 
+/** \brief Signature for functions that can verify that the motion between two consecutive states of a path is valid
+   (e.g., the motion is collision free). Returns true if the motion is valid. */
+typedef boost::function<bool(const RobotState& from, const RobotState& to)> SegmentValidityCallbackFn;
+
 /** \brief Struct for containing jump_threshold.
 
     For the purposes of maintaining API, we support both \e jump_threshold_factor which provides a scaling factor for
@@ -103,6 +109,26 @@ struct MaxEEFStep
   double rotation;     // Radians
 };
 
+/** \brief Struct for containing the step sizes of the adaptive computeCartesianPath
+
+    Steps of up to \e max_step are taken where the path is well-conditioned. A step is halved, down to \e min_step,
+    while IK fails for it, while its joint-space distance exceeds \e max_joint_step or while the condition number of
+    the Jacobian at its end exceeds \e max_condition_number. Setting \e max_joint_step or \e max_condition_number to
+    zero disables the respective check. */
+struct AdaptiveEEFStep
+{
+  explicit AdaptiveEEFStep(const MaxEEFStep& max_step = MaxEEFStep(), const MaxEEFStep& min_step = MaxEEFStep(),
+                           double max_joint_step = 0.0, double max_condition_number = 0.0)
+    : max_step(max_step), min_step(min_step), max_joint_step(max_joint_step), max_condition_number(max_condition_number)
+  {
+  }
+
+  MaxEEFStep max_step;          // Largest step, taken where the path is well-conditioned
+  MaxEEFStep min_step;          // Smallest step subdivision goes down to
+  double max_joint_step;        // Largest joint-space distance between consecutive states
+  double max_condition_number;  // Largest Jacobian condition number at which a step is not subdivided further
+};
+
 /** \brief Representation of a robot's state. This includes position,
     velocity, acceleration and effort.
 
@@ -218,6 +244,10 @@ public:
   void setVariablePositions(const std::vector<std::string>& variable_names,
                             const std::vector<double>& variable_position);
 
+  /** \brief Set the positions of the variables in \e mapping to the corresponding entries of \e variable_position.
+      Names in \e mapping that are not known to the model are skipped. */
+  void setVariablePositions(const VariableIndexMapping& mapping, const std::vector<double>& variable_position);
+
   /** \brief Set the position of a single variable. An exception is thrown if the variable name is not known */
   void setVariablePosition(const std::string& variable, double value)
   {
@@ -309,6 +339,10 @@ public:
   void setVariableVelocities(const std::vector<std::string>& variable_names,
                              const std::vector<double>& variable_velocity);
 
+  /** \brief Set the velocities of the variables in \e mapping to the corresponding entries of \e variable_velocity.
+      Names in \e mapping that are not known to the model are skipped. */
+  void setVariableVelocities(const VariableIndexMapping& mapping, const std::vector<double>& variable_velocity);
+
   /** \brief Set the velocity of a variable. If an unknown variable name is specified, an exception is thrown. */
   void setVariableVelocity(const std::string& variable, double value)
   {
@@ -402,6 +436,10 @@ public:
   void setVariableAccelerations(const std::vector<std::string>& variable_names,
                                 const std::vector<double>& variable_acceleration);
 
+  /** \brief Set the accelerations of the variables in \e mapping to the corresponding entries of \e
+      variable_acceleration. Names in \e mapping that are not known to the model are skipped. */
+  void setVariableAccelerations(const VariableIndexMapping& mapping, const std::vector<double>& variable_acceleration);
+
   /** \brief Set the acceleration of a variable. If an unknown variable name is specified, an exception is thrown. */
   void setVariableAcceleration(const std::string& variable, double value)
   {
@@ -488,6 +526,10 @@ public:
   void setVariableEffort(const std::vector<std::string>& variable_names,
                          const std::vector<double>& variable_acceleration);
 
+  /** \brief Set the effort of the variables in \e mapping to the corresponding entries of \e variable_effort.
+      Names in \e mapping that are not known to the model are skipped. */
+  void setVariableEffort(const VariableIndexMapping& mapping, const std::vector<double>& variable_effort);
+
   /** \brief Set the effort of a variable. If an unknown variable name is specified, an exception is thrown. */
   void setVariableEffort(const std::string& variable, double value)
   {
@@ -1052,6 +1094,27 @@ as the new values that correspond to the group */
                           const GroupStateValidityCallbackFn& constraint = GroupStateValidityCallbackFn(),
                           const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions());
 
+  /**
+      \brief Compute IK solutions for many poses of the same tip at once, with a solver that has a single tip frame.
+      Each pose is brought to the frame of the solver as setFromIK() does for a single pose, and the current positions
+      of the group are the seed of every query. The state is not modified.
+      @param poses The poses the tip needs to achieve
+      @param tip The name of the frame for which IK is attempted
+      @param solutions The positions of the group's variables that reach each pose; empty where none was found
+      @param timeout The timeout passed to the kinematics solver for each pose
+      @return The number of poses for which a solution was found */
+  std::size_t computeIKBatch(const JointModelGroup* group, const EigenSTL::vector_Affine3d& poses,
+                             const std::string& tip, std::vector<std::vector<double> >& solutions, double timeout = 0.0,
+                             const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Compute IK solutions for many poses as computeIKBatch() does, but with \e solver instead of the solver
+      instance of the group. \e solver must have been allocated for \e group, e.g., by the solver allocator of the
+      group, which allows threads with their own solver to compute IK concurrently. */
+  std::size_t computeIKBatch(const JointModelGroup* group, const kinematics::KinematicsBaseConstPtr& solver,
+                             const EigenSTL::vector_Affine3d& poses, const std::string& tip,
+                             std::vector<std::vector<double> >& solutions, double timeout = 0.0,
+                             const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions());
+
   /** \brief Set the joint values from a Cartesian velocity applied during a time dt
    * @param group the group of joints this function operates on
    * @param twist a Cartesian velocity on the 'tip' frame
@@ -1163,6 +1226,49 @@ as the new values that correspond to the group */
                                 JumpThreshold(jump_threshold_factor), validCallback, options);
   }
 
+  /** \brief Compute the sequence of joint values that correspond to a straight Cartesian path to \e target, with step
+     sizes that adapt to the path.
+
+     Instead of interpolating with a fixed step, as many steps of up to \e step.max_step as possible are taken; a step
+     is only subdivided (down to \e step.min_step) where IK fails, where the joint-space distance of the step exceeds
+     \e step.max_joint_step or where the Jacobian at the end of the step is badly conditioned. A step whose joint-space
+     distance still exceeds \e step.max_joint_step at the smallest step size is considered a joint-space jump, and the
+     path is truncated before it, as is the case for IK failures. Since the step sizes vary, \e step.max_joint_step
+     takes the place of the relative jump threshold.
+
+     If \e segment_validity is given, the motion between every two consecutive states of the resulting path is passed
+     to it, split over up to \e thread_count threads (0 means one per hardware thread), and the path is truncated
+     before the first invalid segment. \e segment_validity needs to be thread safe if more than one thread is used.
+     At the end of the function call, the state of the group corresponds to the last state of the returned path. The
+     return value is the fraction of the path that was computed. */
+  double computeCartesianPath(const JointModelGroup* group, std::vector<RobotStatePtr>& traj, const LinkModel* link,
+                              const Eigen::Affine3d& target, bool global_reference_frame, const AdaptiveEEFStep& step,
+                              const GroupStateValidityCallbackFn& validCallback = GroupStateValidityCallbackFn(),
+                              const SegmentValidityCallbackFn& segment_validity = SegmentValidityCallbackFn(),
+                              unsigned int thread_count = 0,
+                              const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Compute the sequence of joint values that perform a general Cartesian path with adaptive step sizes.
+
+     The \e waypoints are reached sequentially as in the fixed-step version; each straight segment between them is
+     computed as in the adaptive version for a single target, and the resulting path is validated once with
+     \e segment_validity. */
+  double computeCartesianPath(const JointModelGroup* group, std::vector<RobotStatePtr>& traj, const LinkModel* link,
+                              const EigenSTL::vector_Affine3d& waypoints, bool global_reference_frame,
+                              const AdaptiveEEFStep& step,
+                              const GroupStateValidityCallbackFn& validCallback = GroupStateValidityCallbackFn(),
+                              const SegmentValidityCallbackFn& segment_validity = SegmentValidityCallbackFn(),
+                              unsigned int thread_count = 0,
+                              const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions());
+
+  /** \brief Tests the motion between consecutive states of \e traj with \e segment_validity, split over up to
+     \e thread_count threads (0 means one per hardware thread), and truncates \e traj before the first invalid
+     segment.
+     @return The fraction of the trajectory that passed.
+  */
+  static double testSegmentValidity(std::vector<RobotStatePtr>& traj, const SegmentValidityCallbackFn& segment_validity,
+                                    unsigned int thread_count = 0);
+
   /** \brief Tests joint space jumps of a trajectory.
 
      If \e jump_threshold_factor is non-zero, we test for relative jumps.
@@ -1229,14 +1335,19 @@ as the new values that correspond to the group */
    * \param use_quaternion_representation Flag indicating if the Jacobian should use a quaternion representation
    * (default is false)
    * \return True if jacobian was successfully computed, false otherwise
+   *
+   * The result is cached: as long as the link transforms of the state do not change, repeated queries for the
+   * same group, link and reference point return the cached Jacobian.
    */
   bool getJacobian(const JointModelGroup* group, const LinkModel* link, const Eigen::Vector3d& reference_point_position,
-                   Eigen::MatrixXd& jacobian, bool use_quaternion_representation = false)
-  {
-    updateLinkTransforms();
-    return static_cast<const RobotState*>(this)->getJacobian(group, link, reference_point_position, jacobian,
-                                                             use_quaternion_representation);
-  }
+                   Eigen::MatrixXd& jacobian, bool use_quaternion_representation = false);
+
+  /** \brief Compute the Jacobians with reference to the origins of several links of a specified group.
+   * This is equivalent to calling getJacobian() for each link, and makes use of the same cache.
+   * \return True if all Jacobians were successfully computed, false otherwise
+   */
+  bool getJacobians(const JointModelGroup* group, const std::vector<const LinkModel*>& links,
+                    std::vector<Eigen::MatrixXd>& jacobians, bool use_quaternion_representation = false);
 
   /** \brief Compute the Jacobian with reference to the last link of a specified group. If the group is not a chain, an
    * exception is thrown.
@@ -1373,6 +1484,11 @@ as the new values that correspond to the group */
     return global_link_transforms_[link->getLinkIndex()];
   }
 
+  /** \brief Compute the global transform of \e link from the current variable values along the chain of its ancestor
+      joints only. Other links and the collision bodies are not updated and the cached state is left untouched, so
+      this is the cheap way to get the pose of a single link of a state that is not used for anything else. */
+  void computeGlobalLinkTransform(const LinkModel* link, Eigen::Affine3d& transform) const;
+
   const Eigen::Affine3d& getCollisionBodyTransforms(const std::string& link_name, std::size_t index)
   {
     return getCollisionBodyTransform(robot_model_->getLinkModel(link_name), index);
@@ -1455,6 +1571,16 @@ as the new values that correspond to the group */
     return dirtyCollisionBodyTransforms();
   }
 
+  /** \brief The version of the variable positions and the attached bodies, incremented whenever either changes
+      through the functions of this class (writes through the pointer returned by getVariablePositions() are not
+      seen). A copy of a state starts with the version of the original; assigning a state to another increments the
+      version of the latter. Caches of values computed from a state can compare versions to know whether they are
+      still valid. Velocities, accelerations and efforts are not tracked. */
+  std::uint64_t getVersion() const
+  {
+    return version_;
+  }
+
   /** @} */
 
   /** \name Computing distances
@@ -1744,21 +1870,39 @@ private:
 
   void markDirtyJointTransforms(const JointModel* joint)
   {
+    ++version_;
     dirty_joint_transforms_[joint->getJointIndex()] = 1;
-    dirty_link_transforms_ =
-        dirty_link_transforms_ == NULL ? joint : robot_model_->getCommonRoot(dirty_link_transforms_, joint);
+    addDirtySubtree(joint, dirty_link_transforms_, dirty_link_roots_, dirty_link_roots_count_);
   }
 
   void markDirtyJointTransforms(const JointModelGroup* group)
   {
+    ++version_;
     const std::vector<const JointModel*>& jm = group->getActiveJointModels();
     for (std::size_t i = 0; i < jm.size(); ++i)
       dirty_joint_transforms_[jm[i]->getJointIndex()] = 1;
-    dirty_link_transforms_ = dirty_link_transforms_ == NULL ?
-                                 group->getCommonRoot() :
-                                 robot_model_->getCommonRoot(dirty_link_transforms_, group->getCommonRoot());
+    addDirtySubtree(group->getCommonRoot(), dirty_link_transforms_, dirty_link_roots_, dirty_link_roots_count_);
   }
 
+  /** \brief Mark all link transforms (and thus all collision body transforms) as dirty */
+  void markAllLinkTransformsDirty()
+  {
+    ++version_;
+    dirty_link_transforms_ = robot_model_->getRootJoint();
+    dirty_link_roots_count_ = 0;
+  }
+
+  /** \brief Add the subtree starting at \e joint to a set of dirty subtrees.
+
+      The set is described by the common root \e common of all dirty subtrees and, as long as there are
+      at most MAX_DIRTY_SUBTREES of them, by the list of disjoint subtree roots \e roots. A \e count of
+      zero with a non-null \e common means that the complete subtree of \e common is dirty. */
+  void addDirtySubtree(const JointModel* joint, const JointModel*& common, const JointModel** roots,
+                       unsigned char& count) const;
+
+  /** \brief Recompute the link transforms of a set of dirty subtrees (see addDirtySubtree()) */
+  void updateLinkTransformsInternal(const JointModel* common, const JointModel* const* roots, unsigned char count);
+
   void markVelocity();
   void markAcceleration();
   void markEffort();
@@ -1804,6 +1948,10 @@ private:
 
   void updateLinkTransformsInternal(const JointModel* start);
 
+  /** \brief Compute the transform of the link with index \e link_index along its ancestor chain, see
+      computeGlobalLinkTransform() */
+  void computeChainTransform(int link_index, Eigen::Affine3d& transform) const;
+
   void getMissingKeys(const std::map<std::string, double>& variable_map,
                       std::vector<std::string>& missing_variables) const;
   void getStateTreeJointString(std::ostream& ss, const JointModel* jm, const std::string& pfx0, bool last) const;
@@ -1817,6 +1965,9 @@ private:
   /** \brief This function is only called in debug mode */
   bool checkCollisionTransforms() const;
 
+  /** \brief Cache of Jacobians computed by the non-const getJacobian() */
+  struct JacobianCache;
+
   RobotModelConstPtr robot_model_;
   void* memory_;
 
@@ -1828,14 +1979,34 @@ private:
   bool has_acceleration_;
   bool has_effort_;
 
+  /** \brief Maximum number of disjoint dirty subtrees that are tracked individually, e.g. one per arm.
+      If more subtrees become dirty, they are collapsed into their common root. */
+  static const std::size_t MAX_DIRTY_SUBTREES = 4;
+
+  /** \brief Common root of all dirty link / collision body transforms, NULL if nothing is dirty */
   const JointModel* dirty_link_transforms_;
   const JointModel* dirty_collision_body_transforms_;
 
+  /** \brief Disjoint roots of the dirty subtrees below dirty_link_transforms_ / dirty_collision_body_transforms_ */
+  const JointModel* dirty_link_roots_[MAX_DIRTY_SUBTREES];
+  const JointModel* dirty_collision_body_roots_[MAX_DIRTY_SUBTREES];
+  unsigned char dirty_link_roots_count_;
+  unsigned char dirty_collision_body_roots_count_;
+
   Eigen::Affine3d* variable_joint_transforms_;         // this points to an element in transforms_, so it is aligned
   Eigen::Affine3d* global_link_transforms_;            // this points to an element in transforms_, so it is aligned
   Eigen::Affine3d* global_collision_body_transforms_;  // this points to an element in transforms_, so it is aligned
   unsigned char* dirty_joint_transforms_;
 
+  /** \brief Incremented whenever the link transforms change */
+  unsigned long link_transforms_version_;
+
+  /** \brief Incremented whenever the variable positions or the attached bodies change, see getVersion() */
+  std::uint64_t version_;
+
+  /** \brief Allocated on first use of the Jacobian cache; not copied with the state */
+  JacobianCache* jacobian_cache_;
+
   /** \brief All attached bodies that are part of this state, indexed by their name */
   std::map<std::string, AttachedBody*> attached_body_map_;
 
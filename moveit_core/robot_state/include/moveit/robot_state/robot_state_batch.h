@@ -0,0 +1,162 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_ROBOT_STATE_BATCH_
+#define MOVEIT_CORE_ROBOT_STATE_BATCH_
+
+#include <moveit/robot_state/robot_state.h>
+
+namespace moveit
+{
+namespace core
+{
+MOVEIT_CLASS_FORWARD(RobotStateBatch);
+
+/** \brief Forward kinematics for many states of the same robot model at once.
+
+    The joint values of the batch are stored column-wise in a single matrix (one column per state,
+    one row per variable). Link transforms are computed in lockstep: every link is processed for
+    all states of the batch before moving on to the next link, so the parent transforms used by a
+    link are contiguous in memory. Joint transforms are computed through the forward kinematics
+    program of the RobotModel (see RobotModel::getForwardKinematicsProgram()).
+
+    Only link transforms are computed. Attached bodies and collision body transforms are not handled;
+    use copyToState() to obtain a full RobotState for a particular column. */
+class RobotStateBatch
+{
+public:
+  /** \brief Construct a batch of \e size states for \e robot_model. All link transforms are dirty initially. */
+  RobotStateBatch(const RobotModelConstPtr& robot_model, std::size_t size = 0);
+
+  /** \brief Get the robot model this batch is constructed for. */
+  const RobotModelConstPtr& getRobotModel() const
+  {
+    return robot_model_;
+  }
+
+  /** \brief Get the number of states in the batch */
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  /** \brief Change the number of states in the batch. This invalidates all previously computed transforms
+      and leaves the joint values of newly added states uninitialized. */
+  void resize(std::size_t size);
+
+  /** \brief Direct access to the joint values (one column per state, variables in RobotModel order).
+      Modifying the matrix marks the link transforms as dirty. */
+  Eigen::MatrixXd& getVariablePositions()
+  {
+    dirty_ = true;
+    return positions_;
+  }
+
+  const Eigen::MatrixXd& getVariablePositions() const
+  {
+    return positions_;
+  }
+
+  /** \brief Set the joint values of the state at \e index from a full variable vector */
+  void setVariablePositions(std::size_t index, const double* position);
+
+  /** \brief Set the joint values of the state at \e index from \e state */
+  void setVariablePositions(std::size_t index, const RobotState& state)
+  {
+    setVariablePositions(index, state.getVariablePositions());
+  }
+
+  /** \brief Copy the joint values of the state at \e index into \e state. The link transforms of \e state
+      are marked dirty, as for any call to RobotState::setVariablePositions(). */
+  void copyToState(std::size_t index, RobotState& state) const;
+
+  /** \brief Compute the link transforms of all states in the batch, if needed */
+  void updateLinkTransforms();
+
+  bool dirtyLinkTransforms() const
+  {
+    return dirty_;
+  }
+
+  /** \brief Get the global transform of \e link for the state at \e index. The returned reference stays
+      valid until the batch is resized. */
+  const Eigen::Affine3d& getGlobalLinkTransform(std::size_t index, const LinkModel* link)
+  {
+    updateLinkTransforms();
+    return global_link_transforms_[link->getLinkIndex() * size_ + index];
+  }
+
+  const Eigen::Affine3d& getGlobalLinkTransform(std::size_t index, const std::string& link_name)
+  {
+    return getGlobalLinkTransform(index, robot_model_->getLinkModel(link_name));
+  }
+
+  const Eigen::Affine3d& getGlobalLinkTransform(std::size_t index, const LinkModel* link) const
+  {
+    BOOST_VERIFY(checkLinkTransforms());
+    return global_link_transforms_[link->getLinkIndex() * size_ + index];
+  }
+
+  const Eigen::Affine3d& getGlobalLinkTransform(std::size_t index, const std::string& link_name) const
+  {
+    return getGlobalLinkTransform(index, robot_model_->getLinkModel(link_name));
+  }
+
+  /** \brief Get the contiguous block of transforms for \e link, one element per state in the batch */
+  const Eigen::Affine3d* getGlobalLinkTransforms(const LinkModel* link)
+  {
+    updateLinkTransforms();
+    return &global_link_transforms_[link->getLinkIndex() * size_];
+  }
+
+private:
+  /** \brief This function is only called in debug mode */
+  bool checkLinkTransforms() const;
+
+  RobotModelConstPtr robot_model_;
+  std::size_t size_;
+  bool dirty_;
+
+  Eigen::MatrixXd positions_;
+
+  /** \brief Link transforms, stored link-major: all states of the batch for link 0, then link 1, ... */
+  EigenSTL::vector_Affine3d global_link_transforms_;
+
+  /** \brief Scratch space for the joint transforms of a single joint across the batch */
+  EigenSTL::vector_Affine3d joint_transforms_;
+};
+}
+}
+
+#endif
@@ -42,50 +42,67 @@ moveit::core::AttachedBody::AttachedBody(const LinkModel* parent_link_model, con
                                          const EigenSTL::vector_Affine3d& attach_trans,
                                          const std::set<std::string>& touch_links,
                                          const trajectory_msgs::JointTrajectory& detach_posture)
-  : parent_link_model_(parent_link_model)
-  , id_(id)
-  , shapes_(shapes)
-  , attach_trans_(attach_trans)
-  , touch_links_(touch_links)
-  , detach_posture_(detach_posture)
+  : parent_link_model_(parent_link_model), geometry_(new Geometry())
 {
+  geometry_->id_ = id;
+  geometry_->shapes_ = shapes;
+  geometry_->attach_trans_ = attach_trans;
+  geometry_->touch_links_ = touch_links;
+  geometry_->detach_posture_ = detach_posture;
+
   global_collision_body_transforms_.resize(attach_trans.size());
   for (std::size_t i = 0; i < global_collision_body_transforms_.size(); ++i)
     global_collision_body_transforms_[i].setIdentity();
 }
 
+moveit::core::AttachedBody::AttachedBody(const AttachedBody& other)
+  : parent_link_model_(other.parent_link_model_)
+  , geometry_(other.geometry_)
+  , global_collision_body_transforms_(other.global_collision_body_transforms_)
+{
+}
+
 moveit::core::AttachedBody::~AttachedBody() = default;
 
+moveit::core::AttachedBody::Geometry& moveit::core::AttachedBody::getGeometryNonConst()
+{
+  if (!geometry_.unique())
+    geometry_.reset(new Geometry(*geometry_));
+  return *geometry_;
+}
+
 void moveit::core::AttachedBody::setScale(double scale)
 {
-  for (std::size_t i = 0; i < shapes_.size(); ++i)
+  std::vector<shapes::ShapeConstPtr>& body_shapes = getGeometryNonConst().shapes_;
+  for (std::size_t i = 0; i < body_shapes.size(); ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->scale(scale);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->scale(scale);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape* copy = shapes_[i]->clone();
+      shapes::Shape* copy = body_shapes[i]->clone();
       copy->scale(scale);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
 }
 
 void moveit::core::AttachedBody::setPadding(double padding)
 {
-  for (std::size_t i = 0; i < shapes_.size(); ++i)
+  std::vector<shapes::ShapeConstPtr>& body_shapes = getGeometryNonConst().shapes_;
+  for (std::size_t i = 0; i < body_shapes.size(); ++i)
   {
     // if this shape is only owned here (and because this is a non-const function), we can safely const-cast:
-    if (shapes_[i].unique())
-      const_cast<shapes::Shape*>(shapes_[i].get())->padd(padding);
+    if (body_shapes[i].unique())
+      const_cast<shapes::Shape*>(body_shapes[i].get())->padd(padding);
     else
     {
       // if the shape is owned elsewhere, we make a copy:
-      shapes::Shape* copy = shapes_[i]->clone();
+      shapes::Shape* copy = body_shapes[i]->clone();
       copy->padd(padding);
-      shapes_[i].reset(copy);
+      body_shapes[i].reset(copy);
     }
   }
 }
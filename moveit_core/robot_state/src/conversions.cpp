@@ -39,6 +39,8 @@
 #include <geometric_shapes/shape_operations.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/lexical_cast.hpp>
+#include <boost/functional/hash.hpp>
+#include <deque>
 
 namespace moveit
 {
@@ -52,6 +54,33 @@ const std::string LOGNAME = "robot_state";
 
 namespace
 {
+// number of name orderings and meshes remembered by each thread
+static const std::size_t CONVERSION_CACHE_SIZE = 8;
+
+// Return the mapping for the name ordering of a message. Messages of the same publisher share their name ordering, so
+// each thread keeps the mappings it used most recently, and the names of a message are resolved only once.
+static VariableIndexMappingConstPtr _getVariableIndexMapping(const RobotModelConstPtr& model,
+                                                             const std::vector<std::string>& names)
+{
+  typedef std::pair<std::weak_ptr<const RobotModel>, VariableIndexMappingConstPtr> CachedMapping;
+  static thread_local std::deque<CachedMapping> cache;
+
+  for (std::deque<CachedMapping>::iterator it = cache.begin(); it != cache.end(); ++it)
+    if (it->second->matches(names) && it->first.lock() == model)
+    {
+      CachedMapping found = *it;
+      cache.erase(it);
+      cache.push_front(found);
+      return found.second;
+    }
+
+  VariableIndexMappingConstPtr mapping(new VariableIndexMapping(*model, names));
+  cache.push_front(CachedMapping(model, mapping));
+  if (cache.size() > CONVERSION_CACHE_SIZE)
+    cache.pop_back();
+  return mapping;
+}
+
 static bool _jointStateToRobotState(const sensor_msgs::JointState& joint_state, RobotState& state)
 {
   if (joint_state.name.size() != joint_state.position.size())
@@ -60,8 +89,25 @@ static bool _jointStateToRobotState(const sensor_msgs::JointState& joint_state,
                     joint_state.name.size(), joint_state.position.size());
     return false;
   }
-
-  state.setVariableValues(joint_state);
+  if (joint_state.name.empty())
+    return true;
+
+  VariableIndexMappingConstPtr mapping = _getVariableIndexMapping(state.getRobotModel(), joint_state.name);
+  // the name based functions report unknown names
+  if (mapping->getKnownCount() != mapping->size())
+    state.setVariableValues(joint_state);
+  else if (mapping->isIdentity())
+  {
+    state.setVariablePositions(joint_state.position);
+    if (joint_state.velocity.size() == joint_state.name.size())
+      state.setVariableVelocities(joint_state.velocity);
+  }
+  else
+  {
+    state.setVariablePositions(*mapping, joint_state.position);
+    if (joint_state.velocity.size() == joint_state.name.size())
+      state.setVariableVelocities(*mapping, joint_state.velocity);
+  }
 
   return true;
 }
@@ -219,6 +265,73 @@ static void _attachedBodyToMsg(const AttachedBody& attached_body, moveit_msgs::A
   }
 }
 
+static std::size_t _hashMeshMsg(const shape_msgs::Mesh& mesh)
+{
+  std::size_t hash = 0;
+  boost::hash_combine(hash, mesh.vertices.size());
+  boost::hash_combine(hash, mesh.triangles.size());
+  for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+  {
+    boost::hash_combine(hash, mesh.vertices[i].x);
+    boost::hash_combine(hash, mesh.vertices[i].y);
+    boost::hash_combine(hash, mesh.vertices[i].z);
+  }
+  for (std::size_t i = 0; i < mesh.triangles.size(); ++i)
+    boost::hash_range(hash, mesh.triangles[i].vertex_indices.begin(), mesh.triangles[i].vertex_indices.end());
+  return hash;
+}
+
+static bool _sameMeshMsg(const shape_msgs::Mesh& mesh1, const shape_msgs::Mesh& mesh2)
+{
+  if (mesh1.vertices.size() != mesh2.vertices.size() || mesh1.triangles.size() != mesh2.triangles.size())
+    return false;
+  for (std::size_t i = 0; i < mesh1.vertices.size(); ++i)
+    if (mesh1.vertices[i].x != mesh2.vertices[i].x || mesh1.vertices[i].y != mesh2.vertices[i].y ||
+        mesh1.vertices[i].z != mesh2.vertices[i].z)
+      return false;
+  for (std::size_t i = 0; i < mesh1.triangles.size(); ++i)
+    if (mesh1.triangles[i].vertex_indices != mesh2.triangles[i].vertex_indices)
+      return false;
+  return true;
+}
+
+// Construct the shape for a mesh message. Attached objects are usually sent again with the same meshes (e.g. in every
+// planning scene message), so each thread keeps the meshes it constructed most recently, identified by the hash of
+// their message, and shares them instead of constructing them again.
+static shapes::ShapeConstPtr _constructMeshFromMsg(const shape_msgs::Mesh& mesh)
+{
+  struct CachedMesh
+  {
+    std::size_t hash_;
+    shape_msgs::Mesh msg_;
+    shapes::ShapeConstPtr shape_;
+  };
+  static thread_local std::deque<CachedMesh> cache;
+
+  std::size_t hash = _hashMeshMsg(mesh);
+  for (std::deque<CachedMesh>::iterator it = cache.begin(); it != cache.end(); ++it)
+    if (it->hash_ == hash && _sameMeshMsg(it->msg_, mesh))
+    {
+      shapes::ShapeConstPtr shape = it->shape_;
+      if (it != cache.begin())
+      {
+        cache.push_front(*it);
+        cache.erase(it + 1);
+      }
+      return shape;
+    }
+
+  shapes::ShapeConstPtr shape(shapes::constructShapeFromMsg(mesh));
+  if (shape)
+  {
+    CachedMesh entry = { hash, mesh, shape };
+    cache.push_front(entry);
+    if (cache.size() > CONVERSION_CACHE_SIZE)
+      cache.pop_back();
+  }
+  return shape;
+}
+
 static void _msgToAttachedBody(const Transforms* tf, const moveit_msgs::AttachedCollisionObject& aco, RobotState& state)
 {
   if (aco.object.operation == moveit_msgs::CollisionObject::ADD)
@@ -263,12 +376,12 @@ static void _msgToAttachedBody(const Transforms* tf, const moveit_msgs::Attached
         }
         for (std::size_t i = 0; i < aco.object.meshes.size(); ++i)
         {
-          shapes::Shape* s = shapes::constructShapeFromMsg(aco.object.meshes[i]);
+          shapes::ShapeConstPtr s = _constructMeshFromMsg(aco.object.meshes[i]);
           if (s)
           {
             Eigen::Affine3d p;
             tf::poseMsgToEigen(aco.object.mesh_poses[i], p);
-            shapes.push_back(shapes::ShapeConstPtr(s));
+            shapes.push_back(s);
             poses.push_back(p);
           }
         }
@@ -445,17 +558,50 @@ bool jointTrajPointToRobotState(const trajectory_msgs::JointTrajectory& trajecto
     return false;
   }
 
-  state.setVariablePositions(trajectory.joint_names, trajectory.points[point_id].positions);
-  if (!trajectory.points[point_id].velocities.empty())
-    state.setVariableVelocities(trajectory.joint_names, trajectory.points[point_id].velocities);
-  if (!trajectory.points[point_id].accelerations.empty())
-    state.setVariableAccelerations(trajectory.joint_names, trajectory.points[point_id].accelerations);
-  if (!trajectory.points[point_id].effort.empty())
-    state.setVariableEffort(trajectory.joint_names, trajectory.points[point_id].effort);
+  VariableIndexMappingConstPtr mapping = _getVariableIndexMapping(state.getRobotModel(), trajectory.joint_names);
+  // the name based functions report unknown names
+  if (mapping->getKnownCount() != mapping->size())
+  {
+    state.setVariablePositions(trajectory.joint_names, trajectory.points[point_id].positions);
+    if (!trajectory.points[point_id].velocities.empty())
+      state.setVariableVelocities(trajectory.joint_names, trajectory.points[point_id].velocities);
+    if (!trajectory.points[point_id].accelerations.empty())
+      state.setVariableAccelerations(trajectory.joint_names, trajectory.points[point_id].accelerations);
+    if (!trajectory.points[point_id].effort.empty())
+      state.setVariableEffort(trajectory.joint_names, trajectory.points[point_id].effort);
+  }
+  else
+    jointTrajPointToRobotState(*mapping, trajectory.points[point_id], state);
 
   return true;
 }
 
+void jointTrajPointToRobotState(const VariableIndexMapping& mapping, const trajectory_msgs::JointTrajectoryPoint& point,
+                                RobotState& state)
+{
+  // values for all variables in the order of the model are copied as a whole
+  if (mapping.isIdentity())
+  {
+    state.setVariablePositions(point.positions);
+    if (!point.velocities.empty())
+      state.setVariableVelocities(point.velocities);
+    if (!point.accelerations.empty())
+      state.setVariableAccelerations(point.accelerations);
+    if (!point.effort.empty())
+      state.setVariableEffort(point.effort);
+  }
+  else
+  {
+    state.setVariablePositions(mapping, point.positions);
+    if (!point.velocities.empty())
+      state.setVariableVelocities(mapping, point.velocities);
+    if (!point.accelerations.empty())
+      state.setVariableAccelerations(mapping, point.accelerations);
+    if (!point.effort.empty())
+      state.setVariableEffort(mapping, point.effort);
+  }
+}
+
 void robotStateToStream(const RobotState& state, std::ostream& out, bool include_header, const std::string& separator)
 {
   // Output name of variables
@@ -41,7 +41,10 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <moveit/backtrace/backtrace.h>
 #include <moveit/profiler/profiler.h>
+#include <moveit/profiler/metrics.h>
 #include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
 #include <moveit/robot_model/aabb.h>
 
 namespace moveit
@@ -56,6 +59,108 @@ static const std::size_t MIN_STEPS_FOR_JUMP_THRESH = 10;
 
 const std::string LOGNAME = "robot_state";
 
+namespace
+{
+moveit::tools::MetricCounter& FK_UPDATES = moveit::tools::MetricsRegistry::instance().counter(
+    "moveit_fk_updates_total", "Updates of the link transforms of robot states");
+moveit::tools::MetricCounter& IK_QUERIES =
+    moveit::tools::MetricsRegistry::instance().counter("moveit_ik_queries_total", "Calls of RobotState::setFromIK()");
+moveit::tools::MetricCounter& IK_SOLUTIONS = moveit::tools::MetricsRegistry::instance().counter(
+    "moveit_ik_solutions_total", "Calls of RobotState::setFromIK() that found a solution");
+moveit::tools::MetricHistogram& IK_LATENCY = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_ik_latency_seconds", "Time spent in RobotState::setFromIK()");
+
+/** \brief Counts an IK query, and whether it succeeded, and observes its latency when it goes out of scope */
+struct IKMetricsScope
+{
+  IKMetricsScope() : success(false), timer(IK_LATENCY)
+  {
+    IK_QUERIES.increment();
+  }
+
+  ~IKMetricsScope()
+  {
+    if (success)
+      IK_SOLUTIONS.increment();
+  }
+
+  bool success;
+  moveit::tools::ScopedMetricTimer timer;
+};
+
+thread_local bool state_memory_pool_destroyed = false;
+
+/** \brief Per-thread free lists of RobotState memory blocks, indexed by block size.
+
+    Planners create and destroy many states of the same model, so instead of returning the memory
+    of a destroyed state to the heap, the block is kept for the next state constructed by the same
+    thread. This avoids contention on the global allocator when multiple planning threads run
+    in parallel. The number of cached blocks per size is bounded. */
+class StateMemoryPool
+{
+public:
+  ~StateMemoryPool()
+  {
+    state_memory_pool_destroyed = true;
+    for (std::pair<const std::size_t, std::vector<void*>>& blocks : free_blocks_)
+      for (void* block : blocks.second)
+        free(block);
+  }
+
+  void* allocate(std::size_t bytes)
+  {
+    std::vector<void*>& blocks = free_blocks_[bytes];
+    if (blocks.empty())
+      return malloc(bytes);
+    void* block = blocks.back();
+    blocks.pop_back();
+    return block;
+  }
+
+  void deallocate(void* block, std::size_t bytes)
+  {
+    std::vector<void*>& blocks = free_blocks_[bytes];
+    if (blocks.size() < MAX_CACHED_BLOCKS)
+      blocks.push_back(block);
+    else
+      free(block);
+  }
+
+private:
+  static const std::size_t MAX_CACHED_BLOCKS = 64;
+  std::map<std::size_t, std::vector<void*>> free_blocks_;
+};
+
+StateMemoryPool& getStateMemoryPool()
+{
+  static thread_local StateMemoryPool pool;
+  return pool;
+}
+
+// states may still be constructed or destroyed by static destructors after the pool of this thread is gone
+void* allocateStateMemory(std::size_t bytes)
+{
+  return state_memory_pool_destroyed ? malloc(bytes) : getStateMemoryPool().allocate(bytes);
+}
+
+void deallocateStateMemory(void* block, std::size_t bytes)
+{
+  if (state_memory_pool_destroyed)
+    free(block);
+  else
+    getStateMemoryPool().deallocate(block, bytes);
+}
+
+std::size_t getStateMemorySize(const RobotModel& model)
+{
+  const int nr_doubles_for_dirty_joint_transforms =
+      1 + model.getJointModelCount() / (sizeof(double) / sizeof(unsigned char));
+  return sizeof(Eigen::Affine3d) *
+             (model.getJointModelCount() + model.getLinkModelCount() + model.getLinkGeometryCount()) +
+         sizeof(double) * (model.getVariableCount() * 3 + nr_doubles_for_dirty_joint_transforms) + 15;
+}
+}
+
 RobotState::RobotState(const RobotModelConstPtr& robot_model)
   : robot_model_(robot_model)
   , has_velocity_(false)
@@ -63,6 +168,11 @@ RobotState::RobotState(const RobotModelConstPtr& robot_model)
   , has_effort_(false)
   , dirty_link_transforms_(robot_model_->getRootJoint())
   , dirty_collision_body_transforms_(nullptr)
+  , dirty_link_roots_count_(0)
+  , dirty_collision_body_roots_count_(0)
+  , link_transforms_version_(0)
+  , version_(0)
+  , jacobian_cache_(nullptr)
   , rng_(nullptr)
 {
   allocMemory();
@@ -73,19 +183,23 @@ RobotState::RobotState(const RobotModelConstPtr& robot_model)
   memset(dirty_joint_transforms_, 1, sizeof(double) * nr_doubles_for_dirty_joint_transforms);
 }
 
-RobotState::RobotState(const RobotState& other) : rng_(nullptr)
+RobotState::RobotState(const RobotState& other)
+  : link_transforms_version_(0), version_(0), jacobian_cache_(nullptr), rng_(nullptr)
 {
   robot_model_ = other.robot_model_;
   allocMemory();
   copyFrom(other);
+  // a copy holds the same positions and bodies as the original
+  version_ = other.version_;
 }
 
 RobotState::~RobotState()
 {
   clearAttachedBodies();
-  free(memory_);
+  deallocateStateMemory(memory_, getStateMemorySize(*robot_model_));
   if (rng_)
     delete rng_;
+  delete jacobian_cache_;
 }
 
 void RobotState::allocMemory()
@@ -93,11 +207,7 @@ void RobotState::allocMemory()
   // memory for the dirty joint transforms
   const int nr_doubles_for_dirty_joint_transforms =
       1 + robot_model_->getJointModelCount() / (sizeof(double) / sizeof(unsigned char));
-  const size_t bytes =
-      sizeof(Eigen::Affine3d) * (robot_model_->getJointModelCount() + robot_model_->getLinkModelCount() +
-                                 robot_model_->getLinkGeometryCount()) +
-      sizeof(double) * (robot_model_->getVariableCount() * 3 + nr_doubles_for_dirty_joint_transforms) + 15;
-  memory_ = malloc(bytes);
+  memory_ = allocateStateMemory(getStateMemorySize(*robot_model_));
 
   // make the memory for transforms align at 16 bytes
   variable_joint_transforms_ = reinterpret_cast<Eigen::Affine3d*>(((uintptr_t)memory_ + 15) & ~(uintptr_t)0x0F);
@@ -120,12 +230,19 @@ RobotState& RobotState::operator=(const RobotState& other)
 
 void RobotState::copyFrom(const RobotState& other)
 {
+  ++link_transforms_version_;
+  version_ = std::max(version_, other.version_) + 1;
   has_velocity_ = other.has_velocity_;
   has_acceleration_ = other.has_acceleration_;
   has_effort_ = other.has_effort_;
 
   dirty_collision_body_transforms_ = other.dirty_collision_body_transforms_;
   dirty_link_transforms_ = other.dirty_link_transforms_;
+  dirty_link_roots_count_ = other.dirty_link_roots_count_;
+  dirty_collision_body_roots_count_ = other.dirty_collision_body_roots_count_;
+  std::copy(other.dirty_link_roots_, other.dirty_link_roots_ + dirty_link_roots_count_, dirty_link_roots_);
+  std::copy(other.dirty_collision_body_roots_, other.dirty_collision_body_roots_ + dirty_collision_body_roots_count_,
+            dirty_collision_body_roots_);
 
   if (dirty_link_transforms_ == robot_model_->getRootJoint())
   {
@@ -154,12 +271,17 @@ void RobotState::copyFrom(const RobotState& other)
     memcpy(variable_joint_transforms_, other.variable_joint_transforms_, bytes);
   }
 
-  // copy attached bodies
+  // copy attached bodies; the copies share their geometry, and their global transforms correspond to the link
+  // transforms copied above (if those are dirty, they are recomputed together with them)
   clearAttachedBodies();
   for (std::map<std::string, AttachedBody*>::const_iterator it = other.attached_body_map_.begin();
        it != other.attached_body_map_.end(); ++it)
-    attachBody(it->second->getName(), it->second->getShapes(), it->second->getFixedTransforms(),
-               it->second->getTouchLinks(), it->second->getAttachedLinkName(), it->second->getDetachPosture());
+  {
+    AttachedBody* ab = new AttachedBody(*it->second);
+    attached_body_map_[ab->getName()] = ab;
+    if (attached_body_update_callback_)
+      attached_body_update_callback_(ab, true);
+  }
 }
 
 bool RobotState::checkJointTransforms(const JointModel* joint) const
@@ -226,7 +348,7 @@ void RobotState::setToRandomPositions()
   random_numbers::RandomNumberGenerator& rng = getRandomNumberGenerator();
   robot_model_->getVariableRandomPositions(rng, position_);
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllLinkTransformsDirty();
   // mimic values are correctly set in RobotModel
 }
 
@@ -291,7 +413,7 @@ void RobotState::setToDefaultValues()
   // set velocity & acceleration to 0
   memset(velocity_, 0, sizeof(double) * 2 * robot_model_->getVariableCount());
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllLinkTransformsDirty();
 }
 
 void RobotState::setVariablePositions(const double* position)
@@ -303,7 +425,7 @@ void RobotState::setVariablePositions(const double* position)
 
   // Since all joint values have potentially changed, we will need to recompute all transforms
   memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-  dirty_link_transforms_ = robot_model_->getRootJoint();
+  markAllLinkTransformsDirty();
 }
 
 void RobotState::setVariablePositions(const std::map<std::string, double>& variable_map)
@@ -350,6 +472,20 @@ void RobotState::setVariablePositions(const std::vector<std::string>& variable_n
   }
 }
 
+void RobotState::setVariablePositions(const VariableIndexMapping& mapping, const std::vector<double>& variable_position)
+{
+  assert(mapping.size() == variable_position.size());
+  const std::vector<int>& indices = mapping.getVariableIndices();
+  const std::vector<const JointModel*>& joints = mapping.getJointModels();
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    if (indices[i] >= 0)
+    {
+      position_[indices[i]] = variable_position[i];
+      markDirtyJointTransforms(joints[i]);
+      updateMimicJoint(joints[i]);
+    }
+}
+
 void RobotState::setVariableVelocities(const std::map<std::string, double>& variable_map)
 {
   markVelocity();
@@ -374,6 +510,17 @@ void RobotState::setVariableVelocities(const std::vector<std::string>& variable_
     velocity_[robot_model_->getVariableIndex(variable_names[i])] = variable_velocity[i];
 }
 
+void RobotState::setVariableVelocities(const VariableIndexMapping& mapping,
+                                       const std::vector<double>& variable_velocity)
+{
+  markVelocity();
+  assert(mapping.size() == variable_velocity.size());
+  const std::vector<int>& indices = mapping.getVariableIndices();
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    if (indices[i] >= 0)
+      velocity_[indices[i]] = variable_velocity[i];
+}
+
 void RobotState::setVariableAccelerations(const std::map<std::string, double>& variable_map)
 {
   markAcceleration();
@@ -398,6 +545,17 @@ void RobotState::setVariableAccelerations(const std::vector<std::string>& variab
     acceleration_[robot_model_->getVariableIndex(variable_names[i])] = variable_acceleration[i];
 }
 
+void RobotState::setVariableAccelerations(const VariableIndexMapping& mapping,
+                                          const std::vector<double>& variable_acceleration)
+{
+  markAcceleration();
+  assert(mapping.size() == variable_acceleration.size());
+  const std::vector<int>& indices = mapping.getVariableIndices();
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    if (indices[i] >= 0)
+      acceleration_[indices[i]] = variable_acceleration[i];
+}
+
 void RobotState::setVariableEffort(const std::map<std::string, double>& variable_map)
 {
   markEffort();
@@ -422,6 +580,16 @@ void RobotState::setVariableEffort(const std::vector<std::string>& variable_name
     effort_[robot_model_->getVariableIndex(variable_names[i])] = variable_effort[i];
 }
 
+void RobotState::setVariableEffort(const VariableIndexMapping& mapping, const std::vector<double>& variable_effort)
+{
+  markEffort();
+  assert(mapping.size() == variable_effort.size());
+  const std::vector<int>& indices = mapping.getVariableIndices();
+  for (std::size_t i = 0; i < indices.size(); ++i)
+    if (indices[i] >= 0)
+      effort_[indices[i]] = variable_effort[i];
+}
+
 void RobotState::setJointEfforts(const JointModel* joint, const double* effort)
 {
   if (has_acceleration_)
@@ -557,7 +725,7 @@ void RobotState::update(bool force)
   if (force)
   {
     memset(dirty_joint_transforms_, 1, robot_model_->getJointModelCount() * sizeof(unsigned char));
-    dirty_link_transforms_ = robot_model_->getRootJoint();
+    markAllLinkTransformsDirty();
   }
 
   // this actually triggers all needed updates
@@ -571,20 +739,26 @@ void RobotState::updateCollisionBodyTransforms()
 
   if (dirty_collision_body_transforms_ != nullptr)
   {
-    const std::vector<const LinkModel*>& links = dirty_collision_body_transforms_->getDescendantLinkModels();
-    dirty_collision_body_transforms_ = nullptr;
-
-    for (std::size_t i = 0; i < links.size(); ++i)
+    // update each dirty subtree separately, or the complete subtree of the common root if too many were dirty
+    const unsigned char count = dirty_collision_body_roots_count_;
+    const JointModel* const* roots = count ? dirty_collision_body_roots_ : &dirty_collision_body_transforms_;
+    for (unsigned char r = 0; r < std::max<unsigned char>(count, 1); ++r)
     {
-      const EigenSTL::vector_Affine3d& ot = links[i]->getCollisionOriginTransforms();
-      const std::vector<int>& ot_id = links[i]->areCollisionOriginTransformsIdentity();
-      const int index_co = links[i]->getFirstCollisionBodyTransformIndex();
-      const int index_l = links[i]->getLinkIndex();
-      for (std::size_t j = 0; j < ot.size(); ++j)
-        global_collision_body_transforms_[index_co + j].matrix().noalias() =
-            ot_id[j] ? global_link_transforms_[index_l].matrix() :
-                       global_link_transforms_[index_l].matrix() * ot[j].matrix();
+      const std::vector<const LinkModel*>& links = roots[r]->getDescendantLinkModels();
+      for (std::size_t i = 0; i < links.size(); ++i)
+      {
+        const EigenSTL::vector_Affine3d& ot = links[i]->getCollisionOriginTransforms();
+        const std::vector<int>& ot_id = links[i]->areCollisionOriginTransformsIdentity();
+        const int index_co = links[i]->getFirstCollisionBodyTransformIndex();
+        const int index_l = links[i]->getLinkIndex();
+        for (std::size_t j = 0; j < ot.size(); ++j)
+          global_collision_body_transforms_[index_co + j].matrix().noalias() =
+              ot_id[j] ? global_link_transforms_[index_l].matrix() :
+                         global_link_transforms_[index_l].matrix() * ot[j].matrix();
+      }
     }
+    dirty_collision_body_transforms_ = nullptr;
+    dirty_collision_body_roots_count_ = 0;
   }
 }
 
@@ -592,45 +766,109 @@ void RobotState::updateLinkTransforms()
 {
   if (dirty_link_transforms_ != nullptr)
   {
-    updateLinkTransformsInternal(dirty_link_transforms_);
-    if (dirty_collision_body_transforms_)
-      dirty_collision_body_transforms_ =
-          robot_model_->getCommonRoot(dirty_collision_body_transforms_, dirty_link_transforms_);
+    FK_UPDATES.increment();
+    updateLinkTransformsInternal(dirty_link_transforms_, dirty_link_roots_, dirty_link_roots_count_);
+    ++link_transforms_version_;
+
+    // the collision bodies of exactly the updated subtrees become dirty
+    if (dirty_link_roots_count_ == 0)
+      addDirtySubtree(dirty_link_transforms_, dirty_collision_body_transforms_, dirty_collision_body_roots_,
+                      dirty_collision_body_roots_count_);
     else
-      dirty_collision_body_transforms_ = dirty_link_transforms_;
+      for (unsigned char r = 0; r < dirty_link_roots_count_; ++r)
+        addDirtySubtree(dirty_link_roots_[r], dirty_collision_body_transforms_, dirty_collision_body_roots_,
+                        dirty_collision_body_roots_count_);
     dirty_link_transforms_ = nullptr;
+    dirty_link_roots_count_ = 0;
+  }
+}
+
+void RobotState::addDirtySubtree(const JointModel* joint, const JointModel*& common, const JointModel** roots,
+                                 unsigned char& count) const
+{
+  if (common == nullptr)
+  {
+    common = roots[0] = joint;
+    count = 1;
+    return;
+  }
+
+  // a count of zero means the complete subtree of common is dirty already
+  if (count > 0)
+  {
+    unsigned char kept = 0;
+    for (unsigned char i = 0; i < count; ++i)
+    {
+      const JointModel* root = robot_model_->getCommonRoot(roots[i], joint);
+      // joint is already part of a dirty subtree
+      if (root == roots[i])
+        return;
+      // drop subtrees that are contained in the subtree of joint
+      if (root != joint)
+        roots[kept++] = roots[i];
+    }
+    if (kept < MAX_DIRTY_SUBTREES)
+    {
+      roots[kept++] = joint;
+      count = kept;
+    }
+    else
+      count = 0;
   }
+  common = robot_model_->getCommonRoot(common, joint);
+}
+
+void RobotState::updateLinkTransformsInternal(const JointModel* common, const JointModel* const* roots,
+                                              unsigned char count)
+{
+  if (count == 0)
+    updateLinkTransformsInternal(common);
+  else
+    for (unsigned char r = 0; r < count; ++r)
+      updateLinkTransformsInternal(roots[r]);
 }
 
 void RobotState::updateLinkTransformsInternal(const JointModel* start)
 {
+  const std::vector<ForwardKinematicsStep>& program = robot_model_->getForwardKinematicsProgram();
   for (const LinkModel* link : start->getDescendantLinkModels())
   {
-    const LinkModel* parent = link->getParentLinkModel();
-    if (parent)  // root JointModel will not have a parent
+    const ForwardKinematicsStep& step = program[link->getLinkIndex()];
+    Eigen::Affine3d& link_transform = global_link_transforms_[link->getLinkIndex()];
+
+    if (step.fixed)
     {
-      if (link->parentJointIsFixed())
-        global_link_transforms_[link->getLinkIndex()].matrix().noalias() =
-            global_link_transforms_[parent->getLinkIndex()].matrix() * link->getJointOriginTransform().matrix();
+      if (step.origin)
+        link_transform.matrix().noalias() =
+            global_link_transforms_[step.parent_link_index].matrix() * step.origin->matrix();
       else
-      {
-        if (link->jointOriginTransformIsIdentity())
-          global_link_transforms_[link->getLinkIndex()].matrix().noalias() =
-              global_link_transforms_[parent->getLinkIndex()].matrix() *
-              getJointTransform(link->getParentJointModel()).matrix();
-        else
-          global_link_transforms_[link->getLinkIndex()].matrix().noalias() =
-              global_link_transforms_[parent->getLinkIndex()].matrix() * link->getJointOriginTransform().matrix() *
-              getJointTransform(link->getParentJointModel()).matrix();
-      }
+        link_transform = global_link_transforms_[step.parent_link_index];
+      continue;
+    }
+
+    Eigen::Affine3d& joint_transform = variable_joint_transforms_[step.joint_index];
+    unsigned char& dirty = dirty_joint_transforms_[step.joint_index];
+    if (dirty)
+    {
+      step.computeJointTransform(position_, joint_transform);
+      dirty = 0;
+    }
+
+    if (step.parent_link_index >= 0)  // root JointModel will not have a parent
+    {
+      if (step.origin)
+        link_transform.matrix().noalias() = global_link_transforms_[step.parent_link_index].matrix() *
+                                            step.origin->matrix() * joint_transform.matrix();
+      else
+        link_transform.matrix().noalias() =
+            global_link_transforms_[step.parent_link_index].matrix() * joint_transform.matrix();
     }
     else
     {
-      if (link->jointOriginTransformIsIdentity())
-        global_link_transforms_[link->getLinkIndex()] = getJointTransform(link->getParentJointModel());
+      if (step.origin)
+        link_transform.matrix().noalias() = step.origin->matrix() * joint_transform.matrix();
       else
-        global_link_transforms_[link->getLinkIndex()].matrix().noalias() =
-            link->getJointOriginTransform().matrix() * getJointTransform(link->getParentJointModel()).matrix();
+        link_transform = joint_transform;
     }
   }
 
@@ -640,16 +878,45 @@ void RobotState::updateLinkTransformsInternal(const JointModel* start)
     it->second->computeTransform(global_link_transforms_[it->second->getAttachedLink()->getLinkIndex()]);
 }
 
+void RobotState::computeGlobalLinkTransform(const LinkModel* link, Eigen::Affine3d& transform) const
+{
+  if (dirty_link_transforms_ == nullptr)
+    transform = global_link_transforms_[link->getLinkIndex()];
+  else
+    computeChainTransform(link->getLinkIndex(), transform);
+}
+
+void RobotState::computeChainTransform(int link_index, Eigen::Affine3d& transform) const
+{
+  const ForwardKinematicsStep& step = robot_model_->getForwardKinematicsProgram()[link_index];
+  if (step.parent_link_index >= 0)
+    computeChainTransform(step.parent_link_index, transform);
+  else
+    transform.setIdentity();
+  if (step.origin)
+    transform = transform * *step.origin;
+  if (step.fixed)
+    return;
+
+  // joint transforms that are up to date are reused, the others are computed without caching them
+  if (!dirty_joint_transforms_[step.joint_index])
+    transform = transform * variable_joint_transforms_[step.joint_index];
+  else
+  {
+    Eigen::Affine3d joint_transform;
+    step.computeJointTransform(position_, joint_transform);
+    transform = transform * joint_transform;
+  }
+}
+
 void RobotState::updateStateWithLinkAt(const LinkModel* link, const Eigen::Affine3d& transform, bool backward)
 {
   updateLinkTransforms();  // no link transforms must be dirty, otherwise the transform we set will be overwritten
+  ++link_transforms_version_;
 
   // update the fact that collision body transforms are out of date
-  if (dirty_collision_body_transforms_)
-    dirty_collision_body_transforms_ =
-        robot_model_->getCommonRoot(dirty_collision_body_transforms_, link->getParentJointModel());
-  else
-    dirty_collision_body_transforms_ = link->getParentJointModel();
+  addDirtySubtree(link->getParentJointModel(), dirty_collision_body_transforms_, dirty_collision_body_roots_,
+                  dirty_collision_body_roots_count_);
 
   global_link_transforms_[link->getLinkIndex()] = transform;
 
@@ -684,6 +951,7 @@ void RobotState::updateStateWithLinkAt(const LinkModel* link, const Eigen::Affin
     }
     // all collision body transforms are invalid now
     dirty_collision_body_transforms_ = parent_link->getParentJointModel();
+    dirty_collision_body_roots_count_ = 0;
   }
 
   // update attached bodies tf; these are usually very few, so we update them all
@@ -809,7 +1077,7 @@ void RobotState::interpolate(const RobotState& to, double t, RobotState& state)
   robot_model_->interpolate(getVariablePositions(), to.getVariablePositions(), t, state.getVariablePositions());
 
   memset(state.dirty_joint_transforms_, 1, state.robot_model_->getJointModelCount() * sizeof(unsigned char));
-  state.dirty_link_transforms_ = state.robot_model_->getRootJoint();
+  state.markAllLinkTransformsDirty();
 }
 
 void RobotState::interpolate(const RobotState& to, double t, RobotState& state,
@@ -848,6 +1116,7 @@ const AttachedBody* RobotState::getAttachedBody(const std::string& id) const
 
 void RobotState::attachBody(AttachedBody* attached_body)
 {
+  ++version_;
   attached_body_map_[attached_body->getName()] = attached_body;
   attached_body->computeTransform(getGlobalLinkTransform(attached_body->getAttachedLink()));
   if (attached_body_update_callback_)
@@ -860,6 +1129,7 @@ void RobotState::attachBody(const std::string& id, const std::vector<shapes::Sha
 {
   const LinkModel* l = robot_model_->getLinkModel(link);
   AttachedBody* ab = new AttachedBody(l, id, shapes, attach_trans, touch_links, detach_posture);
+  ++version_;
   attached_body_map_[id] = ab;
   ab->computeTransform(getGlobalLinkTransform(l));
   if (attached_body_update_callback_)
@@ -903,6 +1173,8 @@ void RobotState::clearAttachedBodies()
       attached_body_update_callback_(it->second, false);
     delete it->second;
   }
+  if (!attached_body_map_.empty())
+    ++version_;
   attached_body_map_.clear();
 }
 
@@ -921,6 +1193,7 @@ void RobotState::clearAttachedBodies(const LinkModel* link)
     delete it->second;
     std::map<std::string, AttachedBody*>::iterator del = it++;
     attached_body_map_.erase(del);
+    ++version_;
   }
 }
 
@@ -939,6 +1212,7 @@ void RobotState::clearAttachedBodies(const JointModelGroup* group)
     delete it->second;
     std::map<std::string, AttachedBody*>::iterator del = it++;
     attached_body_map_.erase(del);
+    ++version_;
   }
 }
 
@@ -951,6 +1225,7 @@ bool RobotState::clearAttachedBody(const std::string& id)
       attached_body_update_callback_(it->second, false);
     delete it->second;
     attached_body_map_.erase(it);
+    ++version_;
     return true;
   }
   else
@@ -1210,6 +1485,74 @@ bool RobotState::getJacobian(const JointModelGroup* group, const LinkModel* link
   return true;
 }
 
+struct RobotState::JacobianCache
+{
+  struct Entry
+  {
+    const JointModelGroup* group;
+    const LinkModel* link;
+    Eigen::Vector3d reference_point_position;
+    bool use_quaternion_representation;
+    unsigned long version;
+    Eigen::MatrixXd jacobian;
+  };
+
+  /** \brief Number of Jacobians that are kept, e.g. for several tips of the same group */
+  static const std::size_t SIZE = 4;
+
+  JacobianCache() : next(0)
+  {
+  }
+
+  std::vector<Entry> entries;
+  std::size_t next;
+};
+
+bool RobotState::getJacobian(const JointModelGroup* group, const LinkModel* link,
+                             const Eigen::Vector3d& reference_point_position, Eigen::MatrixXd& jacobian,
+                             bool use_quaternion_representation)
+{
+  updateLinkTransforms();
+  if (!jacobian_cache_)
+    jacobian_cache_ = new JacobianCache();
+
+  for (const JacobianCache::Entry& entry : jacobian_cache_->entries)
+    if (entry.version == link_transforms_version_ && entry.group == group && entry.link == link &&
+        entry.use_quaternion_representation == use_quaternion_representation &&
+        entry.reference_point_position == reference_point_position)
+    {
+      jacobian = entry.jacobian;
+      return true;
+    }
+
+  if (!static_cast<const RobotState*>(this)->getJacobian(group, link, reference_point_position, jacobian,
+                                                          use_quaternion_representation))
+    return false;
+
+  // replace the oldest entry
+  if (jacobian_cache_->entries.size() < JacobianCache::SIZE)
+    jacobian_cache_->entries.resize(jacobian_cache_->entries.size() + 1);
+  JacobianCache::Entry& entry = jacobian_cache_->entries[jacobian_cache_->next];
+  jacobian_cache_->next = (jacobian_cache_->next + 1) % JacobianCache::SIZE;
+  entry.group = group;
+  entry.link = link;
+  entry.reference_point_position = reference_point_position;
+  entry.use_quaternion_representation = use_quaternion_representation;
+  entry.version = link_transforms_version_;
+  entry.jacobian = jacobian;
+  return true;
+}
+
+bool RobotState::getJacobians(const JointModelGroup* group, const std::vector<const LinkModel*>& links,
+                              std::vector<Eigen::MatrixXd>& jacobians, bool use_quaternion_representation)
+{
+  jacobians.resize(links.size());
+  for (std::size_t i = 0; i < links.size(); ++i)
+    if (!getJacobian(group, links[i], Eigen::Vector3d::Zero(), jacobians[i], use_quaternion_representation))
+      return false;
+  return true;
+}
+
 bool RobotState::setFromDiffIK(const JointModelGroup* jmg, const Eigen::VectorXd& twist, const std::string& tip,
                                double dt, const GroupStateValidityCallbackFn& constraint)
 {
@@ -1403,6 +1746,8 @@ bool RobotState::setFromIK(const JointModelGroup* jmg, const EigenSTL::vector_Af
                            double timeout, const GroupStateValidityCallbackFn& constraint,
                            const kinematics::KinematicsQueryOptions& options)
 {
+  IKMetricsScope metrics;
+
   // Error check
   if (poses_in.size() != tips_in.size())
   {
@@ -1437,7 +1782,9 @@ bool RobotState::setFromIK(const JointModelGroup* jmg, const EigenSTL::vector_Af
     if (poses_in.size() > 1)
     {
       // Forward to setFromIKSubgroups() to allow different subgroup IK solvers to work together
-      return setFromIKSubgroups(jmg, poses_in, tips_in, consistency_limit_sets, attempts, timeout, constraint, options);
+      metrics.success =
+          setFromIKSubgroups(jmg, poses_in, tips_in, consistency_limit_sets, attempts, timeout, constraint, options);
+      return metrics.success;
     }
     else
     {
@@ -1660,12 +2007,121 @@ bool RobotState::setFromIK(const JointModelGroup* jmg, const EigenSTL::vector_Af
       for (std::size_t i = 0; i < bij.size(); ++i)
         solution[bij[i]] = ik_sol[i];
       setJointGroupPositions(jmg, solution);
+      metrics.success = true;
       return true;
     }
   }
   return false;
 }
 
+std::size_t RobotState::computeIKBatch(const JointModelGroup* jmg, const EigenSTL::vector_Affine3d& poses,
+                                       const std::string& tip_in, std::vector<std::vector<double> >& solutions,
+                                       double timeout, const kinematics::KinematicsQueryOptions& options)
+{
+  return computeIKBatch(jmg, jmg->getSolverInstance(), poses, tip_in, solutions, timeout, options);
+}
+
+std::size_t RobotState::computeIKBatch(const JointModelGroup* jmg, const kinematics::KinematicsBaseConstPtr& solver,
+                                       const EigenSTL::vector_Affine3d& poses, const std::string& tip_in,
+                                       std::vector<std::vector<double> >& solutions, double timeout,
+                                       const kinematics::KinematicsQueryOptions& options)
+{
+  solutions.assign(poses.size(), std::vector<double>());
+
+  if (!solver)
+  {
+    ROS_ERROR_NAMED(LOGNAME, "No kinematics solver instantiated for group '%s'", jmg->getName().c_str());
+    return 0;
+  }
+  if (solver->getTipFrames().size() != 1)
+  {
+    ROS_ERROR_NAMED(LOGNAME, "Batches of IK queries need a solver with a single tip frame for group '%s'",
+                    jmg->getName().c_str());
+    return 0;
+  }
+
+  // all poses are given for the same frame, so the transform to the tip frame of the solver is the same for all
+  std::string pose_frame = (!tip_in.empty() && tip_in[0] == '/') ? tip_in.substr(1) : tip_in;
+  std::string solver_tip_frame = solver->getTipFrames()[0];
+  if (!solver_tip_frame.empty() && solver_tip_frame[0] == '/')
+    solver_tip_frame = solver_tip_frame.substr(1);
+  Eigen::Affine3d tip_offset = Eigen::Affine3d::Identity();
+  if (pose_frame != solver_tip_frame)
+  {
+    if (hasAttachedBody(pose_frame))
+    {
+      const AttachedBody* ab = getAttachedBody(pose_frame);
+      const EigenSTL::vector_Affine3d& ab_trans = ab->getFixedTransforms();
+      if (ab_trans.size() != 1)
+      {
+        ROS_ERROR_NAMED(LOGNAME, "Cannot use an attached body with multiple geometries as a reference frame.");
+        return 0;
+      }
+      pose_frame = ab->getAttachedLinkName();
+      tip_offset = ab_trans[0].inverse(Eigen::Isometry);
+    }
+    if (pose_frame != solver_tip_frame)
+    {
+      const robot_model::LinkModel* lm = getLinkModel(pose_frame);
+      if (!lm)
+      {
+        ROS_ERROR_STREAM_NAMED(LOGNAME, "Pose frame '" << pose_frame << "' does not exist.");
+        return 0;
+      }
+      const robot_model::LinkTransformMap& fixed_links = lm->getAssociatedFixedTransforms();
+      for (robot_model::LinkTransformMap::const_iterator it = fixed_links.begin(); it != fixed_links.end(); ++it)
+        if (Transforms::sameFrame(it->first->getName(), solver_tip_frame))
+        {
+          pose_frame = solver_tip_frame;
+          tip_offset = tip_offset * it->second;
+          break;
+        }
+    }
+    if (pose_frame != solver_tip_frame)
+    {
+      ROS_ERROR_NAMED(LOGNAME, "Cannot compute IK for pose reference frame '%s'", pose_frame.c_str());
+      return 0;
+    }
+  }
+
+  // and so is the transform to the base frame of the solver
+  Eigen::Affine3d base_offset = Eigen::Affine3d::Identity();
+  if (!setToIKSolverFrame(base_offset, solver))
+    return 0;
+
+  std::vector<geometry_msgs::Pose> ik_queries(poses.size());
+  for (std::size_t i = 0; i < poses.size(); ++i)
+    tf::poseEigenToMsg(base_offset * poses[i] * tip_offset, ik_queries[i]);
+
+  // if no timeout has been specified, use the default one
+  if (timeout < std::numeric_limits<double>::epsilon())
+    timeout = jmg->getDefaultIKTimeout();
+
+  // the current robot state joint values are the seed of every query
+  const std::vector<unsigned int>& bij = jmg->getKinematicsSolverJointBijection();
+  std::vector<double> initial_values;
+  copyJointGroupPositions(jmg, initial_values);
+  std::vector<std::vector<double> > seeds(1, std::vector<double>(bij.size()));
+  for (std::size_t i = 0; i < bij.size(); ++i)
+    seeds[0][i] = initial_values[bij[i]];
+
+  std::vector<std::vector<double> > ik_solutions;
+  std::vector<moveit_msgs::MoveItErrorCodes> errors;
+  solver->searchPositionIKBatch(ik_queries, seeds, timeout, ik_solutions, errors, options);
+
+  std::size_t solved = 0;
+  for (std::size_t i = 0; i < ik_solutions.size() && i < poses.size(); ++i)
+  {
+    if (ik_solutions[i].size() != bij.size())
+      continue;
+    solutions[i].resize(bij.size());
+    for (std::size_t j = 0; j < bij.size(); ++j)
+      solutions[i][bij[j]] = ik_solutions[i][j];
+    ++solved;
+  }
+  return solved;
+}
+
 bool RobotState::setFromIKSubgroups(const JointModelGroup* jmg, const EigenSTL::vector_Affine3d& poses_in,
                                     const std::vector<std::string>& tips_in,
                                     const std::vector<std::vector<double> >& consistency_limits, unsigned int attempts,
@@ -2000,6 +2456,195 @@ double RobotState::computeCartesianPath(const JointModelGroup* group, std::vecto
   return percentage_solved;
 }
 
+namespace
+{
+// The fraction of a path with the given distances that a step of at most max_step covers; infinite if max_step does
+// not limit the step
+double getStepFraction(const MaxEEFStep& max_step, double translation_distance, double rotation_distance)
+{
+  double fraction = std::numeric_limits<double>::infinity();
+  if (max_step.translation > 0.0 && translation_distance > 0.0)
+    fraction = std::min(fraction, max_step.translation / translation_distance);
+  if (max_step.rotation > 0.0 && rotation_distance > 0.0)
+    fraction = std::min(fraction, max_step.rotation / rotation_distance);
+  return fraction;
+}
+
+double getConditionNumber(const RobotState& state, const JointModelGroup* group, const LinkModel* link)
+{
+  Eigen::MatrixXd jacobian;
+  if (!state.getJacobian(group, link, Eigen::Vector3d::Zero(), jacobian))
+    return std::numeric_limits<double>::infinity();
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd(jacobian);
+  const Eigen::VectorXd& singular_values = svd.singularValues();
+  if (singular_values.size() == 0 || singular_values.minCoeff() <= std::numeric_limits<double>::epsilon())
+    return std::numeric_limits<double>::infinity();
+  return singular_values.maxCoeff() / singular_values.minCoeff();
+}
+
+// Move link of state along the straight Cartesian path to the global target with adaptive steps. Every state that is
+// reached is appended to traj, and its fraction of the path, mapped through fraction_offset + fraction_scale * f, is
+// appended to fractions. Returns the fraction of the path that was reached.
+double followCartesianPath(RobotState& state, const JointModelGroup* group, std::vector<RobotStatePtr>& traj,
+                           std::vector<double>& fractions, const LinkModel* link, const Eigen::Affine3d& target,
+                           const AdaptiveEEFStep& step, const GroupStateValidityCallbackFn& validCallback,
+                           const kinematics::KinematicsQueryOptions& options, double fraction_offset,
+                           double fraction_scale)
+{
+  const Eigen::Affine3d start_pose = state.getGlobalLinkTransform(link);
+  Eigen::Quaterniond start_quaternion(start_pose.linear());
+  Eigen::Quaterniond target_quaternion(target.linear());
+  double rotation_distance = start_quaternion.angularDistance(target_quaternion);
+  double translation_distance = (target.translation() - start_pose.translation()).norm();
+
+  // without a smallest step, steps are subdivided down to a sixteenth of the largest one
+  const double max_fraction = std::min(1.0, getStepFraction(step.max_step, translation_distance, rotation_distance));
+  double min_fraction = getStepFraction(step.min_step, translation_distance, rotation_distance);
+  min_fraction = std::isinf(min_fraction) ? max_fraction / 16.0 : std::min(min_fraction, max_fraction);
+
+  RobotState candidate(state);
+  double reached = 0.0;
+  double fraction = max_fraction;
+  while (reached < 1.0)
+  {
+    double next = std::min(1.0, reached + fraction);
+    bool smallest_step = next - reached <= min_fraction * (1.0 + 1e-9);
+
+    Eigen::Affine3d pose(start_quaternion.slerp(next, target_quaternion));
+    pose.translation() = next * target.translation() + (1 - next) * start_pose.translation();
+
+    // Explicitly use a single IK attempt only, seeded from the last state: We want a smooth trajectory.
+    candidate = state;
+    bool valid = candidate.setFromIK(group, pose, link->getName(), 1, 0.0, validCallback, options);
+    if (valid && step.max_joint_step > 0.0 && candidate.distance(state, group) > step.max_joint_step)
+      valid = false;
+    if (valid)
+    {
+      candidate.update();
+      // badly conditioned regions are traversed with smaller steps, but are not a reason to stop
+      if (step.max_condition_number > 0.0 && !smallest_step &&
+          getConditionNumber(candidate, group, link) > step.max_condition_number)
+        valid = false;
+    }
+
+    if (valid)
+    {
+      state = candidate;
+      traj.push_back(RobotStatePtr(new RobotState(state)));
+      fractions.push_back(fraction_offset + fraction_scale * next);
+      reached = next;
+      fraction = std::min(max_fraction, 2.0 * fraction);
+    }
+    else if (!smallest_step)
+      fraction = std::max(min_fraction, 0.5 * (next - reached));
+    else
+    {
+      ROS_DEBUG_NAMED(LOGNAME, "Cartesian path stops at %f of the segment", reached);
+      break;
+    }
+  }
+  return reached;
+}
+}
+
+double RobotState::computeCartesianPath(const JointModelGroup* group, std::vector<RobotStatePtr>& traj,
+                                        const LinkModel* link, const Eigen::Affine3d& target,
+                                        bool global_reference_frame, const AdaptiveEEFStep& step,
+                                        const GroupStateValidityCallbackFn& validCallback,
+                                        const SegmentValidityCallbackFn& segment_validity, unsigned int thread_count,
+                                        const kinematics::KinematicsQueryOptions& options)
+{
+  return computeCartesianPath(group, traj, link, EigenSTL::vector_Affine3d(1, target), global_reference_frame, step,
+                              validCallback, segment_validity, thread_count, options);
+}
+
+double RobotState::computeCartesianPath(const JointModelGroup* group, std::vector<RobotStatePtr>& traj,
+                                        const LinkModel* link, const EigenSTL::vector_Affine3d& waypoints,
+                                        bool global_reference_frame, const AdaptiveEEFStep& step,
+                                        const GroupStateValidityCallbackFn& validCallback,
+                                        const SegmentValidityCallbackFn& segment_validity, unsigned int thread_count,
+                                        const kinematics::KinematicsQueryOptions& options)
+{
+  traj.clear();
+  if (step.max_step.translation <= 0.0 && step.max_step.rotation <= 0.0)
+  {
+    ROS_ERROR_NAMED(LOGNAME,
+                    "Invalid AdaptiveEEFStep passed into computeCartesianPath. Both the max_step.rotation and "
+                    "max_step.translation components must be non-negative and at least one component must be "
+                    "greater than zero");
+    return 0.0;
+  }
+  if (waypoints.empty())
+    return 0.0;
+
+  const std::vector<const JointModel*>& cjnt = group->getContinuousJointModels();
+  // make sure that continuous joints wrap
+  for (std::size_t i = 0; i < cjnt.size(); ++i)
+    enforceBounds(cjnt[i]);
+  update();
+
+  traj.push_back(RobotStatePtr(new RobotState(*this)));
+  std::vector<double> fractions(1, 0.0);
+  double percentage_solved = 0.0;
+  for (std::size_t i = 0; i < waypoints.size(); ++i)
+  {
+    // the target can be in the local reference frame of the link at the preceding waypoint
+    const Eigen::Affine3d target = global_reference_frame ? waypoints[i] : getGlobalLinkTransform(link) * waypoints[i];
+    double reached = followCartesianPath(*this, group, traj, fractions, link, target, step, validCallback, options,
+                                         (double)i / (double)waypoints.size(), 1.0 / (double)waypoints.size());
+    percentage_solved = (i + reached) / (double)waypoints.size();
+    if (reached < 1.0)
+      break;
+  }
+
+  if (segment_validity && testSegmentValidity(traj, segment_validity, thread_count) < 1.0)
+  {
+    percentage_solved = fractions[traj.size() - 1];
+    *this = *traj.back();
+  }
+  return percentage_solved;
+}
+
+double RobotState::testSegmentValidity(std::vector<RobotStatePtr>& traj,
+                                       const SegmentValidityCallbackFn& segment_validity, unsigned int thread_count)
+{
+  if (traj.size() <= 1 || !segment_validity)
+    return 1.0;
+  const std::size_t segments = traj.size() - 1;
+
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::min<std::size_t>(thread_count, segments);
+
+  // each worker repeatedly claims the next segment; segments after the first invalid one found so far are skipped
+  std::atomic<std::size_t> next(0), first_invalid(segments);
+  auto work = [&traj, &segment_validity, segments, &next, &first_invalid]() {
+    for (std::size_t i = next++; i < segments && i < first_invalid; i = next++)
+      if (!segment_validity(*traj[i], *traj[i + 1]))
+      {
+        std::size_t current = first_invalid;
+        while (i < current && !first_invalid.compare_exchange_weak(current, i))
+          ;
+      }
+  };
+  if (thread_count < 2)
+    work();
+  else
+  {
+    boost::thread_group workers;
+    for (std::size_t t = 0; t < thread_count; ++t)
+      workers.create_thread(work);
+    workers.join_all();
+  }
+
+  const std::size_t valid = first_invalid;
+  if (valid == segments)
+    return 1.0;
+  ROS_DEBUG_NAMED(LOGNAME, "Segment %zu of %zu of the path is invalid; truncating the path", valid, segments);
+  traj.resize(valid + 1);
+  return (double)valid / (double)segments;
+}
+
 double RobotState::testJointSpaceJump(const JointModelGroup* group, std::vector<RobotStatePtr>& traj,
                                       const JumpThreshold& jump_threshold)
 {
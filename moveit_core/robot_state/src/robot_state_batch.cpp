@@ -0,0 +1,130 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_state/robot_state_batch.h>
+
+namespace moveit
+{
+namespace core
+{
+static const std::string LOGNAME = "robot_state_batch";
+
+RobotStateBatch::RobotStateBatch(const RobotModelConstPtr& robot_model, std::size_t size)
+  : robot_model_(robot_model), size_(0), dirty_(true)
+{
+  resize(size);
+}
+
+void RobotStateBatch::resize(std::size_t size)
+{
+  size_ = size;
+  positions_.conservativeResize(robot_model_->getVariableCount(), size);
+  global_link_transforms_.resize(robot_model_->getLinkModelCount() * size);
+  joint_transforms_.resize(size);
+  dirty_ = true;
+}
+
+void RobotStateBatch::setVariablePositions(std::size_t index, const double* position)
+{
+  assert(index < size_);
+  memcpy(positions_.col(index).data(), position, robot_model_->getVariableCount() * sizeof(double));
+  dirty_ = true;
+}
+
+void RobotStateBatch::copyToState(std::size_t index, RobotState& state) const
+{
+  assert(index < size_);
+  state.setVariablePositions(positions_.col(index).data());
+}
+
+bool RobotStateBatch::checkLinkTransforms() const
+{
+  if (dirty_)
+  {
+    ROS_WARN_NAMED(LOGNAME, "Returning dirty link transforms");
+    return false;
+  }
+  return true;
+}
+
+void RobotStateBatch::updateLinkTransforms()
+{
+  if (!dirty_)
+    return;
+
+  const double* positions = positions_.data();
+  const std::size_t stride = positions_.rows();
+
+  const std::vector<ForwardKinematicsStep>& program = robot_model_->getForwardKinematicsProgram();
+  for (const LinkModel* link : robot_model_->getRootJoint()->getDescendantLinkModels())
+  {
+    const ForwardKinematicsStep& step = program[link->getLinkIndex()];
+    Eigen::Affine3d* out = &global_link_transforms_[link->getLinkIndex() * size_];
+
+    // compute the joint transforms for the whole batch
+    if (!step.fixed)
+      for (std::size_t k = 0; k < size_; ++k)
+        step.computeJointTransform(positions + k * stride, joint_transforms_[k]);
+
+    if (step.parent_link_index >= 0)
+    {
+      const Eigen::Affine3d* in = &global_link_transforms_[step.parent_link_index * size_];
+      if (step.fixed && step.origin)
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k].matrix().noalias() = in[k].matrix() * step.origin->matrix();
+      else if (step.fixed)
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k] = in[k];
+      else if (step.origin)
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k].matrix().noalias() = in[k].matrix() * step.origin->matrix() * joint_transforms_[k].matrix();
+      else
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k].matrix().noalias() = in[k].matrix() * joint_transforms_[k].matrix();
+    }
+    else
+    {
+      // root JointModel will not have a parent link
+      if (step.origin)
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k].matrix().noalias() = step.origin->matrix() * joint_transforms_[k].matrix();
+      else
+        for (std::size_t k = 0; k < size_; ++k)
+          out[k] = joint_transforms_[k];
+    }
+  }
+  dirty_ = false;
+}
+}
+}
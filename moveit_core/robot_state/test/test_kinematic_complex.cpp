@@ -36,6 +36,7 @@
 
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/robot_state/robot_state_batch.h>
 #include <moveit/robot_state/conversions.h>
 #include <urdf_parser/urdf_parser.h>
 #include <fstream>
@@ -265,6 +266,15 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ks2.getAttachedBodies(attached_bodies_2);
   ASSERT_EQ(attached_bodies_2.size(), 1);
 
+  // copies share the geometry until one of them modifies it
+  EXPECT_EQ(&attached_bodies_1[0]->getFixedTransforms(), &attached_bodies_2[0]->getFixedTransforms());
+  EXPECT_EQ(attached_bodies_1[0]->getShapes()[0], attached_bodies_2[0]->getShapes()[0]);
+  moveit::core::AttachedBody padded(*attached_bodies_2[0]);
+  padded.setPadding(0.1);
+  EXPECT_NE(padded.getShapes()[0], attached_bodies_2[0]->getShapes()[0]);
+  EXPECT_NE(&padded.getFixedTransforms(), &attached_bodies_2[0]->getFixedTransforms());
+  EXPECT_EQ(static_cast<const shapes::Box*>(attached_bodies_2[0]->getShapes()[0].get())->size[0], .1);
+
   ks.clearAttachedBody("box");
   attached_bodies_1.clear();
   ks.getAttachedBodies(attached_bodies_1);
@@ -276,6 +286,154 @@ TEST_F(LoadPlanningModelsPr2, FullTest)
   ASSERT_EQ(attached_bodies_2.size(), 0);
 }
 
+TEST_F(LoadPlanningModelsPr2, BatchFK)
+{
+  const std::size_t count = 16;
+  moveit::core::RobotStateBatch batch(robot_model, count);
+  std::vector<moveit::core::RobotStatePtr> states;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    states.push_back(moveit::core::RobotStatePtr(new moveit::core::RobotState(robot_model)));
+    states.back()->setToRandomPositions();
+    batch.setVariablePositions(i, *states.back());
+  }
+  EXPECT_TRUE(batch.dirtyLinkTransforms());
+  batch.updateLinkTransforms();
+  EXPECT_FALSE(batch.dirtyLinkTransforms());
+
+  for (std::size_t i = 0; i < count; ++i)
+    for (const moveit::core::LinkModel* link : robot_model->getLinkModels())
+      EXPECT_TRUE(states[i]->getGlobalLinkTransform(link).isApprox(batch.getGlobalLinkTransform(i, link), 1e-10))
+          << link->getName();
+
+  moveit::core::RobotState copy(robot_model);
+  batch.copyToState(3, copy);
+  EXPECT_TRUE(copy.getGlobalLinkTransform("r_gripper_palm_link")
+                  .isApprox(states[3]->getGlobalLinkTransform("r_gripper_palm_link"), 1e-10));
+}
+
+TEST_F(LoadPlanningModelsPr2, DirtySubtrees)
+{
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  state.update();
+  EXPECT_FALSE(state.dirty());
+
+  // touch one joint on each arm; only the two arm subtrees become dirty
+  state.setVariablePosition("r_shoulder_pan_joint", 0.3);
+  state.setVariablePosition("l_elbow_flex_joint", -0.5);
+  state.setVariablePosition("r_wrist_roll_joint", 1.0);
+  EXPECT_TRUE(state.dirtyLinkTransforms());
+  state.update();
+  EXPECT_FALSE(state.dirty());
+
+  moveit::core::RobotState expected(state);
+  expected.update(true);
+  for (const moveit::core::LinkModel* link : robot_model->getLinkModels())
+    EXPECT_TRUE(expected.getGlobalLinkTransform(link).isApprox(state.getGlobalLinkTransform(link), 1e-10))
+        << link->getName();
+  for (const moveit::core::LinkModel* link : robot_model->getLinkModelsWithCollisionGeometry())
+    for (std::size_t i = 0; i < link->getShapes().size(); ++i)
+      EXPECT_TRUE(expected.getCollisionBodyTransform(link, i).isApprox(state.getCollisionBodyTransform(link, i), 1e-10))
+          << link->getName();
+}
+
+TEST_F(LoadPlanningModelsPr2, ChainTransform)
+{
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  state.setToRandomPositions(robot_model->getJointModelGroup("right_arm"));
+
+  // computed on a dirty state, without updating it
+  Eigen::Affine3d chain;
+  for (const moveit::core::LinkModel* link : robot_model->getLinkModels())
+  {
+    ASSERT_TRUE(state.dirtyLinkTransforms());
+    state.computeGlobalLinkTransform(link, chain);
+    moveit::core::RobotState expected(state);
+    expected.update(true);
+    EXPECT_TRUE(expected.getGlobalLinkTransform(link).isApprox(chain, 1e-10)) << link->getName();
+  }
+
+  state.update();
+  const moveit::core::LinkModel* link = robot_model->getLinkModel("r_wrist_roll_link");
+  state.computeGlobalLinkTransform(link, chain);
+  EXPECT_TRUE(state.getGlobalLinkTransform(link).isApprox(chain, 1e-10));
+}
+
+TEST_F(LoadPlanningModelsPr2, CachedJacobian)
+{
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  const moveit::core::JointModelGroup* group = robot_model->getJointModelGroup("right_arm");
+  const moveit::core::LinkModel* tip = group->getLinkModels().back();
+  const Eigen::Vector3d origin = Eigen::Vector3d::Zero();
+
+  Eigen::MatrixXd first, second, expected;
+  ASSERT_TRUE(state.getJacobian(group, tip, origin, first));
+  ASSERT_TRUE(state.getJacobian(group, tip, origin, second));
+  EXPECT_TRUE(first.isApprox(second));
+
+  // changing the state must invalidate the cached Jacobian
+  state.setVariablePosition("r_elbow_flex_joint", -1.0);
+  ASSERT_TRUE(state.getJacobian(group, tip, origin, second));
+  state.update();
+  ASSERT_TRUE(static_cast<const moveit::core::RobotState&>(state).getJacobian(group, tip, origin, expected));
+  EXPECT_TRUE(expected.isApprox(second));
+  EXPECT_FALSE(first.isApprox(second));
+
+  std::vector<Eigen::MatrixXd> jacobians;
+  ASSERT_TRUE(state.getJacobians(group, { tip }, jacobians));
+  ASSERT_EQ(jacobians.size(), 1u);
+  EXPECT_TRUE(expected.isApprox(jacobians[0]));
+}
+
+TEST_F(LoadPlanningModelsPr2, VariableIndexMapping)
+{
+  const std::vector<std::string> names = { "r_elbow_flex_joint", "not_a_joint", "l_shoulder_pan_joint" };
+  moveit::core::VariableIndexMapping mapping(*robot_model, names);
+  EXPECT_TRUE(mapping.matches(names));
+  EXPECT_EQ(mapping.getKnownCount(), 2u);
+  EXPECT_EQ(mapping.getVariableIndices()[0], robot_model->getVariableIndex("r_elbow_flex_joint"));
+  EXPECT_EQ(mapping.getVariableIndices()[1], -1);
+  EXPECT_EQ(mapping.getJointModels()[1], nullptr);
+  EXPECT_EQ(mapping.getJointModels()[2], robot_model->getJointModel("l_shoulder_pan_joint"));
+
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  state.setVariablePositions(mapping, { -0.5, 3.0, 0.2 });
+  EXPECT_EQ(state.getVariablePosition("r_elbow_flex_joint"), -0.5);
+  EXPECT_EQ(state.getVariablePosition("l_shoulder_pan_joint"), 0.2);
+}
+
+TEST_F(LoadPlanningModelsPr2, JointStateConversion)
+{
+  moveit::core::RobotState state(robot_model);
+  state.setToDefaultValues();
+  EXPECT_FALSE(moveit::core::VariableIndexMapping(*robot_model, { "r_elbow_flex_joint" }).isIdentity());
+
+  // a message with all variables in model order is copied as a whole
+  sensor_msgs::JointState full;
+  robot_state::robotStateToJointStateMsg(state, full);
+  full.position[robot_model->getVariableIndex("r_elbow_flex_joint")] = -0.5;
+  if (full.name == robot_model->getVariableNames())
+    EXPECT_TRUE(moveit::core::VariableIndexMapping(*robot_model, full.name).isIdentity());
+
+  sensor_msgs::JointState partial;
+  partial.name = { "l_shoulder_pan_joint", "r_elbow_flex_joint" };
+  partial.position = { 0.2, -0.3 };
+
+  // convert twice, the second time through the mapping of the first
+  for (int i = 0; i < 2; ++i)
+  {
+    EXPECT_TRUE(robot_state::jointStateToRobotState(full, state));
+    EXPECT_EQ(state.getVariablePosition("r_elbow_flex_joint"), -0.5);
+    EXPECT_TRUE(robot_state::jointStateToRobotState(partial, state));
+    EXPECT_EQ(state.getVariablePosition("l_shoulder_pan_joint"), 0.2);
+    EXPECT_EQ(state.getVariablePosition("r_elbow_flex_joint"), -0.3);
+  }
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -78,32 +78,32 @@ public:
 
   const robot_state::RobotState& getWayPoint(std::size_t index) const
   {
-    return *waypoints_[index];
+    return *getMaterializedWayPoint(index);
   }
 
   const robot_state::RobotState& getLastWayPoint() const
   {
-    return *waypoints_.back();
+    return *getMaterializedWayPoint(waypoints_.size() - 1);
   }
 
   const robot_state::RobotState& getFirstWayPoint() const
   {
-    return *waypoints_.front();
+    return *getMaterializedWayPoint(0);
   }
 
   robot_state::RobotStatePtr& getWayPointPtr(std::size_t index)
   {
-    return waypoints_[index];
+    return getMaterializedWayPoint(index);
   }
 
   robot_state::RobotStatePtr& getLastWayPointPtr()
   {
-    return waypoints_.back();
+    return getMaterializedWayPoint(waypoints_.size() - 1);
   }
 
   robot_state::RobotStatePtr& getFirstWayPointPtr()
   {
-    return waypoints_.front();
+    return getMaterializedWayPoint(0);
   }
 
   const std::deque<double>& getWayPointDurations() const
@@ -132,6 +132,7 @@ public:
     if (duration_from_previous_.size() <= index)
       duration_from_previous_.resize(index + 1, 0.0);
     duration_from_previous_[index] = value;
+    time_from_start_.clear();
   }
 
   bool empty() const
@@ -159,6 +160,11 @@ public:
     state->update();
     waypoints_.push_back(state);
     duration_from_previous_.push_back(dt);
+    if (compact_)
+      compact_flags_.push_back(0);
+    // extend the cached times from start, if they are up to date
+    if (time_from_start_.size() + 1 == duration_from_previous_.size())
+      time_from_start_.push_back(time_from_start_.empty() ? dt : time_from_start_.back() + dt);
   }
 
   void addPrefixWayPoint(const robot_state::RobotState& state, double dt)
@@ -168,9 +174,11 @@ public:
 
   void addPrefixWayPoint(const robot_state::RobotStatePtr& state, double dt)
   {
+    expand();
     state->update();
     waypoints_.push_front(state);
     duration_from_previous_.push_front(dt);
+    time_from_start_.clear();
   }
 
   void insertWayPoint(std::size_t index, const robot_state::RobotState& state, double dt)
@@ -180,9 +188,11 @@ public:
 
   void insertWayPoint(std::size_t index, const robot_state::RobotStatePtr& state, double dt)
   {
+    expand();
     state->update();
     waypoints_.insert(waypoints_.begin() + index, state);
     duration_from_previous_.insert(duration_from_previous_.begin() + index, dt);
+    time_from_start_.clear();
   }
 
   /**
@@ -256,11 +266,59 @@ public:
    */
   bool getStateAtDurationFromStart(const double request_duration, robot_state::RobotStatePtr& output_state) const;
 
+  /** @brief Gets the robot states corresponding to many durations from start in a single pass over the trajectory,
+   * using linear time interpolation. Sorted durations are processed in linear time overall.
+   *  @param The durations from start.
+   *  @param The resulting robot states, one per duration. Missing states are allocated.
+   *  @return True if the states are valid, false otherwise (trajectory is empty).
+   */
+  bool getStatesAtDurationsFromStart(const std::vector<double>& request_durations,
+                                     std::vector<robot_state::RobotStatePtr>& output_states) const;
+
+  /** \brief Switch to compact storage.
+
+      The variable positions, velocities and accelerations of all waypoints are copied into contiguous
+      matrices (one column per waypoint) and the RobotState instances of the waypoints are released.
+      Waypoints are materialized again on demand, e.g. by getWayPoint(). Waypoints that carry efforts or
+      attached bodies different from the first waypoint are kept as RobotState instances.
+      Functions that modify the sequence of waypoints other than addSuffixWayPoint() call expand() first. */
+  void compact();
+
+  /** \brief Materialize all waypoints and release the compact storage */
+  void expand();
+
+  /** \brief Returns true if the trajectory is in compact storage mode (see compact()) */
+  bool isCompact() const
+  {
+    return compact_;
+  }
+
 private:
+  /** \brief Return the cached durations from start of all waypoints, updating them if needed */
+  const std::vector<double>& getTimeFromStart() const;
+
+  /** \brief Return the waypoint at \e index, constructing it from the compact storage if needed. */
+  robot_state::RobotStatePtr& getMaterializedWayPoint(std::size_t index) const;
+
   robot_model::RobotModelConstPtr robot_model_;
   const robot_model::JointModelGroup* group_;
-  std::deque<robot_state::RobotStatePtr> waypoints_;
+
+  /** \brief The waypoints; in compact mode, entries are NULL until materialized. A non-NULL entry always takes
+      precedence over the corresponding column of the compact storage. */
+  mutable std::deque<robot_state::RobotStatePtr> waypoints_;
   std::deque<double> duration_from_previous_;
+
+  /** \brief Prefix sums of duration_from_previous_; out of date if the sizes differ */
+  mutable std::vector<double> time_from_start_;
+
+  /** \brief Compact storage: full variable vectors of the waypoints, one column per waypoint */
+  bool compact_;
+  robot_state::RobotStatePtr compact_reference_;
+  Eigen::MatrixXd compact_positions_;
+  Eigen::MatrixXd compact_velocities_;
+  Eigen::MatrixXd compact_accelerations_;
+  /** \brief Per waypoint: COMPACT_STORED, COMPACT_VELOCITIES, COMPACT_ACCELERATIONS bits */
+  std::deque<unsigned char> compact_flags_;
 };
 }
 
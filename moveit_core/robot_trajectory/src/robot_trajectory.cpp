@@ -42,15 +42,104 @@
 
 namespace robot_trajectory
 {
+namespace
+{
+// bits of compact_flags_
+const unsigned char COMPACT_STORED = 1;
+const unsigned char COMPACT_VELOCITIES = 2;
+const unsigned char COMPACT_ACCELERATIONS = 4;
+
+bool sameAttachedBodies(const robot_state::RobotState& a, const robot_state::RobotState& b)
+{
+  std::vector<const robot_state::AttachedBody*> bodies_a, bodies_b;
+  a.getAttachedBodies(bodies_a);
+  b.getAttachedBodies(bodies_b);
+  if (bodies_a.size() != bodies_b.size())
+    return false;
+  for (std::size_t i = 0; i < bodies_a.size(); ++i)
+    if (bodies_a[i]->getName() != bodies_b[i]->getName())
+      return false;
+  return true;
+}
+}
+
 RobotTrajectory::RobotTrajectory(const robot_model::RobotModelConstPtr& robot_model, const std::string& group)
-  : robot_model_(robot_model), group_(group.empty() ? nullptr : robot_model->getJointModelGroup(group))
+  : robot_model_(robot_model)
+  , group_(group.empty() ? nullptr : robot_model->getJointModelGroup(group))
+  , compact_(false)
 {
 }
 
 RobotTrajectory::RobotTrajectory(const robot_model::RobotModelConstPtr& robot_model,
                                  const robot_model::JointModelGroup* group)
-  : robot_model_(robot_model), group_(group)
+  : robot_model_(robot_model), group_(group), compact_(false)
+{
+}
+
+void RobotTrajectory::compact()
+{
+  if (compact_ || waypoints_.empty())
+    return;
+
+  const std::size_t variable_count = robot_model_->getVariableCount();
+  compact_reference_.reset(new robot_state::RobotState(*waypoints_.front()));
+  compact_positions_.resize(variable_count, waypoints_.size());
+  compact_velocities_.resize(variable_count, waypoints_.size());
+  compact_accelerations_.resize(variable_count, waypoints_.size());
+  compact_flags_.assign(waypoints_.size(), 0);
+
+  for (std::size_t i = 0; i < waypoints_.size(); ++i)
+  {
+    const robot_state::RobotState& wp = *waypoints_[i];
+    if (wp.hasEffort() || !sameAttachedBodies(wp, *compact_reference_))
+      continue;
+    unsigned char& flags = compact_flags_[i];
+    flags = COMPACT_STORED;
+    memcpy(compact_positions_.col(i).data(), wp.getVariablePositions(), variable_count * sizeof(double));
+    if (wp.hasVelocities())
+    {
+      memcpy(compact_velocities_.col(i).data(), wp.getVariableVelocities(), variable_count * sizeof(double));
+      flags |= COMPACT_VELOCITIES;
+    }
+    if (wp.hasAccelerations())
+    {
+      memcpy(compact_accelerations_.col(i).data(), wp.getVariableAccelerations(), variable_count * sizeof(double));
+      flags |= COMPACT_ACCELERATIONS;
+    }
+    waypoints_[i].reset();
+  }
+  compact_ = true;
+}
+
+void RobotTrajectory::expand()
 {
+  if (!compact_)
+    return;
+  for (std::size_t i = 0; i < waypoints_.size(); ++i)
+    getMaterializedWayPoint(i);
+  compact_ = false;
+  compact_reference_.reset();
+  compact_positions_.resize(0, 0);
+  compact_velocities_.resize(0, 0);
+  compact_accelerations_.resize(0, 0);
+  compact_flags_.clear();
+}
+
+robot_state::RobotStatePtr& RobotTrajectory::getMaterializedWayPoint(std::size_t index) const
+{
+  robot_state::RobotStatePtr& wp = waypoints_[index];
+  if (!wp)
+  {
+    const unsigned char flags = compact_flags_[index];
+    wp.reset(new robot_state::RobotState(*compact_reference_));
+    wp->setVariablePositions(compact_positions_.col(index).data());
+    if (flags & COMPACT_VELOCITIES)
+      wp->setVariableVelocities(compact_velocities_.col(index).data());
+    if (flags & COMPACT_ACCELERATIONS)
+      wp->setVariableAccelerations(compact_accelerations_.col(index).data());
+    wp->update();
+  }
+  return wp;
 }
 
 void RobotTrajectory::setGroupName(const std::string& group_name)
@@ -81,6 +170,13 @@ void RobotTrajectory::swap(RobotTrajectory& other)
   std::swap(group_, other.group_);
   waypoints_.swap(other.waypoints_);
   duration_from_previous_.swap(other.duration_from_previous_);
+  time_from_start_.swap(other.time_from_start_);
+  std::swap(compact_, other.compact_);
+  compact_reference_.swap(other.compact_reference_);
+  compact_positions_.swap(other.compact_positions_);
+  compact_velocities_.swap(other.compact_velocities_);
+  compact_accelerations_.swap(other.compact_accelerations_);
+  compact_flags_.swap(other.compact_flags_);
 }
 
 void RobotTrajectory::append(const RobotTrajectory& source, double dt, size_t start_index, size_t end_index)
@@ -88,6 +184,11 @@ void RobotTrajectory::append(const RobotTrajectory& source, double dt, size_t st
   end_index = std::min(end_index, source.waypoints_.size());
   if (start_index >= end_index)
     return;
+  if (source.compact_)
+    for (std::size_t i = start_index; i < end_index; ++i)
+      source.getMaterializedWayPoint(i);
+  if (compact_)
+    compact_flags_.insert(compact_flags_.end(), end_index - start_index, 0);
   waypoints_.insert(waypoints_.end(), std::next(source.waypoints_.begin(), start_index),
                     std::next(source.waypoints_.begin(), end_index));
   std::size_t index = duration_from_previous_.size();
@@ -96,23 +197,36 @@ void RobotTrajectory::append(const RobotTrajectory& source, double dt, size_t st
                                  std::next(source.duration_from_previous_.begin(), end_index));
   if (duration_from_previous_.size() > index)
     duration_from_previous_[index] += dt;
+  time_from_start_.clear();
 }
 
 void RobotTrajectory::reverse()
 {
+  // the columns of the compact storage only cover the waypoints that existed when compact() was called
+  if (compact_ && static_cast<std::size_t>(compact_positions_.cols()) != waypoints_.size())
+    expand();
   std::reverse(waypoints_.begin(), waypoints_.end());
+  if (compact_)
+  {
+    std::reverse(compact_flags_.begin(), compact_flags_.end());
+    compact_positions_ = compact_positions_.rowwise().reverse().eval();
+    compact_velocities_ = compact_velocities_.rowwise().reverse().eval();
+    compact_accelerations_ = compact_accelerations_.rowwise().reverse().eval();
+  }
   if (!duration_from_previous_.empty())
   {
     duration_from_previous_.push_back(duration_from_previous_.front());
     std::reverse(duration_from_previous_.begin(), duration_from_previous_.end());
     duration_from_previous_.pop_back();
   }
+  time_from_start_.clear();
 }
 
 void RobotTrajectory::unwind()
 {
   if (waypoints_.empty())
     return;
+  expand();
 
   const std::vector<const robot_model::JointModel*>& cont_joints =
       group_ ? group_->getContinuousJointModels() : robot_model_->getContinuousJointModels();
@@ -148,6 +262,7 @@ void RobotTrajectory::unwind(const robot_state::RobotState& state)
 {
   if (waypoints_.empty())
     return;
+  expand();
 
   const std::vector<const robot_model::JointModel*>& cont_joints =
       group_ ? group_->getContinuousJointModels() : robot_model_->getContinuousJointModels();
@@ -194,6 +309,8 @@ void RobotTrajectory::clear()
 {
   waypoints_.clear();
   duration_from_previous_.clear();
+  time_from_start_.clear();
+  expand();
 }
 
 void RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory& trajectory) const
@@ -246,20 +363,41 @@ void RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory& trajec
       trajectory.joint_trajectory.points[i].positions.resize(onedof.size());
       trajectory.joint_trajectory.points[i].velocities.reserve(onedof.size());
 
-      for (std::size_t j = 0; j < onedof.size(); ++j)
+      // read compacted waypoints directly from the compact storage instead of materializing them
+      const double* positions;
+      const double* velocities = nullptr;
+      const double* accelerations = nullptr;
+      const double* effort = nullptr;
+      if (waypoints_[i])
       {
-        trajectory.joint_trajectory.points[i].positions[j] =
-            waypoints_[i]->getVariablePosition(onedof[j]->getFirstVariableIndex());
-        // if we have velocities/accelerations/effort, copy those too
+        positions = waypoints_[i]->getVariablePositions();
         if (waypoints_[i]->hasVelocities())
-          trajectory.joint_trajectory.points[i].velocities.push_back(
-              waypoints_[i]->getVariableVelocity(onedof[j]->getFirstVariableIndex()));
+          velocities = waypoints_[i]->getVariableVelocities();
         if (waypoints_[i]->hasAccelerations())
-          trajectory.joint_trajectory.points[i].accelerations.push_back(
-              waypoints_[i]->getVariableAcceleration(onedof[j]->getFirstVariableIndex()));
+          accelerations = waypoints_[i]->getVariableAccelerations();
         if (waypoints_[i]->hasEffort())
-          trajectory.joint_trajectory.points[i].effort.push_back(
-              waypoints_[i]->getVariableEffort(onedof[j]->getFirstVariableIndex()));
+          effort = waypoints_[i]->getVariableEffort();
+      }
+      else
+      {
+        positions = compact_positions_.col(i).data();
+        if (compact_flags_[i] & COMPACT_VELOCITIES)
+          velocities = compact_velocities_.col(i).data();
+        if (compact_flags_[i] & COMPACT_ACCELERATIONS)
+          accelerations = compact_accelerations_.col(i).data();
+      }
+
+      for (std::size_t j = 0; j < onedof.size(); ++j)
+      {
+        const int index = onedof[j]->getFirstVariableIndex();
+        trajectory.joint_trajectory.points[i].positions[j] = positions[index];
+        // if we have velocities/accelerations/effort, copy those too
+        if (velocities)
+          trajectory.joint_trajectory.points[i].velocities.push_back(velocities[index]);
+        if (accelerations)
+          trajectory.joint_trajectory.points[i].accelerations.push_back(accelerations[index]);
+        if (effort)
+          trajectory.joint_trajectory.points[i].effort.push_back(effort[index]);
       }
       // clear velocities if we have an incomplete specification
       if (trajectory.joint_trajectory.points[i].velocities.size() != onedof.size())
@@ -278,6 +416,7 @@ void RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory& trajec
     }
     if (!mdof.empty())
     {
+      getMaterializedWayPoint(i);
       trajectory.multi_dof_joint_trajectory.points[i].transforms.resize(mdof.size());
       for (std::size_t j = 0; j < mdof.size(); ++j)
       {
@@ -321,6 +460,29 @@ void RobotTrajectory::getRobotTrajectoryMsg(moveit_msgs::RobotTrajectory& trajec
   }
 }
 
+namespace
+{
+// Set the values of \e point in \e state. The joint names of a trajectory are resolved once into \e mapping. If
+// some of them are unknown, the name based functions are used, which report them.
+void setJointTrajectoryPoint(const std::vector<std::string>& joint_names,
+                             const robot_state::VariableIndexMapping& mapping,
+                             const trajectory_msgs::JointTrajectoryPoint& point, robot_state::RobotState& state)
+{
+  if (mapping.getKnownCount() == mapping.size())
+  {
+    robot_state::jointTrajPointToRobotState(mapping, point, state);
+    return;
+  }
+  state.setVariablePositions(joint_names, point.positions);
+  if (!point.velocities.empty())
+    state.setVariableVelocities(joint_names, point.velocities);
+  if (!point.accelerations.empty())
+    state.setVariableAccelerations(joint_names, point.accelerations);
+  if (!point.effort.empty())
+    state.setVariableEffort(joint_names, point.effort);
+}
+}
+
 void RobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState& reference_state,
                                             const trajectory_msgs::JointTrajectory& trajectory)
 {
@@ -330,18 +492,13 @@ void RobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState& refer
   std::size_t state_count = trajectory.points.size();
   ros::Time last_time_stamp = trajectory.header.stamp;
   ros::Time this_time_stamp = last_time_stamp;
+  robot_state::VariableIndexMapping mapping(*copy.getRobotModel(), trajectory.joint_names);
 
   for (std::size_t i = 0; i < state_count; ++i)
   {
     this_time_stamp = trajectory.header.stamp + trajectory.points[i].time_from_start;
     robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
-    st->setVariablePositions(trajectory.joint_names, trajectory.points[i].positions);
-    if (!trajectory.points[i].velocities.empty())
-      st->setVariableVelocities(trajectory.joint_names, trajectory.points[i].velocities);
-    if (!trajectory.points[i].accelerations.empty())
-      st->setVariableAccelerations(trajectory.joint_names, trajectory.points[i].accelerations);
-    if (!trajectory.points[i].effort.empty())
-      st->setVariableEffort(trajectory.joint_names, trajectory.points[i].effort);
+    setJointTrajectoryPoint(trajectory.joint_names, mapping, trajectory.points[i], *st);
     addSuffixWayPoint(st, (this_time_stamp - last_time_stamp).toSec());
     last_time_stamp = this_time_stamp;
   }
@@ -361,31 +518,30 @@ void RobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState& refer
                                   trajectory.joint_trajectory.header.stamp;
   ros::Time this_time_stamp = last_time_stamp;
 
+  // resolve the joint names once for all points
+  robot_state::VariableIndexMapping mapping(*copy.getRobotModel(), trajectory.joint_trajectory.joint_names);
+  const std::vector<std::string>& mdof_joint_names = trajectory.multi_dof_joint_trajectory.joint_names;
+  std::vector<const robot_model::JointModel*> mdof_joints(mdof_joint_names.size());
+  for (std::size_t j = 0; j < mdof_joint_names.size(); ++j)
+    mdof_joints[j] = copy.getRobotModel()->getJointModel(mdof_joint_names[j]);
+
   for (std::size_t i = 0; i < state_count; ++i)
   {
     robot_state::RobotStatePtr st(new robot_state::RobotState(copy));
     if (trajectory.joint_trajectory.points.size() > i)
     {
-      st->setVariablePositions(trajectory.joint_trajectory.joint_names,
-                               trajectory.joint_trajectory.points[i].positions);
-      if (!trajectory.joint_trajectory.points[i].velocities.empty())
-        st->setVariableVelocities(trajectory.joint_trajectory.joint_names,
-                                  trajectory.joint_trajectory.points[i].velocities);
-      if (!trajectory.joint_trajectory.points[i].accelerations.empty())
-        st->setVariableAccelerations(trajectory.joint_trajectory.joint_names,
-                                     trajectory.joint_trajectory.points[i].accelerations);
-      if (!trajectory.joint_trajectory.points[i].effort.empty())
-        st->setVariableEffort(trajectory.joint_trajectory.joint_names, trajectory.joint_trajectory.points[i].effort);
+      setJointTrajectoryPoint(trajectory.joint_trajectory.joint_names, mapping, trajectory.joint_trajectory.points[i],
+                              *st);
       this_time_stamp =
           trajectory.joint_trajectory.header.stamp + trajectory.joint_trajectory.points[i].time_from_start;
     }
     if (trajectory.multi_dof_joint_trajectory.points.size() > i)
     {
-      for (std::size_t j = 0; j < trajectory.multi_dof_joint_trajectory.joint_names.size(); ++j)
+      for (std::size_t j = 0; j < mdof_joints.size(); ++j)
       {
         Eigen::Affine3d t;
         tf::transformMsgToEigen(trajectory.multi_dof_joint_trajectory.points[i].transforms[j], t);
-        st->setJointPositions(trajectory.multi_dof_joint_trajectory.joint_names[j], t);
+        st->setJointPositions(mdof_joints[j], t);
       }
       this_time_stamp = trajectory.multi_dof_joint_trajectory.header.stamp +
                         trajectory.multi_dof_joint_trajectory.points[i].time_from_start;
@@ -405,6 +561,16 @@ void RobotTrajectory::setRobotTrajectoryMsg(const robot_state::RobotState& refer
   setRobotTrajectoryMsg(st, trajectory);
 }
 
+const std::vector<double>& RobotTrajectory::getTimeFromStart() const
+{
+  if (time_from_start_.size() != duration_from_previous_.size())
+  {
+    time_from_start_.resize(duration_from_previous_.size());
+    std::partial_sum(duration_from_previous_.begin(), duration_from_previous_.end(), time_from_start_.begin());
+  }
+  return time_from_start_;
+}
+
 void RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& duration, int& before, int& after,
                                                                double& blend) const
 {
@@ -416,24 +582,20 @@ void RobotTrajectory::findWayPointIndicesForDurationAfterStart(const double& dur
     return;
   }
 
-  // Find indicies
-  std::size_t index = 0, num_points = waypoints_.size();
-  double running_duration = 0.0;
-  for (; index < num_points; ++index)
-  {
-    running_duration += duration_from_previous_[index];
-    if (running_duration >= duration)
-      break;
-  }
+  // Find the first waypoint that is reached at or after duration
+  const std::vector<double>& time_from_start = getTimeFromStart();
+  const std::size_t num_points = std::min(waypoints_.size(), time_from_start.size());
+  const std::size_t index =
+      std::lower_bound(time_from_start.begin(), time_from_start.begin() + num_points, duration) -
+      time_from_start.begin();
   before = std::max<int>(index - 1, 0);
   after = std::min<int>(index, num_points - 1);
 
   // Compute duration blend
-  double before_time = running_duration - duration_from_previous_[index];
   if (after == before)
     blend = 1.0;
   else
-    blend = (duration - before_time) / duration_from_previous_[index];
+    blend = (duration - time_from_start[before]) / duration_from_previous_[index];
 }
 
 double RobotTrajectory::getWayPointDurationFromStart(std::size_t index) const
@@ -442,11 +604,7 @@ double RobotTrajectory::getWayPointDurationFromStart(std::size_t index) const
     return 0.0;
   if (index >= duration_from_previous_.size())
     index = duration_from_previous_.size() - 1;
-
-  double time = 0.0;
-  for (std::size_t i = 0; i <= index; ++i)
-    time += duration_from_previous_[i];
-  return time;
+  return getTimeFromStart()[index];
 }
 
 double RobotTrajectory::getWaypointDurationFromStart(std::size_t index) const
@@ -466,7 +624,48 @@ bool RobotTrajectory::getStateAtDurationFromStart(const double request_duration,
   findWayPointIndicesForDurationAfterStart(request_duration, before, after, blend);
   // ROS_DEBUG_NAMED("robot_trajectory", "Interpolating %.3f of the way between index %d and %d.", blend, before,
   // after);
-  waypoints_[before]->interpolate(*waypoints_[after], blend, *output_state);
+  getWayPoint(before).interpolate(getWayPoint(after), blend, *output_state);
+  return true;
+}
+
+bool RobotTrajectory::getStatesAtDurationsFromStart(const std::vector<double>& request_durations,
+                                                    std::vector<robot_state::RobotStatePtr>& output_states) const
+{
+  // If there are no waypoints we can't do anything
+  if (getWayPointCount() == 0)
+    return false;
+
+  const std::vector<double>& time_from_start = getTimeFromStart();
+  const std::size_t num_points = std::min(waypoints_.size(), time_from_start.size());
+  output_states.resize(request_durations.size());
+
+  std::size_t index = 0;
+  double last_duration = -std::numeric_limits<double>::infinity();
+  for (std::size_t i = 0; i < request_durations.size(); ++i)
+  {
+    const double duration = request_durations[i];
+    if (!output_states[i])
+      output_states[i].reset(new robot_state::RobotState(getWayPoint(0)));
+
+    // for increasing durations, continue the search from the previous index; otherwise restart with bisection
+    if (duration >= last_duration)
+      while (index < num_points && time_from_start[index] < duration)
+        ++index;
+    else
+      index = std::lower_bound(time_from_start.begin(), time_from_start.begin() + num_points, duration) -
+              time_from_start.begin();
+    last_duration = duration;
+
+    int before = 0, after = 0;
+    double blend = 0.0;
+    if (duration >= 0.0)
+    {
+      before = std::max<int>(index - 1, 0);
+      after = std::min<int>(index, num_points - 1);
+      blend = after == before ? 1.0 : (duration - time_from_start[before]) / duration_from_previous_[index];
+    }
+    getWayPoint(before).interpolate(getWayPoint(after), blend, *output_states[i]);
+  }
   return true;
 }
 
@@ -0,0 +1,127 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_PARAMETERIZATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_TIME_OPTIMAL_PARAMETERIZATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <deque>
+
+namespace trajectory_processing
+{
+/// \brief This class sets the timestamps of a trajectory to the fastest ones that respect the velocity and
+/// acceleration limits of the model, in time linear in the number of waypoints.
+///
+/// The waypoints are interpolated by a cubic spline in joint space, parameterized by arc length, and the
+/// trajectory is treated as a path-velocity decomposition along that spline: the velocity along the path is
+/// computed by reachability analysis (TOPP-RA) on a grid of points along the path. A backward pass computes,
+/// for every grid point, the interval of squared path velocities from which the end of the path can still be
+/// reached at rest, and a forward pass then picks the largest feasible path acceleration at each grid point.
+/// Each step only solves a two variable linear program, so no iteration over the whole trajectory is needed.
+///
+/// Limits are enforced exactly at the grid points; the grid spacing is at most \e path_resolution (in units of
+/// joint space distance) and the path is split into at least \e min_grid_steps steps.
+/// The trajectory starts and ends at rest. The waypoint positions are not changed; each waypoint gets its time,
+/// as well as the velocities and accelerations of each joint.
+class TimeOptimalParameterization
+{
+public:
+  TimeOptimalParameterization(double path_resolution = 0.01, unsigned int min_grid_steps = 100);
+  ~TimeOptimalParameterization();
+
+  bool computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory, const double max_velocity_scaling_factor = 1.0,
+                         const double max_acceleration_scaling_factor = 1.0) const;
+
+private:
+  double path_resolution_;      /// @brief maximum distance between grid points along the path
+  unsigned int min_grid_steps_; /// @brief minimum number of grid steps the path is split into
+};
+
+/// \brief This class time-parameterizes a path the same way as TimeOptimalParameterization, while the path is
+/// still being generated.
+///
+/// Waypoints are added as they become available. computeSegment() times the buffered waypoints except for the last
+/// \e look_ahead ones and hands them out as a segment that can be executed right away, e.g. by pushing it to the
+/// trajectory execution manager. Each segment starts at the last waypoint of the previous one, so consecutive
+/// segments join up. A segment is timed so that the robot could still stop by the last buffered waypoint, and the
+/// next segment continues along the path with the velocity the previous one ended with, so the velocity and
+/// acceleration limits also hold across segment boundaries. The longer the look-ahead, the closer the timing is to
+/// the one of the whole path. finish() times the remaining waypoints, ending at rest.
+class StreamingTimeParameterization
+{
+public:
+  StreamingTimeParameterization(const robot_model::JointModelGroup* group, std::size_t look_ahead = 100,
+                                const double max_velocity_scaling_factor = 1.0,
+                                const double max_acceleration_scaling_factor = 1.0, double path_resolution = 0.01,
+                                unsigned int min_grid_steps = 100);
+  ~StreamingTimeParameterization();
+
+  /// Append a waypoint to the path; continuous joints are unwound with respect to the previous waypoint
+  void addWayPoint(const robot_state::RobotState& state);
+
+  /// Append all waypoints of \e trajectory to the path
+  void addWayPoints(const robot_trajectory::RobotTrajectory& trajectory);
+
+  /// Get the number of waypoints that were added but not handed out in a segment yet
+  std::size_t getBufferedWayPointCount() const;
+
+  /// Fill \e segment with the waypoints that can be timed already. The segment is left empty if the look-ahead is
+  /// not filled yet.
+  bool computeSegment(robot_trajectory::RobotTrajectory& segment);
+
+  /// Fill \e segment with all remaining waypoints, stopping at the last one, and start a new path
+  bool finish(robot_trajectory::RobotTrajectory& segment);
+
+  /// Forget the buffered waypoints and start a new path
+  void clear();
+
+private:
+  bool emitSegment(std::size_t count, robot_trajectory::RobotTrajectory& segment);
+
+  const robot_model::JointModelGroup* group_;
+  std::size_t look_ahead_;
+  double max_velocity_scaling_factor_;
+  double max_acceleration_scaling_factor_;
+  double path_resolution_;
+  unsigned int min_grid_steps_;
+
+  /// @brief The waypoints not handed out yet, preceded by the last waypoint of the previous segment, if any
+  std::deque<robot_state::RobotStatePtr> waypoints_;
+  bool started_;                      /// @brief whether a segment was handed out for the current path
+  std::vector<double> start_tangent_; /// @brief path tangent at the end of the previous segment
+  double start_path_velocity_;        /// @brief squared path velocity at the end of the previous segment
+};
+}
+
+#endif
@@ -38,11 +38,17 @@
 #define MOVEIT_TRAJECTORY_PROCESSING_TRAJECTORY_TOOLS_
 
 #include <moveit_msgs/RobotTrajectory.h>
+#include <vector>
 
 namespace trajectory_processing
 {
 bool isTrajectoryEmpty(const moveit_msgs::RobotTrajectory& trajectory);
 std::size_t trajectoryWaypointCount(const moveit_msgs::RobotTrajectory& trajectory);
+
+/** \brief Get the indices 0 .. \e count - 1 in coarse-to-fine order: the last and the first index, followed by the
+    midpoints of the intervals between already listed indices, breadth first. Checking waypoints in this order finds
+    invalid segments of a path much sooner than a sequential scan. */
+std::vector<std::size_t> coarseToFineOrder(std::size_t count);
 }
 
 #endif
@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_PROCESSING_WAYPOINT_DECIMATION_
+#define MOVEIT_TRAJECTORY_PROCESSING_WAYPOINT_DECIMATION_
+
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <boost/function.hpp>
+#include <vector>
+
+namespace trajectory_processing
+{
+/// \brief This class removes the waypoints of a path that are not needed to follow it within a tolerance.
+///
+/// The path is simplified Douglas-Peucker style: a run of waypoints is replaced by the straight joint-space segment
+/// between its ends if no waypoint deviates from that segment by more than the joint tolerance, no end effector tip
+/// deviates by more than the Cartesian tolerance, and the states along the segment pass the validity check.
+/// Otherwise the run is split at the waypoint that deviates most, and both halves are simplified the same way.
+class WaypointDecimation
+{
+public:
+  typedef boost::function<bool(const robot_state::RobotState& state)> StateValidityFn;
+
+  /// \param joint_tolerance Maximum deviation of any joint variable from the simplified path
+  /// \param cartesian_tolerance Maximum distance of the end effector tips of the group from where they were on the
+  /// original path, measured at the removed waypoints; 0 disables the Cartesian check
+  /// \param validity_resolution Joint-space distance between the states checked along each new segment
+  WaypointDecimation(double joint_tolerance = 0.01, double cartesian_tolerance = 0.005,
+                     double validity_resolution = 0.05);
+
+  /// \brief Remove the waypoints of \e trajectory that are not needed. The durations of removed waypoints are added
+  /// to the next kept waypoint.
+  /// \param is_valid If set, every new segment is checked with this function and kept only if all its states pass
+  /// \param fixed_index Indices of waypoints that are never removed (the first and the last one never are)
+  /// \param kept_index Returns the indices in the original trajectory of the waypoints that were kept
+  /// \return The number of removed waypoints
+  std::size_t decimate(robot_trajectory::RobotTrajectory& trajectory, const StateValidityFn& is_valid,
+                       const std::vector<std::size_t>& fixed_index, std::vector<std::size_t>& kept_index) const;
+
+  std::size_t decimate(robot_trajectory::RobotTrajectory& trajectory,
+                       const StateValidityFn& is_valid = StateValidityFn()) const;
+
+private:
+  double joint_tolerance_;
+  double cartesian_tolerance_;
+  double validity_resolution_;
+};
+}
+
+#endif
@@ -0,0 +1,600 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/time_optimal_parameterization.h>
+#include <ros/console.h>
+#include <boost/math/constants/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace trajectory_processing
+{
+namespace
+{
+const double VLIMIT = 1.0;  // default if not specified in model
+const double ALIMIT = 1.0;  // default if not specified in model
+const double EPSILON = 1e-9;
+
+// Velocity and acceleration limits of a single joint
+struct JointLimits
+{
+  double min_velocity;
+  double max_velocity;
+  double min_acceleration;
+  double max_acceleration;
+};
+
+// The linear constraint a * u + b * x <= c on the path acceleration u and the squared path velocity x
+struct Constraint
+{
+  double a;
+  double b;
+  double c;
+};
+
+// Intersect [x_lo, x_hi] with b * x <= c
+bool addBound(double b, double c, double& x_lo, double& x_hi)
+{
+  if (b > EPSILON)
+    x_hi = std::min(x_hi, c / b);
+  else if (b < -EPSILON)
+    x_lo = std::max(x_lo, c / b);
+  else if (c < -EPSILON)
+    return false;
+  return true;
+}
+
+// Shrink [x_lo, x_hi] to the values of x for which some u satisfies all constraints. With only two variables,
+// eliminating u (Fourier-Motzkin) pairs every upper bound on u with every lower bound, which solves the linear
+// program exactly.
+bool projectConstraints(const std::vector<Constraint>& constraints, double& x_lo, double& x_hi)
+{
+  for (std::size_t k = 0; k < constraints.size(); ++k)
+  {
+    const Constraint& upper = constraints[k];
+    if (std::abs(upper.a) <= EPSILON)
+    {
+      if (!addBound(upper.b, upper.c, x_lo, x_hi))
+        return false;
+    }
+    else if (upper.a > 0.0)
+      for (std::size_t l = 0; l < constraints.size(); ++l)
+      {
+        const Constraint& lower = constraints[l];
+        if (lower.a < -EPSILON &&
+            !addBound(upper.b / upper.a - lower.b / lower.a, upper.c / upper.a - lower.c / lower.a, x_lo, x_hi))
+          return false;
+      }
+  }
+
+  // tolerate rounding errors
+  if (x_lo > x_hi)
+  {
+    if (x_lo - x_hi > EPSILON * std::max(1.0, std::abs(x_hi)))
+      return false;
+    x_lo = x_hi;
+  }
+  return true;
+}
+
+// The range of u that satisfies all constraints for the squared path velocity x
+void accelerationRange(const std::vector<Constraint>& constraints, double x, double& u_lo, double& u_hi)
+{
+  u_lo = -std::numeric_limits<double>::infinity();
+  u_hi = std::numeric_limits<double>::infinity();
+  for (std::size_t k = 0; k < constraints.size(); ++k)
+  {
+    const Constraint& constraint = constraints[k];
+    if (constraint.a > EPSILON)
+      u_hi = std::min(u_hi, (constraint.c - constraint.b * x) / constraint.a);
+    else if (constraint.a < -EPSILON)
+      u_lo = std::max(u_lo, (constraint.c - constraint.b * x) / constraint.a);
+  }
+}
+
+// The joint acceleration q' * u + q'' * x at a grid point must stay within the limits of every joint; the largest
+// squared path velocity that respects the joint velocity limits is returned in x_max.
+void gridPointConstraints(const double* dq, const double* ddq, const std::vector<JointLimits>& limits,
+                          std::vector<Constraint>& constraints, double& x_max)
+{
+  constraints.clear();
+  x_max = std::numeric_limits<double>::infinity();
+  for (std::size_t j = 0; j < limits.size(); ++j)
+  {
+    Constraint upper = { dq[j], ddq[j], limits[j].max_acceleration };
+    Constraint lower = { -dq[j], -ddq[j], -limits[j].min_acceleration };
+    constraints.push_back(upper);
+    constraints.push_back(lower);
+    if (std::abs(dq[j]) > EPSILON)
+    {
+      double v = (dq[j] > 0.0 ? limits[j].max_velocity : -limits[j].min_velocity) / dq[j];
+      x_max = std::min(x_max, v * v);
+    }
+  }
+}
+
+// Compute the second derivatives m of the cubic spline through the values y at the knots spaced by h. The spline is
+// natural at the end; at the start it is natural as well, unless its first derivative is given by start_slope.
+void fitSpline(const std::vector<double>& h, const std::vector<double>& y, const double* start_slope,
+               std::vector<double>& m)
+{
+  const std::size_t n = y.size();
+  m.assign(n, 0.0);
+  const std::size_t first = start_slope ? 0 : 1;
+  if (n < first + 2)
+    return;
+
+  // tridiagonal system for m[first] .. m[n - 2], solved by forward elimination and back substitution
+  std::vector<double> diag(n, 0.0), rhs(n, 0.0);
+  for (std::size_t i = first; i + 1 < n; ++i)
+  {
+    if (i == 0)
+    {
+      diag[i] = 2.0 * h[0];
+      rhs[i] = 6.0 * ((y[1] - y[0]) / h[0] - *start_slope);
+    }
+    else
+    {
+      diag[i] = 2.0 * (h[i - 1] + h[i]);
+      rhs[i] = 6.0 * ((y[i + 1] - y[i]) / h[i] - (y[i] - y[i - 1]) / h[i - 1]);
+    }
+    if (i > first)
+    {
+      double w = h[i - 1] / diag[i - 1];
+      diag[i] -= w * h[i - 1];
+      rhs[i] -= w * rhs[i - 1];
+    }
+  }
+  for (std::size_t i = n - 1; i-- > first;)
+    m[i] = (rhs[i] - h[i] * m[i + 1]) / diag[i];
+}
+
+// The timing of a path at each of its waypoints
+struct PathTiming
+{
+  std::vector<double> durations;                    // time from the previous waypoint
+  std::vector<double> path_velocities;              // squared velocity along the path
+  std::vector<std::vector<double> > tangents;       // first derivative of the joint positions along the path
+  std::vector<std::vector<double> > velocities;     // joint velocities
+  std::vector<std::vector<double> > accelerations;  // joint accelerations
+};
+
+// Time-parameterize the path through the waypoints, given as positions[waypoint][joint], so that it ends at rest.
+// The path starts at rest, unless start_tangent is given: the path then continues a path that had this tangent and
+// the squared path velocity start_path_velocity at the first waypoint.
+bool parameterizePath(const std::vector<std::vector<double> >& positions, const std::vector<JointLimits>& limits,
+                      double path_resolution, unsigned int min_grid_steps, const std::vector<double>& start_tangent,
+                      double start_path_velocity, PathTiming& timing)
+{
+  const std::size_t num_points = positions.size();
+  const std::size_t num_joints = limits.size();
+  timing.durations.assign(num_points, 0.0);
+  timing.path_velocities.assign(num_points, 0.0);
+  timing.tangents.assign(num_points, std::vector<double>(num_joints, 0.0));
+  timing.velocities.assign(num_points, std::vector<double>(num_joints, 0.0));
+  timing.accelerations.assign(num_points, std::vector<double>(num_joints, 0.0));
+
+  // the spline knots are the waypoints that differ from their predecessor; repeated waypoints take no time
+  std::vector<std::size_t> knots(1, 0);
+  std::vector<std::size_t> waypoint_knot(num_points, 0);
+  std::vector<double> h;
+  for (std::size_t i = 1; i < num_points; ++i)
+  {
+    double distance = 0.0;
+    for (std::size_t j = 0; j < num_joints; ++j)
+      distance += (positions[i][j] - positions[knots.back()][j]) * (positions[i][j] - positions[knots.back()][j]);
+    distance = sqrt(distance);
+    if (distance > EPSILON)
+    {
+      knots.push_back(i);
+      h.push_back(distance);
+    }
+    waypoint_knot[i] = knots.size() - 1;
+  }
+  if (knots.size() < 2)
+  {
+    if (start_path_velocity <= EPSILON)
+      return true;
+    ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization", "The path is too short to stop");
+    return false;
+  }
+  const std::size_t num_segments = h.size();
+
+  // cubic spline through the knots, parameterized by arc length, for each joint
+  std::vector<std::vector<double> > second_derivatives(num_joints);
+  std::vector<double> y(knots.size());
+  for (std::size_t j = 0; j < num_joints; ++j)
+  {
+    for (std::size_t k = 0; k < knots.size(); ++k)
+      y[k] = positions[knots[k]][j];
+    fitSpline(h, y, start_tangent.empty() ? NULL : &start_tangent[j], second_derivatives[j]);
+  }
+
+  // grid along the path, with the first and second path derivatives q' and q'' of every joint at each grid point
+  double length = 0.0;
+  for (std::size_t k = 0; k < num_segments; ++k)
+    length += h[k];
+  const double step = std::min(path_resolution, length / std::max(min_grid_steps, 1u));
+  std::vector<std::size_t> knot_grid_point(knots.size(), 0);
+  std::vector<double> ds;
+  std::vector<double> dq, ddq;
+  for (std::size_t k = 0; k < num_segments; ++k)
+  {
+    const std::size_t steps = static_cast<std::size_t>(std::max(1.0, std::ceil(h[k] / step)));
+    for (std::size_t i = 0; i < steps || (k + 1 == num_segments && i == steps); ++i)
+    {
+      const double t = h[k] * i / steps;
+      for (std::size_t j = 0; j < num_joints; ++j)
+      {
+        const double m0 = second_derivatives[j][k];
+        const double m1 = second_derivatives[j][k + 1];
+        const double y0 = positions[knots[k]][j];
+        const double y1 = positions[knots[k + 1]][j];
+        dq.push_back((y1 - y0) / h[k] - (m0 * (h[k] - t) * (h[k] - t) - m1 * t * t) / (2.0 * h[k]) -
+                     (m1 - m0) * h[k] / 6.0);
+        ddq.push_back((m0 * (h[k] - t) + m1 * t) / h[k]);
+      }
+      if (i < steps)
+        ds.push_back(h[k] / steps);
+    }
+    knot_grid_point[k + 1] = ds.size();
+  }
+  const std::size_t num_steps = ds.size();
+
+  // backward pass: [x_lo[i], x_hi[i]] holds the squared path velocities at grid point i from which the end of the
+  // path can be reached at rest
+  std::vector<double> x_lo(num_steps + 1, 0.0), x_hi(num_steps + 1, 0.0);
+  std::vector<Constraint> constraints;
+  for (std::size_t i = num_steps; i-- > 0;)
+  {
+    gridPointConstraints(&dq[i * num_joints], &ddq[i * num_joints], limits, constraints, x_hi[i]);
+    Constraint reach_upper = { 2.0 * ds[i], 1.0, x_hi[i + 1] };
+    Constraint reach_lower = { -2.0 * ds[i], -1.0, -x_lo[i + 1] };
+    constraints.push_back(reach_upper);
+    constraints.push_back(reach_lower);
+    if (!projectConstraints(constraints, x_lo[i], x_hi[i]))
+    {
+      ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization",
+                      "The end of the path cannot be reached at rest from grid point %zu of %zu", i, num_steps);
+      return false;
+    }
+  }
+  if (x_lo[0] > start_path_velocity + EPSILON)
+  {
+    ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization",
+                    "The path cannot be started at path velocity %f", sqrt(start_path_velocity));
+    return false;
+  }
+
+  // forward pass: take the largest path acceleration that keeps the next grid point controllable
+  std::vector<double> x(num_steps + 1, 0.0), u(num_steps + 1, 0.0), time(num_steps + 1, 0.0);
+  x[0] = std::min(std::max(start_path_velocity, 0.0), x_hi[0]);
+  for (std::size_t i = 0; i < num_steps; ++i)
+  {
+    double x_max;
+    gridPointConstraints(&dq[i * num_joints], &ddq[i * num_joints], limits, constraints, x_max);
+    Constraint reach_upper = { 2.0 * ds[i], 0.0, x_hi[i + 1] - x[i] };
+    constraints.push_back(reach_upper);
+    double u_lo, u_hi;
+    accelerationRange(constraints, x[i], u_lo, u_hi);
+    x[i + 1] = std::min(std::max(x[i] + 2.0 * ds[i] * std::max(u_lo, u_hi), x_lo[i + 1]), x_hi[i + 1]);
+    x[i + 1] = std::max(x[i + 1], 0.0);
+    u[i] = (x[i + 1] - x[i]) / (2.0 * ds[i]);
+
+    const double velocity_sum = sqrt(x[i]) + sqrt(x[i + 1]);
+    if (velocity_sum <= EPSILON)
+    {
+      ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization",
+                      "The path velocity vanishes at grid point %zu of %zu", i, num_steps);
+      return false;
+    }
+    time[i + 1] = time[i] + 2.0 * ds[i] / velocity_sum;
+  }
+
+  // the path acceleration at the end continues the last step, within the limits at the last grid point
+  double x_max, u_lo, u_hi;
+  gridPointConstraints(&dq[num_steps * num_joints], &ddq[num_steps * num_joints], limits, constraints, x_max);
+  accelerationRange(constraints, x[num_steps], u_lo, u_hi);
+  u[num_steps] = std::min(std::max(u[num_steps - 1], u_lo), u_hi);
+
+  for (std::size_t i = 0; i < num_points; ++i)
+  {
+    const std::size_t g = knot_grid_point[waypoint_knot[i]];
+    if (i > 0)
+      timing.durations[i] = time[g] - time[knot_grid_point[waypoint_knot[i - 1]]];
+    timing.path_velocities[i] = x[g];
+    const double path_velocity = sqrt(x[g]);
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      timing.tangents[i][j] = dq[g * num_joints + j];
+      timing.velocities[i][j] = dq[g * num_joints + j] * path_velocity;
+      timing.accelerations[i][j] = dq[g * num_joints + j] * u[g] + ddq[g * num_joints + j] * x[g];
+    }
+  }
+  return true;
+}
+
+// Get the velocity and acceleration limits of the variables of the group, scaled by the given factors
+bool getJointLimits(const robot_model::JointModelGroup* group, const double max_velocity_scaling_factor,
+                    const double max_acceleration_scaling_factor, std::vector<JointLimits>& limits)
+{
+  const robot_model::RobotModel& rmodel = group->getParentModel();
+  const std::vector<std::string>& vars = group->getVariableNames();
+  const std::size_t num_joints = group->getVariableCount();
+  double velocity_scaling_factor = 1.0;
+  double acceleration_scaling_factor = 1.0;
+
+  // Set scaling factors
+  if (max_velocity_scaling_factor > 0.0 && max_velocity_scaling_factor <= 1.0)
+    velocity_scaling_factor = max_velocity_scaling_factor;
+  else if (max_velocity_scaling_factor == 0.0)
+    ROS_DEBUG_NAMED("trajectory_processing.time_optimal_parameterization",
+                    "A max_velocity_scaling_factor of 0.0 was specified, defaulting to %f instead.",
+                    velocity_scaling_factor);
+  else
+    ROS_WARN_NAMED("trajectory_processing.time_optimal_parameterization",
+                   "Invalid max_velocity_scaling_factor %f specified, defaulting to %f instead.",
+                   max_velocity_scaling_factor, velocity_scaling_factor);
+
+  if (max_acceleration_scaling_factor > 0.0 && max_acceleration_scaling_factor <= 1.0)
+    acceleration_scaling_factor = max_acceleration_scaling_factor;
+  else if (max_acceleration_scaling_factor == 0.0)
+    ROS_DEBUG_NAMED("trajectory_processing.time_optimal_parameterization",
+                    "A max_acceleration_scaling_factor of 0.0 was specified, defaulting to %f instead.",
+                    acceleration_scaling_factor);
+  else
+    ROS_WARN_NAMED("trajectory_processing.time_optimal_parameterization",
+                   "Invalid max_acceleration_scaling_factor %f specified, defaulting to %f instead.",
+                   max_acceleration_scaling_factor, acceleration_scaling_factor);
+
+  // Set bounds based on model, or default limits
+  limits.resize(num_joints);
+  for (std::size_t j = 0; j < num_joints; ++j)
+  {
+    const robot_model::VariableBounds& bounds = rmodel.getVariableBounds(vars[j]);
+    JointLimits& limit = limits[j];
+    limit.max_velocity = VLIMIT;
+    limit.min_velocity = -VLIMIT;
+    if (bounds.velocity_bounded_)
+    {
+      limit.max_velocity = bounds.max_velocity_;
+      limit.min_velocity = bounds.min_velocity_;
+      if (limit.min_velocity == 0.0)
+        limit.min_velocity = -limit.max_velocity;
+    }
+    limit.max_velocity *= velocity_scaling_factor;
+    limit.min_velocity *= velocity_scaling_factor;
+
+    limit.max_acceleration = ALIMIT;
+    limit.min_acceleration = -ALIMIT;
+    if (bounds.acceleration_bounded_)
+    {
+      limit.max_acceleration = bounds.max_acceleration_;
+      limit.min_acceleration = bounds.min_acceleration_;
+      if (limit.min_acceleration == 0.0)
+        limit.min_acceleration = -limit.max_acceleration;
+    }
+    limit.max_acceleration *= acceleration_scaling_factor;
+    limit.min_acceleration *= acceleration_scaling_factor;
+
+    // Error out if bounds don't make sense
+    if (limit.max_velocity <= 0.0 || limit.max_acceleration <= 0.0 || limit.min_velocity >= 0.0 ||
+        limit.min_acceleration >= 0.0)
+    {
+      ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization",
+                      "Joint %zu velocity limits [%f, %f] and acceleration limits [%f, %f] must include zero "
+                      "in their interior or a solution won't be found.",
+                      j, limit.min_velocity, limit.max_velocity, limit.min_acceleration, limit.max_acceleration);
+      return false;
+    }
+  }
+  return true;
+}
+}
+
+TimeOptimalParameterization::TimeOptimalParameterization(double path_resolution, unsigned int min_grid_steps)
+  : path_resolution_(path_resolution), min_grid_steps_(min_grid_steps)
+{
+}
+
+TimeOptimalParameterization::~TimeOptimalParameterization()
+{
+}
+
+bool TimeOptimalParameterization::computeTimeStamps(robot_trajectory::RobotTrajectory& trajectory,
+                                                    const double max_velocity_scaling_factor,
+                                                    const double max_acceleration_scaling_factor) const
+{
+  if (trajectory.empty())
+    return true;
+
+  const robot_model::JointModelGroup* group = trajectory.getGroup();
+  if (!group)
+  {
+    ROS_ERROR_NAMED("trajectory_processing.time_optimal_parameterization", "It looks like the planner did not set "
+                                                                           "the group the plan was computed for");
+    return false;
+  }
+  const std::vector<int>& idx = group->getVariableIndexList();
+  const std::size_t num_points = trajectory.getWayPointCount();
+  const std::size_t num_joints = group->getVariableCount();
+
+  std::vector<JointLimits> limits;
+  if (!getJointLimits(group, max_velocity_scaling_factor, max_acceleration_scaling_factor, limits))
+    return false;
+
+  // No wrapped angles.
+  trajectory.unwind();
+
+  std::vector<std::vector<double> > positions(num_points, std::vector<double>(num_joints));
+  for (std::size_t i = 0; i < num_points; ++i)
+  {
+    const robot_state::RobotStatePtr& waypoint = trajectory.getWayPointPtr(i);
+    for (std::size_t j = 0; j < num_joints; ++j)
+      positions[i][j] = waypoint->getVariablePosition(idx[j]);
+  }
+
+  PathTiming timing;
+  if (!parameterizePath(positions, limits, path_resolution_, min_grid_steps_, std::vector<double>(), 0.0, timing))
+    return false;
+
+  for (std::size_t i = 0; i < num_points; ++i)
+  {
+    const robot_state::RobotStatePtr& waypoint = trajectory.getWayPointPtr(i);
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      waypoint->setVariableVelocity(idx[j], timing.velocities[i][j]);
+      waypoint->setVariableAcceleration(idx[j], timing.accelerations[i][j]);
+    }
+    trajectory.setWayPointDurationFromPrevious(i, timing.durations[i]);
+  }
+  return true;
+}
+
+StreamingTimeParameterization::StreamingTimeParameterization(const robot_model::JointModelGroup* group,
+                                                             std::size_t look_ahead,
+                                                             const double max_velocity_scaling_factor,
+                                                             const double max_acceleration_scaling_factor,
+                                                             double path_resolution, unsigned int min_grid_steps)
+  : group_(group)
+  , look_ahead_(look_ahead)
+  , max_velocity_scaling_factor_(max_velocity_scaling_factor)
+  , max_acceleration_scaling_factor_(max_acceleration_scaling_factor)
+  , path_resolution_(path_resolution)
+  , min_grid_steps_(min_grid_steps)
+  , started_(false)
+  , start_path_velocity_(0.0)
+{
+}
+
+StreamingTimeParameterization::~StreamingTimeParameterization()
+{
+}
+
+void StreamingTimeParameterization::addWayPoint(const robot_state::RobotState& state)
+{
+  robot_state::RobotStatePtr waypoint(new robot_state::RobotState(state));
+  if (!waypoints_.empty())
+  {
+    // unwrap continuous joints
+    const std::vector<const robot_model::JointModel*>& cont_joints = group_->getContinuousJointModels();
+    for (std::size_t i = 0; i < cont_joints.size(); ++i)
+    {
+      const double two_pi = 2.0 * boost::math::constants::pi<double>();
+      const double last_value = waypoints_.back()->getJointPositions(cont_joints[i])[0];
+      double current_value = waypoint->getJointPositions(cont_joints[i])[0];
+      current_value += two_pi * std::floor((last_value - current_value) / two_pi + 0.5);
+      waypoint->setJointPositions(cont_joints[i], &current_value);
+    }
+    waypoint->update();
+  }
+  waypoints_.push_back(waypoint);
+}
+
+void StreamingTimeParameterization::addWayPoints(const robot_trajectory::RobotTrajectory& trajectory)
+{
+  for (std::size_t i = 0; i < trajectory.getWayPointCount(); ++i)
+    addWayPoint(trajectory.getWayPoint(i));
+}
+
+std::size_t StreamingTimeParameterization::getBufferedWayPointCount() const
+{
+  return started_ ? waypoints_.size() - 1 : waypoints_.size();
+}
+
+bool StreamingTimeParameterization::computeSegment(robot_trajectory::RobotTrajectory& segment)
+{
+  segment.clear();
+  if (waypoints_.size() <= look_ahead_ + 1)
+    return true;
+  return emitSegment(waypoints_.size() - 1 - look_ahead_, segment);
+}
+
+bool StreamingTimeParameterization::finish(robot_trajectory::RobotTrajectory& segment)
+{
+  segment.clear();
+  bool result = true;
+  if (!waypoints_.empty() && (!started_ || waypoints_.size() > 1))
+    result = emitSegment(waypoints_.size() - 1, segment);
+  clear();
+  return result;
+}
+
+void StreamingTimeParameterization::clear()
+{
+  waypoints_.clear();
+  started_ = false;
+  start_tangent_.clear();
+  start_path_velocity_ = 0.0;
+}
+
+bool StreamingTimeParameterization::emitSegment(std::size_t count, robot_trajectory::RobotTrajectory& segment)
+{
+  std::vector<JointLimits> limits;
+  if (!getJointLimits(group_, max_velocity_scaling_factor_, max_acceleration_scaling_factor_, limits))
+    return false;
+
+  // time all buffered waypoints, so that the robot can stop by the last one
+  const std::vector<int>& idx = group_->getVariableIndexList();
+  const std::size_t num_joints = group_->getVariableCount();
+  std::vector<std::vector<double> > positions(waypoints_.size(), std::vector<double>(num_joints));
+  for (std::size_t i = 0; i < waypoints_.size(); ++i)
+    for (std::size_t j = 0; j < num_joints; ++j)
+      positions[i][j] = waypoints_[i]->getVariablePosition(idx[j]);
+
+  PathTiming timing;
+  if (!parameterizePath(positions, limits, path_resolution_, min_grid_steps_, start_tangent_, start_path_velocity_,
+                        timing))
+    return false;
+
+  // hand out the first waypoints; all but the last one of them leave the buffer
+  for (std::size_t i = 0; i <= count; ++i)
+  {
+    robot_state::RobotStatePtr waypoint(new robot_state::RobotState(*waypoints_[i]));
+    for (std::size_t j = 0; j < num_joints; ++j)
+    {
+      waypoint->setVariableVelocity(idx[j], timing.velocities[i][j]);
+      waypoint->setVariableAcceleration(idx[j], timing.accelerations[i][j]);
+    }
+    segment.addSuffixWayPoint(waypoint, i == 0 ? 0.0 : timing.durations[i]);
+  }
+  waypoints_.erase(waypoints_.begin(), waypoints_.begin() + count);
+  started_ = true;
+  start_tangent_ = timing.tangents[count];
+  start_path_velocity_ = timing.path_velocities[count];
+  return true;
+}
+}
@@ -35,6 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/trajectory_processing/trajectory_tools.h>
+#include <deque>
 
 namespace trajectory_processing
 {
@@ -47,4 +48,31 @@ std::size_t trajectoryWaypointCount(const moveit_msgs::RobotTrajectory& trajecto
 {
   return std::max(trajectory.joint_trajectory.points.size(), trajectory.multi_dof_joint_trajectory.points.size());
 }
+
+std::vector<std::size_t> coarseToFineOrder(std::size_t count)
+{
+  std::vector<std::size_t> order;
+  if (count == 0)
+    return order;
+  order.reserve(count);
+  order.push_back(count - 1);
+  if (count > 1)
+    order.push_back(0);
+
+  // open intervals whose midpoints still need to be listed
+  std::deque<std::pair<std::size_t, std::size_t> > intervals;
+  intervals.push_back(std::make_pair(0, count - 1));
+  while (!intervals.empty())
+  {
+    std::pair<std::size_t, std::size_t> interval = intervals.front();
+    intervals.pop_front();
+    if (interval.second - interval.first < 2)
+      continue;
+    std::size_t mid = interval.first + (interval.second - interval.first) / 2;
+    order.push_back(mid);
+    intervals.push_back(std::make_pair(interval.first, mid));
+    intervals.push_back(std::make_pair(mid, interval.second));
+  }
+  return order;
+}
 }
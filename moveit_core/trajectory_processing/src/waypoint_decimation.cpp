@@ -0,0 +1,218 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/trajectory_processing/waypoint_decimation.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace trajectory_processing
+{
+WaypointDecimation::WaypointDecimation(double joint_tolerance, double cartesian_tolerance, double validity_resolution)
+  : joint_tolerance_(std::fabs(joint_tolerance))
+  , cartesian_tolerance_(std::fabs(cartesian_tolerance))
+  , validity_resolution_(std::fabs(validity_resolution))
+{
+}
+
+std::size_t WaypointDecimation::decimate(robot_trajectory::RobotTrajectory& trajectory,
+                                         const StateValidityFn& is_valid) const
+{
+  std::vector<std::size_t> kept_index;
+  return decimate(trajectory, is_valid, std::vector<std::size_t>(), kept_index);
+}
+
+std::size_t WaypointDecimation::decimate(robot_trajectory::RobotTrajectory& trajectory,
+                                         const StateValidityFn& is_valid, const std::vector<std::size_t>& fixed_index,
+                                         std::vector<std::size_t>& kept_index) const
+{
+  kept_index.clear();
+  const std::size_t n = trajectory.getWayPointCount();
+  if (n < 3)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      kept_index.push_back(i);
+    return 0;
+  }
+
+  const robot_model::RobotModelConstPtr& model = trajectory.getRobotModel();
+  const robot_model::JointModelGroup* group = trajectory.getGroup();
+  std::vector<int> variables;
+  if (group)
+    variables = group->getVariableIndexList();
+  else
+    for (std::size_t i = 0; i < model->getVariableCount(); ++i)
+      variables.push_back(i);
+  const std::size_t m = variables.size();
+
+  // copy the positions into one contiguous block, so the deviation of a run of waypoints is a plain loop over
+  // doubles the compiler can vectorize; s holds the joint-space path length up to each waypoint
+  std::vector<double> q(n * m);
+  std::vector<double> s(n, 0.0);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const double* positions = trajectory.getWayPoint(i).getVariablePositions();
+    for (std::size_t j = 0; j < m; ++j)
+      q[i * m + j] = positions[variables[j]];
+    if (i > 0)
+    {
+      double d = 0.0;
+      for (std::size_t j = 0; j < m; ++j)
+        d += (q[i * m + j] - q[(i - 1) * m + j]) * (q[i * m + j] - q[(i - 1) * m + j]);
+      s[i] = s[i - 1] + std::sqrt(d);
+    }
+  }
+
+  std::vector<const robot_model::LinkModel*> tips;
+  if (group && cartesian_tolerance_ > 0.0)
+  {
+    group->getEndEffectorTips(tips);
+    if (tips.empty() && !group->getLinkModels().empty())
+      tips.push_back(group->getLinkModels().back());
+  }
+
+  std::vector<bool> keep(n, false);
+  keep.front() = keep.back() = true;
+  for (std::size_t i = 0; i < fixed_index.size(); ++i)
+    if (fixed_index[i] < n)
+      keep[fixed_index[i]] = true;
+
+  // runs of waypoints between two kept ones that may still be replaced by a single segment
+  std::vector<std::pair<std::size_t, std::size_t> > runs;
+  for (std::size_t i = 1, previous = 0; i < n; ++i)
+    if (keep[i])
+    {
+      runs.push_back(std::make_pair(previous, i));
+      previous = i;
+    }
+
+  robot_state::RobotState state(trajectory.getWayPoint(0));
+  while (!runs.empty())
+  {
+    std::size_t a = runs.back().first;
+    std::size_t b = runs.back().second;
+    runs.pop_back();
+    if (b - a < 2)
+      continue;
+
+    // compare each waypoint with the point of the segment a -> b at the same fraction of the path length
+    const double length = s[b] - s[a];
+    const double* qa = &q[a * m];
+    const double* qb = &q[b * m];
+    std::vector<double> fraction(b - a + 1);
+    std::size_t split = a + (b - a) / 2;
+    double max_error = 0.0;
+    for (std::size_t k = a + 1; k < b; ++k)
+    {
+      const double t = length > std::numeric_limits<double>::epsilon() ? (s[k] - s[a]) / length :
+                                                                         double(k - a) / double(b - a);
+      fraction[k - a] = t;
+      const double* qk = &q[k * m];
+      double error = 0.0;
+      for (std::size_t j = 0; j < m; ++j)
+        error = std::max(error, std::fabs(qk[j] - (qa[j] + t * (qb[j] - qa[j]))));
+      if (error > max_error)
+      {
+        max_error = error;
+        split = k;
+      }
+    }
+    bool replace = max_error <= joint_tolerance_;
+
+    const robot_state::RobotState& from = trajectory.getWayPoint(a);
+    const robot_state::RobotState& to = trajectory.getWayPoint(b);
+    if (replace && !tips.empty())
+    {
+      double max_distance = 0.0;
+      std::size_t farthest = split;
+      for (std::size_t k = a + 1; k < b; ++k)
+      {
+        from.interpolate(to, fraction[k - a], state);
+        const robot_state::RobotStatePtr& original = trajectory.getWayPointPtr(k);
+        for (std::size_t l = 0; l < tips.size(); ++l)
+        {
+          double distance = (state.getGlobalLinkTransform(tips[l]).translation() -
+                             original->getGlobalLinkTransform(tips[l]).translation())
+                                .norm();
+          if (distance > max_distance)
+          {
+            max_distance = distance;
+            farthest = k;
+          }
+        }
+      }
+      if (max_distance > cartesian_tolerance_)
+      {
+        replace = false;
+        split = farthest;
+      }
+    }
+
+    // the new segment is checked in the same pass, so the result needs no second validation
+    if (replace && is_valid)
+    {
+      std::size_t steps = b - a;
+      if (validity_resolution_ > 0.0)
+        steps = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(length / validity_resolution_)));
+      for (std::size_t i = 1; i < steps && replace; ++i)
+      {
+        from.interpolate(to, double(i) / double(steps), state);
+        state.update();
+        replace = is_valid(state);
+      }
+    }
+
+    if (!replace)
+    {
+      keep[split] = true;
+      runs.push_back(std::make_pair(a, split));
+      runs.push_back(std::make_pair(split, b));
+    }
+  }
+
+  robot_trajectory::RobotTrajectory result(model, group);
+  double dt = 0.0;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    dt += trajectory.getWayPointDurationFromPrevious(i);
+    if (!keep[i])
+      continue;
+    result.addSuffixWayPoint(trajectory.getWayPointPtr(i), dt);
+    kept_index.push_back(i);
+    dt = 0.0;
+  }
+  trajectory.swap(result);
+  return n - kept_index.size();
+}
+}
@@ -44,6 +44,10 @@
 #include <moveit/robot_trajectory/robot_trajectory.h>
 #include <moveit/trajectory_processing/iterative_spline_parameterization.h>
 #include <moveit/trajectory_processing/iterative_time_parameterization.h>
+#include <moveit/trajectory_processing/time_optimal_parameterization.h>
+#include <moveit/trajectory_processing/trajectory_tools.h>
+#include <moveit/trajectory_processing/waypoint_decimation.h>
+#include <algorithm>
 
 // Function declarations
 moveit::core::RobotModelConstPtr loadModel();
@@ -212,6 +216,140 @@ TEST(TestTimeParameterization, TestRepeatedPoint)
   ASSERT_LT(trajectory.getWayPointDurationFromStart(trajectory.getWayPointCount() - 1), 0.001);
 }
 
+TEST(TestTimeParameterization, TestTimeOptimal)
+{
+  trajectory_processing::TimeOptimalParameterization time_parameterization;
+  EXPECT_EQ(initStraightTrajectory(trajectory), 0);
+
+  ros::WallTime wt = ros::WallTime::now();
+  EXPECT_TRUE(time_parameterization.computeTimeStamps(trajectory));
+  std::cout << "TimeOptimalParameterization took " << (ros::WallTime::now() - wt).toSec() << std::endl;
+  printTrajectory(trajectory);
+
+  // never slower than the iterative methods, and within the limits of the model at every waypoint
+  ASSERT_LT(trajectory.getWayPointDurationFromStart(trajectory.getWayPointCount() - 1), 3.0);
+  const robot_model::JointModelGroup* group = trajectory.getGroup();
+  const robot_model::VariableBounds& bounds = rmodel->getVariableBounds(group->getVariableNames()[0]);
+  const int index = group->getVariableIndexList()[0];
+  for (std::size_t i = 0; i < trajectory.getWayPointCount(); ++i)
+  {
+    const robot_state::RobotState& point = trajectory.getWayPoint(i);
+    EXPECT_LE(point.getVariableVelocity(index), bounds.max_velocity_ + 1e-6);
+    EXPECT_GE(point.getVariableVelocity(index), -bounds.max_velocity_ - 1e-6);
+  }
+}
+
+TEST(TestTimeParameterization, TestTimeOptimalRepeatedPoint)
+{
+  trajectory_processing::TimeOptimalParameterization time_parameterization;
+  EXPECT_EQ(initRepeatedPointTrajectory(trajectory), 0);
+
+  EXPECT_TRUE(time_parameterization.computeTimeStamps(trajectory));
+  ASSERT_LT(trajectory.getWayPointDurationFromStart(trajectory.getWayPointCount() - 1), 0.001);
+}
+
+TEST(TestTimeParameterization, TestStreaming)
+{
+  EXPECT_EQ(initStraightTrajectory(trajectory), 0);
+  trajectory_processing::StreamingTimeParameterization time_parameterization(trajectory.getGroup(), 3);
+  robot_trajectory::RobotTrajectory segment(rmodel, "right_arm");
+  robot_trajectory::RobotTrajectory streamed(rmodel, "right_arm");
+  const int index = trajectory.getGroup()->getVariableIndexList()[0];
+
+  // add the waypoints in chunks; each segment continues where the previous one ended
+  for (std::size_t i = 0; i < trajectory.getWayPointCount(); i += 2)
+  {
+    time_parameterization.addWayPoint(trajectory.getWayPoint(i));
+    if (i + 1 < trajectory.getWayPointCount())
+      time_parameterization.addWayPoint(trajectory.getWayPoint(i + 1));
+    EXPECT_LE(time_parameterization.getBufferedWayPointCount(), 5u);
+    ASSERT_TRUE(time_parameterization.computeSegment(segment));
+    if (segment.empty())
+      continue;
+    if (!streamed.empty())
+    {
+      EXPECT_NEAR(streamed.getLastWayPoint().getVariablePosition(index),
+                  segment.getFirstWayPoint().getVariablePosition(index), 1e-9);
+      EXPECT_NEAR(streamed.getLastWayPoint().getVariableVelocity(index),
+                  segment.getFirstWayPoint().getVariableVelocity(index), 1e-6);
+    }
+    streamed.append(segment, 0.0, streamed.empty() ? 0 : 1);
+  }
+  ASSERT_TRUE(time_parameterization.finish(segment));
+  streamed.append(segment, 0.0, 1);
+  EXPECT_EQ(trajectory.getWayPointCount(), streamed.getWayPointCount());
+  EXPECT_EQ(0u, time_parameterization.getBufferedWayPointCount());
+  EXPECT_NEAR(0.0, streamed.getLastWayPoint().getVariableVelocity(index), 1e-6);
+
+  // the look-ahead only costs a little time over timing the whole path at once
+  trajectory_processing::TimeOptimalParameterization whole_path;
+  ASSERT_TRUE(whole_path.computeTimeStamps(trajectory));
+  double whole_duration = trajectory.getWayPointDurationFromStart(trajectory.getWayPointCount() - 1);
+  double streamed_duration = streamed.getWayPointDurationFromStart(streamed.getWayPointCount() - 1);
+  EXPECT_GE(streamed_duration, whole_duration - 1e-6);
+  EXPECT_LT(streamed_duration, 1.5 * whole_duration);
+}
+
+TEST(TrajectoryTools, CoarseToFineOrder)
+{
+  EXPECT_TRUE(trajectory_processing::coarseToFineOrder(0).empty());
+  for (std::size_t count = 1; count < 40; ++count)
+  {
+    std::vector<std::size_t> order = trajectory_processing::coarseToFineOrder(count);
+    ASSERT_EQ(count, order.size());
+    EXPECT_EQ(count - 1, order[0]);
+    if (count > 2)
+      EXPECT_EQ((count - 1) / 2, order[2]);
+    std::sort(order.begin(), order.end());
+    for (std::size_t i = 0; i < count; ++i)
+      EXPECT_EQ(i, order[i]);
+  }
+}
+
+TEST(TrajectoryTools, WaypointDecimation)
+{
+  const robot_model::JointModelGroup* group = rmodel->getJointModelGroup("right_arm");
+  ASSERT_TRUE(group);
+  const std::vector<int>& idx = group->getVariableIndexList();
+  moveit::core::RobotState state(rmodel);
+  state.setToDefaultValues();
+
+  // a straight line in joint space, with a bump at waypoint 12
+  robot_trajectory::RobotTrajectory line(rmodel, "right_arm");
+  for (int i = 0; i < 20; ++i)
+  {
+    state.setVariablePosition(idx[0], 0.05 * i);
+    state.setVariablePosition(idx[1], i == 12 ? 0.3 : 0.0);
+    line.addSuffixWayPoint(state, 0.1);
+  }
+
+  trajectory_processing::WaypointDecimation decimation(0.01, 0.0);
+  std::vector<std::size_t> kept;
+  robot_trajectory::RobotTrajectory trajectory(line);
+  EXPECT_EQ(14u, decimation.decimate(trajectory, trajectory_processing::WaypointDecimation::StateValidityFn(),
+                                     std::vector<std::size_t>(1, 5), kept));
+  ASSERT_EQ(6u, kept.size());
+  EXPECT_EQ(0u, kept[0]);
+  EXPECT_EQ(5u, kept[1]);
+  EXPECT_EQ(11u, kept[2]);
+  EXPECT_EQ(12u, kept[3]);
+  EXPECT_EQ(13u, kept[4]);
+  EXPECT_EQ(19u, kept[5]);
+  EXPECT_NEAR(line.getWayPointDurationFromStart(19), trajectory.getWayPointDurationFromStart(5), 1e-9);
+
+  // if no state between the waypoints is valid, no waypoint can be removed
+  trajectory = line;
+  struct RejectAll
+  {
+    bool operator()(const moveit::core::RobotState& state) const
+    {
+      return false;
+    }
+  };
+  EXPECT_EQ(0u, decimation.decimate(trajectory, RejectAll()));
+  EXPECT_EQ(line.getWayPointCount(), trajectory.getWayPointCount());
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -42,6 +42,8 @@
 #include <Eigen/Geometry>
 #include <boost/noncopyable.hpp>
 #include <moveit/macros/class_forward.h>
+#include <unordered_map>
+#include <vector>
 
 namespace moveit
 {
@@ -61,6 +63,12 @@ typedef std::map<std::string, Eigen::Affine3d, std::less<std::string>,
 class Transforms : private boost::noncopyable
 {
 public:
+  /** @brief Handle for a fixed frame, see getFrameId() */
+  typedef std::size_t FrameId;
+
+  /** @brief The handle returned for unknown frames */
+  static const FrameId INVALID_FRAME_ID = static_cast<FrameId>(-1);
+
   /**
    * @brief Construct a transform list
    */
@@ -194,9 +202,43 @@ public:
    */
   virtual const Eigen::Affine3d& getTransform(const std::string& from_frame) const;
 
+  /**
+   * @brief Get the handle of a frame maintained by this object, to look up its transform repeatedly without resolving
+   * the name again. Handles stay valid for the lifetime of this object; setAllTransforms() keeps the handles of the
+   * frames that are set again.
+   * @param frame The name of the frame (with or without leading '/')
+   * @return The handle of the frame, INVALID_FRAME_ID if the frame is not known
+   */
+  FrameId getFrameId(const std::string& frame) const;
+
+  /**
+   * @brief Check whether data can be transformed from the frame with handle \e id
+   */
+  bool canTransform(FrameId id) const
+  {
+    return id < frame_transforms_.size() && frame_transforms_[id];
+  }
+
+  /**
+   * @brief Get transform for the frame with handle \e id (w.r.t target frame)
+   * @param id The handle of the frame, as returned by getFrameId()
+   * @return The required transform
+   */
+  const Eigen::Affine3d& getTransform(FrameId id) const;
+
 protected:
   std::string target_frame_;
   FixedTransformsMap transforms_;
+
+private:
+  /** @brief Give a handle to the frame of the entry \e it of transforms_, or update the transform of its handle */
+  void indexFrame(FixedTransformsMap::const_iterator it);
+
+  /** @brief Handle of each frame, indexed by name with and without leading '/' */
+  std::unordered_map<std::string, FrameId> frame_ids_;
+
+  /** @brief Transform of each handle, pointing into transforms_. NULL if the frame is not currently set */
+  std::vector<const Eigen::Affine3d*> frame_transforms_;
 };
 }
 }
@@ -38,11 +38,14 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <boost/algorithm/string/trim.hpp>
 #include <ros/console.h>
+#include <algorithm>
 
 namespace moveit
 {
 namespace core
 {
+const Transforms::FrameId Transforms::INVALID_FRAME_ID;
+
 Transforms::Transforms(const std::string& target_frame) : target_frame_(target_frame)
 {
   boost::trim(target_frame_);
@@ -57,7 +60,7 @@ Transforms::Transforms(const std::string& target_frame) : target_frame_(target_f
                      target_frame_.c_str(), target_frame_.c_str());
       target_frame_ = '/' + target_frame_;
     }
-    transforms_[target_frame_] = Eigen::Affine3d::Identity();
+    indexFrame(transforms_.insert(std::make_pair(target_frame_, Eigen::Affine3d::Identity())).first);
   }
 }
 
@@ -87,25 +90,44 @@ const FixedTransformsMap& Transforms::getAllTransforms() const
 void Transforms::setAllTransforms(const FixedTransformsMap& transforms)
 {
   transforms_ = transforms;
+  std::fill(frame_transforms_.begin(), frame_transforms_.end(), static_cast<const Eigen::Affine3d*>(NULL));
+  for (FixedTransformsMap::const_iterator it = transforms_.begin(); it != transforms_.end(); ++it)
+    indexFrame(it);
 }
 
-bool Transforms::isFixedFrame(const std::string& frame) const
+void Transforms::indexFrame(FixedTransformsMap::const_iterator it)
 {
-  if (frame.empty())
-    return false;
+  // frames without leading '/' can not be looked up
+  if (it->first.size() < 2 || it->first[0] != '/')
+    return;
+
+  std::pair<std::unordered_map<std::string, FrameId>::iterator, bool> inserted =
+      frame_ids_.insert(std::make_pair(it->first, frame_transforms_.size()));
+  if (inserted.second)
+  {
+    frame_ids_[it->first.substr(1)] = inserted.first->second;
+    frame_transforms_.push_back(&it->second);
+  }
   else
-    return (frame[0] == '/' ? transforms_.find(frame) : transforms_.find('/' + frame)) != transforms_.end();
+    frame_transforms_[inserted.first->second] = &it->second;
+}
+
+Transforms::FrameId Transforms::getFrameId(const std::string& frame) const
+{
+  std::unordered_map<std::string, FrameId>::const_iterator it = frame_ids_.find(frame);
+  return it != frame_ids_.end() && frame_transforms_[it->second] ? it->second : INVALID_FRAME_ID;
+}
+
+bool Transforms::isFixedFrame(const std::string& frame) const
+{
+  return canTransform(getFrameId(frame));
 }
 
 const Eigen::Affine3d& Transforms::getTransform(const std::string& from_frame) const
 {
-  if (!from_frame.empty())
-  {
-    FixedTransformsMap::const_iterator it =
-        (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame));
-    if (it != transforms_.end())
-      return it->second;
-  }
+  FrameId id = getFrameId(from_frame);
+  if (id != INVALID_FRAME_ID)
+    return *frame_transforms_[id];
 
   ROS_ERROR_NAMED("transforms", "Unable to transform from frame '%s' to frame '%s'. Returning identity.",
                   from_frame.c_str(), target_frame_.c_str());
@@ -115,13 +137,22 @@ const Eigen::Affine3d& Transforms::getTransform(const std::string& from_frame) c
   return identity;
 }
 
+const Eigen::Affine3d& Transforms::getTransform(FrameId id) const
+{
+  if (canTransform(id))
+    return *frame_transforms_[id];
+
+  ROS_ERROR_NAMED("transforms", "Unable to transform from frame with id %zu to frame '%s'. Returning identity.", id,
+                  target_frame_.c_str());
+
+  // return identity
+  static const Eigen::Affine3d identity = Eigen::Affine3d::Identity();
+  return identity;
+}
+
 bool Transforms::canTransform(const std::string& from_frame) const
 {
-  if (from_frame.empty())
-    return false;
-  else
-    return (from_frame[0] == '/' ? transforms_.find(from_frame) : transforms_.find('/' + from_frame)) !=
-           transforms_.end();
+  return canTransform(getFrameId(from_frame));
 }
 
 void Transforms::setTransform(const Eigen::Affine3d& t, const std::string& from_frame)
@@ -134,10 +165,16 @@ void Transforms::setTransform(const Eigen::Affine3d& t, const std::string& from_
     {
       ROS_WARN_NAMED("transforms", "Transform specified for frame '%s'. Assuming '/%s' instead", from_frame.c_str(),
                      from_frame.c_str());
-      transforms_['/' + from_frame] = t;
+      setTransform(t, '/' + from_frame);
     }
     else
-      transforms_[from_frame] = t;
+    {
+      std::pair<FixedTransformsMap::iterator, bool> inserted = transforms_.insert(std::make_pair(from_frame, t));
+      if (inserted.second)
+        indexFrame(inserted.first);
+      else
+        inserted.first->second = t;
+    }
   }
 }
 
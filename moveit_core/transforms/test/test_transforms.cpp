@@ -61,6 +61,40 @@ TEST(Transforms, Simple)
   EXPECT_TRUE(tf.isFixedFrame("global"));
 }
 
+TEST(Transforms, FrameIds)
+{
+  moveit::core::Transforms tf("global");
+
+  Eigen::Affine3d t1(Eigen::Translation3d(1.0, 2.0, 3.0));
+  tf.setTransform(t1, "/some_frame_1");
+
+  moveit::core::Transforms::FrameId id = tf.getFrameId("some_frame_1");
+  ASSERT_NE(moveit::core::Transforms::INVALID_FRAME_ID, id);
+  EXPECT_EQ(id, tf.getFrameId("/some_frame_1"));
+  EXPECT_EQ(moveit::core::Transforms::INVALID_FRAME_ID, tf.getFrameId("base_footprint"));
+  EXPECT_TRUE(tf.getTransform(id).isApprox(t1));
+
+  // updating the transform keeps the handle
+  Eigen::Affine3d t2(Eigen::Translation3d(0.0, 1.0, 0.0));
+  tf.setTransform(t2, "/some_frame_1");
+  EXPECT_EQ(id, tf.getFrameId("some_frame_1"));
+  EXPECT_TRUE(tf.getTransform(id).isApprox(t2));
+
+  // handles survive replacing all transforms
+  moveit::core::FixedTransformsMap transforms;
+  transforms["/global"] = Eigen::Affine3d::Identity();
+  transforms["/some_frame_2"] = t1;
+  tf.setAllTransforms(transforms);
+  EXPECT_FALSE(tf.canTransform(id));
+  EXPECT_FALSE(tf.canTransform("some_frame_1"));
+  EXPECT_TRUE(tf.getTransform("some_frame_2").isApprox(t1));
+
+  transforms["/some_frame_1"] = t2;
+  tf.setAllTransforms(transforms);
+  EXPECT_TRUE(tf.canTransform(id));
+  EXPECT_TRUE(tf.getTransform(id).isApprox(t2));
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,119 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_CORE_UTILS_THREAD_GROUPS_
+#define MOVEIT_CORE_UTILS_THREAD_GROUPS_
+
+/** \file thread_groups.h
+ *  \brief CPU affinity and scheduling priorities for named groups of threads
+ *
+ *  Threads declare the group they belong to when they start, e.g. THREAD_GROUP_EXECUTION for the threads that send
+ *  trajectories to the controllers and monitor their execution. The process configures the groups once, typically
+ *  from parameters; threads of groups that are not configured keep the scheduling they inherited. Threads started by a
+ *  thread of a group, e.g. the worker threads of a planner, inherit its scheduling.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace moveit
+{
+namespace core
+{
+/** \brief The threads that plan, e.g. the parallel OMPL plans and the manipulation pipeline */
+extern const std::string THREAD_GROUP_PLANNING;
+
+/** \brief The threads that integrate sensor data, e.g. the occupancy map updaters and the mesh filter */
+extern const std::string THREAD_GROUP_PERCEPTION;
+
+/** \brief The threads that execute trajectories and monitor their execution */
+extern const std::string THREAD_GROUP_EXECUTION;
+
+/** \brief The scheduling of the threads of a group */
+struct ThreadGroupSettings
+{
+  ThreadGroupSettings() : priority(0), nice(0)
+  {
+  }
+
+  /** \brief The CPUs the threads may run on; empty keeps the inherited affinity */
+  std::vector<int> cpus;
+
+  /** \brief The SCHED_FIFO priority (1 to 99) of the threads; 0 keeps the inherited scheduling policy */
+  int priority;
+
+  /** \brief The nice value of threads that are not real-time; 0 keeps the inherited one */
+  int nice;
+};
+
+/** \brief Parse a list of CPUs like "0-3,6", returning false if it is malformed */
+bool parseCpuList(const std::string& list, std::vector<int>& cpus);
+
+/** \brief The settings of the thread groups of the process */
+class ThreadGroupRegistry : private boost::noncopyable
+{
+public:
+  static ThreadGroupRegistry& instance();
+
+  /** \brief Set the scheduling of the threads of \e group that start afterwards */
+  void configure(const std::string& group, const ThreadGroupSettings& settings);
+
+  /** \brief Get the settings of \e group, returning false if it is not configured */
+  bool getSettings(const std::string& group, ThreadGroupSettings& settings) const;
+
+  /** \brief Apply the settings of \e group to the calling thread. Returns false if they could not be applied, e.g.
+      because the process may not use real-time scheduling; a group that is not configured is not an error. */
+  bool applyToCurrentThread(const std::string& group) const;
+
+private:
+  ThreadGroupRegistry()
+  {
+  }
+
+  mutable boost::mutex lock_;
+  std::map<std::string, ThreadGroupSettings> groups_;
+};
+
+/** \brief Shorthand for ThreadGroupRegistry::instance().applyToCurrentThread(group) */
+inline bool joinThreadGroup(const std::string& group)
+{
+  return ThreadGroupRegistry::instance().applyToCurrentThread(group);
+}
+}
+}
+
+#endif
@@ -0,0 +1,169 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/utils/thread_groups.h>
+#include <ros/console.h>
+#include <cstdlib>
+#include <sstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace moveit
+{
+namespace core
+{
+const std::string THREAD_GROUP_PLANNING = "planning";
+const std::string THREAD_GROUP_PERCEPTION = "perception";
+const std::string THREAD_GROUP_EXECUTION = "execution";
+
+namespace
+{
+const std::string LOGNAME = "thread_groups";
+
+bool parseCpu(const std::string& text, int& cpu)
+{
+  char* end;
+  long value = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || value < 0)
+    return false;
+  cpu = static_cast<int>(value);
+  return true;
+}
+}
+
+bool parseCpuList(const std::string& list, std::vector<int>& cpus)
+{
+  cpus.clear();
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ','))
+  {
+    range.erase(0, range.find_first_not_of(' '));
+    range.erase(range.find_last_not_of(' ') + 1);
+    std::size_t dash = range.find('-');
+    int first, last;
+    if (dash == std::string::npos)
+    {
+      if (!parseCpu(range, first))
+        return false;
+      last = first;
+    }
+    else if (!parseCpu(range.substr(0, dash), first) || !parseCpu(range.substr(dash + 1), last) || last < first)
+      return false;
+    for (int cpu = first; cpu <= last; ++cpu)
+      cpus.push_back(cpu);
+  }
+  return !cpus.empty();
+}
+
+ThreadGroupRegistry& ThreadGroupRegistry::instance()
+{
+  static ThreadGroupRegistry registry;
+  return registry;
+}
+
+void ThreadGroupRegistry::configure(const std::string& group, const ThreadGroupSettings& settings)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  groups_[group] = settings;
+}
+
+bool ThreadGroupRegistry::getSettings(const std::string& group, ThreadGroupSettings& settings) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  std::map<std::string, ThreadGroupSettings>::const_iterator it = groups_.find(group);
+  if (it == groups_.end())
+    return false;
+  settings = it->second;
+  return true;
+}
+
+bool ThreadGroupRegistry::applyToCurrentThread(const std::string& group) const
+{
+  ThreadGroupSettings settings;
+  if (!getSettings(group, settings))
+    return true;
+
+  bool ok = true;
+#ifdef __linux__
+  if (!settings.cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (std::size_t i = 0; i < settings.cpus.size(); ++i)
+      if (settings.cpus[i] < CPU_SETSIZE)
+        CPU_SET(settings.cpus[i], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+      ROS_WARN_NAMED(LOGNAME, "Unable to set the CPU affinity of a thread of group '%s'", group.c_str());
+      ok = false;
+    }
+  }
+  if (settings.priority > 0)
+  {
+    sched_param param;
+    param.sched_priority = settings.priority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+    {
+      ROS_WARN_NAMED(LOGNAME, "Unable to set the real-time priority %d of a thread of group '%s'", settings.priority,
+                     group.c_str());
+      ok = false;
+    }
+  }
+  else if (settings.nice != 0)
+  {
+    // on Linux, the nice value of a thread id only applies to that thread
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), settings.nice) != 0)
+    {
+      ROS_WARN_NAMED(LOGNAME, "Unable to set the nice value %d of a thread of group '%s'", settings.nice,
+                     group.c_str());
+      ok = false;
+    }
+  }
+#else
+  if (!settings.cpus.empty() || settings.priority > 0 || settings.nice != 0)
+  {
+    ROS_WARN_NAMED(LOGNAME, "Thread scheduling of group '%s' is only supported on Linux", group.c_str());
+    ok = false;
+  }
+#endif
+  return ok;
+}
+}
+}
@@ -162,6 +162,7 @@ public:
 
   collision_detection::GroupStateRepresentationConstPtr getLastGroupStateRepresentation() const
   {
+    boost::mutex::scoped_lock slock(last_gsr_lock_);
     return last_gsr_;
   }
 
@@ -188,6 +189,13 @@ protected:
 
   static void notifyObjectChange(CollisionWorldDistanceField* self, const ObjectConstPtr& obj, World::Action action);
 
+  /** \brief Checks may run concurrently, so the last representation is only replaced under a lock */
+  void setLastGroupStateRepresentation(const GroupStateRepresentationPtr& gsr) const
+  {
+    boost::mutex::scoped_lock slock(last_gsr_lock_);
+    const_cast<CollisionWorldDistanceField*>(this)->last_gsr_ = gsr;
+  }
+
   Eigen::Vector3d size_;
   Eigen::Vector3d origin_;
   bool use_signed_distance_field_;
@@ -197,6 +205,7 @@ protected:
 
   mutable boost::mutex update_cache_lock_;
   DistanceFieldCacheEntryPtr distance_field_cache_entry_;
+  mutable boost::mutex last_gsr_lock_;
   GroupStateRepresentationPtr last_gsr_;
   World::ObserverHandle observer_handle_;
 };
@@ -137,14 +137,19 @@ bool collision_detection::getCollisionSphereGradients(const distance_field::Dist
 {
   // assumes gradient is properly initialized
 
+  // look up all spheres at once
+  std::vector<double> distances;
+  EigenSTL::vector_Vector3d gradients;
+  std::vector<bool> in_bounds;
+  distance_field->getDistanceGradients(sphere_centers, distances, gradients, in_bounds);
+
   bool in_collision = false;
   for (unsigned int i = 0; i < sphere_list.size(); i++)
   {
-    Eigen::Vector3d p = sphere_centers[i];
-    Eigen::Vector3d grad;
-    bool in_bounds;
-    double dist = distance_field->getDistanceGradient(p.x(), p.y(), p.z(), grad.x(), grad.y(), grad.z(), in_bounds);
-    if (!in_bounds && grad.norm() > EPSILON)
+    const Eigen::Vector3d& p = sphere_centers[i];
+    const Eigen::Vector3d& grad = gradients[i];
+    double dist = distances[i];
+    if (!in_bounds[i] && grad.norm() > EPSILON)
     {
       ROS_DEBUG("Collision sphere point is out of bounds %lf, %lf, %lf", p.x(), p.y(), p.z());
       return true;
@@ -195,18 +200,12 @@ bool collision_detection::getCollisionSphereCollision(const distance_field::Dist
                                                       const EigenSTL::vector_Vector3d& sphere_centers,
                                                       double maximum_value, double tolerance)
 {
+  // only distances are needed here; computing gradients would cost six more lookups per sphere. Points out of
+  // bounds get the uninitialized distance, so they are never in collision.
   for (unsigned int i = 0; i < sphere_list.size(); i++)
   {
-    Eigen::Vector3d p = sphere_centers[i];
-    Eigen::Vector3d grad;
-    bool in_bounds = true;
-    double dist = distance_field->getDistanceGradient(p.x(), p.y(), p.z(), grad.x(), grad.y(), grad.z(), in_bounds);
-
-    if (!in_bounds && grad.norm() > 0)
-    {
-      ROS_DEBUG("Collision sphere point is out of bounds");
-      return true;
-    }
+    const Eigen::Vector3d& p = sphere_centers[i];
+    double dist = distance_field->getDistance(p.x(), p.y(), p.z());
 
     if ((maximum_value > dist) && (sphere_list[i].radius_ - dist > tolerance))
     {
@@ -226,15 +225,8 @@ bool collision_detection::getCollisionSphereCollision(const distance_field::Dist
   colls.clear();
   for (unsigned int i = 0; i < sphere_list.size(); i++)
   {
-    Eigen::Vector3d p = sphere_centers[i];
-    Eigen::Vector3d grad;
-    bool in_bounds = true;
-    double dist = distance_field->getDistanceGradient(p.x(), p.y(), p.z(), grad.x(), grad.y(), grad.z(), in_bounds);
-    if (!in_bounds && (grad.norm() > 0))
-    {
-      ROS_DEBUG("Collision sphere point is out of bounds");
-      return true;
-    }
+    const Eigen::Vector3d& p = sphere_centers[i];
+    double dist = distance_field->getDistance(p.x(), p.y(), p.z());
     if (maximum_value > dist && (sphere_list[i].radius_ - dist > tolerance))
     {
       if (num_coll == 0)
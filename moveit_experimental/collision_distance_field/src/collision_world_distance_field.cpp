@@ -143,7 +143,7 @@ void CollisionWorldDistanceField::checkCollision(const CollisionRequest& req, Co
     return;
   }
 
-  (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+  setLastGroupStateRepresentation(gsr);
 }
 
 void CollisionWorldDistanceField::checkCollision(const CollisionRequest& req, CollisionResult& res,
@@ -186,7 +186,7 @@ void CollisionWorldDistanceField::checkCollision(const CollisionRequest& req, Co
     return;
   }
 
-  (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+  setLastGroupStateRepresentation(gsr);
 }
 
 void CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest& req, CollisionResult& res,
@@ -215,7 +215,7 @@ void CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest& re
       cdr.updateGroupStateRepresentationState(state, gsr);
     }
     getEnvironmentCollisions(req, res, env_distance_field, gsr);
-    (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+    setLastGroupStateRepresentation(gsr);
 
     // checkRobotCollisionHelper(req, res, robot, state, &acm);
   }
@@ -253,7 +253,7 @@ void CollisionWorldDistanceField::checkRobotCollision(const CollisionRequest& re
       cdr.updateGroupStateRepresentationState(state, gsr);
     }
     getEnvironmentCollisions(req, res, env_distance_field, gsr);
-    (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+    setLastGroupStateRepresentation(gsr);
 
     // checkRobotCollisionHelper(req, res, robot, state, &acm);
   }
@@ -292,7 +292,7 @@ void CollisionWorldDistanceField::getCollisionGradients(const CollisionRequest&
     return;
   }
 
-  (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+  setLastGroupStateRepresentation(gsr);
 }
 
 void CollisionWorldDistanceField::getAllCollisions(const CollisionRequest& req, CollisionResult& res,
@@ -322,7 +322,7 @@ void CollisionWorldDistanceField::getAllCollisions(const CollisionRequest& req,
     return;
   }
 
-  (const_cast<CollisionWorldDistanceField*>(this))->last_gsr_ = gsr;
+  setLastGroupStateRepresentation(gsr);
 }
 
 bool CollisionWorldDistanceField::getEnvironmentCollisions(
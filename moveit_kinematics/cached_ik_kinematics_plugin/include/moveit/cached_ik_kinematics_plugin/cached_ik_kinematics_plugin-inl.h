@@ -111,8 +111,10 @@ bool CachedIKKinematicsPlugin<KinematicsPlugin>::getPositionIK(const geometry_ms
 {
   Pose pose(ik_pose);
   const IKEntry& nearest = cache_.getBestApproximateIKSolution(pose);
-  bool solution_found = KinematicsPlugin::getPositionIK(ik_pose, nearest.second, solution, error_code, options) ||
-                        KinematicsPlugin::getPositionIK(ik_pose, ik_seed_state, solution, error_code, options);
+  bool solution_found = KinematicsPlugin::getPositionIK(ik_pose, nearest.second, solution, error_code, options);
+  cache_.recordQuery(solution_found);
+  solution_found =
+      solution_found || KinematicsPlugin::getPositionIK(ik_pose, ik_seed_state, solution, error_code, options);
   if (solution_found)
     cache_.updateCache(nearest, pose, solution);
   return solution_found;
@@ -130,6 +132,7 @@ bool CachedIKKinematicsPlugin<KinematicsPlugin>::searchPositionIK(const geometry
   const IKEntry& nearest = cache_.getBestApproximateIKSolution(pose);
   bool solution_found =
       KinematicsPlugin::searchPositionIK(ik_pose, nearest.second, timeout, solution, error_code, options);
+  cache_.recordQuery(solution_found);
   if (!solution_found)
   {
     std::chrono::duration<double> diff = std::chrono::system_clock::now() - start;
@@ -152,6 +155,7 @@ bool CachedIKKinematicsPlugin<KinematicsPlugin>::searchPositionIK(
   const IKEntry& nearest = cache_.getBestApproximateIKSolution(pose);
   bool solution_found = KinematicsPlugin::searchPositionIK(ik_pose, nearest.second, timeout, consistency_limits,
                                                            solution, error_code, options);
+  cache_.recordQuery(solution_found);
   if (!solution_found)
   {
     std::chrono::duration<double> diff = std::chrono::system_clock::now() - start;
@@ -176,6 +180,7 @@ bool CachedIKKinematicsPlugin<KinematicsPlugin>::searchPositionIK(const geometry
   const IKEntry& nearest = cache_.getBestApproximateIKSolution(pose);
   bool solution_found = KinematicsPlugin::searchPositionIK(ik_pose, nearest.second, timeout, solution,
                                                            solution_callback, error_code, options);
+  cache_.recordQuery(solution_found);
   if (!solution_found)
   {
     std::chrono::duration<double> diff = std::chrono::system_clock::now() - start;
@@ -198,6 +203,7 @@ bool CachedIKKinematicsPlugin<KinematicsPlugin>::searchPositionIK(
   const IKEntry& nearest = cache_.getBestApproximateIKSolution(pose);
   bool solution_found = KinematicsPlugin::searchPositionIK(ik_pose, nearest.second, timeout, consistency_limits,
                                                            solution, solution_callback, error_code, options);
+  cache_.recordQuery(solution_found);
   if (!solution_found)
   {
     std::chrono::duration<double> diff = std::chrono::system_clock::now() - start;
@@ -224,6 +230,7 @@ bool CachedMultiTipIKKinematicsPlugin<KinematicsPlugin>::searchPositionIK(
   bool solution_found =
       KinematicsPlugin::searchPositionIK(ik_poses, nearest.second, timeout, consistency_limits, solution,
                                          solution_callback, error_code, options, context_state);
+  CachedIKKinematicsPlugin<KinematicsPlugin>::cache_.recordQuery(solution_found);
   if (!solution_found)
   {
     std::chrono::duration<double> diff = std::chrono::system_clock::now() - start;
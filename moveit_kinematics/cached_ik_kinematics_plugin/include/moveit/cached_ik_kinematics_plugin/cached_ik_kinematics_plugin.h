@@ -44,12 +44,23 @@
 #include <moveit/cached_ik_kinematics_plugin/detail/NearestNeighborsGNAT.h>
 #include <boost/filesystem.hpp>
 #include <unordered_map>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <utility>
 
 namespace cached_ik_kinematics_plugin
 {
-/** \brief A cache of inverse kinematic solutions */
+/**
+  \brief A cache of inverse kinematic solutions
+
+  Lookups do not lock: they query the most recently published
+  nearest-neighbor structure and scan the few entries added since it
+  was built. A background thread indexes new entries in batches and
+  appends them to the cache file.
+*/
 class IKCache
 {
 public:
@@ -88,9 +99,20 @@ public:
   */
   using IKEntry = std::pair<std::vector<Pose>, std::vector<double>>;
 
+  /** statistics on the use of the cache, e.g., to choose max_cache_size */
+  struct Statistics
+  {
+    /** number of IK queries seeded from the cache */
+    std::size_t queries;
+    /** number of those queries that were solved from the cached seed */
+    std::size_t hits;
+    /** number of entries in the cache */
+    unsigned int size;
+  };
+
   IKCache();
   ~IKCache();
-  IKCache(const IKCache&) = default;
+  IKCache(const IKCache&) = delete;
 
   /** get the entry from the IK cache that best matches a given pose */
   const IKEntry& getBestApproximateIKSolution(const Pose& pose) const;
@@ -111,11 +133,34 @@ public:
   void updateCache(const IKEntry& nearest, const std::vector<Pose>& poses, const std::vector<double>& config) const;
   /** verify with forward kinematics that that the cache entries are correct */
   void verifyCache(kdl_kinematics_plugin::KDLKinematicsPlugin& fk) const;
+  /** record whether an IK query was solved from the seed returned by getBestApproximateIKSolution() */
+  void recordQuery(bool hit) const;
+  /** get the statistics on the use of the cache */
+  Statistics getStatistics() const;
 
 protected:
+  /** nearest neighbor data structure over the first \e size cache entries; it is not changed once published */
+  struct Snapshot
+  {
+    NearestNeighborsGNAT<IKEntry*> nn;
+    unsigned int size{ 0 };
+  };
+
+  /** compute the distance between the poses of two cache entries */
+  static double poseDistance(const std::vector<Pose>& poses1, const std::vector<Pose>& poses2);
   /** compute the distance between two joint configurations */
   double configDistance2(const std::vector<double>& config1, const std::vector<double>& config2) const;
-  /** save current state of cache to disk */
+  /** get the entry that best matches the poses of the query */
+  const IKEntry& getBestApproximateIKSolution(const IKEntry& query) const;
+  /** append an entry to the cache and request indexing once enough entries are not indexed yet */
+  void addEntry(const std::vector<Pose>& poses, const std::vector<double>& config) const;
+  /** index new entries whenever requested, until stopUpdates() is called */
+  void updateLoop() const;
+  /** publish a snapshot over all current entries and save them if enough of them are new */
+  void indexEntries() const;
+  /** stop the thread that indexes new entries */
+  void stopUpdates();
+  /** append the entries added since the last save to disk */
   void saveCache() const;
 
   /** number of joints in the system */
@@ -132,17 +177,30 @@ protected:
 
   /**
     the IK methods are declared const in the base class, but the
-    wrapped methods need to modify the cache, so the next four members
+    wrapped methods need to modify the cache, so the members below
     are mutable
-    cache of IK solutions
+    cache of IK solutions; it has max_cache_size_ slots, of which the
+    first cache_size_ are in use and never change again
   */
   mutable std::vector<IKEntry> ik_cache_;
-  /** nearest neighbor data structure over IK cache entries */
-  mutable NearestNeighborsGNAT<IKEntry*> ik_nn_;
+  /** number of cache entries in use */
+  mutable std::atomic<unsigned int> cache_size_{ 0 };
+  /** latest nearest neighbor data structure, accessed with std::atomic_load() and std::atomic_store() */
+  mutable std::shared_ptr<const Snapshot> snapshot_;
   /** size of the cache when it was last saved */
   mutable unsigned int last_saved_cache_size_{ 0 };
-  /** mutex for changing IK cache */
+  /** mutex for adding IK cache entries */
   mutable std::mutex lock_;
+  /** signals the update thread that new entries need indexing */
+  mutable std::condition_variable update_condition_;
+  /** whether new entries need indexing */
+  mutable bool update_requested_{ false };
+  /** whether the update thread needs to stop */
+  mutable bool stop_updates_{ false };
+  /** thread that indexes and saves new entries */
+  std::thread update_thread_;
+  /** counters for the cache statistics */
+  mutable std::atomic<std::size_t> num_queries_{ 0 }, num_hits_{ 0 };
 };
 
 /** a container of IK caches for cases where there is no fixed base frame */
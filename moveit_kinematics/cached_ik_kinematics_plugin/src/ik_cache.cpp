@@ -35,6 +35,8 @@
 /* Author: Mark Moll */
 
 #include <boost/filesystem/fstream.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <chrono>
 #include <cstdlib>
 #include <numeric>
@@ -43,29 +45,33 @@
 
 namespace cached_ik_kinematics_plugin
 {
+// number of new entries after which a new nearest neighbor data structure is built; entries that are not
+// indexed yet are scanned linearly by lookups
+static const unsigned int INDEX_BATCH_SIZE = 64;
+
 IKCache::IKCache()
 {
-  // set distance function for nearest-neighbor queries
-  ik_nn_.setDistanceFunction([this](const IKEntry* entry1, const IKEntry* entry2) {
-    double dist = 0.;
-    for (unsigned int i = 0; i < entry1->first.size(); ++i)
-      dist += entry1->first[i].distance(entry2->first[i]);
-    return dist;
-  });
 }
 
 IKCache::~IKCache()
 {
-  if (!ik_cache_.empty())
+  stopUpdates();
+  if (cache_size_ > 0)
+  {
     saveCache();
+    Statistics stats = getStatistics();
+    ROS_INFO_NAMED("cached_ik", "%zu of %zu IK queries were solved from seeds in the cache of %u entries",
+                   stats.hits, stats.queries, stats.size);
+  }
 }
 
 void IKCache::initializeCache(const std::string& robot_description, const std::string& group_name,
                               const std::string& cache_name, const unsigned int num_joints, Options opts)
 {
+  stopUpdates();
+
   // read ROS parameters
   max_cache_size_ = opts.max_cache_size;
-  ik_cache_.reserve(max_cache_size_);
   min_pose_distance_ = opts.min_pose_distance;
   min_config_distance2_ = opts.min_joint_config_distance;
   min_config_distance2_ *= min_config_distance2_;
@@ -82,61 +88,90 @@ void IKCache::initializeCache(const std::string& robot_description, const std::s
                                std::to_string(max_cache_size_) + "_" + std::to_string(min_pose_distance_) + "_" +
                                std::to_string(std::sqrt(min_config_distance2_)) + ".ikcache");
 
-  ik_cache_.clear();
-  ik_nn_.clear();
+  // entries are written into preallocated slots, so references to them stay valid while the cache grows
+  ik_cache_.assign(max_cache_size_, IKEntry());
+  cache_size_ = 0;
+  std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>());
   last_saved_cache_size_ = 0;
-  if (boost::filesystem::exists(cache_file_name_))
+  num_queries_ = 0;
+  num_hits_ = 0;
+  if (boost::filesystem::exists(cache_file_name_) && boost::filesystem::file_size(cache_file_name_) > 0)
   {
-    // read cache
-    boost::filesystem::ifstream cache_file(cache_file_name_, std::ios_base::binary | std::ios_base::in);
-    cache_file.read((char*)&last_saved_cache_size_, sizeof(unsigned int));
-    unsigned int num_dofs;
-    cache_file.read((char*)&num_dofs, sizeof(unsigned int));
-    unsigned int num_tips;
-    cache_file.read((char*)&num_tips, sizeof(unsigned int));
-
-    ROS_INFO_NAMED("cached_ik", "Found %d IK solutions for a %d-dof system with %d end effectors in %s",
-                   last_saved_cache_size_, num_dofs, num_tips, cache_file_name_.string().c_str());
-
-    unsigned int position_size = 3 * sizeof(tf2Scalar);
-    unsigned int orientation_size = 4 * sizeof(tf2Scalar);
-    unsigned int pose_size = position_size + orientation_size;
-    unsigned int config_size = num_dofs * sizeof(double);
-    unsigned int offset_conf = pose_size * num_tips;
-    unsigned int bufsize = offset_conf + config_size;
-    char* buffer = new char[bufsize];
-    IKEntry entry;
-    entry.first.resize(num_tips);
-    entry.second.resize(num_dofs);
-    ik_cache_.reserve(last_saved_cache_size_);
-
-    for (unsigned i = 0; i < last_saved_cache_size_; ++i)
+    try
     {
-      unsigned int j = 0;
-      cache_file.read(buffer, bufsize);
-      for (auto& pose : entry.first)
+      // read cache; the file is mapped into memory rather than read into a buffer
+      boost::interprocess::file_mapping cache_file(cache_file_name_.string().c_str(), boost::interprocess::read_only);
+      boost::interprocess::mapped_region region(cache_file, boost::interprocess::read_only);
+      const char* data = static_cast<const char*>(region.get_address());
+      std::size_t header_size = 3 * sizeof(unsigned int);
+      unsigned int saved_cache_size = 0, num_dofs = 0, num_tips = 0;
+      if (region.get_size() >= header_size)
+      {
+        memcpy(&saved_cache_size, data, sizeof(unsigned int));
+        memcpy(&num_dofs, data + sizeof(unsigned int), sizeof(unsigned int));
+        memcpy(&num_tips, data + 2 * sizeof(unsigned int), sizeof(unsigned int));
+      }
+
+      ROS_INFO_NAMED("cached_ik", "Found %d IK solutions for a %d-dof system with %d end effectors in %s",
+                     saved_cache_size, num_dofs, num_tips, cache_file_name_.string().c_str());
+
+      std::size_t position_size = 3 * sizeof(tf2Scalar);
+      std::size_t orientation_size = 4 * sizeof(tf2Scalar);
+      std::size_t pose_size = position_size + orientation_size;
+      std::size_t config_size = num_dofs * sizeof(double);
+      std::size_t offset_conf = pose_size * num_tips;
+      std::size_t entry_size = offset_conf + config_size;
+
+      // ignore entries that were not completely written, and entries beyond the size of the cache
+      if (entry_size > 0 && region.get_size() >= header_size)
+        saved_cache_size = std::min<std::size_t>(saved_cache_size, (region.get_size() - header_size) / entry_size);
+      saved_cache_size = std::min(saved_cache_size, max_cache_size_);
+
+      for (unsigned int i = 0; i < saved_cache_size; ++i)
       {
-        memcpy(&pose.position[0], buffer + j * pose_size, position_size);
-        memcpy(&pose.orientation[0], buffer + j * pose_size + position_size, orientation_size);
-        ++j;
+        const char* buffer = data + header_size + i * entry_size;
+        IKEntry& entry = ik_cache_[i];
+        entry.first.resize(num_tips);
+        entry.second.resize(num_dofs);
+        unsigned int j = 0;
+        for (auto& pose : entry.first)
+        {
+          memcpy(&pose.position[0], buffer + j * pose_size, position_size);
+          memcpy(&pose.orientation[0], buffer + j * pose_size + position_size, orientation_size);
+          ++j;
+        }
+        memcpy(&entry.second[0], buffer + offset_conf, config_size);
       }
-      memcpy(&entry.second[0], buffer + offset_conf, config_size);
-      ik_cache_.push_back(entry);
+      cache_size_ = saved_cache_size;
+      last_saved_cache_size_ = saved_cache_size;
+    }
+    catch (const boost::interprocess::interprocess_exception& e)
+    {
+      ROS_ERROR_NAMED("cached_ik", "Could not read IK cache %s: %s", cache_file_name_.string().c_str(), e.what());
+      cache_size_ = 0;
+      last_saved_cache_size_ = 0;
     }
-    ROS_INFO_NAMED("cached_ik", "freeing buffer");
-    delete buffer;
-    ROS_INFO_NAMED("cached_ik", "freed buffer");
-    std::vector<IKEntry*> ik_entry_ptrs(last_saved_cache_size_);
-    for (unsigned int i = 0; i < last_saved_cache_size_; ++i)
-      ik_entry_ptrs[i] = &ik_cache_[i];
-    ik_nn_.add(ik_entry_ptrs);
   }
 
   num_joints_ = num_joints;
 
+  // index the entries read from disk, then keep indexing new ones in the background
+  indexEntries();
+  stop_updates_ = false;
+  update_requested_ = false;
+  update_thread_ = std::thread([this]() { updateLoop(); });
+
   ROS_INFO_NAMED("cached_ik", "cache file %s initialized!", cache_file_name_.string().c_str());
 }
 
+double IKCache::poseDistance(const std::vector<Pose>& poses1, const std::vector<Pose>& poses2)
+{
+  double dist = 0.;
+  for (unsigned int i = 0; i < poses1.size(); ++i)
+    dist += poses1[i].distance(poses2[i]);
+  return dist;
+}
+
 double IKCache::configDistance2(const std::vector<double>& config1, const std::vector<double>& config2) const
 {
   double dist = 0., diff;
@@ -150,43 +185,62 @@ double IKCache::configDistance2(const std::vector<double>& config1, const std::v
 
 const IKCache::IKEntry& IKCache::getBestApproximateIKSolution(const Pose& pose) const
 {
-  if (ik_cache_.empty())
+  if (cache_size_ == 0)
   {
     static IKEntry dummy = std::make_pair(std::vector<Pose>(1, pose), std::vector<double>(num_joints_, 0.));
     return dummy;
   }
   IKEntry query = std::make_pair(std::vector<Pose>(1, pose), std::vector<double>());
-  return *ik_nn_.nearest(&query);
+  return getBestApproximateIKSolution(query);
 }
 
 const IKCache::IKEntry& IKCache::getBestApproximateIKSolution(const std::vector<Pose>& poses) const
 {
-  if (ik_cache_.empty())
+  if (cache_size_ == 0)
   {
     static IKEntry dummy = std::make_pair(poses, std::vector<double>(num_joints_, 0.));
     return dummy;
   }
   IKEntry query = std::make_pair(poses, std::vector<double>());
-  return *ik_nn_.nearest(&query);
+  return getBestApproximateIKSolution(query);
 }
 
-void IKCache::updateCache(const IKEntry& nearest, const Pose& pose, const std::vector<double>& config) const
+const IKCache::IKEntry& IKCache::getBestApproximateIKSolution(const IKEntry& query) const
 {
-  if (ik_cache_.size() < ik_cache_.capacity() && (nearest.first[0].distance(pose) > min_pose_distance_ ||
-                                                  configDistance2(nearest.second, config) > min_config_distance2_))
+  unsigned int size = cache_size_;
+  std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&snapshot_);
+  const IKEntry* nearest = nullptr;
+  double min_dist = 0.;
+  unsigned int first_unindexed = 0;
+  if (snapshot && snapshot->size > 0)
   {
-    std::lock_guard<std::mutex> slock(lock_);
-    ik_cache_.emplace_back(std::vector<Pose>(1u, pose), config);
-    ik_nn_.add(&ik_cache_.back());
-    if (ik_cache_.size() >= last_saved_cache_size_ + 500u || ik_cache_.size() == max_cache_size_)
-      saveCache();
+    nearest = snapshot->nn.nearest(const_cast<IKEntry*>(&query));
+    min_dist = poseDistance(query.first, nearest->first);
+    first_unindexed = snapshot->size;
+  }
+  for (unsigned int i = first_unindexed; i < size; ++i)
+  {
+    double dist = poseDistance(query.first, ik_cache_[i].first);
+    if (!nearest || dist < min_dist)
+    {
+      nearest = &ik_cache_[i];
+      min_dist = dist;
+    }
   }
+  return *nearest;
+}
+
+void IKCache::updateCache(const IKEntry& nearest, const Pose& pose, const std::vector<double>& config) const
+{
+  if (cache_size_ < max_cache_size_ && (nearest.first[0].distance(pose) > min_pose_distance_ ||
+                                        configDistance2(nearest.second, config) > min_config_distance2_))
+    addEntry(std::vector<Pose>(1u, pose), config);
 }
 
 void IKCache::updateCache(const IKEntry& nearest, const std::vector<Pose>& poses,
                           const std::vector<double>& config) const
 {
-  if (ik_cache_.size() < ik_cache_.capacity())
+  if (cache_size_ < max_cache_size_)
   {
     bool add_to_cache = configDistance2(nearest.second, config) > min_config_distance2_;
     if (!add_to_cache)
@@ -203,24 +257,95 @@ void IKCache::updateCache(const IKEntry& nearest, const std::vector<Pose>& poses
       }
     }
     if (add_to_cache)
-    {
-      std::lock_guard<std::mutex> slock(lock_);
-      ik_cache_.emplace_back(poses, config);
-      ik_nn_.add(&ik_cache_.back());
-      if (ik_cache_.size() >= last_saved_cache_size_ + 500u || ik_cache_.size() == max_cache_size_)
-        saveCache();
-    }
+      addEntry(poses, config);
+  }
+}
+
+void IKCache::addEntry(const std::vector<Pose>& poses, const std::vector<double>& config) const
+{
+  std::lock_guard<std::mutex> slock(lock_);
+  unsigned int size = cache_size_;
+  if (size >= max_cache_size_)
+    return;
+  ik_cache_[size].first = poses;
+  ik_cache_[size].second = config;
+  // publish the entry only once it is complete
+  cache_size_ = ++size;
+
+  std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&snapshot_);
+  unsigned int indexed = snapshot ? snapshot->size : 0;
+  if (size >= indexed + INDEX_BATCH_SIZE || size == max_cache_size_)
+  {
+    update_requested_ = true;
+    update_condition_.notify_one();
+  }
+}
+
+void IKCache::updateLoop() const
+{
+  std::unique_lock<std::mutex> ulock(lock_);
+  while (true)
+  {
+    update_condition_.wait(ulock, [this]() { return update_requested_ || stop_updates_; });
+    if (stop_updates_)
+      break;
+    update_requested_ = false;
+    // lookups and new entries do not wait for the index to be built
+    ulock.unlock();
+    indexEntries();
+    ulock.lock();
+  }
+}
+
+void IKCache::indexEntries() const
+{
+  unsigned int size = cache_size_;
+  std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+  snapshot->nn.setDistanceFunction(
+      [](const IKEntry* entry1, const IKEntry* entry2) { return poseDistance(entry1->first, entry2->first); });
+  std::vector<IKEntry*> ik_entry_ptrs(size);
+  for (unsigned int i = 0; i < size; ++i)
+    ik_entry_ptrs[i] = &ik_cache_[i];
+  snapshot->nn.add(ik_entry_ptrs);
+  snapshot->size = size;
+  std::atomic_store(&snapshot_, std::shared_ptr<const Snapshot>(snapshot));
+
+  if (size >= last_saved_cache_size_ + 500u || (size == max_cache_size_ && size > last_saved_cache_size_))
+    saveCache();
+}
+
+void IKCache::stopUpdates()
+{
+  if (!update_thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> slock(lock_);
+    stop_updates_ = true;
+    update_condition_.notify_one();
   }
+  update_thread_.join();
 }
 
 void IKCache::saveCache() const
 {
   if (cache_file_name_.empty())
+  {
     ROS_ERROR_NAMED("cached_ik", "can't save cache before initialization");
+    return;
+  }
 
-  ROS_INFO_NAMED("cached_ik", "writing %ld IK solutions to %s", ik_cache_.size(), cache_file_name_.string().c_str());
+  unsigned int size = cache_size_;
+  if (size == 0 || size == last_saved_cache_size_)
+    return;
 
-  boost::filesystem::ofstream cache_file(cache_file_name_, std::ios_base::binary | std::ios_base::out);
+  ROS_INFO_NAMED("cached_ik", "appending %u IK solutions to the %u in %s", size - last_saved_cache_size_,
+                 last_saved_cache_size_, cache_file_name_.string().c_str());
+
+  // entries are only ever appended, so only the new ones are written, followed by the number of entries in the header
+  bool append = last_saved_cache_size_ > 0 && boost::filesystem::exists(cache_file_name_);
+  std::ios_base::openmode mode = std::ios_base::binary | std::ios_base::out;
+  mode |= append ? std::ios_base::in : std::ios_base::trunc;
+  boost::filesystem::fstream cache_file(cache_file_name_, mode);
   unsigned int position_size = 3 * sizeof(tf2Scalar);
   unsigned int orientation_size = 4 * sizeof(tf2Scalar);
   unsigned int pose_size = position_size + orientation_size;
@@ -228,25 +353,33 @@ void IKCache::saveCache() const
   unsigned int config_size = ik_cache_[0].second.size() * sizeof(double);
   unsigned int offset_conf = num_tips * pose_size;
   unsigned int bufsize = offset_conf + config_size;
-  char* buffer = new char[bufsize];
-
-  // write number of IK entries and size of each configuration first
-  last_saved_cache_size_ = ik_cache_.size();
-  cache_file.write((char*)&last_saved_cache_size_, sizeof(unsigned int));
-  unsigned int sz = ik_cache_[0].second.size();
-  cache_file.write((char*)&sz, sizeof(unsigned int));
-  cache_file.write((char*)&num_tips, sizeof(unsigned int));
-  for (const auto& entry : ik_cache_)
+  unsigned int header_size = 3 * sizeof(unsigned int);
+  std::vector<char> buffer(bufsize);
+
+  if (!append)
   {
+    // write number of IK entries and size of each configuration first
+    last_saved_cache_size_ = 0;
+    cache_file.write((char*)&last_saved_cache_size_, sizeof(unsigned int));
+    unsigned int sz = ik_cache_[0].second.size();
+    cache_file.write((char*)&sz, sizeof(unsigned int));
+    cache_file.write((char*)&num_tips, sizeof(unsigned int));
+  }
+  cache_file.seekp(header_size + static_cast<std::streamoff>(last_saved_cache_size_) * bufsize);
+  for (unsigned int k = last_saved_cache_size_; k < size; ++k)
+  {
+    const IKEntry& entry = ik_cache_[k];
     for (unsigned int i = 0; i < num_tips; ++i)
     {
-      memcpy(buffer + i * pose_size, &entry.first[i].position[0], position_size);
-      memcpy(buffer + i * pose_size + position_size, &entry.first[i].orientation[0], orientation_size);
+      memcpy(&buffer[i * pose_size], &entry.first[i].position[0], position_size);
+      memcpy(&buffer[i * pose_size + position_size], &entry.first[i].orientation[0], orientation_size);
     }
-    memcpy(buffer + offset_conf, &entry.second[0], config_size);
-    cache_file.write(buffer, bufsize);
+    memcpy(&buffer[offset_conf], &entry.second[0], config_size);
+    cache_file.write(&buffer[0], bufsize);
   }
-  delete buffer;
+  cache_file.seekp(0);
+  cache_file.write((char*)&size, sizeof(unsigned int));
+  last_saved_cache_size_ = size;
 }
 
 void IKCache::verifyCache(kdl_kinematics_plugin::KDLKinematicsPlugin& fk) const
@@ -255,8 +388,9 @@ void IKCache::verifyCache(kdl_kinematics_plugin::KDLKinematicsPlugin& fk) const
   std::vector<geometry_msgs::Pose> poses(tip_names.size());
   double error, max_error = 0.;
 
-  for (const auto& entry : ik_cache_)
+  for (unsigned int k = 0; k < cache_size_; ++k)
   {
+    const IKEntry& entry = ik_cache_[k];
     fk.getPositionFK(tip_names, entry.second, poses);
     error = 0.;
     for (unsigned int i = 0; i < poses.size(); ++i)
@@ -271,6 +405,22 @@ void IKCache::verifyCache(kdl_kinematics_plugin::KDLKinematicsPlugin& fk) const
   ROS_INFO_NAMED("cached_ik", "Max. error in cache entries is %g", max_error);
 }
 
+void IKCache::recordQuery(bool hit) const
+{
+  ++num_queries_;
+  if (hit)
+    ++num_hits_;
+}
+
+IKCache::Statistics IKCache::getStatistics() const
+{
+  Statistics stats;
+  stats.queries = num_queries_;
+  stats.hits = num_hits_;
+  stats.size = cache_size_;
+  return stats;
+}
+
 IKCache::Pose::Pose(const geometry_msgs::Pose& pose)
 {
   position.setX(pose.position.x);
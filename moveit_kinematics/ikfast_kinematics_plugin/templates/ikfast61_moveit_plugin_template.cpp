@@ -136,18 +136,6 @@ enum IkParameterizationType
   /// when serializing the ik parameterizations
 };
 
-// struct for storing and sorting solutions
-struct LimitObeyingSol
-{
-  std::vector<double> value;
-  double dist_from_seed;
-
-  bool operator<(const LimitObeyingSol& a) const
-  {
-    return dist_from_seed < a.dist_from_seed;
-  }
-};
-
 // Code generated by IKFast56/61
 #include "_ROBOT_NAME___GROUP_NAME__ikfast_solver.cpp"
 
@@ -157,6 +145,8 @@ class IKFastKinematicsPlugin : public kinematics::KinematicsBase
   std::vector<double> joint_min_vector_;
   std::vector<double> joint_max_vector_;
   std::vector<bool> joint_has_limits_vector_;
+  std::vector<double> joint_lower_bounds_;  // joint_min_vector_, or -inf for joints without limits
+  std::vector<double> joint_upper_bounds_;  // joint_max_vector_, or +inf for joints without limits
   std::vector<std::string> link_names_;
   const size_t num_joints_;
   std::vector<int> free_params_;
@@ -319,6 +309,16 @@ private:
   void getSolution(const IkSolutionList<IkReal>& solutions, const std::vector<double>& ik_seed_state, int i,
                    std::vector<double>& solution) const;
 
+  /**
+   * @brief Checks whether all joints of a solution are within their limits, widened by tolerance
+   */
+  bool obeysLimits(const std::vector<double>& solution, double tolerance) const;
+
+  /**
+   * @brief Sum of the absolute differences between the joints of a solution and the seed state
+   */
+  double distanceFromSeed(const std::vector<double>& ik_seed_state, const std::vector<double>& solution) const;
+
   double harmonize(const std::vector<double>& ik_seed_state, std::vector<double>& solution) const;
   // void getOrderedSolutions(const std::vector<double> &ik_seed_state, std::vector<std::vector<double> >& solslist);
   void getClosestSolution(const IkSolutionList<IkReal>& solutions, const std::vector<double>& ik_seed_state,
@@ -453,6 +453,16 @@ bool IKFastKinematicsPlugin::initialize(const std::string& robot_description, co
     ROS_DEBUG_STREAM_NAMED(name_, joint_names_[i] << " " << joint_min_vector_[i] << " " << joint_max_vector_[i] << " "
                                                   << joint_has_limits_vector_[i]);
 
+  // contiguous bounds let the limit checks of IK solutions run without branching on joint_has_limits_vector_
+  joint_lower_bounds_.resize(num_joints_);
+  joint_upper_bounds_.resize(num_joints_);
+  for (size_t i = 0; i < num_joints_; ++i)
+  {
+    double unlimited = std::numeric_limits<double>::infinity();
+    joint_lower_bounds_[i] = joint_has_limits_vector_[i] ? joint_min_vector_[i] : -unlimited;
+    joint_upper_bounds_[i] = joint_has_limits_vector_[i] ? joint_max_vector_[i] : unlimited;
+  }
+
   active_ = true;
   return true;
 }
@@ -648,6 +658,27 @@ void IKFastKinematicsPlugin::getSolution(const IkSolutionList<IkReal>& solutions
   }
 }
 
+bool IKFastKinematicsPlugin::obeysLimits(const std::vector<double>& solution, double tolerance) const
+{
+  // no early exit, so that the loop over the contiguous bounds can be vectorized
+  const double* lower = &joint_lower_bounds_[0];
+  const double* upper = &joint_upper_bounds_[0];
+  const double* value = &solution[0];
+  int obeys_limits = 1;
+  for (std::size_t i = 0; i < num_joints_; ++i)
+    obeys_limits &= (value[i] >= lower[i] - tolerance) & (value[i] <= upper[i] + tolerance);
+  return obeys_limits;
+}
+
+double IKFastKinematicsPlugin::distanceFromSeed(const std::vector<double>& ik_seed_state,
+                                                const std::vector<double>& solution) const
+{
+  double dist_from_seed = 0.0;
+  for (std::size_t i = 0; i < num_joints_; ++i)
+    dist_from_seed += fabs(ik_seed_state[i] - solution[i]);
+  return dist_from_seed;
+}
+
 double IKFastKinematicsPlugin::harmonize(const std::vector<double>& ik_seed_state, std::vector<double>& solution) const
 {
   double dist_sqr = 0;
@@ -887,29 +918,22 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose
       return false;
     }
 
-    // sort solutions by their distance to the seed
-    std::vector<LimitObeyingSol> solutions_obey_limits;
+    // sort solutions by their distance to the seed; only their indices are sorted, the solutions are not copied
+    std::vector<std::pair<double, std::size_t>> solutions_by_distance(solutions.size());
     for (std::size_t i = 0; i < solutions.size(); ++i)
-    {
-      double dist_from_seed = 0.0;
-      for (std::size_t j = 0; j < ik_seed_state.size(); ++j)
-      {
-        dist_from_seed += fabs(ik_seed_state[j] - solutions[i][j]);
-      }
-
-      solutions_obey_limits.push_back({ solutions[i], dist_from_seed });
-    }
-    std::sort(solutions_obey_limits.begin(), solutions_obey_limits.end());
+      solutions_by_distance[i] = std::make_pair(distanceFromSeed(ik_seed_state, solutions[i]), i);
+    std::sort(solutions_by_distance.begin(), solutions_by_distance.end());
 
     // check for collisions if a callback is provided
     if (!solution_callback.empty())
     {
-      for (std::size_t i = 0; i < solutions_obey_limits.size(); ++i)
+      for (std::size_t i = 0; i < solutions_by_distance.size(); ++i)
       {
-        solution_callback(ik_pose, solutions_obey_limits[i].value, error_code);
+        const std::vector<double>& candidate = solutions[solutions_by_distance[i].second];
+        solution_callback(ik_pose, candidate, error_code);
         if (error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
         {
-          solution = solutions_obey_limits[i].value;
+          solution = candidate;
           ROS_DEBUG_STREAM_NAMED(name_, "Solution passes callback");
           return true;
         }
@@ -920,7 +944,7 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose
     }
     else
     {
-      solution = solutions_obey_limits[0].value;
+      solution = solutions[solutions_by_distance[0].second];
       error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
       return true;  // no collision check callback provided
     }
@@ -999,9 +1023,11 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose
   std::vector<double> best_solution;
   int nattempts = 0, nvalid = 0;
 
+  // the solution list and the candidate buffer are reused for every value of the free joint
+  IkSolutionList<IkReal> solutions;
+  std::vector<double> sol(num_joints_);
   while (true)
   {
-    IkSolutionList<IkReal> solutions;
     int numsol = solve(frame, vfree, solutions);
 
     ROS_DEBUG_STREAM_NAMED(name_, "Found " << numsol << " solutions from IKFast");
@@ -1013,23 +1039,11 @@ bool IKFastKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose
       for (int s = 0; s < numsol; ++s)
       {
         nattempts++;
-        std::vector<double> sol;
         getSolution(solutions, ik_seed_state, s, sol);
 
-        bool obeys_limits = true;
-        for (unsigned int i = 0; i < sol.size(); i++)
+        if (obeysLimits(sol, 0.0))
         {
-          if (joint_has_limits_vector_[i] && (sol[i] < joint_min_vector_[i] || sol[i] > joint_max_vector_[i]))
-          {
-            obeys_limits = false;
-            break;
-          }
-          // ROS_INFO_STREAM_NAMED(name_,"Num " << i << " value " << sol[i] << " has limits " <<
-          // joint_has_limits_vector_[i] << " " << joint_min_vector_[i] << " " << joint_max_vector_[i]);
-        }
-        if (obeys_limits)
-        {
-          getSolution(solutions, ik_seed_state, s, solution);
+          solution = sol;
 
           // This solution is within joint limits, now check if in collision (if callback provided)
           if (!solution_callback.empty())
@@ -1131,7 +1145,7 @@ bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose& ik_pose, c
   for (std::size_t i = 0; i < free_params_.size(); ++i)
   {
     int p = free_params_[i];
-    ROS_ERROR("%u is %f", p, ik_seed_state[p]);  // DTC
+    ROS_DEBUG_NAMED(name_, "Free parameter %d is %f", p, ik_seed_state[p]);
     vfree[i] = ik_seed_state[p];
   }
 
@@ -1142,44 +1156,29 @@ bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose& ik_pose, c
   int numsol = solve(frame, vfree, solutions);
   ROS_DEBUG_STREAM_NAMED(name_, "Found " << numsol << " solutions from IKFast");
 
-  std::vector<LimitObeyingSol> solutions_obey_limits;
-
+  // keep the solution under limits that is closest to ik_seed_state; candidates are evaluated in a reused buffer
+  double best_dist_from_seed = -1.0;
   if (numsol)
   {
-    std::vector<double> solution_obey_limits;
+    std::vector<double> sol(num_joints_);
     for (std::size_t s = 0; s < numsol; ++s)
     {
-      std::vector<double> sol;
       getSolution(solutions, ik_seed_state, s, sol);
       ROS_DEBUG_NAMED(name_, "Sol %d: %e   %e   %e   %e   %e   %e", (int)s, sol[0], sol[1], sol[2], sol[3], sol[4],
                       sol[5]);
 
-      bool obeys_limits = true;
-      for (std::size_t i = 0; i < sol.size(); i++)
+      // Add tolerance to limit check
+      if (!obeysLimits(sol, LIMIT_TOLERANCE))
       {
-        // Add tolerance to limit check
-        if (joint_has_limits_vector_[i] && ((sol[i] < (joint_min_vector_[i] - LIMIT_TOLERANCE)) ||
-                                            (sol[i] > (joint_max_vector_[i] + LIMIT_TOLERANCE))))
-        {
-          // One element of solution is not within limits
-          obeys_limits = false;
-          ROS_DEBUG_STREAM_NAMED(name_, "Not in limits! " << (int)i << " value " << sol[i] << " has limit: "
-                                                          << joint_has_limits_vector_[i] << "  being  "
-                                                          << joint_min_vector_[i] << " to " << joint_max_vector_[i]);
-          break;
-        }
+        ROS_DEBUG_STREAM_NAMED(name_, "Solution " << s << " is not within limits");
+        continue;
       }
-      if (obeys_limits)
-      {
-        // All elements of this solution obey limits
-        getSolution(solutions, ik_seed_state, s, solution_obey_limits);
-        double dist_from_seed = 0.0;
-        for (std::size_t i = 0; i < ik_seed_state.size(); ++i)
-        {
-          dist_from_seed += fabs(ik_seed_state[i] - solution_obey_limits[i]);
-        }
 
-        solutions_obey_limits.push_back({ solution_obey_limits, dist_from_seed });
+      double dist_from_seed = distanceFromSeed(ik_seed_state, sol);
+      if (best_dist_from_seed < 0.0 || dist_from_seed < best_dist_from_seed)
+      {
+        best_dist_from_seed = dist_from_seed;
+        solution = sol;
       }
     }
   }
@@ -1188,11 +1187,8 @@ bool IKFastKinematicsPlugin::getPositionIK(const geometry_msgs::Pose& ik_pose, c
     ROS_DEBUG_STREAM_NAMED(name_, "No IK solution");
   }
 
-  // Sort the solutions under limits and find the one that is closest to ik_seed_state
-  if (!solutions_obey_limits.empty())
+  if (best_dist_from_seed >= 0.0)
   {
-    std::sort(solutions_obey_limits.begin(), solutions_obey_limits.end());
-    solution = solutions_obey_limits[0].value;
     error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
     return true;
   }
@@ -1240,11 +1236,29 @@ bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose
   KDL::Frame frame;
   tf::poseMsgToKDL(ik_poses[0], frame);
 
-  // solving ik
-  std::vector<IkSolutionList<IkReal>> solution_set;
+  // solving ik; the solutions of each value of the redundant joint are filtered as soon as they are found, so the
+  // solution lists need not be stored
   IkSolutionList<IkReal> ik_solutions;
   std::vector<double> vfree;
   int numsol = 0;
+  bool solutions_found = false;
+  std::vector<double> sol(num_joints_);
+  auto collect_solutions = [&]() {
+    int n = ik_solutions.GetNumSolutions();
+    for (int s = 0; s < n; ++s)
+    {
+      getSolution(ik_solutions, ik_seed_state, s, sol);
+      // Add tolerance to limit check
+      if (obeysLimits(sol, LIMIT_TOLERANCE))
+      {
+        // All elements of solution obey limits
+        solutions_found = true;
+        solutions.push_back(sol);
+      }
+      else
+        ROS_DEBUG_STREAM_NAMED(name_, "Solution " << s << " is not within limits");
+    }
+  };
   std::vector<double> sampled_joint_vals;
   if (!redundant_joint_indices_.empty())
   {
@@ -1279,56 +1293,19 @@ bool IKFastKinematicsPlugin::getPositionIK(const std::vector<geometry_msgs::Pose
       vfree.clear();
       vfree.push_back(sampled_joint_vals[i]);
       numsol += solve(frame, vfree, ik_solutions);
-      solution_set.push_back(ik_solutions);
+      collect_solutions();
     }
   }
   else
   {
     // computing for single solution set
     numsol = solve(frame, vfree, ik_solutions);
-    solution_set.push_back(ik_solutions);
+    collect_solutions();
   }
 
   ROS_DEBUG_STREAM_NAMED(name_, "Found " << numsol << " solutions from IKFast");
-  bool solutions_found = false;
   if (numsol > 0)
   {
-    /*
-      Iterating through all solution sets and storing those that do not exceed joint limits.
-    */
-    for (unsigned int r = 0; r < solution_set.size(); r++)
-    {
-      ik_solutions = solution_set[r];
-      numsol = ik_solutions.GetNumSolutions();
-      for (int s = 0; s < numsol; ++s)
-      {
-        std::vector<double> sol;
-        getSolution(ik_solutions, ik_seed_state, s, sol);
-
-        bool obeys_limits = true;
-        for (unsigned int i = 0; i < sol.size(); i++)
-        {
-          // Add tolerance to limit check
-          if (joint_has_limits_vector_[i] && ((sol[i] < (joint_min_vector_[i] - LIMIT_TOLERANCE)) ||
-                                              (sol[i] > (joint_max_vector_[i] + LIMIT_TOLERANCE))))
-          {
-            // One element of solution is not within limits
-            obeys_limits = false;
-            ROS_DEBUG_STREAM_NAMED(name_, "Not in limits! " << i << " value " << sol[i] << " has limit: "
-                                                            << joint_has_limits_vector_[i] << "  being  "
-                                                            << joint_min_vector_[i] << " to " << joint_max_vector_[i]);
-            break;
-          }
-        }
-        if (obeys_limits)
-        {
-          // All elements of solution obey limits
-          solutions_found = true;
-          solutions.push_back(sol);
-        }
-      }
-    }
-
     if (solutions_found)
     {
       result.kinematic_error = kinematics::KinematicErrors::OK;
@@ -62,6 +62,11 @@
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
 
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <atomic>
+
 namespace kdl_kinematics_plugin
 {
 /**
@@ -103,6 +108,16 @@ public:
                    const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
                    const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
 
+  /**
+   * @brief Solve the queries of the batch in concurrent threads, each of which reuses solvers of its own
+   */
+  virtual bool
+  searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                        const std::vector<std::vector<double> >& ik_seed_states, double timeout,
+                        std::vector<std::vector<double> >& solutions,
+                        std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                        const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
+
   virtual bool getPositionFK(const std::vector<std::string>& link_names, const std::vector<double>& joint_angles,
                              std::vector<geometry_msgs::Pose>& poses) const;
 
@@ -144,6 +159,49 @@ protected:
   virtual bool setRedundantJoints(const std::vector<unsigned int>& redundant_joint_indices);
 
 private:
+  /** @brief The KDL solvers and buffers used by one thread, so that solving IK does not allocate memory */
+  struct Solvers
+  {
+    Solvers(const KDL::Chain& chain, const KDL::JntArray& joint_min, const KDL::JntArray& joint_max,
+            unsigned int num_mimic_joints, unsigned int num_redundant_joints, bool position_ik,
+            unsigned int max_solver_iterations, double epsilon, const std::vector<JointMimic>& mimic_joints);
+
+    KDL::ChainFkSolverPos_recursive fk_solver;
+    KDL::ChainIkSolverVel_pinv_mimic ik_solver_vel;
+    KDL::ChainIkSolverPos_NR_JL_Mimic ik_solver_pos;
+    KDL::JntArray jnt_seed_state, jnt_pos_in, jnt_pos_out, fk_jnt_pos;
+    std::vector<double> values, near, consistency_limits_mimic;
+    random_numbers::RandomNumberGenerator random_number_generator;
+    unsigned int version; /** The value of solvers_version_ the solvers were created for */
+  };
+
+  /** @brief The state shared by the threads that search for a solution to the same query concurrently */
+  struct IKRace
+  {
+    IKRace() : solved(false)
+    {
+    }
+
+    boost::mutex lock; /** Serializes the calls to the solution callback, which need not be thread safe */
+    std::atomic<bool> solved;
+    std::vector<double> solution;
+  };
+
+  /** @brief Create solvers for the current setup of the chain */
+  Solvers* createSolvers() const;
+
+  /** @brief Get the solvers of the calling thread, creating them on first use */
+  Solvers& getSolvers() const;
+
+  /** @brief Search for a solution with random restarts, starting from the seed state or from a random state, until
+   * the timeout expires or, if \e race is set, until another thread finds a solution
+   */
+  bool searchFromSeed(Solvers& solvers, const geometry_msgs::Pose& ik_pose, const KDL::Frame& pose_desired,
+                      const std::vector<double>& ik_seed_state, bool random_seed, const ros::WallTime& start_time,
+                      double timeout, std::vector<double>& solution, const IKCallbackFn& solution_callback,
+                      moveit_msgs::MoveItErrorCodes& error_code, const std::vector<double>& consistency_limits,
+                      const kinematics::KinematicsQueryOptions& options, IKRace* race) const;
+
   bool timedOut(const ros::WallTime& start_time, double duration) const;
 
   /** @brief Check whether the solution lies within the consistency limit of the seed state
@@ -161,7 +219,7 @@ private:
 
   int getKDLSegmentIndex(const std::string& name) const;
 
-  void getRandomConfiguration(KDL::JntArray& jnt_array, bool lock_redundancy) const;
+  void getRandomConfiguration(Solvers& solvers, KDL::JntArray& jnt_array, bool lock_redundancy) const;
 
   /** @brief Get a random configuration within joint limits close to the seed state
    *  @param seed_state Seed state
@@ -170,8 +228,9 @@ private:
    * [seed_state(redundancy_limit)-consistency_limit,seed_state(redundancy_limit)+consistency_limit]
    *  @param jnt_array Returned random configuration
    */
-  void getRandomConfiguration(const KDL::JntArray& seed_state, const std::vector<double>& consistency_limits,
-                              KDL::JntArray& jnt_array, bool lock_redundancy) const;
+  void getRandomConfiguration(Solvers& solvers, const KDL::JntArray& seed_state,
+                              const std::vector<double>& consistency_limits, KDL::JntArray& jnt_array,
+                              bool lock_redundancy) const;
 
   bool isRedundantJoint(unsigned int index) const;
 
@@ -202,6 +261,13 @@ private:
   double max_solver_iterations_;
   double epsilon_;
   std::vector<JointMimic> mimic_joints_;
+
+  mutable boost::thread_specific_ptr<Solvers> solvers_; /** The solvers of each thread that searched for IK */
+  unsigned int solvers_version_; /** Changed when the solvers need to be created again, as redundant joints changed */
+
+  mutable std::vector<boost::shared_ptr<Solvers> > race_solvers_; /** The solvers of the threads that race a query or
+                                                                     solve a batch of queries */
+  mutable boost::mutex race_lock_;                                /** Held while race_solvers_ are in use */
 };
 }
 
@@ -47,26 +47,67 @@
 
 #include <moveit/rdf_loader/rdf_loader.h>
 
+#include <boost/thread.hpp>
+
 // register KDLKinematics as a KinematicsBase implementation
 CLASS_LOADER_REGISTER_CLASS(kdl_kinematics_plugin::KDLKinematicsPlugin, kinematics::KinematicsBase)
 
 namespace kdl_kinematics_plugin
 {
-KDLKinematicsPlugin::KDLKinematicsPlugin() : active_(false)
+KDLKinematicsPlugin::KDLKinematicsPlugin() : active_(false), solvers_version_(0)
 {
 }
 
-void KDLKinematicsPlugin::getRandomConfiguration(KDL::JntArray& jnt_array, bool lock_redundancy) const
+KDLKinematicsPlugin::Solvers::Solvers(const KDL::Chain& chain, const KDL::JntArray& joint_min,
+                                      const KDL::JntArray& joint_max, unsigned int num_mimic_joints,
+                                      unsigned int num_redundant_joints, bool position_ik,
+                                      unsigned int max_solver_iterations, double epsilon,
+                                      const std::vector<JointMimic>& mimic_joints)
+  : fk_solver(chain)
+  , ik_solver_vel(chain, num_mimic_joints, num_redundant_joints, position_ik)
+  , ik_solver_pos(chain, joint_min, joint_max, fk_solver, ik_solver_vel, max_solver_iterations, epsilon, position_ik)
+  , jnt_seed_state(chain.getNrOfJoints())
+  , jnt_pos_in(chain.getNrOfJoints())
+  , jnt_pos_out(chain.getNrOfJoints())
+  , fk_jnt_pos(chain.getNrOfJoints())
+  , version(0)
 {
-  std::vector<double> jnt_array_vector(dimension_, 0.0);
-  state_->setToRandomPositions(joint_model_group_);
-  state_->copyJointGroupPositions(joint_model_group_, &jnt_array_vector[0]);
+  ik_solver_vel.setMimicJoints(mimic_joints);
+  ik_solver_pos.setMimicJoints(mimic_joints);
+}
+
+KDLKinematicsPlugin::Solvers* KDLKinematicsPlugin::createSolvers() const
+{
+  Solvers* solvers = new Solvers(kdl_chain_, joint_min_, joint_max_, joint_model_group_->getMimicJointModels().size(),
+                                 redundant_joint_indices_.size(), position_ik_, max_solver_iterations_, epsilon_,
+                                 mimic_joints_);
+  solvers->version = solvers_version_;
+  solvers->values.resize(dimension_);
+  solvers->near.resize(dimension_);
+  return solvers;
+}
+
+KDLKinematicsPlugin::Solvers& KDLKinematicsPlugin::getSolvers() const
+{
+  Solvers* solvers = solvers_.get();
+  if (!solvers || solvers->version != solvers_version_)
+  {
+    solvers = createSolvers();
+    solvers_.reset(solvers);
+  }
+  return *solvers;
+}
+
+void KDLKinematicsPlugin::getRandomConfiguration(Solvers& solvers, KDL::JntArray& jnt_array,
+                                                 bool lock_redundancy) const
+{
+  joint_model_group_->getVariableRandomPositions(solvers.random_number_generator, &solvers.values[0]);
   for (std::size_t i = 0; i < dimension_; ++i)
   {
     if (lock_redundancy)
       if (isRedundantJoint(i))
         continue;
-    jnt_array(i) = jnt_array_vector[i];
+    jnt_array(i) = solvers.values[i];
   }
 }
 
@@ -78,17 +119,18 @@ bool KDLKinematicsPlugin::isRedundantJoint(unsigned int index) const
   return false;
 }
 
-void KDLKinematicsPlugin::getRandomConfiguration(const KDL::JntArray& seed_state,
+void KDLKinematicsPlugin::getRandomConfiguration(Solvers& solvers, const KDL::JntArray& seed_state,
                                                  const std::vector<double>& consistency_limits,
                                                  KDL::JntArray& jnt_array, bool lock_redundancy) const
 {
-  std::vector<double> values(dimension_, 0.0);
-  std::vector<double> near(dimension_, 0.0);
+  std::vector<double>& values = solvers.values;
+  std::vector<double>& near = solvers.near;
   for (std::size_t i = 0; i < dimension_; ++i)
     near[i] = seed_state(i);
 
   // Need to resize the consistency limits to remove mimic joints
-  std::vector<double> consistency_limits_mimic;
+  std::vector<double>& consistency_limits_mimic = solvers.consistency_limits_mimic;
+  consistency_limits_mimic.clear();
   for (std::size_t i = 0; i < dimension_; ++i)
   {
     if (!mimic_joints_[i].active)
@@ -96,7 +138,7 @@ void KDLKinematicsPlugin::getRandomConfiguration(const KDL::JntArray& seed_state
     consistency_limits_mimic.push_back(consistency_limits[i]);
   }
 
-  joint_model_group_->getVariableRandomPositionsNearBy(state_->getRandomNumberGenerator(), values, near,
+  joint_model_group_->getVariableRandomPositionsNearBy(solvers.random_number_generator, values, near,
                                                        consistency_limits_mimic);
 
   for (std::size_t i = 0; i < dimension_; ++i)
@@ -342,6 +384,7 @@ bool KDLKinematicsPlugin::setRedundantJoints(const std::vector<unsigned int>& re
 
   redundant_joints_map_index_ = redundant_joints_map_index;
   redundant_joint_indices_ = redundant_joints;
+  ++solvers_version_;
   return true;
 }
 
@@ -459,17 +502,138 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     return false;
   }
 
-  KDL::JntArray jnt_seed_state(dimension_);
-  KDL::JntArray jnt_pos_in(dimension_);
-  KDL::JntArray jnt_pos_out(dimension_);
+  KDL::Frame pose_desired;
+  tf::poseMsgToKDL(ik_pose, pose_desired);
 
-  KDL::ChainFkSolverPos_recursive fk_solver(kdl_chain_);
-  KDL::ChainIkSolverVel_pinv_mimic ik_solver_vel(kdl_chain_, joint_model_group_->getMimicJointModels().size(),
-                                                 redundant_joint_indices_.size(), position_ik_);
-  KDL::ChainIkSolverPos_NR_JL_Mimic ik_solver_pos(kdl_chain_, joint_min_, joint_max_, fk_solver, ik_solver_vel,
-                                                  max_solver_iterations_, epsilon_, position_ik_);
-  ik_solver_vel.setMimicJoints(mimic_joints_);
-  ik_solver_pos.setMimicJoints(mimic_joints_);
+  ROS_DEBUG_STREAM_NAMED("kdl", "searchPositionIK2: Position request pose is "
+                                    << ik_pose.position.x << " " << ik_pose.position.y << " " << ik_pose.position.z
+                                    << " " << ik_pose.orientation.x << " " << ik_pose.orientation.y << " "
+                                    << ik_pose.orientation.z << " " << ik_pose.orientation.w);
+
+  // racing needs solvers for the other threads; if another call is racing already, this one searches alone
+  unsigned int racers = std::max(1u, options.parallel_seeds);
+  boost::mutex::scoped_try_lock race_lock(race_lock_);
+  if (racers == 1 || !race_lock.owns_lock())
+    return searchFromSeed(getSolvers(), ik_pose, pose_desired, ik_seed_state, false, n1, timeout, solution,
+                          solution_callback, error_code, consistency_limits, options, NULL);
+
+  race_solvers_.resize(racers - 1);
+  for (std::size_t i = 0; i < race_solvers_.size(); ++i)
+    if (!race_solvers_[i] || race_solvers_[i]->version != solvers_version_)
+      race_solvers_[i].reset(createSolvers());
+
+  // the first racer starts from the seed, the others from random states
+  IKRace race;
+  std::vector<std::vector<double> > racer_solutions(racers);
+  std::vector<moveit_msgs::MoveItErrorCodes> racer_errors(racers);
+  boost::thread_group threads;
+  for (unsigned int i = 1; i < racers; ++i)
+    threads.create_thread([&, i]() {
+      searchFromSeed(*race_solvers_[i - 1], ik_pose, pose_desired, ik_seed_state, true, n1, timeout,
+                     racer_solutions[i], solution_callback, racer_errors[i], consistency_limits, options, &race);
+    });
+  searchFromSeed(getSolvers(), ik_pose, pose_desired, ik_seed_state, false, n1, timeout, racer_solutions[0],
+                 solution_callback, racer_errors[0], consistency_limits, options, &race);
+  threads.join_all();
+
+  if (race.solved)
+  {
+    solution = race.solution;
+    error_code.val = error_code.SUCCESS;
+    return true;
+  }
+  solution = racer_solutions[0];
+  error_code = racer_errors[0];
+  return false;
+}
+
+bool KDLKinematicsPlugin::searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                                const std::vector<std::vector<double> >& ik_seed_states,
+                                                double timeout, std::vector<std::vector<double> >& solutions,
+                                                std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                                                const kinematics::KinematicsQueryOptions& options) const
+{
+  solutions.assign(ik_poses.size(), std::vector<double>());
+  error_codes.assign(ik_poses.size(), moveit_msgs::MoveItErrorCodes());
+  if (ik_poses.empty())
+    return true;
+
+  bool valid = active_;
+  if (!active_)
+    ROS_ERROR_NAMED("kdl", "kinematics not active");
+  else if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    ROS_ERROR_NAMED("kdl", "Expected 1 or %zu seed states instead of %zu", ik_poses.size(), ik_seed_states.size());
+    valid = false;
+  }
+  for (std::size_t i = 0; valid && i < ik_seed_states.size(); ++i)
+    if (ik_seed_states[i].size() != dimension_)
+    {
+      ROS_ERROR_STREAM_NAMED("kdl", "Seed state must have size " << dimension_ << " instead of size "
+                                                                 << ik_seed_states[i].size());
+      valid = false;
+    }
+  if (!valid)
+  {
+    for (std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // the threads take the next unsolved query until none is left
+  std::atomic<std::size_t> next_query(0);
+  std::atomic<std::size_t> solved(0);
+  auto solve_queries = [&](Solvers& solvers) {
+    const IKCallbackFn no_callback;
+    const std::vector<double> no_consistency_limits;
+    for (std::size_t i = next_query++; i < ik_poses.size(); i = next_query++)
+    {
+      KDL::Frame pose_desired;
+      tf::poseMsgToKDL(ik_poses[i], pose_desired);
+      if (searchFromSeed(solvers, ik_poses[i], pose_desired,
+                         ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i], false,
+                         ros::WallTime::now(), timeout, solutions[i], no_callback, error_codes[i],
+                         no_consistency_limits, options, NULL))
+        ++solved;
+      else
+        solutions[i].clear();
+    }
+  };
+
+  // the extra threads use the racing solvers; if another call holds those, this one solves the batch alone
+  std::size_t workers = std::min<std::size_t>(std::max(1u, boost::thread::hardware_concurrency()), ik_poses.size());
+  boost::mutex::scoped_try_lock race_lock(race_lock_);
+  if (!race_lock.owns_lock())
+    workers = 1;
+  if (race_solvers_.size() < workers - 1)
+    race_solvers_.resize(workers - 1);
+  for (std::size_t i = 0; i + 1 < workers; ++i)
+    if (!race_solvers_[i] || race_solvers_[i]->version != solvers_version_)
+      race_solvers_[i].reset(createSolvers());
+
+  boost::thread_group threads;
+  for (std::size_t i = 1; i < workers; ++i)
+    threads.create_thread([&, i]() { solve_queries(*race_solvers_[i - 1]); });
+  solve_queries(getSolvers());
+  threads.join_all();
+
+  return solved == ik_poses.size();
+}
+
+bool KDLKinematicsPlugin::searchFromSeed(Solvers& solvers, const geometry_msgs::Pose& ik_pose,
+                                         const KDL::Frame& pose_desired, const std::vector<double>& ik_seed_state,
+                                         bool random_seed, const ros::WallTime& start_time, double timeout,
+                                         std::vector<double>& solution, const IKCallbackFn& solution_callback,
+                                         moveit_msgs::MoveItErrorCodes& error_code,
+                                         const std::vector<double>& consistency_limits,
+                                         const kinematics::KinematicsQueryOptions& options, IKRace* race) const
+{
+  // the solvers and buffers of this thread are reused, so the search does not allocate memory
+  KDL::JntArray& jnt_seed_state = solvers.jnt_seed_state;
+  KDL::JntArray& jnt_pos_in = solvers.jnt_pos_in;
+  KDL::JntArray& jnt_pos_out = solvers.jnt_pos_out;
+  KDL::ChainIkSolverVel_pinv_mimic& ik_solver_vel = solvers.ik_solver_vel;
+  KDL::ChainIkSolverPos_NR_JL_Mimic& ik_solver_pos = solvers.ik_solver_pos;
 
   if ((redundant_joint_indices_.size() > 0) && !ik_solver_vel.setRedundantJointsMapIndex(redundant_joints_map_index_))
   {
@@ -481,28 +645,39 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
   {
     ik_solver_vel.lockRedundantJoints();
   }
+  else
+  {
+    ik_solver_vel.unlockRedundantJoints();
+  }
 
   solution.resize(dimension_);
 
-  KDL::Frame pose_desired;
-  tf::poseMsgToKDL(ik_pose, pose_desired);
-
-  ROS_DEBUG_STREAM_NAMED("kdl", "searchPositionIK2: Position request pose is "
-                                    << ik_pose.position.x << " " << ik_pose.position.y << " " << ik_pose.position.z
-                                    << " " << ik_pose.orientation.x << " " << ik_pose.orientation.y << " "
-                                    << ik_pose.orientation.z << " " << ik_pose.orientation.w);
   // Do the IK
   for (unsigned int i = 0; i < dimension_; i++)
     jnt_seed_state(i) = ik_seed_state[i];
   jnt_pos_in = jnt_seed_state;
+  if (random_seed)
+  {
+    if (!consistency_limits.empty())
+      getRandomConfiguration(solvers, jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
+    else
+      getRandomConfiguration(solvers, jnt_pos_in, options.lock_redundant_joints);
+  }
 
   unsigned int counter(0);
   while (1)
   {
     //    ROS_DEBUG_NAMED("kdl","Iteration: %d, time: %f, Timeout:
-    //    %f",counter,(ros::WallTime::now()-n1).toSec(),timeout);
+    //    %f",counter,(ros::WallTime::now()-start_time).toSec(),timeout);
     counter++;
-    if (timedOut(n1, timeout))
+    if (race && race->solved)
+    {
+      ROS_DEBUG_NAMED("kdl", "IK was solved by another thread");
+      error_code.val = error_code.NO_IK_SOLUTION;
+      ik_solver_vel.unlockRedundantJoints();
+      return false;
+    }
+    if (timedOut(start_time, timeout))
     {
       ROS_DEBUG_NAMED("kdl", "IK timed out");
       error_code.val = error_code.TIMED_OUT;
@@ -513,7 +688,7 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     ROS_DEBUG_NAMED("kdl", "IK valid: %d", ik_valid);
     if (!consistency_limits.empty())
     {
-      getRandomConfiguration(jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(solvers, jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
       if ((ik_valid < 0 && !options.return_approximate_solution) ||
           !checkConsistency(jnt_seed_state, consistency_limits, jnt_pos_out))
       {
@@ -523,7 +698,7 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     }
     else
     {
-      getRandomConfiguration(jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(solvers, jnt_pos_in, options.lock_redundant_joints);
       ROS_DEBUG_NAMED("kdl", "New random configuration");
       for (unsigned int j = 0; j < dimension_; j++)
         ROS_DEBUG_NAMED("kdl", "%d %f", j, jnt_pos_in(j));
@@ -537,6 +712,15 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     ROS_DEBUG_NAMED("kdl", "Found IK solution");
     for (unsigned int j = 0; j < dimension_; j++)
       solution[j] = jnt_pos_out(j);
+
+    // racers call the solution callback one at a time, and only until one of them succeeds
+    boost::mutex::scoped_lock callback_lock;
+    if (race)
+    {
+      callback_lock = boost::mutex::scoped_lock(race->lock);
+      if (race->solved)
+        continue;
+    }
     if (!solution_callback.empty())
       solution_callback(ik_pose, solution, error_code);
     else
@@ -545,6 +729,11 @@ bool KDLKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     if (error_code.val == error_code.SUCCESS)
     {
       ROS_DEBUG_STREAM_NAMED("kdl", "Solved after " << counter << " iterations");
+      if (race)
+      {
+        race->solution = solution;
+        race->solved = true;
+      }
       ik_solver_vel.unlockRedundantJoints();
       return true;
     }
@@ -575,13 +764,15 @@ bool KDLKinematicsPlugin::getPositionFK(const std::vector<std::string>& link_nam
   geometry_msgs::PoseStamped pose;
   tf::Stamped<tf::Pose> tf_pose;
 
-  KDL::JntArray jnt_pos_in(dimension_);
+  // the solution callback of an IK search may compute FK, so the IK buffers are not used here
+  Solvers& solvers = getSolvers();
+  KDL::JntArray& jnt_pos_in = solvers.fk_jnt_pos;
   for (unsigned int i = 0; i < dimension_; i++)
   {
     jnt_pos_in(i) = joint_angles[i];
   }
 
-  KDL::ChainFkSolverPos_recursive fk_solver(kdl_chain_);
+  KDL::ChainFkSolverPos_recursive& fk_solver = solvers.fk_solver;
 
   bool valid = true;
   for (unsigned int i = 0; i < poses.size(); i++)
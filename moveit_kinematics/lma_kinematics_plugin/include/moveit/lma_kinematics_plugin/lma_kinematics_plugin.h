@@ -62,6 +62,9 @@
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
 
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+
 namespace lma_kinematics_plugin
 {
 /**
@@ -104,6 +107,16 @@ public:
                    const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
                    const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
 
+  /**
+   * @brief Solve the queries of the batch in concurrent threads, each of which has a random number generator of its own
+   */
+  virtual bool
+  searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                        const std::vector<std::vector<double> >& ik_seed_states, double timeout,
+                        std::vector<std::vector<double> >& solutions,
+                        std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                        const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
+
   virtual bool getPositionFK(const std::vector<std::string>& link_names, const std::vector<double>& joint_angles,
                              std::vector<geometry_msgs::Pose>& poses) const;
 
@@ -162,7 +175,8 @@ private:
 
   int getKDLSegmentIndex(const std::string& name) const;
 
-  void getRandomConfiguration(KDL::JntArray& jnt_array, bool lock_redundancy) const;
+  void getRandomConfiguration(random_numbers::RandomNumberGenerator& rng, KDL::JntArray& jnt_array,
+                              bool lock_redundancy) const;
 
   /** @brief Get a random configuration within joint limits close to the seed state
    *  @param seed_state Seed state
@@ -171,8 +185,31 @@ private:
    * [seed_state(redundancy_limit)-consistency_limit,seed_state(redundancy_limit)+consistency_limit]
    *  @param jnt_array Returned random configuration
    */
-  void getRandomConfiguration(const KDL::JntArray& seed_state, const std::vector<double>& consistency_limits,
-                              KDL::JntArray& jnt_array, bool lock_redundancy) const;
+  void getRandomConfiguration(random_numbers::RandomNumberGenerator& rng, const KDL::JntArray& seed_state,
+                              const std::vector<double>& consistency_limits, KDL::JntArray& jnt_array,
+                              bool lock_redundancy) const;
+
+  /** @brief The state shared by the threads that search for a solution to the same query concurrently */
+  struct IKRace
+  {
+    IKRace() : solved(false)
+    {
+    }
+
+    boost::mutex lock; /** Serializes the calls to the solution callback, which need not be thread safe */
+    std::atomic<bool> solved;
+    std::vector<double> solution;
+  };
+
+  /** @brief Search for a solution with random restarts, starting from the seed state or from a random state, until
+   * the timeout expires or, if \e race is set, until another thread finds a solution
+   */
+  bool searchFromSeed(random_numbers::RandomNumberGenerator& rng, const geometry_msgs::Pose& ik_pose,
+                      const KDL::Frame& pose_desired, const std::vector<double>& ik_seed_state, bool random_seed,
+                      const ros::WallTime& start_time, double timeout, std::vector<double>& solution,
+                      const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
+                      const std::vector<double>& consistency_limits, const kinematics::KinematicsQueryOptions& options,
+                      IKRace* race) const;
 
   bool isRedundantJoint(unsigned int index) const;
 
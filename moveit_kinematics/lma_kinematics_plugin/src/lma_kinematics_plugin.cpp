@@ -46,6 +46,8 @@
 
 #include <moveit/rdf_loader/rdf_loader.h>
 
+#include <boost/thread.hpp>
+
 // register KDLKinematics as a KinematicsBase implementation
 CLASS_LOADER_REGISTER_CLASS(lma_kinematics_plugin::LMAKinematicsPlugin, kinematics::KinematicsBase)
 
@@ -55,11 +57,11 @@ LMAKinematicsPlugin::LMAKinematicsPlugin() : active_(false)
 {
 }
 
-void LMAKinematicsPlugin::getRandomConfiguration(KDL::JntArray& jnt_array, bool lock_redundancy) const
+void LMAKinematicsPlugin::getRandomConfiguration(random_numbers::RandomNumberGenerator& rng, KDL::JntArray& jnt_array,
+                                                 bool lock_redundancy) const
 {
   std::vector<double> jnt_array_vector(dimension_, 0.0);
-  state_->setToRandomPositions(joint_model_group_);
-  state_->copyJointGroupPositions(joint_model_group_, &jnt_array_vector[0]);
+  joint_model_group_->getVariableRandomPositions(rng, &jnt_array_vector[0]);
   for (std::size_t i = 0; i < dimension_; ++i)
   {
     if (lock_redundancy)
@@ -77,7 +79,8 @@ bool LMAKinematicsPlugin::isRedundantJoint(unsigned int index) const
   return false;
 }
 
-void LMAKinematicsPlugin::getRandomConfiguration(const KDL::JntArray& seed_state,
+void LMAKinematicsPlugin::getRandomConfiguration(random_numbers::RandomNumberGenerator& rng,
+                                                 const KDL::JntArray& seed_state,
                                                  const std::vector<double>& consistency_limits,
                                                  KDL::JntArray& jnt_array, bool lock_redundancy) const
 {
@@ -95,8 +98,7 @@ void LMAKinematicsPlugin::getRandomConfiguration(const KDL::JntArray& seed_state
     consistency_limits_mimic.push_back(consistency_limits[i]);
   }
 
-  joint_model_group_->getVariableRandomPositionsNearBy(state_->getRandomNumberGenerator(), values, near,
-                                                       consistency_limits_mimic);
+  joint_model_group_->getVariableRandomPositionsNearBy(rng, values, near, consistency_limits_mimic);
 
   for (std::size_t i = 0; i < dimension_; ++i)
   {
@@ -458,6 +460,122 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     return false;
   }
 
+  KDL::Frame pose_desired;
+  tf::poseMsgToKDL(ik_pose, pose_desired);
+
+  ROS_DEBUG_STREAM_NAMED("lma", "searchPositionIK2: Position request pose is "
+                                    << ik_pose.position.x << " " << ik_pose.position.y << " " << ik_pose.position.z
+                                    << " " << ik_pose.orientation.x << " " << ik_pose.orientation.y << " "
+                                    << ik_pose.orientation.z << " " << ik_pose.orientation.w);
+
+  unsigned int racers = std::max(1u, options.parallel_seeds);
+  if (racers == 1)
+    return searchFromSeed(state_->getRandomNumberGenerator(), ik_pose, pose_desired, ik_seed_state, false, n1, timeout,
+                          solution, solution_callback, error_code, consistency_limits, options, NULL);
+
+  // the first racer starts from the seed, the others from random states, each with solvers of its own
+  IKRace race;
+  std::vector<std::vector<double> > racer_solutions(racers);
+  std::vector<moveit_msgs::MoveItErrorCodes> racer_errors(racers);
+  boost::thread_group threads;
+  for (unsigned int i = 1; i < racers; ++i)
+    threads.create_thread([&, i]() {
+      random_numbers::RandomNumberGenerator rng;
+      searchFromSeed(rng, ik_pose, pose_desired, ik_seed_state, true, n1, timeout, racer_solutions[i],
+                     solution_callback, racer_errors[i], consistency_limits, options, &race);
+    });
+  {
+    // the random number generator of state_ is not thread safe, so the calling thread also uses one of its own
+    random_numbers::RandomNumberGenerator rng;
+    searchFromSeed(rng, ik_pose, pose_desired, ik_seed_state, false, n1, timeout, racer_solutions[0],
+                   solution_callback, racer_errors[0], consistency_limits, options, &race);
+  }
+  threads.join_all();
+
+  if (race.solved)
+  {
+    solution = race.solution;
+    error_code.val = error_code.SUCCESS;
+    return true;
+  }
+  solution = racer_solutions[0];
+  error_code = racer_errors[0];
+  return false;
+}
+
+bool LMAKinematicsPlugin::searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                                const std::vector<std::vector<double> >& ik_seed_states,
+                                                double timeout, std::vector<std::vector<double> >& solutions,
+                                                std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                                                const kinematics::KinematicsQueryOptions& options) const
+{
+  solutions.assign(ik_poses.size(), std::vector<double>());
+  error_codes.assign(ik_poses.size(), moveit_msgs::MoveItErrorCodes());
+  if (ik_poses.empty())
+    return true;
+
+  bool valid = active_;
+  if (!active_)
+    ROS_ERROR_NAMED("lma", "kinematics not active");
+  else if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    ROS_ERROR_NAMED("lma", "Expected 1 or %zu seed states instead of %zu", ik_poses.size(), ik_seed_states.size());
+    valid = false;
+  }
+  for (std::size_t i = 0; valid && i < ik_seed_states.size(); ++i)
+    if (ik_seed_states[i].size() != dimension_)
+    {
+      ROS_ERROR_STREAM_NAMED("lma", "Seed state must have size " << dimension_ << " instead of size "
+                                                                 << ik_seed_states[i].size());
+      valid = false;
+    }
+  if (!valid)
+  {
+    for (std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // the threads take the next unsolved query until none is left; the random number generator of state_ is not
+  // thread safe, so each thread uses one of its own
+  std::atomic<std::size_t> next_query(0);
+  std::atomic<std::size_t> solved(0);
+  auto solve_queries = [&]() {
+    random_numbers::RandomNumberGenerator rng;
+    const IKCallbackFn no_callback;
+    const std::vector<double> no_consistency_limits;
+    for (std::size_t i = next_query++; i < ik_poses.size(); i = next_query++)
+    {
+      KDL::Frame pose_desired;
+      tf::poseMsgToKDL(ik_poses[i], pose_desired);
+      if (searchFromSeed(rng, ik_poses[i], pose_desired,
+                         ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i], false,
+                         ros::WallTime::now(), timeout, solutions[i], no_callback, error_codes[i],
+                         no_consistency_limits, options, NULL))
+        ++solved;
+      else
+        solutions[i].clear();
+    }
+  };
+
+  std::size_t workers = std::min<std::size_t>(std::max(1u, boost::thread::hardware_concurrency()), ik_poses.size());
+  boost::thread_group threads;
+  for (std::size_t i = 1; i < workers; ++i)
+    threads.create_thread(solve_queries);
+  solve_queries();
+  threads.join_all();
+
+  return solved == ik_poses.size();
+}
+
+bool LMAKinematicsPlugin::searchFromSeed(random_numbers::RandomNumberGenerator& rng, const geometry_msgs::Pose& ik_pose,
+                                         const KDL::Frame& pose_desired, const std::vector<double>& ik_seed_state,
+                                         bool random_seed, const ros::WallTime& start_time, double timeout,
+                                         std::vector<double>& solution, const IKCallbackFn& solution_callback,
+                                         moveit_msgs::MoveItErrorCodes& error_code,
+                                         const std::vector<double>& consistency_limits,
+                                         const kinematics::KinematicsQueryOptions& options, IKRace* race) const
+{
   KDL::JntArray jnt_seed_state(dimension_);
   KDL::JntArray jnt_pos_in(dimension_);
   KDL::JntArray jnt_pos_out(dimension_);
@@ -493,25 +611,32 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
 
   solution.resize(dimension_);
 
-  KDL::Frame pose_desired;
-  tf::poseMsgToKDL(ik_pose, pose_desired);
-
-  ROS_DEBUG_STREAM_NAMED("lma", "searchPositionIK2: Position request pose is "
-                                    << ik_pose.position.x << " " << ik_pose.position.y << " " << ik_pose.position.z
-                                    << " " << ik_pose.orientation.x << " " << ik_pose.orientation.y << " "
-                                    << ik_pose.orientation.z << " " << ik_pose.orientation.w);
   // Do the IK
   for (unsigned int i = 0; i < dimension_; i++)
     jnt_seed_state(i) = ik_seed_state[i];
   jnt_pos_in = jnt_seed_state;
+  if (random_seed)
+  {
+    if (!consistency_limits.empty())
+      getRandomConfiguration(rng, jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
+    else
+      getRandomConfiguration(rng, jnt_pos_in, options.lock_redundant_joints);
+  }
 
   unsigned int counter(0);
   while (1)
   {
     //    ROS_DEBUG_NAMED("lma","Iteration: %d, time: %f, Timeout:
-    //    %f",counter,(ros::WallTime::now()-n1).toSec(),timeout);
+    //    %f",counter,(ros::WallTime::now()-start_time).toSec(),timeout);
     counter++;
-    if (timedOut(n1, timeout))
+    if (race && race->solved)
+    {
+      ROS_DEBUG_NAMED("lma", "IK was solved by another thread");
+      error_code.val = error_code.NO_IK_SOLUTION;
+      ik_solver_vel.unlockRedundantJoints();
+      return false;
+    }
+    if (timedOut(start_time, timeout))
     {
       ROS_DEBUG_NAMED("lma", "IK timed out");
       error_code.val = error_code.TIMED_OUT;
@@ -522,7 +647,7 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     ROS_DEBUG_NAMED("lma", "IK valid: %d", ik_valid);
     if (!consistency_limits.empty())
     {
-      getRandomConfiguration(jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(rng, jnt_seed_state, consistency_limits, jnt_pos_in, options.lock_redundant_joints);
       if ((ik_valid < 0 && !options.return_approximate_solution) ||
           !checkConsistency(jnt_seed_state, consistency_limits, jnt_pos_out))
       {
@@ -532,7 +657,7 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     }
     else
     {
-      getRandomConfiguration(jnt_pos_in, options.lock_redundant_joints);
+      getRandomConfiguration(rng, jnt_pos_in, options.lock_redundant_joints);
       ROS_DEBUG_NAMED("lma", "New random configuration");
       for (unsigned int j = 0; j < dimension_; j++)
         ROS_DEBUG_NAMED("lma", "%d %f", j, jnt_pos_in(j));
@@ -546,6 +671,15 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     ROS_DEBUG_NAMED("lma", "Found IK solution");
     for (unsigned int j = 0; j < dimension_; j++)
       solution[j] = jnt_pos_out(j);
+
+    // racers call the solution callback one at a time, and only until one of them succeeds
+    boost::mutex::scoped_lock callback_lock;
+    if (race)
+    {
+      callback_lock = boost::mutex::scoped_lock(race->lock);
+      if (race->solved)
+        continue;
+    }
     if (!solution_callback.empty())
       solution_callback(ik_pose, solution, error_code);
     else
@@ -554,6 +688,11 @@ bool LMAKinematicsPlugin::searchPositionIK(const geometry_msgs::Pose& ik_pose, c
     if (error_code.val == error_code.SUCCESS)
     {
       ROS_DEBUG_STREAM_NAMED("lma", "Solved after " << counter << " iterations");
+      if (race)
+      {
+        race->solution = solution;
+        race->solved = true;
+      }
       ik_solver_vel.unlockRedundantJoints();
       return true;
     }
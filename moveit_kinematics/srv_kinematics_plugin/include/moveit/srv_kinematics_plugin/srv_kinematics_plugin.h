@@ -46,7 +46,11 @@
 #include <ros/ros.h>
 
 // System
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
 
 // ROS msgs
 #include <geometry_msgs/PoseStamped.h>
@@ -102,6 +106,17 @@ public:
                    const IKCallbackFn& solution_callback, moveit_msgs::MoveItErrorCodes& error_code,
                    const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
 
+  /**
+   * @brief Keep one request per service client in flight, so the IK server solves the queries of the batch
+   * concurrently
+   */
+  virtual bool
+  searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                        const std::vector<std::vector<double> >& ik_seed_states, double timeout,
+                        std::vector<std::vector<double> >& solutions,
+                        std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                        const kinematics::KinematicsQueryOptions& options = kinematics::KinematicsQueryOptions()) const;
+
   virtual bool getPositionFK(const std::vector<std::string>& link_names, const std::vector<double>& joint_angles,
                              std::vector<geometry_msgs::Pose>& poses) const;
 
@@ -148,6 +163,25 @@ protected:
   virtual bool setRedundantJoints(const std::vector<unsigned int>& redundant_joint_indices);
 
 private:
+  /** @brief A persistent connection to the IK service, which serves one call at a time */
+  struct ServiceClient
+  {
+    ros::ServiceClient client;
+    std::mutex lock;
+  };
+
+  /** @brief Call the IK service on a client that is not busy, or wait for one if all are */
+  bool callService(moveit_msgs::GetPositionIK& ik_srv) const;
+
+  /** @brief Call the IK service on the given client, reconnecting it first if its connection was closed */
+  bool callService(ros::ServiceClient& client, moveit_msgs::GetPositionIK& ik_srv) const;
+
+  /** @brief Look up the solution previously received for the same poses */
+  bool getCachedSolution(const std::vector<geometry_msgs::Pose>& ik_poses, std::vector<double>& solution) const;
+
+  /** @brief Remember the solution received for the poses, forgetting the oldest one if the cache is full */
+  void cacheSolution(const std::vector<geometry_msgs::Pose>& ik_poses, const std::vector<double>& solution) const;
+
   bool timedOut(const ros::WallTime& start_time, double duration) const;
 
   int getJointIndex(const std::string& name) const;
@@ -164,10 +198,17 @@ private:
   robot_model::JointModelGroup* joint_model_group_;
 
   robot_state::RobotStatePtr robot_state_;
+  mutable std::mutex robot_state_lock_; /** Held while robot_state_ converts requests and responses */
 
   int num_possible_redundant_joints_;
 
-  std::shared_ptr<ros::ServiceClient> ik_service_client_;
+  std::vector<std::shared_ptr<ServiceClient> > ik_service_clients_; /** Pool of connections to the IK service */
+  mutable std::atomic<unsigned int> next_service_client_;            /** The client the next call tries first */
+
+  std::size_t solution_cache_size_; /** Maximum number of remembered solutions; 0 disables the cache */
+  mutable std::map<std::vector<double>, std::vector<double> > solution_cache_; /** Solutions by flattened poses */
+  mutable std::deque<std::vector<double> > solution_cache_order_; /** Keys of solution_cache_, oldest first */
+  mutable std::mutex solution_cache_lock_;
 };
 }
 
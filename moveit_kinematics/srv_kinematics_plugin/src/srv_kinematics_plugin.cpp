@@ -48,12 +48,15 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
+#include <algorithm>
+#include <thread>
+
 // register SRVKinematics as a KinematicsBase implementation
 CLASS_LOADER_REGISTER_CLASS(srv_kinematics_plugin::SrvKinematicsPlugin, kinematics::KinematicsBase)
 
 namespace srv_kinematics_plugin
 {
-SrvKinematicsPlugin::SrvKinematicsPlugin() : active_(false)
+SrvKinematicsPlugin::SrvKinematicsPlugin() : active_(false), next_service_client_(0), solution_cache_size_(0)
 {
 }
 
@@ -132,15 +135,30 @@ bool SrvKinematicsPlugin::initialize(const std::string& robot_description, const
   robot_state_.reset(new robot_state::RobotState(robot_model_));
   robot_state_->setToDefaultValues();
 
-  // Create the ROS service client
+  // Several persistent clients let concurrent queries have their requests in flight at the same time
+  int num_service_clients;
+  lookupParam("kinematics_solver_service_clients", num_service_clients, 1);
+  int solution_cache_size;
+  lookupParam("kinematics_solver_service_cache_size", solution_cache_size, 0);
+  solution_cache_size_ = std::max(solution_cache_size, 0);
+
+  // Create the ROS service clients
   ros::NodeHandle nonprivate_handle("");
-  ik_service_client_ = std::make_shared<ros::ServiceClient>(
-      nonprivate_handle.serviceClient<moveit_msgs::GetPositionIK>(ik_service_name));
-  if (!ik_service_client_->waitForExistence(ros::Duration(0.1)))  // wait 0.1 seconds, blocking
+  ik_service_clients_.clear();
+  for (int i = 0; i < std::max(num_service_clients, 1); ++i)
+  {
+    std::shared_ptr<ServiceClient> ik_service_client = std::make_shared<ServiceClient>();
+    ik_service_client->client = nonprivate_handle.serviceClient<moveit_msgs::GetPositionIK>(ik_service_name, true);
+    ik_service_clients_.push_back(ik_service_client);
+  }
+  ros::ServiceClient& ik_service_client = ik_service_clients_[0]->client;
+  if (!ik_service_client.waitForExistence(ros::Duration(0.1)))  // wait 0.1 seconds, blocking
     ROS_WARN_STREAM_NAMED("srv",
-                          "Unable to connect to ROS service client with name: " << ik_service_client_->getService());
+                          "Unable to connect to ROS service client with name: " << ik_service_client.getService());
   else
-    ROS_INFO_STREAM_NAMED("srv", "Service client started with ROS service name: " << ik_service_client_->getService());
+    ROS_INFO_STREAM_NAMED("srv", "Service client started with ROS service name: " << ik_service_client.getService()
+                                                                                  << " (" << ik_service_clients_.size()
+                                                                                  << " connections)");
 
   active_ = true;
   ROS_DEBUG_NAMED("srv", "ROS service-based kinematics solver initialized");
@@ -289,14 +307,32 @@ bool SrvKinematicsPlugin::searchPositionIK(const std::vector<geometry_msgs::Pose
     return false;
   }
 
+  // Poses solved before are answered without a service call, if their solution is still accepted. The solution may
+  // be further away from this seed than consistency limits allow, so queries with such limits are always solved.
+  bool use_cache = solution_cache_size_ > 0 && consistency_limits.empty();
+  if (use_cache && getCachedSolution(ik_poses, solution))
+  {
+    if (solution_callback.empty())
+    {
+      error_code.val = error_code.SUCCESS;
+      return true;
+    }
+    solution_callback(ik_poses[0], solution, error_code);
+    if (error_code.val == error_code.SUCCESS)
+      return true;
+  }
+
   // Create the service message
   moveit_msgs::GetPositionIK ik_srv;
   ik_srv.request.ik_request.avoid_collisions = true;
   ik_srv.request.ik_request.group_name = getGroupName();
 
   // Copy seed state into virtual robot state and convert into moveit_msg
-  robot_state_->setJointGroupPositions(joint_model_group_, ik_seed_state);
-  moveit::core::robotStateToRobotStateMsg(*robot_state_, ik_srv.request.ik_request.robot_state);
+  {
+    std::lock_guard<std::mutex> slock(robot_state_lock_);
+    robot_state_->setJointGroupPositions(joint_model_group_, ik_seed_state);
+    moveit::core::robotStateToRobotStateMsg(*robot_state_, ik_srv.request.ik_request.robot_state);
+  }
 
   // Load the poses into the request in difference places depending if there is more than one or not
   geometry_msgs::PoseStamped ik_pose_st;
@@ -320,8 +356,7 @@ bool SrvKinematicsPlugin::searchPositionIK(const std::vector<geometry_msgs::Pose
     ik_srv.request.ik_request.ik_link_name = getTipFrames()[0];
   }
 
-  ROS_DEBUG_STREAM_NAMED("srv", "Calling service: " << ik_service_client_->getService());
-  if (ik_service_client_->call(ik_srv))
+  if (callService(ik_srv))
   {
     // Check error code
     error_code.val = ik_srv.response.error_code.val;
@@ -347,22 +382,28 @@ bool SrvKinematicsPlugin::searchPositionIK(const std::vector<geometry_msgs::Pose
   }
   else
   {
-    ROS_ERROR_STREAM("Service call failed to connect to service: " << ik_service_client_->getService());
+    ROS_ERROR_STREAM("Service call failed to connect to service: " << ik_service_clients_[0]->client.getService());
     error_code.val = error_code.FAILURE;
     return false;
   }
 
-  // Convert the robot state message to our robot_state representation
-  if (!moveit::core::robotStateMsgToRobotState(ik_srv.response.solution, *robot_state_))
   {
-    ROS_ERROR_STREAM_NAMED("srv",
-                           "An error occured converting received robot state message into internal robot state.");
-    error_code.val = error_code.FAILURE;
-    return false;
-  }
+    std::lock_guard<std::mutex> slock(robot_state_lock_);
+
+    // Convert the robot state message to our robot_state representation
+    if (!moveit::core::robotStateMsgToRobotState(ik_srv.response.solution, *robot_state_))
+    {
+      ROS_ERROR_STREAM_NAMED("srv",
+                             "An error occured converting received robot state message into internal robot state.");
+      error_code.val = error_code.FAILURE;
+      return false;
+    }
 
-  // Get just the joints we are concerned about in our planning group
-  robot_state_->copyJointGroupPositions(joint_model_group_, solution);
+    // Get just the joints we are concerned about in our planning group
+    robot_state_->copyJointGroupPositions(joint_model_group_, solution);
+  }
+  if (use_cache)
+    cacheSolution(ik_poses, solution);
 
   // Run the solution callback (i.e. collision checker) if available
   if (!solution_callback.empty())
@@ -394,6 +435,128 @@ bool SrvKinematicsPlugin::searchPositionIK(const std::vector<geometry_msgs::Pose
   return true;
 }
 
+bool SrvKinematicsPlugin::searchPositionIKBatch(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                               const std::vector<std::vector<double> >& ik_seed_states,
+                                               double timeout, std::vector<std::vector<double> >& solutions,
+                                               std::vector<moveit_msgs::MoveItErrorCodes>& error_codes,
+                                               const kinematics::KinematicsQueryOptions& options) const
+{
+  solutions.assign(ik_poses.size(), std::vector<double>());
+  error_codes.assign(ik_poses.size(), moveit_msgs::MoveItErrorCodes());
+  if (ik_poses.empty())
+    return true;
+
+  if (ik_seed_states.size() != 1 && ik_seed_states.size() != ik_poses.size())
+  {
+    ROS_ERROR_NAMED("srv", "Expected 1 or %zu seed states instead of %zu", ik_poses.size(), ik_seed_states.size());
+    for (std::size_t i = 0; i < error_codes.size(); ++i)
+      error_codes[i].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return false;
+  }
+
+  // each thread keeps one request in flight, taking the next query when its response arrives
+  std::atomic<std::size_t> next_query(0);
+  std::atomic<std::size_t> solved(0);
+  auto solve_queries = [&]() {
+    for (std::size_t i = next_query++; i < ik_poses.size(); i = next_query++)
+    {
+      if (searchPositionIK(ik_poses[i], ik_seed_states.size() == 1 ? ik_seed_states[0] : ik_seed_states[i], timeout,
+                           solutions[i], error_codes[i], options))
+        ++solved;
+      else
+        solutions[i].clear();
+    }
+  };
+
+  std::size_t workers = std::min(ik_service_clients_.size(), ik_poses.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < workers; ++i)
+    threads.push_back(std::thread(solve_queries));
+  solve_queries();
+  for (std::size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+
+  return solved == ik_poses.size();
+}
+
+bool SrvKinematicsPlugin::callService(moveit_msgs::GetPositionIK& ik_srv) const
+{
+  // prefer a client that is not serving another call; if all are busy, wait for the first one tried
+  std::size_t first = next_service_client_++ % ik_service_clients_.size();
+  for (std::size_t i = 0; i < ik_service_clients_.size(); ++i)
+  {
+    ServiceClient& ik_service_client = *ik_service_clients_[(first + i) % ik_service_clients_.size()];
+    std::unique_lock<std::mutex> ulock(ik_service_client.lock, std::try_to_lock);
+    if (ulock.owns_lock())
+      return callService(ik_service_client.client, ik_srv);
+  }
+  ServiceClient& ik_service_client = *ik_service_clients_[first];
+  std::lock_guard<std::mutex> slock(ik_service_client.lock);
+  return callService(ik_service_client.client, ik_srv);
+}
+
+bool SrvKinematicsPlugin::callService(ros::ServiceClient& client, moveit_msgs::GetPositionIK& ik_srv) const
+{
+  // a persistent connection stays closed once the server drops it, so reconnect before calling
+  if (!client.isValid())
+    client = ros::NodeHandle("").serviceClient<moveit_msgs::GetPositionIK>(client.getService(), true);
+  ROS_DEBUG_STREAM_NAMED("srv", "Calling service: " << client.getService());
+  return client.call(ik_srv);
+}
+
+namespace
+{
+std::vector<double> getCacheKey(const std::vector<geometry_msgs::Pose>& ik_poses)
+{
+  std::vector<double> key;
+  key.reserve(7 * ik_poses.size());
+  for (std::size_t i = 0; i < ik_poses.size(); ++i)
+  {
+    const geometry_msgs::Pose& pose = ik_poses[i];
+    key.push_back(pose.position.x);
+    key.push_back(pose.position.y);
+    key.push_back(pose.position.z);
+    key.push_back(pose.orientation.x);
+    key.push_back(pose.orientation.y);
+    key.push_back(pose.orientation.z);
+    key.push_back(pose.orientation.w);
+  }
+  return key;
+}
+}
+
+bool SrvKinematicsPlugin::getCachedSolution(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                            std::vector<double>& solution) const
+{
+  std::vector<double> key = getCacheKey(ik_poses);
+  std::lock_guard<std::mutex> slock(solution_cache_lock_);
+  std::map<std::vector<double>, std::vector<double> >::const_iterator it = solution_cache_.find(key);
+  if (it == solution_cache_.end())
+    return false;
+  solution = it->second;
+  return true;
+}
+
+void SrvKinematicsPlugin::cacheSolution(const std::vector<geometry_msgs::Pose>& ik_poses,
+                                        const std::vector<double>& solution) const
+{
+  std::vector<double> key = getCacheKey(ik_poses);
+  std::lock_guard<std::mutex> slock(solution_cache_lock_);
+  std::pair<std::map<std::vector<double>, std::vector<double> >::iterator, bool> inserted =
+      solution_cache_.insert(std::make_pair(key, solution));
+  if (!inserted.second)
+  {
+    inserted.first->second = solution;
+    return;
+  }
+  solution_cache_order_.push_back(key);
+  while (solution_cache_order_.size() > solution_cache_size_)
+  {
+    solution_cache_.erase(solution_cache_order_.front());
+    solution_cache_order_.pop_front();
+  }
+}
+
 bool SrvKinematicsPlugin::getPositionFK(const std::vector<std::string>& link_names,
                                         const std::vector<double>& joint_angles,
                                         std::vector<geometry_msgs::Pose>& poses) const
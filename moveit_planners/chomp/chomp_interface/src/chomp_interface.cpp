@@ -73,5 +73,8 @@ void CHOMPInterface::loadParams()
             std::string("quintic-spline"));
   nh_.param("enable_failure_recovery", params_.enable_failure_recovery_, false);
   nh_.param("max_recovery_attempts", params_.max_recovery_attempts_, 5);
+  nh_.param("enable_multi_start", params_.enable_multi_start_, false);
+  nh_.param("multi_start_reuse_tolerance", params_.multi_start_reuse_tolerance_, 0.1);
+  nh_.param("resolution_level_max_iterations", params_.resolution_level_max_iterations_, std::vector<int>());
 }
 }
@@ -40,11 +40,15 @@
 #include <eigen3/Eigen/Core>
 #include <chomp_motion_planner/chomp_trajectory.h>
 #include <vector>
+#include <algorithm>
 
 namespace chomp
 {
 /**
  * \brief Represents the smoothness cost for CHOMP, for a single joint
+ *
+ * The quadratic cost of finite differences is banded, so it is stored as its lower band, and its inverse is applied
+ * through a banded Cholesky factorization; both take time and memory linear in the number of trajectory points.
  */
 class ChompCost
 {
@@ -56,44 +60,116 @@ public:
   template <typename Derived>
   void getDerivative(Eigen::MatrixXd::ColXpr joint_trajectory, Eigen::MatrixBase<Derived>& derivative) const;
 
-  const Eigen::MatrixXd& getQuadraticCostInverse() const;
+  /**
+   * \brief Multiply every column of \e rhs by the inverse of the quadratic cost of the free variables, in place
+   */
+  template <typename Derived>
+  void solveQuadraticCost(Eigen::MatrixBase<Derived>& rhs) const;
+
+  /**
+   * \brief Get one column of the inverse of the quadratic cost of the free variables
+   */
+  void getQuadraticCostInverseColumn(int index, Eigen::VectorXd& column) const;
 
-  const Eigen::MatrixXd& getQuadraticCost() const;
+  /**
+   * \brief Get the diagonal of the inverse of the quadratic cost of the free variables
+   */
+  const Eigen::VectorXd& getQuadraticCostInverseDiagonal() const;
+
+  /**
+   * \brief Get the dense inverse of the quadratic cost of the free variables; this takes quadratic time and memory
+   */
+  Eigen::MatrixXd getQuadraticCostInverse() const;
+
+  /**
+   * \brief Get the dense quadratic cost of the free variables
+   */
+  Eigen::MatrixXd getQuadraticCost() const;
 
   double getCost(Eigen::MatrixXd::ColXpr joint_trajectory) const;
 
   double getMaxQuadCostInvValue() const;
 
+  /**
+   * \brief True if \e other has the same quadratic cost, so both can be solved in one operation
+   */
+  bool hasSameQuadraticCost(const ChompCost& other) const;
+
   void scale(double scale);
 
 private:
+  // band(k, i) holds element (i + k, i) of a symmetric matrix, or of a lower triangular one
   Eigen::MatrixXd quad_cost_full_;
   Eigen::MatrixXd quad_cost_;
   // Eigen::VectorXd linear_cost_;
-  Eigen::MatrixXd quad_cost_inv_;
+  Eigen::MatrixXd quad_cost_cholesky_;
+  Eigen::VectorXd quad_cost_inv_diagonal_;
 
-  Eigen::MatrixXd getDiffMatrix(int size, const double* diff_rule) const;
+  void addDiffMatrixProduct(int size, const double* diff_rule, double weight);
+  void computeInverseDiagonal();
+
+  template <typename Derived1, typename Derived2>
+  static void multiplyBanded(const Eigen::MatrixXd& band, const Eigen::MatrixBase<Derived1>& x,
+                             Eigen::MatrixBase<Derived2>& y);
 };
 
+template <typename Derived1, typename Derived2>
+void ChompCost::multiplyBanded(const Eigen::MatrixXd& band, const Eigen::MatrixBase<Derived1>& x,
+                               Eigen::MatrixBase<Derived2>& y)
+{
+  int size = band.cols();
+  int bandwidth = band.rows() - 1;
+  y.setZero();
+  for (int j = 0; j < size; ++j)
+  {
+    y(j) += band(0, j) * x(j);
+    for (int k = 1; k <= bandwidth && j + k < size; ++k)
+    {
+      y(j + k) += band(k, j) * x(j);
+      y(j) += band(k, j) * x(j + k);
+    }
+  }
+}
+
 template <typename Derived>
 void ChompCost::getDerivative(Eigen::MatrixXd::ColXpr joint_trajectory, Eigen::MatrixBase<Derived>& derivative) const
 {
-  derivative = (quad_cost_full_ * (2.0 * joint_trajectory));
+  multiplyBanded(quad_cost_full_, joint_trajectory, derivative);
+  derivative *= 2.0;
 }
 
-inline const Eigen::MatrixXd& ChompCost::getQuadraticCostInverse() const
+template <typename Derived>
+void ChompCost::solveQuadraticCost(Eigen::MatrixBase<Derived>& rhs) const
 {
-  return quad_cost_inv_;
+  const Eigen::MatrixXd& l = quad_cost_cholesky_;
+  int size = l.cols();
+  int bandwidth = l.rows() - 1;
+
+  // forward substitution with L, then back substitution with L^T, on all columns at once
+  for (int i = 0; i < size; ++i)
+  {
+    for (int k = std::max(0, i - bandwidth); k < i; ++k)
+      rhs.row(i) -= l(i - k, k) * rhs.row(k);
+    rhs.row(i) /= l(0, i);
+  }
+  for (int i = size - 1; i >= 0; --i)
+  {
+    for (int k = i + 1; k <= i + bandwidth && k < size; ++k)
+      rhs.row(i) -= l(k - i, i) * rhs.row(k);
+    rhs.row(i) /= l(0, i);
+  }
 }
 
-inline const Eigen::MatrixXd& ChompCost::getQuadraticCost() const
+inline const Eigen::VectorXd& ChompCost::getQuadraticCostInverseDiagonal() const
 {
-  return quad_cost_;
+  return quad_cost_inv_diagonal_;
 }
 
 inline double ChompCost::getCost(Eigen::MatrixXd::ColXpr joint_trajectory) const
 {
-  return joint_trajectory.dot(quad_cost_full_ * joint_trajectory);
+  Eigen::VectorXd product(joint_trajectory.size());
+  multiplyBanded(quad_cost_full_, joint_trajectory, product);
+  return joint_trajectory.dot(product);
 }
 
 }  // namespace chomp
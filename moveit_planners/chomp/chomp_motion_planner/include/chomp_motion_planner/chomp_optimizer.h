@@ -49,6 +49,7 @@
 #include <Eigen/Core>
 #include <Eigen/StdVector>
 #include <vector>
+#include <atomic>
 
 namespace chomp
 {
@@ -82,39 +83,35 @@ public:
     return is_collision_free_;
   }
 
-private:
-  inline double getPotential(double field_distance, double radius, double clearence)
+  /**
+   * Stops a running optimization after its current iteration; can be called from any thread
+   */
+  void terminate()
   {
-    double d = field_distance - radius;
-    double potential = 0.0;
-
-    // three cases below:
-    if (d >= clearence)
-    {
-      potential = 0.0;
-    }
-    else if (d >= 0.0)
-    {
-      double diff = (d - clearence);
-      double gradient_magnitude = diff * clearence;  // (diff / clearance)
-      potential = 0.5 * gradient_magnitude * diff;
-    }
-    else  // if d < 0.0
-    {
-      potential = -d + 0.5 * clearence;
-    }
+    terminated_ = true;
+  }
 
-    return potential;
+private:
+  /**
+   * Computes the obstacle potential of collision points from their distances to the obstacles (field distance minus
+   * sphere radius), without branches so that it vectorizes over all the collision points of a trajectory point
+   */
+  template <typename Derived>
+  inline Eigen::ArrayXd getPotential(const Eigen::ArrayBase<Derived>& d, double clearence) const
+  {
+    // zero beyond the clearance, quadratic within it, and linear inside the obstacles
+    Eigen::ArrayXd diff = d.min(clearence) - clearence;
+    return (d < 0.0).select(0.5 * clearence - d, 0.5 * clearence * diff.square());
   }
   template <typename Derived>
-  void getJacobian(int trajectoryPoint, Eigen::Vector3d& collision_point_pos, std::string& jointName,
+  void getJacobian(int trajectoryPoint, const Eigen::Vector3d& collision_point_pos, int collision_point,
                    Eigen::MatrixBase<Derived>& jacobian) const;
 
   // void getRandomState(const moveit::core::RobotState& currentState,
   //                     const std::string& group_name,
   //                     Eigen::VectorXd& state_vec);
 
-  void setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i);
+  void setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i, moveit::core::RobotState& state);
 
   // collision_proximity::CollisionProximitySpace::TrajectorySafety checkCurrentIterValidity();
 
@@ -140,16 +137,24 @@ private:
   const collision_detection::CollisionRobotHybrid* hy_robot_;
 
   std::vector<ChompCost> joint_costs_;
+  bool shared_joint_cost_;
   collision_detection::GroupStateRepresentationPtr gsr_;
+  /// the states and collision structures of the threads that run the forward kinematics
+  std::vector<moveit::core::RobotState> thread_states_;
+  std::vector<collision_detection::GroupStateRepresentationPtr> thread_gsrs_;
   bool initialized_;
 
-  std::vector<std::vector<std::string> > collision_point_joint_names_;
-  std::vector<EigenSTL::vector_Vector3d> collision_point_pos_eigen_;
-  std::vector<EigenSTL::vector_Vector3d> collision_point_vel_eigen_;
-  std::vector<EigenSTL::vector_Vector3d> collision_point_acc_eigen_;
-  std::vector<std::vector<double> > collision_point_potential_;
-  std::vector<std::vector<double> > collision_point_vel_mag_;
-  std::vector<EigenSTL::vector_Vector3d> collision_point_potential_gradient_;
+  std::vector<std::string> collision_point_joint_names_;
+  /// 1 where a joint (row) moves a collision point (column), and 0 elsewhere
+  Eigen::MatrixXd collision_point_joint_mask_;
+  /// the x, y and z coordinates of all collision points, one column per trajectory point
+  Eigen::MatrixXd collision_point_pos_;
+  Eigen::MatrixXd collision_point_vel_;
+  Eigen::MatrixXd collision_point_acc_;
+  Eigen::MatrixXd collision_point_potential_gradient_;
+  /// the values of all collision points, one column per trajectory point
+  Eigen::MatrixXd collision_point_potential_;
+  Eigen::MatrixXd collision_point_vel_mag_;
   std::vector<EigenSTL::vector_Vector3d> joint_axes_;
   std::vector<EigenSTL::vector_Vector3d> joint_positions_;
   Eigen::MatrixXd group_trajectory_backup_;
@@ -167,8 +172,8 @@ private:
 
   std::vector<int> state_is_in_collision_; /**< Array containing a boolean about collision info for each point in the
                                               trajectory */
-  std::vector<std::vector<int> > point_is_in_collision_;
   bool is_collision_free_;
+  std::atomic<bool> terminated_;
   double worst_collision_cost_state_;
 
   Eigen::MatrixXd smoothness_increments_;
@@ -182,6 +187,9 @@ private:
   Eigen::MatrixXd jacobian_jacobian_tranpose_;
   Eigen::VectorXd random_state_;
   Eigen::VectorXd joint_state_velocities_;
+  Eigen::VectorXd quad_cost_inv_column_;
+  Eigen::MatrixXd cartesian_gradients_;
+  Eigen::MatrixXd cartesian_moments_;
 
   std::vector<std::string> joint_names_;
   std::map<std::string, std::map<std::string, bool> > joint_parent_map_;
@@ -208,6 +216,9 @@ private:
   void calculateCollisionIncrements();
   void calculateTotalIncrements();
   void performForwardKinematics();
+  /** Evaluate the points start + thread, start + thread + thread_count, ... up to end with the state and the collision
+   *  structures of the given thread */
+  void performForwardKinematicsForPoints(int start, int end, int thread, int thread_count);
   void addIncrementsToTrajectory();
   void updateFullTrajectory();
   void debugCost();
@@ -220,7 +231,7 @@ private:
   void updateMomentum();
   void updatePositionFromMomentum();
   void calculatePseudoInverse();
-  void computeJointProperties(int trajectoryPoint);
+  void computeJointProperties(int trajectoryPoint, const moveit::core::RobotState& state);
   bool isCurrentTrajectoryMeshToMeshCollisionFree() const;
 };
 }
@@ -38,6 +38,7 @@
 #define CHOMP_PARAMETERS_H_
 
 #include <ros/ros.h>
+#include <vector>
 
 namespace chomp
 {
@@ -101,6 +102,15 @@ public:
                                   /// an initial path is not found with the specified chomp parameters
   int max_recovery_attempts_;     /// this the maximum recovery attempts to find a collision free path after an initial
                                   /// failure to find a solution
+  bool enable_multi_start_;  /// if set to true, CHOMP optimizes several initial trajectories concurrently (the
+                             /// configured one, a linear one, the input trajectory and the solutions of similar earlier
+                             /// requests) and uses the first collision free result
+  double multi_start_reuse_tolerance_;  /// the largest joint distance between the start and goal states of two
+                                        /// requests for which the solution of one initializes the other
+  std::vector<int> resolution_level_max_iterations_;  /// the maximum iterations of the coarse resolution levels,
+                                                      /// coarsest first; each level has half as many points as the next
+                                                      /// finer one and initializes it, and the full resolution
+                                                      /// trajectory then uses max_iterations_. Empty disables them
 };
 
 }  // namespace chomp
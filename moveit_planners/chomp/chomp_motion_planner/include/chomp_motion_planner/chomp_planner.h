@@ -38,9 +38,12 @@
 #define _CHOMP_PLANNER_H_
 
 #include <chomp_motion_planner/chomp_parameters.h>
+#include <chomp_motion_planner/chomp_trajectory.h>
 #include <moveit_msgs/MotionPlanDetailedResponse.h>
 #include <moveit_msgs/MotionPlanRequest.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <boost/thread/mutex.hpp>
+#include <deque>
 
 namespace chomp
 {
@@ -52,6 +55,23 @@ public:
 
   bool solve(const planning_scene::PlanningSceneConstPtr& planning_scene, const moveit_msgs::MotionPlanRequest& req,
              const ChompParameters& params, moveit_msgs::MotionPlanDetailedResponse& res) const;
+
+private:
+  /** \brief Initialize \e trajectory from the most recent stored solution whose start and goal states are within
+      \e tolerance of the ones of \e trajectory; returns false if there is none */
+  bool getStoredSolution(const std::string& group_name, double tolerance, ChompTrajectory& trajectory) const;
+
+  /** \brief Keep a collision free solution to initialize later requests in multi start mode */
+  void storeSolution(const std::string& group_name, const ChompTrajectory& trajectory) const;
+
+  struct StoredSolution
+  {
+    std::string group_name;
+    Eigen::MatrixXd trajectory;
+  };
+
+  mutable boost::mutex solutions_lock_;
+  mutable std::deque<StoredSolution> solutions_;
 };
 }
 
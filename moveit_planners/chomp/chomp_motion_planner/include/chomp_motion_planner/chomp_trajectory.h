@@ -139,6 +139,14 @@ public:
    */
   bool fillInFromTrajectory(moveit_msgs::MotionPlanDetailedResponse& res);
 
+  /**
+   * \brief Fills in all the points by linear interpolation of a trajectory of the same duration but with a different
+   * number of points, e.g. to initialize a fine trajectory from an optimized coarse one
+   *
+   * The first and the last points are copied from the source trajectory
+   */
+  void fillInFromResampledTrajectory(const ChompTrajectory& source_traj);
+
   /**
    * This function assigns the chomp_trajectory row / robot pose at index 'chomp_trajectory_point' obtained from input
    * trajectory_msgs at index 'trajectory_msgs_point'
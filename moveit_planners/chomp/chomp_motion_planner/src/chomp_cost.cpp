@@ -36,7 +36,8 @@
 
 #include <chomp_motion_planner/chomp_cost.h>
 #include <chomp_motion_planner/chomp_utils.h>
-#include <eigen3/Eigen/LU>
+#include <algorithm>
+#include <cmath>
 
 using namespace Eigen;
 using namespace std;
@@ -48,55 +49,130 @@ ChompCost::ChompCost(const ChompTrajectory& trajectory, int joint_number, const
 {
   int num_vars_all = trajectory.getNumPoints();
   int num_vars_free = num_vars_all - 2 * (DIFF_RULE_LENGTH - 1);
-  MatrixXd diff_matrix = MatrixXd::Zero(num_vars_all, num_vars_all);
-  quad_cost_full_ = MatrixXd::Zero(num_vars_all, num_vars_all);
+  // the product of two differentiation matrices has twice their half width
+  int bandwidth = DIFF_RULE_LENGTH - 1;
+  quad_cost_full_ = MatrixXd::Zero(bandwidth + 1, num_vars_all);
 
   // construct the quad cost for all variables, as a sum of squared differentiation matrices
   double multiplier = 1.0;
   for (unsigned int i = 0; i < derivative_costs.size(); i++)
   {
     multiplier *= trajectory.getDiscretization();
-    diff_matrix = getDiffMatrix(num_vars_all, &DIFF_RULES[i][0]);
-    quad_cost_full_ += (derivative_costs[i] * multiplier) * (diff_matrix.transpose() * diff_matrix);
+    addDiffMatrixProduct(num_vars_all, &DIFF_RULES[i][0], derivative_costs[i] * multiplier);
   }
-  quad_cost_full_ += MatrixXd::Identity(num_vars_all, num_vars_all) * ridge_factor;
+  quad_cost_full_.row(0).array() += ridge_factor;
 
   // extract the quad cost just for the free variables:
-  quad_cost_ = quad_cost_full_.block(DIFF_RULE_LENGTH - 1, DIFF_RULE_LENGTH - 1, num_vars_free, num_vars_free);
+  quad_cost_ = quad_cost_full_.block(0, DIFF_RULE_LENGTH - 1, bandwidth + 1, num_vars_free);
+  for (int k = 1; k <= bandwidth; ++k)
+    quad_cost_.row(k).tail(std::min(k, num_vars_free)).setZero();
 
-  // invert the matrix:
-  quad_cost_inv_ = quad_cost_.inverse();
-
-  // cout << quad_cost_inv_ << endl;
+  // factor the matrix: band Cholesky decomposition LL^T
+  quad_cost_cholesky_ = MatrixXd::Zero(bandwidth + 1, num_vars_free);
+  MatrixXd& l = quad_cost_cholesky_;
+  for (int j = 0; j < num_vars_free; ++j)
+  {
+    double diagonal = quad_cost_(0, j);
+    for (int k = std::max(0, j - bandwidth); k < j; ++k)
+      diagonal -= l(j - k, k) * l(j - k, k);
+    l(0, j) = sqrt(diagonal);
+    for (int i = j + 1; i <= j + bandwidth && i < num_vars_free; ++i)
+    {
+      double value = quad_cost_(i - j, j);
+      for (int k = std::max(0, i - bandwidth); k < j; ++k)
+        value -= l(i - k, k) * l(j - k, k);
+      l(i - j, j) = value / l(0, j);
+    }
+  }
+  computeInverseDiagonal();
 }
 
-Eigen::MatrixXd ChompCost::getDiffMatrix(int size, const double* diff_rule) const
+void ChompCost::addDiffMatrixProduct(int size, const double* diff_rule, double weight)
 {
-  MatrixXd matrix = MatrixXd::Zero(size, size);
-  for (int i = 0; i < size; i++)
+  // row r of the differentiation matrix has diff_rule[j + DIFF_RULE_LENGTH / 2] in column r + j
+  for (int r = 0; r < size; r++)
   {
-    for (int j = -DIFF_RULE_LENGTH / 2; j <= DIFF_RULE_LENGTH / 2; j++)
+    for (int j1 = -DIFF_RULE_LENGTH / 2; j1 <= DIFF_RULE_LENGTH / 2; j1++)
     {
-      int index = i + j;
-      if (index < 0)
-        continue;
-      if (index >= size)
+      int p = r + j1;
+      if (p < 0 || p >= size)
         continue;
-      matrix(i, index) = diff_rule[j + DIFF_RULE_LENGTH / 2];
+      for (int j2 = -DIFF_RULE_LENGTH / 2; j2 <= j1; j2++)
+      {
+        int q = r + j2;
+        if (q < 0)
+          continue;
+        quad_cost_full_(p - q, q) +=
+            weight * diff_rule[j1 + DIFF_RULE_LENGTH / 2] * diff_rule[j2 + DIFF_RULE_LENGTH / 2];
+      }
+    }
+  }
+}
+
+void ChompCost::computeInverseDiagonal()
+{
+  // the band of the inverse Z follows from Z L = L^-T, going backwards from the last variable
+  const MatrixXd& l = quad_cost_cholesky_;
+  int size = l.cols();
+  int bandwidth = l.rows() - 1;
+  MatrixXd z = MatrixXd::Zero(bandwidth + 1, size);
+  for (int i = size - 1; i >= 0; --i)
+  {
+    int last = std::min(size - 1, i + bandwidth);
+    for (int j = last; j >= i; --j)
+    {
+      double value = (j == i) ? 1.0 / l(0, i) : 0.0;
+      for (int k = i + 1; k <= last; ++k)
+      {
+        // element (j, k) of the symmetric inverse, both within the band below i
+        double z_jk = j >= k ? z(j - k, k) : z(k - j, j);
+        value -= l(k - i, i) * z_jk;
+      }
+      z(j - i, i) = value / l(0, i);
     }
   }
+  quad_cost_inv_diagonal_ = z.row(0).transpose();
+}
+
+void ChompCost::getQuadraticCostInverseColumn(int index, Eigen::VectorXd& column) const
+{
+  column = VectorXd::Unit(quad_cost_cholesky_.cols(), index);
+  solveQuadraticCost(column);
+}
+
+Eigen::MatrixXd ChompCost::getQuadraticCostInverse() const
+{
+  MatrixXd inverse = MatrixXd::Identity(quad_cost_cholesky_.cols(), quad_cost_cholesky_.cols());
+  solveQuadraticCost(inverse);
+  return inverse;
+}
+
+Eigen::MatrixXd ChompCost::getQuadraticCost() const
+{
+  int size = quad_cost_.cols();
+  MatrixXd matrix = MatrixXd::Zero(size, size);
+  for (int j = 0; j < size; j++)
+    for (int k = 0; k < quad_cost_.rows() && j + k < size; k++)
+      matrix(j + k, j) = matrix(j, j + k) = quad_cost_(k, j);
   return matrix;
 }
 
 double ChompCost::getMaxQuadCostInvValue() const
 {
-  return quad_cost_inv_.maxCoeff();
+  // the largest element of a positive definite matrix is on its diagonal
+  return quad_cost_inv_diagonal_.maxCoeff();
+}
+
+bool ChompCost::hasSameQuadraticCost(const ChompCost& other) const
+{
+  return quad_cost_full_ == other.quad_cost_full_;
 }
 
 void ChompCost::scale(double scale)
 {
   double inv_scale = 1.0 / scale;
-  quad_cost_inv_ *= inv_scale;
+  quad_cost_inv_diagonal_ *= inv_scale;
+  quad_cost_cholesky_ *= sqrt(scale);
   quad_cost_ *= scale;
   quad_cost_full_ *= scale;
 }
@@ -43,6 +43,8 @@
 #include <moveit/planning_scene/planning_scene.h>
 #include <eigen3/Eigen/LU>
 #include <eigen3/Eigen/Core>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 namespace chomp
 {
@@ -63,6 +65,7 @@ ChompOptimizer::ChompOptimizer(ChompTrajectory* trajectory, const planning_scene
   , state_(start_state)
   , start_state_(start_state)
   , initialized_(false)
+  , terminated_(false)
 {
   std::vector<std::string> cd_names;
   planning_scene->getCollisionDetectorNames(cd_names);
@@ -112,6 +115,18 @@ void ChompOptimizer::initialize()
   hy_world_->getCollisionGradients(req, res, *hy_robot_->getCollisionRobotDistanceField().get(), state_,
                                    &planning_scene_->getAllowedCollisionMatrix(), gsr_);
   ROS_INFO_STREAM("First coll check took " << (ros::WallTime::now() - wt));
+
+  // each thread needs its own collision structures, generated with the allowed collisions like the first one
+  int thread_count = std::min<int>(std::max(1u, boost::thread::hardware_concurrency()), num_vars_all_);
+  thread_states_.assign(thread_count, state_);
+  thread_gsrs_.resize(thread_count);
+  thread_gsrs_[0] = gsr_;
+  for (int t = 1; t < thread_count; ++t)
+  {
+    collision_detection::CollisionResult thread_res;
+    hy_world_->getCollisionGradients(req, thread_res, *hy_robot_->getCollisionRobotDistanceField().get(),
+                                     thread_states_[t], &planning_scene_->getAllowedCollisionMatrix(), thread_gsrs_[t]);
+  }
   num_collision_points_ = 0;
   for (size_t i = 0; i < gsr_->gradients_.size(); i++)
   {
@@ -148,6 +163,14 @@ void ChompOptimizer::initialize()
     joint_costs_[i].scale(max_cost_scale);
   }
 
+  // joints with the same smoothness cost are updated in one solve
+  shared_joint_cost_ = true;
+  for (int i = 1; i < num_joints_; i++)
+  {
+    if (!joint_costs_[i].hasSameQuadraticCost(joint_costs_[0]))
+      shared_joint_cost_ = false;
+  }
+
   // allocate memory for matrices:
   smoothness_increments_ = Eigen::MatrixXd::Zero(num_vars_free_, num_joints_);
   collision_increments_ = Eigen::MatrixXd::Zero(num_vars_free_, num_joints_);
@@ -162,21 +185,21 @@ void ChompOptimizer::initialize()
   group_trajectory_backup_ = group_trajectory_.getTrajectory();
   best_group_trajectory_ = group_trajectory_.getTrajectory();
 
-  collision_point_joint_names_.resize(num_vars_all_, std::vector<std::string>(num_collision_points_));
-  collision_point_pos_eigen_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_collision_points_));
-  collision_point_vel_eigen_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_collision_points_));
-  collision_point_acc_eigen_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_collision_points_));
+  collision_point_joint_names_.resize(num_collision_points_);
+  collision_point_pos_ = Eigen::MatrixXd::Zero(3 * num_collision_points_, num_vars_all_);
+  collision_point_vel_ = Eigen::MatrixXd::Zero(3 * num_collision_points_, num_vars_all_);
+  collision_point_acc_ = Eigen::MatrixXd::Zero(3 * num_collision_points_, num_vars_all_);
+  collision_point_potential_gradient_ = Eigen::MatrixXd::Zero(3 * num_collision_points_, num_vars_all_);
+  collision_point_potential_ = Eigen::MatrixXd::Zero(num_collision_points_, num_vars_all_);
+  collision_point_vel_mag_ = Eigen::MatrixXd::Zero(num_collision_points_, num_vars_all_);
+  cartesian_gradients_ = Eigen::MatrixXd::Zero(3, num_collision_points_);
+  cartesian_moments_ = Eigen::MatrixXd::Zero(3, num_collision_points_);
   joint_axes_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_joints_));
   joint_positions_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_joints_));
 
-  collision_point_potential_.resize(num_vars_all_, std::vector<double>(num_collision_points_));
-  collision_point_vel_mag_.resize(num_vars_all_, std::vector<double>(num_collision_points_));
-  collision_point_potential_gradient_.resize(num_vars_all_, EigenSTL::vector_Vector3d(num_collision_points_));
-
   collision_free_iteration_ = 0;
   is_collision_free_ = false;
   state_is_in_collision_.resize(num_vars_all_);
-  point_is_in_collision_.resize(num_vars_all_, std::vector<int>(num_collision_points_));
 
   last_improvement_iteration_ = -1;
 
@@ -189,11 +212,12 @@ void ChompOptimizer::initialize()
   // random_joint_momentum_ = Eigen::VectorXd::Zero(num_vars_free_);
   multivariate_gaussian_.clear();
   stochasticity_factor_ = 1.0;
-  for (int i = 0; i < num_joints_; i++)
-  {
-    multivariate_gaussian_.push_back(
-        MultivariateGaussian(Eigen::VectorXd::Zero(num_vars_free_), joint_costs_[i].getQuadraticCostInverse()));
-  }
+  // the covariances are dense inverses of the smoothness costs, so they are only computed for HMC
+  // for (int i = 0; i < num_joints_; i++)
+  // {
+  //   multivariate_gaussian_.push_back(
+  //       MultivariateGaussian(Eigen::VectorXd::Zero(num_vars_free_), joint_costs_[i].getQuadraticCostInverse()));
+  // }
 
   std::map<std::string, std::string> fixed_link_resolution_map;
   for (int i = 0; i < num_joints_; i++)
@@ -245,29 +269,31 @@ void ChompOptimizer::initialize()
     }
   }
 
-  int start = free_vars_start_;
-  int end = free_vars_end_;
-  for (int i = start; i <= end; ++i)
+  size_t j = 0;
+  for (size_t g = 0; g < gsr_->gradients_.size(); g++)
   {
-    size_t j = 0;
-    for (size_t g = 0; g < gsr_->gradients_.size(); g++)
-    {
-      collision_detection::GradientInfo& info = gsr_->gradients_[g];
+    collision_detection::GradientInfo& info = gsr_->gradients_[g];
 
-      for (size_t k = 0; k < info.sphere_locations.size(); k++)
+    for (size_t k = 0; k < info.sphere_locations.size(); k++)
+    {
+      if (fixed_link_resolution_map.find(info.joint_name) != fixed_link_resolution_map.end())
       {
-        if (fixed_link_resolution_map.find(info.joint_name) != fixed_link_resolution_map.end())
-        {
-          collision_point_joint_names_[i][j] = fixed_link_resolution_map[info.joint_name];
-        }
-        else
-        {
-          ROS_ERROR("Couldn't find joint %s!", info.joint_name.c_str());
-        }
-        j++;
+        collision_point_joint_names_[j] = fixed_link_resolution_map[info.joint_name];
       }
+      else
+      {
+        ROS_ERROR("Couldn't find joint %s!", info.joint_name.c_str());
+      }
+      j++;
     }
   }
+
+  // resolve the joints that move each collision point once, instead of in every jacobian
+  collision_point_joint_mask_ = Eigen::MatrixXd::Zero(num_joints_, num_collision_points_);
+  for (int p = 0; p < num_collision_points_; p++)
+    for (int k = 0; k < num_joints_; k++)
+      if (isParent(collision_point_joint_names_[p], joint_names_[k]))
+        collision_point_joint_mask_(k, p) = 1.0;
   initialized_ = true;
 }
 
@@ -455,6 +481,12 @@ bool ChompOptimizer::optimize()
       break;
     }
 
+    if (terminated_)
+    {
+      ROS_INFO("Breaking out early because the optimization was terminated.");
+      break;
+    }
+
     /// TODO: HMC BASED COMMENTED CODE BELOW, Need to uncomment and perform extensive testing by varying the HMC
     /// parameters values in the chomp_planning.yaml file so that CHOMP can find optimal paths
 
@@ -611,6 +643,7 @@ void ChompOptimizer::calculateCollisionIncrements()
   double potential;
   double vel_mag_sq;
   double vel_mag;
+  Eigen::Vector3d collision_point_pos;
   Eigen::Vector3d potential_gradient;
   Eigen::Vector3d normalized_velocity;
   Eigen::Matrix3d orthogonal_projector;
@@ -642,42 +675,54 @@ void ChompOptimizer::calculateCollisionIncrements()
   {
     for (int j = 0; j < num_collision_points_; j++)
     {
-      potential = collision_point_potential_[i][j];
+      potential = collision_point_potential_(j, i);
 
       if (potential < 0.0001)
+      {
+        cartesian_gradients_.col(j).setZero();
+        cartesian_moments_.col(j).setZero();
         continue;
+      }
 
-      potential_gradient = -collision_point_potential_gradient_[i][j];
+      collision_point_pos = collision_point_pos_.col(i).segment<3>(3 * j);
+      potential_gradient = -collision_point_potential_gradient_.col(i).segment<3>(3 * j);
 
-      vel_mag = collision_point_vel_mag_[i][j];
+      vel_mag = collision_point_vel_mag_(j, i);
       vel_mag_sq = vel_mag * vel_mag;
 
       // all math from the CHOMP paper:
 
-      normalized_velocity = collision_point_vel_eigen_[i][j] / vel_mag;
+      normalized_velocity = collision_point_vel_.col(i).segment<3>(3 * j) / vel_mag;
       orthogonal_projector = Eigen::Matrix3d::Identity() - (normalized_velocity * normalized_velocity.transpose());
-      curvature_vector = (orthogonal_projector * collision_point_acc_eigen_[i][j]) / vel_mag_sq;
+      curvature_vector = (orthogonal_projector * collision_point_acc_.col(i).segment<3>(3 * j)) / vel_mag_sq;
       cartesian_gradient = vel_mag * (orthogonal_projector * potential_gradient - potential * curvature_vector);
 
-      // pass it through the jacobian transpose to get the increments
-      getJacobian(i, collision_point_pos_eigen_[i][j], collision_point_joint_names_[i][j], jacobian_);
-
       if (parameters_->use_pseudo_inverse_)
       {
+        // pass it through the jacobian pseudo inverse to get the increments
+        getJacobian(i, collision_point_pos, j, jacobian_);
         calculatePseudoInverse();
         collision_increments_.row(i - free_vars_start_).transpose() -= jacobian_pseudo_inverse_ * cartesian_gradient;
       }
       else
       {
-        collision_increments_.row(i - free_vars_start_).transpose() -= jacobian_.transpose() * cartesian_gradient;
+        cartesian_gradients_.col(j) = cartesian_gradient;
+        cartesian_moments_.col(j) = collision_point_pos.cross(cartesian_gradient);
       }
+    }
 
-      /*
-        if(point_is_in_collision_[i][j])
-        {
-        break;
-        }
-      */
+    if (!parameters_->use_pseudo_inverse_)
+    {
+      // pass the gradients of all collision points through the jacobian transposes at once: the jacobian column of
+      // joint k at point p is a_k x (p - o_k), so its product with a gradient g is a_k . (p x g - o_k x g)
+      Eigen::MatrixXd joint_moments = cartesian_moments_ * collision_point_joint_mask_.transpose();
+      Eigen::MatrixXd joint_gradients = cartesian_gradients_ * collision_point_joint_mask_.transpose();
+      for (int k = 0; k < num_joints_; k++)
+      {
+        const Eigen::Vector3d& axis = joint_axes_[i][k];
+        Eigen::Vector3d moment = joint_moments.col(k) - joint_positions_[i][k].cross(joint_gradients.col(k));
+        collision_increments_(i - free_vars_start_, k) -= axis.dot(moment);
+      }
     }
   }
   // cout << collision_increments_ << endl;
@@ -692,13 +737,21 @@ void ChompOptimizer::calculatePseudoInverse()
 
 void ChompOptimizer::calculateTotalIncrements()
 {
-  for (int i = 0; i < num_joints_; i++)
+  final_increments_ = parameters_->smoothness_cost_weight_ * smoothness_increments_ +
+                      parameters_->obstacle_cost_weight_ * collision_increments_;
+  if (shared_joint_cost_)
   {
-    final_increments_.col(i) =
-        parameters_->learning_rate_ * (joint_costs_[i].getQuadraticCostInverse() *
-                                       (parameters_->smoothness_cost_weight_ * smoothness_increments_.col(i) +
-                                        parameters_->obstacle_cost_weight_ * collision_increments_.col(i)));
+    joint_costs_[0].solveQuadraticCost(final_increments_);
   }
+  else
+  {
+    for (int i = 0; i < num_joints_; i++)
+    {
+      Eigen::MatrixXd::ColXpr increments = final_increments_.col(i);
+      joint_costs_[i].solveQuadraticCost(increments);
+    }
+  }
+  final_increments_ *= parameters_->learning_rate_;
 }
 
 void ChompOptimizer::addIncrementsToTrajectory()
@@ -759,11 +812,7 @@ double ChompOptimizer::getCollisionCost()
   // collision costs:
   for (int i = free_vars_start_; i <= free_vars_end_; i++)
   {
-    double state_collision_cost = 0.0;
-    for (int j = 0; j < num_collision_points_; j++)
-    {
-      state_collision_cost += collision_point_potential_[i][j] * collision_point_vel_mag_[i][j];
-    }
+    double state_collision_cost = collision_point_potential_.col(i).dot(collision_point_vel_mag_.col(i));
     collision_cost += state_collision_cost;
     if (state_collision_cost > worst_collision_cost)
     {
@@ -775,12 +824,12 @@ double ChompOptimizer::getCollisionCost()
   return parameters_->obstacle_cost_weight_ * collision_cost;
 }
 
-void ChompOptimizer::computeJointProperties(int trajectory_point)
+void ChompOptimizer::computeJointProperties(int trajectory_point, const moveit::core::RobotState& state)
 {
   // tf::Transform inverseWorldTransform = collision_space_->getInverseWorldTransform(*state_);
   for (int j = 0; j < num_joints_; j++)
   {
-    const moveit::core::JointModel* joint_model = state_.getJointModel(joint_names_[j]);
+    const moveit::core::JointModel* joint_model = state.getJointModel(joint_names_[j]);
     const moveit::core::RevoluteJointModel* revolute_joint =
         dynamic_cast<const moveit::core::RevoluteJointModel*>(joint_model);
     const moveit::core::PrismaticJointModel* prismatic_joint =
@@ -789,8 +838,8 @@ void ChompOptimizer::computeJointProperties(int trajectory_point)
     std::string parent_link_name = joint_model->getParentLinkModel()->getName();
     std::string child_link_name = joint_model->getChildLinkModel()->getName();
     Eigen::Affine3d joint_transform =
-        state_.getGlobalLinkTransform(parent_link_name) *
-        (kmodel_->getLinkModel(child_link_name)->getJointOriginTransform() * (state_.getJointTransform(joint_model)));
+        state.getGlobalLinkTransform(parent_link_name) *
+        (kmodel_->getLinkModel(child_link_name)->getJointOriginTransform() * (state.getJointTransform(joint_model)));
 
     // joint_transform = inverseWorldTransform * jointTransform;
     Eigen::Vector3d axis;
@@ -816,12 +865,12 @@ void ChompOptimizer::computeJointProperties(int trajectory_point)
 }
 
 template <typename Derived>
-void ChompOptimizer::getJacobian(int trajectory_point, Eigen::Vector3d& collision_point_pos, std::string& joint_name,
+void ChompOptimizer::getJacobian(int trajectory_point, const Eigen::Vector3d& collision_point_pos, int collision_point,
                                  Eigen::MatrixBase<Derived>& jacobian) const
 {
   for (int j = 0; j < num_joints_; j++)
   {
-    if (isParent(joint_name, joint_names_[j]))
+    if (collision_point_joint_mask_(j, collision_point) != 0.0)
     {
       Eigen::Vector3d column = joint_axes_[trajectory_point][j].cross(
           Eigen::Vector3d(collision_point_pos(0), collision_point_pos(1), collision_point_pos(2)) -
@@ -910,10 +959,9 @@ void ChompOptimizer::handleJointLimits()
       if (violation)
       {
         int free_var_index = max_violation_index - free_vars_start_;
-        double multiplier =
-            max_violation / joint_costs_[joint_i].getQuadraticCostInverse()(free_var_index, free_var_index);
-        group_trajectory_.getFreeJointTrajectoryBlock(joint_i) +=
-            multiplier * joint_costs_[joint_i].getQuadraticCostInverse().col(free_var_index);
+        double multiplier = max_violation / joint_costs_[joint_i].getQuadraticCostInverseDiagonal()(free_var_index);
+        joint_costs_[joint_i].getQuadraticCostInverseColumn(free_var_index, quad_cost_inv_column_);
+        group_trajectory_.getFreeJointTrajectoryBlock(joint_i) += multiplier * quad_cost_inv_column_;
       }
       if (++count > 10)
         break;
@@ -935,91 +983,92 @@ void ChompOptimizer::performForwardKinematics()
     end = num_vars_all_ - 1;
   }
 
+  // the points are independent, so they are evaluated in parallel
+  int thread_count = std::min<int>(thread_states_.size(), end - start + 1);
+  if (thread_count <= 1)
+    performForwardKinematicsForPoints(start, end, 0, 1);
+  else
+  {
+    boost::thread_group workers;
+    for (int t = 0; t < thread_count; ++t)
+      workers.create_thread(
+          boost::bind(&ChompOptimizer::performForwardKinematicsForPoints, this, start, end, t, thread_count));
+    workers.join_all();
+  }
+
   is_collision_free_ = true;
+  for (int i = start; i <= end; ++i)
+    if (state_is_in_collision_[i])
+      is_collision_free_ = false;
 
-  ros::WallDuration total_dur(0.0);
+  // now, get the vel and acc for each collision point (using finite differencing)
+  for (int i = free_vars_start_; i <= free_vars_end_; i++)
+  {
+    collision_point_vel_.col(i).setZero();
+    collision_point_acc_.col(i).setZero();
+    for (int k = -DIFF_RULE_LENGTH / 2; k <= DIFF_RULE_LENGTH / 2; k++)
+    {
+      collision_point_vel_.col(i) +=
+          (inv_time * DIFF_RULES[0][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_.col(i + k);
+      collision_point_acc_.col(i) +=
+          (inv_time_sq * DIFF_RULES[1][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_.col(i + k);
+    }
 
-  // for each point in the trajectory
-  for (int i = start; i <= end; ++i)
+    // get the norm of the velocity:
+    collision_point_vel_mag_.col(i) =
+        Eigen::Map<const Eigen::MatrixXd>(collision_point_vel_.col(i).data(), 3, num_collision_points_)
+            .colwise()
+            .norm()
+            .transpose();
+  }
+}
+
+void ChompOptimizer::performForwardKinematicsForPoints(int start, int end, int thread, int thread_count)
+{
+  moveit::core::RobotState& state = thread_states_[thread];
+  collision_detection::GroupStateRepresentationPtr& gsr = thread_gsrs_[thread];
+
+  // every thread takes every thread_count-th point, which spreads the points close to obstacles over the threads
+  for (int i = start + thread; i <= end; i += thread_count)
   {
     // Set Robot state from trajectory point...
     collision_detection::CollisionRequest req;
     collision_detection::CollisionResult res;
     req.group_name = planning_group_;
-    setRobotStateFromPoint(group_trajectory_, i);
-    ros::WallTime grad = ros::WallTime::now();
+    setRobotStateFromPoint(group_trajectory_, i, state);
 
-    hy_world_->getCollisionGradients(req, res, *hy_robot_->getCollisionRobotDistanceField().get(), state_, NULL, gsr_);
-    total_dur += (ros::WallTime::now() - grad);
-    computeJointProperties(i);
+    hy_world_->getCollisionGradients(req, res, *hy_robot_->getCollisionRobotDistanceField().get(), state, NULL, gsr);
+    computeJointProperties(i, state);
     state_is_in_collision_[i] = false;
 
     // Keep vars in scope
     {
       size_t j = 0;
-      for (size_t g = 0; g < gsr_->gradients_.size(); g++)
+      for (size_t g = 0; g < gsr->gradients_.size(); g++)
       {
-        collision_detection::GradientInfo& info = gsr_->gradients_[g];
+        collision_detection::GradientInfo& info = gsr->gradients_[g];
 
         for (size_t k = 0; k < info.sphere_locations.size(); k++)
         {
-          collision_point_pos_eigen_[i][j][0] = info.sphere_locations[k].x();
-          collision_point_pos_eigen_[i][j][1] = info.sphere_locations[k].y();
-          collision_point_pos_eigen_[i][j][2] = info.sphere_locations[k].z();
-
-          collision_point_potential_[i][j] =
-              getPotential(info.distances[k], info.sphere_radii[k], parameters_->min_clearence_);
-          collision_point_potential_gradient_[i][j][0] = info.gradients[k].x();
-          collision_point_potential_gradient_[i][j][1] = info.gradients[k].y();
-          collision_point_potential_gradient_[i][j][2] = info.gradients[k].z();
+          collision_point_pos_.col(i).segment<3>(3 * j) = info.sphere_locations[k];
+          collision_point_potential_gradient_.col(i).segment<3>(3 * j) = info.gradients[k];
 
-          point_is_in_collision_[i][j] = (info.distances[k] - info.sphere_radii[k] < info.sphere_radii[k]);
+          // the distances are turned into potentials below, for all collision points at once
+          collision_point_potential_(j, i) = info.distances[k] - info.sphere_radii[k];
 
-          if (point_is_in_collision_[i][j])
-          {
+          if (info.distances[k] - info.sphere_radii[k] < info.sphere_radii[k])
             state_is_in_collision_[i] = true;
-            // if(is_collision_free_ == true) {
-            //   ROS_INFO_STREAM("We know it's not collision free " << g);
-            //   ROS_INFO_STREAM("Sphere location " << info.sphere_locations[k].x() << " " <<
-            //   info.sphere_locations[k].y() << " " << info.sphere_locations[k].z());
-            //   ROS_INFO_STREAM("Gradient " << info.gradients[k].x() << " " << info.gradients[k].y() << " " <<
-            //   info.gradients[k].z() << " distance " << info.distances[k] << " radii " << info.sphere_radii[k]);
-            //   ROS_INFO_STREAM("Radius " << info.sphere_radii[k] << " potential " <<
-            //   collision_point_potential_[i][j]);
-            // }
-
-            is_collision_free_ = false;
-          }
           j++;
         }
       }
     }
-  }
-
-  // ROS_INFO_STREAM("Total dur " << total_dur << " total checks " << end-start+1);
-
-  // now, get the vel and acc for each collision point (using finite differencing)
-  for (int i = free_vars_start_; i <= free_vars_end_; i++)
-  {
-    for (int j = 0; j < num_collision_points_; j++)
-    {
-      collision_point_vel_eigen_[i][j] = Eigen::Vector3d(0, 0, 0);
-      collision_point_acc_eigen_[i][j] = Eigen::Vector3d(0, 0, 0);
-      for (int k = -DIFF_RULE_LENGTH / 2; k <= DIFF_RULE_LENGTH / 2; k++)
-      {
-        collision_point_vel_eigen_[i][j] +=
-            (inv_time * DIFF_RULES[0][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i + k][j];
-        collision_point_acc_eigen_[i][j] +=
-            (inv_time_sq * DIFF_RULES[1][k + DIFF_RULE_LENGTH / 2]) * collision_point_pos_eigen_[i + k][j];
-      }
-
-      // get the norm of the velocity:
-      collision_point_vel_mag_[i][j] = collision_point_vel_eigen_[i][j].norm();
-    }
+    collision_point_potential_.col(i) =
+        getPotential(collision_point_potential_.col(i).array(), parameters_->min_clearence_).matrix();
   }
 }
 
-void ChompOptimizer::setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i)
+void ChompOptimizer::setRobotStateFromPoint(ChompTrajectory& group_trajectory, int i,
+                                            moveit::core::RobotState& state)
 {
   const Eigen::MatrixXd::RowXpr& point = group_trajectory.getTrajectoryPoint(i);
 
@@ -1029,8 +1078,8 @@ void ChompOptimizer::setRobotStateFromPoint(ChompTrajectory& group_trajectory, i
     joint_states.push_back(point(0, j));
   }
 
-  state_.setJointGroupPositions(planning_group_, joint_states);
-  state_.update();
+  state.setJointGroupPositions(planning_group_, joint_states);
+  state.update();
 }
 
 void ChompOptimizer::perturbTrajectory()
@@ -1061,8 +1110,8 @@ void ChompOptimizer::perturbTrajectory()
   int mp_free_vars_index = mid_point - free_vars_start_;
   for (int i = 0; i < num_joints_; i++)
   {
-    group_trajectory_.getFreeJointTrajectoryBlock(i) +=
-        joint_costs_[i].getQuadraticCostInverse().col(mp_free_vars_index) * random_state_(i);
+    joint_costs_[i].getQuadraticCostInverseColumn(mp_free_vars_index, quad_cost_inv_column_);
+    group_trajectory_.getFreeJointTrajectoryBlock(i) += quad_cost_inv_column_ * random_state_(i);
   }
 }
 
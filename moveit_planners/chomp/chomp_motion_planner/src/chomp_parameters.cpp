@@ -68,6 +68,9 @@ ChompParameters::ChompParameters()
   trajectory_initialization_method_ = std::string("quintic-spline");
   enable_failure_recovery_ = false;
   max_recovery_attempts_ = 5;
+  enable_multi_start_ = false;
+  multi_start_reuse_tolerance_ = 0.1;
+  resolution_level_max_iterations_.clear();
 }
 
 ChompParameters::~ChompParameters()
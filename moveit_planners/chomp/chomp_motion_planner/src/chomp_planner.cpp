@@ -40,9 +40,205 @@
 #include <chomp_motion_planner/chomp_optimizer.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit_msgs/MotionPlanRequest.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <set>
 
 namespace chomp
 {
+namespace
+{
+// the number of collision free solutions kept to initialize later requests
+const std::size_t MAX_STORED_SOLUTIONS = 10;
+
+// coarse resolution levels with fewer points are skipped
+const int MIN_COARSE_LEVEL_POINTS = 8;
+
+// one of the initial trajectories that are optimized concurrently
+struct OptimizationStart
+{
+  OptimizationStart(const ChompTrajectory& initial_trajectory, const std::string& initialization)
+    : trajectory(initial_trajectory), name(initialization), initialized(true), collision_free(false)
+  {
+  }
+
+  ChompTrajectory trajectory;
+  std::string name;
+  bool initialized;
+  bool collision_free;
+};
+
+// the optimizers that run for the starts of one request; the first collision free result terminates the others
+struct MultiStart
+{
+  MultiStart() : winner(NULL)
+  {
+  }
+
+  boost::mutex lock;
+  std::set<ChompOptimizer*> optimizers;
+  const OptimizationStart* winner;
+};
+
+// run an optimizer, registered with the multi start (if any) so that a winner of another start can terminate it
+bool runOptimizer(ChompOptimizer& optimizer, MultiStart* multi_start)
+{
+  if (multi_start)
+  {
+    boost::mutex::scoped_lock slock(multi_start->lock);
+    if (multi_start->winner)
+      return false;
+    multi_start->optimizers.insert(&optimizer);
+  }
+  bool result = optimizer.optimize();
+  if (multi_start)
+  {
+    boost::mutex::scoped_lock slock(multi_start->lock);
+    multi_start->optimizers.erase(&optimizer);
+  }
+  return result;
+}
+
+// optimize coarse copies of the trajectory for the iterations of the configured resolution levels, coarsest first;
+// each level is initialized from the result of the previous one, and the trajectory from the result of the finest
+void optimizeCoarseLevels(const planning_scene::PlanningSceneConstPtr& planning_scene, const std::string& group_name,
+                          const ChompParameters& params, const moveit::core::RobotState& start_state,
+                          ChompTrajectory& trajectory, MultiStart* multi_start)
+{
+  const std::vector<int>& level_iterations = params.resolution_level_max_iterations_;
+  ChompParameters level_params = params;
+  ChompTrajectory previous_level(trajectory);
+  for (std::size_t i = 0; i < level_iterations.size(); ++i)
+  {
+    // every level halves the number of intervals of the next finer one
+    int factor = 1 << (level_iterations.size() - i);
+    int num_points = (trajectory.getNumPoints() - 1) / factor + 1;
+    if (num_points < MIN_COARSE_LEVEL_POINTS)
+    {
+      ROS_DEBUG_NAMED("chomp_planner", "Skipping resolution level %d, which would have only %d points", (int)i,
+                      num_points);
+      continue;
+    }
+
+    ChompTrajectory level(planning_scene->getRobotModel(), num_points, trajectory.getDiscretization() * factor,
+                          group_name);
+    level.fillInFromResampledTrajectory(previous_level);
+    level_params.max_iterations_ = level_iterations[i];
+    ChompOptimizer optimizer(&level, planning_scene, group_name, &level_params, start_state);
+    if (!optimizer.isInitialized())
+      return;  // the optimization of the trajectory itself reports the failure
+    ROS_INFO_NAMED("chomp_planner", "Optimizing resolution level %d with %d points for up to %d iterations", (int)i,
+                   num_points, level_params.max_iterations_);
+    runOptimizer(optimizer, multi_start);
+    if (multi_start)
+    {
+      boost::mutex::scoped_lock slock(multi_start->lock);
+      if (multi_start->winner)
+        return;
+    }
+    previous_level = level;
+  }
+  if (previous_level.getNumPoints() != trajectory.getNumPoints())
+    trajectory.fillInFromResampledTrajectory(previous_level);
+}
+
+// optimize the trajectory in place, replanning with the recovery parameters if enabled; returns true if the result
+// is collision free, and sets initialized to false if the optimizer could not be initialized
+bool optimizeTrajectory(const planning_scene::PlanningSceneConstPtr& planning_scene, const std::string& group_name,
+                        const ChompParameters& params, const moveit::core::RobotState& start_state,
+                        ChompTrajectory& trajectory, bool& initialized, MultiStart* multi_start,
+                        const OptimizationStart* start = NULL)
+{
+  ros::WallTime create_time = ros::WallTime::now();
+
+  // warm start the full resolution from the coarse levels
+  if (!params.resolution_level_max_iterations_.empty())
+    optimizeCoarseLevels(planning_scene, group_name, params, start_state, trajectory, multi_start);
+
+  int replan_count = 0;
+  bool replan_flag = false;
+  bool optimization_result = false;
+
+  // a copy of the parameters, which the recovery behaviour changes
+  ChompParameters params_nonconst = params;
+
+  // while loop for replanning (recovery behaviour) if collision free optimized solution not found
+  while (true)
+  {
+    if (replan_flag)
+    {
+      // increase learning rate in hope to find a successful path; increase ridge factor to avoid obstacles; add 5
+      // additional secs in hope to find a solution; increase maximum iterations
+      params_nonconst.setRecoveryParams(params_nonconst.learning_rate_ + 0.02, params_nonconst.ridge_factor_ + 0.002,
+                                        params_nonconst.planning_time_limit_ + 5, params_nonconst.max_iterations_ + 50);
+    }
+
+    // initialize a ChompOptimizer object to load up the optimizer with default parameters or with updated parameters in
+    // case of a recovery behaviour
+    ChompOptimizer optimizer(&trajectory, planning_scene, group_name, &params_nonconst, start_state);
+    if (!optimizer.isInitialized())
+    {
+      ROS_ERROR_STREAM_NAMED("chomp_planner", "Could not initialize optimizer");
+      initialized = false;
+      return false;
+    }
+
+    ROS_DEBUG_NAMED("chomp_planner", "Optimization took %f sec to create",
+                    (ros::WallTime::now() - create_time).toSec());
+
+    optimization_result = runOptimizer(optimizer, multi_start);
+
+    if (multi_start)
+    {
+      boost::mutex::scoped_lock slock(multi_start->lock);
+      if (optimization_result && !multi_start->winner)
+      {
+        multi_start->winner = start;
+        for (std::set<ChompOptimizer*>::iterator it = multi_start->optimizers.begin();
+             it != multi_start->optimizers.end(); ++it)
+          (*it)->terminate();
+      }
+      // another start found a solution, so there is nothing to recover
+      if (multi_start->winner && multi_start->winner != start)
+        return optimization_result;
+    }
+
+    // replan with updated parameters if no solution is found
+    if (params_nonconst.enable_failure_recovery_)
+    {
+      ROS_INFO_NAMED("chomp_planner", "Planned with Chomp Parameters (learning_rate, ridge_factor, "
+                                      "planning_time_limit, max_iterations), attempt: # %d ",
+                     (replan_count + 1));
+      ROS_INFO_NAMED("chomp_planner", "Learning rate: %f ridge factor: %f planning time limit: %f max_iterations %d ",
+                     params_nonconst.learning_rate_, params_nonconst.ridge_factor_,
+                     params_nonconst.planning_time_limit_, params_nonconst.max_iterations_);
+
+      if (!optimization_result && replan_count < params_nonconst.max_recovery_attempts_)
+      {
+        replan_count++;
+        replan_flag = true;
+      }
+      else
+      {
+        break;
+      }
+    }
+    else
+      break;
+  }  // end of while loop
+
+  return optimization_result;
+}
+
+void optimizeStart(const planning_scene::PlanningSceneConstPtr& planning_scene, const std::string& group_name,
+                   const ChompParameters& params, const moveit::core::RobotState& start_state,
+                   OptimizationStart* start, MultiStart* multi_start)
+{
+  start->collision_free = optimizeTrajectory(planning_scene, group_name, params, start_state, start->trajectory,
+                                             start->initialized, multi_start, start);
+}
+}
+
 ChompPlanner::ChompPlanner()
 {
 }
@@ -168,76 +364,60 @@ bool ChompPlanner::solve(const planning_scene::PlanningSceneConstPtr& planning_s
 
   ros::WallTime create_time = ros::WallTime::now();
 
-  int replan_count = 0;
-  bool replan_flag = false;
-  double org_learning_rate = 0.04, org_ridge_factor = 0.0, org_planning_time_limit = 10;
-  int org_max_iterations = 200;
-
-  // storing the initial chomp parameters values
-  org_learning_rate = params.learning_rate_;
-  org_ridge_factor = params.ridge_factor_;
-  org_planning_time_limit = params.planning_time_limit_;
-  org_max_iterations = params.max_iterations_;
-
-  ChompOptimizer* optimizer;
-
-  // create a non_const_params variable which stores the non constant version of the const params variable
-  ChompParameters params_nonconst = params_nonconst.getNonConstParams(params);
-
-  // while loop for replanning (recovery behaviour) if collision free optimized solution not found
-  while (true)
+  bool collision_free = false;
+  if (!params.enable_multi_start_)
   {
-    if (replan_flag)
-    {
-      // increase learning rate in hope to find a successful path; increase ridge factor to avoid obstacles; add 5
-      // additional secs in hope to find a solution; increase maximum iterations
-      params_nonconst.setRecoveryParams(params_nonconst.learning_rate_ + 0.02, params_nonconst.ridge_factor_ + 0.002,
-                                        params_nonconst.planning_time_limit_ + 5, params_nonconst.max_iterations_ + 50);
-    }
-
-    // initialize a ChompOptimizer object to load up the optimizer with default parameters or with updated parameters in
-    // case of a recovery behaviour
-    optimizer = new ChompOptimizer(&trajectory, planning_scene, req.group_name, &params_nonconst, start_state);
-    if (!optimizer->isInitialized())
+    bool initialized = true;
+    collision_free =
+        optimizeTrajectory(planning_scene, req.group_name, params, start_state, trajectory, initialized, NULL);
+    if (!initialized)
     {
-      ROS_ERROR_STREAM_NAMED("chomp_planner", "Could not initialize optimizer");
       res.error_code.val = moveit_msgs::MoveItErrorCodes::PLANNING_FAILED;
       return false;
     }
-
-    ROS_DEBUG_NAMED("chomp_planner", "Optimization took %f sec to create",
-                    (ros::WallTime::now() - create_time).toSec());
-
-    bool optimization_result = optimizer->optimize();
-
-    // replan with updated parameters if no solution is found
-    if (params_nonconst.enable_failure_recovery_)
+  }
+  else
+  {
+    // the starts share the planning scene, and with it the distance field of the hybrid collision world
+    std::vector<OptimizationStart> starts;
+    starts.reserve(4);
+    starts.push_back(OptimizationStart(trajectory, params.trajectory_initialization_method_));
+    if (params.trajectory_initialization_method_.compare("linear") != 0)
     {
-      ROS_INFO_NAMED("chomp_planner", "Planned with Chomp Parameters (learning_rate, ridge_factor, "
-                                      "planning_time_limit, max_iterations), attempt: # %d ",
-                     (replan_count + 1));
-      ROS_INFO_NAMED("chomp_planner", "Learning rate: %f ridge factor: %f planning time limit: %f max_iterations %d ",
-                     params_nonconst.learning_rate_, params_nonconst.ridge_factor_,
-                     params_nonconst.planning_time_limit_, params_nonconst.max_iterations_);
-
-      if (!optimization_result && replan_count < params_nonconst.max_recovery_attempts_)
-      {
-        replan_count++;
-        replan_flag = true;
-        // delete ChompOptimizer object 'optimizer' to prevent a possible memory leak
-        delete optimizer;
-      }
-      else
-      {
-        break;
-      }
+      starts.push_back(OptimizationStart(trajectory, "linear"));
+      starts.back().trajectory.fillInLinearInterpolation();
     }
-    else
-      break;
-  }  // end of while loop
-
-  // resetting the CHOMP Parameters to the original values after a successful plan
-  params_nonconst.setRecoveryParams(org_learning_rate, org_ridge_factor, org_planning_time_limit, org_max_iterations);
+    if (params.trajectory_initialization_method_.compare("fillTrajectory") != 0 && !res.trajectory.empty())
+    {
+      ChompTrajectory input_trajectory(trajectory);
+      if (input_trajectory.fillInFromTrajectory(res))
+        starts.push_back(OptimizationStart(input_trajectory, "input trajectory"));
+    }
+    ChompTrajectory previous_solution(trajectory);
+    if (getStoredSolution(req.group_name, params.multi_start_reuse_tolerance_, previous_solution))
+      starts.push_back(OptimizationStart(previous_solution, "previous solution"));
+
+    ROS_INFO_NAMED("chomp_planner", "Optimizing %d initial trajectories concurrently", (int)starts.size());
+    MultiStart multi_start;
+    boost::thread_group workers;
+    for (std::size_t i = 0; i < starts.size(); ++i)
+      workers.create_thread(boost::bind(&optimizeStart, boost::cref(planning_scene), boost::cref(req.group_name),
+                                        boost::cref(params), boost::cref(start_state), &starts[i], &multi_start));
+    workers.join_all();
+
+    // the first collision free result, or the result of the configured initialization
+    const OptimizationStart& result = multi_start.winner ? *multi_start.winner : starts[0];
+    if (!result.initialized)
+    {
+      res.error_code.val = moveit_msgs::MoveItErrorCodes::PLANNING_FAILED;
+      return false;
+    }
+    ROS_INFO_NAMED("chomp_planner", "Using the result of the %s initialization", result.name.c_str());
+    trajectory = result.trajectory;
+    collision_free = result.collision_free;
+  }
+  if (collision_free)
+    storeSolution(req.group_name, trajectory);
 
   ROS_DEBUG_NAMED("chomp_planner", "Optimization actually took %f sec to run",
                   (ros::WallTime::now() - create_time).toSec());
@@ -274,7 +454,7 @@ bool ChompPlanner::solve(const planning_scene::PlanningSceneConstPtr& planning_s
   res.processing_time.push_back((ros::WallTime::now() - start_time).toSec());
 
   // report planning failure if path has collisions
-  if (not optimizer->isCollisionFree())
+  if (not collision_free)
   {
     ROS_ERROR_STREAM_NAMED("chomp_planner", "Motion plan is invalid.");
     res.error_code.val = moveit_msgs::MoveItErrorCodes::INVALID_MOTION_PLAN;
@@ -302,4 +482,42 @@ bool ChompPlanner::solve(const planning_scene::PlanningSceneConstPtr& planning_s
 
   return true;
 }
+
+bool ChompPlanner::getStoredSolution(const std::string& group_name, double tolerance,
+                                     ChompTrajectory& trajectory) const
+{
+  int goal_index = trajectory.getNumPoints() - 1;
+  boost::mutex::scoped_lock slock(solutions_lock_);
+  for (std::deque<StoredSolution>::const_reverse_iterator it = solutions_.rbegin(); it != solutions_.rend(); ++it)
+  {
+    if (it->group_name != group_name || it->trajectory.rows() != trajectory.getNumPoints() ||
+        it->trajectory.cols() != trajectory.getNumJoints())
+      continue;
+    Eigen::RowVectorXd start_offset = trajectory.getTrajectoryPoint(0) - it->trajectory.row(0);
+    Eigen::RowVectorXd goal_offset = trajectory.getTrajectoryPoint(goal_index) - it->trajectory.row(goal_index);
+    if (start_offset.cwiseAbs().maxCoeff() > tolerance || goal_offset.cwiseAbs().maxCoeff() > tolerance)
+      continue;
+
+    // move the earlier solution onto the new start and goal states, blending the offsets along the trajectory
+    for (int i = 0; i <= goal_index; ++i)
+    {
+      double fraction = (double)i / goal_index;
+      trajectory.getTrajectoryPoint(i) =
+          it->trajectory.row(i) + (1.0 - fraction) * start_offset + fraction * goal_offset;
+    }
+    return true;
+  }
+  return false;
+}
+
+void ChompPlanner::storeSolution(const std::string& group_name, const ChompTrajectory& trajectory) const
+{
+  StoredSolution solution;
+  solution.group_name = group_name;
+  solution.trajectory = const_cast<ChompTrajectory&>(trajectory).getTrajectory();
+  boost::mutex::scoped_lock slock(solutions_lock_);
+  solutions_.push_back(solution);
+  if (solutions_.size() > MAX_STORED_SOLUTIONS)
+    solutions_.pop_front();
+}
 }
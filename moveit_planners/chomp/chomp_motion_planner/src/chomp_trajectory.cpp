@@ -37,6 +37,7 @@
 #include <ros/ros.h>
 #include <chomp_motion_planner/chomp_trajectory.h>
 #include <iostream>
+#include <algorithm>
 
 namespace chomp
 {
@@ -184,6 +185,19 @@ void ChompTrajectory::fillInLinearInterpolation()
   }
 }
 
+void ChompTrajectory::fillInFromResampledTrajectory(const ChompTrajectory& source_traj)
+{
+  double scale = (source_traj.num_points_ - 1) / double(num_points_ - 1);
+  for (int i = 0; i < num_points_; i++)
+  {
+    double source_point = i * scale;
+    int before = std::min(int(source_point), source_traj.num_points_ - 2);
+    double fraction = source_point - before;
+    trajectory_.row(i) =
+        (1.0 - fraction) * source_traj.trajectory_.row(before) + fraction * source_traj.trajectory_.row(before + 1);
+  }
+}
+
 void ChompTrajectory::fillInCubicInterpolation()
 {
   double start_index = start_index_ - 1;
@@ -39,17 +39,14 @@
 
 #include <moveit/macros/class_forward.h>
 #include <moveit/ompl_interface/planning_context_manager.h>
+#include <moveit/ompl_interface/detail/flat_constraint_approximation.h>
 #include <moveit/kinematic_constraints/kinematic_constraint.h>
 #include <ompl/base/StateStorage.h>
 #include <boost/function.hpp>
-#include <boost/serialization/map.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace ompl_interface
 {
-typedef std::pair<std::vector<std::size_t>, std::map<std::size_t, std::pair<std::size_t, std::size_t> > >
-    ConstrainedStateMetadata;
-typedef ompl::base::StateStorageWithMetadata<ConstrainedStateMetadata> ConstraintApproximationStateStorage;
-
 MOVEIT_CLASS_FORWARD(ConstraintApproximation)
 
 class ConstraintApproximation
@@ -59,6 +56,11 @@ public:
                           bool explicit_motions, const moveit_msgs::Constraints& msg, const std::string& filename,
                           const ompl::base::StateStoragePtr& storage, std::size_t milestones = 0);
 
+  /** \brief Construct an approximation whose states are only read from the file at \e path when it is first used */
+  ConstraintApproximation(const std::string& group, const std::string& state_space_parameterization,
+                          bool explicit_motions, const moveit_msgs::Constraints& msg, const std::string& filename,
+                          const ompl::base::StateSpacePtr& space, const std::string& path, std::size_t milestones);
+
   virtual ~ConstraintApproximation()
   {
   }
@@ -102,11 +104,17 @@ public:
     return constraint_msg_;
   }
 
+  /** \brief The storage the approximation was constructed from; empty for approximations read from a file */
   const ompl::base::StateStoragePtr& getStateStorage() const
   {
     return state_storage_ptr_;
   }
 
+  /** \brief The states and connections of the approximation, laid out for sampling. Files in the flat layout are
+      memory-mapped, files saved in the boost serialization format are read and converted. This happens on the first
+      call, and the result is empty if the file could not be read. */
+  const FlatConstraintApproximationPtr& getData() const;
+
   const std::string& getFilename() const
   {
     return ompldb_filename_;
@@ -125,6 +133,14 @@ protected:
   ompl::base::StateStoragePtr state_storage_ptr_;
   ConstraintApproximationStateStorage* state_storage_;
   std::size_t milestones_;
+
+  /// the file the states are read from, if they are not in state_storage_
+  ompl::base::StateSpacePtr space_;
+  std::string path_;
+
+  mutable FlatConstraintApproximationPtr data_;
+  mutable bool loaded_;
+  mutable boost::mutex lock_;
 };
 
 struct ConstraintApproximationConstructionOptions
@@ -136,6 +152,8 @@ struct ConstraintApproximationConstructionOptions
     , explicit_motions(false)
     , explicit_points_resolution(0.0)
     , max_explicit_points(0)
+    , threads(0)
+    , checkpoint_interval(60.0)
   {
   }
 
@@ -146,6 +164,14 @@ struct ConstraintApproximationConstructionOptions
   bool explicit_motions;
   double explicit_points_resolution;
   unsigned int max_explicit_points;
+
+  /// the number of threads that sample and connect states; 0 uses one thread per core
+  unsigned int threads;
+
+  /// if not empty, the progress of the construction is saved to this file every checkpoint_interval seconds, and an
+  /// interrupted construction with the same options resumes from it
+  std::string checkpoint_file;
+  double checkpoint_interval;
 };
 
 struct ConstraintApproximationConstructionResults
@@ -43,6 +43,9 @@
 
 #include <moveit/robot_state/robot_state.h>
 #include <moveit/robot_model/joint_model_group.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+#include <atomic>
 
 namespace ompl_interface
 {
@@ -54,10 +57,45 @@ class ConstrainedGoalSampler : public ompl::base::GoalLazySamples
 {
 public:
   ConstrainedGoalSampler(
-      const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetPtr& ks,
+      const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetConstPtr& ks,
       const constraint_samplers::ConstraintSamplerPtr& cs = constraint_samplers::ConstraintSamplerPtr());
 
+  virtual ~ConstrainedGoalSampler();
+
+  /** \brief Start the sampling thread of GoalLazySamples, and the additional sampling threads allowed by the
+      planning context */
+  void startSampling();
+
+  /** \brief Stop all sampling threads */
+  void stopSampling();
+
+  /** \brief Sample goals for \e constr, which constrains the same links and joints as the constraints this goal was
+      constructed for, starting from the current initial state of the planning context. The sampled goals are
+      checked against \e ks, the constraint set for \e constr. The goals sampled so far are discarded. Returns false
+      if the constraint sampler cannot be configured for \e constr. */
+  bool reconfigure(const moveit_msgs::Constraints& constr,
+                   const kinematic_constraints::KinematicConstraintSetConstPtr& ks);
+
 private:
+  /** \brief The samplers and state of an additional sampling thread */
+  struct SamplingWorker
+  {
+    SamplingWorker(const robot_state::RobotState& state) : work_state_(state)
+    {
+    }
+
+    constraint_samplers::ConstraintSamplerPtr constraint_sampler_;
+    ompl::base::StateSamplerPtr default_sampler_;
+    robot_state::RobotState work_state_;
+  };
+  typedef boost::shared_ptr<SamplingWorker> SamplingWorkerPtr;
+
+  void createWorkers();
+  void sampleInWorker(SamplingWorker* worker);
+  bool samplingDone(unsigned int attempts) const;
+  bool sampleGoal(constraint_samplers::ConstraintSampler* constraint_sampler,
+                  ompl::base::StateSampler* default_sampler, robot_state::RobotState& work_state,
+                  ompl::base::State* new_goal, unsigned int attempts_so_far, bool verbose);
   bool sampleUsingConstraintSampler(const ompl::base::GoalLazySamples* gls, ompl::base::State* new_goal);
   bool stateValidityCallback(ompl::base::State* new_goal, robot_state::RobotState const* state,
                              const robot_model::JointModelGroup*, const double*, bool verbose = false) const;
@@ -65,13 +103,18 @@ private:
                           bool verbose = false) const;
 
   const ModelBasedPlanningContext* planning_context_;
-  kinematic_constraints::KinematicConstraintSetPtr kinematic_constraint_set_;
+  kinematic_constraints::KinematicConstraintSetConstPtr kinematic_constraint_set_;
   constraint_samplers::ConstraintSamplerPtr constraint_sampler_;
   ompl::base::StateSamplerPtr default_sampler_;
   robot_state::RobotState work_state_;
-  unsigned int invalid_sampled_constraints_;
-  bool warned_invalid_samples_;
+  std::atomic<unsigned int> invalid_sampled_constraints_;
+  std::atomic<bool> warned_invalid_samples_;
   unsigned int verbose_display_;
+
+  std::vector<SamplingWorkerPtr> workers_;
+  boost::scoped_ptr<boost::thread_group> worker_threads_;
+  std::atomic<bool> stop_workers_;
+  std::atomic<unsigned int> worker_attempts_;
 };
 }
 
@@ -54,7 +54,7 @@ class ValidConstrainedSampler : public ompl::base::ValidStateSampler
 {
 public:
   ValidConstrainedSampler(
-      const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetPtr& ks,
+      const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetConstPtr& ks,
       const constraint_samplers::ConstraintSamplerPtr& cs = constraint_samplers::ConstraintSamplerPtr());
 
   virtual bool sample(ompl::base::State* state);
@@ -63,7 +63,7 @@ public:
 
 private:
   const ModelBasedPlanningContext* planning_context_;
-  kinematic_constraints::KinematicConstraintSetPtr kinematic_constraint_set_;
+  kinematic_constraints::KinematicConstraintSetConstPtr kinematic_constraint_set_;
   constraint_samplers::ConstraintSamplerPtr constraint_sampler_;
   ompl::base::StateSamplerPtr default_sampler_;
   robot_state::RobotState work_state_;
@@ -0,0 +1,156 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OMPL_INTERFACE_DETAIL_FLAT_CONSTRAINT_APPROXIMATION_
+#define MOVEIT_OMPL_INTERFACE_DETAIL_FLAT_CONSTRAINT_APPROXIMATION_
+
+#include <moveit/macros/class_forward.h>
+#include <ompl/base/StateStorage.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/serialization/map.hpp>
+#include <stdint.h>
+
+namespace boost
+{
+namespace interprocess
+{
+class file_mapping;
+class mapped_region;
+}
+}
+
+namespace ompl_interface
+{
+typedef std::pair<std::vector<std::size_t>, std::map<std::size_t, std::pair<std::size_t, std::size_t> > >
+    ConstrainedStateMetadata;
+typedef ompl::base::StateStorageWithMetadata<ConstrainedStateMetadata> ConstraintApproximationStateStorage;
+
+MOVEIT_CLASS_FORWARD(FlatConstraintApproximation);
+
+/** @class FlatConstraintApproximation
+    @brief The states of a constraint approximation and their connections, laid out in one contiguous block of memory
+    so that they can be memory-mapped from a file and sampled in place.
+
+    The block starts with a header, followed by the signature of the state space, the serialized states (each padded
+    to a multiple of 8 bytes), the neighbors of each state and the explicit motions between connected states. Both
+    indexes consist of an array of offsets, one per state and one past the end, followed by the entries themselves. */
+class FlatConstraintApproximation
+{
+public:
+  /** \brief The intermediate states [first, last) of the motion to state \e to */
+  struct Motion
+  {
+    uint64_t to;
+    uint64_t first;
+    uint64_t last;
+  };
+
+  /** \brief Lay out the states and the metadata of \e storage in memory */
+  FlatConstraintApproximation(const ConstraintApproximationStateStorage& storage);
+
+  /** \brief Map \e filename, which has to be a flat approximation of states of \e space; isValid() returns false
+      otherwise */
+  FlatConstraintApproximation(const ompl::base::StateSpacePtr& space, const std::string& filename);
+
+  ~FlatConstraintApproximation();
+
+  /** \brief Check whether \e filename starts like a flat approximation */
+  static bool isFlatFile(const std::string& filename);
+
+  bool isValid() const
+  {
+    return header_ != NULL;
+  }
+
+  /** \brief Write the block of memory to \e filename */
+  bool save(const std::string& filename) const;
+
+  /** \brief The file the block is mapped from, if any */
+  const std::string& getFilename() const
+  {
+    return filename_;
+  }
+
+  const ompl::base::StateSpacePtr& getStateSpace() const
+  {
+    return space_;
+  }
+
+  std::size_t getStateCount() const;
+
+  std::size_t getNeighborCount() const;
+
+  /** \brief Copy the state at \e index (including its tag) into \e state */
+  void getState(std::size_t index, ompl::base::State* state) const
+  {
+    space_->deserialize(state, states_ + index * state_size_);
+  }
+
+  /** \brief The neighbors of the state at \e index; \e count is set to their number */
+  const uint64_t* getNeighbors(std::size_t index, std::size_t& count) const
+  {
+    count = neighbor_offsets_[index + 1] - neighbor_offsets_[index];
+    return neighbors_ + neighbor_offsets_[index];
+  }
+
+  /** \brief The explicit motion from the state at \e from to the state at \e to, or NULL if there is none */
+  const Motion* findMotion(std::size_t from, std::size_t to) const;
+
+private:
+  struct Header;
+
+  static std::size_t getLayoutSize(const Header& header);
+  void setPointers(const char* data, std::size_t size);
+
+  ompl::base::StateSpacePtr space_;
+  std::string filename_;
+
+  /// the block of memory is either owned (and 8-byte aligned) or mapped from filename_
+  std::vector<uint64_t> buffer_;
+  boost::scoped_ptr<boost::interprocess::file_mapping> file_;
+  boost::scoped_ptr<boost::interprocess::mapped_region> region_;
+
+  const char* data_;
+  std::size_t size_;
+  const Header* header_;
+  std::size_t state_size_;
+  const char* states_;
+  const uint64_t* neighbor_offsets_;
+  const uint64_t* neighbors_;
+  const uint64_t* motion_offsets_;
+  const Motion* motions_;
+};
+}
+
+#endif
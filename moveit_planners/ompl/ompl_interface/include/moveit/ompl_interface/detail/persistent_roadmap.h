@@ -0,0 +1,222 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef MOVEIT_OMPL_INTERFACE_DETAIL_PERSISTENT_ROADMAP_
+#define MOVEIT_OMPL_INTERFACE_DETAIL_PERSISTENT_ROADMAP_
+
+#include <moveit/ompl_interface/parameterization/model_based_state_space.h>
+#include <moveit/macros/class_forward.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit_msgs/Constraints.h>
+#include <ompl/base/Planner.h>
+#include <ompl/datastructures/NearestNeighbors.h>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <Eigen/Geometry>
+#include <stdint.h>
+
+namespace ompl_interface
+{
+MOVEIT_CLASS_FORWARD(PersistentRoadmap);
+
+/** @class PersistentRoadmap
+    @brief A lazily validated probabilistic roadmap for one planning group that is kept across planning requests.
+
+    Vertices and edges are only collision checked when they are part of a candidate solution, and their validity is
+    remembered. When the scene changes, only the vertices and edges whose swept bounding box overlaps a collision
+    object that was added, moved or removed are marked as unknown again; any other change of the scene (allowed
+    collisions, attached bodies, padding, path constraints, the joints outside the group) or collision objects that
+    cannot be bounded (octomaps, planes) reset the validity of the whole roadmap. The roadmap itself is never
+    discarded. */
+class PersistentRoadmap
+{
+public:
+  enum Validity
+  {
+    VALIDITY_UNKNOWN = 0,
+    VALIDITY_VALID = 1,
+    VALIDITY_INVALID = 2
+  };
+
+  /** \brief Construct an empty roadmap whose states belong to \e space */
+  PersistentRoadmap(const ModelBasedStateSpacePtr& space);
+  ~PersistentRoadmap();
+
+  /** \brief The lock that planners hold while they use the roadmap */
+  boost::mutex& getLock()
+  {
+    return lock_;
+  }
+
+  /** \brief Update the validity information for a planning request in \e scene, starting at \e start_state */
+  void synchronize(const planning_scene::PlanningScene& scene, const robot_state::RobotState& start_state,
+                   const moveit_msgs::Constraints& path_constraints);
+
+  /** \brief Mark all vertices and edges as not checked */
+  void clearValidity();
+
+  /** \brief Add a copy of \e state and connect it to up to \e max_neighbors vertices within \e max_distance */
+  std::size_t addVertex(const ompl::base::State* state, double max_distance, unsigned int max_neighbors);
+
+  /** \brief Find the shortest path from one of \e starts to one of \e goals that does not use vertices or edges known
+      to be invalid; returns false if there is none */
+  bool searchPath(const std::vector<std::size_t>& starts, const std::vector<std::size_t>& goals,
+                  std::vector<std::size_t>& path) const;
+
+  /** \brief Check the vertices and edges of \e path that are not known yet. Returns false as soon as one of them is
+      invalid. */
+  bool validatePath(const ompl::base::SpaceInformationPtr& si, const std::vector<std::size_t>& path);
+
+  const ompl::base::State* getState(std::size_t vertex) const
+  {
+    return vertices_[vertex].state;
+  }
+
+  Validity getVertexValidity(std::size_t vertex) const
+  {
+    return static_cast<Validity>(vertices_[vertex].validity);
+  }
+
+  std::size_t getVertexCount() const
+  {
+    return vertices_.size();
+  }
+
+  std::size_t getEdgeCount() const
+  {
+    return edges_.size();
+  }
+
+  /** \brief Save the vertices and edges, but not their validity */
+  bool save(const std::string& filename) const;
+
+  /** \brief Replace the roadmap by the one saved in \e filename; all validity information is reset */
+  bool load(const std::string& filename);
+
+private:
+  struct Vertex
+  {
+    ompl::base::State* state;
+    unsigned char validity;
+    std::vector<std::size_t> edges;
+
+    /// the centers of the bounding spheres of the bodies moved by the group, once the vertex has been checked
+    std::vector<Eigen::Vector3d> centers;
+  };
+
+  struct Edge
+  {
+    std::size_t from;
+    std::size_t to;
+    double length;
+    unsigned char validity;
+  };
+
+  struct Body
+  {
+    const robot_model::LinkModel* link;
+    const robot_state::AttachedBody* attached_body;
+    std::size_t shape;
+    Eigen::Vector3d center;
+    double radius;
+  };
+
+  double distance(std::size_t a, std::size_t b) const;
+  void addEdge(std::size_t from, std::size_t to, double length);
+  std::size_t findEdge(std::size_t from, std::size_t to) const;
+  void computeCenters(Vertex& vertex);
+  bool getVertexBox(const Vertex& vertex, Eigen::AlignedBox3d& box) const;
+  bool getEdgeBox(const Edge& edge, Eigen::AlignedBox3d& box) const;
+  void invalidateRegions(const std::vector<Eigen::AlignedBox3d>& regions);
+  void updateBodies(const robot_state::RobotState& start_state);
+  void clear();
+
+  ModelBasedStateSpacePtr space_;
+  std::vector<Vertex> vertices_;
+  std::vector<Edge> edges_;
+  boost::scoped_ptr<ompl::NearestNeighbors<std::size_t> > nn_;
+
+  /// the state the vertex bounding spheres are computed in, and the bodies that move with the group
+  robot_state::RobotStatePtr work_state_;
+  std::vector<Body> bodies_;
+
+  /// the fingerprint of everything but the collision objects, and the fingerprint and bounding box of each object
+  uint64_t scene_fingerprint_;
+  std::map<std::string, std::pair<uint64_t, Eigen::AlignedBox3d> > objects_;
+
+  boost::mutex lock_;
+};
+
+/** @class PersistentRoadmapPlanner
+    @brief A lazy PRM planner that grows and queries a PersistentRoadmap, so that the roadmap outlives the planner
+    instance and the planning context */
+class PersistentRoadmapPlanner : public ompl::base::Planner
+{
+public:
+  PersistentRoadmapPlanner(const ompl::base::SpaceInformationPtr& si, const PersistentRoadmapPtr& roadmap);
+
+  virtual ompl::base::PlannerStatus solve(const ompl::base::PlannerTerminationCondition& ptc);
+  virtual void clear();
+  virtual void setup();
+
+  /** \brief Set the maximum length of a roadmap edge */
+  void setRange(double range)
+  {
+    range_ = range;
+  }
+
+  double getRange() const
+  {
+    return range_;
+  }
+
+  /** \brief Set the maximum number of neighbors a new vertex is connected to */
+  void setMaxNearestNeighbors(unsigned int max_neighbors)
+  {
+    max_neighbors_ = max_neighbors;
+  }
+
+  unsigned int getMaxNearestNeighbors() const
+  {
+    return max_neighbors_;
+  }
+
+private:
+  PersistentRoadmapPtr roadmap_;
+  ompl::base::StateSamplerPtr sampler_;
+  double range_;
+  unsigned int max_neighbors_;
+};
+}
+
+#endif
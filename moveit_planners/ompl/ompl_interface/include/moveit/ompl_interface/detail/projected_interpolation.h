@@ -0,0 +1,103 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OMPL_INTERFACE_DETAIL_PROJECTED_INTERPOLATION_
+#define MOVEIT_OMPL_INTERFACE_DETAIL_PROJECTED_INTERPOLATION_
+
+#include <moveit/ompl_interface/parameterization/model_based_state_space.h>
+#include <moveit/constraint_samplers/projection_constraint_sampler.h>
+#include <moveit/macros/class_forward.h>
+#include <boost/thread/mutex.hpp>
+
+namespace ompl_interface
+{
+MOVEIT_CLASS_FORWARD(ProjectedInterpolation);
+
+/** \brief Interpolates in joint space and projects the interpolated states onto the path constraints.
+
+    Motions between states that satisfy the constraints then stay close to the constraint manifold, instead of
+    leaving it in between and failing the motion checks. Interpolated states that cannot be projected, or that the
+    projection moves farther than the length of the motion, are left on the straight line. */
+class ProjectedInterpolation
+{
+public:
+  /** \brief Project onto \e constr, keeping the joints outside the group of \e space at their values in \e
+      start_state */
+  ProjectedInterpolation(const planning_scene::PlanningSceneConstPtr& scene, const ModelBasedStateSpacePtr& space,
+                         const robot_state::RobotState& start_state, const moveit_msgs::Constraints& constr);
+  ~ProjectedInterpolation();
+
+  /** \brief Whether \e constr contains constraints the states of the group can be projected onto */
+  bool isValid() const
+  {
+    return valid_;
+  }
+
+  /** \brief Interpolate between \e from and \e to, and project the result. Returns false for the end points,
+      which are taken as they are. Can be called from several threads at once. */
+  bool interpolate(const ompl::base::State* from, const ompl::base::State* to, const double t,
+                   ompl::base::State* state) const;
+
+  /** \brief Get a function for ModelBasedStateSpace::setInterpolationFunction() that keeps \e interpolation alive */
+  static InterpolationFunction getInterpolationFunction(const ProjectedInterpolationPtr& interpolation);
+
+private:
+  /** \brief The state and sampler a thread projects with */
+  struct WorkData
+  {
+    WorkData(const robot_state::RobotState& state) : state_(state)
+    {
+    }
+
+    robot_state::RobotState state_;
+    constraint_samplers::ProjectionConstraintSamplerPtr sampler_;
+    std::vector<double> values_;
+  };
+
+  /** \brief Take work data that is not in use, or construct new data */
+  WorkData* acquireWorkData() const;
+  void releaseWorkData(WorkData* data) const;
+
+  planning_scene::PlanningSceneConstPtr scene_;
+  ModelBasedStateSpacePtr space_;
+  robot_state::RobotState start_state_;
+  moveit_msgs::Constraints constraints_;
+  bool valid_;
+
+  mutable std::vector<WorkData*> spare_work_data_;
+  mutable boost::mutex lock_;
+};
+}
+
+#endif
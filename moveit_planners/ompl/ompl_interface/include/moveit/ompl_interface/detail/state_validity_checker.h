@@ -38,6 +38,7 @@
 #define MOVEIT_OMPL_INTERFACE_DETAIL_STATE_VALIDITY_CHECKER_
 
 #include <moveit/ompl_interface/detail/threadsafe_state_storage.h>
+#include <moveit/ompl_interface/detail/validity_cache.h>
 #include <moveit/collision_detection/collision_common.h>
 #include <ompl/base/StateValidityChecker.h>
 
@@ -70,6 +71,34 @@ public:
 
   void setVerbose(bool flag);
 
+  /** \brief Only check self collisions (besides bounds, path constraints and feasibility) instead of collisions with
+      the world too. These cheaper checks are used to plan candidate paths that are fully checked afterwards, so
+      their results are not cached. */
+  void setSelfCollisionOnly(bool flag)
+  {
+    self_collision_only_ = flag;
+  }
+
+  bool isSelfCollisionOnly() const
+  {
+    return self_collision_only_;
+  }
+
+  /** \brief Store results under a new fingerprint, for a problem that changed after the checker was constructed. The
+      fingerprint must not change between 0 and other values. */
+  void setValidityCacheFingerprint(uint64_t fingerprint)
+  {
+    validity_cache_fingerprint_ = fingerprint;
+  }
+
+  const ModelBasedPlanningContext* getPlanningContext() const
+  {
+    return planning_context_;
+  }
+
+  /** \brief Prepare robot states for the given number of planning threads */
+  void reserveThreadStates(unsigned int thread_count);
+
 protected:
   bool isValidWithoutCache(const ompl::base::State* state, bool verbose) const;
   bool isValidWithoutCache(const ompl::base::State* state, double& dist, bool verbose) const;
@@ -77,6 +106,15 @@ protected:
   bool isValidWithCache(const ompl::base::State* state, bool verbose) const;
   bool isValidWithCache(const ompl::base::State* state, double& dist, bool verbose) const;
 
+  bool isValidUncached(const ompl::base::State* state, bool verbose) const;
+
+  /** \brief The checks used with setSelfCollisionOnly(true); \e dist is only computed if it is not NULL */
+  bool isValidSelfCollisionOnly(const ompl::base::State* state, double* dist, bool verbose) const;
+
+  /** \brief Check \e kstate for collisions (only self collisions, if \e self_only is true) without computing any
+      distance; unless \e verbose is true, this uses the boolean collision query */
+  bool isCollisionFree(const robot_state::RobotState& kstate, bool self_only, bool verbose) const;
+
   const ModelBasedPlanningContext* planning_context_;
   std::string group_name_;
   TSStateStorage tss_;
@@ -86,7 +124,13 @@ protected:
   collision_detection::CollisionRequest collision_request_with_distance_verbose_;
 
   collision_detection::CollisionRequest collision_request_with_cost_;
+  collision_detection::BooleanCollisionRequest boolean_collision_request_;
   bool verbose_;
+  bool self_collision_only_;
+
+  ValidityCachePtr validity_cache_;
+  uint64_t validity_cache_fingerprint_;
+  unsigned int variable_count_;
 };
 }
 
@@ -39,6 +39,7 @@
 
 #include <moveit/robot_state/robot_state.h>
 #include <boost/thread.hpp>
+#include <stdint.h>
 
 namespace ompl_interface
 {
@@ -49,11 +50,26 @@ public:
   TSStateStorage(const robot_state::RobotState& start_state);
   ~TSStateStorage();
 
+  /** \brief Get the state of the calling thread. Every thread caches the states it got last, so repeated calls from
+      the same thread do not lock. */
   robot_state::RobotState* getStateStorage() const;
 
+  /** \brief Copy the start state for the given number of threads in advance, so threads that start planning only
+      have to take one of the copies */
+  void reserve(unsigned int thread_count);
+
 private:
+  /** \brief Find or create the state of the calling thread, under the lock */
+  robot_state::RobotState* lookupStateStorage() const;
+
   robot_state::RobotState start_state_;
+
+  /** \brief Unique among all storages, so thread caches never mistake a storage for an earlier one at the same
+      address */
+  const uint64_t id_;
+
   mutable std::map<boost::thread::id, robot_state::RobotState*> thread_states_;
+  mutable std::vector<robot_state::RobotState*> spare_states_;
   mutable boost::mutex lock_;
 };
 }
@@ -0,0 +1,167 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef MOVEIT_OMPL_INTERFACE_DETAIL_VALIDITY_CACHE_
+#define MOVEIT_OMPL_INTERFACE_DETAIL_VALIDITY_CACHE_
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit_msgs/Constraints.h>
+#include <ompl/base/DiscreteMotionValidator.h>
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace ompl_interface
+{
+MOVEIT_CLASS_FORWARD(ValidityCache);
+
+/** @class ValidityCache
+    @brief A bounded cache of state and motion validity results that is shared by the planning contexts of a group
+    across planning requests.
+
+    States are identified by their joint values rounded to a resolution, combined with a fingerprint of everything
+    else validity depends on (see computeSceneFingerprint()).  Any change of the scene therefore leads to new keys,
+    and the results of earlier scenes are never used again; they are dropped as the cache fills up.  The cache keeps
+    two generations of results, and discards the older generation once the newer one holds half of the entries. */
+class ValidityCache
+{
+public:
+  /** \brief Construct a cache holding up to \e max_size results, for joint values rounded to \e resolution */
+  ValidityCache(std::size_t max_size, double resolution);
+
+  /** \brief Compute a fingerprint of the collision geometry and allowed collisions of \e scene, the joint values and
+      attached bodies of \e start_state outside of \e group_name, and the path constraints. Returns 0 if validity may
+      depend on something the fingerprint cannot capture (octomaps, which change in place, conditional allowed
+      collisions or a state feasibility predicate), in which case results must not be cached. If
+      \e include_world_objects is false, the collision objects of the world are left out. */
+  static uint64_t computeSceneFingerprint(const planning_scene::PlanningScene& scene,
+                                          const robot_state::RobotState& start_state, const std::string& group_name,
+                                          const moveit_msgs::Constraints& path_constraints,
+                                          bool include_world_objects = true);
+
+  /** \brief Compute a fingerprint of the id, shapes and poses of a collision object; 0 for octomaps */
+  static uint64_t computeObjectFingerprint(const collision_detection::World::Object& object);
+
+  /** \brief Get the key of the state with the joint values \e values in the scene with the given fingerprint */
+  uint64_t getStateKey(uint64_t scene_fingerprint, const double* values, unsigned int count) const;
+
+  /** \brief Get the key of the motion between two states; the key does not depend on the direction */
+  static uint64_t getMotionKey(uint64_t state_key1, uint64_t state_key2);
+
+  /** \brief Look up a result; returns false if it is not known */
+  bool lookup(uint64_t key, bool& valid) const;
+
+  /** \brief Store a result */
+  void store(uint64_t key, bool valid);
+
+  /** \brief Remove all results */
+  void clear();
+
+  /** \brief Get the number of stored results */
+  std::size_t size() const;
+
+  std::size_t getHitCount() const
+  {
+    return hits_;
+  }
+
+  std::size_t getMissCount() const
+  {
+    return misses_;
+  }
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+private:
+  static const std::size_t NUM_SHARDS = 16;
+
+  struct Shard
+  {
+    std::unordered_map<uint64_t, bool> current;
+    std::unordered_map<uint64_t, bool> previous;
+    mutable boost::mutex lock;
+  };
+
+  Shard& getShard(uint64_t key) const
+  {
+    return shards_[key % NUM_SHARDS];
+  }
+
+  double resolution_;
+  std::size_t max_shard_generation_size_;
+  mutable Shard shards_[NUM_SHARDS];
+  mutable std::atomic<std::size_t> hits_;
+  mutable std::atomic<std::size_t> misses_;
+};
+
+/** @class CachedMotionValidator
+    @brief A motion validator that checks motions by discretization, like OMPL's default one, and stores the results
+    in a ValidityCache */
+class CachedMotionValidator : public ompl::base::DiscreteMotionValidator
+{
+public:
+  CachedMotionValidator(const ompl::base::SpaceInformationPtr& si, const ValidityCachePtr& cache,
+                        uint64_t scene_fingerprint, unsigned int variable_count);
+
+  virtual bool checkMotion(const ompl::base::State* s1, const ompl::base::State* s2) const;
+  virtual bool checkMotion(const ompl::base::State* s1, const ompl::base::State* s2,
+                           std::pair<ompl::base::State*, double>& last_valid) const;
+
+  /** \brief While disabled, motions are checked without looking up or storing results */
+  void setCacheEnabled(bool flag)
+  {
+    enabled_ = flag;
+  }
+
+  /** \brief Store results under a new fingerprint, for a problem that changed after the validator was constructed */
+  void setSceneFingerprint(uint64_t scene_fingerprint)
+  {
+    scene_fingerprint_ = scene_fingerprint;
+  }
+
+private:
+  uint64_t getMotionKey(const ompl::base::State* s1, const ompl::base::State* s2) const;
+
+  ValidityCachePtr cache_;
+  uint64_t scene_fingerprint_;
+  unsigned int variable_count_;
+  bool enabled_;
+};
+}
+
+#endif
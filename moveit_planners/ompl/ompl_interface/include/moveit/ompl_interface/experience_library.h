@@ -0,0 +1,131 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#ifndef MOVEIT_OMPL_INTERFACE_EXPERIENCE_LIBRARY_
+#define MOVEIT_OMPL_INTERFACE_EXPERIENCE_LIBRARY_
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/ompl_interface/planning_context_manager.h>
+#include <ompl/base/StateStorage.h>
+#include <ompl/geometric/PathGeometric.h>
+#include <boost/serialization/utility.hpp>
+#include <boost/thread/mutex.hpp>
+#include <stdint.h>
+
+namespace ompl_interface
+{
+/// for the first state of a stored path: the number of states in the path and the fingerprint of the scene it was
+/// computed in; (0, 0) for all other states
+typedef std::pair<std::size_t, uint64_t> ExperienceStateMetadata;
+typedef ompl::base::StateStorageWithMetadata<ExperienceStateMetadata> ExperienceStateStorage;
+
+/** \brief A path recalled from the experience library, expressed in the state space of the requesting context */
+struct ExperiencePath
+{
+  og::PathGeometricPtr path;
+
+  /// the fingerprint of the scene the path was computed in (see ValidityCache::computeSceneFingerprint())
+  uint64_t scene_fingerprint;
+
+  /// the distance from the start state of the request to the first state of the path
+  double distance;
+};
+
+MOVEIT_CLASS_FORWARD(ExperienceLibrary);
+
+/** \brief A database of previously computed solution paths, kept per planning group and state space
+    parameterization. Planning contexts recall paths that start close to a new request and end in its goal region,
+    repair them and only plan from scratch when that fails, in the style of OMPL's Lightning framework. */
+class ExperienceLibrary
+{
+public:
+  ExperienceLibrary(const PlanningContextManager& pcontext, std::size_t max_paths = 1000);
+
+  /** \brief Load the paths stored in the folder \e path, replacing the ones in memory */
+  void loadExperience(const std::string& path);
+
+  /** \brief Save all paths to the folder \e path, using the same manifest layout as the ConstraintsLibrary */
+  void saveExperience(const std::string& path);
+
+  void printExperience(std::ostream& out = std::cout) const;
+  void clearExperience();
+
+  /** \brief Get the maximum number of paths stored for each group and parameterization */
+  std::size_t getMaximumPathCount() const
+  {
+    return max_paths_;
+  }
+
+  /** \brief Set the maximum number of paths stored for each group and parameterization; once reached, new paths
+      are not added */
+  void setMaximumPathCount(std::size_t max_paths)
+  {
+    max_paths_ = max_paths;
+  }
+
+  /** \brief Store a solution path computed by \e context in the scene identified by \e scene_fingerprint. Return
+      false if the path was not added. */
+  bool addExperience(const ModelBasedPlanningContext& context, const og::PathGeometric& path,
+                     uint64_t scene_fingerprint);
+
+  /** \brief Get up to \e count stored paths for the group and state space of \e context, closest to \e start
+      first */
+  void getExperience(const ModelBasedPlanningContext& context, const ob::State* start, std::size_t count,
+                     std::vector<ExperiencePath>& paths) const;
+
+  /** \brief Get the number of paths stored for the group and state space of \e context */
+  std::size_t getExperienceCount(const ModelBasedPlanningContext& context) const;
+
+private:
+  struct ExperienceDatabase
+  {
+    std::string group_;
+    std::string state_space_parameterization_;
+    std::string filename_;
+    std::vector<int> space_signature_;
+    boost::shared_ptr<ExperienceStateStorage> storage_;
+
+    /// the index of the first state of each stored path
+    std::vector<std::size_t> paths_;
+  };
+
+  const ExperienceDatabase* findDatabase(const ModelBasedPlanningContext& context) const;
+
+  const PlanningContextManager& context_manager_;
+  std::size_t max_paths_;
+  std::map<std::string, ExperienceDatabase> databases_;
+  mutable boost::mutex lock_;
+};
+}
+
+#endif
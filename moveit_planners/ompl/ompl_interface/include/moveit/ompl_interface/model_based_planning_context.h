@@ -39,6 +39,7 @@
 
 #include <moveit/ompl_interface/parameterization/model_based_state_space.h>
 #include <moveit/ompl_interface/detail/constrained_valid_state_sampler.h>
+#include <moveit/ompl_interface/detail/validity_cache.h>
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/planning_interface/planning_interface.h>
 
@@ -57,6 +58,7 @@ namespace ot = ompl::tools;
 
 MOVEIT_CLASS_FORWARD(ModelBasedPlanningContext);
 MOVEIT_CLASS_FORWARD(ConstraintsLibrary);
+MOVEIT_CLASS_FORWARD(ExperienceLibrary);
 
 struct ModelBasedPlanningContextSpecification;
 typedef boost::function<ob::PlannerPtr(const ompl::base::SpaceInformationPtr& si, const std::string& name,
@@ -146,11 +148,16 @@ public:
     return ompl_benchmark_;
   }
 
-  const kinematic_constraints::KinematicConstraintSetPtr& getPathConstraints() const
+  const kinematic_constraints::KinematicConstraintSetConstPtr& getPathConstraints() const
   {
     return path_constraints_;
   }
 
+  const moveit_msgs::Constraints& getPathConstraintsMsg() const
+  {
+    return path_constraints_msg_;
+  }
+
   /* \brief Get the maximum number of sampling attempts allowed when sampling states is needed */
   unsigned int getMaximumStateSamplingAttempts() const
   {
@@ -187,6 +194,18 @@ public:
     max_goal_samples_ = max_goal_samples;
   }
 
+  /* \brief Get the maximum number of threads that sample goals */
+  unsigned int getMaximumGoalSamplingThreads() const
+  {
+    return max_goal_sampling_threads_;
+  }
+
+  /* \brief Set the maximum number of threads that sample goals; each thread uses its own kinematics solvers */
+  void setMaximumGoalSamplingThreads(unsigned int max_goal_sampling_threads)
+  {
+    max_goal_sampling_threads_ = max_goal_sampling_threads;
+  }
+
   /* \brief Get the maximum number of planning threads allowed */
   unsigned int getMaximumPlanningThreads() const
   {
@@ -259,6 +278,62 @@ public:
     use_state_validity_cache_ = flag;
   }
 
+  /** \brief Set the cache of state and motion validity results that is kept across planning requests, or NULL to
+      not use one. Takes effect when the context is configured. */
+  void setValidityCache(const ValidityCachePtr& cache)
+  {
+    validity_cache_ = cache;
+  }
+
+  const ValidityCachePtr& getValidityCache() const
+  {
+    return validity_cache_;
+  }
+
+  /** \brief The fingerprint of the current planning problem in the validity cache; 0 if results are not cached */
+  uint64_t getValidityCacheFingerprint() const
+  {
+    return validity_cache_fingerprint_;
+  }
+
+  /** \brief The planners only avoid self collisions, and collisions with the world are checked on the solution
+      afterwards; parts of the solution that are in collision are planned again */
+  bool useLazyCollisionChecking() const
+  {
+    return lazy_collision_checking_;
+  }
+
+  /** \brief Set the planner configurations that run concurrently for each request, in place of the planner of this
+      context's own configuration; the first exact solution, or the convergence of the best solution cost, ends
+      planning. Takes effect when the context is configured. */
+  void setPortfolio(const std::vector<planning_interface::PlannerConfigurationSettings>& portfolio)
+  {
+    portfolio_ = portfolio;
+  }
+
+  const std::vector<planning_interface::PlannerConfigurationSettings>& getPortfolio() const
+  {
+    return portfolio_;
+  }
+
+  /** \brief Set the library of previously computed paths to recall before planning from scratch, and to store new
+      solutions in; NULL disables the use of experience */
+  void setExperienceLibrary(const ExperienceLibraryPtr& experience_library)
+  {
+    experience_library_ = experience_library;
+  }
+
+  const ExperienceLibraryPtr& getExperienceLibrary() const
+  {
+    return experience_library_;
+  }
+
+  /** \brief Check whether the last plan was obtained by repairing a path from the experience library */
+  bool isLastPlanFromExperience() const
+  {
+    return last_plan_from_experience_;
+  }
+
   bool simplifySolutions() const
   {
     return simplify_solutions_;
@@ -309,6 +384,14 @@ public:
 
   virtual void configure();
 
+  /** \brief Prepare the context for a request of the same structure as the one it was last configured for: the same
+      planner configuration, workspace and path constraints, the same values of the joints that are not planned for,
+      and goals that constrain the same links and joints, relative to the robot. The scene, the start state and the
+      goal values are updated, and the planner, the validity checker and the goal samplers are kept. Returns false
+      if the request differs in structure; the context must then be cleared and configured again. */
+  bool reconfigure(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                   const moveit_msgs::MotionPlanRequest& req, const robot_state::RobotState& start_state);
+
 protected:
   void preSolve();
   void postSolve();
@@ -321,6 +404,29 @@ protected:
   virtual void useConfig();
   virtual ob::GoalPtr constructGoal();
 
+  /** \brief Run the planners of the portfolio concurrently until one of them finds a solution */
+  bool solvePortfolio(double timeout);
+
+  /** \brief Try to solve the problem by repairing paths from the experience library */
+  bool solveFromExperience(const ob::PlannerTerminationCondition& ptc);
+
+  /** \brief Make \e path valid by replanning the parts that are in collision. If \e trusted is true, all but the
+      first segment of the path are known to be valid. */
+  bool repairPath(og::PathGeometric& path, bool trusted, const ob::PlannerTerminationCondition& ptc) const;
+
+  /** \brief Switch between the self collision checks used while planning lazily and the full checks */
+  void setSelfCollisionOnly(bool flag);
+
+  /** \brief Check the solution computed with self collision checks only against the world, and replan the parts that
+      are in collision */
+  bool validateLazySolution(const ob::PlannerTerminationCondition& ptc);
+
+  /** \brief Add the current solution to the experience library, unless it was recalled from there */
+  void storeExperience();
+
+  /** \brief The fingerprint that identifies the scene of the current request in the experience library */
+  uint64_t getSceneFingerprint() const;
+
   void registerTerminationCondition(const ob::PlannerTerminationCondition& ptc);
   void unregisterTerminationCondition();
 
@@ -339,9 +445,12 @@ protected:
 
   std::vector<int> space_signature_;
 
-  kinematic_constraints::KinematicConstraintSetPtr path_constraints_;
+  kinematic_constraints::KinematicConstraintSetConstPtr path_constraints_;
   moveit_msgs::Constraints path_constraints_msg_;
-  std::vector<kinematic_constraints::KinematicConstraintSetPtr> goal_constraints_;
+  std::vector<kinematic_constraints::KinematicConstraintSetConstPtr> goal_constraints_;
+
+  /// the goals constructed for goal_constraints_, which reconfigure() updates in place
+  std::vector<ob::GoalPtr> goal_samplers_;
 
   const ob::PlannerTerminationCondition* ptc_;
   boost::mutex ptc_lock_;
@@ -356,6 +465,9 @@ protected:
   /// possible)
   unsigned int max_goal_samples_;
 
+  /// the maximum number of threads that sample goals
+  unsigned int max_goal_sampling_threads_;
+
   /// maximum number of attempts to be made at sampling a state when attempting to find valid states that satisfy some
   /// set of constraints
   unsigned int max_state_sampling_attempts_;
@@ -376,7 +488,43 @@ protected:
 
   bool use_state_validity_cache_;
 
+  ValidityCachePtr validity_cache_;
+  uint64_t validity_cache_fingerprint_;
+
+  std::vector<planning_interface::PlannerConfigurationSettings> portfolio_;
+  std::vector<ob::PlannerAllocator> portfolio_allocators_;
+
+  /// anytime planners of the portfolio stop once the best cost improved by less than the given fraction for the given
+  /// time (in seconds)
+  double portfolio_convergence_time_;
+  double portfolio_convergence_improvement_;
+
+  ExperienceLibraryPtr experience_library_;
+  bool last_plan_from_experience_;
+
+  bool lazy_collision_checking_;
+
+  /// sample states for path constraints by projecting them with the Jacobian, instead of using the constraint sampler
+  /// manager, and project interpolated states as well; set by the project_path_constraints setting
+  bool project_path_constraints_;
+
   bool simplify_solutions_;
+
+  /// the number of randomized simplification chains run concurrently on a solution, of which the best result is kept;
+  /// set by the simplification_chains setting, 1 uses the simplifier of the simple setup
+  unsigned int simplification_chains_;
+
+  /// also try the hybrid of the simplified paths; set by the hybridize_simplified_solutions setting
+  bool hybridize_simplified_solutions_;
+
+  /// the settings the context was last configured with, and the fingerprint of the scene without its collision
+  /// objects; reconfigure() only accepts requests that match them, and a fingerprint of 0 means no request does
+  std::map<std::string, std::string> configured_config_;
+  std::vector<planning_interface::PlannerConfigurationSettings> configured_portfolio_;
+  ConstraintsLibraryConstPtr configured_constraints_library_;
+  ValidityCachePtr configured_validity_cache_;
+  double configured_segment_length_;
+  uint64_t configured_fingerprint_;
 };
 }
 
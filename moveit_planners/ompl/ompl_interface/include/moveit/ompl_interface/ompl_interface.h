@@ -39,6 +39,7 @@
 
 #include <moveit/ompl_interface/planning_context_manager.h>
 #include <moveit/ompl_interface/constraints_library.h>
+#include <moveit/ompl_interface/experience_library.h>
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/constraint_sampler_manager_loader/constraint_sampler_manager_loader.h>
 #include <moveit/planning_interface/planning_interface.h>
@@ -139,6 +140,37 @@ public:
 
   void saveConstraintApproximations(const std::string& path);
 
+  ExperienceLibrary& getExperienceLibrary()
+  {
+    return *experience_library_;
+  }
+
+  const ExperienceLibrary& getExperienceLibrary() const
+  {
+    return *experience_library_;
+  }
+
+  /** @brief Recall and repair previously computed paths before planning from scratch, and remember new solutions */
+  void useExperience(bool flag)
+  {
+    use_experience_ = flag;
+  }
+
+  bool isUsingExperience() const
+  {
+    return use_experience_;
+  }
+
+  void loadExperience(const std::string& path);
+
+  void saveExperience(const std::string& path);
+
+  /** @brief Look up param server 'experience_path' and use its value as the path to save planning experience to */
+  bool saveExperience();
+
+  /** @brief Look up param server 'experience_path' and use its value as the path to load planning experience from */
+  bool loadExperience();
+
   bool simplifySolutions() const
   {
     return simplify_solutions_;
@@ -172,6 +204,16 @@ protected:
   /** @brief Load the additional plugins for sampling constraints */
   void loadConstraintSamplers();
 
+  /** @brief Load the size and resolution of the validity cache kept across planning requests */
+  void loadValidityCacheSettings();
+
+  /** @brief Load whether planning experience is used, and the stored experience if it is */
+  void loadExperienceSettings();
+
+  /** @brief Look up param server 'roadmap_path' and use it to store the roadmaps of the geometric::PersistentLazyPRM
+   * planner */
+  void loadPersistentRoadmapSettings();
+
   void configureContext(const ModelBasedPlanningContextPtr& context) const;
 
   /** \brief Configure the OMPL planning context for a new planning request */
@@ -192,6 +234,9 @@ protected:
   ConstraintsLibraryPtr constraints_library_;
   bool use_constraints_approximations_;
 
+  ExperienceLibraryPtr experience_library_;
+  bool use_experience_;
+
   bool simplify_solutions_;
 
 private:
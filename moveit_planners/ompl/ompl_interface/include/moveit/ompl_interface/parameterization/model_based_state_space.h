@@ -265,6 +265,14 @@ protected:
   InterpolationFunction interpolation_function_;
   DistanceFunction distance_function_;
 
+  /// if every variable belongs to a revolute or prismatic joint of its own, distance and interpolate work directly on
+  /// the values: linear variables are weighted by linear_weights_ (0 for continuous joints), and the continuous
+  /// joints are handled separately
+  bool single_dof_joints_;
+  std::vector<double> linear_weights_;
+  std::vector<unsigned int> wrapping_variables_;
+  std::vector<double> wrapping_weights_;
+
   double tag_snap_to_segment_;
   double tag_snap_to_segment_complement_;
 };
@@ -39,6 +39,10 @@
 
 #include <moveit/ompl_interface/parameterization/model_based_state_space.h>
 #include <ompl/base/spaces/SE3StateSpace.h>
+#include <boost/thread/tss.hpp>
+#include <atomic>
+#include <unordered_map>
+#include <stdint.h>
 
 namespace ompl_interface
 {
@@ -104,13 +108,29 @@ public:
   virtual ompl::base::StateSamplerPtr allocDefaultStateSampler() const;
 
   bool computeStateFK(ompl::base::State* state) const;
-  bool computeStateIK(ompl::base::State* state) const;
+
+  /** \brief Compute the joint values of \e state from its poses. Solutions are remembered per thread, so poses that
+      are solved again (as happens when the same motion is interpolated repeatedly) are looked up instead.  If the
+      joint values of \e state are not a good enough seed, IK is retried with the joint values of \e neighbor */
+  bool computeStateIK(ompl::base::State* state, const ompl::base::State* neighbor = NULL) const;
   bool computeStateK(ompl::base::State* state) const;
 
   virtual void setPlanningVolume(double minX, double maxX, double minY, double maxY, double minZ, double maxZ);
   virtual void copyToOMPLState(ompl::base::State* state, const robot_state::RobotState& rstate) const;
   virtual void sanityChecks() const;
 
+  /** \brief Get the number of IK problems whose result was found among the remembered solutions */
+  std::size_t getIKMemoHitCount() const
+  {
+    return ik_memo_hits_;
+  }
+
+  /** \brief Get the number of IK problems that had to be solved */
+  std::size_t getIKMemoMissCount() const
+  {
+    return ik_memo_misses_;
+  }
+
 private:
   struct PoseComponent
   {
@@ -132,8 +152,24 @@ private:
     std::vector<std::string> fk_link_;
   };
 
+  /// a remembered IK result: the rounded pose, the seed it was solved from and the solution (empty if IK failed)
+  struct IKMemoEntry
+  {
+    int64_t pose[7];
+    std::vector<double> seed;
+    std::vector<double> solution;
+  };
+  typedef std::unordered_map<uint64_t, IKMemoEntry> IKMemo;
+
+  bool computeComponentIK(StateType* full_state, unsigned int idx, IKMemo& memo, const StateType* neighbor) const;
+
   std::vector<PoseComponent> poses_;
   double jump_factor_;
+
+  /// the remembered IK results of the calling thread, one memo per pose component
+  mutable boost::thread_specific_ptr<std::vector<IKMemo> > ik_memo_;
+  mutable std::atomic<std::size_t> ik_memo_hits_;
+  mutable std::atomic<std::size_t> ik_memo_misses_;
 };
 }
 
@@ -38,6 +38,7 @@
 #define MOVEIT_OMPL_INTERFACE_PLANNING_CONTEXT_MANAGER_
 
 #include <moveit/ompl_interface/model_based_planning_context.h>
+#include <moveit/ompl_interface/detail/persistent_roadmap.h>
 #include <moveit/ompl_interface/parameterization/model_based_state_space_factory.h>
 #include <moveit/constraint_samplers/constraint_sampler_manager.h>
 #include <moveit/macros/class_forward.h>
@@ -101,6 +102,18 @@ public:
     max_goal_samples_ = max_goal_samples;
   }
 
+  /* \brief Get the maximum number of threads that sample goals */
+  unsigned int getMaximumGoalSamplingThreads() const
+  {
+    return max_goal_sampling_threads_;
+  }
+
+  /* \brief Set the maximum number of threads that sample goals; each thread uses its own kinematics solvers */
+  void setMaximumGoalSamplingThreads(unsigned int max_goal_sampling_threads)
+  {
+    max_goal_sampling_threads_ = max_goal_sampling_threads;
+  }
+
   /* \brief Get the maximum number of planning threads allowed */
   unsigned int getMaximumPlanningThreads() const
   {
@@ -130,6 +143,16 @@ public:
     return minimum_waypoint_count_;
   }
 
+  /** \brief Get the maximum number of validity results cached per group across planning requests */
+  std::size_t getValidityCacheSize() const
+  {
+    return validity_cache_size_;
+  }
+
+  /** \brief Set the maximum number of validity results cached per group across planning requests, and the resolution
+      of the joint values they are cached for. A size of 0 disables the cache. Existing caches are dropped. */
+  void setValidityCacheSize(std::size_t size, double resolution);
+
   /** \brief Get the minimum number of waypoints along the solution path */
   void setMinimumWaypointCount(unsigned int mwc)
   {
@@ -172,6 +195,21 @@ public:
 
   ConfiguredPlannerSelector getPlannerSelector() const;
 
+  /** \brief Set the folder the roadmaps of the geometric::PersistentLazyPRM planner are loaded from when they are
+      first needed, and saved to by savePersistentRoadmaps(); empty to keep roadmaps in memory only */
+  void setPersistentRoadmapPath(const std::string& path)
+  {
+    roadmap_path_ = path;
+  }
+
+  const std::string& getPersistentRoadmapPath() const
+  {
+    return roadmap_path_;
+  }
+
+  /** \brief Save all roadmaps of the geometric::PersistentLazyPRM planner to the persistent roadmap path */
+  void savePersistentRoadmaps() const;
+
 protected:
   typedef boost::function<const ModelBasedStateSpaceFactoryPtr&(const std::string&)> StateSpaceFactoryTypeSelector;
 
@@ -180,6 +218,15 @@ protected:
   void registerDefaultPlanners();
   void registerDefaultStateSpaces();
 
+  /** \brief Get the validity cache shared by the contexts of a group, or NULL if caching is disabled */
+  ValidityCachePtr getValidityCache(const std::string& group) const;
+
+  /** \brief Get the roadmap shared by the contexts that plan in state spaces named like \e space */
+  PersistentRoadmapPtr getPersistentRoadmap(const ModelBasedStateSpacePtr& space) const;
+
+  ob::PlannerPtr allocatePersistentRoadmapPlanner(const ob::SpaceInformationPtr& si, const std::string& new_name,
+                                                  const ModelBasedPlanningContextSpecification& spec) const;
+
   /** \brief This is the function that constructs new planning contexts if no previous ones exist that are suitable */
   ModelBasedPlanningContextPtr getPlanningContext(const planning_interface::PlannerConfigurationSettings& config,
                                                   const StateSpaceFactoryTypeSelector& factory_selector,
@@ -208,6 +255,9 @@ protected:
   /// maximum number of states to sample in the goal region for any planning request (when such sampling is possible)
   unsigned int max_goal_samples_;
 
+  /// the maximum number of threads that sample goals
+  unsigned int max_goal_sampling_threads_;
+
   /// maximum number of attempts to be made at sampling a state when attempting to find valid states that satisfy some
   /// set of constraints
   unsigned int max_state_sampling_attempts_;
@@ -226,6 +276,15 @@ protected:
   /// needed)
   unsigned int minimum_waypoint_count_;
 
+  /// the maximum number of validity results cached per group across requests; 0 disables the cache
+  std::size_t validity_cache_size_;
+
+  /// the resolution of the joint values validity results are cached for
+  double validity_cache_resolution_;
+
+  /// the folder persistent roadmaps are stored in
+  std::string roadmap_path_;
+
 private:
   MOVEIT_CLASS_FORWARD(LastPlanningContext);
   LastPlanningContextPtr last_planning_context_;
@@ -36,10 +36,14 @@
 
 #include <moveit/ompl_interface/constraints_library.h>
 #include <moveit/ompl_interface/detail/constrained_sampler.h>
+#include <moveit/ompl_interface/detail/threadsafe_state_storage.h>
 #include <moveit/profiler/profiler.h>
 #include <ompl/tools/config/SelfConfig.h>
+#include <ompl/datastructures/NearestNeighborsGNAT.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>
 
 namespace ompl_interface
@@ -76,22 +80,298 @@ void hexToMsg(const std::string& hex, T& msg)
   ros::serialization::IStream stream_arg(buffer_arg.get(), serial_size_arg);
   ros::serialization::deserialize(stream_arg, msg);
 }
+
+// The progress of a constraint approximation construction, shared by the threads that sample and connect states
+struct ApproximationConstruction
+{
+  ApproximationConstruction(const ModelBasedPlanningContextPtr& pc, const moveit_msgs::Constraints& sampling,
+                            const kinematic_constraints::KinematicConstraintSet& hard,
+                            const ConstraintApproximationConstructionOptions& opt,
+                            ConstraintApproximationStateStorage* storage)
+    : pcontext(pc)
+    , constr_sampling(sampling)
+    , kset(hard)
+    , options(opt)
+    , cass(storage)
+    , tss(pc->getCompleteInitialRobotState())
+    , attempts(0)
+    , done(-1)
+    , slow_warn(false)
+    , failed(false)
+    , sampling_rate(0.0)
+    , sampling_rate_count(0)
+    , milestones(0)
+    , next(0)
+    , good(0)
+    , last_checkpoint(ompl::time::now())
+  {
+  }
+
+  const ModelBasedPlanningContextPtr& pcontext;
+  const moveit_msgs::Constraints& constr_sampling;
+  const kinematic_constraints::KinematicConstraintSet& kset;
+  const ConstraintApproximationConstructionOptions& options;
+  ConstraintApproximationStateStorage* cass;
+  TSStateStorage tss;
+
+  std::size_t attempts;
+  int done;
+  bool slow_warn;
+  bool failed;
+  double sampling_rate;
+  unsigned int sampling_rate_count;
+
+  /// the milestones are the first states of the storage; the threads connect them in order
+  std::size_t milestones;
+  std::vector<const ob::State*> milestone_states;
+  boost::scoped_ptr<ompl::NearestNeighbors<std::size_t> > nn;
+  std::size_t next;
+  int good;
+
+  ompl::time::point last_checkpoint;
+  boost::mutex lock;
+};
+
+// Save the progress of the construction if options.checkpoint_interval passed since the last time. Called under the
+// lock of the construction.
+void saveCheckpoint(ApproximationConstruction& c)
+{
+  if (c.options.checkpoint_file.empty() ||
+      ompl::time::seconds(ompl::time::now() - c.last_checkpoint) < c.options.checkpoint_interval)
+    return;
+  if (!FlatConstraintApproximation(*c.cass).save(c.options.checkpoint_file))
+    ROS_WARN_NAMED("constraints_library", "Unable to save construction checkpoint to '%s'",
+                   c.options.checkpoint_file.c_str());
+  c.last_checkpoint = ompl::time::now();
+}
+
+// Restore the states and connections of a checkpoint saved by an interrupted construction
+bool loadCheckpoint(ApproximationConstruction& c)
+{
+  if (c.options.checkpoint_file.empty() || !FlatConstraintApproximation::isFlatFile(c.options.checkpoint_file))
+    return false;
+  FlatConstraintApproximation checkpoint(c.pcontext->getOMPLStateSpace(), c.options.checkpoint_file);
+  if (!checkpoint.isValid())
+    return false;
+
+  ompl::base::ScopedState<> temp(c.pcontext->getOMPLStateSpace());
+  for (std::size_t i = 0; i < checkpoint.getStateCount(); ++i)
+  {
+    checkpoint.getState(i, temp.get());
+    c.cass->addState(temp.get());
+  }
+  for (std::size_t i = 0; i < checkpoint.getStateCount(); ++i)
+  {
+    std::size_t count;
+    const uint64_t* neighbors = checkpoint.getNeighbors(i, count);
+    ConstrainedStateMetadata& md = c.cass->getMetadata(i);
+    for (std::size_t k = 0; k < count; ++k)
+    {
+      md.first.push_back(neighbors[k]);
+      const FlatConstraintApproximation::Motion* motion = checkpoint.findMotion(i, neighbors[k]);
+      if (motion)
+        md.second[neighbors[k]] = std::make_pair(motion->first, motion->last);
+    }
+  }
+  ROS_INFO_NAMED("constraints_library", "Resuming construction from %lu states saved in '%s'",
+                 checkpoint.getStateCount(), c.options.checkpoint_file.c_str());
+  return true;
+}
+
+void sampleConstrainedStates(ApproximationConstruction* c)
+{
+  const ModelBasedStateSpacePtr& space = c->pcontext->getOMPLStateSpace();
+
+  // every thread uses its own constraint sampler
+  const constraint_samplers::ConstraintSamplerManagerPtr& csmng = c->pcontext->getConstraintSamplerManager();
+  ConstrainedSampler* csmp = NULL;
+  if (csmng)
+  {
+    constraint_samplers::ConstraintSamplerPtr cs = csmng->selectSampler(
+        c->pcontext->getPlanningScene(), c->pcontext->getJointModelGroup()->getName(), c->constr_sampling);
+    if (cs)
+      csmp = new ConstrainedSampler(c->pcontext.get(), cs);
+  }
+  ob::StateSamplerPtr ss(csmp ? ob::StateSamplerPtr(csmp) : space->allocDefaultStateSampler());
+
+  ompl::base::ScopedState<> temp(space);
+  robot_state::RobotState* kstate = c->tss.getStateStorage();
+  const unsigned int samples = c->options.samples;
+  while (true)
+  {
+    ss->sampleUniform(temp.get());
+    space->copyToRobotState(*kstate, temp.get());
+    bool satisfied = c->kset.decide(*kstate).satisfied;
+
+    boost::mutex::scoped_lock slock(c->lock);
+    if (c->failed || c->cass->size() >= samples)
+      break;
+    ++c->attempts;
+    if (satisfied)
+    {
+      temp->as<ModelBasedStateSpace::StateType>()->tag = c->cass->size();
+      c->cass->addState(temp.get());
+    }
+
+    int done_now = 100 * c->cass->size() / samples;
+    if (c->done != done_now)
+    {
+      c->done = done_now;
+      ROS_INFO_NAMED("constraints_library", "%d%% complete (kept %0.1lf%% sampled states)", c->done,
+                     100.0 * (double)c->cass->size() / (double)c->attempts);
+      saveCheckpoint(*c);
+    }
+
+    if (!c->slow_warn && c->attempts > 10 && c->attempts > c->cass->size() * 100)
+    {
+      c->slow_warn = true;
+      ROS_WARN_NAMED("constraints_library", "Computation of valid state database is very slow...");
+    }
+
+    if (c->attempts > samples && c->cass->size() == 0)
+    {
+      ROS_ERROR_NAMED("constraints_library", "Unable to generate any samples");
+      c->failed = true;
+    }
+  }
+
+  if (csmp)
+  {
+    boost::mutex::scoped_lock slock(c->lock);
+    c->sampling_rate += csmp->getConstrainedSamplingRate();
+    ++c->sampling_rate_count;
+  }
+}
+
+double milestoneDistance(const ob::StateSpace* space, const std::vector<const ob::State*>* states, std::size_t a,
+                         std::size_t b)
+{
+  return space->distance((*states)[a], (*states)[b]);
+}
+
+bool isConnected(const ConstrainedStateMetadata& md, std::size_t to)
+{
+  return std::find(md.first.begin(), md.first.end(), to) != md.first.end();
+}
+
+void connectConstrainedStates(ApproximationConstruction* c)
+{
+  const ConstraintApproximationConstructionOptions& options = c->options;
+  const ob::SpaceInformationPtr& si = c->pcontext->getOMPLSimpleSetup()->getSpaceInformation();
+  const ob::StateSpacePtr& space = si->getStateSpace();
+  std::vector<ob::State*> int_states(options.max_explicit_points, NULL);
+  si->allocStates(int_states);
+  robot_state::RobotState* kstate = c->tss.getStateStorage();
+  ConstraintApproximationStateStorage* cass = c->cass;
+
+  // the neighbors are taken from the closest milestones, of which some may not be connectable
+  std::vector<std::size_t> nbh;
+  while (true)
+  {
+    std::size_t j;
+    {
+      boost::mutex::scoped_lock slock(c->lock);
+      if (c->next >= c->milestones)
+        break;
+      j = c->next++;
+      int done_now = 100 * j / c->milestones;
+      if (c->done != done_now)
+      {
+        c->done = done_now;
+        ROS_INFO_NAMED("constraints_library", "%d%% complete", c->done);
+        saveCheckpoint(*c);
+      }
+      if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
+        continue;
+    }
+
+    const ob::State* sj = c->milestone_states[j];
+    c->nn->nearestK(j, 2 * options.edges_per_sample + 1, nbh);
+    for (std::size_t n = 0; n < nbh.size(); ++n)
+    {
+      std::size_t i = nbh[n];
+      if (i == j)
+        continue;
+      double d = space->distance(c->milestone_states[i], sj);
+      if (d >= options.max_edge_length)
+        break;
+      {
+        boost::mutex::scoped_lock slock(c->lock);
+        if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
+          break;
+        if (cass->getMetadata(i).first.size() >= options.edges_per_sample || isConnected(cass->getMetadata(j), i))
+          continue;
+      }
+
+      unsigned int isteps =
+          std::min<unsigned int>(options.max_explicit_points, d / options.explicit_points_resolution);
+      bool ok = true;
+      if (isteps > 0)
+      {
+        double step = 1.0 / (double)isteps;
+        space->interpolate(c->milestone_states[i], sj, step, int_states[0]);
+        for (unsigned int k = 1; k < isteps; ++k)
+        {
+          double this_step = step / (1.0 - (k - 1) * step);
+          space->interpolate(int_states[k - 1], sj, this_step, int_states[k]);
+          c->pcontext->getOMPLStateSpace()->copyToRobotState(*kstate, int_states[k]);
+          if (!c->kset.decide(*kstate).satisfied)
+          {
+            ok = false;
+            break;
+          }
+        }
+      }
+      if (!ok)
+        continue;
+
+      // another thread may have used up the edges of either state meanwhile
+      boost::mutex::scoped_lock slock(c->lock);
+      if (cass->getMetadata(i).first.size() >= options.edges_per_sample ||
+          cass->getMetadata(j).first.size() >= options.edges_per_sample || isConnected(cass->getMetadata(j), i))
+        continue;
+      cass->getMetadata(i).first.push_back(j);
+      cass->getMetadata(j).first.push_back(i);
+
+      if (options.explicit_motions)
+      {
+        cass->getMetadata(i).second[j].first = cass->size();
+        for (unsigned int k = 0; k < isteps; ++k)
+        {
+          int_states[k]->as<ModelBasedStateSpace::StateType>()->tag = -1;
+          cass->addState(int_states[k]);
+        }
+        cass->getMetadata(i).second[j].second = cass->size();
+        cass->getMetadata(j).second[i] = cass->getMetadata(i).second[j];
+      }
+      c->good++;
+    }
+  }
+
+  si->freeStates(int_states);
+}
 }
 
 class ConstraintApproximationStateSampler : public ob::StateSampler
 {
 public:
-  ConstraintApproximationStateSampler(const ob::StateSpace* space,
-                                      const ConstraintApproximationStateStorage* state_storage, std::size_t milestones)
-    : ob::StateSampler(space), state_storage_(state_storage)
+  ConstraintApproximationStateSampler(const ob::StateSpace* space, const FlatConstraintApproximationConstPtr& data,
+                                      std::size_t milestones)
+    : ob::StateSampler(space), data_(data)
   {
     max_index_ = milestones - 1;
     inv_dim_ = space->getDimension() > 0 ? 1.0 / (double)space->getDimension() : 1.0;
+    work_ = space->allocState();
+  }
+
+  virtual ~ConstraintApproximationStateSampler()
+  {
+    space_->freeState(work_);
   }
 
   virtual void sampleUniform(ob::State* state)
   {
-    space_->copyState(state, state_storage_->getState(rng_.uniformInt(0, max_index_)));
+    data_->getState(rng_.uniformInt(0, max_index_), state);
   }
 
   virtual void sampleUniformNear(ob::State* state, const ob::State* near, const double distance)
@@ -99,16 +379,17 @@ public:
     int index = -1;
     int tag = near->as<ModelBasedStateSpace::StateType>()->tag;
 
-    if (tag >= 0)
+    if (tag >= 0 && (std::size_t)tag < data_->getStateCount())
     {
-      const ConstrainedStateMetadata& md = state_storage_->getMetadata(tag);
-      if (!md.first.empty())
+      std::size_t count;
+      const uint64_t* neighbors = data_->getNeighbors(tag, count);
+      if (count > 0)
       {
-        std::size_t matt = md.first.size() / 3;
+        std::size_t matt = count / 3;
         std::size_t att = 0;
         do
         {
-          index = md.first[rng_.uniformInt(0, md.first.size() - 1)];
+          index = neighbors[rng_.uniformInt(0, count - 1)];
         } while (dirty_.find(index) != dirty_.end() && ++att < matt);
         if (att >= matt)
           index = -1;
@@ -119,15 +400,16 @@ public:
     if (index < 0)
       index = rng_.uniformInt(0, max_index_);
 
-    double dist = space_->distance(near, state_storage_->getState(index));
+    data_->getState(index, work_);
+    double dist = space_->distance(near, work_);
 
     if (dist > distance)
     {
       double d = pow(rng_.uniform01(), inv_dim_) * distance;
-      space_->interpolate(near, state_storage_->getState(index), d / dist, state);
+      space_->interpolate(near, work_, d / dist, state);
     }
     else
-      space_->copyState(state, state_storage_->getState(index));
+      space_->copyState(state, work_);
   }
 
   virtual void sampleGaussian(ob::State* state, const ob::State* mean, const double stdDev)
@@ -137,42 +419,42 @@ public:
 
 protected:
   /** \brief The states to sample from */
-  const ConstraintApproximationStateStorage* state_storage_;
+  FlatConstraintApproximationConstPtr data_;
   std::set<std::size_t> dirty_;
   unsigned int max_index_;
   double inv_dim_;
+
+  /** \brief The stored state currently sampled around */
+  ob::State* work_;
 };
 
-bool interpolateUsingStoredStates(const ConstraintApproximationStateStorage* state_storage, const ob::State* from,
+bool interpolateUsingStoredStates(const FlatConstraintApproximationConstPtr& data, const ob::State* from,
                                   const ob::State* to, const double t, ob::State* state)
 {
   int tag_from = from->as<ModelBasedStateSpace::StateType>()->tag;
   int tag_to = to->as<ModelBasedStateSpace::StateType>()->tag;
 
-  if (tag_from < 0 || tag_to < 0)
+  if (tag_from < 0 || tag_to < 0 || (std::size_t)tag_from >= data->getStateCount())
     return false;
 
   if (tag_from == tag_to)
-    state_storage->getStateSpace()->copyState(state, to);
+    data->getStateSpace()->copyState(state, to);
   else
   {
-    const ConstrainedStateMetadata& md = state_storage->getMetadata(tag_from);
-
-    std::map<std::size_t, std::pair<std::size_t, std::size_t> >::const_iterator it = md.second.find(tag_to);
-    if (it == md.second.end())
+    const FlatConstraintApproximation::Motion* motion = data->findMotion(tag_from, tag_to);
+    if (!motion)
       return false;
-    const std::pair<std::size_t, std::size_t>& istates = it->second;
-    std::size_t index = (std::size_t)((istates.second - istates.first + 2) * t + 0.5);
+    std::size_t index = (std::size_t)((motion->last - motion->first + 2) * t + 0.5);
 
     if (index == 0)
-      state_storage->getStateSpace()->copyState(state, from);
+      data->getStateSpace()->copyState(state, from);
     else
     {
       --index;
-      if (index >= istates.second - istates.first)
-        state_storage->getStateSpace()->copyState(state, to);
+      if (index >= motion->last - motion->first)
+        data->getStateSpace()->copyState(state, to);
       else
-        state_storage->getStateSpace()->copyState(state, state_storage->getState(istates.first + index));
+        data->getState(motion->first + index, state);
     }
   }
   return true;
@@ -180,22 +462,22 @@ bool interpolateUsingStoredStates(const ConstraintApproximationStateStorage* sta
 
 ompl_interface::InterpolationFunction ompl_interface::ConstraintApproximation::getInterpolationFunction() const
 {
-  if (explicit_motions_ && milestones_ > 0 && milestones_ < state_storage_->size())
-    return boost::bind(&interpolateUsingStoredStates, state_storage_, _1, _2, _3, _4);
+  const FlatConstraintApproximationPtr& data = getData();
+  if (data && explicit_motions_ && milestones_ > 0 && milestones_ < data->getStateCount())
+    return boost::bind(&interpolateUsingStoredStates, FlatConstraintApproximationConstPtr(data), _1, _2, _3, _4);
   return InterpolationFunction();
 }
 
 ompl::base::StateSamplerPtr
 allocConstraintApproximationStateSampler(const ob::StateSpace* space, const std::vector<int>& expected_signature,
-                                         const ConstraintApproximationStateStorage* state_storage,
-                                         std::size_t milestones)
+                                         const FlatConstraintApproximationConstPtr& data, std::size_t milestones)
 {
   std::vector<int> sig;
   space->computeSignature(sig);
   if (sig != expected_signature)
     return ompl::base::StateSamplerPtr();
   else
-    return ompl::base::StateSamplerPtr(new ConstraintApproximationStateSampler(space, state_storage, milestones));
+    return ompl::base::StateSamplerPtr(new ConstraintApproximationStateSampler(space, data, milestones));
 }
 }
 
@@ -210,19 +492,79 @@ ompl_interface::ConstraintApproximation::ConstraintApproximation(
   , ompldb_filename_(filename)
   , state_storage_ptr_(storage)
   , milestones_(milestones)
+  , loaded_(false)
 {
   state_storage_ = static_cast<ConstraintApproximationStateStorage*>(state_storage_ptr_.get());
-  state_storage_->getStateSpace()->computeSignature(space_signature_);
+  space_ = state_storage_->getStateSpace();
+  space_->computeSignature(space_signature_);
   if (milestones_ == 0)
     milestones_ = state_storage_->size();
 }
 
+ompl_interface::ConstraintApproximation::ConstraintApproximation(
+    const std::string& group, const std::string& state_space_parameterization, bool explicit_motions,
+    const moveit_msgs::Constraints& msg, const std::string& filename, const ompl::base::StateSpacePtr& space,
+    const std::string& path, std::size_t milestones)
+  : group_(group)
+  , state_space_parameterization_(state_space_parameterization)
+  , explicit_motions_(explicit_motions)
+  , constraint_msg_(msg)
+  , ompldb_filename_(filename)
+  , state_storage_(NULL)
+  , milestones_(milestones)
+  , space_(space)
+  , path_(path)
+  , loaded_(false)
+{
+  space_->computeSignature(space_signature_);
+}
+
+const ompl_interface::FlatConstraintApproximationPtr& ompl_interface::ConstraintApproximation::getData() const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  if (loaded_)
+    return data_;
+  loaded_ = true;
+
+  if (state_storage_)
+    data_.reset(new FlatConstraintApproximation(*state_storage_));
+  else if (FlatConstraintApproximation::isFlatFile(path_))
+    data_.reset(new FlatConstraintApproximation(space_, path_));
+  else
+  {
+    // approximations saved before the flat layout was introduced are deserialized and converted once
+    ConstraintApproximationStateStorage cass(space_);
+    cass.load(path_.c_str());
+    data_.reset(new FlatConstraintApproximation(cass));
+  }
+
+  if (!data_->isValid())
+  {
+    ROS_ERROR_NAMED("constraints_library", "Unable to load constraint approximation named '%s' from '%s'",
+                    constraint_msg_.name.c_str(), path_.c_str());
+    data_.reset();
+  }
+  else if (!state_storage_)
+  {
+    std::size_t milestones = milestones_ > 0 ? milestones_ : data_->getStateCount();
+    ROS_INFO_NAMED("constraints_library", "Loaded %lu states (%lu milestones) and %lu connections (%0.1lf per state) "
+                                          "for constraint named '%s'%s",
+                   data_->getStateCount(), milestones, data_->getNeighborCount(),
+                   (double)data_->getNeighborCount() / (double)milestones, constraint_msg_.name.c_str(),
+                   explicit_motions_ ? ". Explicit motions included." : "");
+  }
+  return data_;
+}
+
 ompl::base::StateSamplerAllocator
 ompl_interface::ConstraintApproximation::getStateSamplerAllocator(const moveit_msgs::Constraints& msg) const
 {
-  if (state_storage_->size() == 0)
+  const FlatConstraintApproximationPtr& data = getData();
+  if (!data || data->getStateCount() == 0)
     return ompl::base::StateSamplerAllocator();
-  return boost::bind(&allocConstraintApproximationStateSampler, _1, space_signature_, state_storage_, milestones_);
+  std::size_t milestones = milestones_ > 0 ? milestones_ : data->getStateCount();
+  return boost::bind(&allocConstraintApproximationStateSampler, _1, space_signature_,
+                     FlatConstraintApproximationConstPtr(data), milestones);
 }
 /*
 void ompl_interface::ConstraintApproximation::visualizeDistribution(const std::string &link_name, unsigned int count,
@@ -299,30 +641,22 @@ void ompl_interface::ConstraintsLibrary::loadConstraintApproximations(const std:
     if (fin.eof())
       break;
     fin >> filename;
-    ROS_INFO_NAMED("constraints_library", "Loading constraint approximation of type '%s' for group '%s' from '%s'...",
+    ROS_INFO_NAMED("constraints_library", "Found constraint approximation of type '%s' for group '%s' in '%s'. "
+                                          "It is loaded on first use.",
                    state_space_parameterization.c_str(), group.c_str(), filename.c_str());
     const ModelBasedPlanningContextPtr& pc = context_manager_.getPlanningContext(group, state_space_parameterization);
     if (pc)
     {
       moveit_msgs::Constraints msg;
       hexToMsg(serialization, msg);
-      ConstraintApproximationStateStorage* cass =
-          new ConstraintApproximationStateStorage(pc->getOMPLSimpleSetup()->getStateSpace());
-      cass->load((path + "/" + filename).c_str());
       ConstraintApproximationPtr cap(new ConstraintApproximation(group, state_space_parameterization, explicit_motions,
-                                                                 msg, filename, ompl::base::StateStoragePtr(cass),
-                                                                 milestones));
+                                                                 msg, filename,
+                                                                 pc->getOMPLSimpleSetup()->getStateSpace(),
+                                                                 path + "/" + filename, milestones));
       if (constraint_approximations_.find(cap->getName()) != constraint_approximations_.end())
         ROS_WARN_NAMED("constraints_library", "Overwriting constraint approximation named '%s'",
                        cap->getName().c_str());
       constraint_approximations_[cap->getName()] = cap;
-      std::size_t sum = 0;
-      for (std::size_t i = 0; i < cass->size(); ++i)
-        sum += cass->getMetadata(i).first.size();
-      ROS_INFO_NAMED("constraints_library", "Loaded %lu states (%lu milestones) and %lu connections (%0.1lf per state) "
-                                            "for constraint named '%s'%s",
-                     cass->size(), cap->getMilestoneCount(), sum, (double)sum / (double)cap->getMilestoneCount(),
-                     msg.name.c_str(), explicit_motions ? ". Explicit motions included." : "");
     }
   }
   ROS_INFO_NAMED("constraints_library", "Done loading constrained space approximations.");
@@ -353,8 +687,19 @@ void ompl_interface::ConstraintsLibrary::saveConstraintApproximations(const std:
       msgToHex(it->second->getConstraintsMsg(), serialization);
       fout << serialization << std::endl;
       fout << it->second->getFilename() << std::endl;
-      if (it->second->getStateStorage())
-        it->second->getStateStorage()->store((path + "/" + it->second->getFilename()).c_str());
+
+      // an approximation that is mapped from the destination file is already saved
+      std::string filename = path + "/" + it->second->getFilename();
+      const FlatConstraintApproximationPtr& data = it->second->getData();
+      if (!data)
+        ROS_ERROR_NAMED("constraints_library", "No states to save for constraint approximation named '%s'",
+                        it->second->getName().c_str());
+      else if (data->getFilename().empty() || !boost::filesystem::exists(filename) ||
+               !boost::filesystem::equivalent(data->getFilename(), filename))
+      {
+        if (!data->save(filename))
+          ROS_ERROR_NAMED("constraints_library", "Unable to save constraint approximation to '%s'", filename.c_str());
+      }
     }
   else
     ROS_ERROR_NAMED("constraints_library", "Unable to save constraint approximation to '%s'", path.c_str());
@@ -450,165 +795,70 @@ ompl::base::StateStoragePtr ompl_interface::ConstraintsLibrary::constructConstra
   robot_state::Transforms no_transforms(pcontext->getRobotModel()->getModelFrame());
   kset.add(constr_hard, no_transforms);
 
-  const robot_state::RobotState& default_state = pcontext->getCompleteInitialRobotState();
-
-  unsigned int attempts = 0;
-
   double bounds_val = std::numeric_limits<double>::max() / 2.0 - 1.0;
   pcontext->getOMPLStateSpace()->setPlanningVolume(-bounds_val, bounds_val, -bounds_val, bounds_val, -bounds_val,
                                                    bounds_val);
   pcontext->getOMPLStateSpace()->setup();
 
-  // construct the constrained states
-
-  robot_state::RobotState kstate(default_state);
-  const constraint_samplers::ConstraintSamplerManagerPtr& csmng = pcontext->getConstraintSamplerManager();
-  ConstrainedSampler* csmp = NULL;
-  if (csmng)
-  {
-    constraint_samplers::ConstraintSamplerPtr cs =
-        csmng->selectSampler(pcontext->getPlanningScene(), pcontext->getJointModelGroup()->getName(), constr_sampling);
-    if (cs)
-      csmp = new ConstrainedSampler(pcontext.get(), cs);
-  }
-
-  ob::StateSamplerPtr ss(csmp ? ob::StateSamplerPtr(csmp) : pcontext->getOMPLStateSpace()->allocDefaultStateSampler());
+  unsigned int threads = options.threads > 0 ? options.threads : std::max(1u, boost::thread::hardware_concurrency());
+  ApproximationConstruction construction(pcontext, constr_sampling, kset, options, cass);
+  loadCheckpoint(construction);
+  construction.tss.reserve(threads);
 
-  ompl::base::ScopedState<> temp(pcontext->getOMPLStateSpace());
-  int done = -1;
-  bool slow_warn = false;
+  // construct the constrained states
   ompl::time::point start = ompl::time::now();
-  while (sstor->size() < options.samples)
+  if (cass->size() < options.samples)
   {
-    ++attempts;
-    int done_now = 100 * sstor->size() / options.samples;
-    if (done != done_now)
-    {
-      done = done_now;
-      ROS_INFO_NAMED("constraints_library", "%d%% complete (kept %0.1lf%% sampled states)", done,
-                     100.0 * (double)sstor->size() / (double)attempts);
-    }
-
-    if (!slow_warn && attempts > 10 && attempts > sstor->size() * 100)
-    {
-      slow_warn = true;
-      ROS_WARN_NAMED("constraints_library", "Computation of valid state database is very slow...");
-    }
-
-    if (attempts > options.samples && sstor->size() == 0)
-    {
-      ROS_ERROR_NAMED("constraints_library", "Unable to generate any samples");
-      break;
-    }
-
-    ss->sampleUniform(temp.get());
-    pcontext->getOMPLStateSpace()->copyToRobotState(kstate, temp.get());
-    if (kset.decide(kstate).satisfied)
-    {
-      if (sstor->size() < options.samples)
-      {
-        temp->as<ModelBasedStateSpace::StateType>()->tag = sstor->size();
-        sstor->addState(temp.get());
-      }
-    }
+    ROS_INFO_NAMED("constraints_library", "Sampling constrained states using %u threads ...", threads);
+    boost::thread_group workers;
+    for (unsigned int t = 0; t < threads; ++t)
+      workers.create_thread(boost::bind(&sampleConstrainedStates, &construction));
+    workers.join_all();
   }
 
   result.state_sampling_time = ompl::time::seconds(ompl::time::now() - start);
   ROS_INFO_NAMED("constraints_library", "Generated %u states in %lf seconds", (unsigned int)sstor->size(),
                  result.state_sampling_time);
-  if (csmp)
+  if (construction.sampling_rate_count > 0)
   {
-    result.sampling_success_rate = csmp->getConstrainedSamplingRate();
+    result.sampling_success_rate = construction.sampling_rate / (double)construction.sampling_rate_count;
     ROS_INFO_NAMED("constraints_library", "Constrained sampling rate: %lf", result.sampling_success_rate);
   }
 
-  result.milestones = sstor->size();
+  // explicit motion states follow the milestones, and are only present after sampling completed
+  while (construction.milestones < sstor->size() &&
+         sstor->getState(construction.milestones)->as<ModelBasedStateSpace::StateType>()->tag >= 0)
+    construction.milestones++;
+  result.milestones = construction.milestones;
   if (options.edges_per_sample > 0)
   {
-    ROS_INFO_NAMED("constraints_library", "Computing graph connections (max %u edges per sample) ...",
-                   options.edges_per_sample);
+    ROS_INFO_NAMED("constraints_library", "Computing graph connections (max %u edges per sample) using %u threads ...",
+                   options.edges_per_sample, threads);
 
     // construct connexions
-    const ob::StateSpacePtr& space = pcontext->getOMPLSimpleSetup()->getStateSpace();
-    unsigned int milestones = sstor->size();
-    std::vector<ob::State*> int_states(options.max_explicit_points, NULL);
-    pcontext->getOMPLSimpleSetup()->getSpaceInformation()->allocStates(int_states);
-
     ompl::time::point start = ompl::time::now();
-    int good = 0;
-    int done = -1;
-
-    for (std::size_t j = 0; j < milestones; ++j)
-    {
-      int done_now = 100 * j / milestones;
-      if (done != done_now)
-      {
-        done = done_now;
-        ROS_INFO_NAMED("constraints_library", "%d%% complete", done);
-      }
-      if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
-        continue;
-
-      const ob::State* sj = sstor->getState(j);
-
-      for (std::size_t i = j + 1; i < milestones; ++i)
-      {
-        if (cass->getMetadata(i).first.size() >= options.edges_per_sample)
-          continue;
-        double d = space->distance(sstor->getState(i), sj);
-        if (d >= options.max_edge_length)
-          continue;
-        unsigned int isteps =
-            std::min<unsigned int>(options.max_explicit_points, d / options.explicit_points_resolution);
-        double step = 1.0 / (double)isteps;
-        bool ok = true;
-        space->interpolate(sstor->getState(i), sj, step, int_states[0]);
-        for (unsigned int k = 1; k < isteps; ++k)
-        {
-          double this_step = step / (1.0 - (k - 1) * step);
-          space->interpolate(int_states[k - 1], sj, this_step, int_states[k]);
-          pcontext->getOMPLStateSpace()->copyToRobotState(kstate, int_states[k]);
-          if (!kset.decide(kstate).satisfied)
-          {
-            ok = false;
-            break;
-          }
-        }
-
-        if (ok)
-        {
-          cass->getMetadata(i).first.push_back(j);
-          cass->getMetadata(j).first.push_back(i);
-
-          if (options.explicit_motions)
-          {
-            cass->getMetadata(i).second[j].first = sstor->size();
-            for (unsigned int k = 0; k < isteps; ++k)
-            {
-              int_states[k]->as<ModelBasedStateSpace::StateType>()->tag = -1;
-              sstor->addState(int_states[k]);
-            }
-            cass->getMetadata(i).second[j].second = sstor->size();
-            cass->getMetadata(j).second[i] = cass->getMetadata(i).second[j];
-          }
-
-          good++;
-          if (cass->getMetadata(j).first.size() >= options.edges_per_sample)
-            break;
-        }
-      }
-    }
+    const ob::StateSpacePtr& space = pcontext->getOMPLSimpleSetup()->getStateSpace();
+    construction.milestone_states.assign(sstor->getStates().begin(),
+                                         sstor->getStates().begin() + construction.milestones);
+    construction.nn.reset(new ompl::NearestNeighborsGNAT<std::size_t>());
+    construction.nn->setDistanceFunction(
+        boost::bind(&milestoneDistance, space.get(), &construction.milestone_states, _1, _2));
+    for (std::size_t j = 0; j < construction.milestones; ++j)
+      construction.nn->add(j);
+
+    construction.done = -1;
+    boost::thread_group workers;
+    for (unsigned int t = 0; t < threads; ++t)
+      workers.create_thread(boost::bind(&connectConstrainedStates, &construction));
+    workers.join_all();
 
     result.state_connection_time = ompl::time::seconds(ompl::time::now() - start);
     ROS_INFO_NAMED("constraints_library", "Computed possible connexions in %lf seconds. Added %d connexions",
-                   result.state_connection_time, good);
-    pcontext->getOMPLSimpleSetup()->getSpaceInformation()->freeStates(int_states);
-
-    return sstor;
+                   result.state_connection_time, construction.good);
   }
 
-  // TODO(davetcoleman): this function did not originally return a value, causing compiler warnings in ROS Melodic
-  // Update with more intelligent logic as needed
-  ROS_ERROR_NAMED("constraints_library", "No StateStoragePtr found - implement better solution here.");
+  // the checkpoint of a completed construction is not needed anymore
+  if (!options.checkpoint_file.empty() && boost::filesystem::exists(options.checkpoint_file))
+    boost::filesystem::remove(options.checkpoint_file);
   return sstor;
 }
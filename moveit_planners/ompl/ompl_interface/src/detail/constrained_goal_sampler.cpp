@@ -37,10 +37,45 @@
 #include <moveit/ompl_interface/detail/constrained_goal_sampler.h>
 #include <moveit/ompl_interface/model_based_planning_context.h>
 #include <moveit/ompl_interface/detail/state_validity_checker.h>
+#include <moveit/constraint_samplers/union_constraint_sampler.h>
+#include <moveit/constraint_samplers/cached_constraint_sampler.h>
+#include <moveit/constraint_samplers/default_constraint_samplers.h>
 #include <moveit/profiler/profiler.h>
 
+namespace
+{
+// give the IK samplers in cs kinematics solvers of their own, so that cs can sample concurrently with other samplers
+// for the same group; returns false if that is not possible
+bool useOwnKinematicsSolvers(const constraint_samplers::ConstraintSamplerPtr& cs)
+{
+  if (constraint_samplers::CachedConstraintSampler* ccs =
+          dynamic_cast<constraint_samplers::CachedConstraintSampler*>(cs.get()))
+    return useOwnKinematicsSolvers(ccs->getSampler());
+  if (constraint_samplers::UnionConstraintSampler* ucs =
+          dynamic_cast<constraint_samplers::UnionConstraintSampler*>(cs.get()))
+  {
+    for (std::size_t i = 0; i < ucs->getSamplers().size(); ++i)
+      if (!useOwnKinematicsSolvers(ucs->getSamplers()[i]))
+        return false;
+    return true;
+  }
+  if (constraint_samplers::IKConstraintSampler* iks = dynamic_cast<constraint_samplers::IKConstraintSampler*>(cs.get()))
+  {
+    const robot_model::JointModelGroup* jmg = iks->getJointModelGroup();
+    const robot_model::SolverAllocatorFn& allocator = jmg->getGroupKinematics().first.allocator_;
+    kinematics::KinematicsBasePtr solver;
+    if (allocator)
+      solver = allocator(jmg);
+    if (!solver)
+      return false;
+    iks->setKinematicsSolver(solver);
+  }
+  return true;
+}
+}
+
 ompl_interface::ConstrainedGoalSampler::ConstrainedGoalSampler(
-    const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetPtr& ks,
+    const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetConstPtr& ks,
     const constraint_samplers::ConstraintSamplerPtr& cs)
   : ob::GoalLazySamples(pc->getOMPLSimpleSetup()->getSpaceInformation(),
                         boost::bind(&ConstrainedGoalSampler::sampleUsingConstraintSampler, this, _1, _2), false)
@@ -51,13 +86,97 @@ ompl_interface::ConstrainedGoalSampler::ConstrainedGoalSampler(
   , invalid_sampled_constraints_(0)
   , warned_invalid_samples_(false)
   , verbose_display_(0)
+  , stop_workers_(false)
+  , worker_attempts_(0)
 {
   if (!constraint_sampler_)
     default_sampler_ = si_->allocStateSampler();
+  createWorkers();
   ROS_DEBUG_NAMED("constrained_goal_sampler", "Constructed a ConstrainedGoalSampler instance at address %p", this);
   startSampling();
 }
 
+ompl_interface::ConstrainedGoalSampler::~ConstrainedGoalSampler()
+{
+  // the sampling threads call into this instance, so they are stopped before its members are destroyed
+  stopSampling();
+}
+
+void ompl_interface::ConstrainedGoalSampler::createWorkers()
+{
+  const constraint_samplers::ConstraintSamplerManagerPtr& csm =
+      planning_context_->getSpecification().constraint_sampler_manager_;
+  unsigned int thread_count = planning_context_->getMaximumGoalSamplingThreads();
+  for (unsigned int i = 1; i < thread_count; ++i)
+  {
+    SamplingWorkerPtr worker(new SamplingWorker(work_state_));
+    if (constraint_sampler_)
+    {
+      if (csm)
+        worker->constraint_sampler_ =
+            csm->selectSampler(planning_context_->getPlanningScene(), planning_context_->getGroupName(),
+                               kinematic_constraint_set_->getAllConstraints());
+      if (!worker->constraint_sampler_ || !useOwnKinematicsSolvers(worker->constraint_sampler_))
+      {
+        ROS_DEBUG_NAMED("constrained_goal_sampler", "Sampling goals with %u threads instead of %u", i, thread_count);
+        break;
+      }
+    }
+    else
+      worker->default_sampler_ = si_->allocStateSampler();
+    workers_.push_back(worker);
+  }
+}
+
+void ompl_interface::ConstrainedGoalSampler::startSampling()
+{
+  ob::GoalLazySamples::startSampling();
+  if (!workers_.empty() && !worker_threads_)
+  {
+    stop_workers_ = false;
+    worker_threads_.reset(new boost::thread_group());
+    for (std::size_t i = 0; i < workers_.size(); ++i)
+      worker_threads_->create_thread(
+          boost::bind(&ConstrainedGoalSampler::sampleInWorker, this, workers_[i].get()));
+  }
+}
+
+void ompl_interface::ConstrainedGoalSampler::stopSampling()
+{
+  if (worker_threads_)
+  {
+    stop_workers_ = true;
+    worker_threads_->join_all();
+    worker_threads_.reset();
+  }
+  ob::GoalLazySamples::stopSampling();
+}
+
+bool ompl_interface::ConstrainedGoalSampler::reconfigure(
+    const moveit_msgs::Constraints& constr, const kinematic_constraints::KinematicConstraintSetConstPtr& ks)
+{
+  // a union of samplers accepts any constraints, but keeps sampling for the ones it was constructed for
+  if (constraint_sampler_ && dynamic_cast<constraint_samplers::UnionConstraintSampler*>(constraint_sampler_.get()))
+    return false;
+
+  stopSampling();
+  if (constraint_sampler_ && !constraint_sampler_->configure(constr))
+    return false;
+  for (std::size_t i = 0; i < workers_.size(); ++i)
+    if (workers_[i]->constraint_sampler_ && !workers_[i]->constraint_sampler_->configure(constr))
+      return false;
+  kinematic_constraint_set_ = ks;
+  clear();
+  work_state_ = planning_context_->getCompleteInitialRobotState();
+  for (std::size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->work_state_ = work_state_;
+  invalid_sampled_constraints_ = 0;
+  warned_invalid_samples_ = false;
+  worker_attempts_ = 0;
+  startSampling();
+  return true;
+}
+
 bool ompl_interface::ConstrainedGoalSampler::checkStateValidity(ob::State* new_goal,
                                                                 const robot_state::RobotState& state,
                                                                 bool verbose) const
@@ -78,28 +197,94 @@ bool ompl_interface::ConstrainedGoalSampler::stateValidityCallback(ob::State* ne
   return checkStateValidity(new_goal, solution_state, verbose);
 }
 
+bool ompl_interface::ConstrainedGoalSampler::samplingDone(unsigned int attempts) const
+{
+  // terminate after too many attempts, after a maximum number of samples, or when a solution has been found
+  return attempts >= planning_context_->getMaximumGoalSamplingAttempts() ||
+         getStateCount() >= planning_context_->getMaximumGoalSamples() ||
+         planning_context_->getOMPLSimpleSetup()->getProblemDefinition()->hasSolution();
+}
+
+void ompl_interface::ConstrainedGoalSampler::sampleInWorker(SamplingWorker* worker)
+{
+  ob::State* new_goal = si_->allocState();
+  while (!stop_workers_)
+  {
+    unsigned int attempts_so_far = samplingAttemptsCount() + worker_attempts_++;
+    if (samplingDone(attempts_so_far))
+      break;
+    if (sampleGoal(worker->constraint_sampler_.get(), worker->default_sampler_.get(), worker->work_state_, new_goal,
+                   attempts_so_far, false))
+      addStateIfDifferent(new_goal, getMinNewSampleDistance());
+  }
+  si_->freeState(new_goal);
+}
+
+bool ompl_interface::ConstrainedGoalSampler::sampleGoal(constraint_samplers::ConstraintSampler* constraint_sampler,
+                                                        ob::StateSampler* default_sampler,
+                                                        robot_state::RobotState& work_state, ob::State* new_goal,
+                                                        unsigned int attempts_so_far, bool verbose)
+{
+  if (constraint_sampler)
+  {
+    // makes the constraint sampler also perform a validity callback
+    robot_state::GroupStateValidityCallbackFn gsvcf =
+        boost::bind(&ompl_interface::ConstrainedGoalSampler::stateValidityCallback, this, new_goal,
+                    _1,  // pointer to state
+                    _2,  // const* joint model group
+                    _3,  // double* of joint positions
+                    verbose);
+    constraint_sampler->setGroupStateValidityCallback(gsvcf);
+
+    if (constraint_sampler->project(work_state, planning_context_->getMaximumStateSamplingAttempts()))
+    {
+      work_state.update();
+      if (kinematic_constraint_set_->decide(work_state, verbose).satisfied)
+      {
+        if (checkStateValidity(new_goal, work_state, verbose))
+          return true;
+      }
+      else
+      {
+        invalid_sampled_constraints_++;
+        if (!warned_invalid_samples_ && invalid_sampled_constraints_ >= (attempts_so_far * 8) / 10)
+        {
+          warned_invalid_samples_ = true;
+          ROS_WARN_NAMED("constrained_goal_sampler", "More than 80%% of the sampled goal states "
+                                                     "fail to satisfy the constraints imposed on the goal sampler. "
+                                                     "Is the constrained sampler working correctly?");
+        }
+      }
+    }
+  }
+  else
+  {
+    default_sampler->sampleUniform(new_goal);
+    if (static_cast<const StateValidityChecker*>(si_->getStateValidityChecker().get())->isValid(new_goal, verbose))
+    {
+      planning_context_->getOMPLStateSpace()->copyToRobotState(work_state, new_goal);
+      if (kinematic_constraint_set_->decide(work_state, verbose).satisfied)
+        return true;
+    }
+  }
+  return false;
+}
+
 bool ompl_interface::ConstrainedGoalSampler::sampleUsingConstraintSampler(const ob::GoalLazySamples* gls,
                                                                           ob::State* new_goal)
 {
   //  moveit::Profiler::ScopedBlock sblock("ConstrainedGoalSampler::sampleUsingConstraintSampler");
 
   unsigned int max_attempts = planning_context_->getMaximumGoalSamplingAttempts();
-  unsigned int attempts_so_far = gls->samplingAttemptsCount();
-
-  // terminate after too many attempts
-  if (attempts_so_far >= max_attempts)
-    return false;
-
-  // terminate after a maximum number of samples
-  if (gls->getStateCount() >= planning_context_->getMaximumGoalSamples())
-    return false;
+  unsigned int attempts_so_far = gls->samplingAttemptsCount() + worker_attempts_;
 
-  // terminate the sampling thread when a solution has been found
-  if (planning_context_->getOMPLSimpleSetup()->getProblemDefinition()->hasSolution())
+  if (samplingDone(attempts_so_far))
     return false;
 
+  // the attempts of the additional sampling threads count towards the maximum as well
+  unsigned int own_attempts = gls->samplingAttemptsCount();
   unsigned int max_attempts_div2 = max_attempts / 2;
-  for (unsigned int a = gls->samplingAttemptsCount(); a < max_attempts && gls->isSampling(); ++a)
+  for (unsigned int a = attempts_so_far; a < max_attempts && gls->isSampling(); a = ++own_attempts + worker_attempts_)
   {
     bool verbose = false;
     if (gls->getStateCount() == 0 && a >= max_attempts_div2)
@@ -109,48 +294,8 @@ bool ompl_interface::ConstrainedGoalSampler::sampleUsingConstraintSampler(const
         verbose_display_++;
       }
 
-    if (constraint_sampler_)
-    {
-      // makes the constraint sampler also perform a validity callback
-      robot_state::GroupStateValidityCallbackFn gsvcf =
-          boost::bind(&ompl_interface::ConstrainedGoalSampler::stateValidityCallback, this, new_goal,
-                      _1,  // pointer to state
-                      _2,  // const* joint model group
-                      _3,  // double* of joint positions
-                      verbose);
-      constraint_sampler_->setGroupStateValidityCallback(gsvcf);
-
-      if (constraint_sampler_->project(work_state_, planning_context_->getMaximumStateSamplingAttempts()))
-      {
-        work_state_.update();
-        if (kinematic_constraint_set_->decide(work_state_, verbose).satisfied)
-        {
-          if (checkStateValidity(new_goal, work_state_, verbose))
-            return true;
-        }
-        else
-        {
-          invalid_sampled_constraints_++;
-          if (!warned_invalid_samples_ && invalid_sampled_constraints_ >= (attempts_so_far * 8) / 10)
-          {
-            warned_invalid_samples_ = true;
-            ROS_WARN_NAMED("constrained_goal_sampler", "More than 80%% of the sampled goal states "
-                                                       "fail to satisfy the constraints imposed on the goal sampler. "
-                                                       "Is the constrained sampler working correctly?");
-          }
-        }
-      }
-    }
-    else
-    {
-      default_sampler_->sampleUniform(new_goal);
-      if (static_cast<const StateValidityChecker*>(si_->getStateValidityChecker().get())->isValid(new_goal, verbose))
-      {
-        planning_context_->getOMPLStateSpace()->copyToRobotState(work_state_, new_goal);
-        if (kinematic_constraint_set_->decide(work_state_, verbose).satisfied)
-          return true;
-      }
-    }
+    if (sampleGoal(constraint_sampler_.get(), default_sampler_.get(), work_state_, new_goal, attempts_so_far, verbose))
+      return true;
   }
   return false;
 }
@@ -39,7 +39,7 @@
 #include <moveit/profiler/profiler.h>
 
 ompl_interface::ValidConstrainedSampler::ValidConstrainedSampler(
-    const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetPtr& ks,
+    const ModelBasedPlanningContext* pc, const kinematic_constraints::KinematicConstraintSetConstPtr& ks,
     const constraint_samplers::ConstraintSamplerPtr& cs)
   : ob::ValidStateSampler(pc->getOMPLSimpleSetup()->getSpaceInformation().get())
   , planning_context_(pc)
@@ -0,0 +1,246 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/ompl_interface/detail/flat_constraint_approximation.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <ros/console.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+struct ompl_interface::FlatConstraintApproximation::Header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t signature_size;
+  uint64_t state_count;
+  uint64_t state_size;
+  uint64_t neighbor_count;
+  uint64_t motion_count;
+};
+
+namespace ompl_interface
+{
+namespace
+{
+static const char MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'C', 'A' };
+static const uint32_t VERSION = 1;
+
+std::size_t padded(std::size_t bytes)
+{
+  return (bytes + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+std::size_t getSignatureSize(uint64_t signature_size)
+{
+  return padded(signature_size * sizeof(int32_t));
+}
+
+bool motionTargetLess(const FlatConstraintApproximation::Motion& motion, uint64_t to)
+{
+  return motion.to < to;
+}
+}
+}
+
+ompl_interface::FlatConstraintApproximation::FlatConstraintApproximation(
+    const ConstraintApproximationStateStorage& storage)
+  : space_(storage.getStateSpace()), data_(NULL), size_(0), header_(NULL)
+{
+  std::vector<int> signature;
+  space_->computeSignature(signature);
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.signature_size = signature.size();
+  header.state_count = storage.size();
+  header.state_size = padded(space_->getSerializationLength());
+  header.neighbor_count = 0;
+  header.motion_count = 0;
+  for (std::size_t i = 0; i < storage.size(); ++i)
+  {
+    header.neighbor_count += storage.getMetadata(i).first.size();
+    header.motion_count += storage.getMetadata(i).second.size();
+  }
+
+  std::size_t size = getLayoutSize(header);
+  buffer_.resize(size / sizeof(uint64_t), 0);
+  char* data = reinterpret_cast<char*>(&buffer_[0]);
+  memcpy(data, &header, sizeof(Header));
+  int32_t* sig = reinterpret_cast<int32_t*>(data + sizeof(Header));
+  for (std::size_t i = 0; i < signature.size(); ++i)
+    sig[i] = signature[i];
+
+  char* states = data + sizeof(Header) + getSignatureSize(header.signature_size);
+  for (std::size_t i = 0; i < storage.size(); ++i)
+    space_->serialize(states + i * header.state_size, storage.getState(i));
+
+  uint64_t* neighbor_offsets = reinterpret_cast<uint64_t*>(states + header.state_count * header.state_size);
+  uint64_t* neighbors = neighbor_offsets + header.state_count + 1;
+  uint64_t* motion_offsets = neighbors + header.neighbor_count;
+  Motion* motions = reinterpret_cast<Motion*>(motion_offsets + header.state_count + 1);
+  neighbor_offsets[0] = 0;
+  motion_offsets[0] = 0;
+  for (std::size_t i = 0; i < storage.size(); ++i)
+  {
+    const ConstrainedStateMetadata& md = storage.getMetadata(i);
+    std::copy(md.first.begin(), md.first.end(), neighbors + neighbor_offsets[i]);
+    neighbor_offsets[i + 1] = neighbor_offsets[i] + md.first.size();
+
+    // the motions are ordered by their target state, since they come from a map
+    Motion* m = motions + motion_offsets[i];
+    for (std::map<std::size_t, std::pair<std::size_t, std::size_t> >::const_iterator it = md.second.begin();
+         it != md.second.end(); ++it, ++m)
+    {
+      m->to = it->first;
+      m->first = it->second.first;
+      m->last = it->second.second;
+    }
+    motion_offsets[i + 1] = motion_offsets[i] + md.second.size();
+  }
+
+  setPointers(data, size);
+}
+
+ompl_interface::FlatConstraintApproximation::FlatConstraintApproximation(const ompl::base::StateSpacePtr& space,
+                                                                         const std::string& filename)
+  : space_(space), filename_(filename), data_(NULL), size_(0), header_(NULL)
+{
+  try
+  {
+    file_.reset(new boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only));
+    region_.reset(new boost::interprocess::mapped_region(*file_, boost::interprocess::read_only));
+  }
+  catch (boost::interprocess::interprocess_exception& ex)
+  {
+    ROS_ERROR_NAMED("constraints_library", "Unable to map constraint approximation '%s': %s", filename.c_str(),
+                    ex.what());
+    region_.reset();
+    file_.reset();
+    return;
+  }
+
+  setPointers(static_cast<const char*>(region_->get_address()), region_->get_size());
+  if (!header_)
+  {
+    ROS_ERROR_NAMED("constraints_library", "File '%s' is not a constraint approximation for state space '%s'",
+                    filename.c_str(), space_->getName().c_str());
+    region_.reset();
+    file_.reset();
+  }
+}
+
+ompl_interface::FlatConstraintApproximation::~FlatConstraintApproximation()
+{
+}
+
+bool ompl_interface::FlatConstraintApproximation::isFlatFile(const std::string& filename)
+{
+  char magic[sizeof(MAGIC)];
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  return fin.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::size_t ompl_interface::FlatConstraintApproximation::getLayoutSize(const Header& header)
+{
+  return sizeof(Header) + getSignatureSize(header.signature_size) + header.state_count * header.state_size +
+         (header.state_count + 1 + header.neighbor_count) * sizeof(uint64_t) +
+         (header.state_count + 1) * sizeof(uint64_t) + header.motion_count * sizeof(Motion);
+}
+
+void ompl_interface::FlatConstraintApproximation::setPointers(const char* data, std::size_t size)
+{
+  header_ = NULL;
+  if (size < sizeof(Header))
+    return;
+  const Header* header = reinterpret_cast<const Header*>(data);
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION)
+    return;
+
+  // the file has to describe states of this space, and its size has to match the counts it claims
+  std::vector<int> signature;
+  space_->computeSignature(signature);
+  if (header->signature_size != signature.size() || header->state_size != padded(space_->getSerializationLength()) ||
+      header->state_count > size / header->state_size || header->neighbor_count > size ||
+      header->motion_count > size || size != getLayoutSize(*header))
+    return;
+  const int32_t* sig = reinterpret_cast<const int32_t*>(data + sizeof(Header));
+  for (std::size_t i = 0; i < signature.size(); ++i)
+    if (sig[i] != signature[i])
+      return;
+
+  state_size_ = header->state_size;
+  states_ = data + sizeof(Header) + getSignatureSize(header->signature_size);
+  neighbor_offsets_ = reinterpret_cast<const uint64_t*>(states_ + header->state_count * state_size_);
+  neighbors_ = neighbor_offsets_ + header->state_count + 1;
+  motion_offsets_ = neighbors_ + header->neighbor_count;
+  motions_ = reinterpret_cast<const Motion*>(motion_offsets_ + header->state_count + 1);
+  if (neighbor_offsets_[header->state_count] != header->neighbor_count ||
+      motion_offsets_[header->state_count] != header->motion_count)
+    return;
+
+  data_ = data;
+  size_ = size;
+  header_ = header;
+}
+
+bool ompl_interface::FlatConstraintApproximation::save(const std::string& filename) const
+{
+  if (!header_)
+    return false;
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  fout.write(data_, size_);
+  return fout.good();
+}
+
+std::size_t ompl_interface::FlatConstraintApproximation::getStateCount() const
+{
+  return header_ ? header_->state_count : 0;
+}
+
+std::size_t ompl_interface::FlatConstraintApproximation::getNeighborCount() const
+{
+  return header_ ? header_->neighbor_count : 0;
+}
+
+const ompl_interface::FlatConstraintApproximation::Motion*
+ompl_interface::FlatConstraintApproximation::findMotion(std::size_t from, std::size_t to) const
+{
+  const Motion* begin = motions_ + motion_offsets_[from];
+  const Motion* end = motions_ + motion_offsets_[from + 1];
+  const Motion* it = std::lower_bound(begin, end, to, &motionTargetLess);
+  return it != end && it->to == to ? it : NULL;
+}
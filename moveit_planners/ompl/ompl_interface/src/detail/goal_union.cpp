@@ -35,7 +35,7 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/ompl_interface/detail/goal_union.h>
-#include <ompl/base/goals/GoalLazySamples.h>
+#include <moveit/ompl_interface/detail/constrained_goal_sampler.h>
 
 namespace
 {
@@ -62,14 +62,14 @@ void ompl_interface::GoalSampleableRegionMux::startSampling()
 {
   for (std::size_t i = 0; i < goals_.size(); ++i)
     if (goals_[i]->hasType(ompl::base::GOAL_LAZY_SAMPLES))
-      static_cast<ompl::base::GoalLazySamples*>(goals_[i].get())->startSampling();
+      static_cast<ConstrainedGoalSampler*>(goals_[i].get())->startSampling();
 }
 
 void ompl_interface::GoalSampleableRegionMux::stopSampling()
 {
   for (std::size_t i = 0; i < goals_.size(); ++i)
     if (goals_[i]->hasType(ompl::base::GOAL_LAZY_SAMPLES))
-      static_cast<ompl::base::GoalLazySamples*>(goals_[i].get())->stopSampling();
+      static_cast<ConstrainedGoalSampler*>(goals_[i].get())->stopSampling();
 }
 
 void ompl_interface::GoalSampleableRegionMux::sampleGoal(ompl::base::State* st) const
@@ -0,0 +1,671 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/persistent_roadmap.h>
+#include <moveit/ompl_interface/detail/state_validity_checker.h>
+#include <moveit/ompl_interface/detail/validity_cache.h>
+#include <moveit/ompl_interface/model_based_planning_context.h>
+#include <geometric_shapes/bodies.h>
+#include <geometric_shapes/body_operations.h>
+#include <ompl/base/goals/GoalSampleableRegion.h>
+#include <ompl/datastructures/NearestNeighborsGNAT.h>
+#include <ompl/geometric/PathGeometric.h>
+#include <ompl/tools/config/SelfConfig.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <queue>
+
+namespace ompl_interface
+{
+namespace
+{
+const char ROADMAP_FILE_MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'R', 'M' };
+const uint32_t ROADMAP_FILE_VERSION = 1;
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream& in, T& value)
+{
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return in.good();
+}
+
+// bound the shape of a body by a sphere; fails for shapes without a finite extent
+bool computeBoundingSphere(const shapes::Shape* shape, const Eigen::Affine3d& pose, bodies::BoundingSphere& sphere)
+{
+  if (shape->type == shapes::PLANE || shape->type == shapes::OCTREE)
+    return false;
+  bodies::Body* body = bodies::createBodyFromShape(shape);
+  if (!body)
+    return false;
+  body->setPose(pose);
+  body->computeBoundingSphere(sphere);
+  delete body;
+  return true;
+}
+
+bool computeObjectBox(const collision_detection::World::Object& object, Eigen::AlignedBox3d& box)
+{
+  box.setEmpty();
+  for (std::size_t i = 0; i < object.shapes_.size(); ++i)
+  {
+    bodies::BoundingSphere sphere;
+    if (!computeBoundingSphere(object.shapes_[i].get(), object.shape_poses_[i], sphere))
+      return false;
+    box.extend(sphere.center - Eigen::Vector3d::Constant(sphere.radius));
+    box.extend(sphere.center + Eigen::Vector3d::Constant(sphere.radius));
+  }
+  return true;
+}
+
+bool intersectsAny(const Eigen::AlignedBox3d& box, const std::vector<Eigen::AlignedBox3d>& regions)
+{
+  for (std::size_t i = 0; i < regions.size(); ++i)
+    if (box.intersects(regions[i]))
+      return true;
+  return false;
+}
+}
+}
+
+ompl_interface::PersistentRoadmap::PersistentRoadmap(const ModelBasedStateSpacePtr& space)
+  : space_(space), nn_(new ompl::NearestNeighborsGNAT<std::size_t>()), scene_fingerprint_(0)
+{
+  nn_->setDistanceFunction(boost::bind(&PersistentRoadmap::distance, this, _1, _2));
+}
+
+ompl_interface::PersistentRoadmap::~PersistentRoadmap()
+{
+  clear();
+}
+
+void ompl_interface::PersistentRoadmap::clear()
+{
+  for (std::size_t i = 0; i < vertices_.size(); ++i)
+    space_->freeState(vertices_[i].state);
+  vertices_.clear();
+  edges_.clear();
+  nn_->clear();
+}
+
+double ompl_interface::PersistentRoadmap::distance(std::size_t a, std::size_t b) const
+{
+  return space_->distance(vertices_[a].state, vertices_[b].state);
+}
+
+void ompl_interface::PersistentRoadmap::synchronize(const planning_scene::PlanningScene& scene,
+                                                    const robot_state::RobotState& start_state,
+                                                    const moveit_msgs::Constraints& path_constraints)
+{
+  // everything but the collision objects has to stay the same for the validity information to be kept
+  uint64_t fingerprint = ValidityCache::computeSceneFingerprint(
+      scene, start_state, space_->getJointModelGroup()->getName(), path_constraints, false);
+  bool reset = fingerprint == 0 || fingerprint != scene_fingerprint_;
+
+  // find the regions of the collision objects that were added, moved or removed
+  std::vector<Eigen::AlignedBox3d> changed;
+  std::map<std::string, std::pair<uint64_t, Eigen::AlignedBox3d> > objects;
+  const collision_detection::WorldConstPtr& world = scene.getWorld();
+  for (collision_detection::World::const_iterator it = world->begin(); it != world->end(); ++it)
+  {
+    std::pair<uint64_t, Eigen::AlignedBox3d>& object = objects[it->first];
+    object.first = ValidityCache::computeObjectFingerprint(*it->second);
+    if (object.first == 0 || !computeObjectBox(*it->second, object.second))
+      reset = true;
+    std::map<std::string, std::pair<uint64_t, Eigen::AlignedBox3d> >::const_iterator previous =
+        objects_.find(it->first);
+    if (previous == objects_.end() || previous->second.first != object.first)
+    {
+      changed.push_back(object.second);
+      if (previous != objects_.end())
+        changed.push_back(previous->second.second);
+    }
+  }
+  for (std::map<std::string, std::pair<uint64_t, Eigen::AlignedBox3d> >::const_iterator it = objects_.begin();
+       it != objects_.end(); ++it)
+    if (objects.find(it->first) == objects.end())
+      changed.push_back(it->second.second);
+  objects_.swap(objects);
+  scene_fingerprint_ = fingerprint;
+
+  if (reset)
+  {
+    updateBodies(start_state);
+    clearValidity();
+  }
+  else if (!changed.empty())
+    invalidateRegions(changed);
+}
+
+void ompl_interface::PersistentRoadmap::updateBodies(const robot_state::RobotState& start_state)
+{
+  work_state_.reset(new robot_state::RobotState(start_state));
+  work_state_->update();
+  bodies_.clear();
+
+  const robot_model::JointModelGroup* group = space_->getJointModelGroup();
+  const std::vector<const robot_model::LinkModel*>& links = group->getUpdatedLinkModelsWithGeometry();
+  for (std::size_t i = 0; i < links.size(); ++i)
+  {
+    Body body;
+    body.link = links[i];
+    body.attached_body = NULL;
+    body.shape = 0;
+    body.center = links[i]->getCenteredBoundingBoxOffset();
+    body.radius = 0.5 * links[i]->getShapeExtentsAtOrigin().norm();
+    bodies_.push_back(body);
+  }
+
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  work_state_->getAttachedBodies(attached_bodies);
+  for (std::size_t i = 0; i < attached_bodies.size(); ++i)
+  {
+    if (!group->isLinkUpdated(attached_bodies[i]->getAttachedLinkName()))
+      continue;
+    const std::vector<shapes::ShapeConstPtr>& shapes = attached_bodies[i]->getShapes();
+    for (std::size_t j = 0; j < shapes.size(); ++j)
+    {
+      bodies::BoundingSphere sphere;
+      if (!computeBoundingSphere(shapes[j].get(), Eigen::Affine3d::Identity(), sphere))
+        continue;
+      Body body;
+      body.link = NULL;
+      body.attached_body = attached_bodies[i];
+      body.shape = j;
+      body.center = sphere.center;
+      body.radius = sphere.radius;
+      bodies_.push_back(body);
+    }
+  }
+}
+
+void ompl_interface::PersistentRoadmap::computeCenters(Vertex& vertex)
+{
+  if (!work_state_)
+    return;
+  space_->copyToRobotState(*work_state_, vertex.state);
+  vertex.centers.resize(bodies_.size());
+  for (std::size_t i = 0; i < bodies_.size(); ++i)
+    if (bodies_[i].link)
+      vertex.centers[i] = work_state_->getGlobalLinkTransform(bodies_[i].link) * bodies_[i].center;
+    else
+      vertex.centers[i] =
+          bodies_[i].attached_body->getGlobalCollisionBodyTransforms()[bodies_[i].shape] * bodies_[i].center;
+}
+
+bool ompl_interface::PersistentRoadmap::getVertexBox(const Vertex& vertex, Eigen::AlignedBox3d& box) const
+{
+  if (vertex.centers.size() != bodies_.size())
+    return false;
+  box.setEmpty();
+  for (std::size_t i = 0; i < bodies_.size(); ++i)
+  {
+    box.extend(vertex.centers[i] - Eigen::Vector3d::Constant(bodies_[i].radius));
+    box.extend(vertex.centers[i] + Eigen::Vector3d::Constant(bodies_[i].radius));
+  }
+  return true;
+}
+
+bool ompl_interface::PersistentRoadmap::getEdgeBox(const Edge& edge, Eigen::AlignedBox3d& box) const
+{
+  const Vertex& from = vertices_[edge.from];
+  const Vertex& to = vertices_[edge.to];
+  Eigen::AlignedBox3d to_box;
+  if (!getVertexBox(from, box) || !getVertexBox(to, to_box))
+    return false;
+  box.extend(to_box);
+
+  // bodies move on arcs between the end points of an edge; padding by half the largest displacement covers arcs of up
+  // to half a turn
+  double displacement = 0.0;
+  for (std::size_t i = 0; i < bodies_.size(); ++i)
+    displacement = std::max(displacement, (from.centers[i] - to.centers[i]).norm());
+  Eigen::Vector3d padding = Eigen::Vector3d::Constant(0.5 * displacement);
+  box.extend(box.min() - padding);
+  box.extend(box.max() + padding);
+  return true;
+}
+
+void ompl_interface::PersistentRoadmap::invalidateRegions(const std::vector<Eigen::AlignedBox3d>& regions)
+{
+  std::size_t vertex_count = 0;
+  std::size_t edge_count = 0;
+  Eigen::AlignedBox3d box;
+  for (std::size_t i = 0; i < vertices_.size(); ++i)
+    if (vertices_[i].validity != VALIDITY_UNKNOWN && (!getVertexBox(vertices_[i], box) || intersectsAny(box, regions)))
+    {
+      vertices_[i].validity = VALIDITY_UNKNOWN;
+      ++vertex_count;
+    }
+  for (std::size_t i = 0; i < edges_.size(); ++i)
+    if (edges_[i].validity != VALIDITY_UNKNOWN && (!getEdgeBox(edges_[i], box) || intersectsAny(box, regions)))
+    {
+      edges_[i].validity = VALIDITY_UNKNOWN;
+      ++edge_count;
+    }
+  ROS_DEBUG_NAMED("persistent_roadmap", "%lu changed regions of the scene affect %lu of %lu vertices and %lu of %lu "
+                                        "edges",
+                  regions.size(), vertex_count, vertices_.size(), edge_count, edges_.size());
+}
+
+void ompl_interface::PersistentRoadmap::clearValidity()
+{
+  for (std::size_t i = 0; i < vertices_.size(); ++i)
+  {
+    vertices_[i].validity = VALIDITY_UNKNOWN;
+    vertices_[i].centers.clear();
+  }
+  for (std::size_t i = 0; i < edges_.size(); ++i)
+    edges_[i].validity = VALIDITY_UNKNOWN;
+}
+
+std::size_t ompl_interface::PersistentRoadmap::addVertex(const ompl::base::State* state, double max_distance,
+                                                          unsigned int max_neighbors)
+{
+  std::size_t index = vertices_.size();
+  vertices_.resize(index + 1);
+  Vertex& vertex = vertices_.back();
+  vertex.state = space_->allocState();
+  space_->copyState(vertex.state, state);
+  vertex.validity = VALIDITY_UNKNOWN;
+
+  std::vector<std::size_t> neighbors;
+  if (nn_->size() > 0)
+    nn_->nearestK(index, std::max(1u, max_neighbors), neighbors);
+
+  // states that are already part of the roadmap (repeated start or goal states) are not added again
+  if (!neighbors.empty() && distance(index, neighbors[0]) <= std::numeric_limits<double>::epsilon())
+  {
+    space_->freeState(vertex.state);
+    vertices_.pop_back();
+    return neighbors[0];
+  }
+
+  for (std::size_t i = 0; i < neighbors.size(); ++i)
+  {
+    double d = distance(index, neighbors[i]);
+    if (d <= max_distance)
+      addEdge(index, neighbors[i], d);
+  }
+  nn_->add(index);
+  return index;
+}
+
+void ompl_interface::PersistentRoadmap::addEdge(std::size_t from, std::size_t to, double length)
+{
+  Edge edge;
+  edge.from = from;
+  edge.to = to;
+  edge.length = length;
+  edge.validity = VALIDITY_UNKNOWN;
+  vertices_[from].edges.push_back(edges_.size());
+  vertices_[to].edges.push_back(edges_.size());
+  edges_.push_back(edge);
+}
+
+std::size_t ompl_interface::PersistentRoadmap::findEdge(std::size_t from, std::size_t to) const
+{
+  const std::vector<std::size_t>& edges = vertices_[from].edges;
+  for (std::size_t i = 0; i < edges.size(); ++i)
+    if ((edges_[edges[i]].from == from && edges_[edges[i]].to == to) ||
+        (edges_[edges[i]].from == to && edges_[edges[i]].to == from))
+      return edges[i];
+  return edges_.size();
+}
+
+bool ompl_interface::PersistentRoadmap::searchPath(const std::vector<std::size_t>& starts,
+                                                   const std::vector<std::size_t>& goals,
+                                                   std::vector<std::size_t>& path) const
+{
+  path.clear();
+  if (starts.empty() || goals.empty())
+    return false;
+
+  // A* with the distance to the closest goal as heuristic
+  const std::size_t count = vertices_.size();
+  std::vector<bool> is_goal(count, false);
+  for (std::size_t i = 0; i < goals.size(); ++i)
+    is_goal[goals[i]] = true;
+  std::vector<double> heuristic(count, -1.0);
+  std::vector<double> cost(count, std::numeric_limits<double>::infinity());
+  std::vector<std::size_t> parent(count, count);
+  std::vector<bool> closed(count, false);
+
+  typedef std::pair<double, std::size_t> QueueEntry;
+  std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > queue;
+  for (std::size_t i = 0; i < starts.size(); ++i)
+    if (vertices_[starts[i]].validity != VALIDITY_INVALID)
+    {
+      cost[starts[i]] = 0.0;
+      queue.push(QueueEntry(0.0, starts[i]));
+    }
+
+  while (!queue.empty())
+  {
+    std::size_t v = queue.top().second;
+    queue.pop();
+    if (closed[v])
+      continue;
+    closed[v] = true;
+
+    if (is_goal[v])
+    {
+      for (std::size_t u = v; u != count; u = parent[u])
+        path.push_back(u);
+      std::reverse(path.begin(), path.end());
+      return true;
+    }
+
+    const std::vector<std::size_t>& edges = vertices_[v].edges;
+    for (std::size_t i = 0; i < edges.size(); ++i)
+    {
+      const Edge& edge = edges_[edges[i]];
+      std::size_t w = edge.from == v ? edge.to : edge.from;
+      if (edge.validity == VALIDITY_INVALID || vertices_[w].validity == VALIDITY_INVALID || closed[w])
+        continue;
+      double c = cost[v] + edge.length;
+      if (c < cost[w])
+      {
+        cost[w] = c;
+        parent[w] = v;
+        if (heuristic[w] < 0.0)
+        {
+          heuristic[w] = std::numeric_limits<double>::infinity();
+          for (std::size_t k = 0; k < goals.size(); ++k)
+            heuristic[w] = std::min(heuristic[w], distance(w, goals[k]));
+        }
+        queue.push(QueueEntry(c + heuristic[w], w));
+      }
+    }
+  }
+  return false;
+}
+
+bool ompl_interface::PersistentRoadmap::validatePath(const ompl::base::SpaceInformationPtr& si,
+                                                     const std::vector<std::size_t>& path)
+{
+  // check the vertices first, they are cheaper than the edges
+  for (std::size_t i = 0; i < path.size(); ++i)
+  {
+    Vertex& vertex = vertices_[path[i]];
+    if (vertex.validity == VALIDITY_UNKNOWN)
+    {
+      vertex.validity = si->isValid(vertex.state) ? VALIDITY_VALID : VALIDITY_INVALID;
+      computeCenters(vertex);
+    }
+    if (vertex.validity == VALIDITY_INVALID)
+      return false;
+  }
+  for (std::size_t i = 1; i < path.size(); ++i)
+  {
+    Edge& edge = edges_[findEdge(path[i - 1], path[i])];
+    if (edge.validity == VALIDITY_UNKNOWN)
+      edge.validity =
+          si->checkMotion(vertices_[edge.from].state, vertices_[edge.to].state) ? VALIDITY_VALID : VALIDITY_INVALID;
+    if (edge.validity == VALIDITY_INVALID)
+      return false;
+  }
+  return true;
+}
+
+bool ompl_interface::PersistentRoadmap::save(const std::string& filename) const
+{
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out.good())
+    return false;
+
+  out.write(ROADMAP_FILE_MAGIC, sizeof(ROADMAP_FILE_MAGIC));
+  writeValue(out, ROADMAP_FILE_VERSION);
+  std::vector<int> signature;
+  space_->computeSignature(signature);
+  writeValue(out, static_cast<uint32_t>(signature.size()));
+  for (std::size_t i = 0; i < signature.size(); ++i)
+    writeValue(out, static_cast<int32_t>(signature[i]));
+
+  writeValue(out, static_cast<uint64_t>(vertices_.size()));
+  std::vector<char> buffer(space_->getSerializationLength());
+  for (std::size_t i = 0; i < vertices_.size(); ++i)
+  {
+    space_->serialize(&buffer[0], vertices_[i].state);
+    out.write(&buffer[0], buffer.size());
+  }
+
+  writeValue(out, static_cast<uint64_t>(edges_.size()));
+  for (std::size_t i = 0; i < edges_.size(); ++i)
+  {
+    writeValue(out, static_cast<uint64_t>(edges_[i].from));
+    writeValue(out, static_cast<uint64_t>(edges_[i].to));
+    writeValue(out, edges_[i].length);
+  }
+  return out.good();
+}
+
+bool ompl_interface::PersistentRoadmap::load(const std::string& filename)
+{
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  if (!in.good())
+    return false;
+
+  char magic[sizeof(ROADMAP_FILE_MAGIC)];
+  in.read(magic, sizeof(magic));
+  uint32_t version, signature_size;
+  if (!in.good() || !std::equal(magic, magic + sizeof(magic), ROADMAP_FILE_MAGIC) || !readValue(in, version) ||
+      version != ROADMAP_FILE_VERSION || !readValue(in, signature_size))
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "'%s' is not a roadmap file", filename.c_str());
+    return false;
+  }
+
+  std::vector<int> signature, file_signature(signature_size);
+  space_->computeSignature(signature);
+  for (std::size_t i = 0; i < file_signature.size(); ++i)
+  {
+    int32_t value;
+    if (!readValue(in, value))
+      return false;
+    file_signature[i] = value;
+  }
+  if (signature != file_signature)
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "The roadmap in '%s' was built for a different state space",
+                    filename.c_str());
+    return false;
+  }
+
+  clear();
+  uint64_t vertex_count, edge_count;
+  bool ok = readValue(in, vertex_count);
+  std::vector<char> buffer(space_->getSerializationLength());
+  std::vector<std::size_t> indices;
+  for (uint64_t i = 0; ok && i < vertex_count; ++i)
+  {
+    in.read(&buffer[0], buffer.size());
+    ok = in.good();
+    if (ok)
+    {
+      Vertex vertex;
+      vertex.state = space_->allocState();
+      space_->deserialize(vertex.state, &buffer[0]);
+      vertex.validity = VALIDITY_UNKNOWN;
+      vertices_.push_back(vertex);
+      indices.push_back(i);
+    }
+  }
+  ok = ok && readValue(in, edge_count);
+  for (uint64_t i = 0; ok && i < edge_count; ++i)
+  {
+    uint64_t from, to;
+    double length;
+    ok = readValue(in, from) && readValue(in, to) && readValue(in, length) && from < vertex_count && to < vertex_count;
+    if (ok)
+      addEdge(from, to, length);
+  }
+  if (!ok)
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "The roadmap in '%s' is truncated", filename.c_str());
+    clear();
+    return false;
+  }
+
+  nn_->add(indices);
+  scene_fingerprint_ = 0;
+  objects_.clear();
+  return true;
+}
+
+ompl_interface::PersistentRoadmapPlanner::PersistentRoadmapPlanner(const ompl::base::SpaceInformationPtr& si,
+                                                                   const PersistentRoadmapPtr& roadmap)
+  : ompl::base::Planner(si, "PersistentLazyPRM"), roadmap_(roadmap), range_(0.0), max_neighbors_(10)
+{
+  specs_.recognizedGoal = ompl::base::GOAL_SAMPLEABLE_REGION;
+  specs_.approximateSolutions = false;
+  specs_.multithreaded = true;
+
+  declareParam<double>("range", this, &PersistentRoadmapPlanner::setRange, &PersistentRoadmapPlanner::getRange,
+                       "0.:1.:10000.");
+  declareParam<unsigned int>("max_nearest_neighbors", this, &PersistentRoadmapPlanner::setMaxNearestNeighbors,
+                             &PersistentRoadmapPlanner::getMaxNearestNeighbors, "1:1000");
+}
+
+void ompl_interface::PersistentRoadmapPlanner::setup()
+{
+  ompl::base::Planner::setup();
+  if (range_ < std::numeric_limits<double>::epsilon())
+  {
+    ompl::tools::SelfConfig sc(si_, getName());
+    sc.configurePlannerRange(range_);
+  }
+}
+
+void ompl_interface::PersistentRoadmapPlanner::clear()
+{
+  // the roadmap is kept; that is the point of this planner
+  ompl::base::Planner::clear();
+  sampler_.reset();
+}
+
+ompl::base::PlannerStatus
+ompl_interface::PersistentRoadmapPlanner::solve(const ompl::base::PlannerTerminationCondition& ptc)
+{
+  checkValidity();
+  ompl::base::GoalSampleableRegion* goal = dynamic_cast<ompl::base::GoalSampleableRegion*>(pdef_->getGoal().get());
+  if (!goal || !goal->couldSample())
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "%s: Insufficient states in sampleable goal region", getName().c_str());
+    return ompl::base::PlannerStatus::INVALID_GOAL;
+  }
+
+  boost::mutex::scoped_lock slock(roadmap_->getLock());
+
+  // bring the validity information up to date with the scene of this request
+  // results of checks for self collisions only must not be kept for later requests
+  const StateValidityChecker* svc = dynamic_cast<const StateValidityChecker*>(si_->getStateValidityChecker().get());
+  bool self_collision_only = svc && svc->isSelfCollisionOnly();
+  if (svc && !self_collision_only && svc->getPlanningContext()->getPlanningScene())
+  {
+    const ModelBasedPlanningContext* context = svc->getPlanningContext();
+    roadmap_->synchronize(*context->getPlanningScene(), context->getCompleteInitialRobotState(),
+                          context->getPathConstraintsMsg());
+  }
+  else
+    roadmap_->clearValidity();
+
+  std::vector<std::size_t> starts, goals;
+  while (const ompl::base::State* st = pis_.nextStart())
+    starts.push_back(roadmap_->addVertex(st, range_, max_neighbors_));
+  if (starts.empty())
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "%s: There are no valid initial states", getName().c_str());
+    return ompl::base::PlannerStatus::INVALID_START;
+  }
+  if (const ompl::base::State* st = pis_.nextGoal(ptc))
+    goals.push_back(roadmap_->addVertex(st, range_, max_neighbors_));
+  if (goals.empty())
+  {
+    ROS_ERROR_NAMED("persistent_roadmap", "%s: Unable to sample any valid states for goal tree", getName().c_str());
+    return ompl::base::PlannerStatus::INVALID_GOAL;
+  }
+
+  std::size_t initial_vertices = roadmap_->getVertexCount();
+  if (!sampler_)
+    sampler_ = si_->allocStateSampler();
+  ompl::base::State* sample = si_->allocState();
+  std::vector<std::size_t> path;
+  bool solved = false;
+  while (!ptc())
+  {
+    // use goal samples that became available in the meantime
+    if (goal->maxSampleCount() > goals.size())
+      if (const ompl::base::State* st = pis_.nextGoal())
+        goals.push_back(roadmap_->addVertex(st, range_, max_neighbors_));
+
+    if (roadmap_->searchPath(starts, goals, path))
+    {
+      // if the path is invalid, the parts found to be invalid are avoided by the next search
+      if (roadmap_->validatePath(si_, path))
+      {
+        solved = true;
+        break;
+      }
+      continue;
+    }
+
+    // the roadmap does not connect the start and goal yet
+    for (unsigned int i = 0; i < max_neighbors_ && !ptc(); ++i)
+    {
+      sampler_->sampleUniform(sample);
+      roadmap_->addVertex(sample, range_, max_neighbors_);
+    }
+  }
+  si_->freeState(sample);
+  if (self_collision_only)
+    roadmap_->clearValidity();
+
+  ROS_DEBUG_NAMED("persistent_roadmap", "%s: Roadmap has %lu vertices (%lu new) and %lu edges", getName().c_str(),
+                  roadmap_->getVertexCount(), roadmap_->getVertexCount() - initial_vertices,
+                  roadmap_->getEdgeCount());
+  if (!solved)
+    return ompl::base::PlannerStatus::TIMEOUT;
+
+  ompl::geometric::PathGeometric* solution = new ompl::geometric::PathGeometric(si_);
+  for (std::size_t i = 0; i < path.size(); ++i)
+    solution->append(roadmap_->getState(path[i]));
+  pdef_->addSolutionPath(ompl::base::PathPtr(solution), false, 0.0, getName());
+  return ompl::base::PlannerStatus::EXACT_SOLUTION;
+}
@@ -0,0 +1,114 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/ompl_interface/detail/projected_interpolation.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+ompl_interface::ProjectedInterpolation::ProjectedInterpolation(const planning_scene::PlanningSceneConstPtr& scene,
+                                                               const ModelBasedStateSpacePtr& space,
+                                                               const robot_state::RobotState& start_state,
+                                                               const moveit_msgs::Constraints& constr)
+  : scene_(scene), space_(space), start_state_(start_state), constraints_(constr), valid_(false)
+{
+  // the first work data also tells whether the constraints can be projected onto
+  WorkData* data = acquireWorkData();
+  valid_ = data->sampler_->isValid();
+  releaseWorkData(data);
+}
+
+ompl_interface::ProjectedInterpolation::~ProjectedInterpolation()
+{
+  for (std::size_t i = 0; i < spare_work_data_.size(); ++i)
+    delete spare_work_data_[i];
+}
+
+ompl_interface::ProjectedInterpolation::WorkData* ompl_interface::ProjectedInterpolation::acquireWorkData() const
+{
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (!spare_work_data_.empty())
+    {
+      WorkData* data = spare_work_data_.back();
+      spare_work_data_.pop_back();
+      return data;
+    }
+  }
+
+  // samplers keep state between calls, so every thread that interpolates at the same time needs its own
+  WorkData* data = new WorkData(start_state_);
+  data->sampler_.reset(new constraint_samplers::ProjectionConstraintSampler(scene_, space_->getJointModelGroupName()));
+  data->sampler_->configure(constraints_);
+  data->values_.resize(space_->getJointModelGroup()->getVariableCount());
+  return data;
+}
+
+void ompl_interface::ProjectedInterpolation::releaseWorkData(WorkData* data) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  spare_work_data_.push_back(data);
+}
+
+bool ompl_interface::ProjectedInterpolation::interpolate(const ompl::base::State* from, const ompl::base::State* to,
+                                                         const double t, ompl::base::State* state) const
+{
+  if (!valid_ || t <= 0.0 || t >= 1.0)
+    return false;
+
+  const robot_model::JointModelGroup* jmg = space_->getJointModelGroup();
+  const double* from_values = from->as<ModelBasedStateSpace::StateType>()->values;
+  const double* to_values = to->as<ModelBasedStateSpace::StateType>()->values;
+  double* values = state->as<ModelBasedStateSpace::StateType>()->values;
+
+  WorkData* data = acquireWorkData();
+  jmg->interpolate(from_values, to_values, t, &data->values_[0]);
+  data->state_.setJointGroupPositions(jmg, data->values_);
+  if (data->sampler_->project(data->state_, 1))
+  {
+    std::vector<double> projected;
+    data->state_.copyJointGroupPositions(jmg, projected);
+    // a projection that jumps to another part of the manifold does not describe the motion
+    if (jmg->distance(&projected[0], &data->values_[0]) <= jmg->distance(from_values, to_values))
+      data->values_.swap(projected);
+  }
+  std::copy(data->values_.begin(), data->values_.end(), values);
+  releaseWorkData(data);
+  return true;
+}
+
+ompl_interface::InterpolationFunction
+ompl_interface::ProjectedInterpolation::getInterpolationFunction(const ProjectedInterpolationPtr& interpolation)
+{
+  return boost::bind(&ProjectedInterpolation::interpolate, interpolation, _1, _2, _3, _4);
+}
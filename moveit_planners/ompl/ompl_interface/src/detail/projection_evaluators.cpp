@@ -63,10 +63,14 @@ void ompl_interface::ProjectionEvaluatorLinkPose::defaultCellSizes()
 void ompl_interface::ProjectionEvaluatorLinkPose::project(const ompl::base::State* state,
                                                           OMPLProjection projection) const
 {
+  // only the chain of link_ is needed, so skip the complete FK and collision body update of copyToRobotState()
   robot_state::RobotState* s = tss_.getStateStorage();
-  planning_context_->getOMPLStateSpace()->copyToRobotState(*s, state);
+  s->setJointGroupPositions(planning_context_->getJointModelGroup(),
+                            state->as<ModelBasedStateSpace::StateType>()->values);
 
-  const Eigen::Vector3d& o = s->getGlobalLinkTransform(link_).translation();
+  Eigen::Affine3d link_transform;
+  s->computeGlobalLinkTransform(link_, link_transform);
+  const Eigen::Vector3d& o = link_transform.translation();
   projection(0) = o.x();
   projection(1) = o.y();
   projection(2) = o.z();
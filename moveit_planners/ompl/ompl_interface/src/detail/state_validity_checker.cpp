@@ -45,7 +45,12 @@ ompl_interface::StateValidityChecker::StateValidityChecker(const ModelBasedPlann
   , group_name_(pc->getGroupName())
   , tss_(pc->getCompleteInitialRobotState())
   , verbose_(false)
+  , self_collision_only_(false)
+  , validity_cache_fingerprint_(pc->getValidityCacheFingerprint())
+  , variable_count_(pc->getJointModelGroup()->getVariableCount())
 {
+  if (validity_cache_fingerprint_)
+    validity_cache_ = pc->getValidityCache();
   specs_.clearanceComputationType = ompl::base::StateValidityCheckerSpecs::APPROXIMATE;
   specs_.hasValidDirectionComputation = false;
 
@@ -61,6 +66,29 @@ ompl_interface::StateValidityChecker::StateValidityChecker(const ModelBasedPlann
 
   collision_request_with_distance_verbose_ = collision_request_with_distance_;
   collision_request_with_distance_verbose_.verbose = true;
+
+  boolean_collision_request_.group = pc->getJointModelGroup();
+}
+
+bool ompl_interface::StateValidityChecker::isCollisionFree(const robot_state::RobotState& kstate, bool self_only,
+                                                           bool verbose) const
+{
+  // verbose checks report the contacts; otherwise, the lean boolean query is enough
+  if (verbose)
+  {
+    collision_detection::CollisionResult res;
+    if (self_only)
+      planning_context_->getPlanningScene()->checkSelfCollision(collision_request_simple_verbose_, res, kstate);
+    else
+      planning_context_->getPlanningScene()->checkCollision(collision_request_simple_verbose_, res, kstate);
+    return !res.collision;
+  }
+  collision_detection::BooleanCollisionResult res;
+  if (self_only)
+    planning_context_->getPlanningScene()->checkSelfCollision(boolean_collision_request_, res, kstate);
+  else
+    planning_context_->getPlanningScene()->checkCollision(boolean_collision_request_, res, kstate);
+  return !res.collision;
 }
 
 void ompl_interface::StateValidityChecker::setVerbose(bool flag)
@@ -68,9 +96,34 @@ void ompl_interface::StateValidityChecker::setVerbose(bool flag)
   verbose_ = flag;
 }
 
+void ompl_interface::StateValidityChecker::reserveThreadStates(unsigned int thread_count)
+{
+  tss_.reserve(thread_count);
+}
+
 bool ompl_interface::StateValidityChecker::isValid(const ompl::base::State* state, bool verbose) const
 {
   //  moveit::Profiler::ScopedBlock sblock("isValid");
+  if (self_collision_only_)
+    return isValidSelfCollisionOnly(state, NULL, verbose);
+
+  // verbose checks are meant to report the reason a state is invalid, so they are always computed
+  if (!validity_cache_ || verbose)
+    return isValidUncached(state, verbose);
+
+  uint64_t key = validity_cache_->getStateKey(validity_cache_fingerprint_,
+                                              state->as<ModelBasedStateSpace::StateType>()->values, variable_count_);
+  bool valid;
+  if (!validity_cache_->lookup(key, valid))
+  {
+    valid = isValidUncached(state, verbose);
+    validity_cache_->store(key, valid);
+  }
+  return valid;
+}
+
+bool ompl_interface::StateValidityChecker::isValidUncached(const ompl::base::State* state, bool verbose) const
+{
   return planning_context_->useStateValidityCache() ? isValidWithCache(state, verbose) :
                                                       isValidWithoutCache(state, verbose);
 }
@@ -78,10 +131,58 @@ bool ompl_interface::StateValidityChecker::isValid(const ompl::base::State* stat
 bool ompl_interface::StateValidityChecker::isValid(const ompl::base::State* state, double& dist, bool verbose) const
 {
   //  moveit::Profiler::ScopedBlock sblock("isValid");
+  if (self_collision_only_)
+    return isValidSelfCollisionOnly(state, &dist, verbose);
   return planning_context_->useStateValidityCache() ? isValidWithCache(state, dist, verbose) :
                                                       isValidWithoutCache(state, dist, verbose);
 }
 
+bool ompl_interface::StateValidityChecker::isValidSelfCollisionOnly(const ompl::base::State* state, double* dist,
+                                                                    bool verbose) const
+{
+  if (!si_->satisfiesBounds(state))
+  {
+    if (verbose)
+      ROS_INFO_NAMED("state_validity_checker", "State outside bounds");
+    if (dist)
+      *dist = 0.0;
+    return false;
+  }
+
+  robot_state::RobotState* kstate = tss_.getStateStorage();
+  planning_context_->getOMPLStateSpace()->copyToRobotState(*kstate, state);
+
+  // check path constraints
+  const kinematic_constraints::KinematicConstraintSetConstPtr& kset = planning_context_->getPathConstraints();
+  if (kset)
+  {
+    kinematic_constraints::ConstraintEvaluationResult cer = kset->decide(*kstate, verbose);
+    if (!cer.satisfied)
+    {
+      if (dist)
+        *dist = cer.distance;
+      return false;
+    }
+  }
+
+  // check feasibility
+  if (!planning_context_->getPlanningScene()->isStateFeasible(*kstate, verbose))
+  {
+    if (dist)
+      *dist = 0.0;
+    return false;
+  }
+
+  // check self collisions only
+  if (!dist)
+    return isCollisionFree(*kstate, true, verbose);
+  collision_detection::CollisionResult res;
+  planning_context_->getPlanningScene()->checkSelfCollision(
+      verbose ? collision_request_with_distance_verbose_ : collision_request_with_distance_, res, *kstate);
+  *dist = res.distance;
+  return res.collision == false;
+}
+
 double ompl_interface::StateValidityChecker::cost(const ompl::base::State* state) const
 {
   double cost = 0.0;
@@ -125,7 +226,7 @@ bool ompl_interface::StateValidityChecker::isValidWithoutCache(const ompl::base:
   planning_context_->getOMPLStateSpace()->copyToRobotState(*kstate, state);
 
   // check path constraints
-  const kinematic_constraints::KinematicConstraintSetPtr& kset = planning_context_->getPathConstraints();
+  const kinematic_constraints::KinematicConstraintSetConstPtr& kset = planning_context_->getPathConstraints();
   if (kset && !kset->decide(*kstate, verbose).satisfied)
     return false;
 
@@ -134,10 +235,7 @@ bool ompl_interface::StateValidityChecker::isValidWithoutCache(const ompl::base:
     return false;
 
   // check collision avoidance
-  collision_detection::CollisionResult res;
-  planning_context_->getPlanningScene()->checkCollision(
-      verbose ? collision_request_simple_verbose_ : collision_request_simple_, res, *kstate);
-  return res.collision == false;
+  return isCollisionFree(*kstate, false, verbose);
 }
 
 bool ompl_interface::StateValidityChecker::isValidWithoutCache(const ompl::base::State* state, double& dist,
@@ -154,7 +252,7 @@ bool ompl_interface::StateValidityChecker::isValidWithoutCache(const ompl::base:
   planning_context_->getOMPLStateSpace()->copyToRobotState(*kstate, state);
 
   // check path constraints
-  const kinematic_constraints::KinematicConstraintSetPtr& kset = planning_context_->getPathConstraints();
+  const kinematic_constraints::KinematicConstraintSetConstPtr& kset = planning_context_->getPathConstraints();
   if (kset)
   {
     kinematic_constraints::ConstraintEvaluationResult cer = kset->decide(*kstate, verbose);
@@ -197,7 +295,7 @@ bool ompl_interface::StateValidityChecker::isValidWithCache(const ompl::base::St
   planning_context_->getOMPLStateSpace()->copyToRobotState(*kstate, state);
 
   // check path constraints
-  const kinematic_constraints::KinematicConstraintSetPtr& kset = planning_context_->getPathConstraints();
+  const kinematic_constraints::KinematicConstraintSetConstPtr& kset = planning_context_->getPathConstraints();
   if (kset && !kset->decide(*kstate, verbose).satisfied)
   {
     const_cast<ob::State*>(state)->as<ModelBasedStateSpace::StateType>()->markInvalid();
@@ -212,10 +310,7 @@ bool ompl_interface::StateValidityChecker::isValidWithCache(const ompl::base::St
   }
 
   // check collision avoidance
-  collision_detection::CollisionResult res;
-  planning_context_->getPlanningScene()->checkCollision(
-      verbose ? collision_request_simple_verbose_ : collision_request_simple_, res, *kstate);
-  if (res.collision == false)
+  if (isCollisionFree(*kstate, false, verbose))
   {
     const_cast<ob::State*>(state)->as<ModelBasedStateSpace::StateType>()->markValid();
     return true;
@@ -249,7 +344,7 @@ bool ompl_interface::StateValidityChecker::isValidWithCache(const ompl::base::St
   planning_context_->getOMPLStateSpace()->copyToRobotState(*kstate, state);
 
   // check path constraints
-  const kinematic_constraints::KinematicConstraintSetPtr& kset = planning_context_->getPathConstraints();
+  const kinematic_constraints::KinematicConstraintSetConstPtr& kset = planning_context_->getPathConstraints();
   if (kset)
   {
     kinematic_constraints::ConstraintEvaluationResult cer = kset->decide(*kstate, verbose);
@@ -35,13 +35,32 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/ompl_interface/detail/threadsafe_state_storage.h>
+#include <atomic>
 
-ompl_interface::TSStateStorage::TSStateStorage(const robot_model::RobotModelPtr& kmodel) : start_state_(kmodel)
+namespace
+{
+struct CachedStateStorage
+{
+  uint64_t id;
+  robot_state::RobotState* state;
+};
+
+// the states each thread got from the last few storages; ids start at 1, so the zero initialized entries never match
+const std::size_t THREAD_CACHE_SIZE = 4;
+thread_local CachedStateStorage thread_cache[THREAD_CACHE_SIZE];
+thread_local std::size_t thread_cache_next = 0;
+
+std::atomic<uint64_t> next_storage_id(1);
+}
+
+ompl_interface::TSStateStorage::TSStateStorage(const robot_model::RobotModelPtr& kmodel)
+  : start_state_(kmodel), id_(next_storage_id++)
 {
   start_state_.setToDefaultValues();
 }
 
-ompl_interface::TSStateStorage::TSStateStorage(const robot_state::RobotState& start_state) : start_state_(start_state)
+ompl_interface::TSStateStorage::TSStateStorage(const robot_state::RobotState& start_state)
+  : start_state_(start_state), id_(next_storage_id++)
 {
 }
 
@@ -50,17 +69,45 @@ ompl_interface::TSStateStorage::~TSStateStorage()
   for (std::map<boost::thread::id, robot_state::RobotState*>::iterator it = thread_states_.begin();
        it != thread_states_.end(); ++it)
     delete it->second;
+  for (std::size_t i = 0; i < spare_states_.size(); ++i)
+    delete spare_states_[i];
+}
+
+void ompl_interface::TSStateStorage::reserve(unsigned int thread_count)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  while (thread_states_.size() + spare_states_.size() < thread_count)
+    spare_states_.push_back(new robot_state::RobotState(start_state_));
 }
 
 robot_state::RobotState* ompl_interface::TSStateStorage::getStateStorage() const
+{
+  for (std::size_t i = 0; i < THREAD_CACHE_SIZE; ++i)
+    if (thread_cache[i].id == id_)
+      return thread_cache[i].state;
+
+  robot_state::RobotState* st = lookupStateStorage();
+  thread_cache[thread_cache_next].id = id_;
+  thread_cache[thread_cache_next].state = st;
+  thread_cache_next = (thread_cache_next + 1) % THREAD_CACHE_SIZE;
+  return st;
+}
+
+robot_state::RobotState* ompl_interface::TSStateStorage::lookupStateStorage() const
 {
   robot_state::RobotState* st = NULL;
-  boost::mutex::scoped_lock slock(lock_);  /// \todo use Thread Local Storage?
+  boost::mutex::scoped_lock slock(lock_);
   std::map<boost::thread::id, robot_state::RobotState*>::const_iterator it =
       thread_states_.find(boost::this_thread::get_id());
   if (it == thread_states_.end())
   {
-    st = new robot_state::RobotState(start_state_);
+    if (spare_states_.empty())
+      st = new robot_state::RobotState(start_state_);
+    else
+    {
+      st = spare_states_.back();
+      spare_states_.pop_back();
+    }
     thread_states_[boost::this_thread::get_id()] = st;
   }
   else
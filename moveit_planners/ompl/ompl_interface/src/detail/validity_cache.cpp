@@ -0,0 +1,379 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/validity_cache.h>
+#include <moveit/ompl_interface/parameterization/model_based_state_space.h>
+#include <geometric_shapes/shapes.h>
+#include <ros/serialization.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ompl_interface
+{
+namespace
+{
+// 64 bit FNV-1a; keys must not depend on the process, unlike pointer values or std::hash
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+void hashBytes(uint64_t& hash, const void* data, std::size_t size)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+}
+
+template <typename T>
+void hashValue(uint64_t& hash, const T& value)
+{
+  hashBytes(hash, &value, sizeof(value));
+}
+
+void hashString(uint64_t& hash, const std::string& value)
+{
+  hashValue(hash, value.size());
+  hashBytes(hash, value.data(), value.size());
+}
+
+void hashPose(uint64_t& hash, const Eigen::Affine3d& pose)
+{
+  hashBytes(hash, pose.matrix().data(), 16 * sizeof(double));
+}
+
+// returns false for shapes whose geometry can change without the shape being replaced
+bool hashShape(uint64_t& hash, const shapes::Shape* shape)
+{
+  hashValue(hash, static_cast<int>(shape->type));
+  switch (shape->type)
+  {
+    case shapes::SPHERE:
+      hashValue(hash, static_cast<const shapes::Sphere*>(shape)->radius);
+      break;
+    case shapes::CYLINDER:
+      hashValue(hash, static_cast<const shapes::Cylinder*>(shape)->radius);
+      hashValue(hash, static_cast<const shapes::Cylinder*>(shape)->length);
+      break;
+    case shapes::CONE:
+      hashValue(hash, static_cast<const shapes::Cone*>(shape)->radius);
+      hashValue(hash, static_cast<const shapes::Cone*>(shape)->length);
+      break;
+    case shapes::BOX:
+      hashBytes(hash, static_cast<const shapes::Box*>(shape)->size, 3 * sizeof(double));
+      break;
+    case shapes::PLANE:
+    {
+      const shapes::Plane* plane = static_cast<const shapes::Plane*>(shape);
+      hashValue(hash, plane->a);
+      hashValue(hash, plane->b);
+      hashValue(hash, plane->c);
+      hashValue(hash, plane->d);
+      break;
+    }
+    case shapes::MESH:
+    {
+      const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+      hashValue(hash, mesh->vertex_count);
+      hashValue(hash, mesh->triangle_count);
+      hashBytes(hash, mesh->vertices, 3 * mesh->vertex_count * sizeof(double));
+      hashBytes(hash, mesh->triangles, 3 * mesh->triangle_count * sizeof(unsigned int));
+      break;
+    }
+    default:
+      return false;
+  }
+  return true;
+}
+
+bool hashShapes(uint64_t& hash, const std::vector<shapes::ShapeConstPtr>& shapes,
+                const EigenSTL::vector_Affine3d& poses)
+{
+  hashValue(hash, shapes.size());
+  for (std::size_t i = 0; i < shapes.size(); ++i)
+  {
+    if (!hashShape(hash, shapes[i].get()))
+      return false;
+    hashPose(hash, poses[i]);
+  }
+  return true;
+}
+}
+
+ValidityCache::ValidityCache(std::size_t max_size, double resolution)
+  : resolution_(resolution), max_shard_generation_size_(std::max<std::size_t>(1, max_size / (2 * NUM_SHARDS)))
+{
+  hits_ = 0;
+  misses_ = 0;
+}
+
+uint64_t ValidityCache::computeSceneFingerprint(const planning_scene::PlanningScene& scene,
+                                                const robot_state::RobotState& start_state,
+                                                const std::string& group_name,
+                                                const moveit_msgs::Constraints& path_constraints,
+                                                bool include_world_objects)
+{
+  if (scene.getStateFeasibilityPredicate())
+    return 0;
+
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hashString(hash, group_name);
+
+  // the collision objects of the world
+  if (include_world_objects)
+  {
+    const collision_detection::WorldConstPtr& world = scene.getWorld();
+    for (collision_detection::World::const_iterator it = world->begin(); it != world->end(); ++it)
+    {
+      hashString(hash, it->first);
+      if (!hashShapes(hash, it->second->shapes_, it->second->shape_poses_))
+        return 0;
+    }
+  }
+
+  // the allowed collisions
+  const collision_detection::AllowedCollisionMatrix& acm = scene.getAllowedCollisionMatrix();
+  std::vector<std::string> names;
+  acm.getAllEntryNames(names);
+  for (std::size_t i = 0; i < names.size(); ++i)
+  {
+    hashString(hash, names[i]);
+    collision_detection::AllowedCollision::Type type;
+    if (acm.getDefaultEntry(names[i], type))
+    {
+      if (type == collision_detection::AllowedCollision::CONDITIONAL)
+        return 0;
+      hashValue(hash, static_cast<int>(type));
+    }
+    for (std::size_t j = i; j < names.size(); ++j)
+      if (acm.getEntry(names[i], names[j], type))
+      {
+        if (type == collision_detection::AllowedCollision::CONDITIONAL)
+          return 0;
+        hashValue(hash, j);
+        hashValue(hash, static_cast<int>(type));
+      }
+  }
+
+  // link padding and scaling
+  std::vector<moveit_msgs::LinkPadding> padding;
+  scene.getCollisionRobot()->getPadding(padding);
+  for (std::size_t i = 0; i < padding.size(); ++i)
+  {
+    hashString(hash, padding[i].link_name);
+    hashValue(hash, padding[i].padding);
+  }
+  std::vector<moveit_msgs::LinkScale> scale;
+  scene.getCollisionRobot()->getScale(scale);
+  for (std::size_t i = 0; i < scale.size(); ++i)
+  {
+    hashString(hash, scale[i].link_name);
+    hashValue(hash, scale[i].scale);
+  }
+
+  // the joints that are not planned for keep the values of the start state
+  const robot_model::JointModelGroup* group = start_state.getJointModelGroup(group_name);
+  std::vector<bool> in_group(start_state.getVariableCount(), false);
+  if (group)
+  {
+    const std::vector<int>& indices = group->getVariableIndexList();
+    for (std::size_t i = 0; i < indices.size(); ++i)
+      in_group[indices[i]] = true;
+  }
+  for (std::size_t i = 0; i < in_group.size(); ++i)
+    if (!in_group[i])
+      hashValue(hash, start_state.getVariablePosition(i));
+
+  std::vector<const robot_state::AttachedBody*> attached_bodies;
+  start_state.getAttachedBodies(attached_bodies);
+  for (std::size_t i = 0; i < attached_bodies.size(); ++i)
+  {
+    hashString(hash, attached_bodies[i]->getName());
+    hashString(hash, attached_bodies[i]->getAttachedLinkName());
+    if (!hashShapes(hash, attached_bodies[i]->getShapes(), attached_bodies[i]->getFixedTransforms()))
+      return 0;
+    const std::set<std::string>& touch_links = attached_bodies[i]->getTouchLinks();
+    for (std::set<std::string>::const_iterator it = touch_links.begin(); it != touch_links.end(); ++it)
+      hashString(hash, *it);
+  }
+
+  // the path constraints
+  uint32_t length = ros::serialization::serializationLength(path_constraints);
+  std::vector<uint8_t> buffer(length);
+  if (length > 0)
+  {
+    ros::serialization::OStream stream(&buffer[0], length);
+    ros::serialization::serialize(stream, path_constraints);
+    hashBytes(hash, &buffer[0], length);
+  }
+
+  // 0 marks scenes that cannot be cached
+  return hash == 0 ? 1 : hash;
+}
+
+uint64_t ValidityCache::computeObjectFingerprint(const collision_detection::World::Object& object)
+{
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hashString(hash, object.id_);
+  if (!hashShapes(hash, object.shapes_, object.shape_poses_))
+    return 0;
+  return hash == 0 ? 1 : hash;
+}
+
+uint64_t ValidityCache::getStateKey(uint64_t scene_fingerprint, const double* values, unsigned int count) const
+{
+  uint64_t hash = FNV_OFFSET_BASIS;
+  hashValue(hash, scene_fingerprint);
+  for (unsigned int i = 0; i < count; ++i)
+    hashValue(hash, static_cast<int64_t>(std::floor(values[i] / resolution_ + 0.5)));
+  return hash;
+}
+
+uint64_t ValidityCache::getMotionKey(uint64_t state_key1, uint64_t state_key2)
+{
+  uint64_t hash = FNV_OFFSET_BASIS;
+  static const char MOTION_TAG = 'm';
+  hashValue(hash, MOTION_TAG);
+  hashValue(hash, std::min(state_key1, state_key2));
+  hashValue(hash, std::max(state_key1, state_key2));
+  return hash;
+}
+
+bool ValidityCache::lookup(uint64_t key, bool& valid) const
+{
+  const Shard& shard = getShard(key);
+  boost::mutex::scoped_lock slock(shard.lock);
+  std::unordered_map<uint64_t, bool>::const_iterator it = shard.current.find(key);
+  if (it == shard.current.end())
+  {
+    it = shard.previous.find(key);
+    if (it == shard.previous.end())
+    {
+      ++misses_;
+      return false;
+    }
+  }
+  valid = it->second;
+  ++hits_;
+  return true;
+}
+
+void ValidityCache::store(uint64_t key, bool valid)
+{
+  Shard& shard = getShard(key);
+  boost::mutex::scoped_lock slock(shard.lock);
+  if (shard.current.size() >= max_shard_generation_size_)
+  {
+    shard.previous.swap(shard.current);
+    shard.current.clear();
+  }
+  shard.current[key] = valid;
+}
+
+void ValidityCache::clear()
+{
+  for (std::size_t i = 0; i < NUM_SHARDS; ++i)
+  {
+    boost::mutex::scoped_lock slock(shards_[i].lock);
+    shards_[i].current.clear();
+    shards_[i].previous.clear();
+  }
+}
+
+std::size_t ValidityCache::size() const
+{
+  std::size_t size = 0;
+  for (std::size_t i = 0; i < NUM_SHARDS; ++i)
+  {
+    boost::mutex::scoped_lock slock(shards_[i].lock);
+    size += shards_[i].current.size() + shards_[i].previous.size();
+  }
+  return size;
+}
+
+CachedMotionValidator::CachedMotionValidator(const ompl::base::SpaceInformationPtr& si, const ValidityCachePtr& cache,
+                                             uint64_t scene_fingerprint, unsigned int variable_count)
+  : ompl::base::DiscreteMotionValidator(si)
+  , cache_(cache)
+  , scene_fingerprint_(scene_fingerprint)
+  , variable_count_(variable_count)
+  , enabled_(true)
+{
+}
+
+uint64_t CachedMotionValidator::getMotionKey(const ompl::base::State* s1, const ompl::base::State* s2) const
+{
+  return ValidityCache::getMotionKey(
+      cache_->getStateKey(scene_fingerprint_, s1->as<ModelBasedStateSpace::StateType>()->values, variable_count_),
+      cache_->getStateKey(scene_fingerprint_, s2->as<ModelBasedStateSpace::StateType>()->values, variable_count_));
+}
+
+bool CachedMotionValidator::checkMotion(const ompl::base::State* s1, const ompl::base::State* s2) const
+{
+  if (!enabled_)
+    return ompl::base::DiscreteMotionValidator::checkMotion(s1, s2);
+  uint64_t key = getMotionKey(s1, s2);
+  bool valid;
+  if (cache_->lookup(key, valid))
+  {
+    if (valid)
+      valid_++;
+    else
+      invalid_++;
+    return valid;
+  }
+  valid = ompl::base::DiscreteMotionValidator::checkMotion(s1, s2);
+  cache_->store(key, valid);
+  return valid;
+}
+
+bool CachedMotionValidator::checkMotion(const ompl::base::State* s1, const ompl::base::State* s2,
+                                        std::pair<ompl::base::State*, double>& last_valid) const
+{
+  if (!enabled_)
+    return ompl::base::DiscreteMotionValidator::checkMotion(s1, s2, last_valid);
+
+  // the last valid state is not cached, so only valid motions are answered from the cache
+  uint64_t key = getMotionKey(s1, s2);
+  bool valid;
+  if (cache_->lookup(key, valid) && valid)
+  {
+    valid_++;
+    return true;
+  }
+  valid = ompl::base::DiscreteMotionValidator::checkMotion(s1, s2, last_valid);
+  cache_->store(key, valid);
+  return valid;
+}
+}
@@ -0,0 +1,247 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/experience_library.h>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+
+namespace ompl_interface
+{
+namespace
+{
+// state spaces are named after their group, followed by the parameterization type
+std::string getStateSpaceParameterization(const std::string& space_name, const std::string& group)
+{
+  if (space_name.size() > group.size() + 1 && space_name.compare(0, group.size(), group) == 0)
+    return space_name.substr(group.size() + 1);
+  return std::string();
+}
+}
+}
+
+ompl_interface::ExperienceLibrary::ExperienceLibrary(const PlanningContextManager& pcontext, std::size_t max_paths)
+  : context_manager_(pcontext), max_paths_(max_paths)
+{
+}
+
+void ompl_interface::ExperienceLibrary::loadExperience(const std::string& path)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  databases_.clear();
+  std::ifstream fin((path + "/manifest").c_str());
+  if (!fin.good())
+  {
+    ROS_WARN_NAMED("experience_library", "Manifest not found in folder '%s'. Not loading experience.", path.c_str());
+    return;
+  }
+
+  ROS_INFO_NAMED("experience_library", "Loading planning experience from '%s'...", path.c_str());
+
+  while (fin.good() && !fin.eof())
+  {
+    std::string group, state_space_parameterization, filename;
+    fin >> group;
+    if (fin.eof())
+      break;
+    fin >> state_space_parameterization;
+    if (fin.eof())
+      break;
+    fin >> filename;
+    const ModelBasedPlanningContextPtr& pc = context_manager_.getPlanningContext(group, state_space_parameterization);
+    if (!pc)
+    {
+      ROS_WARN_NAMED("experience_library", "Unable to load experience of type '%s' for group '%s'",
+                     state_space_parameterization.c_str(), group.c_str());
+      continue;
+    }
+
+    const ob::StateSpacePtr& space = pc->getOMPLSimpleSetup()->getStateSpace();
+    ExperienceDatabase& db = databases_[space->getName()];
+    db.group_ = group;
+    db.state_space_parameterization_ = state_space_parameterization;
+    db.filename_ = filename;
+    space->computeSignature(db.space_signature_);
+    db.storage_.reset(new ExperienceStateStorage(space));
+    db.storage_->load((path + "/" + filename).c_str());
+    db.paths_.clear();
+    for (std::size_t i = 0; i < db.storage_->size();)
+    {
+      std::size_t count = db.storage_->getMetadata(i).first;
+      if (count == 0)
+        ++i;
+      else
+      {
+        db.paths_.push_back(i);
+        i += count;
+      }
+    }
+    ROS_INFO_NAMED("experience_library", "Loaded %lu paths (%lu states) of type '%s' for group '%s'",
+                   db.paths_.size(), db.storage_->size(), state_space_parameterization.c_str(), group.c_str());
+  }
+  ROS_INFO_NAMED("experience_library", "Done loading planning experience.");
+}
+
+void ompl_interface::ExperienceLibrary::saveExperience(const std::string& path)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  ROS_INFO_NAMED("experience_library", "Saving planning experience for %u state spaces to '%s'",
+                 (unsigned int)databases_.size(), path.c_str());
+  try
+  {
+    boost::filesystem::create_directories(path);
+  }
+  catch (...)
+  {
+  }
+
+  std::ofstream fout((path + "/manifest").c_str());
+  if (fout.good())
+    for (std::map<std::string, ExperienceDatabase>::const_iterator it = databases_.begin(); it != databases_.end();
+         ++it)
+    {
+      fout << it->second.group_ << std::endl;
+      fout << it->second.state_space_parameterization_ << std::endl;
+      fout << it->second.filename_ << std::endl;
+      it->second.storage_->store((path + "/" + it->second.filename_).c_str());
+    }
+  else
+    ROS_ERROR_NAMED("experience_library", "Unable to save planning experience to '%s'", path.c_str());
+  fout.close();
+}
+
+void ompl_interface::ExperienceLibrary::printExperience(std::ostream& out) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  for (std::map<std::string, ExperienceDatabase>::const_iterator it = databases_.begin(); it != databases_.end(); ++it)
+  {
+    out << it->second.group_ << std::endl;
+    out << it->second.state_space_parameterization_ << std::endl;
+    out << it->second.paths_.size() << " paths, " << it->second.storage_->size() << " states" << std::endl;
+    out << it->second.filename_ << std::endl;
+  }
+}
+
+void ompl_interface::ExperienceLibrary::clearExperience()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  databases_.clear();
+}
+
+bool ompl_interface::ExperienceLibrary::addExperience(const ModelBasedPlanningContext& context,
+                                                      const og::PathGeometric& path, uint64_t scene_fingerprint)
+{
+  if (path.getStateCount() < 2)
+    return false;
+
+  const ob::StateSpacePtr& space = context.getOMPLSimpleSetup()->getStateSpace();
+  std::vector<int> signature;
+  space->computeSignature(signature);
+
+  boost::mutex::scoped_lock slock(lock_);
+  ExperienceDatabase& db = databases_[space->getName()];
+  if (!db.storage_)
+  {
+    db.group_ = context.getGroupName();
+    db.state_space_parameterization_ = getStateSpaceParameterization(space->getName(), db.group_);
+    db.filename_ = space->getName() + ".ompldb";
+    db.space_signature_ = signature;
+    db.storage_.reset(new ExperienceStateStorage(space));
+  }
+  else if (db.space_signature_ != signature)
+  {
+    ROS_WARN_NAMED("experience_library", "State space '%s' does not match the stored experience",
+                   space->getName().c_str());
+    return false;
+  }
+
+  if (db.paths_.size() >= max_paths_)
+  {
+    ROS_DEBUG_NAMED("experience_library", "Already storing %lu paths for '%s'. Not adding more.", db.paths_.size(),
+                    space->getName().c_str());
+    return false;
+  }
+
+  db.paths_.push_back(db.storage_->size());
+  db.storage_->addState(path.getState(0), ExperienceStateMetadata(path.getStateCount(), scene_fingerprint));
+  for (std::size_t i = 1; i < path.getStateCount(); ++i)
+    db.storage_->addState(path.getState(i), ExperienceStateMetadata(0, 0));
+  return true;
+}
+
+const ompl_interface::ExperienceLibrary::ExperienceDatabase*
+ompl_interface::ExperienceLibrary::findDatabase(const ModelBasedPlanningContext& context) const
+{
+  const ob::StateSpacePtr& space = context.getOMPLSimpleSetup()->getStateSpace();
+  std::map<std::string, ExperienceDatabase>::const_iterator it = databases_.find(space->getName());
+  if (it == databases_.end())
+    return NULL;
+  std::vector<int> signature;
+  space->computeSignature(signature);
+  return signature == it->second.space_signature_ ? &it->second : NULL;
+}
+
+void ompl_interface::ExperienceLibrary::getExperience(const ModelBasedPlanningContext& context, const ob::State* start,
+                                                      std::size_t count, std::vector<ExperiencePath>& paths) const
+{
+  paths.clear();
+  boost::mutex::scoped_lock slock(lock_);
+  const ExperienceDatabase* db = findDatabase(context);
+  if (!db)
+    return;
+
+  const ob::SpaceInformationPtr& si = context.getOMPLSimpleSetup()->getSpaceInformation();
+  std::vector<std::pair<double, std::size_t> > order(db->paths_.size());
+  for (std::size_t i = 0; i < db->paths_.size(); ++i)
+    order[i] = std::make_pair(si->distance(start, db->storage_->getState(db->paths_[i])), db->paths_[i]);
+  count = std::min(count, order.size());
+  std::partial_sort(order.begin(), order.begin() + count, order.end());
+
+  paths.resize(count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const ExperienceStateMetadata& md = db->storage_->getMetadata(order[i].second);
+    paths[i].path.reset(new og::PathGeometric(si));
+    for (std::size_t k = 0; k < md.first; ++k)
+      paths[i].path->append(db->storage_->getState(order[i].second + k));
+    paths[i].scene_fingerprint = md.second;
+    paths[i].distance = order[i].first;
+  }
+}
+
+std::size_t ompl_interface::ExperienceLibrary::getExperienceCount(const ModelBasedPlanningContext& context) const
+{
+  boost::mutex::scoped_lock slock(lock_);
+  const ExperienceDatabase* db = findDatabase(context);
+  return db ? db->paths_.size() : 0;
+}
@@ -35,24 +35,34 @@
 /* Author: Ioan Sucan */
 
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/thread.hpp>
 
 #include <moveit/ompl_interface/model_based_planning_context.h>
 #include <moveit/ompl_interface/detail/state_validity_checker.h>
 #include <moveit/ompl_interface/detail/constrained_sampler.h>
 #include <moveit/ompl_interface/detail/constrained_goal_sampler.h>
 #include <moveit/ompl_interface/detail/goal_union.h>
+#include <moveit/ompl_interface/detail/projected_interpolation.h>
 #include <moveit/ompl_interface/detail/projection_evaluators.h>
 #include <moveit/ompl_interface/constraints_library.h>
+#include <moveit/ompl_interface/experience_library.h>
 #include <moveit/kinematic_constraints/utils.h>
+#include <moveit/kinematic_constraints/constraint_set_cache.h>
+#include <moveit/constraint_samplers/projection_constraint_sampler.h>
 #include <moveit/profiler/profiler.h>
 #include <moveit/utils/lexical_casts.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <ros/serialization.h>
 
 #include <ompl/base/samplers/UniformValidStateSampler.h>
 #include <ompl/base/goals/GoalLazySamples.h>
 #include <ompl/tools/config/SelfConfig.h>
 #include <ompl/base/spaces/SE3StateSpace.h>
 #include <ompl/datastructures/PDF.h>
+#include <ompl/geometric/planners/rrt/RRTConnect.h>
+#include <ompl/base/PlannerTerminationCondition.h>
+#include <ompl/geometric/PathHybridization.h>
+#include <ompl/geometric/PathSimplifier.h>
 
 #include "ompl/base/objectives/PathLengthOptimizationObjective.h"
 #include "ompl/base/objectives/MechanicalWorkOptimizationObjective.h"
@@ -60,6 +70,109 @@
 #include "ompl/base/objectives/StateCostIntegralObjective.h"
 #include "ompl/base/objectives/MaximizeMinClearanceObjective.h"
 
+#include <cstdlib>
+
+namespace ompl_interface
+{
+namespace
+{
+// Tracks the best cost reported by the anytime planners of a portfolio, which would otherwise use up all the time
+class SolutionCostConvergence
+{
+public:
+  SolutionCostConvergence(double time, double improvement)
+    : time_(time), improvement_(improvement), have_cost_(false), best_cost_(0.0)
+  {
+  }
+
+  void report(const ob::Planner* /* planner */, const std::vector<const ob::State*>& /* states */,
+              const ob::Cost cost)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (have_cost_ && cost.value() >= best_cost_)
+      return;
+    if (!have_cost_ || best_cost_ - cost.value() > improvement_ * std::fabs(best_cost_))
+      last_improvement_ = ompl::time::now();
+    best_cost_ = cost.value();
+    have_cost_ = true;
+  }
+
+  bool hasConverged() const
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    return have_cost_ && ompl::time::seconds(ompl::time::now() - last_improvement_) > time_;
+  }
+
+private:
+  double time_;
+  double improvement_;
+  bool have_cost_;
+  double best_cost_;
+  ompl::time::point last_improvement_;
+  mutable boost::mutex lock_;
+};
+
+// messages have no comparison operators, so their serializations are compared
+template <typename T>
+bool sameMessage(const T& a, const T& b)
+{
+  uint32_t length = ros::serialization::serializationLength(a);
+  if (length != ros::serialization::serializationLength(b))
+    return false;
+  if (length == 0)
+    return true;
+  std::vector<uint8_t> buffer_a(length), buffer_b(length);
+  ros::serialization::OStream stream_a(&buffer_a[0], length);
+  ros::serialization::serialize(stream_a, a);
+  ros::serialization::OStream stream_b(&buffer_b[0], length);
+  ros::serialization::serialize(stream_b, b);
+  return buffer_a == buffer_b;
+}
+
+// frames that are not links of the robot may be collision objects, which move with the scene
+bool isRobotFrame(const robot_model::RobotModel& model, const std::string& frame)
+{
+  return frame.empty() || frame == model.getModelFrame() || model.hasLinkModel(frame);
+}
+
+// true if the constraints only differ in their values, and do not depend on the collision objects of the scene
+bool sameStructure(const robot_model::RobotModel& model, const moveit_msgs::Constraints& a,
+                   const moveit_msgs::Constraints& b)
+{
+  if (a.joint_constraints.size() != b.joint_constraints.size() ||
+      a.position_constraints.size() != b.position_constraints.size() ||
+      a.orientation_constraints.size() != b.orientation_constraints.size() || !a.visibility_constraints.empty() ||
+      !b.visibility_constraints.empty())
+    return false;
+  for (std::size_t i = 0; i < a.joint_constraints.size(); ++i)
+    if (a.joint_constraints[i].joint_name != b.joint_constraints[i].joint_name)
+      return false;
+  for (std::size_t i = 0; i < a.position_constraints.size(); ++i)
+  {
+    const moveit_msgs::PositionConstraint& pa = a.position_constraints[i];
+    const moveit_msgs::PositionConstraint& pb = b.position_constraints[i];
+    if (pa.link_name != pb.link_name || pa.header.frame_id != pb.header.frame_id ||
+        !isRobotFrame(model, pb.header.frame_id) ||
+        pa.constraint_region.meshes.size() != pb.constraint_region.meshes.size() ||
+        pa.constraint_region.primitives.size() != pb.constraint_region.primitives.size())
+      return false;
+    for (std::size_t j = 0; j < pa.constraint_region.primitives.size(); ++j)
+      if (pa.constraint_region.primitives[j].type != pb.constraint_region.primitives[j].type)
+        return false;
+  }
+  for (std::size_t i = 0; i < a.orientation_constraints.size(); ++i)
+  {
+    const moveit_msgs::OrientationConstraint& oa = a.orientation_constraints[i];
+    const moveit_msgs::OrientationConstraint& ob = b.orientation_constraints[i];
+    if (oa.link_name != ob.link_name || oa.header.frame_id != ob.header.frame_id ||
+        !isRobotFrame(model, ob.header.frame_id))
+      return false;
+  }
+  return true;
+}
+}
+}
+
 ompl_interface::ModelBasedPlanningContext::ModelBasedPlanningContext(const std::string& name,
                                                                      const ModelBasedPlanningContextSpecification& spec)
   : planning_interface::PlanningContext(name, spec.state_space_->getJointModelGroup()->getName())
@@ -72,13 +185,24 @@ ompl_interface::ModelBasedPlanningContext::ModelBasedPlanningContext(const std::
   , last_plan_time_(0.0)
   , last_simplify_time_(0.0)
   , max_goal_samples_(0)
+  , max_goal_sampling_threads_(1)
   , max_state_sampling_attempts_(0)
   , max_goal_sampling_attempts_(0)
   , max_planning_threads_(0)
   , max_solution_segment_length_(0.0)
   , minimum_waypoint_count_(0)
   , use_state_validity_cache_(true)
+  , validity_cache_fingerprint_(0)
+  , portfolio_convergence_time_(1.0)
+  , portfolio_convergence_improvement_(0.01)
+  , last_plan_from_experience_(false)
+  , lazy_collision_checking_(false)
+  , project_path_constraints_(false)
   , simplify_solutions_(true)
+  , simplification_chains_(1)
+  , hybridize_simplified_solutions_(false)
+  , configured_segment_length_(0.0)
+  , configured_fingerprint_(0)
 {
   complete_initial_robot_state_.update();
   ompl_simple_setup_->getStateSpace()->computeSignature(space_signature_);
@@ -190,7 +314,15 @@ ompl_interface::ModelBasedPlanningContext::allocPathConstrainedSampler(const omp
     }
 
     constraint_samplers::ConstraintSamplerPtr cs;
-    if (spec_.constraint_sampler_manager_)
+    if (project_path_constraints_)
+    {
+      // projection keeps the unconstrained joints random, unlike IK, which also samples the constrained poses
+      constraint_samplers::ProjectionConstraintSamplerAllocator projection;
+      const moveit_msgs::Constraints& constr = path_constraints_->getAllConstraints();
+      if (projection.canService(getPlanningScene(), getGroupName(), constr))
+        cs = projection.alloc(getPlanningScene(), getGroupName(), constr);
+    }
+    if (!cs && spec_.constraint_sampler_manager_)
       cs = spec_.constraint_sampler_manager_->selectSampler(getPlanningScene(), getGroupName(),
                                                             path_constraints_->getAllConstraints());
 
@@ -212,8 +344,21 @@ void ompl_interface::ModelBasedPlanningContext::configure()
   ompl::base::ScopedState<> ompl_start_state(spec_.state_space_);
   spec_.state_space_->copyToOMPLState(ompl_start_state.get(), getCompleteInitialRobotState());
   ompl_simple_setup_->setStartState(ompl_start_state);
+
+  // results stay valid across requests as long as the fingerprint matches
+  validity_cache_fingerprint_ = 0;
+  if (validity_cache_ && getPlanningScene())
+    validity_cache_fingerprint_ = ValidityCache::computeSceneFingerprint(
+        *getPlanningScene(), getCompleteInitialRobotState(), getGroupName(), path_constraints_msg_);
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  if (validity_cache_fingerprint_)
+    si->setMotionValidator(ob::MotionValidatorPtr(new CachedMotionValidator(
+        si, validity_cache_, validity_cache_fingerprint_, getJointModelGroup()->getVariableCount())));
+  else
+    si->setMotionValidator(ob::MotionValidatorPtr(new ob::DiscreteMotionValidator(si)));
   ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr(new StateValidityChecker(this)));
 
+  bool approximated = false;
   if (path_constraints_ && spec_.constraints_library_)
   {
     const ConstraintApproximationPtr& ca =
@@ -222,16 +367,136 @@ void ompl_interface::ModelBasedPlanningContext::configure()
     {
       getOMPLStateSpace()->setInterpolationFunction(ca->getInterpolationFunction());
       ROS_INFO_NAMED("model_based_planning_context", "Using precomputed interpolation states");
+      approximated = true;
     }
   }
 
   useConfig();
+
+  // the precomputed motions of an approximation already stay within the constraints
+  if (project_path_constraints_ && path_constraints_ && !approximated)
+  {
+    ProjectedInterpolationPtr interpolation(new ProjectedInterpolation(
+        getPlanningScene(), spec_.state_space_, getCompleteInitialRobotState(), path_constraints_msg_));
+    if (interpolation->isValid())
+    {
+      getOMPLStateSpace()->setInterpolationFunction(ProjectedInterpolation::getInterpolationFunction(interpolation));
+      ROS_DEBUG_NAMED("model_based_planning_context", "%s: Projecting interpolated states onto the path constraints",
+                      name_.c_str());
+    }
+  }
   if (ompl_simple_setup_->getGoal())
     ompl_simple_setup_->setup();
+
+  // remember what requests need to match to reuse this configuration; every goal must have its own sampler, and
+  // the path constraints must not refer to collision objects
+  configured_config_ = spec_.config_;
+  configured_portfolio_ = portfolio_;
+  configured_constraints_library_ = spec_.constraints_library_;
+  configured_validity_cache_ = validity_cache_;
+  configured_segment_length_ = max_solution_segment_length_;
+  configured_fingerprint_ = 0;
+  if (getPlanningScene() && !goal_samplers_.empty() && goal_samplers_.size() == request_.goal_constraints.size() &&
+      sameStructure(*getRobotModel(), path_constraints_msg_, path_constraints_msg_))
+    configured_fingerprint_ = ValidityCache::computeSceneFingerprint(
+        *getPlanningScene(), getCompleteInitialRobotState(), getGroupName(), path_constraints_msg_, false);
+}
+
+bool ompl_interface::ModelBasedPlanningContext::reconfigure(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                            const moveit_msgs::MotionPlanRequest& req,
+                                                            const robot_state::RobotState& start_state)
+{
+  if (!configured_fingerprint_ || !ompl_simple_setup_->getGoal() || configured_config_ != spec_.config_ ||
+      configured_constraints_library_ != spec_.constraints_library_ || configured_validity_cache_ != validity_cache_ ||
+      configured_segment_length_ != max_solution_segment_length_ || configured_portfolio_.size() != portfolio_.size())
+    return false;
+  for (std::size_t i = 0; i < portfolio_.size(); ++i)
+    if (configured_portfolio_[i].name != portfolio_[i].name || configured_portfolio_[i].config != portfolio_[i].config)
+      return false;
+
+  if (req.group_name != request_.group_name || req.goal_constraints.size() != goal_samplers_.size() ||
+      !sameMessage(req.workspace_parameters, request_.workspace_parameters) ||
+      !sameMessage(req.path_constraints, path_constraints_msg_))
+    return false;
+  std::vector<moveit_msgs::Constraints> goal_constraints(req.goal_constraints.size());
+  for (std::size_t i = 0; i < req.goal_constraints.size(); ++i)
+  {
+    if (!sameStructure(*getRobotModel(), request_.goal_constraints[i], req.goal_constraints[i]))
+      return false;
+    goal_constraints[i] = kinematic_constraints::mergeConstraints(req.goal_constraints[i], req.path_constraints);
+  }
+
+  // everything but the collision objects and the planned joints must be the same
+  if (ValidityCache::computeSceneFingerprint(*planning_scene, start_state, getGroupName(), req.path_constraints,
+                                             false) != configured_fingerprint_)
+    return false;
+  uint64_t validity_cache_fingerprint = 0;
+  if (validity_cache_)
+    validity_cache_fingerprint = ValidityCache::computeSceneFingerprint(*planning_scene, start_state, getGroupName(),
+                                                                        req.path_constraints);
+  // whether results are cached decides the type of motion validator
+  if ((validity_cache_fingerprint != 0) != (validity_cache_fingerprint_ != 0))
+    return false;
+
+  setPlanningScene(planning_scene);
+  setMotionPlanRequest(req);
+  setCompleteInitialState(start_state);
+  kinematic_constraints::KinematicConstraintSetCache& cache =
+      kinematic_constraints::KinematicConstraintSetCache::instance();
+  for (std::size_t i = 0; i < goal_samplers_.size(); ++i)
+  {
+    goal_constraints_[i] =
+        cache.getConstraintSet(getRobotModel(), goal_constraints[i], planning_scene->getTransforms());
+    if (!static_cast<ConstrainedGoalSampler*>(goal_samplers_[i].get())
+             ->reconfigure(goal_constraints[i], goal_constraints_[i]))
+    {
+      configured_fingerprint_ = 0;
+      return false;
+    }
+  }
+
+  ompl::base::ScopedState<> ompl_start_state(spec_.state_space_);
+  spec_.state_space_->copyToOMPLState(ompl_start_state.get(), getCompleteInitialRobotState());
+  ompl_simple_setup_->setStartState(ompl_start_state);
+
+  if (validity_cache_fingerprint != validity_cache_fingerprint_)
+  {
+    validity_cache_fingerprint_ = validity_cache_fingerprint;
+    static_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get())
+        ->setValidityCacheFingerprint(validity_cache_fingerprint_);
+    if (validity_cache_fingerprint_)
+      static_cast<CachedMotionValidator*>(ompl_simple_setup_->getSpaceInformation()->getMotionValidator().get())
+          ->setSceneFingerprint(validity_cache_fingerprint_);
+  }
+  return true;
 }
 
 void ompl_interface::ModelBasedPlanningContext::useConfig()
 {
+  // the planners of a portfolio are configured by their own configurations
+  portfolio_allocators_.clear();
+  for (std::size_t i = 0; i < portfolio_.size(); ++i)
+  {
+    ModelBasedPlanningContextSpecification member_spec = spec_;
+    member_spec.config_ = portfolio_[i].config;
+    std::map<std::string, std::string>::iterator type = member_spec.config_.find("type");
+    if (type == member_spec.config_.end())
+    {
+      ROS_WARN_NAMED("model_based_planning_context",
+                     "%s: Attribute 'type' not specified in portfolio planner configuration '%s'", name_.c_str(),
+                     portfolio_[i].name.c_str());
+      continue;
+    }
+    ConfiguredPlannerAllocator allocator = spec_.planner_selector_(type->second);
+    member_spec.config_.erase(type);
+    if (allocator)
+      portfolio_allocators_.push_back(boost::bind(allocator, _1, portfolio_[i].name, member_spec));
+  }
+
+  lazy_collision_checking_ = false;
+  project_path_constraints_ = false;
+  simplification_chains_ = 1;
+  hybridize_simplified_solutions_ = false;
   const std::map<std::string, std::string>& config = spec_.config_;
   if (config.empty())
     return;
@@ -270,6 +535,50 @@ void ompl_interface::ModelBasedPlanningContext::useConfig()
     cfg.erase(it);
   }
 
+  // the portfolio members were looked up by the context manager
+  portfolio_convergence_time_ = 1.0;
+  portfolio_convergence_improvement_ = 0.01;
+  cfg.erase("portfolio");
+  it = cfg.find("portfolio_convergence_time");
+  if (it != cfg.end())
+  {
+    portfolio_convergence_time_ = moveit::core::toDouble(it->second);
+    cfg.erase(it);
+  }
+  it = cfg.find("portfolio_convergence_improvement");
+  if (it != cfg.end())
+  {
+    portfolio_convergence_improvement_ = moveit::core::toDouble(it->second);
+    cfg.erase(it);
+  }
+
+  it = cfg.find("lazy_collision_checking");
+  if (it != cfg.end())
+  {
+    lazy_collision_checking_ = it->second == "1" || it->second == "true";
+    cfg.erase(it);
+  }
+
+  it = cfg.find("project_path_constraints");
+  if (it != cfg.end())
+  {
+    project_path_constraints_ = it->second == "1" || it->second == "true";
+    cfg.erase(it);
+  }
+
+  it = cfg.find("simplification_chains");
+  if (it != cfg.end())
+  {
+    simplification_chains_ = std::max(1, std::atoi(it->second.c_str()));
+    cfg.erase(it);
+  }
+  it = cfg.find("hybridize_simplified_solutions");
+  if (it != cfg.end())
+  {
+    hybridize_simplified_solutions_ = it->second == "1" || it->second == "true";
+    cfg.erase(it);
+  }
+
   if (cfg.empty())
     return;
 
@@ -319,7 +628,7 @@ void ompl_interface::ModelBasedPlanningContext::useConfig()
   it = cfg.find("type");
   if (it == cfg.end())
   {
-    if (name_ != getGroupName())
+    if (name_ != getGroupName() && portfolio_.empty())
       ROS_WARN_NAMED("model_based_planning_context", "%s: Attribute 'type' not specified in planner configuration",
                      name_.c_str());
   }
@@ -361,8 +670,67 @@ void ompl_interface::ModelBasedPlanningContext::setPlanningVolume(const moveit_m
 
 void ompl_interface::ModelBasedPlanningContext::simplifySolution(double timeout)
 {
-  ompl_simple_setup_->simplifySolution(timeout);
-  last_simplify_time_ = ompl_simple_setup_->getLastSimplificationTime();
+  if (simplification_chains_ <= 1 || !ompl_simple_setup_->haveSolutionPath())
+  {
+    ompl_simple_setup_->simplifySolution(timeout);
+    last_simplify_time_ = ompl_simple_setup_->getLastSimplificationTime();
+    return;
+  }
+
+  ompl::time::point start = ompl::time::now();
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  if (ompl_simple_setup_->getStateValidityChecker())
+    static_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get())
+        ->reserveThreadStates(simplification_chains_);
+
+  // every chain simplifies its own copy of the solution with its own simplifier, and so its own random numbers;
+  // the odd chains only shortcut, which often beats the full simplification on long paths with little free space
+  og::PathGeometric& solution = ompl_simple_setup_->getSolutionPath();
+  std::vector<og::PathGeometric> paths(simplification_chains_, solution);
+  ob::PlannerTerminationCondition ptc = ob::timedPlannerTerminationCondition(timeout);
+  boost::thread_group chains;
+  for (std::size_t i = 0; i < paths.size(); ++i)
+    chains.create_thread([&si, &ptc, &paths, i]() {
+      og::PathSimplifier simplifier(si);
+      if (i % 2 == 0)
+        simplifier.simplify(paths[i], ptc);
+      else
+      {
+        while (!ptc() && simplifier.shortcutPath(paths[i]))
+          ;
+        simplifier.reduceVertices(paths[i]);
+      }
+    });
+  chains.join_all();
+
+  const ob::OptimizationObjectivePtr& objective =
+      ompl_simple_setup_->getProblemDefinition()->getOptimizationObjective();
+  std::size_t best = 0;
+  for (std::size_t i = 1; i < paths.size(); ++i)
+    if (objective ? objective->isCostBetterThan(paths[i].cost(objective), paths[best].cost(objective)) :
+                    paths[i].length() < paths[best].length())
+      best = i;
+  solution = paths[best];
+
+  if (hybridize_simplified_solutions_)
+  {
+    og::PathHybridization hybridization(si);
+    for (std::size_t i = 0; i < paths.size(); ++i)
+      hybridization.recordPath(ob::PathPtr(new og::PathGeometric(paths[i])), false);
+    hybridization.computeHybridPath();
+    const ob::PathPtr& hybrid = hybridization.getHybridPath();
+    if (hybrid)
+    {
+      const og::PathGeometric& hybrid_path = static_cast<const og::PathGeometric&>(*hybrid);
+      if (objective ? objective->isCostBetterThan(hybrid_path.cost(objective), solution.cost(objective)) :
+                      hybrid_path.length() < solution.length())
+        solution = hybrid_path;
+    }
+  }
+
+  last_simplify_time_ = ompl::time::seconds(ompl::time::now() - start);
+  ROS_DEBUG_NAMED("model_based_planning_context", "%s: Kept the result of simplification chain %u of %u",
+                  name_.c_str(), (unsigned int)best, simplification_chains_);
 }
 
 void ompl_interface::ModelBasedPlanningContext::interpolateSolution()
@@ -436,6 +804,7 @@ ompl::base::GoalPtr ompl_interface::ModelBasedPlanningContext::constructGoal()
       goals.push_back(g);
     }
   }
+  goal_samplers_ = goals;
 
   if (!goals.empty())
     return goals.size() == 1 ? goals[0] : ompl::base::GoalPtr(new GoalSampleableRegionMux(goals));
@@ -460,6 +829,8 @@ void ompl_interface::ModelBasedPlanningContext::clear()
   ompl_simple_setup_->setStateValidityChecker(ob::StateValidityCheckerPtr());
   path_constraints_.reset();
   goal_constraints_.clear();
+  goal_samplers_.clear();
+  configured_fingerprint_ = 0;
   getOMPLStateSpace()->setInterpolationFunction(InterpolationFunction());
 }
 
@@ -467,8 +838,9 @@ bool ompl_interface::ModelBasedPlanningContext::setPathConstraints(const moveit_
                                                                    moveit_msgs::MoveItErrorCodes* error)
 {
   // ******************* set the path constraints to use
-  path_constraints_.reset(new kinematic_constraints::KinematicConstraintSet(getRobotModel()));
-  path_constraints_->add(path_constraints, getPlanningScene()->getTransforms());
+  // the set is shared with other contexts that plan with the same constraints, and is never modified
+  path_constraints_ = kinematic_constraints::KinematicConstraintSetCache::instance().getConstraintSet(
+      getRobotModel(), path_constraints, getPlanningScene()->getTransforms());
   path_constraints_msg_ = path_constraints;
 
   return true;
@@ -483,9 +855,9 @@ bool ompl_interface::ModelBasedPlanningContext::setGoalConstraints(
   for (std::size_t i = 0; i < goal_constraints.size(); ++i)
   {
     moveit_msgs::Constraints constr = kinematic_constraints::mergeConstraints(goal_constraints[i], path_constraints);
-    kinematic_constraints::KinematicConstraintSetPtr kset(
-        new kinematic_constraints::KinematicConstraintSet(getRobotModel()));
-    kset->add(constr, getPlanningScene()->getTransforms());
+    kinematic_constraints::KinematicConstraintSetConstPtr kset =
+        kinematic_constraints::KinematicConstraintSetCache::instance().getConstraintSet(
+            getRobotModel(), constr, getPlanningScene()->getTransforms());
     if (!kset->empty())
       goal_constraints_.push_back(kset);
   }
@@ -527,9 +899,10 @@ bool ompl_interface::ModelBasedPlanningContext::benchmark(double timeout, unsign
 
 void ompl_interface::ModelBasedPlanningContext::startSampling()
 {
+  // the lazy goals of a context are its constrained goal samplers
   bool gls = ompl_simple_setup_->getGoal()->hasType(ob::GOAL_LAZY_SAMPLES);
   if (gls)
-    static_cast<ob::GoalLazySamples*>(ompl_simple_setup_->getGoal().get())->startSampling();
+    static_cast<ConstrainedGoalSampler*>(ompl_simple_setup_->getGoal().get())->startSampling();
   else
     // we know this is a GoalSampleableMux by elimination
     static_cast<GoalSampleableRegionMux*>(ompl_simple_setup_->getGoal().get())->startSampling();
@@ -539,7 +912,7 @@ void ompl_interface::ModelBasedPlanningContext::stopSampling()
 {
   bool gls = ompl_simple_setup_->getGoal()->hasType(ob::GOAL_LAZY_SAMPLES);
   if (gls)
-    static_cast<ob::GoalLazySamples*>(ompl_simple_setup_->getGoal().get())->stopSampling();
+    static_cast<ConstrainedGoalSampler*>(ompl_simple_setup_->getGoal().get())->stopSampling();
   else
     // we know this is a GoalSampleableMux by elimination
     static_cast<GoalSampleableRegionMux*>(ompl_simple_setup_->getGoal().get())->stopSampling();
@@ -577,6 +950,7 @@ bool ompl_interface::ModelBasedPlanningContext::solve(planning_interface::Motion
       simplifySolution(request_.allowed_planning_time - ptime);
       ptime += getLastSimplifyTime();
     }
+    storeExperience();
     interpolateSolution();
 
     // fill the response
@@ -620,6 +994,7 @@ bool ompl_interface::ModelBasedPlanningContext::solve(planning_interface::Motion
       res.trajectory_.back().reset(new robot_trajectory::RobotTrajectory(getRobotModel(), getGroupName()));
       getSolutionPath(*res.trajectory_.back());
     }
+    storeExperience();
 
     ompl::time::point start_interpolate = ompl::time::now();
     interpolateSolution();
@@ -649,7 +1024,30 @@ bool ompl_interface::ModelBasedPlanningContext::solve(double timeout, unsigned i
   preSolve();
 
   bool result = false;
-  if (count <= 1)
+  last_plan_from_experience_ = false;
+  if (experience_library_)
+  {
+    ob::PlannerTerminationCondition ptc =
+        ob::timedPlannerTerminationCondition(timeout - ompl::time::seconds(ompl::time::now() - start));
+    registerTerminationCondition(ptc);
+    result = last_plan_from_experience_ = solveFromExperience(ptc);
+    last_plan_time_ = ompl::time::seconds(ompl::time::now() - start);
+    unregisterTerminationCondition();
+  }
+
+  // with lazy collision checking the planners only avoid self collisions, and the world is checked on the solution
+  bool lazy = !result && lazy_collision_checking_ && ompl_simple_setup_->getStateValidityChecker();
+  if (lazy)
+    setSelfCollisionOnly(true);
+
+  if (result)
+    ROS_DEBUG_NAMED("model_based_planning_context", "%s: Solved the planning problem from experience", name_.c_str());
+  else if (!portfolio_allocators_.empty())
+  {
+    result = solvePortfolio(timeout - ompl::time::seconds(ompl::time::now() - start));
+    last_plan_time_ = ompl::time::seconds(ompl::time::now() - start);
+  }
+  else if (count <= 1)
   {
     ROS_DEBUG_NAMED("model_based_planning_context", "%s: Solving the planning problem once...", name_.c_str());
     ob::PlannerTerminationCondition ptc =
@@ -663,6 +1061,9 @@ bool ompl_interface::ModelBasedPlanningContext::solve(double timeout, unsigned i
   {
     ROS_DEBUG_NAMED("model_based_planning_context", "%s: Solving the planning problem %u times...", name_.c_str(),
                     count);
+    if (ompl_simple_setup_->getStateValidityChecker())
+      static_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get())
+          ->reserveThreadStates(std::min(count, max_planning_threads_));
     ompl_parallel_plan_.clearHybridizationPaths();
     if (count <= max_planning_threads_)
     {
@@ -718,11 +1119,202 @@ bool ompl_interface::ModelBasedPlanningContext::solve(double timeout, unsigned i
     }
   }
 
+  if (lazy)
+  {
+    setSelfCollisionOnly(false);
+    if (result)
+    {
+      ob::PlannerTerminationCondition ptc =
+          ob::timedPlannerTerminationCondition(timeout - ompl::time::seconds(ompl::time::now() - start));
+      registerTerminationCondition(ptc);
+      result = validateLazySolution(ptc);
+      last_plan_time_ = ompl::time::seconds(ompl::time::now() - start);
+      unregisterTerminationCondition();
+    }
+  }
+
   postSolve();
 
   return result;
 }
 
+bool ompl_interface::ModelBasedPlanningContext::solvePortfolio(double timeout)
+{
+  std::size_t count = portfolio_allocators_.size();
+  if (count > std::max(1u, max_planning_threads_))
+  {
+    ROS_WARN_NAMED("model_based_planning_context", "%s: Running only the first %u of the %lu portfolio planners",
+                   name_.c_str(), std::max(1u, max_planning_threads_), count);
+    count = std::max(1u, max_planning_threads_);
+  }
+  ROS_DEBUG_NAMED("model_based_planning_context", "%s: Solving the planning problem with %lu portfolio planners...",
+                  name_.c_str(), count);
+
+  if (ompl_simple_setup_->getStateValidityChecker())
+    static_cast<StateValidityChecker*>(ompl_simple_setup_->getStateValidityChecker().get())
+        ->reserveThreadStates(count);
+  ompl_parallel_plan_.clearHybridizationPaths();
+  ompl_parallel_plan_.clearPlanners();
+  for (std::size_t i = 0; i < count; ++i)
+    ompl_parallel_plan_.addPlannerAllocator(portfolio_allocators_[i]);
+
+  // anytime planners only stop at the end of the allotted time, unless their cost stops improving
+  const ob::ProblemDefinitionPtr& pdef = ompl_simple_setup_->getProblemDefinition();
+  SolutionCostConvergence convergence(portfolio_convergence_time_, portfolio_convergence_improvement_);
+  ob::ReportIntermediateSolutionFn previous_callback = pdef->getIntermediateSolutionCallback();
+  pdef->setIntermediateSolutionCallback(boost::bind(&SolutionCostConvergence::report, &convergence, _1, _2, _3));
+  ob::PlannerTerminationCondition ptc = ob::plannerOrTerminationCondition(
+      ob::timedPlannerTerminationCondition(timeout),
+      ob::PlannerTerminationCondition(boost::bind(&SolutionCostConvergence::hasConverged, &convergence), 0.01));
+  registerTerminationCondition(ptc);
+
+  // the first exact solution terminates all other planners
+  bool result = ompl_parallel_plan_.solve(ptc, 1, count, false) == ompl::base::PlannerStatus::EXACT_SOLUTION;
+  unregisterTerminationCondition();
+  pdef->setIntermediateSolutionCallback(previous_callback);
+  return result;
+}
+
+bool ompl_interface::ModelBasedPlanningContext::solveFromExperience(const ob::PlannerTerminationCondition& ptc)
+{
+  const ob::ProblemDefinitionPtr& pdef = ompl_simple_setup_->getProblemDefinition();
+  if (pdef->getStartStateCount() != 1 || goal_constraints_.empty())
+    return false;
+  const ob::State* start = pdef->getStartState(0);
+
+  static const std::size_t MAX_RECALLED_PATHS = 10;
+  std::vector<ExperiencePath> recalled;
+  experience_library_->getExperience(*this, start, MAX_RECALLED_PATHS, recalled);
+  if (recalled.empty())
+    return false;
+
+  uint64_t fingerprint = getSceneFingerprint();
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  robot_state::RobotState goal_state = complete_initial_robot_state_;
+  for (std::size_t i = 0; i < recalled.size() && !ptc(); ++i)
+  {
+    const og::PathGeometric& stored = *recalled[i].path;
+
+    // the stored path has to end in the goal region of this request
+    spec_.state_space_->copyToRobotState(goal_state, stored.getState(stored.getStateCount() - 1));
+    bool reaches_goal = false;
+    for (std::size_t k = 0; k < goal_constraints_.size() && !reaches_goal; ++k)
+      reaches_goal = goal_constraints_[k]->decide(goal_state).satisfied;
+    if (!reaches_goal)
+      continue;
+
+    og::PathGeometric* path = new og::PathGeometric(si, start);
+    for (std::size_t k = recalled[i].distance > 0.0 ? 0 : 1; k < stored.getStateCount(); ++k)
+      path->append(stored.getState(k));
+    ob::PathPtr solution(path);
+
+    // paths computed in the same scene only need the connection from the new start state checked
+    bool trusted = fingerprint != 0 && recalled[i].scene_fingerprint == fingerprint;
+    if (repairPath(*path, trusted, ptc))
+    {
+      pdef->addSolutionPath(solution, false, 0.0, "experience");
+      ROS_DEBUG_NAMED("model_based_planning_context", "%s: Using stored path %lu of %lu (%s)", name_.c_str(), i + 1,
+                      recalled.size(), trusted ? "same scene" : "repaired");
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ompl_interface::ModelBasedPlanningContext::repairPath(og::PathGeometric& path, bool trusted,
+                                                           const ob::PlannerTerminationCondition& ptc) const
+{
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  const std::vector<ob::State*>& states = path.getStates();
+  if (!si->isValid(states[0]))
+    return false;
+
+  og::PathGeometric repaired(si, states[0]);
+  std::size_t i = 0;
+  while (i + 1 < states.size())
+  {
+    if (ptc())
+      return false;
+    std::size_t j = i + 1;
+    if ((trusted && i > 0) || (si->isValid(states[j]) && si->checkMotion(states[i], states[j])))
+    {
+      repaired.append(states[j]);
+      i = j;
+      continue;
+    }
+
+    // skip over the invalid stored states and plan a bridge to the next valid one
+    while (j < states.size() && !si->isValid(states[j]))
+      ++j;
+    if (j == states.size())
+      return false;
+
+    ob::ProblemDefinitionPtr pdef(new ob::ProblemDefinition(si));
+    pdef->setStartAndGoalStates(states[i], states[j]);
+    ob::PlannerPtr planner(new og::RRTConnect(si));
+    planner->setProblemDefinition(pdef);
+    planner->setup();
+    if (planner->solve(ptc) != ob::PlannerStatus::EXACT_SOLUTION)
+      return false;
+    const og::PathGeometric& bridge = static_cast<const og::PathGeometric&>(*pdef->getSolutionPath());
+    for (std::size_t k = 1; k < bridge.getStateCount(); ++k)
+      repaired.append(bridge.getState(k));
+    i = j;
+  }
+  path = repaired;
+  return true;
+}
+
+void ompl_interface::ModelBasedPlanningContext::setSelfCollisionOnly(bool flag)
+{
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  static_cast<StateValidityChecker*>(si->getStateValidityChecker().get())->setSelfCollisionOnly(flag);
+
+  // motions checked for self collisions only must not be remembered as valid
+  CachedMotionValidator* mv = dynamic_cast<CachedMotionValidator*>(si->getMotionValidator().get());
+  if (mv)
+    mv->setCacheEnabled(!flag);
+}
+
+bool ompl_interface::ModelBasedPlanningContext::validateLazySolution(const ob::PlannerTerminationCondition& ptc)
+{
+  const ob::SpaceInformationPtr& si = ompl_simple_setup_->getSpaceInformation();
+  const std::vector<ob::State*>& states = ompl_simple_setup_->getSolutionPath().getStates();
+  bool valid = true;
+  for (std::size_t i = 0; i < states.size() && valid; ++i)
+    valid = si->isValid(states[i]) && (i == 0 || si->checkMotion(states[i - 1], states[i]));
+  if (valid)
+    return true;
+
+  ROS_DEBUG_NAMED("model_based_planning_context",
+                  "%s: The lazily checked solution is in collision, replanning the invalid segments", name_.c_str());
+  og::PathGeometric* path = new og::PathGeometric(ompl_simple_setup_->getSolutionPath());
+  ob::PathPtr solution(path);
+  if (!repairPath(*path, false, ptc))
+    return false;
+  const ob::ProblemDefinitionPtr& pdef = ompl_simple_setup_->getProblemDefinition();
+  pdef->clearSolutionPaths();
+  pdef->addSolutionPath(solution, false, 0.0, "lazy collision checking");
+  return true;
+}
+
+void ompl_interface::ModelBasedPlanningContext::storeExperience()
+{
+  if (!experience_library_ || last_plan_from_experience_ || !ompl_simple_setup_->haveExactSolutionPath())
+    return;
+  if (experience_library_->addExperience(*this, ompl_simple_setup_->getSolutionPath(), getSceneFingerprint()))
+    ROS_DEBUG_NAMED("model_based_planning_context", "%s: Stored the solution path as experience (%lu paths)",
+                    name_.c_str(), experience_library_->getExperienceCount(*this));
+}
+
+uint64_t ompl_interface::ModelBasedPlanningContext::getSceneFingerprint() const
+{
+  if (validity_cache_fingerprint_ || !getPlanningScene())
+    return validity_cache_fingerprint_;
+  return ValidityCache::computeSceneFingerprint(*getPlanningScene(), getCompleteInitialRobotState(), getGroupName(),
+                                                path_constraints_msg_);
+}
+
 void ompl_interface::ModelBasedPlanningContext::registerTerminationCondition(const ob::PlannerTerminationCondition& ptc)
 {
   boost::mutex::scoped_lock slock(ptc_lock_);
@@ -50,12 +50,17 @@ ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstP
   , context_manager_(kmodel, constraint_sampler_manager_)
   , constraints_library_(new ConstraintsLibrary(context_manager_))
   , use_constraints_approximations_(true)
+  , experience_library_(new ExperienceLibrary(context_manager_))
+  , use_experience_(false)
   , simplify_solutions_(true)
 {
   ROS_INFO("Initializing OMPL interface using ROS parameters");
   loadPlannerConfigurations();
   loadConstraintApproximations();
   loadConstraintSamplers();
+  loadValidityCacheSettings();
+  loadExperienceSettings();
+  loadPersistentRoadmapSettings();
 }
 
 ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstPtr& kmodel,
@@ -67,16 +72,24 @@ ompl_interface::OMPLInterface::OMPLInterface(const robot_model::RobotModelConstP
   , context_manager_(kmodel, constraint_sampler_manager_)
   , constraints_library_(new ConstraintsLibrary(context_manager_))
   , use_constraints_approximations_(true)
+  , experience_library_(new ExperienceLibrary(context_manager_))
+  , use_experience_(false)
   , simplify_solutions_(true)
 {
   ROS_INFO("Initializing OMPL interface using specified configuration");
   setPlannerConfigurations(pconfig);
   loadConstraintApproximations();
   loadConstraintSamplers();
+  loadValidityCacheSettings();
+  loadExperienceSettings();
+  loadPersistentRoadmapSettings();
 }
 
 ompl_interface::OMPLInterface::~OMPLInterface()
 {
+  if (use_experience_ && nh_.hasParam("experience_path"))
+    saveExperience();
+  context_manager_.savePersistentRoadmaps();
 }
 
 void ompl_interface::OMPLInterface::setPlannerConfigurations(const planning_interface::PlannerConfigurationMap& pconfig)
@@ -131,6 +144,10 @@ void ompl_interface::OMPLInterface::configureContext(const ModelBasedPlanningCon
     context->setConstraintsApproximations(constraints_library_);
   else
     context->setConstraintsApproximations(ConstraintsLibraryPtr());
+  if (use_experience_)
+    context->setExperienceLibrary(experience_library_);
+  else
+    context->setExperienceLibrary(ExperienceLibraryPtr());
   context->simplifySolutions(simplify_solutions_);
 }
 
@@ -170,12 +187,85 @@ bool ompl_interface::OMPLInterface::loadConstraintApproximations()
   return false;
 }
 
+void ompl_interface::OMPLInterface::loadExperience(const std::string& path)
+{
+  experience_library_->loadExperience(path);
+  std::stringstream ss;
+  experience_library_->printExperience(ss);
+  ROS_INFO_STREAM(ss.str());
+}
+
+void ompl_interface::OMPLInterface::saveExperience(const std::string& path)
+{
+  experience_library_->saveExperience(path);
+}
+
+bool ompl_interface::OMPLInterface::saveExperience()
+{
+  std::string epath;
+  if (nh_.getParam("experience_path", epath))
+  {
+    saveExperience(epath);
+    return true;
+  }
+  ROS_WARN("ROS param 'experience_path' not found. Unable to save planning experience");
+  return false;
+}
+
+bool ompl_interface::OMPLInterface::loadExperience()
+{
+  std::string epath;
+  if (nh_.getParam("experience_path", epath))
+  {
+    loadExperience(epath);
+    return true;
+  }
+  return false;
+}
+
 void ompl_interface::OMPLInterface::loadConstraintSamplers()
 {
   constraint_sampler_manager_loader_.reset(
       new constraint_sampler_manager_loader::ConstraintSamplerManagerLoader(constraint_sampler_manager_));
 }
 
+void ompl_interface::OMPLInterface::loadValidityCacheSettings()
+{
+  int size = 0;
+  double resolution = 1e-4;
+  nh_.param("validity_cache_size", size, size);
+  nh_.param("validity_cache_resolution", resolution, resolution);
+  if (size > 0 && resolution > 0.0)
+  {
+    ROS_INFO("Caching up to %d validity results per group across planning requests", size);
+    context_manager_.setValidityCacheSize(size, resolution);
+  }
+}
+
+void ompl_interface::OMPLInterface::loadExperienceSettings()
+{
+  nh_.param("use_experience", use_experience_, false);
+  int max_paths = experience_library_->getMaximumPathCount();
+  nh_.param("experience_max_paths", max_paths, max_paths);
+  if (max_paths > 0)
+    experience_library_->setMaximumPathCount(max_paths);
+  if (use_experience_)
+  {
+    ROS_INFO("Using planning experience (up to %d paths per group)", max_paths);
+    loadExperience();
+  }
+}
+
+void ompl_interface::OMPLInterface::loadPersistentRoadmapSettings()
+{
+  std::string rpath;
+  if (nh_.getParam("roadmap_path", rpath))
+  {
+    ROS_INFO("Roadmaps of persistent PRM planners are stored in '%s'", rpath.c_str());
+    context_manager_.setPersistentRoadmapPath(rpath);
+  }
+}
+
 bool ompl_interface::OMPLInterface::loadPlannerConfiguration(
     const std::string& group_name, const std::string& planner_id,
     const std::map<std::string, std::string>& group_params,
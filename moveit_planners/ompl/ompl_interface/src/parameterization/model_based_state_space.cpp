@@ -36,6 +36,7 @@
 
 #include <moveit/ompl_interface/parameterization/model_based_state_space.h>
 #include <boost/bind.hpp>
+#include <boost/math/constants/constants.hpp>
 
 ompl_interface::ModelBasedStateSpace::ModelBasedStateSpace(const ModelBasedStateSpaceSpecification& spec)
   : ompl::base::StateSpace(), spec_(spec)
@@ -67,6 +68,32 @@ ompl_interface::ModelBasedStateSpace::ModelBasedStateSpace(const ModelBasedState
     spec_.joint_bounds_[i] = &joint_bounds_storage_[i];
   }
 
+  // groups of revolute and prismatic joints without mimic joints avoid the per joint virtual calls
+  single_dof_joints_ = spec_.joint_model_group_->getMimicJointModels().empty() && variable_count_ > 0 &&
+                       joint_model_vector_.size() == variable_count_;
+  for (std::size_t i = 0; single_dof_joints_ && i < joint_model_vector_.size(); ++i)
+  {
+    const robot_model::JointModel* jm = joint_model_vector_[i];
+    if ((jm->getType() != robot_model::JointModel::REVOLUTE && jm->getType() != robot_model::JointModel::PRISMATIC) ||
+        spec_.joint_model_group_->getVariableGroupIndex(jm->getName()) != (int)i)
+      single_dof_joints_ = false;
+    else if (jm->getType() == robot_model::JointModel::REVOLUTE &&
+             static_cast<const robot_model::RevoluteJointModel*>(jm)->isContinuous())
+    {
+      linear_weights_.push_back(0.0);
+      wrapping_variables_.push_back(i);
+      wrapping_weights_.push_back(jm->getDistanceFactor());
+    }
+    else
+      linear_weights_.push_back(jm->getDistanceFactor());
+  }
+  if (!single_dof_joints_)
+  {
+    linear_weights_.clear();
+    wrapping_variables_.clear();
+    wrapping_weights_.clear();
+  }
+
   // default settings
   setTagSnapToSegment(0.95);
 
@@ -170,6 +197,37 @@ double ompl_interface::ModelBasedStateSpace::distance(const ompl::base::State* s
 {
   if (distance_function_)
     return distance_function_(state1, state2);
+  else if (single_dof_joints_)
+  {
+    const double* values1 = state1->as<StateType>()->values;
+    const double* values2 = state2->as<StateType>()->values;
+    const double* weights = &linear_weights_[0];
+
+    // independent partial sums, so the loop is not serialized on a single accumulator
+    double d0 = 0.0, d1 = 0.0, d2 = 0.0, d3 = 0.0;
+    unsigned int i = 0;
+    for (; i + 4 <= variable_count_; i += 4)
+    {
+      d0 += weights[i] * fabs(values1[i] - values2[i]);
+      d1 += weights[i + 1] * fabs(values1[i + 1] - values2[i + 1]);
+      d2 += weights[i + 2] * fabs(values1[i + 2] - values2[i + 2]);
+      d3 += weights[i + 3] * fabs(values1[i + 3] - values2[i + 3]);
+    }
+    for (; i < variable_count_; ++i)
+      d0 += weights[i] * fabs(values1[i] - values2[i]);
+    double d = (d0 + d1) + (d2 + d3);
+
+    // continuous joints measure the shorter way around the circle
+    for (std::size_t k = 0; k < wrapping_variables_.size(); ++k)
+    {
+      unsigned int j = wrapping_variables_[k];
+      double dj = fmod(fabs(values1[j] - values2[j]), 2.0 * boost::math::constants::pi<double>());
+      if (dj > boost::math::constants::pi<double>())
+        dj = 2.0 * boost::math::constants::pi<double>() - dj;
+      d += wrapping_weights_[k] * dj;
+    }
+    return d;
+  }
   else
     return spec_.joint_model_group_->distance(state1->as<StateType>()->values, state2->as<StateType>()->values);
 }
@@ -203,9 +261,34 @@ void ompl_interface::ModelBasedStateSpace::interpolate(const ompl::base::State*
 
   if (!interpolation_function_ || !interpolation_function_(from, to, t, state))
   {
-    // perform the actual interpolation
-    spec_.joint_model_group_->interpolate(from->as<StateType>()->values, to->as<StateType>()->values, t,
-                                          state->as<StateType>()->values);
+    const double* from_values = from->as<StateType>()->values;
+    const double* to_values = to->as<StateType>()->values;
+    double* values = state->as<StateType>()->values;
+
+    // perform the actual interpolation; the direct loop needs the inputs to stay unchanged for the continuous joints
+    if (single_dof_joints_ && values != from_values && values != to_values)
+    {
+      for (unsigned int i = 0; i < variable_count_; ++i)
+        values[i] = from_values[i] + (to_values[i] - from_values[i]) * t;
+      for (std::size_t k = 0; k < wrapping_variables_.size(); ++k)
+      {
+        unsigned int j = wrapping_variables_[k];
+        double diff = to_values[j] - from_values[j];
+        if (fabs(diff) <= boost::math::constants::pi<double>())
+          continue;
+        if (diff > 0.0)
+          diff = 2.0 * boost::math::constants::pi<double>() - diff;
+        else
+          diff = -2.0 * boost::math::constants::pi<double>() - diff;
+        values[j] = from_values[j] - diff * t;
+        if (values[j] > boost::math::constants::pi<double>())
+          values[j] -= 2.0 * boost::math::constants::pi<double>();
+        else if (values[j] < -boost::math::constants::pi<double>())
+          values[j] += 2.0 * boost::math::constants::pi<double>();
+      }
+    }
+    else
+      spec_.joint_model_group_->interpolate(from_values, to_values, t, values);
 
     // compute tag
     if (from->as<StateType>()->tag >= 0 && t < 1.0 - tag_snap_to_segment_)
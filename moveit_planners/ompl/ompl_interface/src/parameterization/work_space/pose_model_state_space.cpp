@@ -37,11 +37,49 @@
 #include <moveit/ompl_interface/parameterization/work_space/pose_model_state_space.h>
 #include <ompl/base/spaces/SE3StateSpace.h>
 #include <moveit/profiler/profiler.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ompl_interface
+{
+namespace
+{
+// poses are rounded to this resolution to look up remembered IK solutions (m for positions, and for quaternions)
+const double IK_MEMO_RESOLUTION = 1e-6;
+
+// a remembered solution is only used if every joint of its seed is this close to the current seed (rad or m)
+const double IK_MEMO_SEED_TOLERANCE = 0.1;
+
+// the number of solutions remembered per thread and pose component; the memo is emptied when it is full
+const std::size_t IK_MEMO_SIZE = 4096;
+
+uint64_t roundPose(const ompl::base::SE3StateSpace::StateType* se3_state, int64_t* pose)
+{
+  // q and -q are the same rotation
+  const ompl::base::SO3StateSpace::StateType& so3_state = se3_state->rotation();
+  double sign = so3_state.w < 0.0 ? -1.0 : 1.0;
+  const double values[7] = { se3_state->getX(),  se3_state->getY(),  se3_state->getZ(), sign * so3_state.x,
+                             sign * so3_state.y, sign * so3_state.z, sign * so3_state.w };
+  uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+  for (std::size_t i = 0; i < 7; ++i)
+  {
+    pose[i] = static_cast<int64_t>(std::floor(values[i] / IK_MEMO_RESOLUTION + 0.5));
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&pose[i]);
+    for (std::size_t j = 0; j < sizeof(int64_t); ++j)
+    {
+      hash ^= bytes[j];
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+}
+}
 
 const std::string ompl_interface::PoseModelStateSpace::PARAMETERIZATION_TYPE = "PoseModel";
 
 ompl_interface::PoseModelStateSpace::PoseModelStateSpace(const ModelBasedStateSpaceSpecification& spec)
-  : ModelBasedStateSpace(spec)
+  : ModelBasedStateSpace(spec), ik_memo_hits_(0), ik_memo_misses_(0)
 {
   jump_factor_ = 3;  // \todo make this a param
 
@@ -63,6 +101,12 @@ ompl_interface::PoseModelStateSpace::PoseModelStateSpace(const ModelBasedStateSp
 
 ompl_interface::PoseModelStateSpace::~PoseModelStateSpace()
 {
+  std::size_t lookups = ik_memo_hits_ + ik_memo_misses_;
+  if (lookups > 0)
+    ROS_DEBUG_NAMED("pose_model_state_space",
+                    "%s: %u of %u IK problems were found among remembered solutions (%.1lf%%)", getName().c_str(),
+                    (unsigned int)ik_memo_hits_, (unsigned int)lookups,
+                    100.0 * (double)ik_memo_hits_ / (double)lookups);
 }
 
 double ompl_interface::PoseModelStateSpace::distance(const ompl::base::State* state1,
@@ -148,8 +192,8 @@ void ompl_interface::PoseModelStateSpace::interpolate(const ompl::base::State* f
   */
 
   // after interpolation we cannot be sure about the joint values (we use them as seed only)
-  // so we recompute IK if needed
-  if (computeStateIK(state))
+  // so we recompute IK if needed; the closer of the two states provides the seed if the interpolated one fails
+  if (computeStateIK(state, t < 0.5 ? from : to))
   {
     double dj = jump_factor_ * ModelBasedStateSpace::distance(from, to);
     double d_from = ModelBasedStateSpace::distance(from, state);
@@ -268,12 +312,19 @@ bool ompl_interface::PoseModelStateSpace::computeStateFK(ompl::base::State* stat
   return true;
 }
 
-bool ompl_interface::PoseModelStateSpace::computeStateIK(ompl::base::State* state) const
+bool ompl_interface::PoseModelStateSpace::computeStateIK(ompl::base::State* state,
+                                                         const ompl::base::State* neighbor) const
 {
   if (state->as<StateType>()->jointsComputed())
     return true;
+  std::vector<IKMemo>* memo = ik_memo_.get();
+  if (!memo)
+  {
+    memo = new std::vector<IKMemo>(poses_.size());
+    ik_memo_.reset(memo);
+  }
   for (std::size_t i = 0; i < poses_.size(); ++i)
-    if (!poses_[i].computeStateIK(state->as<StateType>(), i))
+    if (!computeComponentIK(state->as<StateType>(), i, (*memo)[i], neighbor ? neighbor->as<StateType>() : NULL))
     {
       state->as<StateType>()->markInvalid();
       return false;
@@ -282,6 +333,55 @@ bool ompl_interface::PoseModelStateSpace::computeStateIK(ompl::base::State* stat
   return true;
 }
 
+bool ompl_interface::PoseModelStateSpace::computeComponentIK(StateType* full_state, unsigned int idx, IKMemo& memo,
+                                                             const StateType* neighbor) const
+{
+  const PoseComponent& component = poses_[idx];
+  const std::vector<unsigned int>& bijection = component.bijection_;
+  IKMemoEntry entry;
+  uint64_t key = roundPose(full_state->poses[idx], entry.pose);
+  entry.seed.resize(bijection.size());
+  for (std::size_t i = 0; i < bijection.size(); ++i)
+    entry.seed[i] = full_state->values[bijection[i]];
+
+  IKMemo::const_iterator it = memo.find(key);
+  if (it != memo.end() && std::equal(entry.pose, entry.pose + 7, it->second.pose))
+  {
+    bool close = true;
+    for (std::size_t i = 0; close && i < bijection.size(); ++i)
+      close = std::abs(entry.seed[i] - it->second.seed[i]) <= IK_MEMO_SEED_TOLERANCE;
+    if (close)
+    {
+      ++ik_memo_hits_;
+      const std::vector<double>& solution = it->second.solution;
+      for (std::size_t i = 0; i < solution.size(); ++i)
+        full_state->values[bijection[i]] = solution[i];
+      return !solution.empty();
+    }
+  }
+  ++ik_memo_misses_;
+
+  bool solved = component.computeStateIK(full_state, idx);
+  if (!solved && neighbor)
+  {
+    for (std::size_t i = 0; i < bijection.size(); ++i)
+      full_state->values[bijection[i]] = neighbor->values[bijection[i]];
+    solved = component.computeStateIK(full_state, idx);
+  }
+  if (solved)
+  {
+    entry.solution.resize(bijection.size());
+    for (std::size_t i = 0; i < bijection.size(); ++i)
+      entry.solution[i] = full_state->values[bijection[i]];
+  }
+
+  // failures are remembered too; they are the most expensive to recompute, as the solver searches until it times out
+  if (memo.size() >= IK_MEMO_SIZE)
+    memo.clear();
+  memo[key] = entry;
+  return solved;
+}
+
 bool ompl_interface::PoseModelStateSpace::computeStateK(ompl::base::State* state) const
 {
   if (state->as<StateType>()->jointsComputed() && !state->as<StateType>()->poseComputed())
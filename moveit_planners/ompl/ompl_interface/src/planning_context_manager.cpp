@@ -37,6 +37,7 @@
 #include <moveit/ompl_interface/planning_context_manager.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/profiler/profiler.h>
+#include <boost/filesystem.hpp>
 #include <algorithm>
 #include <set>
 
@@ -103,6 +104,8 @@ private:
 struct PlanningContextManager::CachedContexts
 {
   std::map<std::pair<std::string, std::string>, std::vector<ModelBasedPlanningContextPtr> > contexts_;
+  std::map<std::string, ValidityCachePtr> validity_caches_;
+  std::map<std::string, PersistentRoadmapPtr> roadmaps_;
   boost::mutex lock_;
 };
 
@@ -113,11 +116,14 @@ ompl_interface::PlanningContextManager::PlanningContextManager(
   : kmodel_(kmodel)
   , constraint_sampler_manager_(csm)
   , max_goal_samples_(10)
+  , max_goal_sampling_threads_(4)
   , max_state_sampling_attempts_(4)
   , max_goal_sampling_attempts_(1000)
   , max_planning_threads_(4)
   , max_solution_segment_length_(0.0)
   , minimum_waypoint_count_(2)
+  , validity_cache_size_(0)
+  , validity_cache_resolution_(1e-4)
 {
   last_planning_context_.reset(new LastPlanningContext());
   cached_contexts_.reset(new CachedContexts());
@@ -185,6 +191,8 @@ void ompl_interface::PlanningContextManager::registerDefaultPlanners()
   registerPlannerAllocator("geometric::LazyPRMstar", boost::bind(&allocatePlanner<og::LazyPRMstar>, _1, _2, _3));
   registerPlannerAllocator("geometric::SPARS", boost::bind(&allocatePlanner<og::SPARS>, _1, _2, _3));
   registerPlannerAllocator("geometric::SPARStwo", boost::bind(&allocatePlanner<og::SPARStwo>, _1, _2, _3));
+  registerPlannerAllocator("geometric::PersistentLazyPRM",
+                           boost::bind(&PlanningContextManager::allocatePersistentRoadmapPlanner, this, _1, _2, _3));
 }
 
 void ompl_interface::PlanningContextManager::registerDefaultStateSpaces()
@@ -290,6 +298,7 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
 
   context->setMaximumPlanningThreads(max_planning_threads_);
   context->setMaximumGoalSamples(max_goal_samples_);
+  context->setMaximumGoalSamplingThreads(max_goal_sampling_threads_);
   context->setMaximumStateSamplingAttempts(max_state_sampling_attempts_);
   context->setMaximumGoalSamplingAttempts(max_goal_sampling_attempts_);
   if (max_solution_segment_length_ > std::numeric_limits<double>::epsilon())
@@ -298,10 +307,107 @@ ompl_interface::ModelBasedPlanningContextPtr ompl_interface::PlanningContextMana
 
   context->setSpecificationConfig(config.config);
 
+  // the members of a portfolio are named like the planner_id of a request
+  std::vector<planning_interface::PlannerConfigurationSettings> portfolio;
+  std::map<std::string, std::string>::const_iterator pf = config.config.find("portfolio");
+  if (pf != config.config.end())
+  {
+    boost::char_separator<char> sep(" ,");
+    boost::tokenizer<boost::char_separator<char> > tok(pf->second, sep);
+    for (boost::tokenizer<boost::char_separator<char> >::iterator beg = tok.begin(); beg != tok.end(); ++beg)
+    {
+      planning_interface::PlannerConfigurationMap::const_iterator member =
+          planner_configs_.find(config.group + "[" + *beg + "]");
+      if (member == planner_configs_.end())
+        member = planner_configs_.find(*beg);
+      if (member == planner_configs_.end())
+        ROS_WARN_NAMED("planning_context_manager", "Planner configuration '%s' of portfolio '%s' was not found",
+                       beg->c_str(), config.name.c_str());
+      else
+        portfolio.push_back(member->second);
+    }
+  }
+  context->setPortfolio(portfolio);
+  context->setValidityCache(getValidityCache(config.group));
+
   last_planning_context_->setContext(context);
   return context;
 }
 
+void ompl_interface::PlanningContextManager::setValidityCacheSize(std::size_t size, double resolution)
+{
+  boost::mutex::scoped_lock slock(cached_contexts_->lock_);
+  validity_cache_size_ = size;
+  validity_cache_resolution_ = resolution;
+  cached_contexts_->validity_caches_.clear();
+}
+
+ompl_interface::ValidityCachePtr
+ompl_interface::PlanningContextManager::getValidityCache(const std::string& group) const
+{
+  boost::mutex::scoped_lock slock(cached_contexts_->lock_);
+  if (validity_cache_size_ == 0)
+    return ValidityCachePtr();
+  ValidityCachePtr& cache = cached_contexts_->validity_caches_[group];
+  if (!cache)
+    cache.reset(new ValidityCache(validity_cache_size_, validity_cache_resolution_));
+  return cache;
+}
+
+ompl_interface::PersistentRoadmapPtr
+ompl_interface::PlanningContextManager::getPersistentRoadmap(const ModelBasedStateSpacePtr& space) const
+{
+  boost::mutex::scoped_lock slock(cached_contexts_->lock_);
+  PersistentRoadmapPtr& roadmap = cached_contexts_->roadmaps_[space->getName()];
+  if (!roadmap)
+  {
+    roadmap.reset(new PersistentRoadmap(space));
+    std::string filename = roadmap_path_ + "/" + space->getName() + ".roadmap";
+    if (!roadmap_path_.empty() && boost::filesystem::exists(filename) && roadmap->load(filename))
+      ROS_INFO_NAMED("planning_context_manager", "Loaded roadmap with %lu vertices and %lu edges from '%s'",
+                     roadmap->getVertexCount(), roadmap->getEdgeCount(), filename.c_str());
+  }
+  return roadmap;
+}
+
+ompl::base::PlannerPtr ompl_interface::PlanningContextManager::allocatePersistentRoadmapPlanner(
+    const ob::SpaceInformationPtr& si, const std::string& new_name,
+    const ModelBasedPlanningContextSpecification& spec) const
+{
+  ompl::base::PlannerPtr planner(new PersistentRoadmapPlanner(si, getPersistentRoadmap(spec.state_space_)));
+  if (!new_name.empty())
+    planner->setName(new_name);
+  planner->params().setParams(spec.config_, true);
+  planner->setup();
+  return planner;
+}
+
+void ompl_interface::PlanningContextManager::savePersistentRoadmaps() const
+{
+  if (roadmap_path_.empty())
+    return;
+  try
+  {
+    boost::filesystem::create_directories(roadmap_path_);
+  }
+  catch (...)
+  {
+  }
+
+  boost::mutex::scoped_lock slock(cached_contexts_->lock_);
+  for (std::map<std::string, PersistentRoadmapPtr>::const_iterator it = cached_contexts_->roadmaps_.begin();
+       it != cached_contexts_->roadmaps_.end(); ++it)
+  {
+    boost::mutex::scoped_lock rlock(it->second->getLock());
+    std::string filename = roadmap_path_ + "/" + it->first + ".roadmap";
+    if (it->second->save(filename))
+      ROS_INFO_NAMED("planning_context_manager", "Saved roadmap with %lu vertices and %lu edges to '%s'",
+                     it->second->getVertexCount(), it->second->getEdgeCount(), filename.c_str());
+    else
+      ROS_ERROR_NAMED("planning_context_manager", "Unable to save roadmap to '%s'", filename.c_str());
+  }
+}
+
 const ompl_interface::ModelBasedStateSpaceFactoryPtr& ompl_interface::PlanningContextManager::getStateSpaceFactory1(
     const std::string& /* dummy */, const std::string& factory_type) const
 {
@@ -413,10 +519,19 @@ ompl_interface::PlanningContextManager::getPlanningContext(const planning_scene:
 
   if (context)
   {
-    context->clear();
-
     robot_state::RobotStatePtr start_state = planning_scene->getCurrentStateUpdated(req.start_state);
 
+    // a request of the same structure as the previous one keeps the planner and goal samplers
+    if (context->reconfigure(planning_scene, req, *start_state))
+    {
+      ROS_DEBUG_NAMED("planning_context_manager", "%s: Reusing the configuration of the planning context.",
+                      context->getName().c_str());
+      error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+      return context;
+    }
+
+    context->clear();
+
     // Setup the context
     context->setPlanningScene(planning_scene);
     context->setMotionPlanRequest(req);
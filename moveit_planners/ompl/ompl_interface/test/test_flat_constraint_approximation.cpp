@@ -0,0 +1,149 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/flat_constraint_approximation.h>
+#include <moveit/ompl_interface/parameterization/joint_space/joint_model_state_space.h>
+#include <moveit_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdio>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+using ompl_interface::ConstraintApproximationStateStorage;
+using ompl_interface::FlatConstraintApproximation;
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    boost::filesystem::path res_path(MOVEIT_TEST_RESOURCES_DIR);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "pr2_description/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    srdf_model_->initFile(*urdf_model_, (res_path / "pr2_description/srdf/robot.xml").string());
+    robot_model_.reset(new moveit::core::RobotModel(urdf_model_, srdf_model_));
+  };
+
+protected:
+  robot_model::RobotModelPtr robot_model_;
+  urdf::ModelInterfaceSharedPtr urdf_model_;
+  srdf::ModelSharedPtr srdf_model_;
+};
+
+TEST_F(LoadPlanningModelsPr2, FlatConstraintApproximation)
+{
+  ompl_interface::ModelBasedStateSpaceSpecification spec(robot_model_, "right_arm");
+  ompl_interface::ModelBasedStateSpacePtr space(new ompl_interface::JointModelStateSpace(spec));
+  space->setup();
+
+  // three milestones connected in a chain, with one intermediate state on the motion between the first two
+  ConstraintApproximationStateStorage storage(space);
+  ompl::base::State* s = space->allocState();
+  robot_state::RobotState state(robot_model_);
+  state.setToDefaultValues();
+  space->copyToOMPLState(s, state);
+  for (int i = 0; i < 4; ++i)
+  {
+    s->as<ompl_interface::ModelBasedStateSpace::StateType>()->values[0] = 0.1 * i;
+    s->as<ompl_interface::ModelBasedStateSpace::StateType>()->tag = i < 3 ? i : -1;
+    storage.addState(s);
+  }
+  storage.getMetadata(0).first.push_back(1);
+  storage.getMetadata(1).first.push_back(0);
+  storage.getMetadata(1).first.push_back(2);
+  storage.getMetadata(2).first.push_back(1);
+  storage.getMetadata(0).second[1] = std::make_pair(3, 4);
+  storage.getMetadata(1).second[0] = std::make_pair(3, 4);
+
+  FlatConstraintApproximation data(storage);
+  ASSERT_TRUE(data.isValid());
+  EXPECT_EQ(4u, data.getStateCount());
+  EXPECT_EQ(4u, data.getNeighborCount());
+
+  std::string filename = (boost::filesystem::temp_directory_path() / "test_flat_constraint_approximation").string();
+  ASSERT_TRUE(data.save(filename));
+  EXPECT_TRUE(FlatConstraintApproximation::isFlatFile(filename));
+  FlatConstraintApproximation mapped(space, filename);
+  ASSERT_TRUE(mapped.isValid());
+  EXPECT_EQ(filename, mapped.getFilename());
+  ASSERT_EQ(4u, mapped.getStateCount());
+
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    mapped.getState(i, s);
+    EXPECT_TRUE(space->equalStates(s, storage.getState(i)));
+    EXPECT_EQ(storage.getState(i)->as<ompl_interface::ModelBasedStateSpace::StateType>()->tag,
+              s->as<ompl_interface::ModelBasedStateSpace::StateType>()->tag);
+  }
+  space->freeState(s);
+
+  std::size_t count;
+  const uint64_t* neighbors = mapped.getNeighbors(1, count);
+  ASSERT_EQ(2u, count);
+  EXPECT_EQ(0u, neighbors[0]);
+  EXPECT_EQ(2u, neighbors[1]);
+
+  const FlatConstraintApproximation::Motion* motion = mapped.findMotion(1, 0);
+  ASSERT_TRUE(motion != NULL);
+  EXPECT_EQ(3u, motion->first);
+  EXPECT_EQ(4u, motion->last);
+  EXPECT_TRUE(mapped.findMotion(1, 2) == NULL);
+
+  // a file for a different state space is rejected
+  ompl_interface::ModelBasedStateSpaceSpecification other_spec(robot_model_, "arms");
+  ompl_interface::ModelBasedStateSpacePtr other_space(new ompl_interface::JointModelStateSpace(other_spec));
+  other_space->setup();
+  EXPECT_FALSE(FlatConstraintApproximation(other_space, filename).isValid());
+  std::remove(filename.c_str());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
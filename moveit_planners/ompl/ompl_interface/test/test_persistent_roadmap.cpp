@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/persistent_roadmap.h>
+#include <moveit/ompl_interface/parameterization/joint_space/joint_model_state_space.h>
+#include <moveit_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shapes.h>
+#include <ompl/base/SpaceInformation.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdio>
+#include <boost/filesystem/path.hpp>
+
+using ompl_interface::PersistentRoadmap;
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    boost::filesystem::path res_path(MOVEIT_TEST_RESOURCES_DIR);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "pr2_description/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    srdf_model_->initFile(*urdf_model_, (res_path / "pr2_description/srdf/robot.xml").string());
+    robot_model_.reset(new moveit::core::RobotModel(urdf_model_, srdf_model_));
+  };
+
+protected:
+  robot_model::RobotModelPtr robot_model_;
+  urdf::ModelInterfaceSharedPtr urdf_model_;
+  srdf::ModelSharedPtr srdf_model_;
+};
+
+TEST_F(LoadPlanningModelsPr2, PersistentRoadmap)
+{
+  ompl_interface::ModelBasedStateSpaceSpecification spec(robot_model_, "right_arm");
+  ompl_interface::ModelBasedStateSpacePtr space(new ompl_interface::JointModelStateSpace(spec));
+  ompl::base::SpaceInformationPtr si(new ompl::base::SpaceInformation(space));
+  si->setup();
+
+  planning_scene::PlanningScene scene(robot_model_);
+  moveit_msgs::Constraints constraints;
+  PersistentRoadmap roadmap(space);
+  roadmap.synchronize(scene, scene.getCurrentState(), constraints);
+
+  // a chain of three states, each close enough to be connected to the previous one
+  robot_state::RobotState state(robot_model_);
+  state.setToDefaultValues();
+  ompl::base::State* s = space->allocState();
+  space->copyToOMPLState(s, state);
+  std::vector<std::size_t> vertices;
+  for (int i = 0; i < 3; ++i)
+  {
+    vertices.push_back(roadmap.addVertex(s, 0.15, 10));
+    s->as<ompl_interface::ModelBasedStateSpace::StateType>()->values[0] += 0.1;
+  }
+  // repeated states are not added again
+  s->as<ompl_interface::ModelBasedStateSpace::StateType>()->values[0] -= 0.1;
+  EXPECT_EQ(vertices[2], roadmap.addVertex(s, 0.15, 10));
+  space->freeState(s);
+  EXPECT_EQ(3u, roadmap.getVertexCount());
+  EXPECT_EQ(2u, roadmap.getEdgeCount());
+
+  std::vector<std::size_t> path;
+  ASSERT_TRUE(roadmap.searchPath(std::vector<std::size_t>(1, vertices[0]), std::vector<std::size_t>(1, vertices[2]),
+                                 path));
+  EXPECT_EQ(vertices, path);
+  EXPECT_EQ(PersistentRoadmap::VALIDITY_UNKNOWN, roadmap.getVertexValidity(vertices[1]));
+  EXPECT_TRUE(roadmap.validatePath(si, path));
+  EXPECT_EQ(PersistentRoadmap::VALIDITY_VALID, roadmap.getVertexValidity(vertices[1]));
+
+  // objects far from the arm keep the validity information, objects around it do not
+  Eigen::Affine3d pose = Eigen::Affine3d::Identity();
+  pose.translation() = Eigen::Vector3d(100.0, 0.0, 0.0);
+  scene.getWorldNonConst()->addToObject("far", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)), pose);
+  roadmap.synchronize(scene, scene.getCurrentState(), constraints);
+  EXPECT_EQ(PersistentRoadmap::VALIDITY_VALID, roadmap.getVertexValidity(vertices[1]));
+
+  scene.getWorldNonConst()->addToObject("near", shapes::ShapeConstPtr(new shapes::Box(4.0, 4.0, 4.0)),
+                                        Eigen::Affine3d::Identity());
+  roadmap.synchronize(scene, scene.getCurrentState(), constraints);
+  EXPECT_EQ(PersistentRoadmap::VALIDITY_UNKNOWN, roadmap.getVertexValidity(vertices[1]));
+
+  // the graph survives a round trip through a file
+  std::string filename = (boost::filesystem::temp_directory_path() / "test_persistent_roadmap.roadmap").string();
+  ASSERT_TRUE(roadmap.save(filename));
+  PersistentRoadmap loaded(space);
+  ASSERT_TRUE(loaded.load(filename));
+  std::remove(filename.c_str());
+  EXPECT_EQ(roadmap.getVertexCount(), loaded.getVertexCount());
+  EXPECT_EQ(roadmap.getEdgeCount(), loaded.getEdgeCount());
+  ASSERT_TRUE(loaded.searchPath(std::vector<std::size_t>(1, vertices[0]), std::vector<std::size_t>(1, vertices[2]),
+                                path));
+  EXPECT_EQ(vertices, path);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
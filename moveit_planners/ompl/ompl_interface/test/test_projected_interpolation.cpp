@@ -0,0 +1,145 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/projected_interpolation.h>
+#include <moveit/ompl_interface/parameterization/joint_space/joint_model_state_space.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <boost/filesystem/path.hpp>
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    boost::filesystem::path res_path(MOVEIT_TEST_RESOURCES_DIR);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "pr2_description/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    srdf_model_->initFile(*urdf_model_, (res_path / "pr2_description/srdf/robot.xml").string());
+    robot_model_.reset(new moveit::core::RobotModel(urdf_model_, srdf_model_));
+  };
+
+protected:
+  robot_model::RobotModelPtr robot_model_;
+  urdf::ModelInterfaceSharedPtr urdf_model_;
+  srdf::ModelSharedPtr srdf_model_;
+};
+
+TEST_F(LoadPlanningModelsPr2, ProjectedInterpolation)
+{
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(robot_model_));
+  ompl_interface::ModelBasedStateSpaceSpecification spec(robot_model_, "left_arm");
+  ompl_interface::ModelBasedStateSpacePtr space(new ompl_interface::JointModelStateSpace(spec));
+  space->setup();
+  robot_state::RobotState start_state(robot_model_);
+  start_state.setToDefaultValues();
+  start_state.update();
+
+  // keep the wrist at the orientation it has in the default state
+  moveit_msgs::Constraints constr;
+  constr.orientation_constraints.resize(1);
+  constr.orientation_constraints[0].link_name = "l_wrist_roll_link";
+  constr.orientation_constraints[0].header.frame_id = robot_model_->getModelFrame();
+  Eigen::Quaterniond q(start_state.getGlobalLinkTransform("l_wrist_roll_link").linear());
+  constr.orientation_constraints[0].orientation.x = q.x();
+  constr.orientation_constraints[0].orientation.y = q.y();
+  constr.orientation_constraints[0].orientation.z = q.z();
+  constr.orientation_constraints[0].orientation.w = q.w();
+  constr.orientation_constraints[0].absolute_x_axis_tolerance = 0.02;
+  constr.orientation_constraints[0].absolute_y_axis_tolerance = 0.02;
+  constr.orientation_constraints[0].absolute_z_axis_tolerance = 0.02;
+  constr.orientation_constraints[0].weight = 1.0;
+  kinematic_constraints::KinematicConstraintSet kset(robot_model_);
+  kset.add(constr, scene->getTransforms());
+
+  ompl_interface::ProjectedInterpolationPtr interpolation(
+      new ompl_interface::ProjectedInterpolation(scene, space, start_state, constr));
+  ASSERT_TRUE(interpolation->isValid());
+
+  // two states that satisfy the constraints, with the wrist moved along the elbow
+  robot_state::RobotState goal_state(start_state);
+  constraint_samplers::ProjectionConstraintSampler sampler(scene, "left_arm");
+  ASSERT_TRUE(sampler.configure(constr));
+  goal_state.setVariablePosition("l_shoulder_pan_joint", 0.6);
+  goal_state.setVariablePosition("l_elbow_flex_joint", -1.0);
+  ASSERT_TRUE(sampler.project(goal_state, 10));
+  goal_state.update();
+  ASSERT_TRUE(kset.decide(goal_state).satisfied);
+
+  ompl::base::State* from = space->allocState();
+  ompl::base::State* to = space->allocState();
+  ompl::base::State* state = space->allocState();
+  space->copyToOMPLState(from, start_state);
+  space->copyToOMPLState(to, goal_state);
+
+  // the end points are left to the state space
+  EXPECT_FALSE(interpolation->interpolate(from, to, 0.0, state));
+  EXPECT_FALSE(interpolation->interpolate(from, to, 1.0, state));
+
+  space->setInterpolationFunction(ompl_interface::ProjectedInterpolation::getInterpolationFunction(interpolation));
+  robot_state::RobotState interpolated(start_state);
+  for (int i = 1; i < 10; ++i)
+  {
+    space->interpolate(from, to, 0.1 * i, state);
+    space->copyToRobotState(interpolated, state);
+    interpolated.update();
+    EXPECT_TRUE(kset.decide(interpolated).satisfied);
+    EXPECT_LE(space->distance(from, state), space->distance(from, to) * 2.0);
+  }
+
+  space->freeState(from);
+  space->freeState(to);
+  space->freeState(state);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
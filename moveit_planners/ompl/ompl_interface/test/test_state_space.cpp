@@ -170,6 +170,39 @@ TEST_F(LoadPlanningModelsPr2, StateSpaceCopy)
   ss.freeState(state);
 }
 
+TEST_F(LoadPlanningModelsPr2, StateSpaceDistanceInterpolate)
+{
+  // right_arm consists of revolute joints, some of them continuous, and uses the direct computation
+  ompl_interface::ModelBasedStateSpaceSpecification spec(robot_model_, "right_arm");
+  ompl_interface::JointModelStateSpace ss(spec);
+  ss.setup();
+  const robot_model::JointModelGroup* jmg = robot_model_->getJointModelGroup("right_arm");
+
+  robot_state::RobotState kstate(robot_model_);
+  ompl::base::State* s1 = ss.allocState();
+  ompl::base::State* s2 = ss.allocState();
+  ompl::base::State* s3 = ss.allocState();
+  std::vector<double> expected(jmg->getVariableCount());
+  for (int i = 0; i < 100; ++i)
+  {
+    kstate.setToRandomPositions(jmg);
+    ss.copyToOMPLState(s1, kstate);
+    kstate.setToRandomPositions(jmg);
+    ss.copyToOMPLState(s2, kstate);
+    const double* v1 = s1->as<ompl_interface::ModelBasedStateSpace::StateType>()->values;
+    const double* v2 = s2->as<ompl_interface::ModelBasedStateSpace::StateType>()->values;
+    EXPECT_NEAR(jmg->distance(v1, v2), ss.distance(s1, s2), 1e-9);
+
+    ss.interpolate(s1, s2, 0.3, s3);
+    jmg->interpolate(v1, v2, 0.3, &expected[0]);
+    for (std::size_t j = 0; j < expected.size(); ++j)
+      EXPECT_NEAR(expected[j], s3->as<ompl_interface::ModelBasedStateSpace::StateType>()->values[j], 1e-12);
+  }
+  ss.freeState(s1);
+  ss.freeState(s2);
+  ss.freeState(s3);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,157 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+#include <moveit/ompl_interface/detail/validity_cache.h>
+#include <moveit_resources/config.h>
+#include <urdf_parser/urdf_parser.h>
+#include <geometric_shapes/shapes.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <boost/filesystem/path.hpp>
+
+using ompl_interface::ValidityCache;
+
+TEST(ValidityCache, StoreAndLookup)
+{
+  ValidityCache cache(64, 0.01);
+  double a[2] = { 0.1, 0.2 };
+  double b[2] = { 0.1, 0.2004 };
+  double c[2] = { 0.1, 0.25 };
+
+  // values are rounded to the resolution, and the fingerprint is part of the key
+  EXPECT_EQ(cache.getStateKey(1, a, 2), cache.getStateKey(1, b, 2));
+  EXPECT_NE(cache.getStateKey(1, a, 2), cache.getStateKey(1, c, 2));
+  EXPECT_NE(cache.getStateKey(1, a, 2), cache.getStateKey(2, a, 2));
+
+  uint64_t ka = cache.getStateKey(1, a, 2);
+  uint64_t kc = cache.getStateKey(1, c, 2);
+  EXPECT_EQ(ValidityCache::getMotionKey(ka, kc), ValidityCache::getMotionKey(kc, ka));
+  EXPECT_NE(ValidityCache::getMotionKey(ka, kc), ka);
+
+  bool valid;
+  EXPECT_FALSE(cache.lookup(ka, valid));
+  cache.store(ka, true);
+  cache.store(kc, false);
+  ASSERT_TRUE(cache.lookup(ka, valid));
+  EXPECT_TRUE(valid);
+  ASSERT_TRUE(cache.lookup(kc, valid));
+  EXPECT_FALSE(valid);
+  EXPECT_EQ(2u, cache.getHitCount());
+  EXPECT_EQ(1u, cache.getMissCount());
+
+  cache.clear();
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_FALSE(cache.lookup(ka, valid));
+}
+
+TEST(ValidityCache, Bounded)
+{
+  ValidityCache cache(320, 0.01);
+  for (int i = 0; i < 10000; ++i)
+  {
+    double value = i;
+    cache.store(cache.getStateKey(1, &value, 1), true);
+  }
+  EXPECT_LE(cache.size(), 320u);
+  EXPECT_GT(cache.size(), 0u);
+}
+
+class LoadPlanningModelsPr2 : public testing::Test
+{
+protected:
+  virtual void SetUp()
+  {
+    boost::filesystem::path res_path(MOVEIT_TEST_RESOURCES_DIR);
+
+    srdf_model_.reset(new srdf::Model());
+    std::string xml_string;
+    std::fstream xml_file((res_path / "pr2_description/urdf/robot.xml").string().c_str(), std::fstream::in);
+    if (xml_file.is_open())
+    {
+      while (xml_file.good())
+      {
+        std::string line;
+        std::getline(xml_file, line);
+        xml_string += (line + "\n");
+      }
+      xml_file.close();
+      urdf_model_ = urdf::parseURDF(xml_string);
+    }
+    srdf_model_->initFile(*urdf_model_, (res_path / "pr2_description/srdf/robot.xml").string());
+    robot_model_.reset(new moveit::core::RobotModel(urdf_model_, srdf_model_));
+  };
+
+protected:
+  robot_model::RobotModelPtr robot_model_;
+  urdf::ModelInterfaceSharedPtr urdf_model_;
+  srdf::ModelSharedPtr srdf_model_;
+};
+
+TEST_F(LoadPlanningModelsPr2, SceneFingerprint)
+{
+  planning_scene::PlanningScene scene(robot_model_);
+  robot_state::RobotState state(robot_model_);
+  state.setToDefaultValues();
+  moveit_msgs::Constraints constraints;
+
+  uint64_t empty = ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints);
+  EXPECT_NE(0u, empty);
+  EXPECT_EQ(empty, ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints));
+  EXPECT_NE(empty, ValidityCache::computeSceneFingerprint(scene, state, "left_arm", constraints));
+
+  // the joints of the group do not matter, the others do
+  const robot_model::JointModelGroup* right_arm = robot_model_->getJointModelGroup("right_arm");
+  std::vector<double> values;
+  state.copyJointGroupPositions(right_arm, values);
+  values[0] += 0.1;
+  state.setJointGroupPositions(right_arm, values);
+  EXPECT_EQ(empty, ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints));
+  EXPECT_NE(empty, ValidityCache::computeSceneFingerprint(scene, state, "left_arm", constraints));
+
+  // world and allowed collision changes
+  scene.getWorldNonConst()->addToObject("box", shapes::ShapeConstPtr(new shapes::Box(0.1, 0.1, 0.1)),
+                                        Eigen::Affine3d::Identity());
+  uint64_t with_box = ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints);
+  EXPECT_NE(empty, with_box);
+  scene.getAllowedCollisionMatrixNonConst().setEntry("box", "r_gripper_palm_link", true);
+  EXPECT_NE(with_box, ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints));
+
+  constraints.name = "path";
+  EXPECT_NE(with_box, ValidityCache::computeSceneFingerprint(scene, state, "right_arm", constraints));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
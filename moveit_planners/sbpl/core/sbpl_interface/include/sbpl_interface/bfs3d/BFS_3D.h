@@ -38,6 +38,7 @@
 #define _SBPL_BFS_3D_H_
 
 #include <boost/thread.hpp>
+#include <vector>
 
 namespace sbpl_interface
 {
@@ -53,14 +54,17 @@ private:
   int origin;
   int volatile* distance_grid;
 
-  int* queue;
-  int queue_head, queue_tail;
+  // the nodes of the current level of the search, and the nodes each thread discovers for the next one
+  std::vector<int> frontier;
+  std::vector<std::vector<int> > next_frontiers;
+  int thread_count;
 
   boost::shared_ptr<boost::thread> search_thread_;
 
   volatile bool running;
 
-  void search(int, int, int volatile*, int*, int&, int&);
+  void search(int, int, int volatile*);
+  void expand(int, int, int volatile*, size_t, size_t, std::vector<int>&);
   inline int getNode(int, int, int);
 
 public:
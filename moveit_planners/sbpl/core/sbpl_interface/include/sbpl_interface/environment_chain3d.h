@@ -65,11 +65,12 @@ namespace sbpl_interface
 {
 struct PlanningStatistics
 {
-  PlanningStatistics() : total_expansions_(0), coll_checks_(0)
+  PlanningStatistics() : total_expansions_(0), cached_expansions_(0), coll_checks_(0)
   {
   }
 
   unsigned int total_expansions_;
+  unsigned int cached_expansions_;
   ros::WallDuration total_expansion_time_;
   ros::WallDuration total_coll_check_time_;
   unsigned int coll_checks_;
@@ -84,6 +85,7 @@ struct PlanningParameters
     , attempt_full_shortcut_(true)
     , interpolation_distance_(DEFAULT_INTERPOLATION_DISTANCE)
     , joint_motion_primitive_distance_(DEFAULT_JOINT_MOTION_PRIMITIVE_DISTANCE)
+    , reuse_search_(false)
   {
   }
 
@@ -92,6 +94,7 @@ struct PlanningParameters
   bool attempt_full_shortcut_;
   double interpolation_distance_;
   double joint_motion_primitive_distance_;
+  bool reuse_search_;  // keep the environment and the planner for the next plan of the same group
 };
 
 /** Environment to be used when planning for a Robotic Arm using the SBPL. */
@@ -219,6 +222,21 @@ public:
     return planning_data_;
   }
 
+  /**
+   * @brief Check if this environment can be set up again for a plan of the group with the parameters, keeping the
+   * states, stored successors and interpolated segments of its previous plans
+   */
+  bool canBeReusedFor(const std::string& group_name, const PlanningParameters& params) const;
+
+  /**
+   * @brief Whether the obstacles may have changed between the previous and the last setup; always true for the first
+   * setup, and with standard collision checking, which does not collect the obstacle cells
+   */
+  bool obstaclesChanged() const
+  {
+    return obstacles_changed_;
+  }
+
   bool populateTrajectoryFromStateIDSequence(const std::vector<int>& state_ids,
                                              trajectory_msgs::JointTrajectory& traj) const;
 
@@ -244,7 +262,9 @@ protected:
   planning_scene::PlanningSceneConstPtr planning_scene_;
 
   double angle_discretization_;
-  BFS_3D* bfs_;
+  boost::shared_ptr<BFS_3D> bfs_;
+  std::vector<int> bfs_walls_;  // the wall cells of the bfs grid, which identify the obstacles it was built for
+  bool obstacles_changed_;
 
   std::vector<boost::shared_ptr<JointMotionWrapper> > joint_motion_wrappers_;
   std::vector<boost::shared_ptr<JointMotionPrimitive> > possible_actions_;
@@ -281,6 +301,7 @@ protected:
   int calculateCost(EnvChain3DHashEntry* HashEntry1, EnvChain3DHashEntry* HashEntry2);
   int getBFSCostToGoal(int x, int y, int z) const;
   int getEndEffectorHeuristic(int FromStateID, int ToStateID);
+  bool isGoalDistance(const std::vector<double>& angles, const int (&xyz)[3]) const;
 
   double getJointDistanceDoubleSum(const std::vector<double>& angles1, const std::vector<double>& angles2) const;
 
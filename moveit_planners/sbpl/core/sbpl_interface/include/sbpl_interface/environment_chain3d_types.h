@@ -65,6 +65,11 @@ struct EnvChain3DHashEntry
   int xyz[3];                  // tip link coordinates in space
   std::vector<int> coord;      // position in the angle discretization
   std::vector<double> angles;  // position of joints in continuous space
+
+  // the valid successors and their costs, stored by the first expansion and reused when the state is expanded again
+  bool successors_generated;
+  std::vector<int> successor_ids;
+  std::vector<int> successor_costs;
 };
 
 /** @brief struct that describes a basic joint constraint */
@@ -153,6 +158,17 @@ struct EnvChain3DPlanningData
     return NULL;
   }
 
+  // forget the successors stored by the expansions of earlier plans, e.g. after the goal changed
+  void clearSuccessors()
+  {
+    for (unsigned int i = 0; i < state_ID_to_coord_table_.size(); i++)
+    {
+      state_ID_to_coord_table_[i]->successors_generated = false;
+      state_ID_to_coord_table_[i]->successor_ids.clear();
+      state_ID_to_coord_table_[i]->successor_costs.clear();
+    }
+  }
+
   bool convertFromStateIDsToAngles(const std::vector<int>& state_ids,
                                    std::vector<std::vector<double> >& angle_vector) const
   {
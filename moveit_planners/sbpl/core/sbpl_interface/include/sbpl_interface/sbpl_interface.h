@@ -64,6 +64,11 @@ public:
 protected:
   PlanningStatistics last_planning_statistics_;
 
+  // the environment and the planner kept for the next plan if reuse_search_ is set; the planner refers to the
+  // environment, so it is declared last and destroyed first
+  mutable boost::shared_ptr<EnvironmentChain3D> env_chain_;
+  mutable boost::shared_ptr<ARAPlanner> planner_;
+
   // DummyEnvironment* dummy_env_;
   // SBPLPlanner *planner_;
 };
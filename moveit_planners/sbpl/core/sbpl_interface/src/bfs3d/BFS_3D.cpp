@@ -1,4 +1,5 @@
 #include <sbpl_interface/bfs3d/BFS_3D.h>
+#include <algorithm>
 
 namespace sbpl_interface
 {
@@ -28,7 +29,8 @@ BFS_3D::BFS_3D(int width, int height, int length)
   dim_xyz = dim_xy * dim_z;
 
   distance_grid = new int[dim_xyz];
-  queue = new int[width * height * length];
+  thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  next_frontiers.resize(thread_count);
 
   for (int node = 0; node < dim_xyz; node++)
   {
@@ -51,7 +53,6 @@ BFS_3D::~BFS_3D()
   }
 
   delete[] distance_grid;
-  delete[] queue;
 }
 
 void BFS_3D::getDimensions(int* width, int* height, int* length)
@@ -93,14 +94,11 @@ void BFS_3D::run(int x, int y, int z)
 
   origin = getNode(x, y, z);
 
-  queue_head = 0;
-  queue_tail = 1;
-  queue[0] = origin;
+  frontier.assign(1, origin);
 
   distance_grid[origin] = 0;
 
-  search_thread_.reset(
-      new boost::thread(&BFS_3D::search, this, dim_x, dim_xy, distance_grid, queue, queue_head, queue_tail));
+  search_thread_.reset(new boost::thread(&BFS_3D::search, this, dim_x, dim_xy, distance_grid));
   running = true;
 }
 
@@ -1,22 +1,29 @@
 #include <sbpl_interface/bfs3d/BFS_3D.h>
 #include <iostream>
 #include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 namespace sbpl_interface
 {
+// levels smaller than this many nodes per thread are expanded by the search thread alone
+static const size_t MIN_NODES_PER_THREAD = 1024;
+
+// threads expanding the same level may reach the same node, so it is claimed with a compare and swap
 #define EXPAND_NEIGHBOR(offset)                                                                                        \
-  if (distance_grid[currentNode + offset] < 0)                                                                         \
+  if (distance_grid[currentNode + offset] < 0 &&                                                                       \
+      __sync_bool_compare_and_swap(&distance_grid[currentNode + offset], (int)UNDISCOVERED, currentCost))              \
   {                                                                                                                    \
-    queue[queue_tail++] = currentNode + offset;                                                                        \
-    distance_grid[currentNode + offset] = currentCost;                                                                 \
+    next.push_back(currentNode + offset);                                                                              \
     boost::this_thread::interruption_point();                                                                          \
   }
 
-void BFS_3D::search(int width, int planeSize, int volatile* distance_grid, int* queue, int& queue_head, int& queue_tail)
+void BFS_3D::expand(int width, int planeSize, int volatile* distance_grid, size_t begin, size_t end,
+                    std::vector<int>& next)
 {
-  while (queue_head < queue_tail)
+  for (size_t i = begin; i < end; i++)
   {
-    int currentNode = queue[queue_head++];
+    int currentNode = frontier[i];
     int currentCost = distance_grid[currentNode] + 1;
 
     EXPAND_NEIGHBOR(-width);
@@ -46,6 +53,46 @@ void BFS_3D::search(int width, int planeSize, int volatile* distance_grid, int*
     EXPAND_NEIGHBOR(width + 1 - planeSize);
     EXPAND_NEIGHBOR(width - 1 - planeSize);
   }
+}
+
+void BFS_3D::search(int width, int planeSize, int volatile* distance_grid)
+{
+  // expand the search one level at a time, splitting large levels over the threads
+  while (!frontier.empty())
+  {
+    boost::this_thread::interruption_point();
+    int level_threads = std::min<size_t>(thread_count, frontier.size() / MIN_NODES_PER_THREAD);
+    if (level_threads <= 1)
+    {
+      next_frontiers[0].clear();
+      expand(width, planeSize, distance_grid, 0, frontier.size(), next_frontiers[0]);
+      frontier.swap(next_frontiers[0]);
+      continue;
+    }
+
+    boost::thread_group workers;
+    try
+    {
+      for (int t = 0; t < level_threads; t++)
+      {
+        next_frontiers[t].clear();
+        workers.create_thread(boost::bind(&BFS_3D::expand, this, width, planeSize, distance_grid,
+                                          frontier.size() * t / level_threads,
+                                          frontier.size() * (t + 1) / level_threads, boost::ref(next_frontiers[t])));
+      }
+      workers.join_all();
+    }
+    catch (boost::thread_interrupted&)
+    {
+      workers.interrupt_all();
+      workers.join_all();
+      throw;
+    }
+
+    frontier.clear();
+    for (int t = 0; t < level_threads; t++)
+      frontier.insert(frontier.end(), next_frontiers[t].begin(), next_frontiers[t].end());
+  }
   // std::cerr << "Search thread done" << std::endl;
   running = false;
 }
@@ -47,9 +47,23 @@ static const double JOINT_DIST_MULT = 1000.0;
 
 namespace sbpl_interface
 {
+namespace
+{
+// the bfs heuristic of the last motion plan, reused by plans with the same goal cell and wall cells
+struct BFSCache
+{
+  boost::mutex lock;
+  boost::shared_ptr<BFS_3D> bfs;
+  int dims[3];
+  int goal_xyz[3];
+  std::vector<int> walls;
+};
+BFSCache bfs_cache;
+}
+
 EnvironmentChain3D::EnvironmentChain3D(const planning_scene::PlanningSceneConstPtr& planning_scene)
   : planning_scene_(planning_scene)
-  , bfs_(NULL)
+  , obstacles_changed_(true)
   , state_(planning_scene->getCurrentState())
   , planning_data_(StateID2IndexMapping)
   , goal_constraint_set_(planning_scene->getRobotModel(), planning_scene->getTransforms())
@@ -63,10 +77,6 @@ EnvironmentChain3D::EnvironmentChain3D(const planning_scene::PlanningSceneConstP
 
 EnvironmentChain3D::~EnvironmentChain3D()
 {
-  if (bfs_ != NULL)
-  {
-    delete bfs_;
-  }
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -173,6 +183,17 @@ void EnvironmentChain3D::GetSuccs(int source_state_ID, std::vector<int>* succ_id
 
   EnvChain3DHashEntry* hash_entry = planning_data_.state_ID_to_coord_table_[source_state_ID];
 
+  // the scene does not change during a plan, so states expanded again in later ARA* iterations keep their successors
+  if (hash_entry->successors_generated)
+  {
+    *succ_idv = hash_entry->successor_ids;
+    *cost_v = hash_entry->successor_costs;
+    planning_statistics_.total_expansions_++;
+    planning_statistics_.cached_expansions_++;
+    planning_statistics_.total_expansion_time_ += ros::WallTime::now() - expansion_start_time;
+    return;
+  }
+
   std::vector<double> source_joint_angles = hash_entry->angles;
   // convertCoordToJointAngles(hash_entry->coord, source_joint_angles);
 
@@ -228,6 +249,22 @@ void EnvironmentChain3D::GetSuccs(int source_state_ID, std::vector<int>* succ_id
     // }
     convertJointAnglesToCoord(succ_joint_angles, succ_coord);
 
+    // a segment interpolated by an earlier plan, with the same obstacles, leads to a state known to be valid; only
+    // the states that may connect to the goal are checked again
+    EnvChain3DHashEntry* known_hash_entry = planning_data_.getHashEntry(succ_coord, i);
+    if (known_hash_entry && known_hash_entry != planning_data_.goal_hash_entry_ &&
+        !isGoalDistance(known_hash_entry->angles, known_hash_entry->xyz))
+    {
+      std::map<int, std::map<int, std::vector<std::vector<double> > > >::const_iterator segments =
+          generated_interpolations_map_.find(source_state_ID);
+      if (segments != generated_interpolations_map_.end() && segments->second.count(known_hash_entry->stateID))
+      {
+        succ_idv->push_back(known_hash_entry->stateID);
+        cost_v->push_back(calculateCost(hash_entry, known_hash_entry));
+        continue;
+      }
+    }
+
     joint_state_group_->setStateValues(succ_joint_angles);
 
     kinematic_constraints::ConstraintEvaluationResult con_res = path_constraint_set_.decide(state_);
@@ -277,16 +314,6 @@ void EnvironmentChain3D::GetSuccs(int source_state_ID, std::vector<int>* succ_id
         continue;
       }
     }
-    int dist;
-    if (planning_parameters_.use_bfs_)
-    {
-      dist = getBFSCostToGoal(xyz[0], xyz[1], xyz[2]);
-    }
-    else
-    {
-      dist = getJointDistanceIntegerMax(succ_joint_angles, planning_data_.goal_hash_entry_->angles,
-                                        planning_parameters_.joint_motion_primitive_distance_);
-    }
 
     EnvChain3DHashEntry* succ_hash_entry = NULL;
     // bool can_get_closer = false;
@@ -302,7 +329,7 @@ void EnvironmentChain3D::GetSuccs(int source_state_ID, std::vector<int>* succ_id
     // }
     // if(!can_get_closer) {
     bool succ_is_goal_state = false;
-    if ((planning_parameters_.use_bfs_ && dist == 0) || (!planning_parameters_.use_bfs_ && dist == 1))
+    if (isGoalDistance(succ_joint_angles, xyz))
     {
       // std::cerr << "Joint distance for goal move " <<
       // getJointDistanceDoubleSum(planning_data_.goal_hash_entry_->angles, succ_joint_angles) << std::endl;
@@ -392,6 +419,9 @@ void EnvironmentChain3D::GetSuccs(int source_state_ID, std::vector<int>* succ_id
     succ_idv->push_back(succ_hash_entry->stateID);
     cost_v->push_back(calculateCost(hash_entry, succ_hash_entry));
   }
+  hash_entry->successors_generated = true;
+  hash_entry->successor_ids = *succ_idv;
+  hash_entry->successor_costs = *cost_v;
   planning_statistics_.total_expansion_time_ += ros::WallTime::now() - expansion_start_time;
 }
 
@@ -431,6 +461,18 @@ bool EnvironmentChain3D::setupForMotionPlan(const planning_scene::PlanningSceneC
   std::cerr << "really here " << std::endl;
   planning_scene_ = planning_scene;
 
+  // an environment kept from an earlier plan still has its states; the search data of the plan itself is reset
+  bool repeated_setup = !planning_data_.state_ID_to_coord_table_.empty();
+  std::vector<int> previous_walls;
+  if (repeated_setup)
+  {
+    previous_walls.swap(bfs_walls_);
+    gsr_.reset();
+    joint_motion_wrappers_.clear();
+    planning_statistics_ = PlanningStatistics();
+    closest_to_goal_ = DBL_MAX;
+  }
+
   planning_group_ = mreq.motion_plan_request.group_name;
   planning_parameters_ = params;
 
@@ -501,11 +543,10 @@ bool EnvironmentChain3D::setupForMotionPlan(const planning_scene::PlanningSceneC
   {
     planning_parameters_.use_bfs_ = false;
   }
-  if (!planning_parameters_.use_standard_collision_checking_ && planning_parameters_.use_bfs_)
+  // the walls also tell a kept environment whether the obstacles changed
+  if (!planning_parameters_.use_standard_collision_checking_ &&
+      (planning_parameters_.use_bfs_ || planning_parameters_.reuse_search_))
   {
-    bfs_ = new BFS_3D(gsr_->dfce_->distance_field_->getXNumCells(), gsr_->dfce_->distance_field_->getYNumCells(),
-                      gsr_->dfce_->distance_field_->getZNumCells());
-
     boost::shared_ptr<const distance_field::DistanceField> world_distance_field =
         hy_world_->getCollisionWorldDistanceField()->getDistanceField();
     if (world_distance_field->getXNumCells() != gsr_->dfce_->distance_field_->getXNumCells() ||
@@ -521,25 +562,27 @@ bool EnvironmentChain3D::setupForMotionPlan(const planning_scene::PlanningSceneC
     //           << world_distance_field->getXNumCells() << " "
     //           << world_distance_field->getYNumCells() << " "
     //           << world_distance_field->getZNumCells() << std::endl;
-    unsigned int wall_count = 0;
+    // the walls are only collected here; the grid is built when the goal is known, unless it can be reused
+    bfs_walls_.clear();
+    int size_y = gsr_->dfce_->distance_field_->getYNumCells() - 2;
+    int size_z = gsr_->dfce_->distance_field_->getZNumCells() - 2;
     for (int i = 0; i < gsr_->dfce_->distance_field_->getXNumCells() - 2; i++)
     {
-      for (int j = 0; j < gsr_->dfce_->distance_field_->getYNumCells() - 2; j++)
+      for (int j = 0; j < size_y; j++)
       {
-        for (int k = 0; k < gsr_->dfce_->distance_field_->getZNumCells() - 2; k++)
+        for (int k = 0; k < size_z; k++)
         {
           boost::this_thread::interruption_point();
           if (gsr_->dfce_->distance_field_->getDistanceFromCell(i + 1, j + 1, k + 1) == 0.0 ||
               world_distance_field->getDistanceFromCell(i + 1, j + 1, k + 1) == 0.0)
           {
-            bfs_->setWall(i + 1, j + 1, k + 1);
-            wall_count++;
+            bfs_walls_.push_back((i * size_y + j) * size_z + k);
           }
         }
       }
     }
   }
-  // std::cerr << "Wall cells are " << wall_count << " of " <<
+  // std::cerr << "Wall cells are " << bfs_walls_.size() << " of " <<
   //   world_distance_field->getXNumCells()*world_distance_field->getYNumCells()*world_distance_field->getZNumCells() <<
   //   std::endl;
 
@@ -566,7 +609,8 @@ bool EnvironmentChain3D::setupForMotionPlan(const planning_scene::PlanningSceneC
     start_xyz[1] = 0.0;
     start_xyz[2] = 0.0;
   }
-  planning_data_.start_hash_entry_ = planning_data_.addHashEntry(start_coords, start_joint_values, start_xyz, 0);
+  if (!repeated_setup || planning_data_.start_hash_entry_->angles != start_joint_values)
+    planning_data_.start_hash_entry_ = planning_data_.addHashEntry(start_coords, start_joint_values, start_xyz, 0);
 
   // setting goal position
   planning_models::RobotState* goal_state(state_);
@@ -627,18 +671,66 @@ bool EnvironmentChain3D::setupForMotionPlan(const planning_scene::PlanningSceneC
   // std::cerr << "Running bfs with goal " << goal_xyz[0] << " " <<  goal_xyz[1] << " " << goal_xyz[2] << std::endl;
   if (planning_parameters_.use_bfs_)
   {
-    bfs_->run(goal_xyz[0], goal_xyz[1], goal_xyz[2]);
+    int dims[3] = { gsr_->dfce_->distance_field_->getXNumCells(), gsr_->dfce_->distance_field_->getYNumCells(),
+                    gsr_->dfce_->distance_field_->getZNumCells() };
+    boost::mutex::scoped_lock slock(bfs_cache.lock);
+    if (bfs_cache.bfs && std::equal(dims, dims + 3, bfs_cache.dims) &&
+        std::equal(goal_xyz, goal_xyz + 3, bfs_cache.goal_xyz) && bfs_cache.walls == bfs_walls_)
+    {
+      ROS_DEBUG_STREAM("Reusing the bfs heuristic of the previous plan");
+      bfs_ = bfs_cache.bfs;
+    }
+    else
+    {
+      bfs_.reset(new BFS_3D(dims[0], dims[1], dims[2]));
+      int size_y = dims[1] - 2;
+      int size_z = dims[2] - 2;
+      for (std::size_t i = 0; i < bfs_walls_.size(); i++)
+      {
+        int cell = bfs_walls_[i];
+        bfs_->setWall(cell / (size_y * size_z) + 1, cell / size_z % size_y + 1, cell % size_z + 1);
+      }
+      bfs_->run(goal_xyz[0], goal_xyz[1], goal_xyz[2]);
+      bfs_cache.bfs = bfs_;
+      std::copy(dims, dims + 3, bfs_cache.dims);
+      std::copy(goal_xyz, goal_xyz + 3, bfs_cache.goal_xyz);
+      bfs_cache.walls = bfs_walls_;
+    }
     // std::cerr << "Got start " << start_xyz[0] << " " <<  start_xyz[1] << " " << start_xyz[2] << " cost "
     //           << getBFSCostToGoal(start_xyz[0], start_xyz[1], start_xyz[2]) << std::endl;
   }
   goal_constraint_set_.clear();
   goal_constraint_set_.add(mreq.motion_plan_request.goal_constraints[0]);
-  planning_data_.goal_hash_entry_ = planning_data_.addHashEntry(goal_coords, goal_joint_values, goal_xyz, 0);
+  obstacles_changed_ =
+      !repeated_setup || planning_parameters_.use_standard_collision_checking_ || bfs_walls_ != previous_walls;
+  bool goal_changed = !repeated_setup || planning_data_.goal_hash_entry_->angles != goal_joint_values;
+  if (obstacles_changed_)
+  {
+    // the stored successors and segments were collision checked against other obstacles
+    planning_data_.clearSuccessors();
+    generated_interpolations_map_.clear();
+  }
+  else if (goal_changed)
+  {
+    // which successors connect to the goal depends on it; the collision free segments remain valid
+    planning_data_.clearSuccessors();
+  }
+  if (goal_changed)
+    planning_data_.goal_hash_entry_ = planning_data_.addHashEntry(goal_coords, goal_joint_values, goal_xyz, 0);
   path_constraint_set_.clear();
   path_constraint_set_.add(mreq.motion_plan_request.path_constraints);
   return true;
 }
 
+bool EnvironmentChain3D::canBeReusedFor(const std::string& group_name, const PlanningParameters& params) const
+{
+  return !planning_data_.state_ID_to_coord_table_.empty() && group_name == planning_group_ &&
+         params.use_bfs_ == planning_parameters_.use_bfs_ &&
+         params.use_standard_collision_checking_ == planning_parameters_.use_standard_collision_checking_ &&
+         params.interpolation_distance_ == planning_parameters_.interpolation_distance_ &&
+         params.joint_motion_primitive_distance_ == planning_parameters_.joint_motion_primitive_distance_;
+}
+
 void EnvironmentChain3D::setMotionPrimitives(const std::string& group_name)
 {
   possible_actions_.clear();
@@ -767,6 +859,14 @@ int EnvironmentChain3D::getBFSCostToGoal(int x, int y, int z) const
   //* .05;//prms_.cost_per_cell_;
 }
 
+bool EnvironmentChain3D::isGoalDistance(const std::vector<double>& angles, const int (&xyz)[3]) const
+{
+  if (planning_parameters_.use_bfs_)
+    return getBFSCostToGoal(xyz[0], xyz[1], xyz[2]) == 0;
+  return getJointDistanceIntegerMax(angles, planning_data_.goal_hash_entry_->angles,
+                                    planning_parameters_.joint_motion_primitive_distance_) == 1;
+}
+
 int EnvironmentChain3D::getJointDistanceIntegerSum(const std::vector<double>& angles1,
                                                    const std::vector<double>& angles2, double delta) const
 {
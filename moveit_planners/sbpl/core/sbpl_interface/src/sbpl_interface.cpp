@@ -49,7 +49,20 @@ bool SBPLInterface::solve(const planning_scene::PlanningSceneConstPtr& planning_
                                              start_state);
 
   ros::WallTime wt = ros::WallTime::now();
-  boost::shared_ptr<EnvironmentChain3D> env_chain(new EnvironmentChain3D(planning_scene));
+  // a kept environment and planner are only put back after a plan that did not fail in between
+  boost::shared_ptr<EnvironmentChain3D> env_chain;
+  boost::shared_ptr<ARAPlanner> planner;
+  if (params.reuse_search_ && env_chain_ && env_chain_->canBeReusedFor(req.motion_plan_request.group_name, params))
+  {
+    env_chain.swap(env_chain_);
+    planner.swap(planner_);
+  }
+  else
+  {
+    planner_.reset();
+    env_chain_.reset();
+    env_chain.reset(new EnvironmentChain3D(planning_scene));
+  }
   if (!env_chain->setupForMotionPlan(planning_scene, req, res, params))
   {
     // std::cerr << "Env chain setup failing" << std::endl;
@@ -60,10 +73,15 @@ bool SBPLInterface::solve(const planning_scene::PlanningSceneConstPtr& planning_
   boost::this_thread::interruption_point();
 
   // DummyEnvironment* dummy_env = new DummyEnvironment();
-  boost::shared_ptr<ARAPlanner> planner(new ARAPlanner(env_chain.get(), true));
-  planner->set_initialsolution_eps(100.0);
-  planner->set_search_mode(true);
-  planner->force_planning_from_scratch();
+  if (!planner)
+  {
+    planner.reset(new ARAPlanner(env_chain.get(), true));
+    planner->set_initialsolution_eps(100.0);
+    planner->set_search_mode(true);
+  }
+  // a kept search is only valid for the same edge costs
+  if (env_chain->obstaclesChanged())
+    planner->force_planning_from_scratch();
   planner->set_start(env_chain->getPlanningData().start_hash_entry_->stateID);
   planner->set_goal(env_chain->getPlanningData().goal_hash_entry_->stateID);
   // std::cerr << "Creation took " << (ros::WallTime::now()-wt) << std::endl;
@@ -74,6 +92,11 @@ bool SBPLInterface::solve(const planning_scene::PlanningSceneConstPtr& planning_
   bool b_ret = planner->replan(10.0, &solution_state_ids, &solution_cost);
   // CALLGRIND_STOP_INSTRUMENTATION;
   double el = (ros::WallTime::now() - wt).toSec();
+  if (params.reuse_search_)
+  {
+    env_chain_ = env_chain;
+    planner_ = planner;
+  }
   std::cerr << "B ret is " << b_ret << " planning time " << el << std::endl;
   std::cerr << "Expansions " << env_chain->getPlanningStatistics().total_expansions_ << " average time "
             << (env_chain->getPlanningStatistics().total_expansion_time_.toSec() /
@@ -82,6 +105,7 @@ bool SBPLInterface::solve(const planning_scene::PlanningSceneConstPtr& planning_
             << 1.0 / (env_chain->getPlanningStatistics().total_expansion_time_.toSec() /
                       (env_chain->getPlanningStatistics().total_expansions_ * 1.0))
             << std::endl;
+  std::cerr << "Cached expansions " << env_chain->getPlanningStatistics().cached_expansions_ << std::endl;
   std::cerr << "Total coll checks " << env_chain->getPlanningStatistics().coll_checks_ << " hz "
             << 1.0 / (env_chain->getPlanningStatistics().total_coll_check_time_.toSec() /
                       (env_chain->getPlanningStatistics().coll_checks_ * 1.0))
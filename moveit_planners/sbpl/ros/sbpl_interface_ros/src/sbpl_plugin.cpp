@@ -52,6 +52,7 @@ public:
     ros::NodeHandle nh;
     display_bfs_publisher_ = nh.advertise<visualization_msgs::Marker>("planning_components_visualization", 10, true);
     sbpl_interface_.reset(new sbpl_interface::SBPLInterface(model));
+    ros::NodeHandle("~").param("sbpl/reuse_search", reuse_search_, false);
   }
 
   bool canServiceRequest(const moveit_msgs::GetMotionPlan::Request& req,
@@ -67,6 +68,7 @@ public:
   {
     sbpl_interface::PlanningParameters params;
     params.use_bfs_ = false;
+    params.reuse_search_ = reuse_search_;
     bool solve_ok = sbpl_interface_->solve(planning_scene, req, res, params);
     return solve_ok;
   }
@@ -76,6 +78,7 @@ public:
   {
     sbpl_interface::PlanningParameters params;
     params.use_bfs_ = false;
+    params.reuse_search_ = reuse_search_;
 
     moveit_msgs::GetMotionPlan::Response res2;
     if (sbpl_interface_->solve(planning_scene, req, res2, params))
@@ -108,6 +111,7 @@ public:
 
 private:
   ros::Publisher display_bfs_publisher_;
+  bool reuse_search_;
   boost::shared_ptr<sbpl_interface::SBPLInterface> sbpl_interface_;
 };
 
@@ -112,6 +112,8 @@ public:
           controllers_[name].reset(new ViaPointController(name, joints, pub_));
         else if (type == "interpolate")
           controllers_[name].reset(new InterpolatingController(name, joints, pub_));
+        else if (type == "scheduled")
+          controllers_[name].reset(new ScheduledController(name, joints, pub_, getScheduler()));
         else
           ROS_ERROR_STREAM("Unknown fake controller type: " << type);
       }
@@ -196,6 +198,27 @@ public:
     return js;
   }
 
+  /*
+   * The scheduler shared by all controllers of type 'scheduled'; created on first use
+   */
+  const FakeControllerSchedulerPtr& getScheduler()
+  {
+    if (!scheduler_)
+    {
+      double rate, latency, jitter;
+      node_handle_.param("fake_controller_scheduler_rate", rate, 100.0);
+      node_handle_.param("fake_controller_latency", latency, 0.0);
+      node_handle_.param("fake_controller_jitter", jitter, 0.0);
+      if (rate <= 0.0)
+      {
+        ROS_WARN_NAMED("MoveItFakeControllerManager", "Invalid fake_controller_scheduler_rate %g, using 100 Hz", rate);
+        rate = 100.0;
+      }
+      scheduler_.reset(new FakeControllerScheduler(pub_, rate, latency, jitter));
+    }
+    return scheduler_;
+  }
+
   virtual ~MoveItFakeControllerManager()
   {
   }
@@ -280,6 +303,7 @@ public:
 protected:
   ros::NodeHandle node_handle_;
   ros::Publisher pub_;
+  FakeControllerSchedulerPtr scheduler_;
   std::map<std::string, BaseFakeControllerPtr> controllers_;
 };
 
@@ -39,6 +39,7 @@
 #include <ros/param.h>
 #include <sensor_msgs/JointState.h>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <limits>
 
 namespace moveit_fake_controller_manager
@@ -274,4 +275,185 @@ void InterpolatingController::execTrajectory(const moveit_msgs::RobotTrajectory&
   ROS_DEBUG("Fake execution of trajectory: done");
 }
 
+FakeControllerScheduler::FakeControllerScheduler(const ros::Publisher& pub, double rate, double latency,
+                                                 double jitter)
+  : pub_(pub)
+  , period_(1.0 / rate)
+  , latency_(latency)
+  , jitter_(jitter)
+  , generator_(std::random_device()())
+  , noise_(0.0, jitter > 0.0 ? jitter : 1.0)
+  , running_(true)
+{
+  ROS_INFO("Fake controller scheduler running at %g Hz (latency: %gs, jitter: %gs)", rate, latency, jitter);
+  thread_ = boost::thread(boost::bind(&FakeControllerScheduler::run, this));
+}
+
+FakeControllerScheduler::~FakeControllerScheduler()
+{
+  running_ = false;
+  thread_.join();
+}
+
+void FakeControllerScheduler::addController(ScheduledController* controller)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  controllers_.push_back(controller);
+}
+
+void FakeControllerScheduler::removeController(ScheduledController* controller)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  controllers_.erase(std::remove(controllers_.begin(), controllers_.end(), controller), controllers_.end());
+}
+
+ros::Duration FakeControllerScheduler::sampleLatency()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return ros::Duration(std::max(0.0, latency_ + (jitter_ > 0.0 ? noise_(generator_) : 0.0)));
+}
+
+void FakeControllerScheduler::run()
+{
+  sensor_msgs::JointState js;
+  ros::WallTime next_cycle = ros::WallTime::now();
+  while (running_)
+  {
+    js.name.clear();
+    js.position.clear();
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      js.header.stamp = ros::Time::now();
+      for (ScheduledController* controller : controllers_)
+        controller->update(js.header.stamp, js);
+      next_cycle += ros::WallDuration(std::max(0.0, period_ + (jitter_ > 0.0 ? noise_(generator_) : 0.0)));
+    }
+    if (!js.name.empty())
+      pub_.publish(js);
+
+    // sleep until the next cycle, but do not try to catch up on cycles that were missed
+    ros::WallTime now = ros::WallTime::now();
+    if (next_cycle > now)
+      (next_cycle - now).sleep();
+    else
+      next_cycle = now;
+  }
+}
+
+ScheduledController::ScheduledController(const std::string& name, const std::vector<std::string>& joints,
+                                         const ros::Publisher& pub, const FakeControllerSchedulerPtr& scheduler)
+  : BaseFakeController(name, joints, pub)
+  , scheduler_(scheduler)
+  , active_(false)
+  , pending_(false)
+  , status_(moveit_controller_manager::ExecutionStatus::SUCCEEDED)
+{
+  scheduler_->addController(this);
+}
+
+ScheduledController::~ScheduledController()
+{
+  scheduler_->removeController(this);
+}
+
+bool ScheduledController::sendTrajectory(const moveit_msgs::RobotTrajectory& t)
+{
+  ROS_INFO("Fake execution of trajectory");
+  ros::Time start_time = std::max(ros::Time::now(), t.joint_trajectory.header.stamp) + scheduler_->sampleLatency();
+
+  boost::mutex::scoped_lock slock(lock_);
+  if (active_ && start_time > ros::Time::now() && !t.joint_trajectory.points.empty())
+  {
+    // like real trajectory controllers, keep moving until the new trajectory starts
+    pending_trajectory_ = t.joint_trajectory;
+    pending_start_time_ = start_time;
+    pending_ = true;
+    return true;
+  }
+  pending_ = false;
+  trajectory_ = t.joint_trajectory;  // replaces any previous fake motion
+  start_time_ = start_time;
+  active_ = !trajectory_.points.empty();
+  status_ = active_ ? moveit_controller_manager::ExecutionStatus::RUNNING :
+                      moveit_controller_manager::ExecutionStatus::SUCCEEDED;
+  if (!active_)
+    done_condition_.notify_all();
+  return true;
+}
+
+bool ScheduledController::cancelExecution()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  pending_ = false;
+  if (active_)
+  {
+    active_ = false;
+    status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
+    ROS_INFO("Fake trajectory execution cancelled");
+  }
+  done_condition_.notify_all();
+  return true;
+}
+
+bool ScheduledController::waitForExecution(const ros::Duration& timeout)
+{
+  boost::unique_lock<boost::mutex> ulock(lock_);
+  boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(timeout.toNSec() / 1000);
+  while (active_)
+    if (timeout.isZero())
+      done_condition_.wait(ulock);
+    else if (!done_condition_.timed_wait(ulock, deadline))
+      return !active_;
+  return true;
+}
+
+moveit_controller_manager::ExecutionStatus ScheduledController::getLastExecutionStatus()
+{
+  boost::mutex::scoped_lock slock(lock_);
+  return status_;
+}
+
+void ScheduledController::update(const ros::Time& time, sensor_msgs::JointState& js)
+{
+  boost::mutex::scoped_lock slock(lock_);
+  if (pending_ && time >= pending_start_time_)
+  {
+    trajectory_.points.swap(pending_trajectory_.points);
+    trajectory_.joint_names.swap(pending_trajectory_.joint_names);
+    start_time_ = pending_start_time_;
+    pending_ = false;
+  }
+  if (!active_ || time < start_time_)
+    return;
+
+  const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = trajectory_.points;
+  const ros::Duration elapsed = time - start_time_;
+  std::vector<trajectory_msgs::JointTrajectoryPoint>::const_iterator next =
+      std::upper_bound(points.begin(), points.end(), elapsed,
+                       [](const ros::Duration& d, const trajectory_msgs::JointTrajectoryPoint& p) {
+                         return d < p.time_from_start;
+                       });
+
+  js.name.insert(js.name.end(), trajectory_.joint_names.begin(), trajectory_.joint_names.end());
+  if (next == points.end())
+  {
+    // publish last point
+    js.position.insert(js.position.end(), points.back().positions.begin(), points.back().positions.end());
+    if (pending_)
+      return;  // hold the last point until the pending trajectory starts
+    active_ = false;
+    status_ = moveit_controller_manager::ExecutionStatus::SUCCEEDED;
+    done_condition_.notify_all();
+    ROS_DEBUG("Fake execution of trajectory: done");
+  }
+  else if (next == points.begin())
+    js.position.insert(js.position.end(), next->positions.begin(), next->positions.end());
+  else
+  {
+    sensor_msgs::JointState interpolated;
+    interpolate(interpolated, *(next - 1), *next, elapsed);
+    js.position.insert(js.position.end(), interpolated.position.begin(), interpolated.position.end());
+  }
+}
+
 }  // end namespace moveit_fake_controller_manager
@@ -40,6 +40,8 @@
 #include <ros/publisher.h>
 #include <ros/rate.h>
 #include <boost/thread/thread.hpp>
+#include <sensor_msgs/JointState.h>
+#include <random>
 
 #ifndef MOVEIT_FAKE_CONTROLLERS
 #define MOVEIT_FAKE_CONTROLLERS
@@ -122,6 +124,69 @@ protected:
 private:
   ros::WallRate rate_;
 };
+
+class ScheduledController;
+
+// advances all ScheduledControllers from a single thread and publishes their joint states in one message per cycle
+class FakeControllerScheduler
+{
+public:
+  /// \e latency is the mean delay before a sent trajectory starts moving; \e jitter is the standard deviation of that
+  /// delay and of the publishing period
+  FakeControllerScheduler(const ros::Publisher& pub, double rate, double latency, double jitter);
+  ~FakeControllerScheduler();
+
+  void addController(ScheduledController* controller);
+  void removeController(ScheduledController* controller);
+
+  /// Sample the delay until a trajectory sent now starts executing
+  ros::Duration sampleLatency();
+
+private:
+  void run();
+
+  const ros::Publisher& pub_;
+  double period_;
+  double latency_;
+  double jitter_;
+  std::mt19937 generator_;
+  std::normal_distribution<double> noise_;
+
+  boost::mutex lock_;
+  std::vector<ScheduledController*> controllers_;
+  bool running_;
+  boost::thread thread_;
+};
+typedef std::shared_ptr<FakeControllerScheduler> FakeControllerSchedulerPtr;
+
+class ScheduledController : public BaseFakeController
+{
+public:
+  ScheduledController(const std::string& name, const std::vector<std::string>& joints, const ros::Publisher& pub,
+                      const FakeControllerSchedulerPtr& scheduler);
+  ~ScheduledController();
+
+  virtual bool sendTrajectory(const moveit_msgs::RobotTrajectory& t);
+  virtual bool cancelExecution();
+  virtual bool waitForExecution(const ros::Duration& timeout);
+  virtual moveit_controller_manager::ExecutionStatus getLastExecutionStatus();
+
+  /// Called by the scheduler: append the interpolated joint positions at \e time to \e js
+  void update(const ros::Time& time, sensor_msgs::JointState& js);
+
+private:
+  FakeControllerSchedulerPtr scheduler_;
+  boost::mutex lock_;
+  boost::condition_variable done_condition_;
+  trajectory_msgs::JointTrajectory trajectory_;
+  ros::Time start_time_;
+  bool active_;
+  // trajectory sent while moving and stamped to start later; the current one is followed until then
+  trajectory_msgs::JointTrajectory pending_trajectory_;
+  ros::Time pending_start_time_;
+  bool pending_;
+  moveit_controller_manager::ExecutionStatus status_;
+};
 }
 
 #endif
@@ -50,6 +50,7 @@
 
 #include <boost/bimap.hpp>
 
+#include <future>
 #include <map>
 #include <memory>
 
@@ -543,21 +544,27 @@ public:
   }
 
   /**
-   * \brief delegates switch  to all known interfaces. Stops of first failing switch.
+   * \brief delegates switch to all known interfaces concurrently, so that a switch takes one service round trip
    * @param activate
    * @param deactivate
-   * @return
+   * @return true if all interfaces switched
    */
   virtual bool switchControllers(const std::vector<std::string>& activate, const std::vector<std::string>& deactivate)
   {
     boost::mutex::scoped_lock lock(controller_managers_mutex_);
 
+    std::vector<std::future<bool> > switches;
     for (ControllerManagersMap::iterator it = controller_managers_.begin(); it != controller_managers_.end(); ++it)
     {
-      if (!it->second->switchControllers(activate, deactivate))
-        return false;
+      moveit_ros_control_interface::MoveItControllerManagerPtr manager = it->second;
+      switches.push_back(std::async(std::launch::async, [manager, &activate, &deactivate]() {
+        return manager->switchControllers(activate, deactivate);
+      }));
     }
-    return true;
+    bool ok = true;
+    for (std::size_t i = 0; i < switches.size(); ++i)
+      ok = switches[i].get() && ok;
+    return ok;
   }
 };
 
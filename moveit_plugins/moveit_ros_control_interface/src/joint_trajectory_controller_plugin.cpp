@@ -38,12 +38,147 @@
 #include <moveit_ros_control_interface/ControllerHandle.h>
 #include <pluginlib/class_list_macros.hpp>
 #include <moveit_simple_controller_manager/follow_joint_trajectory_controller_handle.h>
+#include <control_msgs/JointTrajectoryControllerState.h>
+#include <trajectory_msgs/JointTrajectory.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 namespace moveit_ros_control_interface
 {
+/**
+ * \brief Controller handle that publishes trajectories straight to the command topic of a JointTrajectoryController
+ * and tracks their execution on its state topic, avoiding the goal/feedback/result round-trips of the action interface.
+ * If move_group and the controller run in the same process, roscpp hands the message over without serializing it.
+ * \note The command topic does not report tolerance violations: execution succeeds once the controller holds the last
+ * point of the trajectory.
+ */
+class JointTrajectoryCommandControllerHandle : public moveit_controller_manager::MoveItControllerHandle
+{
+public:
+  JointTrajectoryCommandControllerHandle(const std::string& name)
+    : moveit_controller_manager::MoveItControllerHandle(name)
+    , done_(true)
+    , last_status_(moveit_controller_manager::ExecutionStatus::SUCCEEDED)
+  {
+    ros::NodeHandle nh(name);
+    command_publisher_ = nh.advertise<trajectory_msgs::JointTrajectory>("command", 1);
+    state_subscriber_ = nh.subscribe("state", 1, &JointTrajectoryCommandControllerHandle::stateCallback, this,
+                                     ros::TransportHints().tcpNoDelay());
+  }
+
+  virtual bool sendTrajectory(const moveit_msgs::RobotTrajectory& trajectory)
+  {
+    if (!trajectory.multi_dof_joint_trajectory.points.empty())
+      ROS_WARN_NAMED("JointTrajectoryCommandControllerHandle", "%s cannot execute multi-dof trajectories.",
+                     name_.c_str());
+    if (!waitForController())
+      return false;
+
+    trajectory_msgs::JointTrajectoryPtr command(new trajectory_msgs::JointTrajectory(trajectory.joint_trajectory));
+    boost::mutex::scoped_lock slock(lock_);
+    if (command->points.empty())
+    {
+      done_ = true;
+      last_status_ = moveit_controller_manager::ExecutionStatus::SUCCEEDED;
+      done_condition_.notify_all();
+      return true;
+    }
+    end_time_ = (command->header.stamp.isZero() ? ros::Time::now() : command->header.stamp) +
+                command->points.back().time_from_start;
+    goal_joints_ = command->joint_names;
+    goal_positions_ = command->points.back().positions;
+    done_ = false;
+    last_status_ = moveit_controller_manager::ExecutionStatus::RUNNING;
+    command_publisher_.publish(command);  // published as a pointer, so in-process subscribers receive it as is
+    return true;
+  }
+
+  virtual bool cancelExecution()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (!done_)
+    {
+      // an empty trajectory makes the controller stop at its current position
+      command_publisher_.publish(trajectory_msgs::JointTrajectoryPtr(new trajectory_msgs::JointTrajectory()));
+      done_ = true;
+      last_status_ = moveit_controller_manager::ExecutionStatus::PREEMPTED;
+      done_condition_.notify_all();
+    }
+    return true;
+  }
+
+  virtual bool waitForExecution(const ros::Duration& timeout = ros::Duration(0))
+  {
+    boost::unique_lock<boost::mutex> ulock(lock_);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(timeout.toNSec() / 1000);
+    while (!done_)
+      if (timeout.isZero())
+        done_condition_.wait(ulock);
+      else if (!done_condition_.timed_wait(ulock, deadline))
+        return done_;
+    return true;
+  }
+
+  virtual moveit_controller_manager::ExecutionStatus getLastExecutionStatus()
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    return last_status_;
+  }
+
+private:
+  bool waitForController()
+  {
+    // a freshly advertised topic may not be connected yet; messages published before are lost
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(1.0);
+    while (command_publisher_.getNumSubscribers() == 0 && ros::WallTime::now() < deadline)
+      ros::WallDuration(0.01).sleep();
+    if (command_publisher_.getNumSubscribers() == 0)
+    {
+      ROS_ERROR_NAMED("JointTrajectoryCommandControllerHandle", "Controller %s is not listening on %s",
+                      name_.c_str(), command_publisher_.getTopic().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  void stateCallback(const control_msgs::JointTrajectoryControllerStateConstPtr& state)
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (done_ || state->header.stamp < end_time_)
+      return;
+
+    // the controller holds the last point of the trajectory once it finished executing it
+    for (std::size_t i = 0; i < goal_joints_.size(); ++i)
+    {
+      std::size_t index = std::find(state->joint_names.begin(), state->joint_names.end(), goal_joints_[i]) -
+                          state->joint_names.begin();
+      if (index >= state->desired.positions.size() || i >= goal_positions_.size() ||
+          std::fabs(state->desired.positions[index] - goal_positions_[i]) > 1e-6)
+        return;
+    }
+    done_ = true;
+    last_status_ = moveit_controller_manager::ExecutionStatus::SUCCEEDED;
+    done_condition_.notify_all();
+  }
+
+  ros::Publisher command_publisher_;
+  ros::Subscriber state_subscriber_;
+
+  boost::mutex lock_;
+  boost::condition_variable done_condition_;
+  bool done_;
+  moveit_controller_manager::ExecutionStatus last_status_;
+  ros::Time end_time_;
+  std::vector<std::string> goal_joints_;
+  std::vector<double> goal_positions_;
+};
+
 /**
  * \brief Simple allocator for moveit_simple_controller_manager::FollowJointTrajectoryControllerHandle instances.
+ * If the ~ros_control_command_topic parameter is set, JointTrajectoryCommandControllerHandle instances are allocated
+ * instead.
  */
 class JointTrajectoryControllerAllocator : public ControllerHandleAllocator
 {
@@ -51,6 +186,8 @@ public:
   virtual moveit_controller_manager::MoveItControllerHandlePtr alloc(const std::string& name,
                                                                      const std::vector<std::string>& resources)
   {
+    if (ros::NodeHandle("~").param("ros_control_command_topic", false))
+      return std::make_shared<JointTrajectoryCommandControllerHandle>(name);
     return std::make_shared<moveit_simple_controller_manager::FollowJointTrajectoryControllerHandle>(
         name, "follow_joint_trajectory");
   }
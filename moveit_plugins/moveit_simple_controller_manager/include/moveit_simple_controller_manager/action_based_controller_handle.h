@@ -57,6 +57,10 @@ public:
 
   virtual void addJoint(const std::string& name) = 0;
   virtual void getJoints(std::vector<std::string>& joints) = 0;
+
+  virtual bool isConnected() const = 0;
+  /* wait up to timeout for an action server that was not up when the handle was created */
+  virtual bool connect(const ros::Duration& timeout) = 0;
 };
 
 MOVEIT_CLASS_FORWARD(ActionBasedControllerHandleBase);
@@ -95,17 +99,28 @@ public:
     if (!controller_action_client_->isServerConnected())
     {
       ROS_ERROR_STREAM_NAMED("ActionBasedController", "Action client not connected: " << getActionName());
-      controller_action_client_.reset();
+      pending_action_client_.swap(controller_action_client_);
     }
 
     last_exec_ = moveit_controller_manager::ExecutionStatus::SUCCEEDED;
   }
 
-  bool isConnected() const
+  virtual bool isConnected() const
   {
     return static_cast<bool>(controller_action_client_);
   }
 
+  virtual bool connect(const ros::Duration& timeout)
+  {
+    if (controller_action_client_)
+      return true;
+    if (!pending_action_client_ || !pending_action_client_->waitForServer(timeout))
+      return false;
+    ROS_INFO_STREAM_NAMED("ActionBasedController", "Action client connected: " << getActionName());
+    controller_action_client_.swap(pending_action_client_);
+    return true;
+  }
+
   virtual bool cancelExecution()
   {
     if (!controller_action_client_)
@@ -180,6 +195,9 @@ protected:
 
   /* action client */
   std::shared_ptr<actionlib::SimpleActionClient<T> > controller_action_client_;
+
+  /* action client kept while its server is not up, so connect() can keep waiting on it */
+  std::shared_ptr<actionlib::SimpleActionClient<T> > pending_action_client_;
 };
 
 }  // end namespace moveit_simple_controller_manager
@@ -40,6 +40,8 @@
 #include <moveit_simple_controller_manager/gripper_controller_handle.h>
 #include <moveit_simple_controller_manager/follow_joint_trajectory_controller_handle.h>
 #include <pluginlib/class_list_macros.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <map>
 
@@ -47,8 +49,24 @@ namespace moveit_simple_controller_manager
 {
 class MoveItSimpleControllerManager : public moveit_controller_manager::MoveItControllerManager
 {
+  /* the configuration of one controller, read from controller_list before connecting to it */
+  struct ControllerConfig
+  {
+    ControllerConfig() : parallel_(false), allow_failure_(false)
+    {
+    }
+
+    std::string name_;
+    std::string action_ns_;
+    std::string type_;
+    std::vector<std::string> joints_;
+    std::string command_joint_;
+    bool parallel_;
+    bool allow_failure_;
+  };
+
 public:
-  MoveItSimpleControllerManager() : node_handle_("~")
+  MoveItSimpleControllerManager() : node_handle_("~"), pending_connections_(0), shutdown_(false)
   {
     if (!node_handle_.hasParam("controller_list"))
     {
@@ -64,7 +82,7 @@ public:
       return;
     }
 
-    /* actually create each controller */
+    std::vector<ControllerConfig> configs;
     for (int i = 0; i < controller_list.size(); ++i)
     {
       if (!controller_list[i].hasMember("name") || !controller_list[i].hasMember("joints"))
@@ -75,17 +93,18 @@ public:
 
       try
       {
-        std::string name = std::string(controller_list[i]["name"]);
+        ControllerConfig config;
+        config.name_ = std::string(controller_list[i]["name"]);
+        const std::string& name = config.name_;
 
-        std::string action_ns;
         if (controller_list[i].hasMember("ns"))
         {
           /* TODO: this used to be called "ns", renaming to "action_ns" and will remove in the future */
-          action_ns = std::string(controller_list[i]["ns"]);
+          config.action_ns_ = std::string(controller_list[i]["ns"]);
           ROS_WARN_NAMED("manager", "Use of 'ns' is deprecated, use 'action_ns' instead.");
         }
         else if (controller_list[i].hasMember("action_ns"))
-          action_ns = std::string(controller_list[i]["action_ns"]);
+          config.action_ns_ = std::string(controller_list[i]["action_ns"]);
         else
           ROS_WARN_NAMED("manager", "Please note that 'action_ns' no longer has a default value.");
 
@@ -95,6 +114,8 @@ public:
                                                                                  << " is not specified as an array");
           continue;
         }
+        for (int j = 0; j < controller_list[i]["joints"].size(); ++j)
+          config.joints_.push_back(std::string(controller_list[i]["joints"][j]));
 
         if (!controller_list[i].hasMember("type"))
         {
@@ -102,74 +123,53 @@ public:
           continue;
         }
 
-        std::string type = std::string(controller_list[i]["type"]);
-
-        ActionBasedControllerHandleBasePtr new_handle;
-        if (type == "GripperCommand")
-        {
-          new_handle.reset(new GripperControllerHandle(name, action_ns));
-          if (static_cast<GripperControllerHandle*>(new_handle.get())->isConnected())
-          {
-            if (controller_list[i].hasMember("parallel"))
-            {
-              if (controller_list[i]["joints"].size() != 2)
-              {
-                ROS_ERROR_STREAM_NAMED("manager", "Parallel Gripper requires exactly two joints");
-                continue;
-              }
-              static_cast<GripperControllerHandle*>(new_handle.get())
-                  ->setParallelJawGripper(controller_list[i]["joints"][0], controller_list[i]["joints"][1]);
-            }
-            else
-            {
-              if (controller_list[i].hasMember("command_joint"))
-                static_cast<GripperControllerHandle*>(new_handle.get())
-                    ->setCommandJoint(controller_list[i]["command_joint"]);
-              else
-                static_cast<GripperControllerHandle*>(new_handle.get())
-                    ->setCommandJoint(controller_list[i]["joints"][0]);
-            }
-
-            if (controller_list[i].hasMember("allow_failure"))
-              static_cast<GripperControllerHandle*>(new_handle.get())->allowFailure(true);
-
-            ROS_INFO_STREAM_NAMED("manager", "Added GripperCommand controller for " << name);
-            controllers_[name] = new_handle;
-          }
-        }
-        else if (type == "FollowJointTrajectory")
+        config.type_ = std::string(controller_list[i]["type"]);
+        if (config.type_ == "GripperCommand")
         {
-          new_handle.reset(new FollowJointTrajectoryControllerHandle(name, action_ns));
-          if (static_cast<FollowJointTrajectoryControllerHandle*>(new_handle.get())->isConnected())
+          config.parallel_ = controller_list[i].hasMember("parallel");
+          if (config.parallel_ && config.joints_.size() != 2)
           {
-            ROS_INFO_STREAM_NAMED("manager", "Added FollowJointTrajectory controller for " << name);
-            controllers_[name] = new_handle;
+            ROS_ERROR_STREAM_NAMED("manager", "Parallel Gripper requires exactly two joints");
+            continue;
           }
+          if (controller_list[i].hasMember("command_joint"))
+            config.command_joint_ = std::string(controller_list[i]["command_joint"]);
+          else if (!config.joints_.empty())
+            config.command_joint_ = config.joints_[0];
+          config.allow_failure_ = controller_list[i].hasMember("allow_failure");
         }
-        else
+        else if (config.type_ != "FollowJointTrajectory")
         {
-          ROS_ERROR_STREAM_NAMED("manager", "Unknown controller type: " << type.c_str());
+          ROS_ERROR_STREAM_NAMED("manager", "Unknown controller type: " << config.type_.c_str());
           continue;
         }
-        if (!controllers_[name])
-        {
-          controllers_.erase(name);
-          continue;
-        }
-
-        /* add list of joints, used by controller manager and moveit */
-        for (int j = 0; j < controller_list[i]["joints"].size(); ++j)
-          controllers_[name]->addJoint(std::string(controller_list[i]["joints"][j]));
+        configs.push_back(config);
       }
       catch (...)
       {
         ROS_ERROR_STREAM_NAMED("manager", "Caught unknown exception while parsing controller information");
       }
     }
+
+    /* connect to all controllers concurrently, so startup waits for the slowest action server instead of the sum
+       of all of them; each handle is available as soon as its own server is up */
+    pending_connections_ = configs.size();
+    for (std::size_t i = 0; i < configs.size(); ++i)
+      connection_threads_.create_thread(
+          boost::bind(&MoveItSimpleControllerManager::connectController, this, configs[i]));
+
+    boost::mutex::scoped_lock slock(controllers_lock_);
+    while (pending_connections_ > 0)
+      connections_condition_.wait(slock);
   }
 
   virtual ~MoveItSimpleControllerManager()
   {
+    {
+      boost::mutex::scoped_lock slock(controllers_lock_);
+      shutdown_ = true;
+    }
+    connection_threads_.join_all();
   }
 
   /*
@@ -177,6 +177,7 @@ public:
    */
   virtual moveit_controller_manager::MoveItControllerHandlePtr getControllerHandle(const std::string& name)
   {
+    boost::mutex::scoped_lock slock(controllers_lock_);
     std::map<std::string, ActionBasedControllerHandleBasePtr>::const_iterator it = controllers_.find(name);
     if (it != controllers_.end())
       return static_cast<moveit_controller_manager::MoveItControllerHandlePtr>(it->second);
@@ -190,6 +191,7 @@ public:
    */
   virtual void getControllersList(std::vector<std::string>& names)
   {
+    boost::mutex::scoped_lock slock(controllers_lock_);
     for (std::map<std::string, ActionBasedControllerHandleBasePtr>::const_iterator it = controllers_.begin();
          it != controllers_.end(); ++it)
       names.push_back(it->first);
@@ -218,6 +220,7 @@ public:
    */
   virtual void getControllerJoints(const std::string& name, std::vector<std::string>& joints)
   {
+    boost::mutex::scoped_lock slock(controllers_lock_);
     std::map<std::string, ActionBasedControllerHandleBasePtr>::const_iterator it = controllers_.find(name);
     if (it != controllers_.end())
     {
@@ -251,8 +254,81 @@ public:
   }
 
 protected:
+  /* create the handle for a controller and register it once its action server is up; controllers that miss the
+     connection timeout are registered in the background when their server appears, and become visible to
+     TrajectoryExecutionManager::reloadControllerInformation() from then on */
+  void connectController(const ControllerConfig& config)
+  {
+    ActionBasedControllerHandleBasePtr handle;
+    try
+    {
+      if (config.type_ == "GripperCommand")
+      {
+        GripperControllerHandle* gripper = new GripperControllerHandle(config.name_, config.action_ns_);
+        handle.reset(gripper);
+        if (config.parallel_)
+          gripper->setParallelJawGripper(config.joints_[0], config.joints_[1]);
+        else
+          gripper->setCommandJoint(config.command_joint_);
+        if (config.allow_failure_)
+          gripper->allowFailure(true);
+      }
+      else
+        handle.reset(new FollowJointTrajectoryControllerHandle(config.name_, config.action_ns_));
+
+      /* add list of joints, used by controller manager and moveit */
+      for (std::size_t j = 0; j < config.joints_.size(); ++j)
+        handle->addJoint(config.joints_[j]);
+    }
+    catch (...)
+    {
+      ROS_ERROR_STREAM_NAMED("manager", "Caught unknown exception while creating controller " << config.name_);
+      handle.reset();
+    }
+
+    bool connected = handle && handle->isConnected();
+    if (connected)
+      addController(config, handle);
+    {
+      boost::mutex::scoped_lock slock(controllers_lock_);
+      --pending_connections_;
+    }
+    connections_condition_.notify_all();
+
+    if (!handle || connected)
+      return;
+    ROS_WARN_STREAM_NAMED("manager", "Controller " << config.name_
+                                                   << " is not available yet; it will be added once it comes up");
+    while (ros::ok() && !connected)
+    {
+      {
+        boost::mutex::scoped_lock slock(controllers_lock_);
+        if (shutdown_)
+          return;
+      }
+      connected = handle->connect(ros::Duration(1.0));
+    }
+    if (connected)
+      addController(config, handle);
+  }
+
+  void addController(const ControllerConfig& config, const ActionBasedControllerHandleBasePtr& handle)
+  {
+    boost::mutex::scoped_lock slock(controllers_lock_);
+    controllers_[config.name_] = handle;
+    ROS_INFO_STREAM_NAMED("manager", "Added " << config.type_ << " controller for " << config.name_);
+  }
+
   ros::NodeHandle node_handle_;
+
+  /* protects controllers_, which connection threads fill in as the action servers come up */
+  mutable boost::mutex controllers_lock_;
   std::map<std::string, ActionBasedControllerHandleBasePtr> controllers_;
+
+  boost::thread_group connection_threads_;
+  boost::condition_variable connections_condition_;
+  std::size_t pending_connections_;
+  bool shutdown_;
 };
 
 }  // end namespace moveit_simple_controller_manager
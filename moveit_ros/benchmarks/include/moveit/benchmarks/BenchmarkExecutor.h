@@ -47,14 +47,16 @@
 #include <moveit/warehouse/constraints_storage.h>
 #include <moveit/warehouse/trajectory_constraints_storage.h>
 #include <moveit/planning_interface/planning_interface.h>
-#include <warehouse_ros/database_loader.h>
 #include <pluginlib/class_loader.hpp>
 
 #include <map>
 #include <vector>
 #include <string>
 #include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/progress.hpp>
 #include <memory>
+#include <atomic>
 
 namespace moveit_ros_benchmarks
 {
@@ -156,6 +158,10 @@ protected:
   bool queriesAndPlannersCompatible(const std::vector<BenchmarkRequest>& requests,
                                     const std::map<std::string, std::vector<std::string>>& planners);
 
+  /// Generate a synthetic planning scene with start states and goals, instead of loading them from the warehouse
+  bool generateBenchmarkScene(const BenchmarkOptions& opts, moveit_msgs::PlanningScene& scene_msg,
+                              std::vector<StartState>& start_states, std::vector<PathConstraints>& goal_constraints);
+
   /// Load the planning scene with the given name from the warehouse
   bool loadPlanningScene(const std::string& scene_name, moveit_msgs::PlanningScene& scene_msg);
 
@@ -180,6 +186,19 @@ protected:
   void runBenchmark(moveit_msgs::MotionPlanRequest request,
                     const std::map<std::string, std::vector<std::string>>& planners, int runs);
 
+  /// Solve \e request once with \e context and collect the data of the run. Events are invoked while holding
+  /// \e event_lock, so they never run concurrently.
+  void runPlanner(const planning_interface::PlanningContextPtr& context, double context_setup_time,
+                  moveit_msgs::MotionPlanRequest request, PlannerRunData& run_data, unsigned int parallel_runs,
+                  unsigned int worker, boost::mutex& event_lock);
+
+  /// Worker of a parallel benchmark: pinned to a CPU, it executes runs of \e planner_data until all are done
+  void runParallelWorker(unsigned int worker, const planning_interface::PlanningContextPtr& context,
+                         double context_setup_time, const moveit_msgs::MotionPlanRequest& request,
+                         PlannerBenchmarkData& planner_data,
+                         unsigned int parallel_runs, int& next_run, boost::mutex& lock,
+                         boost::progress_display& progress);
+
   planning_scene_monitor::PlanningSceneMonitor* psm_;
   moveit_warehouse::PlanningSceneStorage* pss_;
   moveit_warehouse::PlanningSceneWorldStorage* psws_;
@@ -187,7 +206,6 @@ protected:
   moveit_warehouse::ConstraintsStorage* cs_;
   moveit_warehouse::TrajectoryConstraintsStorage* tcs_;
 
-  warehouse_ros::DatabaseLoader dbloader;
   planning_scene::PlanningScenePtr planning_scene_;
 
   BenchmarkOptions options_;
@@ -197,6 +215,24 @@ protected:
 
   std::vector<PlannerBenchmarkData> benchmark_data_;
 
+  /// A phase of a run, exported as a trace event
+  struct TraceEvent
+  {
+    std::string name;
+    std::string planner;
+    double start;
+    double duration;
+    unsigned int worker;
+  };
+
+  /// Write the phases of all runs of the last query in the Chrome trace event format
+  void writeTrace(const std::string& filename) const;
+
+  std::vector<TraceEvent> trace_events_;
+
+  /// The number of state validity checks of the planners, counted through the feasibility predicate of the scene
+  std::atomic<unsigned long> validity_checks_;
+
   std::vector<PreRunEventFunction> pre_event_fns_;
   std::vector<PostRunEventFunction> post_event_fns_;
   std::vector<PlannerStartEventFunction> planner_start_fns_;
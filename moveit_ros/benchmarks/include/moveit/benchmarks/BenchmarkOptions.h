@@ -42,6 +42,7 @@
 #include <vector>
 #include <ros/ros.h>
 #include <moveit_msgs/WorkspaceParameters.h>
+#include <moveit/benchmarks/SceneGenerator.h>
 
 namespace moveit_ros_benchmarks
 {
@@ -59,6 +60,10 @@ public:
   const std::string& getSceneName() const;
 
   int getNumRuns() const;
+  /// Number of runs of a planner that are executed concurrently, each in its own planning context
+  int getNumParallelRuns() const;
+  /// Whether the phases of all runs are additionally written as a Chrome trace (chrome://tracing)
+  bool getTraceOutput() const;
   double getTimeout() const;
   const std::string& getBenchmarkName() const;
   const std::string& getGroupName() const;
@@ -75,6 +80,9 @@ public:
   const std::string& getWorkspaceFrameID() const;
   const moveit_msgs::WorkspaceParameters& getWorkspaceParameters() const;
 
+  /// The synthetic scene and queries to benchmark; only used if they are enabled
+  const SceneGeneratorOptions& getSceneGeneratorOptions() const;
+
 protected:
   void readBenchmarkOptions(const std::string& ros_namespace);
 
@@ -84,6 +92,7 @@ protected:
 
   void readWorkspaceParameters(ros::NodeHandle& nh);
   void readGoalOffset(ros::NodeHandle& nh);
+  void readSceneGeneratorOptions(ros::NodeHandle& nh);
 
   /// warehouse parameters
   std::string hostname_;
@@ -92,6 +101,8 @@ protected:
 
   /// benchmark parameters
   int runs_;
+  int parallel_runs_;
+  bool trace_output_;
   double timeout_;
   std::string benchmark_name_;
   std::string group_name_;
@@ -107,6 +118,9 @@ protected:
   std::map<std::string, std::vector<std::string>> planners_;
 
   moveit_msgs::WorkspaceParameters workspace_;
+
+  /// synthetic scene parameters
+  SceneGeneratorOptions generator_;
 };
 }
 
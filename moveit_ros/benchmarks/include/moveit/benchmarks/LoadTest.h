@@ -0,0 +1,146 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROS_BENCHMARKS_LOAD_TEST_
+#define MOVEIT_ROS_BENCHMARKS_LOAD_TEST_
+
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <random_numbers/random_numbers.h>
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace moveit_ros_benchmarks
+{
+/// Parameters of a load test against move_group
+struct LoadTestOptions
+{
+  LoadTestOptions();
+
+  /// The planning group all requests are for
+  std::string group;
+  /// The number of concurrent clients in each stage; stages run one after the other
+  std::vector<unsigned int> client_counts;
+  /// How long each stage runs, in seconds
+  double stage_duration;
+
+  /// Requests per second that each client sends of each kind; a kind is not sent if its rate is zero. Executions
+  /// plan and execute through the move_group action, so their rate should stay low with fake controllers
+  double plan_rate;
+  double execute_rate;
+  double ik_rate;
+  double scene_update_rate;
+
+  /// Planning time allowed for plans and executions, and time after which any request is counted as failed
+  double planning_time;
+  double request_timeout;
+
+  /// The seed of the random goals
+  unsigned int seed;
+};
+
+/// Runs stages of simulated clients that send plan, execute, IK and planning scene update requests to a running
+/// move_group at fixed rates. Each stage reports the latencies of each kind of request, the requests the clients could
+/// not send on time, and the time move_group waited for locks on its planning scene (from the metrics it publishes on
+/// /diagnostics). The stage at which more clients stop increasing the throughput is reported as the saturation point.
+class LoadTest
+{
+public:
+  LoadTest(const LoadTestOptions& options, const std::string& robot_description = "robot_description");
+
+  /// Run all stages and write the report of each stage to \e out when it finishes. Returns false if the services of
+  /// move_group are not available
+  bool run(std::ostream& out);
+
+private:
+  enum RequestKind
+  {
+    PLAN,
+    EXECUTE,
+    IK,
+    SCENE_UPDATE,
+    REQUEST_KINDS
+  };
+
+  struct RequestStats
+  {
+    RequestStats() : failed(0), late(0)
+    {
+    }
+
+    std::vector<double> latencies;
+    std::size_t failed;
+    /// Requests that were not sent because the client was still waiting for an earlier one
+    std::size_t late;
+  };
+
+  struct Stage
+  {
+    unsigned int clients;
+    double duration;
+    RequestStats requests[REQUEST_KINDS];
+    /// The values published by move_group at the start and the end of the stage
+    std::map<std::string, std::string> server_start;
+    std::map<std::string, std::string> server_end;
+
+    /// Successful requests per second
+    double getThroughput() const;
+  };
+
+  class Client;
+
+  void runStage(Stage& stage);
+  void clientLoop(unsigned int client, RequestKind kind, double rate, const ros::WallTime& end, Stage& stage);
+  void writeStage(const Stage& stage, std::ostream& out) const;
+  void diagnosticsCallback(const diagnostic_msgs::DiagnosticArrayConstPtr& msg);
+  std::map<std::string, std::string> getServerMetrics();
+
+  LoadTestOptions options_;
+  ros::NodeHandle nh_;
+  robot_model_loader::RobotModelLoaderPtr rml_;
+  robot_model::RobotModelConstPtr robot_model_;
+
+  boost::mutex stats_lock_;
+
+  ros::Subscriber diagnostics_subscriber_;
+  boost::mutex server_metrics_lock_;
+  std::map<std::string, std::string> server_metrics_;
+};
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROS_BENCHMARKS_PERCEPTION_BENCHMARK_
+#define MOVEIT_ROS_BENCHMARKS_PERCEPTION_BENCHMARK_
+
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+#include <rosbag/message_instance.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace moveit_ros_benchmarks
+{
+/// Replays recorded sensor data, joint states and transforms through the occupancy map pipeline of a planning scene
+/// monitor, and reports how long each stage of the pipeline takes. The sensors are configured with the same
+/// parameters as in move_group. A point cloud or depth image is only sent once the previous one reached the planning
+/// scene, so the pipeline runs as fast as it can rather than at the recorded rate.
+class PerceptionBenchmark
+{
+public:
+  PerceptionBenchmark(const std::string& robot_description = "robot_description");
+  ~PerceptionBenchmark();
+
+  /// Replay the messages of \e bag_file. A sensor message that does not update the planning scene within \e timeout
+  /// seconds is counted as dropped. Returns false if the bag cannot be read
+  bool replay(const std::string& bag_file, double timeout);
+
+  /// Write the throughput, the end-to-end latencies, the durations of the stages and the size of the map
+  void writeReport(std::ostream& out) const;
+
+private:
+  void sceneUpdated(planning_scene_monitor::PlanningSceneMonitor::SceneUpdateType type);
+  void addTransforms(const std::vector<geometry_msgs::TransformStamped>& transforms, bool is_static);
+
+  /// Publish \e message on its recorded topic; returns false if it is not of type \e T
+  template <typename T>
+  bool republish(const rosbag::MessageInstance& message);
+
+  /// Publish a sensor message and wait until the planning scene was updated
+  template <typename T>
+  void republishAndWait(const rosbag::MessageInstance& message, double timeout);
+
+  ros::NodeHandle nh_;
+  boost::shared_ptr<tf::Transformer> tf_;
+  planning_scene_monitor::PlanningSceneMonitorPtr psm_;
+  std::map<std::string, ros::Publisher> publishers_;
+
+  boost::mutex update_lock_;
+  boost::condition_variable update_condition_;
+  std::size_t update_count_;
+
+  std::vector<double> latencies_;
+  std::size_t dropped_;
+  double duration_;
+};
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROS_BENCHMARKS_SCENE_GENERATOR_
+#define MOVEIT_ROS_BENCHMARKS_SCENE_GENERATOR_
+
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit_msgs/CollisionObject.h>
+#include <moveit_msgs/Constraints.h>
+#include <moveit_msgs/RobotState.h>
+#include <random_numbers/random_numbers.h>
+#include <string>
+#include <vector>
+
+namespace moveit_ros_benchmarks
+{
+/// Parameters of a synthetic benchmark scene and of its queries. All lengths are in meters, in the planning frame.
+struct SceneGeneratorOptions
+{
+  SceneGeneratorOptions();
+
+  /// Whether scenes and queries are generated instead of loaded from the warehouse
+  bool enabled;
+  /// The seed of all random choices; the same seed and options produce the same scene and queries
+  unsigned int seed;
+
+  /// The obstacles are placed in the box between these corners
+  double region_min[3];
+  double region_max[3];
+
+  /// Number of boxes and of random closed meshes, with edge lengths (or diameters) between the two sizes
+  unsigned int boxes;
+  unsigned int meshes;
+  double object_min_size;
+  double object_max_size;
+  /// Number of segments around each mesh; a mesh has about segments * segments triangles
+  unsigned int mesh_segments;
+
+  /// Number of shelves standing on the bottom of the region, each with this many boards
+  unsigned int shelves;
+  unsigned int shelf_levels;
+  /// Number of open bins, placed anywhere in the region
+  unsigned int bins;
+
+  /// Fraction of the cells of the region that are occupied in a generated octomap; no octomap is generated if zero
+  double octomap_density;
+  double octomap_resolution;
+
+  /// Number of collision free start states and goals to sample
+  unsigned int start_states;
+  unsigned int goals;
+  /// Number of samples tried for each state before giving up
+  unsigned int max_sampling_attempts;
+};
+
+/// Creates parameterized scenes and start and goal states with reproducible random choices, so that benchmarks can
+/// measure how planning scales with the complexity of a scene
+class SceneGenerator
+{
+public:
+  SceneGenerator(const SceneGeneratorOptions& options);
+
+  /// Add the obstacles and the octomap to \e scene. Objects that collide with the robot in the current state of
+  /// \e scene are left out. Returns the number of objects added
+  std::size_t generateScene(planning_scene::PlanningScene& scene);
+
+  /// Sample collision free states of \e group in \e scene. Returns false if a state could not be found
+  bool generateStartStates(const planning_scene::PlanningScene& scene, const std::string& group,
+                           std::vector<moveit_msgs::RobotState>& states);
+
+  /// Sample collision free goals of \e group in \e scene, as joint constraints. Returns false if a goal could not be
+  /// found
+  bool generateGoals(const planning_scene::PlanningScene& scene, const std::string& group,
+                     std::vector<moveit_msgs::Constraints>& goals);
+
+private:
+  /// A random pose in the region. An \e upright pose is only rotated about the vertical axis; a pose \e on_floor
+  /// is on the bottom of the region
+  geometry_msgs::Pose randomPose(bool upright, bool on_floor);
+  void addBox(moveit_msgs::CollisionObject& object, const geometry_msgs::Pose& origin, double x, double y, double z,
+              double sx, double sy, double sz) const;
+  void addMesh(moveit_msgs::CollisionObject& object, double size);
+  void addShelf(moveit_msgs::CollisionObject& object);
+  void addBin(moveit_msgs::CollisionObject& object);
+  void addOctomap(planning_scene::PlanningScene& scene);
+
+  bool sampleState(const planning_scene::PlanningScene& scene, const robot_model::JointModelGroup* group,
+                   robot_state::RobotState& state);
+
+  SceneGeneratorOptions options_;
+  random_numbers::RandomNumberGenerator rng_;
+};
+}
+
+#endif
@@ -527,6 +527,43 @@ def computeViews(dbname):
     conn.commit()
     c.close()
 
+def computeLatencyPercentiles(dbname):
+    """Compute the latency distribution (p50, p95, p99, max) of all real-valued attributes
+    per experiment and planner, store it in the latencyPercentiles table and print it."""
+    conn = sqlite3.connect(dbname)
+    c = conn.cursor()
+    c.execute('PRAGMA FOREIGN_KEYS = ON')
+    c.execute('PRAGMA table_info(runs)')
+    attributes = [col[1] for col in c.fetchall()[3:] if col[2] == 'REAL']
+
+    c.executescript("""DROP TABLE IF EXISTS latencyPercentiles;
+        CREATE TABLE latencyPercentiles
+        (experimentid INTEGER, plannerid INTEGER, attribute VARCHAR(512), count INTEGER,
+        p50 REAL, p95 REAL, p99 REAL, max REAL,
+        PRIMARY KEY (experimentid, plannerid, attribute),
+        FOREIGN KEY (experimentid) REFERENCES experiments(id) ON DELETE CASCADE,
+        FOREIGN KEY (plannerid) REFERENCES plannerConfigs(id) ON DELETE CASCADE)""")
+
+    c.execute("""SELECT DISTINCT runs.experimentid, experiments.name, runs.plannerid, plannerConfigs.name
+        FROM runs INNER JOIN experiments INNER JOIN plannerConfigs
+        ON experiments.id=runs.experimentid AND plannerConfigs.id=runs.plannerid""")
+    for (experimentid, experiment, plannerid, planner) in c.fetchall():
+        print('Experiment "%s", planner %s' % (experiment, planner))
+        print('    %-32s %6s %12s %12s %12s %12s' % ('attribute', 'count', 'p50', 'p95', 'p99', 'max'))
+        for attribute in attributes:
+            c.execute('SELECT `%s` FROM runs WHERE experimentid=%d AND plannerid=%d AND `%s` IS NOT NULL'
+                % (attribute, experimentid, plannerid, attribute))
+            values = [t[0] for t in c.fetchall()]
+            if len(values) == 0:
+                continue
+            p50, p95, p99 = np.percentile(values, [50, 95, 99])
+            row = (experimentid, plannerid, attribute, len(values), p50, p95, p99, max(values))
+            c.execute('INSERT INTO latencyPercentiles VALUES (?,?,?,?,?,?,?,?)', row)
+            print('    %-32s %6d %12g %12g %12g %12g' % row[2:])
+
+    conn.commit()
+    c.close()
+
 if __name__ == "__main__":
     usage = """%prog [options] [<benchmark.log> ...]"""
     parser = OptionParser("A script to parse benchmarking results.\n" + usage)
@@ -538,6 +575,8 @@ if __name__ == "__main__":
         help="Create a PDF of plots with the filename provided")
     parser.add_option("-m", "--mysql", dest="mysqldb", default=None,
         help="Save SQLite3 database as a MySQL dump file")
+    parser.add_option("-l", "--latency", action="store_true", dest="latency", default=False,
+        help="Compute the p50/p95/p99/max latency of all real-valued attributes per planner")
     (options, args) = parser.parse_args()
 
     if len(args) == 0:
@@ -551,6 +590,9 @@ if __name__ == "__main__":
     if options.view:
         computeViews(options.dbname)
 
+    if options.latency:
+        computeLatencyPercentiles(options.dbname)
+
     if options.plot:
         plotStatistics(options.dbname, options.plot)
 
@@ -44,7 +44,13 @@
 #include <boost/math/constants/constants.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace moveit_ros_benchmarks;
 
@@ -62,6 +68,19 @@ static std::string getHostname()
   }
 }
 
+// Bind the calling thread to one CPU, so concurrent runs do not migrate between cores
+static void pinThreadToCpu(unsigned int index)
+{
+#ifdef __linux__
+  unsigned int cpus = std::max(1u, boost::thread::hardware_concurrency());
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(index % cpus, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    ROS_WARN("Unable to pin benchmark thread %u to a CPU", index);
+#endif
+}
+
 BenchmarkExecutor::BenchmarkExecutor(const std::string& robot_description_param)
 {
   pss_ = NULL;
@@ -71,6 +90,7 @@ BenchmarkExecutor::BenchmarkExecutor(const std::string& robot_description_param)
   tcs_ = NULL;
   psm_ = new planning_scene_monitor::PlanningSceneMonitor(robot_description_param);
   planning_scene_ = psm_->getPlanningScene();
+  validity_checks_ = 0;
 
   // Initialize the class loader for planner plugins
   try
@@ -287,41 +307,47 @@ bool BenchmarkExecutor::initializeBenchmarks(const BenchmarkOptions& opts, movei
   if (!plannerConfigurationsExist(opts.getPlannerConfigurations(), opts.getGroupName()))
     return false;
 
-  try
+  std::vector<StartState> start_states;
+  std::vector<PathConstraints> path_constraints;
+  std::vector<PathConstraints> goal_constraints;
+  std::vector<TrajectoryConstraints> traj_constraints;
+  std::vector<BenchmarkRequest> queries;
+
+  bool ok;
+  if (opts.getSceneGeneratorOptions().enabled)
+    ok = generateBenchmarkScene(opts, scene_msg, start_states, goal_constraints);
+  else
   {
-    warehouse_ros::DatabaseConnection::Ptr conn = dbloader.loadDatabase();
-    conn->setParams(opts.getHostName(), opts.getPort(), 20);
-    if (conn->connect())
+    try
     {
-      pss_ = new moveit_warehouse::PlanningSceneStorage(conn);
-      psws_ = new moveit_warehouse::PlanningSceneWorldStorage(conn);
-      rs_ = new moveit_warehouse::RobotStateStorage(conn);
-      cs_ = new moveit_warehouse::ConstraintsStorage(conn);
-      tcs_ = new moveit_warehouse::TrajectoryConstraintsStorage(conn);
+      warehouse_ros::DatabaseConnection::Ptr conn =
+          moveit_warehouse::getSharedDatabaseConnection(opts.getHostName(), opts.getPort(), 20);
+      if (conn)
+      {
+        pss_ = new moveit_warehouse::PlanningSceneStorage(conn);
+        psws_ = new moveit_warehouse::PlanningSceneWorldStorage(conn);
+        rs_ = new moveit_warehouse::RobotStateStorage(conn);
+        cs_ = new moveit_warehouse::ConstraintsStorage(conn);
+        tcs_ = new moveit_warehouse::TrajectoryConstraintsStorage(conn);
+      }
+      else
+      {
+        ROS_ERROR("Failed to connect to DB");
+        return false;
+      }
     }
-    else
+    catch (std::exception& e)
     {
-      ROS_ERROR("Failed to connect to DB");
+      ROS_ERROR("Failed to initialize benchmark server: '%s'", e.what());
       return false;
     }
-  }
-  catch (std::exception& e)
-  {
-    ROS_ERROR("Failed to initialize benchmark server: '%s'", e.what());
-    return false;
-  }
 
-  std::vector<StartState> start_states;
-  std::vector<PathConstraints> path_constraints;
-  std::vector<PathConstraints> goal_constraints;
-  std::vector<TrajectoryConstraints> traj_constraints;
-  std::vector<BenchmarkRequest> queries;
-
-  bool ok = loadPlanningScene(opts.getSceneName(), scene_msg) && loadStates(opts.getStartStateRegex(), start_states) &&
-            loadPathConstraints(opts.getGoalConstraintRegex(), goal_constraints) &&
-            loadPathConstraints(opts.getPathConstraintRegex(), path_constraints) &&
-            loadTrajectoryConstraints(opts.getTrajectoryConstraintRegex(), traj_constraints) &&
-            loadQueries(opts.getQueryRegex(), opts.getSceneName(), queries);
+    ok = loadPlanningScene(opts.getSceneName(), scene_msg) && loadStates(opts.getStartStateRegex(), start_states) &&
+         loadPathConstraints(opts.getGoalConstraintRegex(), goal_constraints) &&
+         loadPathConstraints(opts.getPathConstraintRegex(), path_constraints) &&
+         loadTrajectoryConstraints(opts.getTrajectoryConstraintRegex(), traj_constraints) &&
+         loadQueries(opts.getQueryRegex(), opts.getSceneName(), queries);
+  }
 
   if (!ok)
   {
@@ -562,6 +588,40 @@ bool BenchmarkExecutor::plannerConfigurationsExist(const std::map<std::string, s
   return true;
 }
 
+bool BenchmarkExecutor::generateBenchmarkScene(const BenchmarkOptions& opts, moveit_msgs::PlanningScene& scene_msg,
+                                               std::vector<StartState>& start_states,
+                                               std::vector<PathConstraints>& goal_constraints)
+{
+  // the obstacles are added to a diff, so the scene of the monitor keeps the state of the robot only
+  planning_scene::PlanningScenePtr scene = planning_scene_->diff();
+  scene->setName(opts.getSceneName().empty() ? "generated" : opts.getSceneName());
+
+  SceneGenerator generator(opts.getSceneGeneratorOptions());
+  generator.generateScene(*scene);
+
+  std::vector<moveit_msgs::RobotState> states;
+  std::vector<moveit_msgs::Constraints> goals;
+  if (!generator.generateStartStates(*scene, opts.getGroupName(), states) ||
+      !generator.generateGoals(*scene, opts.getGroupName(), goals))
+    return false;
+
+  start_states.resize(states.size());
+  for (std::size_t i = 0; i < states.size(); ++i)
+  {
+    start_states[i].state = states[i];
+    start_states[i].name = "generated_start_" + boost::lexical_cast<std::string>(i);
+  }
+  goal_constraints.resize(goals.size());
+  for (std::size_t i = 0; i < goals.size(); ++i)
+  {
+    goal_constraints[i].constraints.assign(1, goals[i]);
+    goal_constraints[i].name = "generated_goal_" + boost::lexical_cast<std::string>(i);
+  }
+
+  scene->getPlanningSceneMsg(scene_msg);
+  return true;
+}
+
 bool BenchmarkExecutor::loadPlanningScene(const std::string& scene_name, moveit_msgs::PlanningScene& scene_msg)
 {
   bool ok = false;
@@ -756,6 +816,15 @@ void BenchmarkExecutor::runBenchmark(moveit_msgs::MotionPlanRequest request,
                                      const std::map<std::string, std::vector<std::string>>& planners, int runs)
 {
   benchmark_data_.clear();
+  trace_events_.clear();
+
+  // count the state validity checks of the planners; the original predicate is restored after the runs
+  const planning_scene::StateFeasibilityFn feasibility = planning_scene_->getStateFeasibilityPredicate();
+  planning_scene_->setStateFeasibilityPredicate(
+      [this, feasibility](const robot_state::RobotState& state, bool verbose) {
+        ++validity_checks_;
+        return feasibility ? feasibility(state, verbose) : true;
+      });
 
   unsigned int num_planners = 0;
   for (std::map<std::string, std::vector<std::string>>::const_iterator it = planners.begin(); it != planners.end();
@@ -780,31 +849,37 @@ void BenchmarkExecutor::runBenchmark(moveit_msgs::MotionPlanRequest request,
       for (std::size_t j = 0; j < planner_start_fns_.size(); ++j)
         planner_start_fns_[j](request, planner_data);
 
-      planning_interface::PlanningContextPtr context =
-          planner_interfaces_[it->first]->getPlanningContext(planning_scene_, request);
-      for (int j = 0; j < runs; ++j)
+      // every concurrent run gets its own planning context
+      const unsigned int parallel_runs = std::max(1, std::min(options_.getNumParallelRuns(), runs));
+      std::vector<planning_interface::PlanningContextPtr> contexts(parallel_runs);
+      std::vector<double> setup_times(parallel_runs);
+      for (std::size_t k = 0; k < contexts.size(); ++k)
       {
-        // Pre-run events
-        for (std::size_t k = 0; k < pre_event_fns_.size(); ++k)
-          pre_event_fns_[k](request);
-
-        // Solve problem
-        planning_interface::MotionPlanDetailedResponse mp_res;
         ros::WallTime start = ros::WallTime::now();
-        bool solved = context->solve(mp_res);
-        double total_time = (ros::WallTime::now() - start).toSec();
-
-        // Collect data
-        start = ros::WallTime::now();
-
-        // Post-run events
-        for (std::size_t k = 0; k < post_event_fns_.size(); ++k)
-          post_event_fns_[k](request, mp_res, planner_data[j]);
-        collectMetrics(planner_data[j], mp_res, solved, total_time);
-        double metrics_time = (ros::WallTime::now() - start).toSec();
-        ROS_DEBUG("Spent %lf seconds collecting metrics", metrics_time);
+        contexts[k] = planner_interfaces_[it->first]->getPlanningContext(planning_scene_, request);
+        setup_times[k] = (ros::WallTime::now() - start).toSec();
+        TraceEvent event = { "context setup", request.planner_id, start.toSec(), setup_times[k], (unsigned int)k };
+        trace_events_.push_back(event);
+      }
 
-        ++progress;
+      boost::mutex lock;
+      if (parallel_runs == 1)
+      {
+        for (int j = 0; j < runs; ++j)
+        {
+          runPlanner(contexts[0], setup_times[0], request, planner_data[j], parallel_runs, 0, lock);
+          ++progress;
+        }
+      }
+      else
+      {
+        int next_run = 0;
+        boost::thread_group workers;
+        for (unsigned int k = 0; k < parallel_runs; ++k)
+          workers.create_thread(boost::bind(&BenchmarkExecutor::runParallelWorker, this, k, contexts[k], setup_times[k],
+                                            boost::cref(request), boost::ref(planner_data), parallel_runs,
+                                            boost::ref(next_run), boost::ref(lock), boost::ref(progress)));
+        workers.join_all();
       }
 
       // Planner completion events
@@ -814,6 +889,86 @@ void BenchmarkExecutor::runBenchmark(moveit_msgs::MotionPlanRequest request,
       benchmark_data_.push_back(planner_data);
     }
   }
+
+  planning_scene_->setStateFeasibilityPredicate(feasibility);
+}
+
+void BenchmarkExecutor::runPlanner(const planning_interface::PlanningContextPtr& context, double context_setup_time,
+                                   moveit_msgs::MotionPlanRequest request, PlannerRunData& run_data,
+                                   unsigned int parallel_runs, unsigned int worker, boost::mutex& event_lock)
+{
+  // Pre-run events
+  {
+    boost::mutex::scoped_lock slock(event_lock);
+    for (std::size_t k = 0; k < pre_event_fns_.size(); ++k)
+      pre_event_fns_[k](request);
+  }
+
+  // Solve problem
+  planning_interface::MotionPlanDetailedResponse mp_res;
+  const unsigned long validity_checks = validity_checks_;
+  ros::WallTime solve_start = ros::WallTime::now();
+  bool solved = context->solve(mp_res);
+  double total_time = (ros::WallTime::now() - solve_start).toSec();
+  // collecting the metrics checks states as well, so the count is taken right after solving
+  const unsigned long run_validity_checks = validity_checks_ - validity_checks;
+
+  // Collect data
+  ros::WallTime start = ros::WallTime::now();
+
+  // Post-run events
+  {
+    boost::mutex::scoped_lock slock(event_lock);
+    for (std::size_t k = 0; k < post_event_fns_.size(); ++k)
+      post_event_fns_[k](request, mp_res, run_data);
+  }
+  collectMetrics(run_data, mp_res, solved, total_time);
+  // runs that shared the CPUs with others must not be mistaken for sequential timings
+  run_data["parallel_runs INTEGER"] = boost::lexical_cast<std::string>(parallel_runs);
+  run_data["context_setup_time REAL"] = moveit::core::toString(context_setup_time);
+  // with concurrent runs, the checks cannot be attributed to a single run
+  if (parallel_runs == 1)
+    run_data["validity_checks INTEGER"] = boost::lexical_cast<std::string>(run_validity_checks);
+  double metrics_time = (ros::WallTime::now() - start).toSec();
+  run_data["metrics_time REAL"] = moveit::core::toString(metrics_time);
+  ROS_DEBUG("Spent %lf seconds collecting metrics", metrics_time);
+
+  // the phases reported by the planner follow each other within the solve call
+  boost::mutex::scoped_lock slock(event_lock);
+  TraceEvent event = { "solve", request.planner_id, solve_start.toSec(), total_time, worker };
+  trace_events_.push_back(event);
+  double phase_start = solve_start.toSec();
+  for (std::size_t j = 0; j < mp_res.description_.size() && j < mp_res.processing_time_.size(); ++j)
+  {
+    TraceEvent phase = { mp_res.description_[j], request.planner_id, phase_start, mp_res.processing_time_[j], worker };
+    trace_events_.push_back(phase);
+    phase_start += mp_res.processing_time_[j];
+  }
+  TraceEvent metrics = { "collect metrics", request.planner_id, start.toSec(), metrics_time, worker };
+  trace_events_.push_back(metrics);
+}
+
+void BenchmarkExecutor::runParallelWorker(unsigned int worker, const planning_interface::PlanningContextPtr& context,
+                                          double context_setup_time, const moveit_msgs::MotionPlanRequest& request,
+                                          PlannerBenchmarkData& planner_data, unsigned int parallel_runs,
+                                          int& next_run, boost::mutex& lock, boost::progress_display& progress)
+{
+  pinThreadToCpu(worker);
+  while (true)
+  {
+    int run;
+    {
+      boost::mutex::scoped_lock slock(lock);
+      if (next_run >= (int)planner_data.size())
+        return;
+      run = next_run++;
+    }
+
+    runPlanner(context, context_setup_time, request, planner_data[run], parallel_runs, worker, lock);
+
+    boost::mutex::scoped_lock slock(lock);
+    ++progress;
+  }
 }
 
 void BenchmarkExecutor::collectMetrics(PlannerRunData& metrics,
@@ -1010,4 +1165,32 @@ void BenchmarkExecutor::writeOutput(const BenchmarkRequest& brequest, const std:
 
   out.close();
   ROS_INFO("Benchmark results saved to '%s'", filename.c_str());
+
+  if (options_.getTraceOutput())
+    writeTrace(filename.substr(0, filename.size() - 4) + ".trace.json");
+}
+
+void BenchmarkExecutor::writeTrace(const std::string& filename) const
+{
+  std::ofstream out(filename.c_str());
+  if (!out)
+  {
+    ROS_ERROR("Failed to open '%s' for trace output", filename.c_str());
+    return;
+  }
+
+  // trace event format: complete events with timestamps and durations in microseconds, one track per worker
+  out << "{\"traceEvents\": [" << std::endl;
+  out.precision(3);
+  out << std::fixed;
+  for (std::size_t i = 0; i < trace_events_.size(); ++i)
+  {
+    const TraceEvent& event = trace_events_[i];
+    out << "  {\"name\": \"" << event.name << "\", \"cat\": \"" << event.planner << "\", \"ph\": \"X\", \"ts\": "
+        << event.start * 1e6 << ", \"dur\": " << event.duration * 1e6 << ", \"pid\": 0, \"tid\": " << event.worker
+        << "}" << (i + 1 < trace_events_.size() ? "," : "") << std::endl;
+  }
+  out << "]}" << std::endl;
+  out.close();
+  ROS_INFO("Benchmark trace saved to '%s'", filename.c_str());
 }
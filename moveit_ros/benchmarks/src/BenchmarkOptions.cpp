@@ -35,14 +35,15 @@
 /* Author: Ryan Luna */
 
 #include <moveit/benchmarks/BenchmarkOptions.h>
+#include <algorithm>
 
 using namespace moveit_ros_benchmarks;
 
-BenchmarkOptions::BenchmarkOptions()
+BenchmarkOptions::BenchmarkOptions() : parallel_runs_(1), trace_output_(false)
 {
 }
 
-BenchmarkOptions::BenchmarkOptions(const std::string& ros_namespace)
+BenchmarkOptions::BenchmarkOptions(const std::string& ros_namespace) : parallel_runs_(1), trace_output_(false)
 {
   readBenchmarkOptions(ros_namespace);
 }
@@ -66,6 +67,8 @@ void BenchmarkOptions::readBenchmarkOptions(const std::string& ros_namespace)
     readWarehouseOptions(nh);
     readBenchmarkParameters(nh);
     readPlannerConfigs(nh);
+    if (nh.hasParam("benchmark_config/generator"))
+      readSceneGeneratorOptions(nh);
   }
   else
   {
@@ -93,6 +96,16 @@ int BenchmarkOptions::getNumRuns() const
   return runs_;
 }
 
+int BenchmarkOptions::getNumParallelRuns() const
+{
+  return parallel_runs_;
+}
+
+bool BenchmarkOptions::getTraceOutput() const
+{
+  return trace_output_;
+}
+
 double BenchmarkOptions::getTimeout() const
 {
   return timeout_;
@@ -167,6 +180,11 @@ const moveit_msgs::WorkspaceParameters& BenchmarkOptions::getWorkspaceParameters
   return workspace_;
 }
 
+const SceneGeneratorOptions& BenchmarkOptions::getSceneGeneratorOptions() const
+{
+  return generator_;
+}
+
 void BenchmarkOptions::readWarehouseOptions(ros::NodeHandle& nh)
 {
   nh.param(std::string("benchmark_config/warehouse/host"), hostname_, std::string("127.0.0.1"));
@@ -184,7 +202,9 @@ void BenchmarkOptions::readBenchmarkParameters(ros::NodeHandle& nh)
 {
   nh.param(std::string("benchmark_config/parameters/name"), benchmark_name_, std::string(""));
   nh.param(std::string("benchmark_config/parameters/runs"), runs_, 10);
+  nh.param(std::string("benchmark_config/parameters/parallel_runs"), parallel_runs_, 1);
   nh.param(std::string("benchmark_config/parameters/timeout"), timeout_, 10.0);
+  nh.param(std::string("benchmark_config/parameters/trace"), trace_output_, false);
   nh.param(std::string("benchmark_config/parameters/output_directory"), output_directory_, std::string(""));
   nh.param(std::string("benchmark_config/parameters/queries"), query_regex_, std::string(".*"));
   nh.param(std::string("benchmark_config/parameters/start_states"), start_state_regex_, std::string(""));
@@ -209,6 +229,8 @@ void BenchmarkOptions::readBenchmarkParameters(ros::NodeHandle& nh)
 
   ROS_INFO("Benchmark name: '%s'", benchmark_name_.c_str());
   ROS_INFO("Benchmark #runs: %d", runs_);
+  if (parallel_runs_ > 1)
+    ROS_WARN("Benchmark runs %d runs in parallel; timings are not comparable to sequential runs", parallel_runs_);
   ROS_INFO("Benchmark timeout: %f secs", timeout_);
   ROS_INFO("Benchmark group: %s", group_name_.c_str());
   ROS_INFO("Benchmark query regex: '%s'", query_regex_.c_str());
@@ -284,3 +306,58 @@ void BenchmarkOptions::readPlannerConfigs(ros::NodeHandle& nh)
     }
   }
 }
+
+void BenchmarkOptions::readSceneGeneratorOptions(ros::NodeHandle& nh)
+{
+  generator_ = SceneGeneratorOptions();
+  generator_.enabled = true;
+
+  // the parameter server has no unsigned integers
+  int seed, boxes, meshes, mesh_segments, shelves, shelf_levels, bins, start_states, goals, attempts;
+  nh.param(std::string("benchmark_config/generator/seed"), seed, static_cast<int>(generator_.seed));
+  nh.param(std::string("benchmark_config/generator/boxes"), boxes, 0);
+  nh.param(std::string("benchmark_config/generator/meshes"), meshes, 0);
+  nh.param(std::string("benchmark_config/generator/mesh_segments"), mesh_segments,
+           static_cast<int>(generator_.mesh_segments));
+  nh.param(std::string("benchmark_config/generator/shelves"), shelves, 0);
+  nh.param(std::string("benchmark_config/generator/shelf_levels"), shelf_levels,
+           static_cast<int>(generator_.shelf_levels));
+  nh.param(std::string("benchmark_config/generator/bins"), bins, 0);
+  nh.param(std::string("benchmark_config/generator/start_states"), start_states,
+           static_cast<int>(generator_.start_states));
+  nh.param(std::string("benchmark_config/generator/goals"), goals, static_cast<int>(generator_.goals));
+  nh.param(std::string("benchmark_config/generator/max_sampling_attempts"), attempts,
+           static_cast<int>(generator_.max_sampling_attempts));
+  generator_.seed = seed;
+  generator_.boxes = std::max(boxes, 0);
+  generator_.meshes = std::max(meshes, 0);
+  generator_.mesh_segments = std::max(mesh_segments, 3);
+  generator_.shelves = std::max(shelves, 0);
+  generator_.shelf_levels = std::max(shelf_levels, 1);
+  generator_.bins = std::max(bins, 0);
+  generator_.start_states = std::max(start_states, 1);
+  generator_.goals = std::max(goals, 1);
+  generator_.max_sampling_attempts = std::max(attempts, 1);
+
+  nh.param(std::string("benchmark_config/generator/object_min_size"), generator_.object_min_size,
+           generator_.object_min_size);
+  nh.param(std::string("benchmark_config/generator/object_max_size"), generator_.object_max_size,
+           generator_.object_max_size);
+  nh.param(std::string("benchmark_config/generator/octomap_density"), generator_.octomap_density,
+           generator_.octomap_density);
+  nh.param(std::string("benchmark_config/generator/octomap_resolution"), generator_.octomap_resolution,
+           generator_.octomap_resolution);
+
+  const char* axes[3] = { "x", "y", "z" };
+  for (int i = 0; i < 3; ++i)
+  {
+    nh.param(std::string("benchmark_config/generator/region/min_corner/") + axes[i], generator_.region_min[i],
+             generator_.region_min[i]);
+    nh.param(std::string("benchmark_config/generator/region/max_corner/") + axes[i], generator_.region_max[i],
+             generator_.region_max[i]);
+  }
+
+  ROS_INFO("Benchmark scene is generated with seed %u: %u boxes, %u meshes, %u shelves, %u bins, octomap density %f",
+           generator_.seed, generator_.boxes, generator_.meshes, generator_.shelves, generator_.bins,
+           generator_.octomap_density);
+}
@@ -0,0 +1,392 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/benchmarks/LoadTest.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/robot_state/robot_state.h>
+#include <moveit_msgs/ApplyPlanningScene.h>
+#include <moveit_msgs/GetMotionPlan.h>
+#include <moveit_msgs/GetPositionIK.h>
+#include <moveit_msgs/MoveGroupAction.h>
+#include <actionlib/client/simple_action_client.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+
+using namespace moveit_ros_benchmarks;
+
+namespace
+{
+const char* REQUEST_NAMES[] = { "plan", "execute", "ik", "scene_update" };
+
+double sortedQuantile(const std::vector<double>& values, double q)
+{
+  if (values.empty())
+    return 0.0;
+  return values[std::min(values.size() - 1, static_cast<std::size_t>(q * values.size()))];
+}
+
+double metricValue(const std::map<std::string, std::string>& metrics, const std::string& key)
+{
+  std::map<std::string, std::string>::const_iterator it = metrics.find(key);
+  if (it == metrics.end())
+    return 0.0;
+  try
+  {
+    return boost::lexical_cast<double>(it->second);
+  }
+  catch (boost::bad_lexical_cast&)
+  {
+    return 0.0;
+  }
+}
+}
+
+LoadTestOptions::LoadTestOptions()
+  : client_counts(1, 1)
+  , stage_duration(30.0)
+  , plan_rate(1.0)
+  , execute_rate(0.0)
+  , ik_rate(1.0)
+  , scene_update_rate(1.0)
+  , planning_time(1.0)
+  , request_timeout(10.0)
+  , seed(1)
+{
+}
+
+/// The connections of one simulated client for one kind of request
+class LoadTest::Client
+{
+public:
+  Client(const LoadTestOptions& options, const robot_model::RobotModelConstPtr& model, unsigned int id,
+         unsigned int seed)
+    : options_(options), state_(model), id_(id), rng_(seed)
+  {
+    group_ = model->getJointModelGroup(options.group);
+    state_.setToDefaultValues();
+  }
+
+  bool connect(RequestKind kind)
+  {
+    switch (kind)
+    {
+      case PLAN:
+        plan_client_ = nh_.serviceClient<moveit_msgs::GetMotionPlan>("plan_kinematic_path");
+        return plan_client_.exists();
+      case EXECUTE:
+        move_client_.reset(new actionlib::SimpleActionClient<moveit_msgs::MoveGroupAction>(nh_, "move_group", false));
+        return move_client_->waitForServer(ros::Duration(options_.request_timeout));
+      case IK:
+        ik_client_ = nh_.serviceClient<moveit_msgs::GetPositionIK>("compute_ik");
+        return ik_client_.exists();
+      case SCENE_UPDATE:
+        scene_client_ = nh_.serviceClient<moveit_msgs::ApplyPlanningScene>("apply_planning_scene");
+        return scene_client_.exists();
+      default:
+        return false;
+    }
+  }
+
+  /// Send one request and wait for its response; returns whether it succeeded
+  bool send(RequestKind kind)
+  {
+    switch (kind)
+    {
+      case PLAN:
+      {
+        moveit_msgs::GetMotionPlan srv;
+        randomRequest(srv.request.motion_plan_request);
+        return plan_client_.call(srv) &&
+               srv.response.motion_plan_response.error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+      }
+      case EXECUTE:
+      {
+        moveit_msgs::MoveGroupGoal goal;
+        randomRequest(goal.request);
+        goal.planning_options.plan_only = false;
+        goal.planning_options.planning_scene_diff.is_diff = true;
+        goal.planning_options.planning_scene_diff.robot_state.is_diff = true;
+        // another client's goal preempts this one, which counts as a failure
+        return move_client_->sendGoalAndWait(goal, ros::Duration(options_.request_timeout)) ==
+                   actionlib::SimpleClientGoalState::SUCCEEDED &&
+               move_client_->getResult()->error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+      }
+      case IK:
+      {
+        // the pose of the tip of the group in a random state, so a solution exists
+        state_.setToRandomPositions(group_, rng_);
+        state_.update();
+        const std::string& tip = group_->getLinkModelNames().back();
+        moveit_msgs::GetPositionIK srv;
+        srv.request.ik_request.group_name = options_.group;
+        srv.request.ik_request.ik_link_name = tip;
+        srv.request.ik_request.robot_state.is_diff = true;
+        srv.request.ik_request.timeout = ros::Duration(0.05);
+        srv.request.ik_request.pose_stamped.header.frame_id = state_.getRobotModel()->getModelFrame();
+        tf::poseEigenToMsg(state_.getGlobalLinkTransform(tip), srv.request.ik_request.pose_stamped.pose);
+        return ik_client_.call(srv) && srv.response.error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+      }
+      case SCENE_UPDATE:
+      {
+        // move a box of this client around, far enough away to not change the results of the plans
+        moveit_msgs::ApplyPlanningScene srv;
+        srv.request.scene.is_diff = true;
+        srv.request.scene.robot_state.is_diff = true;
+        moveit_msgs::CollisionObject object;
+        object.id = "load_test_box_" + boost::lexical_cast<std::string>(id_);
+        object.header.frame_id = state_.getRobotModel()->getModelFrame();
+        object.operation = moveit_msgs::CollisionObject::ADD;
+        object.primitives.resize(1);
+        object.primitives[0].type = shape_msgs::SolidPrimitive::BOX;
+        object.primitives[0].dimensions.assign(3, 0.1);
+        object.primitive_poses.resize(1);
+        object.primitive_poses[0].position.x = 10.0 + rng_.uniformReal(0.0, 1.0);
+        object.primitive_poses[0].position.y = rng_.uniformReal(-1.0, 1.0);
+        object.primitive_poses[0].position.z = rng_.uniformReal(0.0, 1.0);
+        object.primitive_poses[0].orientation.w = 1.0;
+        srv.request.scene.world.collision_objects.push_back(object);
+        return scene_client_.call(srv) && srv.response.success;
+      }
+      default:
+        return false;
+    }
+  }
+
+private:
+  /// A request to plan from the current state to random joint values
+  void randomRequest(moveit_msgs::MotionPlanRequest& request)
+  {
+    state_.setToRandomPositions(group_, rng_);
+    request.group_name = options_.group;
+    request.start_state.is_diff = true;
+    request.goal_constraints.push_back(kinematic_constraints::constructGoalConstraints(state_, group_));
+    request.allowed_planning_time = options_.planning_time;
+    request.num_planning_attempts = 1;
+  }
+
+  const LoadTestOptions& options_;
+  ros::NodeHandle nh_;
+  robot_state::RobotState state_;
+  const robot_model::JointModelGroup* group_;
+  unsigned int id_;
+  random_numbers::RandomNumberGenerator rng_;
+
+  ros::ServiceClient plan_client_;
+  ros::ServiceClient ik_client_;
+  ros::ServiceClient scene_client_;
+  std::unique_ptr<actionlib::SimpleActionClient<moveit_msgs::MoveGroupAction> > move_client_;
+};
+
+double LoadTest::Stage::getThroughput() const
+{
+  std::size_t succeeded = 0;
+  for (int i = 0; i < REQUEST_KINDS; ++i)
+    succeeded += requests[i].latencies.size() - requests[i].failed;
+  return duration > 0.0 ? succeeded / duration : 0.0;
+}
+
+LoadTest::LoadTest(const LoadTestOptions& options, const std::string& robot_description) : options_(options)
+{
+  rml_.reset(new robot_model_loader::RobotModelLoader(robot_description));
+  robot_model_ = rml_->getModel();
+  diagnostics_subscriber_ = nh_.subscribe("/diagnostics", 10, &LoadTest::diagnosticsCallback, this);
+}
+
+void LoadTest::diagnosticsCallback(const diagnostic_msgs::DiagnosticArrayConstPtr& msg)
+{
+  // the status of the metrics publisher capability of move_group
+  static const std::string SUFFIX = ": metrics";
+  for (std::size_t i = 0; i < msg->status.size(); ++i)
+  {
+    const std::string& name = msg->status[i].name;
+    if (name.size() < SUFFIX.size() || name.compare(name.size() - SUFFIX.size(), SUFFIX.size(), SUFFIX) != 0)
+      continue;
+    boost::mutex::scoped_lock _(server_metrics_lock_);
+    server_metrics_.clear();
+    for (std::size_t j = 0; j < msg->status[i].values.size(); ++j)
+      server_metrics_[msg->status[i].values[j].key] = msg->status[i].values[j].value;
+  }
+}
+
+std::map<std::string, std::string> LoadTest::getServerMetrics()
+{
+  boost::mutex::scoped_lock _(server_metrics_lock_);
+  return server_metrics_;
+}
+
+bool LoadTest::run(std::ostream& out)
+{
+  if (!robot_model_ || !robot_model_->hasJointModelGroup(options_.group))
+  {
+    ROS_ERROR("Unknown planning group '%s'", options_.group.c_str());
+    return false;
+  }
+  const char* services[] = { "plan_kinematic_path", "compute_ik", "apply_planning_scene" };
+  for (std::size_t i = 0; i < sizeof(services) / sizeof(services[0]); ++i)
+    if (!ros::service::waitForService(services[i], ros::Duration(options_.request_timeout)))
+    {
+      ROS_ERROR("move_group service '%s' is not available", services[i]);
+      return false;
+    }
+
+  std::vector<Stage> stages(options_.client_counts.size());
+  for (std::size_t i = 0; i < stages.size() && ros::ok(); ++i)
+  {
+    stages[i].clients = options_.client_counts[i];
+    runStage(stages[i]);
+    writeStage(stages[i], out);
+  }
+
+  // more clients that do not increase the throughput by much only queue up in move_group
+  for (std::size_t i = 1; i < stages.size(); ++i)
+  {
+    std::size_t late = 0, sent = 0;
+    for (int k = 0; k < REQUEST_KINDS; ++k)
+    {
+      late += stages[i].requests[k].late;
+      sent += stages[i].requests[k].latencies.size();
+    }
+    if (stages[i].clients > stages[i - 1].clients &&
+        (stages[i].getThroughput() < 1.1 * stages[i - 1].getThroughput() || late > 0.1 * (late + sent)))
+    {
+      out << "Saturated at " << stages[i].clients << " clients: " << stages[i - 1].getThroughput()
+          << " requests/s with " << stages[i - 1].clients << " clients, " << stages[i].getThroughput()
+          << " requests/s with " << stages[i].clients << std::endl;
+      return true;
+    }
+  }
+  if (!stages.empty())
+    out << "Not saturated with up to " << stages.back().clients << " clients" << std::endl;
+  return true;
+}
+
+void LoadTest::runStage(Stage& stage)
+{
+  ROS_INFO("Running %u clients for %f seconds", stage.clients, options_.stage_duration);
+  const double rates[REQUEST_KINDS] = { options_.plan_rate, options_.execute_rate, options_.ik_rate,
+                                        options_.scene_update_rate };
+  stage.server_start = getServerMetrics();
+  const ros::WallTime start = ros::WallTime::now();
+  const ros::WallTime end = start + ros::WallDuration(options_.stage_duration);
+
+  boost::thread_group clients;
+  for (unsigned int c = 0; c < stage.clients; ++c)
+    for (int k = 0; k < REQUEST_KINDS; ++k)
+      if (rates[k] > 0.0)
+        clients.create_thread(boost::bind(&LoadTest::clientLoop, this, c, static_cast<RequestKind>(k), rates[k],
+                                          boost::cref(end), boost::ref(stage)));
+  clients.join_all();
+
+  stage.duration = (ros::WallTime::now() - start).toSec();
+  stage.server_end = getServerMetrics();
+  for (int k = 0; k < REQUEST_KINDS; ++k)
+    std::sort(stage.requests[k].latencies.begin(), stage.requests[k].latencies.end());
+  ROS_INFO("Stage with %u clients finished: %f successful requests/s", stage.clients, stage.getThroughput());
+}
+
+void LoadTest::clientLoop(unsigned int client, RequestKind kind, double rate, const ros::WallTime& end, Stage& stage)
+{
+  Client connection(options_, robot_model_, client, options_.seed + client * REQUEST_KINDS + kind);
+  if (!connection.connect(kind))
+  {
+    ROS_ERROR("Client %u could not connect for '%s' requests", client, REQUEST_NAMES[kind]);
+    return;
+  }
+
+  const ros::WallDuration period(1.0 / rate);
+  // clients start at random offsets within the period, so that their requests do not arrive at once
+  random_numbers::RandomNumberGenerator rng(options_.seed + client);
+  ros::WallTime next = ros::WallTime::now() + ros::WallDuration(rng.uniformReal(0.0, period.toSec()));
+  while (ros::ok() && next < end)
+  {
+    ros::WallTime now = ros::WallTime::now();
+    if (next > now)
+      (next - now).sleep();
+
+    ros::WallTime start = ros::WallTime::now();
+    bool ok = connection.send(kind);
+    double latency = (ros::WallTime::now() - start).toSec();
+
+    // a client that cannot keep up with its rate skips the requests it missed
+    std::size_t late = 0;
+    next += period;
+    for (now = ros::WallTime::now(); next < now; next += period)
+      ++late;
+
+    boost::mutex::scoped_lock _(stats_lock_);
+    RequestStats& stats = stage.requests[kind];
+    stats.latencies.push_back(latency);
+    if (!ok)
+      ++stats.failed;
+    stats.late += late;
+  }
+}
+
+void LoadTest::writeStage(const Stage& stage, std::ostream& out) const
+{
+  out << std::fixed << std::setprecision(3);
+  out << "Stage with " << stage.clients << " clients: " << stage.duration << " s, " << stage.getThroughput()
+      << " successful requests/s" << std::endl;
+  for (int k = 0; k < REQUEST_KINDS; ++k)
+  {
+    const RequestStats& stats = stage.requests[k];
+    if (stats.latencies.empty() && stats.late == 0)
+      continue;
+    out << "  " << REQUEST_NAMES[k] << ": " << stats.latencies.size() << " requests, " << stats.failed << " failed, "
+        << stats.late << " late; latency (ms) p50 " << sortedQuantile(stats.latencies, 0.5) * 1000.0 << ", p90 "
+        << sortedQuantile(stats.latencies, 0.9) * 1000.0 << ", p99 " << sortedQuantile(stats.latencies, 0.99) * 1000.0
+        << ", max " << (stats.latencies.empty() ? 0.0 : stats.latencies.back() * 1000.0) << std::endl;
+  }
+
+  // the lock waits of move_group during the stage, from the counts and means of its histograms
+  static const std::string COUNT = " count";
+  for (std::map<std::string, std::string>::const_iterator it = stage.server_end.begin();
+       it != stage.server_end.end(); ++it)
+  {
+    const std::string& key = it->first;
+    if (key.find("_lock_wait_") == std::string::npos || key.size() < COUNT.size() ||
+        key.compare(key.size() - COUNT.size(), COUNT.size(), COUNT) != 0)
+      continue;
+    const std::string name = key.substr(0, key.size() - COUNT.size());
+    const double count = metricValue(stage.server_end, key) - metricValue(stage.server_start, key);
+    const double sum = metricValue(stage.server_end, key) * metricValue(stage.server_end, name + " mean") -
+                       metricValue(stage.server_start, key) * metricValue(stage.server_start, name + " mean");
+    out << "  move_group " << name << ": " << count << " waits, mean " << (count > 0.0 ? sum / count * 1000.0 : 0.0)
+        << " ms" << std::endl;
+  }
+}
@@ -0,0 +1,234 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/benchmarks/PerceptionBenchmark.h>
+#include <moveit/profiler/metrics.h>
+#include <geometric_shapes/shapes.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/JointState.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/tfMessage.h>
+#include <tf2_msgs/TFMessage.h>
+#include <tf2_ros/buffer.h>
+#include <algorithm>
+#include <iomanip>
+
+using namespace moveit_ros_benchmarks;
+
+namespace
+{
+/// Estimate the \e q quantile of the values counted in a histogram, interpolating within the bucket it falls in
+double histogramQuantile(const std::vector<double>& bounds, const std::vector<std::uint64_t>& buckets,
+                         std::uint64_t count, double q)
+{
+  const double rank = q * count;
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < bounds.size(); ++i)
+  {
+    if (buckets[i] > 0 && seen + buckets[i] >= rank)
+    {
+      const double lower = i > 0 ? bounds[i - 1] : 0.0;
+      return lower + (bounds[i] - lower) * (rank - seen) / buckets[i];
+    }
+    seen += buckets[i];
+  }
+  return bounds.empty() ? 0.0 : bounds.back();
+}
+
+/// The \e q quantile of the sorted \e values
+double sortedQuantile(const std::vector<double>& values, double q)
+{
+  if (values.empty())
+    return 0.0;
+  return values[std::min(values.size() - 1, static_cast<std::size_t>(q * values.size()))];
+}
+}
+
+PerceptionBenchmark::PerceptionBenchmark(const std::string& robot_description)
+  : nh_("~"), tf_(new tf::Transformer()), update_count_(0), dropped_(0), duration_(0.0)
+{
+  // the transforms only come from the bag, not from the tf topics
+  psm_.reset(new planning_scene_monitor::PlanningSceneMonitor(robot_description, tf_));
+  psm_->addUpdateCallback(boost::bind(&PerceptionBenchmark::sceneUpdated, this, _1));
+  psm_->startStateMonitor();
+  psm_->startWorldGeometryMonitor();
+}
+
+PerceptionBenchmark::~PerceptionBenchmark()
+{
+  psm_->stopWorldGeometryMonitor();
+  psm_->stopStateMonitor();
+}
+
+void PerceptionBenchmark::sceneUpdated(planning_scene_monitor::PlanningSceneMonitor::SceneUpdateType type)
+{
+  if (type & planning_scene_monitor::PlanningSceneMonitor::UPDATE_GEOMETRY)
+  {
+    boost::mutex::scoped_lock _(update_lock_);
+    ++update_count_;
+    update_condition_.notify_all();
+  }
+}
+
+void PerceptionBenchmark::addTransforms(const std::vector<geometry_msgs::TransformStamped>& transforms,
+                                        bool is_static)
+{
+  for (std::size_t i = 0; i < transforms.size(); ++i)
+    tf_->getTF2BufferPtr()->setTransform(transforms[i], "rosbag", is_static);
+}
+
+template <typename T>
+bool PerceptionBenchmark::republish(const rosbag::MessageInstance& message)
+{
+  boost::shared_ptr<const T> msg = message.instantiate<T>();
+  if (!msg)
+    return false;
+
+  std::map<std::string, ros::Publisher>::iterator it = publishers_.find(message.getTopic());
+  if (it == publishers_.end())
+  {
+    // publishers and subscribers of the same node are connected directly, so messages are passed without copies
+    ros::NodeHandle root_nh;
+    it = publishers_.insert(std::make_pair(message.getTopic(), root_nh.advertise<T>(message.getTopic(), 100))).first;
+  }
+  it->second.publish(msg);
+  return true;
+}
+
+template <typename T>
+void PerceptionBenchmark::republishAndWait(const rosbag::MessageInstance& message, double timeout)
+{
+  boost::unique_lock<boost::mutex> ulock(update_lock_);
+  const std::size_t count = update_count_;
+  ros::WallTime start = ros::WallTime::now();
+  if (!republish<T>(message))
+    return;
+
+  // the first update of the scene after the message was sent is counted as its update
+  const boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(timeout * 1e6);
+  while (update_count_ == count)
+    if (!update_condition_.timed_wait(ulock, deadline))
+    {
+      ++dropped_;
+      return;
+    }
+  latencies_.push_back((ros::WallTime::now() - start).toSec());
+}
+
+bool PerceptionBenchmark::replay(const std::string& bag_file, double timeout)
+{
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(bag_file, rosbag::bagmode::Read);
+  }
+  catch (rosbag::BagException& ex)
+  {
+    ROS_ERROR("Could not open bag file '%s': %s", bag_file.c_str(), ex.what());
+    return false;
+  }
+
+  ros::WallTime start = ros::WallTime::now();
+  rosbag::View view(bag);
+  for (rosbag::View::iterator it = view.begin(); it != view.end() && ros::ok(); ++it)
+  {
+    const std::string& type = it->getDataType();
+    const bool is_static = it->getTopic() == "/tf_static" || it->getTopic() == "tf_static";
+    if (type == "tf2_msgs/TFMessage")
+      addTransforms(it->instantiate<tf2_msgs::TFMessage>()->transforms, is_static);
+    else if (type == "tf/tfMessage")
+      addTransforms(it->instantiate<tf::tfMessage>()->transforms, is_static);
+    else if (type == "sensor_msgs/JointState")
+      republish<sensor_msgs::JointState>(*it);
+    else if (type == "sensor_msgs/CameraInfo")
+      republish<sensor_msgs::CameraInfo>(*it);
+    else if (type == "sensor_msgs/PointCloud2")
+      republishAndWait<sensor_msgs::PointCloud2>(*it, timeout);
+    else if (type == "sensor_msgs/Image")
+      republishAndWait<sensor_msgs::Image>(*it, timeout);
+  }
+  duration_ = (ros::WallTime::now() - start).toSec();
+  bag.close();
+
+  std::sort(latencies_.begin(), latencies_.end());
+  return true;
+}
+
+void PerceptionBenchmark::writeReport(std::ostream& out) const
+{
+  const std::size_t messages = latencies_.size() + dropped_;
+  out << std::fixed << std::setprecision(3);
+  out << "Replayed " << messages << " sensor messages in " << duration_ << " s ("
+      << (duration_ > 0.0 ? messages / duration_ : 0.0) << " messages/s), " << dropped_ << " did not update the scene"
+      << std::endl;
+  out << "End-to-end latency (ms): p50 " << sortedQuantile(latencies_, 0.5) * 1000.0 << ", p90 "
+      << sortedQuantile(latencies_, 0.9) * 1000.0 << ", p99 " << sortedQuantile(latencies_, 0.99) * 1000.0
+      << ", max " << (latencies_.empty() ? 0.0 : latencies_.back() * 1000.0) << std::endl;
+
+  // the stages are timed by the updaters themselves, in the histograms of the process-wide metrics
+  out << "Stage durations (ms):" << std::endl;
+  std::vector<const moveit::tools::MetricHistogram*> histograms =
+      moveit::tools::MetricsRegistry::instance().getHistograms();
+  for (std::size_t i = 0; i < histograms.size(); ++i)
+  {
+    if (histograms[i]->getName().compare(0, 15, "moveit_octomap_") != 0)
+      continue;
+    std::vector<std::uint64_t> buckets;
+    std::uint64_t count;
+    double sum;
+    histograms[i]->getSnapshot(buckets, count, sum);
+    if (count == 0)
+      continue;
+    const std::vector<double>& bounds = histograms[i]->getBounds();
+    out << "  " << histograms[i]->getName() << ": count " << count << ", mean " << sum / count * 1000.0 << ", p50 "
+        << histogramQuantile(bounds, buckets, count, 0.5) * 1000.0 << ", p90 "
+        << histogramQuantile(bounds, buckets, count, 0.9) * 1000.0 << ", p99 "
+        << histogramQuantile(bounds, buckets, count, 0.99) * 1000.0 << std::endl;
+  }
+
+  // the octree as the planning scene sees it
+  planning_scene_monitor::LockedPlanningSceneRO scene(psm_);
+  collision_detection::World::ObjectConstPtr map =
+      scene->getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+  if (map && !map->shapes_.empty() && map->shapes_[0]->type == shapes::OCTREE)
+  {
+    const std::shared_ptr<const octomap::OcTree>& tree =
+        static_cast<const shapes::OcTree*>(map->shapes_[0].get())->octree;
+    out << "Map: " << tree->getNumLeafNodes() << " leaves, " << tree->size() << " nodes, " << tree->memoryUsage()
+        << " bytes" << std::endl;
+  }
+}
@@ -0,0 +1,90 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <ros/ros.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <moveit/benchmarks/LoadTest.h>
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "moveit_run_load_test");
+  // the action clients of all simulated clients are served by the global callback queue; use one thread per core
+  ros::AsyncSpinner spinner(0);
+  spinner.start();
+
+  ros::NodeHandle nh("~");
+  moveit_ros_benchmarks::LoadTestOptions opts;
+  if (!nh.getParam("group", opts.group))
+  {
+    ROS_ERROR("The planning group is not specified (~group)");
+    return 1;
+  }
+  std::vector<int> client_counts;
+  if (nh.getParam("client_counts", client_counts))
+  {
+    opts.client_counts.clear();
+    for (std::size_t i = 0; i < client_counts.size(); ++i)
+      if (client_counts[i] > 0)
+        opts.client_counts.push_back(client_counts[i]);
+  }
+  nh.param("stage_duration", opts.stage_duration, opts.stage_duration);
+  nh.param("plan_rate", opts.plan_rate, opts.plan_rate);
+  nh.param("execute_rate", opts.execute_rate, opts.execute_rate);
+  nh.param("ik_rate", opts.ik_rate, opts.ik_rate);
+  nh.param("scene_update_rate", opts.scene_update_rate, opts.scene_update_rate);
+  nh.param("planning_time", opts.planning_time, opts.planning_time);
+  nh.param("request_timeout", opts.request_timeout, opts.request_timeout);
+  int seed;
+  nh.param("seed", seed, static_cast<int>(opts.seed));
+  opts.seed = seed;
+  std::string output_file;
+  nh.param("output_file", output_file, std::string(""));
+
+  moveit_ros_benchmarks::LoadTest load_test(opts);
+  std::stringstream report;
+  if (!load_test.run(report))
+    return 1;
+
+  std::cout << report.str();
+  if (!output_file.empty())
+  {
+    std::ofstream out(output_file.c_str());
+    out << report.str();
+  }
+  return 0;
+}
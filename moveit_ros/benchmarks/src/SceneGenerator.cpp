@@ -0,0 +1,346 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/benchmarks/SceneGenerator.h>
+#include <moveit/kinematic_constraints/utils.h>
+#include <moveit/robot_state/conversions.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/math/constants/constants.hpp>
+#include <octomap/octomap.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+using namespace moveit_ros_benchmarks;
+
+SceneGeneratorOptions::SceneGeneratorOptions()
+  : enabled(false)
+  , seed(1)
+  , boxes(0)
+  , meshes(0)
+  , object_min_size(0.05)
+  , object_max_size(0.3)
+  , mesh_segments(16)
+  , shelves(0)
+  , shelf_levels(4)
+  , bins(0)
+  , octomap_density(0.0)
+  , octomap_resolution(0.05)
+  , start_states(1)
+  , goals(1)
+  , max_sampling_attempts(1000)
+{
+  region_min[0] = region_min[1] = -1.0;
+  region_min[2] = 0.0;
+  region_max[0] = region_max[1] = 1.0;
+  region_max[2] = 1.5;
+}
+
+SceneGenerator::SceneGenerator(const SceneGeneratorOptions& options) : options_(options), rng_(options.seed)
+{
+}
+
+std::size_t SceneGenerator::generateScene(planning_scene::PlanningScene& scene)
+{
+  std::vector<moveit_msgs::CollisionObject> objects;
+  for (unsigned int i = 0; i < options_.boxes; ++i)
+  {
+    moveit_msgs::CollisionObject object;
+    object.id = "box_" + boost::lexical_cast<std::string>(i);
+    addBox(object, randomPose(false, false), 0.0, 0.0, 0.0,
+           rng_.uniformReal(options_.object_min_size, options_.object_max_size),
+           rng_.uniformReal(options_.object_min_size, options_.object_max_size),
+           rng_.uniformReal(options_.object_min_size, options_.object_max_size));
+    objects.push_back(object);
+  }
+  for (unsigned int i = 0; i < options_.meshes; ++i)
+  {
+    moveit_msgs::CollisionObject object;
+    object.id = "mesh_" + boost::lexical_cast<std::string>(i);
+    addMesh(object, rng_.uniformReal(options_.object_min_size, options_.object_max_size));
+    objects.push_back(object);
+  }
+  for (unsigned int i = 0; i < options_.shelves; ++i)
+  {
+    moveit_msgs::CollisionObject object;
+    object.id = "shelf_" + boost::lexical_cast<std::string>(i);
+    addShelf(object);
+    objects.push_back(object);
+  }
+  for (unsigned int i = 0; i < options_.bins; ++i)
+  {
+    moveit_msgs::CollisionObject object;
+    object.id = "bin_" + boost::lexical_cast<std::string>(i);
+    addBin(object);
+    objects.push_back(object);
+  }
+
+  for (std::size_t i = 0; i < objects.size(); ++i)
+  {
+    objects[i].header.frame_id = scene.getPlanningFrame();
+    objects[i].operation = moveit_msgs::CollisionObject::ADD;
+    scene.processCollisionObjectMsg(objects[i]);
+  }
+
+  // leave out the objects the robot is in collision with, so the scene can be planned in from its current state
+  std::size_t added = objects.size();
+  if (!objects.empty())
+  {
+    collision_detection::CollisionRequest req;
+    req.contacts = true;
+    req.max_contacts = objects.size() * scene.getRobotModel()->getLinkModelsWithCollisionGeometry().size();
+    collision_detection::CollisionResult res;
+    scene.checkCollision(req, res);
+    for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin();
+         it != res.contacts.end(); ++it)
+    {
+      if (scene.getWorldNonConst()->removeObject(it->first.first))
+        --added;
+      if (scene.getWorldNonConst()->removeObject(it->first.second))
+        --added;
+    }
+  }
+
+  if (options_.octomap_density > 0.0)
+    addOctomap(scene);
+
+  ROS_INFO("Generated %lu objects (%lu left out because the robot collides with them)", added,
+           objects.size() - added);
+  return added;
+}
+
+bool SceneGenerator::generateStartStates(const planning_scene::PlanningScene& scene, const std::string& group,
+                                         std::vector<moveit_msgs::RobotState>& states)
+{
+  const robot_model::JointModelGroup* jmg = scene.getRobotModel()->getJointModelGroup(group);
+  if (!jmg)
+    return false;
+
+  robot_state::RobotState state(scene.getCurrentState());
+  states.resize(options_.start_states);
+  for (std::size_t i = 0; i < states.size(); ++i)
+  {
+    if (!sampleState(scene, jmg, state))
+    {
+      ROS_ERROR("Could not sample a collision free start state for group '%s'", group.c_str());
+      return false;
+    }
+    robot_state::robotStateToRobotStateMsg(state, states[i]);
+  }
+  return true;
+}
+
+bool SceneGenerator::generateGoals(const planning_scene::PlanningScene& scene, const std::string& group,
+                                   std::vector<moveit_msgs::Constraints>& goals)
+{
+  const robot_model::JointModelGroup* jmg = scene.getRobotModel()->getJointModelGroup(group);
+  if (!jmg)
+    return false;
+
+  robot_state::RobotState state(scene.getCurrentState());
+  goals.resize(options_.goals);
+  for (std::size_t i = 0; i < goals.size(); ++i)
+  {
+    if (!sampleState(scene, jmg, state))
+    {
+      ROS_ERROR("Could not sample a collision free goal for group '%s'", group.c_str());
+      return false;
+    }
+    goals[i] = kinematic_constraints::constructGoalConstraints(state, jmg);
+  }
+  return true;
+}
+
+geometry_msgs::Pose SceneGenerator::randomPose(bool upright, bool on_floor)
+{
+  geometry_msgs::Pose pose;
+  pose.position.x = rng_.uniformReal(options_.region_min[0], options_.region_max[0]);
+  pose.position.y = rng_.uniformReal(options_.region_min[1], options_.region_max[1]);
+  pose.position.z =
+      on_floor ? options_.region_min[2] : rng_.uniformReal(options_.region_min[2], options_.region_max[2]);
+  if (upright)
+  {
+    const double yaw = rng_.uniformReal(-boost::math::constants::pi<double>(), boost::math::constants::pi<double>());
+    pose.orientation.z = sin(yaw / 2.0);
+    pose.orientation.w = cos(yaw / 2.0);
+  }
+  else
+  {
+    double q[4];
+    rng_.quaternion(q);
+    pose.orientation.x = q[0];
+    pose.orientation.y = q[1];
+    pose.orientation.z = q[2];
+    pose.orientation.w = q[3];
+  }
+  return pose;
+}
+
+void SceneGenerator::addBox(moveit_msgs::CollisionObject& object, const geometry_msgs::Pose& origin, double x,
+                            double y, double z, double sx, double sy, double sz) const
+{
+  shape_msgs::SolidPrimitive box;
+  box.type = shape_msgs::SolidPrimitive::BOX;
+  box.dimensions.resize(3);
+  box.dimensions[shape_msgs::SolidPrimitive::BOX_X] = sx;
+  box.dimensions[shape_msgs::SolidPrimitive::BOX_Y] = sy;
+  box.dimensions[shape_msgs::SolidPrimitive::BOX_Z] = sz;
+  object.primitives.push_back(box);
+
+  // the offset is expressed in the frame of the origin
+  Eigen::Affine3d o;
+  tf::poseMsgToEigen(origin, o);
+  geometry_msgs::Pose pose;
+  tf::poseEigenToMsg(o * Eigen::Translation3d(x, y, z), pose);
+  object.primitive_poses.push_back(pose);
+}
+
+void SceneGenerator::addMesh(moveit_msgs::CollisionObject& object, double size)
+{
+  // a sphere with randomly displaced vertices: closed, but not convex
+  const unsigned int segments = std::max(options_.mesh_segments, 3u);
+  const unsigned int rings = std::max(segments / 2, 2u);
+  const double pi = boost::math::constants::pi<double>();
+  shape_msgs::Mesh mesh;
+  mesh.vertices.resize(2 + (rings - 1) * segments);
+  mesh.vertices.front().z = 0.5 * size * rng_.uniformReal(0.7, 1.0);
+  mesh.vertices.back().z = -0.5 * size * rng_.uniformReal(0.7, 1.0);
+  for (unsigned int i = 1; i < rings; ++i)
+    for (unsigned int j = 0; j < segments; ++j)
+    {
+      const double theta = pi * i / rings;
+      const double phi = 2.0 * pi * j / segments;
+      const double r = 0.5 * size * rng_.uniformReal(0.7, 1.0);
+      geometry_msgs::Point& p = mesh.vertices[1 + (i - 1) * segments + j];
+      p.x = r * sin(theta) * cos(phi);
+      p.y = r * sin(theta) * sin(phi);
+      p.z = r * cos(theta);
+    }
+
+  const unsigned int bottom = mesh.vertices.size() - 1;
+  const unsigned int last_ring = 1 + (rings - 2) * segments;
+  shape_msgs::MeshTriangle t;
+  for (unsigned int j = 0; j < segments; ++j)
+  {
+    const unsigned int next = (j + 1) % segments;
+    t.vertex_indices[0] = 0;
+    t.vertex_indices[1] = 1 + j;
+    t.vertex_indices[2] = 1 + next;
+    mesh.triangles.push_back(t);
+    for (unsigned int i = 0; i + 2 < rings; ++i)
+    {
+      const unsigned int a = 1 + i * segments + j;
+      const unsigned int b = 1 + i * segments + next;
+      t.vertex_indices[0] = a;
+      t.vertex_indices[1] = a + segments;
+      t.vertex_indices[2] = b;
+      mesh.triangles.push_back(t);
+      t.vertex_indices[0] = b;
+      t.vertex_indices[1] = a + segments;
+      t.vertex_indices[2] = b + segments;
+      mesh.triangles.push_back(t);
+    }
+    t.vertex_indices[0] = last_ring + j;
+    t.vertex_indices[1] = bottom;
+    t.vertex_indices[2] = last_ring + next;
+    mesh.triangles.push_back(t);
+  }
+
+  object.meshes.push_back(mesh);
+  object.mesh_poses.push_back(randomPose(false, false));
+}
+
+void SceneGenerator::addShelf(moveit_msgs::CollisionObject& object)
+{
+  // two sides, a back and the boards, standing on the bottom of the region
+  const double width = 0.8;
+  const double depth = 0.35;
+  const double height = std::min(1.8, options_.region_max[2] - options_.region_min[2]);
+  const double thickness = 0.02;
+  const geometry_msgs::Pose origin = randomPose(true, true);
+  addBox(object, origin, -0.5 * (width - thickness), 0.0, 0.5 * height, thickness, depth, height);
+  addBox(object, origin, 0.5 * (width - thickness), 0.0, 0.5 * height, thickness, depth, height);
+  addBox(object, origin, 0.0, 0.5 * (depth - thickness), 0.5 * height, width, thickness, height);
+  const unsigned int levels = std::max(options_.shelf_levels, 1u);
+  for (unsigned int i = 0; i < levels; ++i)
+    addBox(object, origin, 0.0, 0.0, 0.5 * thickness + i * (height - thickness) / std::max(levels - 1, 1u), width,
+           depth, thickness);
+}
+
+void SceneGenerator::addBin(moveit_msgs::CollisionObject& object)
+{
+  // a bottom and four walls, open at the top
+  const double length = 0.4;
+  const double width = 0.3;
+  const double height = 0.2;
+  const double thickness = 0.01;
+  const geometry_msgs::Pose origin = randomPose(true, false);
+  addBox(object, origin, 0.0, 0.0, 0.5 * thickness, length, width, thickness);
+  addBox(object, origin, -0.5 * (length - thickness), 0.0, 0.5 * height, thickness, width, height);
+  addBox(object, origin, 0.5 * (length - thickness), 0.0, 0.5 * height, thickness, width, height);
+  addBox(object, origin, 0.0, -0.5 * (width - thickness), 0.5 * height, length, thickness, height);
+  addBox(object, origin, 0.0, 0.5 * (width - thickness), 0.5 * height, length, thickness, height);
+}
+
+void SceneGenerator::addOctomap(planning_scene::PlanningScene& scene)
+{
+  const double res = options_.octomap_resolution;
+  std::shared_ptr<octomap::OcTree> octree(new octomap::OcTree(res));
+  std::size_t occupied = 0;
+  for (double x = options_.region_min[0] + 0.5 * res; x < options_.region_max[0]; x += res)
+    for (double y = options_.region_min[1] + 0.5 * res; y < options_.region_max[1]; y += res)
+      for (double z = options_.region_min[2] + 0.5 * res; z < options_.region_max[2]; z += res)
+        if (rng_.uniform01() < options_.octomap_density)
+        {
+          octree->updateNode(octomap::point3d(x, y, z), true);
+          ++occupied;
+        }
+  octree->updateInnerOccupancy();
+  scene.processOctomapPtr(octree, Eigen::Affine3d::Identity());
+  ROS_INFO("Generated an octomap with %lu occupied cells", occupied);
+}
+
+bool SceneGenerator::sampleState(const planning_scene::PlanningScene& scene, const robot_model::JointModelGroup* group,
+                                 robot_state::RobotState& state)
+{
+  for (unsigned int i = 0; i < options_.max_sampling_attempts; ++i)
+  {
+    state.setToRandomPositions(group, rng_);
+    state.update();
+    if (!scene.isStateColliding(state, group->getName()))
+      return true;
+  }
+  return false;
+}
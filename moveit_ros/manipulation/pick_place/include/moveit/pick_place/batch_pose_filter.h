@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PICK_PLACE_BATCH_POSE_FILTER_
+#define MOVEIT_PICK_PLACE_BATCH_POSE_FILTER_
+
+#include <moveit/pick_place/manipulation_plan.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <vector>
+
+namespace pick_place
+{
+/** \brief Filter all the candidate manipulation plans of a request at once, before they enter the manipulation
+    pipeline.
+
+    The end-effector of every plan is checked for collisions at its goal pose in parallel, goal poses that are
+    further away from the base of the planning group than the group can reach or that are not in the reachability map
+    of the group (if one was loaded) are discarded, and IK is computed for the remaining goal poses with a single
+    batched query. The IK solution (if any) is stored in the plan and tried first by the ReachableAndValidPoseFilter
+    stage, before sampling IK solutions with random seeds. */
+class BatchPoseFilter
+{
+public:
+  BatchPoseFilter(const planning_scene::PlanningSceneConstPtr& scene,
+                  const collision_detection::AllowedCollisionMatrixConstPtr& collision_matrix, unsigned int nthreads);
+
+  /** \brief Remove the plans that cannot succeed from \e plans, keeping the order of the remaining ones. The removed
+      plans are appended to \e rejected. All plans must share the same ManipulationPlanSharedData. */
+  void filter(std::vector<ManipulationPlanPtr>& plans, std::vector<ManipulationPlanPtr>& rejected) const;
+
+  void setVerbose(bool flag)
+  {
+    verbose_ = flag;
+  }
+
+private:
+  void checkEndEffectors(const std::vector<ManipulationPlanPtr>& plans, std::size_t first,
+                         std::vector<char>& free) const;
+
+  /// The maximum distance between the parent link of the planning group and the IK link; negative if unbounded
+  double computeMaximumReach(const ManipulationPlanSharedData& shared_data) const;
+
+  planning_scene::PlanningSceneConstPtr planning_scene_;
+  collision_detection::AllowedCollisionMatrixConstPtr collision_matrix_;
+  unsigned int nthreads_;
+  bool verbose_;
+};
+}
+
+#endif
@@ -42,11 +42,15 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <vector>
-#include <deque>
 
 namespace pick_place
 {
-/** \brief Represent the sequence of steps that are executed for a manipulation plan */
+/** \brief Represent the sequence of steps that are executed for a manipulation plan
+
+    Every stage has its own queue of plans waiting to be evaluated by it, ordered by the quality of the plans. Each
+    processing thread is attached to one stage and takes work from the other stages (the ones closest to producing a
+    solution first) only when the queue of its own stage is empty. This way, cheap filtering stages keep feeding the
+    expensive planning stages with the best candidates, instead of threads planning for low ranked candidates. */
 class ManipulationPipeline
 {
 public:
@@ -58,6 +62,11 @@ public:
     return name_;
   }
 
+  unsigned int getThreadCount() const
+  {
+    return nthreads_;
+  }
+
   void setSolutionCallback(const boost::function<void()>& callback)
   {
     solution_callback_ = callback;
@@ -68,6 +77,18 @@ public:
     empty_queue_callback_ = callback;
   }
 
+  /** \brief Set the number of successful plans after which the remaining work is cancelled (default is 1).
+      The solution callback is called once that many plans were found. */
+  void setMaxSolutions(unsigned int count)
+  {
+    max_solutions_ = count > 0 ? count : 1;
+  }
+
+  unsigned int getMaxSolutions() const
+  {
+    return max_solutions_;
+  }
+
   ManipulationPipeline& addStage(const ManipulationStagePtr& next);
   const ManipulationStagePtr& getFirstStage() const;
   const ManipulationStagePtr& getLastStage() const;
@@ -80,8 +101,11 @@ public:
   void stop();
 
   void push(const ManipulationPlanPtr& grasp);
+  /// Record a plan that was rejected before it was pushed to the pipeline (e.g., by a BatchPoseFilter)
+  void addFailedManipulationPlan(const ManipulationPlanPtr& plan);
   void clear();
 
+  /// The successful plans, ordered by increasing quality (the best plan is the last one)
   const std::vector<ManipulationPlanPtr>& getSuccessfulManipulationPlans() const
   {
     return success_;
@@ -97,12 +121,20 @@ public:
 protected:
   void processingThread(unsigned int index);
 
+  /// Take the best plan waiting for stage \e home or, if there is none, steal one from another stage.
+  /// Must be called with queue_access_lock_ held. Returns an empty pointer if there is no work.
+  ManipulationPlanPtr popPlan(std::size_t home, std::size_t& stage);
+  void pushPlan(const ManipulationPlanPtr& plan, std::size_t stage);
+
   std::string name_;
   unsigned int nthreads_;
   bool verbose_;
   std::vector<ManipulationStagePtr> stages_;
 
-  std::deque<ManipulationPlanPtr> queue_;
+  /// One heap of plans (ordered by quality) for every stage
+  std::vector<std::vector<ManipulationPlanPtr> > queues_;
+  std::size_t queued_;
+  unsigned int max_solutions_;
   std::vector<ManipulationPlanPtr> success_;
   std::vector<ManipulationPlanPtr> failed_;
 
@@ -88,7 +88,7 @@ struct ManipulationPlan
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   ManipulationPlan(const ManipulationPlanSharedDataConstPtr& shared_data)
-    : shared_data_(shared_data), processing_stage_(0)
+    : shared_data_(shared_data), processing_stage_(0), quality_(0.0)
   {
   }
 
@@ -128,6 +128,9 @@ struct ManipulationPlan
 
   std::vector<robot_state::RobotStatePtr> possible_goal_states_;
 
+  // Positions of the planning group reaching goal_pose_, as computed by the BatchPoseFilter (empty if none was found)
+  std::vector<double> ik_solution_;
+
   robot_state::RobotStatePtr approach_state_;
 
   // The sequence of trajectories produced for execution
@@ -141,6 +144,9 @@ struct ManipulationPlan
 
   // An id for this plan; this is usually the index of the Grasp / PlaceLocation in the input request
   std::size_t id_;
+
+  // The quality of this plan (e.g., the grasp quality); plans of higher quality are processed first
+  double quality_;
 };
 }
 
@@ -47,6 +47,7 @@ struct PickPlaceParams
   unsigned int max_fail_;
   double max_step_;
   double jump_factor_;
+  unsigned int max_solutions_;
 };
 
 // Get access to a global variable that contains the pick & place params.
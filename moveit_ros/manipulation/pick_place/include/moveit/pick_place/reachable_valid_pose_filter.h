@@ -54,6 +54,7 @@ public:
 
 private:
   bool isEndEffectorFree(const ManipulationPlanPtr& plan, robot_state::RobotState& token_state) const;
+  bool isInReachabilityMap(const ManipulationPlanPtr& plan, const robot_state::RobotState& token_state) const;
 
   planning_scene::PlanningSceneConstPtr planning_scene_;
   collision_detection::AllowedCollisionMatrixConstPtr collision_matrix_;
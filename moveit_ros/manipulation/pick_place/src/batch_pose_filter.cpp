@@ -0,0 +1,178 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/pick_place/batch_pose_filter.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <ros/console.h>
+#include <cmath>
+
+pick_place::BatchPoseFilter::BatchPoseFilter(
+    const planning_scene::PlanningSceneConstPtr& scene,
+    const collision_detection::AllowedCollisionMatrixConstPtr& collision_matrix, unsigned int nthreads)
+  : planning_scene_(scene), collision_matrix_(collision_matrix), nthreads_(std::max(1u, nthreads)), verbose_(false)
+{
+}
+
+void pick_place::BatchPoseFilter::checkEndEffectors(const std::vector<ManipulationPlanPtr>& plans, std::size_t first,
+                                                    std::vector<char>& free) const
+{
+  // every thread needs its own state, the planning scene is only read
+  robot_state::RobotState token_state(planning_scene_->getCurrentState());
+  collision_detection::CollisionRequest req;
+  req.verbose = verbose_;
+  for (std::size_t i = first; i < plans.size(); i += nthreads_)
+  {
+    const ManipulationPlanPtr& plan = plans[i];
+    req.group_name = plan->shared_data_->end_effector_group_->getName();
+    token_state.updateStateWithLinkAt(plan->shared_data_->ik_link_, plan->transformed_goal_pose_);
+    collision_detection::CollisionResult res;
+    planning_scene_->checkCollision(req, res, token_state, *collision_matrix_);
+    free[i] = !res.collision;
+  }
+}
+
+double pick_place::BatchPoseFilter::computeMaximumReach(const ManipulationPlanSharedData& shared_data) const
+{
+  const robot_model::JointModel* root = shared_data.planning_group_->getCommonRoot();
+  if (!root)
+    return -1.0;
+
+  // by the triangle inequality, the IK link is never further away from the parent link of the group's root joint
+  // than the sum of the lengths of the joint origins (and of the prismatic joint strokes) on the way to it
+  double reach = 0.0;
+  for (const robot_model::LinkModel* link = shared_data.ik_link_; link; link = link->getParentLinkModel())
+  {
+    const robot_model::JointModel* joint = link->getParentJointModel();
+    reach += link->getJointOriginTransform().translation().norm();
+    if (joint->getType() == robot_model::JointModel::PRISMATIC)
+    {
+      const moveit::core::VariableBounds& bounds = joint->getVariableBounds()[0];
+      if (!bounds.position_bounded_)
+        return -1.0;
+      reach += std::max(fabs(bounds.min_position_), fabs(bounds.max_position_));
+    }
+    else if (joint->getType() == robot_model::JointModel::PLANAR ||
+             joint->getType() == robot_model::JointModel::FLOATING)
+      return -1.0;
+    if (joint == root)
+      return reach;
+  }
+  // the IK link is not below the root of the group
+  return -1.0;
+}
+
+void pick_place::BatchPoseFilter::filter(std::vector<ManipulationPlanPtr>& plans,
+                                         std::vector<ManipulationPlanPtr>& rejected) const
+{
+  if (plans.empty())
+    return;
+  const ManipulationPlanSharedData& shared_data = *plans.front()->shared_data_;
+  const robot_state::RobotState& current_state = planning_scene_->getCurrentState();
+
+  // bring all goal poses to the planning frame
+  for (std::size_t i = 0; i < plans.size(); ++i)
+  {
+    ManipulationPlan& plan = *plans[i];
+    tf::poseMsgToEigen(plan.goal_pose_.pose, plan.transformed_goal_pose_);
+    plan.transformed_goal_pose_ =
+        planning_scene_->getFrameTransform(current_state, plan.goal_pose_.header.frame_id) * plan.transformed_goal_pose_;
+  }
+
+  // check the end-effector alone for collisions at all goal poses, in parallel
+  std::vector<char> free(plans.size(), 0);
+  unsigned int nthreads = std::min<std::size_t>(nthreads_, plans.size());
+  std::vector<boost::thread*> threads(nthreads - 1, NULL);
+  for (std::size_t t = 1; t < nthreads; ++t)
+    threads[t - 1] = new boost::thread(boost::bind(&BatchPoseFilter::checkEndEffectors, this, boost::cref(plans), t,
+                                                   boost::ref(free)));
+  checkEndEffectors(plans, 0, free);
+  for (std::size_t t = 0; t < threads.size(); ++t)
+  {
+    threads[t]->join();
+    delete threads[t];
+  }
+
+  // discard the goal poses the planning group cannot reach, as recorded by its reachability map if it has one
+  robot_model::ReachabilityMapConstPtr map = shared_data.planning_group_->getReachabilityMap();
+  if (map && (map->getTipLinkName() != shared_data.ik_link_->getName() ||
+              !current_state.getRobotModel()->hasLinkModel(map->getBaseLinkName())))
+    map.reset();
+  Eigen::Affine3d map_base = Eigen::Affine3d::Identity();
+  if (map)
+    map_base = current_state.getGlobalLinkTransform(map->getBaseLinkName()).inverse(Eigen::Isometry);
+  const double reach = computeMaximumReach(shared_data);
+  const robot_model::JointModel* root = shared_data.planning_group_->getCommonRoot();
+  Eigen::Vector3d base = Eigen::Vector3d::Zero();
+  if (root && root->getParentLinkModel())
+    base = current_state.getGlobalLinkTransform(root->getParentLinkModel()).translation();
+
+  std::vector<ManipulationPlanPtr> survivors;
+  survivors.reserve(plans.size());
+  for (std::size_t i = 0; i < plans.size(); ++i)
+  {
+    const ManipulationPlanPtr& plan = plans[i];
+    plan->processing_stage_ = 1;
+    if (!free[i])
+      plan->error_code_.val = moveit_msgs::MoveItErrorCodes::GOAL_IN_COLLISION;
+    else if ((reach >= 0.0 && (plan->transformed_goal_pose_.translation() - base).norm() > reach) ||
+             (map && !map->isPoseReachable(map_base * plan->transformed_goal_pose_)))
+      plan->error_code_.val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    else
+    {
+      plan->processing_stage_ = 0;
+      survivors.push_back(plan);
+      continue;
+    }
+    rejected.push_back(plan);
+  }
+  ROS_DEBUG_NAMED("manipulation", "Batch pose filter kept %u of %u goal poses", (unsigned int)survivors.size(),
+                  (unsigned int)plans.size());
+  plans.swap(survivors);
+
+  // compute IK for the remaining goal poses at once; failing to find a solution from the current state alone
+  // does not mean there is none, so these solutions only serve as the first attempt of the pose filter
+  const kinematics::KinematicsBaseConstPtr& solver = shared_data.planning_group_->getSolverInstance();
+  if (plans.empty() || !solver || solver->getTipFrames().size() != 1)
+    return;
+  EigenSTL::vector_Affine3d poses(plans.size());
+  for (std::size_t i = 0; i < plans.size(); ++i)
+    poses[i] = plans[i]->transformed_goal_pose_;
+  std::vector<std::vector<double> > solutions;
+  robot_state::RobotState seed_state(current_state);
+  seed_state.computeIKBatch(shared_data.planning_group_, poses, shared_data.ik_link_->getName(), solutions);
+  for (std::size_t i = 0; i < plans.size(); ++i)
+    plans[i]->ik_solution_.swap(solutions[i]);
+}
@@ -36,11 +36,27 @@
 
 #include <moveit/pick_place/manipulation_pipeline.h>
 #include <ros/console.h>
+#include <moveit/utils/thread_groups.h>
+#include <algorithm>
 
 namespace pick_place
 {
+namespace
+{
+// Orders plans by increasing priority: higher quality first, lower id first for plans of equal quality
+struct OrderPlanPriority
+{
+  bool operator()(const ManipulationPlanPtr& a, const ManipulationPlanPtr& b) const
+  {
+    if (a->quality_ != b->quality_)
+      return a->quality_ < b->quality_;
+    return a->id_ > b->id_;
+  }
+};
+}
+
 ManipulationPipeline::ManipulationPipeline(const std::string& name, unsigned int nthreads)
-  : name_(name), nthreads_(nthreads), verbose_(false), stop_processing_(true)
+  : name_(name), nthreads_(nthreads), verbose_(false), queues_(1), queued_(0), max_solutions_(1), stop_processing_(true)
 {
   processing_threads_.resize(nthreads, NULL);
 }
@@ -54,6 +70,8 @@ ManipulationPipeline& ManipulationPipeline::addStage(const ManipulationStagePtr&
 {
   next->setVerbose(verbose_);
   stages_.push_back(next);
+  if (queues_.size() < stages_.size())
+    queues_.resize(stages_.size());
   return *this;
 }
 
@@ -83,6 +101,7 @@ void ManipulationPipeline::reset()
 {
   clear();
   stages_.clear();
+  queues_.resize(1);
 }
 
 void ManipulationPipeline::setVerbose(bool flag)
@@ -97,7 +116,9 @@ void ManipulationPipeline::clear()
   stop();
   {
     boost::mutex::scoped_lock slock(queue_access_lock_);
-    queue_.clear();
+    for (std::size_t i = 0; i < queues_.size(); ++i)
+      queues_[i].clear();
+    queued_ = 0;
   }
   {
     boost::mutex::scoped_lock slock(result_lock_);
@@ -121,6 +142,8 @@ void ManipulationPipeline::signalStop()
 {
   for (std::size_t i = 0; i < stages_.size(); ++i)
     stages_[i]->signalStop();
+  // set the flag under the queue lock so that no thread misses the notification while going to wait
+  boost::mutex::scoped_lock slock(queue_access_lock_);
   stop_processing_ = true;
   queue_access_cond_.notify_all();
 }
@@ -137,70 +160,113 @@ void ManipulationPipeline::stop()
     }
 }
 
+ManipulationPlanPtr ManipulationPipeline::popPlan(std::size_t home, std::size_t& stage)
+{
+  ManipulationPlanPtr plan;
+  if (queued_ == 0 || stages_.empty())
+    return plan;
+  stage = home;
+  if (queues_[stage].empty())
+  {
+    // steal work from the other stages, starting with the one that is closest to producing a solution
+    for (stage = stages_.size() - 1; queues_[stage].empty(); --stage)
+      if (stage == 0)
+        return plan;
+  }
+  std::vector<ManipulationPlanPtr>& queue = queues_[stage];
+  std::pop_heap(queue.begin(), queue.end(), OrderPlanPriority());
+  plan = queue.back();
+  queue.pop_back();
+  queued_--;
+  return plan;
+}
+
+void ManipulationPipeline::pushPlan(const ManipulationPlanPtr& plan, std::size_t stage)
+{
+  plan->processing_stage_ = stage;
+  std::vector<ManipulationPlanPtr>& queue = queues_[stage];
+  queue.push_back(plan);
+  std::push_heap(queue.begin(), queue.end(), OrderPlanPriority());
+  queued_++;
+}
+
 void ManipulationPipeline::processingThread(unsigned int index)
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PLANNING);
   ROS_DEBUG_STREAM_NAMED("manipulation", "Start thread " << index << " for '" << name_ << "'");
 
+  // the stage this thread prefers to work on
+  const std::size_t home = stages_.empty() ? 0 : index % stages_.size();
+  bool inc_queue = false;
+  boost::unique_lock<boost::mutex> ulock(queue_access_lock_);
   while (!stop_processing_)
   {
-    bool inc_queue = false;
-    boost::unique_lock<boost::mutex> ulock(queue_access_lock_);
-    // if the queue is empty, we trigger the corresponding event
-    if (queue_.empty() && !stop_processing_ && empty_queue_callback_)
+    std::size_t stage = 0;
+    ManipulationPlanPtr g = popPlan(home, stage);
+    if (!g)
     {
-      empty_queue_threads_++;
-      inc_queue = true;
-      if (empty_queue_threads_ == processing_threads_.size())
-        empty_queue_callback_();
-    }
-    while (queue_.empty() && !stop_processing_)
+      // if there is no work left, we trigger the corresponding event
+      if (!inc_queue && empty_queue_callback_)
+      {
+        inc_queue = true;
+        if (++empty_queue_threads_ == processing_threads_.size())
+          empty_queue_callback_();
+      }
       queue_access_cond_.wait(ulock);
-    while (!stop_processing_ && !queue_.empty())
+      continue;
+    }
+    if (inc_queue)
+    {
+      empty_queue_threads_--;
+      inc_queue = false;
+    }
+
+    ulock.unlock();
+    bool advance = false;
+    try
     {
-      ManipulationPlanPtr g = queue_.front();
-      queue_.pop_front();
-      if (inc_queue)
+      if (stage == 0)
+        g->error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+      bool res = stages_[stage]->evaluate(g);
+      g->processing_stage_ = stage + 1;
+      if (res == false)
       {
-        empty_queue_threads_--;
-        inc_queue = false;
+        boost::mutex::scoped_lock slock(result_lock_);
+        failed_.push_back(g);
+        ROS_INFO_STREAM_NAMED("manipulation", "Manipulation plan " << g->id_ << " failed at stage '"
+                                                                   << stages_[stage]->getName() << "' on thread "
+                                                                   << index);
       }
-
-      queue_access_lock_.unlock();
-      try
+      else if (stage + 1 < stages_.size())
+        advance = true;
+      else if (g->error_code_.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
       {
-        g->error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
-        for (std::size_t i = 0; !stop_processing_ && i < stages_.size(); ++i)
+        g->processing_stage_++;
+        bool enough;
         {
-          bool res = stages_[i]->evaluate(g);
-          g->processing_stage_ = i + 1;
-          if (res == false)
-          {
-            boost::mutex::scoped_lock slock(result_lock_);
-            failed_.push_back(g);
-            ROS_INFO_STREAM_NAMED("manipulation", "Manipulation plan " << g->id_ << " failed at stage '"
-                                                                       << stages_[i]->getName() << "' on thread "
-                                                                       << index);
-            break;
-          }
+          boost::mutex::scoped_lock slock(result_lock_);
+          success_.insert(std::upper_bound(success_.begin(), success_.end(), g, OrderPlanPriority()), g);
+          enough = success_.size() >= max_solutions_;
         }
-        if (g->error_code_.val == moveit_msgs::MoveItErrorCodes::SUCCESS)
+        ROS_INFO_STREAM_NAMED("manipulation", "Found successful manipulation plan!");
+        if (enough)
         {
-          g->processing_stage_++;
-          {
-            boost::mutex::scoped_lock slock(result_lock_);
-            success_.push_back(g);
-          }
+          // cancel the remaining work
           signalStop();
-          ROS_INFO_STREAM_NAMED("manipulation", "Found successful manipulation plan!");
           if (solution_callback_)
             solution_callback_();
         }
       }
-      catch (std::exception& ex)
-      {
-        ROS_ERROR_NAMED("manipulation", "[%s:%u] %s", name_.c_str(), index, ex.what());
-      }
-      queue_access_lock_.lock();
+    }
+    catch (std::exception& ex)
+    {
+      ROS_ERROR_NAMED("manipulation", "[%s:%u] %s", name_.c_str(), index, ex.what());
+    }
+    ulock.lock();
+    if (advance && !stop_processing_)
+    {
+      pushPlan(g, stage + 1);
+      queue_access_cond_.notify_one();
     }
   }
 }
@@ -208,12 +274,18 @@ void ManipulationPipeline::processingThread(unsigned int index)
 void ManipulationPipeline::push(const ManipulationPlanPtr& plan)
 {
   boost::mutex::scoped_lock slock(queue_access_lock_);
-  queue_.push_back(plan);
+  pushPlan(plan, 0);
   ROS_INFO_STREAM_NAMED("manipulation", "Added plan for pipeline '" << name_ << "'. Queue is now of size "
-                                                                    << queue_.size());
+                                                                    << queued_);
   queue_access_cond_.notify_all();
 }
 
+void ManipulationPipeline::addFailedManipulationPlan(const ManipulationPlanPtr& plan)
+{
+  boost::mutex::scoped_lock slock(result_lock_);
+  failed_.push_back(plan);
+}
+
 void ManipulationPipeline::reprocessLastFailure()
 {
   boost::mutex::scoped_lock slock(queue_access_lock_);
@@ -222,9 +294,9 @@ void ManipulationPipeline::reprocessLastFailure()
   ManipulationPlanPtr plan = failed_.back();
   failed_.pop_back();
   plan->clear();
-  queue_.push_back(plan);
+  pushPlan(plan, 0);
   ROS_INFO_STREAM_NAMED("manipulation", "Re-added last failed plan for pipeline '"
-                                            << name_ << "'. Queue is now of size " << queue_.size());
+                                            << name_ << "'. Queue is now of size " << queued_);
   queue_access_cond_.notify_all();
 }
 }
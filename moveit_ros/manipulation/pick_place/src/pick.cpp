@@ -36,6 +36,7 @@
 
 #include <moveit/pick_place/pick_place.h>
 #include <moveit/pick_place/reachable_valid_pose_filter.h>
+#include <moveit/pick_place/batch_pose_filter.h>
 #include <moveit/pick_place/approach_and_translate_stage.h>
 #include <moveit/pick_place/plan_stage.h>
 #include <ros/console.h>
@@ -163,6 +164,7 @@ bool PickPlan::plan(const planning_scene::PlanningSceneConstPtr& planning_scene,
   ManipulationStagePtr stage2(new ApproachAndTranslateStage(planning_scene, approach_grasp_acm));
   ManipulationStagePtr stage3(new PlanStage(planning_scene, pick_place_->getPlanningPipeline()));
   pipeline_.addStage(stage1).addStage(stage2).addStage(stage3);
+  pipeline_.setMaxSolutions(GetGlobalPickPlaceParams().max_solutions_);
 
   initialize();
   pipeline_.start();
@@ -174,7 +176,9 @@ bool PickPlan::plan(const planning_scene::PlanningSceneConstPtr& planning_scene,
   OrderGraspQuality oq(goal.possible_grasps);
   std::sort(grasp_order.begin(), grasp_order.end(), oq);
 
-  // feed the available grasps to the stages we set up
+  // construct the candidate plans for the available grasps
+  std::vector<ManipulationPlanPtr> candidates;
+  candidates.reserve(goal.possible_grasps.size());
   for (std::size_t i = 0; i < goal.possible_grasps.size(); ++i)
   {
     ManipulationPlanPtr p(new ManipulationPlan(const_plan_data));
@@ -183,14 +187,23 @@ bool PickPlan::plan(const planning_scene::PlanningSceneConstPtr& planning_scene,
     p->retreat_ = g.post_grasp_retreat;
     p->goal_pose_ = g.grasp_pose;
     p->id_ = grasp_order[i];
+    p->quality_ = g.grasp_quality;
     // if no frame of reference was specified, assume the transform to be in the reference frame of the object
     if (p->goal_pose_.header.frame_id.empty())
       p->goal_pose_.header.frame_id = goal.target_name;
     p->approach_posture_ = g.pre_grasp_posture;
     p->retreat_posture_ = g.grasp_posture;
-    pipeline_.push(p);
+    candidates.push_back(p);
   }
 
+  // discard the grasps that cannot succeed all at once and feed the others to the stages we set up
+  std::vector<ManipulationPlanPtr> rejected;
+  BatchPoseFilter(planning_scene, approach_grasp_acm, pipeline_.getThreadCount()).filter(candidates, rejected);
+  for (std::size_t i = 0; i < rejected.size(); ++i)
+    pipeline_.addFailedManipulationPlan(rejected[i]);
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+    pipeline_.push(candidates[i]);
+
   // wait till we're done
   waitForPipeline(endtime);
   pipeline_.stop();
@@ -67,6 +67,7 @@ private:
     params_.max_fail_ = config.max_consecutive_fail_attempts;
     params_.max_step_ = config.cartesian_motion_step_size;
     params_.jump_factor_ = config.jump_factor;
+    params_.max_solutions_ = config.max_successful_plans;
   }
 
   dynamic_reconfigure::Server<PickPlaceDynamicReconfigureConfig> dynamic_reconfigure_server_;
@@ -74,7 +75,8 @@ private:
 }
 }
 
-pick_place::PickPlaceParams::PickPlaceParams() : max_goal_count_(5), max_fail_(3), max_step_(0.02), jump_factor_(2.0)
+pick_place::PickPlaceParams::PickPlaceParams()
+  : max_goal_count_(5), max_fail_(3), max_step_(0.02), jump_factor_(2.0), max_solutions_(1)
 {
 }
 
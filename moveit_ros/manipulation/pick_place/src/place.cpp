@@ -36,6 +36,7 @@
 
 #include <moveit/pick_place/pick_place.h>
 #include <moveit/pick_place/reachable_valid_pose_filter.h>
+#include <moveit/pick_place/batch_pose_filter.h>
 #include <moveit/pick_place/approach_and_translate_stage.h>
 #include <moveit/pick_place/plan_stage.h>
 #include <moveit/robot_state/conversions.h>
@@ -297,12 +298,15 @@ bool PlacePlan::plan(const planning_scene::PlanningSceneConstPtr& planning_scene
   ManipulationStagePtr stage2(new ApproachAndTranslateStage(planning_scene, approach_place_acm));
   ManipulationStagePtr stage3(new PlanStage(planning_scene, pick_place_->getPlanningPipeline()));
   pipeline_.addStage(stage1).addStage(stage2).addStage(stage3);
+  pipeline_.setMaxSolutions(GetGlobalPickPlaceParams().max_solutions_);
 
   initialize();
 
   pipeline_.start();
 
-  // add possible place locations
+  // construct the candidate plans for the possible place locations
+  std::vector<ManipulationPlanPtr> candidates;
+  candidates.reserve(goal.place_locations.size());
   for (std::size_t i = 0; i < goal.place_locations.size(); ++i)
   {
     ManipulationPlanPtr p(new ManipulationPlan(const_plan_data));
@@ -326,8 +330,16 @@ bool PlacePlan::plan(const planning_scene::PlanningSceneConstPtr& planning_scene
     p->id_ = i;
     if (p->retreat_posture_.joint_names.empty())
       p->retreat_posture_ = attached_body->getDetachPosture();
-    pipeline_.push(p);
+    candidates.push_back(p);
   }
+
+  // discard the place locations that cannot succeed all at once and feed the others to the stages we set up
+  std::vector<ManipulationPlanPtr> rejected;
+  BatchPoseFilter(planning_scene, approach_place_acm, pipeline_.getThreadCount()).filter(candidates, rejected);
+  for (std::size_t i = 0; i < rejected.size(); ++i)
+    pipeline_.addFailedManipulationPlan(rejected[i]);
+  for (std::size_t i = 0; i < candidates.size(); ++i)
+    pipeline_.push(candidates[i]);
   ROS_INFO_NAMED("manipulation", "Added %d place locations", (int)goal.place_locations.size());
 
   // wait till we're done
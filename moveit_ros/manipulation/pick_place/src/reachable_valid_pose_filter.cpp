@@ -104,11 +104,27 @@ bool pick_place::ReachableAndValidPoseFilter::isEndEffectorFree(const Manipulati
   return res.collision == false;
 }
 
+bool pick_place::ReachableAndValidPoseFilter::isInReachabilityMap(const ManipulationPlanPtr& plan,
+                                                                  const robot_state::RobotState& token_state) const
+{
+  const robot_model::ReachabilityMapConstPtr& map = plan->shared_data_->planning_group_->getReachabilityMap();
+  if (!map || map->getTipLinkName() != plan->shared_data_->ik_link_->getName() ||
+      !token_state.getRobotModel()->hasLinkModel(map->getBaseLinkName()))
+    return true;
+  // the transform of the base link is not affected by placing the end-effector at the goal pose
+  const Eigen::Affine3d& base = token_state.getGlobalLinkTransform(map->getBaseLinkName());
+  if (map->isPoseReachable(base.inverse(Eigen::Isometry) * plan->transformed_goal_pose_))
+    return true;
+  if (verbose_)
+    ROS_INFO_NAMED("manipulation", "The goal pose of plan %u is not in the reachability map", (unsigned int)plan->id_);
+  return false;
+}
+
 bool pick_place::ReachableAndValidPoseFilter::evaluate(const ManipulationPlanPtr& plan) const
 {
   // initialize with scene state
   robot_state::RobotStatePtr token_state(new robot_state::RobotState(planning_scene_->getCurrentState()));
-  if (isEndEffectorFree(plan, *token_state))
+  if (isEndEffectorFree(plan, *token_state) && isInReachabilityMap(plan, *token_state))
   {
     // update the goal pose message if anything has changed; this is because the name of the frame in the input goal
     // pose
@@ -135,6 +151,14 @@ bool pick_place::ReachableAndValidPoseFilter::evaluate(const ManipulationPlanPtr
       plan->goal_sampler_->setGroupStateValidityCallback(boost::bind(
           &isStateCollisionFree, planning_scene_.get(), collision_matrix_.get(), verbose_, plan.get(), _1, _2, _3));
       plan->goal_sampler_->setVerbose(verbose_);
+      // the IK solution computed for all plans at once is tried before sampling new ones
+      if (!plan->ik_solution_.empty() &&
+          isStateCollisionFree(planning_scene_.get(), collision_matrix_.get(), verbose_, plan.get(), token_state.get(),
+                               plan->shared_data_->planning_group_, &plan->ik_solution_[0]))
+      {
+        plan->possible_goal_states_.push_back(token_state);
+        return true;
+      }
       if (plan->goal_sampler_->sample(*token_state, plan->shared_data_->max_goal_sampling_attempts_))
       {
         plan->possible_goal_states_.push_back(token_state);
@@ -55,8 +55,14 @@ static const std::string SET_PLANNER_PARAMS_SERVICE_NAME =
 static const std::string MOVE_ACTION = "move_group";      // name of 'move' action
 static const std::string IK_SERVICE_NAME = "compute_ik";  // name of ik service
 static const std::string FK_SERVICE_NAME = "compute_fk";  // name of fk service
+static const std::string IK_BATCH_SERVICE_NAME =
+    "compute_ik_batch";  // name of the service that solves ik for many poses
+static const std::string FK_BATCH_SERVICE_NAME =
+    "compute_fk_batch";  // name of the service that computes fk for many states
 static const std::string STATE_VALIDITY_SERVICE_NAME =
     "check_state_validity";  // name of the service that validates states
+static const std::string STATE_VALIDITY_BATCH_SERVICE_NAME =
+    "check_state_validity_batch";  // name of the service that validates many states at once
 static const std::string CARTESIAN_PATH_SERVICE_NAME =
     "compute_cartesian_path";  // name of the service that computes cartesian paths
 static const std::string GET_PLANNING_SCENE_SERVICE_NAME =
@@ -65,6 +71,10 @@ static const std::string APPLY_PLANNING_SCENE_SERVICE_NAME =
     "apply_planning_scene";  // name of the service that applies a given planning scene
 static const std::string CLEAR_OCTOMAP_SERVICE_NAME =
     "clear_octomap";  // name of the service that can be used to clear the octomap
+static const std::string BATCH_PLAN_ACTION =
+    "plan_batch";  // name of the action that plans many motion plan requests at once
+static const std::string QUERY_WORLD_OBJECTS_SERVICE_NAME =
+    "query_world_objects";  // name of the service that reports world object poses without their geometry
 }
 
 #endif
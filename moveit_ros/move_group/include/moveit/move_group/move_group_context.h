@@ -38,6 +38,10 @@
 #define MOVEIT_MOVE_GROUP_CONTEXT_
 
 #include <moveit/macros/class_forward.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/noncopyable.hpp>
+#include <vector>
 
 namespace planning_scene_monitor
 {
@@ -64,14 +68,27 @@ namespace move_group
 {
 MOVEIT_CLASS_FORWARD(MoveGroupContext);
 
+class StartupPhases;
+
 struct MoveGroupContext
 {
+  /** \brief Set up the context. \e planning_threads planning pipelines are loaded, so that many planning requests
+      can be served concurrently. The pipelines are loaded while the trajectory execution manager connects to the
+      controllers; if \e startup_phases is given, both are recorded in it. */
   MoveGroupContext(const planning_scene_monitor::PlanningSceneMonitorPtr& planning_scene_monitor,
-                   bool allow_trajectory_execution = false, bool debug = false);
+                   bool allow_trajectory_execution = false, bool debug = false, unsigned int planning_threads = 1,
+                   StartupPhases* startup_phases = NULL);
   ~MoveGroupContext();
 
   bool status() const;
 
+  /** \brief Get a planning pipeline no other request is using, waiting until one is released if needed.
+      Use LockedPlanningPipeline instead of calling this directly. */
+  planning_pipeline::PlanningPipelinePtr acquirePlanningPipeline();
+
+  /** \brief Make a pipeline obtained from acquirePlanningPipeline() available to other requests */
+  void releasePlanningPipeline(const planning_pipeline::PlanningPipelinePtr& pipeline);
+
   planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor_;
   trajectory_execution_manager::TrajectoryExecutionManagerPtr trajectory_execution_manager_;
   planning_pipeline::PlanningPipelinePtr planning_pipeline_;
@@ -79,6 +96,38 @@ struct MoveGroupContext
   plan_execution::PlanWithSensingPtr plan_with_sensing_;
   bool allow_trajectory_execution_;
   bool debug_;
+  unsigned int planning_threads_;
+
+private:
+  // the pipelines not used by a request at the moment; planning_pipeline_ is one of them
+  std::vector<planning_pipeline::PlanningPipelinePtr> free_planning_pipelines_;
+  boost::mutex planning_pipelines_lock_;
+  boost::condition_variable planning_pipeline_released_;
+};
+
+/** \brief Reserves one of the planning pipelines of a MoveGroupContext for as long as it exists, so that concurrent
+    planning requests do not share a planner instance. */
+class LockedPlanningPipeline : private boost::noncopyable
+{
+public:
+  LockedPlanningPipeline(const MoveGroupContextPtr& context)
+    : context_(context), pipeline_(context->acquirePlanningPipeline())
+  {
+  }
+
+  ~LockedPlanningPipeline()
+  {
+    context_->releasePlanningPipeline(pipeline_);
+  }
+
+  const planning_pipeline::PlanningPipelinePtr& operator->() const
+  {
+    return pipeline_;
+  }
+
+private:
+  MoveGroupContextPtr context_;
+  planning_pipeline::PlanningPipelinePtr pipeline_;
 };
 }
 
@@ -0,0 +1,104 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_MOVE_GROUP_STARTUP_PHASES_
+#define MOVEIT_MOVE_GROUP_STARTUP_PHASES_
+
+#include <ros/time.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace move_group
+{
+/** \brief Records how long each phase of the startup of move_group takes. Phases that do not depend on each other
+    run concurrently, so the time each phase started at is recorded as well. Phases may be run from any thread. */
+class StartupPhases
+{
+public:
+  StartupPhases() : start_(ros::WallTime::now())
+  {
+  }
+
+  /** \brief Call \e fn and record it as \e phase */
+  void run(const std::string& phase, const boost::function<void()>& fn)
+  {
+    ros::WallTime begin = ros::WallTime::now();
+    fn();
+    ros::WallTime end = ros::WallTime::now();
+    Phase p = { phase, (begin - start_).toSec(), (end - begin).toSec() };
+    boost::mutex::scoped_lock _(lock_);
+    phases_.push_back(p);
+  }
+
+  /** \brief Write the phases in the order they started, and the time since this object was created */
+  void report(std::ostream& out) const
+  {
+    std::vector<Phase> phases;
+    {
+      boost::mutex::scoped_lock _(lock_);
+      phases = phases_;
+    }
+    std::sort(phases.begin(), phases.end());
+    out << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < phases.size(); ++i)
+      out << "*     " << std::setw(8) << phases[i].start << " s  +" << std::setw(8) << phases[i].duration << " s  "
+          << phases[i].name << std::endl;
+    out << "*     started in " << (ros::WallTime::now() - start_).toSec() << " s" << std::endl;
+  }
+
+private:
+  struct Phase
+  {
+    std::string name;
+    double start;
+    double duration;
+
+    bool operator<(const Phase& other) const
+    {
+      return start < other.start;
+    }
+  };
+
+  ros::WallTime start_;
+  mutable boost::mutex lock_;
+  std::vector<Phase> phases_;
+};
+}
+
+#endif
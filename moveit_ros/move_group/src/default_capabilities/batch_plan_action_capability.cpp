@@ -0,0 +1,127 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+#include "batch_plan_action_capability.h"
+#include <moveit/planning_pipeline/planning_pipeline.h>
+#include <moveit/move_group/capability_names.h>
+#include <moveit/utils/thread_groups.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+
+move_group::MoveGroupBatchPlanAction::MoveGroupBatchPlanAction() : MoveGroupCapability("BatchPlanAction")
+{
+}
+
+void move_group::MoveGroupBatchPlanAction::initialize()
+{
+  batch_action_server_.reset(new actionlib::SimpleActionServer<moveit_ros_move_group::MotionPlanBatchAction>(
+      root_node_handle_, BATCH_PLAN_ACTION, boost::bind(&MoveGroupBatchPlanAction::executeBatchCallback, this, _1),
+      false));
+  batch_action_server_->start();
+}
+
+void move_group::MoveGroupBatchPlanAction::executeBatchCallback(
+    const moveit_ros_move_group::MotionPlanBatchGoalConstPtr& goal)
+{
+  ROS_INFO("Received a batch of %u motion plan requests...", (unsigned int)goal->requests.size());
+  moveit_ros_move_group::MotionPlanBatchResult result;
+  result.responses.resize(goal->requests.size());
+  for (std::size_t i = 0; i < result.responses.size(); ++i)
+    result.responses[i].error_code.val = moveit_msgs::MoveItErrorCodes::PREEMPTED;
+
+  // before we start planning, ensure that we have the latest robot state received...
+  for (std::size_t i = 0; i < goal->requests.size(); ++i)
+    if (goal->requests[i].start_state.is_diff)
+    {
+      context_->planning_scene_monitor_->waitForCurrentRobotState(ros::Time::now());
+      break;
+    }
+  context_->planning_scene_monitor_->updateFrameTransforms();
+
+  // plan all requests against the same copy of the scene, so the monitored scene is not locked for the whole batch
+  planning_scene::PlanningScenePtr scene;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO lscene(context_->planning_scene_monitor_);
+    scene = planning_scene::PlanningScene::clone(lscene);
+  }
+
+  // each thread leases a planning pipeline and takes the next request that is not planned yet
+  std::size_t next_request = 0;
+  boost::mutex batch_lock;
+  boost::thread_group planning_threads;
+  std::size_t thread_count = std::min<std::size_t>(context_->planning_threads_, goal->requests.size());
+  for (std::size_t t = 0; t < thread_count; ++t)
+    planning_threads.create_thread([this, &goal, &scene, &result, &next_request, &batch_lock]() {
+      moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PLANNING);
+      LockedPlanningPipeline planning_pipeline(context_);
+      while (true)
+      {
+        std::size_t index;
+        {
+          boost::mutex::scoped_lock slock(batch_lock);
+          if (next_request >= goal->requests.size() || batch_action_server_->isPreemptRequested() || !ros::ok())
+            return;
+          index = next_request++;
+        }
+
+        planning_interface::MotionPlanResponse res;
+        try
+        {
+          planning_pipeline->generatePlan(scene, goal->requests[index], res);
+        }
+        catch (std::exception& ex)
+        {
+          ROS_ERROR("Planning pipeline threw an exception: %s", ex.what());
+          res.error_code_.val = moveit_msgs::MoveItErrorCodes::FAILURE;
+        }
+
+        moveit_ros_move_group::MotionPlanBatchFeedback feedback;
+        feedback.index = index;
+        res.getMessage(feedback.response);
+        boost::mutex::scoped_lock slock(batch_lock);
+        result.responses[index] = feedback.response;
+        batch_action_server_->publishFeedback(feedback);
+      }
+    });
+  planning_threads.join_all();
+
+  if (batch_action_server_->isPreemptRequested())
+    batch_action_server_->setPreempted(result, "Batch planning was preempted");
+  else
+    batch_action_server_->setSucceeded(result);
+}
+
+#include <class_loader/class_loader.hpp>
+CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupBatchPlanAction, move_group::MoveGroupCapability)
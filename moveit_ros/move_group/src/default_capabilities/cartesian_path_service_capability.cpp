@@ -49,12 +49,25 @@ move_group::MoveGroupCartesianPathService::MoveGroupCartesianPathService()
 {
 }
 
+move_group::MoveGroupCartesianPathService::~MoveGroupCartesianPathService()
+{
+  if (spinner_)
+    spinner_->stop();
+}
+
 void move_group::MoveGroupCartesianPathService::initialize()
 {
   display_path_ = node_handle_.advertise<moveit_msgs::DisplayTrajectory>(
       planning_pipeline::PlanningPipeline::DISPLAY_PATH_TOPIC, 10, true);
-  cartesian_path_service_ = root_node_handle_.advertiseService(CARTESIAN_PATH_SERVICE_NAME,
-                                                               &MoveGroupCartesianPathService::computeService, this);
+
+  // serve requests on our own queue, so they are computed concurrently with each other and with motion plans
+  ros::AdvertiseServiceOptions ops;
+  ops.template init<moveit_msgs::GetCartesianPath::Request, moveit_msgs::GetCartesianPath::Response>(
+      CARTESIAN_PATH_SERVICE_NAME, boost::bind(&MoveGroupCartesianPathService::computeService, this, _1, _2));
+  ops.callback_queue = &callback_queue_;
+  cartesian_path_service_ = root_node_handle_.advertiseService(ops);
+  spinner_.reset(new ros::AsyncSpinner(context_->planning_threads_, &callback_queue_));
+  spinner_->start();
 }
 
 namespace
@@ -39,6 +39,8 @@
 
 #include <moveit/move_group/move_group_capability.h>
 #include <moveit_msgs/GetCartesianPath.h>
+#include <ros/callback_queue.h>
+#include <memory>
 
 namespace move_group
 {
@@ -46,6 +48,7 @@ class MoveGroupCartesianPathService : public MoveGroupCapability
 {
 public:
   MoveGroupCartesianPathService();
+  ~MoveGroupCartesianPathService();
 
   virtual void initialize();
 
@@ -53,6 +56,8 @@ private:
   bool computeService(moveit_msgs::GetCartesianPath::Request& req, moveit_msgs::GetCartesianPath::Response& res);
 
   ros::ServiceServer cartesian_path_service_;
+  ros::CallbackQueue callback_queue_;
+  std::unique_ptr<ros::AsyncSpinner> spinner_;
   ros::Publisher display_path_;
   bool display_computed_paths_;
 };
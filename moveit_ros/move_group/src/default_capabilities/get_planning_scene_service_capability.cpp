@@ -36,16 +36,38 @@
 
 #include "get_planning_scene_service_capability.h"
 #include <moveit/move_group/capability_names.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <boost/bind.hpp>
+#include <algorithm>
 
 move_group::MoveGroupGetPlanningSceneService::MoveGroupGetPlanningSceneService()
   : MoveGroupCapability("GetPlanningSceneService")
+  // versions start at the wall time, so they keep increasing across restarts of move_group
+  , version_(ros::WallTime::now().toNSec())
+  , oldest_version_(version_)
 {
 }
 
+move_group::MoveGroupGetPlanningSceneService::~MoveGroupGetPlanningSceneService()
+{
+  if (world_)
+  {
+    planning_scene_monitor::LockedPlanningSceneRW ps(context_->planning_scene_monitor_);
+    world_->removeObserver(world_observer_);
+    world_index_.reset();
+  }
+}
+
 void move_group::MoveGroupGetPlanningSceneService::initialize()
 {
+  {
+    planning_scene_monitor::LockedPlanningSceneRW ps(context_->planning_scene_monitor_);
+    attachToWorld(ps->getWorldNonConst());
+  }
   get_scene_service_ = root_node_handle_.advertiseService(
       GET_PLANNING_SCENE_SERVICE_NAME, &MoveGroupGetPlanningSceneService::getPlanningSceneService, this);
+  query_world_objects_service_ = root_node_handle_.advertiseService(
+      QUERY_WORLD_OBJECTS_SERVICE_NAME, &MoveGroupGetPlanningSceneService::queryWorldObjectsService, this);
 }
 
 bool move_group::MoveGroupGetPlanningSceneService::getPlanningSceneService(moveit_msgs::GetPlanningScene::Request& req,
@@ -58,5 +80,179 @@ bool move_group::MoveGroupGetPlanningSceneService::getPlanningSceneService(movei
   return true;
 }
 
+bool move_group::MoveGroupGetPlanningSceneService::queryWorldObjectsService(
+    moveit_ros_move_group::QueryWorldObjects::Request& req, moveit_ros_move_group::QueryWorldObjects::Response& res)
+{
+  {
+    planning_scene_monitor::LockedPlanningSceneRO ps(context_->planning_scene_monitor_);
+    boost::mutex::scoped_lock slock(index_lock_);
+    if (ps->getWorld() == world_)
+    {
+      fillQueryResponse(*ps, req, res);
+      return true;
+    }
+  }
+
+  // the monitored scene replaced its world (e.g., it became a diff of a new parent scene), so the index is rebuilt
+  planning_scene_monitor::LockedPlanningSceneRW ps(context_->planning_scene_monitor_);
+  attachToWorld(ps->getWorldNonConst());
+  boost::mutex::scoped_lock slock(index_lock_);
+  fillQueryResponse(*ps, req, res);
+  return true;
+}
+
+void move_group::MoveGroupGetPlanningSceneService::attachToWorld(const collision_detection::WorldPtr& world)
+{
+  if (world_ == world)
+    return;
+  if (world_)
+    world_->removeObserver(world_observer_);
+  {
+    boost::mutex::scoped_lock slock(index_lock_);
+    world_ = world;
+    objects_.clear();
+    removed_objects_.clear();
+    changes_.clear();
+    oldest_version_ = ++version_;
+  }
+  world_index_.reset(new collision_detection::WorldIndex(world_));
+  world_observer_ = world_->addObserver(boost::bind(&MoveGroupGetPlanningSceneService::worldChanged, this, _1, _2));
+  world_->notifyObserverAllObjects(world_observer_, collision_detection::World::CREATE);
+}
+
+void move_group::MoveGroupGetPlanningSceneService::worldChanged(
+    const collision_detection::World::ObjectConstPtr& object, collision_detection::World::Action action)
+{
+  boost::mutex::scoped_lock slock(index_lock_);
+  ++version_;
+
+  std::map<std::string, IndexedObject>::iterator it = objects_.find(object->id_);
+  if (it != objects_.end())
+    changes_.erase(it->second.version_);
+  else
+  {
+    std::map<std::string, std::uint64_t>::iterator removed = removed_objects_.find(object->id_);
+    if (removed != removed_objects_.end())
+    {
+      changes_.erase(removed->second);
+      removed_objects_.erase(removed);
+    }
+  }
+  changes_[version_] = object->id_;
+
+  if (action & collision_detection::World::DESTROY)
+  {
+    if (it != objects_.end())
+      objects_.erase(it);
+    removed_objects_[object->id_] = version_;
+    if (removed_objects_.size() > MAX_REMOVED_OBJECTS)
+    {
+      for (std::map<std::string, std::uint64_t>::const_iterator r = removed_objects_.begin();
+           r != removed_objects_.end(); ++r)
+        changes_.erase(r->second);
+      removed_objects_.clear();
+      oldest_version_ = version_;
+    }
+    return;
+  }
+
+  IndexedObject& indexed = objects_[object->id_];
+  indexed.version_ = version_;
+  indexed.has_shapes_ = !object->shape_poses_.empty();
+  if (!indexed.has_shapes_)
+  {
+    indexed.pose_ = geometry_msgs::Pose();
+    indexed.pose_.orientation.w = 1.0;
+    return;
+  }
+  tf::poseEigenToMsg(object->shape_poses_[0], indexed.pose_);
+  indexed.min_ = indexed.max_ = object->shape_poses_[0].translation();
+  for (std::size_t i = 1; i < object->shape_poses_.size(); ++i)
+  {
+    indexed.min_ = indexed.min_.cwiseMin(object->shape_poses_[i].translation());
+    indexed.max_ = indexed.max_.cwiseMax(object->shape_poses_[i].translation());
+  }
+}
+
+bool move_group::MoveGroupGetPlanningSceneService::matchesQuery(
+    const planning_scene::PlanningScene& scene, const std::string& id, const IndexedObject& object,
+    const moveit_ros_move_group::QueryWorldObjects::Request& req) const
+{
+  if (!req.object_ids.empty() && std::find(req.object_ids.begin(), req.object_ids.end(), id) == req.object_ids.end())
+    return false;
+  if (req.with_type && !scene.hasObjectType(id))
+    return false;
+  if (req.use_roi)
+    return object.has_shapes_ && object.min_.x() >= req.roi_min.x && object.min_.y() >= req.roi_min.y &&
+           object.min_.z() >= req.roi_min.z && object.max_.x() <= req.roi_max.x &&
+           object.max_.y() <= req.roi_max.y && object.max_.z() <= req.roi_max.z;
+  return true;
+}
+
+void move_group::MoveGroupGetPlanningSceneService::addToResponse(
+    const planning_scene::PlanningScene& scene, const std::string& id, const IndexedObject& object,
+    moveit_ros_move_group::QueryWorldObjects::Response& res) const
+{
+  res.ids.push_back(id);
+  res.types.push_back(scene.hasObjectType(id) ? scene.getObjectType(id).key : std::string());
+  res.has_shapes.push_back(object.has_shapes_);
+  res.poses.push_back(object.pose_);
+}
+
+void move_group::MoveGroupGetPlanningSceneService::fillQueryResponse(
+    const planning_scene::PlanningScene& scene, const moveit_ros_move_group::QueryWorldObjects::Request& req,
+    moveit_ros_move_group::QueryWorldObjects::Response& res) const
+{
+  res.version = version_;
+  res.incremental = req.since_version != 0 && req.since_version >= oldest_version_ && req.since_version <= version_;
+
+  if (res.incremental)
+  {
+    // only look at what changed after the version the client already knows
+    for (std::map<std::uint64_t, std::string>::const_iterator it = changes_.upper_bound(req.since_version);
+         it != changes_.end(); ++it)
+    {
+      std::map<std::string, IndexedObject>::const_iterator object = objects_.find(it->second);
+      if (object != objects_.end() && matchesQuery(scene, object->first, object->second, req))
+        addToResponse(scene, object->first, object->second, res);
+      else if (req.object_ids.empty() ||
+               std::find(req.object_ids.begin(), req.object_ids.end(), it->second) != req.object_ids.end())
+        res.removed_ids.push_back(it->second);
+    }
+    return;
+  }
+
+  if (!req.object_ids.empty())
+  {
+    for (std::size_t i = 0; i < req.object_ids.size(); ++i)
+    {
+      std::map<std::string, IndexedObject>::const_iterator object = objects_.find(req.object_ids[i]);
+      if (object != objects_.end() && matchesQuery(scene, object->first, object->second, req))
+        addToResponse(scene, object->first, object->second, res);
+    }
+    return;
+  }
+
+  if (req.use_roi)
+  {
+    // the objects whose shape positions are all in the region are among those whose bounds intersect it
+    std::vector<std::string> candidates;
+    world_index_->getObjectsInRegion(Eigen::AlignedBox3d(Eigen::Vector3d(req.roi_min.x, req.roi_min.y, req.roi_min.z),
+                                                         Eigen::Vector3d(req.roi_max.x, req.roi_max.y, req.roi_max.z)),
+                                     candidates);
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+    {
+      std::map<std::string, IndexedObject>::const_iterator object = objects_.find(candidates[i]);
+      if (object != objects_.end() && matchesQuery(scene, object->first, object->second, req))
+        addToResponse(scene, object->first, object->second, res);
+    }
+    return;
+  }
+
+  for (std::map<std::string, IndexedObject>::const_iterator it = objects_.begin(); it != objects_.end(); ++it)
+    if (matchesQuery(scene, it->first, it->second, req))
+      addToResponse(scene, it->first, it->second, res);
+}
+
 #include <class_loader/class_loader.hpp>
 CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupGetPlanningSceneService, move_group::MoveGroupCapability)
@@ -38,7 +38,10 @@
 #define MOVEIT_MOVE_GROUP_GET_PLANNING_SCENE_CAPABILITY_
 
 #include <moveit/move_group/move_group_capability.h>
+#include <moveit/collision_detection/world_index.h>
 #include <moveit_msgs/GetPlanningScene.h>
+#include <moveit_ros_move_group/QueryWorldObjects.h>
+#include <boost/thread/mutex.hpp>
 
 namespace move_group
 {
@@ -46,14 +49,73 @@ class MoveGroupGetPlanningSceneService : public MoveGroupCapability
 {
 public:
   MoveGroupGetPlanningSceneService();
+  virtual ~MoveGroupGetPlanningSceneService();
 
   virtual void initialize();
 
 private:
+  /** \brief What the world index keeps about an object, so queries never need to look at its geometry */
+  struct IndexedObject
+  {
+    /** \brief The world version of the last change to the object */
+    std::uint64_t version_;
+
+    /** \brief False if the object has no shapes */
+    bool has_shapes_;
+
+    /** \brief The pose of the first shape of the object */
+    geometry_msgs::Pose pose_;
+
+    /** \brief The bounds of the positions of all the shapes of the object */
+    Eigen::Vector3d min_;
+    Eigen::Vector3d max_;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
   bool getPlanningSceneService(moveit_msgs::GetPlanningScene::Request& req,
                                moveit_msgs::GetPlanningScene::Response& res);
+  bool queryWorldObjectsService(moveit_ros_move_group::QueryWorldObjects::Request& req,
+                                moveit_ros_move_group::QueryWorldObjects::Response& res);
+
+  /** \brief Start maintaining the index from the updates of \e world; the planning scene must be write-locked */
+  void attachToWorld(const collision_detection::WorldPtr& world);
+  void worldChanged(const collision_detection::World::ObjectConstPtr& object,
+                    collision_detection::World::Action action);
+
+  /** \brief Answer a query from the index; the planning scene must be read-locked and index_lock_ held */
+  void fillQueryResponse(const planning_scene::PlanningScene& scene,
+                         const moveit_ros_move_group::QueryWorldObjects::Request& req,
+                         moveit_ros_move_group::QueryWorldObjects::Response& res) const;
+  bool matchesQuery(const planning_scene::PlanningScene& scene, const std::string& id, const IndexedObject& object,
+                    const moveit_ros_move_group::QueryWorldObjects::Request& req) const;
+  void addToResponse(const planning_scene::PlanningScene& scene, const std::string& id, const IndexedObject& object,
+                     moveit_ros_move_group::QueryWorldObjects::Response& res) const;
 
   ros::ServiceServer get_scene_service_;
+  ros::ServiceServer query_world_objects_service_;
+
+  /** \brief Protects the index below, which is updated from world observer callbacks */
+  boost::mutex index_lock_;
+  collision_detection::WorldPtr world_;
+  collision_detection::World::ObserverHandle world_observer_;
+
+  /** \brief Incremented with every change of the world */
+  std::uint64_t version_;
+
+  /** \brief Incremental responses can only be computed for versions that are not older than this one */
+  std::uint64_t oldest_version_;
+
+  std::map<std::string, IndexedObject> objects_;
+
+  /** \brief The version at which recently removed objects were removed */
+  std::map<std::string, std::uint64_t> removed_objects_;
+
+  /** \brief The latest change of every object (including removed ones), ordered by version */
+  std::map<std::uint64_t, std::string> changes_;
+
+  /** \brief Spatial index over the bounds of the objects, which contain the positions of their shapes */
+  collision_detection::WorldIndexPtr world_index_;
 };
 }
 
@@ -39,6 +39,9 @@
 #include <moveit/kinematic_constraints/utils.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <moveit/move_group/capability_names.h>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 
 move_group::MoveGroupKinematicsService::MoveGroupKinematicsService() : MoveGroupCapability("KinematicsService")
 {
@@ -50,6 +53,10 @@ void move_group::MoveGroupKinematicsService::initialize()
       root_node_handle_.advertiseService(FK_SERVICE_NAME, &MoveGroupKinematicsService::computeFKService, this);
   ik_service_ =
       root_node_handle_.advertiseService(IK_SERVICE_NAME, &MoveGroupKinematicsService::computeIKService, this);
+  fk_batch_service_ = root_node_handle_.advertiseService(FK_BATCH_SERVICE_NAME,
+                                                         &MoveGroupKinematicsService::computeFKBatchService, this);
+  ik_batch_service_ = root_node_handle_.advertiseService(IK_BATCH_SERVICE_NAME,
+                                                         &MoveGroupKinematicsService::computeIKBatchService, this);
 }
 
 namespace
@@ -64,6 +71,40 @@ bool isIKSolutionValid(const planning_scene::PlanningScene* planning_scene,
   return (!planning_scene || !planning_scene->isStateColliding(*state, jmg->getName())) &&
          (!constraint_set || constraint_set->decide(*state).satisfied);
 }
+
+// the number of poses or states a worker thread of a batch takes at once
+static const std::size_t BATCH_CHUNK_SIZE = 16;
+
+// Split [0, count) into chunks and process them with up to thread_count threads, as work(thread, begin, end)
+void processInParallel(std::size_t count, std::size_t thread_count,
+                       const boost::function<void(std::size_t, std::size_t, std::size_t)>& work)
+{
+  std::size_t next = 0;
+  boost::mutex next_lock;
+  boost::thread_group threads;
+  thread_count = std::min(thread_count, (count + BATCH_CHUNK_SIZE - 1) / BATCH_CHUNK_SIZE);
+  for (std::size_t t = 0; t < thread_count; ++t)
+    threads.create_thread([t, count, &work, &next, &next_lock]() {
+      while (true)
+      {
+        std::size_t begin;
+        {
+          boost::mutex::scoped_lock slock(next_lock);
+          if (next >= count)
+            return;
+          begin = next;
+          next = std::min(count, next + BATCH_CHUNK_SIZE);
+        }
+        work(t, begin, std::min(count, begin + BATCH_CHUNK_SIZE));
+      }
+    });
+  threads.join_all();
+}
+
+std::size_t getBatchThreadCount()
+{
+  return std::max(boost::thread::hardware_concurrency(), 1u);
+}
 }
 
 void move_group::MoveGroupKinematicsService::computeIK(
@@ -211,5 +252,175 @@ bool move_group::MoveGroupKinematicsService::computeFKService(moveit_msgs::GetPo
   return true;
 }
 
+bool move_group::MoveGroupKinematicsService::computeIKBatchService(
+    moveit_ros_move_group::GetPositionIKBatch::Request& req, moveit_ros_move_group::GetPositionIKBatch::Response& res)
+{
+  const moveit_msgs::PositionIKRequest& ik_request = req.ik_request;
+  res.solutions.resize(req.poses.size());
+  res.error_codes.resize(req.poses.size());
+
+  context_->planning_scene_monitor_->updateFrameTransforms();
+
+  // the workers check solutions against an immutable copy of the scene, so the scene does not stay locked
+  planning_scene::PlanningSceneConstPtr scene = context_->planning_scene_monitor_->getPlanningSceneSnapshot();
+  const robot_model::JointModelGroup* jmg = scene->getRobotModel()->getJointModelGroup(ik_request.group_name);
+  if (!jmg)
+  {
+    for (std::size_t i = 0; i < res.error_codes.size(); ++i)
+      res.error_codes[i].val = moveit_msgs::MoveItErrorCodes::INVALID_GROUP_NAME;
+    return true;
+  }
+
+  robot_state::RobotState seed = scene->getCurrentState();
+  robot_state::robotStateMsgToRobotState(ik_request.robot_state, seed);
+  kinematic_constraints::KinematicConstraintSet kset(scene->getRobotModel());
+  kset.add(ik_request.constraints, scene->getTransforms());
+  const kinematic_constraints::KinematicConstraintSet* constraint_set = kset.empty() ? NULL : &kset;
+  const planning_scene::PlanningScene* collision_scene = ik_request.avoid_collisions ? scene.get() : NULL;
+
+  // tf is only used here; the workers get poses in the model frame
+  const std::string& default_frame = scene->getRobotModel()->getModelFrame();
+  EigenSTL::vector_Affine3d poses(req.poses.size());
+  std::vector<std::size_t> pending;
+  for (std::size_t i = 0; i < req.poses.size(); ++i)
+  {
+    geometry_msgs::PoseStamped msg = req.poses[i];
+    if (performTransform(msg, default_frame))
+    {
+      tf::poseMsgToEigen(msg.pose, poses[i]);
+      pending.push_back(i);
+    }
+    else
+      res.error_codes[i].val = moveit_msgs::MoveItErrorCodes::FRAME_TRANSFORM_FAILURE;
+  }
+
+  // solvers cannot be used concurrently, so every worker allocates its own; the solver of the group is only used
+  // when no other solver can be allocated
+  std::vector<kinematics::KinematicsBaseConstPtr> solvers;
+  const robot_model::SolverAllocatorFn& allocator = jmg->getGroupKinematics().first.allocator_;
+  const std::size_t thread_count = std::min(getBatchThreadCount(), pending.size());
+  while (allocator && solvers.size() < thread_count)
+  {
+    kinematics::KinematicsBaseConstPtr solver = allocator(jmg);
+    if (!solver || solver == jmg->getSolverInstance() ||
+        std::find(solvers.begin(), solvers.end(), solver) != solvers.end())
+      break;
+    solvers.push_back(solver);
+  }
+  if (solvers.empty() && jmg->getSolverInstance())
+    solvers.push_back(jmg->getSolverInstance());
+  if (solvers.empty())
+  {
+    ROS_ERROR("No kinematics solver instantiated for group '%s'", jmg->getName().c_str());
+    for (std::size_t i = 0; i < pending.size(); ++i)
+      res.error_codes[pending[i]].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+    return true;
+  }
+
+  // batches need a solver with a single tip frame, which is the default link for the poses
+  const std::vector<std::string>& tip_frames = solvers[0]->getTipFrames();
+  const std::string tip =
+      ik_request.ik_link_name.empty() && !tip_frames.empty() ? tip_frames[0] : ik_request.ik_link_name;
+  const unsigned int attempts = ik_request.attempts > 0 ? ik_request.attempts : jmg->getDefaultIKAttempts();
+  const double timeout = ik_request.timeout.toSec();
+
+  processInParallel(pending.size(), solvers.size(), [&](std::size_t thread, std::size_t begin, std::size_t end) {
+    robot_state::RobotState state(seed);
+    robot_state::RobotState solution(seed);
+    std::vector<std::size_t> todo(pending.begin() + begin, pending.begin() + end);
+    for (unsigned int attempt = 0; attempt < attempts && !todo.empty(); ++attempt)
+    {
+      // retries start from random seeds, as setFromIK() does
+      if (attempt > 0)
+        state.setToRandomPositions(jmg);
+
+      EigenSTL::vector_Affine3d todo_poses(todo.size());
+      for (std::size_t k = 0; k < todo.size(); ++k)
+        todo_poses[k] = poses[todo[k]];
+      std::vector<std::vector<double> > solutions;
+      state.computeIKBatch(jmg, solvers[thread], todo_poses, tip, solutions, timeout);
+
+      std::vector<std::size_t> failed;
+      for (std::size_t k = 0; k < todo.size(); ++k)
+        if (!solutions[k].empty() &&
+            isIKSolutionValid(collision_scene, constraint_set, &solution, jmg, &solutions[k][0]))
+        {
+          robot_state::robotStateToRobotStateMsg(solution, res.solutions[todo[k]], false);
+          res.error_codes[todo[k]].val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+        }
+        else
+          failed.push_back(todo[k]);
+      todo.swap(failed);
+    }
+    for (std::size_t k = 0; k < todo.size(); ++k)
+      res.error_codes[todo[k]].val = moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+  });
+
+  return true;
+}
+
+bool move_group::MoveGroupKinematicsService::computeFKBatchService(
+    moveit_ros_move_group::GetPositionFKBatch::Request& req, moveit_ros_move_group::GetPositionFKBatch::Response& res)
+{
+  if (req.fk_link_names.empty())
+  {
+    ROS_ERROR("No links specified for FK request");
+    res.error_code.val = moveit_msgs::MoveItErrorCodes::INVALID_LINK_NAME;
+    return true;
+  }
+
+  context_->planning_scene_monitor_->updateFrameTransforms();
+
+  const robot_state::RobotState current_state =
+      planning_scene_monitor::LockedPlanningSceneRO(context_->planning_scene_monitor_)->getCurrentState();
+  for (std::size_t i = 0; i < req.fk_link_names.size(); ++i)
+    if (current_state.getRobotModel()->hasLinkModel(req.fk_link_names[i]))
+      res.fk_link_names.push_back(req.fk_link_names[i]);
+  res.error_code.val = res.fk_link_names.size() == req.fk_link_names.size() ?
+                           moveit_msgs::MoveItErrorCodes::SUCCESS :
+                           moveit_msgs::MoveItErrorCodes::INVALID_LINK_NAME;
+
+  // all poses are brought from the model frame to the requested frame by the same transform
+  const std::string& default_frame = current_state.getRobotModel()->getModelFrame();
+  std::string frame_id = default_frame;
+  Eigen::Affine3d to_frame = Eigen::Affine3d::Identity();
+  if (!req.header.frame_id.empty() && !robot_state::Transforms::sameFrame(req.header.frame_id, default_frame) &&
+      context_->planning_scene_monitor_->getTFClient())
+  {
+    geometry_msgs::PoseStamped frame_pose;
+    frame_pose.header.frame_id = default_frame;
+    frame_pose.pose.orientation.w = 1.0;
+    if (performTransform(frame_pose, req.header.frame_id))
+    {
+      tf::poseMsgToEigen(frame_pose.pose, to_frame);
+      frame_id = req.header.frame_id;
+    }
+    else
+      res.error_code.val = moveit_msgs::MoveItErrorCodes::FRAME_TRANSFORM_FAILURE;
+  }
+
+  const ros::Time time_now = ros::Time::now();
+  const std::size_t link_count = res.fk_link_names.size();
+  res.pose_stamped.resize(req.robot_states.size() * link_count);
+  processInParallel(req.robot_states.size(), getBatchThreadCount(),
+                    [&](std::size_t /* thread */, std::size_t begin, std::size_t end) {
+                      robot_state::RobotState rs(current_state);
+                      for (std::size_t i = begin; i < end; ++i)
+                      {
+                        if (i > begin)
+                          rs = current_state;
+                        robot_state::robotStateMsgToRobotState(req.robot_states[i], rs);
+                        for (std::size_t j = 0; j < link_count; ++j)
+                        {
+                          geometry_msgs::PoseStamped& pose = res.pose_stamped[i * link_count + j];
+                          tf::poseEigenToMsg(to_frame * rs.getGlobalLinkTransform(res.fk_link_names[j]), pose.pose);
+                          pose.header.frame_id = frame_id;
+                          pose.header.stamp = time_now;
+                        }
+                      }
+                    });
+  return true;
+}
+
 #include <class_loader/class_loader.hpp>
 CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupKinematicsService, move_group::MoveGroupCapability)
@@ -0,0 +1,149 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "metrics_publisher_capability.h"
+#include <moveit/profiler/metrics.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+diagnostic_msgs::KeyValue keyValue(const std::string& key, const std::string& value)
+{
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = value;
+  return kv;
+}
+
+/** \brief The upper bound of the bucket in which the \e quantile of the values falls */
+std::string quantileBound(const std::vector<double>& bounds, const std::vector<std::uint64_t>& buckets,
+                          std::uint64_t count, double quantile)
+{
+  std::uint64_t cumulative = 0;
+  for (std::size_t i = 0; i < bounds.size(); ++i)
+  {
+    cumulative += buckets[i];
+    if (cumulative >= quantile * count)
+      return "<= " + boost::lexical_cast<std::string>(bounds[i]);
+  }
+  return "> " + boost::lexical_cast<std::string>(bounds.back());
+}
+}
+
+move_group::MoveGroupMetricsPublisher::MoveGroupMetricsPublisher() : MoveGroupCapability("MetricsPublisher")
+{
+}
+
+void move_group::MoveGroupMetricsPublisher::initialize()
+{
+  double period;
+  node_handle_.param("metrics_publish_period", period, 1.0);
+  node_handle_.param("metrics_prometheus_file", prometheus_file_, std::string());
+  if (period <= 0.0)
+  {
+    ROS_INFO("Publishing of metrics is disabled");
+    return;
+  }
+
+  diagnostics_publisher_ = root_node_handle_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  last_publish_time_ = ros::WallTime::now();
+  timer_ = root_node_handle_.createWallTimer(ros::WallDuration(period), &MoveGroupMetricsPublisher::publish, this);
+}
+
+void move_group::MoveGroupMetricsPublisher::publish(const ros::WallTimerEvent& event)
+{
+  const moveit::tools::MetricsRegistry& registry = moveit::tools::MetricsRegistry::instance();
+  const ros::WallTime now = ros::WallTime::now();
+  const double elapsed = (now - last_publish_time_).toSec();
+  last_publish_time_ = now;
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = ros::this_node::getName() + ": metrics";
+  status.hardware_id = ros::this_node::getName();
+  status.message = "OK";
+
+  std::vector<const moveit::tools::MetricCounter*> counters = registry.getCounters();
+  for (std::size_t i = 0; i < counters.size(); ++i)
+  {
+    const std::string& name = counters[i]->getName();
+    std::uint64_t value = counters[i]->value();
+    status.values.push_back(keyValue(name, boost::lexical_cast<std::string>(value)));
+    std::map<std::string, std::uint64_t>::iterator last = last_counts_.find(name);
+    if (last != last_counts_.end() && elapsed > 0.0)
+      status.values.push_back(keyValue(name + " (per second)",
+                                       boost::lexical_cast<std::string>((value - last->second) / elapsed)));
+    last_counts_[name] = value;
+  }
+
+  std::vector<const moveit::tools::MetricHistogram*> histograms = registry.getHistograms();
+  std::vector<std::uint64_t> buckets;
+  for (std::size_t i = 0; i < histograms.size(); ++i)
+  {
+    const std::string& name = histograms[i]->getName();
+    std::uint64_t count;
+    double sum;
+    histograms[i]->getSnapshot(buckets, count, sum);
+    status.values.push_back(keyValue(name + " count", boost::lexical_cast<std::string>(count)));
+    if (count == 0)
+      continue;
+    const std::vector<double>& bounds = histograms[i]->getBounds();
+    status.values.push_back(keyValue(name + " mean", boost::lexical_cast<std::string>(sum / count)));
+    status.values.push_back(keyValue(name + " p50", quantileBound(bounds, buckets, count, 0.5)));
+    status.values.push_back(keyValue(name + " p95", quantileBound(bounds, buckets, count, 0.95)));
+    status.values.push_back(keyValue(name + " p99", quantileBound(bounds, buckets, count, 0.99)));
+  }
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back(status);
+  diagnostics_publisher_.publish(diagnostics);
+
+  if (!prometheus_file_.empty())
+  {
+    // write a temporary file and rename it, so that readers never see a partial file
+    const std::string tmp_file = prometheus_file_ + ".tmp";
+    std::ofstream out(tmp_file.c_str());
+    registry.writePrometheus(out);
+    out.close();
+    if (!out || std::rename(tmp_file.c_str(), prometheus_file_.c_str()) != 0)
+      ROS_WARN_THROTTLE(60, "Unable to write metrics to '%s'", prometheus_file_.c_str());
+  }
+}
+
+#include <class_loader/class_loader.hpp>
+CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupMetricsPublisher, move_group::MoveGroupCapability)
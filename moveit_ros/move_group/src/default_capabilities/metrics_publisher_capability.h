@@ -0,0 +1,67 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_MOVE_GROUP_METRICS_PUBLISHER_CAPABILITY_
+#define MOVEIT_MOVE_GROUP_METRICS_PUBLISHER_CAPABILITY_
+
+#include <moveit/move_group/move_group_capability.h>
+#include <map>
+#include <cstdint>
+
+namespace move_group
+{
+/** \brief Periodically publishes the metrics of moveit::tools::MetricsRegistry on /diagnostics and, if the
+    metrics_prometheus_file parameter is set, writes them to that file in the Prometheus text format (e.g., for the
+    textfile collector of the node exporter) */
+class MoveGroupMetricsPublisher : public MoveGroupCapability
+{
+public:
+  MoveGroupMetricsPublisher();
+
+  virtual void initialize();
+
+private:
+  void publish(const ros::WallTimerEvent& event);
+
+  ros::Publisher diagnostics_publisher_;
+  ros::WallTimer timer_;
+  std::string prometheus_file_;
+
+  /** \brief The counter values of the previous publish, to report rates */
+  std::map<std::string, std::uint64_t> last_counts_;
+  ros::WallTime last_publish_time_;
+};
+}
+
+#endif  // MOVEIT_MOVE_GROUP_METRICS_PUBLISHER_CAPABILITY_
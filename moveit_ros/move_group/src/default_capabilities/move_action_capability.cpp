@@ -181,7 +181,7 @@ void move_group::MoveGroupMoveAction::executeMoveCallback_PlanOnly(const moveit_
 
   try
   {
-    context_->planning_pipeline_->generatePlan(the_scene, goal->request, res);
+    LockedPlanningPipeline(context_)->generatePlan(the_scene, goal->request, res);
   }
   catch (std::exception& ex)
   {
@@ -204,7 +204,7 @@ bool move_group::MoveGroupMoveAction::planUsingPlanningPipeline(const planning_i
   planning_interface::MotionPlanResponse res;
   try
   {
-    solved = context_->planning_pipeline_->generatePlan(plan.planning_scene_, req, res);
+    solved = LockedPlanningPipeline(context_)->generatePlan(plan.planning_scene_, req, res);
   }
   catch (std::exception& ex)
   {
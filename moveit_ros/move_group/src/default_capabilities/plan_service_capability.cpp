@@ -37,31 +37,47 @@
 #include "plan_service_capability.h"
 #include <moveit/planning_pipeline/planning_pipeline.h>
 #include <moveit/move_group/capability_names.h>
+#include <moveit/utils/thread_groups.h>
 
 move_group::MoveGroupPlanService::MoveGroupPlanService() : MoveGroupCapability("MotionPlanService")
 {
 }
 
+move_group::MoveGroupPlanService::~MoveGroupPlanService()
+{
+  if (spinner_)
+    spinner_->stop();
+}
+
 void move_group::MoveGroupPlanService::initialize()
 {
-  plan_service_ =
-      root_node_handle_.advertiseService(PLANNER_SERVICE_NAME, &MoveGroupPlanService::computePlanService, this);
+  // serve requests on our own queue, with one thread per planning pipeline, so they are planned concurrently
+  ros::AdvertiseServiceOptions ops;
+  ops.template init<moveit_msgs::GetMotionPlan::Request, moveit_msgs::GetMotionPlan::Response>(
+      PLANNER_SERVICE_NAME, boost::bind(&MoveGroupPlanService::computePlanService, this, _1, _2));
+  ops.callback_queue = &callback_queue_;
+  plan_service_ = root_node_handle_.advertiseService(ops);
+  spinner_.reset(new ros::AsyncSpinner(context_->planning_threads_, &callback_queue_));
+  spinner_->start();
 }
 
 bool move_group::MoveGroupPlanService::computePlanService(moveit_msgs::GetMotionPlan::Request& req,
                                                           moveit_msgs::GetMotionPlan::Response& res)
 {
+  // the spinner threads only serve planning requests; the threads of parallel plans inherit the scheduling
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PLANNING);
   ROS_INFO("Received new planning service request...");
   // before we start planning, ensure that we have the latest robot state received...
   if (req.motion_plan_request.start_state.is_diff == true)
     context_->planning_scene_monitor_->waitForCurrentRobotState(ros::Time::now());
   context_->planning_scene_monitor_->updateFrameTransforms();
 
+  LockedPlanningPipeline planning_pipeline(context_);
   planning_scene_monitor::LockedPlanningSceneRO ps(context_->planning_scene_monitor_);
   try
   {
     planning_interface::MotionPlanResponse mp_res;
-    context_->planning_pipeline_->generatePlan(ps, req.motion_plan_request, mp_res);
+    planning_pipeline->generatePlan(ps, req.motion_plan_request, mp_res);
     mp_res.getMessage(res.motion_plan_response);
   }
   catch (std::exception& ex)
@@ -39,6 +39,8 @@
 
 #include <moveit/move_group/move_group_capability.h>
 #include <moveit_msgs/GetMotionPlan.h>
+#include <ros/callback_queue.h>
+#include <memory>
 
 namespace move_group
 {
@@ -46,6 +48,7 @@ class MoveGroupPlanService : public MoveGroupCapability
 {
 public:
   MoveGroupPlanService();
+  ~MoveGroupPlanService();
 
   virtual void initialize();
 
@@ -53,6 +56,8 @@ private:
   bool computePlanService(moveit_msgs::GetMotionPlan::Request& req, moveit_msgs::GetMotionPlan::Response& res);
 
   ros::ServiceServer plan_service_;
+  ros::CallbackQueue callback_queue_;
+  std::unique_ptr<ros::AsyncSpinner> spinner_;
 };
 }
 
@@ -0,0 +1,82 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include "shared_state_publisher_capability.h"
+#include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+
+move_group::MoveGroupSharedStatePublisher::MoveGroupSharedStatePublisher()
+  : MoveGroupCapability("SharedStatePublisher"), guard_(new WriterGuard())
+{
+}
+
+move_group::MoveGroupSharedStatePublisher::~MoveGroupSharedStatePublisher()
+{
+  boost::mutex::scoped_lock slock(guard_->lock_);
+  guard_->writer_.reset();
+}
+
+void move_group::MoveGroupSharedStatePublisher::initialize()
+{
+  const planning_scene_monitor::CurrentStateMonitorPtr& state_monitor =
+      context_->planning_scene_monitor_->getStateMonitor();
+  if (!state_monitor)
+  {
+    ROS_ERROR("The current state is not monitored, so it cannot be shared");
+    return;
+  }
+
+  try
+  {
+    guard_->writer_.reset(new planning_scene_monitor::SharedStateWriter(state_monitor->getRobotModel()));
+  }
+  catch (boost::interprocess::interprocess_exception& ex)
+  {
+    ROS_ERROR("Unable to create the shared memory segment for the current state: %s", ex.what());
+    return;
+  }
+  ROS_INFO_STREAM("Sharing the current state through shared memory segment '" << guard_->writer_->getName() << "'");
+
+  // the callback runs after the monitor updated its state
+  std::shared_ptr<WriterGuard> guard = guard_;
+  planning_scene_monitor::CurrentStateMonitor* monitor = state_monitor.get();
+  state_monitor->addUpdateCallback([guard, monitor](const sensor_msgs::JointStateConstPtr&) {
+    std::pair<robot_state::RobotStatePtr, ros::Time> state = monitor->getCurrentStateAndTime();
+    boost::mutex::scoped_lock slock(guard->lock_);
+    if (guard->writer_)
+      guard->writer_->write(*state.first, state.second);
+  });
+}
+
+#include <class_loader/class_loader.hpp>
+CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupSharedStatePublisher, move_group::MoveGroupCapability)
@@ -0,0 +1,67 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_MOVE_GROUP_SHARED_STATE_CAPABILITY_
+#define MOVEIT_MOVE_GROUP_SHARED_STATE_CAPABILITY_
+
+#include <moveit/move_group/move_group_capability.h>
+#include <moveit/planning_scene_monitor/shared_state.h>
+#include <boost/thread/mutex.hpp>
+#include <memory>
+
+namespace move_group
+{
+/** \brief Publishes the current robot state through shared memory, for clients on the same host (see
+    planning_scene_monitor::SharedStateReader) */
+class MoveGroupSharedStatePublisher : public MoveGroupCapability
+{
+public:
+  MoveGroupSharedStatePublisher();
+  ~MoveGroupSharedStatePublisher();
+
+  virtual void initialize();
+
+private:
+  // the state monitor cannot remove callbacks, so they reach the writer through this, until it is reset
+  struct WriterGuard
+  {
+    boost::mutex lock_;
+    std::unique_ptr<planning_scene_monitor::SharedStateWriter> writer_;
+  };
+
+  std::shared_ptr<WriterGuard> guard_;
+};
+}
+
+#endif
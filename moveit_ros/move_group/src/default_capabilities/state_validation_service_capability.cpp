@@ -40,9 +40,27 @@
 #include <moveit/collision_detection/collision_tools.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <moveit/move_group/capability_names.h>
+#include <ros/serialization.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+
+namespace
+{
+// the number of results kept for repeated requests
+static const std::size_t CACHE_SIZE = 256;
+
+template <typename T>
+void appendSerialized(std::vector<uint8_t>& buffer, const T& value)
+{
+  const std::size_t offset = buffer.size();
+  buffer.resize(offset + ros::serialization::serializationLength(value));
+  ros::serialization::OStream stream(buffer.data() + offset, buffer.size() - offset);
+  ros::serialization::serialize(stream, value);
+}
+}
 
 move_group::MoveGroupStateValidationService::MoveGroupStateValidationService()
-  : MoveGroupCapability("StateValidationService")
+  : MoveGroupCapability("StateValidationService"), cache_scene_version_(0)
 {
 }
 
@@ -50,29 +68,117 @@ void move_group::MoveGroupStateValidationService::initialize()
 {
   validity_service_ = root_node_handle_.advertiseService(STATE_VALIDITY_SERVICE_NAME,
                                                          &MoveGroupStateValidationService::computeService, this);
+  validity_batch_service_ = root_node_handle_.advertiseService(
+      STATE_VALIDITY_BATCH_SERVICE_NAME, &MoveGroupStateValidationService::computeBatchService, this);
 }
 
 bool move_group::MoveGroupStateValidationService::computeService(moveit_msgs::GetStateValidity::Request& req,
                                                                  moveit_msgs::GetStateValidity::Response& res)
 {
   planning_scene_monitor::LockedPlanningSceneRO ls(context_->planning_scene_monitor_);
-  robot_state::RobotState rs = ls->getCurrentState();
-  robot_state::robotStateMsgToRobotState(req.robot_state, rs);
+  const unsigned long scene_version = context_->planning_scene_monitor_->getSceneVersion();
+  const CacheKey key = getCacheKey(req.robot_state, req.group_name, req.constraints);
+  if (lookupCache(scene_version, key, res))
+    return true;
+
+  if (kinematic_constraints::isEmpty(req.constraints))
+    checkState(*ls, req.robot_state, req.group_name, NULL, res);
+  else
+  {
+    kinematic_constraints::KinematicConstraintSet kset(ls->getRobotModel());
+    kset.add(req.constraints, ls->getTransforms());
+    checkState(*ls, req.robot_state, req.group_name, &kset, res);
+  }
+
+  storeCache(scene_version, key, res);
+  return true;
+}
+
+bool move_group::MoveGroupStateValidationService::computeBatchService(
+    moveit_ros_move_group::GetStateValidityBatch::Request& req,
+    moveit_ros_move_group::GetStateValidityBatch::Response& res)
+{
+  // all states are checked against the same immutable copy of the scene, without keeping the scene locked
+  const unsigned long scene_version = context_->planning_scene_monitor_->getSceneVersion();
+  planning_scene::PlanningSceneConstPtr scene = context_->planning_scene_monitor_->getPlanningSceneSnapshot();
+  if (!scene)
+    return false;
+
+  std::unique_ptr<kinematic_constraints::KinematicConstraintSet> kset;
+  if (!kinematic_constraints::isEmpty(req.constraints))
+  {
+    kset.reset(new kinematic_constraints::KinematicConstraintSet(scene->getRobotModel()));
+    kset->add(req.constraints, scene->getTransforms());
+  }
+
+  // answer what is cached and check the remaining states in parallel
+  std::vector<moveit_msgs::GetStateValidity::Response> results(req.robot_states.size());
+  std::vector<CacheKey> keys(req.robot_states.size());
+  std::vector<std::size_t> pending;
+  for (std::size_t i = 0; i < req.robot_states.size(); ++i)
+  {
+    keys[i] = getCacheKey(req.robot_states[i], req.group_name, req.constraints);
+    if (!lookupCache(scene_version, keys[i], results[i]))
+      pending.push_back(i);
+  }
+
+  std::size_t next = 0;
+  boost::mutex batch_lock;
+  boost::thread_group threads;
+  const std::size_t thread_count =
+      std::min<std::size_t>(std::max(boost::thread::hardware_concurrency(), 1u), pending.size());
+  for (std::size_t t = 0; t < thread_count; ++t)
+    threads.create_thread([this, &req, &scene, &kset, &results, &pending, &next, &batch_lock]() {
+      while (true)
+      {
+        std::size_t index;
+        {
+          boost::mutex::scoped_lock slock(batch_lock);
+          if (next >= pending.size())
+            return;
+          index = pending[next++];
+        }
+        checkState(*scene, req.robot_states[index], req.group_name, kset.get(), results[index]);
+      }
+    });
+  threads.join_all();
+
+  for (std::size_t i = 0; i < pending.size(); ++i)
+    storeCache(scene_version, keys[pending[i]], results[pending[i]]);
+
+  res.results.resize(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i)
+  {
+    res.results[i].valid = results[i].valid;
+    res.results[i].contacts.swap(results[i].contacts);
+    res.results[i].cost_sources.swap(results[i].cost_sources);
+    res.results[i].constraint_result.swap(results[i].constraint_result);
+  }
+  return true;
+}
+
+void move_group::MoveGroupStateValidationService::checkState(
+    const planning_scene::PlanningScene& scene, const moveit_msgs::RobotState& state, const std::string& group_name,
+    const kinematic_constraints::KinematicConstraintSet* constraints,
+    moveit_msgs::GetStateValidity::Response& res) const
+{
+  robot_state::RobotState rs = scene.getCurrentState();
+  robot_state::robotStateMsgToRobotState(state, rs);
 
   res.valid = true;
 
   // configure collision request
   collision_detection::CollisionRequest creq;
-  creq.group_name = req.group_name;
+  creq.group_name = group_name;
   creq.cost = true;
   creq.contacts = true;
-  creq.max_contacts = ls->getWorld()->size();
-  creq.max_cost_sources = creq.max_contacts + ls->getRobotModel()->getLinkModelsWithCollisionGeometry().size();
+  creq.max_contacts = scene.getWorld()->size();
+  creq.max_cost_sources = creq.max_contacts + scene.getRobotModel()->getLinkModelsWithCollisionGeometry().size();
   creq.max_contacts *= creq.max_contacts;
   collision_detection::CollisionResult cres;
 
   // check collision
-  ls->checkCollision(creq, cres, rs);
+  scene.checkCollision(creq, cres, rs);
 
   // copy contacts if any
   if (cres.collision)
@@ -86,7 +192,7 @@ bool move_group::MoveGroupStateValidationService::computeService(moveit_msgs::Ge
       {
         res.contacts.resize(res.contacts.size() + 1);
         collision_detection::contactToMsg(it->second[k], res.contacts.back());
-        res.contacts.back().header.frame_id = ls->getPlanningFrame();
+        res.contacts.back().header.frame_id = scene.getPlanningFrame();
         res.contacts.back().header.stamp = time_now;
       }
   }
@@ -101,12 +207,10 @@ bool move_group::MoveGroupStateValidationService::computeService(moveit_msgs::Ge
   }
 
   // evaluate constraints
-  if (!kinematic_constraints::isEmpty(req.constraints))
+  if (constraints)
   {
-    kinematic_constraints::KinematicConstraintSet kset(ls->getRobotModel());
-    kset.add(req.constraints, ls->getTransforms());
     std::vector<kinematic_constraints::ConstraintEvaluationResult> kres;
-    kinematic_constraints::ConstraintEvaluationResult total_result = kset.decide(rs, kres);
+    kinematic_constraints::ConstraintEvaluationResult total_result = constraints->decide(rs, kres);
     if (!total_result.satisfied)
       res.valid = false;
 
@@ -118,9 +222,57 @@ bool move_group::MoveGroupStateValidationService::computeService(moveit_msgs::Ge
       res.constraint_result[k].distance = kres[k].distance;
     }
   }
+}
+
+move_group::MoveGroupStateValidationService::CacheKey move_group::MoveGroupStateValidationService::getCacheKey(
+    const moveit_msgs::RobotState& state, const std::string& group_name,
+    const moveit_msgs::Constraints& constraints) const
+{
+  CacheKey key;
+  appendSerialized(key, state);
+  appendSerialized(key, group_name);
+  appendSerialized(key, constraints);
+  return key;
+}
 
+bool move_group::MoveGroupStateValidationService::lookupCache(unsigned long scene_version, const CacheKey& key,
+                                                              moveit_msgs::GetStateValidity::Response& res)
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  if (scene_version != cache_scene_version_)
+    return false;
+  std::map<CacheKey, std::pair<moveit_msgs::GetStateValidity::Response, std::list<CacheKey>::iterator> >::iterator it =
+      cache_.find(key);
+  if (it == cache_.end())
+    return false;
+  cache_order_.splice(cache_order_.end(), cache_order_, it->second.second);
+  res = it->second.first;
   return true;
 }
 
+void move_group::MoveGroupStateValidationService::storeCache(unsigned long scene_version, const CacheKey& key,
+                                                             const moveit_msgs::GetStateValidity::Response& res)
+{
+  boost::mutex::scoped_lock slock(cache_lock_);
+  if (scene_version != cache_scene_version_)
+  {
+    // results for other versions of the scene are of no use anymore
+    if (scene_version < cache_scene_version_)
+      return;
+    cache_.clear();
+    cache_order_.clear();
+    cache_scene_version_ = scene_version;
+  }
+  if (cache_.find(key) != cache_.end())
+    return;
+  if (cache_.size() >= CACHE_SIZE)
+  {
+    cache_.erase(cache_order_.front());
+    cache_order_.pop_front();
+  }
+  cache_order_.push_back(key);
+  cache_[key] = std::make_pair(res, --cache_order_.end());
+}
+
 #include <class_loader/class_loader.hpp>
 CLASS_LOADER_REGISTER_CLASS(move_group::MoveGroupStateValidationService, move_group::MoveGroupCapability)
@@ -38,7 +38,11 @@
 #define MOVEIT_MOVE_GROUP_STATE_VALIDATION_SERVICE_CAPABILITY_
 
 #include <moveit/move_group/move_group_capability.h>
+#include <moveit/kinematic_constraints/kinematic_constraint.h>
 #include <moveit_msgs/GetStateValidity.h>
+#include <moveit_ros_move_group/GetStateValidityBatch.h>
+#include <boost/thread/mutex.hpp>
+#include <list>
 
 namespace move_group
 {
@@ -50,9 +54,30 @@ public:
   virtual void initialize();
 
 private:
+  typedef std::vector<uint8_t> CacheKey;
+
   bool computeService(moveit_msgs::GetStateValidity::Request& req, moveit_msgs::GetStateValidity::Response& res);
+  bool computeBatchService(moveit_ros_move_group::GetStateValidityBatch::Request& req,
+                           moveit_ros_move_group::GetStateValidityBatch::Response& res);
+
+  /** \brief Check \e state against \e scene; \e constraints may be NULL */
+  void checkState(const planning_scene::PlanningScene& scene, const moveit_msgs::RobotState& state,
+                  const std::string& group_name, const kinematic_constraints::KinematicConstraintSet* constraints,
+                  moveit_msgs::GetStateValidity::Response& res) const;
+
+  CacheKey getCacheKey(const moveit_msgs::RobotState& state, const std::string& group_name,
+                       const moveit_msgs::Constraints& constraints) const;
+  bool lookupCache(unsigned long scene_version, const CacheKey& key, moveit_msgs::GetStateValidity::Response& res);
+  void storeCache(unsigned long scene_version, const CacheKey& key, const moveit_msgs::GetStateValidity::Response& res);
 
   ros::ServiceServer validity_service_;
+  ros::ServiceServer validity_batch_service_;
+
+  /** \brief The most recently computed results, valid for the scene version they were computed at */
+  boost::mutex cache_lock_;
+  unsigned long cache_scene_version_;
+  std::list<CacheKey> cache_order_;  // least recently used first
+  std::map<CacheKey, std::pair<moveit_msgs::GetStateValidity::Response, std::list<CacheKey>::iterator> > cache_;
 };
 }
 
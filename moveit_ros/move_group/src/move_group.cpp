@@ -42,8 +42,13 @@
 #include <boost/tokenizer.hpp>
 #include <moveit/macros/console_colors.h>
 #include <moveit/move_group/node_name.h>
+#include <moveit/move_group/startup_phases.h>
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/utils/thread_groups.h>
+#include <boost/thread.hpp>
 #include <memory>
 #include <set>
+#include <algorithm>
 
 static const std::string ROBOT_DESCRIPTION =
     "robot_description";  // name of the robot description (a param name, so it can be changed externally)
@@ -64,22 +69,88 @@ static const char* DEFAULT_CAPABILITIES[] = {
    "move_group/MoveGroupGetPlanningSceneService",
    "move_group/ApplyPlanningSceneService",
    "move_group/ClearOctomapService",
+   "move_group/MoveGroupMetricsPublisher",
 };
 // clang-format on
 
+// Read the scheduling of the thread groups from ~thread_groups, e.g. {execution: {cpus: "2-3", priority: 50}}
+static void loadThreadGroups(const ros::NodeHandle& nh)
+{
+  XmlRpc::XmlRpcValue groups;
+  if (!nh.getParam("thread_groups", groups))
+    return;
+  if (groups.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+  {
+    ROS_ERROR("Parameter '~thread_groups' should be a dictionary of thread groups");
+    return;
+  }
+
+  for (XmlRpc::XmlRpcValue::iterator it = groups.begin(); it != groups.end(); ++it)
+  {
+    XmlRpc::XmlRpcValue& group = it->second;
+    if (group.getType() != XmlRpc::XmlRpcValue::TypeStruct)
+    {
+      ROS_ERROR("The settings of thread group '%s' should be a dictionary", it->first.c_str());
+      continue;
+    }
+
+    moveit::core::ThreadGroupSettings settings;
+    if (group.hasMember("cpus"))
+    {
+      XmlRpc::XmlRpcValue& cpus = group["cpus"];
+      bool valid = true;
+      if (cpus.getType() == XmlRpc::XmlRpcValue::TypeString)
+        valid = moveit::core::parseCpuList(static_cast<std::string>(cpus), settings.cpus);
+      else if (cpus.getType() == XmlRpc::XmlRpcValue::TypeInt)
+        settings.cpus.push_back(static_cast<int>(cpus));
+      else if (cpus.getType() == XmlRpc::XmlRpcValue::TypeArray)
+        for (int i = 0; valid && i < cpus.size(); ++i)
+          if (cpus[i].getType() == XmlRpc::XmlRpcValue::TypeInt)
+            settings.cpus.push_back(static_cast<int>(cpus[i]));
+          else
+            valid = false;
+      else
+        valid = false;
+      if (!valid)
+      {
+        ROS_ERROR("The CPUs of thread group '%s' are malformed", it->first.c_str());
+        continue;
+      }
+    }
+    if (group.hasMember("priority") && group["priority"].getType() == XmlRpc::XmlRpcValue::TypeInt)
+      settings.priority = static_cast<int>(group["priority"]);
+    if (group.hasMember("nice") && group["nice"].getType() == XmlRpc::XmlRpcValue::TypeInt)
+      settings.nice = static_cast<int>(group["nice"]);
+
+    moveit::core::ThreadGroupRegistry::instance().configure(it->first, settings);
+    ROS_INFO("Thread group '%s': %u CPUs, priority %d, nice %d", it->first.c_str(), (unsigned int)settings.cpus.size(),
+             settings.priority, settings.nice);
+  }
+}
+
 class MoveGroupExe
 {
 public:
-  MoveGroupExe(const planning_scene_monitor::PlanningSceneMonitorPtr& psm, bool debug) : node_handle_("~")
+  /** \brief The capabilities are loaded once \e kinematics_thread, which initializes the kinematics solvers, finished;
+      the context is set up in the meantime */
+  MoveGroupExe(const planning_scene_monitor::PlanningSceneMonitorPtr& psm, bool debug, StartupPhases& phases,
+               boost::thread& kinematics_thread)
+    : node_handle_("~")
   {
     // if the user wants to be able to disable execution of paths, they can just set this ROS param to false
     bool allow_trajectory_execution;
     node_handle_.param("allow_trajectory_execution", allow_trajectory_execution, true);
 
-    context_.reset(new MoveGroupContext(psm, allow_trajectory_execution, debug));
+    // the number of planning requests that are served concurrently
+    int planning_threads;
+    node_handle_.param("planning_threads", planning_threads, 1);
+
+    context_.reset(
+        new MoveGroupContext(psm, allow_trajectory_execution, debug, std::max(planning_threads, 1), &phases));
 
     // start the capabilities
-    configureCapabilities();
+    kinematics_thread.join();
+    phases.run("capabilities", boost::bind(&MoveGroupExe::configureCapabilities, this));
   }
 
   ~MoveGroupExe()
@@ -187,13 +258,29 @@ int main(int argc, char** argv)
 {
   ros::init(argc, argv, move_group::NODE_NAME);
 
+  // before any of the threads of the groups start
+  move_group::loadThreadGroups(ros::NodeHandle("~"));
+
   ros::AsyncSpinner spinner(1);
   spinner.start();
 
+  move_group::StartupPhases phases;
   boost::shared_ptr<tf::TransformListener> tf(new tf::TransformListener(ros::Duration(10.0)));
 
-  planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor(
-      new planning_scene_monitor::PlanningSceneMonitor(ROBOT_DESCRIPTION, tf));
+  robot_model_loader::RobotModelLoaderPtr rml;
+  phases.run("robot model",
+             [&rml]() { rml.reset(new robot_model_loader::RobotModelLoader(ROBOT_DESCRIPTION, false)); });
+
+  // only the capabilities use the kinematics solvers, so they are initialized while everything else starts; the
+  // planning scene monitor, the planner plugins and the controller manager do not use them while they start
+  boost::thread kinematics_thread([&phases, &rml]() {
+    phases.run("kinematics solvers", [&rml]() { rml->loadKinematicsSolvers(); });
+  });
+
+  planning_scene_monitor::PlanningSceneMonitorPtr planning_scene_monitor;
+  phases.run("planning scene monitor", [&planning_scene_monitor, &rml, &tf]() {
+    planning_scene_monitor.reset(new planning_scene_monitor::PlanningSceneMonitor(rml, tf));
+  });
 
   if (planning_scene_monitor->getPlanningScene())
   {
@@ -210,21 +297,31 @@ int main(int argc, char** argv)
       ROS_INFO("MoveGroup debug mode is OFF");
 
     printf(MOVEIT_CONSOLE_COLOR_CYAN "Starting context monitors...\n" MOVEIT_CONSOLE_COLOR_RESET);
-    planning_scene_monitor->startSceneMonitor();
-    planning_scene_monitor->startWorldGeometryMonitor();
-    planning_scene_monitor->startStateMonitor();
+    phases.run("context monitors", [&planning_scene_monitor]() {
+      planning_scene_monitor->startSceneMonitor();
+      planning_scene_monitor->startWorldGeometryMonitor();
+      planning_scene_monitor->startStateMonitor();
+    });
     printf(MOVEIT_CONSOLE_COLOR_CYAN "Context monitors started.\n" MOVEIT_CONSOLE_COLOR_RESET);
 
-    move_group::MoveGroupExe mge(planning_scene_monitor, debug);
+    move_group::MoveGroupExe mge(planning_scene_monitor, debug, phases, kinematics_thread);
 
     planning_scene_monitor->publishDebugInformation(debug);
 
+    std::stringstream ss;
+    ss << std::endl << "* MoveGroup startup phases (start, duration):" << std::endl;
+    phases.report(ss);
+    ROS_INFO_STREAM(ss.str());
+
     mge.status();
 
     ros::waitForShutdown();
   }
   else
+  {
+    kinematics_thread.join();
     ROS_ERROR("Planning scene not configured");
+  }
 
   return 0;
 }
@@ -35,36 +35,62 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/move_group/move_group_context.h>
+#include <moveit/move_group/startup_phases.h>
 
 #include <moveit/planning_pipeline/planning_pipeline.h>
 #include <moveit/plan_execution/plan_execution.h>
 #include <moveit/plan_execution/plan_with_sensing.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+
+namespace
+{
+void runPhase(move_group::StartupPhases* phases, const std::string& phase, const boost::function<void()>& fn)
+{
+  if (phases)
+    phases->run(phase, fn);
+  else
+    fn();
+}
+}
 
 move_group::MoveGroupContext::MoveGroupContext(
     const planning_scene_monitor::PlanningSceneMonitorPtr& planning_scene_monitor, bool allow_trajectory_execution,
-    bool debug)
+    bool debug, unsigned int planning_threads, StartupPhases* startup_phases)
   : planning_scene_monitor_(planning_scene_monitor)
   , allow_trajectory_execution_(allow_trajectory_execution)
   , debug_(debug)
+  , planning_threads_(std::max(planning_threads, 1u))
 {
-  planning_pipeline_.reset(new planning_pipeline::PlanningPipeline(planning_scene_monitor_->getRobotModel()));
+  // loading the planner plugins and connecting to the controllers are independent, and both can take seconds
+  boost::thread pipelines_thread([this, startup_phases]() {
+    runPhase(startup_phases, "planning pipelines", [this]() {
+      // one pipeline per planning thread, since planner plugins are not required to be thread-safe
+      for (unsigned int i = 0; i < planning_threads_; ++i)
+      {
+        planning_pipeline::PlanningPipelinePtr pipeline(
+            new planning_pipeline::PlanningPipeline(planning_scene_monitor_->getRobotModel()));
+        pipeline->displayComputedMotionPlans(true);
+        pipeline->checkSolutionPaths(true);
+        if (debug_)
+          pipeline->publishReceivedRequests(true);
+        free_planning_pipelines_.push_back(pipeline);
+      }
+    });
+  });
 
   if (allow_trajectory_execution_)
-  {
-    trajectory_execution_manager_.reset(new trajectory_execution_manager::TrajectoryExecutionManager(
-        planning_scene_monitor_->getRobotModel(), planning_scene_monitor_->getStateMonitor()));
-    plan_execution_.reset(new plan_execution::PlanExecution(planning_scene_monitor_, trajectory_execution_manager_));
-    plan_with_sensing_.reset(new plan_execution::PlanWithSensing(trajectory_execution_manager_));
-    if (debug)
-      plan_with_sensing_->displayCostSources(true);
-  }
-
-  // configure the planning pipeline
-  planning_pipeline_->displayComputedMotionPlans(true);
-  planning_pipeline_->checkSolutionPaths(true);
+    runPhase(startup_phases, "trajectory execution", [this, debug]() {
+      trajectory_execution_manager_.reset(new trajectory_execution_manager::TrajectoryExecutionManager(
+          planning_scene_monitor_->getRobotModel(), planning_scene_monitor_->getStateMonitor()));
+      plan_execution_.reset(new plan_execution::PlanExecution(planning_scene_monitor_, trajectory_execution_manager_));
+      plan_with_sensing_.reset(new plan_execution::PlanWithSensing(trajectory_execution_manager_));
+      if (debug)
+        plan_with_sensing_->displayCostSources(true);
+    });
 
-  if (debug_)
-    planning_pipeline_->publishReceivedRequests(true);
+  pipelines_thread.join();
+  planning_pipeline_ = free_planning_pipelines_.front();
 }
 
 move_group::MoveGroupContext::~MoveGroupContext()
@@ -73,9 +99,29 @@ move_group::MoveGroupContext::~MoveGroupContext()
   plan_execution_.reset();
   trajectory_execution_manager_.reset();
   planning_pipeline_.reset();
+  free_planning_pipelines_.clear();
   planning_scene_monitor_.reset();
 }
 
+planning_pipeline::PlanningPipelinePtr move_group::MoveGroupContext::acquirePlanningPipeline()
+{
+  boost::unique_lock<boost::mutex> ulock(planning_pipelines_lock_);
+  while (free_planning_pipelines_.empty())
+    planning_pipeline_released_.wait(ulock);
+  planning_pipeline::PlanningPipelinePtr pipeline = free_planning_pipelines_.back();
+  free_planning_pipelines_.pop_back();
+  return pipeline;
+}
+
+void move_group::MoveGroupContext::releasePlanningPipeline(const planning_pipeline::PlanningPipelinePtr& pipeline)
+{
+  {
+    boost::mutex::scoped_lock slock(planning_pipelines_lock_);
+    free_planning_pipelines_.push_back(pipeline);
+  }
+  planning_pipeline_released_.notify_one();
+}
+
 bool move_group::MoveGroupContext::status() const
 {
   const planning_interface::PlannerManagerPtr& planner_interface = planning_pipeline_->getPlannerManager();
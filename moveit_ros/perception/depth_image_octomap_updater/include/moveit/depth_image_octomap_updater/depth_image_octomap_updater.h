@@ -89,9 +89,14 @@ private:
   double shadow_threshold_;
   double padding_scale_;
   double padding_offset_;
+  double mesh_decimation_cell_size_;
   double max_update_rate_;
   unsigned int skip_vertical_pixels_;
   unsigned int skip_horizontal_pixels_;
+  bool compute_keys_on_gpu_;
+  bool share_mesh_filter_context_;
+  unsigned int free_space_threads_;
+  double free_space_max_lock_duration_;
 
   unsigned int image_callback_count_;
   double average_callback_dt_;
@@ -104,6 +109,7 @@ private:
   std::vector<float> x_cache_, y_cache_;
   double inv_fx_, inv_fy_, K0_, K2_, K4_, K5_;
   std::vector<unsigned int> filtered_labels_;
+  std::vector<unsigned short> filtered_keys_;
   ros::WallTime last_depth_callback_start_;
 };
 }
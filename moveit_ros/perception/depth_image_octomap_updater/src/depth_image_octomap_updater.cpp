@@ -36,8 +36,10 @@
 
 #include <moveit/depth_image_octomap_updater/depth_image_octomap_updater.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_monitor.h>
+#include <moveit/profiler/metrics.h>
 #include <geometric_shapes/shape_operations.h>
 #include <sensor_msgs/image_encodings.h>
+#include <tf_conversions/tf_eigen.h>
 #include <XmlRpcException.h>
 #include <stdint.h>
 
@@ -45,6 +47,30 @@
 
 namespace occupancy_map_monitor
 {
+namespace
+{
+moveit::tools::MetricHistogram& OCTOMAP_INTEGRATION = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_octomap_integration_seconds", "Time spent integrating a sensor message into the octomap");
+const UpdaterStageMetrics& STAGES = UpdaterStageMetrics::instance();
+
+// the context shared by the mesh filters of all updaters with share_mesh_filter_context set; it is kept alive by
+// their filters only
+boost::mutex SHARED_FILTER_CONTEXT_LOCK;
+std::weak_ptr<mesh_filter::FilterContext> SHARED_FILTER_CONTEXT;
+
+mesh_filter::FilterContextPtr getSharedFilterContext()
+{
+  boost::mutex::scoped_lock _(SHARED_FILTER_CONTEXT_LOCK);
+  mesh_filter::FilterContextPtr context = SHARED_FILTER_CONTEXT.lock();
+  if (!context)
+  {
+    context.reset(new mesh_filter::FilterContext());
+    SHARED_FILTER_CONTEXT = context;
+  }
+  return context;
+}
+}
+
 DepthImageOctomapUpdater::DepthImageOctomapUpdater()
   : OccupancyMapUpdater("DepthImageUpdater")
   , nh_("~")
@@ -59,9 +85,14 @@ DepthImageOctomapUpdater::DepthImageOctomapUpdater()
   , shadow_threshold_(0.04)
   , padding_scale_(0.0)
   , padding_offset_(0.02)
+  , mesh_decimation_cell_size_(0.0)
   , max_update_rate_(0)
   , skip_vertical_pixels_(4)
   , skip_horizontal_pixels_(6)
+  , compute_keys_on_gpu_(false)
+  , share_mesh_filter_context_(false)
+  , free_space_threads_(1)
+  , free_space_max_lock_duration_(0.0)
   , image_callback_count_(0)
   , average_callback_dt_(0.0)
   , good_tf_(5)
@@ -94,10 +125,20 @@ bool DepthImageOctomapUpdater::setParams(XmlRpc::XmlRpcValue& params)
     readXmlParam(params, "shadow_threshold", &shadow_threshold_);
     readXmlParam(params, "padding_scale", &padding_scale_);
     readXmlParam(params, "padding_offset", &padding_offset_);
+    if (params.hasMember("mesh_decimation_cell_size"))
+      readXmlParam(params, "mesh_decimation_cell_size", &mesh_decimation_cell_size_);
     if (params.hasMember("max_update_rate"))
       readXmlParam(params, "max_update_rate", &max_update_rate_);
     readXmlParam(params, "skip_vertical_pixels", &skip_vertical_pixels_);
     readXmlParam(params, "skip_horizontal_pixels", &skip_horizontal_pixels_);
+    if (params.hasMember("compute_keys_on_gpu"))
+      compute_keys_on_gpu_ = static_cast<bool&>(params["compute_keys_on_gpu"]);
+    if (params.hasMember("share_mesh_filter_context"))
+      share_mesh_filter_context_ = static_cast<bool&>(params["share_mesh_filter_context"]);
+    if (params.hasMember("free_space_threads"))
+      readXmlParam(params, "free_space_threads", &free_space_threads_);
+    if (params.hasMember("free_space_max_lock_duration"))
+      readXmlParam(params, "free_space_max_lock_duration", &free_space_max_lock_duration_);
     if (params.hasMember("filtered_cloud_topic"))
       filtered_cloud_topic_ = static_cast<const std::string&>(params["filtered_cloud_topic"]);
   }
@@ -114,14 +155,21 @@ bool DepthImageOctomapUpdater::initialize()
 {
   tf_ = monitor_->getTFClient();
   free_space_updater_.reset(new LazyFreeSpaceUpdater(tree_));
-
-  // create our mesh filter
+  free_space_updater_->setThreadCount(free_space_threads_);
+  free_space_updater_->setMaxWriteLockDuration(free_space_max_lock_duration_);
+
+  // create our mesh filter; with a shared context, all cameras render on one GL context and upload the robot meshes
+  // only once
+  mesh_filter::FilterContextPtr context;
+  if (share_mesh_filter_context_)
+    context = getSharedFilterContext();
   mesh_filter_.reset(new mesh_filter::MeshFilter<mesh_filter::StereoCameraModel>(
-      mesh_filter::MeshFilterBase::TransformCallback(), mesh_filter::StereoCameraModel::RegisteredPSDKParams));
+      mesh_filter::MeshFilterBase::TransformCallback(), mesh_filter::StereoCameraModel::RegisteredPSDKParams, context));
   mesh_filter_->parameters().setDepthRange(near_clipping_plane_distance_, far_clipping_plane_distance_);
   mesh_filter_->setShadowThreshold(shadow_threshold_);
   mesh_filter_->setPaddingOffset(padding_offset_);
   mesh_filter_->setPaddingScale(padding_scale_);
+  mesh_filter_->setMeshDecimationCellSize(mesh_decimation_cell_size_);
   mesh_filter_->setTransformCallback(boost::bind(&DepthImageOctomapUpdater::getShapeTransform, this, _1, _2));
 
   return true;
@@ -244,6 +292,7 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
     monitor_->setMapFrame(depth_msg->header.frame_id);
 
   /* get transform for cloud into map frame */
+  ros::WallTime stage_start = ros::WallTime::now();
   tf::StampedTransform map_H_sensor;
   if (monitor_->getMapFrame() == depth_msg->header.frame_id)
     map_H_sensor.setIdentity();
@@ -308,6 +357,7 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
     ROS_ERROR_THROTTLE(1, "Transform cache was not updated. Self-filtering may fail.");
     return;
   }
+  STAGES.transform.observe((ros::WallTime::now() - stage_start).toSec());
 
   if (depth_msg->is_bigendian && !HOST_IS_BIG_ENDIAN)
     ROS_ERROR_THROTTLE(1, "endian problem: received image data does not match host");
@@ -320,9 +370,12 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
   params.setCameraParameters(info_msg->K[0], info_msg->K[4], info_msg->K[2], info_msg->K[5]);
   params.setImageSize(w, h);
 
+  // the results of the filter are copied back asynchronously, while the rest of this frame is processed
+  stage_start = ros::WallTime::now();
+  mesh_filter::AsyncFilterResultPtr filter_result;
   const bool is_u_short = depth_msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1;
   if (is_u_short)
-    mesh_filter_->filter(&depth_msg->data[0], GL_UNSIGNED_SHORT);
+    filter_result = mesh_filter_->filterAsync(&depth_msg->data[0], GL_UNSIGNED_SHORT);
   else
   {
     if (depth_msg->encoding != sensor_msgs::image_encodings::TYPE_32FC1)
@@ -330,7 +383,7 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
       ROS_ERROR_THROTTLE(1, "Unexpected encoding type: '%s'. Ignoring input.", depth_msg->encoding.c_str());
       return;
     }
-    mesh_filter_->filter(&depth_msg->data[0], GL_FLOAT);
+    filter_result = mesh_filter_->filterAsync(&depth_msg->data[0], GL_FLOAT);
   }
 
   // the mesh filter runs in background; compute extra things in the meantime
@@ -353,7 +406,11 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
 
     // if there are any NaNs, discard data
     if (!(px == px && py == py && inv_fx_ == inv_fx_ && inv_fy_ == inv_fy_))
+    {
+      // the filter may still read the depth image
+      filter_result->wait();
       return;
+    }
 
     // Pre-compute some constants
     if (static_cast<int>(x_cache_.size()) < w)
@@ -371,19 +428,31 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
   const octomap::point3d sensor_origin(map_H_sensor.getOrigin().getX(), map_H_sensor.getOrigin().getY(),
                                        map_H_sensor.getOrigin().getZ());
 
-  octomap::KeySet* occupied_cells_ptr = new octomap::KeySet();
-  octomap::KeySet* model_cells_ptr = new octomap::KeySet();
-  octomap::KeySet& occupied_cells = *occupied_cells_ptr;
-  octomap::KeySet& model_cells = *model_cells_ptr;
+  OcTreeKeySet* occupied_cells_ptr = new OcTreeKeySet();
+  OcTreeKeySet* model_cells_ptr = new OcTreeKeySet();
+  OcTreeKeySet& occupied_cells = *occupied_cells_ptr;
+  OcTreeKeySet& model_cells = *model_cells_ptr;
 
   // allocate memory if needed
   std::size_t img_size = h * w;
   if (filtered_labels_.size() < img_size)
     filtered_labels_.resize(img_size);
 
-  // get the labels of the filtered data
+  // get the labels of the filtered data, or directly the keys of the cells they fall in
   const unsigned int* labels_row = &filtered_labels_[0];
-  mesh_filter_->getFilteredLabels(&filtered_labels_[0]);
+  if (compute_keys_on_gpu_)
+  {
+    if (filtered_keys_.size() < 4 * img_size)
+      filtered_keys_.resize(4 * img_size);
+    Eigen::Affine3d map_H_sensor_eigen;
+    tf::transformTFToEigen(map_H_sensor, map_H_sensor_eigen);
+    mesh_filter_->getFilteredKeys(map_H_sensor_eigen, K0_, K4_, K2_, K5_, tree_->getResolution(),
+                                  tree_->coordToKey(0.0), &filtered_keys_[0]);
+  }
+  else if (!filter_result->getFilteredLabels(&filtered_labels_[0]))
+    mesh_filter_->getFilteredLabels(&filtered_labels_[0]);
+  // includes the work done on this thread while the filter runs
+  STAGES.self_filter.observe((ros::WallTime::now() - stage_start).toSec());
 
   // publish debug information if needed
   if (debug_info_)
@@ -408,7 +477,8 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
     filtered_depth_msg.step = depth_msg->step;
     filtered_depth_msg.data.resize(img_size * sizeof(float));
 
-    mesh_filter_->getFilteredDepth(reinterpret_cast<float*>(&filtered_depth_msg.data[0]));
+    if (!filter_result->getFilteredDepth(reinterpret_cast<float*>(&filtered_depth_msg.data[0])))
+      mesh_filter_->getFilteredDepth(reinterpret_cast<float*>(&filtered_depth_msg.data[0]));
     pub_filtered_depth_image_.publish(filtered_depth_msg, *info_msg);
 
     sensor_msgs::Image label_msg;
@@ -437,7 +507,8 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
     filtered_msg.data.resize(img_size * sizeof(unsigned short));
     if (filtered_data.size() < img_size)
       filtered_data.resize(img_size);
-    mesh_filter_->getFilteredDepth(reinterpret_cast<float*>(&filtered_data[0]));
+    if (!filter_result->getFilteredDepth(reinterpret_cast<float*>(&filtered_data[0])))
+      mesh_filter_->getFilteredDepth(reinterpret_cast<float*>(&filtered_data[0]));
     unsigned short* tmp_ptr = (unsigned short*)&filtered_msg.data[0];
     for (std::size_t i = 0; i < img_size; ++i)
     {
@@ -454,7 +525,19 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
     const int h_bound = h - skip_vertical_pixels_;
     const int w_bound = w - skip_horizontal_pixels_;
 
-    if (is_u_short)
+    if (compute_keys_on_gpu_)
+    {
+      for (int y = skip_vertical_pixels_; y < h_bound; ++y)
+        for (int x = skip_horizontal_pixels_; x < w_bound; ++x)
+        {
+          const unsigned short* key = &filtered_keys_[4 * (y * w + x)];
+          if (key[3] == 1)
+            occupied_cells.insert(octomap::OcTreeKey(key[0], key[1], key[2]));
+          else if (key[3] == 2)
+            model_cells.insert(octomap::OcTreeKey(key[0], key[1], key[2]));
+        }
+    }
+    else if (is_u_short)
     {
       const uint16_t* input_row = reinterpret_cast<const uint16_t*>(&depth_msg->data[0]);
 
@@ -522,27 +605,34 @@ void DepthImageOctomapUpdater::depthImageCallback(const sensor_msgs::ImageConstP
   tree_->unlockRead();
 
   /* cells that overlap with the model are not occupied */
-  for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
+  for (OcTreeKeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
     occupied_cells.erase(*it);
 
   // mark occupied cells
-  tree_->lockWrite();
-  try
-  {
-    /* now mark all occupied cells */
-    for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, true);
-  }
-  catch (...)
+  if (monitor_->getIntegrator())
+    monitor_->getIntegrator()->push(OcTreeKeySet(), occupied_cells, OcTreeKeySet());
+  else
   {
-    ROS_ERROR("Internal error while updating octree");
+    moveit::tools::ScopedMetricTimer timer(STAGES.tree_write);
+    tree_->lockWrite();
+    try
+    {
+      /* now mark all occupied cells */
+      for (OcTreeKeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
+        tree_->updateNode(*it, true);
+    }
+    catch (...)
+    {
+      ROS_ERROR("Internal error while updating octree");
+    }
+    tree_->unlockWrite();
+    tree_->triggerUpdateCallback();
   }
-  tree_->unlockWrite();
-  tree_->triggerUpdateCallback();
 
   // at this point we still have not freed the space
   free_space_updater_->pushLazyUpdate(occupied_cells_ptr, model_cells_ptr, sensor_origin);
 
+  OCTOMAP_INTEGRATION.observe((ros::WallTime::now() - start).toSec());
   ROS_DEBUG("Processed depth image in %lf ms", (ros::WallTime::now() - start).toSec() * 1000.0);
 }
 }
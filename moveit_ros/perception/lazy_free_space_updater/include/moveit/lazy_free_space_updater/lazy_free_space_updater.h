@@ -38,8 +38,12 @@
 #define MOVEIT_OCCUPANCY_MAP_MONITOR_LAZY_FREE_SPACE_UPDATER_
 
 #include <moveit/occupancy_map_monitor/occupancy_map.h>
+#include <moveit/occupancy_map_monitor/octree_key_set.h>
 #include <boost/thread.hpp>
+#include <atomic>
+#include <cstdint>
 #include <deque>
+#include <vector>
 
 namespace occupancy_map_monitor
 {
@@ -49,39 +53,79 @@ public:
   LazyFreeSpaceUpdater(const OccMapTreePtr& tree, unsigned int max_batch_size = 10);
   ~LazyFreeSpaceUpdater();
 
-  void pushLazyUpdate(octomap::KeySet* occupied_cells, octomap::KeySet* model_cells,
-                      const octomap::point3d& sensor_origin);
+  void pushLazyUpdate(OcTreeKeySet* occupied_cells, OcTreeKeySet* model_cells, const octomap::point3d& sensor_origin);
+
+  /** \brief Set the number of threads casting the rays of a batch; 0 uses one thread per core. Default is 1. */
+  void setThreadCount(unsigned int thread_count);
+
+  /** \brief Set for how long (in seconds) the write lock of the tree may be held at once when marking free cells.
+   *  Batches are then written in slices whose size adapts to the measured lock hold time, so readers are not blocked
+   *  for long. Default is 0, which writes every batch under a single lock. */
+  void setMaxWriteLockDuration(double duration);
+
+  /** \brief Number of cell sets pushed with pushLazyUpdate() that were not yet combined into a batch */
+  std::size_t getQueuedCellSetCount() const;
+
+  /** \brief Number of free cells of the batch in progress that were not yet written to the tree */
+  std::size_t getPendingFreeCellCount() const;
+
+  /** \brief Number of batches that were dropped because the previous batch was still being processed */
+  std::size_t getDroppedBatchCount() const;
 
 private:
-#ifdef __APPLE__
-  typedef std::unordered_map<octomap::OcTreeKey, unsigned int, octomap::OcTreeKey::KeyHash> OcTreeKeyCountMap;
-#else
-  typedef std::tr1::unordered_map<octomap::OcTreeKey, unsigned int, octomap::OcTreeKey::KeyHash> OcTreeKeyCountMap;
-#endif
+  typedef OcTreeKeyMap<unsigned int> OcTreeKeyCountMap;
+
+  /** \brief A log-odds update of a single cell, ordered by the octree subtree the cell is in */
+  struct CellUpdate
+  {
+    uint64_t order;
+    octomap::OcTreeKey key;
+    float log_odds;
 
-  void pushBatchToProcess(OcTreeKeyCountMap* occupied_cells, octomap::KeySet* model_cells,
+    bool operator<(const CellUpdate& other) const
+    {
+      return order < other.order;
+    }
+  };
+
+  void pushBatchToProcess(OcTreeKeyCountMap* occupied_cells, OcTreeKeySet* model_cells,
                           const octomap::point3d& sensor_origin);
 
   void lazyUpdateThread();
   void processThread();
 
+  /** \brief Cast the rays to the occupied and model cells of the batch in process and count the cells they pass */
+  void computeFreeCells(OcTreeKeyCountMap& occupied_free_cells, OcTreeKeyCountMap& model_free_cells);
+
+  /** \brief Write \e updates to the tree, releasing the write lock whenever the maximum hold time is reached */
+  void writeUpdates(const std::vector<CellUpdate>& updates);
+
   OccMapTreePtr tree_;
   bool running_;
   std::size_t max_batch_size_;
   double max_sensor_delta_;
+  std::atomic<unsigned int> thread_count_;
+  std::atomic<double> max_write_lock_duration_;
+  std::size_t cells_per_write_lock_;
 
-  std::deque<octomap::KeySet*> occupied_cells_sets_;
-  std::deque<octomap::KeySet*> model_cells_sets_;
+  std::atomic<std::size_t> pending_free_cells_;
+  std::atomic<std::size_t> dropped_batches_;
+
+  std::deque<OcTreeKeySet*> occupied_cells_sets_;
+  std::deque<OcTreeKeySet*> model_cells_sets_;
   std::deque<octomap::point3d> sensor_origins_;
   boost::condition_variable update_condition_;
-  boost::mutex update_cell_sets_lock_;
+  mutable boost::mutex update_cell_sets_lock_;
 
   OcTreeKeyCountMap* process_occupied_cells_set_;
-  octomap::KeySet* process_model_cells_set_;
+  OcTreeKeySet* process_model_cells_set_;
   octomap::point3d process_sensor_origin_;
   boost::condition_variable process_condition_;
   boost::mutex cell_process_lock_;
 
+  std::vector<OcTreeKeyCountMap> thread_occupied_free_cells_;
+  std::vector<OcTreeKeyCountMap> thread_model_free_cells_;
+
   boost::thread update_thread_;
   boost::thread process_thread_;
 };
@@ -35,17 +35,48 @@
 /* Author: Ioan Sucan */
 
 #include <moveit/lazy_free_space_updater/lazy_free_space_updater.h>
+#include <moveit/occupancy_map_monitor/occupancy_map_updater.h>
 #include <ros/console.h>
+#include <moveit/utils/thread_groups.h>
+#include <algorithm>
 
 namespace occupancy_map_monitor
 {
+namespace
+{
+const UpdaterStageMetrics& STAGES = UpdaterStageMetrics::instance();
+
+// insert two zero bits after each of the lower 21 bits of v
+inline uint64_t spreadBits(uint64_t v)
+{
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// Morton code of a key: cells with the same code prefix lie in the same octree subtree
+inline uint64_t subtreeOrder(const octomap::OcTreeKey& key)
+{
+  return spreadBits(key[0]) | spreadBits(key[1]) << 1 | spreadBits(key[2]) << 2;
+}
+}
+
 LazyFreeSpaceUpdater::LazyFreeSpaceUpdater(const OccMapTreePtr& tree, unsigned int max_batch_size)
   : tree_(tree)
   , running_(true)
   , max_batch_size_(max_batch_size)
   , max_sensor_delta_(1e-3)
   ,  // 1mm
-  process_occupied_cells_set_(NULL)
+  thread_count_(1)
+  , max_write_lock_duration_(0.0)
+  , cells_per_write_lock_(4096)
+  , pending_free_cells_(0)
+  , dropped_batches_(0)
+  , process_occupied_cells_set_(NULL)
   , process_model_cells_set_(NULL)
   , update_thread_(boost::bind(&LazyFreeSpaceUpdater::lazyUpdateThread, this))
   , process_thread_(boost::bind(&LazyFreeSpaceUpdater::processThread, this))
@@ -67,7 +98,33 @@ LazyFreeSpaceUpdater::~LazyFreeSpaceUpdater()
   process_thread_.join();
 }
 
-void LazyFreeSpaceUpdater::pushLazyUpdate(octomap::KeySet* occupied_cells, octomap::KeySet* model_cells,
+void LazyFreeSpaceUpdater::setThreadCount(unsigned int thread_count)
+{
+  thread_count_ = thread_count;
+}
+
+void LazyFreeSpaceUpdater::setMaxWriteLockDuration(double duration)
+{
+  max_write_lock_duration_ = duration;
+}
+
+std::size_t LazyFreeSpaceUpdater::getQueuedCellSetCount() const
+{
+  boost::mutex::scoped_lock _(update_cell_sets_lock_);
+  return occupied_cells_sets_.size();
+}
+
+std::size_t LazyFreeSpaceUpdater::getPendingFreeCellCount() const
+{
+  return pending_free_cells_;
+}
+
+std::size_t LazyFreeSpaceUpdater::getDroppedBatchCount() const
+{
+  return dropped_batches_;
+}
+
+void LazyFreeSpaceUpdater::pushLazyUpdate(OcTreeKeySet* occupied_cells, OcTreeKeySet* model_cells,
                                           const octomap::point3d& sensor_origin)
 {
   ROS_DEBUG("Pushing %lu occupied cells and %lu model cells for lazy updating...",
@@ -79,7 +136,7 @@ void LazyFreeSpaceUpdater::pushLazyUpdate(octomap::KeySet* occupied_cells, octom
   update_condition_.notify_one();
 }
 
-void LazyFreeSpaceUpdater::pushBatchToProcess(OcTreeKeyCountMap* occupied_cells, octomap::KeySet* model_cells,
+void LazyFreeSpaceUpdater::pushBatchToProcess(OcTreeKeyCountMap* occupied_cells, OcTreeKeySet* model_cells,
                                               const octomap::point3d& sensor_origin)
 {
   // this is basically a queue of size 1. if this function is called repeatedly without any work being done by
@@ -95,19 +152,127 @@ void LazyFreeSpaceUpdater::pushBatchToProcess(OcTreeKeyCountMap* occupied_cells,
   }
   else
   {
-    ROS_WARN("Previous batch update did not complete. Ignoring set of cells to be freed.");
+    ++dropped_batches_;
+    ROS_WARN("Previous batch update did not complete (%lu cells left). Ignoring set of cells to be freed.",
+             (long unsigned int)pending_free_cells_);
     delete occupied_cells;
     delete model_cells;
   }
 }
 
+void LazyFreeSpaceUpdater::computeFreeCells(OcTreeKeyCountMap& occupied_free_cells,
+                                            OcTreeKeyCountMap& model_free_cells)
+{
+  // collect the ray endpoints, so threads can claim them by index
+  std::vector<std::pair<octomap::OcTreeKey, unsigned int> > endpoints;
+  endpoints.reserve(process_occupied_cells_set_->size() + process_model_cells_set_->size());
+  for (OcTreeKeyCountMap::iterator it = process_occupied_cells_set_->begin(), end = process_occupied_cells_set_->end();
+       it != end; ++it)
+    endpoints.push_back(std::make_pair(it->first, it->second));
+  const std::size_t occupied_count = endpoints.size();
+  for (OcTreeKeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end(); it != end;
+       ++it)
+    endpoints.push_back(std::make_pair(*it, 1u));
+
+  unsigned int thread_count = thread_count_;
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::max<std::size_t>(1, std::min<std::size_t>(thread_count, endpoints.size()));
+  if (thread_occupied_free_cells_.size() < thread_count)
+  {
+    thread_occupied_free_cells_.resize(thread_count);
+    thread_model_free_cells_.resize(thread_count);
+  }
+
+  // computeRayKeys() only reads the tree; each thread counts the cells the rays of its chunks pass in its own maps
+  static const std::size_t RAYS_PER_CHUNK = 256;
+  std::atomic<std::size_t> next(0);
+  auto worker = [this, &endpoints, occupied_count, &next](unsigned int t) {
+    octomap::KeyRay key_ray;
+    OcTreeKeyCountMap& occupied_free = thread_occupied_free_cells_[t];
+    OcTreeKeyCountMap& model_free = thread_model_free_cells_[t];
+    occupied_free.clear();
+    model_free.clear();
+    for (std::size_t begin = next.fetch_add(RAYS_PER_CHUNK); begin < endpoints.size();
+         begin = next.fetch_add(RAYS_PER_CHUNK))
+    {
+      std::size_t end = std::min(begin + RAYS_PER_CHUNK, endpoints.size());
+      for (std::size_t i = begin; i < end; ++i)
+        if (tree_->computeRayKeys(process_sensor_origin_, tree_->keyToCoord(endpoints[i].first), key_ray))
+        {
+          OcTreeKeyCountMap& free_cells = i < occupied_count ? occupied_free : model_free;
+          for (octomap::KeyRay::iterator jt = key_ray.begin(), ray_end = key_ray.end(); jt != ray_end; ++jt)
+            free_cells[*jt] += endpoints[i].second;
+        }
+    }
+  };
+  boost::thread_group workers;
+  for (unsigned int t = 1; t < thread_count; ++t)
+    workers.create_thread([&worker, t]() { worker(t); });
+  worker(0);
+  workers.join_all();
+
+  occupied_free_cells.swap(thread_occupied_free_cells_[0]);
+  model_free_cells.swap(thread_model_free_cells_[0]);
+  for (unsigned int t = 1; t < thread_count; ++t)
+  {
+    for (OcTreeKeyCountMap::iterator it = thread_occupied_free_cells_[t].begin(),
+                                     end = thread_occupied_free_cells_[t].end();
+         it != end; ++it)
+      occupied_free_cells[it->first] += it->second;
+    for (OcTreeKeyCountMap::iterator it = thread_model_free_cells_[t].begin(), end = thread_model_free_cells_[t].end();
+         it != end; ++it)
+      model_free_cells[it->first] += it->second;
+  }
+}
+
+void LazyFreeSpaceUpdater::writeUpdates(const std::vector<CellUpdate>& updates)
+{
+  static const std::size_t MIN_CELLS_PER_WRITE_LOCK = 256;
+  const double max_duration = max_write_lock_duration_;
+
+  std::size_t begin = 0;
+  while (begin < updates.size())
+  {
+    std::size_t end = max_duration > 0.0 ? std::min(updates.size(), begin + cells_per_write_lock_) : updates.size();
+
+    ros::WallTime start = ros::WallTime::now();
+    tree_->lockWrite();
+    try
+    {
+      // the updates are sorted by subtree, so consecutive updates mostly descend along the same path
+      for (std::size_t i = begin; i < end; ++i)
+        tree_->updateNode(updates[i].key, updates[i].log_odds);
+    }
+    catch (...)
+    {
+      ROS_ERROR("Internal error while updating octree");
+    }
+    tree_->unlockWrite();
+    pending_free_cells_ = updates.size() - end;
+
+    if (max_duration > 0.0)
+    {
+      // adapt the slice size to the time the lock was held, smoothing out the noise of single measurements
+      double duration = (ros::WallTime::now() - start).toSec();
+      double target = duration > 0.0 ? (end - begin) * max_duration / duration : 2.0 * cells_per_write_lock_;
+      cells_per_write_lock_ =
+          std::max(MIN_CELLS_PER_WRITE_LOCK, (std::size_t)(0.5 * cells_per_write_lock_ + 0.5 * target));
+      if (end < updates.size())
+        boost::this_thread::yield();
+    }
+    begin = end;
+  }
+}
+
 void LazyFreeSpaceUpdater::processThread()
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PERCEPTION);
   const float lg_0 = tree_->getClampingThresMinLog() - tree_->getClampingThresMaxLog();
   const float lg_miss = tree_->getProbMissLog();
 
-  octomap::KeyRay key_ray1, key_ray2;
   OcTreeKeyCountMap free_cells1, free_cells2;
+  std::vector<CellUpdate> updates;
 
   while (running_)
   {
@@ -127,32 +292,11 @@ void LazyFreeSpaceUpdater::processThread()
 
     ros::WallTime start = ros::WallTime::now();
     tree_->lockRead();
-
-#pragma omp sections
-    {
-#pragma omp section
-      {
-        /* compute the free cells along each ray that ends at an occupied cell */
-        for (OcTreeKeyCountMap::iterator it = process_occupied_cells_set_->begin(),
-                                         end = process_occupied_cells_set_->end();
-             it != end; ++it)
-          if (tree_->computeRayKeys(process_sensor_origin_, tree_->keyToCoord(it->first), key_ray1))
-            for (octomap::KeyRay::iterator jt = key_ray1.begin(), end = key_ray1.end(); jt != end; ++jt)
-              free_cells1[*jt] += it->second;
-      }
-
-#pragma omp section
-      {
-        /* compute the free cells along each ray that ends at a model cell */
-        for (octomap::KeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end();
-             it != end; ++it)
-          if (tree_->computeRayKeys(process_sensor_origin_, tree_->keyToCoord(*it), key_ray2))
-            for (octomap::KeyRay::iterator jt = key_ray2.begin(), end = key_ray2.end(); jt != end; ++jt)
-              free_cells2[*jt]++;
-      }
-    }
-
+    /* compute the free cells along each ray that ends at an occupied cell (free_cells1) or a model cell
+     * (free_cells2) */
+    computeFreeCells(free_cells1, free_cells2);
     tree_->unlockRead();
+    STAGES.ray_casting.observe((ros::WallTime::now() - start).toSec());
 
     for (OcTreeKeyCountMap::iterator it = process_occupied_cells_set_->begin(),
                                      end = process_occupied_cells_set_->end();
@@ -162,7 +306,7 @@ void LazyFreeSpaceUpdater::processThread()
       free_cells2.erase(it->first);
     }
 
-    for (octomap::KeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end();
+    for (OcTreeKeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end();
          it != end; ++it)
     {
       free_cells1.erase(*it);
@@ -170,29 +314,36 @@ void LazyFreeSpaceUpdater::processThread()
     }
     ROS_DEBUG("Marking %lu cells as free...", (long unsigned int)(free_cells1.size() + free_cells2.size()));
 
-    tree_->lockWrite();
-
-    try
+    // set the logodds to the minimum for the cells that are part of the model, and
+    // mark free cells only if not seen occupied in this cloud
+    updates.clear();
+    updates.reserve(process_model_cells_set_->size() + free_cells1.size() + free_cells2.size());
+    for (OcTreeKeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end();
+         it != end; ++it)
     {
-      // set the logodds to the minimum for the cells that are part of the model
-      for (octomap::KeySet::iterator it = process_model_cells_set_->begin(), end = process_model_cells_set_->end();
-           it != end; ++it)
-        tree_->updateNode(*it, lg_0);
-
-      /* mark free cells only if not seen occupied in this cloud */
-      for (OcTreeKeyCountMap::iterator it = free_cells1.begin(), end = free_cells1.end(); it != end; ++it)
-        tree_->updateNode(it->first, it->second * lg_miss);
-      for (OcTreeKeyCountMap::iterator it = free_cells2.begin(), end = free_cells2.end(); it != end; ++it)
-        tree_->updateNode(it->first, it->second * lg_miss);
+      CellUpdate update = { subtreeOrder(*it), *it, lg_0 };
+      updates.push_back(update);
     }
-    catch (...)
+    for (OcTreeKeyCountMap::iterator it = free_cells1.begin(), end = free_cells1.end(); it != end; ++it)
     {
-      ROS_ERROR("Internal error while updating octree");
+      CellUpdate update = { subtreeOrder(it->first), it->first, it->second * lg_miss };
+      updates.push_back(update);
     }
-    tree_->unlockWrite();
+    for (OcTreeKeyCountMap::iterator it = free_cells2.begin(), end = free_cells2.end(); it != end; ++it)
+    {
+      CellUpdate update = { subtreeOrder(it->first), it->first, it->second * lg_miss };
+      updates.push_back(update);
+    }
+    std::sort(updates.begin(), updates.end());
+    pending_free_cells_ = updates.size();
+
+    ros::WallTime write_start = ros::WallTime::now();
+    writeUpdates(updates);
+    STAGES.tree_write.observe((ros::WallTime::now() - write_start).toSec());
     tree_->triggerUpdateCallback();
 
-    ROS_DEBUG("Marked free cells in %lf ms", (ros::WallTime::now() - start).toSec() * 1000.0);
+    ROS_DEBUG("Marked free cells in %lf ms (%lu cell sets queued)", (ros::WallTime::now() - start).toSec() * 1000.0,
+              (long unsigned int)getQueuedCellSetCount());
 
     delete process_occupied_cells_set_;
     process_occupied_cells_set_ = NULL;
@@ -203,8 +354,9 @@ void LazyFreeSpaceUpdater::processThread()
 
 void LazyFreeSpaceUpdater::lazyUpdateThread()
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PERCEPTION);
   OcTreeKeyCountMap* occupied_cells_set = NULL;
-  octomap::KeySet* model_cells_set = NULL;
+  OcTreeKeySet* model_cells_set = NULL;
   octomap::point3d sensor_origin;
   unsigned int batch_size = 0;
 
@@ -220,9 +372,9 @@ void LazyFreeSpaceUpdater::lazyUpdateThread()
     if (batch_size == 0)
     {
       occupied_cells_set = new OcTreeKeyCountMap();
-      octomap::KeySet* s = occupied_cells_sets_.front();
+      OcTreeKeySet* s = occupied_cells_sets_.front();
       occupied_cells_sets_.pop_front();
-      for (octomap::KeySet::iterator it = s->begin(), end = s->end(); it != end; ++it)
+      for (OcTreeKeySet::iterator it = s->begin(), end = s->end(); it != end; ++it)
         (*occupied_cells_set)[*it]++;
       delete s;
       model_cells_set = model_cells_sets_.front();
@@ -243,12 +395,12 @@ void LazyFreeSpaceUpdater::lazyUpdateThread()
       }
       sensor_origins_.pop_front();
 
-      octomap::KeySet* add_occ = occupied_cells_sets_.front();
-      for (octomap::KeySet::iterator it = add_occ->begin(), end = add_occ->end(); it != end; ++it)
+      OcTreeKeySet* add_occ = occupied_cells_sets_.front();
+      for (OcTreeKeySet::iterator it = add_occ->begin(), end = add_occ->end(); it != end; ++it)
         (*occupied_cells_set)[*it]++;
       occupied_cells_sets_.pop_front();
       delete add_occ;
-      octomap::KeySet* mod_occ = model_cells_sets_.front();
+      OcTreeKeySet* mod_occ = model_cells_sets_.front();
       model_cells_set->insert(mod_occ->begin(), mod_occ->end());
       model_cells_sets_.pop_front();
       delete mod_occ;
@@ -44,7 +44,6 @@
 #include <moveit/mesh_filter/transform_provider.h>
 #include <moveit/mesh_filter/mesh_filter.h>
 #include <moveit/mesh_filter/stereo_camera_model.h>
-#include <cv_bridge/cv_bridge.h>
 #include <memory>
 
 namespace mesh_filter
@@ -108,10 +107,6 @@ private:
   int queue_size_;
   TransformProvider transform_provider_;
 
-  cv_bridge::CvImagePtr filtered_depth_ptr_;
-  cv_bridge::CvImagePtr filtered_label_ptr_;
-  cv_bridge::CvImagePtr model_depth_ptr_;
-  cv_bridge::CvImagePtr model_label_ptr_;
   /** \brief distance of near clipping plane*/
   double near_clipping_plane_distance_;
 
@@ -0,0 +1,133 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_MESH_FILTER_FILTER_CONTEXT_
+#define MOVEIT_MESH_FILTER_FILTER_CONTEXT_
+
+#include <moveit/macros/class_forward.h>
+#include <boost/thread.hpp>
+#include <map>
+#include <memory>
+#include <queue>
+#include <stdint.h>
+
+namespace shapes
+{
+class Mesh;
+}
+
+namespace mesh_filter
+{
+MOVEIT_CLASS_FORWARD(Job);
+MOVEIT_CLASS_FORWARD(GLMesh);
+MOVEIT_CLASS_FORWARD(FilterContext);
+
+/**
+ * \brief The thread holding an OpenGL context, together with the meshes uploaded to it.
+ *
+ * Every MeshFilterBase executes its OpenGL work as jobs of a FilterContext. Filters that are constructed with the same
+ * context render on a single thread and GL context, one after the other, and share the buffers of meshes that have
+ * the same geometry, label and decimation. This way several cameras observing the same robot keep one copy of the
+ * link meshes on the GPU and do not compete for the GPU with separate contexts.
+ */
+class FilterContext
+{
+public:
+  /** \brief starts the thread holding the context */
+  FilterContext();
+
+  /** \brief cancels all pending jobs and stops the thread */
+  ~FilterContext();
+
+  /**
+   * \brief add a Job that needs to be executed in the context thread; jobs are executed in the order they were added
+   * \param[in] job the job object that has the function to be executed
+   */
+  void addJob(const JobPtr& job) const;
+
+  /**
+   * \brief returns the GL representation of a mesh, reusing the buffers of an identical mesh that is still in use by a
+   * filter of this context; must be called from within a job
+   * \param[in] mesh the mesh to be uploaded
+   * \param[in] mesh_label the label the mesh is rendered with
+   * \param[in] decimation_cell_size the cell size the mesh is decimated with
+   */
+  GLMeshPtr getMesh(const shapes::Mesh& mesh, unsigned int mesh_label, double decimation_cell_size);
+
+  /** \brief number of getMesh() calls that reused an uploaded mesh */
+  std::size_t getSharedMeshCount() const
+  {
+    return shared_mesh_count_;
+  }
+
+private:
+  /** \brief identifies the meshes that can share their buffers */
+  struct MeshKey
+  {
+    uint64_t hash_;
+    unsigned int vertex_count_;
+    unsigned int triangle_count_;
+    unsigned int mesh_label_;
+    double decimation_cell_size_;
+
+    bool operator<(const MeshKey& other) const;
+  };
+
+  /** \brief executes the jobs until the context is destroyed */
+  void run();
+
+  /** \brief the thread that holds the OpenGL context */
+  boost::thread thread_;
+
+  /** \brief condition variable to notify the thread about new jobs */
+  mutable boost::condition_variable jobs_condition_;
+
+  /** \brief mutex required for synchronization of condition states */
+  mutable boost::mutex jobs_mutex_;
+
+  /** \brief OpenGL job queue that need to be processed by the thread */
+  mutable std::queue<JobPtr> jobs_queue_;
+
+  /** \brief indicates whether the thread should stop; protected by jobs_mutex_ */
+  bool stop_;
+
+  /** \brief the meshes uploaded to this context that can be shared; only accessed from the context thread */
+  std::map<MeshKey, std::weak_ptr<GLMesh> > meshes_;
+
+  /** \brief number of getMesh() calls that reused an uploaded mesh */
+  std::size_t shared_mesh_count_;
+};
+}  // namespace mesh_filter
+
+#endif
@@ -65,8 +65,10 @@ public:
    * \author Suat Gedikli (gedikli@willowgarage.com)
    * \param[in] mesh
    * \param[in] mesh_label
+   * \param[in] decimation_cell_size if positive, vertices falling into the same cube of this size are merged, which
+   * moves each vertex by at most half the cube's diagonal
    */
-  GLMesh(const shapes::Mesh& mesh, unsigned int mesh_label);
+  GLMesh(const shapes::Mesh& mesh, unsigned int mesh_label, double decimation_cell_size = 0.0);
 
   /** \brief Destructor*/
   ~GLMesh();
@@ -74,12 +76,31 @@ public:
    * \brief renders the mesh in current OpenGL frame buffer (context)
    * \param[in] transform the modelview transformation describing the pose of the mesh in camera coordinate frame
    * \author Suat Gedikli (gedikli@willowgarage.com)
+   * \note needs to be called between beginBatch() and endBatch()
    */
   void render(const Eigen::Affine3d& transform) const;
 
+  /** \brief sets up the vertex array state shared by all meshes rendered until endBatch() is called */
+  static void beginBatch();
+
+  /** \brief resets the vertex array state set by beginBatch() */
+  static void endBatch();
+
+  /** \brief number of triangles that are rendered (after decimation) */
+  std::size_t getTriangleCount() const
+  {
+    return index_count_ / 3;
+  }
+
 private:
-  /** \brief the OpenGL mesh represented as a OpenGL list */
-  GLuint list_;
+  /** \brief buffer object holding interleaved vertex positions and normals */
+  GLuint vertex_buffer_;
+
+  /** \brief buffer object holding three vertex indices per triangle */
+  GLuint index_buffer_;
+
+  /** \brief number of indices in index_buffer_ */
+  GLsizei index_count_;
 
   /** \brief label of current mesh*/
   unsigned int mesh_label_;
@@ -71,9 +71,11 @@ public:
    * \param[in] transform_callback Callback function that is called for each mesh to obtain the current transformation.
    * \note the callback expects the mesh handle but no time stamp. Its the users responsibility to return the correct
    * transformation.
+   * \param[in] context the context to render in, see MeshFilterBase::MeshFilterBase()
    */
   MeshFilter(const TransformCallback& transform_callback = TransformCallback(),
-             const typename SensorType::Parameters& sensor_parameters = typename SensorType::Parameters());
+             const typename SensorType::Parameters& sensor_parameters = typename SensorType::Parameters(),
+             const FilterContextPtr& context = FilterContextPtr());
 
   /**
    * \brief returns the Sensor Parameters
@@ -92,10 +94,11 @@ public:
 
 template <typename SensorType>
 MeshFilter<SensorType>::MeshFilter(const TransformCallback& transform_callback,
-                                   const typename SensorType::Parameters& sensor_parameters)
+                                   const typename SensorType::Parameters& sensor_parameters,
+                                   const FilterContextPtr& context)
   : MeshFilterBase(transform_callback, sensor_parameters, SensorType::renderVertexShaderSource,
                    SensorType::renderFragmentShaderSource, SensorType::filterVertexShaderSource,
-                   SensorType::filterFragmentShaderSource)
+                   SensorType::filterFragmentShaderSource, context)
 {
 }
 
@@ -39,6 +39,7 @@
 
 #include <map>
 #include <moveit/macros/class_forward.h>
+#include <moveit/mesh_filter/filter_context.h>
 #include <moveit/mesh_filter/gl_renderer.h>
 #include <moveit/mesh_filter/sensor_model.h>
 #include <boost/function.hpp>
@@ -56,10 +57,52 @@ namespace mesh_filter
 {
 MOVEIT_CLASS_FORWARD(Job);
 MOVEIT_CLASS_FORWARD(GLMesh);
+MOVEIT_CLASS_FORWARD(AsyncFilterResult);
 
 typedef unsigned int MeshHandle;
 typedef uint32_t LabelType;
 
+class MeshFilterBase;
+
+/**
+ * \brief Handle to the results of MeshFilterBase::filterAsync(). The labels and depth of the filtered image are
+ * copied into pixel buffer objects by the GPU while the caller continues; retrieving them only maps these buffers.
+ * \note The filter keeps the results of the last two images submitted with filterAsync(); results of older images are
+ * no longer available.
+ */
+class AsyncFilterResult
+{
+public:
+  /** \brief wait until the image was filtered and the transfer of its results was started */
+  void wait() const;
+
+  /**
+   * \brief retrieves the labels of the filtered image
+   * \param[out] labels pointer to buffer to be filled with labels
+   * \return false if the results were overwritten by a newer image
+   */
+  bool getFilteredLabels(LabelType* labels) const;
+
+  /**
+   * \brief retrieves the filtered depth values in meters
+   * \param[out] depth pointer to buffer to be filled with depth values
+   * \return false if the results were overwritten by a newer image
+   */
+  bool getFilteredDepth(float* depth) const;
+
+private:
+  friend class MeshFilterBase;
+
+  AsyncFilterResult(const MeshFilterBase* filter, const JobPtr& job, unsigned int generation)
+    : filter_(filter), job_(job), generation_(generation)
+  {
+  }
+
+  const MeshFilterBase* filter_;
+  JobPtr job_;
+  unsigned int generation_;
+};
+
 class MeshFilterBase
 {
   // inner types and typedefs
@@ -84,10 +127,13 @@ public:
    * \param[in] transform_callback Callback function that is called for each mesh to obtain the current transformation.
    * \note the callback expects the mesh handle but no time stamp. Its the users responsibility to return the correct
    * transformation.
+   * \param[in] context the context to render in; filters of several cameras can share one context, and with it the
+   * buffers of their meshes. If empty, the filter creates a context of its own.
    */
   MeshFilterBase(const TransformCallback& transform_callback, const SensorModel::Parameters& sensor_parameters,
                  const std::string& render_vertex_shader = "", const std::string& render_fragment_shader = "",
-                 const std::string& filter_vertex_shader = "", const std::string& filter_fragment_shader = "");
+                 const std::string& filter_vertex_shader = "", const std::string& filter_fragment_shader = "",
+                 const FilterContextPtr& context = FilterContextPtr());
 
   /** \brief Desctructor */
   ~MeshFilterBase();
@@ -116,6 +162,14 @@ public:
    */
   void filter(const void* sensor_data, GLushort type, bool wait = false) const;
 
+  /**
+   * \brief label/remove pixels from input depth-image without waiting for the results
+   * \param[in] sensor_data pointer to the input depth image; it needs to stay valid until the handle's wait() returns
+   * \param[in] type GL_FLOAT or GL_UNSIGNED_SHORT
+   * \return handle to retrieve the results of this image, while the next image may already be filtered
+   */
+  AsyncFilterResultPtr filterAsync(const void* sensor_data, GLushort type) const;
+
   /**
    * \brief retrieves the labels of the input data
    * \author Suat Gedikli (gedikli@willowgarage.com)
@@ -133,6 +187,19 @@ public:
    */
   void getFilteredDepth(float* depth) const;
 
+  /**
+   * \brief computes the octree keys of the last filtered depth image on the GPU and retrieves them
+   * \param[in] map_H_sensor transformation from the sensor frame to the frame of the octree
+   * \param[in] fx, fy, cx, cy the pinhole parameters of the depth camera in pixels
+   * \param[in] resolution the resolution of the octree in meters
+   * \param[in] key_offset the key of the cells at coordinate 0 (octomap's tree_max_val)
+   * \param[out] keys buffer of 4 values per pixel: the three key components, and 0 for pixels to ignore, 1 for
+   *       background pixels (occupied cells) or 2 for pixels on the model or beyond the far clipping plane
+   * \note points beyond the far clipping plane are placed on it, since the sensor texture is clamped to its range
+   */
+  void getFilteredKeys(const Eigen::Affine3d& map_H_sensor, float fx, float fy, float cx, float cy, double resolution,
+                       unsigned int key_offset, unsigned short* keys) const;
+
   /**
    * \brief retrieves the labels of the rendered model
    * \author Suat Gedikli (gedikli@willowgarage.com)
@@ -180,6 +247,19 @@ public:
    */
   void setPaddingOffset(float offset);
 
+  /**
+   * \brief set the size of the grid cells used to decimate meshes passed to addMesh() afterwards. Vertices within the
+   * same cell are merged, and the padding offset is increased by half the cell diagonal to cover the simplified mesh.
+   * \param[in] cell_size the edge length of the cells; 0 disables decimation (default)
+   */
+  void setMeshDecimationCellSize(double cell_size);
+
+  /** \brief the context this filter renders in; pass it to the constructor of further filters to share it */
+  const FilterContextPtr& getContext() const
+  {
+    return context_;
+  }
+
 protected:
   /**
    * \brief initializes OpenGL related things as well as renderers
@@ -192,12 +272,6 @@ protected:
    */
   void deInitialize();
 
-  /**
-   * \brief filtering thread
-   */
-  void run(const std::string& render_vertex_shader, const std::string& render_fragment_shader,
-           const std::string& filter_vertex_shader, const std::string& filter_fragment_shader);
-
   /**
    * \brief the filter method that does the magic
    * \param[in] sensor_data pointer to the buffer containing the depth readings
@@ -205,6 +279,25 @@ protected:
    */
   void doFilter(const void* sensor_data, const int encoding) const;
 
+  /**
+   * \brief filters the image and starts copying its labels and depth into the pixel buffers of \e generation
+   */
+  void doFilterAsync(const void* sensor_data, const int encoding, unsigned int generation) const;
+
+  /**
+   * \brief copies the results of \e generation out of its pixel buffers; runs in the filtering thread
+   * \return false if the pixel buffers were reused for a newer image
+   */
+  bool readAsyncResult(unsigned int generation, LabelType* labels, float* depth) const;
+
+  friend class AsyncFilterResult;
+
+  /**
+   * \brief renders the octree keys of the last filtered image and reads them back; runs in the filtering thread
+   */
+  void doComputeKeys(const Eigen::Affine3d& map_H_sensor, float fx, float fy, float cx, float cy, double resolution,
+                     unsigned int key_offset, unsigned short* keys) const;
+
   /**
    * \brief used within a Job to allow the main thread adding meshes
    * \param[in] handle the handle of the mesh that is predetermined and passed
@@ -245,17 +338,8 @@ protected:
    * next_label_) */
   MeshHandle min_handle_;
 
-  /** \brief the filtering thread that also holds the OpenGL context*/
-  boost::thread filter_thread_;
-
-  /** \brief condition variable to notify the filtering thread if a new image arrived*/
-  mutable boost::condition_variable jobs_condition_;
-
-  /** \brief mutex required for synchronization of condition states*/
-  mutable boost::mutex jobs_mutex_;
-
-  /** \brief OpenGL job queue that need to be processed by the worker thread*/
-  mutable std::queue<JobPtr> jobs_queue_;
+  /** \brief the thread holding the OpenGL context, possibly shared with other filters*/
+  FilterContextPtr context_;
 
   /** \brief mutex for synchronization of updating filtered meshes */
   mutable boost::mutex meshes_mutex_;
@@ -263,15 +347,28 @@ protected:
   /** \brief mutex for synchronization of setting/calling transform_callback_ */
   mutable boost::mutex transform_callback_mutex_;
 
-  /** \brief indicates whether the filtering loop should stop*/
-  bool stop_;
-
   /** \brief first pass renderer for rendering the mesh*/
   GLRendererPtr mesh_renderer_;
 
   /** \brief second pass renderer for filtering the results of first pass*/
   GLRendererPtr depth_filter_;
 
+  /** \brief optional third pass that turns the filtered pixels into octree keys; created on first use*/
+  mutable GLRendererPtr key_renderer_;
+
+  /** \brief number of images submitted with filterAsync(); protected by async_mutex_*/
+  mutable unsigned int async_generation_;
+
+  /** \brief keeps the generations of filterAsync() in the order of the jobs*/
+  mutable boost::mutex async_mutex_;
+
+  /** \brief two sets of pixel buffers for the labels and the depth of the last images filtered with filterAsync()*/
+  mutable GLuint readback_buffers_[2][2];
+
+  /** \brief the image each set of pixel buffers holds, and the size of its buffers in bytes*/
+  mutable unsigned int readback_generation_[2];
+  mutable std::size_t readback_size_[2];
+
   /** \brief canvas element (screen-filling quad) for second pass*/
   GLuint canvas_;
 
@@ -292,6 +389,9 @@ protected:
 
   /** \brief threshold for shadowed pixels vs. filtered pixels*/
   float shadow_threshold_;
+
+  /** \brief cell size for decimating meshes when they are added; 0 if meshes are rendered at full resolution*/
+  double mesh_decimation_cell_size_;
 };
 }  // namespace mesh_filter
 
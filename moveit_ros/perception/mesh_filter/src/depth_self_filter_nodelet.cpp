@@ -43,12 +43,29 @@
 #include <moveit/robot_model_loader/robot_model_loader.h>
 #include <moveit/robot_model/robot_model.h>
 #include <eigen3/Eigen/Eigen>
-#include <cv_bridge/cv_bridge.h>
 
 namespace enc = sensor_msgs::image_encodings;
 using namespace std;
 using namespace boost;
 
+namespace
+{
+// a new message for every published image, since subscribers in the same nodelet manager share it with us
+sensor_msgs::ImagePtr createImage(const sensor_msgs::Image& depth_msg, const std::string& encoding,
+                                  unsigned int bytes_per_pixel)
+{
+  sensor_msgs::ImagePtr image(new sensor_msgs::Image);
+  image->header = depth_msg.header;
+  image->width = depth_msg.width;
+  image->height = depth_msg.height;
+  image->encoding = encoding;
+  image->is_bigendian = depth_msg.is_bigendian;
+  image->step = depth_msg.width * bytes_per_pixel;
+  image->data.resize(image->step * image->height);
+  return image;
+}
+}
+
 mesh_filter::DepthSelfFiltering::~DepthSelfFiltering()
 {
 }
@@ -88,11 +105,6 @@ void mesh_filter::DepthSelfFiltering::onInit()
   pub_model_label_image_ =
       model_depth_transport_->advertiseCamera("/model/label", queue_size_, itssc, itssc, rssc, rssc);
 
-  filtered_depth_ptr_.reset(new cv_bridge::CvImage);
-  filtered_label_ptr_.reset(new cv_bridge::CvImage);
-  model_depth_ptr_.reset(new cv_bridge::CvImage);
-  model_label_ptr_.reset(new cv_bridge::CvImage);
-
   mesh_filter_.reset(
       new MeshFilter<StereoCameraModel>(bind(&TransformProvider::getTransform, &transform_provider_, _1, _2),
                                         mesh_filter::StereoCameraModel::RegisteredPSDKParams));
@@ -114,62 +126,45 @@ void mesh_filter::DepthSelfFiltering::filter(const sensor_msgs::ImageConstPtr& d
   params.setCameraParameters(info_msg->K[0], info_msg->K[4], info_msg->K[2], info_msg->K[5]);
   params.setImageSize(depth_msg->width, depth_msg->height);
 
-  const float* src = (const float*)&depth_msg->data[0];
-  //*
-  static unsigned dataSize = 0;
-  static unsigned short* data = 0;
-  if (dataSize < depth_msg->width * depth_msg->height)
-    data = new unsigned short[depth_msg->width * depth_msg->height];
-  for (unsigned idx = 0; idx < depth_msg->width * depth_msg->height; ++idx)
-    data[idx] = (unsigned short)(src[idx] * 1000.0);
-
-  mesh_filter_->filter(data, GL_UNSIGNED_SHORT);
-  // delete[] data;
-  /*/
-  mesh_filter_->filter ((void*) &depth_msg->data[0], GL_FLOAT);
-  //*/
-  if (pub_filtered_depth_image_.getNumSubscribers() > 0)
+  // the filter reads the depth straight from the message, and the results are written straight into the published
+  // messages; within a nodelet manager, subscribers get these buffers without serialization or any further copy
+  if (depth_msg->encoding == enc::TYPE_16UC1)
+    mesh_filter_->filter(&depth_msg->data[0], GL_UNSIGNED_SHORT, true);
+  else if (depth_msg->encoding == enc::TYPE_32FC1)
+    mesh_filter_->filter(&depth_msg->data[0], GL_FLOAT, true);
+  else
   {
-    filtered_depth_ptr_->encoding = sensor_msgs::image_encodings::TYPE_32FC1;
-    filtered_depth_ptr_->header = depth_msg->header;
+    NODELET_ERROR_THROTTLE(1, "Unexpected encoding type: '%s'. Ignoring input.", depth_msg->encoding.c_str());
+    return;
+  }
 
-    if (filtered_depth_ptr_->image.cols != depth_msg->width || filtered_depth_ptr_->image.rows != depth_msg->height)
-      filtered_depth_ptr_->image = cv::Mat(depth_msg->height, depth_msg->width, CV_32FC1);
-    mesh_filter_->getFilteredDepth((float*)filtered_depth_ptr_->image.data);
-    pub_filtered_depth_image_.publish(filtered_depth_ptr_->toImageMsg(), info_msg);
+  if (pub_filtered_depth_image_.getNumSubscribers() > 0)
+  {
+    sensor_msgs::ImagePtr filtered_depth = createImage(*depth_msg, enc::TYPE_32FC1, sizeof(float));
+    mesh_filter_->getFilteredDepth(reinterpret_cast<float*>(&filtered_depth->data[0]));
+    pub_filtered_depth_image_.publish(filtered_depth, info_msg);
   }
 
   // this is from rendering of the model
   if (pub_model_depth_image_.getNumSubscribers() > 0)
   {
-    model_depth_ptr_->encoding = sensor_msgs::image_encodings::TYPE_32FC1;
-    model_depth_ptr_->header = depth_msg->header;
-
-    if (model_depth_ptr_->image.cols != depth_msg->width || model_depth_ptr_->image.rows != depth_msg->height)
-      model_depth_ptr_->image = cv::Mat(depth_msg->height, depth_msg->width, CV_32FC1);
-    mesh_filter_->getModelDepth((float*)model_depth_ptr_->image.data);
-    pub_model_depth_image_.publish(model_depth_ptr_->toImageMsg(), info_msg);
+    sensor_msgs::ImagePtr model_depth = createImage(*depth_msg, enc::TYPE_32FC1, sizeof(float));
+    mesh_filter_->getModelDepth(reinterpret_cast<float*>(&model_depth->data[0]));
+    pub_model_depth_image_.publish(model_depth, info_msg);
   }
 
   if (pub_filtered_label_image_.getNumSubscribers() > 0)
   {
-    filtered_label_ptr_->encoding = sensor_msgs::image_encodings::RGBA8;
-    filtered_label_ptr_->header = depth_msg->header;
-
-    if (filtered_label_ptr_->image.cols != depth_msg->width || filtered_label_ptr_->image.rows != depth_msg->height)
-      filtered_label_ptr_->image = cv::Mat(depth_msg->height, depth_msg->width, CV_8UC4);
-    mesh_filter_->getFilteredLabels((unsigned int*)filtered_label_ptr_->image.data);
-    pub_filtered_label_image_.publish(filtered_label_ptr_->toImageMsg(), info_msg);
+    sensor_msgs::ImagePtr filtered_labels = createImage(*depth_msg, enc::RGBA8, sizeof(LabelType));
+    mesh_filter_->getFilteredLabels(reinterpret_cast<LabelType*>(&filtered_labels->data[0]));
+    pub_filtered_label_image_.publish(filtered_labels, info_msg);
   }
 
   if (pub_model_label_image_.getNumSubscribers() > 0)
   {
-    model_label_ptr_->encoding = sensor_msgs::image_encodings::RGBA8;
-    model_label_ptr_->header = depth_msg->header;
-    if (model_label_ptr_->image.cols != depth_msg->width || model_label_ptr_->image.rows != depth_msg->height)
-      model_label_ptr_->image = cv::Mat(depth_msg->height, depth_msg->width, CV_8UC4);
-    mesh_filter_->getModelLabels((unsigned int*)model_label_ptr_->image.data);
-    pub_model_label_image_.publish(model_label_ptr_->toImageMsg(), info_msg);
+    sensor_msgs::ImagePtr model_labels = createImage(*depth_msg, enc::RGBA8, sizeof(LabelType));
+    mesh_filter_->getModelLabels(reinterpret_cast<LabelType*>(&model_labels->data[0]));
+    pub_model_label_image_.publish(model_labels, info_msg);
   }
 }
 
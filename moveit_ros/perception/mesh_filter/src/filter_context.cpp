@@ -0,0 +1,146 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/mesh_filter/filter_context.h>
+#include <moveit/mesh_filter/filter_job.h>
+#include <moveit/mesh_filter/gl_mesh.h>
+#include <moveit/utils/thread_groups.h>
+#include <geometric_shapes/shapes.h>
+
+namespace
+{
+// FNV-1a over the raw bytes of the vertex and index arrays
+uint64_t hashBytes(const void* data, std::size_t size, uint64_t hash)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+}
+
+bool mesh_filter::FilterContext::MeshKey::operator<(const MeshKey& other) const
+{
+  if (hash_ != other.hash_)
+    return hash_ < other.hash_;
+  if (vertex_count_ != other.vertex_count_)
+    return vertex_count_ < other.vertex_count_;
+  if (triangle_count_ != other.triangle_count_)
+    return triangle_count_ < other.triangle_count_;
+  if (mesh_label_ != other.mesh_label_)
+    return mesh_label_ < other.mesh_label_;
+  return decimation_cell_size_ < other.decimation_cell_size_;
+}
+
+mesh_filter::FilterContext::FilterContext() : stop_(false), shared_mesh_count_(0)
+{
+  thread_ = boost::thread(boost::bind(&FilterContext::run, this));
+}
+
+mesh_filter::FilterContext::~FilterContext()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
+    stop_ = true;
+    while (!jobs_queue_.empty())
+    {
+      jobs_queue_.front()->cancel();
+      jobs_queue_.pop();
+    }
+  }
+  jobs_condition_.notify_one();
+  thread_.join();
+}
+
+void mesh_filter::FilterContext::addJob(const JobPtr& job) const
+{
+  {
+    boost::unique_lock<boost::mutex> _(jobs_mutex_);
+    jobs_queue_.push(job);
+  }
+  jobs_condition_.notify_one();
+}
+
+mesh_filter::GLMeshPtr mesh_filter::FilterContext::getMesh(const shapes::Mesh& mesh, unsigned int mesh_label,
+                                                           double decimation_cell_size)
+{
+  MeshKey key;
+  key.hash_ = hashBytes(mesh.vertices, 3 * mesh.vertex_count * sizeof(double), 14695981039346656037ULL);
+  key.hash_ = hashBytes(mesh.triangles, 3 * mesh.triangle_count * sizeof(unsigned int), key.hash_);
+  key.vertex_count_ = mesh.vertex_count;
+  key.triangle_count_ = mesh.triangle_count;
+  key.mesh_label_ = mesh_label;
+  key.decimation_cell_size_ = decimation_cell_size;
+
+  std::weak_ptr<GLMesh>& entry = meshes_[key];
+  GLMeshPtr gl_mesh = entry.lock();
+  if (gl_mesh)
+  {
+    ++shared_mesh_count_;
+    return gl_mesh;
+  }
+
+  // forget the meshes no filter uses anymore before adding a new one
+  for (std::map<MeshKey, std::weak_ptr<GLMesh> >::iterator it = meshes_.begin(); it != meshes_.end();)
+    if (it->second.expired() && &it->second != &entry)
+      meshes_.erase(it++);
+    else
+      ++it;
+
+  gl_mesh.reset(new GLMesh(mesh, mesh_label, decimation_cell_size));
+  entry = gl_mesh;
+  return gl_mesh;
+}
+
+void mesh_filter::FilterContext::run()
+{
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PERCEPTION);
+  while (true)
+  {
+    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
+    // wait until we get notified about a new job or the destruction of the context
+    while (jobs_queue_.empty() && !stop_)
+      jobs_condition_.wait(lock);
+    if (stop_)
+      break;
+
+    JobPtr job = jobs_queue_.front();
+    jobs_queue_.pop();
+    lock.unlock();
+    job->execute();
+  }
+}
@@ -37,55 +37,164 @@
 #include <moveit/mesh_filter/gl_mesh.h>
 #include <geometric_shapes/shapes.h>
 #include <stdexcept>
+#include <map>
+#include <cmath>
 #include <Eigen/Eigen>
 
 using namespace std;
 using namespace Eigen;
 using shapes::Mesh;
 
-mesh_filter::GLMesh::GLMesh(const Mesh& mesh, unsigned int mesh_label)
+namespace
+{
+// number of floats per vertex in the vertex buffer: position followed by normal
+const int VERTEX_STRIDE = 6;
+
+struct CellKey
+{
+  int x, y, z;
+  bool operator<(const CellKey& other) const
+  {
+    if (x != other.x)
+      return x < other.x;
+    if (y != other.y)
+      return y < other.y;
+    return z < other.z;
+  }
+};
+
+// merges all vertices within the same cell of a cubic grid into their mean (vertex clustering)
+// and drops the triangles that collapse.
+void decimateMesh(const Mesh& mesh, double cell_size, vector<float>& vertices, vector<GLuint>& indices)
+{
+  map<CellKey, GLuint> clusters;
+  vector<GLuint> cluster_of_vertex(mesh.vertex_count);
+  vector<unsigned int> cluster_size;
+  const double inv_cell_size = 1.0 / cell_size;
+  for (unsigned int v = 0; v < mesh.vertex_count; ++v)
+  {
+    const double* p = &mesh.vertices[3 * v];
+    const double* n = &mesh.vertex_normals[3 * v];
+    CellKey key = { (int)floor(p[0] * inv_cell_size), (int)floor(p[1] * inv_cell_size),
+                    (int)floor(p[2] * inv_cell_size) };
+    map<CellKey, GLuint>::iterator it = clusters.insert(make_pair(key, (GLuint)cluster_size.size())).first;
+    if (it->second == cluster_size.size())
+    {
+      cluster_size.push_back(0);
+      vertices.resize(vertices.size() + VERTEX_STRIDE, 0.0f);
+    }
+    float* c = &vertices[VERTEX_STRIDE * it->second];
+    for (int i = 0; i < 3; ++i)
+    {
+      c[i] += p[i];
+      c[i + 3] += n[i];
+    }
+    ++cluster_size[it->second];
+    cluster_of_vertex[v] = it->second;
+  }
+
+  for (std::size_t c = 0; c < cluster_size.size(); ++c)
+  {
+    Map<Vector3f> position(&vertices[VERTEX_STRIDE * c]);
+    Map<Vector3f> normal(&vertices[VERTEX_STRIDE * c + 3]);
+    position /= cluster_size[c];
+    // opposite normals may cancel out; the shader needs a valid direction to apply the padding
+    if (normal.squaredNorm() < 1e-12)
+      normal = Vector3f::UnitZ();
+    normal.normalize();
+  }
+
+  indices.reserve(3 * mesh.triangle_count);
+  for (unsigned int t = 0; t < mesh.triangle_count; ++t)
+  {
+    GLuint v1 = cluster_of_vertex[mesh.triangles[3 * t]];
+    GLuint v2 = cluster_of_vertex[mesh.triangles[3 * t + 1]];
+    GLuint v3 = cluster_of_vertex[mesh.triangles[3 * t + 2]];
+    if (v1 == v2 || v2 == v3 || v1 == v3)
+      continue;
+    indices.push_back(v1);
+    indices.push_back(v2);
+    indices.push_back(v3);
+  }
+}
+}  // namespace
+
+mesh_filter::GLMesh::GLMesh(const Mesh& mesh, unsigned int mesh_label, double decimation_cell_size)
 {
   if (!mesh.vertex_normals)
     throw std::runtime_error("Vertex normals are not computed for input mesh. Call computeVertexNormals() before "
                              "passing as input to mesh_filter.");
 
   mesh_label_ = mesh_label;
-  list_ = glGenLists(1);
-  glNewList(list_, GL_COMPILE);
-  glBegin(GL_TRIANGLES);
-  glColor4ubv((GLubyte*)&mesh_label_);
-  for (unsigned tIdx = 0; tIdx < mesh.triangle_count; ++tIdx)
-  {
-    unsigned v1 = 3 * mesh.triangles[3 * tIdx];
-    unsigned v2 = 3 * mesh.triangles[3 * tIdx + 1];
-    unsigned v3 = 3 * mesh.triangles[3 * tIdx + 2];
 
-    glNormal3f(mesh.vertex_normals[v1], mesh.vertex_normals[v1 + 1], mesh.vertex_normals[v1 + 2]);
-    glVertex3f(mesh.vertices[v1], mesh.vertices[v1 + 1], mesh.vertices[v1 + 2]);
+  vector<float> vertices;
+  vector<GLuint> indices;
+  if (decimation_cell_size > 0.0)
+    decimateMesh(mesh, decimation_cell_size, vertices, indices);
+  else
+  {
+    vertices.resize(VERTEX_STRIDE * mesh.vertex_count);
+    for (unsigned int v = 0; v < mesh.vertex_count; ++v)
+      for (int i = 0; i < 3; ++i)
+      {
+        vertices[VERTEX_STRIDE * v + i] = mesh.vertices[3 * v + i];
+        vertices[VERTEX_STRIDE * v + i + 3] = mesh.vertex_normals[3 * v + i];
+      }
+    indices.assign(mesh.triangles, mesh.triangles + 3 * mesh.triangle_count);
+  }
+  index_count_ = indices.size();
 
-    glNormal3f(mesh.vertex_normals[v2], mesh.vertex_normals[v2 + 1], mesh.vertex_normals[v2 + 2]);
-    glVertex3f(mesh.vertices[v2], mesh.vertices[v2 + 1], mesh.vertices[v2 + 2]);
+  // upload the mesh once; every frame only binds the buffers and issues a single draw call
+  glGenBuffers(1, &vertex_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.empty() ? NULL : &vertices[0],
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    glNormal3f(mesh.vertex_normals[v3], mesh.vertex_normals[v3 + 1], mesh.vertex_normals[v3 + 2]);
-    glVertex3f(mesh.vertices[v3], mesh.vertices[v3 + 1], mesh.vertices[v3 + 2]);
-  }
-  glEnd();
-  glEndList();
+  glGenBuffers(1, &index_buffer_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0],
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 mesh_filter::GLMesh::~GLMesh()
 {
-  glDeleteLists(list_, 1);
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
 }
 
-void mesh_filter::GLMesh::render(const Affine3d& transform) const
+void mesh_filter::GLMesh::beginBatch()
 {
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
   glMatrixMode(GL_MODELVIEW);
+}
+
+void mesh_filter::GLMesh::endBatch()
+{
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void mesh_filter::GLMesh::render(const Affine3d& transform) const
+{
+  if (index_count_ == 0)
+    return;
+
   glPushMatrix();
   if (!(transform.matrix().Flags & RowMajorBit))
     glMultMatrixd(transform.matrix().data());
   else
     glMultTransposeMatrixd(transform.matrix().data());
-  glCallList(list_);
+
+  glColor4ubv((GLubyte*)&mesh_label_);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glVertexPointer(3, GL_FLOAT, VERTEX_STRIDE * sizeof(float), (const GLvoid*)0);
+  glNormalPointer(GL_FLOAT, VERTEX_STRIDE * sizeof(float), (const GLvoid*)(3 * sizeof(float)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glDrawElements(GL_TRIANGLES, index_count_, GL_UNSIGNED_INT, (const GLvoid*)0);
   glPopMatrix();
 }
@@ -53,12 +53,13 @@
 
 using namespace std;
 
-mesh_filter::GLRenderer::GLRenderer(unsigned width, unsigned height, float near, float far)
+mesh_filter::GLRenderer::GLRenderer(unsigned width, unsigned height, float near, float far, GLint color_format)
   : width_(width)
   , height_(height)
   , fbo_id_(0)
   , rbo_id_(0)
   , rgb_id_(0)
+  , color_format_(color_format)
   , depth_id_(0)
   , program_(0)
   , near_(near)
@@ -130,7 +131,7 @@ void mesh_filter::GLRenderer::initFrameBuffers()
 {
   glGenTextures(1, &rgb_id_);
   glBindTexture(GL_TEXTURE_2D, rgb_id_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width_, height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexImage2D(GL_TEXTURE_2D, 0, color_format_, width_, height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -214,6 +215,14 @@ void mesh_filter::GLRenderer::getColorBuffer(unsigned char* buffer) const
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void mesh_filter::GLRenderer::getColorBuffer16(unsigned short* buffer) const
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_id_);
+  glBindTexture(GL_TEXTURE_2D, rgb_id_);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_SHORT, buffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void mesh_filter::GLRenderer::getDepthBuffer(float* buffer) const
 {
   glBindFramebuffer(GL_FRAMEBUFFER, fbo_id_);
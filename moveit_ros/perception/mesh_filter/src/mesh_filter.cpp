@@ -320,9 +320,11 @@ void mesh_filter::MeshFilter::filter(const float* sensor_data, unsigned width, u
   glUniform3f(padding_coefficients_id, padding_coefficients_[0], padding_coefficients_[1], padding_coefficients_[2]);
 
   Affine3d transform;
+  GLMesh::beginBatch();
   for (map<unsigned int, GLMesh*>::const_iterator meshIt = meshes_.begin(); meshIt != meshes_.end(); ++meshIt)
     if (transform_callback_(meshIt->first, transform))
       meshIt->second->render(transform);
+  GLMesh::endBatch();
 
   mesh_renderer_.end();
 
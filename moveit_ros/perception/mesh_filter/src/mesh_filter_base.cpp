@@ -43,10 +43,48 @@
 #include <Eigen/Eigen>
 #include <stdexcept>
 #include <sstream>
+#include <cstring>
+#include <cmath>
 #include <sensor_msgs/image_encodings.h>
 
 #include <ros/console.h>
 
+namespace
+{
+// back-projects every pixel of the sensor depth texture, transforms it into the octree frame and quantizes it to a
+// key; the labels of the filter pass decide whether the cell is occupied or belongs to the model
+const std::string KEY_VERTEX_SHADER_SOURCE = "#version 120\n"
+                                             "void main ()"
+                                             "{"
+                                             "  gl_TexCoord[0] = gl_MultiTexCoord0;"
+                                             "  gl_Position = gl_Vertex;"
+                                             "  gl_Position.w = 1.0;"
+                                             "}";
+
+const std::string KEY_FRAGMENT_SHADER_SOURCE =
+    "#version 120\n"
+    "uniform sampler2D sensor;"
+    "uniform sampler2D label;"
+    "uniform float near;"
+    "uniform float far;"
+    "uniform vec4 camera;"
+    "uniform mat4 map_H_sensor;"
+    "uniform float inv_resolution;"
+    "uniform float key_offset;"
+    "void main()"
+    "{"
+    "  vec4 l = floor(texture2D(label, gl_TexCoord[0].st) * 255.0 + 0.5);"
+    "  float label_value = l.r + 256.0 * l.g + 65536.0 * l.b;"
+    "  float cell_class = label_value == 0.0 ? 1.0 : (label_value >= 3.0 ? 2.0 : 0.0);"
+    "  float z = near + float(texture2D(sensor, gl_TexCoord[0].st)) * (far - near);"
+    "  vec2 pixel = gl_FragCoord.xy - vec2(0.5);"
+    "  vec4 point = map_H_sensor * vec4((pixel.x - camera.z) * z / camera.x,"
+    "                                   (pixel.y - camera.w) * z / camera.y, z, 1.0);"
+    "  vec3 key = clamp(floor(point.xyz * inv_resolution) + key_offset, 0.0, 65535.0);"
+    "  gl_FragColor = vec4(key, cell_class) / 65535.0;"
+    "}";
+}
+
 // include SSE headers
 #ifdef HAVE_SSE_EXTENSIONS
 #include <xmmintrin.h>
@@ -57,18 +95,23 @@ mesh_filter::MeshFilterBase::MeshFilterBase(const TransformCallback& transform_c
                                             const std::string& render_vertex_shader,
                                             const std::string& render_fragment_shader,
                                             const std::string& filter_vertex_shader,
-                                            const std::string& filter_fragment_shader)
+                                            const std::string& filter_fragment_shader,
+                                            const FilterContextPtr& context)
   : sensor_parameters_(sensor_parameters.clone())
   , next_handle_(FirstLabel)  // 0 and 1 are reserved!
   , min_handle_(FirstLabel)
-  , stop_(false)
+  , context_(context ? context : FilterContextPtr(new FilterContext()))
+  , async_generation_(0)
   , transform_callback_(transform_callback)
   , padding_scale_(1.0)
   , padding_offset_(0.01)
   , shadow_threshold_(0.5)
+  , mesh_decimation_cell_size_(0.0)
 {
-  filter_thread_ = boost::thread(boost::bind(&MeshFilterBase::run, this, render_vertex_shader, render_fragment_shader,
-                                             filter_vertex_shader, filter_fragment_shader));
+  // the shaders are copied into the job, the constructor does not wait for the renderers to be set up
+  JobPtr job(new FilterJob<void>(boost::bind(&MeshFilterBase::initialize, this, render_vertex_shader,
+                                             render_fragment_shader, filter_vertex_shader, filter_fragment_shader)));
+  addJob(job);
 }
 
 void mesh_filter::MeshFilterBase::initialize(const std::string& render_vertex_shader,
@@ -98,6 +141,10 @@ void mesh_filter::MeshFilterBase::initialize(const std::string& render_vertex_sh
 
   depth_filter_->end();
 
+  glGenBuffers(4, &readback_buffers_[0][0]);
+  readback_generation_[0] = readback_generation_[1] = 0;
+  readback_size_[0] = readback_size_[1] = 0;
+
   canvas_ = glGenLists(1);
   glNewList(canvas_, GL_COMPILE);
   glBegin(GL_QUADS);
@@ -121,36 +168,27 @@ void mesh_filter::MeshFilterBase::initialize(const std::string& render_vertex_sh
 
 mesh_filter::MeshFilterBase::~MeshFilterBase()
 {
-  {
-    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
-    stop_ = true;
-    while (!jobs_queue_.empty())
-    {
-      jobs_queue_.front()->cancel();
-      jobs_queue_.pop();
-    }
-  }
-  jobs_condition_.notify_one();
-  filter_thread_.join();
+  // the GL objects of this filter have to be released in the context thread, which may outlive this filter
+  JobPtr job(new FilterJob<void>(boost::bind(&MeshFilterBase::deInitialize, this)));
+  addJob(job);
+  job->wait();
 }
 
 void mesh_filter::MeshFilterBase::addJob(const JobPtr& job) const
 {
-  {
-    boost::unique_lock<boost::mutex> _(jobs_mutex_);
-    jobs_queue_.push(job);
-  }
-  jobs_condition_.notify_one();
+  context_->addJob(job);
 }
 
 void mesh_filter::MeshFilterBase::deInitialize()
 {
   glDeleteLists(canvas_, 1);
   glDeleteTextures(1, &sensor_depth_texture_);
+  glDeleteBuffers(4, &readback_buffers_[0][0]);
 
   meshes_.clear();
   mesh_renderer_.reset();
   depth_filter_.reset();
+  key_renderer_.reset();
 }
 
 void mesh_filter::MeshFilterBase::setSize(unsigned int width, unsigned int height)
@@ -189,7 +227,7 @@ mesh_filter::MeshHandle mesh_filter::MeshFilterBase::addMesh(const shapes::Mesh&
 
 void mesh_filter::MeshFilterBase::addMeshHelper(MeshHandle handle, const shapes::Mesh* cmesh)
 {
-  meshes_[handle] = GLMeshPtr(new GLMesh(*cmesh, handle));
+  meshes_[handle] = context_->getMesh(*cmesh, handle, mesh_decimation_cell_size_);
 }
 
 void mesh_filter::MeshFilterBase::removeMesh(MeshHandle handle)
@@ -216,6 +254,12 @@ void mesh_filter::MeshFilterBase::setShadowThreshold(float threshold)
   shadow_threshold_ = threshold;
 }
 
+void mesh_filter::MeshFilterBase::setMeshDecimationCellSize(double cell_size)
+{
+  boost::mutex::scoped_lock _(meshes_mutex_);
+  mesh_decimation_cell_size_ = cell_size;
+}
+
 void mesh_filter::MeshFilterBase::getModelLabels(LabelType* labels) const
 {
   JobPtr job(
@@ -229,12 +273,8 @@ void mesh_filter::MeshFilterBase::getModelDepth(float* depth) const
   JobPtr job1(new FilterJob<void>(boost::bind(&GLRenderer::getDepthBuffer, mesh_renderer_.get(), depth)));
   JobPtr job2(new FilterJob<void>(
       boost::bind(&SensorModel::Parameters::transformModelDepthToMetricDepth, sensor_parameters_.get(), depth)));
-  {
-    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
-    jobs_queue_.push(job1);
-    jobs_queue_.push(job2);
-  }
-  jobs_condition_.notify_one();
+  addJob(job1);
+  addJob(job2);
   job1->wait();
   job2->wait();
 }
@@ -244,48 +284,73 @@ void mesh_filter::MeshFilterBase::getFilteredDepth(float* depth) const
   JobPtr job1(new FilterJob<void>(boost::bind(&GLRenderer::getDepthBuffer, depth_filter_.get(), depth)));
   JobPtr job2(new FilterJob<void>(
       boost::bind(&SensorModel::Parameters::transformFilteredDepthToMetricDepth, sensor_parameters_.get(), depth)));
-  {
-    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
-    jobs_queue_.push(job1);
-    jobs_queue_.push(job2);
-  }
-  jobs_condition_.notify_one();
+  addJob(job1);
+  addJob(job2);
   job1->wait();
   job2->wait();
 }
 
-void mesh_filter::MeshFilterBase::getFilteredLabels(LabelType* labels) const
+void mesh_filter::MeshFilterBase::getFilteredKeys(const Eigen::Affine3d& map_H_sensor, float fx, float fy, float cx,
+                                                  float cy, double resolution, unsigned int key_offset,
+                                                  unsigned short* keys) const
 {
-  JobPtr job(
-      new FilterJob<void>(boost::bind(&GLRenderer::getColorBuffer, depth_filter_.get(), (unsigned char*)labels)));
+  // the transform is passed by reference, which is safe since we wait for the job
+  JobPtr job(new FilterJob<void>(boost::bind(&MeshFilterBase::doComputeKeys, this, boost::cref(map_H_sensor), fx, fy,
+                                             cx, cy, resolution, key_offset, keys)));
   addJob(job);
   job->wait();
 }
 
-void mesh_filter::MeshFilterBase::run(const std::string& render_vertex_shader,
-                                      const std::string& render_fragment_shader,
-                                      const std::string& filter_vertex_shader,
-                                      const std::string& filter_fragment_shader)
+void mesh_filter::MeshFilterBase::doComputeKeys(const Eigen::Affine3d& map_H_sensor, float fx, float fy, float cx,
+                                                float cy, double resolution, unsigned int key_offset,
+                                                unsigned short* keys) const
 {
-  initialize(render_vertex_shader, render_fragment_shader, filter_vertex_shader, filter_fragment_shader);
-
-  while (!stop_)
+  const unsigned width = sensor_parameters_->getWidth();
+  const unsigned height = sensor_parameters_->getHeight();
+  if (!key_renderer_)
   {
-    boost::unique_lock<boost::mutex> lock(jobs_mutex_);
-    // check if we have new sensor data to be processed. If not, wait until we get notified.
-    if (jobs_queue_.empty())
-      jobs_condition_.wait(lock);
-
-    if (!jobs_queue_.empty())
-    {
-      JobPtr job = jobs_queue_.front();
-      jobs_queue_.pop();
-      lock.unlock();
-      job->execute();
-      lock.lock();
-    }
+    // 16 bits per channel hold a full octree key component
+    key_renderer_.reset(new GLRenderer(width, height, sensor_parameters_->getNearClippingPlaneDistance(),
+                                       sensor_parameters_->getFarClippingPlaneDistance(), GL_RGBA16));
+    key_renderer_->setShadersFromString(KEY_VERTEX_SHADER_SOURCE, KEY_FRAGMENT_SHADER_SOURCE);
   }
-  deInitialize();
+  key_renderer_->setBufferSize(width, height);
+
+  key_renderer_->begin();
+  const GLuint program = key_renderer_->getProgramID();
+  glUniform1i(glGetUniformLocation(program, "sensor"), 0);
+  glUniform1i(glGetUniformLocation(program, "label"), 4);
+  glUniform1f(glGetUniformLocation(program, "near"), sensor_parameters_->getNearClippingPlaneDistance());
+  glUniform1f(glGetUniformLocation(program, "far"), sensor_parameters_->getFarClippingPlaneDistance());
+  glUniform4f(glGetUniformLocation(program, "camera"), fx, fy, cx, cy);
+  Eigen::Matrix4f matrix = map_H_sensor.matrix().cast<float>();
+  glUniformMatrix4fv(glGetUniformLocation(program, "map_H_sensor"), 1, GL_FALSE, matrix.data());
+  glUniform1f(glGetUniformLocation(program, "inv_resolution"), 1.0 / resolution);
+  glUniform1f(glGetUniformLocation(program, "key_offset"), key_offset);
+
+  glEnable(GL_TEXTURE_2D);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_ALPHA_TEST);
+  glDisable(GL_BLEND);
+
+  // the sensor depth of the last filtered image, and the labels the filter pass assigned to it
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, sensor_depth_texture_);
+  glActiveTexture(GL_TEXTURE4);
+  glBindTexture(GL_TEXTURE_2D, depth_filter_->getColorTexture());
+  glCallList(canvas_);
+  key_renderer_->end();
+
+  key_renderer_->getColorBuffer16(keys);
+}
+
+void mesh_filter::MeshFilterBase::getFilteredLabels(LabelType* labels) const
+{
+  JobPtr job(
+      new FilterJob<void>(boost::bind(&GLRenderer::getColorBuffer, depth_filter_.get(), (unsigned char*)labels)));
+  addJob(job);
+  job->wait();
 }
 
 void mesh_filter::MeshFilterBase::filter(const void* sensor_data, GLushort type, bool wait) const
@@ -303,6 +368,94 @@ void mesh_filter::MeshFilterBase::filter(const void* sensor_data, GLushort type,
     job->wait();
 }
 
+mesh_filter::AsyncFilterResultPtr mesh_filter::MeshFilterBase::filterAsync(const void* sensor_data, GLushort type) const
+{
+  if (type != GL_FLOAT && type != GL_UNSIGNED_SHORT)
+  {
+    std::stringstream msg;
+    msg << "unknown type \"" << type << "\". Allowed values are GL_FLOAT or GL_UNSIGNED_SHORT.";
+    throw std::runtime_error(msg.str());
+  }
+
+  unsigned int generation;
+  JobPtr job;
+  {
+    // generations are assigned in the order of the queue, so they match the order the images are filtered in
+    boost::unique_lock<boost::mutex> _(async_mutex_);
+    generation = ++async_generation_;
+    job.reset(
+        new FilterJob<void>(boost::bind(&MeshFilterBase::doFilterAsync, this, sensor_data, (int)type, generation)));
+    addJob(job);
+  }
+  return AsyncFilterResultPtr(new AsyncFilterResult(this, job, generation));
+}
+
+void mesh_filter::MeshFilterBase::doFilterAsync(const void* sensor_data, const int encoding,
+                                                unsigned int generation) const
+{
+  doFilter(sensor_data, encoding);
+
+  // start copying the results into the pixel buffers of this generation; glGetTexImage() returns immediately when a
+  // pixel pack buffer is bound, so rendering the next image can overlap with this transfer
+  const unsigned int slot = generation & 1;
+  const std::size_t size = sensor_parameters_->getWidth() * sensor_parameters_->getHeight() * sizeof(float);
+  for (int i = 0; i < 2; ++i)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers_[slot][i]);
+    if (readback_size_[slot] != size)
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    if (i == 0)
+      depth_filter_->getColorBuffer(NULL);
+    else
+      depth_filter_->getDepthBuffer(NULL);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback_size_[slot] = size;
+  readback_generation_[slot] = generation;
+}
+
+bool mesh_filter::MeshFilterBase::readAsyncResult(unsigned int generation, LabelType* labels, float* depth) const
+{
+  const unsigned int slot = generation & 1;
+  if (readback_generation_[slot] != generation)
+    return false;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers_[slot][labels ? 0 : 1]);
+  const void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (data)
+  {
+    memcpy(labels ? static_cast<void*>(labels) : static_cast<void*>(depth), data, readback_size_[slot]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  if (data && depth)
+    sensor_parameters_->transformFilteredDepthToMetricDepth(depth);
+  return data != NULL;
+}
+
+void mesh_filter::AsyncFilterResult::wait() const
+{
+  job_->wait();
+}
+
+bool mesh_filter::AsyncFilterResult::getFilteredLabels(LabelType* labels) const
+{
+  FilterJob<bool>* reader =
+      new FilterJob<bool>(boost::bind(&MeshFilterBase::readAsyncResult, filter_, generation_, labels, (float*)NULL));
+  JobPtr job(reader);
+  filter_->addJob(job);
+  return reader->getResult();
+}
+
+bool mesh_filter::AsyncFilterResult::getFilteredDepth(float* depth) const
+{
+  FilterJob<bool>* reader =
+      new FilterJob<bool>(boost::bind(&MeshFilterBase::readAsyncResult, filter_, generation_, (LabelType*)NULL, depth));
+  JobPtr job(reader);
+  filter_->addJob(job);
+  return reader->getResult();
+}
+
 void mesh_filter::MeshFilterBase::doFilter(const void* sensor_data, const int encoding) const
 {
   boost::mutex::scoped_lock _(transform_callback_mutex_);
@@ -319,14 +472,18 @@ void mesh_filter::MeshFilterBase::doFilter(const void* sensor_data, const int en
   glDisable(GL_BLEND);
 
   GLuint padding_coefficients_id = glGetUniformLocation(mesh_renderer_->getProgramID(), "padding_coefficients");
-  Eigen::Vector3f padding_coefficients =
-      sensor_parameters_->getPaddingCoefficients() * padding_scale_ + Eigen::Vector3f(0, 0, padding_offset_);
+  // decimated meshes deviate from the originals by at most half a cell diagonal
+  const float decimation_padding = 0.5 * std::sqrt(3.0) * mesh_decimation_cell_size_;
+  Eigen::Vector3f padding_coefficients = sensor_parameters_->getPaddingCoefficients() * padding_scale_ +
+                                         Eigen::Vector3f(0, 0, padding_offset_ + decimation_padding);
   glUniform3f(padding_coefficients_id, padding_coefficients[0], padding_coefficients[1], padding_coefficients[2]);
 
   Eigen::Affine3d transform;
+  GLMesh::beginBatch();
   for (std::map<MeshHandle, GLMeshPtr>::const_iterator meshIt = meshes_.begin(); meshIt != meshes_.end(); ++meshIt)
     if (transform_callback_(meshIt->first, transform))
       meshIt->second->render(transform);
+  GLMesh::endBatch();
 
   mesh_renderer_->end();
 
@@ -316,6 +316,49 @@ TEST_P(MeshFilterTestUnsignedShort, unsigned_short)
 }
 INSTANTIATE_TEST_CASE_P(ushort_test, MeshFilterTestUnsignedShort, ::testing::Range<double>(0.0f, 6.0f, 0.5f));
 
+namespace
+{
+bool placeMeshAt(double z, MeshHandle, Affine3d& transform)
+{
+  transform = Affine3d::Identity();
+  transform.translation() = Vector3d(0, 0, z);
+  return true;
+}
+}
+
+TEST(MeshFilterContext, sharedMeshes)
+{
+  const unsigned int width = 64;
+  const unsigned int height = 48;
+  StereoCameraModel::Parameters parameters(width, height, 0.5, 5.0, width >> 1, height >> 1, width >> 1, height >> 1,
+                                           0.1, 0.1);
+  // the same plane seen by two cameras whose filters share one context
+  MeshFilter<StereoCameraModel> filter1(boost::bind(&placeMeshAt, 1.0, _1, _2), parameters);
+  MeshFilter<StereoCameraModel> filter2(boost::bind(&placeMeshAt, 1.0, _1, _2), parameters, filter1.getContext());
+  EXPECT_EQ(filter1.getContext(), filter2.getContext());
+
+  // both sides of a plane, since the filter culls front faces
+  shapes::Mesh mesh(4, 4);
+  const double vertices[] = { -5, -5, 0, -5, 5, 0, 5, 5, 0, 5, -5, 0 };
+  const unsigned int triangles[] = { 0, 3, 2, 0, 2, 1, 0, 2, 3, 0, 1, 2 };
+  std::copy(vertices, vertices + 12, mesh.vertices);
+  std::copy(triangles, triangles + 12, mesh.triangles);
+  mesh.computeVertexNormals();
+  filter1.addMesh(mesh);
+  filter2.addMesh(mesh);
+  EXPECT_EQ(1u, filter1.getContext()->getSharedMeshCount());
+
+  // every pixel is seen just behind the plane, so it is filtered out by both filters
+  vector<float> sensor_data(width * height, 1.05);
+  filter1.filter(&sensor_data[0], GL_FLOAT);
+  filter2.filter(&sensor_data[0], GL_FLOAT);
+  vector<unsigned int> labels1(width * height), labels2(width * height);
+  filter1.getFilteredLabels(&labels1[0]);
+  filter2.getFilteredLabels(&labels2[0]);
+  EXPECT_EQ(labels1, labels2);
+  EXPECT_EQ((unsigned int)MeshFilterBase::FirstLabel, labels1[(height / 2) * width + width / 2]);
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);
@@ -37,10 +37,15 @@
 #ifndef MOVEIT_OCCUPANCY_MAP_MONITOR_OCCUPANCY_MAP_
 #define MOVEIT_OCCUPANCY_MAP_MONITOR_OCCUPANCY_MAP_
 
+#include <moveit/occupancy_map_monitor/octree_key_set.h>
 #include <octomap/octomap.h>
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/function.hpp>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace occupancy_map_monitor
 {
@@ -49,11 +54,31 @@ typedef octomap::OcTreeNode OccMapNode;
 class OccMapTree : public octomap::OcTree
 {
 public:
-  OccMapTree(double resolution) : octomap::OcTree(resolution)
+  OccMapTree(double resolution)
+    : octomap::OcTree(resolution)
+    , all_changed_(false)
+    , snapshots_enabled_(false)
+    , stamps_enabled_(false)
+    , decay_cursor_(0)
   {
   }
 
-  OccMapTree(const std::string& filename) : octomap::OcTree(filename)
+  OccMapTree(const std::string& filename)
+    : octomap::OcTree(filename)
+    , all_changed_(false)
+    , snapshots_enabled_(false)
+    , stamps_enabled_(false)
+    , decay_cursor_(0)
+  {
+  }
+
+  /** @brief Construct a tree holding a copy of the nodes of \e tree */
+  explicit OccMapTree(const octomap::OcTree& tree)
+    : octomap::OcTree(tree)
+    , all_changed_(false)
+    , snapshots_enabled_(false)
+    , stamps_enabled_(false)
+    , decay_cursor_(0)
   {
   }
 
@@ -98,19 +123,234 @@ public:
 
   void triggerUpdateCallback(void)
   {
+    if (snapshots_enabled_)
+      publishSnapshot();
     if (update_callback_)
       update_callback_();
   }
 
+  /** @brief Publish an immutable copy of the tree whenever triggerUpdateCallback() is called. Readers of the snapshot
+   *  never wait for the updaters, which write to this tree; in return, the snapshot is copied once per update */
+  void setSnapshotsEnabled(bool flag)
+  {
+    snapshots_enabled_ = flag;
+    if (flag)
+      publishSnapshot();
+    else
+      std::atomic_store(&snapshot_, std::shared_ptr<const OccMapTree>());
+  }
+
+  bool isSnapshotsEnabled() const
+  {
+    return snapshots_enabled_;
+  }
+
+  /** @brief Replace the snapshot by a copy of the current tree. The tree is read-locked while it is copied, so this
+   *  must not be called with the lock held */
+  void publishSnapshot()
+  {
+    std::shared_ptr<const OccMapTree> snapshot;
+    {
+      ReadLock lock(tree_mutex_);
+      snapshot.reset(new OccMapTree(static_cast<const octomap::OcTree&>(*this)));
+    }
+    std::atomic_store(&snapshot_, snapshot);
+  }
+
+  /** @brief The snapshot published last; it is never modified and can be read without locking. Empty unless
+   *  snapshots are enabled */
+  std::shared_ptr<const OccMapTree> getSnapshot() const
+  {
+    return std::atomic_load(&snapshot_);
+  }
+
   /** @brief Set the callback to trigger when updates are received */
   void setUpdateCallback(const boost::function<void()>& update_callback)
   {
     update_callback_ = update_callback;
   }
 
+  /** @brief Set the log-odds of the node at \e depth that contains \e key, making it a leaf. Unlike setNodeValue(),
+   *  this restores pruned leaves without expanding them. The inner nodes are not updated; call updateInnerOccupancy()
+   *  after setting all leaves */
+  void setLeafLogOdds(const octomap::OcTreeKey& key, unsigned int depth, float log_odds)
+  {
+    bool node_just_created = false;
+    if (!root)
+    {
+      root = new OccMapNode();
+      ++tree_size;
+      node_just_created = true;
+    }
+    OccMapNode* node = root;
+    for (unsigned int d = 0; d < depth && d < tree_depth; ++d)
+    {
+      const unsigned int pos = octomap::computeChildIdx(key, tree_depth - 1 - d);
+      bool created_node = false;
+      if (!nodeChildExists(node, pos))
+      {
+        // a pruned leaf on the way is split, so its other children keep its value
+        if (!nodeHasChildren(node) && !node_just_created)
+          expandNode(node);
+        else
+        {
+          createNodeChild(node, pos);
+          created_node = true;
+        }
+      }
+      node_just_created = created_node;
+      node = getNodeChild(node, pos);
+    }
+    if (nodeHasChildren(node))
+      for (unsigned int i = 0; i < 8; ++i)
+        if (nodeChildExists(node, i))
+          deleteNodeChild(node, i);
+    node->setLogOdds(log_odds);
+    size_changed = true;
+  }
+
+  /** @brief Record that the subtree at \e depth that contains \e key changed in a way change detection does not see,
+   *  e.g. because it was deleted. Has no effect unless change detection is enabled */
+  void markChanged(const octomap::OcTreeKey& key, unsigned int depth)
+  {
+    if (use_change_detection)
+      changed_regions_.push_back(std::make_pair(key, depth));
+  }
+
+  /** @brief Record that the tree was replaced as a whole, e.g. by clearing or loading it, so its changes can not be
+   *  described by changed regions */
+  void markAllChanged()
+  {
+    all_changed_ = true;
+  }
+
+  /** @brief Check whether markAllChanged() was called since the changes were last reset */
+  bool isAllChanged() const
+  {
+    return all_changed_;
+  }
+
+  /** @brief Get the subtrees recorded by markChanged(), as pairs of a key and a depth */
+  const std::vector<std::pair<octomap::OcTreeKey, unsigned int> >& getChangedRegions() const
+  {
+    return changed_regions_;
+  }
+
+  /** @brief Forget all changes recorded so far, including the keys recorded by change detection */
+  void resetChanges()
+  {
+    resetChangeDetection();
+    changed_regions_.clear();
+    all_changed_ = false;
+  }
+
+  using octomap::OcTree::updateNode;
+
+  /** @brief Update the log-odds of the leaf at \e key and, if observation stamps are enabled and the update is a hit,
+   *  record that the leaf was observed occupied now. All the other updateNode() overloads end up here */
+  virtual OccMapNode* updateNode(const octomap::OcTreeKey& key, float log_odds_update, bool lazy_eval = false)
+  {
+    if (stamps_enabled_ && log_odds_update > 0.0f)
+      observation_stamps_[key] = getCurrentStamp();
+    return octomap::OcTree::updateNode(key, log_odds_update, lazy_eval);
+  }
+
+  /** @brief Delete all nodes and the observation stamps */
+  void clear()
+  {
+    octomap::OcTree::clear();
+    observation_stamps_.clear();
+    decay_cursor_ = 0;
+  }
+
+  /** @brief Record when each leaf was last observed occupied, so that decayObservations() can delete the occupied
+   *  leaves that were not observed for a while. Only leaves observed after enabling this can decay. Call this with
+   *  the tree locked for writing */
+  void setObservationStampsEnabled(bool flag)
+  {
+    stamps_enabled_ = flag;
+    if (!flag)
+      observation_stamps_.clear();
+    decay_cursor_ = 0;
+  }
+
+  bool isObservationStampsEnabled() const
+  {
+    return stamps_enabled_;
+  }
+
+  /** @brief The current time in the unit of observation stamps, tenths of a second of a monotonic clock */
+  static uint32_t getCurrentStamp()
+  {
+    return std::chrono::duration_cast<std::chrono::duration<uint32_t, std::deci> >(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /** @brief Delete the occupied leaves that were last observed more than \e max_age stamps before \e now, making
+   *  them unknown again. Only \e max_scanned stamps are checked per call; the next call continues where this one
+   *  stopped, so a map of any size decays in short slices. The stamps are scanned with the tree locked for reading
+   *  and only the expired leaves are deleted with the tree locked for writing, so the updaters are barely delayed.
+   *  Deleted leaves are recorded with markChanged(); the caller triggers the update callback. Returns the number of
+   *  deleted leaves. Must not be called concurrently with itself */
+  std::size_t decayObservations(uint32_t now, uint32_t max_age, std::size_t max_scanned)
+  {
+    std::vector<octomap::OcTreeKey> expired;
+    {
+      ReadLock lock(tree_mutex_);
+      ObservationStamps::const_iterator it = observation_stamps_.beginAt(decay_cursor_);
+      for (std::size_t i = 0; i < max_scanned && it != observation_stamps_.end(); ++i, ++it)
+        if (isExpired(it->second, now, max_age))
+          expired.push_back(it->first);
+      decay_cursor_ = it != observation_stamps_.end() ? it.getSlot() : 0;
+    }
+    if (expired.empty())
+      return 0;
+
+    std::size_t deleted = 0;
+    WriteLock lock(tree_mutex_);
+    for (std::size_t i = 0; i < expired.size(); ++i)
+    {
+      // the leaf may have been observed again since it was scanned
+      ObservationStamps::const_iterator stamp = observation_stamps_.find(expired[i]);
+      if (stamp == observation_stamps_.end() || !isExpired(stamp->second, now, max_age))
+        continue;
+      observation_stamps_.erase(expired[i]);
+      OccMapNode* node = search(expired[i]);
+      if (node && isNodeOccupied(node))
+      {
+        deleteNode(expired[i], tree_depth);
+        markChanged(expired[i], tree_depth);
+        ++deleted;
+      }
+    }
+    return deleted;
+  }
+
+  /** @brief The number of leaves with an observation stamp */
+  std::size_t getObservationStampCount() const
+  {
+    return observation_stamps_.size();
+  }
+
 private:
+  typedef OcTreeKeyMap<uint32_t> ObservationStamps;
+
+  static bool isExpired(uint32_t stamp, uint32_t now, uint32_t max_age)
+  {
+    // stamps taken after now are not expired; the difference is signed to keep them apart from old stamps
+    return static_cast<int32_t>(now - stamp) > static_cast<int32_t>(max_age);
+  }
+
   boost::shared_mutex tree_mutex_;
   boost::function<void()> update_callback_;
+  std::vector<std::pair<octomap::OcTreeKey, unsigned int> > changed_regions_;
+  bool all_changed_;
+  std::atomic<bool> snapshots_enabled_;
+  std::shared_ptr<const OccMapTree> snapshot_;
+  bool stamps_enabled_;
+  ObservationStamps observation_stamps_;
+  std::size_t decay_cursor_;
 };
 
 typedef std::shared_ptr<OccMapTree> OccMapTreePtr;
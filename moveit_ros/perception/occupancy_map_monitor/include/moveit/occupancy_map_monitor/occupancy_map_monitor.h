@@ -47,6 +47,7 @@
 #include <moveit_msgs/LoadMap.h>
 #include <moveit/occupancy_map_monitor/occupancy_map.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_updater.h>
+#include <moveit/occupancy_map_monitor/octree_integrator.h>
 
 #include <boost/thread/mutex.hpp>
 
@@ -84,6 +85,13 @@ public:
     return tree_const_;
   }
 
+  /** @brief The thread that writes the cells of all updaters to the octree, if the octomap_integration_thread
+   *  parameter is set. Empty if every updater writes its cells itself */
+  const OcTreeIntegratorPtr& getIntegrator() const
+  {
+    return integrator_;
+  }
+
   const std::string& getMapFrame() const
   {
     return map_frame_;
@@ -124,9 +132,45 @@ public:
     return active_;
   }
 
+  /** @brief Keep only the cells of the octree within an axis-aligned box of \e size, centered at the origin of \e
+   *  frame. Cells that leave the box are removed periodically while the monitor is active. An empty frame keeps the
+   *  whole map */
+  void setRollingWindow(const std::string& frame, const Eigen::Vector3d& size);
+
+  const std::string& getRollingWindowFrame() const
+  {
+    return rolling_window_frame_;
+  }
+
+  /** @brief Write cells that leave the rolling window to files in \e directory, and load them again when the window
+   *  covers them. An empty directory discards the cells */
+  void setRollingWindowArchiveDirectory(const std::string& directory);
+
+  /** @brief Save the octree to \e filename. Files with the OcTreeSnapshot::FILE_EXTENSION are written as compressed
+   *  snapshots, for which the tree is only locked while its leaves are copied; other files use the octomap binary
+   *  format */
+  bool saveMap(const std::string& filename);
+
+  /** @brief Replace the octree by the map in \e filename. If a load region is set, only the part of a snapshot file
+   *  within that region is loaded */
+  bool loadMap(const std::string& filename);
+
+  /** @brief Restrict loading snapshot files to the box from \e min to \e max (in the map frame). A box with \e min
+   *  not below \e max loads whole files */
+  void setLoadRegion(const octomap::point3d& min, const octomap::point3d& max);
+
 private:
   void initialize();
 
+  void rollingWindowTimerCallback(const ros::WallTimerEvent& event);
+
+  /** @brief Delete one slice of the occupied cells that were not observed for decay_time_ */
+  void decayTimerCallback(const ros::WallTimerEvent& event);
+
+  /** @brief Remove the cells outside the rolling window centered at \e center, archiving them if requested, and load
+   *  archived cells inside it */
+  void updateRollingWindow(const octomap::point3d& center);
+
   /** @brief Save the current octree to a binary file */
   bool saveMapCallback(moveit_msgs::SaveMap::Request& request, moveit_msgs::SaveMap::Response& response);
 
@@ -143,6 +187,7 @@ private:
 
   OccMapTreePtr tree_;
   OccMapTreeConstPtr tree_const_;
+  OcTreeIntegratorPtr integrator_;  // destroyed after the updaters that push to it
 
   std::unique_ptr<pluginlib::ClassLoader<OccupancyMapUpdater> > updater_plugin_loader_;
   std::vector<OccupancyMapUpdaterPtr> map_updaters_;
@@ -158,6 +203,23 @@ private:
   ros::ServiceServer load_map_srv_;
 
   bool active_;
+
+  std::string rolling_window_frame_;
+  Eigen::Vector3d rolling_window_size_;
+  double rolling_window_period_;
+  std::string rolling_window_archive_directory_;
+  ros::WallTimer rolling_window_timer_;
+  octomap::point3d last_archive_load_center_;
+  bool archive_loaded_;
+
+  double decay_time_;
+  double decay_period_;
+  int decay_batch_size_;
+  ros::WallTimer decay_timer_;
+
+  bool use_load_region_;
+  octomap::point3d load_region_min_;
+  octomap::point3d load_region_max_;
 };
 }
 
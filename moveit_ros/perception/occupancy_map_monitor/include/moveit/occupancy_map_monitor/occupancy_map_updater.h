@@ -39,6 +39,7 @@
 
 #include <moveit/macros/class_forward.h>
 #include <moveit/occupancy_map_monitor/occupancy_map.h>
+#include <moveit/profiler/metrics.h>
 #include <geometric_shapes/shapes.h>
 #include <boost/shared_ptr.hpp>
 #include <Eigen/Core>
@@ -55,6 +56,22 @@ typedef boost::function<bool(const std::string& target_frame, const ros::Time& t
 
 class OccupancyMapMonitor;
 
+/** \brief The histograms of the stages sensor messages go through on their way into the occupancy map. They are shared
+    by all updaters, so their sums show where the perception pipeline spends its time. */
+struct UpdaterStageMetrics
+{
+  /** \brief Looking up the pose of the sensor and the transforms of the robot links */
+  moveit::tools::MetricHistogram& transform;
+  /** \brief Masking out the points or pixels that are on the robot */
+  moveit::tools::MetricHistogram& self_filter;
+  /** \brief Computing the occupied and free cells */
+  moveit::tools::MetricHistogram& ray_casting;
+  /** \brief Writing the cells into the octree, under its write lock */
+  moveit::tools::MetricHistogram& tree_write;
+
+  static const UpdaterStageMetrics& instance();
+};
+
 MOVEIT_CLASS_FORWARD(OccupancyMapUpdater);
 
 /** \brief Base class for classes which update the occupancy map.
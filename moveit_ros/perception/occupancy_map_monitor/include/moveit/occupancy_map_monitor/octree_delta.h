@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_DELTA_
+#define MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_DELTA_
+
+#include <moveit/occupancy_map_monitor/occupancy_map.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace occupancy_map_monitor
+{
+/** @brief The regions of an octree that changed since its changes were last reset, with the free / occupied state
+ *  of their leaves.
+ *
+ *  A peer that holds the state of the tree at the last reset obtains the current state by applying the delta.
+ *  Changes are collected per subtree of 2^REGION_SHIFT cells along each axis, so a delta is a small fraction of the
+ *  whole map as long as sensors only update parts of it. Serialized deltas are compressed with zlib. */
+class OcTreeDelta
+{
+public:
+  /** @brief The id of octomap messages that carry a serialized delta instead of a tree */
+  static const std::string OCTOMAP_ID;
+
+  /** @brief Changed cells are sent as part of the subtree this many levels above the leaves that contains them */
+  static const unsigned int REGION_SHIFT = 4;
+
+  OcTreeDelta();
+
+  /** @brief Collect the changes recorded by \e tree, which needs change detection enabled. The caller needs to hold
+   *  at least a read lock on the tree. Changes recorded by OccMapTree::markAllChanged() are not included */
+  explicit OcTreeDelta(const OccMapTree& tree);
+
+  /** @brief Write the compressed delta to \e data */
+  void serialize(std::vector<int8_t>& data) const;
+
+  /** @brief Read a delta written by serialize() */
+  bool deserialize(const std::vector<int8_t>& data);
+
+  /** @brief Replace the contents of the changed regions of \e tree. The caller needs to hold a write lock on the tree
+   *  if it is shared */
+  void apply(OccMapTree& tree) const;
+
+  std::size_t getRegionCount() const
+  {
+    return regions_.size();
+  }
+
+  std::size_t getLeafCount() const
+  {
+    return leaves_.size();
+  }
+
+private:
+  struct Region
+  {
+    octomap::OcTreeKey key;
+    uint8_t depth;
+  };
+
+  struct Leaf
+  {
+    octomap::OcTreeKey key;
+    uint8_t depth;
+    bool occupied;
+  };
+
+  std::vector<Region> regions_;
+  std::vector<Leaf> leaves_;
+};
+}
+
+#endif
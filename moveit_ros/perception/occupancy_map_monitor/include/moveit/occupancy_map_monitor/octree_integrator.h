@@ -0,0 +1,104 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_INTEGRATOR_
+#define MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_INTEGRATOR_
+
+#include <moveit/occupancy_map_monitor/occupancy_map.h>
+#include <moveit/occupancy_map_monitor/octree_key_set.h>
+#include <boost/thread.hpp>
+#include <memory>
+#include <vector>
+
+namespace occupancy_map_monitor
+{
+/** @brief Applies the cell updates of several updaters to an octree from a single thread.
+ *
+ *  Updaters queue the cells of each sensor message as a batch of log-odds changes and return right away. The
+ *  integration thread takes all batches queued since its last cycle, sums the changes of cells that appear in more
+ *  than one of them, and writes the sums to the tree under one write lock. The inner nodes are updated and the tree is
+ *  pruned once per cycle instead of once per cell, and the update callback of the tree is triggered once per cycle. */
+class OcTreeIntegrator
+{
+public:
+  /** @brief Start the integration thread for \e tree */
+  explicit OcTreeIntegrator(const OccMapTreePtr& tree);
+
+  /** @brief Integrate the batches that are still queued and stop the thread */
+  ~OcTreeIntegrator();
+
+  /** @brief Queue the cells of one sensor message: \e free_cells are updated as misses, \e occupied_cells as hits
+   *  and \e model_cells are set to the minimum log-odds */
+  void push(const OcTreeKeySet& free_cells, const OcTreeKeySet& occupied_cells, const OcTreeKeySet& model_cells);
+
+  /** @brief Wait until all batches queued so far were written to the tree */
+  void flush();
+
+  /** @brief Number of cycles the thread ran, and number of batches it integrated */
+  std::size_t getCycleCount() const;
+  std::size_t getBatchCount() const;
+
+private:
+  typedef OcTreeKeyMap<float> Batch;
+
+  void run();
+
+  /** @brief Write the batches in \e batches to the tree and recycle them */
+  void integrate(std::vector<std::unique_ptr<Batch> >& batches);
+
+  OccMapTreePtr tree_;
+
+  mutable boost::mutex queue_lock_;
+  boost::condition_variable queue_condition_;
+  boost::condition_variable flush_condition_;
+  std::vector<std::unique_ptr<Batch> > queue_;
+
+  /** @brief Batches that were integrated, kept to reuse their storage */
+  std::vector<std::unique_ptr<Batch> > unused_;
+
+  /** @brief Sums of the changes of one cycle; only used by the integration thread */
+  Batch merged_;
+
+  bool integrating_;
+  bool stop_;
+  std::size_t cycle_count_;
+  std::size_t batch_count_;
+
+  boost::thread thread_;
+};
+
+typedef std::shared_ptr<OcTreeIntegrator> OcTreeIntegratorPtr;
+}
+
+#endif
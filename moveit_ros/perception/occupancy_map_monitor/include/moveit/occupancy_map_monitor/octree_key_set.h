@@ -0,0 +1,367 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_KEY_SET_
+#define MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_KEY_SET_
+
+#include <octomap/OcTreeKey.h>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace occupancy_map_monitor
+{
+namespace detail
+{
+inline const octomap::OcTreeKey& keyOf(const octomap::OcTreeKey& slot)
+{
+  return slot;
+}
+
+template <typename T>
+inline const octomap::OcTreeKey& keyOf(const std::pair<octomap::OcTreeKey, T>& slot)
+{
+  return slot.first;
+}
+
+/** \brief Open addressing hash table of octree keys with linear probing.
+
+    All slots live in one array, so inserting a key does not allocate unless the table grows, and clear() keeps
+    the capacity for the next use. Iterators are invalidated by insertion and erasure. */
+template <typename Slot>
+class OcTreeKeyTable
+{
+public:
+  template <typename SlotRef, typename TablePtr>
+  class Iterator : public std::iterator<std::forward_iterator_tag, Slot, std::ptrdiff_t, Slot*, SlotRef>
+  {
+  public:
+    Iterator() : table_(NULL), index_(0)
+    {
+    }
+
+    Iterator(TablePtr table, std::size_t index) : table_(table), index_(index)
+    {
+      skipUnused();
+    }
+
+    /** \brief Allow conversion from iterator to const_iterator */
+    template <typename OtherRef, typename OtherPtr>
+    Iterator(const Iterator<OtherRef, OtherPtr>& other) : table_(other.table_), index_(other.index_)
+    {
+    }
+
+    SlotRef operator*() const
+    {
+      return table_->slots_[index_];
+    }
+
+    typename std::remove_reference<SlotRef>::type* operator->() const
+    {
+      return &table_->slots_[index_];
+    }
+
+    Iterator& operator++()
+    {
+      ++index_;
+      skipUnused();
+      return *this;
+    }
+
+    Iterator operator++(int)
+    {
+      Iterator it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const Iterator& other) const
+    {
+      return index_ == other.index_;
+    }
+
+    /** \brief The slot the iterator points to, to resume a scan with OcTreeKeyTable::beginAt() */
+    std::size_t getSlot() const
+    {
+      return index_;
+    }
+
+    bool operator!=(const Iterator& other) const
+    {
+      return index_ != other.index_;
+    }
+
+  private:
+    template <typename OtherRef, typename OtherPtr>
+    friend class Iterator;
+
+    void skipUnused()
+    {
+      while (index_ < table_->used_.size() && !table_->used_[index_])
+        ++index_;
+    }
+
+    TablePtr table_;
+    std::size_t index_;
+  };
+
+  typedef Iterator<Slot&, OcTreeKeyTable*> iterator;
+  typedef Iterator<const Slot&, const OcTreeKeyTable*> const_iterator;
+
+  OcTreeKeyTable() : size_(0), shift_(64)
+  {
+  }
+
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+  bool empty() const
+  {
+    return size_ == 0;
+  }
+
+  /** \brief The number of keys the table can hold before it needs to grow */
+  std::size_t capacity() const
+  {
+    return slots_.size() / 2;
+  }
+
+  iterator begin()
+  {
+    return iterator(this, 0);
+  }
+
+  iterator end()
+  {
+    return iterator(this, slots_.size());
+  }
+
+  const_iterator begin() const
+  {
+    return const_iterator(this, 0);
+  }
+
+  /** \brief Iterator to the first element stored at or after \e slot. Scans of large tables can be split up and
+      resumed with the slot of the iterator they stopped at; elements inserted or erased in between may be missed */
+  const_iterator beginAt(std::size_t slot) const
+  {
+    return const_iterator(this, std::min(slot, slots_.size()));
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(this, slots_.size());
+  }
+
+  /** \brief Remove all keys, keeping the allocated slots */
+  void clear()
+  {
+    if (size_ > 0)
+      std::fill(used_.begin(), used_.end(), 0);
+    size_ = 0;
+  }
+
+  /** \brief Make room for \e count keys without further allocation */
+  void reserve(std::size_t count)
+  {
+    if (count > capacity())
+      rehash(count);
+  }
+
+  iterator find(const octomap::OcTreeKey& key)
+  {
+    return iterator(this, findIndex(key));
+  }
+
+  const_iterator find(const octomap::OcTreeKey& key) const
+  {
+    return const_iterator(this, findIndex(key));
+  }
+
+  std::size_t count(const octomap::OcTreeKey& key) const
+  {
+    return findIndex(key) < slots_.size() ? 1 : 0;
+  }
+
+  /** \brief Remove \e key; returns the number of removed keys */
+  std::size_t erase(const octomap::OcTreeKey& key)
+  {
+    std::size_t i = findIndex(key);
+    if (i >= slots_.size())
+      return 0;
+
+    // shift the following keys of the probe sequence back, so lookups never need tombstones
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t j = (i + 1) & mask; used_[j]; j = (j + 1) & mask)
+    {
+      std::size_t home = homeIndex(keyOf(slots_[j]));
+      if (((j > i) && (home <= i || home > j)) || ((j < i) && (home <= i && home > j)))
+      {
+        slots_[i] = slots_[j];
+        i = j;
+      }
+    }
+    used_[i] = 0;
+    --size_;
+    return 1;
+  }
+
+  void swap(OcTreeKeyTable& other)
+  {
+    slots_.swap(other.slots_);
+    used_.swap(other.used_);
+    std::swap(size_, other.size_);
+    std::swap(shift_, other.shift_);
+  }
+
+protected:
+  /** \brief Find the slot of \e key, or of the free slot it would be inserted in; the bool is true if the key was
+   * added */
+  std::pair<std::size_t, bool> insertIndex(const octomap::OcTreeKey& key)
+  {
+    if (size_ + 1 > capacity())
+      rehash(size_ + 1);
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = homeIndex(key);; i = (i + 1) & mask)
+    {
+      if (!used_[i])
+      {
+        used_[i] = 1;
+        ++size_;
+        return std::make_pair(i, true);
+      }
+      if (keyOf(slots_[i]) == key)
+        return std::make_pair(i, false);
+    }
+  }
+
+  std::vector<Slot> slots_;
+
+private:
+  std::size_t homeIndex(const octomap::OcTreeKey& key) const
+  {
+    // Fibonacci hashing of the packed key; the high bits of the product are well mixed
+    uint64_t packed = static_cast<uint64_t>(key.k[0]) | (static_cast<uint64_t>(key.k[1]) << 16) |
+                      (static_cast<uint64_t>(key.k[2]) << 32);
+    return static_cast<std::size_t>((packed * 0x9E3779B97F4A7C15ULL) >> shift_);
+  }
+
+  std::size_t findIndex(const octomap::OcTreeKey& key) const
+  {
+    if (size_ == 0)
+      return slots_.size();
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = homeIndex(key); used_[i]; i = (i + 1) & mask)
+      if (keyOf(slots_[i]) == key)
+        return i;
+    return slots_.size();
+  }
+
+  void rehash(std::size_t count)
+  {
+    // keep the load factor at most 1/2
+    std::size_t slot_count = 16;
+    unsigned int shift = 60;
+    while (slot_count < 2 * count)
+    {
+      slot_count *= 2;
+      --shift;
+    }
+
+    std::vector<Slot> old_slots(slot_count);
+    std::vector<unsigned char> old_used(slot_count, 0);
+    old_slots.swap(slots_);
+    old_used.swap(used_);
+    shift_ = shift;
+    size_ = 0;
+    for (std::size_t i = 0; i < old_slots.size(); ++i)
+      if (old_used[i])
+        slots_[insertIndex(keyOf(old_slots[i])).first] = old_slots[i];
+  }
+
+  std::vector<unsigned char> used_;
+  std::size_t size_;
+  unsigned int shift_;
+};
+}
+
+/** \brief A set of octree keys that can replace octomap::KeySet in the updaters. It allocates its slots in one
+    array and reuses them after clear() */
+class OcTreeKeySet : public detail::OcTreeKeyTable<octomap::OcTreeKey>
+{
+public:
+  typedef octomap::OcTreeKey value_type;
+
+  std::pair<iterator, bool> insert(const octomap::OcTreeKey& key)
+  {
+    std::pair<std::size_t, bool> r = insertIndex(key);
+    if (r.second)
+      slots_[r.first] = key;
+    return std::make_pair(iterator(this, r.first), r.second);
+  }
+
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last)
+  {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+};
+
+/** \brief A map from octree keys to values of type \e T, with the same storage as OcTreeKeySet */
+template <typename T>
+class OcTreeKeyMap : public detail::OcTreeKeyTable<std::pair<octomap::OcTreeKey, T> >
+{
+public:
+  typedef detail::OcTreeKeyTable<std::pair<octomap::OcTreeKey, T> > Base;
+  typedef std::pair<octomap::OcTreeKey, T> value_type;
+
+  /** \brief Access the value of \e key, inserting a value-initialized one if the key is not in the map */
+  T& operator[](const octomap::OcTreeKey& key)
+  {
+    std::pair<std::size_t, bool> r = this->insertIndex(key);
+    if (r.second)
+      this->slots_[r.first] = value_type(key, T());
+    return this->slots_[r.first].second;
+  }
+};
+}
+
+#endif
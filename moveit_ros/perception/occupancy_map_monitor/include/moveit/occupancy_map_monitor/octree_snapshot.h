@@ -0,0 +1,105 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_SNAPSHOT_
+#define MOVEIT_OCCUPANCY_MAP_MONITOR_OCTREE_SNAPSHOT_
+
+#include <moveit/occupancy_map_monitor/occupancy_map.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace occupancy_map_monitor
+{
+/** @brief A copy of the leaves of an octree that can be written and read without holding a lock on the tree.
+ *
+ *  Snapshot files split the leaves into chunks, one per subtree of 2^CHUNK_SHIFT cells along each axis, and compress
+ *  each chunk with zlib. Files are memory mapped when reading, and only the chunks overlapping a region of interest
+ *  need to be decompressed. Values are stored in host byte order. */
+class OcTreeSnapshot
+{
+public:
+  /** @brief The file name extension that identifies snapshot files */
+  static const std::string FILE_EXTENSION;
+
+  /** @brief Subtrees of this many levels above the leaves are stored as separate chunks */
+  static const unsigned int CHUNK_SHIFT = 6;
+
+  OcTreeSnapshot();
+
+  /** @brief Copy the leaves of \e tree. The caller needs to hold at least a read lock on the tree */
+  explicit OcTreeSnapshot(const OccMapTree& tree);
+
+  /** @brief Write the snapshot to \e filename. The file is replaced only once it was written completely */
+  bool write(const std::string& filename) const;
+
+  /** @brief Read all leaves stored in \e filename */
+  bool read(const std::string& filename);
+
+  /** @brief Read the leaves stored in \e filename that overlap the box from \e bbx_min to \e bbx_max */
+  bool read(const std::string& filename, const octomap::point3d& bbx_min, const octomap::point3d& bbx_max);
+
+  /** @brief Replace the contents of \e tree by the snapshot, including its resolution. The caller needs to hold a
+   *  write lock on the tree */
+  void restore(OccMapTree& tree) const;
+
+  /** @brief Check whether \e filename names a snapshot file, judging by its extension */
+  static bool isSnapshotFile(const std::string& filename);
+
+  double getResolution() const
+  {
+    return resolution_;
+  }
+
+  std::size_t getLeafCount() const
+  {
+    return leaves_.size();
+  }
+
+private:
+  struct Leaf
+  {
+    octomap::OcTreeKey key;
+    uint8_t depth;
+    float log_odds;
+  };
+
+  bool read(const std::string& filename, const octomap::point3d* bbx_min, const octomap::point3d* bbx_max);
+
+  double resolution_;
+  std::vector<Leaf> leaves_;
+};
+}
+
+#endif
@@ -39,10 +39,65 @@
 #include <moveit_msgs/LoadMap.h>
 #include <moveit/occupancy_map_monitor/occupancy_map.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_monitor.h>
+#include <moveit/occupancy_map_monitor/octree_snapshot.h>
 #include <XmlRpcException.h>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdint.h>
 
 namespace occupancy_map_monitor
 {
+namespace
+{
+/* a leaf of the octree that left the rolling window, as stored in the archive files */
+struct ArchivedCell
+{
+  octomap::OcTreeKey key;
+  uint8_t depth;
+  float log_odds;
+};
+
+void writeArchivedCells(const std::string& filename, const std::vector<ArchivedCell>& cells, bool append)
+{
+  std::ofstream file(filename.c_str(), std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+  for (std::size_t i = 0; i < cells.size(); ++i)
+  {
+    file.write(reinterpret_cast<const char*>(&cells[i].key.k[0]), 3 * sizeof(octomap::key_type));
+    file.write(reinterpret_cast<const char*>(&cells[i].depth), sizeof(cells[i].depth));
+    file.write(reinterpret_cast<const char*>(&cells[i].log_odds), sizeof(cells[i].log_odds));
+  }
+  if (!file)
+    ROS_ERROR("Unable to write evicted octomap cells to '%s'", filename.c_str());
+}
+
+bool readArchivedCells(const std::string& filename, std::vector<ArchivedCell>& cells)
+{
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  if (!file)
+    return false;
+  ArchivedCell cell;
+  while (file.read(reinterpret_cast<char*>(&cell.key.k[0]), 3 * sizeof(octomap::key_type)) &&
+         file.read(reinterpret_cast<char*>(&cell.depth), sizeof(cell.depth)) &&
+         file.read(reinterpret_cast<char*>(&cell.log_odds), sizeof(cell.log_odds)))
+    cells.push_back(cell);
+  return true;
+}
+
+/* the archive is split in tiles of the size of the rolling window, so only a few files cover the window */
+std::string getArchiveTileName(const std::string& directory, const Eigen::Vector3d& tile_size, double x, double y,
+                               double z)
+{
+  return directory + "/octomap_" + boost::lexical_cast<std::string>((long)std::floor(x / tile_size.x())) + "_" +
+         boost::lexical_cast<std::string>((long)std::floor(y / tile_size.y())) + "_" +
+         boost::lexical_cast<std::string>((long)std::floor(z / tile_size.z())) + ".cells";
+}
+}
+
 OccupancyMapMonitor::OccupancyMapMonitor(double map_resolution)
   : map_resolution_(map_resolution), debug_info_(false), mesh_handle_count_(0), nh_("~"), active_(false)
 {
@@ -85,6 +140,69 @@ void OccupancyMapMonitor::initialize()
   tree_.reset(new OccMapTree(map_resolution_));
   tree_const_ = tree_;
 
+  // planning scenes can hold immutable copies of the tree, so collision checks never wait for the sensor updates
+  bool snapshots = false;
+  nh_.param("octomap_snapshots", snapshots, false);
+  tree_->setSnapshotsEnabled(snapshots);
+
+  // with several sensors, one thread writing all their cells avoids the updaters waiting for each other's write locks
+  bool integration_thread = false;
+  nh_.param("octomap_integration_thread", integration_thread, false);
+  if (integration_thread)
+    integrator_.reset(new OcTreeIntegrator(tree_));
+
+  // obstacles that are no longer seen, e.g. people that walked away, are forgotten after octomap_decay_time
+  nh_.param("octomap_decay_time", decay_time_, 0.0);
+  nh_.param("octomap_decay_period", decay_period_, 0.1);
+  nh_.param("octomap_decay_batch_size", decay_batch_size_, 10000);
+  if (decay_time_ > 0.0)
+    tree_->setObservationStampsEnabled(true);
+
+  rolling_window_size_ = Eigen::Vector3d(10.0, 10.0, 10.0);
+  archive_loaded_ = false;
+  nh_.param("octomap_rolling_window_period", rolling_window_period_, 1.0);
+  nh_.getParam("octomap_rolling_window_archive_directory", rolling_window_archive_directory_);
+  XmlRpc::XmlRpcValue window_size;
+  if (nh_.getParam("octomap_rolling_window_size", window_size))
+  {
+    try
+    {
+      // either the edge length of a cube or the three edge lengths of a box
+      if (window_size.getType() == XmlRpc::XmlRpcValue::TypeArray && window_size.size() == 3)
+        for (int i = 0; i < 3; ++i)
+          rolling_window_size_[i] = window_size[i].getType() == XmlRpc::XmlRpcValue::TypeInt ?
+                                        (double)(int)window_size[i] :
+                                        (double)window_size[i];
+      else if (window_size.getType() == XmlRpc::XmlRpcValue::TypeInt)
+        rolling_window_size_.setConstant((int)window_size);
+      else
+        rolling_window_size_.setConstant((double)window_size);
+    }
+    catch (XmlRpc::XmlRpcException& ex)
+    {
+      ROS_ERROR("Invalid octomap_rolling_window_size: %s", ex.getMessage().c_str());
+    }
+  }
+  nh_.getParam("octomap_rolling_window_frame", rolling_window_frame_);
+  if (!rolling_window_frame_.empty() && !tf_)
+    ROS_WARN("Rolling window frame specified but no TF instance specified. The whole octomap will be kept.");
+
+  use_load_region_ = false;
+  std::vector<double> load_region;
+  if (nh_.getParam("octomap_load_region", load_region))
+  {
+    // min x, y, z followed by max x, y, z
+    if (load_region.size() == 6)
+      setLoadRegion(octomap::point3d(load_region[0], load_region[1], load_region[2]),
+                    octomap::point3d(load_region[3], load_region[4], load_region[5]));
+    else
+      ROS_ERROR("octomap_load_region needs to list the minimum and the maximum corner of a box (6 values)");
+  }
+  std::string initial_map;
+  if (nh_.getParam("octomap_initial_map", initial_map) && !initial_map.empty())
+    if (!loadMap(initial_map))
+      ROS_ERROR("Unable to load the initial octomap from '%s'", initial_map.c_str());
+
   XmlRpc::XmlRpcValue sensor_list;
   if (nh_.getParam("sensors", sensor_list))
   {
@@ -288,39 +406,286 @@ bool OccupancyMapMonitor::getShapeTransformCache(std::size_t index, const std::s
 bool OccupancyMapMonitor::saveMapCallback(moveit_msgs::SaveMap::Request& request,
                                           moveit_msgs::SaveMap::Response& response)
 {
-  ROS_INFO("Writing map to %s", request.filename.c_str());
-  tree_->lockRead();
-  try
+  response.success = saveMap(request.filename);
+  return true;
+}
+
+bool OccupancyMapMonitor::loadMapCallback(moveit_msgs::LoadMap::Request& request,
+                                          moveit_msgs::LoadMap::Response& response)
+{
+  response.success = loadMap(request.filename);
+  return true;
+}
+
+bool OccupancyMapMonitor::saveMap(const std::string& filename)
+{
+  ROS_INFO("Writing map to %s", filename.c_str());
+  bool success = false;
+  if (OcTreeSnapshot::isSnapshotFile(filename))
   {
-    response.success = tree_->writeBinary(request.filename);
+    // only copying the leaves needs the lock; the updaters continue while the snapshot is compressed and written
+    tree_->lockRead();
+    OcTreeSnapshot snapshot(*tree_);
+    tree_->unlockRead();
+    success = snapshot.write(filename);
   }
-  catch (...)
+  else
   {
-    response.success = false;
+    tree_->lockRead();
+    try
+    {
+      success = tree_->writeBinary(filename);
+    }
+    catch (...)
+    {
+      success = false;
+    }
+    tree_->unlockRead();
   }
-  tree_->unlockRead();
-  return true;
+  return success;
 }
 
-bool OccupancyMapMonitor::loadMapCallback(moveit_msgs::LoadMap::Request& request,
-                                          moveit_msgs::LoadMap::Response& response)
+bool OccupancyMapMonitor::loadMap(const std::string& filename)
+{
+  ROS_INFO("Reading map from %s", filename.c_str());
+  bool success = false;
+  if (OcTreeSnapshot::isSnapshotFile(filename))
+  {
+    // decompress without holding the lock; only building the tree blocks the updaters
+    OcTreeSnapshot snapshot;
+    bool use_region;
+    octomap::point3d region_min, region_max;
+    {
+      boost::mutex::scoped_lock _(parameters_lock_);
+      use_region = use_load_region_;
+      region_min = load_region_min_;
+      region_max = load_region_max_;
+    }
+    if (use_region ? snapshot.read(filename, region_min, region_max) : snapshot.read(filename))
+    {
+      tree_->lockWrite();
+      snapshot.restore(*tree_);
+      tree_->markAllChanged();
+      tree_->unlockWrite();
+      ROS_DEBUG("Loaded %u octomap leaves", (unsigned int)snapshot.getLeafCount());
+      success = true;
+    }
+  }
+  else
+  {
+    /* load the octree from disk */
+    tree_->lockWrite();
+    try
+    {
+      success = tree_->readBinary(filename);
+    }
+    catch (...)
+    {
+      ROS_ERROR("Failed to load map from file");
+      success = false;
+    }
+    tree_->markAllChanged();
+    tree_->unlockWrite();
+  }
+  return success;
+}
+
+void OccupancyMapMonitor::setLoadRegion(const octomap::point3d& min, const octomap::point3d& max)
+{
+  boost::mutex::scoped_lock _(parameters_lock_);
+  use_load_region_ = min.x() < max.x() && min.y() < max.y() && min.z() < max.z();
+  load_region_min_ = min;
+  load_region_max_ = max;
+}
+
+void OccupancyMapMonitor::setRollingWindow(const std::string& frame, const Eigen::Vector3d& size)
+{
+  {
+    boost::mutex::scoped_lock _(parameters_lock_);
+    rolling_window_frame_ = frame;
+    rolling_window_size_ = size;
+    archive_loaded_ = false;
+  }
+  if (active_)
+  {
+    rolling_window_timer_.stop();
+    if (!frame.empty() && tf_)
+      rolling_window_timer_ = root_nh_.createWallTimer(ros::WallDuration(rolling_window_period_),
+                                                       &OccupancyMapMonitor::rollingWindowTimerCallback, this);
+  }
+}
+
+void OccupancyMapMonitor::setRollingWindowArchiveDirectory(const std::string& directory)
 {
-  ROS_INFO("Reading map from %s", request.filename.c_str());
+  boost::mutex::scoped_lock _(parameters_lock_);
+  rolling_window_archive_directory_ = directory;
+  archive_loaded_ = false;
+}
+
+void OccupancyMapMonitor::rollingWindowTimerCallback(const ros::WallTimerEvent& event)
+{
+  std::string map_frame, window_frame;
+  {
+    boost::mutex::scoped_lock _(parameters_lock_);
+    map_frame = map_frame_;
+    window_frame = rolling_window_frame_;
+  }
+  // the map frame is set by the first sensor message if it was not configured
+  if (map_frame.empty() || window_frame.empty())
+    return;
 
-  /* load the octree from disk */
-  tree_->lockWrite();
+  tf::StampedTransform map_H_window;
   try
   {
-    response.success = tree_->readBinary(request.filename);
+    tf_->lookupTransform(map_frame, window_frame, ros::Time(0), map_H_window);
+  }
+  catch (tf::TransformException& ex)
+  {
+    ROS_ERROR_THROTTLE(1, "Unable to locate the octomap rolling window: %s", ex.what());
+    return;
   }
-  catch (...)
+  const tf::Vector3& origin = map_H_window.getOrigin();
+  updateRollingWindow(octomap::point3d(origin.x(), origin.y(), origin.z()));
+}
+
+void OccupancyMapMonitor::updateRollingWindow(const octomap::point3d& center)
+{
+  Eigen::Vector3d size;
+  std::string archive_directory;
+  bool load_archive;
   {
-    ROS_ERROR("Failed to load map from file");
-    response.success = false;
+    boost::mutex::scoped_lock _(parameters_lock_);
+    size = rolling_window_size_;
+    archive_directory = rolling_window_archive_directory_;
+    // only look for archived cells when the window has moved by more than a cell
+    load_archive = !archive_directory.empty() &&
+                   (!archive_loaded_ || (center - last_archive_load_center_).norm() > map_resolution_);
+    if (load_archive)
+    {
+      archive_loaded_ = true;
+      last_archive_load_center_ = center;
+    }
   }
-  tree_->unlockWrite();
+  const octomap::point3d window_min(center.x() - size.x() / 2.0, center.y() - size.y() / 2.0,
+                                    center.z() - size.z() / 2.0);
+  const octomap::point3d window_max(center.x() + size.x() / 2.0, center.y() + size.y() / 2.0,
+                                    center.z() + size.z() / 2.0);
 
-  return true;
+  // find the leaves that are entirely outside the window; leaves crossing its boundary are kept
+  std::vector<ArchivedCell> evicted;
+  tree_->lockRead();
+  for (OccMapTree::leaf_iterator it = tree_->begin_leafs(), end = tree_->end_leafs(); it != end; ++it)
+  {
+    const octomap::point3d c = it.getCoordinate();
+    const double half = it.getSize() / 2.0;
+    if (c.x() + half < window_min.x() || c.x() - half > window_max.x() || c.y() + half < window_min.y() ||
+        c.y() - half > window_max.y() || c.z() + half < window_min.z() || c.z() - half > window_max.z())
+    {
+      ArchivedCell cell;
+      cell.key = it.getKey();
+      cell.depth = it.getDepth();
+      cell.log_odds = it->getLogOdds();
+      evicted.push_back(cell);
+    }
+  }
+  tree_->unlockRead();
+
+  if (!evicted.empty())
+  {
+    tree_->lockWrite();
+    for (std::size_t i = 0; i < evicted.size(); ++i)
+    {
+      tree_->deleteNode(evicted[i].key, evicted[i].depth);
+      tree_->markChanged(evicted[i].key, evicted[i].depth);
+    }
+    tree_->unlockWrite();
+    ROS_DEBUG("Removed %u octomap leaves outside the rolling window", (unsigned int)evicted.size());
+
+    if (!archive_directory.empty())
+    {
+      std::map<std::string, std::vector<ArchivedCell> > tiles;
+      for (std::size_t i = 0; i < evicted.size(); ++i)
+      {
+        const octomap::point3d c = tree_->keyToCoord(evicted[i].key, evicted[i].depth);
+        tiles[getArchiveTileName(archive_directory, size, c.x(), c.y(), c.z())].push_back(evicted[i]);
+      }
+      for (std::map<std::string, std::vector<ArchivedCell> >::const_iterator it = tiles.begin(); it != tiles.end();
+           ++it)
+        writeArchivedCells(it->first, it->second, true);
+    }
+  }
+
+  std::size_t loaded = 0;
+  if (load_archive)
+  {
+    // the window overlaps at most two tiles along each axis
+    const double xs[2] = { window_min.x(), window_max.x() };
+    const double ys[2] = { window_min.y(), window_max.y() };
+    const double zs[2] = { window_min.z(), window_max.z() };
+    std::set<std::string> tile_names;
+    for (int i = 0; i < 8; ++i)
+      tile_names.insert(getArchiveTileName(archive_directory, size, xs[i & 1], ys[(i >> 1) & 1], zs[(i >> 2) & 1]));
+
+    for (std::set<std::string>::const_iterator it = tile_names.begin(); it != tile_names.end(); ++it)
+    {
+      std::vector<ArchivedCell> cells, outside;
+      if (!readArchivedCells(*it, cells))
+        continue;
+
+      std::size_t tile_loaded = 0;
+      tree_->lockWrite();
+      const unsigned int tree_depth = tree_->getTreeDepth();
+      for (std::size_t i = 0; i < cells.size(); ++i)
+      {
+        const octomap::point3d c = tree_->keyToCoord(cells[i].key, cells[i].depth);
+        if (c.x() < window_min.x() || c.x() > window_max.x() || c.y() < window_min.y() || c.y() > window_max.y() ||
+            c.z() < window_min.z() || c.z() > window_max.z())
+        {
+          outside.push_back(cells[i]);
+          continue;
+        }
+        // pruned leaves are restored cell by cell and pruned again below
+        const unsigned int shift = tree_depth - std::min<unsigned int>(cells[i].depth, tree_depth);
+        const unsigned int count = 1u << shift;
+        octomap::OcTreeKey base;
+        for (int k = 0; k < 3; ++k)
+          base.k[k] = (cells[i].key.k[k] >> shift) << shift;
+        for (unsigned int x = 0; x < count; ++x)
+          for (unsigned int y = 0; y < count; ++y)
+            for (unsigned int z = 0; z < count; ++z)
+              tree_->setNodeValue(octomap::OcTreeKey(base.k[0] + x, base.k[1] + y, base.k[2] + z), cells[i].log_odds,
+                                  true);
+        ++tile_loaded;
+      }
+      if (tile_loaded > 0)
+      {
+        tree_->updateInnerOccupancy();
+        tree_->prune();
+      }
+      tree_->unlockWrite();
+      loaded += tile_loaded;
+
+      if (outside.size() == cells.size())
+        continue;
+      if (outside.empty())
+        std::remove(it->c_str());
+      else
+        writeArchivedCells(*it, outside, false);
+    }
+    if (loaded > 0)
+      ROS_DEBUG("Restored %u archived octomap leaves inside the rolling window", (unsigned int)loaded);
+  }
+
+  if (!evicted.empty() || loaded > 0)
+    tree_->triggerUpdateCallback();
+}
+
+void OccupancyMapMonitor::decayTimerCallback(const ros::WallTimerEvent& event)
+{
+  // stamps count tenths of a second
+  const uint32_t max_age = static_cast<uint32_t>(decay_time_ * 10.0 + 0.5);
+  if (tree_->decayObservations(OccMapTree::getCurrentStamp(), max_age, std::max(decay_batch_size_, 1)) > 0)
+    tree_->triggerUpdateCallback();
 }
 
 void OccupancyMapMonitor::startMonitor()
@@ -329,11 +694,19 @@ void OccupancyMapMonitor::startMonitor()
   /* initialize all of the occupancy map updaters */
   for (std::size_t i = 0; i < map_updaters_.size(); ++i)
     map_updaters_[i]->start();
+  if (!rolling_window_frame_.empty() && tf_)
+    rolling_window_timer_ = root_nh_.createWallTimer(ros::WallDuration(rolling_window_period_),
+                                                     &OccupancyMapMonitor::rollingWindowTimerCallback, this);
+  if (decay_time_ > 0.0)
+    decay_timer_ = root_nh_.createWallTimer(ros::WallDuration(decay_period_),
+                                            &OccupancyMapMonitor::decayTimerCallback, this);
 }
 
 void OccupancyMapMonitor::stopMonitor()
 {
   active_ = false;
+  rolling_window_timer_.stop();
+  decay_timer_.stop();
   for (std::size_t i = 0; i < map_updaters_.size(); ++i)
     map_updaters_[i]->stop();
 }
@@ -39,6 +39,18 @@
 
 namespace occupancy_map_monitor
 {
+const UpdaterStageMetrics& UpdaterStageMetrics::instance()
+{
+  moveit::tools::MetricsRegistry& registry = moveit::tools::MetricsRegistry::instance();
+  static const UpdaterStageMetrics metrics = {
+    registry.histogram("moveit_octomap_transform_seconds", "Time spent looking up the transforms of a sensor message"),
+    registry.histogram("moveit_octomap_self_filter_seconds", "Time spent masking out the robot in a sensor message"),
+    registry.histogram("moveit_octomap_ray_casting_seconds", "Time spent computing the occupied and free cells"),
+    registry.histogram("moveit_octomap_tree_write_seconds", "Time spent writing cells into the octree")
+  };
+  return metrics;
+}
+
 OccupancyMapUpdater::OccupancyMapUpdater(const std::string& type) : type_(type)
 {
 }
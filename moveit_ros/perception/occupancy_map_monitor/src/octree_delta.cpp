@@ -0,0 +1,222 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/occupancy_map_monitor/octree_delta.h>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <ros/console.h>
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+namespace occupancy_map_monitor
+{
+const std::string OcTreeDelta::OCTOMAP_ID = "OcTreeDelta";
+
+namespace
+{
+const unsigned int TREE_DEPTH = 16;
+
+template <typename T>
+void appendValue(std::string& buffer, const T& value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(const char*& data, const char* end, T& value)
+{
+  if (end - data < (std::ptrdiff_t)sizeof(T))
+    return false;
+  memcpy(&value, data, sizeof(T));
+  data += sizeof(T);
+  return true;
+}
+
+// identifies the subtree at depth that contains key; coarser subtrees sort first
+uint64_t getRegionId(const octomap::OcTreeKey& key, unsigned int depth)
+{
+  const unsigned int shift = TREE_DEPTH - depth;
+  uint64_t id = depth;
+  for (int i = 0; i < 3; ++i)
+    id = id << 16 | (shift < TREE_DEPTH ? (key.k[i] >> shift) << shift : 0);
+  return id;
+}
+}
+
+OcTreeDelta::OcTreeDelta()
+{
+}
+
+OcTreeDelta::OcTreeDelta(const OccMapTree& tree)
+{
+  const unsigned int region_depth = TREE_DEPTH - REGION_SHIFT;
+  std::set<uint64_t> ids;
+  for (octomap::KeyBoolMap::const_iterator it = tree.changedKeysBegin(), end = tree.changedKeysEnd(); it != end; ++it)
+    ids.insert(getRegionId(it->first, region_depth));
+  const std::vector<std::pair<octomap::OcTreeKey, unsigned int> >& marked = tree.getChangedRegions();
+  for (std::size_t i = 0; i < marked.size(); ++i)
+    ids.insert(getRegionId(marked[i].first, std::min(marked[i].second, region_depth)));
+
+  for (std::set<uint64_t>::const_iterator it = ids.begin(); it != ids.end(); ++it)
+  {
+    Region region;
+    region.depth = *it >> 48;
+    for (int i = 0; i < 3; ++i)
+      region.key.k[i] = *it >> (32 - 16 * i);
+
+    // regions inside a larger changed region are sent as part of that region
+    bool nested = false;
+    for (unsigned int d = 0; d < region.depth && !nested; ++d)
+      nested = ids.count(getRegionId(region.key, d)) > 0;
+    if (nested)
+      continue;
+    regions_.push_back(region);
+
+    const unsigned int extent = (1u << (TREE_DEPTH - region.depth)) - 1;
+    octomap::OcTreeKey max_key;
+    for (int i = 0; i < 3; ++i)
+      max_key.k[i] = region.key.k[i] + extent;
+    for (OccMapTree::leaf_bbx_iterator leaf = tree.begin_leafs_bbx(region.key, max_key), end = tree.end_leafs_bbx();
+         leaf != end; ++leaf)
+    {
+      // pruned leaves that are larger than the region are sent for the part inside the region only
+      Leaf l;
+      l.key = leaf.getDepth() < region.depth ? region.key : leaf.getKey();
+      l.depth = std::max<unsigned int>(leaf.getDepth(), region.depth);
+      l.occupied = tree.isNodeOccupied(*leaf);
+      leaves_.push_back(l);
+    }
+  }
+}
+
+void OcTreeDelta::serialize(std::vector<int8_t>& data) const
+{
+  std::string raw;
+  appendValue(raw, (uint32_t)regions_.size());
+  for (std::size_t i = 0; i < regions_.size(); ++i)
+  {
+    appendValue(raw, regions_[i].key.k);
+    appendValue(raw, regions_[i].depth);
+  }
+  appendValue(raw, (uint32_t)leaves_.size());
+  for (std::size_t i = 0; i < leaves_.size(); ++i)
+  {
+    appendValue(raw, leaves_[i].key.k);
+    appendValue(raw, leaves_[i].depth);
+    appendValue(raw, (uint8_t)leaves_[i].occupied);
+  }
+
+  std::string payload;
+  {
+    boost::iostreams::filtering_ostream out;
+    out.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib::best_speed));
+    out.push(boost::iostreams::back_inserter(payload));
+    out.write(raw.data(), raw.size());
+    out.reset();
+  }
+  data.assign(payload.begin(), payload.end());
+}
+
+bool OcTreeDelta::deserialize(const std::vector<int8_t>& data)
+{
+  regions_.clear();
+  leaves_.clear();
+
+  std::string raw;
+  try
+  {
+    boost::iostreams::filtering_istream in;
+    in.push(boost::iostreams::zlib_decompressor());
+    in.push(boost::iostreams::array_source(reinterpret_cast<const char*>(data.data()), data.size()));
+    boost::iostreams::copy(in, boost::iostreams::back_inserter(raw));
+  }
+  catch (std::exception& ex)
+  {
+    ROS_ERROR("Unable to decompress octree delta: %s", ex.what());
+    return false;
+  }
+
+  const char* record = raw.data();
+  const char* const end = record + raw.size();
+  uint32_t count = 0;
+  bool ok = readValue(record, end, count);
+  for (uint32_t i = 0; ok && i < count; ++i)
+  {
+    Region region;
+    ok = readValue(record, end, region.key.k) && readValue(record, end, region.depth) && region.depth <= TREE_DEPTH;
+    regions_.push_back(region);
+  }
+  ok = ok && readValue(record, end, count);
+  for (uint32_t i = 0; ok && i < count; ++i)
+  {
+    Leaf leaf;
+    uint8_t occupied = 0;
+    ok = readValue(record, end, leaf.key.k) && readValue(record, end, leaf.depth) &&
+         readValue(record, end, occupied) && leaf.depth <= TREE_DEPTH;
+    leaf.occupied = occupied != 0;
+    leaves_.push_back(leaf);
+  }
+  if (!ok || record != end)
+  {
+    ROS_ERROR("Octree delta is corrupted");
+    regions_.clear();
+    leaves_.clear();
+    return false;
+  }
+  return true;
+}
+
+void OcTreeDelta::apply(OccMapTree& tree) const
+{
+  for (std::size_t i = 0; i < regions_.size(); ++i)
+  {
+    // a depth of 0 stands for the leaves when deleting nodes, so the root region is cleared instead
+    if (regions_[i].depth == 0)
+      tree.clear();
+    else
+      tree.deleteNode(regions_[i].key, regions_[i].depth);
+  }
+
+  // like binary octomap messages, deltas only keep the free / occupied state
+  const float occupied = tree.getClampingThresMaxLog();
+  const float free = tree.getClampingThresMinLog();
+  for (std::size_t i = 0; i < leaves_.size(); ++i)
+    tree.setLeafLogOdds(leaves_[i].key, leaves_[i].depth, leaves_[i].occupied ? occupied : free);
+  tree.updateInnerOccupancy();
+}
+}
@@ -0,0 +1,170 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/occupancy_map_monitor/octree_integrator.h>
+#include <moveit/occupancy_map_monitor/occupancy_map_updater.h>
+#include <ros/console.h>
+#include <moveit/utils/thread_groups.h>
+
+namespace occupancy_map_monitor
+{
+OcTreeIntegrator::OcTreeIntegrator(const OccMapTreePtr& tree)
+  : tree_(tree), integrating_(false), stop_(false), cycle_count_(0), batch_count_(0)
+{
+  thread_ = boost::thread(boost::bind(&OcTreeIntegrator::run, this));
+}
+
+OcTreeIntegrator::~OcTreeIntegrator()
+{
+  {
+    boost::mutex::scoped_lock _(queue_lock_);
+    stop_ = true;
+  }
+  queue_condition_.notify_one();
+  thread_.join();
+}
+
+void OcTreeIntegrator::push(const OcTreeKeySet& free_cells, const OcTreeKeySet& occupied_cells,
+                            const OcTreeKeySet& model_cells)
+{
+  std::unique_ptr<Batch> batch;
+  {
+    boost::mutex::scoped_lock _(queue_lock_);
+    if (!unused_.empty())
+    {
+      batch = std::move(unused_.back());
+      unused_.pop_back();
+    }
+  }
+  if (!batch)
+    batch.reset(new Batch());
+  batch->clear();
+  batch->reserve(free_cells.size() + occupied_cells.size() + model_cells.size());
+
+  const float lg_miss = tree_->getProbMissLog();
+  const float lg_hit = tree_->getProbHitLog();
+  for (OcTreeKeySet::const_iterator it = free_cells.begin(), end = free_cells.end(); it != end; ++it)
+    (*batch)[*it] += lg_miss;
+  for (OcTreeKeySet::const_iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
+    (*batch)[*it] += lg_hit;
+  // the cells of the model end up at the minimum, whatever else was seen in them
+  const float lg_model = tree_->getClampingThresMinLog() - tree_->getClampingThresMaxLog();
+  for (OcTreeKeySet::const_iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
+    (*batch)[*it] = lg_model;
+
+  {
+    boost::mutex::scoped_lock _(queue_lock_);
+    queue_.push_back(std::move(batch));
+  }
+  queue_condition_.notify_one();
+}
+
+void OcTreeIntegrator::flush()
+{
+  boost::unique_lock<boost::mutex> lock(queue_lock_);
+  while (!queue_.empty() || integrating_)
+    flush_condition_.wait(lock);
+}
+
+std::size_t OcTreeIntegrator::getCycleCount() const
+{
+  boost::mutex::scoped_lock _(queue_lock_);
+  return cycle_count_;
+}
+
+std::size_t OcTreeIntegrator::getBatchCount() const
+{
+  boost::mutex::scoped_lock _(queue_lock_);
+  return batch_count_;
+}
+
+void OcTreeIntegrator::run()
+{
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PERCEPTION);
+  std::vector<std::unique_ptr<Batch> > batches;
+  boost::unique_lock<boost::mutex> lock(queue_lock_);
+  while (true)
+  {
+    while (queue_.empty() && !stop_)
+      queue_condition_.wait(lock);
+    // the batches queued before the integrator is destroyed are still written
+    if (queue_.empty())
+      break;
+
+    batches.swap(queue_);
+    integrating_ = true;
+    lock.unlock();
+    integrate(batches);
+    lock.lock();
+
+    batch_count_ += batches.size();
+    ++cycle_count_;
+    for (std::size_t i = 0; i < batches.size(); ++i)
+      unused_.push_back(std::move(batches[i]));
+    batches.clear();
+    integrating_ = false;
+    flush_condition_.notify_all();
+  }
+}
+
+void OcTreeIntegrator::integrate(std::vector<std::unique_ptr<Batch> >& batches)
+{
+  // cells seen by several sensors since the last cycle are written once, with the sum of their changes
+  const Batch* changes = batches[0].get();
+  if (batches.size() > 1)
+  {
+    merged_.clear();
+    for (std::size_t i = 0; i < batches.size(); ++i)
+      for (Batch::const_iterator it = batches[i]->begin(), end = batches[i]->end(); it != end; ++it)
+        merged_[it->first] += it->second;
+    changes = &merged_;
+  }
+
+  moveit::tools::ScopedMetricTimer timer(UpdaterStageMetrics::instance().tree_write);
+  tree_->lockWrite();
+  try
+  {
+    for (Batch::const_iterator it = changes->begin(), end = changes->end(); it != end; ++it)
+      tree_->updateNode(it->first, it->second, true);
+    tree_->updateInnerOccupancy();
+    tree_->prune();
+  }
+  catch (...)
+  {
+    ROS_ERROR("Internal error while updating octree");
+  }
+  tree_->unlockWrite();
+  tree_->triggerUpdateCallback();
+}
+}
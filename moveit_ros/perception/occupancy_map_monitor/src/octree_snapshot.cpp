@@ -0,0 +1,336 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/occupancy_map_monitor/octree_snapshot.h>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <ros/console.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace occupancy_map_monitor
+{
+const std::string OcTreeSnapshot::FILE_EXTENSION = ".ots";
+
+namespace
+{
+const char MAGIC[8] = { 'M', 'O', 'V', 'E', 'I', 'T', 'O', 'S' };
+const uint32_t VERSION = 1;
+
+// leaves are stored as three key components, the depth and the log-odds
+const std::size_t LEAF_RECORD_SIZE = 3 * sizeof(octomap::key_type) + sizeof(uint8_t) + sizeof(float);
+
+// leaves above the chunk depth span several chunks; they are kept in a chunk of their own
+const uint16_t COARSE_CHUNK = 0xFFFF;
+
+struct ChunkHeader
+{
+  uint16_t prefix[3];
+  uint32_t leaf_count;
+  uint64_t offset;
+  uint64_t size;
+};
+
+template <typename T>
+void appendValue(std::string& buffer, const T& value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(const char*& data, const char* end, T& value)
+{
+  if (end - data < (std::ptrdiff_t)sizeof(T))
+    return false;
+  memcpy(&value, data, sizeof(T));
+  data += sizeof(T);
+  return true;
+}
+
+// the box covered by the node of a tree of tree_depth levels that contains key, shift levels above the leaves
+void getKeyExtent(const uint16_t key[3], unsigned int shift, unsigned int tree_depth, double resolution,
+                  octomap::point3d& min, octomap::point3d& max)
+{
+  const int center = 1 << (tree_depth - 1);
+  const double size = (1 << shift) * resolution;
+  for (int i = 0; i < 3; ++i)
+  {
+    min(i) = (((key[i] >> shift) << shift) - center) * resolution;
+    max(i) = min(i) + size;
+  }
+}
+
+bool overlaps(const octomap::point3d& min1, const octomap::point3d& max1, const octomap::point3d& min2,
+              const octomap::point3d& max2)
+{
+  return min1.x() <= max2.x() && min2.x() <= max1.x() && min1.y() <= max2.y() && min2.y() <= max1.y() &&
+         min1.z() <= max2.z() && min2.z() <= max1.z();
+}
+}
+
+OcTreeSnapshot::OcTreeSnapshot() : resolution_(0.0)
+{
+}
+
+OcTreeSnapshot::OcTreeSnapshot(const OccMapTree& tree) : resolution_(tree.getResolution())
+{
+  leaves_.reserve(tree.getNumLeafNodes());
+  for (OccMapTree::leaf_iterator it = tree.begin_leafs(), end = tree.end_leafs(); it != end; ++it)
+  {
+    Leaf leaf;
+    leaf.key = it.getKey();
+    leaf.depth = it.getDepth();
+    leaf.log_odds = it->getLogOdds();
+    leaves_.push_back(leaf);
+  }
+}
+
+bool OcTreeSnapshot::isSnapshotFile(const std::string& filename)
+{
+  return filename.size() > FILE_EXTENSION.size() &&
+         filename.compare(filename.size() - FILE_EXTENSION.size(), FILE_EXTENSION.size(), FILE_EXTENSION) == 0;
+}
+
+bool OcTreeSnapshot::write(const std::string& filename) const
+{
+  const unsigned int tree_depth = 16;
+
+  // group the leaves by the subtree they are in
+  std::vector<std::pair<uint64_t, std::size_t> > order(leaves_.size());
+  for (std::size_t i = 0; i < leaves_.size(); ++i)
+  {
+    const Leaf& leaf = leaves_[i];
+    uint64_t chunk = 0xFFFFFFFFFFFFULL;
+    if (leaf.depth + CHUNK_SHIFT >= tree_depth)
+      chunk = (uint64_t)(leaf.key[0] >> CHUNK_SHIFT) << 32 | (uint64_t)(leaf.key[1] >> CHUNK_SHIFT) << 16 |
+              (leaf.key[2] >> CHUNK_SHIFT);
+    order[i] = std::make_pair(chunk, i);
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<ChunkHeader> chunks;
+  std::string payload, raw;
+  for (std::size_t begin = 0; begin < order.size();)
+  {
+    std::size_t end = begin;
+    raw.clear();
+    while (end < order.size() && order[end].first == order[begin].first)
+    {
+      const Leaf& leaf = leaves_[order[end++].second];
+      raw.append(reinterpret_cast<const char*>(&leaf.key.k[0]), 3 * sizeof(octomap::key_type));
+      appendValue(raw, leaf.depth);
+      appendValue(raw, leaf.log_odds);
+    }
+
+    ChunkHeader chunk;
+    const uint64_t id = order[begin].first;
+    chunk.prefix[0] = id >> 32;
+    chunk.prefix[1] = id >> 16;
+    chunk.prefix[2] = id;
+    if (id == 0xFFFFFFFFFFFFULL)
+      chunk.prefix[0] = chunk.prefix[1] = chunk.prefix[2] = COARSE_CHUNK;
+    chunk.leaf_count = end - begin;
+    chunk.offset = payload.size();
+    {
+      boost::iostreams::filtering_ostream out;
+      out.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib::best_speed));
+      out.push(boost::iostreams::back_inserter(payload));
+      out.write(raw.data(), raw.size());
+      out.reset();
+    }
+    chunk.size = payload.size() - chunk.offset;
+    chunks.push_back(chunk);
+    begin = end;
+  }
+
+  std::string header(MAGIC, sizeof(MAGIC));
+  appendValue(header, VERSION);
+  appendValue(header, resolution_);
+  appendValue(header, (uint32_t)tree_depth);
+  appendValue(header, (uint32_t)CHUNK_SHIFT);
+  appendValue(header, (uint64_t)chunks.size());
+  for (std::size_t i = 0; i < chunks.size(); ++i)
+  {
+    for (int k = 0; k < 3; ++k)
+      appendValue(header, chunks[i].prefix[k]);
+    appendValue(header, chunks[i].leaf_count);
+    appendValue(header, chunks[i].offset);
+    appendValue(header, chunks[i].size);
+  }
+
+  // write to a temporary file first, so an existing snapshot is not lost if writing fails
+  const std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream file(tmp_filename.c_str(), std::ios::binary | std::ios::trunc);
+    file.write(header.data(), header.size());
+    file.write(payload.data(), payload.size());
+    if (!file)
+    {
+      ROS_ERROR("Unable to write octree snapshot to '%s'", tmp_filename.c_str());
+      std::remove(tmp_filename.c_str());
+      return false;
+    }
+  }
+  if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    ROS_ERROR("Unable to replace '%s' by the new octree snapshot", filename.c_str());
+    std::remove(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool OcTreeSnapshot::read(const std::string& filename)
+{
+  return read(filename, NULL, NULL);
+}
+
+bool OcTreeSnapshot::read(const std::string& filename, const octomap::point3d& bbx_min,
+                          const octomap::point3d& bbx_max)
+{
+  return read(filename, &bbx_min, &bbx_max);
+}
+
+bool OcTreeSnapshot::read(const std::string& filename, const octomap::point3d* bbx_min,
+                          const octomap::point3d* bbx_max)
+{
+  leaves_.clear();
+  try
+  {
+    boost::iostreams::mapped_file_source file(filename);
+    const char* data = file.data();
+    const char* const file_end = data + file.size();
+
+    char magic[sizeof(MAGIC)];
+    uint32_t version, tree_depth, chunk_shift;
+    uint64_t chunk_count;
+    if (!readValue(data, file_end, magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !readValue(data, file_end, version) || version != VERSION || !readValue(data, file_end, resolution_) ||
+        !readValue(data, file_end, tree_depth) || tree_depth != 16 || !readValue(data, file_end, chunk_shift) ||
+        chunk_shift >= tree_depth || !readValue(data, file_end, chunk_count))
+    {
+      ROS_ERROR("'%s' is not an octree snapshot of a supported version", filename.c_str());
+      return false;
+    }
+
+    std::vector<ChunkHeader> chunks(chunk_count);
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+      if (!readValue(data, file_end, chunks[i].prefix[0]) || !readValue(data, file_end, chunks[i].prefix[1]) ||
+          !readValue(data, file_end, chunks[i].prefix[2]) || !readValue(data, file_end, chunks[i].leaf_count) ||
+          !readValue(data, file_end, chunks[i].offset) || !readValue(data, file_end, chunks[i].size))
+      {
+        ROS_ERROR("Octree snapshot '%s' is truncated", filename.c_str());
+        return false;
+      }
+    const char* const payload = data;
+    const uint64_t payload_size = file_end - payload;
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+      if (chunks[i].offset > payload_size || chunks[i].size > payload_size - chunks[i].offset)
+      {
+        ROS_ERROR("Octree snapshot '%s' is truncated", filename.c_str());
+        return false;
+      }
+
+    std::string raw;
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+    {
+      const ChunkHeader& chunk = chunks[i];
+      const bool coarse = chunk.prefix[0] == COARSE_CHUNK;
+      if (bbx_min && !coarse)
+      {
+        octomap::point3d chunk_min, chunk_max;
+        const uint16_t key[3] = { (uint16_t)(chunk.prefix[0] << chunk_shift),
+                                  (uint16_t)(chunk.prefix[1] << chunk_shift),
+                                  (uint16_t)(chunk.prefix[2] << chunk_shift) };
+        getKeyExtent(key, chunk_shift, tree_depth, resolution_, chunk_min, chunk_max);
+        if (!overlaps(chunk_min, chunk_max, *bbx_min, *bbx_max))
+          continue;
+      }
+
+      raw.resize(chunk.leaf_count * LEAF_RECORD_SIZE);
+      boost::iostreams::filtering_istream in;
+      in.push(boost::iostreams::zlib_decompressor());
+      in.push(boost::iostreams::array_source(payload + chunk.offset, chunk.size));
+      in.read(&raw[0], raw.size());
+      if ((std::size_t)in.gcount() != raw.size())
+      {
+        ROS_ERROR("Octree snapshot '%s' is corrupted", filename.c_str());
+        leaves_.clear();
+        return false;
+      }
+
+      const char* record = raw.data();
+      const char* const raw_end = record + raw.size();
+      for (uint32_t j = 0; j < chunk.leaf_count; ++j)
+      {
+        Leaf leaf;
+        readValue(record, raw_end, leaf.key.k);
+        readValue(record, raw_end, leaf.depth);
+        readValue(record, raw_end, leaf.log_odds);
+        if (bbx_min)
+        {
+          octomap::point3d leaf_min, leaf_max;
+          getKeyExtent(leaf.key.k, tree_depth - std::min<unsigned int>(leaf.depth, tree_depth), tree_depth,
+                       resolution_, leaf_min, leaf_max);
+          if (!overlaps(leaf_min, leaf_max, *bbx_min, *bbx_max))
+            continue;
+        }
+        leaves_.push_back(leaf);
+      }
+    }
+  }
+  catch (std::exception& ex)
+  {
+    ROS_ERROR("Unable to read octree snapshot '%s': %s", filename.c_str(), ex.what());
+    leaves_.clear();
+    return false;
+  }
+  return true;
+}
+
+void OcTreeSnapshot::restore(OccMapTree& tree) const
+{
+  tree.clear();
+  if (resolution_ > 0.0)
+    tree.setResolution(resolution_);
+  for (std::size_t i = 0; i < leaves_.size(); ++i)
+    tree.setLeafLogOdds(leaves_[i].key, leaves_[i].depth, leaves_[i].log_odds);
+  tree.updateInnerOccupancy();
+}
+}
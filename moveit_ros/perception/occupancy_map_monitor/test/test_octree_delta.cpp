@@ -0,0 +1,172 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/occupancy_map_monitor/octree_delta.h>
+
+using namespace occupancy_map_monitor;
+
+namespace
+{
+void fillTree(OccMapTree& tree)
+{
+  for (int i = 0; i < 200; ++i)
+    tree.updateNode(octomap::point3d(-2.0 + 0.02 * i, 0.5, 0.3), true);
+  for (double x = 1.0; x < 1.64; x += tree.getResolution())
+    for (double y = 1.0; y < 1.64; y += tree.getResolution())
+      tree.setNodeValue(octomap::point3d(x, y, 1.0), tree.getClampingThresMinLog());
+  tree.updateInnerOccupancy();
+  tree.prune();
+}
+
+// every known cell of one tree is known and has the same state in the other one
+void expectSameOccupancy(const OccMapTree& a, const OccMapTree& b)
+{
+  for (OccMapTree::leaf_iterator it = a.begin_leafs(), end = a.end_leafs(); it != end; ++it)
+  {
+    OccMapNode* node = b.search(it.getKey());
+    ASSERT_TRUE(node != NULL);
+    EXPECT_EQ(a.isNodeOccupied(*it), b.isNodeOccupied(node));
+  }
+}
+}
+
+TEST(OcTreeDelta, ApplyChanges)
+{
+  OccMapTree tree(0.02);
+  fillTree(tree);
+  tree.enableChangeDetection(true);
+  tree.resetChanges();
+  OccMapTree peer(static_cast<const octomap::OcTree&>(tree));
+
+  // occupy new cells, free some of the occupied ones and delete part of the free region
+  for (int i = 0; i < 50; ++i)
+    tree.updateNode(octomap::point3d(0.5, -1.0 + 0.02 * i, 0.7), true);
+  for (int i = 0; i < 20; ++i)
+    tree.setNodeValue(octomap::point3d(-2.0 + 0.02 * i, 0.5, 0.3), tree.getClampingThresMinLog());
+  octomap::OcTreeKey key = tree.coordToKey(octomap::point3d(1.1, 1.1, 1.0));
+  tree.deleteNode(key, 12);
+  tree.markChanged(key, 12);
+  EXPECT_FALSE(tree.isAllChanged());
+
+  OcTreeDelta delta(tree);
+  EXPECT_LT(0u, delta.getRegionCount());
+  std::vector<int8_t> data;
+  delta.serialize(data);
+
+  OcTreeDelta received;
+  ASSERT_TRUE(received.deserialize(data));
+  EXPECT_EQ(delta.getRegionCount(), received.getRegionCount());
+  EXPECT_EQ(delta.getLeafCount(), received.getLeafCount());
+  received.apply(peer);
+
+  expectSameOccupancy(tree, peer);
+  expectSameOccupancy(peer, tree);
+  EXPECT_TRUE(peer.search(octomap::point3d(1.1, 1.1, 1.0)) == NULL);
+}
+
+TEST(OcTreeDelta, ResetChanges)
+{
+  OccMapTree tree(0.02);
+  tree.enableChangeDetection(true);
+  fillTree(tree);
+  tree.markAllChanged();
+  EXPECT_TRUE(tree.isAllChanged());
+  tree.resetChanges();
+  EXPECT_FALSE(tree.isAllChanged());
+  EXPECT_EQ(0u, OcTreeDelta(tree).getRegionCount());
+}
+
+TEST(OcTreeDelta, RejectInvalidData)
+{
+  std::vector<int8_t> data(16, 7);
+  OcTreeDelta delta;
+  EXPECT_FALSE(delta.deserialize(data));
+  EXPECT_EQ(0u, delta.getRegionCount());
+}
+
+TEST(OccMapTree, PublishSnapshots)
+{
+  OccMapTree tree(0.02);
+  EXPECT_TRUE(tree.getSnapshot() == NULL);
+  tree.setSnapshotsEnabled(true);
+  std::shared_ptr<const OccMapTree> empty = tree.getSnapshot();
+  ASSERT_TRUE(empty != NULL);
+  EXPECT_EQ(0u, empty->size());
+
+  // the published snapshot is a copy of the tree at the time of the update, later writes do not change it
+  fillTree(tree);
+  tree.triggerUpdateCallback();
+  std::shared_ptr<const OccMapTree> filled = tree.getSnapshot();
+  ASSERT_TRUE(filled != empty);
+  expectSameOccupancy(tree, *filled);
+  tree.clear();
+  EXPECT_EQ(0u, empty->size());
+  EXPECT_NE(0u, filled->size());
+
+  tree.setSnapshotsEnabled(false);
+  EXPECT_TRUE(tree.getSnapshot() == NULL);
+}
+
+TEST(OccMapTree, DecayObservations)
+{
+  OccMapTree tree(0.02);
+  tree.setObservationStampsEnabled(true);
+  fillTree(tree);
+  // only the hits are stamped, the free cells never decay
+  const std::size_t stamped = tree.getObservationStampCount();
+  EXPECT_LT(100u, stamped);
+  EXPECT_GE(200u, stamped);
+  const uint32_t now = OccMapTree::getCurrentStamp();
+  EXPECT_EQ(0u, tree.decayObservations(now, 50, 1000));
+
+  // scanning in slices decays every stale cell once
+  tree.enableChangeDetection(true);
+  std::size_t decayed = 0;
+  for (int i = 0; i < 10; ++i)
+    decayed += tree.decayObservations(now + 100, 50, 30);
+  EXPECT_EQ(stamped, decayed);
+  EXPECT_EQ(0u, tree.getObservationStampCount());
+  EXPECT_EQ(stamped, tree.getChangedRegions().size());
+  EXPECT_TRUE(tree.search(octomap::point3d(-1.0, 0.5, 0.3)) == NULL);
+  OccMapNode* free_node = tree.search(octomap::point3d(1.3, 1.3, 1.0));
+  ASSERT_TRUE(free_node != NULL);
+  EXPECT_FALSE(tree.isNodeOccupied(free_node));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
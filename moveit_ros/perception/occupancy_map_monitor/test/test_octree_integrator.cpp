@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/occupancy_map_monitor/octree_integrator.h>
+
+using namespace occupancy_map_monitor;
+
+namespace
+{
+OcTreeKeySet lineOfCells(const OccMapTree& tree, double y, int count)
+{
+  OcTreeKeySet cells;
+  for (int i = 0; i < count; ++i)
+    cells.insert(tree.coordToKey(octomap::point3d(-1.0 + tree.getResolution() * i, y, 0.5)));
+  return cells;
+}
+}
+
+TEST(OcTreeIntegrator, IntegrateBatches)
+{
+  OccMapTreePtr tree(new OccMapTree(0.05));
+  unsigned int callback_count = 0;
+  tree->setUpdateCallback([&callback_count]() { ++callback_count; });
+
+  const OcTreeKeySet occupied = lineOfCells(*tree, 0.0, 20);
+  const OcTreeKeySet free = lineOfCells(*tree, 1.0, 20);
+  const OcTreeKeySet model = lineOfCells(*tree, 2.0, 20);
+  {
+    OcTreeIntegrator integrator(tree);
+    integrator.push(free, occupied, model);
+    // a second sensor sees the occupied cells as well
+    integrator.push(OcTreeKeySet(), occupied, OcTreeKeySet());
+    integrator.flush();
+    EXPECT_EQ(2u, integrator.getBatchCount());
+    EXPECT_GE(integrator.getCycleCount(), 1u);
+    EXPECT_EQ(integrator.getCycleCount(), callback_count);
+  }
+
+  for (OcTreeKeySet::const_iterator it = occupied.begin(); it != occupied.end(); ++it)
+  {
+    OccMapNode* node = tree->search(*it);
+    ASSERT_TRUE(node != NULL);
+    EXPECT_TRUE(tree->isNodeOccupied(node));
+    EXPECT_NEAR(2 * tree->getProbHitLog(), node->getLogOdds(), 1e-5);
+  }
+  for (OcTreeKeySet::const_iterator it = free.begin(); it != free.end(); ++it)
+  {
+    OccMapNode* node = tree->search(*it);
+    ASSERT_TRUE(node != NULL);
+    EXPECT_FALSE(tree->isNodeOccupied(node));
+  }
+  for (OcTreeKeySet::const_iterator it = model.begin(); it != model.end(); ++it)
+  {
+    OccMapNode* node = tree->search(*it);
+    ASSERT_TRUE(node != NULL);
+    EXPECT_FLOAT_EQ(tree->getClampingThresMinLog(), node->getLogOdds());
+  }
+
+  // the inner nodes are updated, e.g. the root holds the maximum of its children
+  EXPECT_FLOAT_EQ(2 * tree->getProbHitLog(), tree->getRoot()->getLogOdds());
+}
+
+TEST(OcTreeIntegrator, DestructorWritesQueuedBatches)
+{
+  OccMapTreePtr tree(new OccMapTree(0.05));
+  const OcTreeKeySet occupied = lineOfCells(*tree, 0.0, 100);
+  {
+    OcTreeIntegrator integrator(tree);
+    for (int i = 0; i < 10; ++i)
+      integrator.push(OcTreeKeySet(), occupied, OcTreeKeySet());
+  }
+  for (OcTreeKeySet::const_iterator it = occupied.begin(); it != occupied.end(); ++it)
+  {
+    OccMapNode* node = tree->search(*it);
+    ASSERT_TRUE(node != NULL);
+    EXPECT_FLOAT_EQ(tree->getClampingThresMaxLog(), node->getLogOdds());
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
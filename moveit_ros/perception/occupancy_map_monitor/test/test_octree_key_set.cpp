@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/occupancy_map_monitor/octree_key_set.h>
+
+using namespace occupancy_map_monitor;
+
+namespace
+{
+octomap::OcTreeKey makeKey(unsigned int i)
+{
+  return octomap::OcTreeKey(i % 37, (i / 37) % 41, i / (37 * 41));
+}
+}
+
+TEST(OcTreeKeySet, InsertFindErase)
+{
+  OcTreeKeySet set;
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(set.begin(), set.end());
+
+  const unsigned int count = 5000;
+  for (unsigned int i = 0; i < count; ++i)
+    EXPECT_TRUE(set.insert(makeKey(i)).second);
+  for (unsigned int i = 0; i < count; ++i)
+    EXPECT_FALSE(set.insert(makeKey(i)).second);
+  EXPECT_EQ(count, set.size());
+
+  // erase every third key; the remaining keys must still be found after the backward shifts
+  for (unsigned int i = 0; i < count; i += 3)
+    EXPECT_EQ(1u, set.erase(makeKey(i)));
+  EXPECT_EQ(0u, set.erase(makeKey(0)));
+  for (unsigned int i = 0; i < count; ++i)
+    EXPECT_EQ(i % 3 == 0 ? 0u : 1u, set.count(makeKey(i))) << i;
+
+  std::size_t iterated = 0;
+  for (OcTreeKeySet::const_iterator it = set.begin(); it != set.end(); ++it)
+    ++iterated;
+  EXPECT_EQ(set.size(), iterated);
+}
+
+TEST(OcTreeKeySet, ClearKeepsCapacity)
+{
+  OcTreeKeySet set;
+  for (unsigned int i = 0; i < 1000; ++i)
+    set.insert(makeKey(i));
+  std::size_t capacity = set.capacity();
+  EXPECT_GE(capacity, 1000u);
+
+  set.clear();
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(capacity, set.capacity());
+  EXPECT_EQ(0u, set.count(makeKey(1)));
+  EXPECT_EQ(set.begin(), set.end());
+
+  octomap::KeyRay ray;
+  ray.addKey(makeKey(3));
+  ray.addKey(makeKey(4));
+  ray.addKey(makeKey(3));
+  set.insert(ray.begin(), ray.end());
+  EXPECT_EQ(2u, set.size());
+  EXPECT_EQ(capacity, set.capacity());
+}
+
+TEST(OcTreeKeyMap, CountKeys)
+{
+  OcTreeKeyMap<unsigned int> map;
+  for (unsigned int i = 0; i < 3000; ++i)
+    map[makeKey(i % 1000)]++;
+  EXPECT_EQ(1000u, map.size());
+  for (OcTreeKeyMap<unsigned int>::iterator it = map.begin(); it != map.end(); ++it)
+    EXPECT_EQ(3u, it->second);
+
+  map.erase(makeKey(10));
+  EXPECT_EQ(map.end(), map.find(makeKey(10)));
+  ASSERT_NE(map.end(), map.find(makeKey(11)));
+  EXPECT_EQ(3u, map.find(makeKey(11))->second);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,131 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <gtest/gtest.h>
+#include <moveit/occupancy_map_monitor/octree_snapshot.h>
+#include <cstdio>
+
+using namespace occupancy_map_monitor;
+
+namespace
+{
+const std::string FILENAME = "test_octree_snapshot" + OcTreeSnapshot::FILE_EXTENSION;
+
+// a tree with occupied cells along a line and a large pruned free region
+void fillTree(OccMapTree& tree)
+{
+  for (int i = 0; i < 200; ++i)
+    tree.updateNode(octomap::point3d(-2.0 + 0.02 * i, 0.5, 0.3), true);
+  for (double x = 1.0; x < 1.64; x += tree.getResolution())
+    for (double y = 1.0; y < 1.64; y += tree.getResolution())
+      for (double z = 1.0; z < 1.64; z += tree.getResolution())
+        tree.setNodeValue(octomap::point3d(x, y, z), tree.getClampingThresMinLog());
+  tree.updateInnerOccupancy();
+  tree.prune();
+}
+}
+
+TEST(OcTreeSnapshot, WriteRead)
+{
+  OccMapTree tree(0.02);
+  fillTree(tree);
+
+  OcTreeSnapshot snapshot(tree);
+  EXPECT_EQ(tree.getNumLeafNodes(), snapshot.getLeafCount());
+  ASSERT_TRUE(snapshot.write(FILENAME));
+
+  OcTreeSnapshot loaded;
+  ASSERT_TRUE(loaded.read(FILENAME));
+  EXPECT_EQ(snapshot.getLeafCount(), loaded.getLeafCount());
+  EXPECT_DOUBLE_EQ(tree.getResolution(), loaded.getResolution());
+
+  OccMapTree restored(0.1);
+  loaded.restore(restored);
+  EXPECT_DOUBLE_EQ(tree.getResolution(), restored.getResolution());
+  EXPECT_EQ(tree.size(), restored.size());
+  for (OccMapTree::leaf_iterator it = tree.begin_leafs(), end = tree.end_leafs(); it != end; ++it)
+  {
+    OccMapNode* node = restored.search(it.getKey(), it.getDepth());
+    ASSERT_TRUE(node != NULL);
+    EXPECT_FLOAT_EQ(it->getLogOdds(), node->getLogOdds());
+  }
+  std::remove(FILENAME.c_str());
+}
+
+TEST(OcTreeSnapshot, ReadRegion)
+{
+  OccMapTree tree(0.02);
+  fillTree(tree);
+  ASSERT_TRUE(OcTreeSnapshot(tree).write(FILENAME));
+
+  OcTreeSnapshot loaded;
+  ASSERT_TRUE(loaded.read(FILENAME, octomap::point3d(-3.0, 0.0, 0.0), octomap::point3d(0.0, 1.0, 1.0)));
+  OccMapTree restored(0.02);
+  loaded.restore(restored);
+
+  // the occupied cells in the region are kept, the free region outside is not loaded
+  OccMapNode* inside = restored.search(octomap::point3d(-1.0, 0.5, 0.3));
+  ASSERT_TRUE(inside != NULL);
+  EXPECT_TRUE(restored.isNodeOccupied(inside));
+  EXPECT_TRUE(restored.search(octomap::point3d(1.3, 1.3, 1.3)) == NULL);
+  EXPECT_TRUE(restored.search(octomap::point3d(1.5, 0.5, 0.3)) == NULL);
+  std::remove(FILENAME.c_str());
+}
+
+TEST(OcTreeSnapshot, RejectInvalidFile)
+{
+  {
+    FILE* file = fopen(FILENAME.c_str(), "wb");
+    ASSERT_TRUE(file != NULL);
+    fputs("not a snapshot", file);
+    fclose(file);
+  }
+  OcTreeSnapshot loaded;
+  EXPECT_FALSE(loaded.read(FILENAME));
+  EXPECT_EQ(0u, loaded.getLeafCount());
+  std::remove(FILENAME.c_str());
+}
+
+TEST(OcTreeSnapshot, IsSnapshotFile)
+{
+  EXPECT_TRUE(OcTreeSnapshot::isSnapshotFile("map" + OcTreeSnapshot::FILE_EXTENSION));
+  EXPECT_FALSE(OcTreeSnapshot::isSnapshotFile("map.bt"));
+  EXPECT_FALSE(OcTreeSnapshot::isSnapshotFile(OcTreeSnapshot::FILE_EXTENSION));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
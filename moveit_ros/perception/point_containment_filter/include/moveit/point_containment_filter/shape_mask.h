@@ -76,6 +76,10 @@ public:
 
   void setTransformCallback(const TransformCallback& transform_callback);
 
+  /** \brief Set the number of threads maskContainment() splits the points of a cloud over. The default is 1; a value
+      of 0 uses one thread per core. */
+  void setThreadCount(unsigned int thread_count);
+
   /** \brief Compute the containment mask (INSIDE or OUTSIDE) for a given pointcloud. If a mask element is INSIDE, the
      point
       is inside the robot. The point is outside if the mask element is OUTSIDE.
@@ -119,6 +123,11 @@ private:
   /** \brief Free memory. */
   void freeMemory();
 
+  /** \brief Compute the mask for the points from \e begin to \e end, testing them in blocks against the bounding
+      spheres and only checking the bodies whose sphere contains a point */
+  void maskPoints(const sensor_msgs::PointCloud2& data_in, std::size_t begin, std::size_t end, double min_dist_squared,
+                  double max_dist_squared, const bodies::BoundingSphere& bound, std::vector<int>& mask) const;
+
   TransformCallback transform_callback_;
   ShapeHandle next_handle_;
   ShapeHandle min_handle_;
@@ -127,6 +136,15 @@ private:
   std::set<SeeShape, SortBodies> bodies_;
   std::map<ShapeHandle, std::set<SeeShape, SortBodies>::iterator> used_handles_;
   std::vector<bodies::BoundingSphere> bspheres_;
+
+  /* the bounding spheres of the posed bodies, in the order of bodies_, in a layout that suits vectorization */
+  std::vector<double> bsphere_x_;
+  std::vector<double> bsphere_y_;
+  std::vector<double> bsphere_z_;
+  std::vector<double> bsphere_radius_squared_;
+  std::vector<const bodies::Body*> bsphere_bodies_;
+
+  unsigned int thread_count_;
 };
 }
 
@@ -38,9 +38,12 @@
 #include <geometric_shapes/body_operations.h>
 #include <ros/console.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <limits>
 
 point_containment_filter::ShapeMask::ShapeMask(const TransformCallback& transform_callback)
-  : transform_callback_(transform_callback), next_handle_(1), min_handle_(1)
+  : transform_callback_(transform_callback), next_handle_(1), min_handle_(1), thread_count_(1)
 {
 }
 
@@ -62,6 +65,12 @@ void point_containment_filter::ShapeMask::setTransformCallback(const TransformCa
   transform_callback_ = transform_callback;
 }
 
+void point_containment_filter::ShapeMask::setThreadCount(unsigned int thread_count)
+{
+  boost::mutex::scoped_lock _(shapes_lock_);
+  thread_count_ = thread_count;
+}
+
 point_containment_filter::ShapeHandle point_containment_filter::ShapeMask::addShape(const shapes::ShapeConstPtr& shape,
                                                                                     double scale, double padding)
 {
@@ -125,6 +134,7 @@ void point_containment_filter::ShapeMask::maskContainment(const sensor_msgs::Poi
   {
     Eigen::Affine3d tmp;
     bspheres_.resize(bodies_.size());
+    bsphere_bodies_.resize(bodies_.size());
     std::size_t j = 0;
     for (std::set<SeeShape>::const_iterator it = bodies_.begin(); it != bodies_.end(); ++it)
     {
@@ -140,36 +150,132 @@ void point_containment_filter::ShapeMask::maskContainment(const sensor_msgs::Poi
       else
       {
         it->body->setPose(tmp);
-        it->body->computeBoundingSphere(bspheres_[j++]);
+        it->body->computeBoundingSphere(bspheres_[j]);
+        bsphere_bodies_[j++] = it->body;
       }
     }
+    // bodies without a transform are not used
+    bspheres_.resize(j);
+    bsphere_bodies_.resize(j);
+    bsphere_x_.resize(j);
+    bsphere_y_.resize(j);
+    bsphere_z_.resize(j);
+    bsphere_radius_squared_.resize(j);
+    for (std::size_t k = 0; k < j; ++k)
+    {
+      bsphere_x_[k] = bspheres_[k].center.x();
+      bsphere_y_[k] = bspheres_[k].center.y();
+      bsphere_z_[k] = bspheres_[k].center.z();
+      bsphere_radius_squared_[k] = bspheres_[k].radius * bspheres_[k].radius;
+    }
 
     // compute a sphere that bounds the entire robot
     bodies::BoundingSphere bound;
     bodies::mergeBoundingSpheres(bspheres_, bound);
-    const double radiusSquared = bound.radius * bound.radius;
+    if (bspheres_.empty())
+      bound.radius = 0.0;
+    const double min_dist_squared = min_sensor_dist * min_sensor_dist;
+    const double max_dist_squared = max_sensor_dist * max_sensor_dist;
+
+    unsigned int thread_count = thread_count_;
+    if (thread_count == 0)
+      thread_count = std::max(1u, boost::thread::hardware_concurrency());
+    // each thread claims chunks of points (rows, for organized clouds of 640 points or more)
+    static const std::size_t POINTS_PER_CHUNK = 640;
+    thread_count = std::min<std::size_t>(thread_count, (np + POINTS_PER_CHUNK - 1) / POINTS_PER_CHUNK);
+    if (thread_count <= 1)
+      maskPoints(data_in, 0, np, min_dist_squared, max_dist_squared, bound, mask);
+    else
+    {
+      std::atomic<std::size_t> next(0);
+      auto worker = [this, &data_in, np, min_dist_squared, max_dist_squared, &bound, &mask, &next]() {
+        for (std::size_t begin = next.fetch_add(POINTS_PER_CHUNK); begin < np; begin = next.fetch_add(POINTS_PER_CHUNK))
+          maskPoints(data_in, begin, std::min<std::size_t>(begin + POINTS_PER_CHUNK, np), min_dist_squared,
+                     max_dist_squared, bound, mask);
+      };
+      boost::thread_group workers;
+      for (unsigned int t = 1; t < thread_count; ++t)
+        workers.create_thread(worker);
+      worker();
+      workers.join_all();
+    }
+  }
+}
+
+void point_containment_filter::ShapeMask::maskPoints(const sensor_msgs::PointCloud2& data_in, std::size_t begin,
+                                                     std::size_t end, double min_dist_squared, double max_dist_squared,
+                                                     const bodies::BoundingSphere& bound, std::vector<int>& mask) const
+{
+  if (begin >= end)
+    return;
 
-    // we now decide which points we keep
-    sensor_msgs::PointCloud2ConstIterator<float> iter_x(data_in, "x");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_y(data_in, "y");
-    sensor_msgs::PointCloud2ConstIterator<float> iter_z(data_in, "z");
+  // the points are read in place; the x, y and z fields are floats at a fixed offset in every point
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(data_in, "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(data_in, "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(data_in, "z");
+  const uint8_t* data_x = reinterpret_cast<const uint8_t*>(&*iter_x);
+  const uint8_t* data_y = reinterpret_cast<const uint8_t*>(&*iter_y);
+  const uint8_t* data_z = reinterpret_cast<const uint8_t*>(&*iter_z);
+  const std::size_t step = data_in.point_step;
+  const double bound_radius_squared = bound.radius * bound.radius;
+  const std::size_t sphere_count = bsphere_bodies_.size();
 
-    // Cloud iterators are not incremented in the for loop, because of the pragma
-    // Comment out below parallelization as it can result in very high CPU consumption
-    //#pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < (int)np; ++i)
+  // points are tested in blocks; the loops over a block have no dependencies between lanes, so the compiler can
+  // vectorize them
+  static const std::size_t BLOCK_SIZE = 8;
+  double px[BLOCK_SIZE], py[BLOCK_SIZE], pz[BLOCK_SIZE];
+  int out[BLOCK_SIZE];
+  bool candidate[BLOCK_SIZE];
+
+  for (std::size_t b = begin; b < end; b += BLOCK_SIZE)
+  {
+    const std::size_t n = std::min(BLOCK_SIZE, end - b);
+    for (std::size_t l = 0; l < BLOCK_SIZE; ++l)
+      if (l < n)
+      {
+        px[l] = *reinterpret_cast<const float*>(data_x + (b + l) * step);
+        py[l] = *reinterpret_cast<const float*>(data_y + (b + l) * step);
+        pz[l] = *reinterpret_cast<const float*>(data_z + (b + l) * step);
+      }
+      else
+        px[l] = py[l] = pz[l] = std::numeric_limits<double>::quiet_NaN();
+
+    // points outside the sensor range are clipped; NaN points fail every comparison and stay OUTSIDE
+    std::size_t candidate_count = 0;
+    for (std::size_t l = 0; l < BLOCK_SIZE; ++l)
     {
-      Eigen::Vector3d pt = Eigen::Vector3d(*(iter_x + i), *(iter_y + i), *(iter_z + i));
-      double d = pt.norm();
-      int out = OUTSIDE;
-      if (d < min_sensor_dist || d > max_sensor_dist)
-        out = CLIP;
-      else if ((bound.center - pt).squaredNorm() < radiusSquared)
-        for (std::set<SeeShape>::const_iterator it = bodies_.begin(); it != bodies_.end() && out == OUTSIDE; ++it)
-          if (it->body->containsPoint(pt))
-            out = INSIDE;
-      mask[i] = out;
+      const double d2 = px[l] * px[l] + py[l] * py[l] + pz[l] * pz[l];
+      const bool clip = d2 < min_dist_squared || d2 > max_dist_squared;
+      const double dx = px[l] - bound.center.x();
+      const double dy = py[l] - bound.center.y();
+      const double dz = pz[l] - bound.center.z();
+      candidate[l] = !clip && dx * dx + dy * dy + dz * dz < bound_radius_squared;
+      out[l] = clip ? CLIP : OUTSIDE;
+      candidate_count += candidate[l];
     }
+
+    // only bodies whose bounding sphere contains a candidate point are tested exactly, largest bodies first
+    for (std::size_t s = 0; s < sphere_count && candidate_count > 0; ++s)
+    {
+      bool hit[BLOCK_SIZE];
+      for (std::size_t l = 0; l < BLOCK_SIZE; ++l)
+      {
+        const double dx = px[l] - bsphere_x_[s];
+        const double dy = py[l] - bsphere_y_[s];
+        const double dz = pz[l] - bsphere_z_[s];
+        hit[l] = candidate[l] && dx * dx + dy * dy + dz * dz <= bsphere_radius_squared_[s];
+      }
+      for (std::size_t l = 0; l < BLOCK_SIZE; ++l)
+        if (hit[l] && bsphere_bodies_[s]->containsPoint(Eigen::Vector3d(px[l], py[l], pz[l])))
+        {
+          out[l] = INSIDE;
+          candidate[l] = false;
+          --candidate_count;
+        }
+    }
+
+    for (std::size_t l = 0; l < n; ++l)
+      mask[b + l] = out[l];
   }
 }
 
@@ -43,7 +43,9 @@
 #include <message_filters/subscriber.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_updater.h>
+#include <moveit/occupancy_map_monitor/octree_key_set.h>
 #include <moveit/point_containment_filter/shape_mask.h>
+#include <boost/thread.hpp>
 
 #include <memory>
 
@@ -72,6 +74,14 @@ private:
   void cloudMsgCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud_msg);
   void stopHelper();
 
+  /* cast rays from the sensor origin to each of the endpoints, using up to ray_casting_threads_ threads */
+  void computeFreeCells(const octomap::point3d& sensor_origin, const std::vector<octomap::OcTreeKey>& endpoints,
+                        OcTreeKeySet& free_cells);
+
+  /* write the cells computed for one point cloud into the octree */
+  void updateTree(const OcTreeKeySet& free_cells, const OcTreeKeySet& occupied_cells, const OcTreeKeySet& model_cells);
+  void updateTreeThread();
+
   ros::NodeHandle root_nh_;
   ros::NodeHandle private_nh_;
   boost::shared_ptr<tf::Transformer> tf_;
@@ -87,13 +97,35 @@ private:
   double max_update_rate_;
   std::string filtered_cloud_topic_;
   ros::Publisher filtered_cloud_publisher_;
+  unsigned int ray_casting_threads_;
+  unsigned int self_filter_threads_;
+  bool pipeline_tree_updates_;
 
   message_filters::Subscriber<sensor_msgs::PointCloud2>* point_cloud_subscriber_;
   tf::MessageFilter<sensor_msgs::PointCloud2>* point_cloud_filter_;
 
-  /* used to store all cells in the map which a given ray passes through during raycasting.
-     we cache this here because it dynamically pre-allocates a lot of memory in its contsructor */
-  octomap::KeyRay key_ray_;
+  /* used to store all cells in the map which a given ray passes through during raycasting, one per thread.
+     we cache these here because they dynamically pre-allocate a lot of memory in their contsructor */
+  std::vector<octomap::KeyRay> key_rays_;
+
+  /* the cells found in the last point cloud; kept as members so their storage is reused for the next cloud */
+  OcTreeKeySet free_cells_;
+  OcTreeKeySet occupied_cells_;
+  OcTreeKeySet model_cells_;
+  OcTreeKeySet clip_cells_;
+  std::vector<OcTreeKeySet> thread_free_cells_;
+  std::vector<octomap::OcTreeKey> ray_endpoints_;
+
+  /* when pipeline_tree_updates_ is set, the cells of the last point cloud are written into the tree by
+     update_tree_thread_ while the next point cloud is filtered */
+  OcTreeKeySet pending_free_cells_;
+  OcTreeKeySet pending_occupied_cells_;
+  OcTreeKeySet pending_model_cells_;
+  bool tree_update_pending_;
+  bool update_tree_thread_running_;
+  boost::mutex tree_update_lock_;
+  boost::condition_variable tree_update_condition_;
+  boost::thread update_tree_thread_;
 
   std::unique_ptr<point_containment_filter::ShapeMask> shape_mask_;
   std::vector<int> mask_;
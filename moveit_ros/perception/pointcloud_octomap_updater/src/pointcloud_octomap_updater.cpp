@@ -37,14 +37,24 @@
 #include <cmath>
 #include <moveit/pointcloud_octomap_updater/pointcloud_octomap_updater.h>
 #include <moveit/occupancy_map_monitor/occupancy_map_monitor.h>
+#include <moveit/profiler/metrics.h>
+#include <moveit/utils/thread_groups.h>
 #include <message_filters/subscriber.h>
 #include <sensor_msgs/point_cloud2_iterator.h>
 #include <XmlRpcException.h>
 
+#include <atomic>
 #include <memory>
 
 namespace occupancy_map_monitor
 {
+namespace
+{
+moveit::tools::MetricHistogram& OCTOMAP_INTEGRATION = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_octomap_integration_seconds", "Time spent integrating a sensor message into the octomap");
+const UpdaterStageMetrics& STAGES = UpdaterStageMetrics::instance();
+}
+
 PointCloudOctomapUpdater::PointCloudOctomapUpdater()
   : OccupancyMapUpdater("PointCloudUpdater")
   , private_nh_("~")
@@ -53,8 +63,14 @@ PointCloudOctomapUpdater::PointCloudOctomapUpdater()
   , max_range_(std::numeric_limits<double>::infinity())
   , point_subsample_(1)
   , max_update_rate_(0)
+  , ray_casting_threads_(1)
+  , self_filter_threads_(1)
+  , pipeline_tree_updates_(false)
   , point_cloud_subscriber_(NULL)
   , point_cloud_filter_(NULL)
+  , key_rays_(1)
+  , tree_update_pending_(false)
+  , update_tree_thread_running_(false)
 {
 }
 
@@ -79,6 +95,13 @@ bool PointCloudOctomapUpdater::setParams(XmlRpc::XmlRpcValue& params)
       readXmlParam(params, "max_update_rate", &max_update_rate_);
     if (params.hasMember("filtered_cloud_topic"))
       filtered_cloud_topic_ = static_cast<const std::string&>(params["filtered_cloud_topic"]);
+    // 0 uses one thread per core
+    if (params.hasMember("ray_casting_threads"))
+      readXmlParam(params, "ray_casting_threads", &ray_casting_threads_);
+    if (params.hasMember("self_filter_threads"))
+      readXmlParam(params, "self_filter_threads", &self_filter_threads_);
+    if (params.hasMember("pipeline_tree_updates"))
+      pipeline_tree_updates_ = static_cast<bool&>(params["pipeline_tree_updates"]);
   }
   catch (XmlRpc::XmlRpcException& ex)
   {
@@ -94,6 +117,7 @@ bool PointCloudOctomapUpdater::initialize()
   tf_ = monitor_->getTFClient();
   shape_mask_.reset(new point_containment_filter::ShapeMask());
   shape_mask_->setTransformCallback(boost::bind(&PointCloudOctomapUpdater::getShapeTransform, this, _1, _2));
+  shape_mask_->setThreadCount(self_filter_threads_);
   if (!filtered_cloud_topic_.empty())
     filtered_cloud_publisher_ = private_nh_.advertise<sensor_msgs::PointCloud2>(filtered_cloud_topic_, 10, false);
   return true;
@@ -103,6 +127,11 @@ void PointCloudOctomapUpdater::start()
 {
   if (point_cloud_subscriber_)
     return;
+  if (pipeline_tree_updates_)
+  {
+    update_tree_thread_running_ = true;
+    update_tree_thread_ = boost::thread(boost::bind(&PointCloudOctomapUpdater::updateTreeThread, this));
+  }
   /* subscribe to point cloud topic using tf filter*/
   point_cloud_subscriber_ = new message_filters::Subscriber<sensor_msgs::PointCloud2>(root_nh_, point_cloud_topic_, 5);
   if (tf_ && !monitor_->getMapFrame().empty())
@@ -124,6 +153,15 @@ void PointCloudOctomapUpdater::stopHelper()
 {
   delete point_cloud_filter_;
   delete point_cloud_subscriber_;
+  if (update_tree_thread_.joinable())
+  {
+    {
+      boost::mutex::scoped_lock _(tree_update_lock_);
+      update_tree_thread_running_ = false;
+      tree_update_condition_.notify_all();
+    }
+    update_tree_thread_.join();
+  }
 }
 
 void PointCloudOctomapUpdater::stop()
@@ -165,6 +203,119 @@ void PointCloudOctomapUpdater::updateMask(const sensor_msgs::PointCloud2& cloud,
 {
 }
 
+void PointCloudOctomapUpdater::computeFreeCells(const octomap::point3d& sensor_origin,
+                                                const std::vector<octomap::OcTreeKey>& endpoints,
+                                                OcTreeKeySet& free_cells)
+{
+  unsigned int thread_count = ray_casting_threads_;
+  if (thread_count == 0)
+    thread_count = std::max(1u, boost::thread::hardware_concurrency());
+  thread_count = std::max<std::size_t>(1, std::min<std::size_t>(thread_count, endpoints.size()));
+  if (key_rays_.size() < thread_count)
+    key_rays_.resize(thread_count);
+
+  if (thread_count == 1)
+  {
+    for (std::size_t i = 0; i < endpoints.size(); ++i)
+      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(endpoints[i]), key_rays_[0]))
+        free_cells.insert(key_rays_[0].begin(), key_rays_[0].end());
+    return;
+  }
+
+  // computeRayKeys() only reads the tree, so each thread claims chunks of rays and collects the cells they
+  // pass through in its own set; the sets are merged once all rays are cast
+  static const std::size_t RAYS_PER_CHUNK = 256;
+  if (thread_free_cells_.size() < thread_count)
+    thread_free_cells_.resize(thread_count);
+  for (unsigned int t = 0; t < thread_count; ++t)
+    thread_free_cells_[t].clear();
+  std::atomic<std::size_t> next(0);
+  auto worker = [this, &sensor_origin, &endpoints, &next](unsigned int t) {
+    octomap::KeyRay& key_ray = key_rays_[t];
+    OcTreeKeySet& cells = thread_free_cells_[t];
+    for (std::size_t begin = next.fetch_add(RAYS_PER_CHUNK); begin < endpoints.size();
+         begin = next.fetch_add(RAYS_PER_CHUNK))
+    {
+      std::size_t end = std::min(begin + RAYS_PER_CHUNK, endpoints.size());
+      for (std::size_t i = begin; i < end; ++i)
+        if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(endpoints[i]), key_ray))
+          cells.insert(key_ray.begin(), key_ray.end());
+    }
+  };
+  boost::thread_group workers;
+  for (unsigned int t = 1; t < thread_count; ++t)
+    workers.create_thread([&worker, t]() { worker(t); });
+  worker(0);
+  workers.join_all();
+
+  free_cells.swap(thread_free_cells_[0]);
+  for (unsigned int t = 1; t < thread_count; ++t)
+    free_cells.insert(thread_free_cells_[t].begin(), thread_free_cells_[t].end());
+}
+
+void PointCloudOctomapUpdater::updateTree(const OcTreeKeySet& free_cells, const OcTreeKeySet& occupied_cells,
+                                          const OcTreeKeySet& model_cells)
+{
+  if (monitor_->getIntegrator())
+  {
+    monitor_->getIntegrator()->push(free_cells, occupied_cells, model_cells);
+    return;
+  }
+
+  moveit::tools::ScopedMetricTimer timer(STAGES.tree_write);
+  tree_->lockWrite();
+
+  try
+  {
+    /* mark free cells only if not seen occupied in this cloud */
+    for (OcTreeKeySet::const_iterator it = free_cells.begin(), end = free_cells.end(); it != end; ++it)
+      tree_->updateNode(*it, false);
+
+    /* now mark all occupied cells */
+    for (OcTreeKeySet::const_iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
+      tree_->updateNode(*it, true);
+
+    // set the logodds to the minimum for the cells that are part of the model
+    const float lg = tree_->getClampingThresMinLog() - tree_->getClampingThresMaxLog();
+    for (OcTreeKeySet::const_iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
+      tree_->updateNode(*it, lg);
+  }
+  catch (...)
+  {
+    ROS_ERROR("Internal error while updating octree");
+  }
+  tree_->unlockWrite();
+  tree_->triggerUpdateCallback();
+}
+
+void PointCloudOctomapUpdater::updateTreeThread()
+{
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_PERCEPTION);
+  OcTreeKeySet free_cells, occupied_cells, model_cells;
+  while (true)
+  {
+    {
+      boost::unique_lock<boost::mutex> ulock(tree_update_lock_);
+      while (!tree_update_pending_ && update_tree_thread_running_)
+        tree_update_condition_.wait(ulock);
+      // cells received before stopping are still written
+      if (!tree_update_pending_)
+        break;
+      free_cells.swap(pending_free_cells_);
+      occupied_cells.swap(pending_occupied_cells_);
+      model_cells.swap(pending_model_cells_);
+      tree_update_pending_ = false;
+      tree_update_condition_.notify_all();
+    }
+    ros::WallTime start = ros::WallTime::now();
+    updateTree(free_cells, occupied_cells, model_cells);
+    ROS_DEBUG("Wrote point cloud into octree in %lf ms", (ros::WallTime::now() - start).toSec() * 1000.0);
+    free_cells.clear();
+    occupied_cells.clear();
+    model_cells.clear();
+  }
+}
+
 void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::ConstPtr& cloud_msg)
 {
   ROS_DEBUG("Received a new point cloud message");
@@ -182,6 +333,7 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
     monitor_->setMapFrame(cloud_msg->header.frame_id);
 
   /* get transform for cloud into map frame */
+  ros::WallTime stage_start = ros::WallTime::now();
   tf::StampedTransform map_H_sensor;
   if (monitor_->getMapFrame() == cloud_msg->header.frame_id)
     map_H_sensor.setIdentity();
@@ -214,12 +366,25 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
     ROS_ERROR_THROTTLE(1, "Transform cache was not updated. Self-filtering may fail.");
     return;
   }
+  ros::WallTime stage_end = ros::WallTime::now();
+  STAGES.transform.observe((stage_end - stage_start).toSec());
+  stage_start = stage_end;
 
   /* mask out points on the robot */
   shape_mask_->maskContainment(*cloud_msg, sensor_origin_eigen, 0.0, max_range_, mask_);
   updateMask(*cloud_msg, sensor_origin_eigen, mask_);
-
-  octomap::KeySet free_cells, occupied_cells, model_cells, clip_cells;
+  stage_end = ros::WallTime::now();
+  STAGES.self_filter.observe((stage_end - stage_start).toSec());
+  stage_start = stage_end;
+
+  OcTreeKeySet& free_cells = free_cells_;
+  OcTreeKeySet& occupied_cells = occupied_cells_;
+  OcTreeKeySet& model_cells = model_cells_;
+  OcTreeKeySet& clip_cells = clip_cells_;
+  free_cells.clear();
+  occupied_cells.clear();
+  model_cells.clear();
+  clip_cells.clear();
   std::unique_ptr<sensor_msgs::PointCloud2> filtered_cloud;
 
   // We only use these iterators if we are creating a filtered_cloud for
@@ -293,20 +458,12 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
       }
     }
 
-    /* compute the free cells along each ray that ends at an occupied cell */
-    for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
-
-    /* compute the free cells along each ray that ends at a model cell */
-    for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
-
-    /* compute the free cells along each ray that ends at a clipped cell */
-    for (octomap::KeySet::iterator it = clip_cells.begin(), end = clip_cells.end(); it != end; ++it)
-      if (tree_->computeRayKeys(sensor_origin, tree_->keyToCoord(*it), key_ray_))
-        free_cells.insert(key_ray_.begin(), key_ray_.end());
+    /* compute the free cells along each ray that ends at an occupied, model or clipped cell */
+    ray_endpoints_.clear();
+    ray_endpoints_.insert(ray_endpoints_.end(), occupied_cells.begin(), occupied_cells.end());
+    ray_endpoints_.insert(ray_endpoints_.end(), model_cells.begin(), model_cells.end());
+    ray_endpoints_.insert(ray_endpoints_.end(), clip_cells.begin(), clip_cells.end());
+    computeFreeCells(sensor_origin, ray_endpoints_, free_cells);
   }
   catch (...)
   {
@@ -315,39 +472,32 @@ void PointCloudOctomapUpdater::cloudMsgCallback(const sensor_msgs::PointCloud2::
   }
 
   tree_->unlockRead();
+  STAGES.ray_casting.observe((ros::WallTime::now() - stage_start).toSec());
 
   /* cells that overlap with the model are not occupied */
-  for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
+  for (OcTreeKeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
     occupied_cells.erase(*it);
 
   /* occupied cells are not free */
-  for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
+  for (OcTreeKeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
     free_cells.erase(*it);
 
-  tree_->lockWrite();
-
-  try
-  {
-    /* mark free cells only if not seen occupied in this cloud */
-    for (octomap::KeySet::iterator it = free_cells.begin(), end = free_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, false);
-
-    /* now mark all occupied cells */
-    for (octomap::KeySet::iterator it = occupied_cells.begin(), end = occupied_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, true);
-
-    // set the logodds to the minimum for the cells that are part of the model
-    const float lg = tree_->getClampingThresMinLog() - tree_->getClampingThresMaxLog();
-    for (octomap::KeySet::iterator it = model_cells.begin(), end = model_cells.end(); it != end; ++it)
-      tree_->updateNode(*it, lg);
-  }
-  catch (...)
+  if (update_tree_thread_.joinable())
   {
-    ROS_ERROR("Internal error while updating octree");
+    // hand the cells to the update thread; wait only if it is still busy with the cloud before the previous one
+    boost::unique_lock<boost::mutex> ulock(tree_update_lock_);
+    while (tree_update_pending_ && update_tree_thread_running_)
+      tree_update_condition_.wait(ulock);
+    pending_free_cells_.swap(free_cells);
+    pending_occupied_cells_.swap(occupied_cells);
+    pending_model_cells_.swap(model_cells);
+    tree_update_pending_ = true;
+    tree_update_condition_.notify_all();
   }
-  tree_->unlockWrite();
+  else
+    updateTree(free_cells, occupied_cells, model_cells);
+  OCTOMAP_INTEGRATION.observe((ros::WallTime::now() - start).toSec());
   ROS_DEBUG("Processed point cloud in %lf ms", (ros::WallTime::now() - start).toSec() * 1000.0);
-  tree_->triggerUpdateCallback();
 
   if (filtered_cloud)
   {
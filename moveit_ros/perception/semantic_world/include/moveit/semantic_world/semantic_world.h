@@ -130,10 +130,38 @@ public:
   std::string findObjectTable(const geometry_msgs::Pose& pose, double min_distance_from_edge = 0.0,
                               double min_vertical_offset = 0.0) const;
 
+  /**
+   * @brief Find the table in the collision world for each of \e poses, see findObjectTable(). The table contours are
+   * only computed when the tables are received, so this is suitable for a large number of poses.
+   * @return For every pose, the name of its table, or an empty string
+   */
+  std::vector<std::string> findObjectTables(const std::vector<geometry_msgs::Pose>& poses,
+                                            double min_distance_from_edge = 0.0,
+                                            double min_vertical_offset = 0.0) const;
+
   bool isInsideTableContour(const geometry_msgs::Pose& pose, const object_recognition_msgs::Table& table,
                             double min_distance_from_edge = 0.0, double min_vertical_offset = 0.0) const;
 
+  /**
+   * @brief Check for each of \e poses whether it is inside the contour of \e table. The contour is computed only
+   * once for all poses.
+   * @param inside Set to true for every pose that is inside the contour
+   */
+  void isInsideTableContour(const std::vector<geometry_msgs::Pose>& poses, const object_recognition_msgs::Table& table,
+                            double min_distance_from_edge, double min_vertical_offset, std::vector<bool>& inside) const;
+
 private:
+  /** @brief The collision mesh and contour of a table, computed once when the table is received */
+  struct TableGeometry;
+  typedef std::shared_ptr<const TableGeometry> TableGeometryConstPtr;
+
+  /** @brief Compute the contour of \e table, and its collision mesh if \e with_mesh is set. Returns NULL if the
+   * table has no contour */
+  TableGeometryConstPtr computeTableGeometry(const object_recognition_msgs::Table& table, bool with_mesh) const;
+
+  static bool isInsideTableContour(const geometry_msgs::Pose& pose, const TableGeometry& table,
+                                   double min_distance_from_edge, double min_vertical_offset);
+
   shapes::Mesh* createSolidMeshFromPlanarPolygon(const shapes::Mesh& polygon, double thickness) const;
 
   shapes::Mesh* orientPlanarPolygon(const shapes::Mesh& polygon) const;
@@ -150,8 +178,14 @@ private:
 
   std::vector<geometry_msgs::PoseStamped> place_poses_;
 
+  /** @brief The geometry of each table in table_array_, NULL if it has none */
+  std::vector<TableGeometryConstPtr> table_geometry_;
+
   std::map<std::string, object_recognition_msgs::Table> current_tables_in_collision_world_;
 
+  /** @brief The geometry of the tables in current_tables_in_collision_world_ */
+  std::map<std::string, TableGeometryConstPtr> current_table_geometry_;
+
   //  boost::mutex table_lock_;
 
   ros::Subscriber table_subscriber_;
@@ -54,6 +54,80 @@ namespace moveit
 {
 namespace semantic_world
 {
+// pixels per meter of the rasterized table contours
+static const int TABLE_SCALE_FACTOR = 100;
+
+struct SemanticWorld::TableGeometry
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /** @brief The solid mesh of the table for the collision world, if has_mesh_ is set */
+  shape_msgs::Mesh mesh_;
+  bool has_mesh_;
+
+  /** @brief Transforms points to the frame of the table */
+  Eigen::Affine3d table_pose_inverse_;
+
+  /** @brief The position of the rasterized contour in the frame of the table */
+  float x_min_, y_min_;
+
+  /** @brief The contour in pixels, and its bounding box */
+  std::vector<cv::Point> contour_;
+  cv::Rect bounds_;
+};
+
+namespace
+{
+// Rasterize the convex hull of a table and extract its contour
+bool computeTableContour(const object_recognition_msgs::Table& table, float& x_min, float& y_min,
+                         std::vector<cv::Point>& contour)
+{
+  // Assumption that the table's normal is along the Z axis
+  if (table.convex_hull.empty())
+    return false;
+  x_min = table.convex_hull[0].x;
+  y_min = table.convex_hull[0].y;
+  float x_max = x_min, y_max = y_min;
+  for (std::size_t j = 1; j < table.convex_hull.size(); ++j)
+  {
+    if (table.convex_hull[j].x < x_min)
+      x_min = table.convex_hull[j].x;
+    else if (table.convex_hull[j].x > x_max)
+      x_max = table.convex_hull[j].x;
+    if (table.convex_hull[j].y < y_min)
+      y_min = table.convex_hull[j].y;
+    else if (table.convex_hull[j].y > y_max)
+      y_max = table.convex_hull[j].y;
+  }
+  std::vector<cv::Point2f> table_contour;
+  for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
+    table_contour.push_back(cv::Point((table.convex_hull[j].x - x_min) * TABLE_SCALE_FACTOR,
+                                      (table.convex_hull[j].y - y_min) * TABLE_SCALE_FACTOR));
+
+  double x_range = fabs(x_max - x_min);
+  double y_range = fabs(y_max - y_min);
+  int max_range = (int)x_range + 1;
+  if (max_range < (int)y_range + 1)
+    max_range = (int)y_range + 1;
+
+  int image_scale = std::max<int>(max_range, 4);
+  cv::Mat src = cv::Mat::zeros(image_scale * TABLE_SCALE_FACTOR, image_scale * TABLE_SCALE_FACTOR, CV_8UC1);
+
+  for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
+  {
+    cv::line(src, table_contour[j], table_contour[(j + 1) % table.convex_hull.size()], cv::Scalar(255), 3, 8);
+  }
+
+  std::vector<std::vector<cv::Point> > contours;
+  std::vector<cv::Vec4i> hierarchy;
+  cv::findContours(src, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+  if (contours.empty())
+    return false;
+  contour.swap(contours[0]);
+  return true;
+}
+}
+
 SemanticWorld::SemanticWorld(const planning_scene::PlanningSceneConstPtr& planning_scene)
   : planning_scene_(planning_scene)
 {
@@ -93,10 +167,10 @@ SemanticWorld::getPlaceLocationsMarker(const std::vector<geometry_msgs::PoseStam
 
 bool SemanticWorld::addTablesToCollisionWorld()
 {
+  // Replace the existing tables by the new ones in a single diff
   moveit_msgs::PlanningScene planning_scene;
   planning_scene.is_diff = true;
 
-  // Remove the existing tables
   std::map<std::string, object_recognition_msgs::Table>::iterator it;
   for (it = current_tables_in_collision_world_.begin(); it != current_tables_in_collision_world_.end(); ++it)
   {
@@ -104,13 +178,10 @@ bool SemanticWorld::addTablesToCollisionWorld()
     co.id = it->first;
     co.operation = moveit_msgs::CollisionObject::REMOVE;
     planning_scene.world.collision_objects.push_back(co);
-    //    collision_object_publisher_.publish(co);
   }
-
-  planning_scene_diff_publisher_.publish(planning_scene);
-  planning_scene.world.collision_objects.clear();
   current_tables_in_collision_world_.clear();
-  // Add the new tables
+  current_table_geometry_.clear();
+
   for (std::size_t i = 0; i < table_array_.tables.size(); ++i)
   {
     moveit_msgs::CollisionObject co;
@@ -118,56 +189,65 @@ bool SemanticWorld::addTablesToCollisionWorld()
     ss << "table_" << i;
     co.id = ss.str();
     current_tables_in_collision_world_[co.id] = table_array_.tables[i];
-    co.operation = moveit_msgs::CollisionObject::ADD;
-
-    const std::vector<geometry_msgs::Point>& convex_hull = table_array_.tables[i].convex_hull;
-
-    EigenSTL::vector_Vector3d vertices(convex_hull.size());
-    std::vector<unsigned int> triangles((vertices.size() - 2) * 3);
-    for (unsigned int j = 0; j < convex_hull.size(); ++j)
-      vertices[j] = Eigen::Vector3d(convex_hull[j].x, convex_hull[j].y, convex_hull[j].z);
-    for (unsigned int j = 1; j < triangles.size() - 1; ++j)
-    {
-      unsigned int i3 = j * 3;
-      triangles[i3++] = 0;
-      triangles[i3++] = j;
-      triangles[i3] = j + 1;
-    }
-
-    shapes::Shape* table_shape = shapes::createMeshFromVertices(vertices, triangles);
-    if (!table_shape)
-      continue;
-
-    shapes::Mesh* table_mesh = static_cast<shapes::Mesh*>(table_shape);
-    shapes::Mesh* table_mesh_solid = orientPlanarPolygon(*table_mesh);
-    if (!table_mesh_solid)
-    {
-      delete table_shape;
-      continue;
-    }
-
-    shapes::ShapeMsg table_shape_msg;
-    if (!shapes::constructMsgFromShape(table_mesh_solid, table_shape_msg))
-    {
-      delete table_shape;
-      delete table_mesh_solid;
+    current_table_geometry_[co.id] = table_geometry_[i];
+    if (!table_geometry_[i] || !table_geometry_[i]->has_mesh_)
       continue;
-    }
-
-    const shape_msgs::Mesh& table_shape_msg_mesh = boost::get<shape_msgs::Mesh>(table_shape_msg);
 
-    co.meshes.push_back(table_shape_msg_mesh);
+    co.operation = moveit_msgs::CollisionObject::ADD;
+    co.meshes.push_back(table_geometry_[i]->mesh_);
     co.mesh_poses.push_back(table_array_.tables[i].pose);
     co.header = table_array_.tables[i].header;
     planning_scene.world.collision_objects.push_back(co);
-    //    collision_object_publisher_.publish(co);
-    delete table_shape;
-    delete table_mesh_solid;
   }
   planning_scene_diff_publisher_.publish(planning_scene);
   return true;
 }
 
+SemanticWorld::TableGeometryConstPtr SemanticWorld::computeTableGeometry(const object_recognition_msgs::Table& table,
+                                                                         bool with_mesh) const
+{
+  std::shared_ptr<TableGeometry> geometry(new TableGeometry());
+  if (!computeTableContour(table, geometry->x_min_, geometry->y_min_, geometry->contour_))
+    return TableGeometryConstPtr();
+  geometry->bounds_ = cv::boundingRect(geometry->contour_);
+  tf::poseMsgToEigen(table.pose, geometry->table_pose_inverse_);
+  geometry->table_pose_inverse_ = geometry->table_pose_inverse_.inverse(Eigen::Isometry);
+
+  geometry->has_mesh_ = false;
+  const std::vector<geometry_msgs::Point>& convex_hull = table.convex_hull;
+  if (!with_mesh || convex_hull.size() < 3)
+    return geometry;
+
+  // triangulate the convex hull as a fan around its first vertex
+  EigenSTL::vector_Vector3d vertices(convex_hull.size());
+  std::vector<unsigned int> triangles((vertices.size() - 2) * 3);
+  for (unsigned int j = 0; j < convex_hull.size(); ++j)
+    vertices[j] = Eigen::Vector3d(convex_hull[j].x, convex_hull[j].y, convex_hull[j].z);
+  for (unsigned int j = 1; j + 1 < convex_hull.size(); ++j)
+  {
+    unsigned int i3 = (j - 1) * 3;
+    triangles[i3++] = 0;
+    triangles[i3++] = j;
+    triangles[i3] = j + 1;
+  }
+
+  shapes::Shape* table_shape = shapes::createMeshFromVertices(vertices, triangles);
+  if (!table_shape)
+    return geometry;
+
+  shapes::Mesh* table_mesh = static_cast<shapes::Mesh*>(table_shape);
+  shapes::Mesh* table_mesh_solid = orientPlanarPolygon(*table_mesh);
+  shapes::ShapeMsg table_shape_msg;
+  if (table_mesh_solid && shapes::constructMsgFromShape(table_mesh_solid, table_shape_msg))
+  {
+    geometry->mesh_ = boost::get<shape_msgs::Mesh>(table_shape_msg);
+    geometry->has_mesh_ = true;
+  }
+  delete table_shape;
+  delete table_mesh_solid;
+  return geometry;
+}
+
 object_recognition_msgs::TableArray SemanticWorld::getTablesInROI(double minx, double miny, double minz, double maxx,
                                                                   double maxy, double maxz) const
 {
@@ -205,7 +285,9 @@ std::vector<std::string> SemanticWorld::getTableNamesInROI(double minx, double m
 void SemanticWorld::clear()
 {
   table_array_.tables.clear();
+  table_geometry_.clear();
   current_tables_in_collision_world_.clear();
+  current_table_geometry_.clear();
 }
 
 std::vector<geometry_msgs::PoseStamped>
@@ -310,49 +392,25 @@ std::vector<geometry_msgs::PoseStamped> SemanticWorld::generatePlacePoses(const
                                                                           double min_distance_from_edge) const
 {
   std::vector<geometry_msgs::PoseStamped> place_poses;
-  // Assumption that the table's normal is along the Z axis
-  if (table.convex_hull.empty())
+  float x_min, y_min;
+  std::vector<cv::Point> contour;
+  if (!computeTableContour(table, x_min, y_min, contour))
     return place_poses;
-  const int scale_factor = 100;
-  std::vector<cv::Point2f> table_contour;
-  float x_min = table.convex_hull[0].x, x_max = x_min, y_min = table.convex_hull[0].y, y_max = y_min;
-  for (std::size_t j = 1; j < table.convex_hull.size(); ++j)
-  {
-    if (table.convex_hull[j].x < x_min)
-      x_min = table.convex_hull[j].x;
-    else if (table.convex_hull[j].x > x_max)
-      x_max = table.convex_hull[j].x;
-    if (table.convex_hull[j].y < y_min)
-      y_min = table.convex_hull[j].y;
-    else if (table.convex_hull[j].y > y_max)
-      y_max = table.convex_hull[j].y;
-  }
-  for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
-    table_contour.push_back(
-        cv::Point((table.convex_hull[j].x - x_min) * scale_factor, (table.convex_hull[j].y - y_min) * scale_factor));
-
-  double x_range = fabs(x_max - x_min);
-  double y_range = fabs(y_max - y_min);
-  int max_range = (int)x_range + 1;
-  if (max_range < (int)y_range + 1)
-    max_range = (int)y_range + 1;
-
-  int image_scale = std::max<int>(max_range, 4);
-  cv::Mat src = cv::Mat::zeros(image_scale * scale_factor, image_scale * scale_factor, CV_8UC1);
+  const int scale_factor = TABLE_SCALE_FACTOR;
 
+  float x_max = x_min, y_max = y_min;
   for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
   {
-    cv::line(src, table_contour[j], table_contour[(j + 1) % table.convex_hull.size()], cv::Scalar(255), 3, 8);
+    x_max = std::max<float>(x_max, table.convex_hull[j].x);
+    y_max = std::max<float>(y_max, table.convex_hull[j].y);
   }
-
   unsigned int num_x = fabs(x_max - x_min) / resolution + 1;
   unsigned int num_y = fabs(y_max - y_min) / resolution + 1;
 
   ROS_DEBUG("Num points for possible place operations: %d %d", num_x, num_y);
 
-  std::vector<std::vector<cv::Point> > contours;
-  std::vector<cv::Vec4i> hierarchy;
-  cv::findContours(src, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+  Eigen::Affine3d pose;
+  tf::poseMsgToEigen(table.pose, pose);
 
   for (std::size_t j = 0; j < num_x; ++j)
   {
@@ -363,13 +421,11 @@ std::vector<geometry_msgs::PoseStamped> SemanticWorld::generatePlacePoses(const
       {
         int point_y = k * resolution * scale_factor;
         cv::Point2f point2f(point_x, point_y);
-        double result = cv::pointPolygonTest(contours[0], point2f, true);
+        double result = cv::pointPolygonTest(contour, point2f, true);
         if ((int)result >= (int)(min_distance_from_edge * scale_factor))
         {
           Eigen::Vector3d point((double)(point_x) / scale_factor + x_min, (double)(point_y) / scale_factor + y_min,
                                 height_above_table + mm * delta_height);
-          Eigen::Affine3d pose;
-          tf::poseMsgToEigen(table.pose, pose);
           point = pose * point;
           geometry_msgs::PoseStamped place_pose;
           place_pose.pose.orientation.w = 1.0;
@@ -385,91 +441,86 @@ std::vector<geometry_msgs::PoseStamped> SemanticWorld::generatePlacePoses(const
   return place_poses;
 }
 
-bool SemanticWorld::isInsideTableContour(const geometry_msgs::Pose& pose, const object_recognition_msgs::Table& table,
-                                         double min_distance_from_edge, double min_vertical_offset) const
+bool SemanticWorld::isInsideTableContour(const geometry_msgs::Pose& pose, const TableGeometry& table,
+                                         double min_distance_from_edge, double min_vertical_offset)
 {
-  // Assumption that the table's normal is along the Z axis
-  if (table.convex_hull.empty())
-    return false;
-  float x_min = table.convex_hull[0].x, x_max = x_min, y_min = table.convex_hull[0].y, y_max = y_min;
-  for (std::size_t j = 1; j < table.convex_hull.size(); ++j)
-  {
-    if (table.convex_hull[j].x < x_min)
-      x_min = table.convex_hull[j].x;
-    else if (table.convex_hull[j].x > x_max)
-      x_max = table.convex_hull[j].x;
-    if (table.convex_hull[j].y < y_min)
-      y_min = table.convex_hull[j].y;
-    else if (table.convex_hull[j].y > y_max)
-      y_max = table.convex_hull[j].y;
-  }
-  const int scale_factor = 100;
-  std::vector<cv::Point2f> table_contour;
-  for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
-    table_contour.push_back(
-        cv::Point((table.convex_hull[j].x - x_min) * scale_factor, (table.convex_hull[j].y - y_min) * scale_factor));
-
-  double x_range = fabs(x_max - x_min);
-  double y_range = fabs(y_max - y_min);
-  int max_range = (int)x_range + 1;
-  if (max_range < (int)y_range + 1)
-    max_range = (int)y_range + 1;
-
-  int image_scale = std::max<int>(max_range, 4);
-  cv::Mat src = cv::Mat::zeros(image_scale * scale_factor, image_scale * scale_factor, CV_8UC1);
-
-  for (std::size_t j = 0; j < table.convex_hull.size(); ++j)
-  {
-    cv::line(src, table_contour[j], table_contour[(j + 1) % table.convex_hull.size()], cv::Scalar(255), 3, 8);
-  }
-
-  std::vector<std::vector<cv::Point> > contours;
-  std::vector<cv::Vec4i> hierarchy;
-  cv::findContours(src, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
-
-  Eigen::Vector3d point(pose.position.x, pose.position.y, pose.position.z);
-  Eigen::Affine3d pose_table;
-  tf::poseMsgToEigen(table.pose, pose_table);
-
   // Point in table frame
-  point = pose_table.inverse(Eigen::Isometry) * point;
+  Eigen::Vector3d point(pose.position.x, pose.position.y, pose.position.z);
+  point = table.table_pose_inverse_ * point;
   // Assuming Z axis points upwards for the table
   if (point.z() < -fabs(min_vertical_offset))
   {
-    ROS_ERROR("Object is not above table");
+    ROS_DEBUG("Object is not above table");
     return false;
   }
 
-  int point_x = (point.x() - x_min) * scale_factor;
-  int point_y = (point.y() - y_min) * scale_factor;
+  int point_x = (point.x() - table.x_min_) * TABLE_SCALE_FACTOR;
+  int point_y = (point.y() - table.y_min_) * TABLE_SCALE_FACTOR;
+  // points more than a pixel outside the bounding box of the contour are at least a pixel away from it
+  const cv::Rect& bounds = table.bounds_;
+  if (min_distance_from_edge >= 0.0 && (point_x < bounds.x - 1 || point_x > bounds.x + bounds.width ||
+                                        point_y < bounds.y - 1 || point_y > bounds.y + bounds.height))
+    return false;
+
   cv::Point2f point2f(point_x, point_y);
-  double result = cv::pointPolygonTest(contours[0], point2f, true);
+  double result = cv::pointPolygonTest(table.contour_, point2f, true);
   ROS_DEBUG("table distance: %f", result);
 
-  if ((int)result >= (int)(min_distance_from_edge * scale_factor))
-    return true;
+  return (int)result >= (int)(min_distance_from_edge * TABLE_SCALE_FACTOR);
+}
+
+bool SemanticWorld::isInsideTableContour(const geometry_msgs::Pose& pose, const object_recognition_msgs::Table& table,
+                                         double min_distance_from_edge, double min_vertical_offset) const
+{
+  TableGeometryConstPtr geometry = computeTableGeometry(table, false);
+  return geometry && isInsideTableContour(pose, *geometry, min_distance_from_edge, min_vertical_offset);
+}
 
-  return false;
+void SemanticWorld::isInsideTableContour(const std::vector<geometry_msgs::Pose>& poses,
+                                         const object_recognition_msgs::Table& table, double min_distance_from_edge,
+                                         double min_vertical_offset, std::vector<bool>& inside) const
+{
+  inside.assign(poses.size(), false);
+  TableGeometryConstPtr geometry = computeTableGeometry(table, false);
+  if (geometry)
+    for (std::size_t i = 0; i < poses.size(); ++i)
+      inside[i] = isInsideTableContour(poses[i], *geometry, min_distance_from_edge, min_vertical_offset);
 }
 
 std::string SemanticWorld::findObjectTable(const geometry_msgs::Pose& pose, double min_distance_from_edge,
                                            double min_vertical_offset) const
 {
-  std::map<std::string, object_recognition_msgs::Table>::const_iterator it;
-  for (it = current_tables_in_collision_world_.begin(); it != current_tables_in_collision_world_.end(); ++it)
+  std::map<std::string, TableGeometryConstPtr>::const_iterator it;
+  for (it = current_table_geometry_.begin(); it != current_table_geometry_.end(); ++it)
   {
     ROS_DEBUG("Testing table: %s", it->first.c_str());
-    if (isInsideTableContour(pose, it->second, min_distance_from_edge, min_vertical_offset))
+    if (it->second && isInsideTableContour(pose, *it->second, min_distance_from_edge, min_vertical_offset))
       return it->first;
   }
   return std::string();
 }
 
+std::vector<std::string> SemanticWorld::findObjectTables(const std::vector<geometry_msgs::Pose>& poses,
+                                                         double min_distance_from_edge,
+                                                         double min_vertical_offset) const
+{
+  std::vector<std::string> tables(poses.size());
+  for (std::size_t i = 0; i < poses.size(); ++i)
+    tables[i] = findObjectTable(poses[i], min_distance_from_edge, min_vertical_offset);
+  return tables;
+}
+
 void SemanticWorld::tableCallback(const object_recognition_msgs::TableArrayPtr& msg)
 {
   table_array_ = *msg;
   ROS_INFO("Table callback with %d tables", (int)table_array_.tables.size());
   transformTableArray(table_array_);
+
+  // compute the meshes and contours once for all later uses of the tables
+  table_geometry_.resize(table_array_.tables.size());
+  for (std::size_t i = 0; i < table_array_.tables.size(); ++i)
+    table_geometry_[i] = computeTableGeometry(table_array_.tables[i], true);
+
   // Callback on an update
   if (table_callback_)
   {
@@ -50,7 +50,9 @@ public:
   CollisionPluginLoader();
   ~CollisionPluginLoader();
 
-  /** @brief This can be called on a new planning scene to setup the collision detector. */
+  /** @brief This can be called on a new planning scene to setup the collision detector. The ~fcl_broadphase
+   * parameter (see collision_detection::parseBroadphaseType()) sets the broadphase of the FCL worlds and robots
+   * constructed after this call, so it is best called before the scene is constructed (\e scene may be NULL). */
   void setupScene(ros::NodeHandle& nh, const planning_scene::PlanningScenePtr& scene);
 
   /**
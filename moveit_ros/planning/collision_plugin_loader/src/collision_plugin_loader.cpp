@@ -33,6 +33,7 @@
  *********************************************************************/
 
 #include <moveit/collision_plugin_loader/collision_plugin_loader.h>
+#include <moveit/collision_detection_fcl/collision_common.h>
 #include <pluginlib/class_loader.hpp>
 #include <memory>
 
@@ -107,28 +108,47 @@ bool CollisionPluginLoader::activate(const std::string& name, const planning_sce
   return loader_->activate(name, scene, exclusive);
 }
 
+namespace
+{
+bool getCollisionParam(ros::NodeHandle& nh, const std::string& name, std::string& value)
+{
+  std::string param_name;
+  if (nh.searchParam(name, param_name))
+    return nh.getParam(param_name, value);
+  // Check for existence in move_group namespace
+  // mainly for rviz plugins to get same collision detector.
+  if (nh.hasParam("/move_group/" + name))
+    return nh.getParam("/move_group/" + name, value);
+  return false;
+}
+}
+
 void CollisionPluginLoader::setupScene(ros::NodeHandle& nh, const planning_scene::PlanningScenePtr& scene)
 {
+  // the broadphase of the FCL collision detector is set up first, as it applies to the FCL collision worlds and
+  // robots constructed from now on, even if no scene is passed
+  std::string broadphase_name;
+  if (getCollisionParam(nh, "fcl_broadphase", broadphase_name) && !broadphase_name.empty())
+  {
+    collision_detection::BroadphaseType broadphase;
+    if (collision_detection::parseBroadphaseType(broadphase_name, broadphase))
+    {
+      if (broadphase != collision_detection::getDefaultBroadphaseType())
+        ROS_INFO_STREAM("Using FCL broadphase: " << broadphase_name);
+      collision_detection::setDefaultBroadphaseType(broadphase);
+    }
+    else
+      ROS_ERROR("Unknown FCL broadphase '%s'. Known types are dynamic_aabb_tree, dynamic_aabb_tree_array, sap, ssap, "
+                "interval_tree, naive and auto",
+                broadphase_name.c_str());
+  }
+
   if (!scene)
     return;
 
-  std::string param_name;
   std::string collision_detector_name;
-
-  if (nh.searchParam("collision_detector", param_name))
-  {
-    nh.getParam(param_name, collision_detector_name);
-  }
-  else if (nh.hasParam("/move_group/collision_detector"))
-  {
-    // Check for existence in move_group namespace
-    // mainly for rviz plugins to get same collision detector.
-    nh.getParam("/move_group/collision_detector", collision_detector_name);
-  }
-  else
-  {
+  if (!getCollisionParam(nh, "collision_detector", collision_detector_name))
     return;
-  }
 
   if (collision_detector_name == "")
   {
@@ -47,6 +47,18 @@ class ConstraintSamplerManagerLoader::Helper
 public:
   Helper(const constraint_samplers::ConstraintSamplerManagerPtr& csm) : nh_("~")
   {
+    // samples found for constraints that are requested again are reused, if enabled
+    int sample_pool_size, samples_per_constraint_set;
+    nh_.param("constraint_sample_pool_size", sample_pool_size, 0);
+    nh_.param("constraint_sample_pool_samples", samples_per_constraint_set, 16);
+    if (sample_pool_size > 0 && samples_per_constraint_set > 0)
+    {
+      csm->setSamplePool(constraint_samplers::ConstraintSamplePoolPtr(
+          new constraint_samplers::ConstraintSamplePool(sample_pool_size, samples_per_constraint_set)));
+      ROS_INFO("Keeping up to %d samples for each of the last %d constraint sets", samples_per_constraint_set,
+               sample_pool_size);
+    }
+
     std::string constraint_samplers;
     if (nh_.getParam("constraint_samplers", constraint_samplers))
     {
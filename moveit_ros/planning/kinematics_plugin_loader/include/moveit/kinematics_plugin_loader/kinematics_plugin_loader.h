@@ -105,6 +105,12 @@ public:
     return ik_attempts_;
   }
 
+  /** \brief Get a map from group name to the file of the reachability map of the group */
+  const std::map<std::string, std::string>& getReachabilityMaps() const
+  {
+    return reachability_maps_;
+  }
+
   void status() const;
 
 private:
@@ -117,6 +123,7 @@ private:
   std::vector<std::string> groups_;
   std::map<std::string, double> ik_timeout_;
   std::map<std::string, unsigned int> ik_attempts_;
+  std::map<std::string, std::string> reachability_maps_;
 
   // default configuration
   std::string default_solver_plugin_;
@@ -139,14 +139,16 @@ public:
           possible_kinematics_solvers_.find(jmg->getName());
       if (it != possible_kinematics_solvers_.end())
       {
-        // just to be sure, do not call the same pluginlib instance allocation function in parallel
-        boost::mutex::scoped_lock slock(lock_);
-
         for (std::size_t i = 0; !result && i < it->second.size(); ++i)
         {
           try
           {
-            result = kinematics_loader_->createUniqueInstance(it->second[i]);
+            {
+              // just to be sure, do not call the same pluginlib instance allocation function in parallel; the
+              // solvers are initialized concurrently though, as this can take long
+              boost::mutex::scoped_lock slock(lock_);
+              result = kinematics_loader_->createUniqueInstance(it->second[i]);
+            }
             if (result)
             {
               const std::vector<const robot_model::LinkModel*>& links = jmg->getLinkModels();
@@ -355,6 +357,15 @@ kinematics_plugin_loader::KinematicsPluginLoader::getLoaderFunction(const srdf::
               ik_attempts_[known_groups[i].name_] = ksolver_attempts;
           }
 
+          // the file of a precomputed reachability map (see moveit_generate_reachability_map)
+          std::string reachability_map_param_name;
+          if (nh.searchParam(base_param_name + "/reachability_map", reachability_map_param_name))
+          {
+            std::string reachability_map;
+            if (nh.getParam(reachability_map_param_name, reachability_map) && !reachability_map.empty())
+              reachability_maps_[known_groups[i].name_] = reachability_map;
+          }
+
           std::string ksolver_res_param_name;
           if (nh.searchParam(base_param_name + "/kinematics_solver_search_resolution", ksolver_res_param_name))
           {
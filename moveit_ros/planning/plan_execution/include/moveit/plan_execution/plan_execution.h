@@ -44,6 +44,7 @@
 #include <moveit/planning_scene_monitor/trajectory_monitor.h>
 #include <moveit/sensor_manager/sensor_manager.h>
 #include <pluginlib/class_loader.hpp>
+#include <limits>
 
 /** \brief This namespace includes functionality specific to the execution and monitoring of motion plans */
 namespace plan_execution
@@ -55,7 +56,7 @@ class PlanExecution
 public:
   struct Options
   {
-    Options() : replan_(false), replan_attempts_(0), replan_delay_(0.0)
+    Options() : replan_(false), replan_attempts_(0), replan_delay_(0.0), replan_lookahead_(0.0)
     {
     }
 
@@ -69,6 +70,12 @@ public:
     /// The amount of time to wait in between replanning attempts (in seconds)
     double replan_delay_;
 
+    /// If replanning is allowed and this is positive, the robot is not stopped when the path becomes invalid during
+    /// execution. Instead, a new plan is computed (using plan_callback_) from the state the robot is expected to reach
+    /// this many seconds later, and spliced into the running execution at that time. The robot is stopped as before if
+    /// the path is invalid before that state, or if the new plan is not ready in time.
+    double replan_lookahead_;
+
     /// Callback for computing motion plans. This callback must always be specified.
     ExecutableMotionPlanComputationFn plan_callback_;
 
@@ -143,7 +150,9 @@ public:
 private:
   void planAndExecuteHelper(ExecutableMotionPlan& plan, const Options& opt);
   bool isRemainingPathValid(const ExecutableMotionPlan& plan);
-  bool isRemainingPathValid(const ExecutableMotionPlan& plan, const std::pair<int, int>& path_segment);
+  bool isRemainingPathValid(const ExecutableMotionPlan& plan, const std::pair<int, int>& path_segment,
+                            std::size_t end_waypoint = std::numeric_limits<std::size_t>::max());
+  bool replanDuringExecution(ExecutableMotionPlan& plan);
 
   void planningSceneUpdatedCallback(const planning_scene_monitor::PlanningSceneMonitor::SceneUpdateType update_type);
   void doneWithTrajectoryExecution(const moveit_controller_manager::ExecutionStatus& status);
@@ -156,6 +165,10 @@ private:
 
   unsigned int default_max_replan_attempts_;
 
+  // set by planAndExecute() when replanning during execution is enabled
+  ExecutableMotionPlanComputationFn replan_callback_;
+  double replan_lookahead_;
+
   bool preempt_requested_;
   bool new_scene_update_;
 
@@ -81,6 +81,7 @@ plan_execution::PlanExecution::PlanExecution(
         planning_scene_monitor_->getRobotModel(), planning_scene_monitor_->getStateMonitor()));
 
   default_max_replan_attempts_ = 5;
+  replan_lookahead_ = 0.0;
 
   preempt_requested_ = false;
   new_scene_update_ = false;
@@ -168,6 +169,10 @@ void plan_execution::PlanExecution::planAndExecuteHelper(ExecutableMotionPlan& p
   unsigned int replan_attempts = 0;
   bool previously_solved = false;
 
+  // allow executeAndMonitor() to replan without stopping, if requested
+  replan_lookahead_ = opt.replan_ ? opt.replan_lookahead_ : 0.0;
+  replan_callback_ = opt.plan_callback_;
+
   // run a planning loop for at most the maximum replanning attempts;
   // re-planning is executed only in case of known types of failures (e.g., environment changed)
   do
@@ -245,6 +250,9 @@ void plan_execution::PlanExecution::planAndExecuteHelper(ExecutableMotionPlan& p
     }
   } while (!preempt_requested_ && max_replan_attempts > replan_attempts);
 
+  replan_lookahead_ = 0.0;
+  replan_callback_ = ExecutableMotionPlanComputationFn();
+
   if (preempt_requested_)
   {
     ROS_DEBUG_NAMED("plan_execution", "PlanExecution was preempted");
@@ -269,7 +277,8 @@ bool plan_execution::PlanExecution::isRemainingPathValid(const ExecutableMotionP
 }
 
 bool plan_execution::PlanExecution::isRemainingPathValid(const ExecutableMotionPlan& plan,
-                                                         const std::pair<int, int>& path_segment)
+                                                         const std::pair<int, int>& path_segment,
+                                                         std::size_t end_waypoint)
 {
   if (path_segment.first >= 0 &&
       plan.plan_components_[path_segment.first].trajectory_monitoring_)  // If path_segment.second <= 0, the function
@@ -282,11 +291,15 @@ bool plan_execution::PlanExecution::isRemainingPathValid(const ExecutableMotionP
     const robot_trajectory::RobotTrajectory& t = *plan.plan_components_[path_segment.first].trajectory_;
     const collision_detection::AllowedCollisionMatrix* acm =
         plan.plan_components_[path_segment.first].allowed_collision_matrix_.get();
-    std::size_t wpc = t.getWayPointCount();
+    std::size_t wpc = std::min(t.getWayPointCount(), end_waypoint);
     collision_detection::CollisionRequest req;
     req.group_name = t.getGroupName();
-    for (std::size_t i = std::max(path_segment.second - 1, 0); i < wpc; ++i)
+    // check the remaining waypoints coarse to fine, so an obstacle that appeared in the way is found quickly
+    std::size_t start = std::max(path_segment.second - 1, 0);
+    std::vector<std::size_t> order = trajectory_processing::coarseToFineOrder(wpc > start ? wpc - start : 0);
+    for (std::size_t k = 0; k < order.size(); ++k)
     {
+      std::size_t i = start + order[k];
       collision_detection::CollisionResult res;
       if (acm)
         plan.planning_scene_->checkCollisionUnpadded(req, res, t.getWayPoint(i), *acm);
@@ -314,6 +327,73 @@ bool plan_execution::PlanExecution::isRemainingPathValid(const ExecutableMotionP
   return true;
 }
 
+bool plan_execution::PlanExecution::replanDuringExecution(ExecutableMotionPlan& plan)
+{
+  // only the last component can be replaced, since the new plan ends at the goal
+  std::pair<int, int> index = trajectory_execution_manager_->getCurrentExpectedTrajectoryIndex();
+  ros::Time trajectory_start = trajectory_execution_manager_->getCurrentExpectedTrajectoryStartTime();
+  if (!replan_callback_ || index.first < 0 || index.first + 1 != (int)plan.plan_components_.size() ||
+      !plan.plan_components_[index.first].trajectory_ || trajectory_start.isZero())
+    return false;
+  const robot_trajectory::RobotTrajectory& trajectory = *plan.plan_components_[index.first].trajectory_;
+
+  // the new plan starts where the robot is expected to be when it is spliced in
+  ros::Time splice_time = ros::Time::now() + ros::Duration(replan_lookahead_);
+  double splice_duration = trajectory.getWayPointDurationFromStart(0) + (splice_time - trajectory_start).toSec();
+  if (splice_duration >= trajectory.getDuration())
+    return false;
+  int before, after;
+  double blend;
+  trajectory.findWayPointIndicesForDurationAfterStart(splice_duration, before, after, blend);
+  if (!isRemainingPathValid(plan, index, after + 1))
+    return false;
+  robot_state::RobotStatePtr splice_state(new robot_state::RobotState(trajectory.getFirstWayPoint()));
+  if (!trajectory.getStateAtDurationFromStart(splice_duration, splice_state))
+    return false;
+
+  ExecutableMotionPlan new_plan;
+  new_plan.planning_scene_monitor_ = plan.planning_scene_monitor_;
+  {
+    planning_scene_monitor::LockedPlanningSceneRO lscene(plan.planning_scene_monitor_);
+    planning_scene::PlanningScenePtr scene = plan.planning_scene_->diff();
+    scene->setCurrentState(*splice_state);
+    new_plan.planning_scene_ = scene;
+  }
+
+  ROS_INFO_NAMED("plan_execution", "Replanning from the state expected in %lf seconds, while executing",
+                 replan_lookahead_);
+  bool solved = false;
+  boost::thread planning_thread([this, &new_plan, &solved]() { solved = replan_callback_(new_plan); });
+
+  // the new trajectory has to reach the controllers before the splice time
+  static const ros::Duration SPLICE_MARGIN(0.05);
+  while (!planning_thread.timed_join(boost::posix_time::milliseconds(10)))
+    if (preempt_requested_ || execution_complete_ || ros::Time::now() + SPLICE_MARGIN >= splice_time)
+    {
+      ROS_INFO_NAMED("plan_execution", "No new plan in time to continue the execution");
+      trajectory_execution_manager_->stopExecution();
+      planning_thread.join();
+      return false;
+    }
+
+  if (!solved || new_plan.error_code_.val != moveit_msgs::MoveItErrorCodes::SUCCESS ||
+      new_plan.plan_components_.size() != 1 || !new_plan.plan_components_[0].trajectory_ ||
+      new_plan.plan_components_[0].trajectory_->empty())
+    return false;
+
+  robot_trajectory::RobotTrajectoryPtr new_trajectory = new_plan.plan_components_[0].trajectory_;
+  new_trajectory->unwind(*splice_state);
+  moveit_msgs::RobotTrajectory msg;
+  new_trajectory->getRobotTrajectoryMsg(msg);
+  if (!trajectory_execution_manager_->spliceTrajectory(msg, splice_time))
+    return false;
+
+  // monitor the new trajectory from now on
+  plan.plan_components_[index.first].trajectory_ = new_trajectory;
+  ROS_INFO_NAMED("plan_execution", "Execution continues with the new plan");
+  return true;
+}
+
 moveit_msgs::MoveItErrorCodes plan_execution::PlanExecution::executeAndMonitor(ExecutableMotionPlan& plan)
 {
   if (!plan.planning_scene_monitor_)
@@ -380,7 +460,7 @@ moveit_msgs::MoveItErrorCodes plan_execution::PlanExecution::executeAndMonitor(E
     // convert to message, pass along
     moveit_msgs::RobotTrajectory msg;
     plan.plan_components_[i].trajectory_->getRobotTrajectoryMsg(msg);
-    if (!trajectory_execution_manager_->push(msg))
+    if (!trajectory_execution_manager_->push(std::move(msg)))
     {
       trajectory_execution_manager_->clear();
       ROS_ERROR_STREAM_NAMED("plan_execution", "Apparently trajectory initialization failed");
@@ -412,7 +492,7 @@ moveit_msgs::MoveItErrorCodes plan_execution::PlanExecution::executeAndMonitor(E
     if (new_scene_update_)
     {
       new_scene_update_ = false;
-      if (!isRemainingPathValid(plan))
+      if (!isRemainingPathValid(plan) && (replan_lookahead_ <= 0.0 || !replanDuringExecution(plan)))
       {
         path_became_invalid_ = true;
         break;
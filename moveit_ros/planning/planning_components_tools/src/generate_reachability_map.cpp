@@ -0,0 +1,306 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_model/reachability_map.h>
+#include <moveit/robot_state/robot_state.h>
+#include <ros/ros.h>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/thread.hpp>
+
+static const std::string ROBOT_DESCRIPTION = "robot_description";
+
+struct MapSettings
+{
+  robot_model::RobotModelConstPtr model;
+  const robot_model::JointModelGroup* group;
+  const robot_model::LinkModel* base;
+  const robot_model::LinkModel* tip;
+  Eigen::Vector3d approach_axis;
+  unsigned int samples;
+  unsigned int rolls;
+  double ik_timeout;
+};
+
+// Record the poses of the tip for random states of the group
+void sampleForwardKinematics(const MapSettings* settings, robot_model::ReachabilityMap* map)
+{
+  random_numbers::RandomNumberGenerator rng;
+  robot_state::RobotState state(settings->model);
+  state.setToDefaultValues();
+  for (unsigned int i = 0; i < settings->samples; ++i)
+  {
+    state.setToRandomPositions(settings->group, rng);
+    state.updateLinkTransforms();
+    map->addPose(state.getGlobalLinkTransform(settings->base).inverse(Eigen::Isometry) *
+                 state.getGlobalLinkTransform(settings->tip));
+  }
+}
+
+// Solve IK for the approach directions that were not reached by sampling, at the centers of the given voxels
+void fillWithInverseKinematics(const MapSettings* settings, const kinematics::KinematicsBaseConstPtr& solver,
+                               const std::vector<std::size_t>* voxels, robot_model::ReachabilityMap* map,
+                               std::vector<std::uint64_t>* found)
+{
+  robot_state::RobotState state(settings->model);
+  state.setToDefaultValues();
+  state.updateLinkTransforms();
+  const Eigen::Affine3d& base = state.getGlobalLinkTransform(settings->base);
+
+  for (std::size_t v = 0; v < voxels->size(); ++v)
+  {
+    std::size_t voxel = (*voxels)[v];
+    std::uint64_t known = map->getDirections(voxel);
+    Eigen::Translation3d center(map->getVoxelCenter(voxel));
+
+    // one query for every missing direction, for each of the rotations about the approach axis
+    EigenSTL::vector_Affine3d poses;
+    std::vector<std::size_t> directions;
+    for (std::size_t d = 0; d < robot_model::ReachabilityMap::DIRECTION_COUNT; ++d)
+    {
+      if ((known >> d) & 1)
+        continue;
+      Eigen::Vector3d direction = robot_model::ReachabilityMap::getDirection(d);
+      Eigen::Quaterniond align = Eigen::Quaterniond::FromTwoVectors(settings->approach_axis, direction);
+      for (unsigned int r = 0; r < settings->rolls; ++r)
+      {
+        poses.push_back(base * center * Eigen::AngleAxisd(2.0 * M_PI * r / settings->rolls, direction) * align);
+        directions.push_back(d);
+      }
+    }
+    if (poses.empty())
+      continue;
+
+    std::vector<std::vector<double> > solutions;
+    state.computeIKBatch(settings->group, solver, poses, settings->tip->getName(), solutions, settings->ik_timeout);
+    for (std::size_t i = 0; i < solutions.size(); ++i)
+      if (!solutions[i].empty())
+        (*found)[v] |= (std::uint64_t)1 << directions[i];
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "generate_reachability_map");
+
+  std::string group_name, output, tip_name, axis = "x";
+  double resolution = 0.05;
+  double ik_timeout = 0.005;
+  unsigned int samples = 1000000;
+  unsigned int rolls = 4;
+  unsigned int nthreads = std::max(1u, boost::thread::hardware_concurrency());
+
+  boost::program_options::options_description desc;
+  desc.add_options()("help", "this screen")("group", boost::program_options::value<std::string>(&group_name),
+                                            "The group to compute the reachability map for")(
+      "output", boost::program_options::value<std::string>(&output),
+      "The file to write the map to; set it as the reachability_map parameter of the group in kinematics.yaml")(
+      "tip", boost::program_options::value<std::string>(&tip_name),
+      "The link whose poses are recorded (default: the tip of the kinematics solver of the group)")(
+      "axis", boost::program_options::value<std::string>(&axis)->default_value(axis),
+      "The approach axis of the tip link (x, y or z)")(
+      "resolution", boost::program_options::value<double>(&resolution)->default_value(resolution),
+      "The size of the voxels (m)")(
+      "samples", boost::program_options::value<unsigned int>(&samples)->default_value(samples),
+      "The number of random states sampled by each thread")(
+      "rolls", boost::program_options::value<unsigned int>(&rolls)->default_value(rolls),
+      "The number of rotations about the approach axis IK is attempted for, for every direction that was not reached "
+      "by sampling (0 disables IK)")(
+      "ik-timeout", boost::program_options::value<double>(&ik_timeout)->default_value(ik_timeout),
+      "The timeout of each IK query (s)")(
+      "threads", boost::program_options::value<unsigned int>(&nthreads)->default_value(nthreads),
+      "The number of threads to use");
+  boost::program_options::variables_map vm;
+  boost::program_options::parsed_options po = boost::program_options::parse_command_line(argc, argv, desc);
+  boost::program_options::store(po, vm);
+  boost::program_options::notify(vm);
+
+  if (vm.count("help") || group_name.empty() || output.empty())
+  {
+    std::cout << "Usage: moveit_generate_reachability_map --group <group> --output <file> [options]" << std::endl
+              << desc << std::endl;
+    return vm.count("help") ? 0 : 1;
+  }
+  nthreads = std::max(1u, nthreads);
+
+  robot_model_loader::RobotModelLoader rml(ROBOT_DESCRIPTION);
+  const robot_model::RobotModelConstPtr& model = rml.getModel();
+  if (!model)
+  {
+    ROS_ERROR("Unable to load the robot model");
+    return 1;
+  }
+  MapSettings settings;
+  settings.model = model;
+  settings.group = model->getJointModelGroup(group_name);
+  if (!settings.group)
+    return 1;
+  settings.base = settings.group->getCommonRoot() ? settings.group->getCommonRoot()->getParentLinkModel() : NULL;
+  if (!settings.base)
+  {
+    ROS_ERROR("The root joint of group '%s' has no parent link the map could be relative to", group_name.c_str());
+    return 1;
+  }
+  const kinematics::KinematicsBaseConstPtr& solver = settings.group->getSolverInstance();
+  if (tip_name.empty() && solver && solver->getTipFrames().size() == 1)
+    tip_name = solver->getTipFrames()[0];
+  if (!tip_name.empty() && tip_name[0] == '/')
+    tip_name = tip_name.substr(1);
+  settings.tip = tip_name.empty() ? NULL : model->getLinkModel(tip_name);
+  if (!settings.tip)
+  {
+    ROS_ERROR("No tip link to compute the reachability map of group '%s' for", group_name.c_str());
+    return 1;
+  }
+  if (axis == "x")
+    settings.approach_axis = Eigen::Vector3d::UnitX();
+  else if (axis == "y")
+    settings.approach_axis = Eigen::Vector3d::UnitY();
+  else if (axis == "z")
+    settings.approach_axis = Eigen::Vector3d::UnitZ();
+  else
+  {
+    ROS_ERROR("Unknown approach axis '%s'", axis.c_str());
+    return 1;
+  }
+  settings.samples = samples;
+  settings.rolls = rolls;
+  settings.ik_timeout = ik_timeout;
+  ros::WallTime start = ros::WallTime::now();
+
+  // find the workspace of the group
+  Eigen::Vector3d min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+  Eigen::Vector3d max = -min;
+  {
+    robot_state::RobotState state(model);
+    state.setToDefaultValues();
+    for (unsigned int i = 0; i < std::min(samples, 100000u); ++i)
+    {
+      state.setToRandomPositions(settings.group);
+      state.updateLinkTransforms();
+      Eigen::Vector3d p = (state.getGlobalLinkTransform(settings.base).inverse(Eigen::Isometry) *
+                           state.getGlobalLinkTransform(settings.tip)).translation();
+      min = min.cwiseMin(p);
+      max = max.cwiseMax(p);
+    }
+  }
+  if (!(min.x() <= max.x()))
+    min = max = Eigen::Vector3d::Zero();
+  min -= Eigen::Vector3d::Constant(2.0 * resolution);
+  max += Eigen::Vector3d::Constant(2.0 * resolution);
+
+  robot_model::ReachabilityMap map(group_name, settings.base->getName(), settings.tip->getName(), min, max, resolution,
+                                   settings.approach_axis);
+  ROS_INFO("Computing a reachability map of %u voxels for '%s' in the frame of '%s'", (unsigned int)map.getVoxelCount(),
+           settings.tip->getName().c_str(), settings.base->getName().c_str());
+
+  // sample random states in every thread, in maps of their own
+  {
+    std::vector<robot_model::ReachabilityMapPtr> maps(nthreads);
+    boost::thread_group threads;
+    for (unsigned int t = 0; t < nthreads; ++t)
+    {
+      maps[t].reset(new robot_model::ReachabilityMap(group_name, settings.base->getName(), settings.tip->getName(),
+                                                     min, max, resolution, settings.approach_axis));
+      threads.create_thread(boost::bind(&sampleForwardKinematics, &settings, maps[t].get()));
+    }
+    threads.join_all();
+    for (unsigned int t = 0; t < nthreads; ++t)
+      for (std::size_t v = 0; v < map.getVoxelCount(); ++v)
+        map.addDirections(v, maps[t]->getDirections(v));
+  }
+  ROS_INFO("Sampled %u states in %lf s", samples * nthreads, (ros::WallTime::now() - start).toSec());
+
+  // solve IK for the directions sampling did not reach, in the voxels at the boundary of the sampled workspace too
+  const robot_model::SolverAllocatorFn& allocator = settings.group->getGroupKinematics().first.allocator_;
+  if (rolls > 0 && allocator)
+  {
+    std::vector<kinematics::KinematicsBaseConstPtr> solvers;
+    for (unsigned int t = 0; t < nthreads; ++t)
+    {
+      kinematics::KinematicsBaseConstPtr s = allocator(settings.group);
+      // solvers that are shared cannot be used concurrently
+      if (!s || std::find(solvers.begin(), solvers.end(), s) != solvers.end())
+        break;
+      solvers.push_back(s);
+    }
+    if (solvers.empty() && solver)
+      solvers.push_back(solver);
+
+    const std::uint64_t ALL_DIRECTIONS = ((std::uint64_t)1 << robot_model::ReachabilityMap::DIRECTION_COUNT) - 1;
+    std::vector<std::vector<std::size_t> > voxels(solvers.size());
+    std::size_t candidates = 0;
+    for (std::size_t v = 0; v < map.getVoxelCount(); ++v)
+    {
+      Eigen::Vector3d center = map.getVoxelCenter(v);
+      bool near_reachable = false;
+      for (int dx = -1; dx <= 1 && !near_reachable; ++dx)
+        for (int dy = -1; dy <= 1 && !near_reachable; ++dy)
+          for (int dz = -1; dz <= 1 && !near_reachable; ++dz)
+            near_reachable = map.isPositionReachable(center + resolution * Eigen::Vector3d(dx, dy, dz));
+      if (near_reachable && map.getDirections(v) != ALL_DIRECTIONS)
+        voxels[candidates++ % voxels.size()].push_back(v);
+    }
+
+    std::vector<std::vector<std::uint64_t> > found(voxels.size());
+    boost::thread_group threads;
+    for (std::size_t t = 0; t < voxels.size(); ++t)
+    {
+      found[t].resize(voxels[t].size(), 0);
+      threads.create_thread(
+          boost::bind(&fillWithInverseKinematics, &settings, solvers[t], &voxels[t], &map, &found[t]));
+    }
+    threads.join_all();
+    for (std::size_t t = 0; t < voxels.size(); ++t)
+      for (std::size_t v = 0; v < voxels[t].size(); ++v)
+        map.addDirections(voxels[t][v], found[t][v]);
+    ROS_INFO("Solved IK in %u voxels with %u threads after %lf s", (unsigned int)candidates,
+             (unsigned int)solvers.size(), (ros::WallTime::now() - start).toSec());
+  }
+
+  // discretization must not make reachable poses look unreachable
+  map.dilate();
+
+  std::size_t reachable = 0;
+  for (std::size_t v = 0; v < map.getVoxelCount(); ++v)
+    if (map.getDirections(v))
+      ++reachable;
+  ROS_INFO("%u of %u voxels are reachable", (unsigned int)reachable, (unsigned int)map.getVoxelCount());
+
+  if (!map.save(output))
+    return 1;
+  ROS_INFO("Wrote the reachability map to '%s'", output.c_str());
+  return 0;
+}
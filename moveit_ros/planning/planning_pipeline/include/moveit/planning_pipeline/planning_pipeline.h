@@ -41,7 +41,10 @@
 #include <moveit/planning_request_adapter/planning_request_adapter.h>
 #include <pluginlib/class_loader.hpp>
 #include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
 
+#include <list>
+#include <map>
 #include <memory>
 
 /** \brief Planning pipeline */
@@ -119,6 +122,26 @@ public:
     return check_solution_paths_;
   }
 
+  /** \brief Keep the solutions of the last \e size successful requests. A request that repeats one of them, in a
+      scene with the same world, attached objects, allowed collisions and padding, and from a start state that
+      quantizes to the same values (see setPlanCacheStartTolerance()), is answered with the cached path once it is
+      found to be valid again. A size of 0 disables the cache. Read from the ~plan_cache_size parameter; default 0. */
+  void setPlanCacheSize(std::size_t size);
+
+  /** \brief Get the value set by setPlanCacheSize() */
+  std::size_t getPlanCacheSize() const;
+
+  /** \brief Set the resolution to which the variables of the start state are rounded when looking up cached plans.
+      The first state of a cached path is replaced by the actual start state. Read from the
+      ~plan_cache_start_tolerance parameter; default 1e-3. */
+  void setPlanCacheStartTolerance(double tolerance);
+
+  /** \brief Get the value set by setPlanCacheStartTolerance() */
+  double getPlanCacheStartTolerance() const;
+
+  /** \brief Forget all cached plans */
+  void clearPlanCache();
+
   /** \brief Call the motion planner plugin and the sequence of planning request adapters (if any).
       \param planning_scene The planning scene where motion planning is to be done
       \param req The request for motion planning
@@ -167,8 +190,29 @@ public:
   }
 
 private:
+  struct CachedPlan
+  {
+    std::string key_;
+    robot_trajectory::RobotTrajectoryPtr trajectory_;
+    std::vector<std::size_t> adapter_added_state_index_;
+  };
+
   void configure();
 
+  void publishComputedMotionPlan(const planning_interface::MotionPlanResponse& res) const;
+
+  /** \brief Compute the key under which the solution for \e req in \e planning_scene is cached */
+  std::string getPlanCacheKey(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                              const planning_interface::MotionPlanRequest& req) const;
+
+  /** \brief Fill \e res with the cached plan for \e key, if there is one and it is still valid */
+  bool getCachedPlan(const std::string& key, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                     const planning_interface::MotionPlanRequest& req, planning_interface::MotionPlanResponse& res,
+                     std::vector<std::size_t>& adapter_added_state_index) const;
+
+  void addCachedPlan(const std::string& key, const planning_interface::MotionPlanResponse& res,
+                     const std::vector<std::size_t>& adapter_added_state_index) const;
+
   ros::NodeHandle nh_;
 
   /// Flag indicating whether motion plans should be published as a moveit_msgs::DisplayTrajectory
@@ -193,6 +237,13 @@ private:
   /// Flag indicating whether the reported plans should be checked once again, by the planning pipeline itself
   bool check_solution_paths_;
   ros::Publisher contacts_publisher_;
+
+  /// Successful plans, most recently used first, and their index by key
+  mutable boost::mutex plan_cache_lock_;
+  std::size_t plan_cache_size_;
+  double plan_cache_start_tolerance_;
+  mutable std::list<CachedPlan> plan_cache_;
+  mutable std::map<std::string, std::list<CachedPlan>::iterator> plan_cache_index_;
 };
 
 MOVEIT_CLASS_FORWARD(PlanningPipeline);
@@ -42,17 +42,55 @@
 #include <visualization_msgs/MarkerArray.h>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <ros/serialization.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <sstream>
 
 const std::string planning_pipeline::PlanningPipeline::DISPLAY_PATH_TOPIC = "display_planned_path";
 const std::string planning_pipeline::PlanningPipeline::MOTION_PLAN_REQUEST_TOPIC = "motion_plan_request";
 const std::string planning_pipeline::PlanningPipeline::MOTION_CONTACTS_TOPIC = "display_contacts";
 
+namespace
+{
+template <typename T>
+void appendSerializedMessage(const T& msg, std::string& out)
+{
+  uint32_t length = ros::serialization::serializationLength(msg);
+  std::vector<uint8_t> buffer(length);
+  if (length > 0)
+  {
+    ros::serialization::OStream stream(&buffer[0], length);
+    ros::serialization::serialize(stream, msg);
+  }
+  out.append(buffer.begin(), buffer.end());
+}
+
+void clearStamps(moveit_msgs::Constraints& c)
+{
+  for (std::size_t i = 0; i < c.position_constraints.size(); ++i)
+    c.position_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.orientation_constraints.size(); ++i)
+    c.orientation_constraints[i].header.stamp = ros::Time();
+  for (std::size_t i = 0; i < c.visibility_constraints.size(); ++i)
+  {
+    c.visibility_constraints[i].target_pose.header.stamp = ros::Time();
+    c.visibility_constraints[i].sensor_pose.header.stamp = ros::Time();
+  }
+}
+
+void clearStamps(moveit_msgs::CollisionObject& co)
+{
+  co.header.stamp = ros::Time();
+}
+}
+
 planning_pipeline::PlanningPipeline::PlanningPipeline(const robot_model::RobotModelConstPtr& model,
                                                       const ros::NodeHandle& nh,
                                                       const std::string& planner_plugin_param_name,
                                                       const std::string& adapter_plugins_param_name)
-  : nh_(nh), kmodel_(model)
+  : nh_(nh), kmodel_(model), plan_cache_size_(0), plan_cache_start_tolerance_(1e-3)
 {
   std::string planner;
   if (nh_.getParam(planner_plugin_param_name, planner))
@@ -73,7 +111,12 @@ planning_pipeline::PlanningPipeline::PlanningPipeline(const robot_model::RobotMo
 planning_pipeline::PlanningPipeline::PlanningPipeline(const robot_model::RobotModelConstPtr& model,
                                                       const ros::NodeHandle& nh, const std::string& planner_plugin_name,
                                                       const std::vector<std::string>& adapter_plugin_names)
-  : nh_(nh), planner_plugin_name_(planner_plugin_name), adapter_plugin_names_(adapter_plugin_names), kmodel_(model)
+  : nh_(nh)
+  , planner_plugin_name_(planner_plugin_name)
+  , adapter_plugin_names_(adapter_plugin_names)
+  , kmodel_(model)
+  , plan_cache_size_(0)
+  , plan_cache_start_tolerance_(1e-3)
 {
   configure();
 }
@@ -167,6 +210,15 @@ void planning_pipeline::PlanningPipeline::configure()
   }
   displayComputedMotionPlans(true);
   checkSolutionPaths(true);
+
+  int plan_cache_size;
+  nh_.param("plan_cache_size", plan_cache_size, 0);
+  setPlanCacheSize(plan_cache_size > 0 ? plan_cache_size : 0);
+  double plan_cache_start_tolerance;
+  nh_.param("plan_cache_start_tolerance", plan_cache_start_tolerance, 1e-3);
+  setPlanCacheStartTolerance(plan_cache_start_tolerance);
+  if (plan_cache_size_ > 0)
+    ROS_INFO("Caching up to %u motion plans", (unsigned int)plan_cache_size_);
 }
 
 void planning_pipeline::PlanningPipeline::displayComputedMotionPlans(bool flag)
@@ -196,6 +248,194 @@ void planning_pipeline::PlanningPipeline::checkSolutionPaths(bool flag)
   check_solution_paths_ = flag;
 }
 
+void planning_pipeline::PlanningPipeline::setPlanCacheSize(std::size_t size)
+{
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  plan_cache_size_ = size;
+  while (plan_cache_.size() > plan_cache_size_)
+  {
+    plan_cache_index_.erase(plan_cache_.back().key_);
+    plan_cache_.pop_back();
+  }
+}
+
+std::size_t planning_pipeline::PlanningPipeline::getPlanCacheSize() const
+{
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  return plan_cache_size_;
+}
+
+void planning_pipeline::PlanningPipeline::setPlanCacheStartTolerance(double tolerance)
+{
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  plan_cache_start_tolerance_ = std::fabs(tolerance);
+  // keys computed with the previous tolerance do not match any more
+  plan_cache_.clear();
+  plan_cache_index_.clear();
+}
+
+double planning_pipeline::PlanningPipeline::getPlanCacheStartTolerance() const
+{
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  return plan_cache_start_tolerance_;
+}
+
+void planning_pipeline::PlanningPipeline::clearPlanCache()
+{
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  plan_cache_.clear();
+  plan_cache_index_.clear();
+}
+
+std::string
+planning_pipeline::PlanningPipeline::getPlanCacheKey(const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                     const planning_interface::MotionPlanRequest& req) const
+{
+  // the request, without the start state and the time stamps
+  planning_interface::MotionPlanRequest canonical = req;
+  canonical.start_state = moveit_msgs::RobotState();
+  canonical.workspace_parameters.header.stamp = ros::Time();
+  for (std::size_t i = 0; i < canonical.goal_constraints.size(); ++i)
+    clearStamps(canonical.goal_constraints[i]);
+  clearStamps(canonical.path_constraints);
+  for (std::size_t i = 0; i < canonical.trajectory_constraints.constraints.size(); ++i)
+    clearStamps(canonical.trajectory_constraints.constraints[i]);
+  std::string key;
+  appendSerializedMessage(canonical, key);
+
+  // the start state, rounded to the tolerance
+  robot_state::RobotState start = planning_scene->getCurrentState();
+  robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start);
+  double tolerance = getPlanCacheStartTolerance();
+  const double* positions = start.getVariablePositions();
+  for (std::size_t i = 0; i < kmodel_->getVariableCount(); ++i)
+    if (tolerance > 0.0)
+    {
+      long long quantized = std::llround(positions[i] / tolerance);
+      key.append(reinterpret_cast<const char*>(&quantized), sizeof(quantized));
+    }
+    else
+      key.append(reinterpret_cast<const char*>(&positions[i]), sizeof(double));
+
+  // a fingerprint of everything in the scene that affects planning, except for the joint values of the current state
+  moveit_msgs::PlanningScene scene_msg;
+  moveit_msgs::PlanningSceneComponents comp;
+  comp.components = moveit_msgs::PlanningSceneComponents::TRANSFORMS |
+                    moveit_msgs::PlanningSceneComponents::ROBOT_STATE_ATTACHED_OBJECTS |
+                    moveit_msgs::PlanningSceneComponents::ALLOWED_COLLISION_MATRIX |
+                    moveit_msgs::PlanningSceneComponents::LINK_PADDING_AND_SCALING |
+                    moveit_msgs::PlanningSceneComponents::WORLD_OBJECT_GEOMETRY |
+                    moveit_msgs::PlanningSceneComponents::OCTOMAP;
+  planning_scene->getPlanningSceneMsg(scene_msg, comp);
+  scene_msg.robot_state.joint_state = sensor_msgs::JointState();
+  scene_msg.robot_state.multi_dof_joint_state = sensor_msgs::MultiDOFJointState();
+  for (std::size_t i = 0; i < scene_msg.robot_state.attached_collision_objects.size(); ++i)
+    clearStamps(scene_msg.robot_state.attached_collision_objects[i].object);
+  for (std::size_t i = 0; i < scene_msg.world.collision_objects.size(); ++i)
+    clearStamps(scene_msg.world.collision_objects[i]);
+  scene_msg.world.octomap.header.stamp = ros::Time();
+  scene_msg.world.octomap.octomap.header.stamp = ros::Time();
+  std::string scene_data;
+  appendSerializedMessage(scene_msg, scene_data);
+  std::size_t fingerprint = std::hash<std::string>()(scene_data);
+  key.append(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+  return key;
+}
+
+bool planning_pipeline::PlanningPipeline::getCachedPlan(const std::string& key,
+                                                        const planning_scene::PlanningSceneConstPtr& planning_scene,
+                                                        const planning_interface::MotionPlanRequest& req,
+                                                        planning_interface::MotionPlanResponse& res,
+                                                        std::vector<std::size_t>& adapter_added_state_index) const
+{
+  ros::WallTime start_time = ros::WallTime::now();
+  robot_trajectory::RobotTrajectoryPtr cached;
+  std::vector<std::size_t> cached_index;
+  {
+    boost::mutex::scoped_lock slock(plan_cache_lock_);
+    std::map<std::string, std::list<CachedPlan>::iterator>::iterator it = plan_cache_index_.find(key);
+    if (it == plan_cache_index_.end())
+      return false;
+    plan_cache_.splice(plan_cache_.begin(), plan_cache_, it->second);
+    cached = it->second->trajectory_;
+    cached_index = it->second->adapter_added_state_index_;
+  }
+
+  // copy the cached path, starting at the actual start state
+  robot_state::RobotState start = planning_scene->getCurrentState();
+  robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start);
+  robot_trajectory::RobotTrajectoryPtr trajectory(new robot_trajectory::RobotTrajectory(kmodel_, cached->getGroup()));
+  trajectory->addSuffixWayPoint(start, 0.0);
+  for (std::size_t i = 1; i < cached->getWayPointCount(); ++i)
+    trajectory->addSuffixWayPoint(cached->getWayPoint(i), cached->getWayPointDurationFromPrevious(i));
+
+  // the scene matches the fingerprint, but the path is checked again in case the start state moved
+  std::vector<std::size_t> index;
+  if (!planning_scene->isPathValid(*trajectory, req.path_constraints, req.group_name, false, &index))
+    for (std::size_t i = 0; i < index.size(); ++i)
+      if (index[i] != 0 && std::find(cached_index.begin(), cached_index.end(), index[i]) == cached_index.end())
+      {
+        ROS_DEBUG("Cached motion plan is not valid any more");
+        boost::mutex::scoped_lock slock(plan_cache_lock_);
+        std::map<std::string, std::list<CachedPlan>::iterator>::iterator it = plan_cache_index_.find(key);
+        if (it != plan_cache_index_.end())
+        {
+          plan_cache_.erase(it->second);
+          plan_cache_index_.erase(it);
+        }
+        return false;
+      }
+
+  res.trajectory_ = trajectory;
+  res.planning_time_ = (ros::WallTime::now() - start_time).toSec();
+  res.error_code_.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+  adapter_added_state_index = cached_index;
+  ROS_DEBUG("Reusing cached motion plan with %u states", (unsigned int)trajectory->getWayPointCount());
+  return true;
+}
+
+void planning_pipeline::PlanningPipeline::addCachedPlan(const std::string& key,
+                                                        const planning_interface::MotionPlanResponse& res,
+                                                        const std::vector<std::size_t>& adapter_added_state_index) const
+{
+  // keep a copy, so callers are free to modify the trajectory they receive
+  robot_trajectory::RobotTrajectoryPtr trajectory(
+      new robot_trajectory::RobotTrajectory(kmodel_, res.trajectory_->getGroup()));
+  for (std::size_t i = 0; i < res.trajectory_->getWayPointCount(); ++i)
+    trajectory->addSuffixWayPoint(res.trajectory_->getWayPoint(i), res.trajectory_->getWayPointDurationFromPrevious(i));
+
+  boost::mutex::scoped_lock slock(plan_cache_lock_);
+  if (plan_cache_size_ == 0)
+    return;
+  std::map<std::string, std::list<CachedPlan>::iterator>::iterator it = plan_cache_index_.find(key);
+  if (it == plan_cache_index_.end())
+  {
+    if (plan_cache_.size() >= plan_cache_size_)
+    {
+      plan_cache_index_.erase(plan_cache_.back().key_);
+      plan_cache_.pop_back();
+    }
+    plan_cache_.push_front(CachedPlan());
+    plan_cache_.front().key_ = key;
+    it = plan_cache_index_.insert(std::make_pair(key, plan_cache_.begin())).first;
+  }
+  else
+    plan_cache_.splice(plan_cache_.begin(), plan_cache_, it->second);
+  it->second->trajectory_ = trajectory;
+  it->second->adapter_added_state_index_ = adapter_added_state_index;
+}
+
+void planning_pipeline::PlanningPipeline::publishComputedMotionPlan(
+    const planning_interface::MotionPlanResponse& res) const
+{
+  moveit_msgs::DisplayTrajectory disp;
+  disp.model_id = kmodel_->getName();
+  disp.trajectory.resize(1);
+  res.trajectory_->getRobotTrajectoryMsg(disp.trajectory[0]);
+  robot_state::robotStateToRobotStateMsg(res.trajectory_->getFirstWayPoint(), disp.trajectory_start);
+  display_path_publisher_.publish(disp);
+}
+
 bool planning_pipeline::PlanningPipeline::generatePlan(const planning_scene::PlanningSceneConstPtr& planning_scene,
                                                        const planning_interface::MotionPlanRequest& req,
                                                        planning_interface::MotionPlanResponse& res) const
@@ -220,6 +460,18 @@ bool planning_pipeline::PlanningPipeline::generatePlan(const planning_scene::Pla
     return false;
   }
 
+  std::string cache_key;
+  if (getPlanCacheSize() > 0)
+  {
+    cache_key = getPlanCacheKey(planning_scene, req);
+    if (getCachedPlan(cache_key, planning_scene, req, res, adapter_added_state_index))
+    {
+      if (display_computed_motion_plans_)
+        publishComputedMotionPlan(res);
+      return true;
+    }
+  }
+
   bool solved = false;
   try
   {
@@ -330,14 +582,10 @@ bool planning_pipeline::PlanningPipeline::generatePlan(const planning_scene::Pla
 
   // display solution path if needed
   if (display_computed_motion_plans_ && solved)
-  {
-    moveit_msgs::DisplayTrajectory disp;
-    disp.model_id = kmodel_->getName();
-    disp.trajectory.resize(1);
-    res.trajectory_->getRobotTrajectoryMsg(disp.trajectory[0]);
-    robot_state::robotStateToRobotStateMsg(res.trajectory_->getFirstWayPoint(), disp.trajectory_start);
-    display_path_publisher_.publish(disp);
-  }
+    publishComputedMotionPlan(res);
+
+  if (!cache_key.empty() && solved && valid && res.trajectory_ && !res.trajectory_->empty())
+    addCachedPlan(cache_key, res, adapter_added_state_index);
 
   return solved && valid;
 }
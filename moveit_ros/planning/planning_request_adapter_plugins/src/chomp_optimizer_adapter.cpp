@@ -157,6 +157,22 @@ public:
       ROS_INFO_STREAM("Param trajectory_initialization_method was not set. Using New value as: "
                       << params_.trajectory_initialization_method_);
     }
+    if (!nh_.getParam("enable_multi_start", params_.enable_multi_start_))
+    {
+      params_.enable_multi_start_ = false;
+      ROS_INFO_STREAM("Param enable_multi_start was not set. Using default value: " << params_.enable_multi_start_);
+    }
+    if (!nh_.getParam("multi_start_reuse_tolerance", params_.multi_start_reuse_tolerance_))
+    {
+      params_.multi_start_reuse_tolerance_ = 0.1;
+      ROS_INFO_STREAM("Param multi_start_reuse_tolerance was not set. Using default value: "
+                      << params_.multi_start_reuse_tolerance_);
+    }
+    if (!nh_.getParam("resolution_level_max_iterations", params_.resolution_level_max_iterations_))
+    {
+      params_.resolution_level_max_iterations_.clear();
+      ROS_INFO_STREAM("Param resolution_level_max_iterations was not set. Using default value: [] (no coarse levels)");
+    }
   }
 
   virtual std::string getDescription() const
@@ -182,7 +198,6 @@ public:
     ROS_INFO_STREAM("Configuring Planning Scene for CHOMP ....");
     planning_scene->setActiveCollisionDetector(hybrid_cd, true);
 
-    chomp::ChompPlanner chompPlanner;
     planning_interface::MotionPlanDetailedResponse res_detailed;
     moveit_msgs::MotionPlanDetailedResponse res_detailed_moveit_msgs;
     moveit_msgs::MotionPlanRequest req_moveit_msgs;
@@ -195,7 +210,7 @@ public:
     res_detailed_moveit_msgs.trajectory.resize(1);
     res_detailed_moveit_msgs.trajectory[0] = trajectory_msgs_from_response;
 
-    bool planning_success = chompPlanner.solve(planning_scene, req, params_, res_detailed_moveit_msgs);
+    bool planning_success = chomp_planner_.solve(planning_scene, req, params_, res_detailed_moveit_msgs);
 
     if (planning_success)
     {
@@ -228,6 +243,8 @@ public:
 private:
   ros::NodeHandle nh_;
   chomp::ChompParameters params_;
+  // kept across requests, so that multi start can reuse earlier solutions
+  chomp::ChompPlanner chomp_planner_;
 };
 }
 
@@ -0,0 +1,107 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_request_adapter/planning_request_adapter.h>
+#include <moveit/trajectory_processing/waypoint_decimation.h>
+#include <class_loader/class_loader.hpp>
+#include <ros/ros.h>
+#include <algorithm>
+#include <memory>
+
+namespace default_planner_request_adapters
+{
+class DecimateWaypoints : public planning_request_adapter::PlanningRequestAdapter
+{
+public:
+  static const std::string JOINT_TOLERANCE_PARAM_NAME;
+  static const std::string CARTESIAN_TOLERANCE_PARAM_NAME;
+  static const std::string RESOLUTION_PARAM_NAME;
+
+  DecimateWaypoints() : planning_request_adapter::PlanningRequestAdapter(), nh_("~")
+  {
+    double joint_tolerance, cartesian_tolerance, resolution;
+    nh_.param(JOINT_TOLERANCE_PARAM_NAME, joint_tolerance, 0.01);
+    nh_.param(CARTESIAN_TOLERANCE_PARAM_NAME, cartesian_tolerance, 0.005);
+    nh_.param(RESOLUTION_PARAM_NAME, resolution, 0.05);
+    ROS_INFO_STREAM("Decimating waypoints with a joint tolerance of " << joint_tolerance
+                                                                      << ", a Cartesian tolerance of "
+                                                                      << cartesian_tolerance);
+    decimation_.reset(new trajectory_processing::WaypointDecimation(joint_tolerance, cartesian_tolerance, resolution));
+  }
+
+  virtual std::string getDescription() const
+  {
+    return "Decimate Waypoints";
+  }
+
+  virtual bool adaptAndPlan(const PlannerFn& planner, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req,
+                            planning_interface::MotionPlanResponse& res,
+                            std::vector<std::size_t>& added_path_index) const
+  {
+    bool result = planner(planning_scene, req, res);
+    if (result && res.trajectory_)
+    {
+      ROS_DEBUG("Running '%s'", getDescription().c_str());
+
+      // states added by other adapters are kept, as they may be deliberately invalid (e.g. a colliding start state)
+      std::vector<std::size_t> kept_index;
+      std::size_t count = res.trajectory_->getWayPointCount();
+      std::size_t removed = decimation_->decimate(
+          *res.trajectory_,
+          [&planning_scene, &req](const robot_state::RobotState& state) {
+            return planning_scene->isStateValid(state, req.path_constraints, req.group_name);
+          },
+          added_path_index, kept_index);
+      for (std::size_t i = 0; i < added_path_index.size(); ++i)
+        added_path_index[i] =
+            std::lower_bound(kept_index.begin(), kept_index.end(), added_path_index[i]) - kept_index.begin();
+      ROS_DEBUG("Removed %u of %u waypoints", (unsigned int)removed, (unsigned int)count);
+    }
+
+    return result;
+  }
+
+private:
+  ros::NodeHandle nh_;
+  std::unique_ptr<trajectory_processing::WaypointDecimation> decimation_;
+};
+
+const std::string DecimateWaypoints::JOINT_TOLERANCE_PARAM_NAME = "decimation_joint_tolerance";
+const std::string DecimateWaypoints::CARTESIAN_TOLERANCE_PARAM_NAME = "decimation_cartesian_tolerance";
+const std::string DecimateWaypoints::RESOLUTION_PARAM_NAME = "decimation_validity_resolution";
+}
+
+CLASS_LOADER_REGISTER_CLASS(default_planner_request_adapters::DecimateWaypoints,
+                            planning_request_adapter::PlanningRequestAdapter);
@@ -77,12 +77,20 @@ public:
                             const planning_interface::MotionPlanRequest& req,
                             planning_interface::MotionPlanResponse& res,
                             std::vector<std::size_t>& added_path_index) const
+  {
+    planning_request_adapter::AdaptationContext context;
+    return adaptAndPlan(planner, planning_scene, req, res, added_path_index, context);
+  }
+
+  virtual bool adaptAndPlan(const PlannerFn& planner, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req,
+                            planning_interface::MotionPlanResponse& res, std::vector<std::size_t>& added_path_index,
+                            planning_request_adapter::AdaptationContext& context) const
   {
     ROS_DEBUG("Running '%s'", getDescription().c_str());
 
     // get the specified start state
-    robot_state::RobotState start_state = planning_scene->getCurrentState();
-    robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start_state);
+    robot_state::RobotState start_state = context.getStartState(planning_scene, req);
 
     const std::vector<const robot_model::JointModel*>& jmodels =
         planning_scene->getRobotModel()->hasJointModelGroup(req.group_name) ?
@@ -180,6 +188,7 @@ public:
     {
       planning_interface::MotionPlanRequest req2 = req;
       robot_state::robotStateToRobotStateMsg(start_state, req2.start_state, false);
+      context.setStartState(planning_scene, req2, start_state);
       solved = planner(planning_scene, req2, res);
     }
     else
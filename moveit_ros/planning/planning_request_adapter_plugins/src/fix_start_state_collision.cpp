@@ -39,6 +39,7 @@
 #include <moveit/trajectory_processing/trajectory_tools.h>
 #include <class_loader/class_loader.hpp>
 #include <ros/ros.h>
+#include <algorithm>
 
 namespace default_planner_request_adapters
 {
@@ -92,18 +93,24 @@ public:
                             const planning_interface::MotionPlanRequest& req,
                             planning_interface::MotionPlanResponse& res,
                             std::vector<std::size_t>& added_path_index) const
+  {
+    planning_request_adapter::AdaptationContext context;
+    return adaptAndPlan(planner, planning_scene, req, res, added_path_index, context);
+  }
+
+  virtual bool adaptAndPlan(const PlannerFn& planner, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req,
+                            planning_interface::MotionPlanResponse& res, std::vector<std::size_t>& added_path_index,
+                            planning_request_adapter::AdaptationContext& context) const
   {
     ROS_DEBUG("Running '%s'", getDescription().c_str());
 
     // get the specified start state
-    robot_state::RobotState start_state = planning_scene->getCurrentState();
-    robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start_state);
+    robot_state::RobotState start_state = context.getStartState(planning_scene, req);
 
     collision_detection::CollisionRequest creq;
     creq.group_name = req.group_name;
-    collision_detection::CollisionResult cres;
-    planning_scene->checkCollision(creq, cres, start_state);
-    if (cres.collision)
+    if (context.isStartStateColliding(planning_scene, req))
     {
       // Rerun in verbose mode
       collision_detection::CollisionRequest vcreq = creq;
@@ -124,31 +131,56 @@ public:
               planning_scene->getRobotModel()->getJointModelGroup(req.group_name)->getJointModels() :
               planning_scene->getRobotModel()->getJointModels();
 
+      // the perturbed states are checked in batches, in parallel; within a batch, the candidate closest to the start
+      // state wins, so the result does not depend on which check finishes first
+      static const std::size_t CANDIDATE_BATCH_SIZE = 32;
       bool found = false;
-      for (int c = 0; !found && c < sampling_attempts_; ++c)
+      int c = 0;
+      std::size_t i = 0;
+      while (!found && c < sampling_attempts_ && !jmodels.empty())
       {
-        for (std::size_t i = 0; !found && i < jmodels.size(); ++i)
+        std::vector<std::pair<double, int> > order;  // distance to the start state and attempt of each candidate
+        std::vector<robot_state::RobotStatePtr> candidates;
+        for (; c < sampling_attempts_ && candidates.size() < CANDIDATE_BATCH_SIZE; i = (i + 1) % jmodels.size())
         {
           std::vector<double> sampled_variable_values(jmodels[i]->getVariableCount());
           const double* original_values = prefix_state->getJointPositions(jmodels[i]);
           jmodels[i]->getVariableRandomPositionsNearBy(rng, &sampled_variable_values[0], original_values,
                                                        jmodels[i]->getMaximumExtent() * jiggle_fraction_);
           start_state.setJointPositions(jmodels[i], sampled_variable_values);
-          collision_detection::CollisionResult cres;
-          planning_scene->checkCollision(creq, cres, start_state);
-          if (!cres.collision)
+          start_state.update();
+          candidates.push_back(robot_state::RobotStatePtr(new robot_state::RobotState(start_state)));
+          order.push_back(std::make_pair(prefix_state->distance(start_state), c));
+          if (i + 1 == jmodels.size())
+            ++c;
+        }
+
+        std::vector<std::size_t> sorted(candidates.size());
+        std::vector<const robot_state::RobotState*> states(candidates.size());
+        for (std::size_t k = 0; k < sorted.size(); ++k)
+          sorted[k] = k;
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [&order](std::size_t a, std::size_t b) { return order[a].first < order[b].first; });
+        for (std::size_t k = 0; k < sorted.size(); ++k)
+          states[k] = candidates[sorted[k]].get();
+
+        std::vector<bool> colliding;
+        planning_scene->checkCollisionBatch(creq, states, colliding);
+        for (std::size_t k = 0; !found && k < colliding.size(); ++k)
+          if (!colliding[k])
           {
             found = true;
+            start_state = *states[k];
             ROS_INFO("Found a valid state near the start state at distance %lf after %d attempts",
-                     prefix_state->distance(start_state), c);
+                     order[sorted[k]].first, order[sorted[k]].second);
           }
-        }
       }
 
       if (found)
       {
         planning_interface::MotionPlanRequest req2 = req;
         robot_state::robotStateToRobotStateMsg(start_state, req2.start_state);
+        context.setStartState(planning_scene, req2, start_state);
         bool solved = planner(planning_scene, req2, res);
         if (solved && !res.trajectory_->empty())
         {
@@ -59,16 +59,23 @@ public:
                             const planning_interface::MotionPlanRequest& req,
                             planning_interface::MotionPlanResponse& res,
                             std::vector<std::size_t>& added_path_index) const
+  {
+    planning_request_adapter::AdaptationContext context;
+    return adaptAndPlan(planner, planning_scene, req, res, added_path_index, context);
+  }
+
+  virtual bool adaptAndPlan(const PlannerFn& planner, const planning_scene::PlanningSceneConstPtr& planning_scene,
+                            const planning_interface::MotionPlanRequest& req,
+                            planning_interface::MotionPlanResponse& res, std::vector<std::size_t>& added_path_index,
+                            planning_request_adapter::AdaptationContext& context) const
   {
     ROS_DEBUG("Running '%s'", getDescription().c_str());
 
     // get the specified start state
-    robot_state::RobotState start_state = planning_scene->getCurrentState();
-    robot_state::robotStateMsgToRobotState(planning_scene->getTransforms(), req.start_state, start_state);
+    const robot_state::RobotState& start_state = context.getStartState(planning_scene, req);
 
     // if the start state is otherwise valid but does not meet path constraints
-    if (planning_scene->isStateValid(start_state, req.group_name) &&
-        !planning_scene->isStateValid(start_state, req.path_constraints, req.group_name))
+    if (context.isStartStateValid(planning_scene, req) && !context.isStartStateConstrained(planning_scene, req))
     {
       ROS_INFO("Path constraints not satisfied for start state...");
       planning_scene->isStateValid(start_state, req.path_constraints, req.group_name, true);
@@ -46,6 +46,7 @@
 #include <boost/thread/mutex.hpp>
 #include <moveit/macros/deprecation.h>
 #include <boost/thread/condition_variable.hpp>
+#include <memory>
 
 namespace planning_scene_monitor
 {
@@ -145,6 +146,12 @@ public:
   */
   bool waitForCurrentState(const ros::Time t = ros::Time::now(), double wait_time = 1.0) const;
 
+  /** @brief Wait for at most \e wait_time seconds for a joint state update stamped after \e t, and copy the variable
+   *  positions and the time stamp of the current state without constructing a RobotState
+   *  @return false if no such update was received within \e wait_time */
+  bool waitForStateUpdate(const ros::Time& t, std::vector<double>& positions, ros::Time& stamp,
+                          double wait_time) const;
+
   /** @brief Wait for at most \e wait_time seconds until the complete robot state is known.
       @return true if the full state is known */
   bool waitForCompleteState(double wait_time) const;
@@ -157,6 +164,24 @@ public:
   /** replaced by waitForCompleteState, will be removed in L-turtle: function waits for complete robot state */
   MOVEIT_DEPRECATED bool waitForCurrentState(const std::string& group, double wait_time) const;
 
+  /** @brief Keep the positions of the last \e capacity joint state updates, so past states can be queried with
+   *  getStateAtTime(). The joint state callback is the only writer; readers do not lock. A capacity of 0 (the
+   *  default) disables the history. Changing the capacity discards the recorded updates. */
+  void setStateHistoryCapacity(std::size_t capacity);
+
+  /** @brief Get the number of joint state updates kept in the state history */
+  std::size_t getStateHistoryCapacity() const;
+
+  /** @brief Set \e state to the monitored state at time \e t, interpolating between the two recorded updates closest
+   *  to \e t. The collision body transforms of \e state are not updated.
+   *  @return false if \e t is not covered by the state history */
+  bool getStateAtTime(const ros::Time& t, robot_state::RobotState& state) const;
+
+  /** @brief Wait for at most \e wait_time seconds until the state history reaches time \e t, and then set \e state
+   *  like getStateAtTime()
+   *  @return false if the history did not reach \e t in time, or if \e t is older than the state history */
+  bool waitForStateAtTime(const ros::Time& t, robot_state::RobotState& state, double wait_time = 1.0) const;
+
   /** @brief Get the time point when the monitor was started */
   const ros::Time& getMonitorStartTime() const
   {
@@ -196,9 +221,15 @@ public:
   }
 
 private:
+  class StateHistory;
+
   void jointStateCallback(const sensor_msgs::JointStateConstPtr& joint_state);
   void tfCallback();
 
+  /** @brief Get the (cached) variable index mapping for the joint names of a joint_state message. Must be called with
+   * state_update_lock_ held */
+  const robot_model::VariableIndexMapping& getJointStateMapping(const std::vector<std::string>& names);
+
   ros::NodeHandle nh_;
   boost::shared_ptr<tf::Transformer> tf_;
   robot_model::RobotModelConstPtr robot_model_;
@@ -215,7 +246,13 @@ private:
   mutable boost::condition_variable state_update_condition_;
   std::vector<JointStateUpdateCallback> update_callbacks_;
 
+  /// Mappings for the joint name orderings received recently; the most recently used one is first
+  std::vector<robot_model::VariableIndexMappingConstPtr> joint_state_mappings_;
+
   std::shared_ptr<TFConnection> tf_connection_;
+
+  /// Recent joint state updates; replaced atomically, NULL unless the history is enabled
+  std::shared_ptr<StateHistory> state_history_;
 };
 
 MOVEIT_CLASS_FORWARD(CurrentStateMonitor);
@@ -51,6 +51,8 @@
 #include <boost/noncopyable.hpp>
 #include <boost/thread/shared_mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <atomic>
+#include <deque>
 #include <memory>
 
 namespace planning_scene_monitor
@@ -204,6 +206,24 @@ public:
     return scene_const_;
   }
 
+  /** @brief Get an immutable copy of the current planning scene.
+   *
+   * Unlike LockedPlanningSceneRO, holding on to the returned scene does not lock the monitor, so long running
+   * readers (e.g., planners) do not delay updates of the scene and are not delayed by them. The copy is shared by
+   * all callers until the scene changes; only the first call after a change copies the scene (under a short read
+   * lock). If the scene contains the octree of the octomap monitor, the copy refers to a copy of that octree, which
+   * is also reused for as long as the octomap does not change. The copy always holds the latest state received
+   * from the current state monitor: when only the state changed, the copy is a diff of the previous one that sets
+   * the new state, without locking the scene. */
+  planning_scene::PlanningSceneConstPtr getPlanningSceneSnapshot();
+
+  /** @brief Get the latest state received from the current state monitor, or NULL if there is none yet.
+   *
+   * State updates are stored without locking the scene. They are merged into the monitored scene when it is next
+   * locked for writing, or when it is locked for reading while no other reader holds it. While a long running reader
+   * holds LockedPlanningSceneRO, the current state of the monitored scene may therefore lag behind this state. */
+  robot_state::RobotStateConstPtr getCurrentStateSnapshot() const;
+
   /** @brief Return true if the scene \e scene can be updated directly
       or indirectly by this monitor. This function will return true if
       the pointer of the scene is the same as the one maintained,
@@ -278,6 +298,40 @@ public:
     return publish_planning_scene_frequency_;
   }
 
+  /** \brief Publish compact planning scene diffs. Objects whose geometry did not change since it was last published
+      are sent as MOVE operations that only carry their poses, and octomaps are sent in binary form. Updates of the
+      octree of the octomap monitor are sent as compressed deltas of the regions that changed (see
+      occupancy_map_monitor::OcTreeDelta), which a PlanningSceneMonitor subscribed to the scene applies to the octree
+      it received before; new subscribers receive a full scene. */
+  void setCompactPlanningScenePublishing(bool flag);
+
+  /** \brief Check whether compact planning scene diffs are published */
+  bool getCompactPlanningScenePublishing() const
+  {
+    return publish_compact_diffs_;
+  }
+
+  /** \brief Set the maximum frequency at which octomap updates are included in published planning scenes. Updates
+      that arrive faster are merged and sent later. A value of 0 (the default) sends every update. */
+  void setOctomapPublishingFrequency(double hz);
+
+  /** \brief Get the maximum frequency at which octomap updates are published (Hz) */
+  double getOctomapPublishingFrequency() const
+  {
+    return publish_octomap_frequency_;
+  }
+
+  /** \brief Limit the average bandwidth used for publishing planning scenes (bytes per second). The publishing rate
+      is lowered as messages get larger, so updates are merged into fewer diffs. A value of 0 (the default) disables
+      the limit. */
+  void setPlanningScenePublishingBandwidth(double bytes_per_second);
+
+  /** \brief Get the bandwidth limit for publishing planning scenes (bytes per second) */
+  double getPlanningScenePublishingBandwidth() const
+  {
+    return publish_planning_scene_bandwidth_;
+  }
+
   /** @brief Get the stored instance of the stored current state monitor
    *  @return An instance of the stored current state monitor*/
   const CurrentStateMonitorPtr& getStateMonitor() const
@@ -308,7 +362,8 @@ public:
 
   /** @brief Update the scene using the monitored state. This function is automatically called when an update to the
      current state is received (if startStateMonitor() has been called).
-      The updates are throttled to a maximum update frequency however, which is set by setStateUpdateFrequency(). */
+      The updates are throttled to a maximum update frequency however, which is set by setStateUpdateFrequency().
+      The state is stored without waiting for the scene lock; see getCurrentStateSnapshot(). */
   void updateSceneWithCurrentState();
 
   /** @brief Update the scene using the monitored state at a specified frequency, in Hz. This function has an effect
@@ -318,6 +373,17 @@ public:
       @param hz the update frequency. By default this is 10Hz. */
   void setStateUpdateFrequency(double hz);
 
+  /** @brief Collect collision objects received on the collision object topic for up to \e seconds and apply them
+      under a single scene lock, with a single update event for the whole batch. This helps when many objects are
+      published at once. With the default of 0, objects are applied as soon as they arrive. */
+  void setCollisionObjectBatchingWindow(double seconds);
+
+  /** @brief Get the time (seconds) for which collision objects are collected before they are applied */
+  double getCollisionObjectBatchingWindow() const
+  {
+    return collision_object_batching_window_.toSec();
+  }
+
   /** @brief Get the maximum frequency (Hz) at which the current state of the planning scene is updated.*/
   double getStateUpdateFrequency() const
   {
@@ -371,6 +437,13 @@ public:
     return last_update_time_;
   }
 
+  /** \brief Return a number that changes every time the planning scene may have changed. Results computed from the
+   * scene can be reused for as long as this number does not change. */
+  unsigned long getSceneVersion() const
+  {
+    return scene_version_ + state_version_;
+  }
+
   void publishDebugInformation(bool flag);
 
   /** @brief This function is called every time there is a change to the planning scene */
@@ -417,6 +490,9 @@ protected:
   /** @brief Callback for a new collision object msg*/
   void collisionObjectCallback(const moveit_msgs::CollisionObjectConstPtr& obj);
 
+  /** @brief Apply all queued collision object msgs to the scene at once */
+  void processPendingCollisionObjects();
+
   /** @brief Callback for a new collision object msg that failed to pass the TF filter */
   void collisionObjectFailTFCallback(const moveit_msgs::CollisionObjectConstPtr& obj,
                                      tf::filter_failure_reasons::FilterFailureReason reason);
@@ -427,6 +503,9 @@ protected:
   /** @brief Callback for octomap updates */
   void octomapUpdateCallback();
 
+  /** @brief Apply an octomap delta received in a planning scene diff to a copy of the octree of the scene */
+  bool applyOctomapDelta(const octomap_msgs::OctomapWithPose& map);
+
   /** @brief Callback for a new attached object msg*/
   void attachObjectCallback(const moveit_msgs::AttachedCollisionObjectConstPtr& obj);
 
@@ -453,6 +532,14 @@ protected:
   bool getShapeTransformCache(const std::string& target_frame, const ros::Time& target_time,
                               occupancy_map_monitor::ShapeTransformCache& cache) const;
 
+  // compute the shape transforms using forward kinematics on the state history of current_state_monitor_;
+  // returns false if the history does not cover target_time. Must be called with shape_handles_lock_ held.
+  bool computeShapeTransformsFromStateHistory(const std::string& target_frame, const ros::Time& target_time,
+                                              occupancy_map_monitor::ShapeTransformCache& cache) const;
+
+  // record joint states in current_state_monitor_ when the octomap needs shape transforms for past sensor times
+  void configureStateHistory();
+
   /// The name of this scene monitor
   std::string monitor_name_;
 
@@ -460,6 +547,8 @@ protected:
   planning_scene::PlanningSceneConstPtr scene_const_;
   planning_scene::PlanningScenePtr parent_scene_;  /// if diffs are monitored, this is the pointer to the parent scene
   boost::shared_mutex scene_update_mutex_;         /// mutex for stored scene
+  std::atomic<unsigned long> scene_version_;       /// Incremented every time the scene may have changed, but not
+                                                   /// for updates of the current state only
   ros::Time last_update_time_;                     /// Last time the state was updated
   ros::Time last_robot_motion_time_;               /// Last time the robot has moved
 
@@ -491,6 +580,15 @@ protected:
   SceneUpdateType new_scene_update_;
   boost::condition_variable_any new_scene_update_condition_;
 
+  // compact publishing (only accessed by the publishing thread, apart from the settings)
+  bool publish_compact_diffs_;
+  double publish_octomap_frequency_;
+  double publish_planning_scene_bandwidth_;
+  std::map<std::string, std::vector<shapes::ShapeConstPtr> > published_shapes_;  // geometry known to subscribers
+  std::size_t published_subscriber_count_;
+  ros::WallTime last_octomap_publish_time_;
+  bool octomap_publish_pending_;
+
   // subscribe to various sources of data
   ros::Subscriber planning_scene_subscriber_;
   ros::Subscriber planning_scene_world_subscriber_;
@@ -502,6 +600,37 @@ protected:
 
   // include a octomap monitor
   std::unique_ptr<occupancy_map_monitor::OccupancyMapMonitor> octomap_monitor_;
+  std::atomic<unsigned long> octomap_version_;  /// Incremented every time the octree of the octomap monitor changes
+
+  /// The latest state received from the current state monitor, stamped with the time and the value of
+  /// state_version_ it was received at
+  struct CurrentState
+  {
+    robot_state::RobotStateConstPtr state_;
+    ros::Time stamp_;
+    unsigned long version_;
+  };
+  std::shared_ptr<const CurrentState> current_state_;  /// accessed with std::atomic_load / std::atomic_store
+  std::atomic<unsigned long> state_version_;           /// Incremented every time a new current state is stored
+  std::atomic<unsigned long> applied_state_version_;   /// value of state_version_ of the current state of scene_
+  boost::mutex current_state_lock_;                    /// serializes the writers of current_state_
+
+  /// Copy current_state_ into scene_, if it has not been copied yet; scene_update_mutex_ must be locked for writing
+  void applyCurrentState();
+
+  /// An immutable copy of the scene, tagged with the values of scene_version_ and state_version_ it was made at.
+  /// world_ is the copy made under the read lock; scene_ is world_ or a diff of it that sets a newer current state
+  struct SceneSnapshot
+  {
+    planning_scene::PlanningSceneConstPtr world_;
+    planning_scene::PlanningSceneConstPtr scene_;
+    unsigned long version_;
+    unsigned long state_version_;
+  };
+  std::shared_ptr<const SceneSnapshot> scene_snapshot_;  /// accessed with std::atomic_load / std::atomic_store
+  std::shared_ptr<const octomap::OcTree> snapshot_octree_;  /// copy of the octree used by the snapshots
+  unsigned long snapshot_octree_version_;                   /// value of octomap_version_ snapshot_octree_ was made at
+  boost::mutex snapshot_lock_;                              /// held while making a new snapshot
 
   // include a current state monitor
   CurrentStateMonitorPtr current_state_monitor_;
@@ -520,6 +649,19 @@ protected:
   CollisionBodyShapeHandles collision_body_shape_handles_;
   mutable boost::recursive_mutex shape_handles_lock_;
 
+  /// incremented whenever the shape handles above change; protected by shape_handles_lock_
+  std::size_t shape_handles_version_;
+
+  /// the most recently computed shape transform caches, so updaters asking for the same frame and time share them
+  struct CachedShapeTransforms
+  {
+    std::string target_frame_;
+    ros::Time target_time_;
+    std::size_t shape_handles_version_;
+    occupancy_map_monitor::ShapeTransformCache cache_;
+  };
+  mutable std::deque<CachedShapeTransforms> shape_transform_caches_;  // protected by shape_handles_lock_
+
   /// lock access to update_callbacks_
   boost::recursive_mutex update_lock_;
   std::vector<boost::function<void(SceneUpdateType)> > update_callbacks_;  /// List of callbacks to trigger when updates
@@ -531,12 +673,19 @@ private:
   // publish planning scene update diffs (runs in its own thread)
   void scenePublishingThread();
 
+  // apply octomap throttling and, if enabled, compact encoding to a message about to be published.
+  // Returns true if an octomap update was held back. Must be called with the octree locked for reading.
+  bool compactPlanningSceneMsg(moveit_msgs::PlanningScene& msg);
+
   // called by current_state_monitor_ when robot state (as monitored on joint state topic) changes
   void onStateUpdate(const sensor_msgs::JointStateConstPtr& joint_state);
 
   // called by state_update_timer_ when a state update it pending
   void stateUpdateTimerCallback(const ros::WallTimerEvent& event);
 
+  // called by collision_object_batching_timer_ to apply the collected collision objects
+  void collisionObjectBatchingTimerCallback(const ros::WallTimerEvent& event);
+
   // Callback for a new planning scene msg
   void newPlanningSceneCallback(const moveit_msgs::PlanningSceneConstPtr& scene);
 
@@ -561,6 +710,16 @@ private:
   // Not safe to access from callback functions.
   ros::WallTimer state_update_timer_;
 
+  /// collision objects received but not yet applied to the scene, protected by pending_collision_objects_lock_
+  std::vector<moveit_msgs::CollisionObjectConstPtr> pending_collision_objects_;
+  boost::mutex pending_collision_objects_lock_;
+
+  /// time for which collision objects are collected before they are applied; zero applies them right away
+  ros::WallDuration collision_object_batching_window_;
+
+  /// timer applying the collected collision objects, running while the world geometry monitor is active
+  ros::WallTimer collision_object_batching_timer_;
+
   /// Last time the state was updated from current_state_monitor_
   // Only access this from callback functions (and constructor)
   ros::WallTime last_robot_state_update_wall_time_;
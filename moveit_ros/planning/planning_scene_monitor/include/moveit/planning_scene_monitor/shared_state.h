@@ -0,0 +1,103 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PLANNING_SCENE_MONITOR_SHARED_STATE_
+#define MOVEIT_PLANNING_SCENE_MONITOR_SHARED_STATE_
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/robot_state/robot_state.h>
+#include <ros/time.h>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <memory>
+#include <string>
+
+namespace planning_scene_monitor
+{
+MOVEIT_CLASS_FORWARD(SharedStateWriter);
+MOVEIT_CLASS_FORWARD(SharedStateReader);
+
+/** @brief The default name of the shared memory segment holding the current state of robots with \e robot_model */
+std::string getSharedStateSegmentName(const robot_model::RobotModelConstPtr& robot_model);
+
+/** @class SharedStateWriter
+    @brief Publishes the joint positions of a robot state through shared memory, so processes on the same host can read
+    the latest state (see SharedStateReader) without subscribing to and decoding joint state messages. */
+class SharedStateWriter
+{
+public:
+  /** @brief Create the shared memory segment \e name (by default getSharedStateSegmentName()), replacing any previous
+      one. Throws boost::interprocess::interprocess_exception if the segment cannot be created. */
+  SharedStateWriter(const robot_model::RobotModelConstPtr& robot_model, const std::string& name = "");
+
+  /** @brief Remove the segment; connected readers are told to reconnect */
+  ~SharedStateWriter();
+
+  /** @brief Publish the variable positions of \e state, observed at \e stamp */
+  void write(const robot_state::RobotState& state, const ros::Time& stamp);
+
+  const std::string& getName() const
+  {
+    return name_;
+  }
+
+private:
+  std::string name_;
+  std::size_t variable_count_;
+  boost::interprocess::mapped_region region_;
+};
+
+/** @class SharedStateReader
+    @brief Reads the robot state published by a SharedStateWriter of the same robot model. */
+class SharedStateReader
+{
+public:
+  SharedStateReader(const robot_model::RobotModelConstPtr& robot_model, const std::string& name = "");
+
+  /** @brief Copy the latest published positions into \e state and their time into \e stamp. Returns false if no
+      writer for the same robot model exists. Other variables of \e state (e.g., velocities) are not modified. */
+  bool read(robot_state::RobotState& state, ros::Time& stamp);
+
+  /** @brief Map the segment again. read() does this when the writer went away cleanly; call it when the state
+      stops being updated, in case the writer crashed and was restarted. */
+  bool connect();
+
+private:
+  robot_model::RobotModelConstPtr robot_model_;
+  std::string name_;
+  std::unique_ptr<boost::interprocess::mapped_region> region_;
+};
+}
+
+#endif
@@ -40,6 +40,7 @@
 #include <moveit/macros/class_forward.h>
 #include <moveit/planning_scene_monitor/current_state_monitor.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
+#include <trajectory_msgs/JointTrajectory.h>
 #include <boost/thread.hpp>
 #include <memory>
 
@@ -51,7 +52,10 @@ typedef boost::function<void(const robot_state::RobotStateConstPtr& state, const
 MOVEIT_CLASS_FORWARD(TrajectoryMonitor);
 
 /** @class TrajectoryMonitor
-    @brief Monitors the joint_states topic and tf to record the trajectory of the robot. */
+    @brief Monitors the joint_states topic and tf to record the trajectory of the robot.
+
+    Recording is driven by the updates of the CurrentStateMonitor. Samples are kept as plain variable positions, in a
+    ring buffer if a recording capacity is set, and are only turned into a RobotTrajectory on request. */
 class TrajectoryMonitor
 {
 public:
@@ -74,20 +78,42 @@ public:
     return sampling_frequency_;
   }
 
+  /** @brief Set the maximum rate at which states are recorded. A frequency of 0 records every state update. */
   void setSamplingFrequency(double sampling_frequency);
 
-  /// Return the current maintained trajectory. This function is not thread safe (hence NOT const), because the
-  /// trajectory could be modified.
-  const robot_trajectory::RobotTrajectory& getTrajectory()
+  /** @brief Keep at most \e capacity samples, overwriting the oldest ones once the buffer is full. The buffer is
+   *  allocated up front. A capacity of 0 (the default) records without limit. Changing the capacity discards the
+   *  recorded samples. */
+  void setRecordingCapacity(std::size_t capacity);
+
+  std::size_t getRecordingCapacity() const
   {
-    return trajectory_;
+    return capacity_;
   }
 
-  void swapTrajectory(robot_trajectory::RobotTrajectory& other)
+  /** @brief Only record a state if a variable moved by more than \e threshold since the last recorded sample.
+   *  A threshold of 0 (the default) disables the decimation. */
+  void setChangeThreshold(double threshold);
+
+  double getChangeThreshold() const
   {
-    trajectory_.swap(other);
+    return change_threshold_;
   }
 
+  /** @brief Get the number of recorded samples */
+  std::size_t getSampleCount() const;
+
+  /// Return the current maintained trajectory, built from the recorded samples. This function is not thread safe
+  /// (hence NOT const), because the returned trajectory is rebuilt by the next call.
+  const robot_trajectory::RobotTrajectory& getTrajectory();
+
+  /// Convert the recorded samples to a RobotTrajectory and swap it into \e other
+  void swapTrajectory(robot_trajectory::RobotTrajectory& other);
+
+  /** @brief Export the recorded samples as a trajectory of all variables of the robot model, stamped with the time of
+   *  the first sample. Unlike a RobotTrajectory, the message can be written to a bag as is. */
+  void getRecordedTrajectoryMsg(trajectory_msgs::JointTrajectory& trajectory) const;
+
   void setOnStateAddCallback(const TrajectoryStateAddedCallback& callback)
   {
     state_add_callback_ = callback;
@@ -95,13 +121,24 @@ public:
 
 private:
   void recordStates();
+  bool addSample(const std::vector<double>& positions, const ros::Time& stamp);
+  /* the position in positions_ / stamps_ of sample \e index, counting from the oldest kept one */
+  std::size_t getSlot(std::size_t index) const;
+  void updateTrajectory();
 
   CurrentStateMonitorConstPtr current_state_monitor_;
   double sampling_frequency_;
+  double change_threshold_;
+  std::size_t variable_count_;
+
+  /* recorded samples; once capacity_ samples are kept, first_sample_ is the index of the oldest one */
+  mutable boost::mutex samples_lock_;
+  std::size_t capacity_;
+  std::vector<double> positions_;
+  std::vector<ros::Time> stamps_;
+  std::size_t first_sample_;
 
   robot_trajectory::RobotTrajectory trajectory_;
-  ros::Time trajectory_start_time_;
-  ros::Time last_recorded_state_time_;
 
   std::unique_ptr<boost::thread> record_states_thread_;
   TrajectoryStateAddedCallback state_add_callback_;
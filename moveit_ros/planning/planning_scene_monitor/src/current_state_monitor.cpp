@@ -38,7 +38,84 @@
 
 #include <tf_conversions/tf_eigen.h>
 
+#include <atomic>
+#include <cstdint>
 #include <limits>
+#include <memory>
+
+/** Fixed size ring buffer of time stamped variable positions. There is a single writer (the joint state callback,
+    serialized by state_update_lock_); readers never lock. Every slot carries a sequence number that is odd while the
+    slot is being written, so readers can detect and retry torn reads. */
+class planning_scene_monitor::CurrentStateMonitor::StateHistory
+{
+public:
+  StateHistory(std::size_t capacity, std::size_t variable_count)
+    : capacity_(capacity)
+    , variable_count_(variable_count)
+    , sequence_(new std::atomic<std::uint32_t>[capacity])
+    , stamps_(new std::atomic<std::int64_t>[capacity])
+    , positions_(new std::atomic<double>[capacity * variable_count])
+    , count_(0)
+  {
+    for (std::size_t i = 0; i < capacity_; ++i)
+    {
+      sequence_[i].store(0, std::memory_order_relaxed);
+      stamps_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::size_t getCapacity() const
+  {
+    return capacity_;
+  }
+
+  /** The number of updates recorded so far (including the ones that were overwritten) */
+  std::uint64_t getCount() const
+  {
+    return count_.load(std::memory_order_acquire);
+  }
+
+  void push(const ros::Time& stamp, const double* positions)
+  {
+    std::uint64_t count = count_.load(std::memory_order_relaxed);
+    std::size_t slot = count % capacity_;
+    std::uint32_t seq = sequence_[slot].load(std::memory_order_relaxed);
+    sequence_[slot].store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stamps_[slot].store(stamp.toNSec(), std::memory_order_relaxed);
+    for (std::size_t i = 0; i < variable_count_; ++i)
+      positions_[slot * variable_count_ + i].store(positions[i], std::memory_order_relaxed);
+    sequence_[slot].store(seq + 2, std::memory_order_release);
+    count_.store(count + 1, std::memory_order_release);
+  }
+
+  /** Read update number \e index (0 is the first update ever recorded). \e positions may be NULL if only the stamp
+      is needed. Returns false if the update is not (or no longer) available. */
+  bool read(std::uint64_t index, ros::Time& stamp, double* positions) const
+  {
+    if (index >= getCount())
+      return false;
+    std::size_t slot = index % capacity_;
+    std::uint32_t seq = sequence_[slot].load(std::memory_order_acquire);
+    if (seq & 1)
+      return false;
+    stamp.fromNSec(stamps_[slot].load(std::memory_order_relaxed));
+    if (positions)
+      for (std::size_t i = 0; i < variable_count_; ++i)
+        positions[i] = positions_[slot * variable_count_ + i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // the slot must not have been rewritten meanwhile, and must still hold update index
+    return sequence_[slot].load(std::memory_order_relaxed) == seq && getCount() - index <= capacity_;
+  }
+
+private:
+  std::size_t capacity_;
+  std::size_t variable_count_;
+  std::unique_ptr<std::atomic<std::uint32_t>[]> sequence_;
+  std::unique_ptr<std::atomic<std::int64_t>[]> stamps_;
+  std::unique_ptr<std::atomic<double>[]> positions_;
+  std::atomic<std::uint64_t> count_;
+};
 
 planning_scene_monitor::CurrentStateMonitor::CurrentStateMonitor(const robot_model::RobotModelConstPtr& robot_model,
                                                                  const boost::shared_ptr<tf::Transformer>& tf)
@@ -122,6 +199,94 @@ void planning_scene_monitor::CurrentStateMonitor::setToCurrentState(robot_state:
   }
 }
 
+void planning_scene_monitor::CurrentStateMonitor::setStateHistoryCapacity(std::size_t capacity)
+{
+  std::shared_ptr<StateHistory> history;
+  if (capacity > 0)
+    history = std::make_shared<StateHistory>(capacity, robot_model_->getVariableCount());
+  boost::mutex::scoped_lock slock(state_update_lock_);
+  std::atomic_store(&state_history_, history);
+}
+
+std::size_t planning_scene_monitor::CurrentStateMonitor::getStateHistoryCapacity() const
+{
+  std::shared_ptr<const StateHistory> history = std::atomic_load(&state_history_);
+  return history ? history->getCapacity() : 0;
+}
+
+bool planning_scene_monitor::CurrentStateMonitor::getStateAtTime(const ros::Time& t,
+                                                                 robot_state::RobotState& state) const
+{
+  std::shared_ptr<const StateHistory> history = std::atomic_load(&state_history_);
+  if (!history)
+    return false;
+
+  std::vector<double> older(robot_model_->getVariableCount());
+  std::vector<double> newer(older.size());
+  // a read only fails if the writer overwrites the slots we look at, so retry a few times
+  for (int attempt = 0; attempt < 3; ++attempt)
+  {
+    std::uint64_t count = history->getCount();
+    if (count == 0)
+      return false;
+
+    // walk back from the most recent update to the first one that is not newer than t
+    std::uint64_t oldest = count > history->getCapacity() ? count - history->getCapacity() : 0;
+    std::uint64_t index = count - 1;
+    ros::Time stamp;
+    bool ok;
+    while ((ok = history->read(index, stamp, nullptr)) && stamp > t && index > oldest)
+      --index;
+    if (!ok)
+      continue;
+    if (stamp > t)
+      return false;  // t is older than the history
+
+    if (!history->read(index, stamp, older.data()))
+      continue;
+    state.setVariablePositions(older.data());
+    if (stamp == t)
+      return true;
+    if (index + 1 >= history->getCount())
+      return false;  // t is newer than the history
+
+    ros::Time newer_stamp;
+    if (!history->read(index + 1, newer_stamp, newer.data()))
+      continue;
+    robot_state::RobotState from(state);
+    robot_state::RobotState to(state);
+    to.setVariablePositions(newer.data());
+    from.interpolate(to, (t - stamp).toSec() / (newer_stamp - stamp).toSec(), state);
+    return true;
+  }
+  return false;
+}
+
+bool planning_scene_monitor::CurrentStateMonitor::waitForStateAtTime(const ros::Time& t,
+                                                                     robot_state::RobotState& state,
+                                                                     double wait_time) const
+{
+  std::shared_ptr<const StateHistory> history = std::atomic_load(&state_history_);
+  if (!history)
+    return false;
+
+  ros::WallTime start = ros::WallTime::now();
+  ros::WallDuration timeout(wait_time);
+  ros::WallDuration elapsed(0, 0);
+  ros::Time newest;
+  boost::mutex::scoped_lock lock(state_update_lock_);
+  // the history is appended under state_update_lock_, so no update is missed between the check and the wait
+  while (history->getCount() == 0 || !history->read(history->getCount() - 1, newest, nullptr) || newest < t)
+  {
+    if (elapsed > timeout)
+      return false;
+    state_update_condition_.wait_for(lock, boost::chrono::nanoseconds((timeout - elapsed).toNSec()));
+    elapsed = ros::WallTime::now() - start;
+  }
+  lock.unlock();
+  return getStateAtTime(t, state);
+}
+
 void planning_scene_monitor::CurrentStateMonitor::addUpdateCallback(const JointStateUpdateCallback& fn)
 {
   if (fn)
@@ -292,6 +457,27 @@ bool planning_scene_monitor::CurrentStateMonitor::waitForCurrentState(const ros:
   return true;
 }
 
+bool planning_scene_monitor::CurrentStateMonitor::waitForStateUpdate(const ros::Time& t, std::vector<double>& positions,
+                                                                    ros::Time& stamp, double wait_time) const
+{
+  ros::WallTime start = ros::WallTime::now();
+  ros::WallDuration elapsed(0, 0);
+  ros::WallDuration timeout(wait_time);
+
+  boost::mutex::scoped_lock lock(state_update_lock_);
+  while (current_state_time_ <= t)
+  {
+    if (elapsed > timeout)
+      return false;
+    state_update_condition_.wait_for(lock, boost::chrono::nanoseconds((timeout - elapsed).toNSec()));
+    elapsed = ros::WallTime::now() - start;
+  }
+  const double* pos = robot_state_.getVariablePositions();
+  positions.assign(pos, pos + robot_model_->getVariableCount());
+  stamp = current_state_time_;
+  return true;
+}
+
 bool planning_scene_monitor::CurrentStateMonitor::waitForCompleteState(double wait_time) const
 {
   double slept_time = 0.0;
@@ -354,11 +540,13 @@ void planning_scene_monitor::CurrentStateMonitor::jointStateCallback(const senso
   {
     boost::mutex::scoped_lock _(state_update_lock_);
     // read the received values, and update their time stamps
+    const std::vector<const moveit::core::JointModel*>& joints =
+        getJointStateMapping(joint_state->name).getJointModels();
     std::size_t n = joint_state->name.size();
     current_state_time_ = joint_state->header.stamp;
     for (std::size_t i = 0; i < n; ++i)
     {
-      const moveit::core::JointModel* jm = robot_model_->getJointModel(joint_state->name[i]);
+      const moveit::core::JointModel* jm = joints[i];
       if (!jm)
         continue;
       // ignore fixed joints, multi-dof joints (they should not even be in the message)
@@ -404,6 +592,10 @@ void planning_scene_monitor::CurrentStateMonitor::jointStateCallback(const senso
           robot_state_.setJointPositions(jm, &b.max_position_);
       }
     }
+
+    // record every update, also unchanged ones: their stamps matter for getStateAtTime()
+    if (state_history_)
+      state_history_->push(current_state_time_, robot_state_.getVariablePositions());
   }
 
   // callbacks, if needed
@@ -415,6 +607,26 @@ void planning_scene_monitor::CurrentStateMonitor::jointStateCallback(const senso
   state_update_condition_.notify_all();
 }
 
+const robot_model::VariableIndexMapping&
+planning_scene_monitor::CurrentStateMonitor::getJointStateMapping(const std::vector<std::string>& names)
+{
+  // publishers usually send the same ordering every time, so the first entry almost always matches
+  static const std::size_t MAX_CACHED_MAPPINGS = 8;
+  for (std::size_t i = 0; i < joint_state_mappings_.size(); ++i)
+    if (joint_state_mappings_[i]->matches(names))
+    {
+      if (i > 0)
+        std::swap(joint_state_mappings_[i], joint_state_mappings_[0]);
+      return *joint_state_mappings_[0];
+    }
+
+  if (joint_state_mappings_.size() >= MAX_CACHED_MAPPINGS)
+    joint_state_mappings_.pop_back();
+  joint_state_mappings_.insert(joint_state_mappings_.begin(),
+                               std::make_shared<const robot_model::VariableIndexMapping>(*robot_model_, names));
+  return *joint_state_mappings_[0];
+}
+
 void planning_scene_monitor::CurrentStateMonitor::tfCallback()
 {
   // read multi-dof joint states from TF, if needed
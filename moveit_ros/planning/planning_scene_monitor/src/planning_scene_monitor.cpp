@@ -42,7 +42,11 @@
 #include <dynamic_reconfigure/server.h>
 #include <moveit_ros_planning/PlanningSceneMonitorDynamicReconfigureConfig.h>
 #include <tf_conversions/tf_eigen.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <octomap_msgs/conversions.h>
+#include <moveit/occupancy_map_monitor/octree_delta.h>
 #include <moveit/profiler/profiler.h>
+#include <moveit/profiler/metrics.h>
 
 #include <memory>
 
@@ -52,6 +56,37 @@ using namespace moveit_ros_planning;
 
 static const std::string LOGNAME = "planning_scene_monitor";
 
+static moveit::tools::MetricHistogram& STATE_UPDATE_LAG = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_scene_state_update_lag_seconds", "Time from the stamp of the current state until the scene holds it");
+static moveit::tools::MetricHistogram& OCTOMAP_SCENE_UPDATE = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_scene_octomap_update_seconds", "Time spent copying the octomap into the planning scene");
+static moveit::tools::MetricHistogram& READ_LOCK_WAIT = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_scene_read_lock_wait_seconds", "Time spent waiting to lock the planning scene for reading");
+static moveit::tools::MetricHistogram& WRITE_LOCK_WAIT = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_scene_write_lock_wait_seconds", "Time spent waiting to lock the planning scene for writing");
+
+/** \brief Copy the joint values of \e from into \e to, keeping the attached bodies of \e to */
+static void copyCurrentState(const robot_state::RobotState& from, robot_state::RobotState& to)
+{
+  to.setVariablePositions(from.getVariablePositions());
+  if (from.hasVelocities())
+    to.setVariableVelocities(from.getVariableVelocities());
+  if (from.hasAccelerations())
+    to.setVariableAccelerations(from.getVariableAccelerations());
+  if (from.hasEffort())
+    to.setVariableEffort(from.getVariableEffort());
+  to.update();
+}
+
+/** \brief Lock \e mutex for writing, observing the time spent waiting for it */
+static boost::unique_lock<boost::shared_mutex> lockForUpdate(boost::shared_mutex& mutex)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  boost::unique_lock<boost::shared_mutex> lock(mutex);
+  WRITE_LOCK_WAIT.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  return lock;
+}
+
 class PlanningSceneMonitor::DynamicReconfigureImpl
 {
 public:
@@ -92,6 +127,9 @@ private:
     if (config.publish_planning_scene)
     {
       owner_->setPlanningScenePublishingFrequency(config.publish_planning_scene_hz);
+      owner_->setCompactPlanningScenePublishing(config.publish_compact_diffs);
+      owner_->setOctomapPublishingFrequency(config.publish_octomap_hz);
+      owner_->setPlanningScenePublishingBandwidth(config.publish_bandwidth);
       owner_->startPublishingPlanningScene(event);
     }
     else
@@ -179,6 +217,12 @@ void PlanningSceneMonitor::initialize(const planning_scene::PlanningScenePtr& sc
   moveit::tools::Profiler::ScopedStart prof_start;
   moveit::tools::Profiler::ScopedBlock prof_block("PlanningSceneMonitor::initialize");
 
+  scene_version_ = 0;
+  state_version_ = 0;
+  applied_state_version_ = 0;
+  octomap_version_ = 0;
+  snapshot_octree_version_ = 0;
+
   if (monitor_name_.empty())
     monitor_name_ = "planning_scene_monitor";
   robot_description_ = rm_loader_->getRobotDescription();
@@ -234,6 +278,11 @@ void PlanningSceneMonitor::initialize(const planning_scene::PlanningScenePtr& sc
 
   publish_planning_scene_frequency_ = 2.0;
   new_scene_update_ = UPDATE_NONE;
+  publish_compact_diffs_ = false;
+  publish_octomap_frequency_ = 0.0;
+  publish_planning_scene_bandwidth_ = 0.0;
+  published_subscriber_count_ = 0;
+  octomap_publish_pending_ = false;
 
   last_update_time_ = last_robot_motion_time_ = ros::Time::now();
   last_robot_state_update_wall_time_ = ros::WallTime::now();
@@ -247,10 +296,21 @@ void PlanningSceneMonitor::initialize(const planning_scene::PlanningScenePtr& sc
   shape_transform_cache_lookup_wait_time_ = ros::Duration(temp_wait_time);
 
   state_update_pending_ = false;
+  shape_handles_version_ = 0;
   state_update_timer_ = nh_.createWallTimer(dt_state_update_, &PlanningSceneMonitor::stateUpdateTimerCallback, this,
                                             false,   // not a oneshot timer
                                             false);  // do not start the timer yet
 
+  double batching_window = 0.0;
+  if (!robot_description_.empty())
+    nh_.param(robot_description_ + "_planning/collision_object_batching_window", batching_window, batching_window);
+  collision_object_batching_window_ = ros::WallDuration(std::max(0.0, batching_window));
+  collision_object_batching_timer_ =
+      nh_.createWallTimer(batching_window > 0.0 ? collision_object_batching_window_ : ros::WallDuration(0.01),
+                          &PlanningSceneMonitor::collisionObjectBatchingTimerCallback, this,
+                          false,   // not a oneshot timer
+                          false);  // started with the world geometry monitor
+
   reconfigure_impl_ = new DynamicReconfigureImpl(this);
 }
 
@@ -260,7 +320,7 @@ void PlanningSceneMonitor::monitorDiffs(bool flag)
   {
     if (flag)
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+      boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
       if (scene_)
       {
         scene_->setAttachedBodyUpdateCallback(robot_state::AttachedBodyCallback());
@@ -284,7 +344,7 @@ void PlanningSceneMonitor::monitorDiffs(bool flag)
         stopPublishingPlanningScene();
       }
       {
-        boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+        boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
         if (scene_)
         {
           scene_->decoupleParent();
@@ -340,6 +400,7 @@ void PlanningSceneMonitor::scenePublishingThread()
       if (octomap_monitor_)
         lock = octomap_monitor_->getOcTreePtr()->reading();
       scene_->getPlanningSceneMsg(msg);
+      compactPlanningSceneMsg(msg);
     }
     planning_scene_publisher_.publish(msg);
     ROS_DEBUG_NAMED(LOGNAME, "Published the full planning scene: '%s'", msg.name.c_str());
@@ -350,16 +411,21 @@ void PlanningSceneMonitor::scenePublishingThread()
     moveit_msgs::PlanningScene msg;
     bool publish_msg = false;
     bool is_full = false;
+    bool octomap_held_back = false;
     ros::Rate rate(publish_planning_scene_frequency_);
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+      boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
       while (new_scene_update_ == UPDATE_NONE && publish_planning_scene_)
         new_scene_update_condition_.wait(ulock);
       if (new_scene_update_ != UPDATE_NONE)
       {
+        applyCurrentState();
         if ((publish_update_types_ & new_scene_update_) || new_scene_update_ == UPDATE_SCENE)
         {
-          if (new_scene_update_ == UPDATE_SCENE)
+          // compact diffs refer to geometry sent earlier, so new subscribers need to see the full scene first
+          std::size_t subscriber_count = planning_scene_publisher_.getNumSubscribers();
+          if (new_scene_update_ == UPDATE_SCENE ||
+              (publish_compact_diffs_ && subscriber_count > published_subscriber_count_))
             is_full = true;
           else
           {
@@ -367,7 +433,9 @@ void PlanningSceneMonitor::scenePublishingThread()
             if (octomap_monitor_)
               lock = octomap_monitor_->getOcTreePtr()->reading();
             scene_->getPlanningSceneDiffMsg(msg);
+            octomap_held_back = compactPlanningSceneMsg(msg);
           }
+          published_subscriber_count_ = subscriber_count;
           boost::recursive_mutex::scoped_lock prevent_shape_cache_updates(shape_handles_lock_);  // we don't want the
                                                                                                  // transform cache to
                                                                                                  // update while we are
@@ -392,25 +460,161 @@ void PlanningSceneMonitor::scenePublishingThread()
             if (octomap_monitor_)
               lock = octomap_monitor_->getOcTreePtr()->reading();
             scene_->getPlanningSceneMsg(msg);
+            compactPlanningSceneMsg(msg);
           }
           // also publish timestamp of this robot_state
           msg.robot_state.joint_state.header.stamp = last_robot_motion_time_;
           publish_msg = true;
         }
-        new_scene_update_ = UPDATE_NONE;
+        // wake up again to send the octomap that was held back
+        new_scene_update_ = octomap_held_back ? UPDATE_GEOMETRY : UPDATE_NONE;
       }
     }
     if (publish_msg)
     {
       rate.reset();
+      ros::WallTime start = ros::WallTime::now();
       planning_scene_publisher_.publish(msg);
       if (is_full)
         ROS_DEBUG_NAMED(LOGNAME, "Published full planning scene: '%s'", msg.name.c_str());
       rate.sleep();
+
+      // stay within the bandwidth limit; updates arriving meanwhile are merged into the next diff
+      if (publish_planning_scene_bandwidth_ > 0.0)
+      {
+        double period = ros::serialization::serializationLength(msg) / publish_planning_scene_bandwidth_;
+        ros::WallDuration remaining = ros::WallDuration(period) - (ros::WallTime::now() - start);
+        if (remaining > ros::WallDuration())
+          remaining.sleep();
+      }
     }
   } while (publish_planning_scene_);
 }
 
+bool PlanningSceneMonitor::compactPlanningSceneMsg(moveit_msgs::PlanningScene& msg)
+{
+  bool held_back = false;
+  bool has_octomap = !msg.world.octomap.octomap.data.empty();
+  ros::WallTime now = ros::WallTime::now();
+  if (msg.is_diff && publish_octomap_frequency_ > 0.0 &&
+      (now - last_octomap_publish_time_).toSec() < 1.0 / publish_octomap_frequency_)
+  {
+    if (has_octomap)
+    {
+      msg.world.octomap = octomap_msgs::OctomapWithPose();
+      octomap_publish_pending_ = true;
+      has_octomap = false;
+    }
+    held_back = octomap_publish_pending_;
+  }
+  else if (msg.is_diff && !has_octomap && octomap_publish_pending_)
+    has_octomap = scene_->getOctomapMsg(msg.world.octomap);
+
+  if (has_octomap || !msg.is_diff)
+  {
+    octomap_publish_pending_ = false;
+    last_octomap_publish_time_ = now;
+  }
+
+  if (!publish_compact_diffs_)
+    return held_back;
+
+  // the monitored octree records its changes, so diffs only need to carry the regions that changed
+  occupancy_map_monitor::OccMapTree* monitored = octomap_monitor_ ? octomap_monitor_->getOcTreePtr().get() : NULL;
+  if (monitored && !monitored->isChangeDetectionEnabled())
+  {
+    monitored->enableChangeDetection(true);
+    monitored->markAllChanged();
+  }
+
+  if (has_octomap)
+  {
+    // the binary encoding only keeps free/occupied information, which is all subscribers use
+    collision_detection::CollisionWorld::ObjectConstPtr map =
+        scene_->getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+    if (map && map->shapes_.size() == 1)
+    {
+      const octomap::OcTree* octree = static_cast<const shapes::OcTree*>(map->shapes_[0].get())->octree.get();
+      msg.world.octomap.octomap = octomap_msgs::Octomap();
+      if (msg.is_diff && octree == monitored && !monitored->isAllChanged())
+      {
+        occupancy_map_monitor::OcTreeDelta delta(*monitored);
+        msg.world.octomap.octomap.id = occupancy_map_monitor::OcTreeDelta::OCTOMAP_ID;
+        msg.world.octomap.octomap.binary = true;
+        msg.world.octomap.octomap.resolution = octree->getResolution();
+        delta.serialize(msg.world.octomap.octomap.data);
+      }
+      else
+        octomap_msgs::binaryMapToMsg(*octree, msg.world.octomap.octomap);
+
+      // subscribers now hold this octree; changes of the monitored one are relative to it only if it was sent
+      if (monitored)
+      {
+        monitored->resetChanges();
+        if (octree != monitored)
+          monitored->markAllChanged();
+      }
+    }
+  }
+  else if (monitored && !msg.is_diff)
+    monitored->markAllChanged();
+
+  if (!msg.is_diff)
+    published_shapes_.clear();
+  for (std::size_t i = 0; i < msg.world.collision_objects.size(); ++i)
+  {
+    moveit_msgs::CollisionObject& co = msg.world.collision_objects[i];
+    if (co.operation == moveit_msgs::CollisionObject::REMOVE)
+    {
+      published_shapes_.erase(co.id);
+      continue;
+    }
+    collision_detection::CollisionWorld::ObjectConstPtr obj = scene_->getWorld()->getObject(co.id);
+    if (!obj)
+      continue;
+
+    std::vector<shapes::ShapeConstPtr>& published = published_shapes_[co.id];
+    if (!msg.is_diff || published != obj->shapes_)
+    {
+      published = obj->shapes_;
+      continue;
+    }
+
+    // Same shapes as last time: only send the poses. Subscribers add primitives, meshes and planes in this order,
+    // which is also the order in which a MOVE operation applies the poses.
+    moveit_msgs::CollisionObject move;
+    move.header = co.header;
+    move.id = co.id;
+    move.operation = moveit_msgs::CollisionObject::MOVE;
+    bool supported = true;
+    for (std::size_t j = 0; j < obj->shapes_.size() && supported; ++j)
+    {
+      geometry_msgs::Pose pose;
+      tf::poseEigenToMsg(obj->shape_poses_[j], pose);
+      switch (obj->shapes_[j]->type)
+      {
+        case shapes::SPHERE:
+        case shapes::BOX:
+        case shapes::CYLINDER:
+        case shapes::CONE:
+          move.primitive_poses.push_back(pose);
+          break;
+        case shapes::MESH:
+          move.mesh_poses.push_back(pose);
+          break;
+        case shapes::PLANE:
+          move.plane_poses.push_back(pose);
+          break;
+        default:
+          supported = false;
+      }
+    }
+    if (supported)
+      co = move;
+  }
+  return held_back;
+}
+
 void PlanningSceneMonitor::getMonitoredTopics(std::vector<std::string>& topics) const
 {
   topics.clear();
@@ -453,6 +657,10 @@ bool PlanningSceneMonitor::updatesScene(const planning_scene::PlanningSceneConst
 
 void PlanningSceneMonitor::triggerSceneUpdateEvent(SceneUpdateType update_type)
 {
+  // state updates are counted by state_version_
+  if (update_type != UPDATE_STATE)
+    scene_version_++;
+
   // do not modify update functions while we are calling them
   boost::recursive_mutex::scoped_lock lock(update_lock_);
 
@@ -503,7 +711,17 @@ void PlanningSceneMonitor::clearOctomap()
 {
   octomap_monitor_->getOcTreePtr()->lockWrite();
   octomap_monitor_->getOcTreePtr()->clear();
+  octomap_monitor_->getOcTreePtr()->markAllChanged();
   octomap_monitor_->getOcTreePtr()->unlockWrite();
+  if (octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
+  {
+    // the scene holds a copy of the tree, which has to be replaced by the cleared one
+    octomap_monitor_->getOcTreePtr()->publishSnapshot();
+    boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
+    scene_->processOctomapPtr(octomap_monitor_->getOcTreePtr()->getSnapshot(), Eigen::Affine3d::Identity());
+  }
+  octomap_version_++;
+  scene_version_++;
 }
 
 bool PlanningSceneMonitor::newPlanningSceneMessage(const moveit_msgs::PlanningScene& scene)
@@ -516,7 +734,7 @@ bool PlanningSceneMonitor::newPlanningSceneMessage(const moveit_msgs::PlanningSc
   SceneUpdateType upd = UPDATE_SCENE;
   std::string old_scene_name;
   {
-    boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+    boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
     // we don't want the transform cache to update while we are potentially changing attached bodies
     boost::recursive_mutex::scoped_lock prevent_shape_cache_updates(shape_handles_lock_);
 
@@ -526,14 +744,26 @@ bool PlanningSceneMonitor::newPlanningSceneMessage(const moveit_msgs::PlanningSc
                            "scene update " << fmod(last_update_time_.toSec(), 10.)
                                            << " robot stamp: " << fmod(last_robot_motion_time_.toSec(), 10.));
     old_scene_name = scene_->getName();
-    result = scene_->usePlanningSceneMsg(scene);
+    if (scene.world.octomap.octomap.id == occupancy_map_monitor::OcTreeDelta::OCTOMAP_ID)
+    {
+      // octomap deltas refer to the octree the scene already holds, so they are applied separately
+      moveit_msgs::PlanningScene without_octomap = scene;
+      without_octomap.world.octomap = octomap_msgs::OctomapWithPose();
+      result = scene_->usePlanningSceneMsg(without_octomap);
+      result = applyOctomapDelta(scene.world.octomap) && result;
+    }
+    else
+      result = scene_->usePlanningSceneMsg(scene);
     if (octomap_monitor_)
     {
       if (!scene.is_diff && scene.world.octomap.octomap.data.empty())
       {
         octomap_monitor_->getOcTreePtr()->lockWrite();
         octomap_monitor_->getOcTreePtr()->clear();
+        octomap_monitor_->getOcTreePtr()->markAllChanged();
         octomap_monitor_->getOcTreePtr()->unlockWrite();
+        if (octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
+          octomap_monitor_->getOcTreePtr()->publishSnapshot();
       }
     }
     robot_model_ = scene_->getRobotModel();
@@ -586,13 +816,40 @@ bool PlanningSceneMonitor::newPlanningSceneMessage(const moveit_msgs::PlanningSc
   return result;
 }
 
+bool PlanningSceneMonitor::applyOctomapDelta(const octomap_msgs::OctomapWithPose& map)
+{
+  collision_detection::CollisionWorld::ObjectConstPtr object =
+      scene_->getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+  const octomap::OcTree* octree = NULL;
+  if (object && object->shapes_.size() == 1)
+    octree = static_cast<const shapes::OcTree*>(object->shapes_[0].get())->octree.get();
+  if (!octree || octree->getResolution() != map.octomap.resolution)
+  {
+    ROS_WARN_NAMED(LOGNAME, "Ignoring octomap delta that does not refer to the octomap of the planning scene");
+    return false;
+  }
+
+  occupancy_map_monitor::OcTreeDelta delta;
+  if (!delta.deserialize(map.octomap.data))
+    return false;
+
+  // planning scenes in use may share the octree, so the delta is applied to a copy
+  std::shared_ptr<occupancy_map_monitor::OccMapTree> updated(new occupancy_map_monitor::OccMapTree(*octree));
+  delta.apply(*updated);
+  Eigen::Affine3d pose;
+  tf::poseMsgToEigen(map.origin, pose);
+  scene_->processOctomapPtr(updated, scene_->getTransforms().getTransform(map.header.frame_id) * pose);
+  ROS_DEBUG_NAMED(LOGNAME, "Applied octomap delta of %u regions", (unsigned int)delta.getRegionCount());
+  return true;
+}
+
 void PlanningSceneMonitor::newPlanningSceneWorldCallback(const moveit_msgs::PlanningSceneWorldConstPtr& world)
 {
   if (scene_)
   {
     updateFrameTransforms();
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+      boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
       last_update_time_ = ros::Time::now();
       scene_->getWorldNonConst()->clearObjects();
       scene_->processPlanningSceneWorldMsg(*world);
@@ -602,7 +859,10 @@ void PlanningSceneMonitor::newPlanningSceneWorldCallback(const moveit_msgs::Plan
         {
           octomap_monitor_->getOcTreePtr()->lockWrite();
           octomap_monitor_->getOcTreePtr()->clear();
+          octomap_monitor_->getOcTreePtr()->markAllChanged();
           octomap_monitor_->getOcTreePtr()->unlockWrite();
+          if (octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
+            octomap_monitor_->getOcTreePtr()->publishSnapshot();
         }
       }
     }
@@ -620,16 +880,65 @@ void PlanningSceneMonitor::collisionObjectFailTFCallback(const moveit_msgs::Coll
 
 void PlanningSceneMonitor::collisionObjectCallback(const moveit_msgs::CollisionObjectConstPtr& obj)
 {
-  if (scene_)
+  if (!scene_)
+    return;
+
+  bool batching;
   {
-    updateFrameTransforms();
-    {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
-      last_update_time_ = ros::Time::now();
-      scene_->processCollisionObjectMsg(*obj);
-    }
-    triggerSceneUpdateEvent(UPDATE_GEOMETRY);
+    boost::mutex::scoped_lock slock(pending_collision_objects_lock_);
+    pending_collision_objects_.push_back(obj);
+    batching = !collision_object_batching_window_.isZero();
+  }
+  // objects arriving concurrently on other spinner threads are still applied together
+  if (!batching)
+    processPendingCollisionObjects();
+}
+
+void PlanningSceneMonitor::processPendingCollisionObjects()
+{
+  std::vector<moveit_msgs::CollisionObjectConstPtr> objects;
+  {
+    boost::mutex::scoped_lock slock(pending_collision_objects_lock_);
+    objects.swap(pending_collision_objects_);
+  }
+  if (objects.empty() || !scene_)
+    return;
+
+  updateFrameTransforms();
+  {
+    boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
+    last_update_time_ = ros::Time::now();
+    for (std::size_t i = 0; i < objects.size(); ++i)
+      scene_->processCollisionObjectMsg(*objects[i]);
+  }
+  ROS_DEBUG_NAMED(LOGNAME, "Applied %u collision object updates", (unsigned int)objects.size());
+  triggerSceneUpdateEvent(UPDATE_GEOMETRY);
+}
+
+void PlanningSceneMonitor::collisionObjectBatchingTimerCallback(const ros::WallTimerEvent& event)
+{
+  processPendingCollisionObjects();
+}
+
+void PlanningSceneMonitor::setCollisionObjectBatchingWindow(double seconds)
+{
+  {
+    boost::mutex::scoped_lock slock(pending_collision_objects_lock_);
+    collision_object_batching_window_ = ros::WallDuration(std::max(0.0, seconds));
+  }
+  if (seconds > 0.0)
+  {
+    collision_object_batching_timer_.setPeriod(collision_object_batching_window_);
+    if (collision_object_subscriber_)
+      collision_object_batching_timer_.start();
   }
+  else
+  {
+    collision_object_batching_timer_.stop();
+    processPendingCollisionObjects();
+  }
+  ROS_DEBUG_NAMED(LOGNAME, "Collision objects are now collected for %lf seconds before they are applied",
+                  collision_object_batching_window_.toSec());
 }
 
 void PlanningSceneMonitor::attachObjectCallback(const moveit_msgs::AttachedCollisionObjectConstPtr& obj)
@@ -638,7 +947,7 @@ void PlanningSceneMonitor::attachObjectCallback(const moveit_msgs::AttachedColli
   {
     updateFrameTransforms();
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+      boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
       last_update_time_ = ros::Time::now();
       scene_->processAttachedCollisionObjectMsg(*obj);
     }
@@ -680,6 +989,7 @@ void PlanningSceneMonitor::excludeRobotLinksFromOctree()
       warned = true;
     }
   }
+  shape_handles_version_++;
 }
 
 void PlanningSceneMonitor::includeRobotLinksInOctree()
@@ -693,6 +1003,7 @@ void PlanningSceneMonitor::includeRobotLinksInOctree()
     for (std::size_t i = 0; i < it->second.size(); ++i)
       octomap_monitor_->forgetShape(it->second[i].first);
   link_shape_handles_.clear();
+  shape_handles_version_++;
 }
 
 void PlanningSceneMonitor::includeAttachedBodiesInOctree()
@@ -708,6 +1019,7 @@ void PlanningSceneMonitor::includeAttachedBodiesInOctree()
     for (std::size_t k = 0; k < it->second.size(); ++k)
       octomap_monitor_->forgetShape(it->second[k].first);
   attached_body_shape_handles_.clear();
+  shape_handles_version_++;
 }
 
 void PlanningSceneMonitor::excludeAttachedBodiesFromOctree()
@@ -735,6 +1047,7 @@ void PlanningSceneMonitor::includeWorldObjectsInOctree()
     for (std::size_t k = 0; k < it->second.size(); ++k)
       octomap_monitor_->forgetShape(it->second[k].first);
   collision_body_shape_handles_.clear();
+  shape_handles_version_++;
 }
 
 void PlanningSceneMonitor::excludeWorldObjectsFromOctree()
@@ -765,6 +1078,7 @@ void PlanningSceneMonitor::excludeAttachedBodyFromOctree(const robot_state::Atta
       attached_body_shape_handles_[attached_body].push_back(std::make_pair(h, i));
     }
   }
+  shape_handles_version_++;
   if (found)
     ROS_DEBUG_NAMED(LOGNAME, "Excluding attached body '%s' from monitored octomap", attached_body->getName().c_str());
 }
@@ -783,6 +1097,7 @@ void PlanningSceneMonitor::includeAttachedBodyInOctree(const robot_state::Attach
       octomap_monitor_->forgetShape(it->second[k].first);
     ROS_DEBUG_NAMED(LOGNAME, "Including attached body '%s' in monitored octomap", attached_body->getName().c_str());
     attached_body_shape_handles_.erase(it);
+    shape_handles_version_++;
   }
 }
 
@@ -805,6 +1120,7 @@ void PlanningSceneMonitor::excludeWorldObjectFromOctree(const collision_detectio
       found = true;
     }
   }
+  shape_handles_version_++;
   if (found)
     ROS_DEBUG_NAMED(LOGNAME, "Excluding collision object '%s' from monitored octomap", obj->id_.c_str());
 }
@@ -823,6 +1139,7 @@ void PlanningSceneMonitor::includeWorldObjectInOctree(const collision_detection:
       octomap_monitor_->forgetShape(it->second[k].first);
     ROS_DEBUG_NAMED(LOGNAME, "Including collision object '%s' in monitored octomap", obj->id_.c_str());
     collision_body_shape_handles_.erase(it);
+    shape_handles_version_++;
   }
 }
 
@@ -916,32 +1233,117 @@ bool PlanningSceneMonitor::waitForCurrentRobotState(const ros::Time& t, double w
 
 void PlanningSceneMonitor::lockSceneRead()
 {
+  moveit::tools::ScopedMetricTimer timer(READ_LOCK_WAIT);
+  // merge a pending state update, unless that would mean waiting for other readers
+  if (applied_state_version_ != state_version_ && scene_update_mutex_.try_lock())
+  {
+    applyCurrentState();
+    scene_update_mutex_.unlock();
+  }
   scene_update_mutex_.lock_shared();
-  if (octomap_monitor_)
+  // with snapshots, the scene holds an immutable copy of the octree and readers do not wait for the updaters
+  if (octomap_monitor_ && !octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
     octomap_monitor_->getOcTreePtr()->lockRead();
 }
 
 void PlanningSceneMonitor::unlockSceneRead()
 {
-  if (octomap_monitor_)
+  if (octomap_monitor_ && !octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
     octomap_monitor_->getOcTreePtr()->unlockRead();
   scene_update_mutex_.unlock_shared();
 }
 
 void PlanningSceneMonitor::lockSceneWrite()
 {
+  moveit::tools::ScopedMetricTimer timer(WRITE_LOCK_WAIT);
   scene_update_mutex_.lock();
+  applyCurrentState();
   if (octomap_monitor_)
     octomap_monitor_->getOcTreePtr()->lockWrite();
 }
 
 void PlanningSceneMonitor::unlockSceneWrite()
 {
+  // the scene may have been modified through LockedPlanningSceneRW, without triggering an update event
+  scene_version_++;
   if (octomap_monitor_)
+  {
+    octomap_version_++;
     octomap_monitor_->getOcTreePtr()->unlockWrite();
+  }
   scene_update_mutex_.unlock();
 }
 
+planning_scene::PlanningSceneConstPtr PlanningSceneMonitor::getPlanningSceneSnapshot()
+{
+  if (!scene_)
+    return planning_scene::PlanningSceneConstPtr();
+
+  std::shared_ptr<const SceneSnapshot> snapshot = std::atomic_load(&scene_snapshot_);
+  if (snapshot && snapshot->version_ == scene_version_ && snapshot->state_version_ == state_version_)
+    return snapshot->scene_;
+
+  // only one thread copies the scene; the others wait for that copy
+  boost::mutex::scoped_lock slock(snapshot_lock_);
+  snapshot = std::atomic_load(&scene_snapshot_);
+  unsigned long version = scene_version_;  // read before copying: changes made while copying cause a new copy
+  std::shared_ptr<const CurrentState> current = std::atomic_load(&current_state_);
+  unsigned long state_version = current ? current->version_ : 0;
+  if (snapshot && snapshot->version_ == version)
+  {
+    if (snapshot->state_version_ == state_version)
+      return snapshot->scene_;
+
+    // only the state changed: set it in a diff of the last copy, which needs no lock of the scene
+    std::shared_ptr<SceneSnapshot> new_snapshot(new SceneSnapshot(*snapshot));
+    new_snapshot->state_version_ = state_version;
+    planning_scene::PlanningScenePtr scene = snapshot->world_->diff();
+    copyCurrentState(*current->state_, scene->getCurrentStateNonConst());
+    new_snapshot->scene_ = scene;
+    std::atomic_store(&scene_snapshot_, std::shared_ptr<const SceneSnapshot>(new_snapshot));
+    return new_snapshot->scene_;
+  }
+
+  std::shared_ptr<SceneSnapshot> new_snapshot(new SceneSnapshot());
+  new_snapshot->version_ = version;
+  new_snapshot->state_version_ = state_version;
+  unsigned long octomap_version = octomap_version_;
+  lockSceneRead();
+  try
+  {
+    planning_scene::PlanningScenePtr scene = planning_scene::PlanningScene::clone(scene_);
+
+    // the octree of the octomap monitor is updated in place, so the copy needs its own octree
+    collision_detection::CollisionWorld::ObjectConstPtr map =
+        scene->getWorld()->getObject(planning_scene::PlanningScene::OCTOMAP_NS);
+    if (octomap_monitor_ && map && map->shapes_.size() == 1 && map->shapes_[0]->type == shapes::OCTREE &&
+        static_cast<const shapes::OcTree*>(map->shapes_[0].get())->octree == octomap_monitor_->getOcTreePtr())
+    {
+      if (!snapshot_octree_ || snapshot_octree_version_ != octomap_version)
+      {
+        snapshot_octree_.reset(new octomap::OcTree(*octomap_monitor_->getOcTreePtr()));
+        snapshot_octree_version_ = octomap_version;
+      }
+      Eigen::Affine3d pose = map->shape_poses_[0];
+      map.reset();
+      scene->processOctomapPtr(snapshot_octree_, pose);
+    }
+    if (current && applied_state_version_ != state_version)
+      copyCurrentState(*current->state_, scene->getCurrentStateNonConst());
+    new_snapshot->world_ = scene;
+    new_snapshot->scene_ = scene;
+  }
+  catch (...)
+  {
+    unlockSceneRead();
+    throw;
+  }
+  unlockSceneRead();
+
+  std::atomic_store(&scene_snapshot_, std::shared_ptr<const SceneSnapshot>(new_snapshot));
+  return new_snapshot->scene_;
+}
+
 void PlanningSceneMonitor::startSceneMonitor(const std::string& scene_topic)
 {
   stopSceneMonitor();
@@ -974,40 +1376,67 @@ bool PlanningSceneMonitor::getShapeTransformCache(const std::string& target_fram
   {
     boost::recursive_mutex::scoped_lock _(shape_handles_lock_);
 
-    for (LinkShapeHandles::const_iterator it = link_shape_handles_.begin(); it != link_shape_handles_.end(); ++it)
-    {
-      tf::StampedTransform tr;
-      tf_->waitForTransform(target_frame, it->first->getName(), target_time, shape_transform_cache_lookup_wait_time_);
-      tf_->lookupTransform(target_frame, it->first->getName(), target_time, tr);
-      Eigen::Affine3d ttr;
-      tf::transformTFToEigen(tr, ttr);
-      for (std::size_t j = 0; j < it->second.size(); ++j)
-        cache[it->second[j].first] = ttr * it->first->getCollisionOriginTransforms()[it->second[j].second];
-    }
-    for (AttachedBodyShapeHandles::const_iterator it = attached_body_shape_handles_.begin();
-         it != attached_body_shape_handles_.end(); ++it)
+    // several updaters often ask for the same sensor frame and time
+    static const std::size_t MAX_CACHED_SHAPE_TRANSFORMS = 4;
+    for (std::size_t i = 0; i < shape_transform_caches_.size(); ++i)
     {
-      tf::StampedTransform tr;
-      tf_->waitForTransform(target_frame, it->first->getAttachedLinkName(), target_time,
-                            shape_transform_cache_lookup_wait_time_);
-      tf_->lookupTransform(target_frame, it->first->getAttachedLinkName(), target_time, tr);
-      Eigen::Affine3d transform;
-      tf::transformTFToEigen(tr, transform);
-      for (std::size_t k = 0; k < it->second.size(); ++k)
-        cache[it->second[k].first] = transform * it->first->getFixedTransforms()[it->second[k].second];
+      const CachedShapeTransforms& cached = shape_transform_caches_[i];
+      if (cached.target_time_ == target_time && cached.shape_handles_version_ == shape_handles_version_ &&
+          cached.target_frame_ == target_frame)
+      {
+        cache.insert(cached.cache_.begin(), cached.cache_.end());
+        return true;
+      }
     }
+
+    occupancy_map_monitor::ShapeTransformCache computed;
+    if (!computeShapeTransformsFromStateHistory(target_frame, target_time, computed))
     {
-      tf::StampedTransform tr;
-      tf_->waitForTransform(target_frame, scene_->getPlanningFrame(), target_time,
-                            shape_transform_cache_lookup_wait_time_);
-      tf_->lookupTransform(target_frame, scene_->getPlanningFrame(), target_time, tr);
-      Eigen::Affine3d transform;
-      tf::transformTFToEigen(tr, transform);
-      for (CollisionBodyShapeHandles::const_iterator it = collision_body_shape_handles_.begin();
-           it != collision_body_shape_handles_.end(); ++it)
+      for (LinkShapeHandles::const_iterator it = link_shape_handles_.begin(); it != link_shape_handles_.end(); ++it)
+      {
+        tf::StampedTransform tr;
+        tf_->waitForTransform(target_frame, it->first->getName(), target_time, shape_transform_cache_lookup_wait_time_);
+        tf_->lookupTransform(target_frame, it->first->getName(), target_time, tr);
+        Eigen::Affine3d ttr;
+        tf::transformTFToEigen(tr, ttr);
+        for (std::size_t j = 0; j < it->second.size(); ++j)
+          computed[it->second[j].first] = ttr * it->first->getCollisionOriginTransforms()[it->second[j].second];
+      }
+      for (AttachedBodyShapeHandles::const_iterator it = attached_body_shape_handles_.begin();
+           it != attached_body_shape_handles_.end(); ++it)
+      {
+        tf::StampedTransform tr;
+        tf_->waitForTransform(target_frame, it->first->getAttachedLinkName(), target_time,
+                              shape_transform_cache_lookup_wait_time_);
+        tf_->lookupTransform(target_frame, it->first->getAttachedLinkName(), target_time, tr);
+        Eigen::Affine3d transform;
+        tf::transformTFToEigen(tr, transform);
         for (std::size_t k = 0; k < it->second.size(); ++k)
-          cache[it->second[k].first] = transform * (*it->second[k].second);
+          computed[it->second[k].first] = transform * it->first->getFixedTransforms()[it->second[k].second];
+      }
+      {
+        tf::StampedTransform tr;
+        tf_->waitForTransform(target_frame, scene_->getPlanningFrame(), target_time,
+                              shape_transform_cache_lookup_wait_time_);
+        tf_->lookupTransform(target_frame, scene_->getPlanningFrame(), target_time, tr);
+        Eigen::Affine3d transform;
+        tf::transformTFToEigen(tr, transform);
+        for (CollisionBodyShapeHandles::const_iterator it = collision_body_shape_handles_.begin();
+             it != collision_body_shape_handles_.end(); ++it)
+          for (std::size_t k = 0; k < it->second.size(); ++k)
+            computed[it->second[k].first] = transform * (*it->second[k].second);
+      }
     }
+
+    if (shape_transform_caches_.size() >= MAX_CACHED_SHAPE_TRANSFORMS)
+      shape_transform_caches_.pop_back();
+    shape_transform_caches_.push_front(CachedShapeTransforms());
+    CachedShapeTransforms& cached = shape_transform_caches_.front();
+    cached.target_frame_ = target_frame;
+    cached.target_time_ = target_time;
+    cached.shape_handles_version_ = shape_handles_version_;
+    cached.cache_.swap(computed);
+    cache.insert(cached.cache_.begin(), cached.cache_.end());
   }
   catch (tf::TransformException& ex)
   {
@@ -1017,6 +1446,53 @@ bool PlanningSceneMonitor::getShapeTransformCache(const std::string& target_fram
   return true;
 }
 
+bool PlanningSceneMonitor::computeShapeTransformsFromStateHistory(
+    const std::string& target_frame, const ros::Time& target_time,
+    occupancy_map_monitor::ShapeTransformCache& cache) const
+{
+  if (!current_state_monitor_ || target_time.isZero())
+    return false;
+  robot_state::RobotState state(getRobotModel());
+  if (!current_state_monitor_->getStateAtTime(target_time, state))
+    return false;
+  state.updateLinkTransforms();
+
+  // only the pose of the model frame needs to come from TF; the planning frame is the model frame
+  tf::StampedTransform tr;
+  tf_->waitForTransform(target_frame, getRobotModel()->getModelFrame(), target_time,
+                        shape_transform_cache_lookup_wait_time_);
+  tf_->lookupTransform(target_frame, getRobotModel()->getModelFrame(), target_time, tr);
+  Eigen::Affine3d transform;
+  tf::transformTFToEigen(tr, transform);
+
+  for (LinkShapeHandles::const_iterator it = link_shape_handles_.begin(); it != link_shape_handles_.end(); ++it)
+  {
+    Eigen::Affine3d link_transform = transform * state.getGlobalLinkTransform(it->first);
+    for (std::size_t j = 0; j < it->second.size(); ++j)
+      cache[it->second[j].first] = link_transform * it->first->getCollisionOriginTransforms()[it->second[j].second];
+  }
+  for (AttachedBodyShapeHandles::const_iterator it = attached_body_shape_handles_.begin();
+       it != attached_body_shape_handles_.end(); ++it)
+  {
+    Eigen::Affine3d link_transform = transform * state.getGlobalLinkTransform(it->first->getAttachedLink());
+    for (std::size_t k = 0; k < it->second.size(); ++k)
+      cache[it->second[k].first] = link_transform * it->first->getFixedTransforms()[it->second[k].second];
+  }
+  for (CollisionBodyShapeHandles::const_iterator it = collision_body_shape_handles_.begin();
+       it != collision_body_shape_handles_.end(); ++it)
+    for (std::size_t k = 0; k < it->second.size(); ++k)
+      cache[it->second[k].first] = transform * (*it->second[k].second);
+  return true;
+}
+
+void PlanningSceneMonitor::configureStateHistory()
+{
+  // about a second of joint states at 1kHz; shape transforms are needed for sensor data that is a few frames old
+  static const std::size_t STATE_HISTORY_CAPACITY = 1024;
+  if (octomap_monitor_ && current_state_monitor_ && current_state_monitor_->getStateHistoryCapacity() == 0)
+    current_state_monitor_->setStateHistoryCapacity(STATE_HISTORY_CAPACITY);
+}
+
 void PlanningSceneMonitor::startWorldGeometryMonitor(const std::string& collision_objects_topic,
                                                      const std::string& planning_scene_world_topic,
                                                      const bool load_octomap_monitor)
@@ -1046,6 +1522,8 @@ void PlanningSceneMonitor::startWorldGeometryMonitor(const std::string& collisio
           boost::bind(&PlanningSceneMonitor::collisionObjectCallback, this, _1));
       ROS_INFO_NAMED(LOGNAME, "Listening to '%s'", root_nh_.resolveName(collision_objects_topic).c_str());
     }
+    if (!collision_object_batching_window_.isZero())
+      collision_object_batching_timer_.start();
   }
 
   if (!planning_scene_world_topic.empty())
@@ -1069,6 +1547,7 @@ void PlanningSceneMonitor::startWorldGeometryMonitor(const std::string& collisio
       octomap_monitor_->setTransformCacheCallback(
           boost::bind(&PlanningSceneMonitor::getShapeTransformCache, this, _1, _2, _3));
       octomap_monitor_->setUpdateCallback(boost::bind(&PlanningSceneMonitor::octomapUpdateCallback, this));
+      configureStateHistory();
     }
     octomap_monitor_->startMonitor();
   }
@@ -1082,6 +1561,8 @@ void PlanningSceneMonitor::stopWorldGeometryMonitor()
     collision_object_filter_.reset();
     collision_object_subscriber_.reset();
     planning_scene_world_subscriber_.shutdown();
+    collision_object_batching_timer_.stop();
+    processPendingCollisionObjects();
   }
   else if (planning_scene_world_subscriber_)
   {
@@ -1101,6 +1582,7 @@ void PlanningSceneMonitor::startStateMonitor(const std::string& joint_states_top
     if (!current_state_monitor_)
       current_state_monitor_.reset(new CurrentStateMonitor(getRobotModel(), tf_, root_nh_));
     current_state_monitor_->addUpdateCallback(boost::bind(&PlanningSceneMonitor::onStateUpdate, this, _1));
+    configureStateHistory();
     current_state_monitor_->startStateMonitor(joint_states_topic);
 
     {
@@ -1200,18 +1682,28 @@ void PlanningSceneMonitor::octomapUpdateCallback()
 
   updateFrameTransforms();
   {
-    boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+    boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
     last_update_time_ = ros::Time::now();
-    octomap_monitor_->getOcTreePtr()->lockRead();
-    try
+    octomap_version_++;
+    moveit::tools::ScopedMetricTimer timer(OCTOMAP_SCENE_UPDATE);
+    if (octomap_monitor_->getOcTreePtr()->isSnapshotsEnabled())
     {
-      scene_->processOctomapPtr(octomap_monitor_->getOcTreePtr(), Eigen::Affine3d::Identity());
-      octomap_monitor_->getOcTreePtr()->unlockRead();
+      // the snapshot was published by the updater that triggered this callback
+      scene_->processOctomapPtr(octomap_monitor_->getOcTreePtr()->getSnapshot(), Eigen::Affine3d::Identity());
     }
-    catch (...)
+    else
     {
-      octomap_monitor_->getOcTreePtr()->unlockRead();  // unlock and rethrow
-      throw;
+      octomap_monitor_->getOcTreePtr()->lockRead();
+      try
+      {
+        scene_->processOctomapPtr(octomap_monitor_->getOcTreePtr(), Eigen::Affine3d::Identity());
+        octomap_monitor_->getOcTreePtr()->unlockRead();
+      }
+      catch (...)
+      {
+        octomap_monitor_->getOcTreePtr()->unlockRead();  // unlock and rethrow
+        throw;
+      }
     }
   }
   triggerSceneUpdateEvent(UPDATE_GEOMETRY);
@@ -1255,12 +1747,27 @@ void PlanningSceneMonitor::updateSceneWithCurrentState()
                               missing_str.c_str());
     }
 
+    // the state is stored without locking the scene, so state updates do not wait for readers of the scene
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
-      last_update_time_ = last_robot_motion_time_ = current_state_monitor_->getCurrentStateTime();
-      ROS_DEBUG_STREAM_NAMED(LOGNAME, "robot state update " << fmod(last_robot_motion_time_.toSec(), 10.));
-      current_state_monitor_->setToCurrentState(scene_->getCurrentStateNonConst());
-      scene_->getCurrentStateNonConst().update();  // compute all transforms
+      boost::mutex::scoped_lock slock(current_state_lock_);
+      std::shared_ptr<CurrentState> current(new CurrentState());
+      current->stamp_ = current_state_monitor_->getCurrentStateTime();
+      current->version_ = state_version_ + 1;
+      robot_state::RobotStatePtr state(new robot_state::RobotState(getRobotModel()));
+      current_state_monitor_->setToCurrentState(*state);
+      state->update();  // compute all transforms
+      current->state_ = state;
+      ROS_DEBUG_STREAM_NAMED(LOGNAME, "robot state update " << fmod(current->stamp_.toSec(), 10.));
+      std::atomic_store(&current_state_, std::shared_ptr<const CurrentState>(current));
+      state_version_ = current->version_;
+      if (!current->stamp_.isZero())
+        STATE_UPDATE_LAG.observe((ros::Time::now() - current->stamp_).toSec());
+    }
+    // merge the state into the scene right away if nobody is using the scene
+    if (scene_update_mutex_.try_lock())
+    {
+      applyCurrentState();
+      scene_update_mutex_.unlock();
     }
     triggerSceneUpdateEvent(UPDATE_STATE);
   }
@@ -1268,6 +1775,22 @@ void PlanningSceneMonitor::updateSceneWithCurrentState()
     ROS_ERROR_THROTTLE_NAMED(1, LOGNAME, "State monitor is not active. Unable to set the planning scene state");
 }
 
+robot_state::RobotStateConstPtr PlanningSceneMonitor::getCurrentStateSnapshot() const
+{
+  std::shared_ptr<const CurrentState> current = std::atomic_load(&current_state_);
+  return current ? current->state_ : robot_state::RobotStateConstPtr();
+}
+
+void PlanningSceneMonitor::applyCurrentState()
+{
+  std::shared_ptr<const CurrentState> current = std::atomic_load(&current_state_);
+  if (!current || current->version_ == applied_state_version_)
+    return;
+  last_update_time_ = last_robot_motion_time_ = current->stamp_;
+  copyCurrentState(*current->state_, scene_->getCurrentStateNonConst());
+  applied_state_version_ = current->version_;
+}
+
 void PlanningSceneMonitor::addUpdateCallback(const boost::function<void(SceneUpdateType)>& fn)
 {
   boost::recursive_mutex::scoped_lock lock(update_lock_);
@@ -1288,6 +1811,32 @@ void PlanningSceneMonitor::setPlanningScenePublishingFrequency(double hz)
                   publish_planning_scene_frequency_);
 }
 
+void PlanningSceneMonitor::setCompactPlanningScenePublishing(bool flag)
+{
+  publish_compact_diffs_ = flag;
+  if (!flag && octomap_monitor_)
+  {
+    occupancy_map_monitor::OccMapTree::WriteLock lock = octomap_monitor_->getOcTreePtr()->writing();
+    octomap_monitor_->getOcTreePtr()->enableChangeDetection(false);
+    octomap_monitor_->getOcTreePtr()->resetChanges();
+  }
+  ROS_DEBUG_NAMED(LOGNAME, "Compact planning scene publishing is now %s", flag ? "enabled" : "disabled");
+}
+
+void PlanningSceneMonitor::setOctomapPublishingFrequency(double hz)
+{
+  publish_octomap_frequency_ = hz;
+  ROS_DEBUG_NAMED(LOGNAME, "Maximum frequency for publishing octomap updates is now %lf Hz",
+                  publish_octomap_frequency_);
+}
+
+void PlanningSceneMonitor::setPlanningScenePublishingBandwidth(double bytes_per_second)
+{
+  publish_planning_scene_bandwidth_ = bytes_per_second;
+  ROS_DEBUG_NAMED(LOGNAME, "Bandwidth limit for publishing planning scenes is now %lf bytes/s",
+                  publish_planning_scene_bandwidth_);
+}
+
 void PlanningSceneMonitor::getUpdatedFrameTransforms(std::vector<geometry_msgs::TransformStamped>& transforms)
 {
   const std::string& target = getRobotModel()->getModelFrame();
@@ -1352,7 +1901,7 @@ void PlanningSceneMonitor::updateFrameTransforms()
     std::vector<geometry_msgs::TransformStamped> transforms;
     getUpdatedFrameTransforms(transforms);
     {
-      boost::unique_lock<boost::shared_mutex> ulock(scene_update_mutex_);
+      boost::unique_lock<boost::shared_mutex> ulock = lockForUpdate(scene_update_mutex_);
       scene_->getTransformsNonConst().setTransforms(transforms);
       last_update_time_ = ros::Time::now();
     }
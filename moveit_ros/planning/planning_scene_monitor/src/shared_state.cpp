@@ -0,0 +1,190 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/planning_scene_monitor/shared_state.h>
+#include <ros/console.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace planning_scene_monitor
+{
+namespace
+{
+const uint64_t SHARED_STATE_MAGIC = 0x6d6f766569745331ull;  // "moveitS1"
+
+// layout of the segment; the variable positions follow the header
+struct SharedStateHeader
+{
+  std::atomic<uint64_t> magic;  // zero while the segment is set up or after the writer is gone
+  uint64_t model_hash;          // identifies the variable names, in order
+  uint64_t variable_count;
+  std::atomic<uint64_t> sequence;  // odd while the positions are written
+  std::atomic<int64_t> stamp_nsec;
+};
+
+uint64_t hashVariableNames(const robot_model::RobotModelConstPtr& robot_model)
+{
+  // FNV-1a over the names, so writer and reader agree without sharing the std::hash implementation
+  uint64_t hash = 14695981039346656037ull;
+  const std::vector<std::string>& names = robot_model->getVariableNames();
+  for (std::size_t i = 0; i < names.size(); ++i)
+    for (std::size_t j = 0; j <= names[i].size(); ++j)
+    {
+      hash ^= j < names[i].size() ? (unsigned char)names[i][j] : 0;
+      hash *= 1099511628211ull;
+    }
+  return hash;
+}
+
+std::size_t segmentSize(std::size_t variable_count)
+{
+  return sizeof(SharedStateHeader) + variable_count * sizeof(double);
+}
+}
+
+std::string getSharedStateSegmentName(const robot_model::RobotModelConstPtr& robot_model)
+{
+  return "moveit_current_state_" + robot_model->getName();
+}
+
+SharedStateWriter::SharedStateWriter(const robot_model::RobotModelConstPtr& robot_model, const std::string& name)
+  : name_(name.empty() ? getSharedStateSegmentName(robot_model) : name)
+  , variable_count_(robot_model->getVariableCount())
+{
+  // readers still mapping a previous segment keep it until they notice its magic is gone
+  boost::interprocess::shared_memory_object::remove(name_.c_str());
+  boost::interprocess::shared_memory_object segment(boost::interprocess::create_only, name_.c_str(),
+                                                     boost::interprocess::read_write);
+  segment.truncate(segmentSize(variable_count_));
+  boost::interprocess::mapped_region(segment, boost::interprocess::read_write).swap(region_);
+
+  SharedStateHeader* header = new (region_.get_address()) SharedStateHeader();
+  header->magic.store(0);
+  header->model_hash = hashVariableNames(robot_model);
+  header->variable_count = variable_count_;
+  header->sequence.store(0);
+  header->stamp_nsec.store(0);
+  header->magic.store(SHARED_STATE_MAGIC, std::memory_order_release);
+}
+
+SharedStateWriter::~SharedStateWriter()
+{
+  static_cast<SharedStateHeader*>(region_.get_address())->magic.store(0, std::memory_order_release);
+  boost::interprocess::shared_memory_object::remove(name_.c_str());
+}
+
+void SharedStateWriter::write(const robot_state::RobotState& state, const ros::Time& stamp)
+{
+  SharedStateHeader* header = static_cast<SharedStateHeader*>(region_.get_address());
+  double* positions = reinterpret_cast<double*>(header + 1);
+
+  // a sequence lock: readers retry if the sequence was odd or changed while they copied the positions
+  uint64_t sequence = header->sequence.load(std::memory_order_relaxed);
+  header->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::copy(state.getVariablePositions(), state.getVariablePositions() + variable_count_, positions);
+  header->stamp_nsec.store(stamp.toNSec(), std::memory_order_relaxed);
+  header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+SharedStateReader::SharedStateReader(const robot_model::RobotModelConstPtr& robot_model, const std::string& name)
+  : robot_model_(robot_model), name_(name.empty() ? getSharedStateSegmentName(robot_model) : name)
+{
+}
+
+bool SharedStateReader::connect()
+{
+  region_.reset();
+  try
+  {
+    boost::interprocess::shared_memory_object segment(boost::interprocess::open_only, name_.c_str(),
+                                                       boost::interprocess::read_only);
+    region_.reset(new boost::interprocess::mapped_region(segment, boost::interprocess::read_only));
+  }
+  catch (boost::interprocess::interprocess_exception&)
+  {
+    return false;
+  }
+
+  const SharedStateHeader* header = static_cast<const SharedStateHeader*>(region_->get_address());
+  if (region_->get_size() < sizeof(SharedStateHeader) ||
+      header->magic.load(std::memory_order_acquire) != SHARED_STATE_MAGIC ||
+      header->variable_count != robot_model_->getVariableCount() ||
+      region_->get_size() < segmentSize(header->variable_count) ||
+      header->model_hash != hashVariableNames(robot_model_))
+  {
+    ROS_DEBUG_STREAM("Shared memory segment '" << name_ << "' does not hold a state of robot '"
+                                               << robot_model_->getName() << "'");
+    region_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool SharedStateReader::read(robot_state::RobotState& state, ros::Time& stamp)
+{
+  if (!region_ || static_cast<const SharedStateHeader*>(region_->get_address())
+                          ->magic.load(std::memory_order_acquire) != SHARED_STATE_MAGIC)
+    if (!connect())
+      return false;
+
+  const SharedStateHeader* header = static_cast<const SharedStateHeader*>(region_->get_address());
+  const double* positions = reinterpret_cast<const double*>(header + 1);
+  std::vector<double> values(header->variable_count);
+  int64_t stamp_nsec = 0;
+  bool consistent = false;
+  // a writer that died while writing leaves the sequence odd, so do not retry forever
+  for (int attempt = 0; !consistent && attempt < 1000; ++attempt)
+  {
+    uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    std::copy(positions, positions + values.size(), values.begin());
+    stamp_nsec = header->stamp_nsec.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    consistent = header->sequence.load(std::memory_order_relaxed) == sequence;
+  }
+  // a zero stamp means nothing was written yet
+  if (!consistent || stamp_nsec == 0)
+    return false;
+
+  state.setVariablePositions(values);
+  stamp.fromNSec(stamp_nsec);
+  return true;
+}
+}
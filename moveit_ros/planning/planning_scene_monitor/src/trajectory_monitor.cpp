@@ -36,7 +36,9 @@
 
 #include <moveit/planning_scene_monitor/trajectory_monitor.h>
 #include <moveit/trajectory_processing/trajectory_tools.h>
-#include <ros/rate.h>
+#include <moveit/utils/thread_groups.h>
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <memory>
 
@@ -44,6 +46,10 @@ planning_scene_monitor::TrajectoryMonitor::TrajectoryMonitor(const CurrentStateM
                                                              double sampling_frequency)
   : current_state_monitor_(state_monitor)
   , sampling_frequency_(5.0)
+  , change_threshold_(0.0)
+  , variable_count_(current_state_monitor_->getRobotModel()->getVariableCount())
+  , capacity_(0)
+  , first_sample_(0)
   , trajectory_(current_state_monitor_->getRobotModel(), "")
 {
   setSamplingFrequency(sampling_frequency);
@@ -56,12 +62,34 @@ planning_scene_monitor::TrajectoryMonitor::~TrajectoryMonitor()
 
 void planning_scene_monitor::TrajectoryMonitor::setSamplingFrequency(double sampling_frequency)
 {
-  if (sampling_frequency <= std::numeric_limits<double>::epsilon())
-    ROS_ERROR("The sampling frequency for trajectory states should be positive");
+  if (sampling_frequency < 0.0)
+    ROS_ERROR("The sampling frequency for trajectory states should not be negative");
   else
     sampling_frequency_ = sampling_frequency;
 }
 
+void planning_scene_monitor::TrajectoryMonitor::setRecordingCapacity(std::size_t capacity)
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  capacity_ = capacity;
+  stamps_.clear();
+  stamps_.reserve(capacity);
+  positions_.assign(capacity * variable_count_, 0.0);
+  first_sample_ = 0;
+}
+
+void planning_scene_monitor::TrajectoryMonitor::setChangeThreshold(double threshold)
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  change_threshold_ = std::max(threshold, 0.0);
+}
+
+std::size_t planning_scene_monitor::TrajectoryMonitor::getSampleCount() const
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  return stamps_.size();
+}
+
 bool planning_scene_monitor::TrajectoryMonitor::isActive() const
 {
   return static_cast<bool>(record_states_thread_);
@@ -89,37 +117,123 @@ void planning_scene_monitor::TrajectoryMonitor::stopTrajectoryMonitor()
 
 void planning_scene_monitor::TrajectoryMonitor::clearTrajectory()
 {
-  bool restart = isActive();
-  if (restart)
-    stopTrajectoryMonitor();
+  boost::mutex::scoped_lock slock(samples_lock_);
+  stamps_.clear();
+  if (capacity_ == 0)
+    positions_.clear();
+  first_sample_ = 0;
   trajectory_.clear();
-  if (restart)
-    startTrajectoryMonitor();
+}
+
+std::size_t planning_scene_monitor::TrajectoryMonitor::getSlot(std::size_t index) const
+{
+  return (first_sample_ + index) % stamps_.size();
+}
+
+bool planning_scene_monitor::TrajectoryMonitor::addSample(const std::vector<double>& positions, const ros::Time& stamp)
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  if (change_threshold_ > 0.0 && !stamps_.empty())
+  {
+    const double* last = &positions_[getSlot(stamps_.size() - 1) * variable_count_];
+    bool changed = false;
+    for (std::size_t i = 0; i < variable_count_ && !changed; ++i)
+      changed = std::fabs(positions[i] - last[i]) > change_threshold_;
+    if (!changed)
+      return false;
+  }
+
+  if (capacity_ == 0)
+  {
+    positions_.insert(positions_.end(), positions.begin(), positions.begin() + variable_count_);
+    stamps_.push_back(stamp);
+  }
+  else if (stamps_.size() < capacity_)
+  {
+    std::copy(positions.begin(), positions.begin() + variable_count_, &positions_[stamps_.size() * variable_count_]);
+    stamps_.push_back(stamp);
+  }
+  else
+  {
+    // the buffer is full: overwrite the oldest sample
+    std::copy(positions.begin(), positions.begin() + variable_count_, &positions_[first_sample_ * variable_count_]);
+    stamps_[first_sample_] = stamp;
+    first_sample_ = (first_sample_ + 1) % capacity_;
+  }
+  return true;
+}
+
+void planning_scene_monitor::TrajectoryMonitor::updateTrajectory()
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  trajectory_.clear();
+  for (std::size_t i = 0; i < stamps_.size(); ++i)
+  {
+    std::size_t slot = getSlot(i);
+    robot_state::RobotStatePtr state(new robot_state::RobotState(current_state_monitor_->getRobotModel()));
+    state->setVariablePositions(&positions_[slot * variable_count_]);
+    trajectory_.addSuffixWayPoint(state, i == 0 ? 0.0 : (stamps_[slot] - stamps_[getSlot(i - 1)]).toSec());
+  }
+}
+
+const robot_trajectory::RobotTrajectory& planning_scene_monitor::TrajectoryMonitor::getTrajectory()
+{
+  updateTrajectory();
+  return trajectory_;
+}
+
+void planning_scene_monitor::TrajectoryMonitor::swapTrajectory(robot_trajectory::RobotTrajectory& other)
+{
+  updateTrajectory();
+  trajectory_.swap(other);
+}
+
+void planning_scene_monitor::TrajectoryMonitor::getRecordedTrajectoryMsg(
+    trajectory_msgs::JointTrajectory& trajectory) const
+{
+  boost::mutex::scoped_lock slock(samples_lock_);
+  trajectory = trajectory_msgs::JointTrajectory();
+  trajectory.header.frame_id = current_state_monitor_->getRobotModel()->getModelFrame();
+  trajectory.joint_names = current_state_monitor_->getRobotModel()->getVariableNames();
+  if (stamps_.empty())
+    return;
+  trajectory.header.stamp = stamps_[getSlot(0)];
+  trajectory.points.resize(stamps_.size());
+  for (std::size_t i = 0; i < stamps_.size(); ++i)
+  {
+    std::size_t slot = getSlot(i);
+    const double* positions = &positions_[slot * variable_count_];
+    trajectory.points[i].positions.assign(positions, positions + variable_count_);
+    trajectory.points[i].time_from_start = stamps_[slot] - trajectory.header.stamp;
+  }
 }
 
 void planning_scene_monitor::TrajectoryMonitor::recordStates()
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_EXECUTION);
   if (!current_state_monitor_)
     return;
 
-  ros::Rate rate(sampling_frequency_);
-
+  std::vector<double> positions;
+  ros::Time stamp;
+  ros::Time record_after;  // the next sample is the first state update stamped after this
   while (record_states_thread_)
   {
-    rate.sleep();
-    std::pair<robot_state::RobotStatePtr, ros::Time> state = current_state_monitor_->getCurrentStateAndTime();
-    if (trajectory_.empty())
+    // wake up on state updates instead of polling; the timeout only bounds the delay of stopTrajectoryMonitor()
+    if (!current_state_monitor_->waitForStateUpdate(record_after, positions, stamp, 0.1))
+      continue;
+    if (!addSample(positions, stamp))
     {
-      trajectory_.addSuffixWayPoint(state.first, 0.0);
-      trajectory_start_time_ = state.second;
-      last_recorded_state_time_ = state.second;
+      record_after = stamp;
+      continue;
     }
-    else
+    record_after = sampling_frequency_ > 0.0 ? stamp + ros::Duration(1.0 / sampling_frequency_) : stamp;
+
+    if (state_add_callback_)
     {
-      trajectory_.addSuffixWayPoint(state.first, (state.second - last_recorded_state_time_).toSec());
-      last_recorded_state_time_ = state.second;
+      robot_state::RobotStatePtr state(new robot_state::RobotState(current_state_monitor_->getRobotModel()));
+      state->setVariablePositions(positions);
+      state_add_callback_(state, stamp);
     }
-    if (state_add_callback_)
-      state_add_callback_(state.first, state.second);
   }
 }
@@ -44,11 +44,42 @@
 
 // Boost
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 
 // C++
 #include <fstream>
 #include <streambuf>
 #include <algorithm>
+#include <map>
+#include <memory>
+
+namespace rdf_loader
+{
+namespace
+{
+/** \brief The models parsed from a robot description parameter, shared by all loaders of the same content (e.g., the
+ * kinematics solvers of all groups) for as long as any of them keeps the models */
+struct ParsedDescription
+{
+  std::string urdf_content_;
+  std::string srdf_content_;
+  std::weak_ptr<urdf::ModelInterface> urdf_;
+  std::weak_ptr<srdf::Model> srdf_;
+};
+
+boost::mutex& GetParsedDescriptionsLock()
+{
+  static boost::mutex lock;
+  return lock;
+}
+
+std::map<std::string, ParsedDescription>& GetParsedDescriptions()
+{
+  static std::map<std::string, ParsedDescription> descriptions;
+  return descriptions;
+}
+}
+}
 
 rdf_loader::RDFLoader::RDFLoader(const std::string& robot_description)
 {
@@ -65,6 +96,29 @@ rdf_loader::RDFLoader::RDFLoader(const std::string& robot_description)
     return;
   }
 
+  const std::string srdf_description(robot_description_ + "_semantic");
+  std::string scontent;
+  bool has_scontent = nh.getParam(srdf_description, scontent);
+
+  // reuse the models parsed earlier from the same content, if they are still in use
+  {
+    boost::mutex::scoped_lock slock(GetParsedDescriptionsLock());
+    std::map<std::string, ParsedDescription>::const_iterator it = GetParsedDescriptions().find(robot_description_);
+    if (it != GetParsedDescriptions().end() && has_scontent && it->second.urdf_content_ == content &&
+        it->second.srdf_content_ == scontent)
+    {
+      urdf_ = it->second.urdf_.lock();
+      srdf_ = it->second.srdf_.lock();
+      if (urdf_ && srdf_)
+      {
+        ROS_DEBUG_NAMED("rdf_loader", "Reusing the robot model parsed from '%s'", robot_description_.c_str());
+        return;
+      }
+      urdf_.reset();
+      srdf_.reset();
+    }
+  }
+
   urdf::Model* umodel = new urdf::Model();
   if (!umodel->initString(content))
   {
@@ -73,9 +127,7 @@ rdf_loader::RDFLoader::RDFLoader(const std::string& robot_description)
   }
   urdf_.reset(umodel);
 
-  const std::string srdf_description(robot_description_ + "_semantic");
-  std::string scontent;
-  if (!nh.getParam(srdf_description, scontent))
+  if (!has_scontent)
   {
     ROS_ERROR_NAMED("rdf_loader", "Robot semantic description not found. Did you forget to define or remap '%s'?",
                     srdf_description.c_str());
@@ -90,6 +142,15 @@ rdf_loader::RDFLoader::RDFLoader(const std::string& robot_description)
     return;
   }
 
+  {
+    boost::mutex::scoped_lock slock(GetParsedDescriptionsLock());
+    ParsedDescription& parsed = GetParsedDescriptions()[robot_description_];
+    parsed.urdf_content_ = content;
+    parsed.srdf_content_ = scontent;
+    parsed.urdf_ = urdf_;
+    parsed.srdf_ = srdf_;
+  }
+
   ROS_DEBUG_STREAM_NAMED("rdf", "Loaded robot model in " << (ros::WallTime::now() - start).toSec() << " seconds");
 }
 
@@ -0,0 +1,98 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_ROBOT_MODEL_LOADER_MESH_CACHE_
+#define MOVEIT_ROBOT_MODEL_LOADER_MESH_CACHE_
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/robot_model/robot_model.h>
+#include <geometric_shapes/shapes.h>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace robot_model_loader
+{
+MOVEIT_CLASS_FORWARD(MeshCache);
+
+/** @class MeshCache
+ *  @brief On-disk cache of the meshes loaded while building a robot model.
+ *
+ *  Every mesh is stored in a versioned binary file in the cache directory, named after a hash of the mesh resource
+ *  and its scale. An entry is only used if the modification time of the mesh file it was created from did not change.
+ *  Only package:// and file:// resources are cached; other resources are always loaded with
+ *  shapes::createMeshFromResource(). Simplified versions of meshes are cached too, named after a hash of the mesh data
+ *  and of the simplification (see loadSimplifiedMesh()). loadMesh() may be called concurrently from multiple
+ *  threads. */
+class MeshCache
+{
+public:
+  /** @brief Use (and create, if needed) the cache directory @e directory */
+  MeshCache(const std::string& directory);
+
+  /** @brief Construct the mesh for @e resource, reading it from the cache if possible and adding it otherwise */
+  shapes::Mesh* loadMesh(const std::string& resource, const Eigen::Vector3d& scale);
+
+  /** @brief Function that computes a simplified version of a mesh, or returns NULL if it cannot */
+  typedef boost::function<shapes::Mesh*(const shapes::Mesh&)> SimplifyFn;
+
+  /** @brief Construct the version of @e mesh that @e simplify computes, reading it from the cache if possible and
+   * adding it otherwise. @e method identifies the simplification, including its parameters (e.g., "decimate 0.01") */
+  shapes::Mesh* loadSimplifiedMesh(const shapes::Mesh& mesh, const std::string& method, const SimplifyFn& simplify);
+
+  /** @brief Get a function that can be passed to the robot_model::RobotModel constructor. The cache must outlive the
+   * construction of the model */
+  robot_model::MeshLoaderFn getLoaderFunction();
+
+  /** @brief Number of meshes read from the cache so far */
+  std::size_t getHitCount() const
+  {
+    return hits_;
+  }
+
+  /** @brief Number of meshes that were not found in the cache so far */
+  std::size_t getMissCount() const
+  {
+    return misses_;
+  }
+
+private:
+  std::string directory_;
+  bool enabled_;
+  boost::mutex lock_;
+  std::size_t hits_;
+  std::size_t misses_;
+};
+}
+
+#endif
@@ -73,7 +73,9 @@ public:
     }
 
     /**  @brief The string name corresponding to the ROS param where the URDF is loaded; Using the same parameter name
-       plus the "_planning" suffix, additional configuration can be specified (e.g., additional joint limits).
+       plus the "_planning" suffix, additional configuration can be specified (e.g., additional joint limits, or
+       collision_simplification/<link>/method set to convex_hull or decimate, with an optional cell_size, to check
+       simpler versions of the collision meshes of a link).
          Loading from the param server is attempted only if loading from string fails. */
     std::string robot_description_;
 
@@ -87,6 +89,10 @@ public:
     /** @brief Flag indicating whether the kinematics solvers should be loaded as well, using specified ROS parameters
      */
     bool load_kinematics_solvers_;
+
+    /** @brief If not empty, meshes are cached in binary form in this directory, to speed up subsequent loads of the
+     * same robot model */
+    std::string mesh_cache_directory_;
   };
 
   /** @brief Default constructor */
@@ -0,0 +1,262 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model_loader/mesh_cache.h>
+#include <geometric_shapes/shape_operations.h>
+#include <ros/package.h>
+#include <ros/console.h>
+#include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/bind.hpp>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <cstring>
+
+namespace robot_model_loader
+{
+namespace
+{
+const std::string LOGNAME = "mesh_cache";
+
+const char CACHE_MAGIC[4] = { 'M', 'M', 'S', 'H' };
+const uint32_t CACHE_VERSION = 1;
+
+/** \brief Resolve a package:// or file:// resource to a file name; returns an empty string for other resources */
+std::string resolveResource(const std::string& resource)
+{
+  static const std::string PACKAGE_PREFIX = "package://";
+  static const std::string FILE_PREFIX = "file://";
+  if (resource.compare(0, FILE_PREFIX.size(), FILE_PREFIX) == 0)
+    return resource.substr(FILE_PREFIX.size());
+  if (resource.compare(0, PACKAGE_PREFIX.size(), PACKAGE_PREFIX) == 0)
+  {
+    const std::size_t slash = resource.find('/', PACKAGE_PREFIX.size());
+    if (slash == std::string::npos)
+      return std::string();
+    const std::string package_path =
+        ros::package::getPath(resource.substr(PACKAGE_PREFIX.size(), slash - PACKAGE_PREFIX.size()));
+    if (package_path.empty())
+      return std::string();
+    return package_path + resource.substr(slash);
+  }
+  return std::string();
+}
+
+template <typename T>
+void writeValue(std::ostream& out, const T& value)
+{
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool readValue(std::istream& in, T& value)
+{
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+void writeArray(std::ostream& out, const T* data, std::size_t count)
+{
+  uint8_t present = data ? 1 : 0;
+  writeValue(out, present);
+  if (data)
+    out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <typename T>
+bool readArray(std::istream& in, T*& data, std::size_t count)
+{
+  uint8_t present;
+  if (!readValue(in, present))
+    return false;
+  if (!present)
+    return true;
+  if (!data)
+    data = new T[count];
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(data), count * sizeof(T)));
+}
+
+void writeEntry(const std::string& path, const std::string& resource, const Eigen::Vector3d& scale, int64_t mtime,
+                const shapes::Mesh& mesh)
+{
+  // write to a temporary file first, so concurrent readers never see partial entries
+  const std::string tmp_path = path + boost::filesystem::unique_path(".%%%%-%%%%.tmp").string();
+  {
+    std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+      return;
+    out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    writeValue(out, CACHE_VERSION);
+    writeValue(out, static_cast<uint32_t>(resource.size()));
+    out.write(resource.data(), resource.size());
+    writeValue(out, scale.x());
+    writeValue(out, scale.y());
+    writeValue(out, scale.z());
+    writeValue(out, mtime);
+    writeValue(out, static_cast<uint32_t>(mesh.vertex_count));
+    writeValue(out, static_cast<uint32_t>(mesh.triangle_count));
+    writeArray(out, mesh.vertices, mesh.vertex_count * 3);
+    writeArray(out, mesh.triangles, mesh.triangle_count * 3);
+    writeArray(out, mesh.triangle_normals, mesh.triangle_count * 3);
+    writeArray(out, mesh.vertex_normals, mesh.vertex_count * 3);
+    if (!out)
+      return;
+  }
+  boost::system::error_code ec;
+  boost::filesystem::rename(tmp_path, path, ec);
+}
+
+shapes::Mesh* readEntry(const std::string& path, const std::string& resource, const Eigen::Vector3d& scale,
+                        int64_t mtime)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in)
+    return nullptr;
+
+  char magic[sizeof(CACHE_MAGIC)];
+  uint32_t version, resource_size;
+  if (!in.read(magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+      !readValue(in, version) || version != CACHE_VERSION || !readValue(in, resource_size))
+    return nullptr;
+
+  std::string cached_resource(resource_size, '\0');
+  double sx, sy, sz;
+  int64_t cached_mtime;
+  uint32_t vertex_count, triangle_count;
+  if (!in.read(&cached_resource[0], resource_size) || !readValue(in, sx) || !readValue(in, sy) ||
+      !readValue(in, sz) || !readValue(in, cached_mtime) || !readValue(in, vertex_count) ||
+      !readValue(in, triangle_count))
+    return nullptr;
+
+  // guard against hash collisions and modified mesh files
+  if (cached_resource != resource || Eigen::Vector3d(sx, sy, sz) != scale || cached_mtime != mtime)
+    return nullptr;
+
+  std::unique_ptr<shapes::Mesh> mesh(new shapes::Mesh(vertex_count, triangle_count));
+  if (!readArray(in, mesh->vertices, vertex_count * 3) || !readArray(in, mesh->triangles, triangle_count * 3) ||
+      !readArray(in, mesh->triangle_normals, triangle_count * 3) ||
+      !readArray(in, mesh->vertex_normals, vertex_count * 3))
+    return nullptr;
+  return mesh.release();
+}
+}
+
+MeshCache::MeshCache(const std::string& directory) : directory_(directory), enabled_(false), hits_(0), misses_(0)
+{
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(directory_, ec);
+  enabled_ = boost::filesystem::is_directory(directory_, ec);
+  if (!enabled_)
+    ROS_WARN_NAMED(LOGNAME, "Unable to use mesh cache directory '%s'", directory_.c_str());
+}
+
+shapes::Mesh* MeshCache::loadMesh(const std::string& resource, const Eigen::Vector3d& scale)
+{
+  const std::string filename = enabled_ ? resolveResource(resource) : std::string();
+  boost::system::error_code ec;
+  const std::time_t mtime = filename.empty() ? 0 : boost::filesystem::last_write_time(filename, ec);
+  if (filename.empty() || ec)
+    return shapes::createMeshFromResource(resource, scale);
+
+  std::size_t hash = 0;
+  boost::hash_combine(hash, resource);
+  boost::hash_combine(hash, scale.x());
+  boost::hash_combine(hash, scale.y());
+  boost::hash_combine(hash, scale.z());
+  std::stringstream ss;
+  ss << std::hex << hash << ".mesh";
+  const std::string path = (boost::filesystem::path(directory_) / ss.str()).string();
+
+  shapes::Mesh* mesh = readEntry(path, resource, scale, mtime);
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (mesh)
+      ++hits_;
+    else
+      ++misses_;
+  }
+  if (mesh)
+  {
+    ROS_DEBUG_NAMED(LOGNAME, "Loaded mesh '%s' from cache", resource.c_str());
+    return mesh;
+  }
+
+  mesh = shapes::createMeshFromResource(resource, scale);
+  if (mesh)
+    writeEntry(path, resource, scale, mtime, *mesh);
+  return mesh;
+}
+
+shapes::Mesh* MeshCache::loadSimplifiedMesh(const shapes::Mesh& mesh, const std::string& method,
+                                            const SimplifyFn& simplify)
+{
+  if (!enabled_)
+    return simplify(mesh);
+
+  // the entry is identified by the mesh data instead of a resource; the resource field holds the method and the size
+  // of the mesh, which guards against hash collisions
+  std::size_t hash = 0;
+  boost::hash_combine(hash, method);
+  boost::hash_range(hash, mesh.vertices, mesh.vertices + 3 * mesh.vertex_count);
+  boost::hash_range(hash, mesh.triangles, mesh.triangles + 3 * mesh.triangle_count);
+  std::stringstream ss;
+  ss << std::hex << hash << ".mesh";
+  const std::string path = (boost::filesystem::path(directory_) / ss.str()).string();
+  std::stringstream signature;
+  signature << method << " " << mesh.vertex_count << " " << mesh.triangle_count;
+  const Eigen::Vector3d scale(1.0, 1.0, 1.0);
+
+  shapes::Mesh* result = readEntry(path, signature.str(), scale, 0);
+  {
+    boost::mutex::scoped_lock slock(lock_);
+    if (result)
+      ++hits_;
+    else
+      ++misses_;
+  }
+  if (result)
+    return result;
+
+  result = simplify(mesh);
+  if (result)
+    writeEntry(path, signature.str(), scale, 0, *result);
+  return result;
+}
+
+robot_model::MeshLoaderFn MeshCache::getLoaderFunction()
+{
+  return boost::bind(&MeshCache::loadMesh, this, _1, _2);
+}
+}
@@ -0,0 +1,148 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/robot_model_loader/mesh_simplification.h>
+#include <geometric_shapes/bodies.h>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace robot_model_loader
+{
+namespace
+{
+typedef std::tuple<int64_t, int64_t, int64_t> Cell;
+
+struct CellHash
+{
+  std::size_t operator()(const Cell& cell) const
+  {
+    std::size_t hash = 0;
+    boost::hash_combine(hash, std::get<0>(cell));
+    boost::hash_combine(hash, std::get<1>(cell));
+    boost::hash_combine(hash, std::get<2>(cell));
+    return hash;
+  }
+};
+}
+
+shapes::Mesh* computeConvexHull(const shapes::Mesh& mesh)
+{
+  if (mesh.vertex_count < 4)
+    return nullptr;
+
+  // bodies::ConvexMesh computes the hull (with qhull) when it is constructed
+  bodies::ConvexMesh hull(&mesh);
+  const EigenSTL::vector_Vector3d& vertices = hull.getVertices();
+  const std::vector<unsigned int>& triangles = hull.getTriangles();
+  if (vertices.size() < 4 || triangles.size() < 12)
+    return nullptr;
+
+  std::unique_ptr<shapes::Mesh> result(new shapes::Mesh(vertices.size(), triangles.size() / 3));
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+  {
+    result->vertices[3 * i] = vertices[i].x();
+    result->vertices[3 * i + 1] = vertices[i].y();
+    result->vertices[3 * i + 2] = vertices[i].z();
+  }
+  std::copy(triangles.begin(), triangles.end(), result->triangles);
+  result->computeTriangleNormals();
+  result->computeVertexNormals();
+  return result.release();
+}
+
+shapes::Mesh* decimateMesh(const shapes::Mesh& mesh, double cell_size)
+{
+  if (cell_size <= 0.0)
+    return nullptr;
+
+  // map every vertex to the cluster of its cell
+  std::unordered_map<Cell, unsigned int, CellHash> clusters;
+  std::vector<unsigned int> cluster_of(mesh.vertex_count);
+  std::vector<Eigen::Vector3d> sums;
+  std::vector<unsigned int> counts;
+  for (unsigned int i = 0; i < mesh.vertex_count; ++i)
+  {
+    const Eigen::Vector3d v(mesh.vertices[3 * i], mesh.vertices[3 * i + 1], mesh.vertices[3 * i + 2]);
+    const Cell cell(static_cast<int64_t>(std::floor(v.x() / cell_size)),
+                    static_cast<int64_t>(std::floor(v.y() / cell_size)),
+                    static_cast<int64_t>(std::floor(v.z() / cell_size)));
+    auto it = clusters.insert(std::make_pair(cell, static_cast<unsigned int>(sums.size()))).first;
+    if (it->second == sums.size())
+    {
+      sums.push_back(Eigen::Vector3d::Zero());
+      counts.push_back(0);
+    }
+    cluster_of[i] = it->second;
+    sums[it->second] += v;
+    counts[it->second]++;
+  }
+  if (sums.size() < 4)
+    return nullptr;
+
+  std::vector<unsigned int> triangles;
+  triangles.reserve(mesh.triangle_count * 3);
+  for (unsigned int i = 0; i < mesh.triangle_count; ++i)
+  {
+    const unsigned int a = cluster_of[mesh.triangles[3 * i]];
+    const unsigned int b = cluster_of[mesh.triangles[3 * i + 1]];
+    const unsigned int c = cluster_of[mesh.triangles[3 * i + 2]];
+    if (a == b || b == c || a == c)
+      continue;
+    triangles.push_back(a);
+    triangles.push_back(b);
+    triangles.push_back(c);
+  }
+  if (triangles.empty())
+    return nullptr;
+
+  std::unique_ptr<shapes::Mesh> result(new shapes::Mesh(sums.size(), triangles.size() / 3));
+  for (std::size_t i = 0; i < sums.size(); ++i)
+  {
+    const Eigen::Vector3d v = sums[i] / counts[i];
+    result->vertices[3 * i] = v.x();
+    result->vertices[3 * i + 1] = v.y();
+    result->vertices[3 * i + 2] = v.z();
+  }
+  std::copy(triangles.begin(), triangles.end(), result->triangles);
+  result->computeTriangleNormals();
+  result->computeVertexNormals();
+  return result.release();
+}
+}
@@ -35,8 +35,16 @@
 /* Author: Ioan Sucan, E. Gil Jones */
 
 #include <moveit/robot_model_loader/robot_model_loader.h>
+#include <moveit/robot_model_loader/mesh_cache.h>
+#include <moveit/robot_model_loader/mesh_simplification.h>
 #include <moveit/profiler/profiler.h>
 #include <ros/ros.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sstream>
 #include <typeinfo>
 
 robot_model_loader::RobotModelLoader::RobotModelLoader(const std::string& robot_description,
@@ -80,6 +88,30 @@ bool canSpecifyPosition(const robot_model::JointModel* jmodel, const unsigned in
     ok = true;
   return ok;
 }
+
+/** \brief Replace the collision meshes of @e link by their simplified versions, computed by @e simplify (or read from
+ * @e mesh_cache, if not NULL). Meshes that cannot be simplified are kept. */
+void simplifyCollisionMeshes(robot_model::LinkModel* link, const std::string& method,
+                             const robot_model_loader::MeshCache::SimplifyFn& simplify,
+                             robot_model_loader::MeshCache* mesh_cache)
+{
+  std::vector<shapes::ShapeConstPtr> shapes = link->getShapes();
+  unsigned int triangles = 0, simplified_triangles = 0;
+  for (shapes::ShapeConstPtr& shape : shapes)
+  {
+    if (shape->type != shapes::MESH)
+      continue;
+    const shapes::Mesh& mesh = static_cast<const shapes::Mesh&>(*shape);
+    shapes::Mesh* simplified = mesh_cache ? mesh_cache->loadSimplifiedMesh(mesh, method, simplify) : simplify(mesh);
+    triangles += mesh.triangle_count;
+    if (simplified)
+      shape.reset(simplified);
+    simplified_triangles += static_cast<const shapes::Mesh&>(*shape).triangle_count;
+  }
+  link->setGeometry(shapes, link->getCollisionOriginTransforms());
+  ROS_DEBUG_NAMED("robot_model_loader", "Simplified the collision meshes of link '%s' (%s) from %u to %u triangles",
+                  link->getName().c_str(), method.c_str(), triangles, simplified_triangles);
+}
 }
 
 void robot_model_loader::RobotModelLoader::configure(const Options& opt)
@@ -88,6 +120,7 @@ void robot_model_loader::RobotModelLoader::configure(const Options& opt)
   moveit::tools::Profiler::ScopedBlock prof_block("RobotModelLoader::configure");
 
   ros::WallTime start = ros::WallTime::now();
+  std::unique_ptr<MeshCache> mesh_cache;
   if (opt.urdf_doc_ && opt.srdf_doc_)
     rdf_loader_.reset(new rdf_loader::RDFLoader(opt.urdf_doc_, opt.srdf_doc_));
   else if (!opt.urdf_string_.empty() && !opt.srdf_string_.empty())
@@ -98,7 +131,15 @@ void robot_model_loader::RobotModelLoader::configure(const Options& opt)
   {
     const srdf::ModelSharedPtr& srdf =
         rdf_loader_->getSRDF() ? rdf_loader_->getSRDF() : srdf::ModelSharedPtr(new srdf::Model());
-    model_.reset(new robot_model::RobotModel(rdf_loader_->getURDF(), srdf));
+    if (opt.mesh_cache_directory_.empty())
+      model_.reset(new robot_model::RobotModel(rdf_loader_->getURDF(), srdf));
+    else
+    {
+      mesh_cache.reset(new MeshCache(opt.mesh_cache_directory_));
+      model_.reset(new robot_model::RobotModel(rdf_loader_->getURDF(), srdf, mesh_cache->getLoaderFunction()));
+      ROS_DEBUG_NAMED("robot_model_loader", "Mesh cache '%s': %u hits, %u misses", opt.mesh_cache_directory_.c_str(),
+                      (unsigned int)mesh_cache->getHitCount(), (unsigned int)mesh_cache->getMissCount());
+    }
   }
 
   if (model_ && !rdf_loader_->getRobotDescription().empty())
@@ -156,6 +197,30 @@ void robot_model_loader::RobotModelLoader::configure(const Options& opt)
       }
       jmodel->setVariableBounds(jlim);
     }
+
+    // links can have their collision meshes replaced by simpler ones, which are much faster to check
+    for (robot_model::LinkModel* link : model_->getLinkModels())
+    {
+      std::string prefix =
+          rdf_loader_->getRobotDescription() + "_planning/collision_simplification/" + link->getName() + "/";
+      std::string method;
+      if (link->getShapes().empty() || !nh.getParam(prefix + "method", method))
+        continue;
+      if (method == "convex_hull")
+        simplifyCollisionMeshes(link, method, &computeConvexHull, mesh_cache.get());
+      else if (method == "decimate")
+      {
+        double cell_size = 0.01;
+        nh.getParam(prefix + "cell_size", cell_size);
+        std::stringstream ss;
+        ss << method << " " << cell_size;
+        simplifyCollisionMeshes(link, ss.str(), boost::bind(&decimateMesh, _1, cell_size), mesh_cache.get());
+      }
+      else
+        ROS_ERROR_NAMED("robot_model_loader",
+                        "Unknown collision simplification method '%s' for link '%s' (use convex_hull or decimate)",
+                        method.c_str(), link->getName().c_str());
+    }
   }
 
   if (model_ && opt.load_kinematics_solvers_)
@@ -187,16 +252,38 @@ void robot_model_loader::RobotModelLoader::loadKinematicsSolvers(
     if (groups.empty() && !model_->getJointModelGroups().empty())
       ROS_WARN("No kinematics plugins defined. Fill and load kinematics.yaml!");
 
+    // initializing a solver can take long (e.g., parsing the robot description or loading cache files), so the
+    // solvers of all groups are initialized concurrently; the loader keeps them, and hands them out again below, once
+    // they are not referenced here any more
+    std::vector<kinematics::KinematicsBasePtr> solvers(groups.size());
+    std::size_t thread_count = std::min<std::size_t>(boost::thread::hardware_concurrency(), groups.size());
+    std::atomic<std::size_t> next(0);
+    auto initialize_solvers = [this, &groups, &solvers, &next, &kinematics_allocator]() {
+      for (std::size_t i = next++; i < groups.size(); i = next++)
+        // Check if a group in kinematics.yaml exists in the srdf
+        if (model_->hasJointModelGroup(groups[i]))
+          solvers[i] = kinematics_allocator(model_->getJointModelGroup(groups[i]));
+    };
+    if (thread_count < 2)
+      initialize_solvers();
+    else
+    {
+      boost::thread_group workers;
+      for (std::size_t t = 0; t < thread_count; ++t)
+        workers.create_thread(initialize_solvers);
+      workers.join_all();
+    }
+
     std::map<std::string, robot_model::SolverAllocatorFn> imap;
     for (std::size_t i = 0; i < groups.size(); ++i)
     {
-      // Check if a group in kinematics.yaml exists in the srdf
       if (!model_->hasJointModelGroup(groups[i]))
         continue;
 
       const robot_model::JointModelGroup* jmg = model_->getJointModelGroup(groups[i]);
 
-      kinematics::KinematicsBasePtr solver = kinematics_allocator(jmg);
+      kinematics::KinematicsBasePtr solver;
+      solver.swap(solvers[i]);
       if (solver)
       {
         std::string error_msg;
@@ -236,5 +323,25 @@ void robot_model_loader::RobotModelLoader::loadKinematicsSolvers(
       robot_model::JointModelGroup* jmg = model_->getJointModelGroup(it->first);
       jmg->setDefaultIKAttempts(it->second);
     }
+
+    // load the reachability maps; they are memory mapped, so this is cheap even for large maps
+    const std::map<std::string, std::string>& maps = kinematics_loader_->getReachabilityMaps();
+    for (std::map<std::string, std::string>::const_iterator it = maps.begin(); it != maps.end(); ++it)
+    {
+      if (!model_->hasJointModelGroup(it->first))
+        continue;
+      robot_model::JointModelGroup* jmg = model_->getJointModelGroup(it->first);
+      robot_model::ReachabilityMapConstPtr map = robot_model::ReachabilityMap::load(it->second);
+      if (!map)
+        continue;
+      if (map->getGroupName() != jmg->getName() || !model_->hasLinkModel(map->getBaseLinkName()) ||
+          !model_->hasLinkModel(map->getTipLinkName()))
+        ROS_ERROR("Reachability map '%s' does not match group '%s'", it->second.c_str(), it->first.c_str());
+      else
+      {
+        jmg->setReachabilityMap(map);
+        ROS_DEBUG("Loaded reachability map '%s' for group '%s'", it->second.c_str(), it->first.c_str());
+      }
+    }
   }
 }
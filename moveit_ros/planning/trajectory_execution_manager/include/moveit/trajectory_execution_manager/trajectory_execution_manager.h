@@ -48,7 +48,9 @@
 #include <boost/thread.hpp>
 #include <pluginlib/class_loader.hpp>
 
+#include <future>
 #include <memory>
+#include <tuple>
 
 namespace trajectory_execution_manager
 {
@@ -119,6 +121,7 @@ public:
   bool ensureActiveController(const std::string& controller);
 
   /** \brief Make sure a particular set of controllers are active.
+      The switch that push() starts in the background for the first pushed trajectory is awaited first.
       \note If manage_controllers_ is false and the controllers that happen to be active to not include the ones
      specified as argument, this function fails. */
   bool ensureActiveControllers(const std::vector<std::string>& controllers);
@@ -151,6 +154,11 @@ public:
   /// If no controller is specified, a default is used.
   bool push(const moveit_msgs::RobotTrajectory& trajectory, const std::vector<std::string>& controllers);
 
+  /// Same as the function above, but the data of \e trajectory is moved, rather than copied, into the parts sent to
+  /// the controllers whenever a single controller executes all of it.
+  bool push(moveit_msgs::RobotTrajectory&& trajectory,
+            const std::vector<std::string>& controllers = std::vector<std::string>());
+
   /// Get the trajectories to be executed
   const std::vector<TrajectoryExecutionContext*>& getTrajectories() const;
 
@@ -200,6 +208,22 @@ public:
   /// is given to the already loaded ones. If no controller is specified, a default is used. This call is non-blocking.
   bool pushAndExecute(const sensor_msgs::JointState& state, const std::vector<std::string>& controllers);
 
+  /// Replace what remains to be executed of the trajectories passed to pushAndExecute(), from \e start_time onward.
+  /// The trajectory is stamped with \e start_time and sent to the controllers right away; they keep following the
+  /// current trajectory until \e start_time and splice the new one in then, as FollowJointTrajectory controllers do
+  /// for goals stamped in the future. Trajectories that were pushed but not sent yet are dropped. The trajectory has
+  /// to start at the state expected at \e start_time (within the allowed start tolerance). A zero \e start_time
+  /// replaces the current motion immediately. This call is non-blocking.
+  bool pushAndReplace(const moveit_msgs::RobotTrajectory& trajectory, const ros::Time& start_time,
+                      const std::vector<std::string>& controllers = std::vector<std::string>());
+
+  /// Replace what remains to be executed of the last trajectory passed to execute(), from \e start_time onward, without
+  /// stopping. The trajectory is stamped with \e start_time and sent to the active controllers right away; they keep
+  /// following the current trajectory until \e start_time and splice the new one in then. The trajectory has to start
+  /// at the state expected at \e start_time and use the same controllers. Afterwards, the trajectory replaces the last
+  /// pushed one, also for getCurrentExpectedTrajectoryIndex().
+  bool spliceTrajectory(const moveit_msgs::RobotTrajectory& trajectory, const ros::Time& start_time);
+
   /// Wait until the execution is complete. This only works for executions started by execute().  If you call this after
   /// pushAndExecute(), it will immediately stop execution.
   moveit_controller_manager::ExecutionStatus waitForExecution();
@@ -209,9 +233,14 @@ public:
   /// first = the index of the trajectory to be executed (in the order push() was called), second = the index of the
   /// point within that trajectory.
   /// Values of -1 are returned when there is no trajectory being executed, or if the trajectory was passed using
-  /// pushAndExecute().
+  /// pushAndExecute(). While blended trajectories are executed, first is the index of the first of them and second
+  /// indexes the points of the merged trajectory.
   std::pair<int, int> getCurrentExpectedTrajectoryIndex() const;
 
+  /// Get the time at which the first point of the trajectory reported by getCurrentExpectedTrajectoryIndex() is
+  /// expected to be reached. A zero time is returned when that index is not available.
+  ros::Time getCurrentExpectedTrajectoryStartTime() const;
+
   /// Return the controller status for the last attempted execution
   moveit_controller_manager::ExecutionStatus getLastExecutionStatus() const;
 
@@ -243,6 +272,18 @@ public:
   /// Enable or disable waiting for trajectory completion
   void setWaitForTrajectoryCompletion(bool flag);
 
+  /// Blend consecutive trajectories passed to execute() instead of stopping in between. Trajectories that use the same
+  /// controllers and start where the previous one ends are merged into a single goal per controller: the next
+  /// trajectory starts \e duration seconds before the previous one finishes and the two motions are superposed
+  /// during that time. The overlap is limited to half the duration of either trajectory. 0 (the default) disables
+  /// blending.
+  void setBlendDuration(double duration);
+
+  /// Compare every joint state received while a trajectory is being executed against the state expected at its time
+  /// stamp, and abort the execution as soon as some joint deviates by more than \e deviation (radians or meters).
+  /// The value needs to account for the tracking lag of the controllers. 0 (the default) disables this check.
+  void setAllowedExecutionDeviation(double deviation);
+
 private:
   struct ControllerInformation
   {
@@ -266,15 +307,30 @@ private:
 
   /// Validate first point of trajectory matches current robot state
   bool validate(const TrajectoryExecutionContext& context) const;
+
+  /// If \e owned_trajectory is not NULL, it points to \e trajectory and its data may be moved into the parts
+  bool pushTrajectory(const moveit_msgs::RobotTrajectory& trajectory, const std::vector<std::string>& controllers,
+                      moveit_msgs::RobotTrajectory* owned_trajectory);
   bool configure(TrajectoryExecutionContext& context, const moveit_msgs::RobotTrajectory& trajectory,
-                 const std::vector<std::string>& controllers);
+                 const std::vector<std::string>& controllers, moveit_msgs::RobotTrajectory* owned_trajectory = NULL);
 
   void updateControllersState(const ros::Duration& age);
+  /// Compute the controllers to switch for \e controllers to be active; false if no switch can activate them
+  bool computeControllerSwitch(const std::vector<std::string>& controllers, std::vector<std::string>& activate,
+                               std::vector<std::string>& deactivate);
+  /// Start the switch that activates \e controllers in the background, to overlap it with the work before execution
+  void startControllerSwitch(const std::vector<std::string>& controllers);
+  /// Wait for the switch started by startControllerSwitch(), if any, and record its result
+  void waitForControllerSwitch();
+  /// Record the states of the switched controllers, so that they are only queried again if the switch failed
+  void updateSwitchedControllers(const std::vector<std::string>& activated, const std::vector<std::string>& deactivated,
+                                 bool ok);
   void updateControllerState(const std::string& controller, const ros::Duration& age);
   void updateControllerState(ControllerInformation& ci, const ros::Duration& age);
 
   bool distributeTrajectory(const moveit_msgs::RobotTrajectory& trajectory, const std::vector<std::string>& controllers,
-                            std::vector<moveit_msgs::RobotTrajectory>& parts);
+                            std::vector<moveit_msgs::RobotTrajectory>& parts,
+                            moveit_msgs::RobotTrajectory* owned_trajectory = NULL);
 
   bool findControllers(const std::set<std::string>& actuated_joints, std::size_t controller_count,
                        const std::vector<std::string>& available_controllers,
@@ -292,13 +348,24 @@ private:
   void executeThread(const ExecutionCompleteCallback& callback, const PathSegmentCompleteCallback& part_callback,
                      bool auto_clear);
   bool executePart(std::size_t part_index);
+  bool executePart(const TrajectoryExecutionContext& context, std::size_t part_index);
+
+  /// Merge trajectories_[first] and the blendable trajectories following it into \e blended.
+  /// Returns the index of the first trajectory that was not merged.
+  std::size_t blendTrajectories(std::size_t first, TrajectoryExecutionContext& blended) const;
+  bool isBlendable(const moveit_msgs::RobotTrajectory& part, const moveit_msgs::RobotTrajectory& next) const;
   bool waitForRobotToStop(const TrajectoryExecutionContext& context, double wait_time = 1.0);
   void continuousExecutionThread();
+  /// Check that \e context continues the trajectories last sent by continuousExecutionThread() at \e start_time
+  bool validateContinuation(const TrajectoryExecutionContext& context, const ros::Time& start_time) const;
 
   void stopExecutionInternal();
 
   void receiveEvent(const std_msgs::StringConstPtr& event);
 
+  /// Check a joint state update from csm_ against the trajectory parts that are being executed
+  void jointStateCallback(const sensor_msgs::JointStateConstPtr& joint_state);
+
   void loadControllerParams();
 
   // Name of this class for logging
@@ -311,8 +378,20 @@ private:
   ros::Subscriber event_topic_subscriber_;
 
   std::map<std::string, ControllerInformation> known_controllers_;
+
+  // combinations of controllers found by generateControllerCombination(), indexed by the actuated joints, the number
+  // of controllers and the available controllers; only valid as long as known_controllers_ cover the same joints
+  typedef std::tuple<std::set<std::string>, std::size_t, std::vector<std::string> > ControllerCombinationKey;
+  std::map<ControllerCombinationKey, std::vector<std::vector<std::string> > > controller_combination_cache_;
   bool manage_controllers_;
 
+  // the switch started by startControllerSwitch() and the controllers it switches; protected by
+  // controller_switch_mutex_
+  std::future<bool> pending_switch_;
+  std::vector<std::string> pending_switch_activate_;
+  std::vector<std::string> pending_switch_deactivate_;
+  boost::mutex controller_switch_mutex_;
+
   // thread used to execute trajectories using the execute() command
   std::unique_ptr<boost::thread> execution_thread_;
 
@@ -338,6 +417,9 @@ private:
   bool run_continuous_execution_thread_;
   std::vector<TrajectoryExecutionContext*> trajectories_;
   std::deque<TrajectoryExecutionContext*> continuous_execution_queue_;
+  // last joint trajectory sent to each controller by continuousExecutionThread(), stamped with the time it started;
+  // protected by continuous_execution_mutex_
+  std::map<std::string, trajectory_msgs::JointTrajectory> continuous_execution_sent_;
 
   std::unique_ptr<pluginlib::ClassLoader<moveit_controller_manager::MoveItControllerManager> >
       controller_manager_loader_;
@@ -360,6 +442,19 @@ private:
   double allowed_start_tolerance_;  // joint tolerance for validate(): radians for revolute joints
   double execution_velocity_scaling_;
   bool wait_for_trajectory_completion_;
+  double blend_duration_;
+
+  double allowed_execution_deviation_;
+  // start time and trajectory of the parts checked by jointStateCallback(); protected by time_index_mutex_
+  std::vector<std::pair<ros::Time, const trajectory_msgs::JointTrajectory*> > monitored_trajectories_;
+  bool execution_deviated_;
+
+  // time added to the expected duration of the running execution by spliceTrajectory(); protected by time_index_mutex_
+  ros::Duration spliced_duration_;
+
+  // disconnects jointStateCallback() from csm_ when this instance is destroyed
+  struct StateUpdateGuard;
+  std::shared_ptr<StateUpdateGuard> state_update_guard_;
 };
 }
 
@@ -36,9 +36,12 @@
 
 #include <moveit/trajectory_execution_manager/trajectory_execution_manager.h>
 #include <moveit/robot_state/robot_state.h>
+#include <moveit/profiler/metrics.h>
 #include <moveit_ros_planning/TrajectoryExecutionDynamicReconfigureConfig.h>
 #include <dynamic_reconfigure/server.h>
 #include <eigen_conversions/eigen_msg.h>
+#include <moveit/utils/thread_groups.h>
+#include <algorithm>
 
 namespace trajectory_execution_manager
 {
@@ -50,6 +53,16 @@ static const double DEFAULT_CONTROLLER_GOAL_DURATION_MARGIN = 0.5;  // allow 0.5
                                                                     // after scaling)
 static const double DEFAULT_CONTROLLER_GOAL_DURATION_SCALING =
     1.1;  // allow the execution of a trajectory to take more time than expected (scaled by a value > 1)
+static const ros::Duration MULTI_CONTROLLER_START_DELAY(0.05);  // time allowed to dispatch the trajectory parts of
+                                                                // multiple controllers before they start executing
+
+// joint distances, in radians or meters
+static const std::vector<double> DEVIATION_BOUNDS = { 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0 };
+static moveit::tools::MetricHistogram& START_DEVIATION = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_execution_start_deviation", "Largest deviation of a trajectory start from the current state",
+    DEVIATION_BOUNDS);
+static moveit::tools::MetricHistogram& EXECUTION_DEVIATION = moveit::tools::MetricsRegistry::instance().histogram(
+    "moveit_execution_deviation", "Largest deviation of a joint state from the executed trajectory", DEVIATION_BOUNDS);
 
 using namespace moveit_ros_planning;
 
@@ -72,12 +85,107 @@ private:
     owner_->setExecutionVelocityScaling(config.execution_velocity_scaling);
     owner_->setAllowedStartTolerance(config.allowed_start_tolerance);
     owner_->setWaitForTrajectoryCompletion(config.wait_for_trajectory_completion);
+    owner_->setBlendDuration(config.blend_duration);
+    owner_->setAllowedExecutionDeviation(config.allowed_execution_deviation);
   }
 
   TrajectoryExecutionManager* owner_;
   dynamic_reconfigure::Server<TrajectoryExecutionDynamicReconfigureConfig> dynamic_reconfigure_server_;
 };
 
+// Sample a joint trajectory at time t (relative to its start). Outside of its time span the trajectory is taken to
+// rest at its first or last waypoint.
+static void sampleJointTrajectory(const trajectory_msgs::JointTrajectory& trajectory, double t,
+                                  trajectory_msgs::JointTrajectoryPoint& point)
+{
+  const std::vector<trajectory_msgs::JointTrajectoryPoint>& points = trajectory.points;
+  const std::size_t n = trajectory.joint_names.size();
+  const bool has_velocities = points.front().velocities.size() == n;
+  const bool has_accelerations = points.front().accelerations.size() == n;
+  point.positions.resize(n);
+  point.velocities.assign(has_velocities ? n : 0, 0.0);
+  point.accelerations.assign(has_accelerations ? n : 0, 0.0);
+
+  if (t <= points.front().time_from_start.toSec() || t >= points.back().time_from_start.toSec())
+  {
+    point.positions = (t <= points.front().time_from_start.toSec() ? points.front() : points.back()).positions;
+    return;
+  }
+
+  std::size_t k = std::upper_bound(points.begin(), points.end(), t,
+                                   [](double time, const trajectory_msgs::JointTrajectoryPoint& p) {
+                                     return time < p.time_from_start.toSec();
+                                   }) -
+                  points.begin();
+  const trajectory_msgs::JointTrajectoryPoint& a = points[k - 1];
+  const trajectory_msgs::JointTrajectoryPoint& b = points[k];
+  const double dt = (b.time_from_start - a.time_from_start).toSec();
+  const double s = (t - a.time_from_start.toSec()) / dt;
+  for (std::size_t j = 0; j < n; ++j)
+  {
+    if (has_velocities)
+    {
+      // cubic Hermite interpolation, as done by most trajectory controllers
+      point.positions[j] = (1.0 + 2.0 * s) * (1.0 - s) * (1.0 - s) * a.positions[j] +
+                           s * (1.0 - s) * (1.0 - s) * dt * a.velocities[j] +
+                           s * s * (3.0 - 2.0 * s) * b.positions[j] + s * s * (s - 1.0) * dt * b.velocities[j];
+      point.velocities[j] = a.velocities[j] + s * (b.velocities[j] - a.velocities[j]);
+    }
+    else
+      point.positions[j] = a.positions[j] + s * (b.positions[j] - a.positions[j]);
+    if (has_accelerations)
+      point.accelerations[j] = a.accelerations[j] + s * (b.accelerations[j] - a.accelerations[j]);
+  }
+}
+
+// Overlap the motion of next onto trajectory, starting offset seconds after the start of trajectory. From then on the
+// displacements of both trajectories add up, and so do their velocities and accelerations.
+static void superposeJointTrajectory(trajectory_msgs::JointTrajectory& trajectory,
+                                     const trajectory_msgs::JointTrajectory& next, double offset)
+{
+  static const double EPSILON = 1e-6;
+
+  // the merged trajectory is sampled at the waypoints of both trajectories within the overlap and after it
+  std::vector<double> times;
+  for (const trajectory_msgs::JointTrajectoryPoint& p : trajectory.points)
+    if (p.time_from_start.toSec() > offset - EPSILON)
+      times.push_back(p.time_from_start.toSec());
+  for (const trajectory_msgs::JointTrajectoryPoint& p : next.points)
+    times.push_back(p.time_from_start.toSec() + offset);
+  std::sort(times.begin(), times.end());
+  times.erase(std::unique(times.begin(), times.end(), [](double a, double b) { return b - a < EPSILON; }),
+              times.end());
+
+  std::vector<trajectory_msgs::JointTrajectoryPoint> points;
+  points.reserve(trajectory.points.size() + next.points.size());
+  for (const trajectory_msgs::JointTrajectoryPoint& p : trajectory.points)
+    if (p.time_from_start.toSec() <= offset - EPSILON)
+      points.push_back(p);
+
+  const std::vector<double>& next_start = next.points.front().positions;
+  trajectory_msgs::JointTrajectoryPoint a, b;
+  for (double t : times)
+  {
+    sampleJointTrajectory(trajectory, t, a);
+    sampleJointTrajectory(next, t - offset, b);
+    for (std::size_t j = 0; j < a.positions.size(); ++j)
+      a.positions[j] += b.positions[j] - next_start[j];
+    for (std::size_t j = 0; j < a.velocities.size(); ++j)
+      a.velocities[j] += b.velocities[j];
+    for (std::size_t j = 0; j < a.accelerations.size(); ++j)
+      a.accelerations[j] += b.accelerations[j];
+    a.time_from_start = ros::Duration(t);
+    points.push_back(a);
+  }
+  trajectory.points.swap(points);
+}
+
+struct TrajectoryExecutionManager::StateUpdateGuard
+{
+  boost::mutex lock_;
+  TrajectoryExecutionManager* owner_;
+};
+
 TrajectoryExecutionManager::TrajectoryExecutionManager(const robot_model::RobotModelConstPtr& kmodel,
                                                        const planning_scene_monitor::CurrentStateMonitorPtr& csm)
   : robot_model_(kmodel), csm_(csm), node_handle_("~")
@@ -98,6 +206,11 @@ TrajectoryExecutionManager::TrajectoryExecutionManager(const robot_model::RobotM
 
 TrajectoryExecutionManager::~TrajectoryExecutionManager()
 {
+  {
+    // csm_ may outlive this instance and cannot remove callbacks, so it is only disconnected
+    boost::mutex::scoped_lock slock(state_update_guard_->lock_);
+    state_update_guard_->owner_ = NULL;
+  }
   run_continuous_execution_thread_ = false;
   stopExecution(true);
   delete reconfigure_impl_;
@@ -118,6 +231,9 @@ void TrajectoryExecutionManager::initialize()
   execution_duration_monitoring_ = true;
   execution_velocity_scaling_ = 1.0;
   allowed_start_tolerance_ = 0.01;
+  blend_duration_ = 0.0;
+  allowed_execution_deviation_ = 0.0;
+  execution_deviated_ = false;
 
   // TODO: Reading from old param location should be removed in L-turtle. Handled by DynamicReconfigure.
   if (node_handle_.getParam("allowed_execution_duration_scaling", allowed_execution_duration_scaling_))
@@ -182,6 +298,19 @@ void TrajectoryExecutionManager::initialize()
   event_topic_subscriber_ =
       root_node_handle_.subscribe(EXECUTION_EVENT_TOPIC, 100, &TrajectoryExecutionManager::receiveEvent, this);
 
+  // execution is monitored right from the joint state updates, to react within one update period
+  state_update_guard_.reset(new StateUpdateGuard());
+  state_update_guard_->owner_ = this;
+  if (csm_)
+  {
+    std::shared_ptr<StateUpdateGuard> guard = state_update_guard_;
+    csm_->addUpdateCallback([guard](const sensor_msgs::JointStateConstPtr& joint_state) {
+      boost::mutex::scoped_lock slock(guard->lock_);
+      if (guard->owner_)
+        guard->owner_->jointStateCallback(joint_state);
+    });
+  }
+
   reconfigure_impl_ = new DynamicReconfigureImpl(this);
 
   if (manage_controllers_)
@@ -220,6 +349,16 @@ void TrajectoryExecutionManager::setWaitForTrajectoryCompletion(bool flag)
   wait_for_trajectory_completion_ = flag;
 }
 
+void TrajectoryExecutionManager::setBlendDuration(double duration)
+{
+  blend_duration_ = duration;
+}
+
+void TrajectoryExecutionManager::setAllowedExecutionDeviation(double deviation)
+{
+  allowed_execution_deviation_ = deviation;
+}
+
 bool TrajectoryExecutionManager::isManagingControllers() const
 {
   return manage_controllers_;
@@ -270,6 +409,19 @@ bool TrajectoryExecutionManager::push(const trajectory_msgs::JointTrajectory& tr
 
 bool TrajectoryExecutionManager::push(const moveit_msgs::RobotTrajectory& trajectory,
                                       const std::vector<std::string>& controllers)
+{
+  return pushTrajectory(trajectory, controllers, NULL);
+}
+
+bool TrajectoryExecutionManager::push(moveit_msgs::RobotTrajectory&& trajectory,
+                                      const std::vector<std::string>& controllers)
+{
+  return pushTrajectory(trajectory, controllers, &trajectory);
+}
+
+bool TrajectoryExecutionManager::pushTrajectory(const moveit_msgs::RobotTrajectory& trajectory,
+                                                const std::vector<std::string>& controllers,
+                                                moveit_msgs::RobotTrajectory* owned_trajectory)
 {
   if (!execution_complete_)
   {
@@ -278,7 +430,7 @@ bool TrajectoryExecutionManager::push(const moveit_msgs::RobotTrajectory& trajec
   }
 
   TrajectoryExecutionContext* context = new TrajectoryExecutionContext();
-  if (configure(*context, trajectory, controllers))
+  if (configure(*context, trajectory, controllers, owned_trajectory))
   {
     if (verbose_)
     {
@@ -292,6 +444,9 @@ bool TrajectoryExecutionManager::push(const moveit_msgs::RobotTrajectory& trajec
       ROS_INFO_NAMED(name_, "%s", ss.str().c_str());
     }
     trajectories_.push_back(context);
+    // the switch for the first trajectory overlaps with validation and with the pushes of the other trajectories
+    if (trajectories_.size() == 1)
+      startControllerSwitch(context->controllers_);
     return true;
   }
   else
@@ -382,8 +537,95 @@ bool TrajectoryExecutionManager::pushAndExecute(const moveit_msgs::RobotTrajecto
   }
 }
 
+bool TrajectoryExecutionManager::pushAndReplace(const moveit_msgs::RobotTrajectory& trajectory,
+                                                const ros::Time& start_time,
+                                                const std::vector<std::string>& controllers)
+{
+  if (!execution_complete_)
+  {
+    ROS_ERROR_NAMED(name_, "Cannot push & replace a trajectory while another is being executed");
+    return false;
+  }
+
+  moveit_msgs::RobotTrajectory stamped_trajectory = trajectory;
+  stamped_trajectory.joint_trajectory.header.stamp = start_time;
+  stamped_trajectory.multi_dof_joint_trajectory.header.stamp = start_time;
+
+  TrajectoryExecutionContext* context = new TrajectoryExecutionContext();
+  if (configure(*context, stamped_trajectory, controllers))
+  {
+    {
+      boost::mutex::scoped_lock slock(continuous_execution_mutex_);
+      if (!validateContinuation(*context, start_time))
+      {
+        delete context;
+        last_execution_status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
+        return false;
+      }
+      // queued trajectories would be sent after the replacement and override it
+      while (!continuous_execution_queue_.empty())
+      {
+        delete continuous_execution_queue_.front();
+        continuous_execution_queue_.pop_front();
+      }
+      continuous_execution_queue_.push_back(context);
+      if (!continuous_execution_thread_)
+        continuous_execution_thread_.reset(
+            new boost::thread(boost::bind(&TrajectoryExecutionManager::continuousExecutionThread, this)));
+    }
+    last_execution_status_ = moveit_controller_manager::ExecutionStatus::SUCCEEDED;
+    continuous_execution_condition_.notify_all();
+    return true;
+  }
+  else
+  {
+    delete context;
+    last_execution_status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
+    return false;
+  }
+}
+
+bool TrajectoryExecutionManager::validateContinuation(const TrajectoryExecutionContext& context,
+                                                      const ros::Time& start_time) const
+{
+  // continuous_execution_mutex_ needs to have been locked by the caller
+  if (allowed_start_tolerance_ == 0)  // skip validation on this magic number
+    return true;
+
+  const ros::Time time = start_time.isZero() ? ros::Time::now() : start_time;
+  trajectory_msgs::JointTrajectoryPoint expected;
+  for (std::size_t i = 0; i < context.trajectory_parts_.size(); ++i)
+  {
+    const trajectory_msgs::JointTrajectory& next = context.trajectory_parts_[i].joint_trajectory;
+    std::map<std::string, trajectory_msgs::JointTrajectory>::const_iterator sent =
+        continuous_execution_sent_.find(context.controllers_[i]);
+    if (next.points.empty() || sent == continuous_execution_sent_.end() || sent->second.points.empty())
+      continue;
+
+    sampleJointTrajectory(sent->second, (time - sent->second.header.stamp).toSec(), expected);
+    for (std::size_t j = 0; j < sent->second.joint_names.size(); ++j)
+    {
+      std::size_t index = std::find(next.joint_names.begin(), next.joint_names.end(), sent->second.joint_names[j]) -
+                          next.joint_names.begin();
+      const robot_model::JointModel* jm = robot_model_->getJointModel(sent->second.joint_names[j]);
+      if (index >= next.points.front().positions.size() || !jm || jm->getVariableCount() != 1)
+        continue;
+      if (jm->distance(&next.points.front().positions[index], &expected.positions[j]) > allowed_start_tolerance_)
+      {
+        ROS_ERROR_NAMED(name_, "\nInvalid Trajectory: start point deviates from the state expected at the start time "
+                               "more than %g\njoint '%s': expected: %g, trajectory: %g",
+                        allowed_start_tolerance_, sent->second.joint_names[j].c_str(), expected.positions[j],
+                        next.points.front().positions[index]);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 void TrajectoryExecutionManager::continuousExecutionThread()
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_EXECUTION);
   std::set<moveit_controller_manager::MoveItControllerHandlePtr> used_handles;
   while (run_continuous_execution_thread_)
   {
@@ -401,12 +643,14 @@ void TrajectoryExecutionManager::continuousExecutionThread()
         if ((*uit)->getLastExecutionStatus() == moveit_controller_manager::ExecutionStatus::RUNNING)
           (*uit)->cancelExecution();
       used_handles.clear();
+      boost::mutex::scoped_lock slock(continuous_execution_mutex_);
       while (!continuous_execution_queue_.empty())
       {
         TrajectoryExecutionContext* context = continuous_execution_queue_.front();
         continuous_execution_queue_.pop_front();
         delete context;
       }
+      continuous_execution_sent_.clear();
       stop_continuous_execution_ = false;
       continue;
     }
@@ -504,6 +748,20 @@ void TrajectoryExecutionManager::continuousExecutionThread()
               break;
             }
           }
+
+        // remember what was sent, so pushAndReplace() can check that replacements continue it
+        if (!handles.empty())
+        {
+          boost::mutex::scoped_lock slock(continuous_execution_mutex_);
+          const ros::Time now = ros::Time::now();
+          for (std::size_t i = 0; i < context->trajectory_parts_.size(); ++i)
+          {
+            trajectory_msgs::JointTrajectory& sent = continuous_execution_sent_[context->controllers_[i]];
+            sent = context->trajectory_parts_[i].joint_trajectory;
+            if (sent.header.stamp < now)
+              sent.header.stamp = now;
+          }
+        }
         delete context;
 
         // remember which handles we used
@@ -523,7 +781,8 @@ void TrajectoryExecutionManager::continuousExecutionThread()
 
 void TrajectoryExecutionManager::reloadControllerInformation()
 {
-  known_controllers_.clear();
+  std::map<std::string, ControllerInformation> previous_controllers;
+  previous_controllers.swap(known_controllers_);
   if (controller_manager_)
   {
     std::vector<std::string> names;
@@ -554,6 +813,17 @@ void TrajectoryExecutionManager::reloadControllerInformation()
           }
         }
   }
+
+  // cached controller combinations remain valid as long as the same controllers actuate the same joints
+  bool changed = previous_controllers.size() != known_controllers_.size();
+  for (std::map<std::string, ControllerInformation>::const_iterator it = known_controllers_.begin();
+       !changed && it != known_controllers_.end(); ++it)
+  {
+    std::map<std::string, ControllerInformation>::const_iterator previous = previous_controllers.find(it->first);
+    changed = previous == previous_controllers.end() || previous->second.joints_ != it->second.joints_;
+  }
+  if (changed)
+    controller_combination_cache_.clear();
 }
 
 void TrajectoryExecutionManager::updateControllerState(const std::string& controller, const ros::Duration& age)
@@ -688,8 +958,17 @@ bool TrajectoryExecutionManager::findControllers(const std::set<std::string>& ac
   std::vector<std::string> work_area;
   OrderPotentialControllerCombination order;
   std::vector<std::vector<std::string> >& selected_options = order.selected_options;
-  generateControllerCombination(0, controller_count, available_controllers, work_area, selected_options,
-                                actuated_joints);
+  ControllerCombinationKey key(actuated_joints, controller_count, available_controllers);
+  std::map<ControllerCombinationKey, std::vector<std::vector<std::string> > >::const_iterator cached =
+      controller_combination_cache_.find(key);
+  if (cached != controller_combination_cache_.end())
+    selected_options = cached->second;
+  else
+  {
+    generateControllerCombination(0, controller_count, available_controllers, work_area, selected_options,
+                                  actuated_joints);
+    controller_combination_cache_[key] = selected_options;
+  }
 
   if (verbose_)
   {
@@ -808,7 +1087,8 @@ bool TrajectoryExecutionManager::selectControllers(const std::set<std::string>&
 
 bool TrajectoryExecutionManager::distributeTrajectory(const moveit_msgs::RobotTrajectory& trajectory,
                                                       const std::vector<std::string>& controllers,
-                                                      std::vector<moveit_msgs::RobotTrajectory>& parts)
+                                                      std::vector<moveit_msgs::RobotTrajectory>& parts,
+                                                      moveit_msgs::RobotTrajectory* owned_trajectory)
 {
   parts.clear();
   parts.resize(controllers.size());
@@ -844,6 +1124,21 @@ bool TrajectoryExecutionManager::distributeTrajectory(const moveit_msgs::RobotTr
                           actuated_joints_single.end(), std::back_inserter(intersect_single));
     if (intersect_mdof.empty() && intersect_single.empty())
       ROS_WARN_STREAM_NAMED(name_, "No joints to be distributed for controller " << controllers[i]);
+    else if (controllers.size() == 1 && intersect_mdof.empty() &&
+             trajectory.multi_dof_joint_trajectory.points.empty() &&
+             intersect_single.size() == trajectory.joint_trajectory.joint_names.size())
+    {
+      // the single controller executes the whole trajectory, so it is taken over as a whole instead of joint by joint
+      if (owned_trajectory)
+        parts[i].joint_trajectory = std::move(owned_trajectory->joint_trajectory);
+      else
+        parts[i].joint_trajectory = trajectory.joint_trajectory;
+      if (execution_velocity_scaling_ != 1.0)
+        for (trajectory_msgs::JointTrajectoryPoint& point : parts[i].joint_trajectory.points)
+          for (double& velocity : point.velocities)
+            velocity *= execution_velocity_scaling_;
+    }
+    else
     {
       if (!intersect_mdof.empty())
       {
@@ -956,6 +1251,7 @@ bool TrajectoryExecutionManager::validate(const TrajectoryExecutionContext& cont
     return false;
   }
 
+  double start_deviation = 0.0;
   for (const auto& trajectory : context.trajectory_parts_)
   {
     if (!trajectory.joint_trajectory.points.empty())
@@ -984,8 +1280,10 @@ bool TrajectoryExecutionManager::validate(const TrajectoryExecutionContext& cont
         // normalize positions and compare
         jm->enforcePositionBounds(&cur_position);
         jm->enforcePositionBounds(&traj_position);
+        start_deviation = std::max(start_deviation, fabs(cur_position - traj_position));
         if (fabs(cur_position - traj_position) > allowed_start_tolerance_)
         {
+          START_DEVIATION.observe(start_deviation);
           ROS_ERROR_NAMED(name_, "\nInvalid Trajectory: start point deviates from current robot state more than %g"
                                  "\njoint '%s': expected: %g, current: %g",
                           allowed_start_tolerance_, joint_names[i].c_str(), traj_position, cur_position);
@@ -1034,12 +1332,14 @@ bool TrajectoryExecutionManager::validate(const TrajectoryExecutionContext& cont
       }
     }
   }
+  START_DEVIATION.observe(start_deviation);
   return true;
 }
 
 bool TrajectoryExecutionManager::configure(TrajectoryExecutionContext& context,
                                            const moveit_msgs::RobotTrajectory& trajectory,
-                                           const std::vector<std::string>& controllers)
+                                           const std::vector<std::string>& controllers,
+                                           moveit_msgs::RobotTrajectory* owned_trajectory)
 {
   if (trajectory.multi_dof_joint_trajectory.points.empty() && trajectory.joint_trajectory.points.empty())
   {
@@ -1078,7 +1378,7 @@ bool TrajectoryExecutionManager::configure(TrajectoryExecutionContext& context,
         all_controller_names.push_back(it->first);
       if (selectControllers(actuated_joints, all_controller_names, context.controllers_))
       {
-        if (distributeTrajectory(trajectory, context.controllers_, context.trajectory_parts_))
+        if (distributeTrajectory(trajectory, context.controllers_, context.trajectory_parts_, owned_trajectory))
           return true;
       }
       else
@@ -1114,7 +1414,7 @@ bool TrajectoryExecutionManager::configure(TrajectoryExecutionContext& context,
         }
     if (selectControllers(actuated_joints, controllers, context.controllers_))
     {
-      if (distributeTrajectory(trajectory, context.controllers_, context.trajectory_parts_))
+      if (distributeTrajectory(trajectory, context.controllers_, context.trajectory_parts_, owned_trajectory))
         return true;
     }
   }
@@ -1227,6 +1527,80 @@ void TrajectoryExecutionManager::execute(const ExecutionCompleteCallback& callba
       new boost::thread(&TrajectoryExecutionManager::executeThread, this, callback, part_callback, auto_clear));
 }
 
+bool TrajectoryExecutionManager::spliceTrajectory(const moveit_msgs::RobotTrajectory& trajectory,
+                                                  const ros::Time& start_time)
+{
+  moveit_msgs::RobotTrajectory stamped_trajectory = trajectory;
+  stamped_trajectory.joint_trajectory.header.stamp = start_time;
+  stamped_trajectory.multi_dof_joint_trajectory.header.stamp = start_time;
+
+  boost::mutex::scoped_lock slock(execution_state_mutex_);
+  if (execution_complete_ || active_handles_.empty() || current_context_ < 0 ||
+      current_context_ + 1 != static_cast<int>(trajectories_.size()))
+  {
+    ROS_ERROR_NAMED(name_, "Trajectories can only be spliced into the last trajectory being executed");
+    return false;
+  }
+
+  TrajectoryExecutionContext& context = *trajectories_[current_context_];
+  TrajectoryExecutionContext spliced;
+  if (!configure(spliced, stamped_trajectory, context.controllers_) || spliced.controllers_ != context.controllers_ ||
+      spliced.trajectory_parts_.size() != active_handles_.size())
+  {
+    ROS_ERROR_NAMED(name_, "A spliced trajectory has to use the controllers of the trajectory being executed");
+    return false;
+  }
+
+  for (std::size_t i = 0; i < active_handles_.size(); ++i)
+  {
+    bool ok = false;
+    try
+    {
+      ok = active_handles_[i]->sendTrajectory(spliced.trajectory_parts_[i]);
+    }
+    catch (std::exception& ex)
+    {
+      ROS_ERROR_NAMED(name_, "Caught %s when sending trajectory to controller", ex.what());
+    }
+    if (!ok)
+    {
+      ROS_ERROR_NAMED(name_, "Failed to splice trajectory into controller %s. Stopping trajectory.",
+                      active_handles_[i]->getName().c_str());
+      stopExecutionInternal();
+      return false;
+    }
+  }
+
+  // from now on, the spliced trajectory is what remains to be executed
+  ros::Duration duration(0.0);
+  std::size_t longest_part = 0;
+  for (std::size_t i = 0; i < spliced.trajectory_parts_.size(); ++i)
+    if (!spliced.trajectory_parts_[i].joint_trajectory.points.empty() &&
+        spliced.trajectory_parts_[i].joint_trajectory.points.back().time_from_start > duration)
+    {
+      duration = spliced.trajectory_parts_[i].joint_trajectory.points.back().time_from_start;
+      longest_part = i;
+    }
+  context.trajectory_parts_.swap(spliced.trajectory_parts_);
+
+  const ros::Time start = start_time.isZero() ? ros::Time::now() : start_time;
+  boost::mutex::scoped_lock tlock(time_index_mutex_);
+  if (!time_index_.empty() && start + duration > time_index_.back())
+    spliced_duration_ += start + duration - time_index_.back();
+  time_index_.clear();
+  for (const trajectory_msgs::JointTrajectoryPoint& point :
+       context.trajectory_parts_[longest_part].joint_trajectory.points)
+    time_index_.push_back(start + point.time_from_start);
+  if (!monitored_trajectories_.empty())
+  {
+    monitored_trajectories_.clear();
+    for (const moveit_msgs::RobotTrajectory& part : context.trajectory_parts_)
+      if (!part.joint_trajectory.points.empty())
+        monitored_trajectories_.push_back(std::make_pair(start, &part.joint_trajectory));
+  }
+  return true;
+}
+
 moveit_controller_manager::ExecutionStatus TrajectoryExecutionManager::waitForExecution()
 {
   {
@@ -1269,6 +1643,7 @@ void TrajectoryExecutionManager::clear()
 void TrajectoryExecutionManager::executeThread(const ExecutionCompleteCallback& callback,
                                                const PathSegmentCompleteCallback& part_callback, bool auto_clear)
 {
+  moveit::core::joinThreadGroup(moveit::core::THREAD_GROUP_EXECUTION);
   // if we already got a stop request before we even started anything, we abort
   if (execution_complete_)
   {
@@ -1284,17 +1659,19 @@ void TrajectoryExecutionManager::executeThread(const ExecutionCompleteCallback&
 
   // execute each trajectory, one after the other (executePart() is blocking) or until one fails.
   // on failure, the status is set by executePart(). Otherwise, it will remain as set above (success)
+  // when blending, consecutive trajectories that can be merged are sent to the controllers as a single goal
   std::size_t i = 0;
-  for (; i < trajectories_.size(); ++i)
+  while (i < trajectories_.size())
   {
-    bool epart = executePart(i);
+    TrajectoryExecutionContext blended;
+    std::size_t end = blend_duration_ > 0.0 ? blendTrajectories(i, blended) : i + 1;
+    bool epart = end > i + 1 ? executePart(blended, i) : executePart(i);
     if (epart && part_callback)
-      part_callback(i);
+      for (std::size_t j = i; j < end; ++j)
+        part_callback(j);
+    i = end;
     if (!epart || execution_complete_)
-    {
-      ++i;
       break;
-    }
   }
 
   // only report that execution finished successfully when the robot actually stopped moving
@@ -1320,7 +1697,30 @@ void TrajectoryExecutionManager::executeThread(const ExecutionCompleteCallback&
 
 bool TrajectoryExecutionManager::executePart(std::size_t part_index)
 {
-  TrajectoryExecutionContext& context = *trajectories_[part_index];
+  return executePart(*trajectories_[part_index], part_index);
+}
+
+bool TrajectoryExecutionManager::executePart(const TrajectoryExecutionContext& original_context,
+                                             std::size_t part_index)
+{
+  // parts sent to different controllers are stamped to start at a common time in the near future, so they start
+  // synchronized no matter how long dispatching them takes
+  TrajectoryExecutionContext synchronized_context;
+  bool synchronize = original_context.trajectory_parts_.size() > 1;
+  for (const moveit_msgs::RobotTrajectory& part : original_context.trajectory_parts_)
+    synchronize = synchronize && part.joint_trajectory.header.stamp.isZero() &&
+                  part.multi_dof_joint_trajectory.header.stamp.isZero();
+  if (synchronize)
+  {
+    synchronized_context = original_context;
+    const ros::Time start_time = ros::Time::now() + MULTI_CONTROLLER_START_DELAY;
+    for (moveit_msgs::RobotTrajectory& part : synchronized_context.trajectory_parts_)
+    {
+      part.joint_trajectory.header.stamp = start_time;
+      part.multi_dof_joint_trajectory.header.stamp = start_time;
+    }
+  }
+  const TrajectoryExecutionContext& context = synchronize ? synchronized_context : original_context;
 
   // first make sure desired controllers are active
   if (ensureActiveControllers(context.controllers_))
@@ -1337,7 +1737,9 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
         // time indexing uses this member too, so we lock this mutex as well
         time_index_mutex_.lock();
         current_context_ = part_index;
+        spliced_duration_ = ros::Duration(0.0);
         time_index_mutex_.unlock();
+        execution_deviated_ = false;
         active_handles_.resize(context.controllers_.size());
         for (std::size_t i = 0; i < context.controllers_.size(); ++i)
         {
@@ -1362,20 +1764,34 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
           active_handles_[i] = h;
         }
         handles = active_handles_;  // keep a copy for later, to avoid thread safety issues
-        for (std::size_t i = 0; i < context.trajectory_parts_.size(); ++i)
-        {
-          bool ok = false;
+
+        // send the parts to all controllers concurrently
+        std::vector<char> sent(context.trajectory_parts_.size(), 0);
+        auto send = [this, &context, &sent](std::size_t i) {
           try
           {
-            ok = active_handles_[i]->sendTrajectory(context.trajectory_parts_[i]);
+            sent[i] = active_handles_[i]->sendTrajectory(context.trajectory_parts_[i]);
           }
           catch (std::exception& ex)
           {
             ROS_ERROR_NAMED(name_, "Caught %s when sending trajectory to controller", ex.what());
           }
-          if (!ok)
-          {
-            for (std::size_t j = 0; j < i; ++j)
+        };
+        if (sent.size() == 1)
+          send(0);
+        else
+        {
+          boost::thread_group senders;
+          for (std::size_t i = 0; i < sent.size(); ++i)
+            senders.create_thread([&send, i]() { send(i); });
+          senders.join_all();
+        }
+
+        std::size_t failed = std::find(sent.begin(), sent.end(), 0) - sent.begin();
+        if (failed < sent.size())
+        {
+          for (std::size_t j = 0; j < sent.size(); ++j)
+            if (sent[j])
               try
               {
                 active_handles_[j]->cancelExecution();
@@ -1384,15 +1800,14 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
               {
                 ROS_ERROR_NAMED(name_, "Caught %s when canceling execution", ex.what());
               }
-            ROS_ERROR_NAMED(name_, "Failed to send trajectory part %zu of %zu to controller %s", i + 1,
-                            context.trajectory_parts_.size(), active_handles_[i]->getName().c_str());
-            if (i > 0)
-              ROS_ERROR_NAMED(name_, "Cancelling previously sent trajectory parts");
-            active_handles_.clear();
-            current_context_ = -1;
-            last_execution_status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
-            return false;
-          }
+          ROS_ERROR_NAMED(name_, "Failed to send trajectory part %zu of %zu to controller %s", failed + 1,
+                          context.trajectory_parts_.size(), active_handles_[failed]->getName().c_str());
+          if (sent.size() > 1)
+            ROS_ERROR_NAMED(name_, "Cancelling the other trajectory parts");
+          active_handles_.clear();
+          current_context_ = -1;
+          last_execution_status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
+          return false;
         }
       }
     }
@@ -1474,17 +1889,36 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
       }
     }
 
+    // let jointStateCallback() compare the actual motion against the expected one
+    if (allowed_execution_deviation_ > 0.0)
+    {
+      boost::mutex::scoped_lock slock(time_index_mutex_);
+      for (const moveit_msgs::RobotTrajectory& part : context.trajectory_parts_)
+        if (!part.joint_trajectory.points.empty())
+          monitored_trajectories_.push_back(
+              std::make_pair(std::max(current_time, part.joint_trajectory.header.stamp), &part.joint_trajectory));
+    }
+
     bool result = true;
     for (std::size_t i = 0; i < handles.size(); ++i)
     {
       if (execution_duration_monitoring_)
       {
-        if (!handles[i]->waitForExecution(expected_trajectory_duration))
-          if (!execution_complete_ && ros::Time::now() - current_time > expected_trajectory_duration)
+        auto allowedDuration = [this, &expected_trajectory_duration]() {
+          boost::mutex::scoped_lock slock(time_index_mutex_);
+          return expected_trajectory_duration + spliced_duration_;
+        };
+        bool finished = handles[i]->waitForExecution(expected_trajectory_duration);
+        // keep waiting for as long as spliceTrajectory() extended the execution
+        for (ros::Duration waited = expected_trajectory_duration, allowed = allowedDuration();
+             !finished && !execution_complete_ && allowed > waited; waited = allowed, allowed = allowedDuration())
+          finished = handles[i]->waitForExecution(allowed - waited);
+        if (!finished)
+          if (!execution_complete_ && ros::Time::now() - current_time > allowedDuration())
           {
             ROS_ERROR_NAMED(name_, "Controller is taking too long to execute trajectory (the expected upper "
                                    "bound for the trajectory execution was %lf seconds). Stopping trajectory.",
-                            expected_trajectory_duration.toSec());
+                            allowedDuration().toSec());
             {
               boost::mutex::scoped_lock slock(execution_state_mutex_);
               stopExecutionInternal();  // this is really tricky. we can't call stopExecution() here, so we call the
@@ -1513,6 +1947,12 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
       }
     }
 
+    if (execution_deviated_)
+    {
+      last_execution_status_ = moveit_controller_manager::ExecutionStatus::ABORTED;
+      result = false;
+    }
+
     // clear the active handles
     execution_state_mutex_.lock();
     active_handles_.clear();
@@ -1520,6 +1960,7 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
     // clear the time index
     time_index_mutex_.lock();
     time_index_.clear();
+    monitored_trajectories_.clear();
     current_context_ = -1;
     time_index_mutex_.unlock();
 
@@ -1533,6 +1974,137 @@ bool TrajectoryExecutionManager::executePart(std::size_t part_index)
   }
 }
 
+bool TrajectoryExecutionManager::isBlendable(const moveit_msgs::RobotTrajectory& part,
+                                             const moveit_msgs::RobotTrajectory& next) const
+{
+  // only joint-space parts that start right away can be merged
+  if (part.joint_trajectory.points.empty() || next.joint_trajectory.points.empty() ||
+      !part.multi_dof_joint_trajectory.points.empty() || !next.multi_dof_joint_trajectory.points.empty() ||
+      part.joint_trajectory.joint_names != next.joint_trajectory.joint_names ||
+      !next.joint_trajectory.header.stamp.isZero())
+    return false;
+
+  const trajectory_msgs::JointTrajectoryPoint& last = part.joint_trajectory.points.back();
+  const trajectory_msgs::JointTrajectoryPoint& first = next.joint_trajectory.points.front();
+  const std::size_t n = part.joint_trajectory.joint_names.size();
+  if (last.positions.size() != n || first.positions.size() != n ||
+      (last.velocities.size() == n) != (first.velocities.size() == n) ||
+      (last.accelerations.size() == n) != (first.accelerations.size() == n))
+    return false;
+
+  // the next trajectory needs to start where this one ends, as validate() would require after a stop
+  if (allowed_start_tolerance_ == 0)
+    return true;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    const robot_model::JointModel* jm = robot_model_->getJointModel(part.joint_trajectory.joint_names[i]);
+    if (!jm)
+      return false;
+    double end_position = last.positions[i];
+    double start_position = first.positions[i];
+    jm->enforcePositionBounds(&end_position);
+    jm->enforcePositionBounds(&start_position);
+    if (fabs(end_position - start_position) > allowed_start_tolerance_)
+      return false;
+  }
+  return true;
+}
+
+std::size_t TrajectoryExecutionManager::blendTrajectories(std::size_t first, TrajectoryExecutionContext& blended) const
+{
+  blended = *trajectories_[first];
+
+  // start time of the last trajectory that was merged, relative to the start of the blended one
+  double last_start = 0.0;
+  std::size_t end = first + 1;
+  for (; end < trajectories_.size(); ++end)
+  {
+    const TrajectoryExecutionContext& next = *trajectories_[end];
+    if (next.controllers_ != blended.controllers_ ||
+        next.trajectory_parts_.size() != blended.trajectory_parts_.size())
+      break;
+    bool blendable = true;
+    for (std::size_t i = 0; i < next.trajectory_parts_.size() && blendable; ++i)
+      blendable = isBlendable(blended.trajectory_parts_[i], next.trajectory_parts_[i]);
+    if (!blendable)
+      break;
+
+    // all parts are overlapped in the same time window, so they stay synchronized
+    double blended_end = 0.0;
+    double next_duration = 0.0;
+    for (std::size_t i = 0; i < next.trajectory_parts_.size(); ++i)
+    {
+      blended_end =
+          std::max(blended_end, blended.trajectory_parts_[i].joint_trajectory.points.back().time_from_start.toSec());
+      next_duration =
+          std::max(next_duration, next.trajectory_parts_[i].joint_trajectory.points.back().time_from_start.toSec());
+    }
+    double overlap = std::min(blend_duration_, 0.5 * std::min(blended_end - last_start, next_duration));
+    last_start = blended_end - std::max(overlap, 0.0);
+    for (std::size_t i = 0; i < next.trajectory_parts_.size(); ++i)
+      superposeJointTrajectory(blended.trajectory_parts_[i].joint_trajectory,
+                               next.trajectory_parts_[i].joint_trajectory, last_start);
+  }
+
+  if (end > first + 1)
+    ROS_DEBUG_NAMED(name_, "Blending trajectories %zu to %zu into a single execution", first, end - 1);
+  return end;
+}
+
+void TrajectoryExecutionManager::jointStateCallback(const sensor_msgs::JointStateConstPtr& joint_state)
+{
+  if (allowed_execution_deviation_ <= 0.0 || execution_complete_)
+    return;
+
+  const ros::Time stamp = joint_state->header.stamp.isZero() ? ros::Time::now() : joint_state->header.stamp;
+  std::string deviating_joint;
+  double expected_position = 0.0, actual_position = 0.0, deviation = 0.0;
+  {
+    boost::mutex::scoped_lock slock(time_index_mutex_);
+    trajectory_msgs::JointTrajectoryPoint expected;
+    for (const auto& monitored : monitored_trajectories_)
+    {
+      if (stamp < monitored.first)
+        continue;
+      const trajectory_msgs::JointTrajectory& trajectory = *monitored.second;
+      sampleJointTrajectory(trajectory, (stamp - monitored.first).toSec(), expected);
+      for (std::size_t i = 0; i < trajectory.joint_names.size() && deviating_joint.empty(); ++i)
+      {
+        std::size_t index = std::find(joint_state->name.begin(), joint_state->name.end(), trajectory.joint_names[i]) -
+                            joint_state->name.begin();
+        const robot_model::JointModel* jm = robot_model_->getJointModel(trajectory.joint_names[i]);
+        if (index >= joint_state->position.size() || !jm || jm->getVariableCount() != 1)
+          continue;
+        double distance = jm->distance(&joint_state->position[index], &expected.positions[i]);
+        deviation = std::max(deviation, distance);
+        if (distance > allowed_execution_deviation_)
+        {
+          deviating_joint = trajectory.joint_names[i];
+          expected_position = expected.positions[i];
+          actual_position = joint_state->position[index];
+        }
+      }
+      if (!deviating_joint.empty())
+        break;
+    }
+    if (!monitored_trajectories_.empty())
+      EXECUTION_DEVIATION.observe(deviation);
+    if (deviating_joint.empty())
+      return;
+    monitored_trajectories_.clear();
+  }
+
+  ROS_ERROR_NAMED(name_, "Joint '%s' deviates from the executed trajectory by more than %g (expected: %g, actual: %g). "
+                         "Stopping trajectory.",
+                  deviating_joint.c_str(), allowed_execution_deviation_, expected_position, actual_position);
+  boost::mutex::scoped_lock slock(execution_state_mutex_);
+  if (!execution_complete_ && !active_handles_.empty())
+  {
+    execution_deviated_ = true;
+    stopExecutionInternal();
+  }
+}
+
 bool TrajectoryExecutionManager::waitForRobotToStop(const TrajectoryExecutionContext& context, double wait_time)
 {
   // skip waiting for convergence?
@@ -1605,6 +2177,14 @@ std::pair<int, int> TrajectoryExecutionManager::getCurrentExpectedTrajectoryInde
   return std::make_pair((int)current_context_, pos);
 }
 
+ros::Time TrajectoryExecutionManager::getCurrentExpectedTrajectoryStartTime() const
+{
+  boost::mutex::scoped_lock slock(time_index_mutex_);
+  if (current_context_ < 0 || time_index_.empty())
+    return ros::Time();
+  return time_index_.front();
+}
+
 const std::vector<TrajectoryExecutionManager::TrajectoryExecutionContext*>&
 TrajectoryExecutionManager::getTrajectories() const
 {
@@ -1657,85 +2237,23 @@ bool TrajectoryExecutionManager::ensureActiveController(const std::string& contr
 
 bool TrajectoryExecutionManager::ensureActiveControllers(const std::vector<std::string>& controllers)
 {
+  // a switch started by push() may already have activated the controllers
+  waitForControllerSwitch();
   updateControllersState(DEFAULT_CONTROLLER_INFORMATION_VALIDITY_AGE);
 
   if (manage_controllers_)
   {
     std::vector<std::string> controllers_to_activate;
     std::vector<std::string> controllers_to_deactivate;
-    std::set<std::string> joints_to_be_activated;
-    std::set<std::string> joints_to_be_deactivated;
-    for (std::size_t i = 0; i < controllers.size(); ++i)
-    {
-      std::map<std::string, ControllerInformation>::const_iterator it = known_controllers_.find(controllers[i]);
-      if (it == known_controllers_.end())
-      {
-        ROS_ERROR_STREAM_NAMED(name_, "Controller " << controllers[i] << " is not known");
-        return false;
-      }
-      if (!it->second.state_.active_)
-      {
-        ROS_DEBUG_STREAM_NAMED(name_, "Need to activate " << controllers[i]);
-        controllers_to_activate.push_back(controllers[i]);
-        joints_to_be_activated.insert(it->second.joints_.begin(), it->second.joints_.end());
-        for (std::set<std::string>::iterator kt = it->second.overlapping_controllers_.begin();
-             kt != it->second.overlapping_controllers_.end(); ++kt)
-        {
-          const ControllerInformation& ci = known_controllers_[*kt];
-          if (ci.state_.active_)
-          {
-            controllers_to_deactivate.push_back(*kt);
-            joints_to_be_deactivated.insert(ci.joints_.begin(), ci.joints_.end());
-          }
-        }
-      }
-      else
-        ROS_DEBUG_STREAM_NAMED(name_, "Controller " << controllers[i] << " is already active");
-    }
-    std::set<std::string> diff;
-    std::set_difference(joints_to_be_deactivated.begin(), joints_to_be_deactivated.end(),
-                        joints_to_be_activated.begin(), joints_to_be_activated.end(), std::inserter(diff, diff.end()));
-    if (!diff.empty())
-    {
-      // find the set of controllers that do not overlap with the ones we want to activate so far
-      std::vector<std::string> possible_additional_controllers;
-      for (std::map<std::string, ControllerInformation>::const_iterator it = known_controllers_.begin();
-           it != known_controllers_.end(); ++it)
-      {
-        bool ok = true;
-        for (std::size_t k = 0; k < controllers_to_activate.size(); ++k)
-          if (it->second.overlapping_controllers_.find(controllers_to_activate[k]) !=
-              it->second.overlapping_controllers_.end())
-          {
-            ok = false;
-            break;
-          }
-        if (ok)
-          possible_additional_controllers.push_back(it->first);
-      }
-
-      // out of the allowable controllers, try to find a subset of controllers that covers the joints to be actuated
-      std::vector<std::string> additional_controllers;
-      if (selectControllers(diff, possible_additional_controllers, additional_controllers))
-        controllers_to_activate.insert(controllers_to_activate.end(), additional_controllers.begin(),
-                                       additional_controllers.end());
-      else
-        return false;
-    }
+    if (!computeControllerSwitch(controllers, controllers_to_activate, controllers_to_deactivate))
+      return false;
     if (!controllers_to_activate.empty() || !controllers_to_deactivate.empty())
     {
       if (controller_manager_)
       {
-        // load controllers to be activated, if needed, and reset the state update cache
-        for (std::size_t a = 0; a < controllers_to_activate.size(); ++a)
-        {
-          ControllerInformation& ci = known_controllers_[controllers_to_activate[a]];
-          ci.last_update_ = ros::Time();
-        }
-        // reset the state update cache
-        for (std::size_t a = 0; a < controllers_to_deactivate.size(); ++a)
-          known_controllers_[controllers_to_deactivate[a]].last_update_ = ros::Time();
-        return controller_manager_->switchControllers(controllers_to_activate, controllers_to_deactivate);
+        bool ok = controller_manager_->switchControllers(controllers_to_activate, controllers_to_deactivate);
+        updateSwitchedControllers(controllers_to_activate, controllers_to_deactivate, ok);
+        return ok;
       }
       else
         return false;
@@ -1754,6 +2272,144 @@ bool TrajectoryExecutionManager::ensureActiveControllers(const std::vector<std::
   }
 }
 
+bool TrajectoryExecutionManager::computeControllerSwitch(const std::vector<std::string>& controllers,
+                                                         std::vector<std::string>& controllers_to_activate,
+                                                         std::vector<std::string>& controllers_to_deactivate)
+{
+  std::set<std::string> joints_to_be_activated;
+  std::set<std::string> joints_to_be_deactivated;
+  for (std::size_t i = 0; i < controllers.size(); ++i)
+  {
+    std::map<std::string, ControllerInformation>::const_iterator it = known_controllers_.find(controllers[i]);
+    if (it == known_controllers_.end())
+    {
+      ROS_ERROR_STREAM_NAMED(name_, "Controller " << controllers[i] << " is not known");
+      return false;
+    }
+    if (!it->second.state_.active_)
+    {
+      ROS_DEBUG_STREAM_NAMED(name_, "Need to activate " << controllers[i]);
+      controllers_to_activate.push_back(controllers[i]);
+      joints_to_be_activated.insert(it->second.joints_.begin(), it->second.joints_.end());
+      for (std::set<std::string>::iterator kt = it->second.overlapping_controllers_.begin();
+           kt != it->second.overlapping_controllers_.end(); ++kt)
+      {
+        const ControllerInformation& ci = known_controllers_[*kt];
+        if (ci.state_.active_)
+        {
+          controllers_to_deactivate.push_back(*kt);
+          joints_to_be_deactivated.insert(ci.joints_.begin(), ci.joints_.end());
+        }
+      }
+    }
+    else
+      ROS_DEBUG_STREAM_NAMED(name_, "Controller " << controllers[i] << " is already active");
+  }
+  std::set<std::string> diff;
+  std::set_difference(joints_to_be_deactivated.begin(), joints_to_be_deactivated.end(), joints_to_be_activated.begin(),
+                      joints_to_be_activated.end(), std::inserter(diff, diff.end()));
+  if (!diff.empty())
+  {
+    // find the set of controllers that do not overlap with the ones we want to activate so far
+    std::vector<std::string> possible_additional_controllers;
+    for (std::map<std::string, ControllerInformation>::const_iterator it = known_controllers_.begin();
+         it != known_controllers_.end(); ++it)
+    {
+      bool ok = true;
+      for (std::size_t k = 0; k < controllers_to_activate.size(); ++k)
+        if (it->second.overlapping_controllers_.find(controllers_to_activate[k]) !=
+            it->second.overlapping_controllers_.end())
+        {
+          ok = false;
+          break;
+        }
+      if (ok)
+        possible_additional_controllers.push_back(it->first);
+    }
+
+    // out of the allowable controllers, try to find a subset of controllers that covers the joints to be actuated
+    std::vector<std::string> additional_controllers;
+    if (selectControllers(diff, possible_additional_controllers, additional_controllers))
+      controllers_to_activate.insert(controllers_to_activate.end(), additional_controllers.begin(),
+                                     additional_controllers.end());
+    else
+      return false;
+  }
+  return true;
+}
+
+void TrajectoryExecutionManager::startControllerSwitch(const std::vector<std::string>& controllers)
+{
+  if (!manage_controllers_ || !controller_manager_)
+    return;
+  waitForControllerSwitch();
+  updateControllersState(DEFAULT_CONTROLLER_INFORMATION_VALIDITY_AGE);
+
+  std::vector<std::string> activate;
+  std::vector<std::string> deactivate;
+  // a switch that cannot be computed fails again in ensureActiveControllers(), which reports it
+  if (!computeControllerSwitch(controllers, activate, deactivate) || (activate.empty() && deactivate.empty()))
+    return;
+  ROS_DEBUG_NAMED(name_, "Switching controllers in the background: %zu to activate, %zu to deactivate",
+                  activate.size(), deactivate.size());
+
+  // reset the state update cache, in case the states are needed before the switch completes
+  for (std::size_t a = 0; a < activate.size(); ++a)
+    known_controllers_[activate[a]].last_update_ = ros::Time();
+  for (std::size_t a = 0; a < deactivate.size(); ++a)
+    known_controllers_[deactivate[a]].last_update_ = ros::Time();
+
+  boost::mutex::scoped_lock slock(controller_switch_mutex_);
+  pending_switch_activate_ = activate;
+  pending_switch_deactivate_ = deactivate;
+  moveit_controller_manager::MoveItControllerManagerPtr controller_manager = controller_manager_;
+  pending_switch_ = std::async(std::launch::async, [controller_manager, activate, deactivate]() {
+    return controller_manager->switchControllers(activate, deactivate);
+  });
+}
+
+void TrajectoryExecutionManager::waitForControllerSwitch()
+{
+  boost::mutex::scoped_lock slock(controller_switch_mutex_);
+  if (!pending_switch_.valid())
+    return;
+  bool ok = false;
+  try
+  {
+    ok = pending_switch_.get();
+  }
+  catch (std::exception& ex)
+  {
+    ROS_ERROR_NAMED(name_, "Caught %s when switching controllers", ex.what());
+  }
+  if (!ok)
+    ROS_WARN_NAMED(name_, "Switching controllers in the background failed");
+  updateSwitchedControllers(pending_switch_activate_, pending_switch_deactivate_, ok);
+  pending_switch_activate_.clear();
+  pending_switch_deactivate_.clear();
+}
+
+void TrajectoryExecutionManager::updateSwitchedControllers(const std::vector<std::string>& activated,
+                                                           const std::vector<std::string>& deactivated, bool ok)
+{
+  // a successful switch tells the new states; otherwise they are queried again when needed
+  const ros::Time stamp = ok ? ros::Time::now() : ros::Time();
+  for (std::size_t a = 0; a < activated.size(); ++a)
+  {
+    ControllerInformation& ci = known_controllers_[activated[a]];
+    if (ok)
+      ci.state_.active_ = true;
+    ci.last_update_ = stamp;
+  }
+  for (std::size_t a = 0; a < deactivated.size(); ++a)
+  {
+    ControllerInformation& ci = known_controllers_[deactivated[a]];
+    if (ok)
+      ci.state_.active_ = false;
+    ci.last_update_ = stamp;
+  }
+}
+
 void TrajectoryExecutionManager::loadControllerParams()
 {
   XmlRpc::XmlRpcValue controller_list;
@@ -52,7 +52,9 @@
 #include <geometry_msgs/PoseStamped.h>
 #include <actionlib/client/simple_action_client.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <tf/tf.h>
+#include <memory>
 
 namespace moveit
 {
@@ -90,6 +92,8 @@ public:
 
 MOVEIT_CLASS_FORWARD(MoveGroupInterface);
 
+struct AsyncPlanState;
+
 /** \class MoveGroupInterface move_group_interface.h moveit/planning_interface/move_group_interface.h
 
     \brief Client class to conveniently use the ROS interfaces provided by the move_group node.
@@ -137,6 +141,38 @@ public:
     double planning_time_;
   };
 
+  /// Called from a background thread when a motion plan requested with asyncPlan() is done (or cancelled)
+  typedef boost::function<void(const MoveItErrorCode& error_code, const Plan& plan)> PlanCallback;
+
+  /// Called when the execution of a plan passed to asyncExecute() is done
+  typedef boost::function<void(const MoveItErrorCode& error_code)> ExecuteCallback;
+
+  /// Handle of a motion plan computed in the background by asyncPlan(); copies refer to the same request
+  class AsyncPlan
+  {
+  public:
+    AsyncPlan(const std::shared_ptr<AsyncPlanState>& state = std::shared_ptr<AsyncPlanState>());
+
+    /// Wait until the plan is done, for at most \e timeout (zero waits without limit). Return true if it is done.
+    bool wait(const ros::WallDuration& timeout = ros::WallDuration()) const;
+
+    /// Check whether the plan is done, successfully or not
+    bool isDone() const;
+
+    /// The outcome of the request, once it is done; PREEMPTED if it was cancelled
+    MoveItErrorCode getErrorCode() const;
+
+    /// The computed plan, once it is done successfully
+    Plan getPlan() const;
+
+    /// Cancel the request. A request still waiting in the queue is dropped; one that move_group is planning already
+    /// completes there, but is reported as cancelled.
+    void cancel();
+
+  private:
+    std::shared_ptr<AsyncPlanState> state_;
+  };
+
   /**
       \brief Construct a MoveGroupInterface instance call using a specified set of options \e opt.
 
@@ -701,9 +737,28 @@ public:
       target. No execution is performed. The resulting plan is stored in \e plan*/
   MoveItErrorCode plan(Plan& plan);
 
+  /** \brief Compute a motion plan like plan(), without blocking. The request is built from the current settings and
+      targets when this is called, so they can be changed for the next request right away. Several requests can be in
+      flight: up to getMaxAsyncPlanRequests() of them are sent to move_group's planning service at a time (which plans
+      them concurrently when its ~planning_threads parameter allows), the others wait in a queue. If \e callback is
+      given, it is called from a background thread once the request is done, e.g. to execute the plan with
+      asyncExecute(). */
+  AsyncPlan asyncPlan(const PlanCallback& callback = PlanCallback());
+
+  /** \brief Set the number of asyncPlan() requests sent to move_group at a time (default 4). This takes effect
+      before the first asyncPlan() call only, since it sets the number of background threads. */
+  void setMaxAsyncPlanRequests(unsigned int count);
+
+  /** \brief Get the number of asyncPlan() requests sent to move_group at a time */
+  unsigned int getMaxAsyncPlanRequests() const;
+
   /** \brief Given a \e plan, execute it without waiting for completion. Return true on success. */
   MoveItErrorCode asyncExecute(const Plan& plan);
 
+  /** \brief Given a \e plan, execute it without waiting for completion, and call \e callback when the execution is
+      done. Return true if the execution was started. */
+  MoveItErrorCode asyncExecute(const Plan& plan, const ExecuteCallback& callback);
+
   /** \brief Given a \e plan, execute it while waiting for completion. Return true on success. */
   MoveItErrorCode execute(const Plan& plan);
 
@@ -39,6 +39,8 @@
 #include <stdexcept>
 #include <sstream>
 #include <memory>
+#include <deque>
+#include <boost/thread.hpp>
 #include <moveit/warehouse/constraints_storage.h>
 #include <moveit/kinematic_constraints/utils.h>
 #include <moveit/move_group/capability_names.h>
@@ -46,6 +48,7 @@
 #include <moveit/move_group_interface/move_group_interface.h>
 #include <moveit/planning_scene_monitor/current_state_monitor.h>
 #include <moveit/planning_scene_monitor/planning_scene_monitor.h>
+#include <moveit/planning_scene_monitor/shared_state.h>
 #include <moveit/planning_scene_interface/planning_scene_interface.h>
 #include <moveit/trajectory_execution_manager/trajectory_execution_manager.h>
 #include <moveit/common_planning_interface_objects/common_objects.h>
@@ -56,6 +59,7 @@
 #include <moveit_msgs/ExecuteKnownTrajectory.h>
 #include <moveit_msgs/QueryPlannerInterfaces.h>
 #include <moveit_msgs/GetCartesianPath.h>
+#include <moveit_msgs/GetMotionPlan.h>
 #include <moveit_msgs/GraspPlanning.h>
 #include <moveit_msgs/GetPlannerParams.h>
 #include <moveit_msgs/SetPlannerParams.h>
@@ -88,6 +92,43 @@ enum ActiveTargetType
 };
 }
 
+/// The shared state of a request made with MoveGroupInterface::asyncPlan()
+struct AsyncPlanState
+{
+  AsyncPlanState() : sent_(false), done_(false), cancelled_(false)
+  {
+  }
+
+  /// Store the outcome and wake up the waiting threads; a cancelled request reports PREEMPTED instead
+  void finish(const MoveItErrorCode& error_code, const MoveGroupInterface::Plan& plan)
+  {
+    {
+      boost::mutex::scoped_lock slock(lock_);
+      if (cancelled_)
+        error_code_ = MoveItErrorCode(moveit_msgs::MoveItErrorCodes::PREEMPTED);
+      else
+      {
+        error_code_ = error_code;
+        plan_ = plan;
+      }
+      done_ = true;
+    }
+    done_condition_.notify_all();
+    if (callback_)
+      callback_(error_code_, plan_);
+  }
+
+  mutable boost::mutex lock_;
+  boost::condition_variable done_condition_;
+  bool sent_;  // taken by a planning thread, or dropped by cancel()
+  bool done_;
+  bool cancelled_;
+  MoveItErrorCode error_code_;
+  MoveGroupInterface::Plan plan_;
+  moveit_msgs::MotionPlanRequest request_;
+  MoveGroupInterface::PlanCallback callback_;
+};
+
 class MoveGroupInterface::MoveGroupInterfaceImpl
 {
 public:
@@ -127,6 +168,8 @@ public:
     max_velocity_scaling_factor_ = 1.0;
     max_acceleration_scaling_factor_ = 1.0;
     initializing_constraints_ = false;
+    max_async_plan_requests_ = 4;
+    stop_async_planning_ = false;
 
     if (joint_model_group_->isChain())
       end_effector_link_ = joint_model_group_->getLinkModelNames().back();
@@ -138,6 +181,7 @@ public:
         planning_scene_monitor::PlanningSceneMonitor::DEFAULT_ATTACHED_COLLISION_OBJECT_TOPIC, 1, false);
 
     current_state_monitor_ = getSharedStateMonitor(robot_model_, tf_, node_handle_);
+    shared_state_reader_.reset(new planning_scene_monitor::SharedStateReader(robot_model_));
 
     ros::WallTime timeout_for_servers = ros::WallTime::now() + wait_for_servers;
     if (wait_for_servers == ros::WallDuration())
@@ -307,6 +351,25 @@ public:
   {
     if (constraints_init_thread_)
       constraints_init_thread_->join();
+
+    // requests still being planned by move_group are waited for; the queued ones are dropped
+    std::deque<std::shared_ptr<AsyncPlanState> > queued;
+    {
+      boost::mutex::scoped_lock slock(async_plan_lock_);
+      stop_async_planning_ = true;
+      queued.swap(async_plan_queue_);
+    }
+    async_plan_condition_.notify_all();
+    async_plan_threads_.join_all();
+    for (std::size_t i = 0; i < queued.size(); ++i)
+    {
+      boost::mutex::scoped_lock slock(queued[i]->lock_);
+      if (queued[i]->sent_)
+        continue;
+      queued[i]->sent_ = true;
+      slock.unlock();
+      queued[i]->finish(MoveItErrorCode(moveit_msgs::MoveItErrorCodes::PREEMPTED), Plan());
+    }
   }
 
   const boost::shared_ptr<tf::Transformer>& getTF() const
@@ -611,6 +674,11 @@ public:
 
   bool startStateMonitor(double wait)
   {
+    // no need to monitor joint states if move_group shares its state with us
+    robot_state::RobotStatePtr shared_state;
+    if (current_state_monitor_ && !current_state_monitor_->isActive() && getSharedCurrentState(shared_state, wait))
+      return true;
+
     if (!current_state_monitor_)
     {
       ROS_ERROR_NAMED("move_group_interface", "Unable to monitor current robot state");
@@ -625,8 +693,46 @@ public:
     return true;
   }
 
+  /** \brief Get the current state from the shared memory segment of move_group, if it runs on this host and shares
+      its state (see move_group/MoveGroupSharedStatePublisher) */
+  bool getSharedCurrentState(robot_state::RobotStatePtr& current_state, double wait_seconds)
+  {
+    // a state this old means the writer is gone, it should have been updated by joint states since
+    static const ros::Duration MAX_SHARED_STATE_AGE(1.0);
+
+    const ros::Time now = ros::Time::now();
+    robot_state::RobotStatePtr state(new robot_state::RobotState(robot_model_));
+    state->setToDefaultValues();
+    ros::Time stamp;
+    if (!shared_state_reader_->read(*state, stamp))
+      return false;
+    if (stamp + MAX_SHARED_STATE_AGE < now)
+    {
+      shared_state_reader_->connect();
+      return false;
+    }
+
+    // just like CurrentStateMonitor::waitForCurrentState(), wait for a state that is not older than the request
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(wait_seconds);
+    while (stamp < now)
+    {
+      if (ros::WallTime::now() > deadline)
+        return false;
+      ros::WallDuration(0.001).sleep();
+      if (!shared_state_reader_->read(*state, stamp))
+        return false;
+    }
+    state->update();
+    current_state = state;
+    return true;
+  }
+
   bool getCurrentState(robot_state::RobotStatePtr& current_state, double wait_seconds = 1.0)
   {
+    if ((!current_state_monitor_ || !current_state_monitor_->isActive()) &&
+        getSharedCurrentState(current_state, wait_seconds))
+      return true;
+
     if (!current_state_monitor_)
     {
       ROS_ERROR_NAMED("move_group_interface", "Unable to get current robot state");
@@ -935,6 +1041,103 @@ public:
     }
   }
 
+  MoveItErrorCode asyncExecute(const Plan& plan, const ExecuteCallback& callback)
+  {
+    if (!execute_action_client_ || !execute_action_client_->isServerConnected())
+    {
+      ROS_ERROR_NAMED("move_group_interface", "The ExecuteTrajectory action is needed to report the end of execution");
+      return MoveItErrorCode(moveit_msgs::MoveItErrorCodes::FAILURE);
+    }
+
+    moveit_msgs::ExecuteTrajectoryGoal goal;
+    goal.trajectory = plan.trajectory_;
+    execute_action_client_->sendGoal(
+        goal, [callback](const actionlib::SimpleClientGoalState&,
+                         const moveit_msgs::ExecuteTrajectoryResultConstPtr& result) {
+          if (callback)
+            callback(result ? MoveItErrorCode(result->error_code) :
+                              MoveItErrorCode(moveit_msgs::MoveItErrorCodes::FAILURE));
+        });
+    return MoveItErrorCode(moveit_msgs::MoveItErrorCodes::SUCCESS);
+  }
+
+  AsyncPlan asyncPlan(const PlanCallback& callback)
+  {
+    // build the request now, so later changes to the targets do not affect it
+    moveit_msgs::MoveGroupGoal goal;
+    constructGoal(goal);
+    std::shared_ptr<AsyncPlanState> state(new AsyncPlanState());
+    state->request_ = goal.request;
+    state->callback_ = callback;
+
+    {
+      boost::mutex::scoped_lock slock(async_plan_lock_);
+      if (async_plan_threads_.size() == 0)
+        for (unsigned int i = 0; i < max_async_plan_requests_; ++i)
+          async_plan_threads_.create_thread(boost::bind(&MoveGroupInterfaceImpl::asyncPlanThread, this));
+      async_plan_queue_.push_back(state);
+    }
+    async_plan_condition_.notify_one();
+    return AsyncPlan(state);
+  }
+
+  void setMaxAsyncPlanRequests(unsigned int count)
+  {
+    boost::mutex::scoped_lock slock(async_plan_lock_);
+    if (async_plan_threads_.size() > 0)
+      ROS_WARN_NAMED("move_group_interface", "The number of concurrent asyncPlan() requests is set already");
+    else
+      max_async_plan_requests_ = std::max(count, 1u);
+  }
+
+  unsigned int getMaxAsyncPlanRequests() const
+  {
+    return max_async_plan_requests_;
+  }
+
+  // every thread sends one request at a time to the planning service of move_group
+  void asyncPlanThread()
+  {
+    ros::ServiceClient plan_service =
+        node_handle_.serviceClient<moveit_msgs::GetMotionPlan>(move_group::PLANNER_SERVICE_NAME);
+    while (true)
+    {
+      std::shared_ptr<AsyncPlanState> state;
+      {
+        boost::unique_lock<boost::mutex> ulock(async_plan_lock_);
+        while (async_plan_queue_.empty() && !stop_async_planning_)
+          async_plan_condition_.wait(ulock);
+        if (stop_async_planning_)
+          return;
+        state = async_plan_queue_.front();
+        async_plan_queue_.pop_front();
+      }
+
+      moveit_msgs::GetMotionPlan srv;
+      {
+        boost::mutex::scoped_lock slock(state->lock_);
+        if (state->sent_)
+          continue;
+        state->sent_ = true;
+        srv.request.motion_plan_request = state->request_;
+      }
+
+      Plan plan;
+      MoveItErrorCode error_code(moveit_msgs::MoveItErrorCodes::FAILURE);
+      if (plan_service.call(srv))
+      {
+        plan.trajectory_ = srv.response.motion_plan_response.trajectory;
+        plan.start_state_ = srv.response.motion_plan_response.trajectory_start;
+        plan.planning_time_ = srv.response.motion_plan_response.planning_time;
+        error_code = MoveItErrorCode(srv.response.motion_plan_response.error_code);
+      }
+      else
+        ROS_WARN_STREAM_NAMED("move_group_interface", "Unable to call the " << move_group::PLANNER_SERVICE_NAME
+                                                                            << " service of move_group");
+      state->finish(error_code, plan);
+    }
+  }
+
   double computeCartesianPath(const std::vector<geometry_msgs::Pose>& waypoints, double step, double jump_threshold,
                               moveit_msgs::RobotTrajectory& msg, const moveit_msgs::Constraints& path_constraints,
                               bool avoid_collisions, moveit_msgs::MoveItErrorCodes& error_code)
@@ -1312,6 +1515,7 @@ private:
   boost::shared_ptr<tf::Transformer> tf_;
   robot_model::RobotModelConstPtr robot_model_;
   planning_scene_monitor::CurrentStateMonitorPtr current_state_monitor_;
+  planning_scene_monitor::SharedStateReaderPtr shared_state_reader_;
   std::unique_ptr<actionlib::SimpleActionClient<moveit_msgs::MoveGroupAction> > move_action_client_;
   std::unique_ptr<actionlib::SimpleActionClient<moveit_msgs::ExecuteTrajectoryAction> > execute_action_client_;
   std::unique_ptr<actionlib::SimpleActionClient<moveit_msgs::PickupAction> > pick_action_client_;
@@ -1359,6 +1563,14 @@ private:
   ros::ServiceClient plan_grasps_service_;
   std::unique_ptr<moveit_warehouse::ConstraintsStorage> constraints_storage_;
   std::unique_ptr<boost::thread> constraints_init_thread_;
+
+  // requests of asyncPlan() that are not sent yet, and the threads sending them
+  std::deque<std::shared_ptr<AsyncPlanState> > async_plan_queue_;
+  boost::thread_group async_plan_threads_;
+  boost::mutex async_plan_lock_;
+  boost::condition_variable async_plan_condition_;
+  unsigned int max_async_plan_requests_;
+  bool stop_async_planning_;
   bool initializing_constraints_;
 };
 }
@@ -1522,6 +1734,12 @@ moveit::planning_interface::MoveGroupInterface::asyncExecute(const Plan& plan)
   return impl_->execute(plan, false);
 }
 
+moveit::planning_interface::MoveItErrorCode
+moveit::planning_interface::MoveGroupInterface::asyncExecute(const Plan& plan, const ExecuteCallback& callback)
+{
+  return impl_->asyncExecute(plan, callback);
+}
+
 moveit::planning_interface::MoveItErrorCode moveit::planning_interface::MoveGroupInterface::execute(const Plan& plan)
 {
   return impl_->execute(plan, true);
@@ -1532,6 +1750,88 @@ moveit::planning_interface::MoveItErrorCode moveit::planning_interface::MoveGrou
   return impl_->plan(plan);
 }
 
+moveit::planning_interface::MoveGroupInterface::AsyncPlan
+moveit::planning_interface::MoveGroupInterface::asyncPlan(const PlanCallback& callback)
+{
+  return impl_->asyncPlan(callback);
+}
+
+void moveit::planning_interface::MoveGroupInterface::setMaxAsyncPlanRequests(unsigned int count)
+{
+  impl_->setMaxAsyncPlanRequests(count);
+}
+
+unsigned int moveit::planning_interface::MoveGroupInterface::getMaxAsyncPlanRequests() const
+{
+  return impl_->getMaxAsyncPlanRequests();
+}
+
+moveit::planning_interface::MoveGroupInterface::AsyncPlan::AsyncPlan(const std::shared_ptr<AsyncPlanState>& state)
+  : state_(state)
+{
+}
+
+bool moveit::planning_interface::MoveGroupInterface::AsyncPlan::wait(const ros::WallDuration& timeout) const
+{
+  if (!state_)
+    return false;
+  boost::unique_lock<boost::mutex> ulock(state_->lock_);
+  if (timeout.isZero())
+    while (!state_->done_)
+      state_->done_condition_.wait(ulock);
+  else
+  {
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(timeout.toNSec() / 1000);
+    while (!state_->done_)
+      if (!state_->done_condition_.timed_wait(ulock, deadline))
+        break;
+  }
+  return state_->done_;
+}
+
+bool moveit::planning_interface::MoveGroupInterface::AsyncPlan::isDone() const
+{
+  if (!state_)
+    return false;
+  boost::mutex::scoped_lock slock(state_->lock_);
+  return state_->done_;
+}
+
+moveit::planning_interface::MoveItErrorCode
+moveit::planning_interface::MoveGroupInterface::AsyncPlan::getErrorCode() const
+{
+  if (!state_)
+    return MoveItErrorCode(moveit_msgs::MoveItErrorCodes::FAILURE);
+  boost::mutex::scoped_lock slock(state_->lock_);
+  return state_->error_code_;
+}
+
+moveit::planning_interface::MoveGroupInterface::Plan
+moveit::planning_interface::MoveGroupInterface::AsyncPlan::getPlan() const
+{
+  if (!state_)
+    return Plan();
+  boost::mutex::scoped_lock slock(state_->lock_);
+  return state_->plan_;
+}
+
+void moveit::planning_interface::MoveGroupInterface::AsyncPlan::cancel()
+{
+  if (!state_)
+    return;
+  {
+    boost::mutex::scoped_lock slock(state_->lock_);
+    if (state_->done_)
+      return;
+    state_->cancelled_ = true;
+    if (state_->sent_)
+      return;
+    state_->sent_ = true;
+  }
+  // not sent to move_group yet, so it is done right away
+  state_->finish(MoveItErrorCode(moveit_msgs::MoveItErrorCodes::PREEMPTED), Plan());
+}
+
 moveit::planning_interface::MoveItErrorCode
 moveit::planning_interface::MoveGroupInterface::pick(const std::string& object, bool plan_only)
 {
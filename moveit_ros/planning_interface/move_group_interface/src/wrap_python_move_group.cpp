@@ -37,6 +37,7 @@
 #include <moveit/move_group_interface/move_group_interface.h>
 #include <moveit/py_bindings_tools/roscpp_initializer.h>
 #include <moveit/py_bindings_tools/py_conversions.h>
+#include <moveit/py_bindings_tools/py_numpy.h>
 #include <moveit/py_bindings_tools/serialize_msg.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/robot_trajectory/robot_trajectory.h>
@@ -44,6 +45,7 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <tf_conversions/tf_eigen.h>
 
+#include <algorithm>
 #include <boost/python.hpp>
 #include <boost/shared_ptr.hpp>
 #include <Python.h>
@@ -76,7 +78,7 @@ public:
 
   bool setJointValueTargetPythonIterable(bp::object& values)
   {
-    return setJointValueTarget(py_bindings_tools::doubleFromList(values));
+    return setJointValueTarget(py_bindings_tools::doubleFromArrayOrList(values));
   }
 
   bool setJointValueTargetPythonDict(bp::dict& values)
@@ -173,6 +175,89 @@ public:
     return py_bindings_tools::listFromDouble(getRandomJointValues());
   }
 
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  py_bindings_tools::np::ndarray getCurrentJointValuesArray()
+  {
+    const robot_model::JointModelGroup* jmg = getRobotModel()->getJointModelGroup(getName());
+    py_bindings_tools::np::ndarray values = py_bindings_tools::emptyArray(jmg->getVariableCount());
+    robot_state::RobotStatePtr state = getCurrentState();
+    if (state)
+      state->copyJointGroupPositions(jmg, py_bindings_tools::arrayData(values));
+    else
+      std::fill_n(py_bindings_tools::arrayData(values), jmg->getVariableCount(), 0.0);
+    return values;
+  }
+
+  py_bindings_tools::np::ndarray getJointValueTargetArray()
+  {
+    const robot_model::JointModelGroup* jmg = getRobotModel()->getJointModelGroup(getName());
+    py_bindings_tools::np::ndarray values = py_bindings_tools::emptyArray(jmg->getVariableCount());
+    MoveGroupInterface::getJointValueTarget().copyJointGroupPositions(jmg, py_bindings_tools::arrayData(values));
+    return values;
+  }
+
+  /* Jacobian of the tip link of the group at \e joint_values, as a 6 x N array. An empty array is returned if the
+   * number of joint values does not match the group. */
+  py_bindings_tools::np::ndarray getJacobianMatrixArray(const bp::object& joint_values,
+                                                        const bp::object& reference_point)
+  {
+    const robot_model::JointModelGroup* jmg = getRobotModel()->getJointModelGroup(getName());
+    std::vector<double> v = py_bindings_tools::doubleFromArrayOrList(joint_values);
+    std::vector<double> ref = py_bindings_tools::doubleFromArrayOrList(reference_point);
+    if (v.size() != jmg->getVariableCount() || ref.size() != 3 || jmg->getLinkModels().empty())
+      return py_bindings_tools::emptyArray(0, 0);
+
+    robot_state::RobotState state(getRobotModel());
+    state.setToDefaultValues();
+    state.setJointGroupPositions(jmg, v);
+    Eigen::MatrixXd jacobian;
+    if (!state.getJacobian(jmg, jmg->getLinkModels().back(), Eigen::Vector3d(ref[0], ref[1], ref[2]), jacobian))
+      return py_bindings_tools::emptyArray(0, 0);
+
+    py_bindings_tools::np::ndarray result = py_bindings_tools::emptyArray(jacobian.rows(), jacobian.cols());
+    Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> >(
+        py_bindings_tools::arrayData(result), jacobian.rows(), jacobian.cols()) = jacobian;
+    return result;
+  }
+
+  /* Unpack a serialized moveit_msgs::RobotTrajectory into arrays: joint_names, time_from_start (N),
+   * positions, velocities, accelerations and effort (N x J each, None if not all points specify them) */
+  bp::dict getTrajectoryArraysPython(const std::string& traj_str)
+  {
+    moveit_msgs::RobotTrajectory traj;
+    py_bindings_tools::deserializeMsg(traj_str, traj);
+    const trajectory_msgs::JointTrajectory& jt = traj.joint_trajectory;
+    const std::size_t n = jt.points.size();
+    const std::size_t j = jt.joint_names.size();
+
+    bp::dict d;
+    d["joint_names"] = py_bindings_tools::listFromString(jt.joint_names);
+    py_bindings_tools::np::ndarray time = py_bindings_tools::emptyArray(n);
+    double* t = py_bindings_tools::arrayData(time);
+    for (std::size_t i = 0; i < n; ++i)
+      t[i] = jt.points[i].time_from_start.toSec();
+    d["time_from_start"] = time;
+    d["positions"] = pointFieldArray(jt, n, j, &trajectory_msgs::JointTrajectoryPoint::positions);
+    d["velocities"] = pointFieldArray(jt, n, j, &trajectory_msgs::JointTrajectoryPoint::velocities);
+    d["accelerations"] = pointFieldArray(jt, n, j, &trajectory_msgs::JointTrajectoryPoint::accelerations);
+    d["effort"] = pointFieldArray(jt, n, j, &trajectory_msgs::JointTrajectoryPoint::effort);
+    return d;
+  }
+
+  static bp::object pointFieldArray(const trajectory_msgs::JointTrajectory& jt, std::size_t n, std::size_t j,
+                                    std::vector<double> trajectory_msgs::JointTrajectoryPoint::*field)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      if ((jt.points[i].*field).size() != j)
+        return bp::object();
+    py_bindings_tools::np::ndarray result = py_bindings_tools::emptyArray(n, j);
+    double* data = py_bindings_tools::arrayData(result);
+    for (std::size_t i = 0; i < n && j > 0; ++i, data += j)
+      memcpy(data, &(jt.points[i].*field)[0], j * sizeof(double));
+    return result;
+  }
+#endif
+
   bp::dict getRememberedJointValuesPython() const
   {
     const std::map<std::string, std::vector<double>>& rv = getRememberedJointValues();
@@ -608,6 +693,13 @@ static void wrap_move_group_interface()
 
   MoveGroupInterfaceClass.def("start_state_monitor", &MoveGroupInterfaceWrapper::startStateMonitor);
   MoveGroupInterfaceClass.def("get_current_joint_values", &MoveGroupInterfaceWrapper::getCurrentJointValuesList);
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  MoveGroupInterfaceClass.def("get_current_joint_values_array",
+                              &MoveGroupInterfaceWrapper::getCurrentJointValuesArray);
+  MoveGroupInterfaceClass.def("get_joint_value_target_array", &MoveGroupInterfaceWrapper::getJointValueTargetArray);
+  MoveGroupInterfaceClass.def("get_jacobian_matrix", &MoveGroupInterfaceWrapper::getJacobianMatrixArray);
+  MoveGroupInterfaceClass.def("get_trajectory_arrays", &MoveGroupInterfaceWrapper::getTrajectoryArraysPython);
+#endif
   MoveGroupInterfaceClass.def("get_random_joint_values", &MoveGroupInterfaceWrapper::getRandomJointValuesList);
   MoveGroupInterfaceClass.def("get_remembered_joint_values",
                               &MoveGroupInterfaceWrapper::getRememberedJointValuesPython);
@@ -667,6 +759,9 @@ static void wrap_move_group_interface()
 BOOST_PYTHON_MODULE(_moveit_move_group_interface)
 {
   using namespace moveit::planning_interface;
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  moveit::py_bindings_tools::initializeNumpy();
+#endif
   wrap_move_group_interface();
 }
 
@@ -38,7 +38,9 @@
 #include <moveit/move_group/capability_names.h>
 #include <moveit_msgs/GetPlanningScene.h>
 #include <moveit_msgs/ApplyPlanningScene.h>
+#include <moveit_ros_move_group/QueryWorldObjects.h>
 #include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
 #include <algorithm>
 
 namespace moveit
@@ -48,11 +50,13 @@ namespace planning_interface
 class PlanningSceneInterface::PlanningSceneInterfaceImpl
 {
 public:
-  explicit PlanningSceneInterfaceImpl(const std::string& ns = "")
+  explicit PlanningSceneInterfaceImpl(const std::string& ns = "") : world_cache_version_(0)
   {
     node_handle_ = ros::NodeHandle(ns);
     planning_scene_service_ =
         node_handle_.serviceClient<moveit_msgs::GetPlanningScene>(move_group::GET_PLANNING_SCENE_SERVICE_NAME);
+    query_world_objects_service_ = node_handle_.serviceClient<moveit_ros_move_group::QueryWorldObjects>(
+        move_group::QUERY_WORLD_OBJECTS_SERVICE_NAME);
     apply_planning_scene_service_ =
         node_handle_.serviceClient<moveit_msgs::ApplyPlanningScene>(move_group::APPLY_PLANNING_SCENE_SERVICE_NAME);
     planning_scene_diff_publisher_ = node_handle_.advertise<moveit_msgs::PlanningScene>("planning_scene", 1);
@@ -60,9 +64,21 @@ public:
 
   std::vector<std::string> getKnownObjectNames(bool with_type)
   {
+    std::vector<std::string> result;
+    {
+      boost::mutex::scoped_lock slock(world_cache_lock_);
+      if (updateWorldCache())
+      {
+        for (std::map<std::string, CachedObject>::const_iterator it = world_cache_.begin(); it != world_cache_.end();
+             ++it)
+          if (!with_type || !it->second.type_.empty())
+            result.push_back(it->first);
+        return result;
+      }
+    }
+
     moveit_msgs::GetPlanningScene::Request request;
     moveit_msgs::GetPlanningScene::Response response;
-    std::vector<std::string> result;
     request.components.components = request.components.WORLD_OBJECT_NAMES;
     if (!planning_scene_service_.call(request, response))
       return result;
@@ -83,9 +99,28 @@ public:
   std::vector<std::string> getKnownObjectNamesInROI(double minx, double miny, double minz, double maxx, double maxy,
                                                     double maxz, bool with_type, std::vector<std::string>& types)
   {
+    std::vector<std::string> result;
+
+    // move_group answers region queries from its spatial index, without sending any geometry
+    moveit_ros_move_group::QueryWorldObjects query;
+    query.request.with_type = with_type;
+    query.request.use_roi = true;
+    query.request.roi_min.x = minx;
+    query.request.roi_min.y = miny;
+    query.request.roi_min.z = minz;
+    query.request.roi_max.x = maxx;
+    query.request.roi_max.y = maxy;
+    query.request.roi_max.z = maxz;
+    if (query_world_objects_service_.call(query))
+    {
+      result = query.response.ids;
+      if (with_type)
+        types.insert(types.end(), query.response.types.begin(), query.response.types.end());
+      return result;
+    }
+
     moveit_msgs::GetPlanningScene::Request request;
     moveit_msgs::GetPlanningScene::Response response;
-    std::vector<std::string> result;
     request.components.components = request.components.WORLD_OBJECT_GEOMETRY;
     if (!planning_scene_service_.call(request, response))
     {
@@ -135,9 +170,23 @@ public:
 
   std::map<std::string, geometry_msgs::Pose> getObjectPoses(const std::vector<std::string>& object_ids)
   {
+    std::map<std::string, geometry_msgs::Pose> result;
+    {
+      boost::mutex::scoped_lock slock(world_cache_lock_);
+      if (updateWorldCache())
+      {
+        for (std::size_t i = 0; i < object_ids.size(); ++i)
+        {
+          std::map<std::string, CachedObject>::const_iterator it = world_cache_.find(object_ids[i]);
+          if (it != world_cache_.end() && it->second.has_pose_)
+            result[it->first] = it->second.pose_;
+        }
+        return result;
+      }
+    }
+
     moveit_msgs::GetPlanningScene::Request request;
     moveit_msgs::GetPlanningScene::Response response;
-    std::map<std::string, geometry_msgs::Pose> result;
     request.components.components = request.components.WORLD_OBJECT_GEOMETRY;
     if (!planning_scene_service_.call(request, response))
     {
@@ -262,11 +311,48 @@ public:
   }
 
 private:
+  struct CachedObject
+  {
+    std::string type_;
+    bool has_pose_;
+    geometry_msgs::Pose pose_;
+  };
+
+  /** \brief Bring the local copy of the world object ids, types and poses up to date, only transferring what changed
+   * since the last update. Returns false if move_group does not offer the query service. Call with
+   * world_cache_lock_ held. */
+  bool updateWorldCache()
+  {
+    moveit_ros_move_group::QueryWorldObjects query;
+    query.request.since_version = world_cache_version_;
+    if (!query_world_objects_service_.call(query))
+      return false;
+
+    if (!query.response.incremental)
+      world_cache_.clear();
+    for (std::size_t i = 0; i < query.response.removed_ids.size(); ++i)
+      world_cache_.erase(query.response.removed_ids[i]);
+    for (std::size_t i = 0; i < query.response.ids.size(); ++i)
+    {
+      CachedObject& object = world_cache_[query.response.ids[i]];
+      object.type_ = query.response.types[i];
+      object.has_pose_ = query.response.has_shapes[i];
+      object.pose_ = query.response.poses[i];
+    }
+    world_cache_version_ = query.response.version;
+    return true;
+  }
+
   ros::NodeHandle node_handle_;
   ros::ServiceClient planning_scene_service_;
   ros::ServiceClient apply_planning_scene_service_;
+  ros::ServiceClient query_world_objects_service_;
   ros::Publisher planning_scene_diff_publisher_;
   robot_model::RobotModelConstPtr robot_model_;
+
+  boost::mutex world_cache_lock_;
+  std::map<std::string, CachedObject> world_cache_;
+  std::uint64_t world_cache_version_;
 };
 
 PlanningSceneInterface::PlanningSceneInterface(const std::string& ns)
@@ -0,0 +1,144 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_PY_BINDINGS_TOOLS_PY_NUMPY_
+#define MOVEIT_PY_BINDINGS_TOOLS_PY_NUMPY_
+
+#include <moveit/py_bindings_tools/py_conversions.h>
+#include <boost/python.hpp>
+#include <cstring>
+#include <vector>
+
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+#include <boost/python/numpy.hpp>
+#endif
+
+namespace moveit
+{
+namespace py_bindings_tools
+{
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+namespace np = boost::python::numpy;
+
+/** \brief Initialize the NumPy C API; must be called once in every module that uses the functions below */
+inline void initializeNumpy()
+{
+  np::initialize();
+}
+
+/** \brief Allocate an uninitialized one dimensional float64 array of \e size elements.
+    The array owns its buffer, so C++ code can fill it in place through arrayData() and hand it to Python
+    without any further copy. */
+inline np::ndarray emptyArray(std::size_t size)
+{
+  return np::empty(boost::python::make_tuple(size), np::dtype::get_builtin<double>());
+}
+
+/** \brief Allocate an uninitialized C-contiguous float64 array of shape \e rows x \e cols */
+inline np::ndarray emptyArray(std::size_t rows, std::size_t cols)
+{
+  return np::empty(boost::python::make_tuple(rows, cols), np::dtype::get_builtin<double>());
+}
+
+/** \brief Allocate an uninitialized C-contiguous float64 array of shape \e d0 x \e d1 x \e d2 */
+inline np::ndarray emptyArray(std::size_t d0, std::size_t d1, std::size_t d2)
+{
+  return np::empty(boost::python::make_tuple(d0, d1, d2), np::dtype::get_builtin<double>());
+}
+
+/** \brief Get the buffer of an array allocated by emptyArray() */
+inline double* arrayData(const np::ndarray& array)
+{
+  return reinterpret_cast<double*>(array.get_data());
+}
+
+/** \brief Copy \e count values into a newly allocated one dimensional array */
+inline np::ndarray arrayFromDouble(const double* values, std::size_t count)
+{
+  np::ndarray array = emptyArray(count);
+  if (count)
+    memcpy(arrayData(array), values, count * sizeof(double));
+  return array;
+}
+
+inline np::ndarray arrayFromDouble(const std::vector<double>& v)
+{
+  return arrayFromDouble(v.data(), v.size());
+}
+
+/** \brief Get a C-contiguous float64 view of \e values. If \e values already is such an array it is returned
+    as is, so its data can be read without any copy; other arrays are converted. Returns false if \e values is
+    not a NumPy array. */
+inline bool contiguousArray(const boost::python::object& values, np::ndarray& array)
+{
+  boost::python::extract<np::ndarray> e(values);
+  if (!e.check())
+    return false;
+  array = e();
+  if (!np::equivalent(array.get_dtype(), np::dtype::get_builtin<double>()))
+    array = array.astype(np::dtype::get_builtin<double>());
+  if (!(array.get_flags() & np::ndarray::C_CONTIGUOUS))
+    array = array.copy();
+  return true;
+}
+
+/** \brief Get the number of elements of an array */
+inline std::size_t arraySize(const np::ndarray& array)
+{
+  std::size_t size = 1;
+  for (int i = 0; i < array.get_nd(); ++i)
+    size *= array.shape(i);
+  return size;
+}
+
+#endif
+
+/** \brief Convert a NumPy array or any other Python iterable of numbers to a vector. NumPy arrays are copied
+    with a single memcpy() instead of being iterated element by element. */
+inline std::vector<double> doubleFromArrayOrList(const boost::python::object& values)
+{
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  np::ndarray array = emptyArray(0);
+  if (contiguousArray(values, array))
+  {
+    const double* data = arrayData(array);
+    return std::vector<double>(data, data + arraySize(array));
+  }
+#endif
+  return doubleFromList(values);
+}
+}
+}
+
+#endif
@@ -38,6 +38,7 @@
 #include <moveit/robot_state/conversions.h>
 #include <moveit/py_bindings_tools/roscpp_initializer.h>
 #include <moveit/py_bindings_tools/py_conversions.h>
+#include <moveit/py_bindings_tools/py_numpy.h>
 #include <moveit/py_bindings_tools/serialize_msg.h>
 #include <moveit_msgs/RobotState.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -352,6 +353,72 @@ public:
     return d;
   }
 
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  /* Positions of all variables of the current state, in the order of getVariableNames() of the robot model */
+  py_bindings_tools::np::ndarray getCurrentVariableValuesArray()
+  {
+    if (!ensureCurrentState())
+      return py_bindings_tools::emptyArray(0);
+    robot_state::RobotStatePtr state = current_state_monitor_->getCurrentState();
+    return py_bindings_tools::arrayFromDouble(state->getVariablePositions(), state->getVariableCount());
+  }
+
+  /* Batched forward kinematics: \e joint_values is an M x N array of positions for the N variables of \e group.
+   * The result is an M x L x 7 array with the pose [x, y, z, qx, qy, qz, qw] of every link in \e links for every
+   * row. Variables outside of the group keep their current values. */
+  py_bindings_tools::np::ndarray getLinkPosesArray(const std::string& group, const bp::list& links,
+                                                   const bp::object& joint_values)
+  {
+    const robot_model::JointModelGroup* jmg = robot_model_->getJointModelGroup(group);
+    py_bindings_tools::np::ndarray values = py_bindings_tools::emptyArray(0);
+    if (!jmg || !py_bindings_tools::contiguousArray(joint_values, values))
+      return py_bindings_tools::emptyArray(0, 0, 7);
+
+    const std::size_t n = jmg->getVariableCount();
+    const std::size_t size = py_bindings_tools::arraySize(values);
+    if (values.get_nd() > 2 || n == 0 || size % n != 0)
+    {
+      ROS_ERROR("Expected an array of rows of %u joint values for group '%s'", (unsigned int)n, group.c_str());
+      return py_bindings_tools::emptyArray(0, 0, 7);
+    }
+
+    std::vector<std::string> link_names = py_bindings_tools::stringFromList(links);
+    std::vector<const robot_model::LinkModel*> lms(link_names.size());
+    for (std::size_t i = 0; i < link_names.size(); ++i)
+      if (!(lms[i] = robot_model_->getLinkModel(link_names[i])))
+        return py_bindings_tools::emptyArray(0, 0, 7);
+
+    robot_state::RobotState state(robot_model_);
+    if (ensureCurrentState())
+      state = *current_state_monitor_->getCurrentState();
+    else
+      state.setToDefaultValues();
+
+    const std::size_t rows = size / n;
+    py_bindings_tools::np::ndarray result = py_bindings_tools::emptyArray(rows, lms.size(), 7);
+    const double* in = py_bindings_tools::arrayData(values);
+    double* out = py_bindings_tools::arrayData(result);
+    for (std::size_t r = 0; r < rows; ++r, in += n)
+    {
+      state.setJointGroupPositions(jmg, in);
+      state.updateLinkTransforms();
+      for (std::size_t i = 0; i < lms.size(); ++i, out += 7)
+      {
+        const Eigen::Affine3d& t = state.getGlobalLinkTransform(lms[i]);
+        Eigen::Quaterniond q(t.linear());
+        out[0] = t.translation().x();
+        out[1] = t.translation().y();
+        out[2] = t.translation().z();
+        out[3] = q.x();
+        out[4] = q.y();
+        out[5] = q.z();
+        out[6] = q.w();
+      }
+    }
+    return result;
+  }
+#endif
+
   const char* getRobotRootLink() const
   {
     return robot_model_->getRootLinkName().c_str();
@@ -388,6 +455,10 @@ static void wrap_robot_interface()
   RobotClass.def("get_current_state", &RobotInterfacePython::getCurrentState);
   RobotClass.def("get_current_variable_values", &RobotInterfacePython::getCurrentVariableValues);
   RobotClass.def("get_current_joint_values", &RobotInterfacePython::getCurrentJointValues);
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  RobotClass.def("get_current_variable_values_array", &RobotInterfacePython::getCurrentVariableValuesArray);
+  RobotClass.def("get_link_poses_array", &RobotInterfacePython::getLinkPosesArray);
+#endif
   RobotClass.def("get_joint_values", &RobotInterfacePython::getJointValues);
   RobotClass.def("get_robot_root_link", &RobotInterfacePython::getRobotRootLink);
   RobotClass.def("has_group", &RobotInterfacePython::hasGroup);
@@ -404,6 +475,9 @@ static void wrap_robot_interface()
 
 BOOST_PYTHON_MODULE(_moveit_robot_interface)
 {
+#ifdef MOVEIT_PY_BINDINGS_TOOLS_HAVE_NUMPY
+  moveit::py_bindings_tools::initializeNumpy();
+#endif
   wrap_robot_interface();
 }
 
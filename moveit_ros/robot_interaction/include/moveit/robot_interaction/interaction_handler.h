@@ -203,6 +203,13 @@ public:
   virtual void handleGeneric(const GenericInteraction& g,
                              const visualization_msgs::InteractiveMarkerFeedbackConstPtr& feedback);
 
+  /** \brief Solve IK for the pose the end-effector is predicted to be dragged
+   * to next, extrapolated from its last two feedback poses. The solution seeds
+   * IK if the next feedback pose arrives close to the prediction. This is
+   * called by RobotInteraction while no feedback is pending.
+   * @return True if a new solution was prefetched. */
+  bool prefetchEndEffector(const EndEffectorInteraction& eef);
+
   /** \brief Check if the marker corresponding to this end-effector leads to an
    * invalid state */
   virtual bool inError(const EndEffectorInteraction& eef) const;
@@ -245,6 +252,12 @@ private:
   void updateStateEndEffector(robot_state::RobotState* state, const EndEffectorInteraction* eef,
                               const geometry_msgs::Pose* pose, StateChangeCallbackFn* callback);
 
+  // Seed \e state with the prefetched solution for \e eef if \e pose is close
+  // to the predicted pose, and record \e pose for the next prediction.
+  // YOU MUST LOCK state_lock_ BEFORE CALLING THIS.
+  void usePrediction(robot_state::RobotState* state, const EndEffectorInteraction* eef,
+                     const geometry_msgs::Pose* pose);
+
   // Update RobotState for a new joint position.
   // YOU MUST LOCK state_lock_ BEFORE CALLING THIS.
   void updateStateJoint(robot_state::RobotState* state, const JointInteraction* vj, const geometry_msgs::Pose* pose,
@@ -286,8 +299,30 @@ private:
   // PROTECTED BY state_lock_
   const void* robot_interaction_;
 
+  // The feedback poses most recently used for IK of an end-effector, and the
+  // IK solution prefetched for the pose extrapolated from them.
+  struct EndEffectorPrediction
+  {
+    EndEffectorPrediction() : pose_count_(0), prefetched_(false), solved_(false)
+    {
+    }
+
+    geometry_msgs::Pose previous_pose_;
+    geometry_msgs::Pose last_pose_;
+    std::size_t pose_count_;
+    bool prefetched_;
+    bool solved_;
+    geometry_msgs::Pose predicted_pose_;
+    std::vector<double> solution_;
+  };
+
+  // Indexed by eef_group.
+  // PROTECTED BY prediction_lock_
+  std::map<std::string, EndEffectorPrediction> prediction_map_;
+
   boost::mutex pose_map_lock_;
   boost::mutex offset_map_lock_;
+  boost::mutex prediction_lock_;
 
   // per group options for doing kinematics.
   // PROTECTED BY state_lock_ - The POINTER is protected by state_lock_.  The
@@ -62,11 +62,15 @@ struct KinematicOptions
     LOCK_REDUNDANT_JOINTS = 0x00000008,        // options_.lock_redundant_joints
     RETURN_APPROXIMATE_SOLUTION = 0x00000010,  // options_.return_approximate_solution
     DISCRETIZATION_METHOD = 0x00000020,
+    DIFF_IK_MAX_DISTANCE = 0x00000040,         // diff_ik_max_distance_
     ALL_QUERY_OPTIONS = LOCK_REDUNDANT_JOINTS | RETURN_APPROXIMATE_SOLUTION | DISCRETIZATION_METHOD,
     ALL = 0x7fffffff
   };
 
   /// Set \e state using inverse kinematics
+  /// If the tip is already within diff_ik_max_distance_ of \e pose, a few
+  /// Jacobian steps starting at the current state are tried first and the
+  /// full IK solver is only called if they do not reach \e pose.
   /// @param state the state to set
   /// @param group name of group whose joints can move
   /// @param tip link that will be posed
@@ -89,6 +93,11 @@ struct KinematicOptions
   /// This is called to determine if the state is valid
   robot_state::GroupStateValidityCallbackFn state_validity_callback_;
 
+  /// max distance (m, and rad for the orientation) between the tip and the
+  /// desired pose for which Jacobian steps are tried before calling the IK
+  /// solver.  0.0 = always use the IK solver
+  double diff_ik_max_distance_;
+
   /// other options
   kinematics::KinematicsQueryOptions options_;
 };
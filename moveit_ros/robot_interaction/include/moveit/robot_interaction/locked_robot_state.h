@@ -51,10 +51,12 @@ MOVEIT_CLASS_FORWARD(LockedRobotState);
 //
 // Only allow one thread to modify the RobotState at a time.
 //
-// Allow any thread access to the RobotState when it is not being modified.  If
-// a (const) reference to the robot state is held when the RobotState needs to
-// be modified, a copy is made and the copy is modified.  Any externally held
-// references will be out of date but still valid.
+// Allow any thread access to the RobotState at any time, also while it is
+// being modified.  Modifications are made to a copy, which replaces the
+// maintained state when it is complete, so readers never wait for writers and
+// always see a consistent state.  Any externally held references will be out
+// of date but still valid.  The state replaced by the last modification is
+// reused for the next one once nobody holds a reference to it any more.
 //
 // The RobotState can only be modified by passing a callback function which
 // does the modification.
@@ -73,6 +75,7 @@ public:
   // it.
   //
   // The transforms in the returned state will always be up to date.
+  // This does not lock state_lock_, and never waits for a modification.
   robot_state::RobotStateConstPtr getState() const;
 
   /// Set the state to the new value.
@@ -85,8 +88,8 @@ public:
   //
   // This modifies the state by calling \e modify on it.
   // The \e modify function is passed a reference to the state which it can
-  // modify.  No threads will be given access to the state while the \e modify
-  // function is running.
+  // modify.  The function runs with state_lock_ held; threads calling
+  // getState() meanwhile get the state as it was before the modification.
   void modifyState(const ModifyStateFunction& modify);
 
 protected:
@@ -98,15 +101,26 @@ protected:
   virtual void robotStateChanged();
 
 protected:
-  // this locks all accesses to the state_ member.
+  // this serializes all modifications of the state_ member.
   // The lock can also be used by subclasses to lock additional fields.
   mutable boost::mutex state_lock_;
 
 private:
-  // The state maintained by this class.
-  // When a modify function is being called this is NULL.
-  // PROTECTED BY state_lock_
+  // Get a copy of \e state to modify and publish, reusing spare_state_ if
+  // possible.  MUST hold state_lock_ when calling this.
+  robot_state::RobotStatePtr copyToSpareState(const robot_state::RobotState& state);
+
+  // Make \e state the maintained state.  MUST hold state_lock_ when calling this.
+  void publishState(const robot_state::RobotStatePtr& state);
+
+  // The state maintained by this class.  It is never modified once published.
+  // ACCESSED WITH std::atomic_load() AND std::atomic_exchange(), which is only
+  // called with state_lock_ held
   robot_state::RobotStatePtr state_;
+
+  // The previously maintained state, which may still be in use by readers.
+  // PROTECTED BY state_lock_
+  robot_state::RobotStatePtr spare_state_;
 };
 }
 
@@ -197,8 +197,12 @@ bool InteractionHandler::getLastJointMarkerPose(const JointInteraction& vj, geom
 
 void InteractionHandler::clearLastEndEffectorMarkerPose(const EndEffectorInteraction& eef)
 {
-  boost::mutex::scoped_lock slock(pose_map_lock_);
-  pose_map_.erase(eef.eef_group);
+  {
+    boost::mutex::scoped_lock slock(pose_map_lock_);
+    pose_map_.erase(eef.eef_group);
+  }
+  boost::mutex::scoped_lock plock(prediction_lock_);
+  prediction_map_.erase(eef.eef_group);
 }
 
 void InteractionHandler::clearLastJointMarkerPose(const JointInteraction& vj)
@@ -209,8 +213,12 @@ void InteractionHandler::clearLastJointMarkerPose(const JointInteraction& vj)
 
 void InteractionHandler::clearLastMarkerPoses()
 {
-  boost::mutex::scoped_lock slock(pose_map_lock_);
-  pose_map_.clear();
+  {
+    boost::mutex::scoped_lock slock(pose_map_lock_);
+    pose_map_.clear();
+  }
+  boost::mutex::scoped_lock plock(prediction_lock_);
+  prediction_map_.clear();
 }
 
 void InteractionHandler::setMenuHandler(const std::shared_ptr<interactive_markers::MenuHandler>& mh)
@@ -328,12 +336,83 @@ void InteractionHandler::updateStateEndEffector(robot_state::RobotState* state,
   // access kinematic_options_map_.
   KinematicOptions kinematic_options = kinematic_options_map_->getOptions(eef->parent_group);
 
+  usePrediction(state, eef, pose);
   bool ok = kinematic_options.setStateFromIK(*state, eef->parent_group, eef->parent_link, *pose);
   bool error_state_changed = setErrorState(eef->parent_group, !ok);
   if (update_callback_)
     *callback = boost::bind(update_callback_, _1, error_state_changed);
 }
 
+// max distance (m, rad) between a feedback pose and the predicted pose for
+// which the prefetched solution is used as IK seed
+static const double PREDICTION_TOLERANCE = 0.01;
+
+// MUST hold state_lock_ when calling this!
+void InteractionHandler::usePrediction(robot_state::RobotState* state, const EndEffectorInteraction* eef,
+                                       const geometry_msgs::Pose* pose)
+{
+  boost::mutex::scoped_lock plock(prediction_lock_);
+  EndEffectorPrediction& prediction = prediction_map_[eef->eef_group];
+
+  if (prediction.solved_)
+  {
+    Eigen::Affine3d predicted, target;
+    tf::poseMsgToEigen(prediction.predicted_pose_, predicted);
+    tf::poseMsgToEigen(*pose, target);
+    Eigen::Affine3d error = predicted.inverse(Eigen::Isometry) * target;
+    if (error.translation().norm() < PREDICTION_TOLERANCE &&
+        Eigen::AngleAxisd(error.rotation()).angle() < PREDICTION_TOLERANCE)
+      state->setJointGroupPositions(eef->parent_group, prediction.solution_);
+  }
+
+  prediction.previous_pose_ = prediction.last_pose_;
+  prediction.last_pose_ = *pose;
+  prediction.pose_count_++;
+  prediction.prefetched_ = false;
+  prediction.solved_ = false;
+}
+
+bool InteractionHandler::prefetchEndEffector(const EndEffectorInteraction& eef)
+{
+  geometry_msgs::Pose predicted_pose;
+  std::size_t pose_count;
+  {
+    boost::mutex::scoped_lock plock(prediction_lock_);
+    std::map<std::string, EndEffectorPrediction>::iterator it = prediction_map_.find(eef.eef_group);
+    if (it == prediction_map_.end() || it->second.pose_count_ < 2 || it->second.prefetched_)
+      return false;
+    it->second.prefetched_ = true;
+    pose_count = it->second.pose_count_;
+
+    // assume the marker keeps moving by the same increment
+    Eigen::Affine3d previous, last;
+    tf::poseMsgToEigen(it->second.previous_pose_, previous);
+    tf::poseMsgToEigen(it->second.last_pose_, last);
+    tf::poseEigenToMsg(last * previous.inverse(Eigen::Isometry) * last, predicted_pose);
+  }
+
+  KinematicOptions kinematic_options;
+  {
+    boost::mutex::scoped_lock lock(state_lock_);
+    kinematic_options = kinematic_options_map_->getOptions(eef.parent_group);
+  }
+
+  // solve on a copy, seeded with the current solution
+  robot_state::RobotState state(*getState());
+  if (!kinematic_options.setStateFromIK(state, eef.parent_group, eef.parent_link, predicted_pose))
+    return false;
+
+  boost::mutex::scoped_lock plock(prediction_lock_);
+  std::map<std::string, EndEffectorPrediction>::iterator it = prediction_map_.find(eef.eef_group);
+  // drop the solution if feedback arrived in the meantime
+  if (it == prediction_map_.end() || it->second.pose_count_ != pose_count)
+    return false;
+  it->second.predicted_pose_ = predicted_pose;
+  state.copyJointGroupPositions(eef.parent_group, it->second.solution_);
+  it->second.solved_ = true;
+  return true;
+}
+
 // MUST hold state_lock_ when calling this!
 void InteractionHandler::updateStateJoint(robot_state::RobotState* state, const JointInteraction* vj,
                                           const geometry_msgs::Pose* feedback_pose, StateChangeCallbackFn* callback)
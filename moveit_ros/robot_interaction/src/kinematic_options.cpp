@@ -35,12 +35,61 @@
 /* Author: Acorn Pooley */
 
 #include <moveit/robot_interaction/kinematic_options.h>
+#include <eigen_conversions/eigen_msg.h>
 #include <boost/static_assert.hpp>
 #include <ros/console.h>
+#include <algorithm>
+
+namespace
+{
+// number of Jacobian steps tried before falling back to the IK solver
+static const unsigned int DIFF_IK_STEPS = 3;
+// distance (m, rad) below which the Jacobian steps are considered converged
+static const double DIFF_IK_TOLERANCE = 1e-4;
+
+// Move the tip of jmg towards target by a few Jacobian steps, starting at the
+// current state. This is much cheaper than a full IK query and sufficient for
+// the small increments produced by dragging an interactive marker. On failure
+// the joints of jmg are restored.
+bool setStateFromDiffIK(robot_state::RobotState& state, const robot_model::JointModelGroup* jmg,
+                        const std::string& tip, const geometry_msgs::Pose& pose, double max_distance,
+                        const robot_state::GroupStateValidityCallbackFn& validity_callback)
+{
+  const robot_model::LinkModel* tip_link = state.getRobotModel()->getLinkModel(tip);
+  if (!tip_link)
+    return false;
+
+  Eigen::Affine3d target;
+  tf::poseMsgToEigen(pose, target);
+  std::vector<double> initial_values;
+  state.copyJointGroupPositions(jmg, initial_values);
+
+  for (unsigned int step = 0;; ++step)
+  {
+    // setFromDiffIK() expects the twist in the frame of the tip
+    Eigen::Affine3d error = state.getGlobalLinkTransform(tip_link).inverse(Eigen::Isometry) * target;
+    Eigen::AngleAxisd rotation(error.rotation());
+    double distance = std::max(error.translation().norm(), rotation.angle());
+    if (distance < DIFF_IK_TOLERANCE)
+      return true;
+    if ((step == 0 && distance > max_distance) || step == DIFF_IK_STEPS)
+      break;
+
+    Eigen::VectorXd twist(6);
+    twist << error.translation(), rotation.axis() * rotation.angle();
+    if (!state.setFromDiffIK(jmg, twist, tip, 1.0, validity_callback))
+      break;
+  }
+
+  state.setJointGroupPositions(jmg, initial_values);
+  return false;
+}
+}
 
 robot_interaction::KinematicOptions::KinematicOptions()
   : timeout_seconds_(0.0)  // 0.0 = use default timeout
   , max_attempts_(0)       // 0 = use default max attempts
+  , diff_ik_max_distance_(0.02)
 {
 }
 
@@ -55,6 +104,13 @@ bool robot_interaction::KinematicOptions::setStateFromIK(robot_state::RobotState
     ROS_ERROR("No getJointModelGroup('%s') found", group.c_str());
     return false;
   }
+  // redundant joints may not be locked by the Jacobian steps
+  if (diff_ik_max_distance_ > 0.0 && !options_.lock_redundant_joints &&
+      setStateFromDiffIK(state, jmg, tip, pose, diff_ik_max_distance_, state_validity_callback_))
+  {
+    state.update();
+    return true;
+  }
   bool result = state.setFromIK(jmg, pose, tip, max_attempts_, timeout_seconds_, state_validity_callback_, options_);
   state.update();
   return result;
@@ -72,7 +128,8 @@ void robot_interaction::KinematicOptions::setOptions(const KinematicOptions& sou
 #define O_FIELDS(F)                                                                                                    \
   F(double, timeout_seconds_, TIMEOUT)                                                                                 \
   F(unsigned int, max_attempts_, MAX_ATTEMPTS)                                                                         \
-  F(robot_state::GroupStateValidityCallbackFn, state_validity_callback_, STATE_VALIDITY_CALLBACK)
+  F(robot_state::GroupStateValidityCallbackFn, state_validity_callback_, STATE_VALIDITY_CALLBACK)                      \
+  F(double, diff_ik_max_distance_, DIFF_IK_MAX_DISTANCE)
 
 // This needs to represent all the fields in
 // kinematics::KinematicsQueryOptions
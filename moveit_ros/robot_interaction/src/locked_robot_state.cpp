@@ -57,8 +57,7 @@ robot_interaction::LockedRobotState::~LockedRobotState()
 
 robot_state::RobotStateConstPtr robot_interaction::LockedRobotState::getState() const
 {
-  boost::mutex::scoped_lock lock(state_lock_);
-  return state_;
+  return std::atomic_load(&state_);
 }
 
 void robot_interaction::LockedRobotState::setState(const robot_state::RobotState& state)
@@ -66,14 +65,9 @@ void robot_interaction::LockedRobotState::setState(const robot_state::RobotState
   {
     boost::mutex::scoped_lock lock(state_lock_);
 
-    // If someone else has a reference to the state, then make a new copy.
-    // The old state is orphaned (does not change, but is now out of date).
-    if (state_.unique())
-      *state_ = state;
-    else
-      state_.reset(new robot_state::RobotState(state));
-
-    state_->update();
+    robot_state::RobotStatePtr next = copyToSpareState(state);
+    next->update();
+    publishState(next);
   }
   robotStateChanged();
 }
@@ -83,17 +77,32 @@ void robot_interaction::LockedRobotState::modifyState(const ModifyStateFunction&
   {
     boost::mutex::scoped_lock lock(state_lock_);
 
-    // If someone else has a reference to the state, then make a copy.
-    // The old state is orphaned (does not change, but is now out of date).
-    if (!state_.unique())
-      state_.reset(new robot_state::RobotState(*state_));
-
-    modify(state_.get());
-    state_->update();
+    // only writers replace state_, and they hold state_lock_
+    robot_state::RobotStatePtr next = copyToSpareState(*state_);
+    modify(next.get());
+    next->update();
+    publishState(next);
   }
   robotStateChanged();
 }
 
+robot_state::RobotStatePtr robot_interaction::LockedRobotState::copyToSpareState(const robot_state::RobotState& state)
+{
+  // Readers can only get a reference to the published state, so once nobody
+  // holds a reference to the spare state it can be overwritten.  Otherwise the
+  // spare state is orphaned (does not change, but is out of date).
+  if (spare_state_ && spare_state_.unique())
+    *spare_state_ = state;
+  else
+    spare_state_.reset(new robot_state::RobotState(state));
+  return spare_state_;
+}
+
+void robot_interaction::LockedRobotState::publishState(const robot_state::RobotStatePtr& state)
+{
+  spare_state_ = std::atomic_exchange(&state_, state);
+}
+
 void robot_interaction::LockedRobotState::robotStateChanged()
 {
 }
@@ -746,6 +746,9 @@ void RobotInteraction::processingThread()
 {
   boost::unique_lock<boost::mutex> ulock(marker_access_lock_);
 
+  // end-effectors moved by the last feedback, by marker name
+  std::map<std::string, std::pair<::robot_interaction::InteractionHandlerPtr, EndEffectorInteraction> > prefetch;
+
   while (run_processing_thread_ && ros::ok())
   {
     while (feedback_map_.empty() && run_processing_thread_ && ros::ok())
@@ -801,6 +804,7 @@ void RobotInteraction::processingThread()
             ROS_ERROR("Exception caught while handling end-effector update: %s", ex.what());
           }
           marker_access_lock_.lock();
+          prefetch[feedback->marker_name] = std::make_pair(ih, eef);
         }
         else if (marker_class == "JJ")
         {
@@ -841,6 +845,25 @@ void RobotInteraction::processingThread()
         ROS_ERROR("Exception caught while processing event: %s", ex.what());
       }
     }
+
+    // while no feedback is pending, solve IK for the poses the end-effectors
+    // are expected to be dragged to next
+    while (!prefetch.empty() && feedback_map_.empty() && ros::ok())
+    {
+      ::robot_interaction::InteractionHandlerPtr ih = prefetch.begin()->second.first;
+      EndEffectorInteraction eef = prefetch.begin()->second.second;
+      prefetch.erase(prefetch.begin());
+      marker_access_lock_.unlock();
+      try
+      {
+        ih->prefetchEndEffector(eef);
+      }
+      catch (std::exception& ex)
+      {
+        ROS_ERROR("Exception caught while prefetching end-effector update: %s", ex.what());
+      }
+      marker_access_lock_.lock();
+    }
   }
 }
 
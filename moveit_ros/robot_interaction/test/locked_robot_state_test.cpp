@@ -296,6 +296,30 @@ TEST(LockedRobotState, robotStateChanged)
   EXPECT_EQ(ls1.cnt_, 3);
 }
 
+TEST(LockedRobotState, stateSnapshots)
+{
+  moveit::core::RobotModelPtr model = getModel();
+  robot_interaction::LockedRobotState ls1(model);
+
+  // a held state is never modified
+  robot_state::RobotStateConstPtr held = ls1.getState();
+  double value = held->getVariablePosition(JOINT_A);
+  ls1.modifyState(modify1);
+  EXPECT_EQ(held->getVariablePosition(JOINT_A), value);
+  EXPECT_EQ(ls1.getState()->getVariablePosition(JOINT_A), 0.00006);
+  EXPECT_NE(held.get(), ls1.getState().get());
+
+  // once released, the replaced state is reused for later modifications
+  const robot_state::RobotState* current = ls1.getState().get();
+  held.reset();
+  ls1.modifyState(modify1);
+  const robot_state::RobotState* next = ls1.getState().get();
+  ls1.modifyState(modify1);
+  EXPECT_EQ(ls1.getState().get(), current);
+  ls1.modifyState(modify1);
+  EXPECT_EQ(ls1.getState().get(), next);
+}
+
 // Class for testing LockedRobotState in multithreaded environment.
 // Contains thread functions for modifying/checking a LockedRobotState.
 class MyInfo
@@ -199,6 +199,8 @@ protected:
 
   void executeMainLoopJobs();
   void publishInteractiveMarkers(bool pose_update);
+  /** \brief Queue an update of the interactive markers; repeated pose updates are coalesced */
+  void scheduleInteractiveMarkerUpdate(bool error_state_changed);
 
   void recomputeQueryStartStateMetrics();
   void recomputeQueryGoalStateMetrics();
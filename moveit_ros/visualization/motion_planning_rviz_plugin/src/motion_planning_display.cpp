@@ -906,13 +906,23 @@ void MotionPlanningDisplay::changedAttachedBodyColor()
   trajectory_visual_->setDefaultAttachedObjectColor(color);
 }
 
+void MotionPlanningDisplay::scheduleInteractiveMarkerUpdate(bool error_state_changed)
+{
+  if (error_state_changed)
+    addBackgroundJob(boost::bind(&MotionPlanningDisplay::publishInteractiveMarkers, this, false),
+                     "publishInteractiveMarkers");
+  else
+    // pose updates read the query states when they run, so a waiting one is superseded by a newer one
+    addBackgroundJob(boost::bind(&MotionPlanningDisplay::publishInteractiveMarkers, this, true),
+                     "updateInteractiveMarkers", moveit::tools::BackgroundProcessing::HIGH, true);
+}
+
 void MotionPlanningDisplay::scheduleDrawQueryStartState(robot_interaction::RobotInteraction::InteractionHandler*,
                                                         bool error_state_changed)
 {
   if (!planning_scene_monitor_)
     return;
-  addBackgroundJob(boost::bind(&MotionPlanningDisplay::publishInteractiveMarkers, this, !error_state_changed),
-                   "publishInteractiveMarkers");
+  scheduleInteractiveMarkerUpdate(error_state_changed);
   recomputeQueryStartStateMetrics();
   addMainLoopJob(boost::bind(&MotionPlanningDisplay::drawQueryStartState, this));
   context_->queueRender();
@@ -923,8 +933,7 @@ void MotionPlanningDisplay::scheduleDrawQueryGoalState(robot_interaction::RobotI
 {
   if (!planning_scene_monitor_)
     return;
-  addBackgroundJob(boost::bind(&MotionPlanningDisplay::publishInteractiveMarkers, this, !error_state_changed),
-                   "publishInteractiveMarkers");
+  scheduleInteractiveMarkerUpdate(error_state_changed);
   recomputeQueryGoalStateMetrics();
   addMainLoopJob(boost::bind(&MotionPlanningDisplay::drawQueryGoalState, this));
   context_->queueRender();
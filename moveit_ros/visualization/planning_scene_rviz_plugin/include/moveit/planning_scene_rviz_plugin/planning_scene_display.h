@@ -88,6 +88,11 @@ public:
       All jobs are queued and processed in order by a single background thread. */
   void addBackgroundJob(const boost::function<void()>& job, const std::string& name);
 
+  /** Queue this function call with \e priority for execution within the background thread. Jobs of higher priority
+      are processed first. If \e coalesce is true, a queued job of the same name is replaced by this one. */
+  void addBackgroundJob(const boost::function<void()>& job, const std::string& name,
+                        moveit::tools::BackgroundProcessing::JobPriority priority, bool coalesce = false);
+
   /** Directly spawn a (detached) background thread for execution of this function call
       Should be used, when order of processing is not relevant / job can run in parallel.
       Must be used, when job will be blocking. Using addBackgroundJob() in this case will block other queued jobs as
@@ -131,6 +136,7 @@ private Q_SLOTS:
   void changedSceneDisplayTime();
   void changedOctreeRenderMode();
   void changedOctreeColorMode();
+  void changedOctreeView();
 
 protected Q_SLOTS:
   virtual void changedAttachedBodyColor();
@@ -210,6 +216,8 @@ protected:
   rviz::FloatProperty* scene_display_time_property_;
   rviz::EnumProperty* octree_render_property_;
   rviz::EnumProperty* octree_coloring_property_;
+  rviz::BoolProperty* octree_culling_property_;
+  rviz::FloatProperty* octree_detail_distance_property_;
 };
 
 }  // namespace moveit_rviz_plugin
@@ -113,6 +113,16 @@ PlanningSceneDisplay::PlanningSceneDisplay(bool listen_to_planning_scene, bool s
   octree_coloring_property_->addOption("Z-Axis", OCTOMAP_Z_AXIS_COLOR);
   octree_coloring_property_->addOption("Cell Probability", OCTOMAP_PROBABLILTY_COLOR);
 
+  octree_culling_property_ =
+      new rviz::BoolProperty("Voxel Culling", true, "Only decode the voxels inside the view of the camera",
+                             scene_category_, SLOT(changedOctreeView()), this);
+
+  octree_detail_distance_property_ = new rviz::FloatProperty(
+      "Voxel Detail Distance", 0.0f, "Voxels farther than this distance (m) from the camera are shown at a coarser "
+                                     "resolution, one level per doubling of the distance (0 for full resolution)",
+      scene_category_, SLOT(changedOctreeView()), this);
+  octree_detail_distance_property_->setMin(0.0);
+
   scene_display_time_property_ =
       new rviz::FloatProperty("Scene Display Time", 0.2f, "The amount of wall-time to wait in between rendering "
                                                           "updates to the planning scene (if any)",
@@ -201,7 +211,8 @@ void PlanningSceneDisplay::reset()
   if (planning_scene_robot_)
     planning_scene_robot_->clear();
 
-  addBackgroundJob(boost::bind(&PlanningSceneDisplay::loadRobotModel, this), "loadRobotModel");
+  addBackgroundJob(boost::bind(&PlanningSceneDisplay::loadRobotModel, this), "loadRobotModel",
+                   moveit::tools::BackgroundProcessing::NORMAL, true);
   Display::reset();
 
   if (planning_scene_robot_)
@@ -217,6 +228,12 @@ void PlanningSceneDisplay::addBackgroundJob(const boost::function<void()>& job,
   background_process_.addJob(job, name);
 }
 
+void PlanningSceneDisplay::addBackgroundJob(const boost::function<void()>& job, const std::string& name,
+                                            moveit::tools::BackgroundProcessing::JobPriority priority, bool coalesce)
+{
+  background_process_.addJob(job, name, priority, coalesce);
+}
+
 void PlanningSceneDisplay::spawnBackgroundJob(const boost::function<void()>& job)
 {
   boost::thread t(job);
@@ -385,6 +402,16 @@ void PlanningSceneDisplay::changedOctreeColorMode()
 {
 }
 
+void PlanningSceneDisplay::changedOctreeView()
+{
+  if (planning_scene_render_)
+  {
+    planning_scene_render_->setOctreeView(octree_culling_property_->getBool(),
+                                          octree_detail_distance_property_->getFloat());
+    queueRenderSceneGeometry();
+  }
+}
+
 void PlanningSceneDisplay::changedSceneRobotVisualEnabled()
 {
   if (isEnabled() && planning_scene_robot_)
@@ -534,6 +561,14 @@ void PlanningSceneDisplay::onRobotModelLoaded()
   changedPlanningSceneTopic();
   planning_scene_render_.reset(new PlanningSceneRender(planning_scene_node_, context_, planning_scene_robot_));
   planning_scene_render_->getGeometryNode()->setVisible(scene_enabled_property_->getBool());
+  // decode octomaps off the render thread; a newer octomap replaces a pending one
+  planning_scene_render_->setJobQueues(
+      [this](const boost::function<void()>& job, const std::string& name) {
+        addBackgroundJob(job, name, moveit::tools::BackgroundProcessing::NORMAL, true);
+      },
+      boost::bind(&PlanningSceneDisplay::addMainLoopJob, this, _1));
+  planning_scene_render_->setOctreeView(octree_culling_property_->getBool(),
+                                        octree_detail_distance_property_->getFloat());
 
   const planning_scene_monitor::LockedPlanningSceneRO& ps = getPlanningSceneRO();
   if (planning_scene_robot_)
@@ -570,7 +605,8 @@ void PlanningSceneDisplay::onEnable()
 {
   Display::onEnable();
 
-  addBackgroundJob(boost::bind(&PlanningSceneDisplay::loadRobotModel, this), "loadRobotModel");
+  addBackgroundJob(boost::bind(&PlanningSceneDisplay::loadRobotModel, this), "loadRobotModel",
+                   moveit::tools::BackgroundProcessing::NORMAL, true);
 
   if (planning_scene_robot_)
   {
@@ -627,6 +663,8 @@ void PlanningSceneDisplay::updateInternal(float wall_dt, float ros_dt)
     current_scene_time_ = 0.0f;
     planning_scene_needs_render_ = false;
   }
+  else if (planning_scene_render_)
+    planning_scene_render_->updateView();
 }
 
 void PlanningSceneDisplay::load(const rviz::Config& config)
@@ -37,23 +37,30 @@
 #ifndef MOVEIT_VISUALIZATION_SCENE_DISPLAY_RVIZ_OCTOMAP_RENDER_
 #define MOVEIT_VISUALIZATION_SCENE_DISPLAY_RVIZ_OCTOMAP_RENDER_
 
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <vector>
 #include <rviz/ogre_helpers/point_cloud.h>
+#include <OgreMatrix4.h>
+#include <OgrePlane.h>
+#include <OgreVector3.h>
 
-#include <moveit/rviz_plugin_render_tools/octomap_render.h>
+#include <moveit/macros/class_forward.h>
 
 namespace octomap
 {
 class OcTree;
+class OcTreeKey;
+class OcTreeNode;
 }
 
 namespace Ogre
 {
 class SceneManager;
 class SceneNode;
+class Camera;
 class AxisAlignedBox;
-class Vector3;
 class Quaternion;
 }
 
@@ -71,33 +78,106 @@ enum OctreeVoxelColorMode
   OCTOMAP_PROBABLILTY_COLOR,
 };
 
+MOVEIT_CLASS_FORWARD(OcTreeRender);
+
+/** \brief Render the leaves of an octree as boxes.
+
+    The voxels are split into chunks, cubes of leaves at the same depth, and every chunk is drawn by its own point
+    cloud. When the octree is updated, only the point clouds of the chunks whose voxels changed are rebuilt.
+
+    Given a View, decoding skips the chunks outside the camera frustum and decodes distant chunks at a coarser
+    depth, so the cost of an update and the size of the point clouds are bounded by what is visible. */
 class OcTreeRender
 {
 public:
+  /** \brief A snapshot of the camera, taken in the render thread, that decode() can use in any thread */
+  struct View
+  {
+    View() : culling_(true), detail_distance_(0.0)
+    {
+    }
+
+    /** \brief Transform from the frame of the octree to the world frame */
+    Ogre::Matrix4 octree_to_world_;
+
+    /** \brief Position of the camera in the world frame */
+    Ogre::Vector3 camera_position_;
+
+    /** \brief Planes of the camera frustum in the world frame, normals pointing inwards */
+    std::vector<Ogre::Plane> frustum_planes_;
+
+    /** \brief Skip the chunks outside of the frustum */
+    bool culling_;
+
+    /** \brief Chunks closer than this are decoded at full depth; each doubling of the distance drops one level.
+        0 decodes all chunks at full depth. */
+    double detail_distance_;
+  };
+
+  /** \brief The voxels of an octree that are to be displayed, keyed by chunk */
+  struct Voxels
+  {
+    std::map<std::uint64_t, std::vector<rviz::PointCloud::Point> > chunks_;
+
+    /** \brief The edge length of the voxels, by depth (starting at 1) */
+    std::vector<double> sizes_;
+  };
+  typedef std::shared_ptr<const Voxels> VoxelsConstPtr;
+
   OcTreeRender(const std::shared_ptr<const octomap::OcTree>& octree, OctreeVoxelRenderMode octree_voxel_rendering,
                OctreeVoxelColorMode octree_color_mode, std::size_t max_octree_depth, Ogre::SceneManager* scene_manager,
                Ogre::SceneNode* parent_node);
+
+  /** \brief Construct a renderer that shows nothing until update() is called */
+  OcTreeRender(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node);
+
   virtual ~OcTreeRender();
 
   void setPosition(const Ogre::Vector3& position);
   void setOrientation(const Ogre::Quaternion& orientation);
 
+  /** \brief Take a snapshot of \e camera relative to this octree, for use with decode() */
+  View getView(const Ogre::Camera* camera, bool culling, double detail_distance) const;
+
+  /** \brief Compute the voxels of \e octree to display, considering \e view if given. This does not touch any Ogre
+      state, so it can run in a background thread, as long as \e octree is not modified meanwhile. */
+  static VoxelsConstPtr decode(const std::shared_ptr<const octomap::OcTree>& octree,
+                               OctreeVoxelRenderMode octree_voxel_rendering, OctreeVoxelColorMode octree_color_mode,
+                               std::size_t max_octree_depth, const View* view = NULL);
+
+  /** \brief Display \e voxels, rebuilding only the chunks that differ from the ones currently displayed */
+  void update(const Voxels& voxels);
+
+  void update(const std::shared_ptr<const octomap::OcTree>& octree, OctreeVoxelRenderMode octree_voxel_rendering,
+              OctreeVoxelColorMode octree_color_mode, std::size_t max_octree_depth = 0)
+  {
+    update(*decode(octree, octree_voxel_rendering, octree_color_mode, max_octree_depth));
+  }
+
 private:
-  void setColor(double z_pos, double min_z, double max_z, double color_factor, rviz::PointCloud::Point* point);
-  void setProbColor(double prob, rviz::PointCloud::Point* point);
+  struct Chunk
+  {
+    Chunk() : cloud_(NULL)
+    {
+    }
+    rviz::PointCloud* cloud_;
+    std::vector<rviz::PointCloud::Point> points_;
+  };
+
+  static void setColor(double z_pos, double min_z, double max_z, double color_factor, rviz::PointCloud::Point* point);
 
-  void octreeDecoding(const std::shared_ptr<const octomap::OcTree>& octree,
-                      OctreeVoxelRenderMode octree_voxel_rendering, OctreeVoxelColorMode octree_color_mode);
+  /** \brief Add the voxel of \e node to \e voxels, unless it is hidden by neighbors on all sides */
+  static void addVoxel(const octomap::OcTree& octree, const octomap::OcTreeKey& key, unsigned int depth,
+                       const octomap::OcTreeNode& node, unsigned int render_mode_mask,
+                       OctreeVoxelColorMode octree_color_mode, double min_z, double max_z, Voxels& voxels);
 
-  // Ogre-rviz point clouds
-  std::vector<rviz::PointCloud*> cloud_;
-  std::shared_ptr<const octomap::OcTree> octree_;
+  void destroyChunk(Chunk& chunk);
+
+  // Ogre-rviz point clouds, one per chunk
+  std::map<std::uint64_t, Chunk> chunks_;
 
   Ogre::SceneNode* scene_node_;
   Ogre::SceneManager* scene_manager_;
-
-  double colorFactor_;
-  std::size_t octree_depth_;
 };
 }
 #endif
@@ -42,6 +42,10 @@
 #include <moveit/rviz_plugin_render_tools/render_shapes.h>
 #include <rviz/helpers/color.h>
 #include <OgreMaterial.h>
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+#include <boost/function.hpp>
+#include <map>
 
 namespace Ogre
 {
@@ -57,11 +61,23 @@ namespace moveit_rviz_plugin
 {
 MOVEIT_CLASS_FORWARD(RobotStateVisualization);
 MOVEIT_CLASS_FORWARD(RenderShapes);
+MOVEIT_CLASS_FORWARD(OcTreeRender);
 MOVEIT_CLASS_FORWARD(PlanningSceneRender);
 
+/** \brief Render the robot state and the world objects of a planning scene.
+
+    Rendering is incremental: each world object keeps its shapes between calls to renderPlanningScene(). An object
+    is rendered again only if its shapes or colors changed; if all its shapes moved together, only its scene node is
+    moved. Octrees are decoded on every call, but only the chunks of voxels that changed are rebuilt. */
 class PlanningSceneRender
 {
 public:
+  /** \brief Queue a named job for execution outside the render thread */
+  typedef boost::function<void(const boost::function<void()>&, const std::string&)> BackgroundJobQueue;
+
+  /** \brief Queue a job for execution in the render thread */
+  typedef boost::function<void(const boost::function<void()>&)> MainLoopJobQueue;
+
   PlanningSceneRender(Ogre::SceneNode* root_node, rviz::DisplayContext* context,
                       const RobotStateVisualizationPtr& robot);
   ~PlanningSceneRender();
@@ -81,11 +97,44 @@ public:
                            OctreeVoxelColorMode voxel_color_mode, float default_scene_alpha);
   void clear();
 
+  /** \brief Decode octrees in \e background_queue and display the result through \e main_loop_queue, instead of
+      decoding them within renderPlanningScene(). Pending jobs of the same object should replace each other. */
+  void setJobQueues(const BackgroundJobQueue& background_queue, const MainLoopJobQueue& main_loop_queue);
+
+  /** \brief Decode octrees for the current camera: skip the voxels outside of its frustum if \e culling is set, and
+      decode voxels farther than \e detail_distance coarser (0 to disable) */
+  void setOctreeView(bool culling, double detail_distance);
+
+  /** \brief Decode the octrees again if the camera moved since they were decoded. Call once per frame. */
+  void updateView();
+
 private:
+  struct RenderedObject;
+  typedef std::shared_ptr<RenderedObject> RenderedObjectPtr;
+
+  void renderObject(const RenderedObjectPtr& rendered, const collision_detection::World::Object& object,
+                    OctreeVoxelRenderMode voxel_render_mode, OctreeVoxelColorMode voxel_color_mode);
+  void updateOctrees(const RenderedObjectPtr& rendered);
+  void destroyObject(const RenderedObjectPtr& rendered);
+
   Ogre::SceneNode* planning_scene_geometry_node_;
   rviz::DisplayContext* context_;
-  RenderShapesPtr render_shapes_;
   RobotStateVisualizationPtr scene_robot_;
+
+  /** \brief The world objects as currently rendered, by name */
+  std::map<std::string, RenderedObjectPtr> rendered_objects_;
+
+  BackgroundJobQueue background_queue_;
+  MainLoopJobQueue main_loop_queue_;
+
+  OctreeVoxelRenderMode octree_voxel_rendering_;
+  OctreeVoxelColorMode octree_color_mode_;
+  bool octree_culling_;
+  double octree_detail_distance_;
+
+  /** \brief The camera pose the octrees were last decoded for */
+  Ogre::Vector3 view_position_;
+  Ogre::Quaternion view_orientation_;
 };
 }
 
@@ -0,0 +1,135 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#ifndef MOVEIT_TRAJECTORY_RVIZ_PLUGIN__TRAJECTORY_TRAIL
+#define MOVEIT_TRAJECTORY_RVIZ_PLUGIN__TRAJECTORY_TRAIL
+
+#include <moveit/macros/class_forward.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <rviz/robot/robot.h>
+#include <OgreQuaternion.h>
+#include <OgreVector3.h>
+
+namespace Ogre
+{
+class SceneNode;
+class StaticGeometry;
+}
+
+namespace rviz
+{
+class DisplayContext;
+}
+
+namespace moveit_rviz_plugin
+{
+MOVEIT_CLASS_FORWARD(TrajectoryTrail);
+
+/** \brief The trail of ghost robots shown along a trajectory.
+
+    Instead of creating an rviz::Robot (a scene node and entity per link) for every ghost, a single template robot
+    is posed at the waypoint of each ghost and its entities are baked into Ogre::StaticGeometry. Ogre merges all
+    copies of a link mesh that share a material into one batch, so the number of draw calls depends on the robot
+    and not on the length of the trail. The link poses of all ghosts are computed in one batch.
+
+    Ghosts are baked in segments of consecutive waypoints, so they can be revealed while the trajectory is
+    animated. The baked geometry lives in world coordinates; isOutdated() tells when the root node moved
+    and the trail needs to be built again. */
+class TrajectoryTrail
+{
+public:
+  TrajectoryTrail(Ogre::SceneNode* root_node, rviz::DisplayContext* context, const std::string& name);
+  ~TrajectoryTrail();
+
+  void load(const urdf::ModelInterface& descr);
+
+  /** \brief The robot the ghosts are copied from. Changes to its appearance only show after the next build(). */
+  rviz::Robot& getRobot()
+  {
+    return robot_;
+  }
+
+  /** \brief Build the ghosts for \e trajectory, replacing any previous ones.
+
+      A ghost is placed at every \e step_size-th waypoint and at the last one. Ghosts at which no link moved
+      more than \e min_distance from the previous ghost are dropped. If more than \e max_ghosts remain
+      (0 for no limit), they are thinned out evenly along the trajectory. */
+  void build(const robot_trajectory::RobotTrajectory& trajectory, std::size_t step_size, std::size_t max_ghosts,
+             double min_distance, bool visual, bool collision);
+
+  void clear();
+
+  bool empty() const
+  {
+    return segments_.empty();
+  }
+
+  std::size_t getGhostCount() const
+  {
+    return ghost_count_;
+  }
+
+  void setVisible(bool visible);
+
+  /** \brief Show only the segments that start at or before \e waypoint, as long as the trail is visible */
+  void showUntil(int waypoint);
+
+  /** \brief Check whether the root node moved since the trail was built */
+  bool isOutdated() const;
+
+private:
+  struct Segment
+  {
+    Ogre::StaticGeometry* geometry_;
+    std::size_t first_waypoint_;
+  };
+
+  void updateVisibility();
+
+  Ogre::SceneNode* root_node_;
+  rviz::DisplayContext* context_;
+  std::string name_;
+  rviz::Robot robot_;
+
+  std::vector<Segment> segments_;
+  std::size_t ghost_count_;
+  bool visible_;
+  int shown_until_;
+
+  Ogre::Vector3 root_position_;
+  Ogre::Quaternion root_orientation_;
+};
+}
+
+#endif
@@ -45,6 +45,7 @@
 #ifndef Q_MOC_RUN
 #include <moveit/rviz_plugin_render_tools/robot_state_visualization.h>
 #include <moveit/rviz_plugin_render_tools/trajectory_panel.h>
+#include <moveit/rviz_plugin_render_tools/trajectory_trail.h>
 #include <ros/ros.h>
 #include <moveit/robot_model/robot_model.h>
 #include <moveit/robot_state/robot_state.h>
@@ -135,7 +136,7 @@ protected:
 
   robot_trajectory::RobotTrajectoryPtr displaying_trajectory_message_;
   robot_trajectory::RobotTrajectoryPtr trajectory_message_to_display_;
-  std::vector<rviz::Robot*> trajectory_trail_;
+  TrajectoryTrailPtr trajectory_trail_;
   ros::Subscriber trajectory_topic_sub_;
   bool animating_path_;
   bool drop_displaying_trajectory_;
@@ -167,6 +168,8 @@ protected:
   rviz::ColorProperty* robot_color_property_;
   rviz::BoolProperty* enable_robot_color_property_;
   rviz::IntProperty* trail_step_size_property_;
+  rviz::IntProperty* trail_max_ghosts_property_;
+  rviz::FloatProperty* trail_min_distance_property_;
 };
 
 }  // namespace moveit_rviz_plugin
@@ -39,6 +39,8 @@
 #include <octomap_msgs/Octomap.h>
 #include <octomap/octomap.h>
 
+#include <OgreAxisAlignedBox.h>
+#include <OgreCamera.h>
 #include <OgreSceneNode.h>
 #include <OgreSceneManager.h>
 
@@ -47,53 +49,69 @@
 namespace moveit_rviz_plugin
 {
 typedef std::vector<rviz::PointCloud::Point> VPoint;
-typedef std::vector<VPoint> VVPoint;
+
+namespace
+{
+// chunks are cubes of 2^CHUNK_SHIFT keys along each axis
+const unsigned int CHUNK_SHIFT = 5;
+
+const double COLOR_FACTOR = 0.8;
+
+std::uint64_t chunkId(const octomap::OcTreeKey& key, unsigned int depth)
+{
+  return static_cast<std::uint64_t>(key[0] >> CHUNK_SHIFT) |
+         (static_cast<std::uint64_t>(key[1] >> CHUNK_SHIFT) << 16) |
+         (static_cast<std::uint64_t>(key[2] >> CHUNK_SHIFT) << 32) | (static_cast<std::uint64_t>(depth) << 48);
+}
+
+unsigned int chunkDepth(std::uint64_t chunk_id)
+{
+  return static_cast<unsigned int>(chunk_id >> 48);
+}
+
+bool samePoints(const VPoint& a, const VPoint& b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    if (a[i].position != b[i].position || a[i].color != b[i].color)
+      return false;
+  return true;
+}
+}
 
 OcTreeRender::OcTreeRender(const std::shared_ptr<const octomap::OcTree>& octree,
                            OctreeVoxelRenderMode octree_voxel_rendering, OctreeVoxelColorMode octree_color_mode,
                            std::size_t max_octree_depth, Ogre::SceneManager* scene_manager,
                            Ogre::SceneNode* parent_node = NULL)
-  : octree_(octree), colorFactor_(0.8)
+  : OcTreeRender(scene_manager, parent_node)
+{
+  update(octree, octree_voxel_rendering, octree_color_mode, max_octree_depth);
+}
+
+OcTreeRender::OcTreeRender(Ogre::SceneManager* scene_manager, Ogre::SceneNode* parent_node)
+  : scene_manager_(scene_manager)
 {
   if (!parent_node)
   {
     parent_node = scene_manager_->getRootSceneNode();
   }
 
-  if (!max_octree_depth)
-  {
-    octree_depth_ = octree->getTreeDepth();
-  }
-  else
-  {
-    octree_depth_ = std::min(max_octree_depth, (std::size_t)octree->getTreeDepth());
-  }
-
   scene_node_ = parent_node->createChildSceneNode();
-
-  cloud_.resize(octree_depth_);
-
-  for (std::size_t i = 0; i < octree_depth_; ++i)
-  {
-    std::stringstream sname;
-    sname << "PointCloud Nr." << i;
-    cloud_[i] = new rviz::PointCloud();
-    cloud_[i]->setName(sname.str());
-    cloud_[i]->setRenderMode(rviz::PointCloud::RM_BOXES);
-    scene_node_->attachObject(cloud_[i]);
-  }
-
-  octreeDecoding(octree, octree_voxel_rendering, octree_color_mode);
 }
 
 OcTreeRender::~OcTreeRender()
 {
-  scene_node_->detachAllObjects();
+  for (std::map<std::uint64_t, Chunk>::iterator it = chunks_.begin(); it != chunks_.end(); ++it)
+    destroyChunk(it->second);
+  scene_manager_->destroySceneNode(scene_node_);
+}
 
-  for (std::size_t i = 0; i < octree_depth_; ++i)
-  {
-    delete cloud_[i];
-  }
+void OcTreeRender::destroyChunk(Chunk& chunk)
+{
+  scene_node_->detachObject(chunk.cloud_);
+  delete chunk.cloud_;
+  chunk.cloud_ = NULL;
 }
 
 void OcTreeRender::setPosition(const Ogre::Vector3& position)
@@ -154,100 +172,199 @@ void OcTreeRender::setColor(double z_pos, double min_z, double max_z, double col
   }
 }
 
-void OcTreeRender::octreeDecoding(const std::shared_ptr<const octomap::OcTree>& octree,
-                                  OctreeVoxelRenderMode octree_voxel_rendering, OctreeVoxelColorMode octree_color_mode)
+OcTreeRender::View OcTreeRender::getView(const Ogre::Camera* camera, bool culling, double detail_distance) const
 {
-  VVPoint pointBuf_;
-  pointBuf_.resize(octree_depth_);
+  View view;
+  view.octree_to_world_ = scene_node_->_getFullTransform();
+  view.camera_position_ = camera->getDerivedPosition();
+  for (unsigned short i = 0; i < 6; ++i)
+  {
+    // an infinite far plane does not cull anything
+    if (i == Ogre::FRUSTUM_PLANE_FAR && camera->getFarClipDistance() == 0)
+      continue;
+    view.frustum_planes_.push_back(camera->getFrustumPlane(i));
+  }
+  view.culling_ = culling;
+  view.detail_distance_ = detail_distance;
+  return view;
+}
 
-  // get dimensions of octree
-  double minX, minY, minZ, maxX, maxY, maxZ;
-  octree->getMetricMin(minX, minY, minZ);
-  octree->getMetricMax(maxX, maxY, maxZ);
+void OcTreeRender::addVoxel(const octomap::OcTree& octree, const octomap::OcTreeKey& key, unsigned int depth,
+                            const octomap::OcTreeNode& node, unsigned int render_mode_mask,
+                            OctreeVoxelColorMode octree_color_mode, double min_z, double max_z, Voxels& voxels)
+{
+  // the left part evaluates to 1 for free voxels and 2 for occupied voxels
+  if (!(((int)octree.isNodeOccupied(node) + 1) & render_mode_mask))
+    return;
+
+  // check if current voxel has neighbors on all sides -> no need to be displayed
+  const int step = 1 << (octree.getTreeDepth() - depth);
+  bool allNeighborsFound = true;
+  for (int dz = -1; allNeighborsFound && dz <= 1; ++dz)
+    for (int dy = -1; allNeighborsFound && dy <= 1; ++dy)
+      for (int dx = -1; allNeighborsFound && dx <= 1; ++dx)
+      {
+        if (!dx && !dy && !dz)
+          continue;
+        const int k[3] = { key[0] + dx * step, key[1] + dy * step, key[2] + dz * step };
+        if (k[0] < 0 || k[1] < 0 || k[2] < 0 || k[0] > 0xFFFF || k[1] > 0xFFFF || k[2] > 0xFFFF)
+        {
+          allNeighborsFound = false;
+          break;
+        }
+        octomap::OcTreeNode* neighbor = octree.search(octomap::OcTreeKey(k[0], k[1], k[2]), depth);
 
-  unsigned int render_mode_mask = static_cast<unsigned int>(octree_voxel_rendering);
+        // the left part evaluates to 1 for free voxels and 2 for occupied voxels
+        if (!(neighbor && (((int)octree.isNodeOccupied(neighbor)) + 1) & render_mode_mask))
+        {
+          // we do not have a neighbor => break!
+          allNeighborsFound = false;
+        }
+      }
+  if (allNeighborsFound)
+    return;
+
+  rviz::PointCloud::Point newPoint;
 
-  size_t pointCount = 0;
+  octomap::point3d center = octree.keyToCoord(key, depth);
+  newPoint.position.x = center.x();
+  newPoint.position.y = center.y();
+  newPoint.position.z = center.z();
+
+  float cell_probability;
+
+  switch (octree_color_mode)
   {
-    // traverse all leafs in the tree:
-    for (octomap::OcTree::iterator it = octree->begin(octree_depth_), end = octree->end(); it != end; ++it)
-    {
-      bool display_voxel = false;
+    case OCTOMAP_Z_AXIS_COLOR:
+      setColor(newPoint.position.z, min_z, max_z, COLOR_FACTOR, &newPoint);
+      break;
+    case OCTOMAP_PROBABLILTY_COLOR:
+      cell_probability = node.getOccupancy();
+      newPoint.setColor((1.0f - cell_probability), cell_probability, 0.0);
+      break;
+    default:
+      break;
+  }
 
-      // the left part evaluates to 1 for free voxels and 2 for occupied voxels
-      if (((int)octree->isNodeOccupied(*it) + 1) & render_mode_mask)
-      {
-        // check if current voxel has neighbors on all sides -> no need to be displayed
-        bool allNeighborsFound = true;
+  // push to point vectors
+  voxels.chunks_[chunkId(key, depth)].push_back(newPoint);
+}
 
-        octomap::OcTreeKey key;
-        octomap::OcTreeKey nKey = it.getKey();
+OcTreeRender::VoxelsConstPtr OcTreeRender::decode(const std::shared_ptr<const octomap::OcTree>& octree,
+                                                 OctreeVoxelRenderMode octree_voxel_rendering,
+                                                 OctreeVoxelColorMode octree_color_mode, std::size_t max_octree_depth,
+                                                 const View* view)
+{
+  std::shared_ptr<Voxels> voxels(new Voxels());
 
-        for (key[2] = nKey[2] - 1; allNeighborsFound && key[2] <= nKey[2] + 1; ++key[2])
-        {
-          for (key[1] = nKey[1] - 1; allNeighborsFound && key[1] <= nKey[1] + 1; ++key[1])
-          {
-            for (key[0] = nKey[0] - 1; allNeighborsFound && key[0] <= nKey[0] + 1; ++key[0])
-            {
-              if (key != nKey)
-              {
-                octomap::OcTreeNode* node = octree->search(key);
-
-                // the left part evaluates to 1 for free voxels and 2 for occupied voxels
-                if (!(node && (((int)octree->isNodeOccupied(node)) + 1) & render_mode_mask))
-                {
-                  // we do not have a neighbor => break!
-                  allNeighborsFound = false;
-                }
-              }
-            }
-          }
-        }
+  const unsigned int tree_depth = octree->getTreeDepth();
+  unsigned int octree_depth = tree_depth;
+  if (max_octree_depth)
+    octree_depth = std::min(static_cast<unsigned int>(max_octree_depth), octree_depth);
 
-        display_voxel |= !allNeighborsFound;
-      }
+  voxels->sizes_.resize(octree_depth);
+  for (std::size_t i = 0; i < octree_depth; ++i)
+    voxels->sizes_[i] = octree->getNodeSize(i + 1);
 
-      if (display_voxel)
-      {
-        rviz::PointCloud::Point newPoint;
+  // get dimensions of octree
+  double minX, minY, minZ, maxX, maxY, maxZ;
+  octree->getMetricMin(minX, minY, minZ);
+  octree->getMetricMax(maxX, maxY, maxZ);
 
-        newPoint.position.x = it.getX();
-        newPoint.position.y = it.getY();
-        newPoint.position.z = it.getZ();
+  unsigned int render_mode_mask = static_cast<unsigned int>(octree_voxel_rendering);
 
-        float cell_probability;
+  // decide for a box in the octree's frame whether it is culled, and at which depth to decode it otherwise
+  const auto decode_depth = [&](const octomap::point3d& min, const octomap::point3d& max) -> int {
+    if (!view)
+      return octree_depth;
+    Ogre::AxisAlignedBox box(min.x(), min.y(), min.z(), max.x(), max.y(), max.z());
+    box.transformAffine(view->octree_to_world_);
+    if (view->culling_)
+      for (std::size_t i = 0; i < view->frustum_planes_.size(); ++i)
+        if (view->frustum_planes_[i].getSide(box) == Ogre::Plane::NEGATIVE_SIDE)
+          return -1;
+    if (view->detail_distance_ <= 0.0)
+      return octree_depth;
+    double distance = box.distance(view->camera_position_);
+    int depth = octree_depth;
+    for (double d = view->detail_distance_; distance > d && depth > 1; d *= 2.0)
+      --depth;
+    return depth;
+  };
+
+  // the octree is visited in chunks of 2^CHUNK_SHIFT keys along each axis; nodes bigger than a chunk are voxels
+  const unsigned int chunk_depth = tree_depth > CHUNK_SHIFT ? std::min(tree_depth - CHUNK_SHIFT, octree_depth) : 1;
+  const unsigned int chunk_mask = (1u << (tree_depth - chunk_depth)) - 1;
+  for (octomap::OcTree::iterator it = octree->begin(chunk_depth), end = octree->end(); it != end; ++it)
+  {
+    const octomap::OcTreeKey key = it.getKey();
+    const unsigned int depth = it.getDepth();
+    const double half_size = 0.5 * octree->getNodeSize(depth);
+    const octomap::point3d center = it.getCoordinate();
+    const int depth_limit = decode_depth(center - octomap::point3d(half_size, half_size, half_size),
+                                         center + octomap::point3d(half_size, half_size, half_size));
+    if (depth_limit < 0)
+      continue;  // not in view
+
+    if (depth < chunk_depth || depth_limit <= static_cast<int>(chunk_depth))
+    {
+      addVoxel(*octree, key, depth, *it, render_mode_mask, octree_color_mode, minZ, maxZ, *voxels);
+      continue;
+    }
 
-        switch (octree_color_mode)
-        {
-          case OCTOMAP_Z_AXIS_COLOR:
-            setColor(newPoint.position.z, minZ, maxZ, colorFactor_, &newPoint);
-            break;
-          case OCTOMAP_PROBABLILTY_COLOR:
-            cell_probability = it->getOccupancy();
-            newPoint.setColor((1.0f - cell_probability), cell_probability, 0.0);
-            break;
-          default:
-            break;
-        }
+    octomap::OcTreeKey min_key, max_key;
+    for (unsigned int k = 0; k < 3; ++k)
+    {
+      min_key[k] = key[k] & ~chunk_mask;
+      max_key[k] = min_key[k] | chunk_mask;
+    }
+    for (octomap::OcTree::leaf_bbx_iterator leaf = octree->begin_leafs_bbx(min_key, max_key, depth_limit),
+                                            leaf_end = octree->end_leafs_bbx();
+         leaf != leaf_end; ++leaf)
+      addVoxel(*octree, leaf.getKey(), leaf.getDepth(), *leaf, render_mode_mask, octree_color_mode, minZ, maxZ,
+               *voxels);
+  }
 
-        // push to point vectors
-        unsigned int depth = it.getDepth();
-        pointBuf_[depth - 1].push_back(newPoint);
+  return voxels;
+}
 
-        ++pointCount;
-      }
+void OcTreeRender::update(const Voxels& voxels)
+{
+  // remove the chunks that are gone
+  for (std::map<std::uint64_t, Chunk>::iterator it = chunks_.begin(); it != chunks_.end();)
+  {
+    if (voxels.chunks_.find(it->first) == voxels.chunks_.end())
+    {
+      destroyChunk(it->second);
+      chunks_.erase(it++);
     }
+    else
+      ++it;
   }
 
-  for (size_t i = 0; i < octree_depth_; ++i)
+  // add new chunks and refill the ones that changed
+  for (std::map<std::uint64_t, VPoint>::const_iterator it = voxels.chunks_.begin(); it != voxels.chunks_.end(); ++it)
   {
-    double size = octree->getNodeSize(i + 1);
+    unsigned int depth = chunkDepth(it->first);
+    if (depth < 1 || depth > voxels.sizes_.size())
+      continue;
 
-    cloud_[i]->clear();
-    cloud_[i]->setDimensions(size, size, size);
+    Chunk& chunk = chunks_[it->first];
+    double size = voxels.sizes_[depth - 1];
+    if (!chunk.cloud_)
+    {
+      chunk.cloud_ = new rviz::PointCloud();
+      chunk.cloud_->setName("PointCloud Nr." + std::to_string(depth - 1));
+      chunk.cloud_->setRenderMode(rviz::PointCloud::RM_BOXES);
+      scene_node_->attachObject(chunk.cloud_);
+    }
+    else if (samePoints(chunk.points_, it->second))
+      continue;
 
-    cloud_[i]->addPoints(&pointBuf_[i].front(), pointBuf_[i].size());
-    pointBuf_[i].clear();
+    chunk.points_ = it->second;
+    chunk.cloud_->clear();
+    chunk.cloud_->setDimensions(size, size, size);
+    chunk.cloud_->addPoints(&chunk.points_.front(), chunk.points_.size());
   }
 }
 }
@@ -37,28 +37,119 @@
 #include <moveit/rviz_plugin_render_tools/planning_scene_render.h>
 #include <moveit/rviz_plugin_render_tools/robot_state_visualization.h>
 #include <moveit/rviz_plugin_render_tools/render_shapes.h>
+#include <moveit/rviz_plugin_render_tools/octomap_render.h>
 #include <rviz/display_context.h>
+#include <rviz/view_controller.h>
+#include <rviz/view_manager.h>
+
+#include <OgreCamera.h>
 
 #include <OgreSceneNode.h>
 #include <OgreSceneManager.h>
 
+#include <boost/bind.hpp>
+
 namespace moveit_rviz_plugin
 {
+/** \brief A world object as it is currently rendered */
+struct PlanningSceneRender::RenderedObject
+{
+  std::string id_;
+  Ogre::SceneNode* node_;
+  RenderShapesPtr render_shapes_;
+
+  /** \brief The octrees among the shapes, by index of the shape */
+  std::map<std::size_t, OcTreeRenderPtr> octrees_;
+
+  /** \brief The shapes and their poses at the time they were rendered, relative to node_ */
+  std::vector<shapes::ShapeConstPtr> shapes_;
+  EigenSTL::vector_Affine3d shape_poses_;
+
+  rviz::Color color_;
+  float alpha_;
+};
+
+namespace
+{
+// the octrees are decoded again for the current view if the camera moved (m) or turned (degrees) more than this
+const double VIEW_MOVE_THRESHOLD = 0.25;
+const double VIEW_TURN_THRESHOLD = 5.0;
+
+Ogre::Vector3 toOgrePosition(const Eigen::Affine3d& pose)
+{
+  const Eigen::Vector3d& t = pose.translation();
+  return Ogre::Vector3(t.x(), t.y(), t.z());
+}
+
+Ogre::Quaternion toOgreOrientation(const Eigen::Affine3d& pose)
+{
+  Eigen::Quaterniond q(pose.linear());
+  return Ogre::Quaternion(q.w(), q.x(), q.y(), q.z());
+}
+
+bool sameColor(const rviz::Color& a, const rviz::Color& b)
+{
+  return a.r_ == b.r_ && a.g_ == b.g_ && a.b_ == b.b_;
+}
+
+// decode octree in a background job and pass the voxels to the renderer in the main loop
+void decodeOctree(const std::shared_ptr<const octomap::OcTree>& octree, OctreeVoxelRenderMode voxel_render_mode,
+                  OctreeVoxelColorMode voxel_color_mode, const std::shared_ptr<const OcTreeRender::View>& view,
+                  const std::weak_ptr<OcTreeRender>& octree_render,
+                  const PlanningSceneRender::MainLoopJobQueue& main_loop_queue)
+{
+  OcTreeRender::VoxelsConstPtr voxels =
+      OcTreeRender::decode(octree, voxel_render_mode, voxel_color_mode, 0u, view.get());
+  main_loop_queue([octree_render, voxels]() {
+    // the object may have been removed in the meantime
+    if (OcTreeRenderPtr render = octree_render.lock())
+      render->update(*voxels);
+  });
+}
+}
+
 PlanningSceneRender::PlanningSceneRender(Ogre::SceneNode* node, rviz::DisplayContext* context,
                                          const RobotStateVisualizationPtr& robot)
-  : planning_scene_geometry_node_(node->createChildSceneNode()), context_(context), scene_robot_(robot)
+  : planning_scene_geometry_node_(node->createChildSceneNode())
+  , context_(context)
+  , scene_robot_(robot)
+  , octree_voxel_rendering_(OCTOMAP_OCCUPIED_VOXELS)
+  , octree_color_mode_(OCTOMAP_Z_AXIS_COLOR)
+  , octree_culling_(false)
+  , octree_detail_distance_(0.0)
+  , view_position_(Ogre::Vector3::ZERO)
+  , view_orientation_(Ogre::Quaternion::IDENTITY)
 {
-  render_shapes_.reset(new RenderShapes(context));
 }
 
 PlanningSceneRender::~PlanningSceneRender()
 {
+  clear();
   context_->getSceneManager()->destroySceneNode(planning_scene_geometry_node_->getName());
 }
 
 void PlanningSceneRender::clear()
 {
-  render_shapes_->clear();
+  for (std::map<std::string, RenderedObjectPtr>::iterator it = rendered_objects_.begin();
+       it != rendered_objects_.end(); ++it)
+    destroyObject(it->second);
+  rendered_objects_.clear();
+}
+
+void PlanningSceneRender::setJobQueues(const BackgroundJobQueue& background_queue,
+                                       const MainLoopJobQueue& main_loop_queue)
+{
+  background_queue_ = background_queue;
+  main_loop_queue_ = main_loop_queue;
+}
+
+void PlanningSceneRender::destroyObject(const RenderedObjectPtr& rendered)
+{
+  // the shapes are attached to the object's node, so they go first
+  rendered->octrees_.clear();
+  rendered->render_shapes_.reset();
+  context_->getSceneManager()->destroySceneNode(rendered->node_);
+  rendered->node_ = NULL;
 }
 
 void PlanningSceneRender::renderPlanningScene(const planning_scene::PlanningSceneConstPtr& scene,
@@ -70,7 +161,8 @@ void PlanningSceneRender::renderPlanningScene(const planning_scene::PlanningScen
   if (!scene)
     return;
 
-  clear();
+  octree_voxel_rendering_ = octree_voxel_rendering;
+  octree_color_mode_ = octree_color_mode;
 
   if (scene_robot_)
   {
@@ -87,6 +179,9 @@ void PlanningSceneRender::renderPlanningScene(const planning_scene::PlanningScen
     scene_robot_->update(robot_state::RobotStateConstPtr(rs), color, color_map);
   }
 
+  std::map<std::string, RenderedObjectPtr> previous_objects;
+  previous_objects.swap(rendered_objects_);
+
   const std::vector<std::string>& ids = scene->getWorld()->getObjectIds();
   for (std::size_t i = 0; i < ids.size(); ++i)
   {
@@ -101,9 +196,142 @@ void PlanningSceneRender::renderPlanningScene(const planning_scene::PlanningScen
       color.b_ = c.b;
       alpha = c.a;
     }
-    for (std::size_t j = 0; j < o->shapes_.size(); ++j)
-      render_shapes_->renderShape(planning_scene_geometry_node_, o->shapes_[j].get(), o->shape_poses_[j],
-                                  octree_voxel_rendering, octree_color_mode, color, alpha);
+
+    RenderedObjectPtr rendered;
+    std::map<std::string, RenderedObjectPtr>::iterator previous = previous_objects.find(ids[i]);
+    if (previous != previous_objects.end())
+    {
+      rendered = previous->second;
+      previous_objects.erase(previous);
+
+      // a different set of shapes or colors needs rendering from scratch
+      if (rendered->shapes_ != o->shapes_ || !sameColor(rendered->color_, color) || rendered->alpha_ != alpha)
+      {
+        destroyObject(rendered);
+        rendered.reset();
+      }
+    }
+
+    if (!rendered)
+    {
+      rendered.reset(new RenderedObject());
+      rendered->id_ = ids[i];
+      rendered->node_ = planning_scene_geometry_node_->createChildSceneNode();
+      rendered->color_ = color;
+      rendered->alpha_ = alpha;
+      renderObject(rendered, *o, octree_voxel_rendering, octree_color_mode);
+    }
+    else if (!o->shape_poses_.empty())
+    {
+      // if all shapes moved rigidly, move the object's node; otherwise render the shapes at their new poses
+      const Eigen::Affine3d transform = o->shape_poses_[0] * rendered->shape_poses_[0].inverse();
+      bool rigid = true;
+      for (std::size_t j = 1; rigid && j < o->shape_poses_.size(); ++j)
+        rigid = (transform * rendered->shape_poses_[j]).isApprox(o->shape_poses_[j], 1e-6);
+      if (rigid)
+      {
+        rendered->node_->setPosition(toOgrePosition(transform));
+        rendered->node_->setOrientation(toOgreOrientation(transform));
+
+        // octrees may change their content without being replaced
+        updateOctrees(rendered);
+      }
+      else
+      {
+        destroyObject(rendered);
+        rendered->node_ = planning_scene_geometry_node_->createChildSceneNode();
+        renderObject(rendered, *o, octree_voxel_rendering, octree_color_mode);
+      }
+    }
+
+    rendered_objects_[ids[i]] = rendered;
+  }
+
+  // objects that are no longer in the scene
+  for (std::map<std::string, RenderedObjectPtr>::iterator it = previous_objects.begin(); it != previous_objects.end();
+       ++it)
+    destroyObject(it->second);
+}
+
+void PlanningSceneRender::renderObject(const RenderedObjectPtr& rendered,
+                                       const collision_detection::World::Object& object,
+                                       OctreeVoxelRenderMode voxel_render_mode, OctreeVoxelColorMode voxel_color_mode)
+{
+  rendered->render_shapes_.reset(new RenderShapes(context_));
+  rendered->octrees_.clear();
+  rendered->shapes_ = object.shapes_;
+  rendered->shape_poses_ = object.shape_poses_;
+
+  for (std::size_t j = 0; j < object.shapes_.size(); ++j)
+  {
+    if (object.shapes_[j]->type == shapes::OCTREE)
+    {
+      OcTreeRenderPtr octree(new OcTreeRender(context_->getSceneManager(), rendered->node_));
+      octree->setPosition(toOgrePosition(object.shape_poses_[j]));
+      octree->setOrientation(toOgreOrientation(object.shape_poses_[j]));
+      rendered->octrees_[j] = octree;
+    }
+    else
+      rendered->render_shapes_->renderShape(rendered->node_, object.shapes_[j].get(), object.shape_poses_[j],
+                                            voxel_render_mode, voxel_color_mode, rendered->color_, rendered->alpha_);
+  }
+  updateOctrees(rendered);
+}
+
+void PlanningSceneRender::updateOctrees(const RenderedObjectPtr& rendered)
+{
+  if (rendered->octrees_.empty())
+    return;
+
+  const Ogre::Camera* camera = NULL;
+  if ((octree_culling_ || octree_detail_distance_ > 0.0) && context_->getViewManager()->getCurrent())
+    camera = context_->getViewManager()->getCurrent()->getCamera();
+  if (camera)
+  {
+    view_position_ = camera->getDerivedPosition();
+    view_orientation_ = camera->getDerivedOrientation();
   }
+
+  for (std::map<std::size_t, OcTreeRenderPtr>::iterator it = rendered->octrees_.begin();
+       it != rendered->octrees_.end(); ++it)
+  {
+    const std::shared_ptr<const octomap::OcTree>& octree =
+        static_cast<const shapes::OcTree*>(rendered->shapes_[it->first].get())->octree;
+    std::shared_ptr<OcTreeRender::View> view;
+    if (camera)
+      view.reset(new OcTreeRender::View(it->second->getView(camera, octree_culling_, octree_detail_distance_)));
+
+    if (background_queue_ && main_loop_queue_)
+      background_queue_(boost::bind(&decodeOctree, octree, octree_voxel_rendering_, octree_color_mode_, view,
+                                    std::weak_ptr<OcTreeRender>(it->second), main_loop_queue_),
+                        "renderOctree " + rendered->id_ + " " + std::to_string(it->first));
+    else
+      it->second->update(*OcTreeRender::decode(octree, octree_voxel_rendering_, octree_color_mode_, 0u, view.get()));
+  }
+}
+
+void PlanningSceneRender::setOctreeView(bool culling, double detail_distance)
+{
+  octree_culling_ = culling;
+  octree_detail_distance_ = detail_distance;
+}
+
+void PlanningSceneRender::updateView()
+{
+  if (!octree_culling_ && octree_detail_distance_ <= 0.0)
+    return;
+  rviz::ViewController* view_controller = context_->getViewManager()->getCurrent();
+  if (!view_controller)
+    return;
+
+  // decode the octrees again once the camera moved or turned noticeably
+  const Ogre::Camera* camera = view_controller->getCamera();
+  if (camera->getDerivedPosition().squaredDistance(view_position_) < VIEW_MOVE_THRESHOLD * VIEW_MOVE_THRESHOLD &&
+      view_orientation_.equals(camera->getDerivedOrientation(), Ogre::Degree(VIEW_TURN_THRESHOLD)))
+    return;
+
+  for (std::map<std::string, RenderedObjectPtr>::iterator it = rendered_objects_.begin();
+       it != rendered_objects_.end(); ++it)
+    updateOctrees(it->second);
 }
 }
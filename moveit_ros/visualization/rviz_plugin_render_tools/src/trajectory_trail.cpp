@@ -0,0 +1,232 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, MoveIt! contributors
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the names of the authors nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+#include <moveit/rviz_plugin_render_tools/trajectory_trail.h>
+#include <moveit/robot_state/robot_state_batch.h>
+#include <rviz/display_context.h>
+#include <rviz/robot/link_updater.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreStaticGeometry.h>
+#include <boost/lexical_cast.hpp>
+#include <limits>
+
+namespace moveit_rviz_plugin
+{
+namespace
+{
+// number of ghosts baked into one Ogre::StaticGeometry; also the granularity at which ghosts appear when animating
+const std::size_t GHOSTS_PER_SEGMENT = 16;
+
+// static geometry names have to be unique within the scene manager
+unsigned int trail_count = 0;
+
+/** \brief Update the links of an rviz::Robot from one state of a robot_state::RobotStateBatch */
+class BatchLinkUpdater : public rviz::LinkUpdater
+{
+public:
+  BatchLinkUpdater(const moveit::core::RobotStateBatch& batch, std::size_t index) : batch_(batch), index_(index)
+  {
+  }
+
+  virtual bool getLinkTransforms(const std::string& link_name, Ogre::Vector3& visual_position,
+                                 Ogre::Quaternion& visual_orientation, Ogre::Vector3& collision_position,
+                                 Ogre::Quaternion& collision_orientation) const
+  {
+    if (!batch_.getRobotModel()->hasLinkModel(link_name))
+      return false;
+
+    const Eigen::Affine3d& transform = batch_.getGlobalLinkTransform(index_, link_name);
+    const Eigen::Vector3d& position = transform.translation();
+    Eigen::Quaterniond orientation(transform.linear());
+    visual_position = Ogre::Vector3(position.x(), position.y(), position.z());
+    visual_orientation = Ogre::Quaternion(orientation.w(), orientation.x(), orientation.y(), orientation.z());
+    collision_position = visual_position;
+    collision_orientation = visual_orientation;
+    return true;
+  }
+
+private:
+  const moveit::core::RobotStateBatch& batch_;
+  std::size_t index_;
+};
+
+// check whether any of the links moved more than distance between the states a and b of the batch
+bool linksMoved(const moveit::core::RobotStateBatch& batch, const std::vector<const robot_model::LinkModel*>& links,
+                std::size_t a, std::size_t b, double distance)
+{
+  const double distance_sq = distance * distance;
+  for (std::size_t i = 0; i < links.size(); ++i)
+    if ((batch.getGlobalLinkTransform(a, links[i]).translation() -
+         batch.getGlobalLinkTransform(b, links[i]).translation())
+            .squaredNorm() > distance_sq)
+      return true;
+  return false;
+}
+}
+
+TrajectoryTrail::TrajectoryTrail(Ogre::SceneNode* root_node, rviz::DisplayContext* context, const std::string& name)
+  : root_node_(root_node)
+  , context_(context)
+  , name_(name + " " + boost::lexical_cast<std::string>(trail_count++))
+  , robot_(root_node, context, name_, NULL)
+  , ghost_count_(0)
+  , visible_(true)
+  , shown_until_(std::numeric_limits<int>::max())
+{
+  robot_.setVisible(false);
+}
+
+TrajectoryTrail::~TrajectoryTrail()
+{
+  clear();
+}
+
+void TrajectoryTrail::load(const urdf::ModelInterface& descr)
+{
+  clear();
+  robot_.load(descr);
+  robot_.setVisible(false);
+}
+
+void TrajectoryTrail::build(const robot_trajectory::RobotTrajectory& trajectory, std::size_t step_size,
+                            std::size_t max_ghosts, double min_distance, bool visual, bool collision)
+{
+  clear();
+  if (trajectory.empty() || (!visual && !collision))
+    return;
+  if (step_size < 1)
+    step_size = 1;
+
+  // candidate waypoints, always including the last one
+  const std::size_t waypoint_count = trajectory.getWayPointCount();
+  std::vector<std::size_t> waypoints;
+  for (std::size_t i = 0; i < waypoint_count; i += step_size)
+    waypoints.push_back(i);
+  if (waypoints.back() != waypoint_count - 1)
+    waypoints.push_back(waypoint_count - 1);
+
+  // link poses of all candidates at once
+  moveit::core::RobotStateBatch batch(trajectory.getRobotModel(), waypoints.size());
+  for (std::size_t i = 0; i < waypoints.size(); ++i)
+    batch.setVariablePositions(i, trajectory.getWayPoint(waypoints[i]));
+  batch.updateLinkTransforms();
+
+  // drop ghosts that would hardly differ from the previous one, but keep the last
+  std::vector<std::size_t> ghosts(1, 0);
+  const std::vector<const robot_model::LinkModel*>& links =
+      trajectory.getRobotModel()->getLinkModelsWithCollisionGeometry();
+  for (std::size_t i = 1; i < waypoints.size(); ++i)
+    if (min_distance <= 0.0 || i + 1 == waypoints.size() || linksMoved(batch, links, ghosts.back(), i, min_distance))
+      ghosts.push_back(i);
+
+  // thin out evenly, keeping the first and the last ghost
+  if (max_ghosts > 0 && ghosts.size() > max_ghosts)
+  {
+    std::vector<std::size_t> thinned;
+    if (max_ghosts == 1)
+      thinned.push_back(ghosts.back());
+    else
+      for (std::size_t k = 0; k < max_ghosts; ++k)
+        thinned.push_back(ghosts[k * (ghosts.size() - 1) / (max_ghosts - 1)]);
+    ghosts.swap(thinned);
+  }
+
+  // bake the template robot at each ghost's pose
+  Ogre::SceneManager* scene_manager = context_->getSceneManager();
+  robot_.setVisible(true);
+  robot_.setVisualVisible(visual);
+  robot_.setCollisionVisible(collision);
+  for (std::size_t k = 0; k < ghosts.size(); ++k)
+  {
+    if (k % GHOSTS_PER_SEGMENT == 0)
+    {
+      Segment segment;
+      segment.geometry_ = scene_manager->createStaticGeometry(
+          name_ + " Segment " + boost::lexical_cast<std::string>(segments_.size()));
+      segment.geometry_->setCastShadows(false);
+      segment.first_waypoint_ = waypoints[ghosts[k]];
+      segments_.push_back(segment);
+    }
+
+    robot_.update(BatchLinkUpdater(batch, ghosts[k]));
+    if (visual)
+      segments_.back().geometry_->addSceneNode(robot_.getVisualNode());
+    if (collision)
+      segments_.back().geometry_->addSceneNode(robot_.getCollisionNode());
+  }
+  robot_.setVisible(false);
+
+  for (std::size_t i = 0; i < segments_.size(); ++i)
+    segments_[i].geometry_->build();
+  ghost_count_ = ghosts.size();
+
+  root_position_ = root_node_->_getDerivedPosition();
+  root_orientation_ = root_node_->_getDerivedOrientation();
+  updateVisibility();
+}
+
+void TrajectoryTrail::clear()
+{
+  Ogre::SceneManager* scene_manager = context_->getSceneManager();
+  for (std::size_t i = 0; i < segments_.size(); ++i)
+    scene_manager->destroyStaticGeometry(segments_[i].geometry_);
+  segments_.clear();
+  ghost_count_ = 0;
+}
+
+void TrajectoryTrail::setVisible(bool visible)
+{
+  visible_ = visible;
+  updateVisibility();
+}
+
+void TrajectoryTrail::showUntil(int waypoint)
+{
+  shown_until_ = waypoint;
+  updateVisibility();
+}
+
+bool TrajectoryTrail::isOutdated() const
+{
+  return !segments_.empty() && (!root_position_.positionEquals(root_node_->_getDerivedPosition()) ||
+                                !root_orientation_.equals(root_node_->_getDerivedOrientation(), Ogre::Radian(1e-4)));
+}
+
+void TrajectoryTrail::updateVisibility()
+{
+  for (std::size_t i = 0; i < segments_.size(); ++i)
+    segments_[i].geometry_->setVisible(visible_ && static_cast<int>(segments_[i].first_waypoint_) <= shown_until_);
+}
+}
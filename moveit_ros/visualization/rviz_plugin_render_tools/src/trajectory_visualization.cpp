@@ -56,6 +56,8 @@
 #include <rviz/display_context.h>
 #include <rviz/window_manager_interface.h>
 
+#include <limits>
+
 namespace moveit_rviz_plugin
 {
 TrajectoryVisualization::TrajectoryVisualization(rviz::Property* widget, rviz::Display* display)
@@ -109,6 +111,18 @@ TrajectoryVisualization::TrajectoryVisualization(rviz::Property* widget, rviz::D
                                                     widget, SLOT(changedTrailStepSize()), this);
   trail_step_size_property_->setMin(1);
 
+  trail_max_ghosts_property_ =
+      new rviz::IntProperty("Trail Max Ghosts", 0, "Maximum number of robots shown in the trajectory trail. If the "
+                                                   "trail is longer, it is thinned out evenly (0 for no limit).",
+                            widget, SLOT(changedTrailStepSize()), this);
+  trail_max_ghosts_property_->setMin(0);
+
+  trail_min_distance_property_ =
+      new rviz::FloatProperty("Trail Min Distance", 0.0f, "Samples of the trajectory trail at which no link moved "
+                                                          "farther than this distance (m) are skipped.",
+                              widget, SLOT(changedTrailStepSize()), this);
+  trail_min_distance_property_->setMin(0.0);
+
   interrupt_display_property_ = new rviz::BoolProperty(
       "Interrupt Display", false,
       "Immediately show newly planned trajectory, interrupting the currently displayed one.", widget);
@@ -126,6 +140,7 @@ TrajectoryVisualization::~TrajectoryVisualization()
   trajectory_message_to_display_.reset();
   displaying_trajectory_message_.reset();
 
+  trajectory_trail_.reset();
   display_path_robot_.reset();
   if (trajectory_slider_dock_panel_)
     delete trajectory_slider_dock_panel_;
@@ -145,6 +160,8 @@ void TrajectoryVisualization::onInitialize(Ogre::SceneNode* scene_node, rviz::Di
   display_path_robot_->setCollisionVisible(display_path_collision_enabled_property_->getBool());
   display_path_robot_->setVisible(false);
 
+  trajectory_trail_.reset(new TrajectoryTrail(scene_node_, context_, "Trail Robot"));
+
   rviz::WindowManagerInterface* window_context = context_->getWindowManager();
   if (window_context)
   {
@@ -181,6 +198,7 @@ void TrajectoryVisualization::onRobotModelLoaded(robot_model::RobotModelConstPtr
 
   // Load rviz robot
   display_path_robot_->load(*robot_model_->getURDF());
+  trajectory_trail_->load(*robot_model_->getURDF());
   enabledRobotColor();  // force-refresh to account for saved display configuration
 }
 
@@ -198,9 +216,8 @@ void TrajectoryVisualization::reset()
 
 void TrajectoryVisualization::clearTrajectoryTrail()
 {
-  for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-    delete trajectory_trail_[i];
-  trajectory_trail_.clear();
+  if (trajectory_trail_)
+    trajectory_trail_->clear();
 }
 
 void TrajectoryVisualization::changedLoopDisplay()
@@ -214,7 +231,7 @@ void TrajectoryVisualization::changedShowTrail()
 {
   clearTrajectoryTrail();
 
-  if (!trail_display_property_->getBool())
+  if (!trajectory_trail_ || !trail_display_property_->getBool())
     return;
   robot_trajectory::RobotTrajectoryPtr t = trajectory_message_to_display_;
   if (!t)
@@ -222,23 +239,19 @@ void TrajectoryVisualization::changedShowTrail()
   if (!t)
     return;
 
-  int stepsize = trail_step_size_property_->getInt();
-  // always include last trajectory point
-  trajectory_trail_.resize((int)std::ceil((t->getWayPointCount() + stepsize - 1) / (float)stepsize));
-  for (std::size_t i = 0; i < trajectory_trail_.size(); i++)
-  {
-    int waypoint_i = std::min(i * stepsize, t->getWayPointCount() - 1);  // limit to last trajectory point
-    rviz::Robot* r = new rviz::Robot(scene_node_, context_, "Trail Robot " + boost::lexical_cast<std::string>(i), NULL);
-    r->load(*robot_model_->getURDF());
-    r->setVisualVisible(display_path_visual_enabled_property_->getBool());
-    r->setCollisionVisible(display_path_collision_enabled_property_->getBool());
-    r->setAlpha(robot_path_alpha_property_->getFloat());
-    r->update(PlanningLinkUpdater(t->getWayPointPtr(waypoint_i)));
-    if (enable_robot_color_property_->getBool())
-      setRobotColor(r, robot_color_property_->getColor());
-    r->setVisible(display_->isEnabled() && (!animating_path_ || waypoint_i <= current_state_));
-    trajectory_trail_[i] = r;
-  }
+  // the ghosts are baked with the appearance the template robot has at this point
+  rviz::Robot& r = trajectory_trail_->getRobot();
+  r.setAlpha(robot_path_alpha_property_->getFloat());
+  if (enable_robot_color_property_->getBool())
+    setRobotColor(&r, robot_color_property_->getColor());
+  else
+    unsetRobotColor(&r);
+
+  trajectory_trail_->build(*t, trail_step_size_property_->getInt(), trail_max_ghosts_property_->getInt(),
+                           trail_min_distance_property_->getFloat(), display_path_visual_enabled_property_->getBool(),
+                           display_path_collision_enabled_property_->getBool());
+  trajectory_trail_->showUntil(animating_path_ ? current_state_ : std::numeric_limits<int>::max());
+  trajectory_trail_->setVisible(display_->isEnabled());
 }
 
 void TrajectoryVisualization::changedTrailStepSize()
@@ -250,8 +263,8 @@ void TrajectoryVisualization::changedTrailStepSize()
 void TrajectoryVisualization::changedRobotPathAlpha()
 {
   display_path_robot_->setAlpha(robot_path_alpha_property_->getFloat());
-  for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-    trajectory_trail_[i]->setAlpha(robot_path_alpha_property_->getFloat());
+  if (trail_display_property_->getBool())
+    changedShowTrail();
 }
 
 void TrajectoryVisualization::changedTrajectoryTopic()
@@ -270,8 +283,8 @@ void TrajectoryVisualization::changedDisplayPathVisualEnabled()
   {
     display_path_robot_->setVisualVisible(display_path_visual_enabled_property_->getBool());
     display_path_robot_->setVisible(display_->isEnabled() && displaying_trajectory_message_ && animating_path_);
-    for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-      trajectory_trail_[i]->setVisualVisible(display_path_visual_enabled_property_->getBool());
+    if (trail_display_property_->getBool())
+      changedShowTrail();
   }
 }
 
@@ -285,8 +298,8 @@ void TrajectoryVisualization::changedDisplayPathCollisionEnabled()
   {
     display_path_robot_->setCollisionVisible(display_path_collision_enabled_property_->getBool());
     display_path_robot_->setVisible(display_->isEnabled() && displaying_trajectory_message_ && animating_path_);
-    for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-      trajectory_trail_[i]->setCollisionVisible(display_path_collision_enabled_property_->getBool());
+    if (trail_display_property_->getBool())
+      changedShowTrail();
   }
 }
 
@@ -297,12 +310,7 @@ void TrajectoryVisualization::onEnable()
   display_path_robot_->setVisualVisible(display_path_visual_enabled_property_->getBool());
   display_path_robot_->setCollisionVisible(display_path_collision_enabled_property_->getBool());
   display_path_robot_->setVisible(displaying_trajectory_message_ && animating_path_);
-  for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-  {
-    trajectory_trail_[i]->setVisualVisible(display_path_visual_enabled_property_->getBool());
-    trajectory_trail_[i]->setCollisionVisible(display_path_collision_enabled_property_->getBool());
-    trajectory_trail_[i]->setVisible(true);
-  }
+  trajectory_trail_->setVisible(true);
 
   changedTrajectoryTopic();  // load topic at startup if default used
 }
@@ -310,8 +318,7 @@ void TrajectoryVisualization::onEnable()
 void TrajectoryVisualization::onDisable()
 {
   display_path_robot_->setVisible(false);
-  for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-    trajectory_trail_[i]->setVisible(false);
+  trajectory_trail_->setVisible(false);
   displaying_trajectory_message_.reset();
   animating_path_ = false;
   if (trajectory_slider_panel_)
@@ -356,6 +363,10 @@ void TrajectoryVisualization::dropTrajectory()
 
 void TrajectoryVisualization::update(float wall_dt, float ros_dt)
 {
+  // the trail is baked in world coordinates and needs rebuilding when the display's frame moves
+  if (trajectory_trail_->isOutdated())
+    changedShowTrail();
+
   if (drop_displaying_trajectory_)
   {
     animating_path_ = false;
@@ -438,9 +449,7 @@ void TrajectoryVisualization::update(float wall_dt, float ros_dt)
       if (trajectory_slider_panel_)
         trajectory_slider_panel_->setSliderPosition(current_state_);
       display_path_robot_->update(displaying_trajectory_message_->getWayPointPtr(current_state_));
-      for (std::size_t i = 0; i < trajectory_trail_.size(); ++i)
-        trajectory_trail_[i]->setVisible(
-            std::min(waypoint_count - 1, static_cast<int>(i) * trail_step_size_property_->getInt()) <= current_state_);
+      trajectory_trail_->showUntil(current_state_);
     }
     else
     {
@@ -498,7 +507,11 @@ void TrajectoryVisualization::incomingDisplayTrajectory(const moveit_msgs::Displ
 void TrajectoryVisualization::changedRobotColor()
 {
   if (enable_robot_color_property_->getBool())
+  {
     setRobotColor(&(display_path_robot_->getRobot()), robot_color_property_->getColor());
+    if (trail_display_property_->getBool())
+      changedShowTrail();
+  }
 }
 
 void TrajectoryVisualization::enabledRobotColor()
@@ -507,6 +520,8 @@ void TrajectoryVisualization::enabledRobotColor()
     setRobotColor(&(display_path_robot_->getRobot()), robot_color_property_->getColor());
   else
     unsetRobotColor(&(display_path_robot_->getRobot()));
+  if (trail_display_property_->getBool())
+    changedShowTrail();
 }
 
 void TrajectoryVisualization::unsetRobotColor(rviz::Robot* robot)
@@ -60,11 +60,26 @@ protected:
   /// Keep only the \e names that match \e regex
   void filterNames(const std::string& regex, std::vector<std::string>& names) const;
 
+  /// Check if any message of \e collection matches \e query. Only the metadata of the first match is fetched.
+  template <typename CollectionPtr>
+  static bool hasMatchingMessage(const CollectionPtr& collection, const warehouse_ros::Query::ConstPtr& query)
+  {
+    auto results = collection->queryResults(query, true);
+    return results.first != results.second;
+  }
+
   warehouse_ros::DatabaseConnection::Ptr conn_;
 };
 
 /// \brief Load a database connection
 typename warehouse_ros::DatabaseConnection::Ptr loadDatabase();
+
+/// \brief Get a connection to the database at \e host:\e port, connecting if needed. The connection is shared with
+/// all other callers in this process that ask for the same database while it is in use, so loading many storages
+/// (or loading them repeatedly) does not reconnect every time. Returns an empty pointer if connecting fails.
+/// A connection is not synchronized: callers must not use it from several threads at once.
+typename warehouse_ros::DatabaseConnection::Ptr getSharedDatabaseConnection(const std::string& host, unsigned int port,
+                                                                           float timeout = 60.0);
 }
 
 #endif
@@ -42,6 +42,7 @@
 #include <moveit_msgs/PlanningScene.h>
 #include <moveit_msgs/MotionPlanRequest.h>
 #include <moveit_msgs/RobotTrajectory.h>
+#include <set>
 
 namespace moveit_warehouse
 {
@@ -62,12 +63,18 @@ public:
 
   static const std::string PLANNING_SCENE_ID_NAME;
   static const std::string MOTION_PLAN_REQUEST_ID_NAME;
+  static const std::string MOTION_PLAN_REQUEST_HASH_NAME;
 
   PlanningSceneStorage(warehouse_ros::DatabaseConnection::Ptr conn);
 
   void addPlanningScene(const moveit_msgs::PlanningScene& scene);
   void addPlanningQuery(const moveit_msgs::MotionPlanRequest& planning_query, const std::string& scene_name,
                         const std::string& query_name = "");
+  /** \brief Add many planning queries for \e scene_name at once, with the semantics of addPlanningQuery() for each.
+      \e query_names may be empty or hold one name per query; empty names are filled in with the generated ones.
+      The existing queries of the scene are listed only once for the whole batch. */
+  void addPlanningQueries(const std::vector<moveit_msgs::MotionPlanRequest>& planning_queries,
+                          const std::string& scene_name, std::vector<std::string>& query_names);
   void addPlanningResult(const moveit_msgs::MotionPlanRequest& planning_query,
                          const moveit_msgs::RobotTrajectory& result, const std::string& scene_name);
 
@@ -110,14 +117,31 @@ public:
 private:
   void createCollections();
 
+  /** \brief Serialize \e planning_query into \e buffer and return a hash of the serialized data */
+  static std::string serializeMotionPlanRequest(const moveit_msgs::MotionPlanRequest& planning_query,
+                                                std::vector<uint8_t>& buffer);
+
   std::string getMotionPlanRequestName(const moveit_msgs::MotionPlanRequest& planning_query,
                                        const std::string& scene_name) const;
+  std::string getMotionPlanRequestName(const std::vector<uint8_t>& buffer, const std::string& hash,
+                                       const std::string& scene_name) const;
   std::string addNewPlanningRequest(const moveit_msgs::MotionPlanRequest& planning_query, const std::string& scene_name,
                                     const std::string& query_name);
+  void insertPlanningRequest(const moveit_msgs::MotionPlanRequest& planning_query, const std::string& scene_name,
+                             const std::string& query_name, const std::string& hash);
+
+  /** \brief Store the hash of the requests of \e scene_name that were saved before hashes were introduced */
+  void addMissingRequestHashes(const std::string& scene_name) const;
+
+  /** \brief Generate a name not in \e used, starting the search at \e index */
+  static std::string generateQueryName(const std::set<std::string>& used, std::size_t& index);
 
   PlanningSceneCollection planning_scene_collection_;
   MotionPlanRequestCollection motion_plan_request_collection_;
   RobotTrajectoryCollection robot_trajectory_collection_;
+
+  /// The scenes for which all stored requests are known to have a hash
+  mutable std::set<std::string> hashed_scenes_;
 };
 }
 
@@ -89,8 +89,7 @@ bool moveit_warehouse::ConstraintsStorage::hasConstraints(const std::string& nam
     q->append(ROBOT_NAME, robot);
   if (!group.empty())
     q->append(CONSTRAINTS_GROUP_NAME, group);
-  std::vector<ConstraintsWithMetadata> constr = constraints_collection_->queryList(q, true);
-  return !constr.empty();
+  return hasMatchingMessage(constraints_collection_, q);
 }
 
 void moveit_warehouse::ConstraintsStorage::getKnownConstraints(const std::string& regex,
@@ -38,7 +38,11 @@
 #include <warehouse_ros/database_loader.h>
 //#include <warehouse_ros_mongo/database_connection.h>
 #include <boost/regex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/lexical_cast.hpp>
 #include <memory>
+#include <map>
 
 moveit_warehouse::MoveItMessageStorage::MoveItMessageStorage(warehouse_ros::DatabaseConnection::Ptr conn) : conn_(conn)
 {
@@ -72,3 +76,26 @@ typename warehouse_ros::DatabaseConnection::Ptr moveit_warehouse::loadDatabase()
   return dbloader->loadDatabase();
   // return typename warehouse_ros::DatabaseConnection::Ptr(new warehouse_ros_mongo::MongoDatabaseConnection());
 }
+
+typename warehouse_ros::DatabaseConnection::Ptr
+moveit_warehouse::getSharedDatabaseConnection(const std::string& host, unsigned int port, float timeout)
+{
+  static boost::mutex lock;
+  static std::map<std::string, boost::weak_ptr<warehouse_ros::DatabaseConnection> > connections;
+
+  const std::string key = host + ":" + boost::lexical_cast<std::string>(port);
+  boost::mutex::scoped_lock slock(lock);
+  warehouse_ros::DatabaseConnection::Ptr conn = connections[key].lock();
+  if (conn && conn->isConnected())
+    return conn;
+
+  conn = loadDatabase();
+  conn->setParams(host, port, timeout);
+  if (!conn->connect())
+  {
+    connections.erase(key);
+    return warehouse_ros::DatabaseConnection::Ptr();
+  }
+  connections[key] = conn;
+  return conn;
+}
@@ -36,11 +36,14 @@
 
 #include <moveit/warehouse/planning_scene_storage.h>
 #include <boost/regex.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cstdio>
 
 const std::string moveit_warehouse::PlanningSceneStorage::DATABASE_NAME = "moveit_planning_scenes";
 
 const std::string moveit_warehouse::PlanningSceneStorage::PLANNING_SCENE_ID_NAME = "planning_scene_id";
 const std::string moveit_warehouse::PlanningSceneStorage::MOTION_PLAN_REQUEST_ID_NAME = "motion_request_id";
+const std::string moveit_warehouse::PlanningSceneStorage::MOTION_PLAN_REQUEST_HASH_NAME = "motion_request_hash";
 
 using warehouse_ros::Metadata;
 using warehouse_ros::Query;
@@ -65,6 +68,7 @@ void moveit_warehouse::PlanningSceneStorage::reset()
   planning_scene_collection_.reset();
   motion_plan_request_collection_.reset();
   robot_trajectory_collection_.reset();
+  hashed_scenes_.clear();
   conn_->dropDatabase(DATABASE_NAME);
   createCollections();
 }
@@ -87,46 +91,83 @@ bool moveit_warehouse::PlanningSceneStorage::hasPlanningScene(const std::string&
 {
   Query::Ptr q = planning_scene_collection_->createQuery();
   q->append(PLANNING_SCENE_ID_NAME, name);
-  std::vector<PlanningSceneWithMetadata> planning_scenes = planning_scene_collection_->queryList(q, true);
-  return !planning_scenes.empty();
+  return hasMatchingMessage(planning_scene_collection_, q);
+}
+
+std::string moveit_warehouse::PlanningSceneStorage::serializeMotionPlanRequest(
+    const moveit_msgs::MotionPlanRequest& planning_query, std::vector<uint8_t>& buffer)
+{
+  buffer.resize(ros::serialization::serializationLength(planning_query));
+  ros::serialization::OStream stream(buffer.data(), buffer.size());
+  ros::serialization::serialize(stream, planning_query);
+
+  // 64 bit FNV-1a; this only needs to be stable, equal hashes are confirmed by comparing the data
+  uint64_t hash = 14695981039346656037ULL;
+  for (std::size_t i = 0; i < buffer.size(); ++i)
+    hash = (hash ^ buffer[i]) * 1099511628211ULL;
+  char str[17];
+  snprintf(str, sizeof(str), "%016llx", (unsigned long long)hash);
+  return str;
 }
 
 std::string moveit_warehouse::PlanningSceneStorage::getMotionPlanRequestName(
     const moveit_msgs::MotionPlanRequest& planning_query, const std::string& scene_name) const
 {
-  // get all existing motion planning requests for this planning scene
+  std::vector<uint8_t> buffer;
+  std::string hash = serializeMotionPlanRequest(planning_query, buffer);
+  return getMotionPlanRequestName(buffer, hash, scene_name);
+}
+
+std::string moveit_warehouse::PlanningSceneStorage::getMotionPlanRequestName(const std::vector<uint8_t>& buffer,
+                                                                             const std::string& hash,
+                                                                             const std::string& scene_name) const
+{
+  addMissingRequestHashes(scene_name);
+
+  // only requests with the same hash can be equal, so only those are fetched and compared
   Query::Ptr q = motion_plan_request_collection_->createQuery();
   q->append(PLANNING_SCENE_ID_NAME, scene_name);
+  q->append(MOTION_PLAN_REQUEST_HASH_NAME, hash);
   std::vector<MotionPlanRequestWithMetadata> existing_requests = motion_plan_request_collection_->queryList(q, false);
 
-  // if there are no requests stored, we are done
-  if (existing_requests.empty())
-    return "";
-
-  // compute the serialization of the message passed as argument
-  const size_t serial_size_arg = ros::serialization::serializationLength(planning_query);
-  boost::shared_array<uint8_t> buffer_arg(new uint8_t[serial_size_arg]);
-  ros::serialization::OStream stream_arg(buffer_arg.get(), serial_size_arg);
-  ros::serialization::serialize(stream_arg, planning_query);
-  const void* data_arg = buffer_arg.get();
-
+  std::vector<uint8_t> existing_buffer;
   for (std::size_t i = 0; i < existing_requests.size(); ++i)
   {
-    const size_t serial_size = ros::serialization::serializationLength(
-        static_cast<const moveit_msgs::MotionPlanRequest&>(*existing_requests[i]));
-    if (serial_size != serial_size_arg)
-      continue;
-    boost::shared_array<uint8_t> buffer(new uint8_t[serial_size]);
-    ros::serialization::OStream stream(buffer.get(), serial_size);
-    ros::serialization::serialize(stream, static_cast<const moveit_msgs::MotionPlanRequest&>(*existing_requests[i]));
-    const void* data = buffer.get();
-    if (memcmp(data_arg, data, serial_size) == 0)
+    serializeMotionPlanRequest(*existing_requests[i], existing_buffer);
+    if (existing_buffer == buffer)
       // we found the same message twice
       return existing_requests[i]->lookupString(MOTION_PLAN_REQUEST_ID_NAME);
   }
   return "";
 }
 
+void moveit_warehouse::PlanningSceneStorage::addMissingRequestHashes(const std::string& scene_name) const
+{
+  if (hashed_scenes_.find(scene_name) != hashed_scenes_.end())
+    return;
+
+  Query::Ptr q = motion_plan_request_collection_->createQuery();
+  q->append(PLANNING_SCENE_ID_NAME, scene_name);
+  std::vector<MotionPlanRequestWithMetadata> requests = motion_plan_request_collection_->queryList(q, true);
+  std::vector<uint8_t> buffer;
+  for (std::size_t i = 0; i < requests.size(); ++i)
+  {
+    if (requests[i]->lookupField(MOTION_PLAN_REQUEST_HASH_NAME) ||
+        !requests[i]->lookupField(MOTION_PLAN_REQUEST_ID_NAME))
+      continue;
+    Query::Ptr qr = motion_plan_request_collection_->createQuery();
+    qr->append(PLANNING_SCENE_ID_NAME, scene_name);
+    qr->append(MOTION_PLAN_REQUEST_ID_NAME, requests[i]->lookupString(MOTION_PLAN_REQUEST_ID_NAME));
+    std::vector<MotionPlanRequestWithMetadata> request = motion_plan_request_collection_->queryList(qr, false);
+    if (request.empty())
+      continue;
+    Metadata::Ptr m = motion_plan_request_collection_->createMetadata();
+    m->append(MOTION_PLAN_REQUEST_HASH_NAME, serializeMotionPlanRequest(*request.front(), buffer));
+    motion_plan_request_collection_->modifyMetadata(qr, m);
+  }
+  hashed_scenes_.insert(scene_name);
+}
+
 void moveit_warehouse::PlanningSceneStorage::addPlanningQuery(const moveit_msgs::MotionPlanRequest& planning_query,
                                                               const std::string& scene_name,
                                                               const std::string& query_name)
@@ -141,31 +182,75 @@ void moveit_warehouse::PlanningSceneStorage::addPlanningQuery(const moveit_msgs:
     addNewPlanningRequest(planning_query, scene_name, query_name);
 }
 
+void moveit_warehouse::PlanningSceneStorage::addPlanningQueries(
+    const std::vector<moveit_msgs::MotionPlanRequest>& planning_queries, const std::string& scene_name,
+    std::vector<std::string>& query_names)
+{
+  query_names.resize(planning_queries.size());
+
+  std::vector<std::string> existing_names;
+  getPlanningQueriesNames(existing_names, scene_name);
+  std::set<std::string> used(existing_names.begin(), existing_names.end());
+  std::size_t index = existing_names.size();
+
+  std::vector<uint8_t> buffer;
+  for (std::size_t i = 0; i < planning_queries.size(); ++i)
+  {
+    std::string hash = serializeMotionPlanRequest(planning_queries[i], buffer);
+    std::string id = getMotionPlanRequestName(buffer, hash, scene_name);
+
+    // same as addPlanningQuery(), but names are only looked up in the database if they are known to exist
+    if (!query_names[i].empty() && id.empty() && used.find(query_names[i]) != used.end())
+      removePlanningQuery(scene_name, query_names[i]);
+    if (id == query_names[i] && !id.empty())
+      continue;
+    if (query_names[i].empty())
+      query_names[i] = generateQueryName(used, index);
+    insertPlanningRequest(planning_queries[i], scene_name, query_names[i], hash);
+    used.insert(query_names[i]);
+  }
+}
+
+std::string moveit_warehouse::PlanningSceneStorage::generateQueryName(const std::set<std::string>& used,
+                                                                      std::size_t& index)
+{
+  std::string id;
+  do
+  {
+    id = "Motion Plan Request " + boost::lexical_cast<std::string>(index);
+    index++;
+  } while (used.find(id) != used.end());
+  return id;
+}
+
 std::string moveit_warehouse::PlanningSceneStorage::addNewPlanningRequest(
     const moveit_msgs::MotionPlanRequest& planning_query, const std::string& scene_name, const std::string& query_name)
 {
   std::string id = query_name;
   if (id.empty())
   {
-    std::set<std::string> used;
-    Query::Ptr q = motion_plan_request_collection_->createQuery();
-    q->append(PLANNING_SCENE_ID_NAME, scene_name);
-    std::vector<MotionPlanRequestWithMetadata> existing_requests = motion_plan_request_collection_->queryList(q, true);
-    for (std::size_t i = 0; i < existing_requests.size(); ++i)
-      used.insert(existing_requests[i]->lookupString(MOTION_PLAN_REQUEST_ID_NAME));
-    std::size_t index = existing_requests.size();
-    do
-    {
-      id = "Motion Plan Request " + boost::lexical_cast<std::string>(index);
-      index++;
-    } while (used.find(id) != used.end());
+    std::vector<std::string> existing_names;
+    getPlanningQueriesNames(existing_names, scene_name);
+    std::set<std::string> used(existing_names.begin(), existing_names.end());
+    std::size_t index = existing_names.size();
+    id = generateQueryName(used, index);
   }
+  std::vector<uint8_t> buffer;
+  insertPlanningRequest(planning_query, scene_name, id, serializeMotionPlanRequest(planning_query, buffer));
+  return id;
+}
+
+void moveit_warehouse::PlanningSceneStorage::insertPlanningRequest(const moveit_msgs::MotionPlanRequest& planning_query,
+                                                                   const std::string& scene_name,
+                                                                   const std::string& query_name,
+                                                                   const std::string& hash)
+{
   Metadata::Ptr metadata = motion_plan_request_collection_->createMetadata();
   metadata->append(PLANNING_SCENE_ID_NAME, scene_name);
-  metadata->append(MOTION_PLAN_REQUEST_ID_NAME, id);
+  metadata->append(MOTION_PLAN_REQUEST_ID_NAME, query_name);
+  metadata->append(MOTION_PLAN_REQUEST_HASH_NAME, hash);
   motion_plan_request_collection_->insert(planning_query, metadata);
-  ROS_DEBUG("Saved planning query '%s' for scene '%s'", id.c_str(), scene_name.c_str());
-  return id;
+  ROS_DEBUG("Saved planning query '%s' for scene '%s'", query_name.c_str(), scene_name.c_str());
 }
 
 void moveit_warehouse::PlanningSceneStorage::addPlanningResult(const moveit_msgs::MotionPlanRequest& planning_query,
@@ -334,8 +419,7 @@ bool moveit_warehouse::PlanningSceneStorage::hasPlanningQuery(const std::string&
   Query::Ptr q = motion_plan_request_collection_->createQuery();
   q->append(PLANNING_SCENE_ID_NAME, scene_name);
   q->append(MOTION_PLAN_REQUEST_ID_NAME, query_name);
-  std::vector<MotionPlanRequestWithMetadata> queries = motion_plan_request_collection_->queryList(q, true);
-  return !queries.empty();
+  return hasMatchingMessage(motion_plan_request_collection_, q);
 }
 
 void moveit_warehouse::PlanningSceneStorage::renamePlanningScene(const std::string& old_scene_name,
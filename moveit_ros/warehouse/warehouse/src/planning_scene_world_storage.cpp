@@ -80,8 +80,7 @@ bool moveit_warehouse::PlanningSceneWorldStorage::hasPlanningSceneWorld(const st
 {
   Query::Ptr q = planning_scene_world_collection_->createQuery();
   q->append(PLANNING_SCENE_WORLD_ID_NAME, name);
-  std::vector<PlanningSceneWorldWithMetadata> psw = planning_scene_world_collection_->queryList(q, true);
-  return !psw.empty();
+  return hasMatchingMessage(planning_scene_world_collection_, q);
 }
 
 void moveit_warehouse::PlanningSceneWorldStorage::getKnownPlanningSceneWorlds(const std::string& regex,
@@ -84,8 +84,7 @@ bool moveit_warehouse::RobotStateStorage::hasRobotState(const std::string& name,
   q->append(STATE_NAME, name);
   if (!robot.empty())
     q->append(ROBOT_NAME, robot);
-  std::vector<RobotStateWithMetadata> constr = state_collection_->queryList(q, true);
-  return !constr.empty();
+  return hasMatchingMessage(state_collection_, q);
 }
 
 void moveit_warehouse::RobotStateStorage::getKnownRobotStates(const std::string& regex, std::vector<std::string>& names,
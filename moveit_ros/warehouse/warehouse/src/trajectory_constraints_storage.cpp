@@ -93,8 +93,7 @@ bool moveit_warehouse::TrajectoryConstraintsStorage::hasTrajectoryConstraints(co
     q->append(ROBOT_NAME, robot);
   if (!group.empty())
     q->append(CONSTRAINTS_GROUP_NAME, group);
-  std::vector<TrajectoryConstraintsWithMetadata> constr = constraints_collection_->queryList(q, true);
-  return !constr.empty();
+  return hasMatchingMessage(constraints_collection_, q);
 }
 
 void moveit_warehouse::TrajectoryConstraintsStorage::getKnownTrajectoryConstraints(const std::string& regex,
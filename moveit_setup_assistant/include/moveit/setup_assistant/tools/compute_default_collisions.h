@@ -71,6 +71,24 @@ struct LinkPairData
  */
 typedef std::map<std::pair<std::string, std::string>, LinkPairData> LinkPairMap;
 
+/**
+ * \brief LinkSignatureMap maps the name of a link to a hash of its collision geometry and of the joints from the root
+ * of the robot to the link. Two links whose signatures did not change can be in collision in the same states as before
+ */
+typedef std::map<std::string, std::string> LinkSignatureMap;
+
+/**
+ * \brief The results of a previous computation, so that only the link pairs involving changed links are resampled
+ */
+struct DefaultCollisionsCache
+{
+  /// Signatures of the links the results were computed for
+  LinkSignatureMap link_signatures;
+
+  /// The disabled link pairs; the pairs that are not listed were sometimes in collision
+  LinkPairMap link_pairs;
+};
+
 /**
  * \brief Generate an adjacency list of links that are always and never in collision, to speed up collision detection
  * \param parent_scene A reference to the robot in the planning scene
@@ -78,11 +96,24 @@ typedef std::map<std::pair<std::string, std::string>, LinkPairData> LinkPairMap;
  * \param trials Set the number random collision checks that are made. Increase the probability of correctness
  * \param min_collision_fraction If collisions are found between a pair of links >= this fraction, the are assumed
  * "always" in collision
+ * \param convergence_trials Stop the search for never colliding links early, once this many consecutive random
+ * trials did not reveal any new colliding pair. 0 always runs all trials
+ * \param cache If set, the pairs of links whose signatures match the cache keep their previous reason instead of
+ * being sampled again. Adjacent links and pairs disabled by the user are always computed again
  * \return Adj List of unique set of pairs of links in string-based form
  */
 LinkPairMap computeDefaultCollisions(const planning_scene::PlanningSceneConstPtr& parent_scene, unsigned int* progress,
                                      const bool include_never_colliding, const unsigned int trials,
-                                     const double min_collision_faction, const bool verbose);
+                                     const double min_collision_faction, const bool verbose,
+                                     const unsigned int convergence_trials = 0,
+                                     const DefaultCollisionsCache* cache = NULL);
+
+/**
+ * \brief Compute the signatures of all links with collision geometry
+ * \param robot_model The robot whose links are hashed
+ * \return The signature of each link with collision geometry
+ */
+LinkSignatureMap computeLinkSignatures(const robot_model::RobotModel& robot_model);
 
 /**
  * \brief Generate a list of unique link pairs for all links with geometry. Order pairs alphabetically. n choose 2 pairs
@@ -247,6 +247,9 @@ public:
   /// SRDF Data and Writer
   srdf::SRDFWriterPtr srdf_;
 
+  /// Signatures of the links the disabled collisions of the SRDF were computed for, empty if they are unknown
+  moveit_setup_assistant::LinkSignatureMap link_signatures_;
+
   // ******************************************************************************************
   // Other Data
   // ******************************************************************************************
@@ -326,6 +329,7 @@ public:
 
   bool outputROSControllersYAML(const std::string& file_path);
   bool output3DSensorPluginYAML(const std::string& file_path);
+  bool outputLinkSignaturesYAML(const std::string& file_path);
 
   /**
    * \brief Helper function to get the controller that is controlling the joint
@@ -347,6 +351,13 @@ public:
    */
   void setCollisionLinkPairs(const moveit_setup_assistant::LinkPairMap& link_pairs, size_t skip_mask = 0);
 
+  /**
+   * \brief Get the disabled collisions of the SRDF together with the link signatures they were computed for
+   * \param cache the previous results for computeDefaultCollisions()
+   * \return false if the link signatures are unknown, so nothing can be reused
+   */
+  bool getDefaultCollisionsCache(moveit_setup_assistant::DefaultCollisionsCache& cache) const;
+
   /**
    * \brief Decide the best two joints to be used for the projection evaluator
    * \param planning_group name of group to use
@@ -432,6 +443,14 @@ public:
    */
   bool input3DSensorsYAML(const std::string& default_file_path, const std::string& file_path = "");
 
+  /**
+   * Input link_signatures.yaml file - contains the signatures of the links the disabled collisions were computed for
+   *
+   * @param file_path path to link_signatures.yaml in the config package
+   * @return true if the file was read correctly
+   */
+  bool inputLinkSignaturesYAML(const std::string& file_path);
+
   /**
    * Helper Function for joining a file path and a file name, or two file paths, etc,
    * in a cross-platform way
@@ -71,7 +71,7 @@ bool loadSetupAssistantConfig(moveit_setup_assistant::MoveItConfigData& config_d
 }
 
 bool setup(moveit_setup_assistant::MoveItConfigData& config_data, bool keep_old,
-           const std::vector<std::string>& xacro_args)
+           const std::vector<std::string>& xacro_args, moveit_setup_assistant::DefaultCollisionsCache* cache)
 {
   std::string urdf_string;
   if (!rdf_loader::RDFLoader::loadXmlFileToString(urdf_string, config_data.urdf_path_, xacro_args))
@@ -97,6 +97,10 @@ bool setup(moveit_setup_assistant::MoveItConfigData& config_data, bool keep_old,
     return false;
   }
 
+  // the previous results are taken from the SRDF before it is cleared
+  if (cache && !config_data.getDefaultCollisionsCache(*cache))
+    ROS_WARN_STREAM("No link signatures loaded, all link pairs are sampled");
+
   if (!keep_old)
     config_data.srdf_->disabled_collisions_.clear();
 
@@ -104,12 +108,14 @@ bool setup(moveit_setup_assistant::MoveItConfigData& config_data, bool keep_old,
 }
 
 moveit_setup_assistant::LinkPairMap compute(moveit_setup_assistant::MoveItConfigData& config_data, uint32_t trials,
-                                            double min_collision_fraction, bool verbose)
+                                            double min_collision_fraction, bool verbose, uint32_t convergence_trials,
+                                            const moveit_setup_assistant::DefaultCollisionsCache* cache)
 {
   // TODO: spin thread and print progess if verbose
   unsigned int collision_progress;
-  return moveit_setup_assistant::computeDefaultCollisions(config_data.getPlanningScene(), &collision_progress,
-                                                          trials > 0, trials, min_collision_fraction, verbose);
+  return moveit_setup_assistant::computeDefaultCollisions(
+      config_data.getPlanningScene(), &collision_progress, trials > 0, trials, min_collision_fraction, verbose,
+      convergence_trials, cache && !cache->link_signatures.empty() ? cache : NULL);
 }
 
 int main(int argc, char* argv[])
@@ -119,12 +125,14 @@ int main(int argc, char* argv[])
   std::string srdf_path;
 
   std::string output_path;
+  std::string link_signatures_path;
 
-  bool include_default = false, include_always = false, keep_old = false, verbose = false;
+  bool include_default = false, include_always = false, keep_old = false, verbose = false, reuse = false;
 
   double min_collision_fraction = 1.0;
 
   uint32_t never_trials = 0;
+  uint32_t convergence_trials = 0;
 
   po::options_description desc("Allowed options");
   desc.add_options()("help", "show help")("config-pkg", po::value(&config_pkg_path), "path to moveit config package")(
@@ -142,7 +150,13 @@ int main(int argc, char* argv[])
 
                   ("trials", po::value(&never_trials), "number of trials for searching never colliding pairs")(
                       "min-collision-fraction", po::value(&min_collision_fraction),
-                      "fraction of small sample size to determine links that are alwas colliding");
+                      "fraction of small sample size to determine links that are alwas colliding")(
+                      "convergence-trials", po::value(&convergence_trials),
+                      "stop searching never colliding pairs after this many trials without a new colliding pair")(
+                      "link-signatures", po::value(&link_signatures_path),
+                      "path to the link signatures of the SRDF, defaults to config/link_signatures.yaml of the config "
+                      "package")("reuse", po::bool_switch(&reuse),
+                                 "only sample the link pairs of links that changed since the signatures were written");
 
   po::positional_options_description pos_desc;
   pos_desc.add("xacro-args", -1);
@@ -184,17 +198,24 @@ int main(int argc, char* argv[])
   if (!srdf_path.empty())
     config_data.srdf_path_ = srdf_path;
 
+  if (link_signatures_path.empty() && !config_pkg_path.empty())
+    link_signatures_path = config_data.appendPaths(config_pkg_path, "config/link_signatures.yaml");
+  if (reuse && !link_signatures_path.empty())
+    config_data.inputLinkSignaturesYAML(link_signatures_path);
+
   std::vector<std::string> xacro_args;
   if (vm.count("xacro-args"))
     xacro_args = vm["xacro-args"].as<std::vector<std::string> >();
 
-  if (!setup(config_data, keep_old, xacro_args))
+  moveit_setup_assistant::DefaultCollisionsCache cache;
+  if (!setup(config_data, keep_old, xacro_args, reuse ? &cache : NULL))
   {
     ROS_ERROR_STREAM("Could not setup updater");
     return 1;
   }
 
-  moveit_setup_assistant::LinkPairMap link_pairs = compute(config_data, never_trials, min_collision_fraction, verbose);
+  moveit_setup_assistant::LinkPairMap link_pairs =
+      compute(config_data, never_trials, min_collision_fraction, verbose, convergence_trials, reuse ? &cache : NULL);
 
   size_t skip_mask = 0;
   if (!include_default)
@@ -206,5 +227,17 @@ int main(int argc, char* argv[])
 
   config_data.srdf_->writeSRDF(output_path.empty() ? config_data.srdf_path_ : output_path);
 
+  // the signatures describe the SRDF only if it lists the pairs of every reason
+  if (!link_signatures_path.empty() && (reuse || vm.count("link-signatures")))
+  {
+    if (skip_mask == 0 && never_trials > 0)
+    {
+      config_data.link_signatures_ = moveit_setup_assistant::computeLinkSignatures(*config_data.getRobotModel());
+      config_data.outputLinkSignaturesYAML(link_signatures_path);
+    }
+    else
+      ROS_INFO_STREAM("Link signatures are only written with --default, --always and --trials");
+  }
+
   return 0;
 }
@@ -35,12 +35,18 @@
 /* Author: Dave Coleman */
 
 #include <moveit/setup_assistant/tools/compute_default_collisions.h>
+#include <moveit/robot_model/revolute_joint_model.h>
+#include <moveit/robot_model/prismatic_joint_model.h>
+#include <geometric_shapes/shapes.h>
 #include <boost/math/special_functions/binomial.hpp>  // for statistics at end
 #include <boost/thread.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/assign.hpp>
 #include <ros/console.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 
 namespace moveit_setup_assistant
 {
@@ -58,33 +64,93 @@ const boost::unordered_map<std::string, DisabledReason> reasonsFromString = boos
 // Unique set of pairs of links in string-based form
 typedef std::set<std::pair<std::string, std::string> > StringPairSet;
 
+// Index of the link pairs that are still candidates for being "never" in collision
+typedef std::map<std::pair<std::string, std::string>, std::size_t> LinkPairIndex;
+
+// Trial counters shared by all threads searching for never colliding links
+struct TrialStatistics
+{
+  TrialStatistics() : trials_done_(0), last_discovery_(0)
+  {
+  }
+  std::atomic<unsigned int> trials_done_;
+  std::atomic<unsigned int> last_discovery_;  // value of trials_done_ when a thread last saw a new colliding pair
+};
+
 // Struct for passing parameters to threads, for cleaner code
 struct ThreadComputation
 {
-  ThreadComputation(planning_scene::PlanningScene& scene, const collision_detection::CollisionRequest& req,
-                    int thread_id, int num_trials, StringPairSet* links_seen_colliding, boost::mutex* lock,
-                    unsigned int* progress)
+  ThreadComputation(const planning_scene::PlanningScene& scene, const collision_detection::CollisionRequest& req,
+                    int thread_id, int num_trials, const LinkPairIndex* pair_index, std::vector<char>* seen_colliding,
+                    TrialStatistics* statistics, unsigned int convergence_trials, unsigned int* progress)
     : scene_(scene)
     , req_(req)
     , thread_id_(thread_id)
     , num_trials_(num_trials)
-    , links_seen_colliding_(links_seen_colliding)
-    , lock_(lock)
+    , pair_index_(pair_index)
+    , seen_colliding_(seen_colliding)
+    , statistics_(statistics)
+    , convergence_trials_(convergence_trials)
     , progress_(progress)
   {
   }
-  planning_scene::PlanningScene& scene_;
+  const planning_scene::PlanningScene& scene_;
   const collision_detection::CollisionRequest& req_;
   int thread_id_;
   unsigned int num_trials_;
-  StringPairSet* links_seen_colliding_;
-  boost::mutex* lock_;
+  const LinkPairIndex* pair_index_;    // shared, read-only
+  std::vector<char>* seen_colliding_;  // owned by this thread, one flag per entry of pair_index_
+  TrialStatistics* statistics_;
+  unsigned int convergence_trials_;
   unsigned int* progress_;  // only to be updated by thread 0
 };
 
 // LinkGraph defines a Link's model and a set of unique links it connects
 typedef std::map<const robot_model::LinkModel*, std::set<const robot_model::LinkModel*> > LinkGraph;
 
+// 64 bit FNV-1a hash, which is the same on every run so that signatures can be stored
+class SignatureHash
+{
+public:
+  SignatureHash() : hash_(14695981039346656037ULL)
+  {
+  }
+
+  void add(const void* data, std::size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i)
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+  }
+
+  template <typename T>
+  void add(const T& value)
+  {
+    add(&value, sizeof(value));
+  }
+
+  void add(const std::string& value)
+  {
+    add(value.data(), value.size());
+    add(value.size());
+  }
+
+  void add(const Eigen::Affine3d& transform)
+  {
+    add(transform.matrix().data(), 16 * sizeof(double));
+  }
+
+  std::string str() const
+  {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash_));
+    return buffer;
+  }
+
+private:
+  unsigned long long hash_;
+};
+
 // ******************************************************************************************
 // Static Prototypes
 // ******************************************************************************************
@@ -154,11 +220,13 @@ static unsigned int disableAlwaysInCollision(planning_scene::PlanningScene& scen
  * \param link_pairs List of all unique link pairs and each pair's properties
  * \param req A reference to a collision request that is already initialized
  * \param links_seen_colliding Set of links that have at some point been seen in collision
+ * \param convergence_trials Stop once this many consecutive trials found no new colliding pair, 0 to run all trials
  * \return number of never in collision links found and disabled
  */
 static unsigned int disableNeverInCollision(const unsigned int num_trials, planning_scene::PlanningScene& scene,
                                             LinkPairMap& link_pairs, const collision_detection::CollisionRequest& req,
-                                            StringPairSet& links_seen_colliding, unsigned int* progress);
+                                            StringPairSet& links_seen_colliding, unsigned int convergence_trials,
+                                            unsigned int* progress);
 
 /**
  * \brief Thread for getting the pairs of links that are never in collision
@@ -166,12 +234,38 @@ static unsigned int disableNeverInCollision(const unsigned int num_trials, plann
  */
 static void disableNeverInCollisionThread(ThreadComputation tc);
 
+/**
+ * \brief Keep the previous reason of the link pairs whose links did not change, and skip them in all later checks
+ * \param scene A reference to the robot in the planning scene
+ * \param link_pairs List of all unique link pairs and each pair's properties
+ * \param cache The results of the previous computation
+ * \param links_seen_colliding Set of links that have at some point been seen in collision
+ * \return number of link pairs whose reason was reused
+ */
+static unsigned int reuseCachedLinkPairs(planning_scene::PlanningScene& scene, LinkPairMap& link_pairs,
+                                         const DefaultCollisionsCache& cache, StringPairSet& links_seen_colliding);
+
+/**
+ * \brief Add the collision geometry of a link to a signature
+ * \param link The link to add
+ * \param hash The signature that is computed
+ */
+static void hashLinkGeometry(const robot_model::LinkModel* link, SignatureHash& hash);
+
+/**
+ * \brief Add the properties of a joint that change where its child link can be to a signature
+ * \param joint The joint to add
+ * \param hash The signature that is computed
+ */
+static void hashJoint(const robot_model::JointModel* joint, SignatureHash& hash);
+
 // ******************************************************************************************
 // Generates an adjacency list of links that are always and never in collision, to speed up collision detection
 // ******************************************************************************************
 LinkPairMap computeDefaultCollisions(const planning_scene::PlanningSceneConstPtr& parent_scene, unsigned int* progress,
                                      const bool include_never_colliding, const unsigned int num_trials,
-                                     const double min_collision_fraction, const bool verbose)
+                                     const double min_collision_fraction, const bool verbose,
+                                     const unsigned int convergence_trials, const DefaultCollisionsCache* cache)
 {
   // Create new instance of planning scene using pointer
   planning_scene::PlanningScenePtr scene = parent_scene->diff();
@@ -208,6 +302,12 @@ LinkPairMap computeDefaultCollisions(const planning_scene::PlanningSceneConstPtr
   *progress = 4;  // Progress bar feedback
   boost::this_thread::interruption_point();
 
+  // 2a. REUSE UNCHANGED LINK PAIRS ------------------------------------------------------------------
+  // The pairs whose links have the same geometry and kinematic chain as in the previous computation keep their reason
+  unsigned int num_reused = 0;
+  if (cache)
+    num_reused = reuseCachedLinkPairs(*scene, link_pairs, *cache, links_seen_colliding);
+
   // 3. INITIAL CONTACTS TO CONSIDER GUESS -----------------------------------------------------------
   // Create collision detection request object
   collision_detection::CollisionRequest req;
@@ -236,7 +336,8 @@ LinkPairMap computeDefaultCollisions(const planning_scene::PlanningSceneConstPtr
   unsigned int num_never = 0;
   if (include_never_colliding)  // option of function
   {
-    num_never = disableNeverInCollision(num_trials, *scene, link_pairs, req, links_seen_colliding, progress);
+    num_never = disableNeverInCollision(num_trials, *scene, link_pairs, req, links_seen_colliding, convergence_trials,
+                                        progress);
   }
 
   // ROS_INFO("Link pairs seen colliding ever: %d", int(links_seen_colliding.size()));
@@ -263,6 +364,7 @@ LinkPairMap computeDefaultCollisions(const planning_scene::PlanningSceneConstPtr
     ROS_INFO("%6d : %s", num_never, "Never in collision");
     ROS_INFO("%6d : %s", num_default, "Default in collision");
     ROS_INFO("%6d : %s", num_adjacent, "Adjacent links disabled");
+    ROS_INFO("%6d : %s", num_reused, "Reused from previous computation");
     ROS_INFO("%6d : %s", num_sometimes, "Sometimes in collision");
     ROS_INFO("%6d : %s", num_disabled, "TOTAL DISABLED");
 
@@ -550,20 +652,33 @@ unsigned int disableAlwaysInCollision(planning_scene::PlanningScene& scene, Link
 // ******************************************************************************************
 unsigned int disableNeverInCollision(const unsigned int num_trials, planning_scene::PlanningScene& scene,
                                      LinkPairMap& link_pairs, const collision_detection::CollisionRequest& req,
-                                     StringPairSet& links_seen_colliding, unsigned int* progress)
+                                     StringPairSet& links_seen_colliding, unsigned int convergence_trials,
+                                     unsigned int* progress)
 {
   unsigned int num_disabled = 0;
 
+  // Only the pairs that are neither disabled yet, nor already seen colliding, can turn out to be never colliding.
+  // Number them once, so each thread can record its findings in a plain flag vector instead of a locked set.
+  LinkPairIndex pair_index;
+  for (LinkPairMap::const_iterator pair_it = link_pairs.begin(); pair_it != link_pairs.end(); ++pair_it)
+    if (!pair_it->second.disable_check && links_seen_colliding.find(pair_it->first) == links_seen_colliding.end())
+      pair_index.insert(std::make_pair(pair_it->first, pair_index.size()));
+
   boost::thread_group bgroup;  // create a group of threads
-  boost::mutex lock;           // used for sharing the same data structures
 
   int num_threads = boost::thread::hardware_concurrency();  // how many cores does this computer have?
+  if (num_threads < 1)
+    num_threads = 1;
   // ROS_INFO_STREAM("Performing " << num_trials << " trials for 'always in collision' checking on " <<
   //   num_threads << " threads...");
 
+  std::vector<std::vector<char> > seen_colliding(num_threads, std::vector<char>(pair_index.size(), 0));
+  TrialStatistics statistics;
+
   for (int i = 0; i < num_threads; ++i)
   {
-    ThreadComputation tc(scene, req, i, num_trials / num_threads, &links_seen_colliding, &lock, progress);
+    ThreadComputation tc(scene, req, i, num_trials / num_threads, &pair_index, &seen_colliding[i], &statistics,
+                         convergence_trials, progress);
     bgroup.create_thread(boost::bind(&disableNeverInCollisionThread, tc));
   }
 
@@ -579,22 +694,31 @@ unsigned int disableNeverInCollision(const unsigned int num_trials, planning_sce
     throw;
   }
 
-  // Loop through every possible link pair and check if it has ever been seen in collision
-  for (LinkPairMap::iterator pair_it = link_pairs.begin(); pair_it != link_pairs.end(); ++pair_it)
+  if (convergence_trials > 0 && statistics.trials_done_ < num_trials / num_threads * num_threads)
+    ROS_INFO("Never colliding links converged after %u of %u trials", statistics.trials_done_.load(), num_trials);
+
+  // Merge the findings of all threads, then disable the pairs that no thread has ever seen colliding
+  collision_detection::AllowedCollisionMatrix& acm = scene.getAllowedCollisionMatrixNonConst();
+  for (LinkPairIndex::const_iterator index_it = pair_index.begin(); index_it != pair_index.end(); ++index_it)
   {
-    if (!pair_it->second.disable_check)  // is not disabled yet
+    bool seen = false;
+    for (int i = 0; i < num_threads && !seen; ++i)
+      seen = seen_colliding[i][index_it->second];
+
+    if (seen)
     {
-      // Check if current pair has been seen colliding ever. If it has never been seen colliding, add it to disabled
-      // list
-      if (links_seen_colliding.find(pair_it->first) == links_seen_colliding.end())
-      {
-        // Add to disabled list using pair ordering
-        pair_it->second.reason = NEVER;
-        pair_it->second.disable_check = true;
+      links_seen_colliding.insert(index_it->first);
+      acm.setEntry(index_it->first.first, index_it->first.second, true);  // disable link checking in the matrix
+    }
+    else
+    {
+      // Add to disabled list using pair ordering
+      LinkPairData& pair_data = link_pairs[index_it->first];
+      pair_data.reason = NEVER;
+      pair_data.disable_check = true;
 
-        // Count it
-        ++num_disabled;
-      }
+      // Count it
+      ++num_disabled;
     }
   }
   // ROS_INFO("Disabled %d link pairs that are never in collision", num_disabled);
@@ -610,11 +734,15 @@ void disableNeverInCollisionThread(ThreadComputation tc)
   // ROS_INFO_STREAM("Thread " << tc.thread_id_ << " running " << tc.num_trials_ << " trials");
 
   // User feedback vars
-  const unsigned int progress_interval = tc.num_trials_ / 20;  // show progress update every 5%
+  const unsigned int progress_interval = std::max(tc.num_trials_ / 20, 1u);  // show progress update every 5%
 
   // Create a new kinematic state for this thread to work on
   robot_state::RobotState kstate(tc.scene_.getRobotModel());
 
+  // Pairs found colliding by this thread are disabled in a private copy of the matrix, so later checks skip them
+  // and no thread ever writes to data another thread reads
+  collision_detection::AllowedCollisionMatrix acm = tc.scene_.getAllowedCollisionMatrix();
+
   // Do a large number of tests
   for (unsigned int i = 0; i < tc.num_trials_; ++i)
   {
@@ -628,27 +756,193 @@ void disableNeverInCollisionThread(ThreadComputation tc)
 
     collision_detection::CollisionResult res;
     kstate.setToRandomPositions();
-    tc.scene_.checkSelfCollision(tc.req_, res, kstate);
+    tc.scene_.checkSelfCollision(tc.req_, res, kstate, acm);
+
+    const unsigned int trial = ++tc.statistics_->trials_done_;
 
     // Check all contacts
+    bool discovered = false;
     for (collision_detection::CollisionResult::ContactMap::const_iterator it = res.contacts.begin();
          it != res.contacts.end(); ++it)
     {
-      // Check if this collision pair is unique before doing a thread lock
-      if (tc.links_seen_colliding_->find(it->first) == tc.links_seen_colliding_->end())
-      {
-        // Collision Matrix and links_seen_colliding is modified only if needed, based on above if statement
+      LinkPairIndex::const_iterator index_it = tc.pair_index_->find(it->first);
+      if (index_it == tc.pair_index_->end())
+        continue;
+      (*tc.seen_colliding_)[index_it->second] = 1;
+      acm.setEntry(it->first.first, it->first.second, true);  // disable link checking in the collision matrix
+      discovered = true;
+    }
+
+    if (discovered)
+      tc.statistics_->last_discovery_ = trial;
+    else if (tc.convergence_trials_ > 0)
+    {
+      // another thread may have stored a later discovery in the meantime
+      const unsigned int last_discovery = tc.statistics_->last_discovery_;
+      if (trial > last_discovery && trial - last_discovery >= tc.convergence_trials_)
+        break;  // the set of colliding pairs has converged
+    }
+  }
+}
+
+// ******************************************************************************************
+// Keep the previous reason of the link pairs whose links did not change
+// ******************************************************************************************
+unsigned int reuseCachedLinkPairs(planning_scene::PlanningScene& scene, LinkPairMap& link_pairs,
+                                  const DefaultCollisionsCache& cache, StringPairSet& links_seen_colliding)
+{
+  const LinkSignatureMap signatures = computeLinkSignatures(*scene.getRobotModel());
+  collision_detection::AllowedCollisionMatrix& acm = scene.getAllowedCollisionMatrixNonConst();
+
+  unsigned int num_reused = 0;
+  for (LinkPairMap::iterator pair_it = link_pairs.begin(); pair_it != link_pairs.end(); ++pair_it)
+  {
+    if (pair_it->second.disable_check)  // adjacent links are always computed again
+      continue;
+
+    // both links need to be unchanged
+    bool unchanged = true;
+    for (int i = 0; i < 2 && unchanged; ++i)
+    {
+      const std::string& link = i == 0 ? pair_it->first.first : pair_it->first.second;
+      LinkSignatureMap::const_iterator cached_it = cache.link_signatures.find(link);
+      unchanged = cached_it != cache.link_signatures.end() && cached_it->second == signatures.find(link)->second;
+    }
+    if (!unchanged)
+      continue;
+
+    LinkPairMap::const_iterator cached_pair_it = cache.link_pairs.find(pair_it->first);
+    DisabledReason reason = cached_pair_it == cache.link_pairs.end() || !cached_pair_it->second.disable_check ?
+                                NOT_DISABLED :
+                                cached_pair_it->second.reason;
+    if (reason == NOT_DISABLED)
+      links_seen_colliding.insert(pair_it->first);  // it is not a candidate for being never in collision anymore
+    else if (reason == NEVER || reason == DEFAULT || reason == ALWAYS)
+      setLinkPair(pair_it->first.first, pair_it->first.second, reason, link_pairs);
+    else  // the reason is not the result of sampling, or the links are not adjacent anymore
+      continue;
+
+    // the pair is decided, so it is skipped by the collision checks of the following steps
+    acm.setEntry(pair_it->first.first, pair_it->first.second, true);
+    ++num_reused;
+  }
+  ROS_INFO("Reused the previous results of %u of %u link pairs", num_reused, (unsigned int)link_pairs.size());
+
+  return num_reused;
+}
+
+// ******************************************************************************************
+// Compute the signatures of all links with collision geometry
+// ******************************************************************************************
+LinkSignatureMap computeLinkSignatures(const robot_model::RobotModel& robot_model)
+{
+  LinkSignatureMap signatures;
+  const std::vector<std::string>& names = robot_model.getLinkModelNamesWithCollisionGeometry();
+  for (std::size_t i = 0; i < names.size(); ++i)
+  {
+    const robot_model::LinkModel* link = robot_model.getLinkModel(names[i]);
 
-        boost::mutex::scoped_lock slock(*tc.lock_);
-        tc.links_seen_colliding_->insert(it->first);
+    SignatureHash hash;
+    hashLinkGeometry(link, hash);
 
-        tc.scene_.getAllowedCollisionMatrixNonConst().setEntry(it->first.first, it->first.second,
-                                                               true);  // disable link checking in the collision matrix
+    // the joints from the link up to the root determine where the link can be
+    for (const robot_model::LinkModel* chain_link = link; chain_link; chain_link = chain_link->getParentLinkModel())
+    {
+      hash.add(chain_link->getJointOriginTransform());
+      if (chain_link->getParentJointModel())
+        hashJoint(chain_link->getParentJointModel(), hash);
+    }
+
+    signatures[names[i]] = hash.str();
+  }
+
+  return signatures;
+}
+
+// ******************************************************************************************
+// Add the collision geometry of a link to a signature
+// ******************************************************************************************
+void hashLinkGeometry(const robot_model::LinkModel* link, SignatureHash& hash)
+{
+  const std::vector<shapes::ShapeConstPtr>& shapes = link->getShapes();
+  hash.add(shapes.size());
+  for (std::size_t i = 0; i < shapes.size(); ++i)
+  {
+    hash.add(link->getCollisionOriginTransforms()[i]);
+
+    const shapes::Shape* shape = shapes[i].get();
+    hash.add(shape->type);
+    switch (shape->type)
+    {
+      case shapes::SPHERE:
+        hash.add(static_cast<const shapes::Sphere*>(shape)->radius);
+        break;
+      case shapes::CYLINDER:
+        hash.add(static_cast<const shapes::Cylinder*>(shape)->radius);
+        hash.add(static_cast<const shapes::Cylinder*>(shape)->length);
+        break;
+      case shapes::CONE:
+        hash.add(static_cast<const shapes::Cone*>(shape)->radius);
+        hash.add(static_cast<const shapes::Cone*>(shape)->length);
+        break;
+      case shapes::BOX:
+        hash.add(static_cast<const shapes::Box*>(shape)->size, 3 * sizeof(double));
+        break;
+      case shapes::PLANE:
+      {
+        const shapes::Plane* plane = static_cast<const shapes::Plane*>(shape);
+        hash.add(plane->a);
+        hash.add(plane->b);
+        hash.add(plane->c);
+        hash.add(plane->d);
+        break;
+      }
+      case shapes::MESH:
+      {
+        const shapes::Mesh* mesh = static_cast<const shapes::Mesh*>(shape);
+        hash.add(mesh->vertex_count);
+        hash.add(mesh->vertices, 3 * mesh->vertex_count * sizeof(double));
+        hash.add(mesh->triangle_count);
+        hash.add(mesh->triangles, 3 * mesh->triangle_count * sizeof(unsigned int));
+        break;
       }
+      default:  // e.g. octrees, which are not hashed; such a link changes on every computation
+        hash.add(shape);
+        break;
     }
   }
 }
 
+// ******************************************************************************************
+// Add the properties of a joint that change where its child link can be to a signature
+// ******************************************************************************************
+void hashJoint(const robot_model::JointModel* joint, SignatureHash& hash)
+{
+  hash.add(joint->getType());
+  if (joint->getType() == robot_model::JointModel::REVOLUTE)
+    hash.add(static_cast<const robot_model::RevoluteJointModel*>(joint)->getAxis());
+  else if (joint->getType() == robot_model::JointModel::PRISMATIC)
+    hash.add(static_cast<const robot_model::PrismaticJointModel*>(joint)->getAxis());
+
+  // a mimic joint moves within the bounds of the joint it follows
+  const robot_model::JointModel* source = joint;
+  if (joint->getMimic())
+  {
+    source = joint->getMimic();
+    hash.add(source->getName());
+    hash.add(joint->getMimicFactor());
+    hash.add(joint->getMimicOffset());
+  }
+
+  const robot_model::JointModel::Bounds& bounds = source->getVariableBounds();
+  for (std::size_t i = 0; i < bounds.size(); ++i)
+  {
+    hash.add(bounds[i].position_bounded_);
+    hash.add(bounds[i].min_position_);
+    hash.add(bounds[i].max_position_);
+  }
+}
+
 // ******************************************************************************************
 // Converts a reason for disabling a link pair into a string
 // ******************************************************************************************
@@ -198,6 +198,34 @@ bool MoveItConfigData::outputSetupAssistantFile(const std::string& file_path)
   return true;  // file created successfully
 }
 
+// ******************************************************************************************
+// Output link signatures of the disabled collisions
+// ******************************************************************************************
+bool MoveItConfigData::outputLinkSignaturesYAML(const std::string& file_path)
+{
+  YAML::Emitter emitter;
+  emitter << YAML::Comment("Signatures of the links the disabled collisions of the SRDF were computed for");
+  emitter << YAML::BeginMap;
+  emitter << YAML::Key << "link_signatures" << YAML::Value << YAML::BeginMap;
+  for (moveit_setup_assistant::LinkSignatureMap::const_iterator signature_it = link_signatures_.begin();
+       signature_it != link_signatures_.end(); ++signature_it)
+    emitter << YAML::Key << signature_it->first << YAML::Value << signature_it->second;
+  emitter << YAML::EndMap;
+  emitter << YAML::EndMap;
+
+  std::ofstream output_stream(file_path.c_str(), std::ios_base::trunc);
+  if (!output_stream.good())
+  {
+    ROS_ERROR_STREAM("Unable to open file for writing " << file_path);
+    return false;
+  }
+
+  output_stream << emitter.c_str();
+  output_stream.close();
+
+  return true;  // file created successfully
+}
+
 // ******************************************************************************************
 // Output OMPL Planning config files
 // ******************************************************************************************
@@ -1160,6 +1188,30 @@ void MoveItConfigData::setCollisionLinkPairs(const moveit_setup_assistant::LinkP
   srdf_->disabled_collisions_.assign(disabled_collisions.begin(), disabled_collisions.end());
 }
 
+// ******************************************************************************************
+// Get the disabled collisions of the SRDF together with the link signatures they were computed for
+// ******************************************************************************************
+bool MoveItConfigData::getDefaultCollisionsCache(moveit_setup_assistant::DefaultCollisionsCache& cache) const
+{
+  cache.link_signatures = link_signatures_;
+  cache.link_pairs.clear();
+  if (link_signatures_.empty())
+    return false;
+
+  for (std::vector<srdf::Model::DisabledCollision>::const_iterator collision_it = srdf_->disabled_collisions_.begin();
+       collision_it != srdf_->disabled_collisions_.end(); ++collision_it)
+  {
+    std::pair<std::string, std::string> link_pair(collision_it->link1_, collision_it->link2_);
+    if (link_pair.first >= link_pair.second)
+      std::swap(link_pair.first, link_pair.second);
+
+    moveit_setup_assistant::LinkPairData& link_pair_data = cache.link_pairs[link_pair];
+    link_pair_data.reason = moveit_setup_assistant::disabledReasonFromString(collision_it->reason_);
+    link_pair_data.disable_check = true;
+  }
+  return true;
+}
+
 // ******************************************************************************************
 // Decide the best two joints to be used for the projection evaluator
 // ******************************************************************************************
@@ -1203,6 +1255,38 @@ bool parse(const YAML::Node& node, const std::string& key, T& storage, const T&
   return valid;
 }
 
+// ******************************************************************************************
+// Input link_signatures.yaml file
+// ******************************************************************************************
+bool MoveItConfigData::inputLinkSignaturesYAML(const std::string& file_path)
+{
+  link_signatures_.clear();
+
+  // Load file
+  std::ifstream input_stream(file_path.c_str());
+  if (!input_stream.good())
+  {
+    ROS_ERROR_STREAM("Unable to open file for reading " << file_path);
+    return false;
+  }
+
+  // Begin parsing
+  try
+  {
+    YAML::Node doc = YAML::Load(input_stream);
+    if (const YAML::Node& signatures_node = doc["link_signatures"])
+      for (YAML::const_iterator signature_it = signatures_node.begin(); signature_it != signatures_node.end();
+           ++signature_it)
+        link_signatures_[signature_it->first.as<std::string>()] = signature_it->second.as<std::string>();
+  }
+  catch (YAML::ParserException& e)  // Catch errors
+  {
+    ROS_ERROR_STREAM(e.what());
+    return false;
+  }
+  return true;
+}
+
 bool MoveItConfigData::inputOMPLYAML(const std::string& file_path)
 {
   // Load file
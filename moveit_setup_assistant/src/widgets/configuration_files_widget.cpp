@@ -317,6 +317,16 @@ bool ConfigurationFilesWidget::loadGenFiles()
   file.write_on_changes = MoveItConfigData::SENSORS_CONFIG;
   gen_files_.push_back(file);
 
+  // link_signatures.yaml --------------------------------------------------------------------------------------
+  file.file_name_ = "link_signatures.yaml";
+  file.rel_path_ = config_data_->appendPaths(config_path, file.file_name_);
+  file.description_ = "Hashes of the collision geometry and kinematic chain of each link, for the disabled collisions "
+                      "in the SRDF. When the collision matrix is generated again, only link pairs involving changed "
+                      "links are sampled.";
+  file.gen_func_ = boost::bind(&MoveItConfigData::outputLinkSignaturesYAML, config_data_, _1);
+  file.write_on_changes = MoveItConfigData::COLLISIONS;
+  gen_files_.push_back(file);
+
   // -------------------------------------------------------------------------------------------------------------------
   // LAUNCH FILES ------------------------------------------------------------------------------------------------------
   // -------------------------------------------------------------------------------------------------------------------
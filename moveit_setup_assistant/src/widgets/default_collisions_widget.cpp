@@ -262,9 +262,16 @@ void DefaultCollisionsWidget::generateCollisionTable(unsigned int* collision_pro
   // clear previously loaded collision matrix entries
   config_data_->getPlanningScene()->getAllowedCollisionMatrixNonConst().clear();
 
+  // only the link pairs of links that changed since the current table was computed are sampled again
+  moveit_setup_assistant::DefaultCollisionsCache cache;
+  cache.link_signatures = link_signatures_;
+  cache.link_pairs = link_pairs_;
+
   // Find the default collision matrix - all links that are allowed to collide
   link_pairs_ = moveit_setup_assistant::computeDefaultCollisions(
-      config_data_->getPlanningScene(), collision_progress, include_never_colliding, num_trials, min_frac, verbose);
+      config_data_->getPlanningScene(), collision_progress, include_never_colliding, num_trials, min_frac, verbose, 0,
+      link_signatures_.empty() ? NULL : &cache);
+  link_signatures_ = moveit_setup_assistant::computeLinkSignatures(*config_data_->getRobotModel());
 
   // End the progress bar loop
   *collision_progress = 100;
@@ -681,6 +688,7 @@ void DefaultCollisionsWidget::linkPairsToSRDF()
       config_data_->srdf_->disabled_collisions_.push_back(dc);
     }
   }
+  config_data_->link_signatures_ = link_signatures_;
 
   // Update collision_matrix for robot pose's use
   config_data_->loadAllowedCollisionMatrix();
@@ -693,6 +701,7 @@ void DefaultCollisionsWidget::linkPairsFromSRDF()
 {
   // Clear all the previous data in the compute_default_collisions tool
   link_pairs_.clear();
+  link_signatures_ = config_data_->link_signatures_;
 
   // Create new instance of planning scene using pointer
   planning_scene::PlanningScenePtr scene = config_data_->getPlanningScene()->diff();
@@ -197,6 +197,9 @@ private:
   /// main storage of link pair data
   moveit_setup_assistant::LinkPairMap link_pairs_;
 
+  /// signatures of the links link_pairs_ was computed for, empty if they are unknown
+  moveit_setup_assistant::LinkSignatureMap link_signatures_;
+
   /// Contains all the configuration data for the setup assistant
   moveit_setup_assistant::MoveItConfigDataPtr config_data_;
 
@@ -423,6 +423,12 @@ bool StartScreenWidget::loadExistingFiles()
   ompl_yaml_path /= "config/ompl_planning.yaml";
   config_data_->inputOMPLYAML(ompl_yaml_path.make_preferred().native().c_str());
 
+  // Load the signatures of the links the disabled collisions were computed for, packages might not have them yet
+  fs::path link_signatures_yaml_path = config_data_->config_pkg_path_;
+  link_signatures_yaml_path /= "config/link_signatures.yaml";
+  if (fs::is_regular_file(link_signatures_yaml_path))
+    config_data_->inputLinkSignaturesYAML(link_signatures_yaml_path.make_preferred().native().c_str());
+
   // DONE LOADING --------------------------------------------------------------------------
 
   // Call a function that enables navigation
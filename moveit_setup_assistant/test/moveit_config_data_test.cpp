@@ -149,6 +149,47 @@ TEST_F(MoveItConfigData, ReadingSensorsConfig)
             std::string("occupancy_map_monitor/DepthImageOctomapUpdater"));
 }
 
+// This tests writing/parsing of link_signatures.yaml and reusing the previous default collisions
+TEST_F(MoveItConfigData, ReusingDefaultCollisions)
+{
+  moveit_setup_assistant::MoveItConfigDataPtr config_data_;
+  config_data_.reset(new moveit_setup_assistant::MoveItConfigData());
+
+  // Signatures are the same for the same robot
+  moveit_setup_assistant::LinkSignatureMap signatures = moveit_setup_assistant::computeLinkSignatures(*robot_model);
+  EXPECT_EQ(signatures.size(), robot_model->getLinkModelNamesWithCollisionGeometry().size());
+  EXPECT_TRUE(signatures == moveit_setup_assistant::computeLinkSignatures(*robot_model));
+
+  // Temporary file used during the test and is deleted when the test is finished
+  char test_file[] = "/tmp/msa_unittest_link_signatures.yaml";
+
+  config_data_->link_signatures_ = signatures;
+  EXPECT_EQ(config_data_->outputLinkSignaturesYAML(test_file), true);
+  config_data_->link_signatures_.clear();
+  EXPECT_EQ(config_data_->inputLinkSignaturesYAML(test_file), true);
+  EXPECT_TRUE(config_data_->link_signatures_ == signatures);
+  boost::filesystem::remove(test_file);
+
+  // If no link changed, all sampled link pairs keep their reason
+  planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(robot_model));
+  unsigned int progress;
+  moveit_setup_assistant::DefaultCollisionsCache cache;
+  cache.link_signatures = signatures;
+  cache.link_pairs = moveit_setup_assistant::computeDefaultCollisions(scene, &progress, true, 1000, 0.95, false);
+
+  moveit_setup_assistant::LinkPairMap link_pairs =
+      moveit_setup_assistant::computeDefaultCollisions(scene, &progress, true, 1000, 0.95, false, 0, &cache);
+  ASSERT_EQ(link_pairs.size(), cache.link_pairs.size());
+  for (moveit_setup_assistant::LinkPairMap::const_iterator pair_it = link_pairs.begin(),
+                                                          cached_it = cache.link_pairs.begin();
+       pair_it != link_pairs.end(); ++pair_it, ++cached_it)
+  {
+    EXPECT_TRUE(pair_it->first == cached_it->first);
+    EXPECT_EQ(pair_it->second.reason, cached_it->second.reason);
+    EXPECT_EQ(pair_it->second.disable_check, cached_it->second.disable_check);
+  }
+}
+
 int main(int argc, char** argv)
 {
   testing::InitGoogleTest(&argc, argv);